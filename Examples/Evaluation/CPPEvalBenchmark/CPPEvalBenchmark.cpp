@@ -0,0 +1,353 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPPEvalBenchmark.cpp : Latency and throughput of a model through the extended evaluation interface
+//
+// Usage: cppevalbenchmark modelPath=<model> [option=value ...]
+//   batchSizes=1:8:32      sequences per ForwardPassBatch() call, each measured in turn
+//   threads=1:4            concurrent evaluators (clones of the first one), each measured in turn
+//   sequenceLength=1       frames per sequence
+//   iterations=100         timed calls per thread, after 'warmup' untimed ones
+//   warmup=10
+//   seed=1                 for the random inputs
+//   saveOutputs=<file>     instead of measuring, write the outputs of one call on the first batch size to <file>
+//   compareOutputs=<file>  instead of measuring, compare them against <file>, written by saveOutputs
+//   tolerance=1e-4         largest absolute difference that compareOutputs accepts (exit code 1 otherwise)
+// All other options are passed to CreateNetwork(), e.g. deviceId=0, outputNodeNames=..., quantizedTimesBits=12,
+// sparseTimesMinSparsity=0.8, fuseNodesForInference=true, so that such changes can be measured against the same baseline.
+// Only models with dense inputs are supported.
+//
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Eval.h"
+#ifdef _WIN32
+#include "Windows.h"
+#include "Psapi.h"
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace Microsoft::MSR::CNTK;
+
+typedef std::chrono::steady_clock Clock;
+
+// "1:8:32" -> { 1, 8, 32 }
+static std::vector<size_t> ParseList(const std::string& s)
+{
+    std::vector<size_t> values;
+    for (size_t begin = 0; begin <= s.size();)
+    {
+        size_t end = std::min(s.find(':', begin), s.size());
+        values.push_back(std::stoul(s.substr(begin, end - begin)));
+        begin = end + 1;
+    }
+    return values;
+}
+
+static std::vector<std::wstring> ParseNames(const std::string& s)
+{
+    std::vector<std::wstring> names;
+    for (size_t begin = 0; begin <= s.size();)
+    {
+        size_t end = std::min(s.find(':', begin), s.size());
+        std::string name = s.substr(begin, end - begin);
+        if (!name.empty())
+            names.push_back(std::wstring(name.begin(), name.end()));
+        begin = end + 1;
+    }
+    return names;
+}
+
+// peak resident set size of this process, in MB
+static double PeakResidentSetSize()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize / 1048576.0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_maxrss / 1024.0; // (kilobytes on Linux)
+#endif
+}
+
+//
+// The inputs and outputs of one ForwardPassBatch() call: 'batchSize' sequences of 'sequenceLength' frames each.
+//
+struct Batch
+{
+    std::vector<std::vector<float>> m_inputData;  // [s * numInputs + i]
+    std::vector<std::vector<float>> m_outputData; // [s * numOutputs + o]
+    std::vector<ValueRefs<float>> m_inputs;
+    std::vector<ValueRefs<float>> m_outputs;
+
+    Batch(const VariableSchema& inputSchema, const VariableSchema& outputSchema, size_t batchSize, size_t sequenceLength, unsigned int seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+        for (size_t s = 0; s < batchSize; s++)
+        {
+            for (const auto& input : inputSchema)
+            {
+                std::vector<float> data(input.m_numElements * sequenceLength);
+                for (auto& value : data)
+                    value = uniform(random);
+                m_inputData.push_back(std::move(data));
+            }
+            for (const auto& output : outputSchema)
+                m_outputData.push_back(std::vector<float>(output.m_numElements * sequenceLength));
+        }
+        m_inputs.resize(batchSize, ValueRefs<float>(inputSchema.size()));
+        m_outputs.resize(batchSize, ValueRefs<float>(outputSchema.size()));
+        for (size_t s = 0; s < batchSize; s++)
+        {
+            for (size_t i = 0; i < inputSchema.size(); i++)
+                m_inputs[s][i].m_buffer.InitFrom(m_inputData[s * inputSchema.size() + i]);
+            for (size_t o = 0; o < outputSchema.size(); o++)
+                m_outputs[s][o].m_buffer.InitFrom(m_outputData[s * outputSchema.size() + o]);
+        }
+    }
+
+    void Evaluate(IEvaluateModelExtended<float>* eval)
+    {
+        eval->ForwardPassBatch(m_inputs, m_outputs);
+    }
+};
+
+// latencies in milliseconds, sorted
+static double Percentile(const std::vector<double>& latencies, double p)
+{
+    return latencies.empty() ? 0 : latencies[std::min(latencies.size() - 1, (size_t) (p * latencies.size()))];
+}
+
+static void Measure(IEvaluateModelExtended<float>* eval, const VariableSchema& inputSchema, const VariableSchema& outputSchema,
+                    size_t numThreads, size_t batchSize, size_t sequenceLength, size_t numWarmup, size_t numIterations, unsigned int seed)
+{
+    // the first thread uses 'eval' itself
+    std::vector<IEvaluateModelExtended<float>*> evals(1, eval);
+    for (size_t k = 1; k < numThreads; k++)
+        evals.push_back(eval->Clone());
+    std::vector<std::vector<double>> latencies(numThreads);
+    std::vector<std::string> errors(numThreads);
+
+    auto run = [&](size_t k)
+    {
+        try
+        {
+            Batch batch(inputSchema, outputSchema, batchSize, sequenceLength, seed + (unsigned int) k);
+            for (size_t n = 0; n < numWarmup; n++)
+                batch.Evaluate(evals[k]);
+            for (size_t n = 0; n < numIterations; n++)
+            {
+                auto start = Clock::now();
+                batch.Evaluate(evals[k]);
+                latencies[k].push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+            }
+        }
+        catch (const std::exception& e)
+        {
+            errors[k] = e.what();
+        }
+    };
+
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (size_t k = 1; k < numThreads; k++)
+        threads.push_back(std::thread(run, k));
+    run(0);
+    for (auto& thread : threads)
+        thread.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (size_t k = 1; k < numThreads; k++)
+        evals[k]->Destroy();
+    for (const auto& error : errors)
+    {
+        if (!error.empty())
+            throw std::runtime_error(error);
+    }
+
+    // (the wall time includes the warmup)
+    std::vector<double> all;
+    for (const auto& threadLatencies : latencies)
+        all.insert(all.end(), threadLatencies.begin(), threadLatencies.end());
+    std::sort(all.begin(), all.end());
+    double numSamples = (double) numThreads * (numWarmup + numIterations) * batchSize * sequenceLength;
+    fprintf(stderr, "%8d %8d %12.3f %12.3f %12.3f %12.3f %14.1f\n", (int) numThreads, (int) batchSize,
+            Percentile(all, 0.5), Percentile(all, 0.99), Percentile(all, 0.999), all.empty() ? 0 : all.back(), numSamples / seconds);
+    fflush(stderr);
+}
+
+// saveOutputs/compareOutputs: the outputs of one call, as the number of values followed by the values, per output and sequence
+static bool SaveOrCompareOutputs(IEvaluateModelExtended<float>* eval, const VariableSchema& inputSchema, const VariableSchema& outputSchema,
+                                 size_t batchSize, size_t sequenceLength, unsigned int seed, const std::string& path, bool save, double tolerance)
+{
+    Batch batch(inputSchema, outputSchema, batchSize, sequenceLength, seed);
+    batch.Evaluate(eval);
+
+    FILE* f = fopen(path.c_str(), save ? "wb" : "rb");
+    if (!f)
+        throw std::runtime_error("Cannot open " + path);
+    std::vector<double> maxDifferences(outputSchema.size(), 0);
+    bool sameSizes = true;
+    for (size_t s = 0; s < batchSize; s++)
+    {
+        for (size_t o = 0; o < outputSchema.size(); o++)
+        {
+            const auto& output = batch.m_outputs[s][o].m_buffer;
+            unsigned long long size = output.size();
+            if (save)
+            {
+                fwrite(&size, sizeof(size), 1, f);
+                fwrite(output.data(), sizeof(float), output.size(), f);
+                continue;
+            }
+            unsigned long long baselineSize = 0;
+            if (fread(&baselineSize, sizeof(baselineSize), 1, f) != 1 || baselineSize != size)
+            {
+                sameSizes = false;
+                break;
+            }
+            std::vector<float> baseline(size);
+            if (fread(baseline.data(), sizeof(float), baseline.size(), f) != baseline.size())
+            {
+                sameSizes = false;
+                break;
+            }
+            for (size_t j = 0; j < baseline.size(); j++)
+                maxDifferences[o] = std::max(maxDifferences[o], (double) std::fabs(output[j] - baseline[j]));
+        }
+    }
+    bool failed = ferror(f) != 0;
+    fclose(f);
+    if (failed)
+        throw std::runtime_error("Error reading or writing " + path);
+
+    if (save)
+    {
+        fprintf(stderr, "Outputs of %d sequences written to %s.\n", (int) batchSize, path.c_str());
+        return true;
+    }
+    if (!sameSizes)
+    {
+        fprintf(stderr, "The outputs do not have the sizes of those in %s (other model, batch size or seed?).\n", path.c_str());
+        return false;
+    }
+    bool withinTolerance = true;
+    for (size_t o = 0; o < outputSchema.size(); o++)
+    {
+        fprintf(stderr, "%ls: largest absolute difference %g\n", outputSchema[o].m_name.c_str(), maxDifferences[o]);
+        withinTolerance &= maxDifferences[o] <= tolerance;
+    }
+    fprintf(stderr, withinTolerance ? "Within tolerance %g.\n" : "Tolerance %g exceeded.\n", tolerance);
+    return withinTolerance;
+}
+
+int main(int argc, char* argv[])
+{
+    std::map<std::string, std::string> options = {
+        { "batchSizes", "1:8:32" }, { "threads", "1" }, { "sequenceLength", "1" }, { "iterations", "100" }, { "warmup", "10" },
+        { "seed", "1" }, { "saveOutputs", "" }, { "compareOutputs", "" }, { "tolerance", "1e-4" }
+    };
+    std::string networkConfiguration;
+    std::string outputNodeNames;
+    bool hasModelPath = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        size_t pos = arg.find('=');
+        if (pos == std::string::npos)
+        {
+            fprintf(stderr, "Error: Arguments must be of the form option=value, not '%s'.\n", arg.c_str());
+            return 2;
+        }
+        std::string name = arg.substr(0, pos);
+        if (options.find(name) != options.end())
+            options[name] = arg.substr(pos + 1);
+        else // for CreateNetwork()
+        {
+            networkConfiguration += arg + "\n";
+            hasModelPath |= name == "modelPath";
+            if (name == "outputNodeNames")
+                outputNodeNames = arg.substr(pos + 1);
+        }
+    }
+    if (!hasModelPath)
+    {
+        fprintf(stderr, "Usage: %s modelPath=<model> [batchSizes=1:8:32] [threads=1] [sequenceLength=1] [iterations=100] [warmup=10] [seed=1]\n"
+                        "       [saveOutputs=<file> | compareOutputs=<file> [tolerance=1e-4]] [<CreateNetwork() option>=<value> ...]\n", argv[0]);
+        return 2;
+    }
+
+    IEvaluateModelExtended<float>* eval = nullptr;
+    try
+    {
+        auto batchSizes = ParseList(options["batchSizes"]);
+        auto threadCounts = ParseList(options["threads"]);
+        size_t sequenceLength = std::stoul(options["sequenceLength"]);
+        size_t numIterations = std::stoul(options["iterations"]);
+        size_t numWarmup = std::stoul(options["warmup"]);
+        unsigned int seed = (unsigned int) std::stoul(options["seed"]);
+        if (batchSizes.empty() || threadCounts.empty() || sequenceLength == 0)
+            throw std::invalid_argument("batchSizes, threads and sequenceLength must not be 0.");
+
+        auto start = Clock::now();
+        GetEvalExtendedF(&eval);
+        eval->CreateNetwork(networkConfiguration);
+        std::vector<std::wstring> outputs = ParseNames(outputNodeNames);
+        if (outputs.empty())
+        {
+            for (const auto& output : eval->GetOutputSchema())
+                outputs.push_back(output.m_name);
+        }
+        eval->StartForwardEvaluation(outputs);
+        VariableSchema inputSchema = eval->GetInputSchema();
+        VariableSchema outputSchema = eval->GetOutputSchema();
+        for (const auto& input : inputSchema)
+        {
+            if (input.m_storageType == VariableLayout::Sparse)
+                throw std::invalid_argument("Only models with dense inputs are supported.");
+        }
+        fprintf(stderr, "Model loaded in %.1f ms: %d inputs, %d outputs.\n",
+                std::chrono::duration<double, std::milli>(Clock::now() - start).count(), (int) inputSchema.size(), (int) outputSchema.size());
+
+        int exitCode = 0;
+        if (!options["saveOutputs"].empty())
+            SaveOrCompareOutputs(eval, inputSchema, outputSchema, batchSizes[0], sequenceLength, seed, options["saveOutputs"], /*save=*/true, 0);
+        else if (!options["compareOutputs"].empty())
+            exitCode = SaveOrCompareOutputs(eval, inputSchema, outputSchema, batchSizes[0], sequenceLength, seed, options["compareOutputs"],
+                                            /*save=*/false, std::stod(options["tolerance"])) ? 0 : 1;
+        else
+        {
+            fprintf(stderr, "%8s %8s %12s %12s %12s %12s %14s\n", "threads", "batch", "p50 [ms]", "p99 [ms]", "p999 [ms]", "max [ms]", "samples/s");
+            for (size_t numThreads : threadCounts)
+                for (size_t batchSize : batchSizes)
+                    Measure(eval, inputSchema, outputSchema, std::max(numThreads, (size_t) 1), batchSize, sequenceLength, numWarmup, numIterations, seed);
+        }
+
+        // GPU memory is not visible through the evaluation interface; see nvidia-smi for deviceId >= 0
+        fprintf(stderr, "Peak resident set size: %.1f MB\n", PeakResidentSetSize());
+        eval->Destroy();
+        return exitCode;
+    }
+    catch (const std::exception& e)
+    {
+        fprintf(stderr, "Error: %s\n", e.what());
+        if (eval)
+            eval->Destroy();
+        return 2;
+    }
+}
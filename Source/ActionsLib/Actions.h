@@ -30,6 +30,10 @@ bool TryGetNetworkFactory(const ConfigRecordType& config, function<ComputationNe
 template <class ConfigRecordType, typename ElemType>
 function<ComputationNetworkPtr(DEVICEID_TYPE)> GetNetworkFactory(const ConfigRecordType& config);
 
+// applies the 'nodeDevices' option, see ComputationNetwork::SetNodeDevices(); returns false if it is not given
+template <class ConfigRecordType>
+bool SetNodeDevicesFromConfig(const ConfigRecordType& config, const ComputationNetworkPtr& net);
+
 template <class ConfigRecordType, typename ElemType>
 ComputationNetworkPtr GetModelFromConfig(const ConfigRecordType& config, const std::wstring& outputNodeNameConfig, std::vector<std::wstring>& outputNodeNamesVector);
 
@@ -62,6 +66,10 @@ template <typename ElemType>
 void DoWriteWordAndClassInfo(const ConfigParameters& config);
 template <typename ElemType>
 void DoTopologyPlot(const ConfigParameters& config);
+template <typename ElemType>
+void DoConvertToBinaryChunks(const ConfigParameters& config);
+template <typename ElemType>
+void DoBenchmarkReader(const ConfigParameters& config);
 
 // special purpose (SpecialPurposeActions.cpp)
 template <typename ElemType>
@@ -319,6 +319,8 @@ void DoWriteOutput(const ConfigParameters& config)
         wstring outputPath = config(L"outputPath");
         WriteFormattingOptions formattingOptions(config);
         bool nodeUnitTest = config(L"nodeUnitTest", "false");
+        writer.SetAsyncWrite(config(L"asyncWrite", false));
+        writer.SetBinaryOutput(config(L"binaryOutput", false));
         writer.WriteOutput(testDataReader, mbSize[0], outputPath, outputNodeNamesVector, formattingOptions, epochSize, nodeUnitTest);
     }
     else
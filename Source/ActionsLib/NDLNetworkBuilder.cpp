@@ -232,6 +232,24 @@ void NDLNodeEvaluatorImpl<ElemType>::Evaluate(NDLNode<ElemType>* node, const wst
             nodePtr = builder.RowRepeat(NULL, num_repeat, name);
         }
     }
+    else if (cnNodeType == OperationNameOf(ContextWindowNode))
+    {
+        if (parameter.size() != 3)
+            RuntimeError("ContextWindow should have three parameters. Usage: ContextWindow(origNodeName, leftContext, rightContext).");
+
+        nodeParamCount = 1;
+        nodeParamStart = 0;
+
+        if (pass == ndlPassInitial)
+        {
+            // evaluate only scalar parameters
+            vector<void*> params = EvaluateParameters(node, baseName, 0, parameter.size(), pass);
+            size_t leftContext = ((NDLNode<ElemType>*) params[1])->GetScalar();
+            size_t rightContext = ((NDLNode<ElemType>*) params[2])->GetScalar();
+
+            nodePtr = builder.ContextWindow(NULL, leftContext, rightContext, name);
+        }
+    }
     else if (cnNodeType == OperationNameOf(DiagonalNode))
     {
         if (parameter.size() != 1)
@@ -169,11 +169,13 @@ bool CheckFunction(std::string& p_nodeType, bool* allowUndeterminedVariable)
     else if (EqualInsensitive(nodeType, OperationNameOf(ClipNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(ConvolutionNode), L"Convolve")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(PoolingNode))) ret = true;
+    else if (EqualInsensitive(nodeType, OperationNameOf(ContextWindowNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(CosDistanceNode), L"CosDist")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(CosDistanceWithNegativeSamplesNode), L"CosWithNegSamples")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(CosineNode), L"Cos")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(CrossEntropyNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(CrossEntropyWithSoftmaxNode), L"CEWithSM")) ret = true;
+    else if (EqualInsensitive(nodeType, OperationNameOf(CTCWithSoftmaxNode), L"CTC")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(DiagTimesNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(DiagonalNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(DropoutNode))) ret = true;
@@ -12,6 +12,7 @@
 #include "ScriptableObjects.h"
 #include "BrainScriptEvaluator.h"
 #include "BrainScriptParser.h"
+#include "TimerUtility.h"
 
 function<ComputationNetworkPtr(DEVICEID_TYPE)> GetCreateNetworkFn(const ScriptableObjects::IConfigRecord& config)
 {
@@ -96,18 +97,28 @@ bool TryGetNetworkFactory(const ConfigRecordType& config, function<ComputationNe
             L"precision = '%ls'\n"        // 'float' or 'double'
             L"network = %ls",             // source code of expression that evaluates to a ComputationNetwork
             (int)deviceId, traceLevel, ElemTypeName<ElemType>(), sourceOfNetwork.c_str());
+        Timer timer;
+        timer.Start();
         let expr = BS::ParseConfigDictFromString(sourceOfBS, L"BrainScriptNetworkBuilder", move(includePaths));
+        timer.Stop();
+        if (traceLevel > 0)
+            fprintf(stderr, "BrainScriptNetworkBuilder: Parsed the network description in %.3f seconds.\n", timer.ElapsedSeconds());
 
         // the rest is done in a lambda that is only evaluated when a virgin network is needed
         // Note that evaluating the BrainScript *is* instantiating the network, so the evaluate call must be inside the lambda.
-        createNetworkFn = [expr](DEVICEID_TYPE /*deviceId*/)
+        createNetworkFn = [expr, traceLevel](DEVICEID_TYPE /*deviceId*/)
         {
             // evaluate the parse tree, particularly the top-level field 'network'
             // Evaluating it will create the network.
+            Timer timer;
+            timer.Start();
             let object = EvaluateField(expr, L"network");                   // this comes back as a BS::Object
             let network = dynamic_pointer_cast<ComputationNetwork>(object); // cast it
             if (!network)
                 LogicError("BuildNetworkFromDescription: ComputationNetwork not what it was meant to be");
+            timer.Stop();
+            if (traceLevel > 0)
+                fprintf(stderr, "BrainScriptNetworkBuilder: Created the network in %.3f seconds.\n", timer.ElapsedSeconds());
             return network;
         };
         return true;
@@ -147,12 +158,37 @@ static void PatchOutputNodes(const ComputationNetworkPtr& net, const ConfigArray
     }
 }
 
+// 'nodeDevices' is an array of "nodeName@deviceId", e.g. ("OutputLayer.W@1" : "OutputLayer.z@1"), where the name may
+// contain a '*' wildcard and deviceId -1 is the CPU. The network must be compiled after this.
+template <class ConfigRecordType>
+bool SetNodeDevicesFromConfig(const ConfigRecordType& config, const ComputationNetworkPtr& net)
+{
+    vector<wstring> nodeDeviceStrings = config(L"nodeDevices", ConfigRecordType::Array(stringargvector()));
+    vector<pair<wstring, DEVICEID_TYPE>> nodeDevices;
+    for (let& nodeDevice : nodeDeviceStrings)
+    {
+        let pos = nodeDevice.find_last_of(L'@');
+        if (pos == wstring::npos || pos == 0 || pos + 1 == nodeDevice.size())
+            InvalidArgument("nodeDevices: '%ls' is not of the form nodeName@deviceId.", nodeDevice.c_str());
+        nodeDevices.push_back(make_pair(nodeDevice.substr(0, pos), (DEVICEID_TYPE) stoi(nodeDevice.substr(pos + 1))));
+    }
+    if (nodeDevices.empty())
+        return false;
+    net->SetNodeDevices(nodeDevices);
+    return true;
+}
+
 template <class ConfigRecordType, typename ElemType>
 ComputationNetworkPtr GetModelFromConfig(const ConfigRecordType& config, const wstring& outputNodeNamesConfig, vector<wstring>& outputNodeNamesVector)
 {
     DEVICEID_TYPE deviceId = DeviceFromConfig(config);
 
     ConfigArray outputNodeNames = config(outputNodeNamesConfig.c_str(), ConfigArray(""));
+    // the callers only evaluate the network, so they may fold and fuse nodes (FusedTimesPlusNode)
+    bool foldNodesForInference = config(L"foldNodesForInference", false);
+    bool fuseNodesForInference = config(L"fuseNodesForInference", false);
+    bool fuseElementwiseNodes = config(L"fuseElementwiseNodes", false);
+    bool splitRecurrentProducts = config(L"splitRecurrentProducts", false);
 
     ComputationNetworkPtr net;
 
@@ -163,10 +199,16 @@ ComputationNetworkPtr GetModelFromConfig(const ConfigRecordType& config, const w
     {
         // We have several ways to create a network.
         net = createNetworkFn(deviceId);
-        if (outputNodeNames.size() > 0)
+        bool placeNodes = SetNodeDevicesFromConfig(config, net);
+        if (outputNodeNames.size() > 0 || foldNodesForInference || fuseNodesForInference || fuseElementwiseNodes || splitRecurrentProducts || placeNodes)
         {
             net->InvalidateCompiledNetwork();
-            PatchOutputNodes(net, outputNodeNames, outputNodeNamesVector);
+            if (outputNodeNames.size() > 0)
+                PatchOutputNodes(net, outputNodeNames, outputNodeNamesVector);
+            net->SetFoldNodesForInference(foldNodesForInference);
+            net->SetFuseNodesForInference(fuseNodesForInference);
+            net->SetFuseElementwiseNodes(fuseElementwiseNodes);
+            net->SetSplitRecurrentProducts(splitRecurrentProducts);
             net->CompileNetwork();
             // BUGBUG: This will generate double Validation output in the log
         }
@@ -179,12 +221,24 @@ ComputationNetworkPtr GetModelFromConfig(const ConfigRecordType& config, const w
         // By not compiling the network before patching, we avoid double log output for validation.
         net = make_shared<ComputationNetwork>(deviceId);
         net->SetTraceLevel(config(L"traceLevel", 0));
+        // let the large parameters of a CPU model be views of the model file
+        net->SetMemoryMapParameters(config(L"memoryMapModel", false));
         net->Read<ElemType>(modelPath);
         if (outputNodeNames.size() > 0)
             PatchOutputNodes(net, outputNodeNames, outputNodeNamesVector);
+        net->SetFoldNodesForInference(foldNodesForInference);
+        net->SetFuseNodesForInference(fuseNodesForInference);
+        net->SetFuseElementwiseNodes(fuseElementwiseNodes);
+        net->SetSplitRecurrentProducts(splitRecurrentProducts);
+        SetNodeDevicesFromConfig(config, net);
         net->CompileNetwork();
     }
 
+    // evaluate independent branches concurrently (CPU only)
+    net->SetConcurrentBranches(config(L"concurrentBranches", false));
+    // compute elementwise nodes in place of their inputs where possible
+    net->SetInPlaceComputation(config(L"inPlaceComputation", false));
+
     return net;
 }
 
@@ -194,3 +248,5 @@ template function<ComputationNetworkPtr(DEVICEID_TYPE)> GetNetworkFactory<Config
 template function<ComputationNetworkPtr(DEVICEID_TYPE)> GetNetworkFactory<ConfigParameters, double>(const ConfigParameters& config);
 template ComputationNetworkPtr GetModelFromConfig<ConfigParameters, float> (const ConfigParameters& config, const wstring&, vector<wstring>& outputNodeNamesVector);
 template ComputationNetworkPtr GetModelFromConfig<ConfigParameters, double>(const ConfigParameters& config, const wstring&, vector<wstring>& outputNodeNamesVector);
+template bool SetNodeDevicesFromConfig<ScriptableObjects::IConfigRecord>(const ScriptableObjects::IConfigRecord& config, const ComputationNetworkPtr& net);
+template bool SetNodeDevicesFromConfig<ConfigParameters>(const ConfigParameters& config, const ComputationNetworkPtr& net);
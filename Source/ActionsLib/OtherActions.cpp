@@ -16,6 +16,14 @@
 #include "Config.h"
 #include "ScriptableObjects.h"
 #include "BrainScriptEvaluator.h"
+#include "StringUtil.h"
+#include "CorpusDescriptor.h"
+#include "Bundler.h"
+#include "BinaryChunkWriter.h"
+#include "ReaderStatistics.h"
+#include "TimerUtility.h"
+#include "BestGpu.h"
+#include "MatrixQuantizerImpl.h" // for MatrixComputeStreamEvent
 
 #include <string>
 #include <chrono>
@@ -559,3 +567,158 @@ void DoTopologyPlot(const ConfigParameters& config)
 
 template void DoTopologyPlot<float>(const ConfigParameters& config);
 template void DoTopologyPlot<double>(const ConfigParameters& config);
+
+// ===========================================================================
+// DoConvertToBinaryChunks() - implements CNTK "convertToBinaryChunks" command
+// Writes all sequences of the deserializers of a reader into a file of the binary chunk format,
+// so that the parsing of the original data is paid for once, and trainings read the file with the BinaryChunkDeserializer.
+//   convert = [
+//       action = "convertToBinaryChunks"
+//       outputFile = "train.bin"
+//       chunkSizeInBytes = 33554432  # size of the uncompressed chunks
+//       compression = "none"         # or "lz4", if CNTK was built with it
+//       reader = [ deserializers = ( [ type = "CNTKTextFormatDeserializer" ; module = "CNTKTextFormatReader" ; ... ] ) ]
+//   ]
+// Transforms are not applied, as they are usually randomized per epoch.
+// ===========================================================================
+
+template <typename ElemType>
+void DoConvertToBinaryChunks(const ConfigParameters& config)
+{
+    wstring outputFile = config(L"outputFile");
+    size_t chunkSizeInBytes = config(L"chunkSizeInBytes", (size_t)32 * 1024 * 1024);
+    string compressionName = config(L"compression", "none");
+    int traceLevel = config(L"traceLevel", 0);
+
+    BinaryChunkFormat::Compression compression;
+    if (AreEqualIgnoreCase(compressionName, "none"))
+        compression = BinaryChunkFormat::Compression::none;
+    else if (AreEqualIgnoreCase(compressionName, "lz4"))
+        compression = BinaryChunkFormat::Compression::lz4;
+    else
+        InvalidArgument("convertToBinaryChunks: Unknown compression '%s', expected 'none' or 'lz4'.", compressionName.c_str());
+    if (!BinaryChunkFormat::IsCompressionSupported(compression))
+        InvalidArgument("convertToBinaryChunks: CNTK was built without support for compression '%s'.", compressionName.c_str());
+
+    // The deserializers are created the same way the CompositeDataReader does.
+    typedef bool (*CreateDeserializerFactory)(IDataDeserializer** d, const std::wstring& type, const ConfigParameters& cfg, CorpusDescriptorPtr corpus, bool primary);
+    ConfigParameters readerConfig(config(L"reader"));
+    argvector<ConfigValue> deserializerConfigs =
+        readerConfig(L"deserializers", ConfigParameters::Array(argvector<ConfigValue>(vector<ConfigValue>{})));
+    if (deserializerConfigs.empty())
+        InvalidArgument("convertToBinaryChunks: Could not find deserializers in the reader config.");
+
+    Plugin plugin;
+    auto corpus = make_shared<CorpusDescriptor>();
+    vector<IDataDeserializerPtr> deserializers;
+    for (size_t i = 0; i < deserializerConfigs.size(); ++i)
+    {
+        ConfigParameters p = deserializerConfigs[i];
+        p.Insert("frameMode", "false");
+        p.Insert("precision", sizeof(ElemType) == sizeof(double) ? "double" : "float");
+
+        std::string module = p("module");
+        std::wstring type = p("type");
+        CreateDeserializerFactory f = (CreateDeserializerFactory)plugin.Load(module, "CreateDeserializer");
+        IDataDeserializer* d;
+        if (!f(&d, type, p, corpus, i == 0))
+            RuntimeError("convertToBinaryChunks: Cannot create deserializer. Please check module and type in the configuration.");
+        deserializers.push_back(IDataDeserializerPtr(d));
+    }
+
+    IDataDeserializerPtr deserializer = deserializers.front();
+    if (deserializers.size() > 1)
+        deserializer = make_shared<Bundler>(readerConfig, deserializer, deserializers, (bool)readerConfig(L"checkData", true));
+
+    auto start = std::chrono::system_clock::now();
+    BinaryChunkWriter writer(outputFile, deserializer->GetStreamDescriptions(), chunkSizeInBytes, compression);
+    writer.AddSequences(*deserializer, [&corpus](const KeyType& key) { return corpus->GetStringRegistry()[(size_t)key.m_sequence]; }, traceLevel);
+    writer.Close();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start);
+
+    fprintf(stderr, "convertToBinaryChunks: Wrote %d sequences in %d chunks to '%ls' in %.1f seconds.\n",
+            (int)writer.NumberOfSequences(), (int)writer.NumberOfChunks(), outputFile.c_str(), elapsed.count() / 1000.0);
+}
+
+template void DoConvertToBinaryChunks<float>(const ConfigParameters& config);
+template void DoConvertToBinaryChunks<double>(const ConfigParameters& config);
+
+// ===========================================================================
+// DoBenchmarkReader() - implements CNTK "benchmarkReader" command
+// Reads minibatches with a reader the way training does, but without a network, and reports where the time goes:
+// samples/s, MB/s, the time of each stage of the reader, and how many prefetched minibatches were ready when
+// the next one was requested.
+//   benchmark = [
+//       action = "benchmarkReader"
+//       inputs = "features:labels"   # the streams to read, as named in the reader config
+//       sparseInputs = "labels"      # those of them that are read as sparse matrices
+//       minibatchSize = 256
+//       epochSize = 0                # 0 for the whole data
+//       maxEpochs = 1
+//       deviceId = -1                # to include the copies to a GPU
+//       reader = [ ... ]
+//   ]
+// Only readers that collect statistics (the ones based on the reader library) report the stages.
+// ===========================================================================
+
+template <typename ElemType>
+void DoBenchmarkReader(const ConfigParameters& config)
+{
+    DEVICEID_TYPE deviceId = DeviceFromConfig(config);
+    ConfigParameters readerConfig(config(L"reader"));
+    readerConfig.Insert("traceLevel", config(L"traceLevel", "0"));
+    size_t minibatchSize = config(L"minibatchSize", (size_t)256);
+    size_t epochSize = config(L"epochSize", (size_t)0);
+    if (epochSize == 0)
+        epochSize = requestDataSize;
+    size_t maxEpochs = config(L"maxEpochs", (size_t)1);
+
+    ConfigArray inputNames = config(L"inputs");
+    ConfigArray sparseInputNames = config(L"sparseInputs", "");
+    std::set<std::wstring> sparseInputs;
+    for (size_t i = 0; i < sparseInputNames.size(); ++i)
+        sparseInputs.insert(sparseInputNames[i]);
+    if (inputNames.empty())
+        InvalidArgument("benchmarkReader: No inputs specified.");
+
+    // Every input gets a layout of its own, as there is no network to tell which of them share a dynamic axis.
+    StreamMinibatchInputs matrices;
+    for (size_t i = 0; i < inputNames.size(); ++i)
+    {
+        std::wstring name = inputNames[i];
+        bool isSparse = sparseInputs.find(name) != sparseInputs.end();
+        auto matrix = isSparse ? make_shared<Matrix<ElemType>>(0, 0, deviceId, SPARSE, matrixFormatSparseCSC) : make_shared<Matrix<ElemType>>(deviceId);
+        matrices.AddInput(name, matrix, make_shared<MBLayout>(), TensorShape());
+    }
+
+    DataReader dataReader(readerConfig);
+    for (size_t epoch = 0; epoch < maxEpochs; ++epoch)
+    {
+        ReaderStatistics statistics;
+        dataReader.GetAndResetStatistics(statistics); // only this epoch
+
+        Timer timer;
+        timer.Start();
+        dataReader.StartMinibatchLoop(minibatchSize, epoch, matrices.GetStreamDescriptions(), epochSize);
+        size_t numberOfMinibatches = 0;
+        while (dataReader.GetMinibatch(matrices))
+            numberOfMinibatches++;
+
+        // Copies to the GPU only have to be done by now.
+        if (deviceId != CPUDEVICE)
+        {
+            unique_ptr<MatrixComputeStreamEvent> computeStreamEvent(MatrixComputeStreamEvent::Create(deviceId));
+            computeStreamEvent->SynchronizeEvent();
+        }
+        timer.Stop();
+
+        double elapsedSeconds = timer.ElapsedSeconds();
+        fprintf(stderr, "benchmarkReader: Epoch[%d of %d]: %d minibatches in %.3f seconds\n",
+                (int)epoch + 1, (int)maxEpochs, (int)numberOfMinibatches, elapsedSeconds);
+        if (dataReader.GetAndResetStatistics(statistics))
+            statistics.Print(stderr, "benchmarkReader: ", elapsedSeconds);
+    }
+}
+
+template void DoBenchmarkReader<float>(const ConfigParameters& config);
+template void DoBenchmarkReader<double>(const ConfigParameters& config);
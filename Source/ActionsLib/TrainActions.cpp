@@ -106,7 +106,35 @@ void DoTrain(const ConfigRecordType& config)
     createNetworkFn = GetNetworkFactory<ConfigRecordType, ElemType>(config);
 
     // create or load from checkpoint
-    shared_ptr<ComputationNetwork> net = !loadNetworkFromCheckpoint ? createNetworkFn(deviceId) : ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelFileName);
+    shared_ptr<ComputationNetwork> net = !loadNetworkFromCheckpoint ? createNetworkFn(deviceId) : optimizer->LoadNetworkForEpoch(deviceId, int(startEpoch) - 1);
+
+    // optionally fuse elementwise expressions, such as the gates of LSTMs, into FusedElementwiseNodes
+    if (config(L"fuseElementwiseNodes", false))
+    {
+        net->InvalidateCompiledNetwork();
+        net->SetFuseElementwiseNodes(true);
+        net->CompileNetwork();
+    }
+
+    // optionally take the non-recurrent part of Times (W, RowStack (x, h)) out of recurrent loops
+    if (config(L"splitRecurrentProducts", false))
+    {
+        net->InvalidateCompiledNetwork();
+        net->SetSplitRecurrentProducts(true);
+        net->CompileNetwork();
+    }
+
+    // optionally place nodes on other devices, for a model that does not fit on one GPU
+    if (SetNodeDevicesFromConfig(config, net))
+    {
+        net->InvalidateCompiledNetwork();
+        net->CompileNetwork();
+    }
+
+    // optionally evaluate independent branches of the network concurrently (CPU only)
+    net->SetConcurrentBranches(config(L"concurrentBranches", false));
+    // optionally let elementwise nodes compute their values in place of their inputs' values
+    net->SetInPlaceComputation(config(L"inPlaceComputation", false));
 
     auto dataReader = CreateObject<DataReader>(config, L"reader");
 
@@ -27,6 +27,7 @@
 #include "CommonMatrix.h"
 #include "SGD.h"
 #include "MPIWrapper.h"
+#include "NumaTopology.h"
 #include "Config.h"
 #include "SimpleEvaluator.h"
 #include "SimpleOutputWriter.h"
@@ -87,6 +88,54 @@ void RedirectStdErr(wstring logpath)
     static auto fKept = f;                // keep it around (until it gets changed)
 }
 
+// The rank of the process among the processes on its host, from the MPI launcher if it tells.
+static size_t GetLocalRank(const shared_ptr<MPIWrapper>& mpi)
+{
+    if (!mpi)
+        return 0;
+    if (mpi->NumLocalNodes() > 1) // known once hierarchical reduction is enabled
+        return mpi->LocalNodeRank();
+    for (const char* name : { "OMPI_COMM_WORLD_LOCAL_RANK", "MV2_COMM_WORLD_LOCAL_RANK", "MPI_LOCALRANKID" })
+    {
+        const char* value = getenv(name);
+        if (value != nullptr)
+            return (size_t) atoi(value);
+    }
+    return mpi->CurrentNodeRank();
+}
+
+// With numaBinding = "replicaPerNode", the processes on a host are bound to the cores and the memory of its NUMA nodes
+// (sockets) in turn, by their local rank, e.g. for one data-parallel replica per socket of a CPU server. The math
+// library then uses one thread per core of the node unless numCPUThreads is given, and what the process allocates
+// from then on (CPU matrices, reader buffers) is placed in the memory of the node.
+static void BindToNumaNode(const wstring& numaBinding, const shared_ptr<MPIWrapper>& mpi)
+{
+    if (numaBinding.empty() || numaBinding == L"none")
+        return;
+    if (numaBinding != L"replicaPerNode")
+        InvalidArgument("Unknown numaBinding '%ls', expected 'none' or 'replicaPerNode'.", numaBinding.c_str());
+
+    NumaTopology topology;
+    const size_t node = GetLocalRank(mpi) % topology.NumNodes();
+    if (!topology.Bind(node))
+    {
+        fprintf(stderr, "WARNING: Could not bind the process to NUMA node %d.\n", (int) node);
+        return;
+    }
+
+    int numThreads = CPUMatrix<float /*any will do*/>::SetNumThreads((int) topology.Cores(node).size());
+    LOGPRINTF(stderr, "Bound to NUMA node %d of %d, using %d CPU threads.\n", (int) node, (int) topology.NumNodes(), numThreads);
+}
+
+// Reports the threads of the math library at startup, since the OpenMP threads of the math functions, the pool of
+// the BLAS library and the worker threads of the readers (which report theirs when they start them) together
+// should not exceed the cores; the aggregation and the prefetch of the readers take a thread each in addition.
+static void ReportThreadCounts()
+{
+    LOGPRINTF(stderr, "CPU threads: %d for math functions, %d for BLAS, of %d hardware threads.\n",
+              CPUMatrix<float /*any will do*/>::GetNumThreads(), CPUMatrix<float /*any will do*/>::GetNumBlasThreads(), (int) std::thread::hardware_concurrency());
+}
+
 std::string WCharToString(const wchar_t* wst)
 {
     std::wstring ws(wst);
@@ -185,6 +234,7 @@ void DoCommands(const ConfigParameters& config, const shared_ptr<MPIWrapper>& mp
             LOGPRINTF(stderr, "Using %d CPU threads.\n", numCPUThreads);
         }
     }
+    ReportThreadCounts();
 
     bool progressTracing = config(L"progressTracing", false);
 
@@ -330,6 +380,14 @@ void DoCommands(const ConfigParameters& config, const shared_ptr<MPIWrapper>& mp
                 {
                     DoParameterSVD<ElemType>(commandParams);
                 }
+                else if (thisAction == "convertToBinaryChunks")
+                {
+                    DoConvertToBinaryChunks<ElemType>(commandParams);
+                }
+                else if (thisAction == "benchmarkReader")
+                {
+                    DoBenchmarkReader<ElemType>(commandParams);
+                }
                 else
                 {
                     RuntimeError("unknown action: %s  in command set: %s", thisAction.c_str(), command[i].c_str());
@@ -562,6 +620,11 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
     g_shareNodeValueMatrices = config(L"shareNodeValueMatrices", false);
 
     TracingGPUMemoryAllocator::SetTraceLevel(config(L"traceGPUMemoryAllocations", 0));
+    TracingGPUMemoryAllocator::SetCachingEnabled(config(L"cacheGPUMemoryAllocations", true));
+    TracingGPUMemoryAllocator::SetCacheLimitInMBs(config(L"gpuMemoryCacheLimitInMB", (size_t) 0));
+    MatrixResizePolicy::SetGrowthFactor(config(L"matrixGrowthFactor", MatrixResizePolicy::GetGrowthFactor()));
+    MatrixResizePolicy::SetShrinkThreshold(config(L"matrixShrinkThreshold", MatrixResizePolicy::GetShrinkThreshold()));
+    SetCuDnnAlgorithmCacheOptions(config(L"cudnnAlgorithmCacheFile", L""), config(L"cudnnMaxWorkspacePerAlgorithmInMB", (size_t) 0) * 1024 * 1024);
 
     bool synchronizeCUDAKernelExecutions = config(L"synchronizeCUDAKernelExecutions", false);
     if (synchronizeCUDAKernelExecutions)
@@ -582,6 +645,9 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
     // echo gpu info to log
     PrintGpuInfo();
 
+    wstring numaBinding = config(L"numaBinding", L"none");
+    BindToNumaNode(numaBinding, mpi);
+
     // execute the actions
     // std::string type = config(L"precision", "float");
     if (Globals::ShouldForceDeterministicAlgorithms())
@@ -593,6 +659,7 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
         if (numCPUThreads > 0)
             LOGPRINTF(stderr, "Using %d CPU threads.\n", numCPUThreads);
     }
+    ReportThreadCounts();
 
     bool progressTracing = config(L"progressTracing", false);
     size_t fullTotalMaxEpochs = 1; // BUGBUG: BS does not allow me to read out the max epochs parameters, as that would instantiate and thus execute the objects
@@ -627,6 +694,9 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
         fprintf(fp, "successfully finished at %s on %s\n", TimeDateStamp().c_str(), GetHostName().c_str());
         fcloseOrDie(fp);
     }
+    if (TracingGPUMemoryAllocator::IsTraceEnabled())
+        TracingGPUMemoryAllocator::PrintCacheStatistics();
+
     // TODO: change this back to COMPLETED, double underscores don't look good in output
     LOGPRINTF(stderr, "__COMPLETED__\n");
     fflush(stderr);
@@ -702,6 +772,11 @@ int wmainOldCNTKConfig(int argc, wchar_t* argv[])
     g_shareNodeValueMatrices = config(L"shareNodeValueMatrices", false);
 
     TracingGPUMemoryAllocator::SetTraceLevel(config(L"traceGPUMemoryAllocations", 0));
+    TracingGPUMemoryAllocator::SetCachingEnabled(config(L"cacheGPUMemoryAllocations", true));
+    TracingGPUMemoryAllocator::SetCacheLimitInMBs(config(L"gpuMemoryCacheLimitInMB", (size_t) 0));
+    MatrixResizePolicy::SetGrowthFactor(config(L"matrixGrowthFactor", MatrixResizePolicy::GetGrowthFactor()));
+    MatrixResizePolicy::SetShrinkThreshold(config(L"matrixShrinkThreshold", MatrixResizePolicy::GetShrinkThreshold()));
+    SetCuDnnAlgorithmCacheOptions(config(L"cudnnAlgorithmCacheFile", L""), config(L"cudnnMaxWorkspacePerAlgorithmInMB", (size_t) 0) * 1024 * 1024);
 
     if (logpath != L"")
     {
@@ -770,6 +845,9 @@ int wmainOldCNTKConfig(int argc, wchar_t* argv[])
         fprintf(stderr, "\n");
     }
 
+    wstring numaBinding = config(L"numaBinding", L"none");
+    BindToNumaNode(numaBinding, mpi);
+
     // run commands
     std::string type = config(L"precision", "float");
     // accept old precision key for backward compatibility
@@ -788,6 +866,9 @@ int wmainOldCNTKConfig(int argc, wchar_t* argv[])
     else
         RuntimeError("CNTK: Invalid precision string: \"%s\", must be \"float\" or \"double\"", type.c_str());
 
+    if (TracingGPUMemoryAllocator::IsTraceEnabled())
+        TracingGPUMemoryAllocator::PrintCacheStatistics();
+
     // if completed then write a doneFile if requested
     if (!doneFile.empty())
     {
@@ -342,7 +342,9 @@ namespace CNTK
     {
         friend class CompositeFunction;
         friend class LearnerBase;
+        friend class DataParallelDistributedTrainer;
         friend class Variable;
+        friend class Value;
         friend class PackedValue;
 
         template <typename T, typename ...CtorArgTypes>
@@ -540,6 +542,35 @@ namespace CNTK
         ///
         CNTK_API NDArrayViewPtr Alias(bool readOnly = false) const;
 
+        ///
+        /// Creates a new NDArrayView which is a view of the section of 'this' view of shape 'extent' at 'startOffset', over the same underlying data.
+        /// The section need not be contiguous in memory. Only views with dense storage format can be sliced.
+        ///
+        CNTK_API NDArrayViewPtr SliceView(const std::vector<size_t>& startOffset, const std::vector<size_t>& extent, bool readOnly = false) const;
+
+        ///
+        /// Creates a new NDArrayView which is a view of 'this' view with the axes 'axis1' and 'axis2' swapped, over the same underlying data.
+        ///
+        CNTK_API NDArrayViewPtr TransposeAxesView(size_t axis1, size_t axis2, bool readOnly = false) const;
+
+        ///
+        /// Creates a new read-only NDArrayView which is a view of 'this' view with its axes of dimension 1 (and any axes beyond its rank)
+        /// broadcast to the dimensions of 'broadcastShape', over the same underlying data.
+        ///
+        CNTK_API NDArrayViewPtr BroadcastView(const NDShape& broadcastShape) const;
+
+        ///
+        /// Creates a new NDArrayView which is a view of 'this' view reshaped to 'newShape', over the same underlying data.
+        /// 'this' view must be contiguous in memory, i.e. not a transposed, broadcast or strided view.
+        ///
+        CNTK_API NDArrayViewPtr AsShape(const NDShape& newShape) const;
+
+        ///
+        /// Returns a boolean indicating if the elements of 'this' view are stored contiguously in memory (in column-major order).
+        /// DataBuffer/WritableDataBuffer can only be called for such views or their contiguous slices, and other views are copied where a contiguous matrix is needed.
+        ///
+        CNTK_API bool IsContiguous() const;
+
         ///
         /// Copies the contents of the 'source' NDArrayView to 'this' view.
         /// The shapes of the 'source' view and 'this' view must be identical.
@@ -584,6 +615,16 @@ namespace CNTK
         template <typename ElementType>
         Microsoft::MSR::CNTK::TensorView<ElementType>* GetWritableTensorView();
 
+        const Microsoft::MSR::CNTK::TensorShape& GetTensorShape() const;
+        NDArrayViewPtr ViewWithTensorShape(const NDShape& viewShape, const Microsoft::MSR::CNTK::TensorShape& tensorShape, bool readOnly) const;
+
+        // Returns a number that changes with every writable access to the data underlying 'this' view (through any view of it),
+        // and that no other storage ever has; or UntrackedStorageVersion for views of a buffer owned by the caller, which the
+        // caller may change at any time
+        size_t StorageVersion() const { return m_storageVersion ? *m_storageVersion : UntrackedStorageVersion; }
+        void BumpStorageVersion();
+        static const size_t UntrackedStorageVersion = (size_t)-1;
+
     private:
         CNTK::DataType m_dataType;
         DeviceDescriptor m_device;
@@ -592,6 +633,7 @@ namespace CNTK
         bool m_isReadOnly;
 
         std::shared_ptr<void> m_tensorView; // Microsoft::MSR::CNTK::TensorView<ElemType>*
+        std::shared_ptr<size_t> m_storageVersion; // shared by all views of the same storage; null if untracked
     };
 
     enum class MaskKind : char
@@ -704,6 +746,10 @@ namespace CNTK
 
         Microsoft::MSR::CNTK::Matrix<char>* GetMatrix() const;
 
+        // Returns a number that changes with every modification of the mask underlying 'this' view (see NDArrayView::StorageVersion())
+        size_t StorageVersion() const { return *m_storageVersion; }
+        void BumpStorageVersion();
+
         // Disallow copy and move construction and assignment
         NDMask(const NDMask&) = delete; NDMask& operator=(const NDMask&) = delete; NDMask& operator=(NDMask&&) = delete; NDMask(NDMask&& other) = delete;
 
@@ -712,6 +758,7 @@ namespace CNTK
         NDShape m_maskShape;
 
         std::shared_ptr<Microsoft::MSR::CNTK::Matrix<char>> m_matrixView;
+        std::shared_ptr<size_t> m_storageVersion; // shared by all aliases of the same mask
     };
 
     /// 
@@ -747,6 +794,23 @@ namespace CNTK
         template <typename ElementType>
         CNTK_API static ValuePtr Create(size_t vocabularySize, const std::vector<std::vector<size_t>>& oneHotSequences, const DeviceDescriptor& device, bool readOnly = false);
 
+        ///
+        /// Create a new Value object containing a collection of variable length sequences of one hot vectors, given as the flat array 'oneHotIndices'
+        /// of the indices of all sequences, one after the other, where sequence i consists of the entries [sequenceOffsets[i], sequenceOffsets[i + 1]).
+        /// Only the indices are copied to the device; the sparse data structure is built there.
+        ///
+        template <typename ElementType>
+        CNTK_API static ValuePtr Create(size_t vocabularySize, const std::vector<SparseIndexType>& oneHotIndices, const std::vector<size_t>& sequenceOffsets, const DeviceDescriptor& device, bool readOnly = false);
+
+        ///
+        /// Create a new Value object containing a collection of variable length sequences that are stored in the caller-owned buffer 'data',
+        /// laid out as the Value's data: 'sequenceLengths.size()' slots of max('sequenceLengths') samples of shape 'sampleShape' each, where
+        /// sequence i occupies the first sequenceLengths[i] samples of slot i. On the CPU device the created Value object refers to 'data'
+        /// without copying it, and the buffer must outlive the Value; on other devices the data is copied to the device once.
+        ///
+        template <typename ElementType>
+        CNTK_API static ValuePtr Create(const NDShape& sampleShape, const std::vector<size_t>& sequenceLengths, ElementType* data, const DeviceDescriptor& device, bool readOnly = false);
+
         ///
         /// Destruct 'this' Value object.
         ///
@@ -1355,9 +1419,9 @@ namespace CNTK
             return operator[](key.c_str());
         }
 
-        CNTK_API DictionaryValue operator[](const wchar_t* key) const;
+        CNTK_API const DictionaryValue& operator[](const wchar_t* key) const;
 
-        DictionaryValue operator[](const std::wstring& key) const
+        const DictionaryValue& operator[](const std::wstring& key) const
         {
             return operator[](key.c_str());
         }
@@ -2430,6 +2494,14 @@ namespace CNTK
     ///
     CNTK_API FunctionPtr TransposeTimes(const Variable& leftOperand, const Variable& rightOperand, size_t outputRank = 1, const std::wstring& name = L"");
 
+    ///
+    /// Create an instance of the CNTK built-in operation that multiplies the matrices (or vectors) of each sample of the
+    /// specified operands, which must have the same dynamic axes, optionally transposing the ones of either operand.
+    /// The products of all samples are computed in a single batched matrix multiplication, e.g. the attention scores of
+    /// all sequences of a minibatch from their keys and queries.
+    ///
+    CNTK_API FunctionPtr BatchTimes(const Variable& leftOperand, const Variable& rightOperand, bool transposeLeftOperand = false, bool transposeRightOperand = false, const std::wstring& name = L"");
+
     ///
     /// Create an instance of the CNTK built-in operation to compute squared-error for specified input operands.
     ///
@@ -2813,6 +2885,44 @@ namespace CNTK
                                        double clippingThresholdPerSample = std::numeric_limits<double>::infinity(),
                                        bool gradientClippingWithTruncation = true);
 
+    ///
+    /// Abstraction for training a model on several workers (MPI ranks) at once. A Trainer constructed with a DistributedTrainer
+    /// hands it the gradients of each minibatch after the backward pass, before the learners update the parameters.
+    ///
+    class DistributedTrainer
+    {
+    public:
+        ///
+        /// Replaces the minibatch statistics of this worker in place by their sums over all workers: the 'gradientValues' (which the
+        /// Trainer passes in the same order on all workers), the number of samples and the training loss and evaluation criterion
+        /// summed over the samples of the minibatch.
+        /// Returns false if none of the workers had any samples, in which case the parameters are not updated.
+        ///
+        virtual bool PreParameterUpdateCallback(std::vector<std::pair<Parameter, NDArrayViewPtr>>& gradientValues, size_t& numSamples,
+                                                double& aggregateTrainingLoss, double& aggregateEvalCriterion) = 0;
+
+        ///
+        /// Number of workers and rank of this worker, e.g. for MinibatchSource::StartDistributedMinibatchLoop.
+        ///
+        virtual size_t NumberOfWorkers() const = 0;
+        virtual size_t WorkerRank() const = 0;
+
+        ///
+        /// Destruct this DistributedTrainer.
+        ///
+        virtual ~DistributedTrainer() {}
+    };
+
+    ///
+    /// Create a DistributedTrainer for synchronous data parallel training over MPI, which sums up the gradients
+    /// of all workers the same way as SGD's SimpleDistGradAggregator.
+    /// 'gradientBucketSizeInBytes' > 0 packs the dense gradients into contiguous buckets of about that size, each reduced with a single allreduce.
+    /// 'useAsyncBufferedParameterUpdate' overlaps the exchange of the gradients with the computation of the next minibatch; the parameters are
+    /// then updated with the gradients of the minibatch before.
+    /// 'useHalfPrecisionGradients' exchanges the dense gradients as half precision floats.
+    ///
+    CNTK_API DistributedTrainerPtr CreateDataParallelDistributedTrainer(size_t gradientBucketSizeInBytes = 0, bool useAsyncBufferedParameterUpdate = false, bool useHalfPrecisionGradients = false);
+
     ///
     /// Trainer is the top-level abstraction responsible for the orchestration of the training of a model
     /// using the specified learners and training data either explicitly supplied as Value objects or from
@@ -2825,15 +2935,20 @@ namespace CNTK
         /// Construct a Trainer to train the specified 'model' with the specified 'trainingLoss' Variable as the training criterion
         /// and using the specified set of 'parameterLearners' for updating the model's parameters using computed gradients.
         ///
-        CNTK_API Trainer(const FunctionPtr& model, const FunctionPtr& lossFunction, const std::unordered_set<LearnerPtr>& parameterLearners);
+        CNTK_API Trainer(const FunctionPtr& model, const FunctionPtr& lossFunction, const std::unordered_set<LearnerPtr>& parameterLearners,
+                         const DistributedTrainerPtr& distributedTrainer = nullptr);
 
         ///
         /// Construct a Trainer to train the specified 'model' with the specified 'trainingLoss' as the training criterion,
         /// the specified 'evaluationFunction' as the criterion for evaluating the trained model's quality, and using the specified set
         /// of 'parameterLearners' for updating the model's parameters using computed gradients.
+        /// With a 'distributedTrainer', the gradients are combined across the workers of a distributed job before each parameter update.
+        /// Parameters of the model that none of the 'parameterLearners' covers are frozen: they are not updated, and no gradients
+        /// are computed for them or for the parts of the model that only lead to them.
         ///
         // TODO: Add overload for multiple evaluation criterion
-        CNTK_API Trainer(const FunctionPtr& model, const FunctionPtr& lossFunction, const FunctionPtr& evaluationFunction, const std::unordered_set<LearnerPtr>& parameterLearners);
+        CNTK_API Trainer(const FunctionPtr& model, const FunctionPtr& lossFunction, const FunctionPtr& evaluationFunction, const std::unordered_set<LearnerPtr>& parameterLearners,
+                         const DistributedTrainerPtr& distributedTrainer = nullptr);
 
         ///
         /// Optimize model parameters using the specified 'arguments' minibatch of training samples.
@@ -2858,6 +2973,7 @@ namespace CNTK
 
         ///
         /// Checkpoint the model and other Trainer state at the specified file location
+        /// In distributed training, only the worker of rank 0 writes the checkpoint.
         ///
         CNTK_API void SaveCheckpoint(const std::wstring& modelFilePath);
 
@@ -2893,6 +3009,7 @@ namespace CNTK
 
         ///
         /// Returns the number of samples in the last minibatch trained with
+        /// (in distributed training, the loss, evaluation and sample count of the last minibatch are those of all workers together).
         ///
         size_t PreviousMinibatchSampleCount() const { return m_prevMinibatchNumSamples; }
 
@@ -2901,7 +3018,23 @@ namespace CNTK
         ///
         const std::unordered_set<LearnerPtr>& ParameterLearners() const { return m_parameterLearners; }
 
+        ///
+        /// DistributedTrainer that combines the gradients across workers, or null if 'this' Trainer trains locally.
+        ///
+        DistributedTrainerPtr GetDistributedTrainer() const { return m_distributedTrainer; }
+
+        ///
+        /// With 'ownComputeStream', the TrainMinibatch and TestMinibatch calls of 'this' Trainer issue their work on a GPU to a stream
+        /// of its own, rather than to that of the calling thread. Trainers that are called from different threads of the process (e.g. to
+        /// train several small models of a hyperparameter sweep on one device) then overlap their work on the device, and share its
+        /// memory through the caching allocator of the process. Takes effect with the next call.
+        ///
+        CNTK_API void SetOwnComputeStream(bool ownComputeStream);
+
     private:
+        // the stream of SetOwnComputeStream() that the calling thread switches to for a call, or null
+        Microsoft::MSR::CNTK::MatrixComputeStream* BeginComputeStream(const DeviceDescriptor& computeDevice);
+
         FunctionPtr m_combinedTrainingFunction;
         FunctionPtr m_model;
         FunctionPtr m_lossFunction;
@@ -2910,6 +3043,17 @@ namespace CNTK
         FunctionPtr m_aggregatedEvaluationFunction;
 
         std::unordered_set<LearnerPtr> m_parameterLearners;
+        DistributedTrainerPtr m_distributedTrainer;
+
+        // with several learners on a GPU, each learner updates its parameters on a stream of its own
+        std::shared_ptr<Microsoft::MSR::CNTK::MatrixComputeStreams> m_learnerStreams;
+
+        // of SetOwnComputeStream(), created on the device of the first call
+        bool m_ownComputeStream;
+        std::shared_ptr<Microsoft::MSR::CNTK::MatrixComputeStream> m_computeStream;
+
+        // gradients of the model's parameters, kept across minibatches
+        std::unordered_map<Variable, ValuePtr> m_parameterGradients;
 
         size_t m_prevMinibatchNumSamples;
         ValuePtr m_prevMinibatchAggregateTrainingLossValue;
@@ -2957,6 +3101,16 @@ namespace CNTK
         ValuePtr m_data;
     };
 
+    ///
+    /// How long the readers of a MinibatchSource had to wait for the minibatches (see MinibatchSource::GetAndResetStatistics).
+    ///
+    struct MinibatchSourceStatistics
+    {
+        size_t m_numMinibatches;      // Number of GetNextMinibatch calls
+        size_t m_numReadyMinibatches; // Number of these calls that found their minibatch already prefetched
+        double m_waitSeconds;         // Time these calls were blocked waiting for their minibatch
+    };
+
     ///
     /// Abstraction for generating minibatches of samples for training/evaluation.
     ///
@@ -3003,6 +3157,19 @@ namespace CNTK
         ///
         CNTK_API const std::unordered_map<StreamInformation, MinibatchData>& GetNextMinibatch(size_t minibatchSizeInSamples, const DeviceDescriptor& device = DeviceDescriptor::UseDefaultDevice());
 
+        ///
+        /// Makes 'this' MinibatchSource return only the share of worker 'workerRank' (out of 'numberOfWorkers') of each minibatch,
+        /// so that the minibatch size passed to GetNextMinibatch is that of all workers together.
+        /// Must be called before the first GetNextMinibatch call.
+        ///
+        CNTK_API virtual void StartDistributedMinibatchLoop(size_t numberOfWorkers, size_t workerRank);
+
+        ///
+        /// Returns how long the GetNextMinibatch calls since the last call of this method were blocked waiting for data,
+        /// which tells whether reading keeps up with the training loop.
+        ///
+        CNTK_API virtual MinibatchSourceStatistics GetAndResetStatistics();
+
         // TODO: Methods to save and restore from checkpoints
 
         // Disallow copy and move construction and assignment
@@ -3031,11 +3198,16 @@ namespace CNTK
 
     /// 
     /// Instantiate the CNTK built-in test format minibatch source
+    /// The minibatch sources of the process that give the same 'sharedChunkCacheName' (e.g. those of several Trainers that train
+    /// in one process) load each chunk of the data once, and keep it in memory for all of them.
     ///
-    inline MinibatchSourcePtr TextFormatMinibatchSource(const std::wstring& dataFilePath, const std::vector<StreamConfiguration>& streamConfigs, size_t epochSize = SIZE_MAX)
+    inline MinibatchSourcePtr TextFormatMinibatchSource(const std::wstring& dataFilePath, const std::vector<StreamConfiguration>& streamConfigs, size_t epochSize = SIZE_MAX,
+                                                        const std::wstring& sharedChunkCacheName = L"")
     {
         CNTK::Dictionary minibatchSourceConfiguration;
         minibatchSourceConfiguration[L"epochSize"] = epochSize;
+        if (!sharedChunkCacheName.empty())
+            minibatchSourceConfiguration[L"sharedChunkCache"] = sharedChunkCacheName;
 
         CNTK::Dictionary deserializerConfiguration;
         deserializerConfiguration[L"type"] = L"CNTKTextFormatDeserializer";
@@ -47,6 +47,8 @@ namespace Microsoft { namespace MSR { namespace CNTK {
     template <typename ElemType>
     class TensorView;
 
+    struct TensorShape;
+
     class ComputationNetwork;
 
     template <typename ElemType>
@@ -57,6 +59,9 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
     class ComputationNodeBase;
     typedef std::shared_ptr<ComputationNodeBase> ComputationNodeBasePtr;
+
+    class MatrixComputeStreams;
+    class MatrixComputeStream;
 }}}
 
 // TODO: The following should be reconciled with the equivalent code in the CNTK implementation
@@ -181,9 +186,14 @@ namespace CNTK
 
     class Dictionary;
 
+    class DeviceDescriptor;
+
     class MinibatchSource;
     typedef std::shared_ptr<MinibatchSource> MinibatchSourcePtr;
 
+    class DistributedTrainer;
+    typedef std::shared_ptr<DistributedTrainer> DistributedTrainerPtr;
+
     namespace Internal
     {
         // Create a new Function instance which just passes through specified list of 'operands'.
@@ -212,5 +222,13 @@ namespace CNTK
 
         CNTK_API void DisableAutomaticUnpackingOfPackedValues();
         bool IsAutomaticUnpackingOfPackedValuesDisabled();
+
+        CNTK_API void DisableParallelLearnerUpdates();
+        bool IsParallelLearnerUpdatesDisabled();
+
+        // For benchmarks: waits until the work issued to a GPU 'device' so far is done (no-op on the CPU), and the bytes
+        // in use on a GPU 'device' by all processes (0 for the CPU).
+        CNTK_API void SynchronizeDevice(const DeviceDescriptor& device);
+        CNTK_API size_t GetDeviceMemoryInUse(const DeviceDescriptor& device);
     }
 }
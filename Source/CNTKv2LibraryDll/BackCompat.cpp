@@ -188,6 +188,12 @@ namespace CNTK
                 primitiveFunctionConfigParameters[PrimitiveFunction::AttributeNameOutputRank] = (size_t)node->As<TransposeTimesNode<ElementType>>()->OutputRank();
                 opType = PrimitiveOpType::TransposeTimes;
             }
+            else if (node->OperationName() == OperationNameOf(BatchTimesNode))
+            {
+                primitiveFunctionConfigParameters[PrimitiveFunction::AttributeNameTransposeLeftOperand] = node->As<BatchTimesNode<ElementType>>()->TransposeA();
+                primitiveFunctionConfigParameters[PrimitiveFunction::AttributeNameTransposeRightOperand] = node->As<BatchTimesNode<ElementType>>()->TransposeB();
+                opType = PrimitiveOpType::BatchTimes;
+            }
             else if (node->OperationName() == OperationNameOf(PastValueNode))
             {
                 if (inputVars.size() == 1)
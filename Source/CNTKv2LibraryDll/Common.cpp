@@ -7,6 +7,8 @@
 #include "CNTKLibrary.h"
 #include "Utils.h"
 #include "BestGpu.h"
+#include "GPUWatcher.h"
+#include "MatrixQuantizerImpl.h"
 #include <mutex>
 #include <algorithm>
 #include <CPUMatrix.h> // For CPUMatrix::SetNumThreads
@@ -54,6 +56,32 @@ namespace CNTK
         {
             return s_disableAutomaticUnpackingOfPackedValues.load();
         }
+
+        std::atomic<bool> s_disableParallelLearnerUpdates(false);
+        void DisableParallelLearnerUpdates()
+        {
+            s_disableParallelLearnerUpdates.store(true);
+        }
+
+        bool IsParallelLearnerUpdatesDisabled()
+        {
+            return s_disableParallelLearnerUpdates.load();
+        }
+
+        void SynchronizeDevice(const DeviceDescriptor& device)
+        {
+            if (device.Type() != DeviceKind::GPU)
+                return;
+            std::unique_ptr<Microsoft::MSR::CNTK::MatrixComputeStreamEvent> event(Microsoft::MSR::CNTK::MatrixComputeStreamEvent::Create(AsCNTKImplDeviceId(device)));
+            event->SynchronizeEvent();
+        }
+
+        size_t GetDeviceMemoryInUse(const DeviceDescriptor& device)
+        {
+            if (device.Type() != DeviceKind::GPU)
+                return 0;
+            return GPUWatcher::GetUsedMemoryOnCUDADevice(AsCNTKImplDeviceId(device));
+        }
     }
 
     /*static*/ std::atomic<bool> DeviceDescriptor::s_defaultDeviceFrozen(false);
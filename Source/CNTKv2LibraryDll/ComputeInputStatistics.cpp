@@ -9,6 +9,9 @@
 #include "Function.h"
 #include <tuple>
 #include "ComputationNetworkBuilder.h"
+#include "MinibatchSource.h"
+#include "MPIWrapper.h"
+#include "PreComputeAccumulation.h"
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -90,6 +93,18 @@ namespace CNTK
             computationNetwork->ForwardProp(preComputeNodes);
         }
 
+        // A distributed MinibatchSource gives each worker only its share of the data; the workers merge their statistics
+        // as with precomputation in SGD, one worker per MPI rank
+        auto compositeMinibatchSource = dynamic_cast<CompositeMinibatchSource*>(minibatchSource.get());
+        if (compositeMinibatchSource && compositeMinibatchSource->NumberOfWorkers() > 1)
+        {
+            auto mpi = GetMPIWrapper();
+            if (mpi->NumNodesInUse() != compositeMinibatchSource->NumberOfWorkers())
+                InvalidArgument("ComputeMeanAndVariance: The MinibatchSource is distributed over %d workers, but there are %d MPI ranks",
+                                (int)compositeMinibatchSource->NumberOfWorkers(), (int)mpi->NumNodesInUse());
+            MergePreComputeAccumulations(preComputeNodes, mpi);
+        }
+
         // finalize
         for (auto & preComputeNode : preComputeNodes)
             dynamic_pointer_cast<IPreComputeNode>(preComputeNode)->MarkComputed(true /*done accumulating*/);
@@ -0,0 +1,132 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "CNTKLibrary.h"
+#include "Utils.h"
+#include "MPIWrapper.h"
+#include "SimpleDistGradAggregator.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace CNTK
+{
+    // The MPIWrapper is a process-wide singleton that can only be created once
+    MPIWrapperPtr GetMPIWrapper()
+    {
+        static MPIWrapperPtr mpi = MPIWrapper::GetInstance(/*create =*/ true);
+        return mpi;
+    }
+
+    // Synchronous data parallel training, with the gradient aggregation of SGD (SimpleDistGradAggregator):
+    // the gradients, the sample count and the criterion values are summed up across all MPI ranks.
+    class DataParallelDistributedTrainer final : public DistributedTrainer
+    {
+    public:
+        DataParallelDistributedTrainer(size_t gradientBucketSizeInBytes, bool useAsyncBufferedParameterUpdate, bool useHalfPrecisionGradients)
+            : m_mpi(GetMPIWrapper()), m_gradientBucketSizeInBytes(gradientBucketSizeInBytes),
+              m_useAsyncBufferedParameterUpdate(useAsyncBufferedParameterUpdate), m_useHalfPrecisionGradients(useHalfPrecisionGradients)
+        {}
+
+        virtual bool PreParameterUpdateCallback(std::vector<std::pair<Parameter, NDArrayViewPtr>>& gradientValues, size_t& numSamples,
+                                                double& aggregateTrainingLoss, double& aggregateEvalCriterion) override
+        {
+            if (gradientValues.empty())
+                LogicError("DistributedTrainer: No gradients to aggregate");
+
+            switch (gradientValues.front().second->GetDataType())
+            {
+            case DataType::Float:
+                return Aggregate<float>(m_floatAggregator, gradientValues, numSamples, aggregateTrainingLoss, aggregateEvalCriterion);
+            case DataType::Double:
+                return Aggregate<double>(m_doubleAggregator, gradientValues, numSamples, aggregateTrainingLoss, aggregateEvalCriterion);
+            default:
+                LogicError("Unsupported DataType %s", DataTypeName(gradientValues.front().second->GetDataType()));
+            }
+        }
+
+        virtual size_t NumberOfWorkers() const override { return m_mpi->NumNodesInUse(); }
+        virtual size_t WorkerRank() const override { return m_mpi->CurrentNodeRank(); }
+
+    private:
+        template <typename ElementType>
+        bool Aggregate(std::unique_ptr<SimpleDistGradAggregator<ElementType>>& aggregator, std::vector<std::pair<Parameter, NDArrayViewPtr>>& gradientValues,
+                       size_t& numSamples, double& aggregateTrainingLoss, double& aggregateEvalCriterion)
+        {
+            // The aggregator keys its buckets and buffers on the gradient matrices, so these must be the same objects in every minibatch
+            bool resetState = !aggregator;
+            if (resetState)
+            {
+                aggregator.reset(new SimpleDistGradAggregator<ElementType>(m_mpi, m_useAsyncBufferedParameterUpdate, /*syncStatsTrace =*/ 0, m_gradientBucketSizeInBytes, m_useHalfPrecisionGradients));
+                for (const auto& gradientValue : gradientValues)
+                {
+                    auto viewMatrix = gradientValue.second->GetWritableMatrix<ElementType>();
+                    m_gradientViews.push_back(gradientValue.second);
+                    m_viewMatrices.push_back(viewMatrix);
+                    if (m_useAsyncBufferedParameterUpdate)
+                        m_gradientMatrices.push_back(std::make_shared<Matrix<ElementType>>(viewMatrix->GetNumRows(), viewMatrix->GetNumCols(), viewMatrix->GetDeviceId()));
+                }
+            }
+            else if (gradientValues.size() != m_gradientViews.size())
+                LogicError("DistributedTrainer: The number of gradients must not change across minibatches");
+
+            std::vector<Matrix<ElementType>*> gradients;
+            for (size_t i = 0; i < gradientValues.size(); ++i)
+            {
+                if (gradientValues[i].second != m_gradientViews[i])
+                    LogicError("DistributedTrainer: The gradients must be stored in the same NDArrayView objects in every minibatch");
+
+                auto& viewMatrix = *std::static_pointer_cast<Matrix<ElementType>>(m_viewMatrices[i]);
+                if (m_useAsyncBufferedParameterUpdate)
+                {
+                    // The aggregator swaps the contents of the gradient matrices with its buffers, which must not be
+                    // the storage of the NDArrayViews; so the gradients take a detour through matrices of our own.
+                    auto& gradientMatrix = *std::static_pointer_cast<Matrix<ElementType>>(m_gradientMatrices[i]);
+                    gradientMatrix.AssignValuesOf(viewMatrix);
+                    gradients.push_back(&gradientMatrix);
+                }
+                else
+                    gradients.push_back(&viewMatrix);
+            }
+
+            std::shared_ptr<DistGradHeader> header(DistGradHeader::Create(/*numEvalNode =*/ 1), [](DistGradHeader* ptr) { DistGradHeader::Destroy(ptr); });
+            header->numSamples = numSamples;
+            header->numSamplesWithLabel = numSamples;
+            header->criterion = aggregateTrainingLoss;
+            header->evalErrors[0] = std::make_pair(aggregateEvalCriterion, numSamples);
+
+            bool samplesProcessed = aggregator->AggregateGradients(gradients, header.get(), resetState);
+
+            if (m_useAsyncBufferedParameterUpdate)
+            {
+                for (size_t i = 0; i < gradients.size(); ++i)
+                    std::static_pointer_cast<Matrix<ElementType>>(m_viewMatrices[i])->AssignValuesOf(*gradients[i]);
+            }
+
+            numSamples = header->numSamples;
+            aggregateTrainingLoss = header->criterion;
+            aggregateEvalCriterion = header->evalErrors[0].first;
+            return samplesProcessed;
+        }
+
+        MPIWrapperPtr m_mpi;
+        size_t m_gradientBucketSizeInBytes;
+        bool m_useAsyncBufferedParameterUpdate;
+        bool m_useHalfPrecisionGradients;
+
+        std::unique_ptr<SimpleDistGradAggregator<float>> m_floatAggregator;
+        std::unique_ptr<SimpleDistGradAggregator<double>> m_doubleAggregator;
+
+        // in the order of the gradients passed by the Trainer
+        std::vector<NDArrayViewPtr> m_gradientViews;
+        std::vector<std::shared_ptr<void>> m_viewMatrices;     // Matrix objects over the storage of m_gradientViews
+        std::vector<std::shared_ptr<void>> m_gradientMatrices; // with m_useAsyncBufferedParameterUpdate only
+    };
+
+    DistributedTrainerPtr CreateDataParallelDistributedTrainer(size_t gradientBucketSizeInBytes /*= 0*/, bool useAsyncBufferedParameterUpdate /*= false*/, bool useHalfPrecisionGradients /*= false*/)
+    {
+        return MakeSharedObject<DataParallelDistributedTrainer>(gradientBucketSizeInBytes, useAsyncBufferedParameterUpdate, useHalfPrecisionGradients);
+    }
+}
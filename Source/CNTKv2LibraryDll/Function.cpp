@@ -17,6 +17,7 @@
 #include "NonlinearityNodes.h"
 #include "RecurrentNodes.h"
 #include "Value.h"
+#include "CUDAPageLockedMemAllocator.h"
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -401,6 +402,8 @@ namespace CNTK
     /*static*/ const std::wstring PrimitiveFunction::AttributeNameLowerPad = L"lowerPad";
     /*static*/ const std::wstring PrimitiveFunction::AttributeNameUpperPad = L"upperPad";
     /*static*/ const std::wstring PrimitiveFunction::AttributeNameTranspose = L"transpose";
+    /*static*/ const std::wstring PrimitiveFunction::AttributeNameTransposeLeftOperand = L"transposeLeftOperand";
+    /*static*/ const std::wstring PrimitiveFunction::AttributeNameTransposeRightOperand = L"transposeRightOperand";
     /*static*/ const std::wstring PrimitiveFunction::AttributeNameMaxTempMemSizeInSamples = L"maxTempMemSizeInSamples";
     /*static*/ const std::wstring PrimitiveFunction::AttributeNamePoolingType = L"poolingType";
     /*static*/ const std::wstring PrimitiveFunction::AttributeNamePoolingWindowShape = L"poolingWindowShape";
@@ -575,6 +578,28 @@ namespace CNTK
             outputShape = TimesOpOutputShape(transposedLeftOperandShape, inputs[1].Shape(), outputRank);
             break;
         }
+        case PrimitiveOpType::BatchTimes:
+        {
+            assert(inputs.size() == 2);
+            bool transposeLeft = functionConfig[PrimitiveFunction::AttributeNameTransposeLeftOperand].Value<bool>();
+            bool transposeRight = functionConfig[PrimitiveFunction::AttributeNameTransposeRightOperand].Value<bool>();
+            const auto& leftShape = inputs[0].Shape();
+            const auto& rightShape = inputs[1].Shape();
+            if (leftShape.Rank() < 1 || leftShape.Rank() > 2 || rightShape.Rank() < 1 || rightShape.Rank() > 2)
+                InvalidArgument("BatchTimes: The operands must be matrices or vectors, not of shapes [%S] and [%S]", AsStringForErrorReporting(leftShape).c_str(), AsStringForErrorReporting(rightShape).c_str());
+
+            size_t leftRows = leftShape[0], leftCols = (leftShape.Rank() > 1) ? leftShape[1] : 1;
+            size_t rightRows = rightShape[0], rightCols = (rightShape.Rank() > 1) ? rightShape[1] : 1;
+            if ((transposeLeft ? leftRows : leftCols) != (transposeRight ? rightCols : rightRows))
+                InvalidArgument("BatchTimes: The inner dimensions of the operands of shapes [%S] and [%S] do not match", AsStringForErrorReporting(leftShape).c_str(), AsStringForErrorReporting(rightShape).c_str());
+
+            size_t outputRows = transposeLeft ? leftCols : leftRows;
+            if ((rightShape.Rank() == 1) && !transposeRight)
+                outputShape = { outputRows };
+            else
+                outputShape = { outputRows, transposeRight ? rightRows : rightCols };
+            break;
+        }
         case PrimitiveOpType::Convolution:
         {
             assert(inputs.size() == 2);
@@ -955,6 +980,13 @@ namespace CNTK
             computationNodePtr = New<TransposeTimesNode<ElementType>>(network->GetDeviceId(), functionName, outputRank);
             break;
         }
+        case PrimitiveOpType::BatchTimes:
+        {
+            bool transposeLeft = functionConfig[PrimitiveFunction::AttributeNameTransposeLeftOperand].Value<bool>();
+            bool transposeRight = functionConfig[PrimitiveFunction::AttributeNameTransposeRightOperand].Value<bool>();
+            computationNodePtr = New<BatchTimesNode<ElementType>>(network->GetDeviceId(), functionName, transposeLeft, transposeRight);
+            break;
+        }
         case PrimitiveOpType::Convolution:
         {
             NDShape outputMapCount, kernelShape;
@@ -1117,23 +1149,73 @@ namespace CNTK
         return computationNodePtr;
     }
 
-    template <typename ElementType>
-    ComputationNetworkPtr CompositeFunction::GetComputationNetwork(const DeviceDescriptor& device, const std::unordered_set<Variable>& backpropRoots, bool allocateNetworkMatrices)
+    void CompositeFunction::SwapCurrentComputationNetwork(ComputationNetworkPlan& plan)
+    {
+        std::swap(m_computationNetwork, plan.m_network);
+        std::swap(m_variableToNodeMap, plan.m_variableToNodeMap);
+        std::swap(m_isVariableRootMap, plan.m_isVariableRootMap);
+        std::swap(m_currentBackpropRoots, plan.m_backpropRoots);
+        std::swap(m_networkMatricesAllocated, plan.m_networkMatricesAllocated);
+        std::swap(m_leafValueVersions, plan.m_leafValueVersions);
+        std::swap(m_leafValuesForTraining, plan.m_leafValuesForTraining);
+    }
+
+    // Makes the network for 'device' and 'backpropRoots' (any, if empty) the current one if it is current or cached, and returns
+    // whether it was found. If not, the current network is cached and the current state is left empty for a new network.
+    bool CompositeFunction::SwitchComputationNetwork(const DeviceDescriptor& device, const std::unordered_set<Variable>& backpropRoots)
     {
-        if (m_computationNetwork != nullptr)
+        auto matches = [&](const ComputationNetworkPtr& network, const std::unordered_set<Variable>& networkBackpropRoots)
         {
-            // TODO: We should either invalidate and readapt the network if he backpropRoots change compared to what was specified when the network
-            // was last constructed, to just recreate a new network.
-            // For now just disallow changing the backpropRoots after the network is created
-            if (!backpropRoots.empty() && (m_currentBackpropRoots != backpropRoots))
-                LogicError("Changing backprop roots across different Forward calls on a CNTK composite Function is currently unsupported");
+            return (AsDeviceDescriptor(network->GetDeviceId()) == device) && (backpropRoots.empty() || (networkBackpropRoots == backpropRoots));
+        };
 
-            // TODO: Support changing the device across different invocations of the forward method on a Function instance
-            if (AsDeviceDescriptor(m_computationNetwork->GetDeviceId()) != device)
-                LogicError("Changing device across different Forward calls on a CNTK composite Function is currently unsupported");
+        m_computationNetworkUseCount++;
+        if (m_computationNetwork == nullptr)
+        {
+            if (m_cachedComputationNetworks.empty())
+                return false;
         }
-
+        else if (matches(m_computationNetwork, m_currentBackpropRoots))
+            return true;
         else
+        {
+            ComputationNetworkPlan current;
+            SwapCurrentComputationNetwork(current);
+            current.m_lastUse = m_computationNetworkUseCount;
+            m_cachedComputationNetworks.push_back(std::move(current));
+        }
+
+        auto found = std::find_if(m_cachedComputationNetworks.begin(), m_cachedComputationNetworks.end(), [&](const ComputationNetworkPlan& plan)
+        {
+            return matches(plan.m_network, plan.m_backpropRoots);
+        });
+        bool isFound = (found != m_cachedComputationNetworks.end());
+        if (isFound)
+        {
+            SwapCurrentComputationNetwork(*found);
+            m_cachedComputationNetworks.erase(found);
+        }
+
+        // evict the least recently used networks (which frees their matrices)
+        while (m_cachedComputationNetworks.size() > MaxCachedComputationNetworks)
+        {
+            m_cachedComputationNetworks.erase(std::min_element(m_cachedComputationNetworks.begin(), m_cachedComputationNetworks.end(), [](const ComputationNetworkPlan& a, const ComputationNetworkPlan& b)
+            {
+                return a.m_lastUse < b.m_lastUse;
+            }));
+        }
+
+        return isFound;
+    }
+
+    // The network is compiled and its matrices allocated once per (device, backpropRoots): a Forward call with other backpropRoots
+    // (e.g. alternating between training and evaluation criteria) or on another device switches to a cached network instead of
+    // rebuilding one. The network always computes all outputs of 'this' Function, so the requested outputs need not be part of the key,
+    // and sequence lengths and minibatch sizes are absorbed by the MBLayout without recompilation.
+    template <typename ElementType>
+    ComputationNetworkPtr CompositeFunction::GetComputationNetwork(const DeviceDescriptor& device, const std::unordered_set<Variable>& backpropRoots, bool allocateNetworkMatrices)
+    {
+        if (!SwitchComputationNetwork(device, backpropRoots))
         {
             m_computationNetwork = std::make_shared<ComputationNetwork>(AsCNTKImplDeviceId(device));
 
@@ -1197,6 +1279,14 @@ namespace CNTK
 #ifdef _DEBUG
             m_computationNetwork->SetTraceLevel(1);
 #endif
+            // Validation propagates the need for gradients from the parameters to the nodes depending on them
+            for (const auto& parameter : m_frozenParameters)
+            {
+                auto found = m_variableToNodeMap.find(parameter);
+                if (found != m_variableToNodeMap.end())
+                    found->second->SetLearningRateMultiplier(0);
+            }
+
             m_computationNetwork->CompileNetwork();
 
             // Verify that the shapes of the output Variables that we computed match the corresponding nodes in the ComputationNetwork
@@ -1561,8 +1651,63 @@ namespace CNTK
         return GetValueObjectFromCNTKImplMatrixAndMBLayout(var.Shape(), matrix, layout, readOnly);
     }
 
+    InputStagingBuffers::~InputStagingBuffers()
+    {
+        for (auto& slot : m_slots)
+        {
+            if (slot.m_transferer)
+                slot.m_transferer->WaitForCopyCPUToGPU();
+            if (slot.m_buffer)
+                CUDAPageLockedMemAllocator::Free(slot.m_buffer, m_deviceId);
+        }
+    }
+
+    template <typename ElementType>
+    void InputStagingBuffers::Upload(const Matrix<ElementType>& source, Matrix<ElementType>& target)
+    {
+        StartUpload(source, target, /*targetInUse =*/ true)->WaitForCopyCPUToGPUOnComputeStreamAsync();
+    }
+
     template <typename ElementType>
-    /*static*/ void CompositeFunction::PopulateComputationNodeValue(const std::pair<Variable, ValuePtr>& variableValue, ComputationNodeBasePtr& computationNode)
+    DataTransfererPtr InputStagingBuffers::StartUpload(const Matrix<ElementType>& source, Matrix<ElementType>& target, bool targetInUse)
+    {
+        auto& slot = m_slots[m_nextSlot];
+        m_nextSlot = (m_nextSlot + 1) % m_slots.size();
+
+        // the copy out of this buffer from NumSlots uploads ago must have finished before it is overwritten
+        if (!slot.m_transferer)
+            slot.m_transferer = CreatePrefetchDataTransferer(m_deviceId);
+        else
+            slot.m_transferer->WaitForCopyCPUToGPU();
+
+        size_t numBytes = source.GetNumElements() * sizeof(ElementType);
+        if (slot.m_capacity < numBytes)
+        {
+            if (slot.m_buffer)
+                CUDAPageLockedMemAllocator::Free(slot.m_buffer, m_deviceId);
+            slot.m_buffer = nullptr;
+            slot.m_capacity = 0;
+            slot.m_buffer = CUDAPageLockedMemAllocator::Malloc(numBytes, m_deviceId);
+            slot.m_capacity = numBytes;
+        }
+        memcpy(slot.m_buffer, source.Data(), numBytes);
+
+        // The compute stream may still read the previous values of 'target'; the copy waits for that
+        if (targetInUse)
+        {
+            slot.m_transferer->RecordComputeStreamSyncPoint();
+            slot.m_transferer->WaitForSyncPointOnAssignStreamAsync();
+        }
+        target.SetValue(source.GetNumRows(), source.GetNumCols(), m_deviceId, (ElementType*) slot.m_buffer, matrixFlagNormal, slot.m_transferer.get());
+        slot.m_transferer->RecordCPUToGPUCopy();
+        return slot.m_transferer;
+    }
+
+    template DataTransfererPtr InputStagingBuffers::StartUpload<float>(const Matrix<float>& source, Matrix<float>& target, bool targetInUse);
+    template DataTransfererPtr InputStagingBuffers::StartUpload<double>(const Matrix<double>& source, Matrix<double>& target, bool targetInUse);
+
+    template <typename ElementType>
+    /*static*/ void CompositeFunction::PopulateComputationNodeValue(const std::pair<Variable, ValuePtr>& variableValue, ComputationNodeBasePtr& computationNode, InputStagingBuffers* stagingBuffers)
     {
         std::pair<std::shared_ptr<const Matrix<ElementType>>, MBLayoutPtr> CNTKMatrixAndMBLayout;
         auto packedValue = dynamic_cast<PackedValue*>(variableValue.second.get());
@@ -1575,41 +1720,191 @@ namespace CNTK
 
         auto& nodeData = computationNode->As<ComputationNode<ElementType>>()->Value();
 
-        // Switch the node matrix to the right matrix type
-        nodeData.AssignValuesOf(*CNTKMatrixAndMBLayout.first);
+        // Dense CPU data for a dense GPU node is uploaded asynchronously through page-locked memory
+        const auto& sourceData = *CNTKMatrixAndMBLayout.first;
+        if ((stagingBuffers != nullptr) && (sourceData.GetDeviceId() == CPUDEVICE) && (sourceData.GetMatrixType() == MatrixType::DENSE) &&
+            (nodeData.GetDeviceId() == stagingBuffers->GetDeviceId()) && (nodeData.GetMatrixType() == MatrixType::DENSE))
+            stagingBuffers->Upload(sourceData, nodeData);
+        else // Switch the node matrix to the right matrix type
+            nodeData.AssignValuesOf(sourceData);
         computationNode->GetMBLayout()->CopyFrom(layout);
     }
 
+    bool CompositeFunction::LeafValueVersion::operator==(const LeafValueVersion& other) const
+    {
+        auto data = m_data.lock();
+        if (!data || (data != other.m_data.lock()) || (m_dataVersion == NDArrayView::UntrackedStorageVersion) || (m_dataVersion != other.m_dataVersion))
+            return false;
+
+        if (m_hasMask != other.m_hasMask)
+            return false;
+
+        if (!m_hasMask)
+            return true;
+
+        auto mask = m_mask.lock();
+        return mask && (mask == other.m_mask.lock()) && (m_maskVersion == other.m_maskVersion);
+    }
+
+    /*static*/ CompositeFunction::LeafValueVersion CompositeFunction::GetLeafValueVersion(const ValuePtr& value)
+    {
+        // (Data() would unpack a PackedValue)
+        auto packedValue = dynamic_cast<PackedValue*>(value.get());
+        NDArrayViewPtr data = packedValue ? packedValue->PackedDataView() : nullptr;
+        if (data)
+            return GetLeafValueVersion(data);
+
+        LeafValueVersion version = GetLeafValueVersion(value->Data());
+        auto mask = value->Mask();
+        if (mask)
+        {
+            version.m_hasMask = true;
+            version.m_mask = mask;
+            version.m_maskVersion = mask->StorageVersion();
+        }
+
+        return version;
+    }
+
+    /*static*/ CompositeFunction::LeafValueVersion CompositeFunction::GetLeafValueVersion(const NDArrayViewPtr& value)
+    {
+        LeafValueVersion version;
+        version.m_data = value;
+        version.m_dataVersion = value->StorageVersion();
+        return version;
+    }
+
+    bool CompositeFunction::IsLeafValueUnchanged(const Variable& leaf, const LeafValueVersion& version) const
+    {
+        auto recordedVersion = m_leafValueVersions.find(leaf);
+        return (recordedVersion != m_leafValueVersions.end()) && (recordedVersion->second == version);
+    }
+
+    // Arguments whose Values did not change since they were last fed in are skipped, and keep their eval time stamps
     void CompositeFunction::PopulateNetworkInputs(const std::unordered_map<Variable, ValuePtr>& arguments)
     {
+        int networkDeviceId = m_computationNetwork->GetDeviceId();
+        if ((networkDeviceId != CPUDEVICE) && (!m_inputStagingBuffers || (m_inputStagingBuffers->GetDeviceId() != networkDeviceId)))
+            m_inputStagingBuffers.reset(new InputStagingBuffers(networkDeviceId));
+
         std::vector<ComputationNodeBasePtr> inputNodes;
         for (auto argumentValuePair : arguments)
         {
             auto argument = argumentValuePair.first;
             auto argumentComputationNode = m_variableToNodeMap[argument];
             assert(argumentComputationNode);
-            inputNodes.push_back(argumentComputationNode);
 
             ValuePtr argumentValue = arguments.at(argument);
 
+            auto argumentValueVersion = GetLeafValueVersion(argumentValue);
+            if (IsLeafValueUnchanged(argument, argumentValueVersion))
+                continue;
+
+            m_leafValueVersions.erase(argument);
+            inputNodes.push_back(argumentComputationNode);
+
             MBLayoutPtr layout;
             switch (argumentValue->GetDataType())
             {
             case DataType::Float:
-                PopulateComputationNodeValue<float>({ argument, argumentValue }, argumentComputationNode);
+                PopulateComputationNodeValue<float>({ argument, argumentValue }, argumentComputationNode, m_inputStagingBuffers.get());
                 break;
             case DataType::Double:
-                PopulateComputationNodeValue<double>({ argument, argumentValue }, argumentComputationNode);
+                PopulateComputationNodeValue<double>({ argument, argumentValue }, argumentComputationNode, m_inputStagingBuffers.get());
                 break;
             default:
                 LogicError("Unsupported DataType %s", DataTypeName(argumentValue->GetDataType()));
                 break;
             }
+
+            m_leafValueVersions[argument] = argumentValueVersion;
         }
 
         m_computationNetwork->BumpEvalTimeStamp(inputNodes);
     }
 
+    // The nodes of the network refer to the values of Parameters and Constants, which the learners (or the user) may have written since
+    // the previous evaluation; the nodes whose values changed get new eval time stamps, so that the nodes depending on them are recomputed.
+    void CompositeFunction::BumpChangedParameterNodes()
+    {
+        std::vector<ComputationNodeBasePtr> changedNodes;
+        for (const auto& varNodePair : m_variableToNodeMap)
+        {
+            const auto& leaf = varNodePair.first;
+            if (!leaf.IsParameter() && !leaf.IsConstant())
+                continue;
+
+            auto valueVersion = GetLeafValueVersion(leaf.IsConstant() ? Constant(leaf).Value() : Parameter(leaf).Value());
+            if (IsLeafValueUnchanged(leaf, valueVersion))
+                continue;
+
+            m_leafValueVersions[leaf] = valueVersion;
+            changedNodes.push_back(varNodePair.second);
+        }
+
+        if (!changedNodes.empty())
+            ComputationNetwork::BumpEvalTimeStamp(changedNodes);
+    }
+
+    // With node value memory sharing, AllocateAllMatrices() lets later nodes reuse the value matrices of the nodes whose values are
+    // needed neither by their consumers nor during backprop; so after a ForwardProp() these values are gone, although the time stamps
+    // of the nodes say that they are up to date. Such a node is recomputed whenever a consumer of it is, which may in turn require its own
+    // inputs; all other up-to-date nodes keep their values and are not recomputed.
+    void CompositeFunction::MarkReleasedValuesOutdated(const std::vector<ComputationNodeBasePtr>& outputsToEvaluate)
+    {
+        auto isReleased = [](const ComputationNodeBasePtr& node)
+        {
+            return (node->GetNumInputs() > 0) && node->IsValueSharable() && !node->IsOutputNeededDuringBackprop();
+        };
+
+        std::vector<ComputationNodeBasePtr> nodes;
+        std::unordered_set<ComputationNodeBasePtr> visitedNodes;
+        for (const auto& output : outputsToEvaluate)
+        {
+            for (const auto& node : m_computationNetwork->GetEvalOrder(output))
+            {
+                if (visitedNodes.insert(node).second)
+                    nodes.push_back(node);
+            }
+        }
+
+        // Mirrors the time stamp checks of ForwardProp(), where a recurrent loop is out of date if any of its nodes but the delay nodes is.
+        // Since the values to recompute are found while going through the nodes, this repeats until nothing changes (typically twice).
+        std::unordered_set<ComputationNodeBasePtr> recomputedNodes;
+        std::vector<ComputationNodeBasePtr> releasedNodesToRecompute;
+        for (bool changed = true; changed;)
+        {
+            changed = false;
+            for (const auto& node : nodes)
+            {
+                if (recomputedNodes.find(node) == recomputedNodes.end())
+                {
+                    bool isRecomputed = node->IsOutOfDateWrtInputs() && (node->OperationName() != OperationNameOf(PastValueNode)) && (node->OperationName() != OperationNameOf(FutureValueNode));
+                    for (const auto& input : node->GetInputs())
+                        isRecomputed = isRecomputed || (recomputedNodes.find(input) != recomputedNodes.end());
+
+                    if (!isRecomputed)
+                        continue;
+
+                    recomputedNodes.insert(node);
+                    changed = true;
+                }
+
+                for (const auto& input : node->GetInputs())
+                {
+                    if (isReleased(input) && recomputedNodes.insert(input).second)
+                    {
+                        releasedNodesToRecompute.push_back(input);
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        for (const auto& node : releasedNodesToRecompute)
+            node->SetEvalTimeStampOutdatedWrtAll();
+    }
+
     template <typename ElementType>
     /*static*/ void CompositeFunction::PopulateComputationNodeGradient(const std::pair<Variable, ValuePtr>& variableGradient, Microsoft::MSR::CNTK::ComputationNodeBasePtr& computationNode)
     {
@@ -1824,8 +2119,17 @@ namespace CNTK
                 InvalidArgument("Function::Forward: Required argument's (%S) value that the requested output(s) depend on has not been provided", requiredArgument.Name().c_str());
         }
 
+        // Nodes may compute differently in training mode (e.g. BatchNormalization), so all of them are recomputed when the mode changes
+        bool isTraining = !outputsToRetainBackwardStateFor.empty();
+        if (isTraining != m_leafValuesForTraining)
+        {
+            m_leafValueVersions.clear();
+            m_leafValuesForTraining = isTraining;
+        }
+
         // Feed data into the arguments of the network
         PopulateNetworkInputs(arguments);
+        BumpChangedParameterNodes();
 
         // Dropout nodes have an implicit input in the form of the random mask that is applied to its explicit input
         // This mask is regerated every minibatch and hence dropout nodes with a non-zero dropout rate must me marked outdated
@@ -2134,6 +2438,14 @@ namespace CNTK
         return BinaryOp(PrimitiveOpType::TransposeTimes, leftOperand, rightOperand, std::move(additionalProperties), name);
     }
 
+    FunctionPtr BatchTimes(const Variable& leftOperand, const Variable& rightOperand, bool transposeLeftOperand /*= false*/, bool transposeRightOperand /*= false*/, const std::wstring& name/* = L""*/)
+    {
+        auto additionalProperties = Dictionary();
+        additionalProperties[PrimitiveFunction::AttributeNameTransposeLeftOperand] = transposeLeftOperand;
+        additionalProperties[PrimitiveFunction::AttributeNameTransposeRightOperand] = transposeRightOperand;
+        return BinaryOp(PrimitiveOpType::BatchTimes, leftOperand, rightOperand, std::move(additionalProperties), name);
+    }
+
     FunctionPtr SquaredError(const Variable& prediction, const Variable& targets, const std::wstring& name/* = L""*/)
     {
         auto difference = Minus(prediction, targets);
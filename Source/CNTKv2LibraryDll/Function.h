@@ -49,6 +49,7 @@ namespace CNTK
         ScatterPacked,
         Times,
         TransposeTimes,
+        BatchTimes,
         Convolution,
         SquaredError,
         CrossEntropyWithSoftmax,
@@ -113,6 +114,7 @@ namespace CNTK
             { PrimitiveOpType::ScatterPacked, L"ScatterPacked" },
             { PrimitiveOpType::Times, L"Times" },
             { PrimitiveOpType::TransposeTimes, L"TransposeTimes" },
+            { PrimitiveOpType::BatchTimes, L"BatchTimes" },
             { PrimitiveOpType::Convolution, L"Convolution" },
             { PrimitiveOpType::SquaredError, L"SquaredError" },
             { PrimitiveOpType::CrossEntropyWithSoftmax, L"CrossEntropyWithSoftmax" },
@@ -205,6 +207,8 @@ namespace CNTK
         static const std::wstring AttributeNameLowerPad;
         static const std::wstring AttributeNameUpperPad;
         static const std::wstring AttributeNameTranspose;
+        static const std::wstring AttributeNameTransposeLeftOperand;
+        static const std::wstring AttributeNameTransposeRightOperand;
         static const std::wstring AttributeNameMaxTempMemSizeInSamples;
         static const std::wstring AttributeNamePoolingType;
         static const std::wstring AttributeNamePoolingWindowShape;
@@ -437,13 +441,11 @@ namespace CNTK
                                                 std::vector<bool>& autoPad, const NDShape& lowerPad, const NDShape& upperPad,
                                                 bool transpose)
         {
-            decltype(&Microsoft::MSR::CNTK::ConvolveGeometry::ComputeOutputShape) computeOutputShapeFunc;
+            // (ComputeOutputShape() also takes the number of groups, which the V2 Convolution does not have)
             if (!transpose)
-                computeOutputShapeFunc = &Microsoft::MSR::CNTK::ConvolveGeometry::ComputeOutputShape;
+                return AsNDShape(Microsoft::MSR::CNTK::ConvolveGeometry::ComputeOutputShape(AsTensorShape(operandShape), AsTensorShape(kernelShape), AsTensorShape(outputMapCount), AsTensorShape(strides), sharing, autoPad, AsTensorShape(lowerPad), AsTensorShape(upperPad)));
             else
-                computeOutputShapeFunc = &Microsoft::MSR::CNTK::ConvolveGeometry::ComputeInputShape;
-
-            return AsNDShape(computeOutputShapeFunc(AsTensorShape(operandShape), AsTensorShape(kernelShape), AsTensorShape(outputMapCount), AsTensorShape(strides), sharing, autoPad, AsTensorShape(lowerPad), AsTensorShape(upperPad)));
+                return AsNDShape(Microsoft::MSR::CNTK::ConvolveGeometry::ComputeInputShape(AsTensorShape(operandShape), AsTensorShape(kernelShape), AsTensorShape(outputMapCount), AsTensorShape(strides), sharing, autoPad, AsTensorShape(lowerPad), AsTensorShape(upperPad)));
         }
 
         // TODO: Reconcile this with the ComputationNode::Validate functionality in core CNTK to avoid duplication of inference logic
@@ -470,6 +472,44 @@ namespace CNTK
     };
     typedef std::shared_ptr<CNTKBackPropState> CNTKBackPropStatePtr;
 
+    // A ring of page-locked host buffers through which CompositeFunction::Forward() uploads dense CPU argument values to the nodes of
+    // a GPU network. Each copy runs on a separate stream and the compute stream waits for it, so the host does not block; a buffer is
+    // reused only after the copy out of it has finished.
+    class InputStagingBuffers
+    {
+    public:
+        InputStagingBuffers(int deviceId, size_t numSlots = NumSlots) : m_deviceId(deviceId), m_slots(numSlots), m_nextSlot(0) {}
+        ~InputStagingBuffers();
+
+        int GetDeviceId() const { return m_deviceId; }
+
+        template <typename ElementType>
+        void Upload(const Microsoft::MSR::CNTK::Matrix<ElementType>& source, Microsoft::MSR::CNTK::Matrix<ElementType>& target);
+
+        // Starts the copy without making the compute stream wait for it: the caller must call WaitForCopyCPUToGPUOnComputeStreamAsync()
+        // on the returned transferer before 'target' is used. 'targetInUse' makes the copy wait for the compute issued so far.
+        template <typename ElementType>
+        Microsoft::MSR::CNTK::DataTransfererPtr StartUpload(const Microsoft::MSR::CNTK::Matrix<ElementType>& source, Microsoft::MSR::CNTK::Matrix<ElementType>& target, bool targetInUse);
+
+    private:
+        InputStagingBuffers(const InputStagingBuffers&) = delete;
+        InputStagingBuffers& operator=(const InputStagingBuffers&) = delete;
+
+        struct Slot
+        {
+            Microsoft::MSR::CNTK::DataTransfererPtr m_transferer; // (created at the first use of the slot)
+            void* m_buffer;
+            size_t m_capacity;
+
+            Slot() : m_buffer(nullptr), m_capacity(0) {}
+        };
+        static const size_t NumSlots = 4;
+
+        int m_deviceId;
+        std::vector<Slot> m_slots;
+        size_t m_nextSlot;
+    };
+
     class CompositeFunction;
     typedef std::shared_ptr<CompositeFunction> CompositeFunctionPtr;
 
@@ -537,6 +577,23 @@ namespace CNTK
         void PurgeComputationNetwork()
         {
             m_computationNetwork = nullptr;
+            m_variableToNodeMap.clear();
+            m_isVariableRootMap.clear();
+            m_currentBackpropRoots.clear();
+            m_leafValueVersions.clear();
+        }
+
+        // Parameters that are not to be trained, e.g. those not covered by any learner of a Trainer. The networks built
+        // from then on compute no gradients for them, and none for the nodes whose gradients would only flow into them,
+        // so that these get neither gradient matrices nor BackpropTo calls.
+        void SetFrozenParameters(const std::unordered_set<Variable>& parameters)
+        {
+            if (parameters == m_frozenParameters)
+                return;
+
+            m_frozenParameters = parameters;
+            PurgeComputationNetwork();
+            m_cachedComputationNetworks.clear();
         }
 
     private:
@@ -545,7 +602,8 @@ namespace CNTK
                                                 std::unordered_set<Variable>& replacedPlaceholders) override;
 
         CompositeFunction(const FunctionPtr& rootFunction, std::unordered_set<FunctionPtr>&& allPrimitiveFunctions, const std::wstring& name)
-            : Function({}, rootFunction->Outputs(), Dictionary(), rootFunction, name), m_allPrimitiveFunctions(std::move(allPrimitiveFunctions))
+            : Function({}, rootFunction->Outputs(), Dictionary(), rootFunction, name), m_allPrimitiveFunctions(std::move(allPrimitiveFunctions)),
+              m_networkMatricesAllocated(false), m_leafValuesForTraining(false), m_computationNetworkUseCount(0)
         {}
 
         std::vector<Variable> DetermineInputs() const
@@ -579,6 +637,44 @@ namespace CNTK
         template <typename ElementType>
         Microsoft::MSR::CNTK::ComputationNetworkPtr GetComputationNetwork(const DeviceDescriptor& device, const std::unordered_set<Variable>& backpropRoots, bool allocateNetworkMatrices);
 
+        // The data (and mask) a leaf node of the network (an argument, Parameter or Constant) was last populated from, with their
+        // storage versions at that time. A leaf whose Value has not changed since is neither populated nor gets a new eval time
+        // stamp, so that ForwardProp() does not recompute the nodes that only depend on unchanged leaves.
+        struct LeafValueVersion
+        {
+            std::weak_ptr<const NDArrayView> m_data;
+            size_t m_dataVersion;
+            bool m_hasMask;
+            std::weak_ptr<const NDMask> m_mask;
+            size_t m_maskVersion;
+
+            LeafValueVersion() : m_dataVersion(NDArrayView::UntrackedStorageVersion), m_hasMask(false), m_maskVersion(0) {}
+            bool operator==(const LeafValueVersion& other) const;
+        };
+        static LeafValueVersion GetLeafValueVersion(const ValuePtr& value);
+        static LeafValueVersion GetLeafValueVersion(const NDArrayViewPtr& value);
+        bool IsLeafValueUnchanged(const Variable& leaf, const LeafValueVersion& version) const;
+
+        // A compiled ComputationNetwork of 'this' Function with its node map and allocated matrices. Besides the current
+        // one, GetComputationNetwork() keeps up to MaxCachedComputationNetworks that were built for other (device, backpropRoots).
+        struct ComputationNetworkPlan
+        {
+            Microsoft::MSR::CNTK::ComputationNetworkPtr m_network;
+            std::unordered_map<Variable, Microsoft::MSR::CNTK::ComputationNodeBasePtr> m_variableToNodeMap;
+            std::unordered_map<Variable, bool> m_isVariableRootMap;
+            std::unordered_set<Variable> m_backpropRoots;
+            bool m_networkMatricesAllocated;
+            std::unordered_map<Variable, LeafValueVersion> m_leafValueVersions;
+            bool m_leafValuesForTraining;
+            size_t m_lastUse;
+
+            ComputationNetworkPlan() : m_networkMatricesAllocated(false), m_leafValuesForTraining(false), m_lastUse(0) {}
+        };
+        static const size_t MaxCachedComputationNetworks = 3;
+
+        void SwapCurrentComputationNetwork(ComputationNetworkPlan& plan);
+        bool SwitchComputationNetwork(const DeviceDescriptor& device, const std::unordered_set<Variable>& backpropRoots);
+
         template <typename ElementType>
         static Microsoft::MSR::CNTK::ComputationNodeBasePtr CreateComputationNode(const Variable& variable,
                                                                                   PrimitiveFunction* primitiveFunction,
@@ -600,8 +696,10 @@ namespace CNTK
                                                                     std::unordered_map<Variable, bool>& isVariableRootMap);
 
         template <typename ElementType>
-        static void PopulateComputationNodeValue(const std::pair<Variable, ValuePtr>& variableValue, Microsoft::MSR::CNTK::ComputationNodeBasePtr& computationNode);
+        static void PopulateComputationNodeValue(const std::pair<Variable, ValuePtr>& variableValue, Microsoft::MSR::CNTK::ComputationNodeBasePtr& computationNode, InputStagingBuffers* stagingBuffers = nullptr);
         void PopulateNetworkInputs(const std::unordered_map<Variable, ValuePtr>& arguments);
+        void BumpChangedParameterNodes();
+        void MarkReleasedValuesOutdated(const std::vector<Microsoft::MSR::CNTK::ComputationNodeBasePtr>& outputsToEvaluate);
 
         template <typename ElementType>
         static void PopulateComputationNodeGradient(const std::pair<Variable, ValuePtr>& variableGradient, Microsoft::MSR::CNTK::ComputationNodeBasePtr& computationNode);
@@ -644,6 +742,21 @@ namespace CNTK
         std::unordered_map<Variable, std::vector<Variable>> m_perOutputVarArgumentDependencies;
 
         bool m_networkMatricesAllocated;
+
+        // what the leaf nodes of the current network were populated from, see LeafValueVersion; and whether that was in training mode
+        // (which invalidates the other mode's values of some nodes)
+        std::unordered_map<Variable, LeafValueVersion> m_leafValueVersions;
+        bool m_leafValuesForTraining;
+
+        // networks built for other (device, backpropRoots) than the current one, see ComputationNetworkPlan
+        std::vector<ComputationNetworkPlan> m_cachedComputationNetworks;
+        size_t m_computationNetworkUseCount;
+
+        // see SetFrozenParameters()
+        std::unordered_set<Variable> m_frozenParameters;
+
+        // for the uploads of CPU arguments to a GPU network, see PopulateNetworkInputs()
+        std::unique_ptr<InputStagingBuffers> m_inputStagingBuffers;
     };
 
     inline std::vector<CNTK::Axis> DynamicAxesFromInternalDynamicAxisName(const std::wstring& internalDynamicAxisName)
@@ -60,6 +60,38 @@ namespace CNTK
         }
     }
 
+    /*static*/ void LearnerBase::UpdateNonFiniteFlag(const NDArrayViewPtr& value, vector<NDArrayViewPtr>& flags)
+    {
+        auto flagIter = find_if(flags.begin(), flags.end(), [&](const NDArrayViewPtr& flag)
+        {
+            return flag->GetDataType() == value->GetDataType() && flag->Device() == value->Device();
+        });
+        if (flagIter == flags.end())
+            flagIter = flags.insert(flags.end(), MakeSharedObject<NDArrayView>(0.0, value->GetDataType(), NDShape({ 1 }), value->Device()));
+
+        switch (value->GetDataType())
+        {
+        case DataType::Float:
+            value->GetMatrix<float>()->UpdateNonFiniteFlag(*GetWritableMatrix<float>(*flagIter));
+            break;
+        case DataType::Double:
+            value->GetMatrix<double>()->UpdateNonFiniteFlag(*GetWritableMatrix<double>(*flagIter));
+            break;
+        default:
+            LogicError("Unsupported DataType %s", DataTypeName(value->GetDataType()));
+        }
+    }
+
+    /*static*/ bool LearnerBase::HasNonFiniteFlag(const vector<NDArrayViewPtr>& flags)
+    {
+        for (const auto& flag : flags)
+        {
+            if (flag->GetDataType() == DataType::Float ? GetMatrix<float>(flag)->Get00Element() != 0 : GetMatrix<double>(flag)->Get00Element() != 0)
+                return true;
+        }
+        return false;
+    }
+
     /*static*/ void LearnerBase::Print(const NDArrayViewPtr& value, const char* msg)
     {
         switch (value->GetDataType())
@@ -113,7 +145,8 @@ namespace CNTK
             // multiply by actualMBSize so that it's invariant to minibatch size since learning rate is per sample
             auto weight = ElementType(m_additionalOptions.l2RegularizationWeight * actualMBSize);
             const auto& parameterMatrix = parameterValue->GetWritableMatrix<ElementType>();
-            Matrix<ElementType>::ScaleAndAdd(weight, *parameterMatrix, *gradientMatrix);
+            // (a sparse gradient is regularized lazily, only on the columns that the minibatch touched)
+            Matrix<ElementType>::ScaleAndAddToStoredColumns(weight, *parameterMatrix, *gradientMatrix);
         }
     }
 
@@ -214,6 +247,18 @@ namespace CNTK
         // make sure trainingSampleCount is a valid value
         assert(trainingSampleCount > 0);
 
+#if !DUMPOUTPUT
+        if (TryMultiTensorUpdate(gradientValues, trainingSampleCount))
+        {
+            m_sampleCount += trainingSampleCount;
+            m_minibatchCount++;
+            return false;
+        }
+#endif
+
+#ifdef _DEBUG
+        vector<NDArrayViewPtr> nonFiniteFlags; // read once, after all updates
+#endif
         for (const auto& parameter : Parameters())
         {
             const auto& smoothedGradientValue = m_smoothedGradientValues.at(parameter);
@@ -223,11 +268,6 @@ namespace CNTK
             LOGPRINTF(stderr, "Update_%ls\n", parameter.Uid().c_str());
 #endif
 
-#ifdef _DEBUG
-            if (HasNan(smoothedGradientValue, "TrainOneEpoch/UpdateWeights/Learner::Update(): "))
-                LogicError("%ls has NaNs in smoothedGradient.", parameter.Uid().c_str());
-#endif
-
 #if DUMPOUTPUT
             auto learningRate = ElementType(LearningRate());
             auto momentum = ElementType(MomentumPerMB(m_momentums[m_sampleCount], trainingSampleCount));
@@ -245,11 +285,23 @@ namespace CNTK
 #endif
 
 #ifdef _DEBUG
-            const auto& parameterValue = parameter.Value();
-            if (HasNan(parameterValue, "TrainOneEpoch/UpdateWeights/Learner::Update(): "))
-                LogicError("%ls has NaNs in parameter values after parameter update.", parameter.Uid().c_str());
+            UpdateNonFiniteFlag(smoothedGradientValue, nonFiniteFlags);
+            UpdateNonFiniteFlag(parameter.Value(), nonFiniteFlags);
 #endif
         }
+#ifdef _DEBUG
+        if (HasNonFiniteFlag(nonFiniteFlags))
+        {
+            for (const auto& parameter : Parameters())
+            {
+                if (HasNan(m_smoothedGradientValues.at(parameter), "TrainOneEpoch/UpdateWeights/Learner::Update(): "))
+                    LogicError("%ls has NaNs in smoothedGradient.", parameter.Uid().c_str());
+                if (HasNan(parameter.Value(), "TrainOneEpoch/UpdateWeights/Learner::Update(): "))
+                    LogicError("%ls has NaNs in parameter values after parameter update.", parameter.Uid().c_str());
+            }
+            LogicError("Learner::Update(): The parameters or smoothed gradients have infinite values after the parameter update.");
+        }
+#endif
         m_sampleCount += trainingSampleCount;
         m_minibatchCount++;
         return false;
@@ -264,6 +316,110 @@ namespace CNTK
         PostProcess<ElementType>(parameter, gradientValue, trainingSampleCount);
     }
 
+    bool LearnerBase::TryMultiTensorUpdate(const unordered_map<Parameter, NDArrayViewPtr>& gradientValues, size_t trainingSampleCount)
+    {
+        // noise injection, L1 regularization and clipping by the norm are not elementwise
+        if (m_additionalOptions.gaussianNoiseInjectionStdDev > 0 || m_additionalOptions.l1RegularizationWeight > 0 ||
+            (m_additionalOptions.gradientClippingThresholdPerSample != numeric_limits<double>::infinity() && !m_additionalOptions.gradientClippingWithTruncation))
+            return false;
+
+        vector<Parameter> parameters(Parameters().begin(), Parameters().end());
+        if (parameters.empty())
+            return false;
+
+        DataType dataType = parameters[0].GetDataType();
+        for (const auto& parameter : parameters)
+        {
+            if (parameter.GetDataType() != dataType || gradientValues.at(parameter)->IsSparse())
+                return false;
+        }
+
+        MultiTensorUpdateParams<double> params = {};
+        vector<double> adaMuls;
+        if (!GetMultiTensorUpdateParams(dataType, parameters.size(), trainingSampleCount, params, adaMuls))
+            return false;
+
+        // as in PreProcess(), multiplied by the minibatch size since the learning rate is per sample
+        params.m_gradientScale = 1;
+        params.m_clippingThreshold = m_additionalOptions.gradientClippingThresholdPerSample * trainingSampleCount;
+        if (m_additionalOptions.l2RegularizationWeight > 0)
+            params.m_l2Weight = m_additionalOptions.l2RegularizationWeight * trainingSampleCount;
+
+        if (dataType == DataType::Float)
+            MultiTensorUpdate<float>(parameters, gradientValues, params, adaMuls);
+        else if (dataType == DataType::Double)
+            MultiTensorUpdate<double>(parameters, gradientValues, params, adaMuls);
+        else
+            NOT_IMPLEMENTED;
+        return true;
+    }
+
+    template <typename ElementType>
+    void LearnerBase::MultiTensorUpdate(const vector<Parameter>& parameters, const unordered_map<Parameter, NDArrayViewPtr>& gradientValues,
+                                        const MultiTensorUpdateParams<double>& params, const vector<double>& adaMuls) const
+    {
+        MultiTensorUpdateParams<ElementType> typedParams;
+        typedParams.m_kind = params.m_kind;
+        typedParams.m_learningRate = ElementType(params.m_learningRate);
+        typedParams.m_momentum = ElementType(params.m_momentum);
+        typedParams.m_varMomentum = ElementType(params.m_varMomentum);
+        typedParams.m_rmsGamma = ElementType(params.m_rmsGamma);
+        typedParams.m_rmsInc = ElementType(params.m_rmsInc);
+        typedParams.m_rmsMax = ElementType(params.m_rmsMax);
+        typedParams.m_rmsDec = ElementType(params.m_rmsDec);
+        typedParams.m_rmsMin = ElementType(params.m_rmsMin);
+        typedParams.m_needAveMultiplier = params.m_needAveMultiplier;
+        typedParams.m_gradientScale = ElementType(params.m_gradientScale);
+        typedParams.m_clippingThreshold = ElementType(params.m_clippingThreshold);
+        typedParams.m_l2Weight = ElementType(params.m_l2Weight);
+
+#ifdef _DEBUG
+        const bool checkForNan = true;
+#else
+        const bool checkForNan = false;
+#endif
+
+        // one fused update for the parameters of each device
+        vector<bool> done(parameters.size(), false);
+        for (size_t first = 0; first < parameters.size(); first++)
+        {
+            if (done[first])
+                continue;
+
+            auto device = parameters[first].Value()->Device();
+            vector<size_t> group;
+            vector<shared_ptr<Matrix<ElementType>>> matrices; // (keeps the matrices of the views alive)
+            vector<Matrix<ElementType>*> smoothedGradients, gradients, values;
+            vector<ElementType> groupAdaMuls;
+            for (size_t k = first; k < parameters.size(); k++)
+            {
+                const auto& parameter = parameters[k];
+                if (done[k] || !(parameter.Value()->Device() == device))
+                    continue;
+
+                done[k] = true;
+                group.push_back(k);
+                matrices.push_back(GetWritableMatrix<ElementType>(m_smoothedGradientValues.at(parameter)));
+                smoothedGradients.push_back(matrices.back().get());
+                matrices.push_back(GetWritableMatrix<ElementType>(gradientValues.at(parameter)));
+                gradients.push_back(matrices.back().get());
+                matrices.push_back(GetWritableMatrix<ElementType>(parameter.Value()));
+                values.push_back(matrices.back().get());
+                if (!adaMuls.empty())
+                    groupAdaMuls.push_back(ElementType(adaMuls[k]));
+            }
+
+            if (Matrix<ElementType>::MultiTensorUpdate(typedParams, smoothedGradients, gradients, values, groupAdaMuls, checkForNan))
+            {
+                for (size_t k : group)
+                {
+                    if (HasNan(parameters[k].Value(), "TrainOneEpoch/UpdateWeights/Learner::Update(): "))
+                        LogicError("%ls has NaNs in parameter values after parameter update.", parameters[k].Uid().c_str());
+                }
+            }
+        }
+    }
+
     string LearnerBase::LearnerType() const
     {
         auto name = typeid(*this).name(); 
@@ -375,6 +531,15 @@ namespace CNTK
                                            learningRate, momentum, m_useNesterovAcceleration);
     }
 
+    /*virtual*/ bool LearnerSGD::GetMultiTensorUpdateParams(DataType /*dataType*/, size_t /*numParameters*/, size_t trainingSampleCount,
+                                                            MultiTensorUpdateParams<double>& params, vector<double>& /*adaMuls*/) const /*override*/
+    {
+        params.m_kind = m_useNesterovAcceleration ? MultiTensorUpdateKind::Nesterov : MultiTensorUpdateKind::MomentumSGD;
+        params.m_learningRate = LearningRate();
+        params.m_momentum = MomentumPerMB(m_momentums[m_sampleCount], trainingSampleCount);
+        return true;
+    }
+
     LearnerAdaGrad::LearnerAdaGrad(const vector<Parameter>& parameters,
                                    const LearningRatesPerSample& learningRates,
                                    bool needAveMultiplier,
@@ -406,6 +571,15 @@ namespace CNTK
         Matrix<ElementType>::ScaleAndAdd(ElementType(-learningRate / aveMultiplier), *gradientMatrix, *parameterMatrix);
     }
 
+    /*virtual*/ bool LearnerAdaGrad::GetMultiTensorUpdateParams(DataType /*dataType*/, size_t /*numParameters*/, size_t /*trainingSampleCount*/,
+                                                                MultiTensorUpdateParams<double>& params, vector<double>& /*adaMuls*/) const /*override*/
+    {
+        params.m_kind = MultiTensorUpdateKind::AdaGrad;
+        params.m_learningRate = LearningRate();
+        params.m_needAveMultiplier = m_needAveMultiplier;
+        return true;
+    }
+
     LearnerFSAdaGrad::LearnerFSAdaGrad(const vector<Parameter>& parameters,
                                        const LearningRatesPerSample& learningRates, 
                                        const MomentumsPerSample& momentums,
@@ -421,6 +595,17 @@ namespace CNTK
         }
     }
 
+    static const double FSAdaGradTargetAvDenom = 0.0025; // 1/400 magic constant
+    static const size_t FSAdaGradTimeConstant = 2 * 3600 * 100;
+
+    // BUGBUG!!! Carried over from Alexey's original implementation (shared by all FSAdaGrad learners), needs to be fixed.
+    template <typename ElementType>
+    static double& FSAdaGradSmoothedCount()
+    {
+        static double smoothedCount = 0;
+        return smoothedCount;
+    }
+
     /*virtual*/ void LearnerFSAdaGrad::Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const /*override*/
     {
         UPDATE_FUNCTION;
@@ -439,13 +624,28 @@ namespace CNTK
         auto learningRate = LearningRate();
         auto momentum = MomentumPerMB(m_momentums[m_sampleCount], trainingSampleCount);
 
-        const double targetAdagradAvDenom = 0.0025; // 1/400 magic constant
-        const size_t adagradT = 2 * 3600 * 100;
+        const double varMomentum = (exp(-1.0 * trainingSampleCount / FSAdaGradTimeConstant));
+        double& smoothedCount = FSAdaGradSmoothedCount<ElementType>();
 
-        const double varMomentum = (exp(-1.0 * trainingSampleCount / adagradT));
-        static double smoothedCount = 0;  // BUGBUG!!! Carried over from Alexey's original implementation, needs to be fixed.
+        smoothedGradientMatrix->FSAdagradUpdate(trainingSampleCount, *gradientMatrix, *parameterMatrix, smoothedCount, learningRate, FSAdaGradTargetAvDenom, momentum, varMomentum);
+    }
+
+    /*virtual*/ bool LearnerFSAdaGrad::GetMultiTensorUpdateParams(DataType dataType, size_t numParameters, size_t trainingSampleCount,
+                                                                  MultiTensorUpdateParams<double>& params, vector<double>& adaMuls) const /*override*/
+    {
+        params.m_kind = MultiTensorUpdateKind::FSAdaGrad;
+        params.m_learningRate = LearningRate();
+        params.m_momentum = MomentumPerMB(m_momentums[m_sampleCount], trainingSampleCount);
+        params.m_varMomentum = exp(-1.0 * trainingSampleCount / FSAdaGradTimeConstant);
 
-        smoothedGradientMatrix->FSAdagradUpdate(trainingSampleCount, *gradientMatrix, *parameterMatrix, smoothedCount, learningRate, targetAdagradAvDenom, momentum, varMomentum);
+        // the multiplier that FSAdagradUpdate() computes, and the count it advances, once for every parameter
+        double& smoothedCount = dataType == DataType::Float ? FSAdaGradSmoothedCount<float>() : FSAdaGradSmoothedCount<double>();
+        for (size_t k = 0; k < numParameters; k++)
+        {
+            smoothedCount = params.m_varMomentum * smoothedCount + (1.0 - params.m_varMomentum) * trainingSampleCount;
+            adaMuls.push_back(FSAdaGradTargetAvDenom * sqrt(smoothedCount));
+        }
+        return true;
     }
 
     LearnerRMSProp::LearnerRMSProp(const vector<Parameter>& parameters, const LearningRatesPerSample& learningRates,
@@ -496,6 +696,20 @@ namespace CNTK
         Matrix<ElementType>::ScaleAndAdd(ElementType(-learningRate / aveMultiplier), *gradientMatrix, *parameterMatrix);
     }
 
+    /*virtual*/ bool LearnerRMSProp::GetMultiTensorUpdateParams(DataType /*dataType*/, size_t /*numParameters*/, size_t /*trainingSampleCount*/,
+                                                                MultiTensorUpdateParams<double>& params, vector<double>& /*adaMuls*/) const /*override*/
+    {
+        params.m_kind = MultiTensorUpdateKind::RmsProp;
+        params.m_learningRate = LearningRate();
+        params.m_rmsGamma = m_gamma;
+        params.m_rmsInc = m_inc;
+        params.m_rmsMax = m_max;
+        params.m_rmsDec = m_dec;
+        params.m_rmsMin = m_min;
+        params.m_needAveMultiplier = m_needAveMultiplier;
+        return true;
+    }
+
     // Explicit template instantiations
     template shared_ptr<Matrix<float>> LearnerBase::GetWritableMatrix<float>(const NDArrayViewPtr& arrayView);
     template shared_ptr<Matrix<double>> LearnerBase::GetWritableMatrix<double>(const NDArrayViewPtr& arrayView);
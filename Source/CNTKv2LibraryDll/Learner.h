@@ -5,6 +5,7 @@
 
 #include "stdafx.h"
 #include "CNTKLibrary.h"
+#include "MultiTensorUpdate.h"
 #include <numeric>
 
 namespace CNTK 
@@ -58,6 +59,15 @@ namespace CNTK
 
         virtual void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const = 0;
 
+        // If the update above is one that Matrix::MultiTensorUpdate() can apply to all parameters at once, fills in its kind
+        // and learner-specific scalars (the caller adds clipping and L2 regularization) and returns true.
+        // FSAdaGrad also appends one multiplier for each of 'numParameters' parameters.
+        virtual bool GetMultiTensorUpdateParams(DataType /*dataType*/, size_t /*numParameters*/, size_t /*trainingSampleCount*/,
+                                                Microsoft::MSR::CNTK::MultiTensorUpdateParams<double>& /*params*/, std::vector<double>& /*adaMuls*/) const
+        {
+            return false;
+        }
+
         std::string LearnerType() const;
 
         bool m_wasLearningRateReset;
@@ -110,10 +120,23 @@ namespace CNTK
         template <typename ElementType>
         void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const;
 
+        // Updates all parameters with one fused update per device instead of one update per parameter, if the learner,
+        // the additional options and the gradients allow it; returns false (and does nothing) otherwise.
+        bool TryMultiTensorUpdate(const std::unordered_map<Parameter, NDArrayViewPtr>& gradientValues, size_t trainingSampleCount);
+
+        template <typename ElementType>
+        void MultiTensorUpdate(const std::vector<Parameter>& parameters, const std::unordered_map<Parameter, NDArrayViewPtr>& gradientValues,
+                               const Microsoft::MSR::CNTK::MultiTensorUpdateParams<double>& params, const std::vector<double>& adaMuls) const;
+
         // TODO: make these functions friends of NDViewArray and move to Utils?
         static bool HasNan(const NDArrayViewPtr& value, const char* name);
         static void Print(const NDArrayViewPtr& value, const char* msg);
 
+        // Sets the flag in 'flags' (one per device and data type, created as needed) if 'value' has NaN or Inf values.
+        // This does not wait for the device; only HasNonFiniteFlag() reads the flags back.
+        static void UpdateNonFiniteFlag(const NDArrayViewPtr& value, std::vector<NDArrayViewPtr>& flags);
+        static bool HasNonFiniteFlag(const std::vector<NDArrayViewPtr>& flags);
+
         static const size_t checkpointVersion = 1;
     };
 
@@ -134,6 +157,8 @@ namespace CNTK
     protected:
 
         virtual void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const override;
+        virtual bool GetMultiTensorUpdateParams(DataType dataType, size_t numParameters, size_t trainingSampleCount,
+                                                Microsoft::MSR::CNTK::MultiTensorUpdateParams<double>& params, std::vector<double>& adaMuls) const override;
 
         template <typename ElementType>
         void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const;
@@ -189,6 +214,8 @@ namespace CNTK
         bool m_needAveMultiplier;
 
         virtual void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const override;
+        virtual bool GetMultiTensorUpdateParams(DataType dataType, size_t numParameters, size_t trainingSampleCount,
+                                                Microsoft::MSR::CNTK::MultiTensorUpdateParams<double>& params, std::vector<double>& adaMuls) const override;
 
         template <typename ElementType>
         void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const;
@@ -207,6 +234,8 @@ namespace CNTK
     protected:
 
         virtual void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const override;
+        virtual bool GetMultiTensorUpdateParams(DataType dataType, size_t numParameters, size_t trainingSampleCount,
+                                                Microsoft::MSR::CNTK::MultiTensorUpdateParams<double>& params, std::vector<double>& adaMuls) const override;
 
         template <typename ElementType>
         void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const;
@@ -233,6 +262,8 @@ namespace CNTK
         bool m_needAveMultiplier;
 
         virtual void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const override;
+        virtual bool GetMultiTensorUpdateParams(DataType dataType, size_t numParameters, size_t trainingSampleCount,
+                                                Microsoft::MSR::CNTK::MultiTensorUpdateParams<double>& params, std::vector<double>& adaMuls) const override;
 
         template <typename ElementType>
         void Update(const Parameter& parameter, const NDArrayViewPtr& gradientValue, const NDArrayViewPtr& smoothedGradientValue, size_t trainingSampleCount) const;
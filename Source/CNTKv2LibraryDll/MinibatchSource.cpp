@@ -13,6 +13,7 @@
 #include "Function.h"
 #include <tuple>
 #include "Value.h"
+#include "TimerUtility.h"
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -23,6 +24,16 @@ namespace CNTK
         return GetNextMinibatch(0, minibatchSizeInSamples, device);
     }
 
+    /*virtual*/ void MinibatchSource::StartDistributedMinibatchLoop(size_t /*numberOfWorkers*/, size_t /*workerRank*/)
+    {
+        LogicError("StartDistributedMinibatchLoop: This MinibatchSource does not support distributed reading");
+    }
+
+    /*virtual*/ MinibatchSourceStatistics MinibatchSource::GetAndResetStatistics()
+    {
+        return {};
+    }
+
     const StreamInformation& MinibatchSource::StreamInfo(const std::wstring& streamName)
     {
         std::unordered_set<const StreamInformation*> matchingStreamInfos;
@@ -68,7 +79,8 @@ namespace CNTK
     }
 
     CompositeMinibatchSource::CompositeMinibatchSource(const Dictionary& configuration)
-        : m_epochEndReached(false), m_prevMinibatchSize(0), m_epochSize(SIZE_MAX)
+        : m_epochEndReached(false), m_prevMinibatchSize(0), m_epochSize(SIZE_MAX), m_numberOfWorkers(1), m_workerRank(0),
+          m_device(DeviceDescriptor::CPUDevice()), m_launchType(std::launch::async), m_prefetchDepth(1), m_currentSlot(0), m_statistics()
     {
         // The CNTK reader implementation requires for each deserializer both the module and deserializer type be specified
         // This is redundant and the V2 API users will just specify type from which the module is automatically inferred
@@ -127,6 +139,19 @@ namespace CNTK
         if (m_epochSize == 0)
             m_epochSize = Microsoft::MSR::CNTK::requestDataSize;
 
+        // The same prefetch settings as those of the ReaderShim
+        const wchar_t* prefetchConfigurationKey = L"prefetch";
+        if (augmentedConfiguration.Contains(prefetchConfigurationKey) && !augmentedConfiguration[prefetchConfigurationKey].Value<bool>())
+            m_launchType = std::launch::deferred;
+
+        const wchar_t* prefetchDepthConfigurationKey = L"minibatchPrefetchDepth";
+        if (augmentedConfiguration.Contains(prefetchDepthConfigurationKey))
+            m_prefetchDepth = augmentedConfiguration[prefetchDepthConfigurationKey].Value<size_t>();
+
+        if (m_prefetchDepth == 0)
+            InvalidArgument("CompositeMinibatchSource: minibatchPrefetchDepth must be at least 1");
+        m_prefetchTasks.resize(m_prefetchDepth);
+
         typedef Reader*(*CreateCompositeDataReaderProc)(const ConfigParameters* parameters);
         CreateCompositeDataReaderProc createReaderProc = (CreateCompositeDataReaderProc)Plugin().Load(L"CompositeDataReader", "CreateCompositeDataReader");
         m_compositeDataReader.reset(createReaderProc(&config));
@@ -136,6 +161,35 @@ namespace CNTK
             m_streamInfos.insert({ streamDesc->m_name, streamDesc->m_id, AsStorageFormat(streamDesc->m_storageType), AsDataType(streamDesc->m_elementType), AsNDShape(*(streamDesc->m_sampleLayout)) });
     }
 
+    /*virtual*/ void CompositeMinibatchSource::StartDistributedMinibatchLoop(size_t numberOfWorkers, size_t workerRank) /*override*/
+    {
+        if (m_prevMinibatchSize != 0)
+            LogicError("StartDistributedMinibatchLoop: Must be called before the first GetNextMinibatch call");
+
+        if ((numberOfWorkers == 0) || (workerRank >= numberOfWorkers))
+            InvalidArgument("StartDistributedMinibatchLoop: Worker rank %d is out of range for %d workers", (int)workerRank, (int)numberOfWorkers);
+
+        m_numberOfWorkers = numberOfWorkers;
+        m_workerRank = workerRank;
+    }
+
+    CompositeMinibatchSource::~CompositeMinibatchSource()
+    {
+        // The prefetch tasks use 'this'
+        for (const auto& prefetchTask : m_prefetchTasks)
+        {
+            if (prefetchTask.valid())
+                prefetchTask.wait();
+        }
+    }
+
+    /*virtual*/ MinibatchSourceStatistics CompositeMinibatchSource::GetAndResetStatistics() /*override*/
+    {
+        auto statistics = m_statistics;
+        m_statistics = {};
+        return statistics;
+    }
+
     /*virtual*/ const std::unordered_map<StreamInformation, MinibatchData>&
     CompositeMinibatchSource::GetNextMinibatch(size_t minibatchSizeInSequences,
                                                size_t minibatchSizeInSamples,
@@ -153,8 +207,7 @@ namespace CNTK
 
             if (m_prevMinibatchSize == 0)
             {
-                // TODO: Add support for distributed reading
-                EpochConfiguration epochConfig = { 1, 0, minibatchSizeInSamples, m_epochSize, 0, 0 };
+                EpochConfiguration epochConfig = { m_numberOfWorkers, m_workerRank, minibatchSizeInSamples, m_epochSize, 0, 0 };
 
                 std::map<std::wstring, int> requiredStreams;
                 for (const auto& s : m_streamInfos)
@@ -163,59 +216,121 @@ namespace CNTK
 
                 m_compositeDataReader->StartEpoch(epochConfig, requiredStreams);
                 m_prevMinibatchSize = minibatchSizeInSamples;
+
+                // The minibatches are produced on 'device' ahead of time. Each upload in flight needs a staging buffer of its
+                // own: those of the prefetched minibatches and of the one the compute stream is waiting for.
+                m_device = device;
+                if (m_device.Type() != DeviceKind::CPU)
+                    m_stagingBuffers.reset(new InputStagingBuffers(m_device.Id(), (m_prefetchDepth + 1) * m_streamInfos.size()));
+
+                for (size_t slot = 0; slot < m_prefetchDepth; ++slot)
+                    StartPrefetch(slot);
             }
 
             if (minibatchSizeInSamples != m_prevMinibatchSize)
                 LogicError("GetNextMinibatch: Changing minibatch sizes across calls is currently unsupported");
 
-            auto compositeReaderMinibatchData = m_compositeDataReader->ReadMinibatch();
-            m_epochEndReached = compositeReaderMinibatchData.m_endOfEpoch;
+            if (device != m_device)
+                LogicError("GetNextMinibatch: Changing the device across calls is currently unsupported");
+
+            auto& prefetchTask = m_prefetchTasks[m_currentSlot];
+            bool isReady = (prefetchTask.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+            Timer waitTimer;
+            waitTimer.Start();
+            PrefetchedMinibatch prefetchedMinibatch = prefetchTask.get();
+            waitTimer.Stop();
+            m_statistics.m_numMinibatches++;
+            m_statistics.m_numReadyMinibatches += isReady ? 1 : 0;
+            m_statistics.m_waitSeconds += waitTimer.ElapsedSeconds();
+
+            // Everything issued on the compute stream after this waits for the uploads of the minibatch
+            for (const auto& transferer : prefetchedMinibatch.m_transferers)
+                transferer->WaitForCopyCPUToGPUOnComputeStreamAsync();
+
+            m_epochEndReached = prefetchedMinibatch.m_isEndOfEpoch;
+            m_minibatchData = std::move(prefetchedMinibatch.m_minibatchData);
+
+            if (!m_epochEndReached)
+                StartPrefetch(m_currentSlot);
+            m_currentSlot = (m_currentSlot + 1) % m_prefetchDepth;
+        }
 
-            auto& streamInfos = StreamInfos();
-            auto compositeDataReaderStreamDescs = m_compositeDataReader->GetStreamDescriptions();
-            size_t numStreams = compositeDataReaderStreamDescs.size();
-            for (size_t i = 0; i < numStreams; ++i)
-            {
-                auto currentStreamDesc = compositeDataReaderStreamDescs[i];
-                auto iter = std::find_if(streamInfos.begin(), streamInfos.end(), [currentStreamDesc](const StreamInformation& streamInfo) {
-                    return streamInfo.m_id == currentStreamDesc->m_id;
-                });
+        return m_minibatchData;
+    }
 
-                if (iter == streamInfos.end())
-                    continue;
+    void CompositeMinibatchSource::StartPrefetch(size_t slot)
+    {
+        // Tasks are started in the order of their minibatches, so the previous one is in the slot before this.
+        auto previousTask = m_prefetchTasks[(slot + m_prefetchDepth - 1) % m_prefetchDepth];
+        m_prefetchTasks[slot] = std::async(m_launchType, [this, previousTask]()
+        {
+            // The reader is not thread safe, and the minibatches have to be read in order.
+            if (previousTask.valid() && previousTask.get().m_isEndOfEpoch)
+                return PrefetchedMinibatch{ {}, true, {} };
+            return ReadMinibatch();
+        }).share();
+    }
 
-                auto& currentStreamInfo = *iter;
-                auto sampleShape = AsNDShape(*(currentStreamDesc->m_sampleLayout));
+    CompositeMinibatchSource::PrefetchedMinibatch CompositeMinibatchSource::ReadMinibatch()
+    {
+        PrefetchedMinibatch prefetchedMinibatch;
+        auto compositeReaderMinibatchData = m_compositeDataReader->ReadMinibatch();
+        prefetchedMinibatch.m_isEndOfEpoch = compositeReaderMinibatchData.m_endOfEpoch;
 
-                ValuePtr minibatchValuePtr;
-                if (compositeReaderMinibatchData.m_data.empty())
-                {
-                    minibatchValuePtr = MakeSharedObject<Value>(MakeSharedObject<NDArrayView>(currentStreamInfo.m_elementType, sampleShape.AppendShape({ 0, 0 }), DeviceDescriptor::CPUDevice()));
-                    continue;
-                }
+        auto& streamInfos = StreamInfos();
+        auto compositeDataReaderStreamDescs = m_compositeDataReader->GetStreamDescriptions();
+        size_t numStreams = compositeDataReaderStreamDescs.size();
+        for (size_t i = 0; i < numStreams; ++i)
+        {
+            auto currentStreamDesc = compositeDataReaderStreamDescs[i];
+            auto iter = std::find_if(streamInfos.begin(), streamInfos.end(), [currentStreamDesc](const StreamInformation& streamInfo) {
+                return streamInfo.m_id == currentStreamDesc->m_id;
+            });
 
-                auto currentStreamMinibatchData = compositeReaderMinibatchData.m_data[i];
-                if (currentStreamDesc->m_elementType == ElementType::tfloat)
-                {
-                    auto CNTKMatrixType = (currentStreamDesc->m_storageType == StorageType::dense) ? DENSE : SPARSE;
-                    auto CNTKMatrixFormat = (currentStreamDesc->m_storageType == StorageType::dense) ? matrixFormatDense : matrixFormatSparseCSC;
-                    auto dataMatrix = std::make_shared<Matrix<float>>(0, 0, CPUDEVICE, CNTKMatrixType, CNTKMatrixFormat);
-                    size_t sampleSize = currentStreamDesc->m_sampleLayout->GetNumElements();
+            if (iter == streamInfos.end())
+                continue;
 
-                    // TODO: Eliminate the unnecessary CPU to CPU copy
-                    ReaderShim<float>::FillMatrixFromStream(currentStreamDesc->m_storageType, dataMatrix.get(), sampleSize, currentStreamMinibatchData, nullptr);
-                    minibatchValuePtr = MakeSharedObject<PackedValue>(sampleShape, dataMatrix, currentStreamMinibatchData->m_layout, /*readOnly =*/ false);
+            auto& currentStreamInfo = *iter;
+            auto sampleShape = AsNDShape(*(currentStreamDesc->m_sampleLayout));
 
-                    size_t numSamples = currentStreamMinibatchData->m_layout->GetActualNumSamples();
-                    size_t numSequences = currentStreamMinibatchData->m_layout->GetNumSequences();
+            ValuePtr minibatchValuePtr;
+            if (compositeReaderMinibatchData.m_data.empty())
+            {
+                minibatchValuePtr = MakeSharedObject<Value>(MakeSharedObject<NDArrayView>(currentStreamInfo.m_elementType, sampleShape.AppendShape({ 0, 0 }), DeviceDescriptor::CPUDevice()));
+                continue;
+            }
 
-                    m_minibatchData[currentStreamInfo] = { numSequences, numSamples, minibatchValuePtr };
+            auto currentStreamMinibatchData = compositeReaderMinibatchData.m_data[i];
+            if (currentStreamDesc->m_elementType == ElementType::tfloat)
+            {
+                auto CNTKMatrixType = (currentStreamDesc->m_storageType == StorageType::dense) ? DENSE : SPARSE;
+                auto CNTKMatrixFormat = (currentStreamDesc->m_storageType == StorageType::dense) ? matrixFormatDense : matrixFormatSparseCSC;
+                auto dataMatrix = std::make_shared<Matrix<float>>(0, 0, CPUDEVICE, CNTKMatrixType, CNTKMatrixFormat);
+                size_t sampleSize = currentStreamDesc->m_sampleLayout->GetNumElements();
+
+                // TODO: Eliminate the unnecessary CPU to CPU copy
+                ReaderShim<float>::FillMatrixFromStream(currentStreamDesc->m_storageType, dataMatrix.get(), sampleSize, currentStreamMinibatchData, nullptr);
+                if (m_stagingBuffers && (CNTKMatrixType == DENSE))
+                {
+                    // On its own stream, so that the copy overlaps with the compute of the minibatches before
+                    auto deviceMatrix = std::make_shared<Matrix<float>>(0, 0, m_stagingBuffers->GetDeviceId());
+                    prefetchedMinibatch.m_transferers.push_back(m_stagingBuffers->StartUpload(*dataMatrix, *deviceMatrix, /*targetInUse =*/ false));
+                    dataMatrix = deviceMatrix;
                 }
-                else
-                    LogicError("Input data of type other than DataType::Float is currently unsupported by the CNTK built-in composite MinibatchSource!");
+                else if (m_stagingBuffers)
+                    dataMatrix->TransferToDeviceIfNotThere(m_stagingBuffers->GetDeviceId(), /*isBeingMoved =*/ true);
+
+                minibatchValuePtr = MakeSharedObject<PackedValue>(sampleShape, dataMatrix, currentStreamMinibatchData->m_layout, /*readOnly =*/ false);
+
+                size_t numSamples = currentStreamMinibatchData->m_layout->GetActualNumSamples();
+                size_t numSequences = currentStreamMinibatchData->m_layout->GetNumSequences();
+
+                prefetchedMinibatch.m_minibatchData[currentStreamInfo] = { numSequences, numSamples, minibatchValuePtr };
             }
+            else
+                LogicError("Input data of type other than DataType::Float is currently unsupported by the CNTK built-in composite MinibatchSource!");
         }
 
-        return m_minibatchData;
+        return prefetchedMinibatch;
     }
 }
@@ -9,6 +9,8 @@
 #include "CNTKLibrary.h"
 #include "Utils.h"
 #include "Reader.h"
+#include "Function.h"
+#include <future>
 
 namespace CNTK
 {
@@ -16,6 +18,7 @@ namespace CNTK
     {
     public:
         CompositeMinibatchSource(const Dictionary& configuration);
+        ~CompositeMinibatchSource();
 
         virtual const std::unordered_set<StreamInformation>& StreamInfos() override { return m_streamInfos; }
 
@@ -23,12 +26,40 @@ namespace CNTK
                                                                                              size_t minibatchSizeInSequences,
                                                                                              const DeviceDescriptor& device = DeviceDescriptor::UseDefaultDevice()) override;
 
+        virtual void StartDistributedMinibatchLoop(size_t numberOfWorkers, size_t workerRank) override;
+
+        virtual MinibatchSourceStatistics GetAndResetStatistics() override;
+
+        size_t NumberOfWorkers() const { return m_numberOfWorkers; }
+
     private: 
+        // A minibatch read on the prefetch thread, with its data already on the device of the GetNextMinibatch calls
+        struct PrefetchedMinibatch
+        {
+            std::unordered_map<StreamInformation, MinibatchData> m_minibatchData;
+            bool m_isEndOfEpoch;
+            std::vector<Microsoft::MSR::CNTK::DataTransfererPtr> m_transferers; // of the uploads still in flight
+        };
+
+        void StartPrefetch(size_t slot);
+        PrefetchedMinibatch ReadMinibatch();
+
         std::unordered_set<StreamInformation> m_streamInfos;
         std::shared_ptr<Microsoft::MSR::CNTK::Reader> m_compositeDataReader;
         bool m_epochEndReached;
         size_t m_prevMinibatchSize;
         size_t m_epochSize;
+        size_t m_numberOfWorkers;
+        size_t m_workerRank;
         std::unordered_map<StreamInformation, MinibatchData> m_minibatchData;
+
+        // There are always m_prefetchDepth minibatches read ahead, one after another (see ReaderShim)
+        DeviceDescriptor m_device;
+        std::unique_ptr<InputStagingBuffers> m_stagingBuffers; // (GPU devices only)
+        std::launch m_launchType;
+        size_t m_prefetchDepth;
+        std::vector<std::shared_future<PrefetchedMinibatch>> m_prefetchTasks;
+        size_t m_currentSlot;
+        MinibatchSourceStatistics m_statistics;
     };
 }
@@ -84,6 +84,8 @@ namespace CNTK
     NDArrayView::NDArrayView(CNTK::DataType dataType, const NDShape& viewShape, void* dataBuffer, size_t bufferSizeInBytes, const DeviceDescriptor& device, bool readOnly/* = false*/)
         : NDArrayView(dataType, device, StorageFormat::Dense, viewShape, readOnly, AllocateTensorView(dataType, viewShape, device, dataBuffer, bufferSizeInBytes))
     {
+        // The caller can write to the buffer without our knowledge
+        m_storageVersion = nullptr;
     }
 
     template <typename ElementType>
@@ -99,7 +101,8 @@ namespace CNTK
     }
 
     NDArrayView::NDArrayView(CNTK::DataType dataType, const DeviceDescriptor& device, CNTK::StorageFormat storageType, const NDShape& viewShape, bool readOnly, void* tensorView)
-        : m_dataType(dataType), m_device(device), m_storageFormat(storageType), m_viewShape(viewShape), m_isReadOnly(readOnly)
+        : m_dataType(dataType), m_device(device), m_storageFormat(storageType), m_viewShape(viewShape), m_isReadOnly(readOnly),
+          m_storageVersion(std::make_shared<size_t>(Internal::NewUniqueId()))
     {
         m_tensorView = std::shared_ptr<void>(tensorView, [this](void*) {
             switch (m_dataType)
@@ -131,6 +134,13 @@ namespace CNTK
         if (IsSparse())
             LogicError("Filling a NDArrayView with a scalar is only allowed for NDArrayView objects with dense storage format");
 
+        if (!IsContiguous())
+        {
+            NDArrayView scalar(value, NDShape({ 1 }), Device());
+            CopyFrom(*scalar.BroadcastView(Shape()));
+            return;
+        }
+
         GetWritableMatrix<float>()->SetValue(value);
     }
 
@@ -139,6 +149,13 @@ namespace CNTK
         if (IsSparse())
             LogicError("Filling a NDArrayView with a scalar is only allowed for NDArrayView objects with dense storage format");
 
+        if (!IsContiguous())
+        {
+            NDArrayView scalar(value, NDShape({ 1 }), Device());
+            CopyFrom(*scalar.BroadcastView(Shape()));
+            return;
+        }
+
         GetWritableMatrix<double>()->SetValue(value);
     }
 
@@ -185,12 +202,19 @@ namespace CNTK
     template <typename ElementType>
     std::shared_ptr<const Matrix<ElementType>> NDArrayView::GetMatrix(size_t rowColSplitPoint/* = AutoSelectRowColSplitPoint*/) const
     {
+        // There is no Matrix over the elements of a strided view, so readers get a contiguous copy
+        if (!IsContiguous())
+            return DeepClone()->GetMatrix<ElementType>(rowColSplitPoint);
+
         return GetMatrixImpl<ElementType>(GetTensorView<ElementType>(), rowColSplitPoint);
     }
 
     template <typename ElementType>
     std::shared_ptr<Matrix<ElementType>> NDArrayView::GetWritableMatrix(size_t rowColSplitPoint/* = AutoSelectRowColSplitPoint*/)
     {
+        if (!IsContiguous())
+            InvalidArgument("NDArrayView::GetWritableMatrix: A NDArrayView that is not contiguous in memory cannot be written as a Matrix");
+
         return GetMatrixImpl<ElementType>(GetWritableTensorView<ElementType>(), rowColSplitPoint);
     }
 
@@ -209,11 +233,66 @@ namespace CNTK
         if (IsReadOnly())
             InvalidArgument("NDArrayView::GetWritableTensorView: Cannot get writable TensorView from a read-only NDArrayView");
 
+        BumpStorageVersion();
         return const_cast<TensorView<ElementType>*>(GetTensorView<ElementType>());
     }
 
+    void NDArrayView::BumpStorageVersion()
+    {
+        if (m_storageVersion)
+            *m_storageVersion = Internal::NewUniqueId();
+    }
+
+    const TensorShape& NDArrayView::GetTensorShape() const
+    {
+        switch (m_dataType)
+        {
+        case DataType::Float:
+            return GetTensorView<float>()->GetShape();
+        case DataType::Double:
+            return GetTensorView<double>()->GetShape();
+        default:
+            LogicError("Unsupported DataType %s", DataTypeName(m_dataType));
+        }
+    }
+
+    // A Matrix over the elements of a view is a column slice of the storage object,
+    // so a dense view must also begin and end at a column boundary of that (e.g. not a slice of a vector)
+    template <typename ElementType>
+    static bool IsMatrixSlice(const TensorView<ElementType>& tensorView)
+    {
+        const auto& tensorShape = tensorView.GetShape();
+        size_t numStorageRows = tensorView.GetSOB().GetNumRows();
+        return tensorShape.IsDense() && (tensorShape.GetOffset() % numStorageRows == 0) && (tensorShape.GetNumElements() % numStorageRows == 0);
+    }
+
+    bool NDArrayView::IsContiguous() const
+    {
+        switch (m_dataType)
+        {
+        case DataType::Float:
+            return IsMatrixSlice(*GetTensorView<float>());
+        case DataType::Double:
+            return IsMatrixSlice(*GetTensorView<double>());
+        default:
+            LogicError("Unsupported DataType %s", DataTypeName(m_dataType));
+        }
+    }
+
     NDArrayViewPtr NDArrayView::DeepClone(const DeviceDescriptor& device, bool readOnly/* = false*/) const
     {
+        if (!IsContiguous())
+        {
+            // Strided views are compacted elementwise on their own device (see CopyFrom)
+            NDArrayViewPtr denseView = MakeSharedObject<NDArrayView>(this->GetDataType(), this->GetStorageFormat(), this->Shape(), this->Device());
+            denseView->CopyFrom(*this);
+            if (device != this->Device())
+                return denseView->DeepClone(device, readOnly);
+
+            denseView->m_isReadOnly = readOnly;
+            return denseView;
+        }
+
         NDArrayViewPtr newView = MakeSharedObject<NDArrayView>(this->GetDataType(), this->GetStorageFormat(), this->Shape(), device);
         switch (m_dataType)
         {
@@ -248,6 +327,30 @@ namespace CNTK
         if (IsReadOnly())
             RuntimeError("NDArrayView::CopyFrom: Cannot modify contents of a readonly NDArrayView");
 
+        if (!IsContiguous() || !source.IsContiguous())
+        {
+            // A TensorView copy follows the strides of both views; it needs both on the same device
+            if (source.Device() != Device())
+            {
+                CopyFrom(*source.DeepClone(Device()));
+                return;
+            }
+
+            switch (m_dataType)
+            {
+            case DataType::Float:
+                GetWritableTensorView<float>()->AssignCopyOf(*source.GetTensorView<float>());
+                break;
+            case DataType::Double:
+                GetWritableTensorView<double>()->AssignCopyOf(*source.GetTensorView<double>());
+                break;
+            default:
+                LogicError("Unsupported DataType %s", DataTypeName(m_dataType));
+                break;
+            }
+            return;
+        }
+
         switch (m_dataType)
         {
         case DataType::Float:
@@ -286,7 +389,106 @@ namespace CNTK
             break;
         }
 
-        return MakeSharedObject<NDArrayView>(GetDataType(), Device(), GetStorageFormat(), Shape(), IsReadOnly() || readOnly, tensorView);
+        auto aliasView = MakeSharedObject<NDArrayView>(GetDataType(), Device(), GetStorageFormat(), Shape(), IsReadOnly() || readOnly, tensorView);
+        aliasView->m_storageVersion = m_storageVersion;
+        return aliasView;
+    }
+
+    NDArrayViewPtr NDArrayView::ViewWithTensorShape(const NDShape& viewShape, const TensorShape& tensorShape, bool readOnly) const
+    {
+        void* tensorView = nullptr;
+        switch (m_dataType)
+        {
+        case DataType::Float:
+            tensorView = new TensorView<float>(*(GetTensorView<float>()), tensorShape);
+            break;
+        case DataType::Double:
+            tensorView = new TensorView<double>(*(GetTensorView<double>()), tensorShape);
+            break;
+        default:
+            LogicError("Unsupported DataType %s", DataTypeName(m_dataType));
+            break;
+        }
+
+        auto view = MakeSharedObject<NDArrayView>(GetDataType(), Device(), GetStorageFormat(), viewShape, IsReadOnly() || readOnly, tensorView);
+        view->m_storageVersion = m_storageVersion;
+        return view;
+    }
+
+    NDArrayViewPtr NDArrayView::SliceView(const std::vector<size_t>& startOffset, const std::vector<size_t>& extent, bool readOnly/* = false*/) const
+    {
+        if (IsSparse())
+            InvalidArgument("NDArrayView::SliceView: Only NDArrayView objects with dense storage format can be sliced");
+
+        auto rank = Shape().Rank();
+        if ((startOffset.size() != rank) || (extent.size() != rank))
+            InvalidArgument("NDArrayView::SliceView: The rank of the startOffset (%d) and extent (%d) must match the rank (%d) of the NDArrayView", (int)startOffset.size(), (int)extent.size(), (int)rank);
+
+        auto tensorShape = GetTensorShape();
+        for (size_t i = 0; i < rank; ++i)
+        {
+            if ((extent[i] == 0) || (startOffset[i] + extent[i] > Shape()[i]))
+                InvalidArgument("NDArrayView::SliceView: The section [%d, %d) of axis %d is out of bounds or empty for the NDArrayView of shape %S",
+                                (int)startOffset[i], (int)(startOffset[i] + extent[i]), (int)i, AsStringForErrorReporting(Shape()).c_str());
+
+            tensorShape.NarrowTo(i, startOffset[i], startOffset[i] + extent[i]);
+        }
+
+        return ViewWithTensorShape(NDShape(extent), tensorShape, readOnly);
+    }
+
+    NDArrayViewPtr NDArrayView::TransposeAxesView(size_t axis1, size_t axis2, bool readOnly/* = false*/) const
+    {
+        if (IsSparse())
+            InvalidArgument("NDArrayView::TransposeAxesView: Only NDArrayView objects with dense storage format can be transposed");
+
+        auto rank = Shape().Rank();
+        if ((axis1 >= rank) || (axis2 >= rank))
+            InvalidArgument("NDArrayView::TransposeAxesView: The axes %d and %d must be less than the rank (%d) of the NDArrayView", (int)axis1, (int)axis2, (int)rank);
+
+        auto tensorShape = GetTensorShape();
+        tensorShape.SwapDimsInPlace(axis1, axis2);
+        auto viewShape = Shape();
+        std::swap(viewShape[axis1], viewShape[axis2]);
+
+        return ViewWithTensorShape(viewShape, tensorShape, readOnly);
+    }
+
+    NDArrayViewPtr NDArrayView::BroadcastView(const NDShape& broadcastShape) const
+    {
+        if (IsSparse())
+            InvalidArgument("NDArrayView::BroadcastView: Only NDArrayView objects with dense storage format can be broadcast");
+
+        auto rank = Shape().Rank();
+        bool canBroadcast = (broadcastShape.Rank() >= rank);
+        for (size_t i = 0; canBroadcast && (i < rank); ++i)
+            canBroadcast = (Shape()[i] == broadcastShape[i]) || (Shape()[i] == 1);
+
+        if (!canBroadcast)
+            InvalidArgument("NDArrayView::BroadcastView: The NDArrayView of shape %S cannot be broadcast to shape %S",
+                            AsStringForErrorReporting(Shape()).c_str(), AsStringForErrorReporting(broadcastShape).c_str());
+
+        auto tensorShape = GetTensorShape();
+        tensorShape.BroadcastInPlace(AsTensorViewShape(broadcastShape).GetDims());
+
+        return ViewWithTensorShape(broadcastShape, tensorShape, /*readOnly =*/ true);
+    }
+
+    NDArrayViewPtr NDArrayView::AsShape(const NDShape& newShape) const
+    {
+        if (IsSparse())
+            InvalidArgument("NDArrayView::AsShape: Only NDArrayView objects with dense storage format can be reshaped");
+
+        if (newShape.TotalSize() != Shape().TotalSize())
+            InvalidArgument("NDArrayView::AsShape: The total size of the new shape %S must match the total size of the NDArrayView's shape %S",
+                            AsStringForErrorReporting(newShape).c_str(), AsStringForErrorReporting(Shape()).c_str());
+
+        if (!IsContiguous())
+            InvalidArgument("NDArrayView::AsShape: A NDArrayView that is not contiguous in memory cannot be reshaped; DeepClone it first");
+
+        auto tensorShape = GetTensorShape().Reshaped(AsTensorViewShape(newShape).GetDims());
+
+        return ViewWithTensorShape(newShape, tensorShape, /*readOnly =*/ false);
     }
 
     // TODO: This could actually be strided?
@@ -296,6 +498,7 @@ namespace CNTK
         if (IsReadOnly())
             InvalidArgument("NDArrayView::WritableDataBuffer: Cannot get writable data buffer from a read-only NDArrayView");
 
+        BumpStorageVersion();
         return const_cast<ElementType*>(DataBuffer<ElementType>());
     }
 
@@ -309,6 +512,9 @@ namespace CNTK
         if (IsSparse())
             InvalidArgument("DataBuffer/WritableDataBuffer methods can only be called for NDArrayiew objects with dense storage format");
 
+        if (!IsContiguous())
+            InvalidArgument("DataBuffer/WritableDataBuffer methods can only be called for NDArrayView objects that are contiguous in memory");
+
         // First make sure that the underlying matrix is on the right device
         auto matrix = GetMatrix<ElementType>();
         matrix->TransferToDeviceIfNotThere(AsCNTKImplDeviceId(m_device), true);
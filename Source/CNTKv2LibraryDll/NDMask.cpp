@@ -21,7 +21,7 @@ namespace CNTK
     }
 
     NDMask::NDMask(const NDShape& shape, Matrix<char>* matrix)
-        : m_device(AsDeviceDescriptor(matrix->GetDeviceId())), m_maskShape(shape)
+        : m_device(AsDeviceDescriptor(matrix->GetDeviceId())), m_maskShape(shape), m_storageVersion(std::make_shared<size_t>(Internal::NewUniqueId()))
     {
         m_matrixView = std::shared_ptr<Matrix<char>>(matrix, [](Matrix<char>* ptr) { delete ptr; });
     }
@@ -55,6 +55,7 @@ namespace CNTK
 
         NDShape shape = sectionShape.AppendShape(NDShape(m_maskShape.Rank() - sectionShape.Rank(), NDShape::InferredDimension));
 
+        BumpStorageVersion();
         auto maskMatrix = GetMatrix();
         size_t rowOffset = offset[0];
         size_t colOffset = offset[1];
@@ -77,6 +78,7 @@ namespace CNTK
     void NDMask::Clear()
     {
         // Clear the mask by marking all samples as Valid
+        BumpStorageVersion();
         GetMatrix()->SetValue((char)MaskKind::Valid);
     }
 
@@ -108,6 +110,7 @@ namespace CNTK
         if (source.Shape() != Shape())
             InvalidArgument("NDMask::CopyFrom: The 'source' mask's shape must be same as the shape of this NDMask");
 
+        BumpStorageVersion();
         GetMatrix()->AssignValuesOf(*source.GetMatrix());
     }
 
@@ -121,6 +124,13 @@ namespace CNTK
 
     NDMaskPtr NDMask::Alias() const
     {
-        return MakeSharedObject<NDMask>(this->Shape(), new Matrix<char>(GetMatrix()->AsReference()));
+        auto alias = MakeSharedObject<NDMask>(this->Shape(), new Matrix<char>(GetMatrix()->AsReference()));
+        alias->m_storageVersion = m_storageVersion;
+        return alias;
+    }
+
+    void NDMask::BumpStorageVersion()
+    {
+        *m_storageVersion = Internal::NewUniqueId();
     }
 }
@@ -7,11 +7,15 @@
 #include "CNTKLibrary.h"
 #include "Utils.h"
 #include "Function.h"
+#include "MatrixQuantizerImpl.h"
+
+using namespace Microsoft::MSR::CNTK;
 
 namespace CNTK
 {
-    Trainer::Trainer(const FunctionPtr& model, const FunctionPtr& lossFunction, const FunctionPtr& evaluationFunction, const std::unordered_set<LearnerPtr>& parameterLearners)
-        : m_model(model), m_lossFunction(lossFunction), m_evaluationFunction(evaluationFunction), m_parameterLearners(parameterLearners), m_prevMinibatchNumSamples(1)
+    Trainer::Trainer(const FunctionPtr& model, const FunctionPtr& lossFunction, const FunctionPtr& evaluationFunction, const std::unordered_set<LearnerPtr>& parameterLearners,
+                     const DistributedTrainerPtr& distributedTrainer /*= nullptr*/)
+        : m_model(model), m_lossFunction(lossFunction), m_evaluationFunction(evaluationFunction), m_parameterLearners(parameterLearners), m_distributedTrainer(distributedTrainer), m_ownComputeStream(false), m_prevMinibatchNumSamples(1)
     {
         if (m_lossFunction->Output().DynamicAxes().empty())
             InvalidArgument("The loss function specified in the Trainer constructor must correspond to minibatch data and have dynamic axes");
@@ -46,12 +50,26 @@ namespace CNTK
         }
 
         std::unordered_set<Parameter> modelParametersSet(modelParameters.begin(), modelParameters.end());
-        if (modelParametersSet != learnerParameters)
-            InvalidArgument("Trainer ctor: Union of the parameters covered by the specified parameterLearners should match the specified model's parameters");
+        for (const auto& parameter : learnerParameters)
+        {
+            if (modelParametersSet.find(parameter) == modelParametersSet.end())
+                InvalidArgument("Trainer ctor: Parameter named %S covered by the specified parameterLearners is not a parameter of the specified model", parameter.Name().c_str());
+        }
+
+        // The parameters no learner covers stay as they are, and so no gradients are computed for them
+        std::unordered_set<Variable> frozenParameters;
+        for (const auto& parameter : modelParameters)
+        {
+            if (learnerParameters.find(parameter) == learnerParameters.end())
+                frozenParameters.insert(parameter);
+        }
+
+        dynamic_cast<CompositeFunction*>(m_combinedTrainingFunction.get())->SetFrozenParameters(frozenParameters);
     }
 
-    Trainer::Trainer(const FunctionPtr& model, const FunctionPtr& lossFunction, const std::unordered_set<LearnerPtr>& parameterLearners)
-        : Trainer(model, lossFunction, nullptr, parameterLearners)
+    Trainer::Trainer(const FunctionPtr& model, const FunctionPtr& lossFunction, const std::unordered_set<LearnerPtr>& parameterLearners,
+                     const DistributedTrainerPtr& distributedTrainer /*= nullptr*/)
+        : Trainer(model, lossFunction, nullptr, parameterLearners, distributedTrainer)
     {}
 
     static double GetScalarValue(const ValuePtr& value)
@@ -94,11 +112,35 @@ namespace CNTK
         return (numSamplesInDataArrayView - numMaskedSamples);
     }
 
+    void Trainer::SetOwnComputeStream(bool ownComputeStream)
+    {
+        m_ownComputeStream = ownComputeStream;
+        if (!m_ownComputeStream)
+            m_computeStream.reset();
+    }
+
+    // The caller ends the stream at the end of the call, which then has copied the results it reads to the CPU; the
+    // blocking stream synchronizes with the legacy stream that the other threads use for the Values they are given.
+    MatrixComputeStream* Trainer::BeginComputeStream(const DeviceDescriptor& computeDevice)
+    {
+        if (!m_ownComputeStream || (computeDevice.Type() != DeviceKind::GPU))
+            return nullptr;
+
+        if (!m_computeStream)
+            m_computeStream.reset(MatrixComputeStream::Create(AsCNTKImplDeviceId(computeDevice)));
+
+        m_computeStream->Begin();
+        return m_computeStream.get();
+    }
+
     double Trainer::TestMinibatch(const std::unordered_map<Variable, ValuePtr>& arguments, const DeviceDescriptor& computeDevice /*= DeviceDescriptor::UseDefaultDevice()*/)
     {
         if (!m_aggregatedEvaluationFunction)
             InvalidArgument("Trainer::TestMinibatch: Cannot test when no evaluation function was specified during 'this' trainer's construction");
 
+        auto computeStream = BeginComputeStream(computeDevice);
+        auto endComputeStream = MakeScopeExit([computeStream]() { if (computeStream) computeStream->End(); });
+
         // TODO: Should we refactor this code that is somewhat similar to the prologue of the TrainMinibatch function
         std::unordered_map<Variable, ValuePtr> outputs = { { m_aggregatedEvaluationFunction, nullptr }, {m_evaluationFunction, nullptr} };
         m_combinedTrainingFunction->Forward(arguments, outputs, computeDevice);
@@ -115,6 +157,9 @@ namespace CNTK
 
     bool Trainer::TrainMinibatch(const std::unordered_map<Variable, ValuePtr>& arguments, std::unordered_map<Variable, ValuePtr>& outputsToFetch, const DeviceDescriptor& computeDevice /*= DeviceDescriptor::UseDefaultDevice()*/)
     {
+        auto computeStream = BeginComputeStream(computeDevice);
+        auto endComputeStream = MakeScopeExit([computeStream]() { if (computeStream) computeStream->End(); });
+
         std::unordered_map<Variable, ValuePtr> outputs = { { m_aggregatedLossFunction, nullptr }, { m_lossFunction, nullptr } };
         if (m_aggregatedEvaluationFunction)
             outputs.insert({ m_aggregatedEvaluationFunction, nullptr });
@@ -138,16 +183,56 @@ namespace CNTK
         else
             rootGradientValue->Data()->SetValue(1.0);
 
+        // The gradients of the parameters covered by the learners are allocated by the first Backward call and written into
+        // the same Values afterwards
         auto modelParameters = m_combinedTrainingFunction->Parameters();
-        std::unordered_map<Variable, ValuePtr> parameterGradients;
-        for (const auto& parameter : modelParameters)
-            parameterGradients[parameter] = nullptr;
+        auto& parameterGradients = m_parameterGradients;
+        if (parameterGradients.empty())
+        {
+            for (const auto& learner : m_parameterLearners)
+                for (const auto& parameter : learner->Parameters())
+                    parameterGradients[parameter] = nullptr;
+        }
 
         m_combinedTrainingFunction->Backward(backPropSate, { { m_aggregatedLossFunction, rootGradientValue } }, parameterGradients);
 
         m_prevMinibatchNumSamples = GetSampleCount(m_lossFunction, outputs[m_lossFunction]);
 
+        if (m_distributedTrainer)
+        {
+            // Sum up the gradients, the sample count and the criteria of all workers, in the same order of parameters on every worker
+            std::vector<std::pair<Parameter, NDArrayViewPtr>> gradientValues;
+            for (const auto& parameter : modelParameters)
+            {
+                auto found = parameterGradients.find(parameter);
+                if (found != parameterGradients.end())
+                    gradientValues.push_back({ parameter, found->second->Data() });
+            }
+
+            double aggregateTrainingLoss = GetScalarValue(m_prevMinibatchAggregateTrainingLossValue);
+            double aggregateEvalCriterion = m_aggregatedEvaluationFunction ? GetScalarValue(m_prevMinibatchAggregateEvalCriterionValue) : 0;
+            bool samplesProcessed = m_distributedTrainer->PreParameterUpdateCallback(gradientValues, m_prevMinibatchNumSamples, aggregateTrainingLoss, aggregateEvalCriterion);
+
+            m_prevMinibatchAggregateTrainingLossValue = MakeSharedObject<Value>(MakeSharedObject<NDArrayView>(aggregateTrainingLoss, NDShape({ 1 }), DeviceDescriptor::CPUDevice()));
+            if (m_aggregatedEvaluationFunction)
+                m_prevMinibatchAggregateEvalCriterionValue = MakeSharedObject<Value>(MakeSharedObject<NDArrayView>(aggregateEvalCriterion, NDShape({ 1 }), DeviceDescriptor::CPUDevice()));
+
+            // Keep the learners from seeing minibatches without samples, but do not stop the training
+            if (!samplesProcessed)
+                return true;
+        }
+
+        // The learners update disjoint sets of parameters, so on a GPU their updates can overlap: each learner issues its
+        // work to a stream of its own, and the main stream (and thus the next minibatch) waits only for the events those
+        // streams record at the end of their learner's update.
+        if (!m_learnerStreams && (m_parameterLearners.size() > 1) && (computeDevice.Type() == DeviceKind::GPU) && !Internal::IsParallelLearnerUpdatesDisabled())
+            m_learnerStreams.reset(MatrixComputeStreams::Create(AsCNTKImplDeviceId(computeDevice), m_parameterLearners.size()));
+
+        if (m_learnerStreams)
+            m_learnerStreams->Fork();
+
         bool anyUpdatesPerformed = false;
+        size_t learnerIndex = 0;
         for (auto learner : m_parameterLearners)
         {
             std::unordered_map<Parameter, NDArrayViewPtr> learnerParameterGradients;
@@ -160,9 +245,27 @@ namespace CNTK
                     LogicError("The gradient value for a Parameter cannot have an associated mask!");
             }
 
-            anyUpdatesPerformed |= learner->Update(learnerParameterGradients, m_prevMinibatchNumSamples);
+            if (m_learnerStreams)
+                m_learnerStreams->Begin(learnerIndex++);
+
+            try
+            {
+                anyUpdatesPerformed |= learner->Update(learnerParameterGradients, m_prevMinibatchNumSamples);
+            }
+            catch (...)
+            {
+                if (m_learnerStreams)
+                    m_learnerStreams->Join();
+                throw;
+            }
+
+            if (m_learnerStreams)
+                m_learnerStreams->End();
         }
 
+        if (m_learnerStreams)
+            m_learnerStreams->Join();
+
         return anyUpdatesPerformed;
     }
 
@@ -184,6 +287,10 @@ namespace CNTK
 
     void Trainer::SaveCheckpoint(const std::wstring& modelFilePath)
     {
+        // All workers hold the same model and learner state
+        if (m_distributedTrainer && (m_distributedTrainer->WorkerRank() != 0))
+            return;
+
         SaveAsLegacyModel(m_combinedTrainingFunction, modelFilePath);
 
         if (m_parameterLearners.size() > 1)
@@ -13,11 +13,18 @@
 #include "Reader.h"
 #include "ConvolutionEngine.h"
 
+namespace Microsoft { namespace MSR { namespace CNTK {
+    class MPIWrapper;
+}}}
+
 namespace CNTK
 {
     // Forward declarations
     class Dictionary;
 
+    // The process-wide MPIWrapper of the library, created on first use (see DistributedTrainer.cpp)
+    std::shared_ptr<Microsoft::MSR::CNTK::MPIWrapper> GetMPIWrapper();
+
     // Helper to get the size of an element of the specified DataType
     inline size_t ElementSize(DataType dataType)
     {
@@ -37,17 +37,13 @@ namespace CNTK
         }
     }
 
-    template <typename T>
-    static NDMaskPtr CreateMask(size_t numElementsPerSample, const std::vector<std::vector<T>>& sequences, const DeviceDescriptor& device)
+    static NDMaskPtr CreateMask(const std::vector<size_t>& sequenceLengths, const DeviceDescriptor& device)
     {
-        size_t numSequences = sequences.size();
-        std::vector<size_t> sequenceLengths(numSequences);
+        size_t numSequences = sequenceLengths.size();
         size_t maxSequenceLength = 0;
         bool needsMask = false;
         for (size_t i = 0; i < numSequences; ++i)
         {
-            sequenceLengths[i] = sequences[i].size() / numElementsPerSample;
-
             if (maxSequenceLength < sequenceLengths[i])
                 maxSequenceLength = sequenceLengths[i];
 
@@ -55,52 +51,82 @@ namespace CNTK
                 needsMask = true;
         }
 
-        // If needed, create a mask to account for variability in lengths of specified sequences
+        // If needed, create a mask to account for variability in lengths of specified sequences.
+        // It is built on the CPU, where marking a section does not launch a kernel, and copied to the device once.
         NDMaskPtr deviceValueMask;
         if (needsMask)
         {
             NDShape valueMaskShape = { maxSequenceLength, numSequences };
-            deviceValueMask = MakeSharedObject<NDMask>(valueMaskShape, device);
+            auto valueMask = MakeSharedObject<NDMask>(valueMaskShape, DeviceDescriptor::CPUDevice());
             for (size_t i = 0; i < numSequences; ++i)
             {
-                deviceValueMask->MarkSequenceBegin({0, i});
-                deviceValueMask->InvalidateSection({ sequenceLengths[i], i }, { NDShape::InferredDimension, 1 });
+                valueMask->MarkSequenceBegin({0, i});
+                valueMask->InvalidateSection({ sequenceLengths[i], i }, { NDShape::InferredDimension, 1 });
             }
+
+            deviceValueMask = (device == DeviceDescriptor::CPUDevice()) ? valueMask : valueMask->DeepClone(device);
         }
 
         return deviceValueMask;
     }
 
+    template <typename T>
+    static NDMaskPtr CreateMask(size_t numElementsPerSample, const std::vector<std::vector<T>>& sequences, const DeviceDescriptor& device)
+    {
+        std::vector<size_t> sequenceLengths(sequences.size());
+        for (size_t i = 0; i < sequences.size(); ++i)
+            sequenceLengths[i] = sequences[i].size() / numElementsPerSample;
+
+        return CreateMask(sequenceLengths, device);
+    }
+
     template <typename ElementType>
     /*static*/ ValuePtr Value::Create(size_t vocabularySize, const std::vector<std::vector<size_t>>& oneHotSequences, const DeviceDescriptor& device, bool readOnly/* = false*/)
     {
-        NDMaskPtr deviceValueMask = CreateMask(1, oneHotSequences, device);
-        size_t maxSequenceLength = (deviceValueMask == nullptr) ? oneHotSequences[0].size() : deviceValueMask->Shape()[0];
+        std::vector<SparseIndexType> oneHotIndices;
+        std::vector<size_t> sequenceOffsets(1, 0);
+        for (const auto& sequence : oneHotSequences)
+        {
+            for (auto index : sequence)
+                oneHotIndices.push_back((SparseIndexType)index);
 
-        size_t numSequences = oneHotSequences.size();
-        NDShape sampleShape = { vocabularySize };
-        NDShape valueDataShape = sampleShape.AppendShape({ maxSequenceLength, numSequences });
-        size_t numCSCCols = valueDataShape.SubShape(1).TotalSize() + 1;
-        std::vector<SparseIndexType> colStarts(numCSCCols);
-        std::vector<ElementType> nonZeroValues;
-        std::vector<SparseIndexType> rowIndices;
+            sequenceOffsets.push_back(oneHotIndices.size());
+        }
+
+        return Create<ElementType>(vocabularySize, oneHotIndices, sequenceOffsets, device, readOnly);
+    }
+
+    template <typename ElementType>
+    /*static*/ ValuePtr Value::Create(size_t vocabularySize, const std::vector<SparseIndexType>& oneHotIndices, const std::vector<size_t>& sequenceOffsets, const DeviceDescriptor& device, bool readOnly/* = false*/)
+    {
+        if (sequenceOffsets.size() < 2)
+            InvalidArgument("Value::Create: At least one sequence has to be specified");
+
+        if ((sequenceOffsets.front() != 0) || (sequenceOffsets.back() != oneHotIndices.size()))
+            InvalidArgument("Value::Create: The sequence offsets must start at 0 and end at the number of one hot indices (%d)", (int)oneHotIndices.size());
+
+        size_t numSequences = sequenceOffsets.size() - 1;
+        std::vector<size_t> sequenceLengths(numSequences);
+        std::vector<SparseIndexType> offsets(numSequences + 1);
         for (size_t i = 0; i < numSequences; ++i)
         {
-            size_t currentSequenceLength = oneHotSequences[i].size();
-            size_t j = 0;
-            for (; j < currentSequenceLength; ++j)
-            {
-                colStarts[(i * maxSequenceLength) + j] = (SparseIndexType)nonZeroValues.size();
-                nonZeroValues.push_back(1);
-                rowIndices.push_back((SparseIndexType)(oneHotSequences[i][j]));
-            }
+            if (sequenceOffsets[i + 1] < sequenceOffsets[i])
+                InvalidArgument("Value::Create: The sequence offsets must not decrease");
 
-            for (; j < maxSequenceLength; ++j)
-                colStarts[(i * maxSequenceLength) + j] = (SparseIndexType)(nonZeroValues.size());
+            sequenceLengths[i] = sequenceOffsets[i + 1] - sequenceOffsets[i];
+            offsets[i] = (SparseIndexType)sequenceOffsets[i];
         }
+        offsets[numSequences] = (SparseIndexType)sequenceOffsets[numSequences];
+
+        NDMaskPtr deviceValueMask = CreateMask(sequenceLengths, device);
+        size_t maxSequenceLength = *std::max_element(sequenceLengths.begin(), sequenceLengths.end());
+
+        NDShape valueDataShape = NDShape({ vocabularySize }).AppendShape({ maxSequenceLength, numSequences });
+        auto deviceValueData = MakeSharedObject<NDArrayView>(AsDataType<ElementType>(), StorageFormat::SparseCSC, valueDataShape, device);
+        deviceValueData->template GetWritableMatrix<ElementType>()->SetMatrixFromOneHotSequences(oneHotIndices.data(), offsets.data(), numSequences, maxSequenceLength, vocabularySize);
+        if (readOnly)
+            deviceValueData = deviceValueData->Alias(true);
 
-        colStarts[numSequences * maxSequenceLength] = (SparseIndexType)(nonZeroValues.size());
-        NDArrayViewPtr deviceValueData = MakeSharedObject<NDArrayView>(valueDataShape, colStarts.data(), rowIndices.data(), nonZeroValues.data(), nonZeroValues.size(), device, readOnly);
         return MakeSharedObject<Value>(deviceValueData, deviceValueMask);
     }
 
@@ -137,6 +163,32 @@ namespace CNTK
         return MakeSharedObject<Value>(deviceValueData, deviceValueMask);
     }
 
+    template <typename ElementType>
+    /*static*/ ValuePtr Value::Create(const NDShape& sampleShape, const std::vector<size_t>& sequenceLengths, ElementType* data, const DeviceDescriptor& device, bool readOnly/* = false*/)
+    {
+        if (sequenceLengths.empty())
+            InvalidArgument("Value::Create: At least one sequence has to be specified");
+
+        if (data == nullptr)
+            InvalidArgument("Value::Create: The data buffer must not be null");
+
+        NDMaskPtr deviceValueMask = CreateMask(sequenceLengths, device);
+        size_t maxSequenceLength = *std::max_element(sequenceLengths.begin(), sequenceLengths.end());
+
+        // Wrap the caller's buffer; a Value on another device gets its data copied straight from it
+        NDShape valueDataShape = sampleShape.AppendShape({ maxSequenceLength, sequenceLengths.size() });
+        auto valueData = MakeSharedObject<NDArrayView>(valueDataShape, data, valueDataShape.TotalSize(), DeviceDescriptor::CPUDevice(), readOnly);
+        if (device == DeviceDescriptor::CPUDevice())
+            return MakeSharedObject<Value>(valueData, deviceValueMask);
+
+        NDArrayViewPtr deviceValueData = MakeSharedObject<NDArrayView>(AsDataType<ElementType>(), valueDataShape, device);
+        deviceValueData->CopyFrom(*valueData);
+        if (readOnly)
+            deviceValueData = deviceValueData->Alias(true);
+
+        return MakeSharedObject<Value>(deviceValueData, deviceValueMask);
+    }
+
     /*virtual*/ Value::~Value()
     {
     }
@@ -222,4 +274,8 @@ namespace CNTK
     template /*static*/ CNTK_API ValuePtr Value::Create<double>(const NDShape& sampleShape, const std::vector<std::vector<double>>& sequences, const DeviceDescriptor& device, bool readOnly/* = false*/);
     template /*static*/ CNTK_API ValuePtr Value::Create<float>(size_t vocabSize, const std::vector<std::vector<size_t>>& oneHotSequences, const DeviceDescriptor& device, bool readOnly/* = false*/);
     template /*static*/ CNTK_API ValuePtr Value::Create<double>(size_t vocabSize, const std::vector<std::vector<size_t>>& oneHotSequences, const DeviceDescriptor& device, bool readOnly/* = false*/);
+    template /*static*/ CNTK_API ValuePtr Value::Create<float>(size_t vocabSize, const std::vector<SparseIndexType>& oneHotIndices, const std::vector<size_t>& sequenceOffsets, const DeviceDescriptor& device, bool readOnly/* = false*/);
+    template /*static*/ CNTK_API ValuePtr Value::Create<double>(size_t vocabSize, const std::vector<SparseIndexType>& oneHotIndices, const std::vector<size_t>& sequenceOffsets, const DeviceDescriptor& device, bool readOnly/* = false*/);
+    template /*static*/ CNTK_API ValuePtr Value::Create<float>(const NDShape& sampleShape, const std::vector<size_t>& sequenceLengths, float* data, const DeviceDescriptor& device, bool readOnly/* = false*/);
+    template /*static*/ CNTK_API ValuePtr Value::Create<double>(const NDShape& sampleShape, const std::vector<size_t>& sequenceLengths, double* data, const DeviceDescriptor& device, bool readOnly/* = false*/);
 }
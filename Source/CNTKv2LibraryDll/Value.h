@@ -96,6 +96,9 @@ namespace CNTK
             return { m_packedData->GetMatrix<ElementType>(), m_packedDataLayout };
         }
 
+        // The packed data, or null once unpacked
+        NDArrayViewPtr PackedDataView() const { return m_isPacked ? m_packedData : nullptr; }
+
     private:
         PackedValue(const NDShape& sampleShape, const NDArrayViewPtr& packedData, const std::shared_ptr<Microsoft::MSR::CNTK::MBLayout>& packedDataLayout, bool isReadOnly)
             : Value(nullptr), m_isPacked(true), m_sampleShape(sampleShape), m_packedData(packedData), m_packedDataLayout(packedDataLayout), m_isReadOnly(isReadOnly)
@@ -44,6 +44,7 @@ int bestGPUDummy = 42; // put something into this CPP, as to avoid a linker warn
 #endif // __WINDOWS__
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <algorithm>
 
 #include <memory>
@@ -85,6 +86,7 @@ class BestGpu
 private:
     bool m_initialized;       // initialized
     bool m_nvmlData;          // nvml Data is valid
+    bool m_nvmlInitialized;   // nvmlInit() succeeded, nvmlShutdown() is due
     bool m_cudaData;          // cuda Data is valid
     int m_deviceCount;        // how many devices are available?
     int m_queryCount;         // how many times have we queried the usage counters?
@@ -96,10 +98,15 @@ private:
     void GetCudaProperties();
     void GetNvmlData();
     void QueryNvmlData();
+    bool ReadProbeCache();
+    void WriteProbeCache() const;
+    static std::string ProbeCacheFileName();
+
+    static const time_t ProbeCacheLifetime = 5; // in seconds
 
 public:
     BestGpu()
-        : m_initialized(false), m_nvmlData(false), m_cudaData(false), m_deviceCount(0), m_queryCount(0), m_lastFlags(bestGpuNormal), m_lastCount(0), m_allowedDevices(-1), m_disallowCPUDevice(false)
+        : m_initialized(false), m_nvmlData(false), m_nvmlInitialized(false), m_cudaData(false), m_deviceCount(0), m_queryCount(0), m_lastFlags(bestGpuNormal), m_lastCount(0), m_allowedDevices(-1), m_disallowCPUDevice(false)
     {
         Init();
     }
@@ -276,15 +283,23 @@ void BestGpu::GetCudaProperties()
 
     for (ProcessorData* pd : m_procData)
     {
-        cudaSetDevice(dev);
+        // cudaGetDeviceProperties() does not create a context on the device; the memory usage comes from NVML.
         pd->deviceId = dev;
         cudaGetDeviceProperties(&pd->deviceProp, dev);
-        size_t free;
-        size_t total;
-        cudaMemGetInfo(&free, &total);
         pd->cores = _ConvertSMVer2Cores(pd->deviceProp.major, pd->deviceProp.minor) * pd->deviceProp.multiProcessorCount;
-        pd->cudaFreeMem = free;
-        pd->cudaTotalMem = total;
+#ifdef _WIN32
+        // With the WDDM driver NVML sees all memory as allocated by Windows, so only these devices are asked
+        // through CUDA, which costs a context on each of them.
+        if (!pd->deviceProp.tccDriver)
+        {
+            size_t free;
+            size_t total;
+            cudaSetDevice(dev);
+            cudaMemGetInfo(&free, &total);
+            pd->cudaFreeMem = free;
+            pd->cudaTotalMem = total;
+        }
+#endif
         dev++;
         // cudaDeviceReset() explicitly destroys and cleans up all resources associated with the 
         // current device in the current process.
@@ -316,11 +331,10 @@ void BestGpu::Init()
         m_procData.push_back(data);
     }
 
+    // NVML is only initialized when devices are selected (GetDevices()), and not at all if another process
+    // has just probed the devices (see ReadProbeCache()).
     if (m_deviceCount > 0)
-    {
         GetCudaProperties();
-        GetNvmlData();
-    }
     m_initialized = true;
 }
 
@@ -332,7 +346,7 @@ BestGpu::~BestGpu()
     }
     m_procData.clear();
 
-    if (m_nvmlData)
+    if (m_nvmlInitialized)
     {
         nvmlReturn_t r = nvmlShutdown();
         if ((r != NVML_SUCCESS) && !std::uncaught_exception())
@@ -346,7 +360,7 @@ BestGpu::~BestGpu()
 void BestGpu::GetNvmlData()
 {
     // if we already did this, or we couldn't initialize the CUDA data, skip it
-    if (m_nvmlData || !m_cudaData)
+    if (m_nvmlInitialized || !m_cudaData)
         return;
 
     // First initialize NVML library
@@ -355,10 +369,94 @@ void BestGpu::GetNvmlData()
     {
         return;
     }
+    m_nvmlInitialized = true;
 
     QueryNvmlData();
 }
 
+// The result of the last NVML query of any process on this machine is shared through a file that is only accessed
+// while holding the querying lock, so that processes started together (e.g. the MPI ranks of a job) probe the
+// devices once instead of each initializing NVML and querying every device.
+std::string BestGpu::ProbeCacheFileName()
+{
+#ifdef _WIN32
+    char path[MAX_PATH + 1];
+    DWORD len = GetTempPathA(MAX_PATH, path);
+    return std::string(path, len > MAX_PATH ? 0 : len) + "DBN.exe GPGPU probe cache";
+#else
+    return "/var/lock/DBN.exe GPGPU probe cache"; // next to the lock files of CrossProcessMutex
+#endif
+}
+
+// ReadProbeCache - take the NVML data from the probe cache if it is recent and describes the same devices
+// returns: true if m_procData was filled in from the cache
+bool BestGpu::ReadProbeCache()
+{
+    FILE* f = fopen(ProbeCacheFileName().c_str(), "r");
+    if (!f)
+        return false;
+
+    bool valid = false;
+    long long timeStamp;
+    int deviceCount;
+    if (fscanf(f, "%lld %d", &timeStamp, &deviceCount) == 2 && deviceCount == m_deviceCount)
+    {
+        long long age = (long long) time(nullptr) - timeStamp;
+        valid = age >= 0 && age <= ProbeCacheLifetime;
+        std::vector<ProcessorData> cached(m_procData.size());
+        for (int i = 0; valid && i < deviceCount; i++)
+        {
+            int pciBusID, cntkFound;
+            unsigned long long memFree, memTotal;
+            unsigned int utilGpu, utilMemory;
+            valid = fscanf(f, "%d %llu %llu %u %u %d", &pciBusID, &memFree, &memTotal, &utilGpu, &utilMemory, &cntkFound) == 6;
+            auto pd = std::find_if(m_procData.begin(), m_procData.end(), [pciBusID](const ProcessorData* pd) { return pd->deviceProp.pciBusID == pciBusID; });
+            valid = valid && pd != m_procData.end();
+            if (valid)
+            {
+                auto& data = cached[pd - m_procData.begin()];
+                data.memory.free = memFree;
+                data.memory.total = memTotal;
+                data.memory.used = memTotal - memFree;
+                data.utilization.gpu = utilGpu;
+                data.utilization.memory = utilMemory;
+                data.cntkFound = cntkFound != 0;
+            }
+        }
+        // only a complete cache is taken
+        for (size_t i = 0; valid && i < m_procData.size(); i++)
+        {
+            m_procData[i]->memory = cached[i].memory;
+            m_procData[i]->utilization = cached[i].utilization;
+            m_procData[i]->cntkFound = cached[i].cntkFound;
+        }
+    }
+    fclose(f);
+
+    if (valid)
+        m_nvmlData = true;
+    return valid;
+}
+
+// WriteProbeCache - share the NVML data of the last query with other processes
+void BestGpu::WriteProbeCache() const
+{
+    if (!m_nvmlData)
+        return;
+
+    // the cache is only an optimization, so failures are ignored; a partial file does not parse
+    FILE* f = fopen(ProbeCacheFileName().c_str(), "w");
+    if (!f)
+        return;
+    fprintf(f, "%lld %d\n", (long long) time(nullptr), m_deviceCount);
+    for (const ProcessorData* pd : m_procData)
+    {
+        fprintf(f, "%d %llu %llu %u %u %d\n", pd->deviceProp.pciBusID, (unsigned long long) pd->memory.free, (unsigned long long) pd->memory.total,
+                pd->utilization.gpu, pd->utilization.memory, pd->cntkFound ? 1 : 0);
+    }
+    fclose(f);
+}
+
 // GetDevice - Determine the best device ID to use
 // bestFlags - flags that modify how the score is calculated
 int BestGpu::GetDevice(BestGpuFlags bestFlags)
@@ -446,8 +544,23 @@ std::vector<int> BestGpu::GetDevices(int number, BestGpuFlags p_bestFlags)
         return best;
     }
 
+    // global lock for this process
+    // It is also held while probing, so that only one of the processes that start together queries NVML;
+    // the others take its result from the probe cache.
+    CrossProcessMutex deviceAllocationLock("DBN.exe GPGPU querying lock");
+
+    if (!deviceAllocationLock.Acquire(/*wait=*/true)) // failure  --this should not really happen
+        RuntimeError("DeviceFromConfig: Unexpected failure acquiring device allocation lock.");
+
     // get latest data
-    QueryNvmlData();
+    if ((bestFlags & bestGpuRequery) || !ReadProbeCache())
+    {
+        if (m_nvmlInitialized)
+            QueryNvmlData();
+        else
+            GetNvmlData();
+        WriteProbeCache();
+    }
 
     double utilGpuW = 0.15;
     double utilMemW = 0.1;
@@ -491,7 +604,8 @@ std::vector<int> BestGpu::GetDevices(int number, BestGpuFlags p_bestFlags)
         score += pd->cores / 1000.0f * speedW;
         double mem = pd->memory.total > 0 ? pd->memory.free / (double) pd->memory.total : 1000000; // I saw this to be 0 when remoted in
         // if it's not a tcc driver, then it's WDDM driver and values will be off because windows allocates all the memory from the nvml point of view
-        if (!pd->deviceProp.tccDriver || pd->memory.total == 0)
+        // (only then the memory was asked through CUDA, see GetCudaProperties())
+        if (pd->cudaTotalMem > 0 && (!pd->deviceProp.tccDriver || pd->memory.total == 0))
             mem = pd->cudaFreeMem / (double) pd->cudaTotalMem;
         score += mem * freeMemW;
         score += (pd->cntkFound ? 0 : 1) * mlAppRunningW;
@@ -523,12 +637,6 @@ std::vector<int> BestGpu::GetDevices(int number, BestGpuFlags p_bestFlags)
             break;
     }
 
-    // global lock for this process
-    CrossProcessMutex deviceAllocationLock("DBN.exe GPGPU querying lock");
-
-    if (!deviceAllocationLock.Acquire((bestFlags & bestGpuExclusiveLock) != 0)) // failure  --this should not really happen
-        RuntimeError("DeviceFromConfig: Unexpected failure acquiring device allocation lock.");
-
     {
         // even if user do not want to lock the GPU, we still need to check whether a particular GPU is locked or not,
         // to respect other users' exclusive lock.
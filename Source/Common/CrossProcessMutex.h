@@ -98,7 +98,7 @@ public:
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
-#include <signal.h>
+#include <errno.h>
 
 class CrossProcessMutex
 {
@@ -110,20 +110,8 @@ class CrossProcessMutex
     std::string m_fileName; // lock file name
     struct flock m_lock;    // fnctl lock structure
 
-    static void noOpAlarmHandler(int /*signum*/)
-    {
-        // this handler is intentionally NO-OP
-        // the side effect of execution this handler
-        // will be a termination of fcntl call below with EINTR
-    }
-
-    static void setupTimeout(int seconds)
-    {
-        struct sigaction action = {};
-        action.sa_handler = &CrossProcessMutex::noOpAlarmHandler;
-        sigaction(SIGALRM, &action, NULL);
-        alarm(seconds);
-    }
+    // bounds of the polling interval while waiting for the lock
+    enum { minPollMicroseconds = 1000, maxPollMicroseconds = 50000 };
 
 public:
     CrossProcessMutex(const std::string& name)
@@ -140,6 +128,7 @@ public:
         mode_t mask = umask(0);
 
         assert(m_fd == -1);
+        useconds_t pollInterval = minPollMicroseconds;
         for (;;)
         {
             // opening a lock file
@@ -149,21 +138,21 @@ public:
             // locking it with the fcntl API
             memset(&m_lock, 0, sizeof(m_lock));
             m_lock.l_type = F_WRLCK;
-            // BUG: fcntl call with F_SETLKW doesn't always reliably detect when lock is released
-            // As a workaround, using alarm() for interupting fcntl if it waits more than 1 second
-            setupTimeout(1);
-            int r = fcntl(fd, wait ? F_SETLKW : F_SETLK, &m_lock);
-            if (errno == EINTR)
-            {
-                sleep(1);
-                // retrying in the case of signal or timeout
-                close(fd);
-                continue;
-            }
+            // F_SETLKW does not always reliably detect when the lock is released, so we always try without blocking
+            // and, when waiting, poll with an exponentially growing interval (1 ms up to 50 ms) instead of
+            // sleeping a whole second per attempt
+            int r = fcntl(fd, F_SETLK, &m_lock);
             if (r != 0)
             {
-                // acquire failed
+                int error = errno;
                 close(fd);
+                if (wait && (error == EACCES || error == EAGAIN || error == EINTR))
+                {
+                    usleep(pollInterval);
+                    pollInterval = 2 * pollInterval < maxPollMicroseconds ? 2 * pollInterval : maxPollMicroseconds;
+                    continue;
+                }
+                // acquire failed
                 umask(mask);
                 return false;
             }
@@ -383,6 +383,30 @@ bool DataReader::DataEnd()
     return bRet;
 }
 
+bool DataReader::SetWorkerShares(const std::vector<double>& shares)
+{
+    bool supported = true;
+    for (size_t i = 0; i < m_ioNames.size(); i++)
+        supported &= m_dataReaders[m_ioNames[i]]->SetWorkerShares(shares);
+    return supported;
+}
+
+bool DataReader::GetAndResetStatistics(ReaderStatistics& statistics)
+{
+    bool hasStatistics = false;
+    statistics = ReaderStatistics();
+    for (size_t i = 0; i < m_ioNames.size(); i++)
+    {
+        ReaderStatistics readerStatistics;
+        if (m_dataReaders[m_ioNames[i]]->GetAndResetStatistics(readerStatistics))
+        {
+            statistics += readerStatistics;
+            hasStatistics = true;
+        }
+    }
+    return hasStatistics;
+}
+
 // register SGD<> with the ScriptableObject system
 ScriptableObjects::ConfigurableRuntimeTypeRegister::Add<DataReader> registerDataReaderPlugin(L"DataReaderPlugin");
 
@@ -14,15 +14,19 @@
 #include <string>
 #include <stdint.h>
 #include <locale>
+#include <algorithm>
+#include <future>
 #ifdef _WIN32
 #define NOMINMAX
 #include "Windows.h"
 #include <VersionHelpers.h>
 #include <Shlwapi.h>
+#include <malloc.h> // for _aligned_malloc()
 #pragma comment(lib, "Shlwapi.lib")
 #endif
 #ifdef __unix__
 #include <unistd.h>
+#include <fcntl.h>
 #include <linux/limits.h> // for PATH_MAX
 #endif
 
@@ -84,6 +88,7 @@ void File::Init(const wchar_t* filename, int fileOptions)
 {
     m_filename = filename;
     m_options = fileOptions;
+    m_directIOUnavailable = false;
     if (m_filename.empty())
         RuntimeError("File: filename is empty");
     const auto outputPipe = (m_filename.front() == '|');
@@ -281,6 +286,222 @@ void File::Flush()
     fflushOrDie(m_file);
 }
 
+void File::Sync()
+{
+    fflushOrDie(m_file);
+    fsyncOrDie(m_file);
+}
+
+// A second handle of a file that bypasses the OS cache, for transfers of whole pages at page-aligned offsets.
+// A transfer is split into requests of s_chunkSize that are issued at explicit offsets on threads of their own,
+// s_numBuffers of them at once, each staged through an aligned buffer (the callers' memory need not be aligned).
+// Writes through it are made durable by File::Sync() like the others.
+class DirectFileIO
+{
+public:
+    static const size_t s_alignment = 4096;           // of offsets, sizes and buffers, no smaller than the sectors of common disks
+    static const size_t s_chunkSize = 8 * 1024 * 1024; // per request
+    static const size_t s_numBuffers = 4;              // requests in flight
+
+    // Returns null where the file cannot be opened for direct I/O, e.g. on file systems that do not support it.
+    static shared_ptr<DirectFileIO> TryOpen(const wstring& path, bool writing)
+    {
+        shared_ptr<DirectFileIO> io(new DirectFileIO());
+#ifdef _WIN32
+        io->m_handle = CreateFileW(path.c_str(), GENERIC_READ | (writing ? GENERIC_WRITE : 0), FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                   NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED, NULL);
+        if (io->m_handle == INVALID_HANDLE_VALUE)
+            return nullptr;
+        io->m_buffers = (char*) _aligned_malloc(s_numBuffers * s_chunkSize, s_alignment);
+        if (!io->m_buffers)
+            return nullptr;
+#else
+        io->m_fd = open(msra::strfun::utf8(path).c_str(), (writing ? O_RDWR : O_RDONLY) | O_DIRECT);
+        if (io->m_fd < 0)
+            return nullptr;
+        void* buffers = nullptr;
+        if (posix_memalign(&buffers, s_alignment, s_numBuffers * s_chunkSize) != 0)
+            return nullptr;
+        io->m_buffers = (char*) buffers;
+#endif
+        return io;
+    }
+
+    ~DirectFileIO()
+    {
+#ifdef _WIN32
+        _aligned_free(m_buffers);
+        if (m_handle != INVALID_HANDLE_VALUE)
+            CloseHandle(m_handle);
+#else
+        free(m_buffers);
+        if (m_fd >= 0)
+            close(m_fd);
+#endif
+    }
+
+    // 'offset' and 'numBytes' are multiples of s_alignment.
+    void Write(uint64_t offset, const char* data, size_t numBytes)
+    {
+        vector<future<void>> pending(s_numBuffers);
+        for (size_t chunk = 0; chunk * s_chunkSize < numBytes; chunk++)
+        {
+            auto& request = pending[chunk % s_numBuffers];
+            if (request.valid())
+                request.get(); // its buffer is free again
+            char* buffer = m_buffers + (chunk % s_numBuffers) * s_chunkSize;
+            size_t chunkBytes = min(s_chunkSize, numBytes - chunk * s_chunkSize);
+            memcpy(buffer, data + chunk * s_chunkSize, chunkBytes);
+            request = async(launch::async, [=]() { Transfer(offset + chunk * s_chunkSize, buffer, chunkBytes, /*writing=*/true); });
+        }
+        for (auto& request : pending)
+            if (request.valid())
+                request.get();
+    }
+
+    void Read(uint64_t offset, char* data, size_t numBytes)
+    {
+        size_t numChunks = (numBytes + s_chunkSize - 1) / s_chunkSize;
+        vector<future<void>> pending(s_numBuffers);
+        auto issue = [&](size_t chunk)
+        {
+            char* buffer = m_buffers + (chunk % s_numBuffers) * s_chunkSize;
+            size_t chunkBytes = min(s_chunkSize, numBytes - chunk * s_chunkSize);
+            pending[chunk % s_numBuffers] = async(launch::async, [=]() { Transfer(offset + chunk * s_chunkSize, buffer, chunkBytes, /*writing=*/false); });
+        };
+        for (size_t chunk = 0; chunk < min(numChunks, s_numBuffers); chunk++)
+            issue(chunk);
+        for (size_t chunk = 0; chunk < numChunks; chunk++)
+        {
+            pending[chunk % s_numBuffers].get();
+            memcpy(data + chunk * s_chunkSize, m_buffers + (chunk % s_numBuffers) * s_chunkSize, min(s_chunkSize, numBytes - chunk * s_chunkSize));
+            if (chunk + s_numBuffers < numChunks)
+                issue(chunk + s_numBuffers);
+        }
+    }
+
+private:
+    DirectFileIO()
+        : m_buffers(nullptr)
+#ifdef _WIN32
+        , m_handle(INVALID_HANDLE_VALUE)
+#else
+        , m_fd(-1)
+#endif
+    {}
+
+    void Transfer(uint64_t offset, char* buffer, size_t numBytes, bool writing) const
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD) offset;
+        overlapped.OffsetHigh = (DWORD) (offset >> 32);
+        overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (!overlapped.hEvent)
+            RuntimeError("File: cannot create an event for direct I/O: error %d", (int) GetLastError());
+        DWORD n = 0;
+        BOOL ok = writing ? WriteFile(m_handle, buffer, (DWORD) numBytes, NULL, &overlapped) : ReadFile(m_handle, buffer, (DWORD) numBytes, NULL, &overlapped);
+        if (ok || GetLastError() == ERROR_IO_PENDING)
+            ok = GetOverlappedResult(m_handle, &overlapped, &n, TRUE);
+        DWORD error = GetLastError();
+        CloseHandle(overlapped.hEvent);
+        if (!ok || n != numBytes)
+            RuntimeError("File: error %s %d bytes at offset %llu with direct I/O: error %d", writing ? "writing" : "reading", (int) numBytes, (unsigned long long) offset, (int) error);
+#else
+        while (numBytes > 0)
+        {
+            ssize_t n = writing ? pwrite(m_fd, buffer, numBytes, (off_t) offset) : pread(m_fd, buffer, numBytes, (off_t) offset);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                RuntimeError("File: error %s %d bytes at offset %llu with direct I/O: %s", writing ? "writing" : "reading", (int) numBytes, (unsigned long long) offset,
+                             n == 0 ? "unexpected end of file" : strerror(errno));
+            buffer += n;
+            offset += n;
+            numBytes -= n;
+        }
+#endif
+    }
+
+    char* m_buffers; // s_numBuffers of s_chunkSize
+#ifdef _WIN32
+    HANDLE m_handle;
+#else
+    int m_fd;
+#endif
+};
+
+const size_t DirectFileIO::s_alignment;
+const size_t DirectFileIO::s_chunkSize;
+const size_t DirectFileIO::s_numBuffers;
+
+// smaller blocks are not worth a second handle and the staging
+static const size_t s_minDirectIOBytes = 4 * 1024 * 1024;
+
+// The part of a block of 'numBytes' at the current position that is transferred with direct I/O: the whole pages it
+// covers. Returns false if the block is to be transferred through stdio entirely.
+bool File::GetDirectIORange(size_t numBytes, uint64_t& begin, uint64_t& end)
+{
+    if (numBytes < s_minDirectIOBytes || IsTextBased() || !CanSeek() || m_directIOUnavailable)
+        return false;
+
+    const uint64_t alignment = DirectFileIO::s_alignment;
+    uint64_t pos = GetPosition();
+    begin = (pos + alignment - 1) / alignment * alignment;
+    end = (pos + numBytes) / alignment * alignment;
+    if (end < begin + s_minDirectIOBytes)
+        return false;
+
+    if (!m_directIO)
+    {
+        m_directIO = DirectFileIO::TryOpen(m_filename, !!(m_options & fileOptionsWrite));
+        if (!m_directIO)
+        {
+            m_directIOUnavailable = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+// The bytes before and after the whole pages go through stdio, which is flushed first, so that the two never
+// refer to the same page.
+void File::PutBlock(const void* data, size_t numBytes)
+{
+    uint64_t begin, end;
+    if (!GetDirectIORange(numBytes, begin, end))
+    {
+        fwriteOrDie(data, 1, numBytes, m_file);
+        return;
+    }
+
+    const char* bytes = (const char*) data;
+    uint64_t pos = GetPosition();
+    fwriteOrDie(bytes, 1, (size_t) (begin - pos), m_file);
+    fflushOrDie(m_file);
+    m_directIO->Write(begin, bytes + (begin - pos), (size_t) (end - begin));
+    SetPosition(end);
+    fwriteOrDie(bytes + (end - pos), 1, (size_t) (pos + numBytes - end), m_file);
+}
+
+void File::GetBlock(void* data, size_t numBytes)
+{
+    uint64_t begin, end;
+    if (!GetDirectIORange(numBytes, begin, end))
+    {
+        freadOrDie(data, 1, numBytes, m_file);
+        return;
+    }
+
+    char* bytes = (char*) data;
+    uint64_t pos = GetPosition();
+    freadOrDie(bytes, 1, (size_t) (begin - pos), m_file);
+    fflushOrDie(m_file); // (pending writes of a read/write file)
+    m_directIO->Read(begin, bytes + (begin - pos), (size_t) (end - begin));
+    SetPosition(end);
+    freadOrDie(bytes + (end - pos), 1, (size_t) (pos + numBytes - end), m_file);
+}
+
 // read a line
 // End of line is denoted by one of these, i.e. we don't support the old Mac OS convention of CR
 //  - LF
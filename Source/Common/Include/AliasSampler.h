@@ -0,0 +1,124 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// AliasSampler.h -- drawing from a discrete distribution in constant time (Walker's alias method)
+//
+
+#pragma once
+
+#include "Basics.h"
+#include <stdint.h>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// ---------------------------------------------------------------------------
+// AliasSampler -- draws indices in [0, n) with probabilities proportional to given weights,
+// e.g. noise words for noise contrastive estimation.
+// The table is built once in O(n) (Vose's variant of the alias method), then every draw costs
+// two random numbers and one table lookup, independent of n.
+// ---------------------------------------------------------------------------
+
+class AliasSampler
+{
+public:
+    AliasSampler()
+    {
+    }
+
+    explicit AliasSampler(const std::vector<double>& weights)
+    {
+        size_t n = weights.size();
+        if (n == 0)
+            InvalidArgument("AliasSampler: The distribution must have at least one element.");
+        if (n > UINT32_MAX)
+            InvalidArgument("AliasSampler: Too many elements (%d).", (int) n);
+
+        double sum = 0;
+        for (auto weight : weights)
+        {
+            if (weight < 0)
+                InvalidArgument("AliasSampler: Weights must not be negative.");
+            sum += weight;
+        }
+        if (sum <= 0)
+            InvalidArgument("AliasSampler: The sum of the weights must be positive.");
+
+        m_probability.resize(n);
+        m_threshold.resize(n);
+        m_alias.resize(n);
+
+        // Each column i of the table is split into the part that stays i (m_threshold[i]) and the part
+        // that goes to m_alias[i]. Columns with a scaled probability below 1 are filled up by those above 1.
+        std::vector<uint32_t> below, above; // (not 'small', which is a macro on Windows)
+        for (size_t i = 0; i < n; i++)
+        {
+            m_probability[i] = weights[i] / sum;
+            m_threshold[i] = m_probability[i] * n;
+            m_alias[i] = (uint32_t) i;
+            (m_threshold[i] < 1 ? below : above).push_back((uint32_t) i);
+        }
+        while (!below.empty() && !above.empty())
+        {
+            uint32_t lower = below.back();
+            below.pop_back();
+            uint32_t higher = above.back();
+            m_alias[lower] = higher;
+            m_threshold[higher] -= 1 - m_threshold[lower];
+            if (m_threshold[higher] < 1)
+            {
+                above.pop_back();
+                below.push_back(higher);
+            }
+        }
+        // what is left is 1 up to rounding errors
+        for (auto i : below)
+            m_threshold[i] = 1;
+        for (auto i : above)
+            m_threshold[i] = 1;
+    }
+
+    size_t Size() const
+    {
+        return m_probability.size();
+    }
+
+    double Probability(size_t i) const
+    {
+        return m_probability[i];
+    }
+
+    // Draws one index. Only the raw output of the engine is used (no std distributions), so that
+    // the draws are the same on all platforms.
+    template <class Engine>
+    size_t Sample(Engine& engine) const
+    {
+        size_t column = (size_t)(Uniform(engine) * m_threshold.size());
+        if (column >= m_threshold.size()) // rounding
+            column = m_threshold.size() - 1;
+        return Uniform(engine) < m_threshold[column] ? column : m_alias[column];
+    }
+
+    // Draws 'count' indices into 'samples'.
+    template <class Engine, class IndexType>
+    void Sample(Engine& engine, IndexType* samples, size_t count) const
+    {
+        for (size_t i = 0; i < count; i++)
+            samples[i] = (IndexType) Sample(engine);
+    }
+
+private:
+    // a uniform random number in [0, 1)
+    template <class Engine>
+    static double Uniform(Engine& engine)
+    {
+        return (double) (engine() - Engine::min()) / ((double) (Engine::max() - Engine::min()) + 1.0);
+    }
+
+    std::vector<double> m_probability; // [i] normalized weight of i
+    std::vector<double> m_threshold;   // [column] part of the column that is drawn as the column itself
+    std::vector<uint32_t> m_alias;     // [column] what is drawn for the rest of the column
+};
+
+}}}
@@ -27,6 +27,7 @@
 #include "Sequences.h"
 #include "Config.h" // for ConfigParameters
 #include "ScriptableObjects.h"
+#include "ReaderStatistics.h"
 #include <map>
 #include <string>
 #include <memory>
@@ -310,6 +311,19 @@ public:
         return false;
     }
 
+    // Gets the statistics of the reader since the last call, if it collects any.
+    virtual bool GetAndResetStatistics(ReaderStatistics& /*statistics*/)
+    {
+        return false;
+    }
+
+    // The share of the data of each worker in the following distributed minibatch loops, one per worker (empty: equal
+    // shares). Returns false if the reader cannot split the data other than equally.
+    virtual bool SetWorkerShares(const std::vector<double>& /*shares*/)
+    {
+        return false;
+    }
+
     bool GetFrame(StreamMinibatchInputs& /*matrices*/, const size_t /*tidx*/, vector<size_t>& /*history*/)
     {
         NOT_IMPLEMENTED;
@@ -464,6 +478,10 @@ public:
     // TODO: The return value if this is never used except in loops where we do an &=. It is not clear whether that is a bug or intentionally prevents DataEnd() from being called.
     //       Once this is understood, we can change the return value to void.
 
+    // Sums up the statistics of the readers of all sections.
+    virtual bool GetAndResetStatistics(ReaderStatistics& statistics) override;
+    virtual bool SetWorkerShares(const std::vector<double>& shares) override;
+
     // Gets a copy of the minibatch for the forward computation. This can be
     // useful if some of the computation has to happen in the reader.
     virtual bool GetMinibatchCopy(
@@ -296,6 +296,55 @@ class VariableSchema : public std::vector<VariableLayout>
         }
 };
 
+//
+// Options of IEvaluateModelExtended::BeamSearch()
+//
+struct BeamSearchOptions
+{
+    std::wstring m_tokenInputName; // the input that takes the previous token, as a one-hot vector over the vocabulary
+    size_t m_startToken;           // the previous token of the first step
+    size_t m_endToken;             // the token that finishes a hypothesis
+    size_t m_beamWidth;            // hypotheses kept per sentence
+    size_t m_maxLength;            // tokens of a hypothesis, including the end token
+
+    BeamSearchOptions() : m_startToken(0), m_endToken(0), m_beamWidth(5), m_maxLength(100) {}
+};
+
+//
+// Options of IEvaluateModelExtended::StartForwardEvaluation() for a steady latency: the largest shapes that
+// ForwardPass() and ForwardPassBatch() will be called with, for which all buffers are allocated up front, by
+// m_numWarmupPasses passes over zero inputs of these shapes (which also select the cuDNN algorithms and set up
+// the libraries). Calls within the shapes then allocate no buffers, see GetNumAllocationsSinceWarmup(). (On the CPU,
+// ForwardPass() binds the inputs to the caller's buffers, so that a ForwardPassBatch() after it allocates them again.)
+// For several models in one process (see EvalModelHost.h): m_ownComputeStream issues the work of each call to a
+// stream of the evaluator, so that the calls of models on different threads overlap on the device, and
+// m_releaseBuffersAfterCall gives the buffers back to the caching allocator after each call, so that the models
+// take their activations from the same memory in turn (at the price of the allocations counted above).
+//
+struct ForwardEvaluationOptions
+{
+    size_t m_maxBatchSize;      // sequences of a ForwardPassBatch() call; 1 if only ForwardPass() is used
+    size_t m_maxSequenceLength; // samples of a sequence; 1 for models without a dynamic axis
+    size_t m_numWarmupPasses;
+    bool m_ownComputeStream;
+    bool m_releaseBuffersAfterCall;
+
+    ForwardEvaluationOptions()
+        : m_maxBatchSize(1), m_maxSequenceLength(1), m_numWarmupPasses(2), m_ownComputeStream(false), m_releaseBuffersAfterCall(false)
+    {}
+};
+
+//
+// A decoded sequence: the tokens after the start token, and the sum of their log-probabilities.
+// Unfinished hypotheses (without the end token) are those that reached the maximum length.
+//
+struct BeamSearchHypothesis
+{
+    std::vector<size_t> m_tokens;
+    double m_score;
+    bool m_isFinished;
+};
+
 //
 // Extended interface, allowing for sparse input.
 // Implementation constraints: 
@@ -319,6 +368,19 @@ public:
     //
     virtual void StartForwardEvaluation(const std::vector<std::wstring>& outputs) = 0;
 
+    //
+    // Same as above, and preallocate for the given shapes with warmup passes. Requires dense inputs. The recurrent
+    // state of the warmup passes is left behind, so that the first ForwardPass() should reset the RNN.
+    //
+    virtual void StartForwardEvaluation(const std::vector<std::wstring>& outputs, const ForwardEvaluationOptions& options) = 0;
+
+    //
+    // GetNumAllocationsSinceWarmup - the number of matrix buffers and device buffers allocated since the warmup of
+    // StartForwardEvaluation(), 0 as long as the calls stay within its shapes. The count is of the whole process,
+    // so it includes the allocations of other evaluators and of the models they run at the same time.
+    //
+    virtual size_t GetNumAllocationsSinceWarmup() const = 0;
+
     //
     // GetVariableLayout - retrieve information about tensor shapes and memory layout of inputs necessary for a
     // particular output. By default this returns all available inputs. After StartForwardEvaluation(), this
@@ -355,6 +417,47 @@ public:
     // resetRNN - flags whether to reset memory cells of RNN. 
     //
     virtual void ForwardPass(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& output, bool resetRNN) = 0;
+
+    //
+    // ForwardPassBatch - Evaluate several independent sequences in one forward pass, as parallel sequences of 
+    // one minibatch. inputs[s] and outputs[s] are the inputs and outputs of sequence s, as for ForwardPass();
+    // every sequence starts with a reset RNN state. Sequences may differ in length. Only dense inputs are supported.
+    //
+    virtual void ForwardPassBatch(const std::vector<ValueRefs<ElemType>>& inputs, std::vector<ValueRefs<ElemType>>& outputs) = 0;
+
+    //
+    // Streaming evaluation with explicit recurrent state, e.g. to serve many audio streams with one evaluator.
+    // CreateStreamState() returns a handle to the state of a new stream, which starts reset; ReleaseStreamState() frees it.
+    // ForwardPassStreams() evaluates the next chunk of each of the given streams in one minibatch, with inputs[s] and
+    // outputs[s] as for ForwardPass(), and advances their states. Chunks may differ in length. Only dense inputs and
+    // models without FutureValue are supported. StartForwardEvaluation() releases all stream states.
+    //
+    virtual size_t CreateStreamState() = 0;
+    virtual void ReleaseStreamState(size_t stream) = 0;
+    virtual void ForwardPassStreams(const std::vector<size_t>& streams, const std::vector<ValueRefs<ElemType>>& inputs, std::vector<ValueRefs<ElemType>>& outputs) = 0;
+
+    //
+    // BeamSearch - Decode several sentences with a sequence-to-sequence model, advancing the hypotheses of all of them
+    // in one minibatch per step. The single output passed to StartForwardEvaluation() must be the log-probabilities
+    // of the next token (e.g. LogSoftmax), with the dynamic axis of the inputs; the input options.m_tokenInputName
+    // takes the previous token. All other inputs condition the decoder: sources[s] has one sample of each of them, in
+    // the order of GetInputSchema() without the token input, which is fed at every step of sentence s (e.g. the
+    // output of an encoder evaluated with ForwardPassBatch()). The recurrent state of the hypotheses stays on the
+    // device, and is reordered there as the beams move on, and the best candidates are selected on the device, so
+    // that only those are copied back. A sentence stops once no live hypothesis can beat the options.m_beamWidth
+    // best finished ones. results[s] receives up to options.m_beamWidth hypotheses of sentence s, best first.
+    // The requirements of ForwardPassStreams() apply; the stream states of the caller are left alone.
+    //
+    virtual void BeamSearch(const std::vector<ValueRefs<ElemType>>& sources, const BeamSearchOptions& options, std::vector<std::vector<BeamSearchHypothesis>>& results) = 0;
+
+    //
+    // Clone - create another evaluator of the same model, for calling ForwardPass() from another thread. 
+    // The model parameters are shared, not copied; each clone has its own internal state. If StartForwardEvaluation()
+    // has been called, the clone is started with the same outputs. 
+    // This method must not be called concurrently with ForwardPass() on this instance. Every clone must be
+    // released with Destroy(); the clones remain valid after this instance has been destroyed.
+    //
+    virtual IEvaluateModelExtended<ElemType>* Clone() const = 0;
 };
 
 template <typename ElemType>
@@ -0,0 +1,281 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// EvalBatching.h -- dynamic batching of single evaluation requests on top of IEvaluateModelExtended
+//
+#pragma once
+
+#include "Eval.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+//
+// Counters of a BatchingEvaluator since its creation.
+//
+struct BatchingStatistics
+{
+    size_t m_numRequests;
+    size_t m_numBatches;
+
+    // [n] = number of forward passes over n requests
+    std::vector<size_t> m_batchSizeHistogram;
+
+    // Time from Submit() until the outputs are ready, in microseconds, over the most recent requests.
+    double m_latencyP50;
+    double m_latencyP90;
+    double m_latencyP99;
+    double m_latencyMax;
+};
+
+//
+// ForwardPassScheduler -- lets at most 'maxConcurrentPasses' forward passes of the BatchingEvaluators that share it
+// run at a time, e.g. of several models on one device, so that the memory of their activations peaks for that many
+// passes at most. Waiting passes start in the order of the oldest request of their batch.
+//
+class ForwardPassScheduler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    explicit ForwardPassScheduler(size_t maxConcurrentPasses)
+        : m_maxConcurrentPasses(std::max(maxConcurrentPasses, (size_t)1)), m_numRunning(0), m_nextTicket(0)
+    {
+    }
+
+    ForwardPassScheduler(const ForwardPassScheduler&) = delete;
+    ForwardPassScheduler& operator=(const ForwardPassScheduler&) = delete;
+
+    // Wait until a pass whose oldest request was submitted at 'submitTime' may run. Each call is followed by Release().
+    void Acquire(Clock::time_point submitTime)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto ticket = m_waiting.insert(std::make_pair(submitTime, m_nextTicket++)).first;
+        m_changed.wait(lock, [&]() { return m_numRunning < m_maxConcurrentPasses && ticket == m_waiting.begin(); });
+        m_waiting.erase(ticket);
+        m_numRunning++;
+        lock.unlock();
+        m_changed.notify_all(); // (the next one may run as well)
+    }
+
+    void Release()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_numRunning--;
+        }
+        m_changed.notify_all();
+    }
+
+private:
+    const size_t m_maxConcurrentPasses;
+
+    std::mutex m_mutex; // guards all below
+    std::condition_variable m_changed;
+    std::set<std::pair<Clock::time_point, size_t>> m_waiting; // (the ticket tells passes of the same time apart)
+    size_t m_numRunning;
+    size_t m_nextTicket;
+};
+
+//
+// BatchingEvaluator -- combines requests from many threads into few forward passes.
+//
+// Submit() queues a request (one sequence) and returns a future that is ready when its outputs have been written.
+// A worker thread evaluates up to 'maxBatchSize' queued requests in one ForwardPassBatch(), as parallel sequences
+// of one minibatch. It waits for a full batch at most 'maxWaitMicroseconds' after the oldest request was queued.
+// The evaluator must have been started with StartForwardEvaluation(), is not owned, and must not be used in
+// other ways while the BatchingEvaluator exists. A request's buffers must stay valid until its future is ready;
+// an error in a forward pass is reported through the futures of all its requests. With a 'scheduler' (not owned),
+// each forward pass waits for its turn in it.
+//
+template <typename ElemType>
+class BatchingEvaluator
+{
+public:
+    BatchingEvaluator(IEvaluateModelExtended<ElemType>* eval, size_t maxBatchSize, size_t maxWaitMicroseconds, size_t numLatenciesKept = 10000,
+                      ForwardPassScheduler* scheduler = nullptr)
+        : m_eval(eval), m_maxBatchSize(std::max(maxBatchSize, (size_t)1)), m_maxWait(maxWaitMicroseconds),
+          m_numLatenciesKept(std::max(numLatenciesKept, (size_t)1)), m_scheduler(scheduler), m_stopping(false),
+          m_numRequests(0), m_numBatches(0), m_batchSizeHistogram(m_maxBatchSize + 1), m_nextLatency(0)
+    {
+        m_worker = std::thread([this]() { Run(); });
+    }
+
+    // Evaluates the requests that are still queued before returning.
+    ~BatchingEvaluator()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wakeUp.notify_all();
+        m_worker.join();
+    }
+
+    BatchingEvaluator(const BatchingEvaluator&) = delete;
+    BatchingEvaluator& operator=(const BatchingEvaluator&) = delete;
+
+    //
+    // Queue the inputs of one sequence, as for ForwardPass(). 'outputs' (including their size) is written by
+    // the worker thread before the future becomes ready.
+    //
+    std::future<void> Submit(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& outputs)
+    {
+        Request request;
+        request.m_inputs = inputs;
+        request.m_outputs = &outputs;
+        request.m_submitTime = Clock::now();
+        auto future = request.m_done.get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping)
+                throw std::logic_error("BatchingEvaluator: Submit() called during destruction.");
+            m_queue.push_back(std::move(request));
+        }
+        m_wakeUp.notify_all();
+        return future;
+    }
+
+    BatchingStatistics GetStatistics() const
+    {
+        std::vector<double> latencies;
+        BatchingStatistics statistics;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            statistics.m_numRequests = m_numRequests;
+            statistics.m_numBatches = m_numBatches;
+            statistics.m_batchSizeHistogram = m_batchSizeHistogram;
+            latencies = m_latencies;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&latencies](double p)
+        {
+            return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))];
+        };
+        statistics.m_latencyP50 = percentile(0.5);
+        statistics.m_latencyP90 = percentile(0.9);
+        statistics.m_latencyP99 = percentile(0.99);
+        statistics.m_latencyMax = latencies.empty() ? 0.0 : latencies.back();
+        return statistics;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Request
+    {
+        ValueRefs<ElemType> m_inputs;   // (refers to the caller's buffers)
+        ValueRefs<ElemType>* m_outputs;
+        std::promise<void> m_done;
+        Clock::time_point m_submitTime;
+    };
+
+    void Run()
+    {
+        std::vector<Request> batch;
+        std::vector<ValueRefs<ElemType>> inputs;
+        std::vector<ValueRefs<ElemType>> outputs;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wakeUp.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+                if (m_queue.empty()) // stopping, and nothing left to do
+                    return;
+                auto deadline = m_queue.front().m_submitTime + std::chrono::microseconds(m_maxWait);
+                m_wakeUp.wait_until(lock, deadline, [this]() { return m_stopping || m_queue.size() >= m_maxBatchSize; });
+
+                size_t batchSize = std::min(m_queue.size(), m_maxBatchSize);
+                for (size_t k = 0; k < batchSize; k++)
+                {
+                    batch.push_back(std::move(m_queue.front()));
+                    m_queue.pop_front();
+                }
+            }
+
+            inputs.clear();
+            outputs.clear();
+            for (const auto& request : batch)
+            {
+                inputs.push_back(request.m_inputs);
+                outputs.push_back(*request.m_outputs);
+            }
+
+            std::exception_ptr error;
+            if (m_scheduler)
+                m_scheduler->Acquire(batch.front().m_submitTime);
+            try
+            {
+                m_eval->ForwardPassBatch(inputs, outputs);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            if (m_scheduler)
+                m_scheduler->Release();
+
+            auto now = Clock::now();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_numRequests += batch.size();
+                m_numBatches++;
+                m_batchSizeHistogram[batch.size()]++;
+                for (const auto& request : batch)
+                {
+                    double latency = std::chrono::duration<double, std::micro>(now - request.m_submitTime).count();
+                    if (m_latencies.size() < m_numLatenciesKept)
+                        m_latencies.push_back(latency);
+                    else
+                        m_latencies[m_nextLatency] = latency; // overwrite the oldest
+                    m_nextLatency = (m_nextLatency + 1) % m_numLatenciesKept;
+                }
+            }
+
+            for (size_t k = 0; k < batch.size(); k++)
+            {
+                if (error)
+                    batch[k].m_done.set_exception(error);
+                else
+                {
+                    *batch[k].m_outputs = outputs[k]; // (the sizes)
+                    batch[k].m_done.set_value();
+                }
+            }
+            batch.clear();
+        }
+    }
+
+    IEvaluateModelExtended<ElemType>* m_eval;
+    const size_t m_maxBatchSize;
+    const size_t m_maxWait; // microseconds
+    const size_t m_numLatenciesKept;
+    ForwardPassScheduler* const m_scheduler;
+
+    mutable std::mutex m_mutex; // guards all below
+    std::condition_variable m_wakeUp;
+    std::deque<Request> m_queue;
+    bool m_stopping;
+
+    size_t m_numRequests;
+    size_t m_numBatches;
+    std::vector<size_t> m_batchSizeHistogram;
+    std::vector<double> m_latencies; // ring buffer of the most recent ones
+    size_t m_nextLatency;
+
+    std::thread m_worker; // (last, to start after everything else is initialized)
+};
+
+} } }
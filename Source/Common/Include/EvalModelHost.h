@@ -0,0 +1,76 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// EvalModelHost.h -- several models in one process, on one device, on top of BatchingEvaluator
+//
+#pragma once
+
+#include "EvalBatching.h"
+
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+//
+// ModelHost -- evaluates the requests for several models, each with a BatchingEvaluator of its own, of which at most
+// 'maxConcurrentPasses' forward passes run at a time, the oldest requests first (see ForwardPassScheduler).
+//
+// The models share the device memory of the process through the caching allocator of the Math library. To also
+// share the memory of their activations, start each evaluator with ForwardEvaluationOptions::m_releaseBuffersAfterCall:
+// the cache then holds the activations of at most 'maxConcurrentPasses' passes, whichever models they are of, instead
+// of those of all models. With m_ownComputeStream, the passes that run at the same time overlap on the device.
+//
+// The evaluators must have been started with StartForwardEvaluation(), are not owned, and must not be used in other
+// ways while the ModelHost exists. Models are added before the first Submit().
+//
+template <typename ElemType>
+class ModelHost
+{
+public:
+    ModelHost(size_t maxConcurrentPasses, size_t maxWaitMicroseconds)
+        : m_scheduler(maxConcurrentPasses), m_maxWait(maxWaitMicroseconds)
+    {
+    }
+
+    ModelHost(const ModelHost&) = delete;
+    ModelHost& operator=(const ModelHost&) = delete;
+
+    // Returns the index of the model for Submit().
+    size_t AddModel(IEvaluateModelExtended<ElemType>* eval, size_t maxBatchSize)
+    {
+        m_models.push_back(std::unique_ptr<BatchingEvaluator<ElemType>>(
+            new BatchingEvaluator<ElemType>(eval, maxBatchSize, m_maxWait, /*numLatenciesKept=*/10000, &m_scheduler)));
+        return m_models.size() - 1;
+    }
+
+    size_t GetNumModels() const { return m_models.size(); }
+
+    // as BatchingEvaluator::Submit(), for the model of index 'model'
+    std::future<void> Submit(size_t model, const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& outputs)
+    {
+        return GetModel(model).Submit(inputs, outputs);
+    }
+
+    BatchingStatistics GetStatistics(size_t model) const
+    {
+        return GetModel(model).GetStatistics();
+    }
+
+private:
+    BatchingEvaluator<ElemType>& GetModel(size_t model) const
+    {
+        if (model >= m_models.size())
+            throw std::invalid_argument("ModelHost: Invalid model index.");
+        return *m_models[model];
+    }
+
+    ForwardPassScheduler m_scheduler;
+    const size_t m_maxWait; // microseconds
+    std::vector<std::unique_ptr<BatchingEvaluator<ElemType>>> m_models; // (last, to stop before the scheduler goes)
+};
+
+} } }
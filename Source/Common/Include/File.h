@@ -6,6 +6,7 @@
 
 #include "Basics.h"
 #include <stdio.h>
+#include <memory>
 #include <string>
 #include <vector>
 #include <stdint.h>
@@ -24,6 +25,9 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
 using namespace std;
 
+class MemoryMappedFile;
+class DirectFileIO;
+
 // file options, Type of textfile to use
 enum FileOptions
 {
@@ -99,7 +103,11 @@ private:
     bool m_pcloseNeeded; // was opened with popen(), use pclose() when destructing
     bool m_seekable;     // this stream is seekable
     int m_options;       // FileOptions ored togther
+    std::shared_ptr<MemoryMappedFile> m_mapping; // see SetMemoryMapping()
+    std::shared_ptr<DirectFileIO> m_directIO;    // see PutBlock(), opened on first use
+    bool m_directIOUnavailable;
     void Init(const wchar_t* filename, int fileOptions);
+    bool GetDirectIORange(size_t numBytes, uint64_t& begin, uint64_t& end);
 
 public:
     File(const std::wstring& filename, int fileOptions);
@@ -108,6 +116,7 @@ public:
     ~File();
 
     void Flush();
+    void Sync(); // Flush() and wait until the data is on the disk
 
     bool CanSeek() const { return m_seekable; }
     size_t Size();
@@ -250,6 +259,19 @@ public:
 
     operator FILE*() const { return m_file; }
 
+    // Write or read a block of raw bytes at the current position of a binary file, e.g. the elements of a matrix.
+    // The whole pages of large blocks bypass stdio and the OS cache: they are transferred with O_DIRECT (unbuffered
+    // handles on Windows) in large requests through aligned staging buffers, several of them in flight at once.
+    // Blocks that start at a page boundary (see LearnableParameter::SaveAlignedValue()) go through this path entirely.
+    // Small blocks, text files, pipes and file systems without direct I/O use fwriteOrDie()/freadOrDie().
+    void PutBlock(const void* data, size_t numBytes);
+    void GetBlock(void* data, size_t numBytes);
+
+    // A mapping of the same file, which readers of large blocks may take the data from instead of reading it
+    // (see LearnableParameter::Load()). Null unless set by whoever opened the file.
+    void SetMemoryMapping(const std::shared_ptr<MemoryMappedFile>& mapping) { m_mapping = mapping; }
+    const std::shared_ptr<MemoryMappedFile>& GetMemoryMapping() const { return m_mapping; }
+
     // Read a matrix stored in text format from 'filePath' (whitespace-separated columns, newline-separated rows),
     // and return a flat vector containing the contents of this file in column-major format.
     // filePath: path to file containing matrix in text format.
@@ -0,0 +1,79 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Half.h -- conversions between float and IEEE 754 half precision (binary16), for data that is stored or exchanged
+// in half precision while all arithmetic stays in float.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#pragma push_macro("TENSOR_OPS_DECL")
+#ifndef TENSOR_OPS_DECL // to make these accessible to CUDA kernels, say '#define TENSOR_OPS_DECL __device__ __host__'
+#define TENSOR_OPS_DECL
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Rounds to nearest even; values beyond the half range become infinity, NaNs stay NaNs.
+inline TENSOR_OPS_DECL uint16_t FloatToHalf(float value)
+{
+    uint32_t f;
+    memcpy(&f, &value, sizeof(f));
+    uint32_t sign = (f >> 16) & 0x8000;
+    uint32_t abs = f & 0x7fffffff;
+    if (abs >= 0x7f800000) // infinity or NaN
+        return (uint16_t)(sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0));
+    if (abs >= 0x477ff000) // rounds to more than the largest half, 65504
+        return (uint16_t)(sign | 0x7c00);
+    if (abs < 0x38800000) // below the smallest normal half, 2^-14: a subnormal or zero
+    {
+        if (abs <= 0x33000000) // at most half of the smallest subnormal, 2^-24
+            return (uint16_t)sign;
+        uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - (abs >> 23);
+        uint32_t h = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (h & 1)))
+            h++;
+        return (uint16_t)(sign | h);
+    }
+    // rebias the exponent and round the mantissa to 10 bits; a carry correctly moves into the exponent
+    uint32_t h = (abs - 0x38000000) >> 13;
+    uint32_t rest = abs & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+        h++;
+    return (uint16_t)(sign | h);
+}
+
+inline TENSOR_OPS_DECL float HalfToFloat(uint16_t value)
+{
+    uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+    uint32_t f;
+    if (exponent == 0x1f)     // infinity or NaN
+        f = sign | 0x7f800000 | (mantissa << 13);
+    else if (exponent != 0)   // normal
+        f = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    else                      // subnormal or zero, mantissa * 2^-24
+    {
+        float r = mantissa * (1.0f / 16777216);
+        return sign ? -r : r;
+    }
+    float result;
+    memcpy(&result, &f, sizeof(result));
+    return result;
+}
+
+inline TENSOR_OPS_DECL bool IsHalfFinite(uint16_t value)
+{
+    return (value & 0x7c00) != 0x7c00;
+}
+
+}}}
+
+#pragma pop_macro("TENSOR_OPS_DECL")
@@ -11,6 +11,9 @@
 #pragma warning(pop)
 #else
 #include "mpi.h"
+#if defined(OPEN_MPI)
+#include "mpi-ext.h" // for MPIX_CUDA_AWARE_SUPPORT
+#endif
 #endif
 #pragma comment(lib, "msmpi.lib")
 
@@ -19,6 +22,8 @@
 #include <array>
 #include <vector>
 #include <memory>
+#include <cmath>
+#include "Half.h"
 
 #define FFLUSH_SUCCESS 0
 
@@ -63,6 +68,39 @@ static int operator||(int rc, const MpiFail &what)
 class MPIWrapper;
 typedef std::shared_ptr<MPIWrapper> MPIWrapperPtr;
 
+// An asynchronous in-place sum over all nodes in use, see MPIWrapper::AllReduceAsync()
+class MPIAllReduceRequest
+{
+    friend class MPIWrapper;
+
+    void* m_data;
+    int m_count;
+    MPI_Datatype m_dataType;
+    MPI_Op m_op;
+    bool m_hierarchical; // the request is the reduction to the local leader, which Wait() continues
+    MPI_Request m_request;
+
+    // for a reduction in half precision (see MPIWrapper::AllReduceHalfAsync()): the data as exchanged, and where the sum goes
+    std::vector<uint16_t> m_halfData;
+    void* m_target;
+    bool m_targetIsDouble;
+    float m_scale;
+    bool m_overflow;
+
+public:
+    MPIAllReduceRequest()
+        : m_data(nullptr), m_count(0), m_dataType(MPI_DATATYPE_NULL), m_op(MPI_SUM), m_hierarchical(false), m_request(MPI_REQUEST_NULL),
+          m_target(nullptr), m_targetIsDouble(false), m_scale(1), m_overflow(false)
+    {
+    }
+
+    // whether the half-precision sum exceeded the half range, which is the same on all nodes
+    bool Overflowed() const
+    {
+        return m_overflow;
+    }
+};
+
 class MPIWrapper : public std::enable_shared_from_this<MPIWrapper>
 {
     int m_myRank;
@@ -72,6 +110,17 @@ class MPIWrapper : public std::enable_shared_from_this<MPIWrapper>
     // MPI communicator that reflects the current subset selection
     MPI_Comm m_currentComm;
 
+    // for hierarchical reduction: the nodes on the same host, and the first node of every host (MPI_COMM_NULL on all others)
+    MPI_Comm m_localComm;
+    MPI_Comm m_leaderComm;
+    int m_localRank;
+    int m_numLocalNodes;
+    int m_numHosts;
+    bool m_useHierarchicalReduction;
+
+    // sum of half-precision floats, for AllReduceHalfAsync()
+    MPI_Op m_halfSumOp;
+
     static MPIWrapperPtr s_mpi;
 
     // MPI_Init() with delay-loading the msmpi.dll (possibly causing a failure if missing; we want to catch that)
@@ -121,7 +170,8 @@ class MPIWrapper : public std::enable_shared_from_this<MPIWrapper>
 
 public:
     MPIWrapper()
-        : m_currentComm(MPI_COMM_WORLD)
+        : m_currentComm(MPI_COMM_WORLD), m_localComm(MPI_COMM_NULL), m_leaderComm(MPI_COMM_NULL), m_localRank(0), m_numLocalNodes(1), m_numHosts(1), m_useHierarchicalReduction(false),
+          m_halfSumOp(MPI_OP_NULL)
     {
         static bool initialized = false;
         if (initialized)
@@ -137,6 +187,7 @@ public:
         MPI_Comm_rank(MPI_COMM_WORLD, &m_myRank);
         MPI_Comm_size(MPI_COMM_WORLD, &m_numMPINodes);
         m_numNodesInUse = m_numMPINodes;
+        MPI_Op_create(&MPIWrapper::HalfSum, 1 /*commutative*/, &m_halfSumOp) || MpiFail("mpiaggregator: MPI_Op_create");
 
         // Verify that the environment variable used by GetTotalNumberOfMPINodes()  
         // matches what the MPI API says. There're actually two possible cases:
@@ -209,6 +260,13 @@ public:
             #endif
             }
 
+            if (m_leaderComm != MPI_COMM_NULL)
+                MPI_Comm_free(&m_leaderComm);
+            if (m_localComm != MPI_COMM_NULL)
+                MPI_Comm_free(&m_localComm);
+            if (m_halfSumOp != MPI_OP_NULL)
+                MPI_Op_free(&m_halfSumOp);
+
             MPI_Finalize();
         }
     }
@@ -328,6 +386,185 @@ public:
         return 0;
     }
 
+    // whether MPI operations accept device (GPU) memory, i.e. MPI was built with CUDA support.
+    // This is detected for Open MPI only; setting the environment variable CNTK_CUDA_AWARE_MPI to 1 or 0 overrides the detection.
+    static bool IsCudaAware()
+    {
+        const char* p = std::getenv("CNTK_CUDA_AWARE_MPI");
+        if (p)
+            return std::stoi(string(p)) != 0;
+#if defined(MPIX_CUDA_AWARE_SUPPORT) && MPIX_CUDA_AWARE_SUPPORT
+        return MPIX_Query_cuda_support() == 1; // the library might have been built with CUDA support but run without it
+#else
+        return false;
+#endif
+    }
+
+    // -----------------------------------------------------------------------
+    // hierarchical reduction: sum within each host first, then among one leader per host, then broadcast within the host,
+    // so that only one node per host communicates across the (slower) network between hosts
+    // -----------------------------------------------------------------------
+
+    // Split the communicator into hosts; must be called by all nodes. Has no effect (i.e. reduction stays flat) if all
+    // nodes are on one host or every host runs a single node, since then there is nothing to gain.
+    // With 'traceLevel' > 0, the main node reports the layout and the kind of reduction chosen.
+    void EnableHierarchicalReduction(int traceLevel = 0)
+    {
+        if (m_localComm == MPI_COMM_NULL && Communicator() != MPI_COMM_NULL)
+        {
+            MPI_Comm_split_type(Communicator(), MPI_COMM_TYPE_SHARED, (int) CurrentNodeRank(), MPI_INFO_NULL, &m_localComm) || MpiFail("EnableHierarchicalReduction: MPI_Comm_split_type");
+            MPI_Comm_rank(m_localComm, &m_localRank) || MpiFail("EnableHierarchicalReduction: MPI_Comm_rank");
+            MPI_Comm_size(m_localComm, &m_numLocalNodes) || MpiFail("EnableHierarchicalReduction: MPI_Comm_size");
+            MPI_Comm_split(Communicator(), IsLocalLeader() ? 0 : MPI_UNDEFINED, (int) CurrentNodeRank(), &m_leaderComm) || MpiFail("EnableHierarchicalReduction: MPI_Comm_split");
+
+            m_numHosts = IsLocalLeader() ? 1 : 0;
+            MPI_Allreduce(MPI_IN_PLACE, &m_numHosts, 1, MPI_INT, MPI_SUM, Communicator()) || MpiFail("EnableHierarchicalReduction: MPI_Allreduce");
+        }
+
+        m_useHierarchicalReduction = (m_numHosts > 1) && (m_numHosts < (int) NumNodesInUse());
+        if (traceLevel > 0 && IsMainNode())
+        {
+            fprintf(stderr, "mpihelper: %d nodes on %d hosts, %d of them on the host of the main node; %s reduction\n",
+                    (int) NumNodesInUse(), m_numHosts, m_numLocalNodes, m_useHierarchicalReduction ? "hierarchical" : "flat");
+            fflush(stderr);
+        }
+    }
+
+    bool UsingHierarchicalReduction() const
+    {
+        return m_useHierarchicalReduction;
+    }
+    MPI_Comm LocalCommunicator() const
+    {
+        return m_localComm;
+    }
+    MPI_Comm LeaderCommunicator() const
+    {
+        return m_leaderComm;
+    }
+    size_t LocalNodeRank() const
+    {
+        return m_localRank;
+    }
+    size_t NumLocalNodes() const
+    {
+        return m_numLocalNodes;
+    }
+    size_t NumHosts() const
+    {
+        return m_numHosts;
+    }
+    bool IsLocalLeader() const
+    {
+        return m_localRank == 0;
+    }
+
+    // Start an in-place sum of 'data' over all nodes in use; a plain MPI_Iallreduce unless hierarchical reduction is enabled.
+    // Hierarchically, only the reduction within the host runs asynchronously; the exchange among the leaders and the broadcast
+    // within the host are done by Wait(). Since these are collectives as well, all nodes must start and wait for the requests
+    // in the same order, and start all requests of a batch before waiting for any of them.
+    template <class ElemType>
+    void AllReduceAsync(ElemType* data, size_t count, MPIAllReduceRequest* request) const
+    {
+        request->m_halfData.clear();
+        StartAllReduce(data, count, GetDataType(data), MPI_SUM, request);
+    }
+
+    // Start an in-place sum of 'data' like AllReduceAsync(), but exchanging it as half-precision floats, which halves the
+    // traffic. 'data' is multiplied by 'scale' before it is rounded, so that small values don't flush to zero (dynamic loss
+    // scaling), and Wait() divides the sum by it again. If the sum overflowed the half range, Wait() leaves 'data' as it was
+    // and the request reports Overflowed().
+    template <class ElemType>
+    void AllReduceHalfAsync(ElemType* data, size_t count, float scale, MPIAllReduceRequest* request) const
+    {
+        request->m_halfData.resize(count);
+        uint16_t* halfData = request->m_halfData.data();
+#pragma omp parallel for
+        for (long i = 0; i < (long) count; i++)
+            halfData[i] = FloatToHalf((float) (data[i] * scale));
+        request->m_target = data;
+        request->m_targetIsDouble = sizeof(ElemType) == sizeof(double);
+        request->m_scale = scale;
+        request->m_overflow = false;
+        StartAllReduce(halfData, count, MPI_UNSIGNED_SHORT, m_halfSumOp, request);
+    }
+
+    // give MPI the chance to make progress on the request; returns true if it has completed
+    bool Test(MPIAllReduceRequest* request) const
+    {
+        int completed = 0;
+        MPI_Test(&request->m_request, &completed, MPI_STATUS_IGNORE) || MpiFail("Test: MPI_Test");
+        return completed && !request->m_hierarchical;
+    }
+
+    void Wait(MPIAllReduceRequest* request) const
+    {
+        MPI_Wait(&request->m_request, MPI_STATUS_IGNORE) || MpiFail("Wait: MPI_Wait");
+        if (request->m_hierarchical)
+        {
+            if (IsLocalLeader())
+                MPI_Allreduce(MPI_IN_PLACE, request->m_data, request->m_count, request->m_dataType, request->m_op, m_leaderComm) || MpiFail("Wait: MPI_Allreduce");
+            MPI_Bcast(request->m_data, request->m_count, request->m_dataType, 0, m_localComm) || MpiFail("Wait: MPI_Bcast");
+            request->m_hierarchical = false;
+        }
+        if (!request->m_halfData.empty())
+        {
+            if (request->m_targetIsDouble)
+                UnpackHalfSum((double*) request->m_target, request);
+            else
+                UnpackHalfSum((float*) request->m_target, request);
+            request->m_halfData.clear();
+        }
+    }
+
+private:
+    void StartAllReduce(void* data, size_t count, MPI_Datatype dataType, MPI_Op op, MPIAllReduceRequest* request) const
+    {
+        request->m_data = data;
+        request->m_count = (int) count;
+        request->m_dataType = dataType;
+        request->m_op = op;
+        request->m_hierarchical = m_useHierarchicalReduction;
+        if (!m_useHierarchicalReduction)
+        {
+            // On Windows this async MPI_Iallreduce call requires MS MPI v7 or higher to be installed
+            MPI_Iallreduce(MPI_IN_PLACE, data, request->m_count, dataType, op, Communicator(), &request->m_request) || MpiFail("AllReduceAsync: MPI_Iallreduce");
+        }
+        else if (IsLocalLeader())
+            MPI_Ireduce(MPI_IN_PLACE, data, request->m_count, dataType, op, 0, m_localComm, &request->m_request) || MpiFail("AllReduceAsync: MPI_Ireduce");
+        else
+            MPI_Ireduce(data, nullptr, request->m_count, dataType, op, 0, m_localComm, &request->m_request) || MpiFail("AllReduceAsync: MPI_Ireduce");
+    }
+
+    static void HalfSum(void* in, void* inout, int* len, MPI_Datatype*)
+    {
+        const uint16_t* a = (const uint16_t*) in;
+        uint16_t* c = (uint16_t*) inout;
+        for (int i = 0; i < *len; i++)
+            c[i] = FloatToHalf(HalfToFloat(a[i]) + HalfToFloat(c[i]));
+    }
+
+    template <class ElemType>
+    static void UnpackHalfSum(ElemType* data, MPIAllReduceRequest* request)
+    {
+        const uint16_t* halfData = request->m_halfData.data();
+        long count = (long) request->m_halfData.size();
+        for (long i = 0; i < count; i++)
+        {
+            if (!IsHalfFinite(halfData[i]))
+            {
+                request->m_overflow = true;
+                return;
+            }
+        }
+        ElemType inverseScale = (ElemType) (1 / request->m_scale);
+#pragma omp parallel for
+        for (long i = 0; i < count; i++)
+            data[i] = HalfToFloat(halfData[i]) * inverseScale;
+    }
+
+public:
+
     // -----------------------------------------------------------------------
     // data-exchange functions (wrappers around MPI functions)
     // -----------------------------------------------------------------------
@@ -387,6 +624,32 @@ public:
         }
     }
 
+    // allgather of vectors whose lengths differ between the nodes: 'gathered' gets the concatenation of the
+    // 'local' vectors of all nodes in use, in the order of their ranks
+    template <class ElemType>
+    void AllGather(const std::vector<ElemType> &local, std::vector<ElemType> &gathered) const
+    {
+        if ((NumNodesInUse() > 1) && (Communicator() != MPI_COMM_NULL))
+        {
+            int count = (int) local.size();
+            std::vector<int> counts(NumNodesInUse()), displacements(NumNodesInUse());
+            MPI_Allgather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, Communicator()) || MpiFail("AllGather: MPI_Allgather");
+
+            size_t total = 0;
+            for (size_t i = 0; i < counts.size(); i++)
+            {
+                displacements[i] = (int) total;
+                total += counts[i];
+            }
+
+            gathered.resize(total);
+            MPI_Allgatherv(const_cast<ElemType *>(local.data()), count, GetDataType(gathered.data()),
+                           gathered.data(), counts.data(), displacements.data(), GetDataType(gathered.data()), Communicator()) || MpiFail("AllGather: MPI_Allgatherv");
+        }
+        else
+            gathered = local;
+    }
+
     // wait for all ranks to reach here
     void WaitAll()
     {
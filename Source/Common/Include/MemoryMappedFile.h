@@ -0,0 +1,168 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <string>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "Basics.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// A read-only mapping of a whole file into memory. Reads go straight to the page cache,
+// without copies into private buffers, and the pages are shared with other readers of the same file.
+// With 'copyOnWrite', the memory may also be written: a page that is written becomes a private copy
+// of the process, and the file does not change.
+class MemoryMappedFile
+{
+public:
+    explicit MemoryMappedFile(const std::wstring& path, bool copyOnWrite = false)
+        : m_path(path), m_copyOnWrite(copyOnWrite), m_data(nullptr), m_size(0)
+#ifdef _WIN32
+        , m_file(INVALID_HANDLE_VALUE), m_mapping(NULL)
+#endif
+    {
+        try
+        {
+            Open();
+        }
+        catch (...)
+        {
+            Close();
+            throw;
+        }
+    }
+
+    ~MemoryMappedFile()
+    {
+        Close();
+    }
+
+    const char* Data() const { return m_data; }
+    // only with 'copyOnWrite'
+    char* MutableData() const
+    {
+        if (!m_copyOnWrite)
+            LogicError("MemoryMappedFile: The mapping of file %ls is read-only.", m_path.c_str());
+        return const_cast<char*>(m_data);
+    }
+    size_t Size() const { return m_size; }
+    const std::wstring& Path() const { return m_path; }
+
+    enum class Access
+    {
+        Normal,     // no particular pattern, the default
+        Sequential, // read once from front to back, so read ahead aggressively
+        Random,     // no read-ahead
+        WillNeed,   // about to be read, start paging it in
+    };
+
+    // Tells the OS how [offset, offset + size) is going to be accessed. A hint only, which is not
+    // supported on all platforms (on Windows it is ignored).
+    void Advise(size_t offset, size_t size, Access access) const
+    {
+        if (m_data == nullptr || offset >= m_size)
+            return;
+        size = std::min(size, m_size - offset);
+#ifdef _WIN32
+        UNUSED(access);
+#else
+        // madvise() needs a page-aligned start
+        static const size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+        const size_t alignedOffset = offset - offset % pageSize;
+        int advice = (access == Access::Sequential) ? MADV_SEQUENTIAL :
+                     (access == Access::Random) ? MADV_RANDOM :
+                     (access == Access::WillNeed) ? MADV_WILLNEED : MADV_NORMAL;
+        madvise((void*) (m_data + alignedOffset), size + (offset - alignedOffset), advice); // a failed hint is no error
+#endif
+    }
+
+private:
+    void Open()
+    {
+        const std::wstring& path = m_path;
+#ifdef _WIN32
+        m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (m_file == INVALID_HANDLE_VALUE)
+            RuntimeError("MemoryMappedFile: Unable to open file %ls, error 0x%x.", path.c_str(), (unsigned int) GetLastError());
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size))
+            RuntimeError("MemoryMappedFile: Unable to get the size of file %ls, error 0x%x.", path.c_str(), (unsigned int) GetLastError());
+        m_size = (size_t) size.QuadPart;
+        if (m_size == 0)
+            return; // an empty file cannot be mapped, and there is nothing to read anyway
+
+        m_mapping = CreateFileMapping(m_file, NULL, m_copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+        if (m_mapping == NULL)
+            RuntimeError("MemoryMappedFile: Unable to map file %ls, error 0x%x.", path.c_str(), (unsigned int) GetLastError());
+
+        m_data = (const char*) MapViewOfFile(m_mapping, m_copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+        if (m_data == nullptr)
+            RuntimeError("MemoryMappedFile: Unable to map a view of file %ls, error 0x%x.", path.c_str(), (unsigned int) GetLastError());
+#else
+        int fd = open(wtocharpath(path).c_str(), O_RDONLY);
+        if (fd == -1)
+            RuntimeError("MemoryMappedFile: Unable to open file %ls, errno %d.", path.c_str(), errno);
+
+        struct stat buf;
+        if (fstat(fd, &buf) != 0)
+        {
+            close(fd);
+            RuntimeError("MemoryMappedFile: Unable to get the size of file %ls, errno %d.", path.c_str(), errno);
+        }
+        m_size = (size_t) buf.st_size;
+        if (m_size > 0)
+        {
+            void* data = m_copyOnWrite ? mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+                                       : mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                close(fd);
+                RuntimeError("MemoryMappedFile: Unable to map file %ls, errno %d.", path.c_str(), errno);
+            }
+            m_data = (const char*) data;
+        }
+        close(fd); // the mapping keeps the file referenced
+#endif
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (m_data != nullptr)
+            UnmapViewOfFile(m_data);
+        if (m_mapping != NULL)
+            CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE)
+            CloseHandle(m_file);
+#else
+        if (m_data != nullptr)
+            munmap((void*) m_data, m_size);
+#endif
+        m_data = nullptr;
+    }
+
+    std::wstring m_path;
+    bool m_copyOnWrite;
+    const char* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#endif
+
+    DISABLE_COPY_AND_MOVE(MemoryMappedFile);
+};
+
+}}}
@@ -0,0 +1,166 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+#include "Basics.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// The NUMA nodes of the machine (typically its sockets) and the cores of each of them, for binding processes and
+// threads to the cores and the memory of a node. Unlike msra::numa (numahelpers.h), which is Windows only, this
+// works on Linux as well. Where the topology cannot be determined, there is a single node with all cores.
+class NumaTopology
+{
+public:
+    NumaTopology()
+    {
+#ifdef _WIN32
+        ULONG highestNode = 0;
+        if (GetNumaHighestNodeNumber(&highestNode))
+        {
+            for (ULONG node = 0; node <= highestNode; ++node)
+            {
+                ULONGLONG mask = 0;
+                if (!GetNumaNodeProcessorMask((UCHAR) node, &mask) || mask == 0)
+                    continue;
+                std::vector<size_t> cores;
+                for (size_t core = 0; core < 64; ++core)
+                    if (mask & (1ULL << core))
+                        cores.push_back(core);
+                m_nodes.push_back(node);
+                m_nodeCores.push_back(cores);
+            }
+        }
+#else
+        for (size_t node : ParseList(ReadLine("/sys/devices/system/node/online")))
+        {
+            auto cores = ParseList(ReadLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+            if (cores.empty())
+                continue; // a node with memory only
+            m_nodes.push_back(node);
+            m_nodeCores.push_back(cores);
+        }
+#endif
+        if (m_nodeCores.empty())
+        {
+            std::vector<size_t> cores(std::max(1u, std::thread::hardware_concurrency()));
+            for (size_t core = 0; core < cores.size(); ++core)
+                cores[core] = core;
+            m_nodes.push_back(0);
+            m_nodeCores.push_back(cores);
+        }
+    }
+
+    // The nodes that have cores, numbered from 0 here (the system may number them differently).
+    size_t NumNodes() const { return m_nodeCores.size(); }
+    const std::vector<size_t>& Cores(size_t node) const { return m_nodeCores[node]; }
+
+    // Binds the calling thread to the cores of a node, and makes its allocations prefer the memory of the node,
+    // so that the pages it touches first are local. On Linux the binding is inherited by the threads it creates
+    // from then on, so it is meant to be done at startup; on Windows it applies to the whole process.
+    // Returns false if the binding failed.
+    bool Bind(size_t node) const
+    {
+        const auto& cores = m_nodeCores[node];
+#ifdef _WIN32
+        DWORD_PTR mask = 0;
+        for (size_t core : cores)
+            if (core < sizeof(mask) * 8)
+                mask |= (DWORD_PTR) 1 << core;
+        // Windows allocates from the node of the ideal processor of a thread by default, so the affinity suffices
+        return SetProcessAffinityMask(GetCurrentProcess(), mask) != 0;
+#else
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (size_t core : cores)
+            CPU_SET(core, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0)
+            return false;
+
+#ifdef SYS_set_mempolicy
+        // set_mempolicy(MPOL_PREFERRED, ...) without a dependency on libnuma; other nodes are used when this one is full
+        const int mpolPreferred = 1;
+        const size_t systemNode = m_nodes[node];
+        std::vector<unsigned long> nodeMask(systemNode / (8 * sizeof(unsigned long)) + 1, 0);
+        nodeMask[systemNode / (8 * sizeof(unsigned long))] |= 1UL << (systemNode % (8 * sizeof(unsigned long)));
+        syscall(SYS_set_mempolicy, mpolPreferred, nodeMask.data(), nodeMask.size() * 8 * sizeof(unsigned long) + 1); // a failed hint is no error
+#endif
+        return true;
+#endif
+    }
+
+    // Pins a thread to a core.
+    static void PinToCore(std::thread& thread, size_t core)
+    {
+        size_t numCores = std::max(1u, std::thread::hardware_concurrency());
+#ifdef _WIN32
+        numCores = std::min(numCores, sizeof(DWORD_PTR) * 8);
+        SetThreadAffinityMask(thread.native_handle(), (DWORD_PTR)1 << (core % numCores));
+#else
+        cpu_set_t cores;
+        CPU_ZERO(&cores);
+        CPU_SET(core % numCores, &cores);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(cores), &cores); // a failed pinning is no error
+#endif
+    }
+
+private:
+#ifndef _WIN32
+    static std::string ReadLine(const std::string& path)
+    {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+
+    // Parses a list such as "0-7,16-23" of /sys.
+    static std::vector<size_t> ParseList(const std::string& list)
+    {
+        std::vector<size_t> result;
+        size_t pos = 0;
+        while (pos < list.size())
+        {
+            size_t end = list.find(',', pos);
+            if (end == std::string::npos)
+                end = list.size();
+            std::string range = list.substr(pos, end - pos);
+            size_t dash = range.find('-');
+            try
+            {
+                size_t first = std::stoul(range.substr(0, dash));
+                size_t last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+                for (size_t i = first; i <= last; ++i)
+                    result.push_back(i);
+            }
+            catch (const std::exception&)
+            {
+                return std::vector<size_t>(); // not what we expected, treat as unknown
+            }
+            pos = end + 1;
+        }
+        return result;
+    }
+#endif
+
+    std::vector<size_t> m_nodes;                  // the system's number of each node
+    std::vector<std::vector<size_t>> m_nodeCores; // the cores of each node
+};
+
+}}}
@@ -0,0 +1,120 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <string>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+#include "Basics.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// A file opened for reads at explicit offsets (pread() on Linux, overlapped ReadFile() on Windows).
+// There is no shared file position, so several threads may read through the same object at the same time,
+// e.g. the chunks that a randomizer prefetches.
+class PositionalFile
+{
+public:
+    explicit PositionalFile(const std::wstring& path)
+        : m_path(path)
+    {
+#ifdef _WIN32
+        m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (m_file == INVALID_HANDLE_VALUE)
+            RuntimeError("PositionalFile: Unable to open file %ls, error 0x%x.", path.c_str(), (unsigned int) GetLastError());
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size))
+        {
+            CloseHandle(m_file);
+            RuntimeError("PositionalFile: Unable to get the size of file %ls, error 0x%x.", path.c_str(), (unsigned int) GetLastError());
+        }
+        m_size = (size_t) size.QuadPart;
+#else
+        m_fd = open(wtocharpath(path).c_str(), O_RDONLY);
+        if (m_fd == -1)
+            RuntimeError("PositionalFile: Unable to open file %ls, errno %d.", path.c_str(), errno);
+
+        struct stat buf;
+        if (fstat(m_fd, &buf) != 0)
+        {
+            close(m_fd);
+            RuntimeError("PositionalFile: Unable to get the size of file %ls, errno %d.", path.c_str(), errno);
+        }
+        m_size = (size_t) buf.st_size;
+#endif
+    }
+
+    ~PositionalFile()
+    {
+#ifdef _WIN32
+        CloseHandle(m_file);
+#else
+        close(m_fd);
+#endif
+    }
+
+    size_t Size() const { return m_size; }
+    const std::wstring& Path() const { return m_path; }
+
+    // Reads [offset, offset + size) into 'buffer'; reading beyond the end of the file is an error.
+    void Read(size_t offset, size_t size, void* buffer) const
+    {
+        if (offset > m_size || size > m_size - offset)
+            RuntimeError("PositionalFile: Reading beyond the end of file %ls, the file is truncated.", m_path.c_str());
+
+        char* p = (char*) buffer;
+        while (size > 0)
+        {
+#ifdef _WIN32
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = (DWORD) offset;
+            overlapped.OffsetHigh = (DWORD) ((uint64_t) offset >> 32);
+            DWORD toRead = (DWORD) std::min(size, (size_t) 1 << 30), read = 0;
+            if (!ReadFile(m_file, p, toRead, &read, &overlapped) || read == 0)
+                RuntimeError("PositionalFile: Unable to read file %ls, error 0x%x.", m_path.c_str(), (unsigned int) GetLastError());
+#else
+            ssize_t read = pread(m_fd, p, size, (off_t) offset);
+            if (read < 0 && errno == EINTR)
+                continue;
+            if (read <= 0)
+                RuntimeError("PositionalFile: Unable to read file %ls, errno %d.", m_path.c_str(), errno);
+#endif
+            p += read;
+            offset += (size_t) read;
+            size -= (size_t) read;
+        }
+    }
+
+    template <class T>
+    T ReadValue(size_t offset) const
+    {
+        T value;
+        Read(offset, sizeof(value), &value);
+        return value;
+    }
+
+private:
+    std::wstring m_path;
+    size_t m_size;
+#ifdef _WIN32
+    HANDLE m_file;
+#else
+    int m_fd;
+#endif
+
+    DISABLE_COPY_AND_MOVE(PositionalFile);
+};
+
+}}}
@@ -0,0 +1,203 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ReaderStatistics.h -- where the time of a reader goes: the stages of the pipeline
+// (deserializer -> randomizer -> transformer -> packer -> ReaderShim), its throughput, and how often the
+// consumer of the minibatches had to wait for them.
+//
+
+#pragma once
+
+#include <stdio.h>
+#include <mutex>
+#include <vector>
+#include "Platform.h"
+#include "TimerUtility.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+enum class ReaderStage
+{
+    deserialize, // loading chunks and getting sequences from them
+    randomize,   // putting the sequences in order
+    transform,
+    pack,        // copying the sequences into minibatch buffers
+    transfer,    // filling the matrices of the network, including the copy to the GPU
+    numberOfStages
+};
+
+inline const char* ToString(ReaderStage stage)
+{
+    static const char* names[] = { "deserialize", "randomize", "transform", "pack", "transfer" };
+    return names[(size_t)stage];
+}
+
+// The statistics of a reader over a period of time.
+struct ReaderStatistics
+{
+    ReaderStatistics()
+        : m_minibatches(0), m_samples(0), m_bytes(0), m_waitSeconds(0)
+    {
+        for (auto& seconds : m_stageSeconds)
+            seconds = 0;
+    }
+
+    // Time spent in each stage, without the time of the stages it calls, summed over the threads of the reader.
+    double m_stageSeconds[(size_t)ReaderStage::numberOfStages];
+
+    size_t m_minibatches;
+    size_t m_samples;
+    size_t m_bytes;      // size of the minibatch data handed to the network
+
+    double m_waitSeconds; // time the consumer waited for the prefetched minibatches
+
+    // [n] number of minibatches that were requested while n prefetched minibatches were ready.
+    // Mostly 0 means the reader does not keep up.
+    std::vector<size_t> m_prefetchOccupancy;
+
+    ReaderStatistics& operator+=(const ReaderStatistics& other)
+    {
+        for (size_t i = 0; i < (size_t)ReaderStage::numberOfStages; ++i)
+            m_stageSeconds[i] += other.m_stageSeconds[i];
+        m_minibatches += other.m_minibatches;
+        m_samples += other.m_samples;
+        m_bytes += other.m_bytes;
+        m_waitSeconds += other.m_waitSeconds;
+        if (m_prefetchOccupancy.size() < other.m_prefetchOccupancy.size())
+            m_prefetchOccupancy.resize(other.m_prefetchOccupancy.size(), 0);
+        for (size_t i = 0; i < other.m_prefetchOccupancy.size(); ++i)
+            m_prefetchOccupancy[i] += other.m_prefetchOccupancy[i];
+        return *this;
+    }
+
+    // Prints the statistics in one line, with the rates over the given wall clock time.
+    void Print(FILE* f, const char* prefix, double elapsedSeconds) const
+    {
+        fprintf(f, "%s%d minibatches, %d samples", prefix, (int)m_minibatches, (int)m_samples);
+        if (elapsedSeconds > 0)
+            fprintf(f, " (%.1f samples/s, %.2f MB/s)", m_samples / elapsedSeconds, m_bytes / elapsedSeconds / (1024 * 1024));
+        fprintf(f, "; stages:");
+        for (size_t i = 0; i < (size_t)ReaderStage::numberOfStages; ++i)
+            fprintf(f, " %s = %.3gs", ToString((ReaderStage)i), m_stageSeconds[i]);
+        fprintf(f, "; waited = %.3gs; ready prefetched minibatches:", m_waitSeconds);
+        for (size_t i = 0; i < m_prefetchOccupancy.size(); ++i)
+            fprintf(f, " %d:%d", (int)i, (int)m_prefetchOccupancy[i]);
+        fprintf(f, "\n");
+    }
+};
+
+// Collects the statistics of one reader, from all its threads.
+class ReaderStatisticsCollector
+{
+public:
+    void AddStageTime(ReaderStage stage, double seconds)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_statistics.m_stageSeconds[(size_t)stage] += seconds;
+    }
+
+    void AddMinibatch(size_t samples, size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_statistics.m_minibatches++;
+        m_statistics.m_samples += samples;
+        m_statistics.m_bytes += bytes;
+    }
+
+    // A minibatch was requested while readyMinibatches prefetched ones were ready, and it took that long to get it.
+    void AddWait(double seconds, size_t readyMinibatches)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_statistics.m_waitSeconds += seconds;
+        if (m_statistics.m_prefetchOccupancy.size() <= readyMinibatches)
+            m_statistics.m_prefetchOccupancy.resize(readyMinibatches + 1, 0);
+        m_statistics.m_prefetchOccupancy[readyMinibatches]++;
+    }
+
+    // Returns the statistics since the last call.
+    ReaderStatistics GetAndReset()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        ReaderStatistics result = m_statistics;
+        m_statistics = ReaderStatistics();
+        return result;
+    }
+
+    // The collector that the stage timers of the current thread report to, nullptr if none.
+    static ReaderStatisticsCollector*& Current()
+    {
+        static THREAD_LOCAL ReaderStatisticsCollector* current = nullptr;
+        return current;
+    }
+
+private:
+    std::mutex m_lock;
+    ReaderStatistics m_statistics;
+};
+
+// Makes the stage timers of the current thread report to the given collector, for the lifetime of the object.
+// Work handed to other threads has to take the collector along, see ReaderStatisticsCollector::Current().
+class ReaderStatisticsScope
+{
+public:
+    explicit ReaderStatisticsScope(ReaderStatisticsCollector* collector)
+        : m_previous(ReaderStatisticsCollector::Current())
+    {
+        ReaderStatisticsCollector::Current() = collector;
+    }
+
+    ~ReaderStatisticsScope()
+    {
+        ReaderStatisticsCollector::Current() = m_previous;
+    }
+
+private:
+    ReaderStatisticsCollector* m_previous;
+};
+
+// Adds the time of a scope to a stage of the current collector, minus the time of the stage timers nested in it.
+// Does nothing if the thread has no collector.
+class ReaderStageTimer
+{
+public:
+    explicit ReaderStageTimer(ReaderStage stage)
+        : m_stage(stage), m_collector(ReaderStatisticsCollector::Current()), m_parent(nullptr), m_nestedSeconds(0)
+    {
+        if (!m_collector)
+            return;
+        m_parent = Innermost();
+        Innermost() = this;
+        m_timer.Start();
+    }
+
+    ~ReaderStageTimer()
+    {
+        if (!m_collector)
+            return;
+        m_timer.Stop();
+        double seconds = m_timer.ElapsedSeconds();
+        m_collector->AddStageTime(m_stage, seconds - m_nestedSeconds);
+        if (m_parent)
+            m_parent->m_nestedSeconds += seconds;
+        Innermost() = m_parent;
+    }
+
+private:
+    static ReaderStageTimer*& Innermost()
+    {
+        static THREAD_LOCAL ReaderStageTimer* innermost = nullptr;
+        return innermost;
+    }
+
+    ReaderStage m_stage;
+    ReaderStatisticsCollector* m_collector;
+    ReaderStageTimer* m_parent;
+    double m_nestedSeconds;
+    Timer m_timer;
+
+    ReaderStageTimer(const ReaderStageTimer&) = delete;
+    ReaderStageTimer& operator=(const ReaderStageTimer&) = delete;
+};
+
+}}}
@@ -7,8 +7,10 @@
 
 #include <memory>     // for shared_ptr<>
 #include <functional> // for function<>
+#include <algorithm>
 #include <map>
 #include <set>
+#include <unordered_map>
 
 namespace Microsoft { namespace MSR { namespace ScriptableObjects {
 
@@ -530,16 +532,19 @@ class ConfigRecord : public Object, public IConfigRecord // all configuration ar
 {
     function<void(const std::wstring &)> failfn; // function to call in case of failure due to this value
     // change to ContextInsensitiveMap<ConfigValuePtr>
-    std::map<std::wstring, ConfigValuePtr> members;
+    // (hashed, since every identifier of an expression is looked up along the whole chain of enclosing scopes)
+    std::unordered_map<std::wstring, ConfigValuePtr> members;
     IConfigRecordPtr parentScope; // we look up the chain
+    const ConfigRecord *parentRecord; // parentScope if it is a ConfigRecord (mostly), to walk the chain without virtual calls
     ConfigRecord()
+        : parentRecord(nullptr)
     {
     } // forbidden (private) to instantiate without a scope
 public:
     // --- creation phase
 
     ConfigRecord(IConfigRecordPtr parentScope, const function<void(const std::wstring &)> &failfn)
-        : parentScope(parentScope), failfn(failfn)
+        : parentScope(parentScope), failfn(failfn), parentRecord(dynamic_cast<const ConfigRecord *>(parentScope.get()))
     {
     }
     void Add(const std::wstring &id, const function<void(const std::wstring &)> & /*failfn*/, const ConfigValuePtr &value)
@@ -570,22 +575,27 @@ public:
     }
     const ConfigValuePtr * /*IConfigRecord::*/ Find(const std::wstring &id) const // returns nullptr if not found
     {
-        auto memberIter = members.find(id);
-        if (memberIter == members.end())
-            if (parentScope)
-                return parentScope->Find(id);
-            else
+        for (const ConfigRecord *record = this;; record = record->parentRecord)
+        {
+            auto memberIter = record->members.find(id);
+            if (memberIter != record->members.end())
+                return &memberIter->second.ResolveValue();
+            if (!record->parentScope)
                 return nullptr;
-        else
-            return &memberIter->second.ResolveValue();
+            if (!record->parentRecord) // some other kind of record up the chain
+                return record->parentScope->Find(id);
+        }
     }
     // get member ids; use this when you intend to consume all record entries and do not know the names
     // Note that unlike Find() and operator[], which return parent matches, this only returns entries in this record.
+    // They are sorted, so that e.g. the nodes of a network are named in the same order on all platforms.
     virtual std::vector<std::wstring> /*IConfigRecord::*/ GetMemberIds() const
     {
         std::vector<std::wstring> ids;
+        ids.reserve(members.size());
         for (auto &member : members)
             ids.push_back(member.first);
+        std::sort(ids.begin(), ids.end());
         return ids;
     }
 };
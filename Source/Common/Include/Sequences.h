@@ -109,7 +109,9 @@ struct MBLayout
     // -------------------------------------------------------------------
 
     MBLayout(size_t numParallelSequences, size_t numTimeSteps, const std::wstring &name)
-        : m_distanceToStart(CPUDEVICE), m_distanceToEnd(CPUDEVICE), m_columnsValidityMask(CPUDEVICE)
+        : m_distanceToStart(CPUDEVICE), m_distanceToEnd(CPUDEVICE), m_columnsValidityMask(CPUDEVICE),
+          m_validColumnIndicesFloat(CPUDEVICE), m_validColumnIndicesDouble(CPUDEVICE),
+          m_columnsCacheChecked(false), m_cachedStructureHash(0), m_cachedNumTimeSteps(0), m_cachedNumParallelSequences(0)
     {
         Init(numParallelSequences, numTimeSteps);
         SetUniqueAxisName(name != L"" ? name : L"DynamicAxis");
@@ -123,6 +125,8 @@ struct MBLayout
     // Use this instead of actual assignment to make it super-obvious that this is not copying the pointer but actual content. The pointer is kept fixed.
     // Use "keepName" if the "identity" of the target is to be preserved, e.g. 
     // while copying from reader space to network space.
+    // The mask and column indices this layout has cached are kept if 'other' has the structure they were computed for
+    // (as the layouts of consecutive minibatches of fixed-size buckets do), otherwise those of 'other' are copied, if current.
     void CopyFrom(const MBLayoutPtr& other, bool keepName=false)
     {
         m_numTimeSteps = other->m_numTimeSteps;
@@ -130,6 +134,7 @@ struct MBLayout
         m_sequences = other->m_sequences;
         m_numFramesDeclared = other->m_numFramesDeclared;
         m_numGapFrames = other->m_numGapFrames;
+        m_structureHash = other->m_structureHash;
 
         m_distanceToStart.SetValue(other->m_distanceToStart);
         m_distanceToEnd.SetValue(other->m_distanceToEnd);
@@ -139,7 +144,17 @@ struct MBLayout
 
         m_timeStepHasGap = other->m_timeStepHasGap;
 
-        m_columnsValidityMask.SetValue(other->m_columnsValidityMask);
+        m_columnsCacheChecked = false;
+        if (!HasCachedStructure() && other->HasCachedStructure())
+        {
+            m_columnsValidityMask.SetValue(other->m_columnsValidityMask);
+            m_validColumnIndicesFloat.Resize(0, 0); // recreated when needed
+            m_validColumnIndicesDouble.Resize(0, 0);
+            m_cachedStructureHash = other->m_cachedStructureHash;
+            m_cachedNumTimeSteps = other->m_cachedNumTimeSteps;
+            m_cachedNumParallelSequences = other->m_cachedNumParallelSequences;
+            m_cachedSequences = other->m_cachedSequences;
+        }
         m_writable = other->m_writable;
 
         if (!keepName)
@@ -156,6 +171,7 @@ struct MBLayout
         m_sequences = std::move(other->m_sequences);
         m_numFramesDeclared = other->m_numFramesDeclared;
         m_numGapFrames = other->m_numGapFrames;
+        m_structureHash = other->m_structureHash;
 
         m_distanceToStart = std::move(other->m_distanceToStart);
         m_distanceToEnd = std::move(other->m_distanceToEnd);
@@ -166,6 +182,13 @@ struct MBLayout
         m_timeStepHasGap = std::move(other->m_timeStepHasGap);
 
         m_columnsValidityMask = std::move(other->m_columnsValidityMask);
+        m_validColumnIndicesFloat = std::move(other->m_validColumnIndicesFloat);
+        m_validColumnIndicesDouble = std::move(other->m_validColumnIndicesDouble);
+        m_columnsCacheChecked = other->m_columnsCacheChecked;
+        m_cachedStructureHash = other->m_cachedStructureHash;
+        m_cachedNumTimeSteps = other->m_cachedNumTimeSteps;
+        m_cachedNumParallelSequences = other->m_cachedNumParallelSequences;
+        m_cachedSequences = std::move(other->m_cachedSequences);
         m_writable = other->m_writable;
 
         m_axisName = std::move(other->m_axisName);
@@ -176,6 +199,7 @@ struct MBLayout
 
 public:
     // resize and reset all frames to None (note: this is an invalid state and must be fixed by caller afterwards)
+    // The cached mask and column indices are kept for a later layout of the same structure.
     void Init(size_t numParallelSequences, size_t numTimeSteps)
     {
         // remember the dimensions
@@ -186,7 +210,8 @@ public:
         m_distanceToNearestStart.assign(m_numTimeSteps, PTRDIFF_MAX);
         m_distanceToNearestEnd.assign(m_numTimeSteps, PTRDIFF_MAX);
         m_timeStepHasGap.assign(m_numTimeSteps, false);
-        m_columnsValidityMask.Resize(0, 0); // invalidate
+        m_columnsCacheChecked = false; // see RevalidateColumnsCache()
+        m_structureHash = HashCombine(m_numParallelSequences, m_numTimeSteps);
         // reset state
         m_numFramesDeclared = 0;
         m_numGapFrames = 0;
@@ -306,6 +331,18 @@ public:
 
     const Matrix<char>& GetColumnsValidityMask(DEVICEID_TYPE deviceId) const;
 
+    // The indices of the columns that are not gaps, in ascending order, as a row vector for gathering them into a compact
+    // matrix with Matrix::DoGatherColumnsOf() and scattering results back with DoScatterColumnsOf(). Lazily created, like the mask.
+    template <class ElemType>
+    const Matrix<ElemType>& GetValidColumnIndices(DEVICEID_TYPE deviceId) const;
+
+    // Whether so many columns are gaps that an op had better compute only the valid ones, gathered with
+    // GetValidColumnIndices(), than all of them and mask the gaps afterwards.
+    bool HasManyGaps() const
+    {
+        return HasGaps() && GetActualNumSamples() > 0 && 8 * (GetNumCols() - GetActualNumSamples()) >= GetNumCols();
+    }
+
     // compare whether two layouts are the same
     bool operator==(const MBLayout& other) const
     {
@@ -373,6 +410,8 @@ public:
 
         // remember it
         m_sequences.push_back(seqDesc);
+        m_structureHash = HashCombine(m_structureHash, HashStructure(seqDesc));
+        m_columnsCacheChecked = false;
 
         // create all the cached fast-lookup information
         const auto seqId = seqDesc.seqId;
@@ -424,6 +463,7 @@ public:
             auto &seqDesc = m_sequences[s];
             seqDesc.seqId = s;
             seqDesc.s = s;
+            m_structureHash = HashCombine(m_structureHash, HashStructure(seqDesc));
         }
         m_numFramesDeclared = numSamples;
 
@@ -571,6 +611,38 @@ private:
     // and 0 indicates invalid (aka MinibatchPackingFlags::NoInput)
     mutable Matrix<char> m_columnsValidityMask;
 
+    // Cached indices of the valid columns, see GetValidColumnIndices()
+    mutable Matrix<float> m_validColumnIndicesFloat;
+    mutable Matrix<double> m_validColumnIndicesDouble;
+    template <class ElemType>
+    const Matrix<ElemType>& CreateValidColumnIndices(Matrix<ElemType>& indices, DEVICEID_TYPE deviceId) const;
+    std::vector<char> ComputeColumnsValidity() const;
+
+    // The mask and the column indices depend only on the structure of the layout: its dimensions and where its
+    // sequences and gaps are, not the ids of the sequences. They stay cached (on their device) across Init() and
+    // CopyFrom() together with the structure they were computed for, and are recomputed once it changes.
+    size_t m_structureHash;                              // of the current structure, accumulated by Init() and AddSequence()
+    mutable bool m_columnsCacheChecked;                  // whether the caches have been revalidated since the structure last changed
+    mutable size_t m_cachedStructureHash;                // the structure the caches were computed for
+    mutable size_t m_cachedNumTimeSteps, m_cachedNumParallelSequences;
+    mutable vector<SequenceInfo> m_cachedSequences;
+
+    static size_t HashCombine(size_t hash, size_t value)
+    {
+        return hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+    }
+
+    static size_t HashStructure(const SequenceInfo& seq)
+    {
+        return HashCombine(HashCombine(HashCombine(seq.s, (size_t)seq.tBegin), seq.tEnd), seq.seqId == GAP_SEQUENCE_ID);
+    }
+
+    // Whether the current structure is the one the caches were computed for.
+    bool HasCachedStructure() const;
+
+    // Drops the caches if the structure has changed since they were computed.
+    void RevalidateColumnsCache() const;
+
     // A boolean flag indicating whether the MBLayout can be further modified
     // When it's value is false, no set operations are allowed on the MBLayout.
     // Meant to guard in lazy creation of m_columnsValidityMask.
@@ -880,41 +952,119 @@ inline size_t MBLayout::GetActualNumSamples() const { return m_numFramesDeclared
 inline const Matrix<char>& MBLayout::GetColumnsValidityMask(DEVICEID_TYPE deviceId) const
 {
     CheckIsValid();
+    RevalidateColumnsCache();
     // lazily compute the validity mask
     if (m_columnsValidityMask.IsEmpty())
     {
         assert(HasGaps()); // must only be called if there are gaps
         Lock();
 
-        // Determine indices of all invalid columns in the minibatch
-        // TODO: This can be done more efficiently by using m_sequences[].
-        size_t nT = GetNumTimeSteps();
-        size_t nS = GetNumParallelSequences();
+        std::vector<char> columnsValidityMask = ComputeColumnsValidity(); // form the mask in a CPU-side STL vector first
+
+        if (deviceId != m_columnsValidityMask.GetDeviceId())
+            m_columnsValidityMask = Matrix<char>(deviceId);
+        m_columnsValidityMask.SetValue(1, columnsValidityMask.size(), deviceId, columnsValidityMask.data());
+    }
+    return m_columnsValidityMask;
+}
 
-        std::vector<char> columnsValidityMask(nT * nS, 1); // form the mask in a CPU-side STL vector first
-        size_t gapsFound = 0;
-        for (size_t t = 0; t < nT; t++)
+inline bool MBLayout::HasCachedStructure() const
+{
+    if (m_structureHash != m_cachedStructureHash || m_numTimeSteps != m_cachedNumTimeSteps ||
+        m_numParallelSequences != m_cachedNumParallelSequences || m_sequences.size() != m_cachedSequences.size())
+        return false;
+    for (size_t i = 0; i < m_sequences.size(); i++)
+    {
+        const auto& seq = m_sequences[i];
+        const auto& cached = m_cachedSequences[i];
+        if (seq.s != cached.s || seq.tBegin != cached.tBegin || seq.tEnd != cached.tEnd ||
+            (seq.seqId == GAP_SEQUENCE_ID) != (cached.seqId == GAP_SEQUENCE_ID))
+            return false;
+    }
+    return true;
+}
+
+inline void MBLayout::RevalidateColumnsCache() const
+{
+    if (m_columnsCacheChecked)
+        return;
+    if (!HasCachedStructure())
+    {
+        m_columnsValidityMask.Resize(0, 0); // invalidate
+        m_validColumnIndicesFloat.Resize(0, 0);
+        m_validColumnIndicesDouble.Resize(0, 0);
+        m_cachedStructureHash = m_structureHash;
+        m_cachedNumTimeSteps = m_numTimeSteps;
+        m_cachedNumParallelSequences = m_numParallelSequences;
+        m_cachedSequences = m_sequences;
+    }
+    m_columnsCacheChecked = true;
+}
+
+// 1 for each valid column and 0 for each gap
+inline std::vector<char> MBLayout::ComputeColumnsValidity() const
+{
+    // Determine indices of all invalid columns in the minibatch
+    // TODO: This can be done more efficiently by using m_sequences[].
+    size_t nT = GetNumTimeSteps();
+    size_t nS = GetNumParallelSequences();
+
+    std::vector<char> columnsValidityMask(nT * nS, 1);
+    size_t gapsFound = 0;
+    for (size_t t = 0; t < nT; t++)
+    {
+        FrameRange fr(nullptr, t);
+        if (IsGap(fr))
         {
-            FrameRange fr(nullptr, t);
-            if (IsGap(fr))
+            for (size_t s = 0; s < nS; s++)
             {
-                for (size_t s = 0; s < nS; s++)
+                if (IsGap(fr.Sequence(s)))
                 {
-                    if (IsGap(fr.Sequence(s)))
-                    {
-                        columnsValidityMask[(t * nS) + s] = 0;
-                        gapsFound++;
-                    }
+                    columnsValidityMask[(t * nS) + s] = 0;
+                    gapsFound++;
                 }
             }
         }
-        assert(gapsFound == m_numGapFrames); // sanity check
+    }
+    assert(gapsFound == m_numGapFrames); // sanity check
+    UNUSED(gapsFound);
+    return columnsValidityMask;
+}
 
-        if (deviceId != m_columnsValidityMask.GetDeviceId())
-            m_columnsValidityMask = Matrix<char>(deviceId);
-        m_columnsValidityMask.SetValue(1, nS * nT, deviceId, columnsValidityMask.data());
+template <class ElemType>
+inline const Matrix<ElemType>& MBLayout::CreateValidColumnIndices(Matrix<ElemType>& indices, DEVICEID_TYPE deviceId) const
+{
+    CheckIsValid();
+    RevalidateColumnsCache();
+    if (indices.IsEmpty())
+    {
+        Lock();
+
+        const auto columnsValidity = ComputeColumnsValidity();
+        std::vector<ElemType> validColumns;
+        validColumns.reserve(GetActualNumSamples());
+        for (size_t j = 0; j < columnsValidity.size(); j++)
+            if (columnsValidity[j])
+                validColumns.push_back((ElemType) j);
+        assert(!validColumns.empty()); // only called if there are valid columns
+
+        if (deviceId != indices.GetDeviceId())
+            indices = Matrix<ElemType>(deviceId);
+        indices.SetValue(1, validColumns.size(), deviceId, validColumns.data());
     }
-    return m_columnsValidityMask;
+    return indices;
+}
+
+template <>
+inline const Matrix<float>& MBLayout::GetValidColumnIndices<float>(DEVICEID_TYPE deviceId) const
+{
+    return CreateValidColumnIndices(m_validColumnIndicesFloat, deviceId);
+}
+
+template <>
+inline const Matrix<double>& MBLayout::GetValidColumnIndices<double>(DEVICEID_TYPE deviceId) const
+{
+    return CreateValidColumnIndices(m_validColumnIndicesDouble, deviceId);
 }
 
 // class for defining an iteration over a sequence, forward and backward
@@ -0,0 +1,155 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// StringHashMap.h -- an open addressing hash map from strings to values, and an allocation free tokenizer,
+// for looking up the tokens of text input (e.g. words in a vocabulary) right in the line buffer.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Maps strings to values with linear probing. The keys are copied into one contiguous buffer, so that a lookup
+// by (pointer, length) touches the slot array and one key only, and never creates a string.
+// Values cannot be removed individually, only all of them through Clear().
+template <class CharType, class ValueType>
+class StringHashMap
+{
+public:
+    StringHashMap()
+        : m_size(0)
+    {
+    }
+
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+    void Clear()
+    {
+        m_slots.clear();
+        m_keys.clear();
+        m_size = 0;
+    }
+
+    // Adds the key or overwrites its value.
+    void Set(const CharType* key, size_t length, const ValueType& value)
+    {
+        // Keep the load factor at most 1/2, so that probe sequences stay short.
+        if (2 * (m_size + 1) > m_slots.size())
+            Rehash(m_slots.empty() ? 16 : 2 * m_slots.size());
+
+        Slot& slot = m_slots[FindSlot(key, length, Hash(key, length))];
+        if (slot.m_keyLength == 0)
+        {
+            slot.m_hash = Hash(key, length);
+            slot.m_keyOffset = m_keys.size();
+            slot.m_keyLength = length + 1; // 0 marks an empty slot, so that the empty string can be a key
+            m_keys.insert(m_keys.end(), key, key + length);
+            m_size++;
+        }
+        slot.m_value = value;
+    }
+
+    void Set(const std::basic_string<CharType>& key, const ValueType& value)
+    {
+        Set(key.data(), key.size(), value);
+    }
+
+    // Returns the value of the key, or nullptr if it is not in the map.
+    const ValueType* Find(const CharType* key, size_t length) const
+    {
+        if (m_slots.empty())
+            return nullptr;
+        const Slot& slot = m_slots[FindSlot(key, length, Hash(key, length))];
+        return slot.m_keyLength == 0 ? nullptr : &slot.m_value;
+    }
+
+    const ValueType* Find(const std::basic_string<CharType>& key) const
+    {
+        return Find(key.data(), key.size());
+    }
+
+private:
+    struct Slot
+    {
+        uint64_t m_hash;
+        size_t m_keyOffset;
+        size_t m_keyLength; // length of the key + 1, 0 for an empty slot
+        ValueType m_value;
+    };
+
+    // FNV-1a over the characters of the key.
+    static uint64_t Hash(const CharType* key, size_t length)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < length; ++i)
+        {
+            hash ^= (uint64_t)key[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // Returns the slot that holds the key, or the empty slot where it would be added.
+    size_t FindSlot(const CharType* key, size_t length, uint64_t hash) const
+    {
+        size_t mask = m_slots.size() - 1;
+        for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask)
+        {
+            const Slot& slot = m_slots[i];
+            if (slot.m_keyLength == 0)
+                return i;
+            if (slot.m_hash == hash && slot.m_keyLength == length + 1 &&
+                std::char_traits<CharType>::compare(m_keys.data() + slot.m_keyOffset, key, length) == 0)
+                return i;
+        }
+    }
+
+    void Rehash(size_t capacity)
+    {
+        std::vector<Slot> slots(capacity, Slot{ 0, 0, 0, ValueType() });
+        slots.swap(m_slots);
+        size_t mask = capacity - 1;
+        for (const auto& slot : slots)
+        {
+            if (slot.m_keyLength == 0)
+                continue;
+            size_t i = (size_t)slot.m_hash & mask;
+            while (m_slots[i].m_keyLength != 0)
+                i = (i + 1) & mask;
+            m_slots[i] = slot;
+        }
+    }
+
+    std::vector<Slot> m_slots; // the number of slots is a power of 2
+    std::vector<CharType> m_keys;
+    size_t m_size;
+};
+
+// Calls 'onToken(const CharType* token, size_t length)' for each non empty token in [begin, end) that is
+// delimited by spaces, tabs or line breaks, the way SplitString(line, " \n\r\t") splits a line.
+template <class CharType, class TokenFunction>
+inline void ForEachToken(const CharType* begin, const CharType* end, TokenFunction&& onToken)
+{
+    auto isDelimiter = [](CharType c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; };
+    const CharType* p = begin;
+    while (p != end)
+    {
+        while (p != end && isDelimiter(*p))
+            ++p;
+        const CharType* token = p;
+        while (p != end && !isDelimiter(*p))
+            ++p;
+        if (p != token)
+            onToken(token, (size_t)(p - token));
+    }
+}
+
+}}}
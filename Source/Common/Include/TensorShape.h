@@ -654,6 +654,53 @@ public:
             NarrowTo(k, (size_t)bounds.first[k], (size_t)bounds.second[k]);
         return *this;
     }
+    // broadcast singleton dimensions to the given (same or higher rank) dimensions, done in-place
+    // The broadcast dimensions get a stride of 0, so several indices refer to the same element; such a tensor must only be read.
+    template <class DimensionVector>
+    TensorShape& BroadcastInPlace(const DimensionVector& dims)
+    {
+        if (dims.size() < size())
+            LogicError("BroadcastInPlace: Cannot broadcast to a lower rank.");
+        for (size_t k = 0; k < dims.size(); k++)
+        {
+            if (k >= size())
+            {
+                m_dims.push_back(1);
+                m_strides.push_back(0);
+            }
+            if (m_dims[k] != (size_t)dims[k])
+            {
+                if (m_dims[k] != 1)
+                    LogicError("BroadcastInPlace: Only singleton dimensions can be broadcast.");
+                m_dims[k] = (size_t)dims[k];
+                m_strides[k] = 0;
+            }
+        }
+        return *this;
+    }
+    // reinterpret a dense tensor (or dense slice) with other dimensions of the same number of elements
+    TensorShape Reshaped(const SmallVector<size_t>& dims) const
+    {
+        VerifyIsDense();
+        TensorShape result(dims);
+        if (result.GetNumElements() != GetNumElements())
+            LogicError("Reshaped: Cannot reshape [%s] to [%s].", string(*this).c_str(), string(result).c_str());
+        result.m_offset = m_offset;
+        result.m_allocation = m_allocation;
+        return result;
+    }
+    // test whether the elements are stored without gaps in column-major order (slices may still have an offset)
+    // Same test as VerifyIsDense(), which AsMatrix() applies.
+    bool IsDense() const
+    {
+        for (size_t k = 0; k < m_dims.size(); k++)
+        {
+            ptrdiff_t stride = k > 0 ? m_strides[k - 1] * (ptrdiff_t) m_dims[k - 1] : 1;
+            if (m_strides[k] != stride)
+                return false;
+        }
+        return true;
+    }
     // swap two existing dimensions (implements transposition)
     // This yields the same tensor but index positions are exchanged.
     // This tensor is now no longer stored as column-major.
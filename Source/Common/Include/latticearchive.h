@@ -200,6 +200,7 @@ class lattice
     // more compact lattice storage
     std::vector<edgeinfo> edges2;                 // TODO: rename these
     std::vector<aligninfo> uniquededgedatatokens; // [-1]: LM score; [-2]: ac score; [0..]: actual aligninfo records
+    bool compacthaszerotokenedges;                // for rebuildedges() of a lattice kept compact
     float& uniqueedgelmscore(size_t firstalign)
     {
         return *(float*) &uniquededgedatatokens.data()[firstalign - 1];
@@ -939,9 +940,22 @@ public:
 
     // empty constructor, e.g. for use in minibatch source
     lattice()
+        : compacthaszerotokenedges(false)
     {
     }
 
+    // A V2 lattice read with fread (..., expand = false) stays in the compact form of the archive, edges2[] and
+    // uniquededgedatatokens[], which is a fraction of the size of edges[] and align[]. Call expand() before using it.
+    bool iscompact() const
+    {
+        return edges.empty() && !edges2.empty();
+    }
+    void expand()
+    {
+        if (iscompact())
+            rebuildedges(compacthaszerotokenedges);
+    }
+
     size_t freadtag(FILE* f, const char* tag)
     {
         fcheckTag(f, tag);
@@ -964,8 +978,9 @@ public:
     // If this fails, the lattice is in unusable state, but it is OK to call fread() again to regain a usable object. I.e. this is safe to be used in retry loops.
     // This will also map the aligninfo entries to the new symbol table, through idmap.
     // V1 lattices will be converted. 'spsenoneid' is used in that process.
+    // V2 lattices are expanded to edges[] and align[] unless 'expand' is false (see iscompact()).
     template <class IDMAP>
-    void fread(FILE* f, const IDMAP& idmap, size_t spunit)
+    void fread(FILE* f, const IDMAP& idmap, size_t spunit, bool expand = true)
     {
         size_t version = freadtag(f, "LAT ");
         if (version == 1)
@@ -1057,7 +1072,14 @@ public:
                 // RuntimeError("fread: mismatching /sp/ units");
             }
             // reconstruct old lattice format from this   --TODO: remove once we change to new data representation
-            rebuildedges(info.impliedspunitid != spunit /*to be able to read somewhat broken V2 lattice archives*/);
+            compacthaszerotokenedges = (info.impliedspunitid != spunit); // to be able to read somewhat broken V2 lattice archives
+            if (expand)
+                rebuildedges(compacthaszerotokenedges);
+            else // (in case this object held a lattice before)
+            {
+                edges.clear();
+                align.clear();
+            }
         }
         else
             RuntimeError("fread: unsupported lattice format version");
@@ -1301,6 +1323,21 @@ public:
         return toc.find(key) != toc.end();
     }
 
+    // the keys of all lattices, in the order in which they are read best: by archive, and in it by byte offset
+    std::vector<std::wstring> getkeys() const
+    {
+        std::vector<std::pair<std::pair<size_t, uint64_t>, std::wstring>> entries;
+        entries.reserve(toc.size());
+        for (const auto& entry : toc)
+            entries.push_back(std::make_pair(std::make_pair((size_t) entry.second.archiveindex, (uint64_t) entry.second.offset), entry.first));
+        std::sort(entries.begin(), entries.end());
+        std::vector<std::wstring> keys;
+        keys.reserve(entries.size());
+        for (const auto& entry : entries)
+            keys.push_back(entry.second);
+        return keys;
+    }
+
 #if 0 // TODO: change design to keep the #frames in the TOC, so we can check for mismatches before entering the training iteration
     // return # frames for a key, or 0 if lattice not found (this combines the function of haslattice(), we save one lookup)
     size_t getlatticeframes (const std::wstring & key) const
@@ -1318,8 +1355,9 @@ public:
     // 'key' is supposed to be known to exist. Use haslattice() to ensure. This is because this function is called from a retry loop.
     // Lattices will have unit ids updated according to the modelsymmap.
     // V1 lattices will be converted. 'spsenoneid' is used in the conversion for optimizing storing 0-frame /sp/ aligns.
+    // With 'expand' false, V2 lattices are kept compact (see lattice::iscompact()).
     void getlattice(const std::wstring& key, lattice& L,
-                    size_t expectedframes = SIZE_MAX /*if unknown*/) const
+                    size_t expectedframes = SIZE_MAX /*if unknown*/, bool expand = true) const
     {
         auto iter = toc.find(key);
         if (iter == toc.end())
@@ -1346,7 +1384,7 @@ public:
             // seek to start
             fsetpos(f, offset);
             // get it
-            L.fread(f, idmap, spunit);
+            L.fread(f, idmap, spunit, expand);
             L.setverbosity(verbosity);
 #ifdef HACK_IN_SILENCE // hack to simulate DEL in the lattice
             const size_t silunit = getid(modelsymmap, "sil");
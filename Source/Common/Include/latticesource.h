@@ -62,13 +62,31 @@ public:
 #endif
     }
 
-    void getlattices(const std::wstring& key, std::shared_ptr<const latticepair>& L, size_t expectedframes) const
+    // the keys of the (denominator) lattices, in the order in which they are read best
+    std::vector<std::wstring> getkeys() const
+    {
+        return denlattices.getkeys();
+    }
+
+    // With 'compact', the lattice is kept in the compact form of the archive if it has one (V2), for the lattices that
+    // are held in RAM with their feature chunk; expanded() then gives the form that sequence training works on.
+    void getlattices(const std::wstring& key, std::shared_ptr<const latticepair>& L, size_t expectedframes, bool compact = false) const
     {
         std::shared_ptr<latticepair> LP(new latticepair);
-        denlattices.getlattice(key, LP->second, expectedframes); // this loads the lattice from disk, using the existing L.second object
+        denlattices.getlattice(key, LP->second, expectedframes, !compact); // this loads the lattice from disk, using the existing L.second object
         L = LP;
     }
 
+    // returns 'L' if it is expanded, else an expanded copy (that lives as long as the minibatch that refers to it)
+    static std::shared_ptr<const latticepair> expanded(const std::shared_ptr<const latticepair>& L)
+    {
+        if (!L->second.iscompact())
+            return L;
+        std::shared_ptr<latticepair> LP(new latticepair(*L));
+        LP->second.expand();
+        return LP;
+    }
+
     void setverbosity(int veb)
     {
         verbosity = veb;
@@ -8,11 +8,14 @@
 #include "Basics.h"
 #include "File.h"
 #include "Matrix.h"
+#include "ValueCompression.h"
 #include "Config.h"
 
 #include "ComputationNode.h"
 #include "ScriptableObjects.h"
 #include "ComputationEnvironment.h"
+#include "MemoryProfiler.h"
+#include "TimingProfiler.h"
 
 #include <map>
 #include <string>
@@ -29,6 +32,7 @@
 #include <chrono>
 #include <unordered_map>
 #include <set>
+#include <functional>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -52,6 +56,16 @@ public:
         m_randomSeedOffset(0),
         m_isCompiled(false),
         m_areMatricesAllocated(false),
+        m_foldNodesForInference(false),
+        m_fuseNodesForInference(false),
+        m_fuseElementwiseNodes(false),
+        m_splitRecurrentProducts(false),
+        m_recomputeSegmentLength(0),
+        m_concurrentBranches(false),
+        m_inPlaceComputation(false),
+        m_stashValues(false),
+        m_stashCompression(ValueCompression::half),
+        m_memoryMapParameters(false),
         m_pMBLayoutOfNetwork(make_shared<MBLayout>(1, 0, L"*")),
         m_environment(make_shared<ComputationEnvironment>())
     {
@@ -117,12 +131,13 @@ public:
         return net;
     }
 
-    void Save(const std::wstring& fileName, const FileOptions fileFormat = FileOptions::fileOptionsBinary) const;
+    // 'sync': wait until the file is on the disk
+    void Save(const std::wstring& fileName, const FileOptions fileFormat = FileOptions::fileOptionsBinary, bool sync = false) const;
     void SaveEdited(const std::wstring& fileName, const FileOptions fileFormat = FileOptions::fileOptionsBinary);
 
 private:
 
-    void SaveToFileImpl(const std::wstring& fileName, const FileOptions fileFormat) const;
+    void SaveToFileImpl(const std::wstring& fileName, const FileOptions fileFormat, bool sync) const;
 
 public:
 
@@ -136,6 +151,28 @@ public:
     // main entry point for backprop
     void Backprop(const ComputationNodeBasePtr rootNode);
 
+    // Registers a function that Backprop(rootNode) calls for each learnable parameter below 'rootNode' as soon as its
+    // gradient is complete, i.e. right after the last node consuming the parameter has been backpropagated.
+    // This allows to overlap e.g. gradient aggregation with the remainder of the backward pass. Pass nullptr to remove it.
+    typedef std::function<void(const ComputationNodeBasePtr&)> GradientReadyCallback;
+    void SetGradientReadyCallback(const ComputationNodeBasePtr& rootNode, const GradientReadyCallback& callback);
+
+    // let ForwardProp() and Backprop() of all roots report each node to 'profiler' (nullptr to stop), see MemoryProfiler
+    void SetMemoryProfiler(const std::shared_ptr<MemoryProfiler>& profiler);
+    // same for the time of each node, see TimingProfiler
+    void SetTimingProfiler(const std::shared_ptr<TimingProfiler>& profiler);
+
+    // the memory plan of the network's matrices, for its statistics
+    const MatrixPool& GetMatrixPool() const { return m_matrixPool; }
+    // free the memory of the planned buffers until the next ForwardProp(), which computes all nodes again,
+    // e.g. for models that take turns on a device (see MatrixPool::ReleaseBufferMemory())
+    void ReleaseMatrixPoolMemory()
+    {
+        m_matrixPool.ReleaseBufferMemory();
+        for (auto& nodeIter : m_nameToNodeMap)
+            nodeIter.second->SetEvalTimeStampOutdatedWrtAll();
+    }
+
     // partial forward entry
     void ForwardProp(const ComputationNodeBasePtr rootNode, const ComputationNodeBasePtr startNode, 
                      const ComputationNodeBasePtr endNode);
@@ -175,12 +212,107 @@ public:
 
     void CompileNetwork(); // call this after creation, Load(), and any modification
 
+    // let CompileNetwork() fold BatchNormalization and mean/variance normalization into the weights of the preceding or
+    // following product, and replace subexpressions of model values by their precomputed value,
+    // for networks that are only evaluated (they can no longer be trained)
+    void SetFoldNodesForInference(bool foldNodesForInference) { m_foldNodesForInference = foldNodesForInference; }
+
+    // let CompileNetwork() replace Times -> Plus -> nonlinearity chains by FusedTimesPlusNodes,
+    // for networks that are only evaluated (they can no longer be trained)
+    void SetFuseNodesForInference(bool fuseNodesForInference) { m_fuseNodesForInference = fuseNodesForInference; }
+
+    // let CompileNetwork() replace ElementTimes/Plus/Sigmoid/Tanh expressions by FusedElementwiseNodes
+    void SetFuseElementwiseNodes(bool fuseElementwiseNodes) { m_fuseElementwiseNodes = fuseElementwiseNodes; }
+
+    // let CompileNetwork() split Times (W, RowStack (x, h)) inside recurrent loops, so that W x is computed outside the loop
+    void SetSplitRecurrentProducts(bool splitRecurrentProducts) { m_splitRecurrentProducts = splitRecurrentProducts; }
+
+    // let CompileNetwork() place nodes on other devices than that of the network, for models that do not fit on one GPU
+    // Each entry is a node name, which may contain a '*' wildcard, and a device; later entries win. See PlaceNodesOnDevices().
+    void SetNodeDevices(const std::vector<std::pair<std::wstring, DEVICEID_TYPE>>& nodeDevices) { m_nodeDevices = nodeDevices; }
+
+    // let AllocateAllMatrices() plan gradient checkpointing for the training criterion: the values inside a segment are
+    // released after ForwardProp() and recomputed segment by segment during Backprop(), which trades compute for memory.
+    // A segment ends after every 'segmentLength' non-leaf nodes (0: no limit) and at each node in 'checkpointNodeNames'.
+    // Call this before AllocateAllMatrices().
+    void SetRecomputeSegments(size_t segmentLength, const std::vector<std::wstring>& checkpointNodeNames)
+    {
+        m_recomputeSegmentLength = segmentLength;
+        m_recomputeCheckpointNodeNames = checkpointNodeNames;
+    }
+    bool IsRecomputingSegments() const { return m_recomputeSegmentLength > 0 || !m_recomputeCheckpointNodeNames.empty(); }
+
+    // let AllocateAllMatrices() prepare ForwardProp() to evaluate independent nodes concurrently, one level of the dependency
+    // graph after the other, and plan the memory sharing for that. CPU only; networks on a GPU are still evaluated in sequence.
+    // Call this before AllocateAllMatrices().
+    void SetConcurrentBranches(bool concurrentBranches) { m_concurrentBranches = concurrentBranches; }
+
+    // let AllocateAllMatrices() have elementwise nodes (see ComputationNode::CanComputeValueInPlaceOfInput()) write their value
+    // over the value of an input of the same shape, if they are its only consumer and that input value is not needed in backprop.
+    // Call this before AllocateAllMatrices().
+    void SetInPlaceComputation(bool inPlaceComputation) { m_inPlaceComputation = inPlaceComputation; }
+
+    // let AllocateAllMatrices() keep the training criterion's values that Backprop() needs encoded in fewer bits (see
+    // ValueCompression.h) from their last consumer in ForwardProp() to their first user in Backprop(), and share their matrices
+    // in between: in 1 bit if Backprop() only needs their sign (e.g. the output of a ReLU that only its own derivative reads),
+    // else in 16 ("half") or 8 bits ("byte"). "none" keeps them as they are. Values of or used by recurrent loops, or used by
+    // other roots, are kept as well. Changes gradients by the precision lost. Call this before AllocateAllMatrices().
+    void SetStashCompression(const std::wstring& compression)
+    {
+        m_stashValues = compression != L"none";
+        if (compression == L"half" || compression == L"none")
+            m_stashCompression = ValueCompression::half;
+        else if (compression == L"byte")
+            m_stashCompression = ValueCompression::byte;
+        else
+            InvalidArgument("SetStashCompression: Unknown compression '%ls', expected 'none', 'half' or 'byte'.", compression.c_str());
+    }
+
+    // let Read() memory-map the model file on the CPU, so that large LearnableParameters (model version 15) are paged in
+    // on first use instead of being read, and share their pages with other processes that load the same file.
+    // The mapping is copy-on-write: training modifies private copies of the pages, never the file.
+    void SetMemoryMapParameters(bool memoryMapParameters) { m_memoryMapParameters = memoryMapParameters; }
+
 private:
+    ComputationNetworkPtr CloneNetwork(CopyNodeFlags flags, int traceLevel) const;
     void ValidateNetwork();
-    size_t ValidateNodes(list<ComputationNodeBasePtr> nodes, bool isFirstPass, bool isFinalValidationPass);
+    struct ValidationState
+    {
+        size_t m_lastValidation = 0; // clock of the last Validate() of the node
+        size_t m_lastChange = 0;     // clock of the last Validate() that changed the node
+        bool m_valid = false;        // valid after the last pass
+    };
+    struct ValidationStates : map<ComputationNodeBasePtr, ValidationState>
+    {
+        size_t m_clock = 0;          // counts Validate() calls
+    };
+    size_t ValidateNodes(const list<ComputationNodeBasePtr>& nodes, bool isFirstPass, bool isFinalValidationPass, ValidationStates& states);
     bool ValidateNode(ComputationNodeBasePtr node, bool isFinalValidationPass) const;
     void MarkValueNonSharableNodes();
     void ChangeNodeInputs(ComputationNodeBasePtr fromNode, ComputationNodeBasePtr toNode);
+    typedef std::function<bool(const ComputationNodeBasePtr&)> IsIntermediateNodeFunction;
+    size_t FuseNodes(const std::function<bool(const ComputationNodeBasePtr&, const IsIntermediateNodeFunction&)>& tryFuse);
+    void ReplaceByFusedNode(const ComputationNodeBasePtr& node, const vector<ComputationNodeBasePtr>& intermediates,
+                            const ComputationNodeBasePtr& fused, const vector<ComputationNodeBasePtr>& inputs);
+    bool FoldNodesForInference();
+    template <class ElemType>
+    bool TryFoldConstant(const ComputationNodeBasePtr& node);
+    template <class ElemType>
+    bool TryFoldBatchNormalization(const ComputationNodeBasePtr& node, const IsIntermediateNodeFunction& isIntermediate);
+    template <class ElemType>
+    bool TryFoldMeanVarNormalization(const ComputationNodeBasePtr& node, const IsIntermediateNodeFunction& isIntermediate);
+    bool FuseNodesForInference();
+    template <class ElemType>
+    bool TryFuseTimesPlus(const ComputationNodeBasePtr& node, const IsIntermediateNodeFunction& isIntermediate);
+    bool FuseElementwiseNodes();
+    template <class ElemType>
+    bool TryFuseElementwise(const ComputationNodeBasePtr& node, int pattern, const IsIntermediateNodeFunction& isIntermediate);
+    bool SplitRecurrentProducts();
+    template <class ElemType>
+    bool TrySplitRecurrentProduct(const ComputationNodeBasePtr& node, const IsIntermediateNodeFunction& isIntermediate);
+    bool PlaceNodesOnDevices();
+    template <class ElemType>
+    ComputationNodeBasePtr DeviceCopyOf(const ComputationNodeBasePtr& input, DEVICEID_TYPE deviceId);
 
 private:
     void DetermineSetOfAllRoots();
@@ -196,8 +328,37 @@ public:
 private:
     void PrintMemorySharingStructure(const std::vector<ComputationNodeBasePtr>& nodes);
     void ReleaseMatricesAfterEvalForChildren(ComputationNodeBasePtr n, std::unordered_map<ComputationNodeBasePtr, int>& parentCount);
+    std::unordered_map<ComputationNodeBasePtr, size_t> DetermineDependencyLevels(const std::list<ComputationNodeBasePtr>& nodes) const;
+    size_t DetermineInPlaceInput(const ComputationNodeBasePtr& node,
+                                 const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap,
+                                 const std::set<ComputationNodeBasePtr>& recomputedNodes) const;
+
+    // a segment of the training criterion's network whose values are recomputed before its first node in reverse order is backpropagated
+    struct RecomputationSegment
+    {
+        ComputationNodeBasePtr m_first;              // first and last node of the segment in evaluation order
+        ComputationNodeBasePtr m_last;
+        std::vector<ComputationNodeBasePtr> m_nodes; // the nodes to recompute, in evaluation order
+    };
+    std::vector<RecomputationSegment> PlanRecomputation(const ComputationNodeBasePtr& trainRootNode,
+                                                        const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap,
+                                                        std::unordered_map<ComputationNodeBasePtr, bool>& outputValueNeededDuringBackProp);
     void AllocateGradientMatricesForInputs(ComputationNodeBasePtr parentNode);
 
+    // a value that Backprop() needs, kept compressed between its last consumer in ForwardProp() and its first user in Backprop()
+    struct StashedValue
+    {
+        ComputationNodeBasePtr m_node;
+        ValueCompression m_compression;
+        ComputationNodeBasePtr m_compressAfter;    // the last consumer in evaluation order, after whose ForwardProp() it is compressed
+        ComputationNodeBasePtr m_decompressBefore; // the first user in reverse order, before whose Backprop() it is decompressed
+        ComputationNodeBasePtr m_releaseAfter;     // the last user in reverse order, after whose Backprop() it is released
+    };
+    std::vector<StashedValue> PlanStashCompression(const ComputationNodeBasePtr& trainRootNode, const std::vector<ComputationNodeBasePtr>& forwardPropRoots,
+                                                   const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap,
+                                                   const std::set<ComputationNodeBasePtr>& recomputedNodes,
+                                                   std::unordered_map<ComputationNodeBasePtr, bool>& outputValueNeededDuringBackProp);
+
 public:
     // -----------------------------------------------------------------------
     // evaluation: execution plan and network recurrent-loop analysis
@@ -377,8 +538,11 @@ public:
     void RenameNode(const std::wstring& nodeNameOrig, const std::wstring& nodeNameNew);
     void RenameNode(ComputationNodeBasePtr node, const std::wstring& newNodeName);
     void DeleteNode(const std::wstring& nodeName);
+    void RemoveNodesNotNeededFor(const std::vector<ComputationNodeBasePtr>& outputNodes);
     void ReplaceNode(wstring nodeName, ComputationNodeBasePtr newNode);
     void InsertNode(wstring nodeName, ComputationNodeBasePtr newNode, const std::set<std::wstring>& newNodeTags);
+    ComputationNetworkPtr CloneSharingModelValues() const;
+    ComputationNetworkPtr CloneModelValuesToCPU() const;
     void ReplaceLeafNode(wstring oldNodeName, ComputationNodeBasePtr newNode);
     void ReplaceFinalCriterionNode(wstring oldNodeName, ComputationNodeBasePtr newNode);
     void AddFeatureNode(ComputationNodeBasePtr featureNode);
@@ -446,7 +610,7 @@ public:
 
     // TODO: Why are all these static, but then take a network as the first argument? --> make them class members
     template <class ElemType>
-    static void SetDropoutRate(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, size_t randSeedBase);
+    static void SetDropoutRate(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, size_t randSeedBase, bool statelessMask = false);
 
     template <class ElemType>
     static void SetBatchNormalizationTimeConstants(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, 
@@ -1053,6 +1217,29 @@ protected:
         // There is currently no other constructor for inner nested PAR-traversed sub-networks, but there will be.
         PARTraversalFlowControlNode(const std::vector<shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const std::list<ComputationNodeBasePtr>& allNodes);
         // Base::m_nestedNodes contains all top-level nodes, in evaluation order
+
+        void SetGradientReadyCallback(const GradientReadyCallback& callback);
+        void SetRecomputation(const std::map<ComputationNodeBasePtr, std::vector<ComputationNodeBasePtr>>& recomputeBefore) { m_recomputeBefore = recomputeBefore; }
+        void SetStashedValues(const std::vector<StashedValue>& stashedValues);
+        void SetDependencyLevels(const std::unordered_map<ComputationNodeBasePtr, size_t>& levels);
+        void SetMemoryProfiler(const std::shared_ptr<MemoryProfiler>& profiler) { m_memoryProfiler = profiler; }
+        void SetTimingProfiler(const std::shared_ptr<TimingProfiler>& profiler) { m_timingProfiler = profiler; }
+
+    private:
+        void ForwardPropByLevels(const FrameRange& fr);
+
+        // m_nestedNodes grouped by dependency level, if ForwardProp() evaluates the nodes of a level concurrently
+        std::vector<std::vector<ComputationNodeBasePtr>> m_levels;
+        GradientReadyCallback m_gradientReadyCallback;
+        std::shared_ptr<MemoryProfiler> m_memoryProfiler;
+        std::shared_ptr<TimingProfiler> m_timingProfiler;
+        // nested node -> nodes whose values are recomputed, in evaluation order, before that node is backpropagated
+        std::map<ComputationNodeBasePtr, std::vector<ComputationNodeBasePtr>> m_recomputeBefore;
+        // nested node -> values compressed after its ForwardProp(), and values decompressed before its Backprop()
+        std::map<ComputationNodeBasePtr, std::vector<StashedValue>> m_compressAfter;
+        std::map<ComputationNodeBasePtr, std::vector<StashedValue>> m_decompressBefore;
+        // nested node -> learnable parameters whose gradients are complete once that node has been backpropagated
+        std::map<ComputationNodeBasePtr, std::vector<ComputationNodeBasePtr>> m_gradientsCompletedBy;
     };
 
 public:
@@ -1110,6 +1297,18 @@ private:
     // cache for evaluation ordering:
     bool m_isCompiled; // CompileNetwork has been called
     bool m_areMatricesAllocated; // AllocateAllMatrices has been called
+    bool m_foldNodesForInference; // CompileNetwork() calls FoldNodesForInference()
+    bool m_fuseNodesForInference; // CompileNetwork() calls FuseNodesForInference()
+    bool m_fuseElementwiseNodes;  // CompileNetwork() calls FuseElementwiseNodes()
+    bool m_splitRecurrentProducts; // CompileNetwork() calls SplitRecurrentProducts()
+    std::vector<std::pair<std::wstring, DEVICEID_TYPE>> m_nodeDevices; // CompileNetwork() calls PlaceNodesOnDevices() if not empty
+    size_t m_recomputeSegmentLength;                         // see SetRecomputeSegments()
+    std::vector<std::wstring> m_recomputeCheckpointNodeNames;
+    bool m_concurrentBranches;                               // see SetConcurrentBranches()
+    bool m_inPlaceComputation;                               // see SetInPlaceComputation()
+    bool m_stashValues;                                      // see SetStashCompression()
+    ValueCompression m_stashCompression;
+    bool m_memoryMapParameters;                              // see SetMemoryMapParameters()
 
     // cached network iterations
     std::map<const ComputationNodeBasePtr, std::list<ComputationNodeBasePtr>> m_evalOrders; // [out node] flat depth-first traversal starting from out node
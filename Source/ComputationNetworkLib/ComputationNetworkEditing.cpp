@@ -8,7 +8,14 @@
 #include "Basics.h"
 #include "ComputationNode.h"
 #include "ComputationNetwork.h"
+#include "ConvolutionalNodes.h"
+#include "DeprecatedNodes.h"
 #include "InputAndParamNodes.h"
+#include "LinearAlgebraNodes.h"
+#include "NonlinearityNodes.h"
+#include "PreComputeNodes.h"
+#include "ReshapingNodes.h"
+#include "SpecialPurposeNodes.h"
 #include "TrainingNodes.h"
 #include <string>
 #include <vector>
@@ -103,6 +110,51 @@ void ComputationNetwork::CopyInputs(const std::wstring fromName, std::wstring to
     CopyNode(*this, fromName, toName, CopyNodeFlags::copyNodeInputLinks);
 }
 
+// CloneSharingModelValues - a compiled copy of the network for evaluation from another thread
+// The values of parameters and precomputed nodes (IsModelValue()) are shared with this network rather than copied,
+// so they must not be changed, e.g. by training or MEL, while a clone is in use. All other state is the clone's own.
+// Must not run concurrently with an evaluation of this network.
+ComputationNetworkPtr ComputationNetwork::CloneSharingModelValues() const
+{
+    return CloneNetwork(CopyNodeFlags(CopyNodeFlags::copyNodeValue | CopyNodeFlags::copyNodeShareModelValues), TraceLevel());
+}
+
+// CloneModelValuesToCPU - a compiled snapshot of the model, to be saved while this network goes on training
+// Dense values of parameters and precomputed nodes are copied to the CPU, other nodes have no values.
+// The snapshot is for Save() only.
+ComputationNetworkPtr ComputationNetwork::CloneModelValuesToCPU() const
+{
+    return CloneNetwork(CopyNodeFlags(CopyNodeFlags::copyNodeValue | CopyNodeFlags::copyNodeModelValuesToCPU), /*traceLevel=*/0);
+}
+
+ComputationNetworkPtr ComputationNetwork::CloneNetwork(CopyNodeFlags flags, int traceLevel) const
+{
+    auto net = make_shared<ComputationNetwork>(GetDeviceId());
+    net->SetTraceLevel(traceLevel);
+
+    for (const auto& iter : m_nameToNodeMap)
+        net->AddNodeToNet(iter.second->Duplicate(iter.first, flags));
+
+    // connect the copies like the originals
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        vector<ComputationNodeBasePtr> inputs;
+        for (const auto& input : iter.second->GetInputs())
+            inputs.push_back(net->GetNodeFromName(input->NodeName()));
+        if (!inputs.empty())
+            net->GetNodeFromName(iter.first)->AttachInputs(inputs);
+    }
+
+    for (const wstring& groupTag : { L"feature", L"label", L"criterion", L"evaluation", L"output" })
+    {
+        for (const auto& node : const_cast<ComputationNetwork&>(*this).GetNodeGroup(groupTag))
+            net->AddToNodeGroup(groupTag, net->GetNodeFromName(node->NodeName()));
+    }
+
+    net->CompileNetwork();
+    return net;
+}
+
 // RenameNode - Rename a node to another name
 // nodeNameOrig - original node name
 // nodeNameNew - new node name
@@ -167,6 +219,45 @@ void ComputationNetwork::DeleteNode(const std::wstring& nodeName)
     RemoveNodeFromNet(nodeToDelete);
 }
 
+// RemoveNodesNotNeededFor() -- delete all nodes that none of 'outputNodes' depends on, e.g. the criteria and labels
+// of a network that is only evaluated. The node groups keep the remaining nodes only.
+void ComputationNetwork::RemoveNodesNotNeededFor(const vector<ComputationNodeBasePtr>& outputNodes)
+{
+    set<ComputationNodeBasePtr> needed;
+    vector<ComputationNodeBasePtr> toVisit(outputNodes.begin(), outputNodes.end());
+    while (!toVisit.empty())
+    {
+        let node = toVisit.back();
+        toVisit.pop_back();
+        if (!node || !needed.insert(node).second)
+            continue;
+        for (let& input : node->GetInputs())
+            toVisit.push_back(input);
+    }
+
+    vector<ComputationNodeBasePtr> notNeeded;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        if (needed.find(iter.second) == needed.end())
+            notNeeded.push_back(iter.second);
+    }
+    if (notNeeded.empty())
+        return;
+
+    InvalidateCompiledNetwork();
+    for (let& node : notNeeded)
+    {
+        for (auto group : GetAllNodeGroups())
+            group->erase(std::remove(group->begin(), group->end(), node), group->end());
+        RemoveNodeFromNet(node);
+    }
+    for (let& node : notNeeded)
+        node->DetachInputs(); // (only when all are gone, since they may feed each other in loops)
+
+    if (TraceLevel() > 0)
+        fprintf(stderr, "\nRemoveNodesNotNeededFor: %d nodes that the %d outputs do not depend on were removed.\n", (int) notNeeded.size(), (int) outputNodes.size());
+}
+
 // replace a named node by newNode of the same type under the same name, including moving over all network links
 // This is used in the KL-reg based adaptation to reduce feature copy
 // need to update all the mappings as well childrens.
@@ -296,6 +387,653 @@ void ComputationNetwork::ReplaceFinalCriterionNode(wstring oldNodeName, Computat
     AddToNodeGroup(L"criterion", newNode);
 }
 
+// FuseNodes() -- apply a fusion to all nodes of the network
+// tryFuse(node, isIntermediate) replaces 'node', and intermediate nodes below it, by a fused node, and returns
+// whether it did. Nodes that disappear that way must not be needed by anything else (no other consumers, not a
+// root, not in a node group), which is what isIntermediate() tells.
+// Returns the number of fused nodes; if not 0, the network must be compiled again.
+size_t ComputationNetwork::FuseNodes(const std::function<bool(const ComputationNodeBasePtr&, const IsIntermediateNodeFunction&)>& tryFuse)
+{
+    map<ComputationNodeBasePtr, size_t> numConsumers;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        for (const auto& input : iter.second->GetInputs())
+            numConsumers[input]++;
+    }
+    set<ComputationNodeBasePtr> keep(m_allRoots.begin(), m_allRoots.end());
+    for (auto group : GetAllNodeGroups())
+        keep.insert(group->begin(), group->end());
+    IsIntermediateNodeFunction isIntermediate = [&](const ComputationNodeBasePtr& node)
+    {
+        return numConsumers[node] == 1 && keep.find(node) == keep.end();
+    };
+
+    // (copied, since the loop modifies the network)
+    vector<ComputationNodeBasePtr> nodes;
+    for (const auto& iter : m_nameToNodeMap)
+        nodes.push_back(iter.second);
+
+    size_t numFused = 0;
+    for (const auto& node : nodes)
+    {
+        // a node may already be gone as the intermediate of an earlier fusion
+        if (NodeNameExists(node->NodeName()) && GetNodeFromName(node->NodeName()) == node && tryFuse(node, isIntermediate))
+            numFused++;
+    }
+    return numFused;
+}
+
+// ReplaceByFusedNode() -- put 'fused' in place of 'node', removing 'node' and 'intermediates' from the network
+void ComputationNetwork::ReplaceByFusedNode(const ComputationNodeBasePtr& node, const vector<ComputationNodeBasePtr>& intermediates,
+                                            const ComputationNodeBasePtr& fused, const vector<ComputationNodeBasePtr>& inputs)
+{
+    ChangeNodeInputs(node, fused);
+    for (auto group : GetAllNodeGroups())
+        replace(group->begin(), group->end(), node, fused);
+    RemoveNodeFromNet(node);
+    node->DetachInputs();
+    for (let& intermediate : intermediates)
+    {
+        RemoveNodeFromNet(intermediate);
+        intermediate->DetachInputs();
+    }
+    fused->AttachInputs(inputs);
+    AddNodeToNet(fused);
+}
+
+// FoldNodesForInference() -- simplify the network for evaluation by precomputing what does not depend on the inputs
+// This is called by CompileNetwork() after validation, if SetFoldNodesForInference() was set:
+//  - BatchNormalization (Times (W, x)) and BatchNormalization (Convolution (W, x)), optionally with a Plus of a bias in
+//    between, become Plus (Times (W', x), b'), with the scale and shift of the running statistics folded into W' and b'
+//  - Times (W, PerDimMeanVarNormalization (x, mean, invStdDev)), or with (x - mean) .* invStdDev, becomes
+//    Plus (Times (W', x), b'), with W' = W diag (invStdDev) and b' = -W' mean
+//  - nodes that only depend on model values (learnable parameters and precomputed statistics) become LearnableParameters
+//    with the value that they evaluate to
+// The replacing Plus or parameter takes the name and the place of the original node. Model values that are no longer
+// used are removed. Returns true if the network was changed; it must then be compiled again.
+bool ComputationNetwork::FoldNodesForInference()
+{
+    set<ComputationNodeBasePtr> usedBefore;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        for (const auto& input : iter.second->GetInputs())
+            usedBefore.insert(input);
+    }
+
+    size_t numNormalizations = FuseNodes([this](const ComputationNodeBasePtr& node, const IsIntermediateNodeFunction& isIntermediate)
+    {
+        return TryFoldBatchNormalization<float>(node, isIntermediate) || TryFoldBatchNormalization<double>(node, isIntermediate) ||
+               TryFoldMeanVarNormalization<float>(node, isIntermediate) || TryFoldMeanVarNormalization<double>(node, isIntermediate);
+    });
+    size_t numConstants = FuseNodes([this](const ComputationNodeBasePtr& node, const IsIntermediateNodeFunction&)
+    {
+        return TryFoldConstant<float>(node) || TryFoldConstant<double>(node);
+    });
+
+    // e.g. the running statistics of a folded BatchNormalization node
+    set<ComputationNodeBasePtr> usedAfter;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        for (const auto& input : iter.second->GetInputs())
+            usedAfter.insert(input);
+    }
+    set<ComputationNodeBasePtr> keep;
+    for (auto group : GetAllNodeGroups())
+        keep.insert(group->begin(), group->end());
+    vector<ComputationNodeBasePtr> unused;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        let& node = iter.second;
+        if (node->IsModelValue() && usedBefore.find(node) != usedBefore.end() && usedAfter.find(node) == usedAfter.end() && keep.find(node) == keep.end())
+            unused.push_back(node);
+    }
+    for (let& node : unused)
+    {
+        RemoveNodeFromNet(node);
+        node->DetachInputs();
+    }
+
+    if ((numNormalizations > 0 || numConstants > 0) && TraceLevel() > 0)
+        fprintf(stderr, "\nFoldNodesForInference: %d normalizations were folded into products, %d nodes were replaced by their constant value, %d unused model values were removed.\n",
+                (int) numNormalizations, (int) numConstants, (int) unused.size());
+    return numNormalizations > 0 || numConstants > 0;
+}
+
+// a model value whose value can be read now: a LearnableParameter, or a statistic that has been precomputed
+template <class ElemType>
+static bool IsFoldableValue(const ComputationNodeBasePtr& node)
+{
+    let value = dynamic_pointer_cast<ComputationNode<ElemType>>(node);
+    if (!value || !value->IsModelValue() || value->HasMBLayout() || !value->ValuePtr() || value->Value().GetMatrixType() != DENSE)
+        return false;
+    let preCompute = dynamic_pointer_cast<IPreComputeNode>(node);
+    return !preCompute || preCompute->HasComputed();
+}
+
+template <class ElemType>
+static vector<ElemType> GetValueAsVector(const ComputationNodeBasePtr& node)
+{
+    let& value = dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+    unique_ptr<ElemType[]> data(value.CopyToArray());
+    return vector<ElemType>(data.get(), data.get() + value.GetNumElements());
+}
+
+// a constant with the given values, which is not learned further
+template <class ElemType>
+static ComputationNodeBasePtr NewFoldedParameter(DEVICEID_TYPE deviceId, const wstring& name, const TensorShape& shape, vector<ElemType>& values)
+{
+    let parameter = New<LearnableParameter<ElemType>>(deviceId, name, shape);
+    auto& value = parameter->Value();
+    value.SetValue(value.GetNumRows(), value.GetNumCols(), deviceId, values.data());
+    ComputationNodeBasePtr node = parameter;
+    node->SetLearningRateMultiplier(0);
+    return node;
+}
+
+template <class ElemType>
+bool ComputationNetwork::TryFoldConstant(const ComputationNodeBasePtr& node)
+{
+    // only nodes that compute their value from their inputs alone, without state or buffers of their own
+    static const set<wstring> foldableOperations =
+    {
+        OperationNameOf(PlusNode), OperationNameOf(MinusNode), OperationNameOf(ElementTimesNode), OperationNameOf(TimesNode),
+        OperationNameOf(TransposeTimesNode), OperationNameOf(TransposeDimensionsNode), OperationNameOf(ReshapeNode),
+        OperationNameOf(SliceNode), OperationNameOf(RowStackNode), OperationNameOf(NegateNode), OperationNameOf(ExpNode),
+        OperationNameOf(LogNode), OperationNameOf(SqrtNode), OperationNameOf(ReciprocalNode), OperationNameOf(AbsNode),
+        OperationNameOf(SigmoidNode), OperationNameOf(TanhNode), OperationNameOf(RectifiedLinearNode)
+    };
+    let constant = dynamic_pointer_cast<ComputationNode<ElemType>>(node);
+    if (!constant || constant->HasMBLayout() || constant->GetNumInputs() == 0 ||
+        foldableOperations.find(constant->OperationName()) == foldableOperations.end())
+        return false;
+    for (let& input : constant->GetInputs())
+    {
+        if (!IsFoldableValue<ElemType>(input))
+            return false;
+    }
+
+    constant->CreateValueMatrixIfNull();
+    constant->BeginForwardProp();
+    constant->ForwardProp(FrameRange(nullptr));
+    constant->EndForwardProp();
+    auto values = GetValueAsVector<ElemType>(constant);
+    ReplaceByFusedNode(node, {}, NewFoldedParameter<ElemType>(node->GetDeviceId(), node->NodeName(), node->GetSampleLayout(), values), {});
+    return true;
+}
+
+template <class ElemType>
+bool ComputationNetwork::TryFoldBatchNormalization(const ComputationNodeBasePtr& node, const IsIntermediateNodeFunction& isIntermediate)
+{
+    let bn = dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(node);
+    if (!bn)
+        return false;
+    for (size_t i = 1; i < node->GetNumInputs(); i++)
+    {
+        if (!IsFoldableValue<ElemType>(node->Input(i)))
+            return false;
+    }
+
+    // the product, possibly through a Plus with a bias
+    ComputationNodeBasePtr product = node->Input(0);
+    ComputationNodeBasePtr bias;
+    vector<ComputationNodeBasePtr> intermediates;
+    if (IsNodePtr<PlusNode<ElemType>>(product) && isIntermediate(product))
+    {
+        for (size_t productIndex = 0; productIndex < 2; productIndex++)
+        {
+            let candidate = product->Input(productIndex);
+            if ((IsNodePtr<TimesNode<ElemType>>(candidate) || IsNodePtr<ConvolutionNode<ElemType>>(candidate)) && IsFoldableValue<ElemType>(product->Input(1 - productIndex)))
+            {
+                intermediates.push_back(product);
+                bias = product->Input(1 - productIndex);
+                product = candidate;
+                break;
+            }
+        }
+    }
+    if (!isIntermediate(product) || product->GetNumInputs() != 2 || !IsFoldableValue<ElemType>(product->Input(0)))
+        return false;
+    let weights = product->Input(0);
+
+    vector<ElemType> scale, shift;
+    if (!bn->GetInferenceTransform(scale, shift))
+        return false;
+    size_t numMaps = scale.size();
+    size_t numWeights = weights->GetSampleLayout().GetNumElements();
+    let& shape = node->GetSampleLayout();
+    if (product->GetSampleLayout() != shape || (bias && product->GetMBLayout() != intermediates[0]->GetMBLayout()))
+        return false;
+
+    // W (m x k) scales row i by scale[i] for Times; a convolution kernel has one contiguous block of weights per output map
+    bool perRow;
+    TensorShape shiftShape = shape;
+    if (IsNodePtr<TimesNode<ElemType>>(product))
+    {
+        if (bn->IsSpatial() || shape.GetRank() != 1 || shape[0] != numMaps || weights->GetSampleLayout().GetRank() != 2 ||
+            weights->GetSampleLayout()[0] != numMaps)
+            return false;
+        perRow = true;
+    }
+    else
+    {
+        let convolution = dynamic_pointer_cast<ConvolutionNode<ElemType>>(product);
+        if (!convolution || convolution->Transpose() || convolution->ImageLayout() != ImageLayoutKind::CHW || !bn->IsSpatial() ||
+            bn->GetImageLayoutKind() != ImageLayoutKind::CHW || shape.GetRank() == 0 || shape[shape.GetRank() - 1] != numMaps ||
+            numWeights % numMaps != 0)
+            return false;
+        perRow = false;
+        vector<size_t> dims(shape.GetRank(), 1);
+        dims.back() = numMaps;
+        shiftShape = TensorShape(dims);
+    }
+    if (bias && bias->GetSampleLayout() != shiftShape)
+        return false;
+
+    // BN (W x + c) = scale .* (W x + c) + shift = (scale .* W) x + (scale .* c + shift)
+    auto foldedWeights = GetValueAsVector<ElemType>(weights);
+    size_t blockSize = numWeights / numMaps;
+    for (size_t j = 0; j < numWeights; j++)
+        foldedWeights[j] *= scale[perRow ? j % numMaps : j / blockSize];
+    if (bias)
+    {
+        let biasValues = GetValueAsVector<ElemType>(bias);
+        for (size_t i = 0; i < numMaps; i++)
+            shift[i] += scale[i] * biasValues[i];
+    }
+
+    let deviceId = node->GetDeviceId();
+    let& name = node->NodeName();
+    let newWeights = NewFoldedParameter<ElemType>(deviceId, name + L".foldedWeights", weights->GetSampleLayout(), foldedWeights);
+    let newShift = NewFoldedParameter<ElemType>(deviceId, name + L".foldedBias", shiftShape, shift);
+    AddNodeToNet(newWeights);
+    AddNodeToNet(newShift);
+    product->SetInput(0, newWeights);
+    ReplaceByFusedNode(node, intermediates, New<PlusNode<ElemType>>(deviceId, name), { product, newShift });
+    return true;
+}
+
+template <class ElemType>
+bool ComputationNetwork::TryFoldMeanVarNormalization(const ComputationNodeBasePtr& node, const IsIntermediateNodeFunction& isIntermediate)
+{
+    if (!IsNodePtr<TimesNode<ElemType>>(node))
+        return false;
+    let weights = node->Input(0);
+    let normalized = node->Input(1);
+    if (!IsFoldableValue<ElemType>(weights) || !isIntermediate(normalized))
+        return false;
+
+    ComputationNodeBasePtr input, mean, invStdDev;
+    vector<ComputationNodeBasePtr> intermediates = { normalized };
+    if (IsNodePtr<PerDimMeanVarNormalizationNode<ElemType>>(normalized))
+    {
+        input = normalized->Input(0);
+        mean = normalized->Input(1);
+        invStdDev = normalized->Input(2);
+    }
+    else if (IsNodePtr<ElementTimesNode<ElemType>>(normalized))
+    {
+        for (size_t differenceIndex = 0; differenceIndex < 2; differenceIndex++)
+        {
+            let difference = normalized->Input(differenceIndex);
+            if (IsNodePtr<MinusNode<ElemType>>(difference) && isIntermediate(difference) && difference != normalized->Input(1 - differenceIndex))
+            {
+                input = difference->Input(0);
+                mean = difference->Input(1);
+                invStdDev = normalized->Input(1 - differenceIndex);
+                intermediates.push_back(difference);
+                break;
+            }
+        }
+    }
+    if (!input || !IsFoldableValue<ElemType>(mean) || !IsFoldableValue<ElemType>(invStdDev))
+        return false;
+
+    // the normalization must not broadcast the input, and W (m x k) must be a plain matrix over it
+    size_t k = input->GetSampleLayout().GetNumElements();
+    let& shape = node->GetSampleLayout();
+    size_t m = shape.GetNumElements();
+    if (normalized->GetSampleLayout() != input->GetSampleLayout() || normalized->GetMBLayout() != input->GetMBLayout() ||
+        mean->GetSampleLayout().GetNumElements() != k || invStdDev->GetSampleLayout().GetNumElements() != k ||
+        weights->GetSampleLayout().GetRank() != 2 || weights->GetSampleLayout()[0] != m || weights->GetSampleLayout()[1] != k)
+        return false;
+
+    // W ((x - mean) .* invStdDev) = (W diag (invStdDev)) x - (W diag (invStdDev)) mean
+    auto foldedWeights = GetValueAsVector<ElemType>(weights);
+    let meanValues = GetValueAsVector<ElemType>(mean);
+    let invStdDevValues = GetValueAsVector<ElemType>(invStdDev);
+    vector<ElemType> shift(m, 0);
+    for (size_t j = 0; j < k; j++)
+    {
+        for (size_t i = 0; i < m; i++)
+        {
+            foldedWeights[j * m + i] *= invStdDevValues[j];
+            shift[i] -= foldedWeights[j * m + i] * meanValues[j];
+        }
+    }
+
+    let deviceId = node->GetDeviceId();
+    let& name = node->NodeName();
+    let newWeights = NewFoldedParameter<ElemType>(deviceId, name + L".foldedWeights", weights->GetSampleLayout(), foldedWeights);
+    let newShift = NewFoldedParameter<ElemType>(deviceId, name + L".foldedBias", shape, shift);
+    let product = node->Duplicate(name + L".folded", CopyNodeFlags::copyNodeValue);
+    AddNodeToNet(newWeights);
+    AddNodeToNet(newShift);
+    product->AttachInputs({ newWeights, input });
+    AddNodeToNet(product);
+    ReplaceByFusedNode(node, intermediates, New<PlusNode<ElemType>>(deviceId, name), { product, newShift });
+    return true;
+}
+
+// FuseNodesForInference() -- replace Times -> Plus -> Sigmoid/Tanh/RectifiedLinear chains by FusedTimesPlusNodes
+// This is called by CompileNetwork() after validation, if SetFuseNodesForInference() was set.
+// The fused node takes the name and the place of the nonlinearity.
+// Returns true if the network was changed; it must then be compiled again.
+bool ComputationNetwork::FuseNodesForInference()
+{
+    size_t numFused = FuseNodes([this](const ComputationNodeBasePtr& node, const IsIntermediateNodeFunction& isIntermediate)
+    {
+        return TryFuseTimesPlus<float>(node, isIntermediate) || TryFuseTimesPlus<double>(node, isIntermediate);
+    });
+    if (numFused > 0 && TraceLevel() > 0)
+        fprintf(stderr, "\nFuseNodesForInference: %d Times -> Plus -> nonlinearity chains were replaced by %ls nodes.\n",
+                (int) numFused, FusedTimesPlusNode<float>::TypeName().c_str());
+    return numFused > 0;
+}
+
+template <class ElemType>
+bool ComputationNetwork::TryFuseTimesPlus(const ComputationNodeBasePtr& node, const IsIntermediateNodeFunction& isIntermediate)
+{
+    ElementWiseOperator activation;
+    if (IsNodePtr<SigmoidNode<ElemType>>(node))
+        activation = opSigmoid;
+    else if (IsNodePtr<TanhNode<ElemType>>(node))
+        activation = opTanh;
+    else if (IsNodePtr<RectifiedLinearNode<ElemType>>(node))
+        activation = opLinearRectifier;
+    else
+        return false;
+
+    let plus = node->Input(0);
+    if (!IsNodePtr<PlusNode<ElemType>>(plus) || !isIntermediate(plus))
+        return false;
+
+    for (size_t timesIndex = 0; timesIndex < 2; timesIndex++)
+    {
+        let times = plus->Input(timesIndex);
+        let bias = plus->Input(1 - timesIndex);
+        if (!IsNodePtr<TimesNode<ElemType>>(times) || !isIntermediate(times) || times == bias)
+            continue;
+
+        // only a plain matrix product of vector samples, plus a bias vector of the same shape, which is what FusedTimesPlusNode computes
+        let weights = times->Input(0);
+        let input = times->Input(1);
+        let& shape = times->GetSampleLayout();
+        if (shape.GetRank() != 1 || plus->GetSampleLayout() != shape || node->GetSampleLayout() != shape ||
+            weights->HasMBLayout() || bias->HasMBLayout() || bias->GetSampleLayout().GetNumElements() != shape.GetNumElements() ||
+            weights->GetSampleLayout().GetNumElements() != shape.GetNumElements() * input->GetSampleLayout().GetNumElements() ||
+            plus->GetMBLayout() != times->GetMBLayout())
+            continue;
+
+        ReplaceByFusedNode(node, { plus, times }, New<FusedTimesPlusNode<ElemType>>(node->GetDeviceId(), node->NodeName(), activation), { weights, input, bias });
+        return true;
+    }
+    return false;
+}
+
+// FuseElementwiseNodes() -- replace small elementwise expressions by FusedElementwiseNodes
+// This is called by CompileNetwork() after validation, if SetFuseElementwiseNodes() was set. The patterns are
+//  - ElementTimes (a, Sigmoid (b)) and ElementTimes (a, Tanh (b)), the gates of an LSTM
+//  - Plus (ElementTimes (a, b), c), its cell update
+// with the operands in either order. The Sigmoid and Tanh of the first pattern are fused before the second one is
+// matched, i.e. f .* c + i .* Tanh (z) becomes Plus (FusedElementwise (f, c), FusedElementwise (i, z)).
+// Unlike FusedTimesPlusNode, the fused nodes have gradients, so this applies to training as well.
+// Returns true if the network was changed; it must then be compiled again.
+bool ComputationNetwork::FuseElementwiseNodes()
+{
+    size_t numFused = 0;
+    for (int pattern = 0; pattern < 2; pattern++)
+    {
+        numFused += FuseNodes([this, pattern](const ComputationNodeBasePtr& node, const IsIntermediateNodeFunction& isIntermediate)
+        {
+            return TryFuseElementwise<float>(node, pattern, isIntermediate) || TryFuseElementwise<double>(node, pattern, isIntermediate);
+        });
+    }
+    if (numFused > 0 && TraceLevel() > 0)
+        fprintf(stderr, "\nFuseElementwiseNodes: %d elementwise expressions were replaced by %ls nodes.\n",
+                (int) numFused, FusedElementwiseNode<float>::TypeName().c_str());
+    return numFused > 0;
+}
+
+template <class ElemType>
+bool ComputationNetwork::TryFuseElementwise(const ComputationNodeBasePtr& node, int pattern, const IsIntermediateNodeFunction& isIntermediate)
+{
+    // the fused node computes the broadcast shape of all inputs, which is only that of the original expression
+    // if the intermediate result is not broadcast itself, i.e. has the shape and the layout of the node
+    let sameShapeAndLayout = [&](const ComputationNodeBasePtr& intermediate)
+    {
+        return intermediate->GetSampleLayout() == node->GetSampleLayout() && intermediate->GetMBLayout() == node->GetMBLayout();
+    };
+
+    if (pattern == 0 && IsNodePtr<ElementTimesNode<ElemType>>(node))
+    {
+        for (size_t fIndex = 0; fIndex < 2; fIndex++)
+        {
+            let f = node->Input(fIndex);
+            let a = node->Input(1 - fIndex);
+            ElementWiseOperator op;
+            if (IsNodePtr<SigmoidNode<ElemType>>(f))
+                op = opElementwiseProductWithSigmoid;
+            else if (IsNodePtr<TanhNode<ElemType>>(f))
+                op = opElementwiseProductWithTanh;
+            else
+                continue;
+            if (!isIntermediate(f) || f == a || !sameShapeAndLayout(f))
+                continue;
+
+            ReplaceByFusedNode(node, { f }, New<FusedElementwiseNode<ElemType>>(node->GetDeviceId(), node->NodeName(), op), { a, f->Input(0) });
+            return true;
+        }
+    }
+    else if (pattern == 1 && IsNodePtr<PlusNode<ElemType>>(node))
+    {
+        for (size_t productIndex = 0; productIndex < 2; productIndex++)
+        {
+            let product = node->Input(productIndex);
+            let c = node->Input(1 - productIndex);
+            if (!IsNodePtr<ElementTimesNode<ElemType>>(product) || !isIntermediate(product) || product == c || !sameShapeAndLayout(product))
+                continue;
+
+            ReplaceByFusedNode(node, { product }, New<FusedElementwiseNode<ElemType>>(node->GetDeviceId(), node->NodeName(), opElementwiseProductPlus),
+                               { product->Input(0), product->Input(1), c });
+            return true;
+        }
+    }
+    return false;
+}
+
+// SplitRecurrentProducts() -- take the non-recurrent part of Times (W, RowStack (x, h)) products out of recurrent loops
+// This is called by CompileNetwork() after validation, if SetSplitRecurrentProducts() was set. In a simple RNN cell,
+// Times (W, RowStack (x, PastValue (h))) is a member of the loop, so W is multiplied with x one frame at a time, although
+// x does not depend on the recurrence. The product is rewritten as
+//     Plus (Times (Slice (W, x columns), x), Times (Slice (W, h columns), h))
+// which makes the first Times a regular node that the next compilation evaluates outside the loop, as one product over
+// the whole minibatch. Consecutive RowStack inputs of the same kind become one product (of a new RowStack if needed).
+// The gradients stay exact, so this applies to training as well.
+// Returns true if the network was changed; it must then be compiled again.
+bool ComputationNetwork::SplitRecurrentProducts()
+{
+    size_t numSplit = FuseNodes([this](const ComputationNodeBasePtr& node, const IsIntermediateNodeFunction& isIntermediate)
+    {
+        return TrySplitRecurrentProduct<float>(node, isIntermediate) || TrySplitRecurrentProduct<double>(node, isIntermediate);
+    });
+    if (numSplit > 0 && TraceLevel() > 0)
+        fprintf(stderr, "\nSplitRecurrentProducts: %d products inside recurrent loops were split into a recurrent and a non-recurrent part.\n", (int) numSplit);
+    return numSplit > 0;
+}
+
+template <class ElemType>
+bool ComputationNetwork::TrySplitRecurrentProduct(const ComputationNodeBasePtr& node, const IsIntermediateNodeFunction& isIntermediate)
+{
+    if (!IsNodePtr<TimesNode<ElemType>>(node) || !node->IsPartOfLoop())
+        return false;
+    let weights = node->Input(0);
+    let stack = node->Input(1);
+    if (!IsNodePtr<RowStackNode<ElemType>>(stack) || weights->HasMBLayout() || weights->GetSampleLayout().GetRank() != 2 ||
+        node->GetSampleLayout().GetRank() != 1 || stack->GetSampleLayout().GetRank() != 1 || stack->GetNumInputs() < 2)
+        return false;
+
+    // an input is recurrent if it is in the same loop; the others must be sequences like the RowStack, so that their
+    // product is one as well
+    let loop = FindInRecurrentLoops(m_allSEQNodes, node);
+    vector<bool> isRecurrent;
+    bool anyRecurrent = false, anyNonRecurrent = false;
+    for (let& input : stack->GetInputs())
+    {
+        if (input->GetSampleLayout().GetRank() != 1)
+            return false;
+        bool recurrent = input->IsPartOfLoop() && FindInRecurrentLoops(m_allSEQNodes, input) == loop;
+        if (!recurrent && input->GetMBLayout() != stack->GetMBLayout())
+            return false;
+        isRecurrent.push_back(recurrent);
+        anyRecurrent |= recurrent;
+        anyNonRecurrent |= !recurrent;
+    }
+    if (!anyRecurrent || !anyNonRecurrent)
+        return false;
+
+    // one product per run of inputs of the same kind, over the matching columns of the weights
+    let deviceId = node->GetDeviceId();
+    let& name = node->NodeName();
+    vector<ComputationNodeBasePtr> products;
+    size_t column = 0;
+    for (size_t first = 0; first < stack->GetNumInputs();)
+    {
+        size_t last = first;
+        size_t numColumns = 0;
+        for (; last < stack->GetNumInputs() && isRecurrent[last] == isRecurrent[first]; last++)
+            numColumns += stack->Input(last)->GetSampleLayout().GetNumElements();
+        let k = to_wstring(products.size());
+
+        ComputationNodeBasePtr slice = New<SliceNode<ElemType>>(deviceId, name + L".weights" + k, (int) column, (int) (column + numColumns), 2);
+        slice->AttachInputs({ weights });
+        AddNodeToNet(slice);
+        ComputationNodeBasePtr input = stack->Input(first);
+        if (last - first > 1)
+        {
+            input = New<RowStackNode<ElemType>>(deviceId, name + L".inputs" + k);
+            input->AttachInputs(vector<ComputationNodeBasePtr>(stack->GetInputs().begin() + first, stack->GetInputs().begin() + last));
+            AddNodeToNet(input);
+        }
+        ComputationNodeBasePtr product = New<TimesNode<ElemType>>(deviceId, name + L".times" + k);
+        product->AttachInputs({ slice, input });
+        AddNodeToNet(product);
+        products.push_back(product);
+
+        column += numColumns;
+        first = last;
+    }
+
+    // sum them up; the last Plus takes the name and the place of the product
+    ComputationNodeBasePtr sum = products[0];
+    for (size_t k = 1; k + 1 < products.size(); k++)
+    {
+        ComputationNodeBasePtr partialSum = New<PlusNode<ElemType>>(deviceId, name + L".sum" + to_wstring(k));
+        partialSum->AttachInputs({ sum, products[k] });
+        AddNodeToNet(partialSum);
+        sum = partialSum;
+    }
+    vector<ComputationNodeBasePtr> intermediates;
+    if (isIntermediate(stack))
+        intermediates.push_back(stack);
+    ReplaceByFusedNode(node, intermediates, New<PlusNode<ElemType>>(deviceId, name), { sum, products.back() });
+    return true;
+}
+
+// PlaceNodesOnDevices() -- model parallelism: move the nodes named by SetNodeDevices() to their devices
+// This is called by CompileNetwork() after validation, if SetNodeDevices() was set. Wherever a node then has an input
+// on another device, a DeviceCopyNode named <input>.device<deviceId> is put in between, one per input and device, so
+// that no matrix operation mixes devices. Nodes that manage inputs on other devices themselves (ShardedCrossEntropyWithSoftmax)
+// are left alone. The copies are saved with the model; when a model with copies is loaded and placed again, each copy
+// follows its consumers, so that none are added twice.
+// Returns true if copies were inserted; the network must then be compiled again.
+bool ComputationNetwork::PlaceNodesOnDevices()
+{
+    size_t numMoved = 0;
+    for (let& nodeDevice : m_nodeDevices)
+    {
+        let nodes = GetNodesFromName(nodeDevice.first);
+        if (nodes.empty())
+            InvalidArgument("PlaceNodesOnDevices: No node matches '%ls'.", nodeDevice.first.c_str());
+        for (let& node : nodes)
+        {
+            if (node->GetDeviceId() == nodeDevice.second)
+                continue;
+            node->MoveToDevice(nodeDevice.second);
+            numMoved++;
+        }
+    }
+
+    // collect the consumers first, since the loop below adds nodes
+    vector<ComputationNodeBasePtr> nodes;
+    map<ComputationNodeBasePtr, set<DEVICEID_TYPE>> consumerDevices;
+    for (let& iter : m_nameToNodeMap)
+    {
+        nodes.push_back(iter.second);
+        for (let& input : iter.second->GetInputs())
+            consumerDevices[input].insert(iter.second->GetDeviceId());
+    }
+    for (let& node : nodes)
+    {
+        let iter = consumerDevices.find(node);
+        if ((IsNodePtr<DeviceCopyNode<float>>(node) || IsNodePtr<DeviceCopyNode<double>>(node)) &&
+            iter != consumerDevices.end() && iter->second.size() == 1 && *iter->second.begin() != node->GetDeviceId())
+        {
+            node->MoveToDevice(*iter->second.begin());
+            numMoved++;
+        }
+    }
+
+    size_t numCopies = 0;
+    for (let& node : nodes)
+    {
+        if (node->AcceptsInputsFromOtherDevices())
+            continue;
+        for (size_t i = 0; i < node->GetNumInputs(); i++)
+        {
+            let input = node->Input(i);
+            if (input->GetDeviceId() == node->GetDeviceId())
+                continue;
+            let size = m_nameToNodeMap.size();
+            let copy = IsNodePtr<ComputationNode<float>>(input) ? DeviceCopyOf<float>(input, node->GetDeviceId()) : DeviceCopyOf<double>(input, node->GetDeviceId());
+            node->SetInput(i, copy);
+            numCopies += m_nameToNodeMap.size() - size;
+        }
+    }
+
+    if ((numMoved > 0 || numCopies > 0) && TraceLevel() > 0)
+        fprintf(stderr, "\nPlaceNodesOnDevices: %d nodes were moved to other devices, and %d %ls nodes were inserted.\n",
+                (int) numMoved, (int) numCopies, DeviceCopyNode<float>::TypeName().c_str());
+    return numCopies > 0;
+}
+
+// the copy of 'input' on 'deviceId', shared by all its consumers there
+template <class ElemType>
+ComputationNodeBasePtr ComputationNetwork::DeviceCopyOf(const ComputationNodeBasePtr& input, DEVICEID_TYPE deviceId)
+{
+    let name = input->NodeName() + L".device" + (deviceId == CPUDEVICE ? wstring(L"CPU") : to_wstring(deviceId));
+    if (NodeNameExists(name))
+    {
+        let copy = GetNodeFromName(name);
+        if (!IsNodePtr<DeviceCopyNode<ElemType>>(copy) || copy->Input(0) != input || copy->GetDeviceId() != deviceId)
+            RuntimeError("PlaceNodesOnDevices: The name of the device copy %ls is already taken.", name.c_str());
+        return copy;
+    }
+    ComputationNodeBasePtr copy = New<DeviceCopyNode<ElemType>>(deviceId, name);
+    copy->AttachInputs({ input });
+    AddNodeToNet(copy);
+    return copy;
+}
+
 void ComputationNetwork::AddFeatureNode(ComputationNodeBasePtr featureNode)
 {
     InvalidateCompiledNetwork();
@@ -10,12 +10,14 @@
 #include "ComputationNetwork.h"
 #include "RecurrentNodes.h"
 #include "InputAndParamNodes.h"
+#include "TimerUtility.h"
 #include <string>
 #include <vector>
 #include <list>
 #include <set>
 #include <algorithm>
 #include <map>
+#include <exception>
 
 using namespace std;
 
@@ -79,6 +81,39 @@ void ComputationNetwork::Backprop(const ComputationNodeBasePtr rootNode) // trai
     GetNestedNetwork(rootNode)->Backprop(FrameRange(nullptr), true, true);
 }
 
+void ComputationNetwork::SetGradientReadyCallback(const ComputationNodeBasePtr& rootNode, const GradientReadyCallback& callback)
+{
+    VerifyIsCompiled("SetGradientReadyCallback");
+
+    shared_ptr<PARTraversalFlowControlNode> network = dynamic_pointer_cast<PARTraversalFlowControlNode>(GetNestedNetwork(rootNode));
+    assert(network);
+    network->SetGradientReadyCallback(callback);
+}
+
+void ComputationNetwork::SetMemoryProfiler(const shared_ptr<MemoryProfiler>& profiler)
+{
+    VerifyIsCompiled("SetMemoryProfiler");
+
+    for (auto& nestedNetwork : m_nestedNetworks)
+    {
+        shared_ptr<PARTraversalFlowControlNode> network = dynamic_pointer_cast<PARTraversalFlowControlNode>(nestedNetwork.second);
+        assert(network);
+        network->SetMemoryProfiler(profiler);
+    }
+}
+
+void ComputationNetwork::SetTimingProfiler(const shared_ptr<TimingProfiler>& profiler)
+{
+    VerifyIsCompiled("SetTimingProfiler");
+
+    for (auto& nestedNetwork : m_nestedNetworks)
+    {
+        shared_ptr<PARTraversalFlowControlNode> network = dynamic_pointer_cast<PARTraversalFlowControlNode>(nestedNetwork.second);
+        assert(network);
+        network->SetTimingProfiler(profiler);
+    }
+}
+
 void ComputationNetwork::ForwardProp(const ComputationNodeBasePtr rootNode, const ComputationNodeBasePtr startNode, const ComputationNodeBasePtr endNode)
 {
     VerifyIsCompiled("ForwardProp");
@@ -142,46 +177,202 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
         }
     }
 }
+// returns whether the node was out of date and has been evaluated
+static bool ForwardPropNestedNode(const ComputationNodeBasePtr& node, const FrameRange& fr)
+{
+#if 0
+    if (dynamic_pointer_cast<LearnableParameter<float>>(node))
+        dynamic_pointer_cast<ComputationNode<float>>(node)->DebugLogMinibatch();
+#endif
+    bool isOutOfDate = node->IsOutOfDateWrtInputs();
+    if (isOutOfDate)
+    {
+        node->BeginForwardProp();
+        node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
+        node->EndForwardProp();
+
+        node->BumpEvalTimeStamp();
+    }
+
+    // more extreme tracing for the ultimate debugging experience. Make space on your disk.
+    if (node->GetEnvironmentPtr() && node->Environment().traceLevel >= 1000000) // very high number, since this spews like hell
+        DumpNode<float>(node, /*dumpGradient=*/false) || DumpNode<double>(node, false);
+    return isOutOfDate;
+}
+
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::ForwardProp(const FrameRange& fr) /*override*/
 {
+    bool isProfiling = m_memoryProfiler && m_memoryProfiler->IsActive();
+    if (!m_levels.empty() && !isProfiling && !m_timingProfiler) // (the profilers record the nodes one after the other)
+        return ForwardPropByLevels(fr);
+
     for (auto& node : m_nestedNodes)
     {
-#if 0
-        if (dynamic_pointer_cast<LearnableParameter<float>>(node))
-            dynamic_pointer_cast<ComputationNode<float>>(node)->DebugLogMinibatch();
-#endif
-        if (node->IsOutOfDateWrtInputs())
+        double startTime = isProfiling ? m_memoryProfiler->Now() : 0;
+        size_t begin = m_timingProfiler ? m_timingProfiler->Begin() : 0;
+        if (ForwardPropNestedNode(node, fr)) // (nodes shared with other roots are evaluated once)
         {
-            node->BeginForwardProp();
-            node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
-            node->EndForwardProp();
+            // stash compression: encode the values that were last consumed here, before others write over their matrices
+            auto compress = m_compressAfter.find(node);
+            if (compress != m_compressAfter.end())
+            {
+                for (const auto& stashed : compress->second)
+                    stashed.m_node->CompressValue(stashed.m_compression);
+            }
 
-            node->BumpEvalTimeStamp();
+            if (isProfiling)
+                m_memoryProfiler->RecordNode(node, /*isBackprop=*/false, startTime);
+            if (m_timingProfiler)
+                m_timingProfiler->EndNode(node, /*isBackprop=*/false, begin);
         }
+    }
+}
 
-        // more extreme tracing for the ultimate debugging experience. Make space on your disk.
-        if (node->GetEnvironmentPtr() && node->Environment().traceLevel >= 1000000) // very high number, since this spews like hell
-            DumpNode<float>(node, /*dumpGradient=*/false) || DumpNode<double>(node, false);
+// The nodes of a level only depend on nodes of lower levels, so they are evaluated concurrently, as tasks of an OpenMP team,
+// each of them single-threaded. A level with a single node runs on the calling thread, where the node's operations can use all threads.
+// The memory sharing was planned level by level as well (AllocateAllMatrices()), so concurrent nodes never share a matrix.
+void ComputationNetwork::PARTraversalFlowControlNode::ForwardPropByLevels(const FrameRange& fr)
+{
+    for (const auto& level : m_levels)
+    {
+        if (level.size() == 1)
+        {
+            ForwardPropNestedNode(level.front(), fr);
+            continue;
+        }
+
+        std::exception_ptr exception;
+#pragma omp parallel for schedule(dynamic, 1)
+        for (long i = 0; i < (long) level.size(); i++)
+        {
+            try
+            {
+                ForwardPropNestedNode(level[i], fr);
+            }
+            catch (...) // exceptions must not leave the parallel region
+            {
+#pragma omp critical
+                if (!exception)
+                    exception = std::current_exception();
+            }
+        }
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+}
+
+void ComputationNetwork::PARTraversalFlowControlNode::SetDependencyLevels(const std::unordered_map<ComputationNodeBasePtr, size_t>& levels)
+{
+    m_levels.clear();
+    for (const auto& node : m_nestedNodes)
+    {
+        // a recurrent loop is evaluated as a whole, at the level of its nodes
+        auto seqNode = dynamic_pointer_cast<SEQTraversalFlowControlNode>(node);
+        auto level = levels.find(seqNode ? seqNode->m_nestedNodes.front() : node);
+        if (level == levels.end())
+            LogicError("SetDependencyLevels: No level for node %ls.", node->NodeName().c_str());
+        if (m_levels.size() <= level->second)
+            m_levels.resize(level->second + 1);
+        m_levels[level->second].push_back(node);
     }
 }
 
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::Backprop(const FrameRange& fr, bool childrenInThisLoop, bool childrenInOuterLoop) /*override*/
 {
     childrenInThisLoop, childrenInOuterLoop; // TODO: think through what these mean when coming from PAR mode
+    bool isProfiling = m_memoryProfiler && m_memoryProfiler->IsActive();
     // process nodes in pre-determined order
     for (auto pnode = m_nestedNodes.rbegin(); pnode != m_nestedNodes.rend(); pnode++) // iterate backwards over evaluation order
     {
         auto& node = *pnode;
+        double startTime = isProfiling ? m_memoryProfiler->Now() : 0;
+        size_t begin = m_timingProfiler ? m_timingProfiler->Begin() : 0;
+
+        // gradient checkpointing: recompute the values of the segment that ends here, which were released after ForwardProp()
+        // The time stamps are not bumped, since the values are the same as before.
+        auto recompute = m_recomputeBefore.find(node);
+        if (recompute != m_recomputeBefore.end())
+        {
+            for (const auto& recomputedNode : recompute->second)
+            {
+                recomputedNode->BeginForwardProp();
+                recomputedNode->ForwardProp(fr.WithLayout(recomputedNode->GetMBLayout()));
+                recomputedNode->EndForwardProp();
+            }
+        }
+
+        // stash compression: decode the values that Backprop() needs from here on
+        auto decompress = m_decompressBefore.find(node);
+        if (decompress != m_decompressBefore.end())
+        {
+            for (const auto& stashed : decompress->second)
+                stashed.m_node->DecompressValue(stashed.m_compression);
+        }
 
         node->BeginBackprop();
         node->Backprop(fr.WithLayout(node->GetMBLayout()), true /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
         node->EndBackprop();
+        if (isProfiling)
+            m_memoryProfiler->RecordNode(node, /*isBackprop=*/true, startTime);
+        if (m_timingProfiler)
+            m_timingProfiler->EndNode(node, /*isBackprop=*/true, begin);
 
         // more extreme tracing for the ultimate debugging experience. Make space on your disk.
         if (node->GetEnvironmentPtr() && node->Environment().traceLevel >= 1000000 && node->NeedsGradient()) // very high number, since this spews like hell
             DumpNode<float>(node, /*dumpGradient=*/true) || DumpNode<double>(node, true);
+
+        // notify about parameters whose gradients are now complete
+        if (m_gradientReadyCallback)
+        {
+            auto completed = m_gradientsCompletedBy.find(node);
+            if (completed != m_gradientsCompletedBy.end())
+            {
+                for (const auto& parameter : completed->second)
+                    m_gradientReadyCallback(parameter);
+            }
+        }
+    }
+}
+
+void ComputationNetwork::PARTraversalFlowControlNode::SetStashedValues(const std::vector<StashedValue>& stashedValues)
+{
+    m_compressAfter.clear();
+    m_decompressBefore.clear();
+    for (const auto& stashed : stashedValues)
+    {
+        m_compressAfter[stashed.m_compressAfter].push_back(stashed);
+        m_decompressBefore[stashed.m_decompressBefore].push_back(stashed);
     }
 }
+
+void ComputationNetwork::PARTraversalFlowControlNode::SetGradientReadyCallback(const GradientReadyCallback& callback)
+{
+    m_gradientReadyCallback = callback;
+    if (!m_gradientReadyCallback || !m_gradientsCompletedBy.empty())
+        return;
+
+    // Determine for each learnable parameter the nested node that is backpropagated last among its consumers.
+    // Nodes are backpropagated in reverse order, so that is the first consumer in evaluation order.
+    // Recurrent loops are backpropagated as a whole, so the loop counts as the consumer of all parameters used inside.
+    std::map<ComputationNodeBasePtr, ComputationNodeBasePtr> lastConsumer;
+    for (auto pnode = m_nestedNodes.rbegin(); pnode != m_nestedNodes.rend(); pnode++)
+    {
+        auto& node = *pnode;
+        auto seqNode = dynamic_pointer_cast<SEQTraversalFlowControlNode>(node);
+        std::vector<ComputationNodeBasePtr> consumers = seqNode ? seqNode->m_nestedNodes : std::vector<ComputationNodeBasePtr>{ node };
+        for (const auto& consumer : consumers)
+        {
+            for (const auto& input : consumer->GetInputs())
+            {
+                if (input->IsLeaf() && input->IsParameterUpdateRequired())
+                    lastConsumer[input] = node;
+            }
+        }
+    }
+
+    for (const auto& entry : lastConsumer)
+        m_gradientsCompletedBy[entry.second].push_back(entry.first);
+}
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) /*override*/
 {
 }
@@ -216,6 +407,13 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
             node->EndForwardProp();
 
             node->BumpEvalTimeStamp();
+
+            auto compress = m_compressAfter.find(node);
+            if (compress != m_compressAfter.end())
+            {
+                for (const auto& stashed : compress->second)
+                    stashed.m_node->CompressValue(stashed.m_compression);
+            }
         }
 
         if (node == startNode) 
@@ -475,8 +673,21 @@ void ComputationNetwork::CompileNetwork()
     // Or just invalidate it again, which is easier and safer.
     InvalidateCompiledNetwork();
 
+    // where the time goes, for large networks (printed at the end)
+    Timer stepTimer;
+    stepTimer.Start();
+    auto lap = [&stepTimer]()
+    {
+        stepTimer.Stop();
+        double seconds = stepTimer.ElapsedSeconds();
+        stepTimer.Restart();
+        return seconds;
+    };
+    double rootsSeconds, evalOrderSeconds, loopsSeconds, nestingSeconds, validationSeconds;
+
     // all steps below have to be repeated for all root nodes (=nodes without parents and PreComputeNodes)
     DetermineSetOfAllRoots();
+    rootsSeconds = lap();
 
     if (TraceLevel() > 0)
     {
@@ -501,9 +712,11 @@ void ComputationNetwork::CompileNetwork()
     // This sets all MBLayout pointers of Input nodes according to user spec of time axes.
     // TODO: Don't use m_inputValues, traverse ourselves, to remove dependency on FormEvalOrder().
     ResetMBLayouts();
+    evalOrderSeconds = lap();
 
     // STEP: Discover nested loops.
     FormRecurrentLoops(nullptr); // form the global one  --TODO: just use this; should be no need to do this for each root
+    loopsSeconds = lap();
     //for (auto& node : m_allRoots)
     //    FormRecurrentLoops(node); // BUGBUG: These calls are needed because they patch EvalOrders. Will be unnecessary once we move this out.
 
@@ -517,12 +730,25 @@ void ComputationNetwork::CompileNetwork()
     // STEP: Form nested structure of PAR and SEQ traversal nodes.
     for (auto& node : m_allRoots)
         FormNestedNetwork(node);
+    nestingSeconds = lap();
 
     // STEP: Infer node dimensions.
     ValidateNetwork();
+    validationSeconds = lap();
+
+    if (TraceLevel() > 0)
+        fprintf(stderr, "\nPost-processed %d nodes in %.3f seconds: roots %.3f, eval orders %.3f, loops %.3f, per-root orders %.3f, validation %.3f.\n",
+                (int)m_nameToNodeMap.size(), rootsSeconds + evalOrderSeconds + loopsSeconds + nestingSeconds + validationSeconds,
+                rootsSeconds, evalOrderSeconds, loopsSeconds, nestingSeconds, validationSeconds);
 
     // STEP: Optimize the network.
-    // :)
+    // Fusing nodes changes the graph, which is then compiled once more from scratch (and will not be fused further).
+    if ((!m_nodeDevices.empty() && PlaceNodesOnDevices()) || (m_splitRecurrentProducts && SplitRecurrentProducts()) || (m_foldNodesForInference && FoldNodesForInference()) ||
+        (m_fuseNodesForInference && FuseNodesForInference()) || (m_fuseElementwiseNodes && FuseElementwiseNodes()))
+    {
+        CompileNetwork();
+        return;
+    }
 
     // STEP: Some final details.
     ResetEvalTimeStamps(); // invalidate all m_value fields. Really belongs into StartEvaluateMinibatchLoop()
@@ -667,18 +893,21 @@ void ComputationNetwork::ValidateNetwork()
     //    Keep going through the list until all nodes have been validated and all inputs have been validated as well.
     //  - validate (final)              // final means consistency checks
     //    Fail if any change during this stage.
+    // The passes after the first only revisit nodes that are not valid yet or whose inputs changed since, which for
+    // large networks is typically a small set around the recurrent loops.
+    ValidationStates states;
     size_t pass = 1;
     size_t toValidate = nodes.size();
     while (toValidate > 0)
     {
         if (TraceLevel() > 0)
         fprintf(stderr, "\nValidating network. %d nodes to process in pass %d.\n\n", (int) toValidate, (int) pass);
-        toValidate = ValidateNodes(nodes, /*isFirstPass=*/pass == 1, false /*isFinalValidationPass*/);
+        toValidate = ValidateNodes(nodes, /*isFirstPass=*/pass == 1, false /*isFinalValidationPass*/, states);
         pass++;
     }
     if (TraceLevel() > 0)
     fprintf(stderr, "\nValidating network, final pass.\n\n");
-    toValidate = ValidateNodes(nodes, /*isFirstPass=*/pass == 1, true /*isFinalValidationPass*/);
+    toValidate = ValidateNodes(nodes, /*isFirstPass=*/pass == 1, true /*isFinalValidationPass*/, states);
     if (toValidate != 0)
         LogicError("ValidateSubNetwork: ValidateNodes(true) unexpectedly returned with work left to do.");
 
@@ -756,13 +985,20 @@ bool ComputationNetwork::ValidateNode(ComputationNodeBasePtr node, bool isFinalV
 
 // perform one pass of validation over the topologically-sorted node set
 // returns how many nodes either could not yet be validated yet or have changed and thus must be redone
-size_t ComputationNetwork::ValidateNodes(list<ComputationNodeBasePtr> nodes, bool isFirstPass, bool isFinalValidationPass)
+// A non-final pass after the first skips nodes that were valid in the previous one and none of whose inputs changed
+// since; 'states' keeps that information across passes. The final pass checks all nodes.
+size_t ComputationNetwork::ValidateNodes(const list<ComputationNodeBasePtr>& nodes, bool isFirstPass, bool isFinalValidationPass, ValidationStates& states)
 {
     size_t todo = 0;
     for (auto& node : nodes)
     {
         const auto& children = node->GetInputs();
         const bool isLeaf = node->IsLeaf();
+        auto& state = states[node];
+        if (!isFirstPass && !isFinalValidationPass && state.m_valid &&
+            none_of(children.begin(), children.end(), [&](const ComputationNodeBasePtr& child) { return states[child].m_lastChange > state.m_lastValidation; }))
+            continue;
+
         // only validate a node if it has at least one child
         bool hasVisitedChild = false;
         bool allChildrenVisited = true;
@@ -781,27 +1017,38 @@ size_t ComputationNetwork::ValidateNodes(list<ComputationNodeBasePtr> nodes, boo
         bool valid = false;
         if (hasVisitedChild || isLeaf) // got at least one child: it makes sense to call Validate()
         {
-            string prevPrototype = node->FormatOperationPrototype("");
+            // (formatting the prototypes is not free, so it is only done for the log)
+            string prevPrototype = TraceLevel() > 0 ? node->FormatOperationPrototype("") : string();
             bool unchanged;
             try
             {
                 unchanged = !ValidateNode(node, isFinalValidationPass);
-                string updatedPrototype = node->FormatOperationPrototype("");
-#if 0           // print prototype in final validation pass. Problematic for tracking down validation errors in loops.
-                unchanged;
-                if (isFinalValidationPass)
-#else           // print prototype upon every change (useful for debugging)
-                if (isFirstPass || !unchanged || prevPrototype != updatedPrototype)
+                if (TraceLevel() > 0)
+                {
+                    string updatedPrototype = node->FormatOperationPrototype("");
+#if 0               // print prototype in final validation pass. Problematic for tracking down validation errors in loops.
+                    unchanged;
+                    if (isFinalValidationPass)
+#else               // print prototype upon every change (useful for debugging)
+                    if (isFirstPass || !unchanged || prevPrototype != updatedPrototype)
 #endif
-                    if (TraceLevel() > 0)
                     fprintf(stderr, "Validating --> %s\n", updatedPrototype.c_str());
+                }
             }
             catch (...) // if validation failed then print the prototype anyway so one can see the input args
             {
-                fprintf(stderr, "Validating --> %s FAILED\n", prevPrototype.c_str());
+                fprintf(stderr, "Validating --> %s FAILED\n", (TraceLevel() > 0 ? prevPrototype : node->FormatOperationPrototype("")).c_str());
                 throw;
             }
             node->m_visited = true;
+            // Validate() may also infer the dimensions of inputs (e.g. of a LearnableParameter), so a change counts for them as well
+            state.m_lastValidation = ++states.m_clock;
+            if (!unchanged)
+            {
+                state.m_lastChange = state.m_lastValidation;
+                for (auto& child : children)
+                    states[child].m_lastChange = state.m_lastValidation;
+            }
             // print the new type
             // sanity checks
             if (isFinalValidationPass && !unchanged)
@@ -811,6 +1058,7 @@ size_t ComputationNetwork::ValidateNodes(list<ComputationNodeBasePtr> nodes, boo
             // if all children valid then
             valid = (allChildrenVisited && unchanged) || isLeaf;
         }
+        state.m_valid = valid;
         // count those that we need to redo
         if (!valid)
             todo++;
@@ -908,7 +1156,12 @@ void ComputationNetwork::PrintMemorySharingStructure(const vector<ComputationNod
             numShared++;
     }
 
-    fprintf(stderr, "\nMemory Sharing: Out of %d matrices, %d are shared as %d, and %d are not shared.\n\n", (int)numMatrices, (int)(numMatrices - numUnshared), (int)numShared, (int)numUnshared);
+    fprintf(stderr, "\nMemory Sharing: Out of %d matrices, %d are shared as %d, and %d are not shared.\n", (int)numMatrices, (int)(numMatrices - numUnshared), (int)numShared, (int)numUnshared);
+    // planned vs. naive (no sharing) peak of the pooled matrices; minibatch-dependent matrices are counted per sample
+    fprintf(stderr, "Memory Planning: %d pooled matrices planned into %d buffers; peak %.1f KB per sample + %.1f MB fixed (without sharing: %.1f KB per sample + %.1f MB fixed).\n\n",
+            (int)m_matrixPool.GetNumRequests(), (int)m_matrixPool.GetNumBuffers(),
+            m_matrixPool.GetPlannedBytes(/*mbScale=*/true) / 1024.0, m_matrixPool.GetPlannedBytes(/*mbScale=*/false) / (1024.0 * 1024.0),
+            m_matrixPool.GetUnsharedBytes(/*mbScale=*/true) / 1024.0, m_matrixPool.GetUnsharedBytes(/*mbScale=*/false) / (1024.0 * 1024.0));
     for (const auto& item : memSharingStructure)
     {
         if (item.second.size() < 2) // only print actually shared matrices
@@ -993,6 +1246,30 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
         }
     }
 
+    // gradient checkpointing: the values to recompute are no longer needed during backprop, so they are released after ForwardProp()
+    std::vector<RecomputationSegment> recomputationSegments;
+    if (performingBackPropagation && IsRecomputingSegments())
+        recomputationSegments = PlanRecomputation(trainRootNode, parentsMap, outputValueNeededDuringBackProp);
+
+    // recomputed values must not overwrite, or be overwritten by, a value computed in place
+    std::set<ComputationNodeBasePtr> recomputedNodes;
+    for (const auto& segment : recomputationSegments)
+        recomputedNodes.insert(segment.m_nodes.begin(), segment.m_nodes.end());
+
+    // stash compression: the values kept compressed are not needed during backprop either, but released after ForwardProp()
+    // Nodes evaluated level by level have no single last consumer to compress after.
+    std::vector<StashedValue> stashedValues;
+    if (performingBackPropagation && m_stashValues)
+    {
+        if (m_concurrentBranches && m_deviceId < 0)
+            fprintf(stderr, "AllocateAllMatrices: stashCompression is not supported with concurrentBranches; values are kept as they are.\n");
+        else
+            stashedValues = PlanStashCompression(trainRootNode, forwardPropRoots, parentsMap, recomputedNodes, outputValueNeededDuringBackProp);
+    }
+    std::set<ComputationNodeBasePtr> inPlaceExcludedNodes = recomputedNodes; // (the compressed ones are read after their last consumer)
+    for (const auto& stashed : stashedValues)
+        inPlaceExcludedNodes.insert(stashed.m_node);
+
     std::unordered_map<ComputationNodeBasePtr, int> parentCount;
     for (auto& keyValue : parentsMap)
     {
@@ -1013,32 +1290,75 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
         }
     }
 
-    set<ComputationNodeBasePtr> completedEvaluate;
-    for (auto& nodeIter : compositeForwardPropEvalOrder)
+    // with concurrent branches (CPU only), the nodes of a dependency level are evaluated together,
+    // so all of their matrices are requested before any input of theirs is released
+    std::vector<std::vector<ComputationNodeBasePtr>> forwardPropSteps;
+    bool concurrentBranches = m_concurrentBranches && m_deviceId < 0;
+    if (m_concurrentBranches && !concurrentBranches)
+        fprintf(stderr, "AllocateAllMatrices: concurrentBranches is only supported on the CPU; nodes are evaluated in sequence.\n");
+    if (concurrentBranches)
+    {
+        // all nested networks evaluate level by level, since the plan is only valid for that order
+        auto levels = DetermineDependencyLevels(allNodesEvalOrder);
+        for (auto& node : compositeForwardPropEvalOrder)
+        {
+            if (forwardPropSteps.size() <= levels[node])
+                forwardPropSteps.resize(levels[node] + 1);
+            forwardPropSteps[levels[node]].push_back(node);
+        }
+        for (auto& nestedNetwork : m_nestedNetworks)
+        {
+            auto network = dynamic_pointer_cast<PARTraversalFlowControlNode>(nestedNetwork.second);
+            assert(network);
+            network->SetDependencyLevels(levels);
+        }
+    }
+    else
     {
-        nodeIter->SetOutputNeededDuringBackprop(outputValueNeededDuringBackProp[nodeIter]);
+        for (auto& node : compositeForwardPropEvalOrder)
+            forwardPropSteps.push_back({ node });
+    }
 
-        if (nodeIter->IsPartOfLoop())
+    set<ComputationNodeBasePtr> completedEvaluate;
+    for (const auto& step : forwardPropSteps)
+    {
+        std::vector<shared_ptr<SEQTraversalFlowControlNode>> loopsInStep;
+        for (auto& nodeIter : step)
         {
-            // TODO: use FormNestedNetwork() here to avoid completedEvaluate[] check
-            shared_ptr<SEQTraversalFlowControlNode> recInfo = FindInRecurrentLoops(m_allSEQNodes, nodeIter);
-            assert(recInfo != nullptr);
-            if (completedEvaluate.insert(recInfo).second)
-            {
-                recInfo->RequestMatricesBeforeForwardProp(m_matrixPool);
+            nodeIter->SetOutputNeededDuringBackprop(outputValueNeededDuringBackProp[nodeIter]);
 
-                for (auto& nodeLoopIter : recInfo->m_nestedNodes)
+            if (nodeIter->IsPartOfLoop())
+            {
+                // TODO: use FormNestedNetwork() here to avoid completedEvaluate[] check
+                shared_ptr<SEQTraversalFlowControlNode> recInfo = FindInRecurrentLoops(m_allSEQNodes, nodeIter);
+                assert(recInfo != nullptr);
+                if (completedEvaluate.insert(recInfo).second)
                 {
-                    ReleaseMatricesAfterEvalForChildren(nodeLoopIter, parentCount);
+                    recInfo->RequestMatricesBeforeForwardProp(m_matrixPool);
+                    loopsInStep.push_back(recInfo);
                 }
             }
+            else
+            {
+                if (m_inPlaceComputation)
+                    nodeIter->SetValueInPlaceOfInput(DetermineInPlaceInput(nodeIter, parentsMap, inPlaceExcludedNodes));
+                nodeIter->RequestMatricesBeforeForwardProp(m_matrixPool);
+            }
         }
-        else
+
+        for (auto& recInfo : loopsInStep)
+        {
+            for (auto& nodeLoopIter : recInfo->m_nestedNodes)
+            {
+                ReleaseMatricesAfterEvalForChildren(nodeLoopIter, parentCount);
+            }
+        }
+        for (auto& nodeIter : step)
         {
-            nodeIter->RequestMatricesBeforeForwardProp(m_matrixPool);
             // we only release matrices for the children since the root node's information will be used and should not be shared
             // with others
-            ReleaseMatricesAfterEvalForChildren(nodeIter, parentCount);
+            if (!nodeIter->IsPartOfLoop())
+                ReleaseMatricesAfterEvalForChildren(nodeIter, parentCount);
         }
     }
 
@@ -1052,9 +1372,39 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
         // we need to call it here since we always compute gradients for children and root node is not children of other node
         trainRootNode->RequestMatricesBeforeBackprop(m_matrixPool);
 
+        // the recomputed values live from the start of their segment's backprop to its end
+        std::map<ComputationNodeBasePtr, const RecomputationSegment*> segmentsByLast, segmentsByFirst;
+        for (const auto& segment : recomputationSegments)
+        {
+            segmentsByLast[segment.m_last] = &segment;
+            segmentsByFirst[segment.m_first] = &segment;
+        }
+        // and the stashed values from their decompression to their last user
+        std::map<ComputationNodeBasePtr, std::vector<ComputationNodeBasePtr>> decompressedBefore, releasedAfter;
+        for (const auto& stashed : stashedValues)
+        {
+            decompressedBefore[stashed.m_decompressBefore].push_back(stashed.m_node);
+            releasedAfter[stashed.m_releaseAfter].push_back(stashed.m_node);
+        }
+
         for (auto iter = backPropNodes.rbegin(); iter != backPropNodes.rend(); iter++) // for gradient computation, traverse in reverse order
         {
             auto n = *iter;
+            auto segmentStart = segmentsByLast.find(n);
+            if (segmentStart != segmentsByLast.end())
+            {
+                m_matrixPool.BeginRecomputation();
+                for (const auto& recomputedNode : segmentStart->second->m_nodes)
+                    recomputedNode->RequestMatricesBeforeForwardProp(m_matrixPool);
+                m_matrixPool.EndRecomputation();
+            }
+            auto decompressed = decompressedBefore.find(n);
+            if (decompressed != decompressedBefore.end())
+            {
+                for (const auto& stashedNode : decompressed->second)
+                    stashedNode->ReacquireValueFromPool(m_matrixPool);
+            }
+
             if (n->IsPartOfLoop())
             {
                 std::vector<ComputationNodeBasePtr> recurrentNodes;
@@ -1077,16 +1427,96 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
                 if ((n != trainRootNode) && n->NeedsGradient())
                     n->ReleaseMatricesAfterBackprop(m_matrixPool);
             }
+
+            auto segmentEnd = segmentsByFirst.find(n);
+            if (segmentEnd != segmentsByFirst.end())
+            {
+                for (const auto& recomputedNode : segmentEnd->second->m_nodes)
+                    recomputedNode->ReleaseMatricesAfterForwardProp(m_matrixPool);
+            }
+            auto released = releasedAfter.find(n);
+            if (released != releasedAfter.end())
+            {
+                for (const auto& stashedNode : released->second)
+                    stashedNode->ReleaseValueToPool(m_matrixPool);
+            }
+        }
+
+        if (!recomputationSegments.empty())
+        {
+            std::map<ComputationNodeBasePtr, std::vector<ComputationNodeBasePtr>> recomputeBefore;
+            size_t numRecomputedNodes = 0;
+            for (const auto& segment : recomputationSegments)
+            {
+                recomputeBefore[segment.m_last] = segment.m_nodes;
+                numRecomputedNodes += segment.m_nodes.size();
+            }
+            auto network = dynamic_pointer_cast<PARTraversalFlowControlNode>(GetNestedNetwork(trainRootNode));
+            assert(network);
+            network->SetRecomputation(recomputeBefore);
+            if (TraceLevel() > 0)
+                fprintf(stderr, "\nRecomputation: %d node values are recomputed in %d segments during backprop.\n", (int)numRecomputedNodes, (int)recomputationSegments.size());
+        }
+
+        if (!stashedValues.empty())
+        {
+            auto network = dynamic_pointer_cast<PARTraversalFlowControlNode>(GetNestedNetwork(trainRootNode));
+            assert(network);
+            network->SetStashedValues(stashedValues);
+            if (TraceLevel() > 0)
+            {
+                size_t numSigns = count_if(stashedValues.begin(), stashedValues.end(), [](const StashedValue& stashed) { return stashed.m_compression == ValueCompression::sign; });
+                fprintf(stderr, "\nStashCompression: %d node values are kept compressed between ForwardProp() and Backprop(), %d of them as signs.\n", (int)stashedValues.size(), (int)numSigns);
+            }
         }
     }
 
+    // now that all lifetimes are known, assign the requested matrices to shared buffers
+    m_matrixPool.OptimizedMemoryAllocation();
+
     m_areMatricesAllocated = true;
 
+    if (m_inPlaceComputation && TraceLevel() > 0)
+    {
+        size_t numInPlaceNodes = 0;
+        for (const auto& node : compositeForwardPropEvalOrder)
+        {
+            if (!node->IsPartOfLoop() && node->ValuePtr() && node->GetNumInputs() > 0 &&
+                any_of(node->GetInputs().begin(), node->GetInputs().end(), [&](const ComputationNodeBasePtr& input) { return input->ValuePtr() == node->ValuePtr(); }))
+                numInPlaceNodes++;
+        }
+        fprintf(stderr, "\nInPlaceComputation: %d node values are computed in place of an input value.\n", (int)numInPlaceNodes);
+    }
+
     // print the memory sharing structure
     if (TraceLevel() > 0)
     PrintMemorySharingStructure(GetAllNodes());
 }
 
+// the input whose value 'node' can overwrite with its own, or SIZE_MAX
+// That input must be read by no one else, also not in backprop, and match the node in shape and layout.
+size_t ComputationNetwork::DetermineInPlaceInput(const ComputationNodeBasePtr& node,
+                                                 const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap,
+                                                 const std::set<ComputationNodeBasePtr>& recomputedNodes) const
+{
+    if (node->IsPartOfLoop() || !node->IsValueSharable() || recomputedNodes.find(node) != recomputedNodes.end())
+        return SIZE_MAX;
+    for (size_t i = 0; i < node->GetNumInputs(); i++)
+    {
+        const auto& input = node->Input(i);
+        if (!node->CanComputeValueInPlaceOfInput(i) || input->IsPartOfLoop() || !input->IsValueSharable() ||
+            input->IsOutputNeededDuringBackprop() || recomputedNodes.find(input) != recomputedNodes.end())
+            continue;
+        auto parents = parentsMap.find(input);
+        if (parents == parentsMap.end() || parents->second.size() != 1)
+            continue;
+        if (input->GetSampleLayout() != node->GetSampleLayout() || input->GetMBLayout() != node->GetMBLayout())
+            continue;
+        return i;
+    }
+    return SIZE_MAX;
+}
+
 void ComputationNetwork::ReleaseMatricesAfterEvalForChildren(ComputationNodeBasePtr n, std::unordered_map<ComputationNodeBasePtr, int>& parentCount)
 {
     for (int i = 0; i < n->GetNumInputs(); i++)
@@ -1098,4 +1528,220 @@ void ComputationNetwork::ReleaseMatricesAfterEvalForChildren(ComputationNodeBase
     }
 }
 
+// the dependency level of each node: 0 for leaves, else one more than the highest level of an input
+// The nodes of a recurrent loop are evaluated together and get the level of the loop. 'nodes' must be in evaluation order.
+std::unordered_map<ComputationNodeBasePtr, size_t> ComputationNetwork::DetermineDependencyLevels(const std::list<ComputationNodeBasePtr>& nodes) const
+{
+    std::unordered_map<ComputationNodeBasePtr, size_t> levels;
+    for (const auto& node : nodes)
+    {
+        if (levels.find(node) != levels.end()) // a member of a loop seen before
+            continue;
+
+        shared_ptr<SEQTraversalFlowControlNode> recInfo = node->IsPartOfLoop() ? FindInRecurrentLoops(m_allSEQNodes, node) : nullptr;
+        std::vector<ComputationNodeBasePtr> members = recInfo ? recInfo->m_nestedNodes : std::vector<ComputationNodeBasePtr>{ node };
+        size_t level = 0;
+        for (const auto& member : members)
+        {
+            for (const auto& input : member->GetInputs())
+            {
+                auto inputLevel = levels.find(input);
+                if (inputLevel != levels.end()) // not found: another member of the loop
+                    level = max(level, inputLevel->second + 1);
+            }
+        }
+        for (const auto& member : members)
+            levels[member] = level;
+    }
+    return levels;
+}
+
+// Gradient checkpointing: cut the training criterion's evaluation order into segments (see SetRecomputeSegments()) and
+// determine the values that are released after ForwardProp() and recomputed when Backprop() reaches the end of their segment.
+// A node is recomputed if it can be (CanRecomputeValue()), does not end its segment, is only consumed inside its segment,
+// and all its inputs are either kept or recomputed as well. Recurrent loops are not recomputed and end a segment.
+// Nodes whose values are released after ForwardProp() anyway are recomputed only if a recomputed node needs them.
+// The values to recompute are marked as not needed during backprop in 'outputValueNeededDuringBackProp'.
+std::vector<ComputationNetwork::RecomputationSegment> ComputationNetwork::PlanRecomputation(const ComputationNodeBasePtr& trainRootNode,
+                                                                                           const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap,
+                                                                                           std::unordered_map<ComputationNodeBasePtr, bool>& outputValueNeededDuringBackProp)
+{
+    std::vector<RecomputationSegment> segments;
+    if (!g_shareNodeValueMatrices) // nothing is released, so there is nothing to gain
+        return segments;
+
+    std::set<ComputationNodeBasePtr> checkpoints;
+    for (const auto& name : m_recomputeCheckpointNodeNames)
+        checkpoints.insert(GetNodeFromName(name));
+
+    // segments, and whether a node ends its segment
+    const std::list<ComputationNodeBasePtr>& evalOrder = GetEvalOrder(trainRootNode);
+    std::unordered_map<ComputationNodeBasePtr, size_t> segmentOf;
+    std::set<ComputationNodeBasePtr> segmentEnds;
+    bool isSegmentOpen = false;
+    size_t segmentLength = 0;
+    for (const auto& node : evalOrder)
+    {
+        if (node->IsPartOfLoop() || (isSegmentOpen && ((m_recomputeSegmentLength > 0 && segmentLength >= m_recomputeSegmentLength) || checkpoints.find(segments.back().m_last) != checkpoints.end())))
+        {
+            if (isSegmentOpen)
+                segmentEnds.insert(segments.back().m_last);
+            isSegmentOpen = false;
+            segmentLength = 0;
+        }
+        if (node->IsPartOfLoop())
+            continue;
+        if (!isSegmentOpen)
+        {
+            segments.push_back(RecomputationSegment{ node, node, {} });
+            isSegmentOpen = true;
+        }
+        segments.back().m_last = node;
+        segmentOf[node] = segments.size() - 1;
+        if (!node->IsLeaf())
+            segmentLength++;
+    }
+    if (isSegmentOpen)
+        segmentEnds.insert(segments.back().m_last);
+
+    // which nodes can be recomputed, in evaluation order, so that all inputs are decided before their consumers
+    auto isKept = [&](const ComputationNodeBasePtr& node)
+    {
+        auto needed = outputValueNeededDuringBackProp.find(node);
+        return !node->IsValueSharable() || (needed != outputValueNeededDuringBackProp.end() && needed->second);
+    };
+    std::set<ComputationNodeBasePtr> recomputable;
+    for (const auto& node : evalOrder)
+    {
+        auto segment = segmentOf.find(node);
+        if (segment == segmentOf.end() || node == trainRootNode || segmentEnds.find(node) != segmentEnds.end() ||
+            !node->IsValueSharable() || !node->CanRecomputeValue())
+            continue;
+
+        bool canRecompute = true;
+        auto parents = parentsMap.find(node);
+        if (parents != parentsMap.end())
+        {
+            for (const auto& parent : parents->second)
+            {
+                auto parentSegment = segmentOf.find(parent);
+                if (parentSegment == segmentOf.end() || parentSegment->second != segment->second) // also consumers outside this criterion
+                    canRecompute = false;
+            }
+        }
+        for (const auto& input : node->GetInputs())
+        {
+            // the inputs of a recomputed node are in its segment as well, since they are only consumed there
+            if (recomputable.find(input) == recomputable.end() && !isKept(input))
+                canRecompute = false;
+        }
+        if (canRecompute)
+            recomputable.insert(node);
+    }
+
+    // recompute the kept values, and whatever they need
+    std::set<ComputationNodeBasePtr> recompute;
+    for (auto iter = evalOrder.rbegin(); iter != evalOrder.rend(); iter++)
+    {
+        const auto& node = *iter;
+        if (recomputable.find(node) == recomputable.end() || (!isKept(node) && recompute.find(node) == recompute.end()))
+            continue;
+        recompute.insert(node);
+        for (const auto& input : node->GetInputs())
+        {
+            if (recomputable.find(input) != recomputable.end())
+                recompute.insert(input);
+        }
+    }
+    for (const auto& node : evalOrder)
+    {
+        if (recompute.find(node) == recompute.end())
+            continue;
+        segments[segmentOf[node]].m_nodes.push_back(node);
+        outputValueNeededDuringBackProp[node] = false;
+    }
+
+    segments.erase(remove_if(segments.begin(), segments.end(), [](const RecomputationSegment& segment) { return segment.m_nodes.empty(); }), segments.end());
+    return segments;
+}
+
+
+// Stash compression: determine the values of the training criterion's network that are kept compressed (see SetStashCompression())
+// from their last consumer in ForwardProp() to their first user in Backprop(), so that their matrices are shared in between.
+// A value is stashed if Backprop() needs it, it is neither a root, nor a leaf, nor recomputed, it is not part of a recurrent loop
+// and only consumed by nodes of the criterion's network that are not in loops and not recomputed either.
+// The stashed values are marked as not needed during backprop in 'outputValueNeededDuringBackProp'.
+std::vector<ComputationNetwork::StashedValue> ComputationNetwork::PlanStashCompression(const ComputationNodeBasePtr& trainRootNode, const std::vector<ComputationNodeBasePtr>& forwardPropRoots,
+                                                                                       const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap,
+                                                                                       const std::set<ComputationNodeBasePtr>& recomputedNodes,
+                                                                                       std::unordered_map<ComputationNodeBasePtr, bool>& outputValueNeededDuringBackProp)
+{
+    std::vector<StashedValue> stashedValues;
+    if (!g_shareNodeValueMatrices) // nothing is released, so there is nothing to gain
+        return stashedValues;
+
+    const std::list<ComputationNodeBasePtr>& evalOrder = GetEvalOrder(trainRootNode);
+    std::unordered_map<ComputationNodeBasePtr, size_t> positions;
+    for (const auto& node : evalOrder)
+    {
+        size_t position = positions.size();
+        positions[node] = position;
+    }
+    std::set<ComputationNodeBasePtr> roots(forwardPropRoots.begin(), forwardPropRoots.end());
+
+    for (const auto& node : evalOrder)
+    {
+        auto needed = outputValueNeededDuringBackProp.find(node);
+        auto parents = parentsMap.find(node);
+        if (needed == outputValueNeededDuringBackProp.end() || !needed->second || parents == parentsMap.end() ||
+            roots.find(node) != roots.end() || node->IsLeaf() || node->RequiresPreCompute() || node->IsPartOfLoop() ||
+            !node->IsValueSharable() || recomputedNodes.find(node) != recomputedNodes.end())
+            continue;
+
+        // the consumers, and the users in backprop among them and the node itself
+        StashedValue stashed{ node, m_stashCompression, nullptr, nullptr, nullptr };
+        bool canStash = true;
+        bool isUsedByParents = false;
+        auto isLater = [&](const ComputationNodeBasePtr& a, const ComputationNodeBasePtr& b) { return !b || positions[a] > positions[b]; };
+        auto addUser = [&](const ComputationNodeBasePtr& user)
+        {
+            if (isLater(user, stashed.m_decompressBefore))
+                stashed.m_decompressBefore = user;
+            if (!stashed.m_releaseAfter || positions[user] < positions[stashed.m_releaseAfter])
+                stashed.m_releaseAfter = user;
+        };
+        for (const auto& parent : parents->second)
+        {
+            if (positions.find(parent) == positions.end() || parent->IsPartOfLoop() || recomputedNodes.find(parent) != recomputedNodes.end())
+            {
+                canStash = false; // consumed by another root, or whenever a loop or a recomputation runs
+                break;
+            }
+            if (isLater(parent, stashed.m_compressAfter))
+                stashed.m_compressAfter = parent;
+            for (size_t i = 0; i < parent->GetNumInputs(); i++)
+            {
+                if (parent->Input(i) == node && parent->NeedsGradient() && parent->InputUsedInComputingInputNodesGradients(i))
+                {
+                    addUser(parent);
+                    isUsedByParents = true;
+                }
+            }
+        }
+        if (node->NeedsGradient() && node->OutputUsedInComputingInputNodesGradients())
+            addUser(node);
+        if (!canStash || !stashed.m_decompressBefore)
+            continue;
+        // nothing is gained if the value is decompressed right after it is compressed
+        if (stashed.m_compressAfter == trainRootNode && stashed.m_decompressBefore == trainRootNode)
+            continue;
+
+        if (!isUsedByParents && node->BackpropNeedsOnlySignOfOutput())
+            stashed.m_compression = ValueCompression::sign;
+        stashedValues.push_back(stashed);
+        outputValueNeededDuringBackProp[node] = false;
+    }
+    return stashedValues;
+}
+
 }}}
@@ -18,10 +18,13 @@
 #include "ComputationNetwork.h"
 #include "ComputationNetworkBuilder.h"
 
+#include "TimerUtility.h"
+
 #include <memory>
 #include <deque>
 #include <set>
 #include <string>
+#include <unordered_set>
 
 #ifndef let
 #define let const auto
@@ -48,6 +51,10 @@ ComputationNetwork::ComputationNetwork(const IConfigRecordPtr configp) :
     SetTraceLevel(config[L"traceLevel"]);
     DEVICEID_TYPE deviceId = (DEVICEID_TYPE)(int)config[L"deviceId"];
 
+    // Reading the members evaluates the BrainScript that creates the nodes (lazily until now).
+    Timer timer;
+    timer.Start();
+
     deque<ComputationNodeBasePtr> workList;
 
     // process 'special nodes'
@@ -73,6 +80,9 @@ ComputationNetwork::ComputationNetwork(const IConfigRecordPtr configp) :
     }
 
     // TODO: process "outputNodes" etc. arrays: Sync to node Tags, and make them all roots.
+    timer.Stop();
+    if (TraceLevel() > 0)
+        fprintf(stderr, "\nEvaluated the network description in %.3f seconds.\n", timer.ElapsedSeconds());
 
     // construct from roots
     ConstructFromRoots(deviceId, move(workList), map<ComputationNodeBasePtr, ComputationNodeBasePtr>()/*no mapping*/);
@@ -125,10 +135,16 @@ void ComputationNetwork::ConstructFromRoots(DEVICEID_TYPE deviceId, deque<Comput
 
     // process work list
     // Also call LateAttachInputs() where needed.
+    // Nodes are reached once per reference; 'visited' skips the repeats without a lookup by name.
+    Timer timer;
+    timer.Start();
+    unordered_set<ComputationNodeBasePtr> visited;
     while (!workList.empty())
     {
         let node = workList.front();
         workList.pop_front();
+        if (!visited.insert(node).second)
+            continue;
 
         // add to set
         let wasAdded = AddNodeToNetIfNotYet(node, /*makeUniqueName=*/ true);
@@ -174,11 +190,15 @@ void ComputationNetwork::ConstructFromRoots(DEVICEID_TYPE deviceId, deque<Comput
                 node->SetInput(i, input);
             }
 
-            workList.push_back(input); // (we could check whether c is in 'nodes' already here to optimize, but this way it is cleaner)
+            if (visited.find(input) == visited.end())
+                workList.push_back(input);
         }
     }
+    timer.Stop();
     if (TraceLevel() > 0 && numRelinked > 0)
         fprintf(stderr, "ConstructFromRoots: %d references were remapped.", (int)numRelinked);
+    if (TraceLevel() > 0)
+        fprintf(stderr, "ConstructFromRoots: Collected %d nodes in %.3f seconds.\n", (int)m_nameToNodeMap.size(), timer.ElapsedSeconds());
 
     // perform all necessary post-processing
     CompileNetwork();
@@ -43,7 +43,9 @@
 #define CNTK_MODEL_VERSION_12 12 // Times() m_inputRank to support parameter-rank inference
 #define CNTK_MODEL_VERSION_13 13 // batch norm: switch running inverse std deviation -> variance, MB count -> samplesSeen; CuDNN v5
 #define CNTK_MODEL_VERSION_14 14 // axis parameter in OptimizedRNNStackNode
-#define CURRENT_CNTK_MODEL_VERSION CNTK_MODEL_VERSION_14
+#define CNTK_MODEL_VERSION_15 15 // page-aligned values of large LearnableParameters
+#define CNTK_MODEL_VERSION_16 16 // groups in ConvolutionNode
+#define CURRENT_CNTK_MODEL_VERSION CNTK_MODEL_VERSION_16
 
 extern bool g_shareNodeValueMatrices;
 
@@ -59,7 +61,9 @@ enum CopyNodeFlags // flags to be passed to the CopyTo() function
     copyNodeValue          = 1, // copy everything except for the input links
     copyNodeInputLinks     = 2, // copy over input links
     copyNodeAll            = 3, // copy everything
-    copyNodeAcrossNetworks = 4  // allow a cross network child copy
+    copyNodeAcrossNetworks = 4, // allow a cross network child copy
+    copyNodeShareModelValues = 8, // with copyNodeValue: share the value matrix of model values (IsModelValue()) instead of copying it
+    copyNodeModelValuesToCPU = 16 // with copyNodeValue: copy only the values of model values, into new CPU matrices if dense; no gradients
 };
 
 #pragma region base computation class
@@ -290,7 +294,7 @@ public:
     // -----------------------------------------------------------------------
 
     ComputationNodeBase(DEVICEID_TYPE deviceId, const wstring& name) :
-        m_deviceId(deviceId), m_outputNeededDuringBackprop(true), m_learningRateMultiplier(0),
+        m_deviceId(deviceId), m_outputNeededDuringBackprop(true), m_valueInPlaceOfInput(SIZE_MAX), m_learningRateMultiplier(0),
         m_gradientInitialized(false), m_nodeName(name == L"" ? CreateUniqNodeName() : name)
     {
         // TODO: should m_learningRateMultiplier be set to 0? Or should every node have a way to add its own say on the learning rate for all its inputs?
@@ -611,6 +615,13 @@ public:
 
     DEVICEID_TYPE GetDeviceId() const { return m_deviceId; }
 
+    // place the node on another device (see ComputationNetwork::SetNodeDevices())
+    // The value and gradient are moved along; other matrices that a node creates itself are moved by the matrix library when first used.
+    virtual void MoveToDevice(DEVICEID_TYPE deviceId) { m_deviceId = deviceId; }
+
+    // Can the inputs live on other devices than the node? Otherwise CompileNetwork() puts a DeviceCopyNode between them.
+    virtual bool AcceptsInputsFromOtherDevices() const { return false; }
+
     // helper to access to element(0,0) without having to type-cast
     virtual double Get00Element() const = 0;
     virtual MatrixBasePtr ValuePtr() const = 0; // for use in readers that pass the agnostic object around
@@ -639,6 +650,8 @@ public:
 
     // return true if the node's value should be computed before the normal training. e.g., mean and invStd of input features.
     virtual bool /*IComputationNode::*/ RequiresPreCompute() const { return false; }
+    // return true if the node's value is part of the model, i.e. is loaded rather than computed from the inputs (parameters and precomputed values)
+    virtual bool IsModelValue() const { return RequiresPreCompute(); }
 
     const ComputationEnvironment& Environment() const
     {
@@ -650,6 +663,8 @@ public:
     void SetEnvironment(ComputationEnvironmentPtr environment) { m_environment = environment; }
 
     virtual std::set<std::pair<const MatrixBase*, std::wstring>> GetMatrixInfo() const = 0; // to be defined by <ElemType> version
+    // the allocated bytes of the value or gradient, and which matrix holds it (nullptr if none), for MemoryProfiler
+    virtual size_t GetMatrixBytes(bool gradient, const MatrixBase*& matrix) const { matrix = nullptr; return 0; }
 
     // -----------------------------------------------------------------------
     // validation
@@ -762,9 +777,34 @@ public:
     // Base-class version makes conservative assumption that it is. Override if not.
     virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const { return true; }
 
+    // Can the output value be recomputed from the inputs during backprop (see ComputationNetwork::SetRecomputeSegments())?
+    // Override if ForwardProp() has side effects or is not deterministic, e.g. it draws random numbers or updates state.
+    virtual bool CanRecomputeValue() const { return !IsLeaf() && !RequiresPreCompute(); }
+
+    // Does BackpropTo() only need to know which elements of the output value are > 0, e.g. for the derivative of a ReLU?
+    // If nothing else needs the value in backprop, it can then be stashed in 1 bit per element (see ComputationNetwork::SetStashCompression()).
+    virtual bool BackpropNeedsOnlySignOfOutput() const { return false; }
+
+    // stash compression (see ComputationNetwork::SetStashCompression()): the value is encoded after ForwardProp() has used it,
+    // and its matrix shared with others until it is decoded for Backprop()
+    virtual void CompressValue(ValueCompression compression) = 0;
+    virtual void DecompressValue(ValueCompression compression) = 0;
+    virtual void ReacquireValueFromPool(MatrixPool& matrixPool) = 0; // the released value matrix lives again from here
+    virtual void ReleaseValueToPool(MatrixPool& matrixPool) = 0;
+
+    // Can ForwardProp() and BackpropTo() be captured into a GPUGraph once and replayed for later minibatches of the same layout (see GPUGraphStep)?
+    // Override if they pass host state that changes from minibatch to minibatch to the device, e.g. random numbers or counters.
+    // Reading values back to the host needs no override, as it makes the capture fail, and the step runs as usual.
+    virtual bool CanBeCapturedInGPUGraph() const { return true; }
+
     void SetOutputNeededDuringBackprop(bool f) { m_outputNeededDuringBackprop = f; }
     bool IsOutputNeededDuringBackprop() const { return !g_shareNodeValueMatrices || m_outputNeededDuringBackprop; }
 
+    // Can ForwardProp() write the value over the value of the specified input node, i.e. is it elementwise in that input?
+    // AllocateAllMatrices() then lets the node do so if nothing reads that input value afterwards (see ComputationNetwork::SetInPlaceComputation()).
+    virtual bool CanComputeValueInPlaceOfInput(size_t /*childIndex*/) const { return false; }
+    void SetValueInPlaceOfInput(size_t childIndex) { m_valueInPlaceOfInput = childIndex; } // SIZE_MAX: a matrix of its own
+
     // -----------------------------------------------------------------------
     // helpers for network traversal
     // -----------------------------------------------------------------------
@@ -891,6 +931,7 @@ protected:
     float m_learningRateMultiplier;    // update parameters? Only used for LearnableParameters.    --TODO: Should we make this a member of LearnableParameters actually? And require a type cast? Currently it is read out for all leaves.
     bool m_gradientInitialized;        // indicates whether the gradient matrix has been resized and initialized to 0
     bool m_outputNeededDuringBackprop; // indicates whether the output value of the node is needed during backprop
+    size_t m_valueInPlaceOfInput;      // input whose value matrix the value shares, or SIZE_MAX
 };
 typedef ComputationNodeBase::ComputationNodeBasePtr ComputationNodeBasePtr;
 
@@ -968,14 +1009,30 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = DownCast(nodeP);
-            if (m_value)
+            if (m_value && (flags & CopyNodeFlags::copyNodeShareModelValues) && IsModelValue())
+                node->m_value = m_value; // read-only while shared, see ComputationNetwork::CloneSharingModelValues()
+            else if (flags & CopyNodeFlags::copyNodeModelValuesToCPU) // see ComputationNetwork::CloneModelValuesToCPU()
+            {
+                node->m_value = nullptr;
+                if (m_value && IsModelValue() && m_value->GetMatrixType() == DENSE)
+                {
+                    node->m_value = make_shared<Matrix<ElemType>>(CPUDEVICE);
+                    node->m_value->AssignValuesOf(*m_value);
+                }
+                else if (m_value && IsModelValue()) // (sparse matrices cannot be written from the CPU)
+                {
+                    node->CreateValueMatrixIfNull();
+                    node->m_value->SetValue(*m_value);
+                }
+            }
+            else if (m_value)
             {
                 node->CreateValueMatrixIfNull();
                 node->m_value->SetValue(*m_value);
             }
             else
                 node->m_value = nullptr;
-            if (m_gradient)
+            if (m_gradient && !(flags & CopyNodeFlags::copyNodeModelValuesToCPU))
             {
                 node->CreateGradientMatrixIfNull();
                 node->m_gradient->SetValue(*m_gradient);
@@ -1487,11 +1544,23 @@ public:
         return matrixInfo;
     }
 
+    virtual size_t GetMatrixBytes(bool gradient, const MatrixBase*& matrix) const override
+    {
+        const auto& m = gradient ? m_gradient : m_value;
+        matrix = m.get();
+        return m ? m->BufferSize() : 0;
+    }
+
     // request matrices needed to do node function value evaluation
     virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
     {
         if (IsValueSharable())
-            RequestMatrixFromPool(m_value, matrixPool);
+        {
+            auto inPlaceInput = m_valueInPlaceOfInput < m_inputs.size() ? dynamic_pointer_cast<ComputationNode<ElemType>>(m_inputs[m_valueInPlaceOfInput]) : nullptr;
+            if (!m_value && inPlaceInput && matrixPool.RequestInPlace<ElemType>(m_value, inPlaceInput->m_value))
+                return;
+            RequestMatrixFromPool(m_value, matrixPool, GetSampleLayout().GetNumElements(), HasMBLayout());
+        }
         else
             CreateMatrixIfNull(m_value);
     }
@@ -1516,7 +1585,7 @@ public:
     // request matrices that are needed for gradient computation
     virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) override
     {
-        RequestMatrixFromPool(m_gradient, matrixPool);
+        RequestMatrixFromPool(m_gradient, matrixPool, GetSampleLayout().GetNumElements(), HasMBLayout());
     }
 
     // release gradient and temp matrices that no longer needed after all the children's gradients are computed.
@@ -1534,11 +1603,43 @@ public:
         }
     }
 
+    virtual void CompressValue(ValueCompression compression) override
+    {
+        if (!m_compressedValue)
+            m_compressedValue = make_shared<Matrix<char>>(m_deviceId);
+        m_value->CompressValuesInto(*m_compressedValue, compression);
+        m_compressedValueNumRows = m_value->GetNumRows();
+    }
+
+    virtual void DecompressValue(ValueCompression compression) override
+    {
+        m_value->AssignDecompressedValuesOf(*m_compressedValue, compression, m_compressedValueNumRows);
+    }
+
+    virtual void ReacquireValueFromPool(MatrixPool& matrixPool) override
+    {
+        matrixPool.Reacquire<ElemType>(m_value);
+    }
+
+    virtual void ReleaseValueToPool(MatrixPool& matrixPool) override
+    {
+        ReleaseMatrixToPool(m_value, matrixPool);
+    }
+
     void CreateValueMatrixIfNull()
     {
         CreateMatrixIfNull(m_value);
     }
 
+    virtual void /*ComputationNodeBase::*/ MoveToDevice(DEVICEID_TYPE deviceId) override
+    {
+        Base::MoveToDevice(deviceId);
+        if (m_value)
+            m_value->TransferToDeviceIfNotThere(deviceId, /*isBeingMoved=*/ true);
+        if (m_gradient)
+            m_gradient->TransferToDeviceIfNotThere(deviceId, /*isBeingMoved=*/ true);
+    }
+
     void CreateGradientMatrixIfNull()
     {
         CreateMatrixIfNull(m_gradient);
@@ -1561,11 +1662,17 @@ protected:
             matrixPtr = make_shared<Matrix<ElemType>>(m_deviceId);
     }
 
-    void RequestMatrixFromPool(shared_ptr<Matrix<ElemType>>& matrixPtr, MatrixPool& matrixPool)
+    // 'matrixSize' is the expected number of elements (per sample if 'mbScale'), used by the pool to plan the sharing; 0 if unknown
+    void RequestMatrixFromPool(shared_ptr<Matrix<ElemType>>& matrixPtr, MatrixPool& matrixPool, size_t matrixSize = 0, bool mbScale = false)
     {
         if (matrixPtr == nullptr)
         {
-            matrixPtr = matrixPool.Request<ElemType>(m_deviceId);
+            matrixPool.Request<ElemType>(matrixPtr, m_deviceId, matrixSize, mbScale);
+        }
+        else if (matrixPool.IsRecomputing())
+        {
+            // the matrix was released after ForwardProp() and is needed again to recompute the value during backprop
+            matrixPool.Reacquire<ElemType>(matrixPtr);
         }
     }
 
@@ -1588,6 +1695,13 @@ public:
                                       const std::string& sequencePrologue, const std::string& sequenceEpilogue, const std::string& elementSeparator,
                                       const std::string& sampleSeparator, std::string valueFormatString,
                                       bool outputGradient = false) const;
+    // same for a copy of the values, 'matData' (matRows x matCols, column major, overwritten for category labels), laid out
+    // as 'pMBLayout' says (null: one sequence over all columns). SimpleOutputWriter formats such copies on other threads.
+    static void WriteMinibatchDataWithFormatting(FILE* f, ElemType* matData, size_t matRows, size_t matCols, const TensorShape& sampleLayout, MBLayoutPtr pMBLayout,
+                                                 const FrameRange& fr, size_t onlyUpToRow, size_t onlyUpToT, bool transpose, bool isCategoryLabel, bool isSparse,
+                                                 const std::vector<std::string>& labelMapping, const std::string& sequenceSeparator,
+                                                 const std::string& sequencePrologue, const std::string& sequenceEpilogue, const std::string& elementSeparator,
+                                                 const std::string& sampleSeparator, std::string valueFormatString);
 
     // simple helper to log the content of a minibatch
     void DebugLogMinibatch(bool outputGradient = false) const
@@ -1756,6 +1870,8 @@ public:
 protected:
 
     shared_ptr<Matrix<ElemType>> m_value, m_gradient;
+    shared_ptr<Matrix<char>> m_compressedValue; // the value between ForwardProp() and Backprop(), if stashed compressed
+    size_t m_compressedValueNumRows = 0;
 
     static std::map<size_t, std::map<size_t, shared_ptr<Matrix<ElemType>>>> s_constOnes;
 };
@@ -1884,6 +2000,10 @@ public:
     virtual std::string FormatOperationPrototype(const std::string& extraArgs) const override { return ""; }
     virtual void DumpNodeInfo(const bool /*printValues*/, const bool /*printMetadata*/, File& fstream) const override {}
     virtual std::set<std::pair<const MatrixBase*, std::wstring>> GetMatrixInfo() const override { NOT_IMPLEMENTED; }
+    virtual void CompressValue(ValueCompression) override { NOT_IMPLEMENTED; }
+    virtual void DecompressValue(ValueCompression) override { NOT_IMPLEMENTED; }
+    virtual void ReacquireValueFromPool(MatrixPool&) override { NOT_IMPLEMENTED; }
+    virtual void ReleaseValueToPool(MatrixPool&) override { NOT_IMPLEMENTED; }
 
     virtual void ForwardProp(const FrameRange&, const ComputationNodeBasePtr, const ComputationNodeBasePtr) { NOT_IMPLEMENTED; }
 
@@ -1951,6 +2071,10 @@ struct IPreComputeNode
     // call this with 'false' at start and with 'true' at end
     // This is used for resetting and updating from accumulators.
     virtual void MarkComputed(const bool hasComputed) = 0;
+    // For precomputation over disjoint parts of the data (see PreComputeAccumulation.h), between the two calls: the
+    // statistics accumulated so far, and replacing them by the merge of such accumulations of all the parts.
+    virtual void GetAccumulation(std::vector<double>& accumulation) const = 0;
+    virtual void MergeAccumulations(const std::vector<std::vector<double>>& accumulations) = 0;
 };
 
 // =======================================================================
@@ -147,6 +147,7 @@ public:
     TensorShape LowerPad() const { return m_lowerPad; }
     TensorShape UpperPad() const { return m_upperPad; }
     bool Transpose() const { return m_transpose; }
+    ImageLayoutKind ImageLayout() const { return m_imageLayout; }
     size_t MaxTempMemSizeInSamples() const { return m_maxTempMemSizeInSamples; }
     PoolKind PoolingKind() const { return m_poolKind; }
 
@@ -233,14 +234,14 @@ class ConvolutionNode : public ConvolutionNodeBase<ElemType>, public NumInputs<2
     static const std::wstring TypeName() { return L"Convolution"; }
 public:
     ConvolutionNode(DEVICEID_TYPE deviceId, const wstring& name)
-        : Base(deviceId, name)
+        : Base(deviceId, name), m_groups(1)
     {
     }
     ConvolutionNode(DEVICEID_TYPE deviceId, const wstring& name, const TensorShape& kernelShape, const TensorShape& mapCount, const TensorShape& strideShape,
                     const std::vector<bool>& sharing, const std::vector<bool>& autoPadding, const TensorShape& lowerPad, const TensorShape& upperPad,
-                    bool transpose, ImageLayoutKind imageLayout, size_t maxTempMemSizeInSamples)
+                    bool transpose, ImageLayoutKind imageLayout, size_t maxTempMemSizeInSamples, size_t groups = 1)
                     : Base(deviceId, name, kernelShape, mapCount, strideShape, sharing, autoPadding, lowerPad, upperPad, PoolKind::None, transpose, imageLayout, maxTempMemSizeInSamples),
-                    m_convolution2D(false)
+                    m_convolution2D(false), m_groups(groups)
     {
     }
     ConvolutionNode(DEVICEID_TYPE deviceId, const wstring& name, const size_t kernelWidth, const size_t kernelHeight, const size_t outputChannels,
@@ -258,6 +259,10 @@ public:
                           configp->Get(L"dimSharing"), configp->Get(L"dimPadding"), configp->Get(L"dimPadLower"), configp->Get(L"dimPadUpper"),
                           configp->Get(L"transpose"), ImageLayoutKindFrom(configp->Get(L"imageLayout")), configp->Get(L"maxTempMemSizeInSamples"))
     {
+        // 'groups' is optional, for configs written before grouped convolutions
+        auto groups = configp->Find(L"groups");
+        if (groups)
+            m_groups = (size_t)*groups;
         AttachInputsFromConfig(configp, GetExpectedNumInputs());
     }
 
@@ -266,6 +271,7 @@ public:
     {
         Base::Save(fstream);
         fstream << m_convolution2D;
+        fstream << m_groups;
     }
 
     void Load(File& fstream, size_t modelVersion) override
@@ -302,6 +308,9 @@ public:
         {
             fstream >> m_convolution2D;
         }
+        m_groups = 1;
+        if (modelVersion >= CNTK_MODEL_VERSION_16)
+            fstream >> m_groups;
     }
 
     void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
@@ -311,6 +320,7 @@ public:
         {
             auto node = dynamic_pointer_cast<ConvolutionNode<ElemType>>(nodeP);
             node->m_convolution2D = m_convolution2D;
+            node->m_groups = m_groups;
         }
     }
 
@@ -368,6 +378,8 @@ public:
         if (m_convolution2D)
         // NOTE: when m_convolution2D is true, it's a legacy branch. Code should not enter here any more. 
         {
+            if (m_groups > 1)
+                InvalidArgument("%ls: Grouped convolution is not supported with the legacy 2D convolution syntax.", NodeDescription().c_str());
             // Need to update some tensors with correct input dims.
             auto inDims = ImageDimensions(GetInputSampleLayout(inputIdx), m_imageLayout);
             // inputShape is used in ConvolveGeometry which supports only CHW layout.
@@ -406,10 +418,12 @@ public:
             inputShape = GetInputSampleLayout(inputIdx);
             // infer reduction dimensions if not given
             InferReductionDims(inputShape, inputShape);
+            if (m_groups > 1)
+                InferGroupDims(inputShape);
             if (!m_transpose)
             {
                 outputShape = ConvolveGeometry::ComputeOutputShape(inputShape, m_kernelShape, m_mapCount, m_stride,
-                                                                    m_sharing, m_autoPad, m_lowerPad, m_upperPad);
+                                                                    m_sharing, m_autoPad, m_lowerPad, m_upperPad, m_groups);
             }
             else
             {
@@ -450,7 +464,7 @@ public:
             {
                 auto geometry = std::make_shared<ConvolveGeometry>(!m_transpose ? inputShape : outputShape,
                                                                    m_kernelShape, m_mapCount, m_stride, 
-                                                                   m_sharing, m_autoPad, m_lowerPad, m_upperPad);
+                                                                   m_sharing, m_autoPad, m_lowerPad, m_upperPad, m_groups);
                 m_convEng = ConvolutionEngine<ElemType>::Create(geometry, m_deviceId, m_imageLayout,
                                                                 m_maxTempMemSizeInSamples, m_poolKind,
                                                                 ConvolutionEngineKind::All, NodeName(), Globals::ShouldForceDeterministicAlgorithms());
@@ -485,9 +499,39 @@ public:
             m_convEng->SetmMaxTempMemSizeInSamples(maxTempMemSizeInSamples);
     }
 
+    size_t Groups() const { return m_groups; }
+
+private:
+    // The kernel of a grouped convolution spans the channels of a group (the rightmost dimension), and so does
+    // its stride, unless they are given. E.g. a depthwise 3 x 3 kernel of 32 channels in 32 groups is [3 x 3 x 1].
+    void InferGroupDims(const TensorShape& inputShape)
+    {
+        if (m_transpose)
+            InvalidArgument("%ls: Grouped convolution is not supported for deconvolution (transpose).", NodeDescription().c_str());
+        if (m_imageLayout != ImageLayoutKind::CHW)
+            InvalidArgument("%ls: Grouped convolution requires the CHW (cudnn) image layout.", NodeDescription().c_str());
+        size_t last = inputShape.GetRank() - 1;
+        if (inputShape.GetRank() == 0 || m_kernelShape.GetRank() != inputShape.GetRank() || (inputShape[last] % m_groups) != 0)
+            InvalidArgument("%ls: Grouped convolution requires that the number of input channels (%d) is a multiple of the number of groups (%d).",
+                            NodeDescription().c_str(), inputShape.GetRank() == 0 ? 0 : (int)inputShape[last], (int)m_groups);
+        size_t groupChannels = inputShape[last] / m_groups;
+        auto kernelDims = m_kernelShape.GetDims();
+        if (kernelDims[last] == inputShape[last])
+            kernelDims[last] = groupChannels;
+        m_kernelShape = TensorShape(kernelDims);
+        if (m_stride.GetRank() == inputShape.GetRank() && m_stride[last] == inputShape[last])
+        {
+            auto strideDims = m_stride.GetDims();
+            strideDims[last] = groupChannels;
+            m_stride = TensorShape(strideDims);
+        }
+    }
+
 protected:
     // Flag that indicates whether the node is created using 2D-syntax.
     bool m_convolution2D;
+    // Number of groups of grouped convolutions, 1 for full ones (see ConvolveGeometry::Groups()).
+    size_t m_groups;
 };
 
 // -----------------------------------------------------------------------
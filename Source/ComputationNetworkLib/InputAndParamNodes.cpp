@@ -6,6 +6,7 @@
 #include "Basics.h"
 #include "InputAndParamNodes.h"
 #include "File.h"        // for LoadMatrixFromTextFile()
+#include "MemoryMappedFile.h"
 #include "TensorShape.h" // for SmallVector<>
 
 #include <string>
@@ -412,7 +413,64 @@ void LearnableParameter<ElemType>::Save(File& fstream) const /*override*/
     Base::Save(fstream);
     fstream << m_learningRateMultiplier;
     m_sampleLayout.Save(fstream);
-    fstream << Value();
+
+    bool isAligned = !fstream.IsTextBased() && fstream.CanSeek() && Value().GetMatrixType() == DENSE &&
+                     Value().GetNumElements() * sizeof(ElemType) >= s_minAlignedValueBytes;
+    fstream << isAligned;
+    if (isAligned)
+        SaveAlignedValue(fstream);
+    else
+        fstream << Value();
+}
+
+// dimensions, padding to the next page, and the elements as in memory
+template <class ElemType>
+void LearnableParameter<ElemType>::SaveAlignedValue(File& fstream) const
+{
+    const auto& value = Value();
+    fstream << value.GetNumRows() << value.GetNumCols();
+    size_t padding = (s_valueAlignment - (fstream.GetPosition() + sizeof(size_t)) % s_valueAlignment) % s_valueAlignment;
+    fstream << padding;
+    vector<char> zeros(padding + 1);
+    fwriteOrDie(zeros.data(), 1, padding, fstream);
+
+    if (value.GetDeviceId() == CPUDEVICE)
+        fstream.PutBlock(value.Data(), value.GetNumElements() * sizeof(ElemType));
+    else
+    {
+        unique_ptr<ElemType[]> data(value.CopyToArray());
+        fstream.PutBlock(data.get(), value.GetNumElements() * sizeof(ElemType));
+    }
+}
+
+// If the file comes with a memory mapping (see ComputationNetwork::SetMemoryMapParameters()), a CPU value becomes
+// a copy-on-write view of the file: it is paged in when used, and its pages are shared with other processes that
+// use the same model, unless written to. Otherwise it is read in one piece.
+template <class ElemType>
+void LearnableParameter<ElemType>::LoadAlignedValue(File& fstream)
+{
+    size_t numRows, numCols, padding;
+    fstream >> numRows >> numCols >> padding;
+    uint64_t offset = fstream.GetPosition() + padding;
+    size_t numElements = numRows * numCols;
+
+    CreateMatrixIfNull(m_value);
+    const auto& mapping = fstream.GetMemoryMapping();
+    if (mapping && Value().GetDeviceId() == CPUDEVICE && offset + numElements * sizeof(ElemType) <= mapping->Size())
+    {
+        Value().SetValue(numRows, numCols, CPUDEVICE, (ElemType*) (mapping->MutableData() + offset), matrixFlagDontOwnBuffer);
+        m_valueMapping = mapping;
+    }
+    else
+    {
+        fstream.SetPosition(offset);
+        vector<ElemType> data(numElements);
+        fstream.GetBlock(data.data(), numElements * sizeof(ElemType));
+        Value().SetValue(numRows, numCols, Value().GetDeviceId(), data.data());
+        m_valueMapping.reset();
+    }
+    fstream.SetPosition(offset + numElements * sizeof(ElemType));
+    SetDims(TensorShape(numRows, numCols), false); // (as LoadValue())
 }
 
 template <class ElemType>
@@ -445,7 +503,13 @@ void LearnableParameter<ElemType>::Load(File& fstream, size_t modelVersion) /*ov
         }
     }
 
-    LoadValue(fstream);
+    bool isAligned = false;
+    if (modelVersion >= CNTK_MODEL_VERSION_15)
+        fstream >> isAligned;
+    if (isAligned)
+        LoadAlignedValue(fstream);
+    else
+        LoadValue(fstream);
     SetDims(sampleLayout, false); // note: call this after LoadValue() since LoadValue() overwrites m_sampleLayout
     VerifyDataSize(Value());      // sanity check
 
@@ -466,6 +530,7 @@ template <class ElemType>
         node->m_initOutputRank = m_initOutputRank;
         node->m_initOnCPUOnly  = m_initOnCPUOnly;
         node->m_initValue      = m_initValue;
+        node->m_valueMapping   = m_valueMapping; // (in case the value is shared)
     }
 }
 
@@ -113,6 +113,12 @@ private:
     // deferred initialization
     void LazyInitParameters();
 
+    // values of at least this size are stored raw and page-aligned, so that a memory-mapped model file can be used in place
+    static const size_t s_minAlignedValueBytes = 64 * 1024;
+    static const size_t s_valueAlignment = 4096;
+    void SaveAlignedValue(File& fstream) const;
+    void LoadAlignedValue(File& fstream);
+
 public:
     // reload parameters from file
     // This is called from MEL.
@@ -122,6 +128,7 @@ public:
     virtual void Load(File& fstream, size_t modelVersion) override;
 
     virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override;
+    virtual bool IsModelValue() const override { return true; }
 
     // computation functions don't do anything for parameter nodes
     virtual void UpdateFunctionMBSize() override;
@@ -150,6 +157,8 @@ private:
     int m_initOutputRank;
     bool m_initOnCPUOnly;
     ElemType m_initValue;
+
+    std::shared_ptr<MemoryMappedFile> m_valueMapping; // the model file, if Value() is a view of it
 };
 
 // -----------------------------------------------------------------------
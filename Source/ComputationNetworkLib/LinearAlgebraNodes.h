@@ -8,6 +8,7 @@
 #include "ComputationNode.h"
 #include "Matrix.h"
 #include "TensorView.h"
+#include "QuantizedProduct.h"
 
 #include <unordered_set>
 #include <map>
@@ -60,6 +61,8 @@ public:
 
         inputGradient.AddCopyOf(gradient);
     }
+
+    virtual bool CanComputeValueInPlaceOfInput(size_t /*childIndex*/) const override { return true; }
 };
 
 template class PlusNode<float>;
@@ -162,6 +165,8 @@ public:
         ElemType sign = inputIndex == 0 ? 1.0f : -1.0f;
         inputGradient.AddCopyOf(gradient, sign);
     }
+
+    virtual bool CanComputeValueInPlaceOfInput(size_t /*childIndex*/) const override { return true; }
 };
 
 template class MinusNode<float>;
@@ -251,6 +256,8 @@ public:
             auto node = dynamic_pointer_cast<TimesNodeBase<ElemType, m_transpose>>(nodeP);
             node->m_outputRank          = m_outputRank;
             node->m_inferInputRankToMap = m_inferInputRankToMap;
+            node->m_quantizedProduct    = m_quantizedProduct; // (immutable)
+            node->m_sparseLeftArgument  = m_sparseLeftArgument; // (immutable)
         }
     }
 
@@ -306,6 +313,31 @@ public:
             return;
         }
 
+        if (m_sparseLeftArgument && InputRef(1).Value().GetMatrixType() == DENSE)
+        {
+            auto result = ValueFor(fr);
+            Matrix<ElemType>::MultiplyAndWeightedAdd(1, *m_sparseLeftArgument, true, InputRef(1).ValueFor(fr), false, 0, result);
+            return;
+        }
+
+        if (m_quantizedProduct && InputRef(1).Value().GetMatrixType() == DENSE)
+        {
+            auto result = ValueFor(fr);
+            m_quantizedProduct->Multiply(InputRef(1).ValueFor(fr), result);
+            return;
+        }
+
+        if (CanSkipGaps(fr))
+        {
+            // multiply the valid columns only; the gaps of the result become 0
+            const auto& validColumns = GetMBLayout()->template GetValidColumnIndices<ElemType>(m_deviceId);
+            m_compactInput->DoGatherColumnsOf(0, validColumns, InputRef(1).Value(), 1);
+            m_compactOutput->Resize(Value().GetNumRows(), validColumns.GetNumCols());
+            Matrix<ElemType>::Multiply(LeftArgumentAsMatrix(/*gradient=*/false), m_transpose, *m_compactInput, false, *m_compactOutput);
+            Value().DoScatterColumnsOf(0, validColumns, *m_compactOutput, 1);
+            return;
+        }
+
         // TensorView::DoMatrixProductOf() will reduce each tensor object into a 2D tensor (or fail if it cannot)
         // and recreate actual Matrix objects (in case of sparse, they must be identical to the original tensor storage object).
         // Transposition is applied after flattening into 2D, but only allowed if the input sample is 2D anyway.
@@ -328,6 +360,29 @@ public:
             return;
         }
 
+        if (CanSkipGaps(fr) && (inputIndex == 1 || InputRef(0).Gradient().GetMatrixType() == DENSE))
+        {
+            // the gradients of the valid columns only, which needs no masking
+            const auto& validColumns = GetMBLayout()->template GetValidColumnIndices<ElemType>(m_deviceId);
+            m_compactOutputGradient->DoGatherColumnsOf(0, validColumns, Gradient(), 1);
+            if (inputIndex == 0)
+            {
+                m_compactInputOrGradient->DoGatherColumnsOf(0, validColumns, InputRef(1).Value(), 1);
+                auto input0Gradient = LeftArgumentAsMatrix(/*gradient=*/true);
+                if (m_transpose)
+                    Matrix<ElemType>::MultiplyAndAdd(*m_compactInputOrGradient, false, *m_compactOutputGradient, true, input0Gradient);
+                else
+                    Matrix<ElemType>::MultiplyAndAdd(*m_compactOutputGradient, false, *m_compactInputOrGradient, true, input0Gradient);
+            }
+            else
+            {
+                m_compactInputOrGradient->Resize(InputRef(1).Value().GetNumRows(), validColumns.GetNumCols());
+                Matrix<ElemType>::Multiply(LeftArgumentAsMatrix(/*gradient=*/false), !m_transpose, *m_compactOutputGradient, false, *m_compactInputOrGradient);
+                InputRef(1).Gradient().DoScatterColumnsOf(1, validColumns, *m_compactInputOrGradient, 1);
+            }
+            return;
+        }
+
         // this potentially computes inner products over time, so we must mask gaps to 0
         if (Input(inputIndex)->ReducesInTimeWrt(shared_from_this()))
             MaskMissingGradientColumnsToZero(fr);
@@ -359,6 +414,34 @@ public:
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
     // but both *inputs* are used, so we don't overload the InputUsed-() function which defaults to 'true'
 
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        RequestMatrixFromPool(m_compactInput, matrixPool);
+        RequestMatrixFromPool(m_compactOutput, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterForwardProp(matrixPool);
+        ReleaseMatrixToPool(m_compactInput, matrixPool);
+        ReleaseMatrixToPool(m_compactOutput, matrixPool);
+    }
+
+    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeBackprop(matrixPool);
+        RequestMatrixFromPool(m_compactInputOrGradient, matrixPool);
+        RequestMatrixFromPool(m_compactOutputGradient, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_compactInputOrGradient, matrixPool);
+        ReleaseMatrixToPool(m_compactOutputGradient, matrixPool);
+    }
+
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
     {
         Base::Validate(isFinalValidationPass);
@@ -497,9 +580,79 @@ public:
 
     size_t OutputRank() const { return m_outputRank; }
 
+    // Let ForwardProp() compute the product in integer arithmetic, with the current value of the left argument
+    // quantized to 'numBits' bits (see QuantizedProduct). For inference only: the quantized weights do not follow
+    // later updates, and Backprop() still uses the original ones. Returns false, and changes nothing, unless the
+    // left argument is a plain dense CPU matrix without MB layout, and not sparse already (see SparsifyLeftArgument()).
+    bool QuantizeLeftArgument(size_t numBits)
+    {
+        const auto& weights = InputRef(0);
+        bool transpose = m_transpose; // (avoids C4127: conditional expression is constant)
+        if (transpose || m_outputRank != 1 || weights.HasMBLayout() || m_sparseLeftArgument ||
+            weights.Value().GetDeviceId() != CPUDEVICE || weights.Value().GetMatrixType() != DENSE ||
+            weights.Value().GetNumRows() != GetSampleLayout().GetNumElements() ||
+            weights.Value().GetNumCols() != InputRef(1).GetSampleLayout().GetNumElements())
+            return false;
+        m_quantizedProduct = make_shared<QuantizedProduct<ElemType>>(weights.Value(), numBits);
+        return true;
+    }
+
+    // Let ForwardProp() multiply with a sparse copy of the current value of the left argument, e.g. of pruned weights,
+    // if at least the fraction 'minSparsity' of its elements are 0. The copy is the CSC matrix of the [input dim x output dim]
+    // weights, multiplied transposed: on the CPU, a dot product per row of the result, in parallel over the rows; on the
+    // GPU, a csrmm of the weights without transposition. For inference only, like QuantizeLeftArgument(). Returns false,
+    // and changes nothing, unless the left argument is a dense matrix without MB layout that is sparse enough.
+    bool SparsifyLeftArgument(double minSparsity)
+    {
+        const auto& weights = InputRef(0);
+        const size_t numElements = GetSampleLayout().GetNumElements() * InputRef(1).GetSampleLayout().GetNumElements();
+        if (m_outputRank != 1 || weights.HasMBLayout() || m_quantizedProduct || weights.Value().GetMatrixType() != DENSE ||
+            numElements == 0 || weights.Value().GetNumElements() != numElements)
+            return false;
+        if (1 - weights.Value().MatrixNorm0() / (double) numElements < minSparsity)
+            return false;
+
+        auto sparse = make_shared<Matrix<ElemType>>(weights.Value().GetDeviceId());
+        bool transpose = m_transpose; // (avoids C4127: conditional expression is constant)
+        if (transpose)
+            sparse->SetValue(LeftArgumentAsMatrix(/*gradient=*/false));
+        else
+            sparse->AssignTransposeOf(LeftArgumentAsMatrix(/*gradient=*/false));
+        sparse->SwitchToMatrixType(SPARSE, matrixFormatSparseCSC, /*keepValues=*/true);
+        m_sparseLeftArgument = sparse;
+        return true;
+    }
+
 private:
+    // Can the product be computed over the valid columns of the minibatch only (see MBLayout::HasManyGaps())? That is the
+    // case for the common W * x of a dense x whose samples are reduced over entirely, for the whole minibatch at once.
+    bool CanSkipGaps(const FrameRange& fr) const
+    {
+        if (!fr.IsAllFrames() || !HasMBLayout() || InputRef(0).HasMBLayout() || !GetMBLayout()->HasManyGaps())
+            return false;
+        const auto& input1 = InputRef(1);
+        return input1.GetMBLayout() == GetMBLayout() && input1.Value().GetMatrixType() == DENSE && InputRef(0).Value().GetMatrixType() == DENSE &&
+               InputRef(0).Value().GetNumElements() == GetSampleLayout().GetNumElements() * input1.GetSampleLayout().GetNumElements();
+    }
+
+    // the left argument, or its gradient, as the matrix [output dim x input dim], or transposed for TransposeTimes
+    Matrix<ElemType> LeftArgumentAsMatrix(bool gradient) const
+    {
+        const auto& matrix = gradient ? InputRef(0).Gradient() : InputRef(0).Value();
+        const size_t outputDim = GetSampleLayout().GetNumElements();
+        const size_t inputDim = InputRef(1).GetSampleLayout().GetNumElements();
+        return m_transpose ? matrix.Reshaped(inputDim, outputDim) : matrix.Reshaped(outputDim, inputDim);
+    }
+
     size_t m_outputRank;
     int m_inferInputRankToMap;  // -1 (not specified) or says how to expand shape of W, to keep this many mapping dims
+    shared_ptr<QuantizedProduct<ElemType>> m_quantizedProduct; // (shared by copies of the node)
+    shared_ptr<Matrix<ElemType>> m_sparseLeftArgument;         // [input dim x output dim], CSC (shared by copies of the node)
+
+    // the valid columns of the right argument and of the result in ForwardProp(), and of the right argument or its
+    // gradient and of the gradient of the result in BackpropTo(), if CanSkipGaps()
+    shared_ptr<Matrix<ElemType>> m_compactInput, m_compactOutput;
+    shared_ptr<Matrix<ElemType>> m_compactInputOrGradient, m_compactOutputGradient;
 };
 
 // -----------------------------------------------------------------------
@@ -569,6 +722,475 @@ public:
 template class TransposeTimesNode<float>;
 template class TransposeTimesNode<double>;
 
+// -----------------------------------------------------------------------
+// EmbeddingLookupNode (E, ids) -- the columns E[:, ids[t]] of an embedding matrix
+// The same as Times(E, one-hot(ids)), but without the sparse matrix: the ids are a dense input with one element per
+// sample (e.g. a 1-dimensional input of the text reader), and the forward pass gathers the columns of E. The gradient
+// of E is block-sparse (SparseBlockCol) with a column for each distinct id of the minibatch, computed by sorting the
+// ids and adding up the gradients of equal ids. Like the sparse gradient of TimesNode, it is assigned rather than
+// accumulated, so an embedding that has other consumers needs sparseGradient=false, which scatters into a dense
+// gradient instead. Gaps of the ids are set to -1, which maps them to a zero column.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class EmbeddingLookupNode : public ComputationNode<ElemType>, public NumInputs<2>
+{
+    typedef ComputationNode<ElemType> Base;
+    UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"EmbeddingLookup"; }
+
+public:
+    EmbeddingLookupNode(DEVICEID_TYPE deviceId, const wstring& name, bool sparseGradient = true)
+        : Base(deviceId, name), m_sparseGradient(sparseGradient)
+    {
+    }
+    EmbeddingLookupNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : EmbeddingLookupNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"sparseGradient"))
+    {
+        AttachInputsFromConfig(configp, this->GetExpectedNumInputs());
+    }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        InputRef(1).MaskMissingValueColumnsTo(fr, -1);
+        auto ids = InputRef(1).ValueFor(fr);
+        ValueFor(fr).DoGatherColumnsOf(/*beta=*/0, ids, InputRef(0).ValueAsMatrix(), /*alpha=*/1);
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
+    {
+        if (inputIndex != 0) // no gradient for the ids
+            return;
+
+        auto ids = InputRef(1).ValueFor(fr); // (gaps were set to -1 by ForwardProp())
+        auto& gradient = InputRef(0).GradientAsMatrix();
+        if (gradient.GetMatrixType() == SPARSE)
+            gradient.AssignScatteredColumnsOf(ids, GradientFor(fr), /*alpha=*/1);
+        else
+            gradient.DoScatterColumnsOf(/*beta=*/1, ids, GradientFor(fr), /*alpha=*/1);
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t childIndex) const override { return childIndex == 1; }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        InferMBLayoutFromInputsForStandardCase(isFinalValidationPass);
+
+        if (isFinalValidationPass)
+        {
+            if (Input(0)->HasMBLayout() || Input(0)->GetSampleLayout().GetRank() != 2)
+                InvalidArgument("%ls: The embedding must be a matrix [dimension x number of ids], not [%s].", NodeDescription().c_str(), string(Input(0)->GetSampleLayout()).c_str());
+            if (Input(1)->GetSampleLayout().GetNumElements() != 1)
+                InvalidArgument("%ls: The ids must have a single element per sample, not [%s].", NodeDescription().c_str(), string(Input(1)->GetSampleLayout()).c_str());
+            if (Input(1)->Value().GetMatrixType() != DENSE)
+                InvalidArgument("%ls: The ids must be dense; use Times() for a one-hot sparse input.", NodeDescription().c_str());
+        }
+
+        // a column of the embedding for each id
+        const auto& embeddingDims = Input(0)->GetSampleLayout().GetDims();
+        SetDims(TensorShape(embeddingDims.empty() ? 0 : embeddingDims[0]), HasMBLayout());
+    }
+
+    virtual void AllocateGradientMatricesForInputs(MatrixPool& matrixPool) override
+    {
+        // like for TimesNode with a sparse input, the block-sparse gradient is allocated here rather than from the pool;
+        // within a loop, where the gradient is computed frame by frame, it must be dense
+        if (m_sparseGradient && Input(0)->NeedsGradient() && !IsPartOfLoop())
+        {
+            Input(0)->CreateGradientMatrixIfNull();
+            Input(0)->Gradient().SwitchToMatrixType(SPARSE, MatrixFormat::matrixFormatSparseBlockCol, false);
+        }
+
+        Base::AllocateGradientMatricesForInputs(matrixPool);
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<EmbeddingLookupNode<ElemType>>(nodeP);
+            node->m_sparseGradient = m_sparseGradient;
+        }
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_sparseGradient;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        fstream >> m_sparseGradient;
+    }
+
+private:
+    bool m_sparseGradient;
+};
+
+template class EmbeddingLookupNode<float>;
+template class EmbeddingLookupNode<double>;
+
+// -----------------------------------------------------------------------
+// BatchTimesNode (A, B, transposeA=false, transposeB=false) -- a matrix product for each sample
+// Both inputs are minibatch data of the same layout whose samples are matrices or column vectors, and each sample
+// of the result is the product op(A_t) * op(B_t) of the samples of the inputs, where op() transposes if asked to:
+//  [I x J x *] * [J x K x *] = [I x K x *], and for a column vector B [I x J x *] * [J x *] = [I x *].
+// All products of a minibatch are a single batched GEMM (see Matrix::BatchMultiplyAndWeightedAdd()). E.g. with the
+// keys and values of a sequence in the samples [D x T], the attention scores of all samples are
+// BatchTimes(keys, query, transposeA=true) [T], and the contexts BatchTimes(values, weights) [D].
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class BatchTimesNode : public ComputationNode<ElemType>, public NumInputs<2>
+{
+    typedef ComputationNode<ElemType> Base;
+    UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"BatchTimes"; }
+
+public:
+    BatchTimesNode(DEVICEID_TYPE deviceId, const wstring& name, bool transposeA = false, bool transposeB = false)
+        : Base(deviceId, name), m_transposeA(transposeA), m_transposeB(transposeB)
+    {
+    }
+    BatchTimesNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : BatchTimesNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"transposeA"), configp->Get(L"transposeB"))
+    {
+        AttachInputsFromConfig(configp, this->GetExpectedNumInputs());
+    }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        auto result = ValueFor(fr);
+        Matrix<ElemType>::BatchMultiplyAndWeightedAdd(1, InputRef(0).ValueFor(fr), m_transposeA, SampleRows(0), InputRef(1).ValueFor(fr), m_transposeB, SampleRows(1), 0, result);
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
+    {
+        auto outputGradient = GradientFor(fr);
+        auto inputGradient = InputRef(inputIndex).GradientFor(fr);
+        if (inputIndex == 0)
+        {
+            auto b = InputRef(1).ValueFor(fr);
+            if (!m_transposeA) // dA += dC * op(B)'
+                Matrix<ElemType>::BatchMultiplyAndWeightedAdd(1, outputGradient, false, SampleRows(-1), b, !m_transposeB, SampleRows(1), 1, inputGradient);
+            else               // dA += op(B) * dC'
+                Matrix<ElemType>::BatchMultiplyAndWeightedAdd(1, b, m_transposeB, SampleRows(1), outputGradient, true, SampleRows(-1), 1, inputGradient);
+        }
+        else
+        {
+            auto a = InputRef(0).ValueFor(fr);
+            if (!m_transposeB) // dB += op(A)' * dC
+                Matrix<ElemType>::BatchMultiplyAndWeightedAdd(1, a, !m_transposeA, SampleRows(0), outputGradient, false, SampleRows(-1), 1, inputGradient);
+            else               // dB += dC' * op(A)
+                Matrix<ElemType>::BatchMultiplyAndWeightedAdd(1, outputGradient, true, SampleRows(-1), a, m_transposeA, SampleRows(0), 1, inputGradient);
+        }
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        InferMBLayoutFromInputsForStandardCase(isFinalValidationPass);
+
+        const auto& dimsA = Input(0)->GetSampleLayout().GetDims();
+        const auto& dimsB = Input(1)->GetSampleLayout().GetDims();
+        if (isFinalValidationPass)
+        {
+            if (!Input(0)->HasMBLayout() || Input(0)->GetMBLayout() != Input(1)->GetMBLayout())
+                InvalidArgument("%ls: Both operands must be minibatch data of the same layout; use Times() for a product with a parameter.", NodeDescription().c_str());
+            if (dimsA.empty() || dimsA.size() > 2 || dimsB.empty() || dimsB.size() > 2)
+                InvalidArgument("%ls: The samples of the operands must be matrices or column vectors, not [%s] and [%s].",
+                                NodeDescription().c_str(), string(Input(0)->GetSampleLayout()).c_str(), string(Input(1)->GetSampleLayout()).c_str());
+            if (Input(0)->Value().GetMatrixType() != DENSE || Input(1)->Value().GetMatrixType() != DENSE)
+                InvalidArgument("%ls: The operands must be dense.", NodeDescription().c_str());
+        }
+
+        // op(A) is [m x k] and op(B) [k x n]
+        const size_t rowsA = dimsA.empty() ? 0 : dimsA[0], colsA = dimsA.size() > 1 ? dimsA[1] : 1;
+        const size_t rowsB = dimsB.empty() ? 0 : dimsB[0], colsB = dimsB.size() > 1 ? dimsB[1] : 1;
+        const size_t m = m_transposeA ? colsA : rowsA, k = m_transposeA ? rowsA : colsA;
+        const size_t l = m_transposeB ? colsB : rowsB, n = m_transposeB ? rowsB : colsB;
+        if (isFinalValidationPass && k != l)
+            InvalidArgument("%ls: The inner dimensions of the operands [%s] and [%s] do not match.",
+                            NodeDescription().c_str(), string(Input(0)->GetSampleLayout()).c_str(), string(Input(1)->GetSampleLayout()).c_str());
+        SetDims(dimsB.size() <= 1 && !m_transposeB ? TensorShape(m) : TensorShape(m, n), HasMBLayout());
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<BatchTimesNode<ElemType>>(nodeP);
+            node->m_transposeA = m_transposeA;
+            node->m_transposeB = m_transposeB;
+        }
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_transposeA << m_transposeB;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        fstream >> m_transposeA >> m_transposeB;
+    }
+
+    bool TransposeA() const { return m_transposeA; }
+    bool TransposeB() const { return m_transposeB; }
+
+private:
+    // the rows of the samples of an input, or of the output for -1, which the products see as matrices
+    size_t SampleRows(int inputIndex) const
+    {
+        return (inputIndex < 0 ? GetSampleLayout() : InputRef(inputIndex).GetSampleLayout())[0];
+    }
+
+    bool m_transposeA;
+    bool m_transposeB;
+};
+
+template class BatchTimesNode<float>;
+template class BatchTimesNode<double>;
+
+// -----------------------------------------------------------------------
+// FusedTimesPlusNode (A, B, bias) -- f(A * B + bias) in one step
+// This is a fully connected layer: A is a matrix, bias a column vector that is added to each column
+// of the product, and f is none (opCopy), opSigmoid, opTanh or opLinearRectifier. It is computed by
+// Matrix::MultiplyAndAddBias(), which saves the passes over the output for the bias and for f.
+// These nodes are not written by users. ComputationNetwork::FuseNodesForInference() puts them in
+// place of Times -> Plus -> Sigmoid/Tanh/RectifiedLinear chains of networks that are only evaluated,
+// which is why there is no gradient.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class FusedTimesPlusNode : public ComputationNode<ElemType>, public NumInputs<3>
+{
+    typedef ComputationNode<ElemType> Base;
+    UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"FusedTimesPlus"; }
+
+public:
+    DeclareConstructorFromConfigWithNumInputs(FusedTimesPlusNode);
+    FusedTimesPlusNode(DEVICEID_TYPE deviceId, const wstring& name, ElementWiseOperator activation = opCopy)
+        : Base(deviceId, name), m_activation(activation)
+    {
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<FusedTimesPlusNode<ElemType>>(nodeP);
+            node->m_activation = m_activation;
+        }
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << (int) m_activation;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        int activation;
+        fstream >> activation;
+        m_activation = (ElementWiseOperator) activation;
+    }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        // A * B is a plain matrix product after flattening A into [rows x K] and the samples of B into K-vectors
+        size_t rows = GetSampleLayout().GetNumElements();
+        Matrix<ElemType> input = InputRef(1).ValueFor(fr.AllowBroadcast());
+        size_t K = InputRef(1).GetSampleLayout().GetNumElements();
+        if (input.GetNumRows() != K)
+            input = input.Reshaped(K, input.GetNumElements() / K);
+        Matrix<ElemType> result = ValueFor(fr);
+        Matrix<ElemType>::MultiplyAndAddBias(InputRef(0).Value().Reshaped(rows, K), input, InputRef(2).Value(), m_activation, result);
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t /*inputIndex*/, const FrameRange& /*fr*/) override
+    {
+        LogicError("%ls %ls operation is only used for inference and has no gradient.", NodeName().c_str(), OperationName().c_str());
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        InferMBLayoutFromInputsForStandardCase(isFinalValidationPass);
+
+        size_t rows = Input(2)->GetSampleLayout().GetNumElements();
+        if (isFinalValidationPass)
+        {
+            if (Input(0)->HasMBLayout() || Input(2)->HasMBLayout())
+                InvalidArgument("%ls %ls operation: The matrix and the bias must not be minibatch data.", NodeName().c_str(), OperationName().c_str());
+            if (Input(0)->GetSampleLayout().GetNumElements() != rows * Input(1)->GetSampleLayout().GetNumElements())
+                InvalidArgument("%ls %ls operation: The shapes of the matrix [%s], the input [%s] and the bias [%s] are not compatible.", NodeName().c_str(), OperationName().c_str(),
+                                string(Input(0)->GetSampleLayout()).c_str(), string(Input(1)->GetSampleLayout()).c_str(), string(Input(2)->GetSampleLayout()).c_str());
+            if (m_activation != opCopy && m_activation != opSigmoid && m_activation != opTanh && m_activation != opLinearRectifier)
+                InvalidArgument("%ls %ls operation: Unsupported activation %d.", NodeName().c_str(), OperationName().c_str(), (int) m_activation);
+        }
+        SetDims(TensorShape(rows), HasMBLayout());
+    }
+
+    ElementWiseOperator Activation() const { return m_activation; }
+
+private:
+    ElementWiseOperator m_activation;
+};
+
+template class FusedTimesPlusNode<float>;
+template class FusedTimesPlusNode<double>;
+
+// -----------------------------------------------------------------------
+// FusedElementwiseNode (a, b[, c]) -- a small elementwise expression in a single tensor operation
+// The expression is one of the fused TensorOps: opElementwiseProductWithSigmoid (a .* Sigmoid(b)),
+// opElementwiseProductWithTanh (a .* Tanh(b)) or opElementwiseProductPlus (a .* b + c), which are the
+// gates and the cell update of an LSTM. Each of them is one sweep over the data forward and one per
+// input backward, instead of one per node and a temporary for each intermediate result.
+// Like ElementTimesNode, this allows broadcasting.
+// These nodes are not written by users. ComputationNetwork::FuseElementwiseNodes() puts them in place
+// of the ElementTimes, Plus, Sigmoid and Tanh nodes they compute.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class FusedElementwiseNode : public ComputationNode<ElemType>
+{
+    typedef ComputationNode<ElemType> Base;
+    UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"FusedElementwise"; }
+
+public:
+    DeclareConstructorFromConfig(FusedElementwiseNode);
+    FusedElementwiseNode(DEVICEID_TYPE deviceId, const wstring& name, ElementWiseOperator op = opElementwiseProductPlus)
+        : Base(deviceId, name), m_op(op)
+    {
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<FusedElementwiseNode<ElemType>>(nodeP);
+            node->m_op = m_op;
+        }
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << (int) m_op;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        int op;
+        fstream >> op;
+        m_op = (ElementWiseOperator) op;
+    }
+
+    // the number of inputs of an op
+    static size_t NumInputsOf(ElementWiseOperator op)
+    {
+        switch (op)
+        {
+        case opElementwiseProductWithSigmoid:
+        case opElementwiseProductWithTanh:
+            return 2;
+        case opElementwiseProductPlus:
+            return 3;
+        default:
+            return 0; // not supported
+        }
+    }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        size_t rank = DetermineElementwiseTensorRank();
+        auto result =             ValueTensorFor(rank, fr);
+        auto input0 = InputRef(0).ValueTensorFor(rank, fr.AllowBroadcast());
+        auto input1 = InputRef(1).ValueTensorFor(rank, fr.AllowBroadcast());
+        if (m_op == opElementwiseProductPlus)
+            result.DoTernaryOpOf(0, input0, input1, InputRef(2).ValueTensorFor(rank, fr.AllowBroadcast()), 1, m_op, opSum);
+        else
+            result.DoBinaryOpOf(0, input0, input1, 1, m_op, opSum);
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
+    {
+        size_t rank = DetermineElementwiseTensorRank();
+        auto gradient      =                 GradientTensorFor(rank, fr);
+        auto inputGradient = Input(inputIndex)->GradientTensorFor(rank, fr.AllowBroadcast());
+
+        // if reduction then mask the respective input(s) (zero out the gaps)
+        if (Input(inputIndex)->ReducesInTimeWrt(shared_from_this()))
+            MaskMissingGradientColumnsToZero(fr);
+        for (size_t i = 0; i < 2; i++)
+        {
+            if (i != inputIndex && Input(inputIndex)->ReducesInTimeWrt(Input(i)))
+                Input(i)->MaskMissingValueColumnsToZero(fr);
+        }
+
+        if (m_op == opElementwiseProductPlus)
+        {
+            if (inputIndex == 2)
+                inputGradient.AddCopyOf(gradient);
+            else
+                inputGradient.AddElementwiseProductOf(gradient, InputRef(1 - inputIndex).ValueTensorFor(rank, fr.AllowBroadcast()));
+            return;
+        }
+
+        auto input1 = InputRef(1).ValueTensorFor(rank, fr.AllowBroadcast());
+        if (inputIndex == 0) // gradient * f(b)
+            inputGradient.DoBinaryOpOf(1, gradient, input1, 1, m_op, opSum);
+        else                 // gradient * a * f'(b)
+        {
+            auto input0 = InputRef(0).ValueTensorFor(rank, fr.AllowBroadcast());
+            ElementWiseOperator derivativeOp = m_op == opElementwiseProductWithSigmoid ? opElementwiseProductWithSigmoidDerivativeOfProduct : opElementwiseProductWithTanhDerivativeOfProduct;
+            inputGradient.DoTernaryOpOf(1, gradient, input0, input1, 1, derivativeOp, opSum);
+        }
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t childIndex) const override { return childIndex < 2; }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        size_t numInputs = NumInputsOf(m_op);
+        if (numInputs == 0)
+            InvalidArgument("%ls %ls operation: Unsupported operation %d.", NodeName().c_str(), OperationName().c_str(), (int) m_op);
+        if (GetNumInputs() != numInputs)
+            InvalidArgument("%ls %ls operation: Expected %d inputs, but %d were given.", NodeName().c_str(), OperationName().c_str(), (int) numInputs, (int) GetNumInputs());
+        ValidateNaryZip(isFinalValidationPass, /*allowBroadcast=*/true, numInputs);
+    }
+
+    ElementWiseOperator Op() const { return m_op; }
+
+private:
+    ElementWiseOperator m_op;
+};
+
+template class FusedElementwiseNode<float>;
+template class FusedElementwiseNode<double>;
+
 // -----------------------------------------------------------------------
 // SumElementsNode (input)
 // Sums up all elements in the input across all samples into a single scalar.
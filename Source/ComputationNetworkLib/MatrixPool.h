@@ -9,6 +9,7 @@
 #include <stdexcept>
 #include <vector>
 #include <algorithm>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "Basics.h"
@@ -19,16 +20,121 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
 // MatrixPool -- class to support memory sharing
 // Despite the gather general name of this class, it is specifically designed to support the memory sharing of ComputationNodes.
+//
+// Memory sharing is planned offline. While ComputationNetwork::AllocateAllMatrices() simulates the forward and backward
+// pass, every Request() hands out a placeholder matrix and records the lifetime interval (request step to release step),
+// the estimated size, and the node's matrix slot. OptimizedMemoryAllocation() then assigns the recorded intervals to shared
+// buffers by best fit in order of their start (greedy interval coloring), so that a large buffer is not handed to a tiny node
+// while a large node grows a different buffer, and finally binds each node's slot to its buffer.
+//
+// A matrix that is released and later needed again, because its value is recomputed during backprop (see
+// ComputationNetwork::SetRecomputeSegments()), is requested again with Reacquire() and then has several lifetimes. Other
+// matrices can use its buffer in between.
+//
+// A node that computes its value in place of an input's value (see ComputationNetwork::SetInPlaceComputation()) gets that
+// input's request with RequestInPlace(); the request then has several holders and lives until the last one releases it.
+//
+// The plan is stream-ordered. Every request and release happens on the current stream (SetCurrentStream(), 0 unless the
+// simulated execution uses several). Work on one stream is ordered, so a buffer released there may serve the next request
+// right away. A buffer released on another stream, however, is only handed out after a synchronization between the two
+// streams that follows the release, which the simulation reports with RecordStreamSync(): there, the executor records an
+// event on the releasing stream, and the requesting stream waits for it. No global device synchronization is needed.
+//
+// Sizes are estimated from the sample layout, since the minibatch size is not known at this point. Matrices with an MBLayout
+// scale with the number of columns of the minibatch and are therefore only planned together with each other.
+//
 // Note: see #define SUPRESS_MEMSHARING below as for how to temporarily disable memory sharing altogether, for debugging
 class MatrixPool
 {
-    vector<shared_ptr<Matrix<float>>>  m_releasedFloatMatrices;
-    vector<shared_ptr<Matrix<double>>> m_releasedDoubleMatrices;
+    struct Lifetime
+    {
+        size_t m_allocStep;
+        size_t m_releaseStep; // SIZE_MAX if never released (lives until the end)
+        size_t m_allocStream;
+        size_t m_releaseStream;
+    };
 
     template <class ElemType>
-    vector<shared_ptr<Matrix<ElemType>>>& GetReleasedMatrices();
+    struct MemRequestInfo
+    {
+        DEVICEID_TYPE m_deviceId;
+        shared_ptr<Matrix<ElemType>>* m_pMatrixPtr; // the node's slot the planned buffer will be assigned to
+        vector<shared_ptr<Matrix<ElemType>>*> m_inPlaceMatrixPtrs; // slots of nodes computing in place of this one (RequestInPlace())
+        size_t m_numHolders;                        // slots that have not released it yet
+        shared_ptr<Matrix<ElemType>> m_placeholder; // what the slot holds until the plan is applied
+        size_t m_matrixSize;                        // estimated number of elements (per sample column if m_mbScale)
+        bool m_mbScale;                             // size scales with the minibatch size
+        vector<Lifetime> m_lifetimes;               // in order; more than one if reacquired after its release
+    };
+
+    vector<MemRequestInfo<float>>  m_memRequestInfoFloatVec;
+    vector<MemRequestInfo<double>> m_memRequestInfoDoubleVec;
+    size_t m_stepCounter;
+    bool m_recomputing; // Request() calls are for recomputing values (ComputationNode::RequestMatrixFromPool())
+
+    // streams
+    struct StreamSync
+    {
+        size_t m_step;
+        size_t m_fromStream, m_toStream; // work on m_toStream after m_step waits for work on m_fromStream before it
+    };
+    size_t m_currentStream;
+    size_t m_numStreams;
+    vector<StreamSync> m_streamSyncs; // in order of their steps
+
+    // statistics of the last plan, in bytes (per sample for minibatch-scaled matrices)
+    struct MemoryPlanStatistics
+    {
+        size_t m_numRequests;
+        size_t m_numBuffers;
+        size_t m_unsharedBytes[2]; // [mbScale] sum over all requests, i.e. no sharing at all
+        size_t m_plannedBytes[2];  // [mbScale] sum over the planned buffers
+    };
+    MemoryPlanStatistics m_planStatistics;
+
+    // the shared buffers of the last plan, to tell how much memory they hold at a time
+    vector<weak_ptr<Matrix<float>>>  m_plannedFloatBuffers;
+    vector<weak_ptr<Matrix<double>>> m_plannedDoubleBuffers;
+    void KeepPlannedBuffer(const shared_ptr<Matrix<float>>& buffer) { m_plannedFloatBuffers.push_back(buffer); }
+    void KeepPlannedBuffer(const shared_ptr<Matrix<double>>& buffer) { m_plannedDoubleBuffers.push_back(buffer); }
+
+    template <class ElemType>
+    static size_t GetAllocatedBytes(const vector<weak_ptr<Matrix<ElemType>>>& buffers, DEVICEID_TYPE deviceId)
+    {
+        size_t bytes = 0;
+        for (const auto& weakBuffer : buffers)
+        {
+            auto buffer = weakBuffer.lock();
+            if (buffer && buffer->GetDeviceId() == deviceId)
+                bytes += buffer->BufferSize();
+        }
+        return bytes;
+    }
+
+    template <class ElemType>
+    static void ReleaseBufferMemory(const vector<weak_ptr<Matrix<ElemType>>>& buffers)
+    {
+        for (const auto& weakBuffer : buffers)
+        {
+            auto buffer = weakBuffer.lock();
+            if (buffer)
+            {
+                buffer->Resize(0, 0);
+                buffer->ShrinkToFit();
+            }
+        }
+    }
+
+    template <class ElemType>
+    vector<MemRequestInfo<ElemType>>& GetMemRequestInfoVec();
 
 public:
+    MatrixPool()
+        : m_stepCounter(0), m_recomputing(false), m_currentStream(0), m_numStreams(1)
+    {
+        m_planStatistics = MemoryPlanStatistics();
+    }
+
     // release here means the matrix can be put back and shared by others
     template <class ElemType>
     void Release(shared_ptr<Matrix<ElemType>> freeMatrix)
@@ -38,38 +144,261 @@ public:
 //#define SUPRESS_MEMSHARING // #define this to disable memory sharing through this structure
         // TODO: Make this a runtime option.
 #ifndef SUPRESS_MEMSHARING
-        vector<shared_ptr<Matrix<ElemType>>>& releasedMatrices = GetReleasedMatrices<ElemType>();
-#ifdef _DEBUG
-        for (int i = 0; i < releasedMatrices.size(); i++)
+        vector<MemRequestInfo<ElemType>>& memRequestInfoVec = GetMemRequestInfoVec<ElemType>();
+        for (auto iter = memRequestInfoVec.rbegin(); iter != memRequestInfoVec.rend(); iter++)
         {
-            if (releasedMatrices[i] == freeMatrix)
+            if (iter->m_placeholder != freeMatrix)
+                continue;
+            if (iter->m_lifetimes.back().m_releaseStep != SIZE_MAX)
                 RuntimeError("MatrixPool::Release: freeMatrix is already in the released pool.");
+            if (--iter->m_numHolders == 0)
+            {
+                iter->m_lifetimes.back().m_releaseStep = m_stepCounter++;
+                iter->m_lifetimes.back().m_releaseStream = m_currentStream;
+            }
+            return;
         }
-
+        // a matrix the node created itself rather than requesting it from the pool is simply not shared
 #endif
-        releasedMatrices.push_back(freeMatrix);
+    }
+
+    // hands out a placeholder for the slot 'matrixPtr'; the slot is bound to its planned buffer by OptimizedMemoryAllocation()
+    template <class ElemType>
+    void Request(shared_ptr<Matrix<ElemType>>& matrixPtr, DEVICEID_TYPE deviceId, size_t matrixSize = 0, bool mbScale = false)
+    {
+        MemRequestInfo<ElemType> memRequestInfo;
+        memRequestInfo.m_deviceId = deviceId;
+        memRequestInfo.m_pMatrixPtr = &matrixPtr;
+        memRequestInfo.m_numHolders = 1;
+        memRequestInfo.m_placeholder = make_shared<Matrix<ElemType>>(deviceId);
+        memRequestInfo.m_matrixSize = matrixSize;
+        memRequestInfo.m_mbScale = mbScale;
+        memRequestInfo.m_lifetimes.push_back(Lifetime{ m_stepCounter++, SIZE_MAX, m_currentStream, m_currentStream });
+        GetMemRequestInfoVec<ElemType>().push_back(memRequestInfo);
+
+        matrixPtr = memRequestInfo.m_placeholder;
+    }
+
+    // hands the slot 'matrixPtr' the live request 'inputMatrix' of another node, to compute in place of it; both slots are
+    // bound to the same buffer, which is not shared with others before both are released. False if 'inputMatrix' is not live.
+    template <class ElemType>
+    bool RequestInPlace(shared_ptr<Matrix<ElemType>>& matrixPtr, const shared_ptr<Matrix<ElemType>>& inputMatrix)
+    {
+#ifndef SUPRESS_MEMSHARING
+        vector<MemRequestInfo<ElemType>>& memRequestInfoVec = GetMemRequestInfoVec<ElemType>();
+        for (auto iter = memRequestInfoVec.rbegin(); iter != memRequestInfoVec.rend(); iter++)
+        {
+            if (iter->m_placeholder != inputMatrix)
+                continue;
+            if (iter->m_lifetimes.back().m_releaseStep != SIZE_MAX || inputMatrix->GetMatrixType() == SPARSE)
+                return false;
+            iter->m_inPlaceMatrixPtrs.push_back(&matrixPtr);
+            iter->m_numHolders++;
+            matrixPtr = iter->m_placeholder;
+            return true;
+        }
 #endif
+        return false;
     }
 
+    // a released matrix is needed again; starts another lifetime of it. Nothing to do if it is still alive or not from the pool.
     template <class ElemType>
-    shared_ptr<Matrix<ElemType>> Request(DEVICEID_TYPE deviceId)
+    void Reacquire(const shared_ptr<Matrix<ElemType>>& matrix)
+    {
+        vector<MemRequestInfo<ElemType>>& memRequestInfoVec = GetMemRequestInfoVec<ElemType>();
+        for (auto iter = memRequestInfoVec.rbegin(); iter != memRequestInfoVec.rend(); iter++)
+        {
+            if (iter->m_placeholder != matrix)
+                continue;
+            if (iter->m_lifetimes.back().m_releaseStep != SIZE_MAX)
+            {
+                iter->m_lifetimes.push_back(Lifetime{ m_stepCounter++, SIZE_MAX, m_currentStream, m_currentStream });
+                iter->m_numHolders = 1;
+            }
+            return;
+        }
+    }
+
+    // the stream on which the following requests and releases happen
+    void SetCurrentStream(size_t stream)
+    {
+        m_currentStream = stream;
+        m_numStreams = max(m_numStreams, stream + 1);
+    }
+    size_t GetCurrentStream() const { return m_currentStream; }
+
+    // from here on, work on 'toStream' waits for the work issued on 'fromStream' so far (an event recorded on one, waited for on the other)
+    void RecordStreamSync(size_t fromStream, size_t toStream)
+    {
+        m_numStreams = max(m_numStreams, max(fromStream, toStream) + 1);
+        if (fromStream != toStream)
+            m_streamSyncs.push_back(StreamSync{ m_stepCounter++, fromStream, toStream });
+    }
+
+    // between these, the nodes' requests for matrices they already hold reacquire them, to recompute their values
+    void BeginRecomputation() { m_recomputing = true; }
+    void EndRecomputation() { m_recomputing = false; }
+    bool IsRecomputing() const { return m_recomputing; }
+
+    // run the plan over all recorded requests and bind the nodes' slots to the shared buffers
+    void OptimizedMemoryAllocation()
+    {
+        m_planStatistics = MemoryPlanStatistics();
+        m_plannedFloatBuffers.clear();
+        m_plannedDoubleBuffers.clear();
+        OptimizedMemoryAllocation<float>();
+        OptimizedMemoryAllocation<double>();
+        m_streamSyncs.clear();
+    }
+
+    size_t GetNumRequests() const { return m_planStatistics.m_numRequests; }
+    size_t GetNumBuffers() const { return m_planStatistics.m_numBuffers; }
+    // peak memory without any sharing vs. with the plan, as bytes per sample (minibatch-scaled) and fixed bytes
+    size_t GetUnsharedBytes(bool mbScale) const { return m_planStatistics.m_unsharedBytes[mbScale ? 1 : 0]; }
+    size_t GetPlannedBytes(bool mbScale) const { return m_planStatistics.m_plannedBytes[mbScale ? 1 : 0]; }
+    // bytes the buffers of the plan currently hold on a device, as sized by the last minibatch
+    size_t GetAllocatedBytes(DEVICEID_TYPE deviceId) const
+    {
+        return GetAllocatedBytes(m_plannedFloatBuffers, deviceId) + GetAllocatedBytes(m_plannedDoubleBuffers, deviceId);
+    }
+    // give the memory of the buffers of the plan back to their allocator (on a GPU, the caching allocator that all
+    // networks of the process share). The buffers keep their place in the plan and grow again in the next ForwardProp().
+    void ReleaseBufferMemory()
     {
-        vector<shared_ptr<Matrix<ElemType>>>& releasedMatrices = GetReleasedMatrices<ElemType>();
-        shared_ptr<Matrix<ElemType>> matrixPtr;
-        if (releasedMatrices.empty())
+        ReleaseBufferMemory(m_plannedFloatBuffers);
+        ReleaseBufferMemory(m_plannedDoubleBuffers);
+    }
+
+private:
+    // is work on 'stream' from 'step' on ordered after the end of 'lifetime', so that it may use the same buffer?
+    bool IsOrderedAfter(const Lifetime& lifetime, size_t stream, size_t step) const
+    {
+        if (lifetime.m_releaseStep > step)
+            return false;
+        if (lifetime.m_releaseStream == stream)
+            return true;
+        for (const auto& sync : m_streamSyncs)
         {
-            matrixPtr = make_shared<Matrix<ElemType>>(deviceId);
+            if (sync.m_step > step)
+                break;
+            if (sync.m_step > lifetime.m_releaseStep && sync.m_fromStream == lifetime.m_releaseStream && sync.m_toStream == stream)
+                return true;
         }
-        else
+        return false;
+    }
+
+    // can two lifetimes use the same buffer?
+    bool AreDisjoint(const Lifetime& a, const Lifetime& b) const
+    {
+        if (a.m_allocStep >= b.m_releaseStep)
+            return IsOrderedAfter(b, a.m_allocStream, a.m_allocStep);
+        if (b.m_allocStep >= a.m_releaseStep)
+            return IsOrderedAfter(a, b.m_allocStream, b.m_allocStep);
+        return false; // overlap
+    }
+
+    template <class ElemType>
+    void OptimizedMemoryAllocation()
+    {
+        struct Buffer
         {
-            matrixPtr = releasedMatrices.back();
-            releasedMatrices.pop_back();
+            DEVICEID_TYPE m_deviceId;
+            bool m_mbScale;
+            size_t m_size;
+            vector<Lifetime> m_busy; // lifetimes of the matrices assigned so far
+            shared_ptr<Matrix<ElemType>> m_matrix;
+
+            bool IsFreeFor(const vector<Lifetime>& lifetimes, const MatrixPool& pool) const
+            {
+                for (const auto& busy : m_busy)
+                    for (const auto& lifetime : lifetimes)
+                        if (!pool.AreDisjoint(busy, lifetime))
+                            return false;
+                return true;
+            }
+
+            // lifetimes that ended before 'step', and are ordered before it on all streams, cannot conflict with the request
+            // starting at 'step' or any later one
+            void ForgetBefore(size_t step, const MatrixPool& pool)
+            {
+                m_busy.erase(remove_if(m_busy.begin(), m_busy.end(), [&](const Lifetime& busy)
+                {
+                    for (size_t stream = 0; stream < pool.m_numStreams; stream++)
+                        if (!pool.IsOrderedAfter(busy, stream, step))
+                            return false;
+                    return true;
+                }), m_busy.end());
+            }
+        };
+        vector<Buffer> buffers;
+
+        vector<MemRequestInfo<ElemType>>& memRequestInfoVec = GetMemRequestInfoVec<ElemType>();
+        // requests are recorded in order of their (first) start, which is the order the greedy plan needs
+        for (auto& memRequestInfo : memRequestInfoVec)
+        {
+            // a placeholder that was turned sparse meanwhile cannot live in a shared dense buffer; the node keeps it,
+            // and nodes computing in place of it get a matrix of their own
+            if (memRequestInfo.m_placeholder->GetMatrixType() == SPARSE || *memRequestInfo.m_pMatrixPtr != memRequestInfo.m_placeholder)
+            {
+                for (auto pMatrixPtr : memRequestInfo.m_inPlaceMatrixPtrs)
+                {
+                    if (*pMatrixPtr == memRequestInfo.m_placeholder)
+                        *pMatrixPtr = make_shared<Matrix<ElemType>>(memRequestInfo.m_deviceId);
+                }
+                continue;
+            }
+
+            // best fit among the buffers that are free during all lifetimes of the request: the smallest one that is large enough,
+            // or else the largest one, which then grows by the smallest amount
+            Buffer* bestFit = nullptr;
+            for (auto& buffer : buffers)
+            {
+                buffer.ForgetBefore(memRequestInfo.m_lifetimes.front().m_allocStep, *this);
+                if (buffer.m_deviceId != memRequestInfo.m_deviceId || buffer.m_mbScale != memRequestInfo.m_mbScale || !buffer.IsFreeFor(memRequestInfo.m_lifetimes, *this))
+                    continue;
+                if (!bestFit)
+                    bestFit = &buffer;
+                else if (buffer.m_size >= memRequestInfo.m_matrixSize)
+                {
+                    if (bestFit->m_size < memRequestInfo.m_matrixSize || buffer.m_size < bestFit->m_size)
+                        bestFit = &buffer;
+                }
+                else if (bestFit->m_size < memRequestInfo.m_matrixSize && buffer.m_size > bestFit->m_size)
+                    bestFit = &buffer;
+            }
+
+            if (!bestFit)
+            {
+                Buffer buffer;
+                buffer.m_deviceId = memRequestInfo.m_deviceId;
+                buffer.m_mbScale = memRequestInfo.m_mbScale;
+                buffer.m_size = 0;
+                buffer.m_matrix = memRequestInfo.m_placeholder; // the first user's placeholder becomes the buffer
+                buffers.push_back(buffer);
+                bestFit = &buffers.back();
+            }
+
+            bestFit->m_size = max(bestFit->m_size, memRequestInfo.m_matrixSize);
+            bestFit->m_busy.insert(bestFit->m_busy.end(), memRequestInfo.m_lifetimes.begin(), memRequestInfo.m_lifetimes.end());
+            *memRequestInfo.m_pMatrixPtr = bestFit->m_matrix;
+            for (auto pMatrixPtr : memRequestInfo.m_inPlaceMatrixPtrs)
+            {
+                if (*pMatrixPtr == memRequestInfo.m_placeholder)
+                    *pMatrixPtr = bestFit->m_matrix;
+            }
+
+            m_planStatistics.m_numRequests++;
+            m_planStatistics.m_unsharedBytes[memRequestInfo.m_mbScale ? 1 : 0] += memRequestInfo.m_matrixSize * sizeof(ElemType);
         }
 
-        if (!matrixPtr) // this can't really happen
-            LogicError("MatrixPool::Request: failed to get a valid matrix.");
+        for (const auto& buffer : buffers)
+        {
+            m_planStatistics.m_plannedBytes[buffer.m_mbScale ? 1 : 0] += buffer.m_size * sizeof(ElemType);
+            KeepPlannedBuffer(buffer.m_matrix);
+        }
+        m_planStatistics.m_numBuffers += buffers.size();
 
-        return matrixPtr;
+        memRequestInfoVec.clear();
     }
 };
 
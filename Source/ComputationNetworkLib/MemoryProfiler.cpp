@@ -0,0 +1,167 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "Basics.h"
+#include "MemoryProfiler.h"
+#include "GPUWatcher.h"
+#include "fileutil.h"
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+MemoryProfiler::MemoryProfiler(const wstring& fileName, size_t numMinibatches, DEVICEID_TYPE deviceId)
+    : m_fileName(fileName), m_numMinibatches(numMinibatches), m_numMinibatchesDone(0), m_deviceId(deviceId), m_isWritten(false),
+      m_startTime(chrono::steady_clock::now()), m_liveBytes(0), m_peakBytes(0), m_peakIsBackprop(false)
+{
+}
+
+MemoryProfiler::~MemoryProfiler()
+{
+    if (!m_isWritten && !m_events.empty())
+    {
+        try
+        {
+            WriteTrace();
+        }
+        catch (...) // must not throw from a destructor, which may run while unwinding
+        {
+        }
+    }
+}
+
+double MemoryProfiler::Now() const
+{
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - m_startTime).count();
+}
+
+void MemoryProfiler::BeginMinibatch()
+{
+    m_peakBytes = 0;
+    m_peakNode.clear();
+}
+
+void MemoryProfiler::EndMinibatch()
+{
+    if (!IsActive())
+        return;
+    fprintf(stderr, "MemoryProfiler: Minibatch %d: peak of %.1f MB in %ls of %ls.\n",
+            (int) m_numMinibatchesDone, m_peakBytes / (1024.0 * 1024.0), m_peakIsBackprop ? L"Backprop" : L"ForwardProp", m_peakNode.c_str());
+    m_numMinibatchesDone++;
+    if (m_numMinibatchesDone == m_numMinibatches)
+        WriteTrace();
+}
+
+// account for the current size of a value or gradient matrix of 'node'
+void MemoryProfiler::UpdateMatrix(const ComputationNodeBasePtr& node, bool gradient, bool isWritten, double time, int thread)
+{
+    const MatrixBase* matrix;
+    size_t bytes = node->GetMatrixBytes(gradient, matrix);
+    if (!matrix)
+        return;
+    size_t& oldBytes = m_matrixBytes[matrix];
+    m_liveBytes += bytes - oldBytes;
+    oldBytes = bytes;
+    if (!isWritten)
+        return;
+
+    // a matrix that served another node before is shared through the MatrixPool
+    wstring owner = gradient ? node->NodeName() + L" (gradient)" : node->NodeName();
+    wstring& oldOwner = m_matrixOwner[matrix];
+    if (!oldOwner.empty() && oldOwner != owner)
+        m_events.push_back(Event{ 'i', owner, oldOwner, m_numMinibatchesDone, thread, time, 0, 0, 0, 0, 0 });
+    oldOwner = owner;
+}
+
+void MemoryProfiler::RecordNode(const ComputationNodeBasePtr& node, bool isBackprop, double startTime)
+{
+    double time = Now();
+    int thread = isBackprop ? 1 : 0;
+
+    // a recurrent loop is reported as a whole
+    vector<ComputationNodeBasePtr> nodes;
+    auto flowControlNode = dynamic_pointer_cast<FlowControlNode>(node);
+    if (flowControlNode)
+        nodes = flowControlNode->GetNestedNodes();
+    else
+        nodes.push_back(node);
+
+    size_t valueBytes = 0, gradientBytes = 0;
+    for (const auto& n : nodes)
+    {
+        // ForwardProp() writes the value; Backprop() writes the gradients of the inputs
+        UpdateMatrix(n, /*gradient=*/false, /*isWritten=*/!isBackprop, time, thread);
+        UpdateMatrix(n, /*gradient=*/true, /*isWritten=*/false, time, thread);
+        if (isBackprop)
+        {
+            for (const auto& input : n->GetInputs())
+                UpdateMatrix(input, /*gradient=*/true, /*isWritten=*/input->NeedsGradient(), time, thread);
+        }
+        const MatrixBase* matrix;
+        valueBytes += n->GetMatrixBytes(/*gradient=*/false, matrix);
+        gradientBytes += n->GetMatrixBytes(/*gradient=*/true, matrix);
+    }
+
+    size_t deviceBytes = m_deviceId >= 0 ? GPUWatcher::GetUsedMemoryOnCUDADevice(m_deviceId) : 0;
+    m_events.push_back(Event{ 'X', node->NodeName(), wstring(), m_numMinibatchesDone, thread, startTime, time - startTime, valueBytes, gradientBytes, m_liveBytes, deviceBytes });
+    m_events.push_back(Event{ 'C', L"memory", wstring(), m_numMinibatchesDone, 0, time, 0, 0, 0, m_liveBytes, deviceBytes });
+
+    if (m_liveBytes >= m_peakBytes)
+    {
+        m_peakBytes = m_liveBytes;
+        m_peakNode = node->NodeName();
+        m_peakIsBackprop = isBackprop;
+    }
+}
+
+// JSON string with quotes
+static string JsonString(const wstring& s)
+{
+    string result = "\"";
+    for (char c : msra::strfun::utf8(s))
+    {
+        if (c == '"' || c == '\\')
+            result += '\\';
+        if ((unsigned char) c < 0x20)
+            c = ' ';
+        result += c;
+    }
+    return result + "\"";
+}
+
+void MemoryProfiler::WriteTrace()
+{
+    m_isWritten = true;
+    FILE* f = fopenOrDie(m_fileName, L"w");
+    fprintf(f, "{\"traceEvents\":[\n");
+    size_t numMinibatches = 0; // including an incomplete one
+    for (const auto& e : m_events)
+        numMinibatches = max(numMinibatches, e.m_minibatch + 1);
+    for (size_t i = 0; i < numMinibatches; i++)
+    {
+        fprintf(f, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"minibatch %d\"}},\n", i > 0 ? ",\n" : "", (int) i, (int) i);
+        fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"ForwardProp\"}},\n", (int) i);
+        fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":1,\"args\":{\"name\":\"Backprop\"}}", (int) i);
+    }
+    for (const auto& e : m_events) // (after the metadata of their minibatch)
+    {
+        fprintf(f, ",\n{\"name\":%s,\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,", JsonString(e.m_name).c_str(), e.m_phase, (int) e.m_minibatch, e.m_thread, e.m_time);
+        if (e.m_phase == 'X')
+            fprintf(f, "\"dur\":%.3f,\"args\":{\"value bytes\":%llu,\"gradient bytes\":%llu,\"live bytes\":%llu,\"device bytes\":%llu}}",
+                    e.m_duration, (unsigned long long) e.m_valueBytes, (unsigned long long) e.m_gradientBytes, (unsigned long long) e.m_liveBytes, (unsigned long long) e.m_deviceBytes);
+        else if (e.m_phase == 'C')
+            fprintf(f, "\"args\":{\"live MB\":%.3f,\"device MB\":%.3f}}", e.m_liveBytes / (1024.0 * 1024.0), e.m_deviceBytes / (1024.0 * 1024.0));
+        else
+            fprintf(f, "\"s\":\"t\",\"args\":{\"previous user\":%s}}", JsonString(e.m_detail).c_str());
+    }
+    fprintf(f, "\n]}\n");
+    fcloseOrDie(f);
+    fprintf(stderr, "MemoryProfiler: Wrote the memory profile of %d minibatches to %ls.\n", (int) numMinibatches, m_fileName.c_str());
+    m_events.clear();
+}
+
+}}}
@@ -0,0 +1,84 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// MemoryProfiler.h -- records the memory that the nodes hold along the evaluation order, as a timeline in Chrome trace format
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "ComputationNode.h"
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// MemoryProfiler -- memory high-water mark of a network, node by node
+//
+// ComputationNetwork::SetMemoryProfiler() makes ForwardProp() and Backprop() report every node of the evaluation order
+// (a recurrent loop counts as one). For each, the profiler records
+//  - the bytes of its value and gradient,
+//  - the bytes held by all matrices seen so far, where matrices shared through the MatrixPool count once,
+//  - the memory in use on the GPU, if the network runs on one,
+//  - which node last used a matrix before, when a node writes into a shared one (MatrixPool reuse).
+// Each minibatch is one process in the trace (chrome://tracing): forward and backward pass are a thread each, the memory is a counter.
+// After 'numMinibatches' minibatches, or when destroyed earlier (e.g. unwinding from an out-of-memory error), the profiler
+// writes the trace and prints the peak of each minibatch, with the node that reached it.
+// Note that on a GPU, the durations only measure launching the kernels.
+// -----------------------------------------------------------------------
+
+class MemoryProfiler
+{
+public:
+    MemoryProfiler(const std::wstring& fileName, size_t numMinibatches, DEVICEID_TYPE deviceId);
+    ~MemoryProfiler(); // writes the trace if not done yet
+
+    bool IsActive() const { return !m_isWritten && m_numMinibatchesDone < m_numMinibatches; }
+
+    void BeginMinibatch();
+    void EndMinibatch(); // writes the trace after the last one
+
+    // time stamp in microseconds, for RecordNode()
+    double Now() const;
+    // 'node' was forward- or backpropagated, starting at 'startTime'
+    void RecordNode(const ComputationNodeBasePtr& node, bool isBackprop, double startTime);
+
+private:
+    struct Event
+    {
+        char m_phase;          // 'X': node, 'C': memory counter, 'i': reuse of a shared matrix
+        std::wstring m_name;
+        std::wstring m_detail; // 'i': node that used the matrix before
+        size_t m_minibatch;
+        int m_thread;          // 0: forward, 1: backward
+        double m_time, m_duration;
+        size_t m_valueBytes, m_gradientBytes, m_liveBytes, m_deviceBytes;
+    };
+
+    void UpdateMatrix(const ComputationNodeBasePtr& node, bool gradient, bool isWritten, double time, int thread);
+    void WriteTrace();
+
+    std::wstring m_fileName;
+    size_t m_numMinibatches;
+    size_t m_numMinibatchesDone;
+    DEVICEID_TYPE m_deviceId;
+    bool m_isWritten;
+    std::chrono::steady_clock::time_point m_startTime;
+
+    std::map<const MatrixBase*, size_t> m_matrixBytes;        // [matrix] bytes last seen
+    std::map<const MatrixBase*, std::wstring> m_matrixOwner;  // [matrix] node that last wrote it
+    size_t m_liveBytes;                                       // sum of m_matrixBytes
+
+    // peak of the current minibatch
+    size_t m_peakBytes;
+    std::wstring m_peakNode;
+    bool m_peakIsBackprop;
+
+    std::vector<Event> m_events;
+};
+
+}}}
@@ -97,6 +97,11 @@ public:
     {
         return opType == binaryWithInputGradient;
     }
+    virtual bool BackpropNeedsOnlySignOfOutput() const override
+    {
+        return opBackward == opElementwiseProductWithLinearRectifierDerivativeFromOutput;
+    }
+    virtual bool CanComputeValueInPlaceOfInput(size_t /*childIndex*/) const override { return true; }
 };
 
 #define UnaryElementWiseWithOpCodeNodeBaseMembers UsingComputationNodeMembersBoilerplate;
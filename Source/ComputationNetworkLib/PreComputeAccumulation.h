@@ -0,0 +1,130 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// PreComputeAccumulation.h -- precomputation (MeanNode, InvStdDevNode) over disjoint parts of the data
+//
+// Every MPI rank accumulates the statistics over its own part of the data; MergePreComputeAccumulations() then merges
+// the accumulations of all ranks (with Chan's parallel variance update, see IPreComputeNode::MergeAccumulations()), so
+// that all ranks end up with the statistics of all the data. The merged accumulations can be kept in a cache file,
+// from which a later run takes them instead of reading the data again, provided it has the same precompute nodes
+// (by name and dimension). All functions are called between MarkComputed(false) and MarkComputed(true).
+//
+
+#pragma once
+
+#include "ComputationNode.h"
+#include "File.h"
+#include "MPIWrapper.h"
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Replaces the accumulations of the nodes by the merge of those of all ranks, with a single allgather. All ranks must
+// call this with the same nodes.
+inline void MergePreComputeAccumulations(const std::list<ComputationNodeBasePtr>& nodes, const MPIWrapperPtr& mpi)
+{
+    std::vector<double> accumulations, gathered;
+    std::vector<size_t> sizes;
+    for (const auto& node : nodes)
+    {
+        std::vector<double> accumulation;
+        dynamic_pointer_cast<IPreComputeNode>(node)->GetAccumulation(accumulation);
+        sizes.push_back(accumulation.size());
+        accumulations.insert(accumulations.end(), accumulation.begin(), accumulation.end());
+    }
+
+    mpi->AllGather(accumulations, gathered);
+    size_t numRanks = mpi->NumNodesInUse();
+    if (gathered.size() != numRanks * accumulations.size())
+        LogicError("MergePreComputeAccumulations: The ranks have different precompute nodes.");
+
+    // merged in rank order, so that all ranks compute the same statistics
+    size_t offset = 0;
+    auto sizeIter = sizes.begin();
+    for (const auto& node : nodes)
+    {
+        std::vector<std::vector<double>> parts;
+        for (size_t rank = 0; rank < numRanks; rank++)
+        {
+            auto begin = gathered.begin() + rank * accumulations.size() + offset;
+            parts.emplace_back(begin, begin + *sizeIter);
+        }
+        dynamic_pointer_cast<IPreComputeNode>(node)->MergeAccumulations(parts);
+        offset += *sizeIter++;
+    }
+}
+
+inline void SavePreComputeCache(const std::wstring& path, const std::list<ComputationNodeBasePtr>& nodes)
+{
+    File::MakeIntermediateDirs(path);
+    File fstream(path, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
+    fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BPreComputeCache");
+    fstream << (size_t) nodes.size();
+    for (const auto& node : nodes)
+    {
+        std::vector<double> accumulation;
+        dynamic_pointer_cast<IPreComputeNode>(node)->GetAccumulation(accumulation);
+        fstream << node->NodeName() << accumulation;
+    }
+    fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EPreComputeCache");
+}
+
+// the accumulations in a cache file, by node name
+typedef std::map<std::wstring, std::vector<double>> PreComputeCache;
+
+// Reads the cache file and checks that it has an accumulation of the right dimension for each of the nodes; if not,
+// the reason is returned in 'whyNot'. ApplyPreComputeCache() then sets the nodes from it.
+inline bool ReadPreComputeCache(const std::wstring& path, const std::list<ComputationNodeBasePtr>& nodes, PreComputeCache& cached, std::string& whyNot)
+{
+    if (!File::Exists(path))
+    {
+        whyNot = "the file does not exist";
+        return false;
+    }
+
+    try
+    {
+        cached.clear();
+        File fstream(path, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+        fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BPreComputeCache");
+        size_t numNodes;
+        fstream >> numNodes;
+        for (size_t i = 0; i < numNodes; i++)
+        {
+            std::wstring name;
+            fstream >> name;
+            fstream >> cached[name];
+        }
+        fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EPreComputeCache");
+    }
+    catch (const std::exception& e)
+    {
+        whyNot = std::string("it cannot be read: ") + e.what();
+        return false;
+    }
+
+    for (const auto& node : nodes)
+    {
+        auto iter = cached.find(node->NodeName());
+        std::vector<double> accumulation;
+        dynamic_pointer_cast<IPreComputeNode>(node)->GetAccumulation(accumulation);
+        if (iter == cached.end() || iter->second.size() != accumulation.size())
+        {
+            whyNot = "it does not match the precompute node " + msra::strfun::utf8(node->NodeName());
+            return false;
+        }
+    }
+    return true;
+}
+
+inline void ApplyPreComputeCache(const std::list<ComputationNodeBasePtr>& nodes, const PreComputeCache& cached)
+{
+    for (const auto& node : nodes)
+        dynamic_pointer_cast<IPreComputeNode>(node)->MergeAccumulations({ cached.at(node->NodeName()) });
+}
+
+}}}
@@ -192,6 +192,61 @@ public:
 protected:
     size_t m_numSamples; // (SIZE_MAX while outside accumulation state)
     bool IsAccumulating() const { return m_numSamples != SIZE_MAX; }
+
+    // An accumulation is laid out as the number of samples, the mean and, if 'withVariance', the (population) variance.
+    void GetMeanAndVarianceAccumulation(const Matrix<ElemType>& mean, const Matrix<ElemType>* var, std::vector<double>& accumulation) const
+    {
+        if (!IsAccumulating())
+            LogicError("%ls %ls operation: GetAccumulation() called while not accumulating.", NodeName().c_str(), OperationName().c_str());
+        accumulation.assign(1, (double) m_numSamples);
+        for (auto matrix : { &mean, var })
+        {
+            if (!matrix)
+                continue;
+            std::unique_ptr<ElemType[]> data(matrix->CopyToArray());
+            accumulation.insert(accumulation.end(), data.get(), data.get() + matrix->GetNumElements());
+        }
+    }
+
+    // Chan et al.'s parallel update: the mean and variance of the union of disjoint parts of the data from those of the parts
+    void MergeMeansAndVariances(const std::vector<std::vector<double>>& accumulations, Matrix<ElemType>& mean, Matrix<ElemType>* var)
+    {
+        if (!IsAccumulating())
+            LogicError("%ls %ls operation: MergeAccumulations() called while not accumulating.", NodeName().c_str(), OperationName().c_str());
+        size_t dim = mean.GetNumElements();
+        double numSamples = 0;
+        std::vector<double> mergedMean(dim, 0), mergedVar(var ? dim : 0, 0);
+        for (const auto& accumulation : accumulations)
+        {
+            if (accumulation.size() != 1 + dim + mergedVar.size())
+                LogicError("%ls %ls operation: MergeAccumulations() got an accumulation of a different dimension.", NodeName().c_str(), OperationName().c_str());
+            double partNumSamples = accumulation[0];
+            if (partNumSamples == 0)
+                continue;
+            double totalNumSamples = numSamples + partNumSamples;
+            for (size_t i = 0; i < dim; i++)
+            {
+                double delta = accumulation[1 + i] - mergedMean[i];
+                mergedMean[i] += delta * partNumSamples / totalNumSamples;
+                if (var)
+                    mergedVar[i] = (numSamples * mergedVar[i] + partNumSamples * accumulation[1 + dim + i]) / totalNumSamples
+                                 + delta * delta * numSamples * partNumSamples / (totalNumSamples * totalNumSamples);
+            }
+            numSamples = totalNumSamples;
+        }
+
+        m_numSamples = (size_t) numSamples;
+        SetFromAccumulation(mergedMean, mean);
+        if (var)
+            SetFromAccumulation(mergedVar, *var);
+    }
+
+private:
+    static void SetFromAccumulation(const std::vector<double>& values, Matrix<ElemType>& matrix)
+    {
+        std::vector<ElemType> data(values.begin(), values.end());
+        matrix.SetValue(matrix.GetNumRows(), matrix.GetNumCols(), matrix.GetDeviceId(), data.data());
+    }
 };
 
 #define UsingMeanInvStdDevNodeBaseNodeMembers \
@@ -232,6 +287,16 @@ public:
         // no else branch because ForwardPropNonLooping() already leaves a valid mean in m_value
     }
 
+    virtual void /*IPreComputeNode::*/ GetAccumulation(std::vector<double>& accumulation) const override
+    {
+        Base::GetMeanAndVarianceAccumulation(Value(), nullptr, accumulation);
+    }
+
+    virtual void /*IPreComputeNode::*/ MergeAccumulations(const std::vector<std::vector<double>>& accumulations) override
+    {
+        Base::MergeMeansAndVariances(accumulations, Value(), nullptr);
+    }
+
     virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
     {
         FrameRange fr(InputRef(0).GetMBLayout());
@@ -313,6 +378,16 @@ public:
         }
     }
 
+    virtual void /*IPreComputeNode::*/ GetAccumulation(std::vector<double>& accumulation) const override
+    {
+        Base::GetMeanAndVarianceAccumulation(*m_mean, m_var.get(), accumulation);
+    }
+
+    virtual void /*IPreComputeNode::*/ MergeAccumulations(const std::vector<std::vector<double>>& accumulations) override
+    {
+        Base::MergeMeansAndVariances(accumulations, *m_mean, m_var.get());
+    }
+
     virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
     {
         FrameRange fr(InputRef(0).GetMBLayout());
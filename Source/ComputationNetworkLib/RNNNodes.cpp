@@ -23,7 +23,6 @@
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
-vector<size_t> numSequencesForFrame;
 // -----------------------------------------------------------------------
 // OptimizedRNNStackNode
 // -----------------------------------------------------------------------
@@ -123,8 +122,8 @@ void OptimizedRNNStackNode<ElemType>::ForwardProp(const FrameRange& fr)
         shapeYT = TensorShape(shapeYT.GetDims());
 
         // create a vector with the correct number of timesteps(shapeXT[2]) containing the sequence count (shapeXT[1])
-        numSequencesForFrame = vector<size_t>(shapeXT[2], shapeXT[1]);
-        m_transposedOutput->RNNForward(*m_transposedInput, paramW, shapeXT[0], shapeYT[0], numSequencesForFrame, m_rnnAttributes, *m_reserve, *m_workspace);
+        m_numSequencesForFrame = vector<size_t>(shapeXT[2], shapeXT[1]);
+        m_transposedOutput->RNNForward(*m_transposedInput, paramW, shapeXT[0], shapeYT[0], m_numSequencesForFrame, m_rnnAttributes, *m_reserve, *m_workspace);
 
         // No one uses shapeY, but it is necessary
         TensorShape shapeY;
@@ -139,12 +138,12 @@ void OptimizedRNNStackNode<ElemType>::ForwardProp(const FrameRange& fr)
         shapeYT = TensorShape(          GetTensorSliceFor(SIZE_MAX, fr));
 
         // This changes the data from "minibatch paking" in InputRef(0).Value() to "dense CuDNN packing" in m_transposedInput
-        this->PackSequencesForCuDNN(InputRef(1).Value(), *m_transposedInput, numSequencesForFrame);
+        this->PackSequencesForCuDNN(InputRef(1).Value(), *m_transposedInput, m_numSequencesForFrame);
 
         // ensure enough storage
         m_transposedOutput->Resize(this->Value().GetNumRows(), m_transposedInput->GetNumCols());
 
-        m_transposedOutput->RNNForward(*m_transposedInput, paramW, shapeXT[0], shapeYT[0], numSequencesForFrame, m_rnnAttributes, *m_reserve, *m_workspace);
+        m_transposedOutput->RNNForward(*m_transposedInput, paramW, shapeXT[0], shapeYT[0], m_numSequencesForFrame, m_rnnAttributes, *m_reserve, *m_workspace);
         this->UnpackSequencesFromCuDNN(*m_transposedOutput, this->Value());
     }
     m_BackwardDataCalledYet = false;
@@ -302,23 +301,23 @@ void OptimizedRNNStackNode<ElemType>::PackSequencesForCuDNN(const Matrix<ElemTyp
     numSequencesForFrame.resize(maxSeqLength);
     fill(numSequencesForFrame.begin(), numSequencesForFrame.end(), 0L);
 
-    // make sure the index is on CPU so we can use SetValue()
-    // 
-    m_packingIndex->TransferToDeviceIfNotThere(-1, true/*isBeingMoved*/, false/*emptyTransfer*/, false/*updatePreferredDevice*/);
-
-    // Reserve one element for every valid sample. DoGatherColumnsOf() requires it to be a row vector
-    m_packingIndex->Resize(1, mb->GetActualNumSamples());
-
-    size_t dst_frame = 0;
+    // The sequences are packed frame by frame, longest first, so that frame fr holds only the sequences that are still
+    // running, and CuDNN never computes the padding of the shorter ones. The index is built on the host and uploaded
+    // in one go; it has exactly one entry per packed sample (fewer than GetActualNumSamples() if maxSeqLength was cut).
+    m_packingIndexHost.clear();
     for (size_t fr = 0; fr < maxSeqLength; fr++)
     {
         for (size_t j = 0; j < numSequences && seq[sequenceOrder[j]].GetNumTimeSteps()>fr; j++)
         {
-            m_packingIndex->SetValue(0, dst_frame++, (ElemType)mb->GetColumnIndex(seq[sequenceOrder[j]], fr));
+            m_packingIndexHost.push_back((ElemType)mb->GetColumnIndex(seq[sequenceOrder[j]], fr));
             numSequencesForFrame[fr]++;
         }
     }
 
+    // DoGatherColumnsOf() requires the index to be a row vector
+    m_packingIndex->TransferToDeviceIfNotThere(src.GetDeviceId(), true/*isBeingMoved*/, true/*emptyTransfer*/, false/*updatePreferredDevice*/);
+    m_packingIndex->SetValue(1, m_packingIndexHost.size(), src.GetDeviceId(), m_packingIndexHost.data());
+
     // this->gather(beta,idx,a,alpha) operation is defined as
     // *this[:,j] = a[:,idx[j]] * alpha + *this[:,j] * beta
     dst.DoGatherColumnsOf(0.0, *(this->m_packingIndex), src, 1.0);
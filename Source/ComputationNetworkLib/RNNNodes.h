@@ -95,6 +95,8 @@ protected:
     shared_ptr<Matrix<ElemType>> m_workspace;
     shared_ptr<Matrix<ElemType>> m_reserve;
     shared_ptr<Matrix<ElemType>> m_packingIndex;
+    vector<ElemType> m_packingIndexHost;     // host copy of m_packingIndex, kept to avoid reallocating it
+    vector<size_t> m_numSequencesForFrame;   // [t] number of sequences packed for frame t, longest first
 
 private:
     void TransposeHelper(const MatrixBasePtr matX, const TensorShape &shapeX, MatrixBasePtr matY, TensorShape &shapeY);
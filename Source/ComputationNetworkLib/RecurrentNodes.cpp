@@ -31,7 +31,8 @@ DelayedValueNodeBase<ElemType, direction>::DelayedValueNodeBase(DEVICEID_TYPE de
     m_initialStateValueMatrix(make_shared<Matrix<ElemType>>(deviceId)),
     m_inputInvalidMatrix(make_shared<Matrix<ElemType>>(deviceId)),
     m_zeroMatrix(make_shared<Matrix<ElemType>>(deviceId)),
-    m_delayedValue(make_shared<Matrix<ElemType>>(deviceId))
+    m_delayedValue(make_shared<Matrix<ElemType>>(deviceId)),
+    m_keepWholeInput(false)
 {
     m_initialStateValue = initialState;
     m_timeStep = 1;
@@ -55,6 +56,7 @@ template<class ElemType, int direction>
         node->m_initialStateValue = m_initialStateValue;
         node->m_initialStateValueMatrix->SetValue(m_initialStateValue);
         node->m_delayedValue->SetValue(*m_delayedValue);
+        node->m_keepWholeInput = m_keepWholeInput;
         if (m_delayedActivationMBLayout)
             (node->m_delayedActivationMBLayout = make_shared<MBLayout>())->CopyFrom(m_delayedActivationMBLayout);
         else
@@ -324,18 +326,40 @@ template<class ElemType, int direction>
 /*virtual*/ void DelayedValueNodeBase<ElemType,direction>::EndForwardProp() /*override*/ // called after last iteration step of ForwardProp()
 {
     // In truncated BPTT, we carry over left-to-right state across minibatches.
-    // It is kept in m_delayedValue, m_delayedActivationMBLayout.
-    // This could be optimized as follows:
-    //  - only keep the required number of frames (m_timeStep)
-    //  - we don't need to keep anything in full-sequence mode
-    //  - we don't need to keep anything if all sequences are closed (sentence end)
-    //    This condition includes full-sequence mode.
-    // TODO: Can we optimize this and only copy if there is a sequence spanning across the end of the MB? And add a check to BeginForwardProp() to make sure we got one if there is a boundary at the start?
-    m_delayedValue->SetValue(InputRef(0).Value());
+    // It is kept in m_delayedValue, m_delayedActivationMBLayout: only the required number of frames (m_timeStep),
+    // and nothing if all sequences are closed (sentence end), which includes full-sequence mode.
     if (!m_delayedActivationMBLayout)
         m_delayedActivationMBLayout = make_shared<MBLayout>();
-    m_delayedActivationMBLayout->CopyFrom(m_pMBLayout);
-    // Perf BUGBUG: ^^ This copies a matrix from CPU to GPU at each MB; we should short-circuit it
+    int dir = direction; // (this avoids a 'conditional expression is constant' warning)
+    if (dir > 0 || m_keepWholeInput)
+    {
+        m_delayedValue->SetValue(InputRef(0).Value());
+        m_delayedActivationMBLayout->CopyFrom(m_pMBLayout);
+        // ^^ The validity mask is only copied when the structure of the layout changes (see MBLayout::CopyFrom())
+    }
+    else if (!m_pMBLayout->HasSequenceBeyondEnd())
+    {
+        // nothing is carried over: the next minibatch starts new sequences only (e.g. in full-sequence mode)
+        m_delayedValue->Resize(InputRef(0).Value().GetNumRows(), 0);
+        m_delayedActivationMBLayout->CopyFrom(m_pMBLayout);
+    }
+    else
+    {
+        // The next minibatch reads at most the last m_timeStep frames. They are kept as a minibatch of their own, with
+        // the tail of the layout, in one copy of a contiguous column range. (The input buffer itself is planned by the
+        // MatrixPool for this pass only, and may be assigned to other nodes before the next minibatch reads it.)
+        const size_t numTimeSteps = m_pMBLayout->GetNumTimeSteps();
+        const size_t numParallelSequences = m_pMBLayout->GetNumParallelSequences();
+        const size_t numKept = min((size_t)m_timeStep, numTimeSteps);
+        const size_t firstKept = numTimeSteps - numKept;
+        m_delayedValue->SetValue(InputRef(0).Value().ColumnSlice(firstKept * numParallelSequences, numKept * numParallelSequences));
+        m_delayedActivationMBLayout->Init(numParallelSequences, numKept);
+        for (const auto& seq : m_pMBLayout->GetAllSequences())
+        {
+            if (seq.tEnd > firstKept)
+                m_delayedActivationMBLayout->AddSequence(seq.seqId, seq.s, seq.tBegin - (ptrdiff_t)firstKept, seq.tEnd - firstKept);
+        }
+    }
 
     Base::EndForwardProp();
 }
@@ -438,8 +462,9 @@ template<class ElemType, int direction>
         }
         else
         {
+            // the last frame of what EndForwardProp() kept
             auto pState = make_shared<DelayedValueNodeState<ElemType>>(m_deviceId);
-            pState->CacheState(m_delayedValue->ColumnSlice((nT - 1) * nU, nU));
+            pState->CacheState(m_delayedValue->ColumnSlice((m_delayedActivationMBLayout->GetNumTimeSteps() - 1) * nU, nU));
             pState->CacheDelayedMBLayout(m_delayedActivationMBLayout);
             pExportedState = pState;
         }
@@ -69,6 +69,7 @@ public:
     virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override;
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
     virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+    virtual bool CanRecomputeValue() const override { return false; } // ForwardProp() carries state across minibatches
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override;
     virtual int /*IRecurrentNode::*/ GetRecurrenceSteppingDirection() const override { return -direction; }
     virtual NodeStatePtr /*IStatefulNode::*/ ExportState() override;
@@ -76,6 +77,19 @@ public:
     int TimeStep() const { return m_timeStep; }
     ElemType InitialActivationValue() const { return m_initialStateValue; }
 
+    // explicit state for streaming evaluation (CNTKEvalExtended::ForwardPassStreams()): the frames that precede the
+    // next minibatch, as if they were a previous one with layout 'pMBLayout'; after a minibatch, DelayedValue() is its input
+    // (otherwise, it is only what truncated BPTT needs of it, see EndForwardProp())
+    void SetDelayedValue(const Matrix<ElemType>& value, const MBLayoutPtr& pMBLayout)
+    {
+        m_keepWholeInput = true;
+        m_delayedValue->SetValue(value);
+        if (!m_delayedActivationMBLayout)
+            m_delayedActivationMBLayout = make_shared<MBLayout>();
+        m_delayedActivationMBLayout->CopyFrom(pMBLayout);
+    }
+    const Matrix<ElemType>& DelayedValue() const { return *m_delayedValue; }
+
 protected:
     ElemType m_initialStateValue;                           // starting value for hidden activation vector at boundary
     int m_timeStep;                                         // delay in frames (typ. 1)
@@ -91,6 +105,7 @@ protected:
 
     shared_ptr<Matrix<ElemType>> m_delayedValue;            // saves the activation of the previous step that this node points to
     MBLayoutPtr m_delayedActivationMBLayout;                // layout for m_delayedValue
+    bool m_keepWholeInput;                                  // m_delayedValue is the whole input of the last minibatch (set by SetDelayedValue())
 };
 
 #define UsingDelayedValueNodeMembers        \
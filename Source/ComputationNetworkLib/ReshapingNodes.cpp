@@ -242,6 +242,10 @@ template <class ElemType>
     let& inMBLayout = InputRef(0).GetMBLayout();
     let& input = InputRef(0).Value();
     let& sequences = inMBLayout->GetAllSequences();
+    // The new MBLayout depends on the values, which is the one transfer to the host: of the condition row, in one piece.
+    auto& condition = m_conditionBuffer;
+    condition.resize(input.GetNumCols());
+    input.CopySection(1, input.GetNumCols(), condition.data(), 1);
     auto& indexSequences = m_indexSequenceBuffer;
     if (indexSequences.size() < sequences.size())
         indexSequences.resize(sequences.size());
@@ -253,11 +257,9 @@ template <class ElemType>
         auto& indexSequence = indexSequences[i];
         indexSequence.clear();
         for (size_t t = 0; t < seq.GetNumTimeSteps(); t++)
-            if (input(0, inMBLayout->GetColumnIndex(seq, t))) // this is the condition check that this node performs; the meat
+            if (condition[inMBLayout->GetColumnIndex(seq, t)]) // this is the condition check that this node performs; the meat
                 indexSequence.push_back(t);
-        // Note: The above accesses m_value directly on the CPU, putting it into BOTH state, possibly for other consumers as well.
     }
-    input.CollapseDataLocation(); // BUGBUG: Move back, since BOTH state is broken at present.
     // create a new MBLayout
     let& outMBLayout = GetMBLayout();
     outMBLayout->InitAsPackedSequences(SequenceLengthVector(sequences, indexSequences), /*temp*/m_placementBuffer, /*temp*/m_rowAllocationsBuffer);
@@ -278,9 +280,9 @@ template <class ElemType>
         assert(sequences[i].seqId == GAP_SEQUENCE_ID);
     for (size_t i = size; i < outMBLayout->GetAllSequences().size(); i++)
         assert(outMBLayout->GetAllSequences()[i].seqId == GAP_SEQUENCE_ID);
-    // the result will be kept in CPUDEVICE, since most likely we will access it again in PackedIndexNode
-    Value().TransferToDeviceIfNotThere(CPUDEVICE, /*isBeingMoved=*/ true, /*emptyTransfer=*/ true, /*updatePreferredDevice=*/ true);
-    Value().SetValue(1, outMBLayout->GetNumCols(), CPUDEVICE, buf.data(), MatrixFormat::matrixFormatColMajor);
+    // the result is kept on our device, where PackedIndexNode maps it
+    Value().TransferToDeviceIfNotThere(m_deviceId, /*isBeingMoved=*/ true, /*emptyTransfer=*/ true, /*updatePreferredDevice=*/ true);
+    Value().SetValue(1, outMBLayout->GetNumCols(), m_deviceId, buf.data(), MatrixFormat::matrixFormatColMajor);
 }
 
 template <class ElemType>
@@ -322,26 +324,32 @@ template <class ElemType>
     let& indexMBLayout  = InputRef(INDEXDATA).GetMBLayout();
     let&  index  = InputRef(INDEXDATA).Value(); // per-seq index values that are to be mapped
     auto& result =                   Value(); // packed index values as mapped to sourceData's layout
-    // loop over sourceSequences
     // Input matrix contains time indices for each sequence that refer to frames inside that sequence.
-    // We replace every per-sequence index by the resolved column index w.r.t. the same MBLayout.
-    let& sourceSequences = sourceMBLayout->GetAllSequences();
-    for (size_t i = 0; i < sourceSequences.size(); i++)
+    // We replace every per-sequence index by the resolved column index w.r.t. the source MBLayout.
+    // The values stay on the device: from the layouts alone, we determine for each index column the column of time 0
+    // of its source sequence and the time range of it inside the minibatch, and the mapping is a single kernel.
+    // Indices out of that range become gaps (-1), since they are not seen on the host.
+    let numParallelSequences = sourceMBLayout->GetNumParallelSequences();
+    let numSourceTimeSteps = (ptrdiff_t)sourceMBLayout->GetNumTimeSteps();
+    auto& ranges = m_rangesBuffer;
+    ranges.assign(3 * indexMBLayout->GetNumCols(), 0); // gaps get an empty range
+    for (let& sourceSeq : sourceMBLayout->GetAllSequences())
     {
-        let& sourceSeq = sourceSequences[i];
         if (sourceSeq.seqId == GAP_SEQUENCE_ID)
             continue;
         let& indexSeq = indexMBLayout->FindSequence(sourceSeq.seqId);          // find corresponding entry in indexMBLayout
+        let tBegin = max((ptrdiff_t)0, -sourceSeq.tBegin);                    // the time range of the source sequence in the minibatch
+        let tEnd = min((ptrdiff_t)sourceSeq.GetNumTimeSteps(), numSourceTimeSteps - sourceSeq.tBegin);
         for (size_t tIndex = 0; tIndex < indexSeq.GetNumTimeSteps(); tIndex++) // map all index values in index sequence
         {
-            let jIndex  = indexMBLayout->GetColumnIndex(indexSeq, tIndex);    // map time index to actual location in the matrix storage object
-            let tSource = (size_t)index(0, jIndex);                           // the new time location (relative to source sequence)
-            let jSource = sourceMBLayout->GetColumnIndex(sourceSeq, tSource); // map new time index as well. This performs a range check.
-            result(0, jIndex) = (ElemType)jSource;
+            let jIndex = indexMBLayout->GetColumnIndex(indexSeq, tIndex);     // map time index to actual location in the matrix storage object
+            ranges[3 * jIndex]     = (ElemType)(sourceSeq.tBegin * (ptrdiff_t)numParallelSequences + (ptrdiff_t)sourceSeq.s);
+            ranges[3 * jIndex + 1] = (ElemType)tBegin;
+            ranges[3 * jIndex + 2] = (ElemType)tEnd;
         }
     }
-    // Note: maybe this is no longer needed, now that we do the same inside UpdateFunctionValueSize() for all nodes.
-    result.CollapseDataLocation(); // BUGBUG: Move back, since BOTH state is broken at present.
+    m_ranges->SetValue(3, indexMBLayout->GetNumCols(), m_deviceId, ranges.data(), matrixFlagNormal);
+    result.AssignPackedIndicesOf(index, *m_ranges, numParallelSequences);
 }
 
 template <class ElemType>
@@ -431,6 +439,69 @@ template <class ElemType>
 template class GatherPackedNode<float>;
 template class GatherPackedNode<double>;
 
+// -----------------------------------------------------------------------
+// ContextWindowNode(input, leftContext, rightContext) -- splice each frame with its neighbors
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+/*virtual*/ void ContextWindowNode<ElemType>::ForwardPropNonLooping() /*override*/
+{
+    // The output, seen as a [inputDim x (#columns * window size)] matrix, is a gather of input columns:
+    // column (j * window size + k) is the input column of frame t - leftContext + k of the sequence of column j,
+    // clipped to the frames of the sequence that are in the minibatch.
+    let& layout = InputRef(0).GetMBLayout();
+    let numParallelSequences = (ptrdiff_t)layout->GetNumParallelSequences();
+    let window = GetWindowSize();
+    auto& columnMap = m_columnMapBuffer;
+    columnMap.assign(layout->GetNumCols() * window, (ElemType)-1); // gaps remain -1
+    for (let& seq : layout->GetAllSequences())
+    {
+        if (seq.seqId == GAP_SEQUENCE_ID)
+            continue;
+        let tBegin = max(seq.tBegin, (ptrdiff_t)0);
+        let tEnd = (ptrdiff_t)min(seq.tEnd, layout->GetNumTimeSteps());
+        for (ptrdiff_t t = tBegin; t < tEnd; t++)
+        {
+            let j = (t * numParallelSequences + (ptrdiff_t)seq.s) * window;
+            for (size_t k = 0; k < window; k++)
+            {
+                let tContext = min(max(t + (ptrdiff_t)k - (ptrdiff_t)m_leftContext, tBegin), tEnd - 1);
+                columnMap[j + k] = (ElemType)(tContext * numParallelSequences + (ptrdiff_t)seq.s);
+            }
+        }
+    }
+    m_columnMap->SetValue(1, columnMap.size(), m_deviceId, columnMap.data(), matrixFlagNormal);
+
+    let& input = InputRef(0).ValueAsMatrix();
+    auto splicedFrames = ValueAsMatrix().Reshaped(input.GetNumRows(), input.GetNumCols() * window);
+    splicedFrames.DoGatherColumnsOf(/*beta=*/0, *m_columnMap, input, /*alpha=*/1);
+}
+
+template <class ElemType>
+/*virtual*/ void ContextWindowNode<ElemType>::BackpropToNonLooping(size_t /*inputIndex*/) /*override*/
+{
+    // every input frame receives the sum of the gradients of all positions it was spliced into (frames at the
+    // sequence boundaries more than once)
+    auto& inputGradient = InputRef(0).GradientAsMatrix();
+    let splicedGradient = GradientAsMatrix().Reshaped(inputGradient.GetNumRows(), inputGradient.GetNumCols() * GetWindowSize());
+    inputGradient.DoScatterColumnsOf(/*beta=*/1, *m_columnMap, splicedGradient, /*alpha=*/1);
+}
+
+template <class ElemType>
+/*virtual*/ void ContextWindowNode<ElemType>::Validate(bool isFinalValidationPass) /*override*/
+{
+    Base::Validate(isFinalValidationPass);
+    InferMBLayoutFromInputsForStandardCase(isFinalValidationPass);
+    if (isFinalValidationPass && !HasMBLayout())
+        InvalidArgument("%ls requires its input to be a sequence (have a time dimension).", NodeDescription().c_str());
+
+    // the spliced frames are stacked into a vector, like the features of the readers with a context window
+    SetDims(TensorShape(GetInputSampleLayout(0).GetNumElements() * GetWindowSize()), HasMBLayout());
+}
+
+template class ContextWindowNode<float>;
+template class ContextWindowNode<double>;
+
 // -----------------------------------------------------------------------
 // ScatterPackedNode(layoutData, packedIndex, sourceData) -- scatter operation
 // -----------------------------------------------------------------------
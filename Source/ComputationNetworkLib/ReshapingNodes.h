@@ -635,6 +635,89 @@ private:
 template class RowRepeatNode<float>;
 template class RowRepeatNode<double>;
 
+// -----------------------------------------------------------------------
+// ContextWindowNode (input, leftContext, rightContext) -- splice each frame with its neighbors
+// Each output column is the stack of the input columns t-leftContext..t+rightContext of the same sequence, where
+// frames beyond the sequence boundaries repeat the first or last frame; this is the context window of the HTK readers
+// (contextWindow), done on the device, so that the reader only needs to deliver the raw frames.
+// It works on whole sequences, that is, not with frameMode=true; with truncated sequences, the context is limited to
+// the frames of the minibatch.
+// The splicing is a single gather with a column map that is computed from the MBLayout; the gradient is scattered back.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class ContextWindowNode : public ComputationNodeNonLooping<ElemType>, public NumInputs<1>
+{
+    typedef ComputationNodeNonLooping<ElemType> Base; UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"ContextWindow"; }
+
+public:
+    ContextWindowNode(DEVICEID_TYPE deviceId, const wstring& name, size_t leftContext = 0, size_t rightContext = 0)
+        : Base(deviceId, name),
+          m_leftContext(leftContext), m_rightContext(rightContext)
+    {
+    }
+    ContextWindowNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : ContextWindowNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"leftContext"), configp->Get(L"rightContext"))
+    {
+        AttachInputsFromConfig(configp, this->GetExpectedNumInputs());
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<ContextWindowNode<ElemType>>(nodeP);
+            node->m_leftContext = m_leftContext;
+            node->m_rightContext = m_rightContext;
+        }
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_leftContext << m_rightContext;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        fstream >> m_leftContext >> m_rightContext;
+    }
+
+    virtual std::string FormatOperationPrototype(const std::string& extraArgs) const override
+    {
+        return Base::FormatOperationPrototype(extraArgs + msra::strfun::strprintf(", leftContext=%lu, rightContext=%lu", m_leftContext, m_rightContext));
+    }
+
+    virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override;
+    virtual void /*ComputationNodeNonLooping::*/ BackpropToNonLooping(size_t inputIndex) override;
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+    virtual void Validate(bool isFinalValidationPass) override;
+
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        RequestMatrixFromPool(m_columnMap, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_columnMap, matrixPool);
+    }
+
+private:
+    size_t GetWindowSize() const { return 1 + m_leftContext + m_rightContext; }
+
+    size_t m_leftContext;
+    size_t m_rightContext;
+    shared_ptr<Matrix<ElemType>> m_columnMap;  // [1 x (#columns * window size)] input column of each spliced frame, -1 for gaps
+    std::vector<ElemType> m_columnMapBuffer;   // host side of m_columnMap
+};
+
 // -----------------------------------------------------------------------
 // WhereNode(cond) -- extract indices of non-0 values in a sequence
 // As this implies a runtime-value dependent reduction in dimension, it can
@@ -698,6 +781,7 @@ private:
     std::vector<std::vector<size_t>>   m_indexSequenceBuffer; // [sequenceIndex][t] for creating the result sequences
     std::vector<size_t>               m_rowAllocationsBuffer; // [row] for determining new MBLayout packing
     std::vector<std::pair<size_t, size_t>> m_placementBuffer; // [sequenceIndex] assigned location for a sequence
+    std::vector<ElemType>                  m_conditionBuffer; // [column] host copy of the input
     std::wstring m_dynamicAxisName;
 };
 
@@ -734,6 +818,22 @@ public:
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
     virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
     virtual void Validate(bool isFinalValidationPass) override;
+
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        RequestMatrixFromPool(m_ranges, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterForwardProp(matrixPool);
+        ReleaseMatrixToPool(m_ranges, matrixPool);
+    }
+
+private:
+    shared_ptr<Matrix<ElemType>> m_ranges; // [3 x #columns] per index column: column of time 0 of its source sequence, and its time range in the minibatch
+    std::vector<ElemType> m_rangesBuffer;  // host side of m_ranges
 };
 
 // -----------------------------------------------------------------------
@@ -765,4 +765,61 @@ public:
 template class DummyCriterionNode<float>;
 template class DummyCriterionNode<double>;
 
+// -----------------------------------------------------------------------
+// DeviceCopyNode (input) -- copy of the input on the device of this node
+// ComputationNetwork::SetNodeDevices() places nodes on other devices; CompileNetwork() then puts these nodes in place
+// where an input lives on another device than its consumer, so that each node only touches matrices on its own device.
+// The value is copied in ForwardProp(), and the gradient is copied back and added to that of the input in BackpropTo().
+// Copies between GPUs go peer-to-peer where possible. Only dense values are supported; place a sparse input on the
+// device of its consumers instead.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class DeviceCopyNode : public ComputationNode<ElemType>, public NumInputs<1>
+{
+    typedef ComputationNode<ElemType> Base; UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"DeviceCopy"; }
+
+public:
+    DeclareConstructorFromConfigWithNumInputs(DeviceCopyNode);
+    DeviceCopyNode(DEVICEID_TYPE deviceId, const wstring& name)
+        : Base(deviceId, name)
+    {
+    }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        auto input = InputRef(0).ValueFor(fr);
+        if (input.GetMatrixType() != DENSE)
+            RuntimeError("%ls: Only dense values can be copied to another device; place %ls on device %d instead.",
+                         NodeDescription().c_str(), Input(0)->NodeDescription().c_str(), (int) m_deviceId);
+        ValueFor(fr).AssignValuesOf(input);
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t /*inputIndex*/, const FrameRange& fr) override
+    {
+        auto inputGradient = InputRef(0).GradientFor(fr);
+        if (!m_inputGradient || m_inputGradient->GetDeviceId() != inputGradient.GetDeviceId())
+            m_inputGradient = make_shared<Matrix<ElemType>>(inputGradient.GetDeviceId());
+        m_inputGradient->AssignValuesOf(GradientFor(fr));
+        Matrix<ElemType>::ScaleAndAdd(1, *m_inputGradient, inputGradient);
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+    virtual bool AcceptsInputsFromOtherDevices() const override { return true; }
+    virtual bool CanBeCapturedInGPUGraph() const override { return false; } // copies between devices
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        ValidateUnaryMap(isFinalValidationPass);
+    }
+
+private:
+    shared_ptr<Matrix<ElemType>> m_inputGradient; // the gradient on the device of the input
+};
+
+template class DeviceCopyNode<float>;
+template class DeviceCopyNode<double>;
+
 } } }
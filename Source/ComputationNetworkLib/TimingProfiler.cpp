@@ -0,0 +1,184 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "Basics.h"
+#include "TimingProfiler.h"
+#include "fileutil.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+TimingProfiler::TimingProfiler(DEVICEID_TYPE deviceId, const wstring& traceFileName, size_t numMinibatchesToTrace)
+    : m_deviceId(deviceId), m_traceFileName(traceFileName), m_numMinibatchesToTrace(traceFileName.empty() ? 0 : numMinibatchesToTrace),
+      m_numMinibatchesDone(0), m_isWritten(false), m_startTime(chrono::steady_clock::now()), m_numMarks(0), m_firstMarkTime(0)
+{
+}
+
+TimingProfiler::~TimingProfiler()
+{
+    if (!m_isWritten && !m_events.empty())
+    {
+        try
+        {
+            WriteTrace();
+        }
+        catch (...) // must not throw from a destructor, which may run while unwinding
+        {
+        }
+    }
+}
+
+// microseconds
+double TimingProfiler::Now() const
+{
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - m_startTime).count();
+}
+
+size_t TimingProfiler::Begin()
+{
+    if (m_numMarks == 0)
+        m_firstMarkTime = Now();
+    if (m_deviceId >= 0)
+        m_deviceMarks.Record();
+    else
+        m_hostMarks.push_back(Now());
+    return m_numMarks++;
+}
+
+void TimingProfiler::End(const wstring& name, Track track, size_t begin)
+{
+    size_t end = Begin();
+    m_spans.push_back(Span{ name, track, begin, end });
+}
+
+void TimingProfiler::EndMinibatch()
+{
+    // times of the marks in microseconds, relative to m_startTime
+    vector<float> deviceMs;
+    if (m_deviceId >= 0)
+        m_deviceMarks.Resolve(deviceMs);
+    auto markTime = [&](size_t mark)
+    {
+        return m_deviceId >= 0 ? m_firstMarkTime + 1000.0 * deviceMs[mark] : m_hostMarks[mark];
+    };
+
+    bool isTraced = m_numMinibatchesDone < m_numMinibatchesToTrace;
+    for (const auto& span : m_spans)
+    {
+        double time = markTime(span.m_begin);
+        double duration = markTime(span.m_end) - time;
+        Totals& totals = span.m_track == Track::phase ? m_phaseTotals[span.m_name] : m_nodeTotals[span.m_name];
+        if (span.m_track == Track::backward)
+        {
+            totals.m_backwardCalls++;
+            totals.m_backwardMs += duration / 1000;
+        }
+        else
+        {
+            totals.m_forwardCalls++;
+            totals.m_forwardMs += duration / 1000;
+        }
+        if (isTraced)
+            m_events.push_back(Event{ span.m_name, span.m_track, m_numMinibatchesDone, time, duration });
+    }
+    m_spans.clear();
+    m_hostMarks.clear();
+    m_numMarks = 0;
+    m_numMinibatchesDone++;
+
+    if (isTraced && m_numMinibatchesDone == m_numMinibatchesToTrace)
+        WriteTrace();
+}
+
+void TimingProfiler::Finish(int epochNumber)
+{
+    if (!m_spans.empty()) // an incomplete minibatch
+        EndMinibatch();
+    else
+    {
+        // marks without spans, e.g. of a read that found the end of the data
+        if (m_deviceId >= 0)
+        {
+            vector<float> unused;
+            m_deviceMarks.Resolve(unused);
+        }
+        m_hostMarks.clear();
+        m_numMarks = 0;
+    }
+
+    double totalMs = 0;
+    for (const auto& totals : m_nodeTotals)
+        totalMs += totals.second.m_forwardMs + totals.second.m_backwardMs;
+    for (const auto& totals : m_phaseTotals)
+        totalMs += totals.second.m_forwardMs;
+
+    fprintf(stderr, "TimingProfiler: Epoch[%d]: %d minibatches, %.1f ms measured.\n", epochNumber, (int) m_numMinibatchesDone, totalMs);
+    fprintf(stderr, "TimingProfiler: %-40s %8s %12s %12s %7s\n", "phase", "calls", "time [ms]", "", "%");
+    for (const auto& totals : m_phaseTotals)
+        fprintf(stderr, "TimingProfiler: %-40ls %8d %12.3f %12s %6.2f%%\n", totals.first.c_str(), (int) totals.second.m_forwardCalls,
+                totals.second.m_forwardMs, "", totalMs > 0 ? 100 * totals.second.m_forwardMs / totalMs : 0);
+
+    // nodes by their total time
+    vector<pair<wstring, Totals>> nodes(m_nodeTotals.begin(), m_nodeTotals.end());
+    sort(nodes.begin(), nodes.end(), [](const pair<wstring, Totals>& a, const pair<wstring, Totals>& b)
+    {
+        return a.second.m_forwardMs + a.second.m_backwardMs > b.second.m_forwardMs + b.second.m_backwardMs;
+    });
+    fprintf(stderr, "TimingProfiler: %-40s %8s %12s %12s %7s\n", "node", "calls", "forward [ms]", "backward [ms]", "%");
+    for (const auto& node : nodes)
+    {
+        double nodeMs = node.second.m_forwardMs + node.second.m_backwardMs;
+        fprintf(stderr, "TimingProfiler: %-40ls %8d %12.3f %12.3f %6.2f%%\n", node.first.c_str(), (int) node.second.m_forwardCalls,
+                node.second.m_forwardMs, node.second.m_backwardMs, totalMs > 0 ? 100 * nodeMs / totalMs : 0);
+    }
+
+    if (!m_isWritten && !m_events.empty())
+        WriteTrace();
+}
+
+// JSON string with quotes
+static string JsonString(const wstring& s)
+{
+    string result = "\"";
+    for (char c : msra::strfun::utf8(s))
+    {
+        if (c == '"' || c == '\\')
+            result += '\\';
+        if ((unsigned char) c < 0x20)
+            c = ' ';
+        result += c;
+    }
+    return result + "\"";
+}
+
+void TimingProfiler::WriteTrace()
+{
+    m_isWritten = true;
+    FILE* f = fopenOrDie(m_traceFileName, L"w");
+    fprintf(f, "{\"traceEvents\":[\n");
+    size_t numMinibatches = 0;
+    for (const auto& e : m_events)
+        numMinibatches = max(numMinibatches, e.m_minibatch + 1);
+    for (size_t i = 0; i < numMinibatches; i++)
+    {
+        fprintf(f, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"minibatch %d\"}},\n", i > 0 ? ",\n" : "", (int) i, (int) i);
+        fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"ForwardProp\"}},\n", (int) i);
+        fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":1,\"args\":{\"name\":\"Backprop\"}},\n", (int) i);
+        fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":2,\"args\":{\"name\":\"phases\"}}", (int) i);
+    }
+    for (const auto& e : m_events)
+        fprintf(f, ",\n{\"name\":%s,\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                JsonString(e.m_name).c_str(), (int) e.m_minibatch, (int) e.m_track, e.m_time, e.m_duration);
+    fprintf(f, "\n]}\n");
+    fcloseOrDie(f);
+    fprintf(stderr, "TimingProfiler: Wrote the timeline of %d minibatches to %ls.\n", (int) numMinibatches, m_traceFileName.c_str());
+    m_events.clear();
+}
+
+}}}
@@ -0,0 +1,101 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// TimingProfiler.h -- time spent per node and per training phase, as an epoch summary and a timeline in Chrome trace format
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "ComputationNode.h"
+#include "GPUWatcher.h"
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// TimingProfiler -- where the time of an epoch goes
+//
+// ComputationNetwork::SetTimingProfiler() makes ForwardProp() and Backprop() time every node of the evaluation order
+// (a recurrent loop counts as one); the training loop adds its phases (reading, gradient aggregation, weight update).
+// On a GPU, the spans are delimited by CUDA events in the compute stream, so they measure the kernels rather than
+// their launch; the events are resolved once per minibatch, in EndMinibatch(), which thus waits for the GPU.
+// Finish() prints the totals of the epoch, node by node, and writes the first 'numMinibatchesToTrace' minibatches
+// as a trace (chrome://tracing), where forward pass, backward pass and phases are a thread each.
+// -----------------------------------------------------------------------
+
+class TimingProfiler
+{
+public:
+    enum class Track
+    {
+        forward,
+        backward,
+        phase
+    };
+
+    // no trace if 'traceFileName' is empty
+    TimingProfiler(DEVICEID_TYPE deviceId, const std::wstring& traceFileName, size_t numMinibatchesToTrace);
+    ~TimingProfiler(); // writes the trace if not done yet
+
+    // marks the start of a span
+    size_t Begin();
+    // ends the span 'name' that began at 'begin'
+    void End(const std::wstring& name, Track track, size_t begin);
+    // 'node' was forward- or backpropagated since 'begin'
+    void EndNode(const ComputationNodeBasePtr& node, bool isBackprop, size_t begin)
+    {
+        End(node->NodeName(), isBackprop ? Track::backward : Track::forward, begin);
+    }
+
+    void EndMinibatch();
+    void Finish(int epochNumber);
+
+private:
+    struct Span
+    {
+        std::wstring m_name;
+        Track m_track;
+        size_t m_begin, m_end;
+    };
+    struct Event
+    {
+        std::wstring m_name;
+        Track m_track;
+        size_t m_minibatch;
+        double m_time, m_duration; // microseconds
+    };
+    struct Totals
+    {
+        Totals() : m_forwardCalls(0), m_backwardCalls(0), m_forwardMs(0), m_backwardMs(0) {}
+        size_t m_forwardCalls, m_backwardCalls;
+        double m_forwardMs, m_backwardMs;
+    };
+
+    double Now() const;
+    void WriteTrace();
+
+    DEVICEID_TYPE m_deviceId;
+    std::wstring m_traceFileName;
+    size_t m_numMinibatchesToTrace;
+    size_t m_numMinibatchesDone;
+    bool m_isWritten;
+    std::chrono::steady_clock::time_point m_startTime;
+
+    // marks of the current minibatch: host times on the CPU, CUDA events on a GPU
+    std::vector<double> m_hostMarks;
+    CudaEventTimeline m_deviceMarks;
+    size_t m_numMarks;
+    double m_firstMarkTime; // host time of the first mark, where the device times start
+    std::vector<Span> m_spans;
+
+    std::map<std::wstring, Totals> m_nodeTotals;
+    std::map<std::wstring, Totals> m_phaseTotals; // (counted as forward)
+    std::vector<Event> m_events;
+};
+
+}}}
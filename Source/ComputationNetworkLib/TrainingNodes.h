@@ -8,10 +8,12 @@
 #include "ComputationNode.h"
 #include "BatchNormalizationEngine.h"
 #include "RNGHandle.h"
+#include "PhiloxRNG.h"
 
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include <map>
+#include <random>
 #include <string>
 #include <vector>
 #include <stdexcept>
@@ -105,6 +107,8 @@ template class SquareErrorNode<double>;
 // -----------------------------------------------------------------------
 // CrossEntropyWithSoftmaxNode (labels, prediction)
 // calculates: -sum(left_i * log(softmax_i(right)))
+// With sparse labels that need no gradient (the usual case of large vocabularies), the softmax and the cross entropy
+// are computed in one fused pass over each column that never stores the log-softmax, see Matrix::CrossEntropyWithSoftmax().
 // -----------------------------------------------------------------------
 
 template <class ElemType>
@@ -116,7 +120,7 @@ class CrossEntropyWithSoftmaxNode : public ComputationNodeNonLooping /*Computati
 public:
     DeclareConstructorFromConfigWithNumInputs(CrossEntropyWithSoftmaxNode);
     CrossEntropyWithSoftmaxNode(DEVICEID_TYPE deviceId, const wstring& name)
-        : Base(deviceId, name)
+        : Base(deviceId, name), m_isFused(false), m_skippedGaps(false)
     {
     }
 
@@ -149,7 +153,16 @@ public:
 #endif
 
             auto gradient = InputRef(1).GradientFor(fr);
-            Matrix<ElemType>::AddScaledDifference(Gradient(), *m_softmaxOfRight, InputRef(0).ValueFor(fr), gradient);
+            if (m_isFused) // m_softmaxOfRight holds softmax - labels
+                Matrix<ElemType>::Multiply1x1AndWeightedAdd(+1.0f, Gradient() /*1x1*/, *m_softmaxOfRight, 1.0f, gradient);
+            else if (m_skippedGaps) // m_softmaxOfRight and m_compactLabels hold the valid columns only
+            {
+                *m_softmaxOfRight -= *m_compactLabels;
+                Matrix<ElemType>::Multiply1x1AndWeightedAdd(+1.0f, Gradient() /*1x1*/, *m_softmaxOfRight, 0.0f, *m_softmaxOfRight);
+                gradient.DoScatterColumnsOf(1, InputRef(1).GetMBLayout()->template GetValidColumnIndices<ElemType>(m_deviceId), *m_softmaxOfRight, 1);
+            }
+            else
+                Matrix<ElemType>::AddScaledDifference(Gradient(), *m_softmaxOfRight, InputRef(0).ValueFor(fr), gradient);
 #if DUMPOUTPUT
             InputRef(1).GradientFor(fr).Print("CrossEntropyWithSoftmaxNode Partial-Right");
 #endif
@@ -166,13 +179,46 @@ public:
 
     virtual void UpdateFunctionMBSize() override
     {
-        m_logSoftmaxOfRight->Resize(Input(1)->Value());
-        m_softmaxOfRight->Resize(*m_logSoftmaxOfRight);
+        m_softmaxOfRight->Resize(Input(1)->Value());
+        if (!CanUseFusedSoftmax())
+            m_logSoftmaxOfRight->Resize(Input(1)->Value());
     }
 
     virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override // -sum(left_i * log(softmax_i(right)))
     {
         FrameRange fr(InputRef(0).GetMBLayout());
+        m_isFused = CanUseFusedSoftmax();
+        m_skippedGaps = !m_isFused && CanSkipGaps();
+        if (m_isFused)
+        {
+            // per-column cross entropy and softmax - labels in one pass; gaps contribute zero to the sum and to the gradient
+            Matrix<ElemType>::CrossEntropyWithSoftmax(InputRef(0).ValueFor(fr), InputRef(1).ValueFor(fr), *m_crossEntropyOfColumns, *m_softmaxOfRight);
+            MaskMissingColumnsToZero(*m_crossEntropyOfColumns, InputRef(1).GetMBLayout(), fr);
+            MaskMissingColumnsToZero(*m_softmaxOfRight, InputRef(1).GetMBLayout(), fr);
+            Value().AssignSumOfElements(*m_crossEntropyOfColumns);
+#if NANCHECK
+            Value().HasNan("CrossEntropyWithSoftmax");
+#endif
+            return;
+        }
+
+        // with many gaps, the softmax of the valid columns only, gathered into compact matrices (see MBLayout::HasManyGaps())
+        if (m_skippedGaps)
+        {
+            const auto& validColumns = InputRef(1).GetMBLayout()->template GetValidColumnIndices<ElemType>(m_deviceId);
+            m_compactLabels->DoGatherColumnsOf(0, validColumns, InputRef(0).Value(), 1);
+            m_softmaxOfRight->DoGatherColumnsOf(0, validColumns, InputRef(1).Value(), 1);
+            m_logSoftmaxOfRight->AssignLogSoftmaxOf(*m_softmaxOfRight, true);
+            m_softmaxOfRight->SetValue(*m_logSoftmaxOfRight);
+            m_softmaxOfRight->InplaceExp();
+            Value().AssignInnerProductOfMatrices(*m_compactLabels, *m_logSoftmaxOfRight);
+            Value() *= -1;
+#if NANCHECK
+            Value().HasNan("CrossEntropyWithSoftmax");
+#endif
+            return;
+        }
+
         // first compute the softmax (column-wise)
         // Note that we need both log and non-log for gradient computation.
         m_logSoftmaxOfRight->AssignLogSoftmaxOf(InputRef(1).ValueFor(fr), true);
@@ -205,6 +251,10 @@ public:
             auto node = dynamic_pointer_cast<CrossEntropyWithSoftmaxNode<ElemType>>(nodeP);
             node->m_logSoftmaxOfRight->SetValue(*m_logSoftmaxOfRight);
             node->m_softmaxOfRight->SetValue(*m_softmaxOfRight);
+            node->m_crossEntropyOfColumns->SetValue(*m_crossEntropyOfColumns);
+            node->m_compactLabels->SetValue(*m_compactLabels);
+            node->m_isFused = m_isFused;
+            node->m_skippedGaps = m_skippedGaps;
         }
     }
 
@@ -214,16 +264,235 @@ public:
         Base::RequestMatricesBeforeForwardProp(matrixPool);
         RequestMatrixFromPool(m_logSoftmaxOfRight, matrixPool);
         RequestMatrixFromPool(m_softmaxOfRight, matrixPool);
+        RequestMatrixFromPool(m_crossEntropyOfColumns, matrixPool);
+        RequestMatrixFromPool(m_compactLabels, matrixPool);
     }
 
 protected:
+    // the fused computation needs the labels as CSC, and cannot give their gradient (it has no log-softmax)
+    bool CanUseFusedSoftmax() const
+    {
+        const auto& labels = InputRef(0).Value();
+        return labels.GetMatrixType() == SPARSE && labels.GetFormat() == matrixFormatSparseCSC && !InputRef(0).NeedsGradient();
+    }
+
+    // gathering the valid columns needs dense labels, and the compact log-softmax cannot give their gradient either
+    bool CanSkipGaps() const
+    {
+        const auto& layout = InputRef(1).GetMBLayout();
+        return layout && layout->HasManyGaps() && InputRef(0).GetMBLayout() == layout &&
+               InputRef(0).Value().GetMatrixType() == DENSE && InputRef(1).Value().GetMatrixType() == DENSE && !InputRef(0).NeedsGradient();
+    }
+
     shared_ptr<Matrix<ElemType>> m_logSoftmaxOfRight;
-    shared_ptr<Matrix<ElemType>> m_softmaxOfRight;
+    shared_ptr<Matrix<ElemType>> m_softmaxOfRight;        // softmax - labels if m_isFused
+    shared_ptr<Matrix<ElemType>> m_crossEntropyOfColumns; // [1 x T], if m_isFused
+    shared_ptr<Matrix<ElemType>> m_compactLabels;         // the valid columns of the labels, if m_skippedGaps
+    bool m_isFused;                                       // whether the last ForwardProp() took the fused path
+    bool m_skippedGaps;                                   // whether it computed the valid columns only (see CanSkipGaps())
 };
 
 template class CrossEntropyWithSoftmaxNode<float>;
 template class CrossEntropyWithSoftmaxNode<double>;
 
+// -----------------------------------------------------------------------
+/// CTCWithSoftmaxNode (labels, prediction, blankTokenId=#classes-1)
+// -----------------------------------------------------------------------
+
+// Connectionist temporal classification, for end-to-end speech recognition: -sum over the utterances of the log of
+// the total probability of all alignments of the label sequence (with optional blanks between the labels) with the
+// frames, under the frame-wise softmax of 'prediction'.
+// 'labels' is a sequence of one-hot vectors (dense or sparse) with a dynamic axis of its own, with one sequence for each
+// sequence of 'prediction' (the one with the same sequence id). Full sequences are required (no truncated BPTT).
+// The log-softmax, the forward-backward and the gradient all run on the device of the prediction (Matrix::AssignCTCScore());
+// the only host-to-device copies are the sequence descriptions taken from the MBLayouts, and nothing is read back.
+template <class ElemType>
+class CTCWithSoftmaxNode : public ComputationNodeNonLooping<ElemType>, public NumInputs<2>
+{
+    typedef ComputationNodeNonLooping<ElemType> Base; UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"CTCWithSoftmax"; }
+
+public:
+    CTCWithSoftmaxNode(DEVICEID_TYPE deviceId, const wstring& name, size_t blankTokenId = SIZE_MAX)
+        : Base(deviceId, name), m_blankTokenId(blankTokenId)
+    {
+    }
+    CTCWithSoftmaxNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : CTCWithSoftmaxNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Exists(L"blankTokenId") ? (size_t) configp->Get(L"blankTokenId") : SIZE_MAX)
+    {
+        AttachInputsFromConfig(configp, this->GetExpectedNumInputs());
+    }
+
+    virtual void BackpropToNonLooping(size_t inputIndex) override
+    {
+        // no gradient flows into the labels
+        if (inputIndex == 1)
+        {
+            FrameRange fr(InputRef(1).GetMBLayout());
+            m_softmaxOfRight->SetValue(*m_logSoftmaxOfRight);
+            m_softmaxOfRight->InplaceExp();
+            MaskMissingColumnsToZero(*m_softmaxOfRight, InputRef(1).GetMBLayout(), fr);
+            auto gradient = InputRef(1).GradientFor(fr);
+            Matrix<ElemType>::AddScaledDifference(Gradient(), *m_softmaxOfRight, *m_occupancy, gradient);
+#ifdef _DEBUG
+            InputRef(1).InvalidateMissingGradientColumns(fr);
+#endif
+        }
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+
+    virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
+    {
+        let& labelLayout = InputRef(0).GetMBLayout();
+        let& frameLayout = InputRef(1).GetMBLayout();
+        let numClasses = InputRef(1).GetSampleMatrixNumRows();
+        let blankTokenId = m_blankTokenId == SIZE_MAX ? numClasses - 1 : m_blankTokenId;
+        if (blankTokenId >= numClasses)
+            InvalidArgument("%ls: blankTokenId %d exceeds the number of classes %d.", NodeDescription().c_str(), (int) blankTokenId, (int) numClasses);
+
+        // the utterances and their label sequences, from the MBLayouts
+        m_uttToChanInd.clear();
+        m_uttBeginFrame.clear();
+        m_uttFrameNum.clear();
+        m_uttLabelNum.clear();
+        std::vector<const MBLayout::SequenceInfo*> labelSequences;
+        size_t maxFrameNum = 0;
+        size_t maxLabelNum = 1; // (keeps the label matrix non-empty)
+        for (let& seq : frameLayout->GetAllSequences())
+        {
+            if (seq.seqId == GAP_SEQUENCE_ID)
+                continue;
+            if (seq.tBegin < 0 || seq.tEnd > frameLayout->GetNumTimeSteps())
+                InvalidArgument("%ls requires full sequences, it cannot be used with truncated sequences.", NodeDescription().c_str());
+            let& labelSequence = labelLayout->FindSequence(seq.seqId);
+            labelSequences.push_back(&labelSequence);
+            m_uttToChanInd.push_back(seq.s);
+            m_uttBeginFrame.push_back(seq.tBegin);
+            m_uttFrameNum.push_back(seq.GetNumTimeSteps());
+            m_uttLabelNum.push_back(labelSequence.GetNumTimeSteps());
+            maxFrameNum = max(maxFrameNum, seq.GetNumTimeSteps());
+            maxLabelNum = max(maxLabelNum, labelSequence.GetNumTimeSteps());
+        }
+
+        // the class ids of the labels, [maxLabelNum x #utterances]: the one-hot labels are multiplied with the row vector
+        // 0, 1, ..., #classes-1, and the result is gathered into the utterances' columns
+        if (!m_classIds || m_classIds->GetNumCols() != numClasses || m_classIds->GetDeviceId() != m_deviceId)
+        {
+            std::vector<ElemType> classIds(numClasses);
+            for (size_t k = 0; k < numClasses; k++)
+                classIds[k] = (ElemType) k;
+            m_classIds = make_shared<Matrix<ElemType>>(1, numClasses, classIds.data(), m_deviceId, matrixFlagNormal);
+        }
+        Matrix<ElemType>::Multiply(*m_classIds, false, InputRef(0).Value(), false, *m_labelIds);
+
+        m_labelColumnMapBuffer.assign(maxLabelNum * labelSequences.size(), (ElemType) -1);
+        for (size_t u = 0; u < labelSequences.size(); u++)
+        {
+            for (size_t l = 0; l < m_uttLabelNum[u]; l++)
+                m_labelColumnMapBuffer[u * maxLabelNum + l] = (ElemType) labelLayout->GetColumnIndex(*labelSequences[u], l);
+        }
+        m_labelColumnMap->SetValue(1, m_labelColumnMapBuffer.size(), m_deviceId, m_labelColumnMapBuffer.data());
+        m_labelSequences->DoGatherColumnsOf(/*beta=*/0, *m_labelColumnMap, *m_labelIds, /*alpha=*/1);
+        m_labelSequences->Reshape(maxLabelNum, labelSequences.size());
+
+        m_logSoftmaxOfRight->AssignLogSoftmaxOf(InputRef(1).Value(), true);
+        m_occupancy->AssignCTCScore(*m_logSoftmaxOfRight, *m_alpha, *m_beta, *m_labelSequences, Value(),
+                                    m_uttToChanInd, m_uttBeginFrame, m_uttFrameNum, m_uttLabelNum,
+                                    frameLayout->GetNumParallelSequences(), maxFrameNum, blankTokenId);
+#if NANCHECK
+        Value().HasNan("CTCWithSoftmax");
+#endif
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        m_pMBLayout = nullptr; // this node computes a scalar
+
+        if (isFinalValidationPass)
+        {
+            if (!Input(0)->HasMBLayout() || !Input(1)->HasMBLayout())
+                InvalidArgument("%ls requires the labels and the prediction to be sequences.", NodeDescription().c_str());
+            if (Input(0)->GetSampleMatrixNumRows() != Input(1)->GetSampleMatrixNumRows())
+                InvalidArgument("%ls: The label dimension %d does not match the prediction dimension %d.", NodeDescription().c_str(),
+                                (int) Input(0)->GetSampleMatrixNumRows(), (int) Input(1)->GetSampleMatrixNumRows());
+        }
+
+        SetDims(TensorShape(1), false);
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<CTCWithSoftmaxNode<ElemType>>(nodeP);
+            node->m_blankTokenId = m_blankTokenId;
+        }
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_blankTokenId;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        fstream >> m_blankTokenId;
+    }
+
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        RequestMatrixFromPool(m_logSoftmaxOfRight, matrixPool);
+        RequestMatrixFromPool(m_softmaxOfRight, matrixPool);
+        RequestMatrixFromPool(m_occupancy, matrixPool);
+        RequestMatrixFromPool(m_alpha, matrixPool);
+        RequestMatrixFromPool(m_beta, matrixPool);
+        RequestMatrixFromPool(m_labelIds, matrixPool);
+        RequestMatrixFromPool(m_labelColumnMap, matrixPool);
+        RequestMatrixFromPool(m_labelSequences, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_logSoftmaxOfRight, matrixPool);
+        ReleaseMatrixToPool(m_softmaxOfRight, matrixPool);
+        ReleaseMatrixToPool(m_occupancy, matrixPool);
+        ReleaseMatrixToPool(m_alpha, matrixPool);
+        ReleaseMatrixToPool(m_beta, matrixPool);
+        ReleaseMatrixToPool(m_labelIds, matrixPool);
+        ReleaseMatrixToPool(m_labelColumnMap, matrixPool);
+        ReleaseMatrixToPool(m_labelSequences, matrixPool);
+    }
+
+protected:
+    size_t m_blankTokenId; // SIZE_MAX: the last class
+
+    shared_ptr<Matrix<ElemType>> m_logSoftmaxOfRight;
+    shared_ptr<Matrix<ElemType>> m_softmaxOfRight;
+    shared_ptr<Matrix<ElemType>> m_occupancy;      // posterior of each class in each frame, given the label sequence
+    shared_ptr<Matrix<ElemType>> m_alpha;          // forward and backward log scores
+    shared_ptr<Matrix<ElemType>> m_beta;
+    shared_ptr<Matrix<ElemType>> m_classIds;       // [1 x #classes] 0, 1, ..., #classes-1
+    shared_ptr<Matrix<ElemType>> m_labelIds;       // [1 x #label columns] class id of each label
+    shared_ptr<Matrix<ElemType>> m_labelColumnMap; // [1 x maxLabelNum * #utterances] label column of each label of the utterances, -1 beyond their end
+    shared_ptr<Matrix<ElemType>> m_labelSequences; // [maxLabelNum x #utterances] class ids of the labels of each utterance
+    std::vector<ElemType> m_labelColumnMapBuffer;
+    std::vector<size_t> m_uttToChanInd;
+    std::vector<size_t> m_uttBeginFrame;
+    std::vector<size_t> m_uttFrameNum;
+    std::vector<size_t> m_uttLabelNum;
+};
+
+template class CTCWithSoftmaxNode<float>;
+template class CTCWithSoftmaxNode<double>;
+
 // -----------------------------------------------------------------------
 /// CrossEntropyNode (labels, prediction)
 // -----------------------------------------------------------------------
@@ -598,6 +867,8 @@ public:
         return false;
     }
 
+    virtual bool CanBeCapturedInGPUGraph() const override { return false; } // new noise samples every time
+
     virtual void UpdateFunctionMBSize() override
     {
         // TODO (this does not really break it since for full matrices, class Matrix will resize by itself)
@@ -681,6 +952,504 @@ private:
 template class NoiseContrastiveEstimationNode<float>;
 template class NoiseContrastiveEstimationNode<double>;
 
+// -----------------------------------------------------------------------
+// SampledCrossEntropyWithSoftmaxNode (labels, hidden, weights, numSamples=)
+//  - Input(0) [V x T] one-hot labels, dense or sparse
+//  - Input(1) [H x T] hidden layer activation
+//  - Input(2) [H x V] output weights, one column per class (fold a bias into it with a constant row of the hidden layer)
+// Sampled softmax for large vocabularies: in training, each minibatch draws 'numSamples' classes from the log-uniform
+// (Zipfian) distribution P(k) = log((k+2)/(k+1)) / log(V+1), which suits class ids sorted by frequency, shared by all
+// frames. The logits are computed only for the true class and the sampled ones, from the gathered columns of the
+// weights; each logit is corrected by the log of the expected count of its class in the sample, and a sampled class
+// that equals the true class of a frame is left out of that frame's softmax. The cost is thus independent of V, except
+// for the scatter of the weight gradient into its [H x V] matrix. Outside of training, the full softmax is used.
+// Only the sample (numSamples class ids) is copied to the device per minibatch.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class SampledCrossEntropyWithSoftmaxNode : public ComputationNodeNonLooping<ElemType>, public NumInputs<3>
+{
+    typedef ComputationNodeNonLooping<ElemType> Base; UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"SampledCrossEntropyWithSoftmax"; }
+
+    // our inputs
+    static const size_t LABELDATA = 0;
+    static const size_t INPUTDATA = 1;
+    static const size_t WEIGHTS = 2;
+
+public:
+    SampledCrossEntropyWithSoftmaxNode(DEVICEID_TYPE deviceId, const wstring& name, size_t numSamples = 0)
+        : Base(deviceId, name), m_numSamples(numSamples), m_randomSeed((unsigned long) CreateUniqId()), m_isGradientScaled(false), m_logExpectedCountsNumSamples(0)
+    {
+    }
+    SampledCrossEntropyWithSoftmaxNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : SampledCrossEntropyWithSoftmaxNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"numSamples"))
+    {
+        AttachInputsFromConfig(configp, this->GetExpectedNumInputs());
+    }
+
+    virtual void BackpropToNonLooping(size_t inputIndex) override
+    {
+        // no gradient flows into the labels
+        if (inputIndex == LABELDATA)
+            return;
+        if (!Environment().IsTraining())
+            LogicError("%ls: BackpropTo() is only supported in training.", NodeDescription().c_str());
+
+        // the derivatives w.r.t. the logits, computed by ForwardProp(), scaled by the 1x1 incoming gradient
+        if (!m_isGradientScaled)
+        {
+            Matrix<ElemType>::Multiply1x1AndWeightedAdd(1.0f, Gradient() /*1x1*/, *m_sampledLogits, 0.0f, *m_sampledLogits);
+            Matrix<ElemType>::Multiply1x1AndWeightedAdd(1.0f, Gradient() /*1x1*/, *m_trueLogits, 0.0f, *m_trueLogits);
+            m_isGradientScaled = true;
+        }
+
+        FrameRange fr(InputRef(LABELDATA).GetMBLayout());
+        auto hidden = InputRef(INPUTDATA).MaskedValueFor(fr);
+        if (inputIndex == INPUTDATA)
+        {
+            auto gradient = InputRef(INPUTDATA).GradientFor(fr);
+            Matrix<ElemType>::MultiplyAndAdd(*m_sampledWeights, false, *m_sampledLogits, false, gradient);
+            m_labelWeights->RowElementMultiplyWith(*m_trueLogits); // (not used any further)
+            Matrix<ElemType>::ScaleAndAdd(1, *m_labelWeights, gradient);
+        }
+        else if (inputIndex == WEIGHTS)
+        {
+            // only the columns of the sampled and the true classes are updated; gaps have the class id -1
+            auto& gradient = InputRef(WEIGHTS).GradientAsMatrix();
+            m_weightGradient->AssignProductOf(hidden, false, *m_sampledLogits, true);
+            gradient.DoScatterColumnsOf(/*beta=*/1, *m_sampleIds, *m_weightGradient, /*alpha=*/1);
+            m_weightGradient->SetValue(hidden);
+            m_weightGradient->RowElementMultiplyWith(*m_trueLogits);
+            gradient.DoScatterColumnsOf(/*beta=*/1, *m_labelIds, *m_weightGradient, /*alpha=*/1);
+        }
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t childIndex) const override { return childIndex == INPUTDATA; }
+    virtual bool CanBeCapturedInGPUGraph() const override { return false; } // new samples every time
+
+    virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
+    {
+        FrameRange fr(InputRef(LABELDATA).GetMBLayout());
+        auto labels = InputRef(LABELDATA).ValueFor(fr);
+        auto hidden = InputRef(INPUTDATA).MaskedValueFor(fr);
+        auto& weights = InputRef(WEIGHTS).ValueAsMatrix();
+        const auto& layout = InputRef(LABELDATA).GetMBLayout();
+
+        if (!Environment().IsTraining())
+        {
+            // full softmax
+            m_sampledLogits->AssignProductOf(weights, true, hidden, false);
+            if (labels.GetMatrixType() == SPARSE && labels.GetFormat() == matrixFormatSparseCSC)
+            {
+                Matrix<ElemType>::CrossEntropyWithSoftmax(labels, *m_sampledLogits, *m_trueLogits, *m_logits);
+                MaskMissingColumnsToZero(*m_trueLogits, layout, fr);
+                Value().AssignSumOfElements(*m_trueLogits);
+            }
+            else
+            {
+                m_logits->AssignLogSoftmaxOf(*m_sampledLogits, true);
+                MaskMissingColumnsToZero(*m_logits, layout, fr);
+                Value().AssignInnerProductOfMatrices(InputRef(LABELDATA).MaskedValueFor(fr), *m_logits);
+                Value() *= -1;
+            }
+            return;
+        }
+
+        const size_t numClasses = weights.GetNumCols();
+        const size_t numSamples = m_numSamples;
+        PrepareSampling(numClasses);
+
+        // the class ids of the labels [1 x T], from their product with the row vector 0, 1, ..., V-1; -1 in gaps
+        Matrix<ElemType>::Multiply(*m_classIds, false, labels, false, *m_labelIds);
+        MaskMissingColumnsTo(*m_labelIds, layout, fr, (ElemType) -1);
+
+        // the sample, shared by all frames
+        std::uniform_real_distribution<double> uniform(0, 1);
+        const double logRange = log((double) numClasses + 1);
+        for (size_t k = 0; k < numSamples; k++)
+        {
+            size_t classId = (size_t) (exp(uniform(m_sampler) * logRange)) - 1;
+            classId = min(classId, numClasses - 1);
+            m_sampleIdsBuffer[k] = (ElemType) classId;
+            m_sampleLogExpectedCountsBuffer[k] = (ElemType) LogExpectedCount(classId, numClasses);
+        }
+        m_sampleIds->SetValue(1, numSamples, m_deviceId, m_sampleIdsBuffer.data());
+        m_sampleLogExpectedCounts->SetValue(numSamples, 1, m_deviceId, m_sampleLogExpectedCountsBuffer.data());
+
+        // logits of the sampled classes [numSamples x T], with the sampled true classes pushed out of the softmax
+        const size_t numCols = hidden.GetNumCols();
+        m_sampledWeights->DoGatherColumnsOf(/*beta=*/0, *m_sampleIds, weights, /*alpha=*/1);
+        m_sampledLogits->AssignProductOf(*m_sampledWeights, true, hidden, false);
+        Matrix<ElemType>::ScaleAndAdd(-1, *m_sampleLogExpectedCounts, *m_sampledLogits);
+        auto sampledLogits = TensorView<ElemType>(m_sampledLogits, TensorShape(numSamples, numCols));
+        sampledLogits.AddEqualOf(TensorView<ElemType>(m_sampleIds, TensorShape(numSamples, 1)), TensorView<ElemType>(m_labelIds, TensorShape(1, numCols)), (ElemType) -1e30);
+
+        // logits of the true classes [1 x T]
+        m_labelWeights->DoGatherColumnsOf(/*beta=*/0, *m_labelIds, weights, /*alpha=*/1);
+        MaskMissingColumnsToZero(*m_labelWeights, layout, fr); // (skipped by the gather)
+        Matrix<ElemType>::InnerProduct(*m_labelWeights, hidden, *m_trueLogits, true);
+        m_labelLogExpectedCounts->DoGatherColumnsOf(/*beta=*/0, *m_labelIds, *m_logExpectedCounts, /*alpha=*/1);
+        Matrix<ElemType>::ScaleAndAdd(-1, *m_labelLogExpectedCounts, *m_trueLogits);
+
+        // softmax over [true class; sampled classes], the true class being the target
+        m_logits->Resize(1 + numSamples, numCols);
+        m_logits->AssignToRowSliceValuesOf(*m_trueLogits, 0, 1);
+        m_logits->AssignToRowSliceValuesOf(*m_sampledLogits, 1, numSamples);
+        m_logits->InplaceLogSoftmax(true);
+        MaskMissingColumnsToZero(*m_logits, layout, fr);
+        m_trueLogits->AssignRowSliceValuesOf(*m_logits, 0, 1);
+        Value().AssignSumOfElements(*m_trueLogits);
+        Value() *= -1;
+
+        // the derivatives w.r.t. the logits, softmax - [1; 0], for BackpropTo(); they replace the logits
+        m_logits->InplaceExp();
+        MaskMissingColumnsToZero(*m_logits, layout, fr);
+        m_trueLogits->AssignRowSliceValuesOf(*m_logits, 0, 1);
+        *m_trueLogits -= 1;
+        MaskMissingColumnsToZero(*m_trueLogits, layout, fr);
+        m_sampledLogits->AssignRowSliceValuesOf(*m_logits, 1, numSamples);
+        m_isGradientScaled = false;
+#if NANCHECK
+        Value().HasNan("SampledCrossEntropyWithSoftmax");
+#endif
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        m_pMBLayout = nullptr; // this node computes a scalar
+
+        if (isFinalValidationPass)
+        {
+            if (!Input(LABELDATA)->HasMBLayout() || !Input(INPUTDATA)->HasMBLayout() || Input(WEIGHTS)->HasMBLayout())
+                InvalidArgument("%ls requires the labels and the hidden layer to be minibatches, and the weights to be a matrix.", NodeDescription().c_str());
+            if (Input(LABELDATA)->GetSampleMatrixNumRows() != Input(WEIGHTS)->GetAsMatrixNumCols())
+                InvalidArgument("%ls: The label dimension %d does not match the number of columns %d of the weights.", NodeDescription().c_str(),
+                                (int) Input(LABELDATA)->GetSampleMatrixNumRows(), (int) Input(WEIGHTS)->GetAsMatrixNumCols());
+            if (Input(INPUTDATA)->GetSampleMatrixNumRows() != Input(WEIGHTS)->GetAsMatrixNumRows())
+                InvalidArgument("%ls: The hidden layer dimension %d does not match the number of rows %d of the weights.", NodeDescription().c_str(),
+                                (int) Input(INPUTDATA)->GetSampleMatrixNumRows(), (int) Input(WEIGHTS)->GetAsMatrixNumRows());
+            if (m_numSamples == 0)
+                InvalidArgument("%ls: numSamples must be greater than 0.", NodeDescription().c_str());
+        }
+
+        SetDims(TensorShape(1), false);
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<SampledCrossEntropyWithSoftmaxNode<ElemType>>(nodeP);
+            node->m_numSamples = m_numSamples;
+            node->m_randomSeed = m_randomSeed;
+        }
+    }
+
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_numSamples;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        fstream >> m_numSamples;
+    }
+
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        RequestMatrixFromPool(m_labelIds, matrixPool);
+        RequestMatrixFromPool(m_sampleIds, matrixPool);
+        RequestMatrixFromPool(m_sampleLogExpectedCounts, matrixPool);
+        RequestMatrixFromPool(m_labelLogExpectedCounts, matrixPool);
+        RequestMatrixFromPool(m_sampledWeights, matrixPool);
+        RequestMatrixFromPool(m_labelWeights, matrixPool);
+        RequestMatrixFromPool(m_sampledLogits, matrixPool);
+        RequestMatrixFromPool(m_trueLogits, matrixPool);
+        RequestMatrixFromPool(m_logits, matrixPool);
+    }
+
+    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeBackprop(matrixPool);
+        RequestMatrixFromPool(m_weightGradient, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_labelIds, matrixPool);
+        ReleaseMatrixToPool(m_sampleIds, matrixPool);
+        ReleaseMatrixToPool(m_sampleLogExpectedCounts, matrixPool);
+        ReleaseMatrixToPool(m_labelLogExpectedCounts, matrixPool);
+        ReleaseMatrixToPool(m_sampledWeights, matrixPool);
+        ReleaseMatrixToPool(m_labelWeights, matrixPool);
+        ReleaseMatrixToPool(m_sampledLogits, matrixPool);
+        ReleaseMatrixToPool(m_trueLogits, matrixPool);
+        ReleaseMatrixToPool(m_logits, matrixPool);
+        ReleaseMatrixToPool(m_weightGradient, matrixPool);
+    }
+
+private:
+    // log of the expected count of class k in a sample of m_numSamples classes drawn with replacement
+    double LogExpectedCount(size_t k, size_t numClasses) const
+    {
+        return log((double) m_numSamples * log((k + 2.0) / (k + 1.0)) / log(numClasses + 1.0));
+    }
+
+    // the class id row and the log expected counts of all classes, for a new number of classes or device
+    void PrepareSampling(size_t numClasses)
+    {
+        if (m_sampleIdsBuffer.empty())
+            m_sampler.seed(m_randomSeed);
+        m_sampleIdsBuffer.resize(m_numSamples);
+        m_sampleLogExpectedCountsBuffer.resize(m_numSamples);
+        if (m_classIds && m_classIds->GetNumCols() == numClasses && m_classIds->GetDeviceId() == m_deviceId &&
+            m_logExpectedCountsNumSamples == m_numSamples)
+            return;
+
+        std::vector<ElemType> buffer(numClasses);
+        for (size_t k = 0; k < numClasses; k++)
+            buffer[k] = (ElemType) k;
+        m_classIds = make_shared<Matrix<ElemType>>(1, numClasses, buffer.data(), m_deviceId, matrixFlagNormal);
+        for (size_t k = 0; k < numClasses; k++)
+            buffer[k] = (ElemType) LogExpectedCount(k, numClasses);
+        m_logExpectedCounts = make_shared<Matrix<ElemType>>(1, numClasses, buffer.data(), m_deviceId, matrixFlagNormal);
+        m_logExpectedCountsNumSamples = m_numSamples;
+    }
+
+    size_t m_numSamples;
+    unsigned long m_randomSeed;
+    std::mt19937 m_sampler;
+    std::vector<ElemType> m_sampleIdsBuffer;
+    std::vector<ElemType> m_sampleLogExpectedCountsBuffer;
+    bool m_isGradientScaled; // whether BackpropTo() has scaled the derivatives by the incoming gradient
+
+    shared_ptr<Matrix<ElemType>> m_classIds;                // [1 x V] 0, 1, ..., V-1
+    shared_ptr<Matrix<ElemType>> m_logExpectedCounts;       // [1 x V] log expected count of each class in the sample
+    size_t m_logExpectedCountsNumSamples;                   // the sample size of m_logExpectedCounts
+    shared_ptr<Matrix<ElemType>> m_labelIds;                // [1 x T] class id of each label, -1 in gaps
+    shared_ptr<Matrix<ElemType>> m_sampleIds;               // [1 x numSamples]
+    shared_ptr<Matrix<ElemType>> m_sampleLogExpectedCounts; // [numSamples x 1]
+    shared_ptr<Matrix<ElemType>> m_labelLogExpectedCounts;  // [1 x T]
+    shared_ptr<Matrix<ElemType>> m_sampledWeights;          // [H x numSamples] gathered columns of the weights
+    shared_ptr<Matrix<ElemType>> m_labelWeights;            // [H x T]
+    shared_ptr<Matrix<ElemType>> m_sampledLogits;           // [numSamples x T], after ForwardProp() in training their derivatives
+    shared_ptr<Matrix<ElemType>> m_trueLogits;              // [1 x T], likewise
+    shared_ptr<Matrix<ElemType>> m_logits;                  // [1 + numSamples x T]
+    shared_ptr<Matrix<ElemType>> m_weightGradient;          // [H x max(numSamples, T)]
+};
+
+template class SampledCrossEntropyWithSoftmaxNode<float>;
+template class SampledCrossEntropyWithSoftmaxNode<double>;
+
+// -----------------------------------------------------------------------
+// ShardedCrossEntropyWithSoftmaxNode (labels, logits1, ..., logitsK)
+//  - Input(0) [V x T] one-hot labels, dense or sparse
+//  - Input(k) [V_k x T] logits of the k-th shard of the classes, which follow each other, V_1 + ... + V_K = V,
+//    e.g. Times (W_k, h) for an output layer whose weights are split by rows into K parameters
+// CrossEntropyWithSoftmax over the row-stacked logits, for output layers that are placed on several devices (see
+// ComputationNetwork::SetNodeDevices()). The logits and their derivatives stay on the device of their shard; only the
+// normalizers are exchanged: each shard computes its own log-softmax, the [1 x T] log-sum-exp of each shard is copied to
+// this node, which combines them, and each shard gets back its [1 x T] share of the log-softmax over the shards. The
+// labels enter each shard as [1 x T] class ids. This node takes its inputs from other devices, so no DeviceCopyNodes
+// are put in front of it. The per-shard matrices are kept on their devices between minibatches.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class ShardedCrossEntropyWithSoftmaxNode : public ComputationNodeNonLooping<ElemType> // note: not deriving from NumInputs<>, the number of shards is variable
+{
+    typedef ComputationNodeNonLooping<ElemType> Base; UsingComputationNodeMembersBoilerplate;
+    static const std::wstring TypeName() { return L"ShardedCrossEntropyWithSoftmax"; }
+
+    static const size_t LABELDATA = 0;
+
+public:
+    DeclareConstructorFromConfig(ShardedCrossEntropyWithSoftmaxNode);
+    ShardedCrossEntropyWithSoftmaxNode(DEVICEID_TYPE deviceId, const wstring& name)
+        : Base(deviceId, name)
+    {
+    }
+
+    virtual void BackpropToNonLooping(size_t inputIndex) override
+    {
+        // no gradient flows into the labels
+        if (inputIndex == LABELDATA)
+            return;
+
+        // the derivatives softmax - labels, computed by ForwardProp(), scaled by the 1x1 incoming gradient
+        FrameRange fr(InputRef(LABELDATA).GetMBLayout());
+        auto& shard = m_shards[inputIndex - 1];
+        shard.gradient->AssignValuesOf(Gradient());
+        auto gradient = InputRef(inputIndex).GradientFor(fr);
+        Matrix<ElemType>::Multiply1x1AndWeightedAdd(+1.0f, *shard.gradient /*1x1*/, *shard.logSoftmax, 1.0f, gradient);
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+    virtual bool AcceptsInputsFromOtherDevices() const override { return true; }
+    virtual bool CanBeCapturedInGPUGraph() const override { return false; } // the shards are exchanged on the host
+
+    virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override
+    {
+        FrameRange fr(InputRef(LABELDATA).GetMBLayout());
+        auto labels = InputRef(LABELDATA).ValueFor(fr);
+        const auto& layout = InputRef(LABELDATA).GetMBLayout();
+        PrepareShards();
+
+        // the local log-softmax of each shard, and its normalizer log sum_i exp(z_i) = z_0 - logSoftmax_0
+        const size_t numShards = m_shards.size();
+        const size_t numCols = labels.GetNumCols();
+        m_normalizers->Resize(numShards, numCols);
+        for (size_t k = 0; k < numShards; k++)
+        {
+            auto& shard = m_shards[k];
+            auto logits = InputRef(k + 1).MaskedValueFor(fr);
+            shard.logSoftmax->AssignLogSoftmaxOf(logits, true);
+            shard.normalizer->AssignRowSliceValuesOf(logits, 0, 1);
+            shard.correction->AssignRowSliceValuesOf(*shard.logSoftmax, 0, 1);
+            *shard.normalizer -= *shard.correction;
+            m_transferBuffer->AssignValuesOf(*shard.normalizer);
+            m_normalizers->AssignToRowSliceValuesOf(*m_transferBuffer, k, 1);
+
+            // the class ids of the labels within the shard [1 x T], from their product with the row 1, 2, ..., V_k at the
+            // columns of the shard, and 0 elsewhere; -1 for the labels of other shards and in gaps
+            Matrix<ElemType>::Multiply(*shard.classIds, false, labels, false, *m_labelIds);
+            *m_labelIds -= 1;
+            MaskMissingColumnsTo(*m_labelIds, layout, fr, (ElemType) -1);
+            shard.labelIds->AssignValuesOf(*m_labelIds);
+        }
+
+        // the log-softmax over the shards is what each shard adds to its local log-softmax
+        m_normalizers->InplaceLogSoftmax(true);
+        Value().SetValue(0);
+        for (size_t k = 0; k < numShards; k++)
+        {
+            auto& shard = m_shards[k];
+            const size_t numClasses = shard.rowIds->GetNumRows();
+            m_transferBuffer->AssignRowSliceValuesOf(*m_normalizers, k, 1);
+            shard.correction->AssignValuesOf(*m_transferBuffer);
+            Matrix<ElemType>::ScaleAndAdd(1, *shard.correction, *shard.logSoftmax);
+            MaskMissingColumnsToZero(*shard.logSoftmax, layout, fr);
+
+            // the cross entropy from the labels of the shard, one-hot [V_k x T]
+            shard.labels->Resize(numClasses, numCols);
+            TensorView<ElemType>(shard.labels, TensorShape(numClasses, numCols)).AssignEqualOf(TensorView<ElemType>(shard.rowIds, TensorShape(numClasses, 1)),
+                                                                                                 TensorView<ElemType>(shard.labelIds, TensorShape(1, numCols)));
+            shard.criterion->AssignInnerProductOfMatrices(*shard.labels, *shard.logSoftmax);
+            m_transferBuffer->AssignValuesOf(*shard.criterion);
+            Value() -= *m_transferBuffer;
+
+            // the derivatives w.r.t. the logits, softmax - labels, for BackpropTo(); they replace the log-softmax
+            shard.logSoftmax->InplaceExp();
+            Matrix<ElemType>::ScaleAndAdd(-1, *shard.labels, *shard.logSoftmax);
+            MaskMissingColumnsToZero(*shard.logSoftmax, layout, fr);
+        }
+#if NANCHECK
+        Value().HasNan("ShardedCrossEntropyWithSoftmax");
+#endif
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        m_pMBLayout = nullptr; // this node computes a scalar
+
+        if (GetNumInputs() < 2)
+            InvalidArgument("%ls requires the labels and at least one shard of logits.", NodeDescription().c_str());
+        if (isFinalValidationPass)
+        {
+            if (!Input(LABELDATA)->HasMBLayout())
+                InvalidArgument("%ls requires the labels to be a minibatch.", NodeDescription().c_str());
+            size_t numClasses = 0;
+            for (size_t k = 1; k < GetNumInputs(); k++)
+            {
+                if (Input(k)->GetMBLayout() != Input(LABELDATA)->GetMBLayout())
+                    InvalidArgument("%ls: The logits %ls must be minibatches with the layout of the labels.", NodeDescription().c_str(), Input(k)->NodeDescription().c_str());
+                numClasses += Input(k)->GetSampleMatrixNumRows();
+            }
+            if (numClasses != Input(LABELDATA)->GetSampleMatrixNumRows())
+                InvalidArgument("%ls: The label dimension %d does not match the %d classes of the shards.", NodeDescription().c_str(),
+                                (int) Input(LABELDATA)->GetSampleMatrixNumRows(), (int) numClasses);
+        }
+
+        SetDims(TensorShape(1), false);
+    }
+
+    virtual void /*ComputationNodeBase::*/ MoveToDevice(DEVICEID_TYPE deviceId) override
+    {
+        Base::MoveToDevice(deviceId);
+        m_normalizers.reset(); // (recreated on the new device by PrepareShards())
+    }
+
+private:
+    // (re)creates the matrices of the shards if the number of classes or the device of a shard has changed
+    void PrepareShards()
+    {
+        const size_t numClasses = InputRef(LABELDATA).GetSampleMatrixNumRows();
+        const DEVICEID_TYPE labelsDeviceId = InputRef(LABELDATA).Value().GetDeviceId();
+        m_shards.resize(GetNumInputs() - 1);
+        size_t firstClass = 0;
+        for (size_t k = 0; k < m_shards.size(); k++)
+        {
+            auto& shard = m_shards[k];
+            const size_t numShardClasses = InputRef(k + 1).GetSampleMatrixNumRows();
+            const DEVICEID_TYPE deviceId = InputRef(k + 1).Value().GetDeviceId();
+            if (!shard.classIds || shard.classIds->GetDeviceId() != labelsDeviceId || shard.rowIds->GetDeviceId() != deviceId ||
+                shard.rowIds->GetNumRows() != numShardClasses || shard.firstClass != firstClass)
+            {
+                std::vector<ElemType> buffer(numClasses, 0);
+                for (size_t i = 0; i < numShardClasses; i++)
+                    buffer[firstClass + i] = (ElemType) (i + 1);
+                shard.classIds = make_shared<Matrix<ElemType>>(1, numClasses, buffer.data(), labelsDeviceId, matrixFlagNormal);
+                for (size_t i = 0; i < numShardClasses; i++)
+                    buffer[i] = (ElemType) i;
+                shard.rowIds = make_shared<Matrix<ElemType>>(numShardClasses, 1, buffer.data(), deviceId, matrixFlagNormal);
+                for (auto* matrixPtr : { &shard.labelIds, &shard.labels, &shard.logSoftmax, &shard.normalizer, &shard.correction, &shard.criterion, &shard.gradient })
+                    *matrixPtr = make_shared<Matrix<ElemType>>(deviceId);
+                shard.firstClass = firstClass;
+            }
+            firstClass += numShardClasses;
+        }
+
+        if (!m_labelIds || m_labelIds->GetDeviceId() != labelsDeviceId)
+            m_labelIds = make_shared<Matrix<ElemType>>(labelsDeviceId);
+        if (!m_normalizers)
+        {
+            m_normalizers = make_shared<Matrix<ElemType>>(m_deviceId);
+            m_transferBuffer = make_shared<Matrix<ElemType>>(m_deviceId);
+        }
+    }
+
+    struct Shard
+    {
+        size_t firstClass = 0;
+        shared_ptr<Matrix<ElemType>> classIds;   // [1 x V] on the device of the labels: i + 1 at column firstClass + i of the shard, else 0
+        shared_ptr<Matrix<ElemType>> rowIds;     // [V_k x 1] 0, 1, ..., V_k - 1
+        shared_ptr<Matrix<ElemType>> labelIds;   // [1 x T] class id of each label within the shard, -1 if none
+        shared_ptr<Matrix<ElemType>> labels;     // [V_k x T] one-hot
+        shared_ptr<Matrix<ElemType>> logSoftmax; // [V_k x T], after ForwardProp() the derivatives softmax - labels
+        shared_ptr<Matrix<ElemType>> normalizer; // [1 x T] log-sum-exp of the shard
+        shared_ptr<Matrix<ElemType>> correction; // [1 x T]
+        shared_ptr<Matrix<ElemType>> criterion;  // [1 x 1]
+        shared_ptr<Matrix<ElemType>> gradient;   // [1 x 1] incoming gradient
+    };
+    std::vector<Shard> m_shards; // the matrices of each shard, on its device
+
+    shared_ptr<Matrix<ElemType>> m_labelIds;       // [1 x T] on the device of the labels
+    shared_ptr<Matrix<ElemType>> m_normalizers;    // [K x T] on our device, one row per shard
+    shared_ptr<Matrix<ElemType>> m_transferBuffer; // [1 x T] or [1 x 1] on our device
+};
+
+template class ShardedCrossEntropyWithSoftmaxNode<float>;
+template class ShardedCrossEntropyWithSoftmaxNode<double>;
+
 // -----------------------------------------------------------------------
 // ClassBasedCrossEntropyWithSoftmaxNode (labeldata(.,t), inputdata(.,t), embeddingMatrix, clsProbBeforeSoftmaxData(.,t))
 //  - Input(0) [4 x T] label in dense matrix in
@@ -1441,7 +2210,9 @@ public:
     DeclareConstructorFromConfigWithNumInputs(DropoutNode);
     DropoutNode(DEVICEID_TYPE deviceId, const wstring& name)
         : Base(deviceId, name),
-          m_dropoutRate(0)
+          m_dropoutRate(0),
+          m_statelessMask(false),
+          m_maskIteration(0)
     {
         m_randomSeed = (unsigned long) CreateUniqId();
     }
@@ -1451,7 +2222,9 @@ public:
         Matrix<ElemType> sliceInput0Grad = InputRef(0).GradientFor(fr);
         Matrix<ElemType> sliceOutputGrad = GradientFor(fr);
 
-        if (m_dropoutRate > 0)
+        if (m_dropoutRate > 0 && m_statelessMask) // regenerate the mask of ForwardProp()
+            sliceInput0Grad.AddDropoutOf(sliceOutputGrad, (ElemType) m_dropoutRate, (ElemType) (1.0 / (1.0 - m_dropoutRate)), MaskKey(), MaskOffset(fr), /*beta=*/1);
+        else if (m_dropoutRate > 0)
             sliceInput0Grad.AddElementProductOf(sliceOutputGrad, DataFor(*m_maskOfDropout, fr));
         else
             sliceInput0Grad += sliceOutputGrad;
@@ -1459,15 +2232,26 @@ public:
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
     virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+    virtual bool CanRecomputeValue() const override { return false; } // a new mask every time
+    virtual bool CanBeCapturedInGPUGraph() const override { return false; }
+    virtual bool CanComputeValueInPlaceOfInput(size_t /*childIndex*/) const override { return true; }
 
     virtual void UpdateFunctionMBSize() override
     {
         Base::UpdateFunctionMBSize();
         // resize temporaries to their proper size
-        if (m_dropoutRate > 0)
+        if (m_dropoutRate > 0 && !m_statelessMask)
             m_maskOfDropout->Resize(Input(0)->Value());
     }
 
+    virtual void /*IComputationNode::*/ BeginForwardProp() override
+    {
+        Base::BeginForwardProp();
+        // a new mask for every minibatch; in loops, all steps share the key and differ in the offset
+        if (m_statelessMask && !Environment().IsInferring())
+            m_maskIteration++;
+    }
+
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
     {
         Matrix<ElemType> sliceInput0Value = Input(0)->ValueFor(fr);
@@ -1475,7 +2259,13 @@ public:
 
         if (Environment().IsInferring() || m_dropoutRate <= 0)
         {
-            sliceOutputValue.SetValue(sliceInput0Value);
+            if (ValuePtr() != Input(0)->ValuePtr()) // (nothing to do in place)
+                sliceOutputValue.SetValue(sliceInput0Value);
+        }
+        else if (m_statelessMask)
+        {
+            // apply dropout mask, which is a function of (seed, minibatch, element) and is not stored
+            sliceOutputValue.AddDropoutOf(sliceInput0Value, (ElemType) m_dropoutRate, (ElemType) (1.0 / (1.0 - m_dropoutRate)) /*pre-scaled*/, MaskKey(), MaskOffset(fr), /*beta=*/0);
         }
         else
         {
@@ -1509,6 +2299,13 @@ public:
         m_RNGHandle = nullptr;
     }
 
+    // Stateless mode: the mask comes from a counter-based RNG (Philox) keyed by the seed and the minibatch, and
+    // backprop regenerates it instead of keeping it in a buffer the size of the activation.
+    void SetStatelessMask(bool statelessMask)
+    {
+        m_statelessMask = statelessMask;
+    }
+
     RNGHandle& GetRNGHandle()
     {
         if (m_RNGHandle == nullptr) 
@@ -1526,6 +2323,8 @@ public:
             node->m_dropoutRate = m_dropoutRate;
             node->m_randomSeed = m_randomSeed;
             node->m_maskOfDropout = m_maskOfDropout;
+            node->m_statelessMask = m_statelessMask;
+            node->m_maskIteration = m_maskIteration;
         }
     }
     // request matrices needed to do node function value evaluation
@@ -1545,10 +2344,21 @@ public:
     double GetDropoutRate() const { return m_dropoutRate; }
 
 private:
+    uint64_t MaskKey() const { return PhiloxKey((uint32_t) m_randomSeed, (uint32_t) m_maskIteration); }
+
+    // index of the first element of the frame range in the stream of the minibatch
+    size_t MaskOffset(const FrameRange& fr) const
+    {
+        return ColumnRangeWithMBLayoutFor(Value().GetNumCols(), fr, GetMBLayout()).first * Value().GetNumRows();
+    }
+
     double m_dropoutRate;
     unsigned long m_randomSeed;
     std::shared_ptr<RNGHandle> m_RNGHandle;
 
+    bool m_statelessMask;
+    size_t m_maskIteration; // minibatches seen in stateless mode
+
     shared_ptr<Matrix<ElemType>> m_maskOfDropout;
 };
 
@@ -1907,6 +2717,37 @@ public:
     }
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    virtual bool CanRecomputeValue() const override { return false; } // ForwardProp() updates the running statistics
+    virtual bool CanBeCapturedInGPUGraph() const override { return false; } // the blend factors depend on the number of samples seen
+
+    // In inference mode, the node computes output = a .* input + b with one (a, b) per map if spatial, else per element.
+    // Get those, unless there are no running statistics yet. See ComputationNetwork::FoldNodesForInference().
+    bool GetInferenceTransform(std::vector<ElemType>& a, std::vector<ElemType>& b)
+    {
+        if (m_samplesSeen == 0 || m_convertRunningVariancePending || m_postBatchNormalization)
+            return false;
+        auto getValues = [this](size_t inputIndex)
+        {
+            const auto& value = Input(inputIndex)->Value();
+            std::unique_ptr<ElemType[]> data(value.CopyToArray());
+            return std::vector<ElemType>(data.get(), data.get() + value.GetNumElements());
+        };
+        auto scale = getValues(1);
+        auto bias = getValues(2);
+        auto runMean = getValues(3);
+        auto runVariance = getValues(4);
+        a.resize(scale.size());
+        b.resize(scale.size());
+        for (size_t i = 0; i < scale.size(); i++)
+        {
+            a[i] = (ElemType) (scale[i] / sqrt(runVariance[i] + m_epsilon)); // (as in CPUMatrix::BatchNormalizationForward())
+            b[i] = bias[i] - a[i] * runMean[i];
+        }
+        return true;
+    }
+
+    bool IsSpatial() const { return m_spatial; }
+    ImageLayoutKind GetImageLayoutKind() const { return m_imageLayoutKind; }
 
     void Validate(bool isFinalValidationPass) override
     {
@@ -1927,7 +2768,8 @@ public:
             auto paramLayout = Input(i)->GetSampleLayout();
             if (paramLayout.GetRank() == 2 && paramLayout[0] == 0 && paramLayout[1] == 1 && inputLayout.GetNumElements() > 0) // [0 x 1]
             {
-                size_t total = m_spatial ? inputLayout.GetDims().back() : inputLayout.GetNumElements();
+                size_t total = !m_spatial ? inputLayout.GetNumElements() :
+                               m_imageLayoutKind == HWC ? inputLayout[0] : inputLayout.GetDims().back();
                 Input(i)->ValidateInferInputDimsFrom(TensorShape(total, 1));
             }
         }
@@ -1972,11 +2814,12 @@ public:
                         InvalidArgument("%ls: Data input cannot broadcast.", NodeDescription().c_str());
 #endif
             }
-            if (m_spatial && m_imageLayoutKind != CHW)
+            // The cuDNN engine runs the legacy layout as NHWC tensors, the CNTK engine knows only CHW.
+            if (m_spatial && m_imageLayoutKind != CHW && m_useCntkEngine)
             {
                 InvalidArgument(
-                    "%ls %ls currently supports only cuDNN (CHW) data layout. " 
-                    "Please specify imageLayout=\"cudnn\" in BatchNormalization node in your NDL/BrainScript "
+                    "%ls %ls currently supports only cuDNN (CHW) data layout with the CNTK engine. " 
+                    "Please specify imageLayout=\"cudnn\" (or useCntkEngine=false) in BatchNormalization node in your NDL/BrainScript "
                     "and make sure your input data layout is CHW", NodeName().c_str(), OperationName().c_str());
             }
             double cudnnMinEps = 1e-5; // CUDNN_BN_MIN_EPSILON
@@ -2043,6 +2886,10 @@ public:
     double Epsilon() const { return m_epsilon; }
     bool UseCNTKEngine() const { return m_useCntkEngine; }
 
+    // the number of samples the running statistics are based on, e.g. for SGD to roll back trial minibatches
+    size_t SamplesSeen() const { return m_samplesSeen; }
+    void SetSamplesSeen(size_t samplesSeen) { m_samplesSeen = samplesSeen; }
+
     void SetPostBatchNormalizationBegin()
     {
         m_postBatchNormalization = true;
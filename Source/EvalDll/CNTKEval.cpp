@@ -27,6 +27,8 @@
 #include "NoRandomizer.h"
 #include "HeapMemoryProvider.h"
 #include "InputAndParamNodes.h"
+#include "RecurrentNodes.h"
+#include "LinearAlgebraNodes.h"
 #include "latticearchive.h"
 #include <limits>
 
@@ -63,6 +65,64 @@ void CNTKEvalBase<ElemType>::CreateNetwork(const std::string& networkDescription
     {
         LogicError("Unable to construct network from description");
     }
+
+    // optionally let the first StartForwardEvaluation() delete what its outputs do not need, e.g. criteria and labels
+    m_removeUnusedNodes = config(L"removeUnusedNodes", false);
+
+    // optional sparse products with pruned weight matrices, before the quantization of the others
+    if (config.Exists(L"sparseTimesMinSparsity"))
+        SparsifyTimesNodes(config(L"sparseTimesMinSparsity"));
+
+    // optional integer arithmetic for the products with weight matrices
+    size_t quantizedTimesBits = config(L"quantizedTimesBits", (size_t) 0);
+    if (quantizedTimesBits > 0)
+        QuantizeTimesNodes(quantizedTimesBits);
+}
+
+// QuantizeTimesNodes - quantize the weights of all products with a LearnableParameter, see TimesNodeBase::QuantizeLeftArgument()
+template <typename ElemType>
+void CNTKEvalBase<ElemType>::QuantizeTimesNodes(size_t numBits)
+{
+    if (this->m_net->GetDeviceId() != CPUDEVICE)
+        InvalidArgument("quantizedTimesBits: Quantized products are only implemented for the CPU (deviceId=-1).");
+
+    auto nodes = this->m_net->GetNodesWithType(OperationNameOf(TimesNode));
+    size_t numQuantized = 0;
+    for (const auto& node : nodes)
+    {
+        if (node->Input(0)->OperationName() != OperationNameOf(LearnableParameter))
+            continue;
+        auto timesNode = dynamic_pointer_cast<TimesNode<ElemType>>(node);
+        if (timesNode && timesNode->QuantizeLeftArgument(numBits))
+            numQuantized++;
+    }
+    fprintf(stderr, "CNTKEval: Quantized the weights of %d of %d Times operations to %d bits.\n", (int) numQuantized, (int) nodes.size(), (int) numBits);
+}
+
+// SparsifyTimesNodes - multiply with sparse copies of the weights of all products with a LearnableParameter of which
+// at least the fraction 'minSparsity' is 0, see TimesNodeBase::SparsifyLeftArgument()
+template <typename ElemType>
+void CNTKEvalBase<ElemType>::SparsifyTimesNodes(double minSparsity)
+{
+    if (minSparsity < 0 || minSparsity > 1)
+        InvalidArgument("sparseTimesMinSparsity: The fraction of zero weights (%f) must be in [0, 1].", minSparsity);
+
+    size_t numNodes = 0, numSparse = 0;
+    for (const auto& node : this->m_net->GetNodesWithType(OperationNameOf(TimesNode)))
+    {
+        numNodes++;
+        auto timesNode = dynamic_pointer_cast<TimesNode<ElemType>>(node);
+        if (timesNode && node->Input(0)->OperationName() == OperationNameOf(LearnableParameter) && timesNode->SparsifyLeftArgument(minSparsity))
+            numSparse++;
+    }
+    for (const auto& node : this->m_net->GetNodesWithType(OperationNameOf(TransposeTimesNode)))
+    {
+        numNodes++;
+        auto timesNode = dynamic_pointer_cast<TransposeTimesNode<ElemType>>(node);
+        if (timesNode && node->Input(0)->OperationName() == OperationNameOf(LearnableParameter) && timesNode->SparsifyLeftArgument(minSparsity))
+            numSparse++;
+    }
+    fprintf(stderr, "CNTKEval: Multiplying with sparse weights in %d of %d Times operations (at least %.0f%% zeros).\n", (int) numSparse, (int) numNodes, minSparsity * 100);
 }
 
 
@@ -262,6 +322,12 @@ void CNTKEvalExtended<ElemType>::StartForwardEvaluation(const std::vector<wstrin
 {
     m_scopedNetworkOperationMode = make_shared<ScopedNetworkOperationMode>(this->m_net, NetworkOperationMode::inferring);
     m_outputNodes  = this->m_net->OutputNodesByName(outputNodeNames);
+    if (this->m_removeUnusedNodes && !m_started)
+    {
+        // (later calls can only ask for outputs that are left)
+        this->m_net->RemoveNodesNotNeededFor(m_outputNodes);
+        this->m_net->CompileNetwork();
+    }
     m_inputNodes = this->m_net->InputNodesForOutputs(outputNodeNames);
     // allocate memory for forward computation
     this->m_net->AllocateAllMatrices({}, m_outputNodes, nullptr);
@@ -275,9 +341,122 @@ void CNTKEvalExtended<ElemType>::StartForwardEvaluation(const std::vector<wstrin
             RuntimeError("Sparse outputs are not supported by this API.");
     }
 
+    // the recurrent state for ForwardPassStreams()
+    std::set<ComputationNodeBasePtr> pastValueNodes;
+    m_hasFutureValueNodes = false;
+    for (const auto& node : m_outputNodes)
+    {
+        for (const auto& pastValueNode : this->m_net->GetNodesWithType(OperationNameOf(PastValueNode), node))
+            pastValueNodes.insert(pastValueNode);
+        m_hasFutureValueNodes |= !this->m_net->GetNodesWithType(OperationNameOf(FutureValueNode), node).empty();
+    }
+    m_pastValueNodes.assign(pastValueNodes.begin(), pastValueNodes.end());
+    m_streamStates.clear();
+    for (const auto& node : m_pastValueNodes)
+        m_streamStates.push_back(make_shared<Matrix<ElemType>>(node->GetSampleLayout().GetNumElements(), 0, node->GetDeviceId()));
+    m_streamNumFrames.clear();
+    m_freeStreams.clear();
+
+    m_options = ForwardEvaluationOptions();
+    m_computeStream.reset();
+    m_preallocated = false;
     m_started = true;
 }
 
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::StartForwardEvaluation(const std::vector<wstring>& outputNodeNames, const ForwardEvaluationOptions& options)
+{
+    if (options.m_maxBatchSize == 0 || options.m_maxSequenceLength == 0)
+        InvalidArgument("StartForwardEvaluation: The maximum batch size and sequence length must be at least 1.");
+
+    StartForwardEvaluation(outputNodeNames);
+    m_options = options;
+    if (m_options.m_ownComputeStream)
+        m_computeStream.reset(MatrixComputeStream::Create(this->m_net->GetDeviceId()));
+    BeginCall();
+    auto endCall = MakeScopeExit([this]() { EndCall(); });
+    Warmup();
+    m_preallocated = true;
+}
+
+// Around each call: its work goes to the stream of the evaluator, and its buffers back to the allocator after it,
+// as the options ask for. The public calls have copied their outputs to the caller by then, which waits for the stream.
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::BeginCall()
+{
+    if (m_computeStream)
+        m_computeStream->Begin();
+}
+
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::EndCall()
+{
+    if (m_computeStream)
+        m_computeStream->End();
+    if (m_options.m_releaseBuffersAfterCall)
+        this->m_net->ReleaseMatrixPoolMemory();
+}
+
+// Matrix buffers, and device buffers that did not come from the cache of the allocator.
+template<typename ElemType>
+/*static*/ size_t CNTKEvalExtended<ElemType>::GetNumAllocations()
+{
+    return MatrixResizePolicy::GetNumAllocations() + TracingGPUMemoryAllocator::GetNumDeviceMallocs();
+}
+
+template<typename ElemType>
+size_t CNTKEvalExtended<ElemType>::GetNumAllocationsSinceWarmup() const
+{
+    if (!m_preallocated)
+        RuntimeError("GetNumAllocationsSinceWarmup() called without the preallocation of StartForwardEvaluation()");
+    return GetNumAllocations() - m_numAllocationsAtWarmup;
+}
+
+// Forward passes over zero inputs of the largest shapes, as parallel sequences: the node values and the buffers of the
+// MatrixPool grow to what any call within the shapes needs (matrices keep their capacity when resized to less, see
+// MatrixResizePolicy), as do the staging buffers, the layouts and the workspaces of the libraries. All but the first
+// sequence are one sample shorter, so that the masks of the gaps are allocated as well.
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::Warmup()
+{
+    const size_t numSequences = m_options.m_maxBatchSize;
+    const size_t maxLength = m_options.m_maxSequenceLength;
+    std::vector<std::vector<ElemType>> inputData(m_inputNodes.size() * 2); // [2 * i] full length, [2 * i + 1] shorter
+    std::vector<ValueRefs<ElemType>> inputs(numSequences, ValueRefs<ElemType>(m_inputNodes.size()));
+    for (size_t i = 0; i < m_inputNodes.size(); ++i)
+    {
+        auto matrix = dynamic_pointer_cast<Matrix<ElemType>>(m_inputNodes[i]->ValuePtr());
+        if (matrix->GetMatrixType() != MatrixType::DENSE)
+            RuntimeError("StartForwardEvaluation: Input %ls is sparse; the preallocation requires dense inputs.", m_inputNodes[i]->GetName().c_str());
+        const size_t numRows = m_inputNodes[i]->GetSampleLayout().GetNumElements();
+        inputData[2 * i].assign(numRows * maxLength, 0);
+        inputData[2 * i + 1].assign(numRows * max(maxLength - 1, (size_t) 1), 0);
+        for (size_t s = 0; s < numSequences; ++s)
+            inputs[s][i].m_buffer.InitFrom(inputData[2 * i + (s > 0 ? 1 : 0)]);
+    }
+    if (MatrixResizePolicy::GetShrinkThreshold() > 0)
+        fprintf(stderr, "WARNING: StartForwardEvaluation: With a matrix shrink threshold of %g, smaller calls may still reallocate buffers.\n", MatrixResizePolicy::GetShrinkThreshold());
+
+    std::vector<ValueRefs<ElemType>> outputs; // (left on the device)
+    size_t numAllocationsBeforePass = 0;
+    for (size_t pass = 0; pass < m_options.m_numWarmupPasses; ++pass)
+    {
+        numAllocationsBeforePass = GetNumAllocations();
+        SetParallelSequenceInputs(inputs, outputs, std::vector<ptrdiff_t>(numSequences, 0), "StartForwardEvaluation");
+        ForwardParallelSequences(outputs);
+    }
+
+    size_t maxOutputElements = 0;
+    for (const auto& node : m_outputNodes)
+        maxOutputElements = max(maxOutputElements, dynamic_pointer_cast<Matrix<ElemType>>(node->ValuePtr())->GetNumElements());
+    m_outputStaging.reserve(maxOutputElements);
+
+    m_numAllocationsAtWarmup = GetNumAllocations();
+    if (m_options.m_numWarmupPasses > 1 && m_numAllocationsAtWarmup != numAllocationsBeforePass)
+        fprintf(stderr, "WARNING: StartForwardEvaluation: The last warmup pass still allocated %d buffers; later calls of the same shapes may, too.\n",
+                (int) (m_numAllocationsAtWarmup - numAllocationsBeforePass));
+}
+
 template<typename ElemType>
 VariableSchema CNTKEvalExtended<ElemType>::GetOutputSchema() const
 {
@@ -321,6 +500,21 @@ void CNTKEvalExtended<ElemType>::ForwardPassT(const std::vector<ValueBuffer<Elem
     if (outputs.size() != m_outputNodes.size())
         RuntimeError("Expected %d outputs, but got %d.", (int)m_outputNodes.size(), (int)outputs.size());
 
+    BeginCall();
+    auto endCall = MakeScopeExit([this]() { EndCall(); });
+
+    // Dense inputs on the CPU are bound to the caller's buffers for the duration of this call, instead of being copied.
+    // Unbind them when done, as the buffers may be gone by the next call.
+    auto unbindInputs = MakeScopeExit([&]()
+    {
+        for (auto& inputNode : m_inputNodes)
+        {
+            auto matrix = dynamic_pointer_cast<Matrix<ElemType>>(inputNode->ValuePtr());
+            if (matrix->GetMatrixType() == MatrixType::DENSE && matrix->GetDeviceId() == CPUDEVICE)
+                matrix->SetValue(0, 0, CPUDEVICE, nullptr, matrixFlagNormal);
+        }
+    });
+
     size_t i = 0;
     for (auto& inputNode : m_inputNodes)
     {
@@ -364,7 +558,9 @@ void CNTKEvalExtended<ElemType>::ForwardPassT(const std::vector<ValueBuffer<Elem
         // INT_MIN is used to specify the lower bound of look-back step of recurrent nodes
         inputNode->GetMBLayout()->AddSequence(0, 0, resetRNN ? 0 : INT_MIN, numCols);
 
-        if (type == MatrixType::DENSE)
+        if (type == MatrixType::DENSE && matrix->GetDeviceId() == CPUDEVICE)
+            matrix->SetValue(numRows, numCols, CPUDEVICE, buffer.m_buffer.data(), matrixFlagDontOwnBuffer);
+        else if (type == MatrixType::DENSE)
             matrix->SetValue(numRows, numCols, matrix->GetDeviceId(), buffer.m_buffer.data(), matrixFlagNormal);
         else if (type == MatrixType::SPARSE)
         {
@@ -435,6 +631,523 @@ void CNTKEvalExtended<ElemType>::ForwardPass(const ValueRefs<ElemType>& inputs,
     ForwardPassT(inputs, outputs, resetRNN);
 }
 
+// Lay out the inputs of several sequences as the parallel sequences of one minibatch: frame t of sequence s is column
+// t * numSequences + s. Sequence s begins at time beginTimes[s], which is negative if it continues an earlier one.
+// Inputs that share a dynamic axis (MBLayout) must agree in the sequence lengths; returns the lengths for each.
+// 'outputs' may be empty if the outputs are to stay on the device (see ForwardParallelSequences()).
+template<typename ElemType>
+std::map<MBLayoutPtr, std::vector<size_t>> CNTKEvalExtended<ElemType>::SetParallelSequenceInputs(const std::vector<ValueRefs<ElemType>>& inputs, const std::vector<ValueRefs<ElemType>>& outputs,
+                                                                                                 const std::vector<ptrdiff_t>& beginTimes, const char* function)
+{
+    if (!m_started)
+        RuntimeError("%s() called before StartForwardEvaluation()", function);
+
+    const size_t numSequences = inputs.size();
+    if (numSequences == 0 || (!outputs.empty() && outputs.size() != numSequences))
+        RuntimeError("Expected inputs and outputs for the same, non-zero number of sequences, but got %d and %d.", (int)numSequences, (int)outputs.size());
+    for (size_t s = 0; s < numSequences; ++s)
+    {
+        if (inputs[s].size() != m_inputNodes.size())
+            RuntimeError("Sequence %d: Expected %d inputs, but got %d.", (int)s, (int)m_inputNodes.size(), (int)inputs[s].size());
+        if (!outputs.empty() && outputs[s].size() != m_outputNodes.size())
+            RuntimeError("Sequence %d: Expected %d outputs, but got %d.", (int)s, (int)m_outputNodes.size(), (int)outputs[s].size());
+    }
+
+    std::map<MBLayoutPtr, std::vector<size_t>> layoutLengths;
+    std::vector<ElemType>& data = m_inputStaging;
+    for (size_t i = 0; i < m_inputNodes.size(); ++i)
+    {
+        auto& inputNode = m_inputNodes[i];
+        auto matrix = dynamic_pointer_cast<Matrix<ElemType>>(inputNode->ValuePtr());
+        if (matrix->GetMatrixType() != MatrixType::DENSE)
+            RuntimeError("Input %ls: Sparse inputs are not supported by %s().", inputNode->GetName().c_str(), function);
+        size_t numRows = inputNode->GetSampleLayout().GetNumElements();
+
+        std::vector<size_t> lengths(numSequences);
+        size_t maxLength = 0;
+        for (size_t s = 0; s < numSequences; ++s)
+        {
+            const auto& buffer = inputs[s][i].m_buffer;
+            if (buffer.data() == nullptr)
+                RuntimeError("Input %ls, sequence %d: Buffer is not allocated.", inputNode->GetName().c_str(), (int)s);
+            if (buffer.size() == 0 || buffer.size() % numRows != 0)
+                RuntimeError("Input %ls, sequence %d: Expected input data to be a non-zero multiple of %" PRIu64 ", but it is %" PRIu64 ".",
+                             inputNode->GetName().c_str(), (int)s, numRows, buffer.size());
+            lengths[s] = buffer.size() / numRows;
+            maxLength = max(maxLength, lengths[s]);
+        }
+
+        auto pMBLayout = inputNode->GetMBLayout();
+        auto known = layoutLengths.find(pMBLayout);
+        if (known == layoutLengths.end())
+        {
+            pMBLayout->Init(numSequences, maxLength);
+            for (size_t s = 0; s < numSequences; ++s)
+            {
+                pMBLayout->AddSequence(s, s, beginTimes[s], lengths[s]);
+                if (lengths[s] < maxLength)
+                    pMBLayout->AddGap(s, lengths[s], maxLength);
+            }
+            layoutLengths[pMBLayout] = lengths;
+        }
+        else if (known->second != lengths)
+            RuntimeError("Input %ls: Sequence lengths differ from those of another input with the same dynamic axis.", inputNode->GetName().c_str());
+
+        data.assign(numRows * numSequences * maxLength, 0); // gaps are zero
+        for (size_t s = 0; s < numSequences; ++s)
+        {
+            const ElemType* source = inputs[s][i].m_buffer.data();
+            for (size_t t = 0; t < lengths[s]; ++t)
+                memcpy(&data[(t * numSequences + s) * numRows], source + t * numRows, numRows * sizeof(ElemType));
+        }
+        matrix->SetValue(numRows, numSequences * maxLength, matrix->GetDeviceId(), data.data(), matrixFlagNormal);
+    }
+
+    ComputationNetwork::BumpEvalTimeStamp(m_inputNodes);
+    return layoutLengths;
+}
+
+// Evaluate the outputs for the inputs set by SetParallelSequenceInputs(), and scatter their columns to the sequences.
+// An output without a dynamic axis goes to every sequence. If 'outputs' is empty, the values stay on the device.
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::ForwardParallelSequences(std::vector<ValueRefs<ElemType>>& outputs)
+{
+    std::vector<ElemType>& data = m_outputStaging;
+    for (size_t o = 0; o < m_outputNodes.size(); ++o)
+    {
+        auto node = m_outputNodes[o];
+        this->m_net->ForwardProp(node);
+        if (outputs.empty())
+            continue;
+        shared_ptr<Matrix<ElemType>> outputMatrix = dynamic_pointer_cast<Matrix<ElemType>>(node->ValuePtr());
+        size_t numRows = outputMatrix->GetNumRows();
+        size_t numElements = outputMatrix->GetNumElements();
+        data.resize(numElements);
+        ElemType* copy = data.data();
+        outputMatrix->CopyToArray(copy, numElements);
+
+        auto pMBLayout = node->GetMBLayout();
+        for (size_t s = 0; s < outputs.size(); ++s)
+        {
+            auto& vec = outputs[s][o].m_buffer;
+            if (!pMBLayout)
+            {
+                if (vec.capacity() < numElements)
+                    RuntimeError("Sequence %d: Not enough space in output buffer for output '%ls'.", (int)s, node->GetName().c_str());
+                vec.resize(numElements);
+                memcpy(vec.data(), copy, numElements * sizeof(ElemType));
+                continue;
+            }
+
+            const MBLayout::SequenceInfo* seq = nullptr;
+            for (const auto& candidate : pMBLayout->GetAllSequences())
+                if (candidate.seqId == s)
+                    seq = &candidate;
+            if (!seq)
+                RuntimeError("Output '%ls': Sequence %d is missing.", node->GetName().c_str(), (int)s);
+            size_t begin = (size_t)max(seq->tBegin, (ptrdiff_t)0);
+            size_t end = min(seq->tEnd, pMBLayout->GetNumTimeSteps());
+            if (vec.capacity() < (end - begin) * numRows)
+                RuntimeError("Sequence %d: Not enough space in output buffer for output '%ls'.", (int)s, node->GetName().c_str());
+            vec.resize((end - begin) * numRows);
+            for (size_t t = begin; t < end; ++t)
+                memcpy(vec.data() + (t - begin) * numRows, copy + (t * pMBLayout->GetNumParallelSequences() + seq->s) * numRows, numRows * sizeof(ElemType));
+        }
+    }
+}
+
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::ForwardPassBatch(const std::vector<ValueRefs<ElemType>>& inputs, std::vector<ValueRefs<ElemType>>& outputs)
+{
+    BeginCall();
+    auto endCall = MakeScopeExit([this]() { EndCall(); });
+    SetParallelSequenceInputs(inputs, outputs, std::vector<ptrdiff_t>(inputs.size(), 0), "ForwardPassBatch");
+    ForwardParallelSequences(outputs);
+}
+
+template<typename ElemType>
+size_t CNTKEvalExtended<ElemType>::CreateStreamState()
+{
+    if (!m_started)
+        RuntimeError("CreateStreamState() called before StartForwardEvaluation()");
+    if (m_hasFutureValueNodes)
+        RuntimeError("CreateStreamState: Models that look into the future (FutureValue) cannot be evaluated as streams.");
+
+    size_t stream;
+    if (!m_freeStreams.empty())
+    {
+        stream = m_freeStreams.back();
+        m_freeStreams.pop_back();
+    }
+    else
+    {
+        stream = m_streamNumFrames.size();
+        m_streamNumFrames.push_back(0);
+    }
+    m_streamNumFrames[stream] = 0; // (a new stream has no history)
+
+    // grow the state stores geometrically
+    for (size_t i = 0; i < m_pastValueNodes.size(); ++i)
+    {
+        const auto& node = m_pastValueNodes[i];
+        auto delayNode = dynamic_pointer_cast<DelayedValueNodeBase<ElemType, -1>>(node);
+        auto& states = m_streamStates[i];
+        size_t timeStep = delayNode->TimeStep();
+        size_t capacity = states->GetNumCols() / timeStep;
+        if (stream < capacity)
+            continue;
+        size_t numRows = node->GetSampleLayout().GetNumElements();
+        auto grown = make_shared<Matrix<ElemType>>(numRows, max(2 * capacity, (size_t)1) * timeStep, node->GetDeviceId());
+        grown->SetValue(0);
+        if (capacity > 0)
+            grown->SetColumnSlice(*states, 0, states->GetNumCols());
+        states = grown;
+    }
+    return stream;
+}
+
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::ReleaseStreamState(size_t stream)
+{
+    if (stream >= m_streamNumFrames.size() || m_streamNumFrames[stream] == SIZE_MAX)
+        RuntimeError("ReleaseStreamState: Invalid stream state %d.", (int)stream);
+    m_streamNumFrames[stream] = SIZE_MAX;
+    m_freeStreams.push_back(stream);
+}
+
+// The state of a stream is the last TimeStep() inputs of each PastValue node. Before the forward pass, they are
+// gathered from the state stores into the delayed value of each node, as if they were the end of a previous
+// minibatch with the same parallel sequences. After it, the last frames of each stream, which may partly still
+// come from that history if the chunk is short, are gathered and scattered back into the stores.
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::ForwardPassStreams(const std::vector<size_t>& streams, const std::vector<ValueRefs<ElemType>>& inputs, std::vector<ValueRefs<ElemType>>& outputs)
+{
+    if (outputs.size() != streams.size())
+        RuntimeError("ForwardPassStreams: Expected outputs for %d streams, but got %d.", (int)streams.size(), (int)outputs.size());
+    BeginCall();
+    auto endCall = MakeScopeExit([this]() { EndCall(); });
+    ForwardStreams(streams, inputs, outputs);
+}
+
+// ForwardPassStreams(), where 'outputs' may be empty to leave the values of the outputs on the device
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::ForwardStreams(const std::vector<size_t>& streams, const std::vector<ValueRefs<ElemType>>& inputs, std::vector<ValueRefs<ElemType>>& outputs)
+{
+    const size_t numSequences = streams.size();
+    if (inputs.size() != numSequences)
+        RuntimeError("ForwardPassStreams: Expected inputs for %d streams, but got %d.", (int)numSequences, (int)inputs.size());
+    std::vector<ptrdiff_t> beginTimes(numSequences);
+    for (size_t s = 0; s < numSequences; ++s)
+    {
+        if (streams[s] >= m_streamNumFrames.size() || m_streamNumFrames[streams[s]] == SIZE_MAX)
+            RuntimeError("ForwardPassStreams: Invalid stream state %d.", (int)streams[s]);
+        if (std::count(streams.begin(), streams.end(), streams[s]) != 1)
+            RuntimeError("ForwardPassStreams: Stream state %d is given more than once.", (int)streams[s]);
+        beginTimes[s] = -(ptrdiff_t)m_streamNumFrames[streams[s]];
+    }
+
+    auto layoutLengths = SetParallelSequenceInputs(inputs, outputs, beginTimes, "ForwardPassStreams");
+    if (layoutLengths.size() != 1)
+        RuntimeError("ForwardPassStreams: All inputs must share one dynamic axis.");
+    const MBLayoutPtr& pMBLayout = layoutLengths.begin()->first;
+    const std::vector<size_t>& lengths = layoutLengths.begin()->second;
+
+    // column maps, one per distinct time step: [t * numSequences + s] -> column of frame t of sequence s in the state
+    // store, in this minibatch, or in the history (-1: none)
+    typedef std::map<int, shared_ptr<Matrix<ElemType>>> ColumnMaps;
+    ColumnMaps storeMaps, fromMinibatchMaps, fromHistoryMaps;
+    std::vector<ElemType> map;
+    auto getMap = [&](ColumnMaps& maps, int timeStep, DEVICEID_TYPE deviceId, const std::function<ptrdiff_t(size_t, size_t)>& column) -> const Matrix<ElemType>&
+    {
+        auto& columnMap = maps[timeStep];
+        if (!columnMap)
+        {
+            map.resize(timeStep * numSequences);
+            for (size_t t = 0; t < (size_t)timeStep; ++t)
+                for (size_t s = 0; s < numSequences; ++s)
+                    map[t * numSequences + s] = (ElemType)column(t, s);
+            columnMap = make_shared<Matrix<ElemType>>(1, map.size(), map.data(), deviceId);
+        }
+        return *columnMap;
+    };
+
+    std::vector<shared_ptr<Matrix<ElemType>>> histories;
+    for (size_t i = 0; i < m_pastValueNodes.size(); ++i)
+    {
+        const auto& node = m_pastValueNodes[i];
+        auto delayNode = dynamic_pointer_cast<DelayedValueNodeBase<ElemType, -1>>(node);
+        int timeStep = delayNode->TimeStep();
+        if (node->GetMBLayout() != pMBLayout)
+            RuntimeError("ForwardPassStreams: %ls must have the dynamic axis of the inputs.", node->NodeDescription().c_str());
+
+        auto historyLayout = make_shared<MBLayout>(numSequences, timeStep, L"");
+        for (size_t s = 0; s < numSequences; ++s)
+        {
+            size_t numFrames = m_streamNumFrames[streams[s]];
+            if (numFrames > 0)
+                historyLayout->AddSequence(s, s, (ptrdiff_t)timeStep - (ptrdiff_t)numFrames, timeStep);
+            else
+                historyLayout->AddGap(s, 0, timeStep);
+        }
+        histories.push_back(make_shared<Matrix<ElemType>>(node->GetDeviceId()));
+        histories.back()->DoGatherColumnsOf(0, getMap(storeMaps, timeStep, node->GetDeviceId(), [&](size_t t, size_t s) { return (ptrdiff_t)(streams[s] * timeStep + t); }),
+                                            *m_streamStates[i], 1);
+        delayNode->SetDelayedValue(*histories.back(), historyLayout);
+    }
+
+    ForwardParallelSequences(outputs);
+
+    for (size_t i = 0; i < m_pastValueNodes.size(); ++i)
+    {
+        const auto& node = m_pastValueNodes[i];
+        auto delayNode = dynamic_pointer_cast<DelayedValueNodeBase<ElemType, -1>>(node);
+        int timeStep = delayNode->TimeStep();
+        // frame t of the new state of sequence s is its frame lengths[s] - timeStep + t in this minibatch,
+        // or, if that is negative, frame lengths[s] + t of the history
+        auto fromMinibatch = [&](size_t t, size_t s) { ptrdiff_t tm = (ptrdiff_t)lengths[s] - timeStep + t; return tm >= 0 ? tm * (ptrdiff_t)numSequences + (ptrdiff_t)s : -1; };
+        auto fromHistory   = [&](size_t t, size_t s) { ptrdiff_t th = (ptrdiff_t)lengths[s] + t; return th < timeStep ? th * (ptrdiff_t)numSequences + (ptrdiff_t)s : -1; };
+        Matrix<ElemType> state(node->GetSampleLayout().GetNumElements(), timeStep * numSequences, node->GetDeviceId());
+        state.SetValue(0);
+        state.DoGatherColumnsOf(1, getMap(fromMinibatchMaps, timeStep, node->GetDeviceId(), fromMinibatch), delayNode->DelayedValue(), 1);
+        state.DoGatherColumnsOf(1, getMap(fromHistoryMaps, timeStep, node->GetDeviceId(), fromHistory), *histories[i], 1);
+        // overwrite the stream's columns of the store: subtracting what was gathered from them clears them exactly
+        // (scattering with beta = 0 would clear the whole store)
+        const auto& storeMap = getMap(storeMaps, timeStep, node->GetDeviceId(), nullptr); // (made above)
+        m_streamStates[i]->DoScatterColumnsOf(1, storeMap, *histories[i], -1);
+        m_streamStates[i]->DoScatterColumnsOf(1, storeMap, state, 1);
+    }
+
+    for (size_t s = 0; s < numSequences; ++s)
+        m_streamNumFrames[streams[s]] += lengths[s];
+}
+
+// Make the states of the streams 'to' copies of those of the streams 'from', on the device. The two may overlap, as
+// when the hypotheses of a beam are reordered, but no stream may be given twice in 'to'.
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::CopyStreamStates(const std::vector<size_t>& from, const std::vector<size_t>& to)
+{
+    std::vector<ElemType> fromColumns, toColumns;
+    for (size_t i = 0; i < m_pastValueNodes.size(); ++i)
+    {
+        const auto& node = m_pastValueNodes[i];
+        size_t timeStep = dynamic_pointer_cast<DelayedValueNodeBase<ElemType, -1>>(node)->TimeStep();
+        fromColumns.clear();
+        toColumns.clear();
+        for (size_t s = 0; s < from.size(); ++s)
+        {
+            for (size_t t = 0; t < timeStep; ++t)
+            {
+                fromColumns.push_back((ElemType)(from[s] * timeStep + t));
+                toColumns.push_back((ElemType)(to[s] * timeStep + t));
+            }
+        }
+        Matrix<ElemType> fromMap(1, fromColumns.size(), fromColumns.data(), node->GetDeviceId());
+        Matrix<ElemType> toMap(1, toColumns.size(), toColumns.data(), node->GetDeviceId());
+        Matrix<ElemType> copied(node->GetDeviceId()), overwritten(node->GetDeviceId());
+        copied.DoGatherColumnsOf(0, fromMap, *m_streamStates[i], 1);
+        overwritten.DoGatherColumnsOf(0, toMap, *m_streamStates[i], 1);
+        // as in ForwardStreams(), subtracting what is there clears the columns exactly
+        m_streamStates[i]->DoScatterColumnsOf(1, toMap, overwritten, -1);
+        m_streamStates[i]->DoScatterColumnsOf(1, toMap, copied, 1);
+    }
+
+    std::vector<size_t> numFrames;
+    for (size_t stream : from)
+        numFrames.push_back(m_streamNumFrames[stream]);
+    for (size_t s = 0; s < to.size(); ++s)
+        m_streamNumFrames[to[s]] = numFrames[s];
+}
+
+// Each sentence has m_beamWidth streams, of which its live hypotheses occupy the first ones. A step evaluates the
+// last token of all live hypotheses in one minibatch, leaving the log-probabilities on the device. There they are
+// gathered into m_beamWidth slots per sentence, [vocabulary x slots], and the score of the hypothesis of each slot
+// (-inf for empty slots) is added to its column, so that the columns of a sentence, seen as one of
+// vocabulary * m_beamWidth rows, hold the scores of all its candidates, of which VectorMax() selects the best
+// 2 * m_beamWidth. Only these are copied back. The new live hypotheses are the best ones that do not end, and their
+// streams get the states of the streams of the hypotheses they extend.
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::BeamSearch(const std::vector<ValueRefs<ElemType>>& sources, const BeamSearchOptions& options, std::vector<std::vector<BeamSearchHypothesis>>& results)
+{
+    if (!m_started)
+        RuntimeError("BeamSearch() called before StartForwardEvaluation()");
+    if (m_outputNodes.size() != 1 || !m_outputNodes[0]->HasMBLayout())
+        RuntimeError("BeamSearch: Expected a single output with a dynamic axis, the log-probabilities of the next token.");
+    const auto& outputNode = m_outputNodes[0];
+    const size_t vocabularySize = outputNode->GetSampleLayout().GetNumElements();
+    auto tokenInput = std::find_if(m_inputNodes.begin(), m_inputNodes.end(), [&](const ComputationNodeBasePtr& node) { return node->GetName() == options.m_tokenInputName; });
+    if (tokenInput == m_inputNodes.end())
+        RuntimeError("BeamSearch: The output does not depend on an input '%ls'.", options.m_tokenInputName.c_str());
+    if ((*tokenInput)->GetSampleLayout().GetNumElements() != vocabularySize)
+        RuntimeError("BeamSearch: The token input '%ls' must have the dimension of the output, %d.", options.m_tokenInputName.c_str(), (int)vocabularySize);
+    if (options.m_beamWidth == 0 || options.m_startToken >= vocabularySize || options.m_endToken >= vocabularySize)
+        RuntimeError("BeamSearch: Invalid beam width %d, start token %d or end token %d for a vocabulary of %d.",
+                     (int)options.m_beamWidth, (int)options.m_startToken, (int)options.m_endToken, (int)vocabularySize);
+    const size_t tokenInputIndex = tokenInput - m_inputNodes.begin();
+    const size_t numSentences = sources.size();
+    for (size_t s = 0; s < numSentences; ++s)
+    {
+        if (sources[s].size() + 1 != m_inputNodes.size())
+            RuntimeError("BeamSearch: Sentence %d: Expected %d conditioning inputs, but got %d.", (int)s, (int)m_inputNodes.size() - 1, (int)sources[s].size());
+        for (size_t i = 0, j = 0; i < m_inputNodes.size(); ++i)
+        {
+            if (i == tokenInputIndex)
+                continue;
+            if (sources[s][j++].m_buffer.size() != m_inputNodes[i]->GetSampleLayout().GetNumElements())
+                RuntimeError("BeamSearch: Sentence %d: Expected a single sample of input %ls.", (int)s, m_inputNodes[i]->GetName().c_str());
+        }
+    }
+    BeginCall();
+    auto endCall = MakeScopeExit([this]() { EndCall(); });
+
+    struct Hypothesis
+    {
+        size_t m_sentence;
+        size_t m_stream;
+        std::vector<size_t> m_tokens;
+        double m_score;
+    };
+    const size_t beamWidth = options.m_beamWidth;
+    const size_t numCandidates = min(2 * beamWidth, vocabularySize * beamWidth); // room for the ones that end
+    const DEVICEID_TYPE deviceId = outputNode->GetDeviceId();
+
+    results.assign(numSentences, std::vector<BeamSearchHypothesis>());
+    std::vector<size_t> streams;
+    std::vector<Hypothesis> live;
+    for (size_t s = 0; s < numSentences; ++s)
+    {
+        for (size_t k = 0; k < beamWidth; ++k)
+            streams.push_back(CreateStreamState());
+        live.push_back(Hypothesis{ s, streams[s * beamWidth], std::vector<size_t>(), 0 });
+    }
+
+    try
+    {
+        std::vector<ElemType> oneHot, slotColumns, slotScores, topIndices, topValues;
+        std::vector<ValueRefs<ElemType>> inputs, noOutputs;
+        std::vector<size_t> stepStreams, sentenceSlots, fromStreams, toStreams;
+        Matrix<ElemType> candidates(deviceId), topIndicesOnDevice(deviceId), topValuesOnDevice(deviceId);
+        for (size_t step = 0; step < options.m_maxLength && !live.empty(); ++step)
+        {
+            // the last token of each hypothesis, with the conditioning inputs of its sentence
+            const size_t numHypotheses = live.size();
+            oneHot.assign(numHypotheses * vocabularySize, 0);
+            inputs.assign(numHypotheses, ValueRefs<ElemType>(m_inputNodes.size()));
+            stepStreams.resize(numHypotheses);
+            for (size_t h = 0; h < numHypotheses; ++h)
+            {
+                const auto& hypothesis = live[h];
+                oneHot[h * vocabularySize + (hypothesis.m_tokens.empty() ? options.m_startToken : hypothesis.m_tokens.back())] = 1;
+                for (size_t i = 0, j = 0; i < m_inputNodes.size(); ++i)
+                {
+                    if (i == tokenInputIndex)
+                        inputs[h][i].m_buffer.InitFrom(&oneHot[h * vocabularySize], vocabularySize, vocabularySize);
+                    else
+                        inputs[h][i].m_buffer = sources[hypothesis.m_sentence][j++].m_buffer;
+                }
+                stepStreams[h] = hypothesis.m_stream;
+            }
+            ForwardStreams(stepStreams, inputs, noOutputs);
+
+            // the scores of all candidates of the sentences that are still active, in beamWidth slots per sentence
+            sentenceSlots.clear(); // [a] the sentence of the a-th active one
+            slotColumns.clear();
+            slotScores.clear();
+            for (size_t h = 0; h < numHypotheses; ++h)
+            {
+                if (sentenceSlots.empty() || sentenceSlots.back() != live[h].m_sentence) // (the hypotheses of a sentence are consecutive)
+                {
+                    sentenceSlots.push_back(live[h].m_sentence);
+                    slotColumns.resize(sentenceSlots.size() * beamWidth, -1);
+                    slotScores.resize(sentenceSlots.size() * beamWidth, -std::numeric_limits<ElemType>::infinity());
+                }
+                size_t slot = (sentenceSlots.size() - 1) * beamWidth + (live[h].m_stream - streams[live[h].m_sentence * beamWidth]);
+                slotColumns[slot] = (ElemType)h;
+                slotScores[slot] = (ElemType)live[h].m_score;
+            }
+            const size_t numActive = sentenceSlots.size();
+            const auto& logProbabilities = *dynamic_pointer_cast<Matrix<ElemType>>(outputNode->ValuePtr());
+            candidates.DoGatherColumnsOf(0, Matrix<ElemType>(1, slotColumns.size(), slotColumns.data(), deviceId), logProbabilities, 1);
+            Matrix<ElemType>::ScaleAndAdd(1, Matrix<ElemType>(1, slotScores.size(), slotScores.data(), deviceId), candidates);
+            candidates.Reshaped(vocabularySize * beamWidth, numActive).VectorMax(topIndicesOnDevice, topValuesOnDevice, /*isColWise=*/true, (int)numCandidates);
+            topIndices.resize(numCandidates * numActive);
+            topValues.resize(numCandidates * numActive);
+            ElemType* indices = topIndices.data();
+            ElemType* values = topValues.data();
+            size_t size = topIndices.size();
+            topIndicesOnDevice.CopyToArray(indices, size);
+            size = topValues.size();
+            topValuesOnDevice.CopyToArray(values, size);
+
+            // the new hypotheses of each sentence, best first (VectorMax() need not sort them)
+            std::vector<Hypothesis> next;
+            fromStreams.clear();
+            toStreams.clear();
+            for (size_t a = 0; a < numActive; ++a)
+            {
+                const size_t s = sentenceSlots[a];
+                std::vector<size_t> order(numCandidates);
+                for (size_t c = 0; c < numCandidates; ++c)
+                    order[c] = a * numCandidates + c;
+                std::sort(order.begin(), order.end(), [&](size_t x, size_t y) { return topValues[x] > topValues[y]; });
+
+                const size_t firstNew = next.size();
+                for (size_t c : order)
+                {
+                    if (topValues[c] == -std::numeric_limits<ElemType>::infinity())
+                        break; // the rest are empty slots
+                    size_t candidate = (size_t)topIndices[c];
+                    size_t token = candidate % vocabularySize;
+                    const auto& parent = live[(size_t)slotColumns[a * beamWidth + candidate / vocabularySize]];
+                    std::vector<size_t> tokens(parent.m_tokens);
+                    tokens.push_back(token);
+                    if (token == options.m_endToken)
+                        results[s].push_back(BeamSearchHypothesis{ tokens, (double)topValues[c], true });
+                    else if (next.size() - firstNew < beamWidth)
+                    {
+                        size_t stream = streams[s * beamWidth + next.size() - firstNew];
+                        fromStreams.push_back(parent.m_stream);
+                        toStreams.push_back(stream);
+                        next.push_back(Hypothesis{ s, stream, tokens, (double)topValues[c] });
+                    }
+                }
+
+                // scores only decrease, so the sentence is done once its best live hypothesis is below the
+                // beamWidth best finished ones
+                auto& finished = results[s];
+                std::sort(finished.begin(), finished.end(), [](const BeamSearchHypothesis& x, const BeamSearchHypothesis& y) { return x.m_score > y.m_score; });
+                if (finished.size() > beamWidth)
+                    finished.resize(beamWidth);
+                if (next.size() > firstNew && finished.size() == beamWidth && next[firstNew].m_score <= finished.back().m_score)
+                {
+                    next.resize(firstNew);
+                    fromStreams.resize(firstNew);
+                    toStreams.resize(firstNew);
+                }
+            }
+            CopyStreamStates(fromStreams, toStreams);
+            live.swap(next);
+        }
+    }
+    catch (...)
+    {
+        for (size_t stream : streams)
+            ReleaseStreamState(stream);
+        throw;
+    }
+    for (size_t stream : streams)
+        ReleaseStreamState(stream);
+
+    // the hypotheses that reached the maximum length
+    for (const auto& hypothesis : live)
+        results[hypothesis.m_sentence].push_back(BeamSearchHypothesis{ hypothesis.m_tokens, hypothesis.m_score, false });
+    for (auto& hypotheses : results)
+    {
+        std::sort(hypotheses.begin(), hypotheses.end(), [](const BeamSearchHypothesis& x, const BeamSearchHypothesis& y) { return x.m_score > y.m_score; });
+        if (hypotheses.size() > beamWidth)
+            hypotheses.resize(beamWidth);
+    }
+}
+
 template <typename ElemType>
 void CNTKEvalExtended<ElemType>::Destroy()
 {
@@ -444,6 +1157,29 @@ void CNTKEvalExtended<ElemType>::Destroy()
     delete this;
 }
 
+template <typename ElemType>
+IEvaluateModelExtended<ElemType>* CNTKEvalExtended<ElemType>::Clone() const
+{
+    if (!this->m_net)
+        RuntimeError("Clone() called before CreateNetwork()");
+
+    std::unique_ptr<CNTKEvalExtended<ElemType>> clone(new CNTKEvalExtended<ElemType>());
+    clone->m_config = this->m_config;
+    clone->m_removeUnusedNodes = this->m_removeUnusedNodes;
+    clone->m_net = this->m_net->CloneSharingModelValues(); // parameters are shared read-only
+    if (m_started)
+    {
+        std::vector<wstring> outputNodeNames;
+        for (const auto& node : m_outputNodes)
+            outputNodeNames.push_back(node->NodeName());
+        if (m_preallocated)
+            clone->StartForwardEvaluation(outputNodeNames, m_options);
+        else
+            clone->StartForwardEvaluation(outputNodeNames);
+    }
+    return clone.release();
+}
+
 template <typename ElemType>
 void EVAL_API GetEvalExtended(IEvaluateModelExtended<ElemType>** peval)
 {
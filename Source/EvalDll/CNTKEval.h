@@ -19,6 +19,7 @@
 #include "EvalWriter.h"
 
 #include "ComputationNetwork.h"
+#include "MatrixQuantizerImpl.h" // for MatrixComputeStream
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -29,9 +30,13 @@ protected:
     typedef shared_ptr<ComputationNode<ElemType>> ComputationNodePtr;
     ConfigParameters m_config;
     ComputationNetworkPtr m_net;
+    bool m_removeUnusedNodes; // see CreateNetwork()
 
     // constructor
-    CNTKEvalBase() : m_net(nullptr) { }
+    CNTKEvalBase() : m_net(nullptr), m_removeUnusedNodes(false) { }
+
+    void QuantizeTimesNodes(size_t numBits);
+    void SparsifyTimesNodes(double minSparsity);
 public:
 
     // CreateNetwork - create a network based on the network description
@@ -91,12 +96,16 @@ class CNTKEvalExtended : public CNTKEvalBase<ElemType>, public IEvaluateModelExt
 {
 public:
     CNTKEvalExtended() : CNTKEvalBase<ElemType>(), 
-        m_started(false){}
+        m_started(false), m_hasFutureValueNodes(false), m_preallocated(false), m_numAllocationsAtWarmup(0){}
 
     virtual VariableSchema GetOutputSchema() const override;
 
     virtual void StartForwardEvaluation(const std::vector<wstring>& outputs) override;
 
+    virtual void StartForwardEvaluation(const std::vector<wstring>& outputs, const ForwardEvaluationOptions& options) override;
+
+    virtual size_t GetNumAllocationsSinceWarmup() const override;
+
     virtual VariableSchema GetInputSchema() const override;
 
     virtual void ForwardPass(const Values<ElemType>& inputs, Values<ElemType>& output) override;
@@ -107,8 +116,20 @@ public:
 
     virtual void ForwardPass(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& output, bool resetRNN) override;
 
+    virtual void ForwardPassBatch(const std::vector<ValueRefs<ElemType>>& inputs, std::vector<ValueRefs<ElemType>>& outputs) override;
+
+    virtual size_t CreateStreamState() override;
+
+    virtual void ReleaseStreamState(size_t stream) override;
+
+    virtual void ForwardPassStreams(const std::vector<size_t>& streams, const std::vector<ValueRefs<ElemType>>& inputs, std::vector<ValueRefs<ElemType>>& outputs) override;
+
+    virtual void BeamSearch(const std::vector<ValueRefs<ElemType>>& sources, const BeamSearchOptions& options, std::vector<std::vector<BeamSearchHypothesis>>& results) override;
+
     virtual void Destroy() override;
 
+    virtual IEvaluateModelExtended<ElemType>* Clone() const override;
+
     virtual void CreateNetwork(const std::string& networkDescription) override
     {
         CNTKEvalBase<ElemType>::CreateNetwork(networkDescription);
@@ -127,6 +148,32 @@ private:
     StreamMinibatchInputs m_inputMatrices;
     bool m_started;
 
+    // state of the streams of ForwardPassStreams()
+    std::vector<ComputationNodeBasePtr> m_pastValueNodes;
+    std::vector<shared_ptr<Matrix<ElemType>>> m_streamStates; // [i] last TimeStep() inputs of m_pastValueNodes[i] per stream: column stream * TimeStep() + t
+    std::vector<size_t> m_streamNumFrames;                  // [stream] frames evaluated so far, SIZE_MAX if released
+    std::vector<size_t> m_freeStreams;
+    bool m_hasFutureValueNodes;
+
+    // preallocation for steady-state calls, see ForwardEvaluationOptions
+    ForwardEvaluationOptions m_options;
+    bool m_preallocated;
+    size_t m_numAllocationsAtWarmup;
+    std::vector<ElemType> m_inputStaging;  // of SetParallelSequenceInputs()
+    std::vector<ElemType> m_outputStaging; // of ForwardParallelSequences()
+    std::unique_ptr<MatrixComputeStream> m_computeStream; // of m_options.m_ownComputeStream
+
+    static size_t GetNumAllocations();
+    void Warmup();
+    void BeginCall();
+    void EndCall();
+
+    std::map<MBLayoutPtr, std::vector<size_t>> SetParallelSequenceInputs(const std::vector<ValueRefs<ElemType>>& inputs, const std::vector<ValueRefs<ElemType>>& outputs,
+                                                                         const std::vector<ptrdiff_t>& beginTimes, const char* function);
+    void ForwardParallelSequences(std::vector<ValueRefs<ElemType>>& outputs);
+    void ForwardStreams(const std::vector<size_t>& streams, const std::vector<ValueRefs<ElemType>>& inputs, std::vector<ValueRefs<ElemType>>& outputs);
+    void CopyStreamStates(const std::vector<size_t>& from, const std::vector<size_t>& to);
+
     template<template<typename> class ValueContainer> 
     void ForwardPassT(const std::vector < ValueBuffer<ElemType, ValueContainer> >& inputs,
                       std::vector < ValueBuffer<ElemType, ValueContainer> >& outputs, bool resetRNN);
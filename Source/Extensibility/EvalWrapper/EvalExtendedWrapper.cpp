@@ -31,6 +31,7 @@ using namespace std;
 using namespace System;
 using namespace System::Collections::Generic;
 using namespace System::Collections;
+using namespace System::Runtime::InteropServices;
 
 namespace Microsoft { namespace MSR { namespace CNTK { namespace Extensibility { namespace Managed {
 
@@ -44,6 +45,9 @@ using GetEvalProc = void(*)(IEvaluateModelExtended<ElemType>**);
 // A buffer to keep data for all samples in a (variable length) sequence 
 // from a single input or output.
 // This is used for both dense and sparse data.
+// ForwardPass() hands the arrays to the native evaluator in place, pinned for the duration of the call. Buffers that
+// are reused across calls should be pinned once with Pin() instead, which spares the pinning on every call; they
+// stay pinned until Unpin() or until the buffer is disposed.
 //
 generic<class ElemType>
 public ref class ValueBuffer
@@ -52,6 +56,7 @@ public ref class ValueBuffer
         ValueBuffer()
         {
             Size = 0;
+            m_isPinned = false;
         }
 
         //
@@ -61,6 +66,7 @@ public ref class ValueBuffer
         {
             Buffer = gcnew cli::array<ElemType>(bufferSize);
             Size = bufferSize;
+            m_isPinned = false;
         }
 
         //
@@ -72,6 +78,35 @@ public ref class ValueBuffer
             Indices = gcnew cli::array<int>(bufferSize);
             ColIndices = gcnew cli::array<int>(colIndicesSize);
             Size = colIndicesSize - 1;
+            m_isPinned = false;
+        }
+
+        ~ValueBuffer()
+        {
+            this->!ValueBuffer();
+        }
+
+        //
+        // Pin Buffer, Indices and ColIndices until Unpin(). Arrays assigned after this call are pinned by the 
+        // next ForwardPass().
+        //
+        void Pin()
+        {
+            m_isPinned = true;
+            PinArrays();
+        }
+
+        void Unpin()
+        {
+            m_isPinned = false;
+            FreeHandle(m_bufferHandle);
+            FreeHandle(m_indicesHandle);
+            FreeHandle(m_colIndicesHandle);
+        }
+
+        property bool IsPinned
+        {
+            bool get() { return m_isPinned; }
         }
 
         //
@@ -116,6 +151,58 @@ public ref class ValueBuffer
 
 
         // TODO: Should it have a read-only StorageType property?
+
+    internal:
+        //
+        // Pin the current arrays for a call of ForwardPass(). Returns true if they are to be unpinned after the call,
+        // i.e. if Pin() was not called.
+        //
+        bool PinForCall()
+        {
+            PinArrays();
+            return !m_isPinned;
+        }
+
+        // of the pinned arrays, see PinForCall()
+        IntPtr BufferAddress() { return m_bufferHandle.AddrOfPinnedObject(); }
+        IntPtr IndicesAddress() { return m_indicesHandle.AddrOfPinnedObject(); }
+        IntPtr ColIndicesAddress() { return m_colIndicesHandle.AddrOfPinnedObject(); }
+
+    protected:
+        !ValueBuffer()
+        {
+            Unpin();
+        }
+
+    private:
+        void PinArrays()
+        {
+            PinArray(m_bufferHandle, Buffer);
+            PinArray(m_indicesHandle, Indices);
+            PinArray(m_colIndicesHandle, ColIndices);
+        }
+
+        // Make 'handle' pin 'array', unless it does already.
+        static void PinArray(GCHandle% handle, Array^ array)
+        {
+            if (handle.IsAllocated && Object::ReferenceEquals(handle.Target, array))
+                return;
+
+            FreeHandle(handle);
+            if (array != nullptr)
+                handle = GCHandle::Alloc(array, GCHandleType::Pinned);
+        }
+
+        static void FreeHandle(GCHandle% handle)
+        {
+            if (handle.IsAllocated)
+                handle.Free();
+        }
+
+        bool m_isPinned;
+        GCHandle m_bufferHandle;
+        GCHandle m_indicesHandle;
+        GCHandle m_colIndicesHandle;
     };
 
 //
@@ -181,6 +268,11 @@ public:
         {
             pin_ptr <IEvaluateModelExtended<ElemType>*> p_eval = &m_eval;
             GetEvalExtended<ElemType>(p_eval);
+
+            m_inputRefs = new Native::ValueRefs<ElemType>();
+            m_outputRefs = new Native::ValueRefs<ElemType>();
+            m_batchInputRefs = new std::vector<Native::ValueRefs<ElemType>>();
+            m_batchOutputRefs = new std::vector<Native::ValueRefs<ElemType>>();
         }
         catch (const exception& ex)
         {
@@ -265,6 +357,63 @@ public:
         }
     }
 
+    //
+    // Same as above, and allocate all buffers for calls of up to maxBatchSize sequences of up to maxSequenceLength
+    // samples, with warmup passes, so that such calls allocate none (see GetNumAllocationsSinceWarmup()).
+    //
+    void StartForwardEvaluation(List<String^>^ outputs, int maxBatchSize, int maxSequenceLength, int numWarmupPasses)
+    {
+        if (m_eval == nullptr)
+        {
+            throw gcnew ObjectDisposedException("Object has been disposed.");
+        }
+        if (maxBatchSize < 1 || maxSequenceLength < 1 || numWarmupPasses < 0)
+        {
+            throw gcnew ArgumentOutOfRangeException("The maximum batch size and sequence length must be positive, the warmup passes not negative.");
+        }
+
+        std::vector<wstring> outputNodeNames;
+        msclr::interop::marshal_context context;
+
+        for each (String^ output in outputs)
+        {
+            outputNodeNames.push_back(context.marshal_as<std::wstring>(output));
+        }
+
+        ForwardEvaluationOptions options;
+        options.m_maxBatchSize = (size_t)maxBatchSize;
+        options.m_maxSequenceLength = (size_t)maxSequenceLength;
+        options.m_numWarmupPasses = (size_t)numWarmupPasses;
+        try
+        {
+            m_eval->StartForwardEvaluation(outputNodeNames, options);
+        }
+        catch (const exception& ex)
+        {
+            throw GetCustomException(ex);
+        }
+    }
+
+    //
+    // The number of buffers allocated since the warmup of StartForwardEvaluation(), of the whole process.
+    //
+    long long GetNumAllocationsSinceWarmup()
+    {
+        if (m_eval == nullptr)
+        {
+            throw gcnew ObjectDisposedException("Object has been disposed.");
+        }
+
+        try
+        {
+            return (long long)m_eval->GetNumAllocationsSinceWarmup();
+        }
+        catch (const exception& ex)
+        {
+            throw GetCustomException(ex);
+        }
+    }
+
     //
     // Forward Pass - Evaluate (perform a forward pass for) a single unit using the model with the given inputs and 
     // outputs.
@@ -282,19 +431,15 @@ public:
             throw gcnew ObjectDisposedException("Object has been disposed.");
         }
 
+        // The value refs are kept from call to call, so that only their pointers and sizes are set here
+        auto& stdInputs = *m_inputRefs;
+        auto& stdOutputs = *m_outputRefs;
+        List<ValueBuffer<ElemType>^>^ unpinAfterCall = gcnew List<ValueBuffer<ElemType>^>();
         try
         {
-            Native::ValueRefs<ElemType> stdInputs;
-            Native::ValueRefs<ElemType> stdOutputs;
-
-            // Hold gc objects in the stack, while performing native actions
-            vector<gcroot<cli::array<ElemType>^>> pinBuffers;
-            vector<gcroot<cli::array<int>^>> pinIndices;
-
             // Map the managed space into the native space, results will be written directly into the managed memory space
-            // https://msdn.microsoft.com/en-us/library/1dz8byfh.aspx
-            TransferVectorsToValueBuffers(inputs, stdInputs, pinBuffers, pinIndices, StorageType::Sparse);
-            TransferVectorsToValueBuffers(outputs, stdOutputs, pinBuffers, pinIndices, StorageType::Dense);
+            TransferVectorsToValueBuffers(inputs, stdInputs, unpinAfterCall, /*isInput=*/true);
+            TransferVectorsToValueBuffers(outputs, stdOutputs, unpinAfterCall, /*isInput=*/false);
 
             try
             {
@@ -311,9 +456,69 @@ public:
                 throw GetCustomException(ex);
             }
         }
-        catch (Exception^)
+        finally
+        {
+            for each (auto item in unpinAfterCall)
+            {
+                item->Unpin();
+            }
+        }
+    }
+
+    //
+    // Forward Pass - Evaluate several independent requests in one forward pass, as parallel sequences of one
+    // minibatch. inputs[r] and outputs[r] are the buffers of request r, as for the ForwardPass() above; every request
+    // starts with a reset RNN state. Requests may differ in length. Only dense inputs are supported.
+    // Called after StartForwardEvaluation()
+    //
+    void ForwardPass(cli::array<cli::array<ValueBuffer<ElemType>^>^>^ inputs, cli::array<cli::array<ValueBuffer<ElemType>^>^>^ outputs)
+    {
+        if (m_eval == nullptr)
+        {
+            throw gcnew ObjectDisposedException("Object has been disposed.");
+        }
+
+        if (inputs->Length != outputs->Length)
+        {
+            throw gcnew CNTKRuntimeException("Expected as many output buffers as input buffers for ForwardPass", String::Empty);
+        }
+
+        auto& stdInputs = *m_batchInputRefs;
+        auto& stdOutputs = *m_batchOutputRefs;
+        stdInputs.resize(inputs->Length);
+        stdOutputs.resize(outputs->Length);
+        List<ValueBuffer<ElemType>^>^ unpinAfterCall = gcnew List<ValueBuffer<ElemType>^>();
+        try
+        {
+            for (int r = 0; r < inputs->Length; ++r)
+            {
+                TransferVectorsToValueBuffers(inputs[r], stdInputs[r], unpinAfterCall, /*isInput=*/true);
+                TransferVectorsToValueBuffers(outputs[r], stdOutputs[r], unpinAfterCall, /*isInput=*/false);
+            }
+
+            try
+            {
+                m_eval->ForwardPassBatch(stdInputs, stdOutputs);
+
+                for (int r = 0; r < outputs->Length; ++r)
+                {
+                    for (int i = 0; i < outputs[r]->Length; ++i)
+                    {
+                        outputs[r][i]->Size = (int)stdOutputs[r][i].m_buffer.m_size;
+                    }
+                }
+            }
+            catch (const exception& ex)
+            {
+                throw GetCustomException(ex);
+            }
+        }
+        finally
         {
-            throw;
+            for each (auto item in unpinAfterCall)
+            {
+                item->Unpin();
+            }
         }
     }
 
@@ -335,12 +540,27 @@ protected:
             m_eval->Destroy();
             m_eval = nullptr;
         }
+
+        delete m_inputRefs;
+        delete m_outputRefs;
+        delete m_batchInputRefs;
+        delete m_batchOutputRefs;
+        m_inputRefs = nullptr;
+        m_outputRefs = nullptr;
+        m_batchInputRefs = nullptr;
+        m_batchOutputRefs = nullptr;
     }
 
 private:
     // Native model evaluation instance
     IEvaluateModelExtended<ElemType> *m_eval;
 
+    // The native views of the managed buffers of the last ForwardPass() call, reused by the next one
+    Native::ValueRefs<ElemType>* m_inputRefs;
+    Native::ValueRefs<ElemType>* m_outputRefs;
+    std::vector<Native::ValueRefs<ElemType>>* m_batchInputRefs;
+    std::vector<Native::ValueRefs<ElemType>>* m_batchOutputRefs;
+
     /// <summary> Throws a CLR exception based on a native exception</summary>
     /// <param name="ex">The native exception to throw as a CLR exception</param>
     /// <returns>A CLR exception</returns>
@@ -422,41 +642,16 @@ private:
         }
     }
 
-    void PinBuffer(cli::array<ElemType>^ itemBuffer, vector<gcroot<cli::array<ElemType>^>>& pinBuffers, Native::ValueBuffer<ElemType, Native::VectorRef>* vb, StorageType storageType, int bufferSize)
-    {
-        // gcroot object manages the pointer so that it always corresponds to the correct managed location (even after gc relocation)
-        gcroot<cli::array<ElemType>^> pBuf(itemBuffer);
-        pin_ptr<ElemType> pp = &(pBuf[0]);
-        pinBuffers.push_back(pBuf);
-        vb->m_buffer.InitFrom(pp, bufferSize, storageType == StorageType::Sparse ? bufferSize : 0);
-        pp = nullptr;
-    }
-
-    void PinIndices(cli::array<int>^ itemBuffer, vector<gcroot<cli::array<int>^>>& pinBuffers, Native::ValueBuffer<ElemType, Native::VectorRef>* vb, StorageType storageType, int bufferSize)
-    {
-        // gcroot object manages the pointer so that it always corresponds to the correct managed location (even after gc relocation)
-        gcroot<cli::array<int>^> pBuf(itemBuffer);
-        pin_ptr<int> pp = &(pBuf[0]);
-        pinBuffers.push_back(pBuf);
-        vb->m_indices.InitFrom(pp, bufferSize, storageType == StorageType::Sparse ? bufferSize : 0);
-        pp = nullptr;
-    }
-
-    void PinColIndices(cli::array<int>^ itemBuffer, vector<gcroot<cli::array<int>^>>& pinBuffers, Native::ValueBuffer<ElemType, Native::VectorRef>* vb, StorageType storageType, int bufferSize)
-    {
-        // gcroot object manages the pointer so that it always corresponds to the correct managed location (even after gc relocation)
-        gcroot<cli::array<int>^> pBuf(itemBuffer);
-        pin_ptr<int> pp = &(pBuf[0]);
-        pinBuffers.push_back(pBuf);
-        vb->m_colIndices.InitFrom(pp, bufferSize, storageType == StorageType::Sparse ? bufferSize : 0);
-        pp = nullptr;
-    }
-
-    void TransferVectorsToValueBuffers(cli::array<ValueBuffer<ElemType>^>^ list, Native::ValueRefs<ElemType>& valueRefs, vector<gcroot<cli::array<ElemType>^>>& pinBuffers, vector<gcroot<cli::array<int>^>>& pinIndices, StorageType storageType)
+    // Points 'valueRefs' at the arrays of the buffers in 'list', which are pinned for the call, so that the native
+    // evaluator reads the inputs from and writes the outputs to the managed arrays directly.
+    // Buffers that are pinned only for the call are added to 'unpinAfterCall'.
+    void TransferVectorsToValueBuffers(cli::array<ValueBuffer<ElemType>^>^ list, Native::ValueRefs<ElemType>& valueRefs, List<ValueBuffer<ElemType>^>^ unpinAfterCall, bool isInput)
     {
-        for each (auto item in list)
+        valueRefs.resize(list->Length);
+        for (int i = 0; i < list->Length; ++i)
         {
-            Native::ValueBuffer<ElemType, Native::VectorRef> vb;
+            auto item = list[i];
+            auto& vb = valueRefs[i];
 
             int numElements = item->Size;
             int bufferSize = item->ColIndices != nullptr ? item->ColIndices[item->Size - 1] : item->Size;
@@ -467,19 +662,14 @@ private:
                 throw gcnew CNTKRuntimeException("Invalid buffer (empty) for argument into ForwardPass", String::Empty);
             }
 
-            PinBuffer(item->Buffer, pinBuffers, &vb, storageType, bufferSize);
-
-            if (item->Indices != nullptr)
-            {
-                PinIndices(item->Indices, pinIndices, &vb, storageType, bufferSize);
-            }
-
-            if (item->ColIndices != nullptr)
+            if (item->PinForCall())
             {
-                PinColIndices(item->ColIndices, pinIndices, &vb, storageType, numElements);
+                unpinAfterCall->Add(item);
             }
 
-            valueRefs.push_back(vb);
+            vb.m_buffer.InitFrom((ElemType*)item->BufferAddress().ToPointer(), bufferSize, isInput ? bufferSize : 0);
+            vb.m_indices.InitFrom(item->Indices != nullptr ? (int*)item->IndicesAddress().ToPointer() : nullptr, item->Indices != nullptr ? bufferSize : 0, item->Indices != nullptr && isInput ? bufferSize : 0);
+            vb.m_colIndices.InitFrom(item->ColIndices != nullptr ? (int*)item->ColIndicesAddress().ToPointer() : nullptr, item->ColIndices != nullptr ? numElements : 0, item->ColIndices != nullptr && isInput ? numElements : 0);
         }
     }
 
@@ -541,14 +731,16 @@ void EmitExtended()
     f.GetInputSchema();
     f.GetOutputSchema();
     f.StartForwardEvaluation(nullptr);
-    f.ForwardPass(nullptr, nullptr);
+    f.ForwardPass((cli::array<ValueBuffer<float>^>^)nullptr, nullptr);
+    f.ForwardPass((cli::array<cli::array<ValueBuffer<float>^>^>^)nullptr, nullptr);
 
     ModelEvaluationExtendedD d;
     d.CreateNetwork("");
     d.GetInputSchema();
     d.GetOutputSchema();
     d.StartForwardEvaluation(nullptr);
-    d.ForwardPass(nullptr, nullptr);
+    d.ForwardPass((cli::array<ValueBuffer<double>^>^)nullptr, nullptr);
+    d.ForwardPass((cli::array<cli::array<ValueBuffer<double>^>^>^)nullptr, nullptr);
 
     VariableSchema sc;
     sc.CreateBuffers<float>();
@@ -0,0 +1,31 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full licence information.
+//
+#include "stdafx.h"
+#include <malloc.h>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <assert.h>
+#include <iostream>
+#include <exception>
+#include "BlockMultiplierMatrixUtil.h"
+
+#include "BlockHandlerAVX512.h"
+
+#ifdef SUPPORT_AVX512
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+int BlockHandlerAVX512::RowToColOffsetRewrittenA(int row, int kOffset, int blockSize, int rowsPerBlock, int origCols)
+{
+    int rowIdx = row / rowsPerBlock;
+    int offsetFromBlockBeginning = row % rowsPerBlock;
+    int colIdx = kOffset * rowsPerBlock * blockSize + (offsetFromBlockBeginning * blockSize);
+    return (rowIdx * (origCols / blockSize) * rowsPerBlock * blockSize) + colIdx;
+}
+
+}}}
+
+#endif // SUPPORT_AVX512
@@ -0,0 +1,395 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full licence information.
+//
+#pragma once
+#include "BlockMultiplierPlatform.h"
+#include <immintrin.h>
+#include <emmintrin.h>
+#include <assert.h>
+#include <cstdint>
+#define FOR_CNTK
+#ifdef FOR_CNTK
+#include "CommonMatrix.h"
+#endif
+
+#ifdef SUPPORT_AVX512
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Block handler for 16-bit integer matrices with AVX-512 (F and BW, i.e. Skylake-SP or better).
+// Same block layout as BlockHandlerAVX, but a __m512i holds 32 values of a block, so a block of 128
+// takes four registers per row instead of eight and the blocks of 32 and 64 need half the instructions.
+// If the compiler targets VNNI (e.g. gcc -mavx512vnni), the multiply and the add of the partial sums
+// are a single vpdpwssd. The blocks of 8 and 16 are too short for the wide registers and use SSE and AVX2.
+// Like the AVX2 handler this needs to be compiled for the instruction set (SUPPORT_AVX512) and throws
+// illegal instruction on older processors, use IsSupported() to check at run time before picking it.
+class MATH_API BlockHandlerAVX512
+{
+
+    private:
+        // Unlike the kernels of the other handlers, these add to the accumulators they are given, and
+        // the wide ones take the rows of A from memory (as operands of vpmaddwd) rather than in registers:
+        // 16 __m512i arguments end up spilled to the stack, and reloaded for every column, anyway.
+        FORCEINLINE static void kernelsse8x4(__m128i xmmRow0, __m128i xmmRow1, __m128i xmmRow2, __m128i xmmRow3,
+                short* B, __m128i* return1, __m128i* return2, __m128i* return3, __m128i* return4);
+        FORCEINLINE static void kernelavx16x4(__m256i xmmRow0B0a, __m256i xmmRow1B0a, __m256i xmmRow2B0a, __m256i xmmRow3B0a,
+                short* B, __m512i* return1, __m512i* return2, __m512i* return3, __m512i* return4);
+        FORCEINLINE static void kernelavx512_32x4(short* A, short* B, __m512i* return1, __m512i* return2, __m512i* return3, __m512i* return4);
+        FORCEINLINE static void kernelavx512_64x4(short* A, short* B, __m512i* return1, __m512i* return2, __m512i* return3, __m512i* return4);
+        FORCEINLINE static void kernelavx512_128x4(short* A, short* B, __m512i* return1, __m512i* return2, __m512i* return3, __m512i* return4);
+
+        FORCEINLINE static void kernelsse8x1(__m128i xmmRow0,
+                short* B, __m128i* return1);
+        FORCEINLINE static void kernelavx16x1(__m256i xmmRow0B0a,
+                short* B, __m512i* return1);
+        FORCEINLINE static void kernelavx512_32x1(short* A, short* B, __m512i* return1);
+        FORCEINLINE static void kernelavx512_64x1(short* A, short* B, __m512i* return1);
+        FORCEINLINE static void kernelavx512_128x1(short* A, short* B, __m512i* return1);
+
+        // sum + the sums of the products of adjacent pairs of 16-bit values of a and b.
+        FORCEINLINE static __m512i my_dpwssd_epi32(__m512i sum, __m512i a, __m512i b)
+        {
+#ifdef __AVX512VNNI__
+            return _mm512_dpwssd_epi32(sum, a, b);
+#else
+            return _mm512_add_epi32(sum, _mm512_madd_epi16(a, b));
+#endif
+        }
+
+        // The result of a block of 16 in the low half of an accumulator.
+        FORCEINLINE static __m512i AddLow256(__m512i sum, __m256i addMe)
+        {
+            return _mm512_add_epi32(sum, _mm512_inserti64x4(_mm512_setzero_si512(), addMe, 0));
+        }
+
+        // Inline, unlike in the other handlers: it is computed for every column, and the call costs as much
+        // as a block of 32.
+        FORCEINLINE static int RowToColOffsetRewrittenB(int col, int kOffset, int blockSize, int origCols)
+        {
+            return (origCols * blockSize * kOffset) + (col * blockSize);
+        }
+        static int RowToColOffsetRewrittenA(int row, int kOffset, int blockSize, int rowsPerBlock, int origCols);
+    public:
+        typedef __m512i VectorT;
+        typedef int16_t ScalarAT;
+        typedef int16_t ScalarBT;
+        typedef int32_t ScalarCT;
+        FORCEINLINE static void HandleBlock8x4(int currBlock, int startRow, int k, int n, short* newA, short* B,
+                int blockCnt, __m128i* resultStorage);
+        FORCEINLINE static void HandleBlock16x4(int currBlock, int startRow, int k, int n, short* newA, short* B,
+                int blockCnt, __m512i* resultStorage);
+        FORCEINLINE static void HandleBlock32x4(int currBlock, int startRow, int k, int n, short* newA, short* B,
+                int blockCnt, __m512i* resultStorage);
+        FORCEINLINE static void HandleBlock64x4(int currBlock, int startRow, int k, int n, short* newA, short* B,
+                int blockCnt, __m512i* resultStorage);
+        FORCEINLINE static void HandleBlock128x4(int currBlock, int startRow, int k, int n, short* newA, short* B,
+                int blockCnt, __m512i* resultStorage, VectorT* subtractMe);
+
+        FORCEINLINE static void HandleBlock8x1(int currBlock, int startRow, int k, int n, short* newA, short* B,
+                int blockCnt, __m128i* resultStorage);
+        FORCEINLINE static void HandleBlock16x1(int currBlock, int startRow, int k, int n, short* newA, short* B,
+                int blockCnt, __m512i* resultStorage);
+        FORCEINLINE static void HandleBlock32x1(int currBlock, int startRow, int k, int n, short* newA, short* B,
+                int blockCnt, __m512i* resultStorage);
+        FORCEINLINE static void HandleBlock64x1(int currBlock, int startRow, int k, int n, short* newA, short* B,
+                int blockCnt, __m512i* resultStorage);
+        FORCEINLINE static void HandleBlock128x1(int currBlock, int startRow, int k, int n, short* newA, short* B,
+                int blockCnt, __m512i* resultStorage, VectorT* subtractMe);
+
+        static VectorT* PrepareExtraB(const ScalarBT* /*prepareMe*/, int /*k*/, int /*n*/)
+        {
+            return nullptr;
+        }
+        static void FreePreparedB(VectorT* freeMe) { freeMe;  assert(nullptr == freeMe); }
+
+        // Whether this processor can run the handler (including VNNI, if it was compiled for it).
+        static bool IsSupported()
+        {
+#ifdef __AVX512VNNI__
+            return CpuSupportsAVX512BW() && CpuSupportsAVX512VNNI();
+#else
+            return CpuSupportsAVX512BW();
+#endif
+        }
+};
+
+#define LOADAVX512_16x4 \
+    __m256i r0b0a = _mm256_loadu_si256((__m256i*)currA);\
+__m256i r1b0a = _mm256_loadu_si256((__m256i*)currA + 1);\
+__m256i r2b0a = _mm256_loadu_si256((__m256i*)currA + 2);\
+__m256i r3b0a = _mm256_loadu_si256((__m256i*)currA + 3);
+
+#define LOADAVX512_16x1 \
+    __m256i r0b0a = _mm256_loadu_si256((__m256i*)currA);
+
+#define LOADAVX512_8x4 \
+    __m128i r0b0a = _mm_load_si128((__m128i*)currA);\
+__m128i r1b0a = _mm_load_si128((__m128i*)currA + 1);\
+__m128i r2b0a = _mm_load_si128((__m128i*)currA + 2);\
+__m128i r3b0a = _mm_load_si128((__m128i*)currA + 3);
+
+#define LOADAVX512_8x1 \
+    __m128i r0b0a = _mm_load_si128((__m128i*)currA);
+
+FORCEINLINE void BlockHandlerAVX512::HandleBlock8x4(int currBlock, int startRow, int k, int n, short* newA, short* B,
+        int /*blockCnt*/, __m128i* resultStorage)
+{
+    int aOffset = RowToColOffsetRewrittenA(startRow, currBlock, 8, 4, k);
+    short* currA = &newA[aOffset];
+    LOADAVX512_8x4;
+    for (int c = 0; c < n; ++c)
+    {
+        short* currB = &B[RowToColOffsetRewrittenB(c, currBlock, 8, n)];
+        kernelsse8x4(r0b0a, r1b0a, r2b0a, r3b0a, currB,
+                &resultStorage[RowColToOffset(0, c, n)], &resultStorage[RowColToOffset(1, c, n)],
+                &resultStorage[RowColToOffset(2, c, n)], &resultStorage[RowColToOffset(3, c, n)]);
+    }
+}
+
+FORCEINLINE void BlockHandlerAVX512::HandleBlock8x1(int currBlock, int startRow, int k, int n, short* newA, short* B,
+        int /*blockCnt*/, __m128i* resultStorage)
+{
+    int aOffset = RowToColOffsetRewrittenA(startRow, currBlock, 8, 1, k);
+    short* currA = &newA[aOffset];
+    LOADAVX512_8x1;
+    for (int c = 0; c < n; ++c)
+    {
+        short* currB = &B[RowToColOffsetRewrittenB(c, currBlock, 8, n)];
+        kernelsse8x1(r0b0a, currB, &resultStorage[RowColToOffset(0, c, n)]);
+    }
+}
+
+FORCEINLINE void BlockHandlerAVX512::HandleBlock16x4(int currBlock, int startRow, int k, int n, short* newA, short* B,
+        int /*blockCnt*/, __m512i* resultStorage)
+{
+    int aOffset = RowToColOffsetRewrittenA(startRow, currBlock, 16, 4, k);
+    short* currA = &newA[aOffset];
+    LOADAVX512_16x4;
+    for (int c = 0; c < n; ++c)
+    {
+        short* currB = &B[RowToColOffsetRewrittenB(c, currBlock, 16, n)];
+        kernelavx16x4(r0b0a, r1b0a, r2b0a, r3b0a, currB,
+                &resultStorage[RowColToOffset(0, c, n)], &resultStorage[RowColToOffset(1, c, n)],
+                &resultStorage[RowColToOffset(2, c, n)], &resultStorage[RowColToOffset(3, c, n)]);
+    }
+}
+
+FORCEINLINE void BlockHandlerAVX512::HandleBlock16x1(int currBlock, int startRow, int k, int n, short* newA, short* B,
+        int /*blockCnt*/, __m512i* resultStorage)
+{
+    int aOffset = RowToColOffsetRewrittenA(startRow, currBlock, 16, 1, k);
+    short* currA = &newA[aOffset];
+    LOADAVX512_16x1;
+    for (int c = 0; c < n; ++c)
+    {
+        short* currB = &B[RowToColOffsetRewrittenB(c, currBlock, 16, n)];
+        kernelavx16x1(r0b0a, currB, &resultStorage[RowColToOffset(0, c, n)]);
+    }
+}
+
+FORCEINLINE void BlockHandlerAVX512::HandleBlock32x4(int currBlock, int startRow, int k, int n, short* newA, short* B,
+        int /*blockCnt*/, __m512i* resultStorage)
+{
+    int aOffset = RowToColOffsetRewrittenA(startRow, currBlock, 32, 4, k);
+    short* currA = &newA[aOffset];
+    for (int c = 0; c < n; ++c)
+    {
+        short* currB = &B[RowToColOffsetRewrittenB(c, currBlock, 32, n)];
+        kernelavx512_32x4(currA, currB,
+                &resultStorage[RowColToOffset(0, c, n)], &resultStorage[RowColToOffset(1, c, n)],
+                &resultStorage[RowColToOffset(2, c, n)], &resultStorage[RowColToOffset(3, c, n)]);
+    }
+}
+
+FORCEINLINE void BlockHandlerAVX512::HandleBlock32x1(int currBlock, int startRow, int k, int n, short* newA, short* B,
+        int /*blockCnt*/, __m512i* resultStorage)
+{
+    int aOffset = RowToColOffsetRewrittenA(startRow, currBlock, 32, 1, k);
+    short* currA = &newA[aOffset];
+    for (int c = 0; c < n; ++c)
+    {
+        short* currB = &B[RowToColOffsetRewrittenB(c, currBlock, 32, n)];
+        kernelavx512_32x1(currA, currB, &resultStorage[RowColToOffset(0, c, n)]);
+    }
+}
+
+FORCEINLINE void BlockHandlerAVX512::HandleBlock64x4(int currBlock, int startRow, int k, int n, short* newA, short* B,
+        int /*blockCnt*/, __m512i* resultStorage)
+{
+    int aOffset = RowToColOffsetRewrittenA(startRow, currBlock, 64, 4, k);
+    short* currA = &newA[aOffset];
+    for (int c = 0; c < n; ++c)
+    {
+        short* currB = &B[RowToColOffsetRewrittenB(c, currBlock, 64, n)];
+        kernelavx512_64x4(currA, currB,
+                &resultStorage[RowColToOffset(0, c, n)], &resultStorage[RowColToOffset(1, c, n)],
+                &resultStorage[RowColToOffset(2, c, n)], &resultStorage[RowColToOffset(3, c, n)]);
+    }
+}
+
+FORCEINLINE void BlockHandlerAVX512::HandleBlock64x1(int currBlock, int startRow, int k, int n, short* newA, short* B,
+        int /*blockCnt*/, __m512i* resultStorage)
+{
+    int aOffset = RowToColOffsetRewrittenA(startRow, currBlock, 64, 1, k);
+    short* currA = &newA[aOffset];
+    for (int c = 0; c < n; ++c)
+    {
+        short* currB = &B[RowToColOffsetRewrittenB(c, currBlock, 64, n)];
+        kernelavx512_64x1(currA, currB, &resultStorage[RowColToOffset(0, c, n)]);
+    }
+}
+
+// Both blocks go into the accumulators before they are stored, which halves the traffic to resultStorage.
+FORCEINLINE void BlockHandlerAVX512::HandleBlock128x4(int currBlock, int startRow, int k, int n, short* newA, short* B,
+        int blockCnt, __m512i* resultStorage, VectorT* /*subtractMe*/)
+{
+    int aOffset = RowToColOffsetRewrittenA(startRow, currBlock, 128, 4, k);
+    int aOffset2 = RowToColOffsetRewrittenA(startRow, currBlock + 1, 128, 4, k);
+    short* currA = &newA[aOffset];
+    short* currA2 = &newA[aOffset2];
+    for (int c = 0; c < n; ++c)
+    {
+        short* currB = &B[RowToColOffsetRewrittenB(c, currBlock, 128, n)];
+        short* currB2 = &B[RowToColOffsetRewrittenB(c, currBlock + 1, 128, n)];
+        __m512i accum1 = resultStorage[RowColToOffset(0, c, n)];
+        __m512i accum2 = resultStorage[RowColToOffset(1, c, n)];
+        __m512i accum3 = resultStorage[RowColToOffset(2, c, n)];
+        __m512i accum4 = resultStorage[RowColToOffset(3, c, n)];
+        kernelavx512_128x4(currA, currB, &accum1, &accum2, &accum3, &accum4);
+        if (blockCnt > 1)
+        {
+            kernelavx512_128x4(currA2, currB2, &accum1, &accum2, &accum3, &accum4);
+        }
+        resultStorage[RowColToOffset(0, c, n)] = accum1;
+        resultStorage[RowColToOffset(1, c, n)] = accum2;
+        resultStorage[RowColToOffset(2, c, n)] = accum3;
+        resultStorage[RowColToOffset(3, c, n)] = accum4;
+    }
+}
+
+FORCEINLINE void BlockHandlerAVX512::HandleBlock128x1(int currBlock, int startRow, int k, int n, short* newA, short* B,
+        int blockCnt, __m512i* resultStorage, VectorT* /*subtractMe*/)
+{
+    int aOffset = RowToColOffsetRewrittenA(startRow, currBlock, 128, 1, k);
+    int aOffset2 = RowToColOffsetRewrittenA(startRow, currBlock + 1, 128, 1, k);
+    short* currA = &newA[aOffset];
+    short* currA2 = &newA[aOffset2];
+    for (int c = 0; c < n; ++c)
+    {
+        short* currB = &B[RowToColOffsetRewrittenB(c, currBlock, 128, n)];
+        short* currB2 = &B[RowToColOffsetRewrittenB(c, currBlock + 1, 128, n)];
+        __m512i accum1 = resultStorage[RowColToOffset(0, c, n)];
+        kernelavx512_128x1(currA, currB, &accum1);
+        if (blockCnt > 1)
+        {
+            kernelavx512_128x1(currA2, currB2, &accum1);
+        }
+        resultStorage[RowColToOffset(0, c, n)] = accum1;
+    }
+}
+
+FORCEINLINE void BlockHandlerAVX512::kernelsse8x1(__m128i xmmRow0,
+        short* B, __m128i* return1)
+{
+    __m128i xmmCol0 = _mm_load_si128((__m128i*)B);
+    *return1 = _mm_add_epi32(*return1, _mm_madd_epi16(xmmRow0, xmmCol0));
+}
+
+FORCEINLINE void BlockHandlerAVX512::kernelsse8x4(__m128i xmmRow0, __m128i xmmRow1, __m128i xmmRow2, __m128i xmmRow3,
+        short* B, __m128i* return1, __m128i* return2, __m128i* return3, __m128i* return4)
+{
+    __m128i xmmCol0 = _mm_load_si128((__m128i*)B);
+    *return1 = _mm_add_epi32(*return1, _mm_madd_epi16(xmmRow0, xmmCol0));
+    *return2 = _mm_add_epi32(*return2, _mm_madd_epi16(xmmRow1, xmmCol0));
+    *return3 = _mm_add_epi32(*return3, _mm_madd_epi16(xmmRow2, xmmCol0));
+    *return4 = _mm_add_epi32(*return4, _mm_madd_epi16(xmmRow3, xmmCol0));
+}
+
+FORCEINLINE void BlockHandlerAVX512::kernelavx16x1(__m256i xmmRow0B0a,
+        short* B, __m512i* return1)
+{
+    __m256i xmmCol0B0a = _mm256_loadu_si256((__m256i*)B);
+    *return1 = AddLow256(*return1, _mm256_madd_epi16(xmmRow0B0a, xmmCol0B0a));
+}
+
+FORCEINLINE void BlockHandlerAVX512::kernelavx16x4(__m256i xmmRow0B0a, __m256i xmmRow1B0a, __m256i xmmRow2B0a, __m256i xmmRow3B0a,
+        short* B, __m512i* return1, __m512i* return2, __m512i* return3, __m512i* return4)
+{
+    __m256i xmmCol0B0a = _mm256_loadu_si256((__m256i*)B);
+    *return1 = AddLow256(*return1, _mm256_madd_epi16(xmmRow0B0a, xmmCol0B0a));
+    *return2 = AddLow256(*return2, _mm256_madd_epi16(xmmRow1B0a, xmmCol0B0a));
+    *return3 = AddLow256(*return3, _mm256_madd_epi16(xmmRow2B0a, xmmCol0B0a));
+    *return4 = AddLow256(*return4, _mm256_madd_epi16(xmmRow3B0a, xmmCol0B0a));
+}
+
+// The dot products of one row of A (in memory) with the column of B, in parts of 32 values.
+#define DOTAVX512_x1(row) \
+    my_dpwssd_epi32(*return##row, _mm512_loadu_si512((__m512i*)(A + (row - 1) * 32)), zmmCol0B0a)
+#define DOTAVX512_x2(row) \
+    _mm512_add_epi32(*return##row, my_dpwssd_epi32(_mm512_madd_epi16(_mm512_loadu_si512((__m512i*)(A + (row - 1) * 64)), zmmCol0B0a), \
+            _mm512_loadu_si512((__m512i*)(A + (row - 1) * 64 + 32)), zmmCol0B0b))
+// Two chains per row, to hide the latency of the multiply-adds.
+#define DOTAVX512_x4(row) \
+    _mm512_add_epi32(*return##row, _mm512_add_epi32( \
+            my_dpwssd_epi32(_mm512_madd_epi16(_mm512_loadu_si512((__m512i*)(A + (row - 1) * 128)), zmmCol0B0a), \
+                    _mm512_loadu_si512((__m512i*)(A + (row - 1) * 128 + 32)), zmmCol0B0b), \
+            my_dpwssd_epi32(_mm512_madd_epi16(_mm512_loadu_si512((__m512i*)(A + (row - 1) * 128 + 64)), zmmCol0B0c), \
+                    _mm512_loadu_si512((__m512i*)(A + (row - 1) * 128 + 96)), zmmCol0B0d)))
+
+FORCEINLINE void BlockHandlerAVX512::kernelavx512_32x1(short* A, short* B, __m512i* return1)
+{
+    __m512i zmmCol0B0a = _mm512_loadu_si512((__m512i*)B);
+    *return1 = DOTAVX512_x1(1);
+}
+
+FORCEINLINE void BlockHandlerAVX512::kernelavx512_32x4(short* A, short* B, __m512i* return1, __m512i* return2, __m512i* return3, __m512i* return4)
+{
+    __m512i zmmCol0B0a = _mm512_loadu_si512((__m512i*)B);
+    *return1 = DOTAVX512_x1(1);
+    *return2 = DOTAVX512_x1(2);
+    *return3 = DOTAVX512_x1(3);
+    *return4 = DOTAVX512_x1(4);
+}
+
+FORCEINLINE void BlockHandlerAVX512::kernelavx512_64x1(short* A, short* B, __m512i* return1)
+{
+    __m512i zmmCol0B0a = _mm512_loadu_si512((__m512i*)B);
+    __m512i zmmCol0B0b = _mm512_loadu_si512((__m512i*)B + 1);
+    *return1 = DOTAVX512_x2(1);
+}
+
+FORCEINLINE void BlockHandlerAVX512::kernelavx512_64x4(short* A, short* B, __m512i* return1, __m512i* return2, __m512i* return3, __m512i* return4)
+{
+    __m512i zmmCol0B0a = _mm512_loadu_si512((__m512i*)B);
+    __m512i zmmCol0B0b = _mm512_loadu_si512((__m512i*)B + 1);
+    *return1 = DOTAVX512_x2(1);
+    *return2 = DOTAVX512_x2(2);
+    *return3 = DOTAVX512_x2(3);
+    *return4 = DOTAVX512_x2(4);
+}
+
+FORCEINLINE void BlockHandlerAVX512::kernelavx512_128x1(short* A, short* B, __m512i* return1)
+{
+    __m512i zmmCol0B0a = _mm512_loadu_si512((__m512i*)B);
+    __m512i zmmCol0B0b = _mm512_loadu_si512((__m512i*)B + 1);
+    __m512i zmmCol0B0c = _mm512_loadu_si512((__m512i*)B + 2);
+    __m512i zmmCol0B0d = _mm512_loadu_si512((__m512i*)B + 3);
+    *return1 = DOTAVX512_x4(1);
+}
+
+FORCEINLINE void BlockHandlerAVX512::kernelavx512_128x4(short* A, short* B, __m512i* return1, __m512i* return2, __m512i* return3, __m512i* return4)
+{
+    __m512i zmmCol0B0a = _mm512_loadu_si512((__m512i*)B);
+    __m512i zmmCol0B0b = _mm512_loadu_si512((__m512i*)B + 1);
+    __m512i zmmCol0B0c = _mm512_loadu_si512((__m512i*)B + 2);
+    __m512i zmmCol0B0d = _mm512_loadu_si512((__m512i*)B + 3);
+    *return1 = DOTAVX512_x4(1);
+    *return2 = DOTAVX512_x4(2);
+    *return3 = DOTAVX512_x4(3);
+    *return4 = DOTAVX512_x4(4);
+}
+
+}}}
+
+#endif // SUPPORT_AVX512
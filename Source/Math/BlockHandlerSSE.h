@@ -114,6 +114,7 @@ class MATH_API BlockHandlerSSE
             return nullptr;
         }
         static void FreePreparedB(VectorT* freeMe) { freeMe;  assert(nullptr == freeMe); }
+        static bool IsSupported() { return true; }
 
 };
 
@@ -23,6 +23,9 @@
 #ifdef SUPPORT_AVX2
 #include "BlockHandlerAVX.h"
 #endif
+#ifdef SUPPORT_AVX512
+#include "BlockHandlerAVX512.h"
+#endif
 //#define STDTHREAD
 #define OPENMPTHREAD
 #ifdef STDTHREAD
@@ -73,9 +76,10 @@ template<typename BlockHandlerT>struct HandlerArgs
 // multiplication. Blocks of A and B (the LHS and RHS of the multiplication)
 // are then handed off to a class implementing the BlockHandlerT interface.
 // Implementations are provided for multiplying 16-bit integer matrices using
-// the SSE and AVX2 instruction sets. To compile for AVX2, you need to add the /arch:AVX2
+// the SSE, AVX2 and AVX-512 instruction sets. To compile for AVX2, you need to add the /arch:AVX2
 // flag to the compiler. Note that the AVX2 code only runs on Haswell or better processors,
-// will throw illegal instruction on other machines.
+// will throw illegal instruction on other machines. Likewise the AVX-512 code (SUPPORT_AVX512)
+// needs Skylake-SP or better. BlockHandlerT::IsSupported() tells whether a handler runs on this machine.
 // To use the code, first call PrepareB, which rewrites B in block order and returns
 // a pointer to the rewritten block (don't forget to call FreePreparedB on it when you're done
 // multiplying by that matrix). Then you can call MultiplyMatrices().
@@ -182,7 +186,7 @@ template<typename BlockHandlerT> class BlockMultiplier
         static void BlockHandler128x4Thread(HandlerArgs<BlockHandlerT> ha)
         {
             // Accumulate full row results locally b/f writing to C
-            VectorT* resultStorage = (VectorT*)ALIGNED_ALLOC(sizeof(VectorT) * ha.rowsPerBlock * ha.n, 16);
+            VectorT* resultStorage = (VectorT*)ALIGNED_ALLOC(sizeof(VectorT) * ha.rowsPerBlock * ha.n, sizeof(VectorT));
             memset(resultStorage, 0, sizeof(VectorT) * ha.rowsPerBlock * ha.n);
             const int blocksAtOnce = 2;
 
@@ -221,7 +225,7 @@ template<typename BlockHandlerT> class BlockMultiplier
 
         static void BlockHandler64x4Thread(HandlerArgs<BlockHandlerT> ha)
         {
-            VectorT* resultStorage = (VectorT*)ALIGNED_ALLOC(sizeof(VectorT) * 4 * ha.n, 16);
+            VectorT* resultStorage = (VectorT*)ALIGNED_ALLOC(sizeof(VectorT) * 4 * ha.n, sizeof(VectorT));
             memset(resultStorage, 0, sizeof(VectorT) * 4 * ha.n);
             int32_t* transC = ha.transC;
 
@@ -254,7 +258,7 @@ template<typename BlockHandlerT> class BlockMultiplier
 
         static void BlockHandler32x4Thread(HandlerArgs<BlockHandlerT> ha)
         {
-            VectorT* resultStorage = (VectorT*)ALIGNED_ALLOC(sizeof(VectorT) * 4 * ha.n, 16);
+            VectorT* resultStorage = (VectorT*)ALIGNED_ALLOC(sizeof(VectorT) * 4 * ha.n, sizeof(VectorT));
             memset(resultStorage, 0, sizeof(VectorT) * 4 * ha.n);
             int32_t* transC = ha.transC;
 
@@ -287,7 +291,7 @@ template<typename BlockHandlerT> class BlockMultiplier
 
         static void BlockHandler16x4Thread(HandlerArgs<BlockHandlerT> ha)
         {
-            VectorT* resultStorage = (VectorT*) ALIGNED_ALLOC(sizeof(VectorT) * 4 * ha.n, 16);
+            VectorT* resultStorage = (VectorT*) ALIGNED_ALLOC(sizeof(VectorT) * 4 * ha.n, sizeof(VectorT));
             memset(resultStorage, 0, sizeof(VectorT) * 4 * ha.n);
             int32_t* transC = ha.transC;
             for (int currBlock = 0; currBlock < ha.blocks; ++currBlock)
@@ -379,7 +383,7 @@ template<typename BlockHandlerT> class BlockMultiplier
 
         static void BlockHandler64x1Thread(HandlerArgs<BlockHandlerT> ha)
         {
-            VectorT* resultStorage = (VectorT*)ALIGNED_ALLOC(sizeof(VectorT) * ha.rowsPerBlock * ha.n, 16);
+            VectorT* resultStorage = (VectorT*)ALIGNED_ALLOC(sizeof(VectorT) * ha.rowsPerBlock * ha.n, sizeof(VectorT));
             memset(resultStorage, 0, sizeof(VectorT) * ha.rowsPerBlock * ha.n);
             int32_t* transC = ha.transC;
 
@@ -403,7 +407,7 @@ template<typename BlockHandlerT> class BlockMultiplier
 
         static void BlockHandler32x1Thread(HandlerArgs<BlockHandlerT> ha)
         {
-            VectorT* resultStorage = (VectorT*)ALIGNED_ALLOC(sizeof(VectorT) * ha.rowsPerBlock * ha.n, 16);
+            VectorT* resultStorage = (VectorT*)ALIGNED_ALLOC(sizeof(VectorT) * ha.rowsPerBlock * ha.n, sizeof(VectorT));
             memset(resultStorage, 0, sizeof(VectorT) * ha.rowsPerBlock * ha.n);
             int32_t* transC = ha.transC;
 
@@ -427,7 +431,7 @@ template<typename BlockHandlerT> class BlockMultiplier
 
         static void BlockHandler16x1Thread(HandlerArgs<BlockHandlerT> ha)
         {
-            VectorT* resultStorage = (VectorT*)ALIGNED_ALLOC(sizeof(VectorT) * ha.rowsPerBlock * ha.n, 16);
+            VectorT* resultStorage = (VectorT*)ALIGNED_ALLOC(sizeof(VectorT) * ha.rowsPerBlock * ha.n, sizeof(VectorT));
             memset(resultStorage, 0, sizeof(VectorT) * ha.rowsPerBlock  * ha.n);
             int32_t* transC = ha.transC;
 
@@ -545,6 +549,22 @@ template<typename BlockHandlerT> class BlockMultiplier
         }
 #endif
 
+#ifdef SUPPORT_AVX512
+        //Same as above, for AVX-512 registers. Saturating each step costs more than the dot products
+        //for short k, so this sums exactly in 64 bits and saturates once.
+        FORCEINLINE static int32_t my_hadd(__m512i hAddMe)
+        {
+            __m512i low = _mm512_cvtepi32_epi64(_mm512_castsi512_si256(hAddMe));
+            __m512i high = _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(hAddMe, 1));
+            long long sum = _mm512_reduce_add_epi64(_mm512_add_epi64(low, high));
+            if (sum > INT32_MAX)
+                return INT32_MAX;
+            if (sum < INT32_MIN)
+                return INT32_MIN;
+            return (int32_t)sum;
+        }
+#endif
+
 
         int m_numThreads;
 
@@ -588,6 +608,9 @@ template<> const int BlockMultiplier<BlockHandlerSSE>::MAXRANGE;
 #ifdef SUPPORT_AVX2
 template<> const int BlockMultiplier<BlockHandlerAVX>::MAXRANGE;
 #endif
+#ifdef SUPPORT_AVX512
+template<> const int BlockMultiplier<BlockHandlerAVX512>::MAXRANGE;
+#endif
 
 
 template<typename BlockHandlerT> typename BlockMultiplier<BlockHandlerT>::ScalarAT* BlockMultiplier<BlockHandlerT>::CreateMatrixA(int m, int n, ScalarAT initVal)
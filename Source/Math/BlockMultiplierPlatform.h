@@ -17,3 +17,85 @@
 #endif
 #endif
 
+
+// The AVX-512 handler uses AVX2 for the short blocks, and the processors have it anyway.
+#if defined(SUPPORT_AVX512) && !defined(SUPPORT_AVX2)
+#define SUPPORT_AVX2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Run time checks of the instruction sets of the block handlers, so that a handler can be picked for the host.
+// An instruction set counts only if the OS saves the registers it needs.
+inline void BlockMultiplierCpuid(unsigned int leaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+    __cpuidex((int*)regs, (int)leaf, 0);
+#else
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// The register state enabled by the OS (XCR0), 0 if the processor has no xgetbv.
+inline unsigned long long BlockMultiplierEnabledRegisterState()
+{
+    unsigned int regs[4];
+    BlockMultiplierCpuid(1, regs);
+    if (!(regs[2] & (1u << 27))) // OSXSAVE
+        return 0;
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+inline bool CpuSupportsAVX2()
+{
+    unsigned int regs[4];
+    BlockMultiplierCpuid(0, regs);
+    if (regs[0] < 7)
+        return false;
+    BlockMultiplierCpuid(7, regs);
+    const unsigned long long ymmState = 0x6; // SSE and AVX registers
+    return (regs[1] & (1u << 5)) && (BlockMultiplierEnabledRegisterState() & ymmState) == ymmState;
+}
+
+inline bool CpuSupportsFMA()
+{
+    unsigned int regs[4];
+    BlockMultiplierCpuid(1, regs);
+    const unsigned long long ymmState = 0x6;
+    return (regs[2] & (1u << 12)) && (BlockMultiplierEnabledRegisterState() & ymmState) == ymmState;
+}
+
+inline bool CpuSupportsAVX512BW()
+{
+    unsigned int regs[4];
+    BlockMultiplierCpuid(0, regs);
+    if (regs[0] < 7)
+        return false;
+    BlockMultiplierCpuid(7, regs);
+    const unsigned long long zmmState = 0xe6; // SSE, AVX, opmask and both halves of the zmm registers
+    return (regs[1] & (1u << 16)) && (regs[1] & (1u << 30)) && // AVX512F, AVX512BW
+           (BlockMultiplierEnabledRegisterState() & zmmState) == zmmState;
+}
+
+inline bool CpuSupportsAVX512VNNI()
+{
+    if (!CpuSupportsAVX512BW())
+        return false;
+    unsigned int regs[4];
+    BlockMultiplierCpuid(7, regs);
+    return (regs[2] & (1u << 11)) != 0;
+}
+
+}}}
@@ -11,6 +11,13 @@
 
 #include "CPUMatrix.h"
 #include "TensorOps.h"
+#include "MultiTensorUpdate.h"
+#include "CPUVectorKernels.h"
+#include "PhiloxRNG.h"
+#include "ImageAugmentation.h"
+#include "ValueCompression.h"
+#include "CPURNN.h"
+#include "ConvolveGeometry.h"
 #include <assert.h>
 #include <stdexcept>
 #include <omp.h>
@@ -72,6 +79,49 @@ bool TracingGPUMemoryAllocator::IsTraceEnabled()
     return (m_traceLevel > 0);
 }
 
+bool MATH_API TracingGPUMemoryAllocator::m_cachingEnabled = true;
+size_t MATH_API TracingGPUMemoryAllocator::m_cacheLimitInBytes = 0;
+std::atomic<size_t> MATH_API TracingGPUMemoryAllocator::m_numDeviceMallocs(0);
+
+void TracingGPUMemoryAllocator::SetCachingEnabled(bool enabled)
+{
+    m_cachingEnabled = enabled;
+}
+
+bool TracingGPUMemoryAllocator::IsCachingEnabled()
+{
+    return m_cachingEnabled;
+}
+
+void TracingGPUMemoryAllocator::SetCacheLimitInMBs(size_t limitInMBs)
+{
+    m_cacheLimitInBytes = limitInMBs << 20;
+}
+
+size_t TracingGPUMemoryAllocator::GetCacheLimitInBytes()
+{
+    return m_cacheLimitInBytes;
+}
+
+double MATH_API MatrixResizePolicy::m_growthFactor = 1.5;
+double MATH_API MatrixResizePolicy::m_shrinkThreshold = 0;
+std::atomic<size_t> MATH_API MatrixResizePolicy::m_numReallocations(0);
+std::atomic<size_t> MATH_API MatrixResizePolicy::m_numAllocations(0);
+
+void MatrixResizePolicy::SetGrowthFactor(double growthFactor)
+{
+    if (growthFactor < 1)
+        InvalidArgument("The growth factor of matrix buffers must be at least 1, but is %g.", growthFactor);
+    m_growthFactor = growthFactor;
+}
+
+void MatrixResizePolicy::SetShrinkThreshold(double shrinkThreshold)
+{
+    if (shrinkThreshold < 0 || shrinkThreshold >= 1)
+        InvalidArgument("The shrink threshold of matrix buffers must be in [0, 1), but is %g.", shrinkThreshold);
+    m_shrinkThreshold = shrinkThreshold;
+}
+
 #pragma region Helpful Enum Definitions
 enum class MatrixOrder
 {
@@ -101,6 +151,164 @@ enum class MatrixOpSide : char
 };
 #pragma endregion Helpful Enum Definitions
 
+#pragma region Vectorized Kernels
+// The elementwise functions and sums of float matrices go through the CPUVectorKernels of the best instruction
+// set of the processor. There are no double kernels; the double overloads return false, and the callers keep their loops.
+
+// Calls kernel(begin, count) on chunks of [0, n), in parallel.
+template <class KernelFunction>
+static void ForEachChunk(size_t n, const KernelFunction& kernel)
+{
+    const size_t chunkSize = 16384; // large enough that the OMP overhead does not matter
+    long chunks = (long) ((n + chunkSize - 1) / chunkSize);
+#pragma omp parallel for if (chunks > 1)
+    for (long k = 0; k < chunks; k++)
+    {
+        size_t begin = k * chunkSize;
+        kernel(begin, std::min(chunkSize, n - begin));
+    }
+}
+
+static bool VectorizedExp(const float* a, float* c, size_t n)
+{
+    const auto& kernels = CPUVectorKernels::Best();
+    ForEachChunk(n, [&](size_t begin, size_t count) { kernels.Exp(a + begin, c + begin, count); });
+    return true;
+}
+
+static bool VectorizedSigmoid(const float* a, float* c, size_t n)
+{
+    const auto& kernels = CPUVectorKernels::Best();
+    ForEachChunk(n, [&](size_t begin, size_t count) { kernels.Sigmoid(a + begin, c + begin, count); });
+    return true;
+}
+
+static bool VectorizedTanh(const float* a, float* c, size_t n)
+{
+    const auto& kernels = CPUVectorKernels::Best();
+    ForEachChunk(n, [&](size_t begin, size_t count) { kernels.Tanh(a + begin, c + begin, count); });
+    return true;
+}
+
+// log softmax of each column of a column-major rows x cols matrix
+static bool VectorizedLogSoftmaxColumns(const float* a, float* c, size_t rows, size_t cols)
+{
+    const auto& kernels = CPUVectorKernels::Best();
+#pragma omp parallel for
+    for (long j = 0; j < (long) cols; j++)
+    {
+        // we need to extract max before applying exp to avoid overflow
+        float maxV = kernels.Max(a + j * rows, rows);
+        double sum = kernels.SubtractAndSumExp(a + j * rows, maxV, c + j * rows, rows);
+        kernels.AddScalar(-(float) log(sum), c + j * rows, rows);
+    }
+    return true;
+}
+
+// c[j * ldc] = beta * c[j * ldc] + alpha * (sum of the contiguous column a[j * lda ...])
+static bool VectorizedColumnSums(float beta, const float* a, size_t rows, size_t cols, ptrdiff_t lda, float* c, ptrdiff_t ldc, float alpha)
+{
+    const auto& kernels = CPUVectorKernels::Best();
+#pragma omp parallel for if (cols > 1)
+    for (long j = 0; j < (long) cols; j++)
+    {
+        float sum = (float) kernels.Sum(a + j * lda, rows) * alpha;
+        if (beta != 0)
+            sum += beta * c[j * ldc];
+        c[j * ldc] = sum;
+    }
+    return true;
+}
+
+// c[i] = beta * c[i] + alpha * (sum of the row a[i + j * lda]), for the contiguous vector c
+static bool VectorizedRowSums(float beta, const float* a, size_t rows, size_t cols, size_t lda, float* c, float alpha)
+{
+    const auto& kernels = CPUVectorKernels::Best();
+    ForEachChunk(rows, [&](size_t begin, size_t count) { kernels.RowSums(a + begin, count, cols, lda, beta, c + begin, alpha); });
+    return true;
+}
+
+// c = f(c) in place for the activations of AddBiasAndActivation() that have a kernel
+static bool VectorizedActivation(ElementWiseOperator activation, float* c, size_t n)
+{
+    const auto& kernels = CPUVectorKernels::Best();
+    switch (activation)
+    {
+    case opSigmoid: kernels.Sigmoid(c, c, n); return true;
+    case opTanh:    kernels.Tanh(c, c, n);    return true;
+    default:        return false;
+    }
+}
+
+static bool VectorizedExp(const double*, double*, size_t) { return false; }
+static bool VectorizedSigmoid(const double*, double*, size_t) { return false; }
+static bool VectorizedTanh(const double*, double*, size_t) { return false; }
+static bool VectorizedLogSoftmaxColumns(const double*, double*, size_t, size_t) { return false; }
+static bool VectorizedColumnSums(double, const double*, size_t, size_t, ptrdiff_t, double*, ptrdiff_t, double) { return false; }
+static bool VectorizedRowSums(double, const double*, size_t, size_t, size_t, double*, double) { return false; }
+static bool VectorizedActivation(ElementWiseOperator, double*, size_t) { return false; }
+
+// Products of at most this many multiply-adds, e.g. the matrix-vector products of a recurrent step of one sequence,
+// skip the BLAS library, whose dispatch and threading take longer than the product itself (see SetSmallGemmThreshold()).
+static size_t s_smallGemmThreshold = 256 * 1024;
+
+// c = alpha * op(a) * op(b) + beta * c on the calling thread, if it is small enough
+static bool VectorizedSmallGemm(bool transposeA, bool transposeB, size_t m, size_t n, size_t k, float alpha, const float* a, size_t lda,
+                                const float* b, size_t ldb, float beta, float* c, size_t ldc)
+{
+    if (m * n * k > s_smallGemmThreshold)
+        return false;
+    CPUVectorKernels::Best().SmallGemm(transposeA, transposeB, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+    return true;
+}
+static bool VectorizedSmallGemm(bool, bool, size_t, size_t, size_t, double, const double*, size_t, const double*, size_t, double, double*, size_t) { return false; }
+
+// The inner loops of batch normalization and pooling, over contiguous runs of a channel; for double, the plain loops.
+static void SumAndSumOfSquares(const float* a, size_t n, double& sum, double& sumOfSquares) { CPUVectorKernels::Best().SumAndSumOfSquares(a, n, sum, sumOfSquares); }
+static void SumAndDot(const float* a, const float* b, size_t n, double& sum, double& dot) { CPUVectorKernels::Best().SumAndDot(a, b, n, sum, dot); }
+static void ScaleAndShift(const float* a, float scale, float shift, float* c, size_t n) { CPUVectorKernels::Best().ScaleAndShift(a, scale, shift, c, n); }
+static void AddLinearCombination(float alpha, const float* a, float beta, const float* b, float gamma, float* c, size_t n) { CPUVectorKernels::Best().AddLinearCombination(alpha, a, beta, b, gamma, c, n); }
+static void MaxInto(const float* a, float* c, size_t n) { CPUVectorKernels::Best().MaxInto(a, c, n); }
+static void AddInto(const float* a, float* c, size_t n) { CPUVectorKernels::Best().AddInto(a, c, n); }
+
+static void SumAndSumOfSquares(const double* a, size_t n, double& sum, double& sumOfSquares)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += a[i];
+        sumOfSquares += a[i] * a[i];
+    }
+}
+static void SumAndDot(const double* a, const double* b, size_t n, double& sum, double& dot)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += a[i];
+        dot += a[i] * b[i];
+    }
+}
+static void ScaleAndShift(const double* a, double scale, double shift, double* c, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        c[i] = a[i] * scale + shift;
+}
+static void AddLinearCombination(double alpha, const double* a, double beta, const double* b, double gamma, double* c, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        c[i] += alpha * a[i] + beta * b[i] + gamma;
+}
+static void MaxInto(const double* a, double* c, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        c[i] = std::max(c[i], a[i]);
+}
+static void AddInto(const double* a, double* c, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        c[i] += a[i];
+}
+#pragma endregion Vectorized Kernels
+
 #pragma region Constructors and Destructor
 
 template <class ElemType>
@@ -662,6 +870,27 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::DoGatherColumnsOf(ElemType beta, const
     return *this;
 }
 
+// see Matrix<ElemType>::AssignPackedIndicesOf()
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignPackedIndicesOf(const CPUMatrix<ElemType>& idx, const CPUMatrix<ElemType>& ranges, size_t numParallelSequences)
+{
+    if (idx.GetNumRows() != 1 || ranges.GetNumRows() != 3 || ranges.GetNumCols() != idx.GetNumCols())
+        InvalidArgument("AssignPackedIndicesOf: Expected a row vector of indices and a range for each of its columns.");
+
+    RequireSize(1, idx.GetNumCols());
+    auto& us = *this;
+    foreach_column(j, us)
+    {
+        auto t = idx(0, j); // (NaN fails both tests)
+        if (t >= ranges(1, j) && t < ranges(2, j))
+            us(0, j) = ranges(0, j) + (ElemType)((size_t)t * numParallelSequences);
+        else
+            us(0, j) = -1;
+    }
+
+    return *this;
+}
+
 // *this[:,idx[j]] = a[:,j] * alpha + *this[:,idx[j]] * beta
 template <class ElemType>
 CPUMatrix<ElemType>& CPUMatrix<ElemType>::DoScatterColumnsOf(ElemType beta, const CPUMatrix<ElemType>& idx, const CPUMatrix<ElemType>& a, ElemType alpha)
@@ -677,18 +906,33 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::DoScatterColumnsOf(ElemType beta, cons
 
     // pre-scale with beta upfront
     // Scatter may add more than one source column to the same target, so we must pre-scale with beta, and then just keep adding.
-    Scale(beta, us); // if beta is 0, then this will be a memset()
+    if (beta != 1) // (e.g. a sparse update of a large gradient must not touch the whole matrix)
+        Scale(beta, us); // if beta is 0, then this will be a memset()
 
-#pragma omp parallel for // TODO: Depending in circumstance, it may be more efficient to parallelize over rows.
     foreach_column(jIn, a)
     {
-        auto jOutF = idx(0, jIn);           // this is the column we copy/add into
-        if (std::isnan(jOutF) || jOutF < 0) // negative index means gap
-            continue;
-        size_t jOut = (size_t)jOutF;
-        if (jOut >= GetNumCols())
-            InvalidArgument("DoGatherColumnsOf: Map out of bounds.");
-        ScaleAndAddColumn(/*beta=*/(ElemType)1, &us(0, jOut), &a(0, jIn), us.GetNumRows(), alpha);
+        auto jOutF = idx(0, jIn);
+        if (!std::isnan(jOutF) && jOutF >= GetNumCols())
+            InvalidArgument("DoScatterColumnsOf: Map out of bounds.");
+    }
+
+    // The map may send several source columns into the same target column (e.g. the gradient of a context window),
+    // so the threads work on disjoint bands of rows rather than on columns.
+    const long numRows = (long)us.GetNumRows();
+    const long bandSize = 64;
+#pragma omp parallel for
+    for (long iBegin = 0; iBegin < numRows; iBegin += bandSize)
+    {
+        const long iEnd = min(iBegin + bandSize, numRows);
+        foreach_column(jIn, a)
+        {
+            auto jOutF = idx(0, jIn);           // this is the column we copy/add into
+            if (std::isnan(jOutF) || jOutF < 0) // negative index means gap
+                continue;
+            size_t jOut = (size_t)jOutF;
+            for (long i = iBegin; i < iEnd; i++)
+                us(i, jOut) += a(i, jIn) * alpha;
+        }
     }
 
     return *this;
@@ -760,6 +1004,57 @@ void CPUMatrix<ElemType>::MaskColumnsValue(const CPUMatrix<char>& columnsMask, E
     }
 }
 
+template <class ElemType>
+size_t CPUMatrix<ElemType>::ExtractLargestMagnitudes(size_t k, ElemType threshold, int* indices, ElemType* values)
+{
+    ElemType* data = Data();
+    size_t n = GetNumElements();
+    assert(k > 0 && k <= n);
+
+    // the k-th largest magnitude
+    std::vector<ElemType> magnitudes(n);
+    for (size_t i = 0; i < n; i++)
+        magnitudes[i] = fabs(data[i]);
+    std::nth_element(magnitudes.begin(), magnitudes.begin() + (k - 1), magnitudes.end(), std::greater<ElemType>());
+    ElemType kthMagnitude = magnitudes[k - 1];
+
+    // all larger magnitudes (of which there are fewer than k), then as many of the k-th as fit
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (fabs(data[i]) > kthMagnitude && fabs(data[i]) >= threshold)
+        {
+            indices[count] = (int) i;
+            values[count++] = data[i];
+            data[i] = 0;
+        }
+    }
+    if (kthMagnitude > 0 && kthMagnitude >= threshold)
+    {
+        for (size_t i = 0; i < n && count < k; i++)
+        {
+            if (fabs(data[i]) == kthMagnitude)
+            {
+                indices[count] = (int) i;
+                values[count++] = data[i];
+                data[i] = 0;
+            }
+        }
+    }
+    return count;
+}
+
+template <class ElemType>
+void CPUMatrix<ElemType>::AddValuesAtIndices(const int* indices, const ElemType* values, size_t count)
+{
+    ElemType* data = Data();
+    for (size_t i = 0; i < count; i++)
+    {
+        assert(indices[i] >= 0 && (size_t) indices[i] < GetNumElements());
+        data[indices[i]] += values[i];
+    }
+}
+
 template <class ElemType>
 void CPUMatrix<ElemType>::SetColumn(const ElemType* colPointer, size_t j)
 {
@@ -876,8 +1171,9 @@ void CPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, E
     // if it's externally managed, then populate the structure
     if (matrixFlags & matrixFlagDontOwnBuffer)
     {
-        // free previous array allocation if any before overwriting
-        delete[] Buffer();
+        // free previous array allocation if any before overwriting (unless that was borrowed, too)
+        if (!HasExternalBuffer())
+            delete[] Buffer();
 
         m_numRows = numRows;
         m_numCols = numCols;
@@ -886,6 +1182,14 @@ void CPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, E
     }
     else
     {
+        // a borrowed buffer must not be written: get an own one
+        if (HasExternalBuffer())
+        {
+            SetBuffer(nullptr, 0);
+            SetSizeAllocated(0);
+            m_numRows = 0;
+            m_numCols = 0;
+        }
         RequireSize(numRows, numCols);
 
         if (!IsEmpty())
@@ -1133,6 +1437,40 @@ void CPUMatrix<ElemType>::SetUniformRandomMask(const ElemType maskRate, const El
     }
 }
 
+// this = beta * this + a .* mask, where element i is masked by word (offset + i) % 4 of Philox block (offset + i) / 4 of 'key'
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddDropoutOf(const CPUMatrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue, uint64_t key, size_t offset, const ElemType beta)
+{
+    if (a.IsEmpty())
+        LogicError("AddDropoutOf: Matrix is empty.");
+
+    if (beta == 0 && this != &a)
+        RequireSize(a.GetNumRows(), a.GetNumCols());
+    else if (!(a.GetNumRows() == GetNumRows() && a.GetNumCols() == GetNumCols()))
+        InvalidArgument("AddDropoutOf: The input matrix dimensions do not match [this].");
+
+    ElemType* us = Data();
+    const ElemType* pa = a.Data();
+    const long long n = (long long) GetNumElements();
+    const long long firstBlock = (long long) (offset / 4), endBlock = (long long) ((offset + n + 3) / 4);
+    const float rate = (float) maskRate;
+#pragma omp parallel for
+    for (long long block = firstBlock; block < endBlock; block++)
+    {
+        PhiloxBlock random = Philox4x32_10((uint64_t) block, key);
+        for (int w = 0; w < 4; w++)
+        {
+            long long i = block * 4 + w - (long long) offset;
+            if (i < 0 || i >= n)
+                continue;
+            ElemType value = PhiloxToUniform(random.w[w]) <= rate ? 0 : pa[i] * scaleValue;
+            us[i] = beta == 0 ? value : beta * us[i] + value;
+        }
+    }
+
+    return *this;
+}
+
 template <class ElemType>
 ElemType CPUMatrix<ElemType>::Adagrad(CPUMatrix<ElemType>& gradients, const bool needAveMultiplier)
 {
@@ -1344,6 +1682,177 @@ ElemType CPUMatrix<ElemType>::RmsProp(CPUMatrix<ElemType>& gradients,
         return 1;
 }
 
+template <class ElemType>
+/*static*/ bool CPUMatrix<ElemType>::MultiTensorUpdate(const MultiTensorUpdateParams<ElemType>& params,
+                                                       const std::vector<CPUMatrix<ElemType>*>& smoothedGradients, const std::vector<CPUMatrix<ElemType>*>& gradients,
+                                                       const std::vector<CPUMatrix<ElemType>*>& values, const std::vector<ElemType>& adaMuls, bool checkForNan)
+{
+    bool hasNan = false;
+    for (size_t k = 0; k < values.size(); k++)
+    {
+        ElemType* smoothed = smoothedGradients[k]->Data();
+        ElemType* gradient = gradients[k]->Data();
+        ElemType* value = values[k]->Data();
+        long n = (long) values[k]->GetNumElements();
+        ElemType adaMul = adaMuls.empty() ? 0 : adaMuls[k];
+
+        if (params.m_needAveMultiplier)
+        {
+            // (sequential, so that the sum is that of Adagrad() and RmsProp())
+            ElemType multiplierSum = 0;
+            for (long i = 0; i < n; i++)
+                multiplierSum += MultiTensorUpdateElement(params, adaMul, smoothed, gradient, value, i, n);
+            ElemType aveMultiplier = n > 0 ? multiplierSum / n : 1;
+            for (long i = 0; i < n; i++)
+                MultiTensorApplyStep(params, aveMultiplier, gradient, value, i);
+        }
+        else
+        {
+#pragma omp parallel for
+            for (long i = 0; i < n; i++)
+                MultiTensorUpdateElement(params, adaMul, smoothed, gradient, value, i, n);
+        }
+
+        for (long i = 0; checkForNan && !hasNan && i < n; i++)
+            hasNan = std::isnan(value[i]);
+    }
+    return hasNan;
+}
+
+template <class ElemType>
+/*static*/ double CPUMatrix<ElemType>::MultiTensorSumOfSquares(const std::vector<const CPUMatrix<ElemType>*>& tensors)
+{
+    double sum = 0;
+    for (auto tensor : tensors)
+    {
+        const ElemType* data = tensor->Data();
+        long n = (long) tensor->GetNumElements();
+#pragma omp parallel for reduction(+ : sum)
+        for (long i = 0; i < n; i++)
+            sum += (double) data[i] * data[i];
+    }
+    return sum;
+}
+
+template <class ElemType>
+void CPUMatrix<ElemType>::AssignAugmentedImages(const unsigned char* images, size_t numCols, const ImageAugmentationParams& params, const ElemType* mean, uint64_t key)
+{
+    const size_t planeSize = (size_t) params.m_width * params.m_height;
+    const size_t channels = params.m_channels;
+    const size_t numRows = planeSize * channels;
+    RequireSize(numRows, numCols);
+    ElemType* data = Data();
+
+#pragma omp parallel for
+    for (long j = 0; j < (long) numCols; j++)
+    {
+        const unsigned char* src = images + j * numRows;
+        ElemType* dst = data + j * numRows;
+        const ImageAugmentationDraws draws = DrawImageAugmentation(params, key, j);
+
+        float imageMean = 0;
+        if (params.m_brightnessRadius > 0)
+        {
+            unsigned int sum = 0;
+            for (size_t i = 0; i < numRows; i++)
+                sum += src[i];
+            imageMean = (float) sum / numRows;
+        }
+
+        for (size_t pixel = 0; pixel < planeSize; pixel++)
+        {
+            float x[4];
+            for (size_t c = 0; c < channels; c++)
+                x[c] = src[pixel * channels + c];
+            AugmentImagePixel(params, draws, imageMean, x);
+            for (size_t c = 0; c < channels; c++)
+            {
+                size_t index = pixel * channels + c;
+                float value = mean ? x[c] - (float) mean[index] : x[c];
+                dst[params.m_transpose ? c * planeSize + pixel : index] = (ElemType) (value * params.m_scale);
+            }
+        }
+    }
+}
+
+template <class ElemType>
+void CPUMatrix<ElemType>::CompressValuesInto(char* codes, size_t columnBytes, ValueCompression compression) const
+{
+    const size_t numRows = GetNumRows();
+    const ElemType* data = Data();
+
+#pragma omp parallel for
+    for (long j = 0; j < (long) GetNumCols(); j++)
+    {
+        const ElemType* src = data + j * numRows;
+        char* dst = codes + j * columnBytes;
+        if (compression == ValueCompression::sign)
+        {
+            memset(dst, 0, columnBytes);
+            for (size_t i = 0; i < numRows; i++)
+            {
+                if (src[i] > 0)
+                    dst[i / 8] |= (char) (1 << (i % 8));
+            }
+        }
+        else if (compression == ValueCompression::half)
+        {
+            uint16_t* halves = reinterpret_cast<uint16_t*>(dst);
+            for (size_t i = 0; i < numRows; i++)
+                halves[i] = FloatToHalf((float) src[i]);
+        }
+        else
+        {
+            float minimum = numRows > 0 ? (float) src[0] : 0;
+            float maximum = minimum;
+            for (size_t i = 1; i < numRows; i++)
+            {
+                minimum = fminf(minimum, (float) src[i]);
+                maximum = fmaxf(maximum, (float) src[i]);
+            }
+            float* header = reinterpret_cast<float*>(dst);
+            header[0] = minimum;
+            header[1] = (maximum - minimum) / 255;
+            const float scale = header[1] > 0 ? 1 / header[1] : 0;
+            unsigned char* bytes = reinterpret_cast<unsigned char*>(dst + 2 * sizeof(float));
+            for (size_t i = 0; i < numRows; i++)
+                bytes[i] = FloatToByteCode((float) src[i], minimum, scale);
+        }
+    }
+}
+
+template <class ElemType>
+void CPUMatrix<ElemType>::AssignDecompressedValuesOf(const char* codes, size_t columnBytes, ValueCompression compression, size_t numRows, size_t numCols)
+{
+    RequireSize(numRows, numCols);
+    ElemType* data = Data();
+
+#pragma omp parallel for
+    for (long j = 0; j < (long) numCols; j++)
+    {
+        const char* src = codes + j * columnBytes;
+        ElemType* dst = data + j * numRows;
+        if (compression == ValueCompression::sign)
+        {
+            for (size_t i = 0; i < numRows; i++)
+                dst[i] = (ElemType) ((src[i / 8] >> (i % 8)) & 1);
+        }
+        else if (compression == ValueCompression::half)
+        {
+            const uint16_t* halves = reinterpret_cast<const uint16_t*>(src);
+            for (size_t i = 0; i < numRows; i++)
+                dst[i] = (ElemType) HalfToFloat(halves[i]);
+        }
+        else
+        {
+            const float* header = reinterpret_cast<const float*>(src);
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(src + 2 * sizeof(float));
+            for (size_t i = 0; i < numRows; i++)
+                dst[i] = (ElemType) (header[0] + bytes[i] * header[1]);
+        }
+    }
+}
+
 template <class ElemType>
 void CPUMatrix<ElemType>::Reshape(const size_t numRows, const size_t numCols)
 {
@@ -1366,7 +1875,8 @@ void CPUMatrix<ElemType>::RequireSize(const size_t numRows, const size_t numCols
 // Resize() -- change matrix size
 // This function is cheap if the matrix size does not change.
 // Current content is not preserved.
-// If growOnly is true, resize will not reallocate memory if the current memory is large enough (i.e., will not shrink).
+// If growOnly is true, resize will not reallocate memory if the current memory is large enough (i.e., will shrink only
+// as far as MatrixResizePolicy allows). A buffer that grows gets the spare capacity of MatrixResizePolicy.
 // If this object does not own its memory then new memory cannot be allocated (one can still shrink and/or reshape).
 template <class ElemType>
 void CPUMatrix<ElemType>::Resize(const size_t numRows, const size_t numCols, bool growOnly /*=true*/)
@@ -1376,22 +1886,9 @@ void CPUMatrix<ElemType>::Resize(const size_t numRows, const size_t numCols, boo
 
     VerifyResizable(__func__);
 
-    size_t numElements = numRows * numCols;
-    if (numElements > GetSizeAllocated() ||                 // grow allocation
-        (!growOnly && (numElements != GetSizeAllocated()))) // shrink allocation (not if 'growOnly')
-    {
-        // reallocate buffer
-        ElemType* pArray = nullptr;
-        if (numElements > 0)
-        {
-            pArray = NewArray<ElemType>(numElements);
-        }
-        // success: update the object
-        delete[] Buffer();
-
-        SetBuffer(pArray, numElements * sizeof(ElemType));
-        SetSizeAllocated(numElements);
-    }
+    size_t capacity = MatrixResizePolicy::GetCapacity(numRows * numCols, GetSizeAllocated(), growOnly);
+    if (capacity != GetSizeAllocated())
+        Reallocate(capacity, false);
 
     // success
     m_sliceViewOffset = 0;
@@ -1399,6 +1896,38 @@ void CPUMatrix<ElemType>::Resize(const size_t numRows, const size_t numCols, boo
     m_numCols         = numCols;
 }
 
+// ShrinkToFit() -- release the spare capacity that Resize() left, keeping the content
+template <class ElemType>
+void CPUMatrix<ElemType>::ShrinkToFit()
+{
+    if (GetSizeAllocated() == GetNumElements())
+        return;
+    VerifyResizable(__func__);
+    Reallocate(GetNumElements(), true);
+}
+
+// replace the buffer by one of 'capacity' elements, into which the content is moved if 'keepContent'
+template <class ElemType>
+void CPUMatrix<ElemType>::Reallocate(size_t capacity, bool keepContent)
+{
+    ElemType* pArray = nullptr;
+    if (capacity > 0)
+    {
+        pArray = NewArray<ElemType>(capacity);
+        MatrixResizePolicy::CountAllocation();
+        if (keepContent)
+            memcpy(pArray, Data(), std::min(capacity, GetNumElements()) * sizeof(ElemType));
+    }
+    if (GetSizeAllocated() > 0)
+        MatrixResizePolicy::CountReallocation();
+    // success: update the object
+    delete[] Buffer();
+
+    SetBuffer(pArray, capacity * sizeof(ElemType));
+    SetSizeAllocated(capacity);
+    m_sliceViewOffset = 0;
+}
+
 // allocated by the callee but should be deleted by the caller
 // TODO: change to use STL vector instead
 template <class ElemType>
@@ -2090,6 +2619,9 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignSigmoidOf(const CPUMatrix<ElemTy
     if (this != &a)
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
+    if (VectorizedSigmoid(a.Data(), Data(), GetNumElements()))
+        return *this;
+
 #pragma omp parallel for
     foreach_coord (i, j, us)
     {
@@ -2105,6 +2637,50 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignSigmoidOf(const CPUMatrix<ElemTy
     return *this;
 }
 
+// this = f(this + bias), with the column vector bias added to every column
+// f is opCopy (no activation), opSigmoid, opTanh or opLinearRectifier, computed like the element-wise TensorOp() would.
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddBiasAndActivation(const CPUMatrix<ElemType>& bias, ElementWiseOperator activation)
+{
+    if (IsEmpty())
+        LogicError("AddBiasAndActivation: Matrix is empty.");
+    if (bias.GetNumElements() != GetNumRows())
+        InvalidArgument("AddBiasAndActivation: The bias must have one element per row.");
+    if (activation != opCopy && activation != opSigmoid && activation != opTanh && activation != opLinearRectifier)
+        InvalidArgument("AddBiasAndActivation: Unsupported activation %d.", (int) activation);
+
+    const size_t rows = GetNumRows();
+    const ElemType* biasData = bias.Data();
+#pragma omp parallel for
+    for (long j = 0; j < (long) GetNumCols(); j++)
+    {
+        ElemType* column = Data() + j * rows;
+        for (size_t i = 0; i < rows; i++)
+            column[i] += biasData[i];
+        if (VectorizedActivation(activation, column, rows))
+            continue;
+        switch (activation)
+        {
+        case opSigmoid:
+            for (size_t i = 0; i < rows; i++)
+                column[i] = Sigmoid(column[i]);
+            break;
+        case opTanh:
+            for (size_t i = 0; i < rows; i++)
+                column[i] = tanh_(column[i]);
+            break;
+        case opLinearRectifier:
+            for (size_t i = 0; i < rows; i++)
+                column[i] = column[i] > 0 ? column[i] : 0;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return *this;
+}
+
 template <class ElemType>
 CPUMatrix<ElemType>& CPUMatrix<ElemType>::InplaceLinearRectifierDerivative()
 {
@@ -2206,6 +2782,9 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignTanhOf(const CPUMatrix<ElemType>
     if (this != &a)
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
+    if (VectorizedTanh(a.Data(), Data(), GetNumElements()))
+        return *this;
+
     long m = (long) GetNumRows(), n = (long) GetNumCols();
 #pragma omp parallel for
     for (long j = 0; j < n; j++)
@@ -2245,6 +2824,9 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignLogSoftmaxOf(const CPUMatrix<Ele
     if (this != &a)
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
+    if (isColWise && VectorizedLogSoftmaxColumns(a.Data(), Data(), GetNumRows(), GetNumCols()))
+        return *this;
+
     if (isColWise)
     {
 #pragma omp parallel for
@@ -2407,6 +2989,9 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignExpOf(const CPUMatrix<ElemType>&
     if (this != &a)
         RequireSize(a.GetNumRows(), a.GetNumCols());
 
+    if (VectorizedExp(a.Data(), Data(), GetNumElements()))
+        return *this;
+
     long m = (long) GetNumRows(), n = (long) GetNumCols();
 #pragma omp parallel for
     for (long j = 0; j < n; j++)
@@ -2894,6 +3479,9 @@ void CPUMatrix<ElemType>::VectorSum(const CPUMatrix<ElemType>& a, CPUMatrix<Elem
     {
         c.RequireSize(1, n);
 
+        if (VectorizedColumnSums((ElemType) 0, a.Data(), m, n, m, c.Data(), 1, (ElemType) 1))
+            return;
+
 #pragma omp parallel for
         foreach_column (j, a)
         {
@@ -2910,6 +3498,9 @@ void CPUMatrix<ElemType>::VectorSum(const CPUMatrix<ElemType>& a, CPUMatrix<Elem
     {
         c.RequireSize(m, 1);
 
+        if (VectorizedRowSums((ElemType) 0, a.Data(), m, n, m, c.Data(), (ElemType) 1))
+            return;
+
 #pragma omp parallel for
         foreach_row (i, a)
         {
@@ -3413,11 +4004,38 @@ void CPUMatrix<ElemType>::VectorMax(CPUMatrix<ElemType>& maxIndexes, CPUMatrix<E
                 maxIndexes(0, j) = (ElemType) index;
             }
         }
-        else
+        else if (topK <= 32)
         {
-            std::vector<int> indices(m);
-            int i = 0;
-            std::generate(indices.begin(), indices.end(), [&i]
+            // one pass per column that keeps its top k sorted (descending, the lower row first among equal values):
+            // almost all elements only take the comparison with the smallest of the k
+#pragma omp parallel for
+            for (int icol = 0; icol < n; icol++)
+            {
+                const ElemType* curVal = Data() + (size_t) icol * m;
+                ElemType* curIdx = maxIndexes.Data() + (size_t) icol * topK;
+                ElemType* curMax = maxValues.Data() + (size_t) icol * topK;
+                int count = 0;
+                for (int irow = 0; irow < m; irow++)
+                {
+                    ElemType v = curVal[irow];
+                    if (count == topK && !(v > curMax[topK - 1]))
+                        continue;
+                    int j = count < topK ? count++ : topK - 1;
+                    for (; j > 0 && v > curMax[j - 1]; j--)
+                    {
+                        curMax[j] = curMax[j - 1];
+                        curIdx[j] = curIdx[j - 1];
+                    }
+                    curMax[j] = v;
+                    curIdx[j] = static_cast<ElemType>(irow);
+                }
+            }
+        }
+        else
+        {
+            std::vector<int> indices(m);
+            int i = 0;
+            std::generate(indices.begin(), indices.end(), [&i]
                           {
                               return i++;
                           });
@@ -3828,52 +4446,49 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::UnpackConvolutionInput(CPUMatrix<ElemT
 }
 
 //assume each column is an input sample. Each sample is stored in  (r00, g00, b00, r01, g01, b01, r10, g10, b10, r11, g11, b11)
-template <class ElemType>
-CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignMaxPoolingResult(const CPUMatrix<ElemType>& inputBatch, const size_t channels,
-                                                                 const size_t /*inputWidth*/, const size_t inputHeight, const size_t /*inputSizePerSample*/,
-                                                                 const size_t /*outputWidth*/, const size_t outputHeight, const size_t outputSizePerSample,
-                                                                 const size_t windowWidth, const size_t windowHeight, const size_t horizontalSubsample, const size_t verticalSubsample)
-{
-    const long inputHeightTimesChannel = (long) (inputHeight * channels);
-    const long outputHeightTimesChannel = (long) (outputHeight * channels);
-    const size_t batchSize = inputBatch.GetNumCols();
-    RequireSize(outputSizePerSample, batchSize);
-
-// IN_ELEM_ROWPOS(channel, row, col) = (channel + (row + col * inputHeight) * channels)
-// IN_ELEM_COLPOS = sample
-
-// OUT_ELEM_ROWPOS(channel, wrow, wcol) = (channel + (wrow + wcol * outputHeight) * channels)
-// OUT_ELEM_COLPOS = sample
-
+// The pooling of the legacy engine, where element (channel, row, col) of a sample is at channel + (row + col * height) * channels:
+// the output of a pixel is the combination of the contiguous channel vectors of the pixels of its window, the first one
+// copied and the others combined into it, in parallel over the samples and output columns.
+template <class ElemType, class CombineFunction>
+static void LegacyPoolingForward(const CPUMatrix<ElemType>& in, CPUMatrix<ElemType>& out, size_t channels, size_t inputHeight, size_t outputHeight,
+                                 size_t windowWidth, size_t windowHeight, size_t horizontalSubsample, size_t verticalSubsample, const CombineFunction& combine)
+{
+    const size_t inputSizePerSample = in.GetNumRows(), outputSizePerSample = out.GetNumRows();
+    const size_t outputWidth = outputSizePerSample / (outputHeight * channels);
+    const long numColumns = (long) (in.GetNumCols() * outputWidth);
 #pragma omp parallel for
-    for (long sample = 0; sample < (long) batchSize; sample++)
+    for (long k = 0; k < numColumns; k++)
     {
-        for (long outputIndexWithinSample = 0; outputIndexWithinSample < outputSizePerSample; outputIndexWithinSample++)
+        const size_t sample = k / outputWidth, y = k % outputWidth; // (wcol)
+        const ElemType* input = in.Data() + sample * inputSizePerSample + y * horizontalSubsample * inputHeight * channels;
+        ElemType* output = out.Data() + sample * outputSizePerSample + y * outputHeight * channels;
+        for (size_t x = 0; x < outputHeight; x++, output += channels) // (wrow)
         {
-            const long y = outputIndexWithinSample / outputHeightTimesChannel;   // wcol
-            const long nXC = outputIndexWithinSample % outputHeightTimesChannel; // channel + wrow*channels
-            const long x = (long) (nXC / channels);                              // wrow
-            const long c = (long) (nXC % channels);                              // channel
-
-            ElemType maxVal = -FLT_MAX;
-            ElemType minVal = FLT_MAX;
-            const long rowInWindowBase = (long) ((x * verticalSubsample + y * horizontalSubsample * inputHeight) * channels + c);
-            for (long colInWindow = 0; colInWindow < windowWidth; colInWindow++)
+            for (size_t colInWindow = 0; colInWindow < windowWidth; colInWindow++)
             {
-                long rowInInput = rowInWindowBase + colInWindow * inputHeightTimesChannel;
-                for (long rowInWindow = 0; rowInWindow < windowHeight; rowInWindow++)
+                const ElemType* window = input + (x * verticalSubsample + colInWindow * inputHeight) * channels;
+                for (size_t rowInWindow = 0; rowInWindow < windowHeight; rowInWindow++, window += channels)
                 {
-                    const ElemType val = inputBatch(rowInInput, sample); // pf[rowInWindow*channels];
-                    maxVal = std::max(maxVal, val);
-                    minVal = std::min(minVal, val);
-                    rowInInput += (long) channels;
+                    if (colInWindow == 0 && rowInWindow == 0)
+                        memcpy(output, window, channels * sizeof(ElemType));
+                    else
+                        combine(window, output, channels);
                 }
             }
-
-            (*this)(outputIndexWithinSample, sample) = maxVal;
         }
     }
+}
 
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignMaxPoolingResult(const CPUMatrix<ElemType>& inputBatch, const size_t channels,
+                                                                 const size_t /*inputWidth*/, const size_t inputHeight, const size_t /*inputSizePerSample*/,
+                                                                 const size_t /*outputWidth*/, const size_t outputHeight, const size_t outputSizePerSample,
+                                                                 const size_t windowWidth, const size_t windowHeight, const size_t horizontalSubsample, const size_t verticalSubsample)
+{
+    const size_t batchSize = inputBatch.GetNumCols();
+    RequireSize(outputSizePerSample, batchSize);
+    LegacyPoolingForward(inputBatch, *this, channels, inputHeight, outputHeight, windowWidth, windowHeight, horizontalSubsample, verticalSubsample,
+                         [](const ElemType* a, ElemType* c, size_t n) { MaxInto(a, c, n); });
     return *this;
 }
 
@@ -3930,44 +4545,11 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignAveragePoolingResult(const CPUMa
                                                                      const size_t /*outputWidth*/, const size_t outputHeight, const size_t outputSizePerSample,
                                                                      const size_t windowWidth, const size_t windowHeight, const size_t horizontalSubsample, const size_t verticalSubsample)
 {
-    const long inputHeightTimesChannel = (long) (inputHeight * channels);
-    const long outputHeightTimesChannel = (long) (outputHeight * channels);
     const size_t batchSize = inputBatch.GetNumCols();
-    const size_t windowSize = windowWidth * windowHeight;
     RequireSize(outputSizePerSample, batchSize);
-
-// IN_ELEM_ROWPOS(channel, row, col) = (channel + (row + col * inputHeight) * channels)
-// IN_ELEM_COLPOS = sample
-
-// OUT_ELEM_ROWPOS(channel, wrow, wcol) = (channel + (wrow + wcol * outputHeight) * channels)
-// OUT_ELEM_COLPOS = sample
-
-#pragma omp parallel for
-    for (long sample = 0; sample < batchSize; sample++)
-    {
-        for (long outputIndexWithinSample = 0; outputIndexWithinSample < outputSizePerSample; outputIndexWithinSample++)
-        {
-            const long y = outputIndexWithinSample / outputHeightTimesChannel;   // wcol
-            const long nXC = outputIndexWithinSample % outputHeightTimesChannel; // channel + wrow*channels
-            const long x = (long) (nXC / channels);                              // wrow
-            const long c = (long) (nXC % channels);                              // channel
-
-            ElemType sum = 0;
-            const long rowInWindowBase = (long) ((x * verticalSubsample + y * horizontalSubsample * inputHeight) * channels + c);
-            for (long colInWindow = 0; colInWindow < windowWidth; colInWindow++)
-            {
-                long rowInInput = rowInWindowBase + colInWindow * inputHeightTimesChannel;
-                for (long rowInWindow = 0; rowInWindow < windowHeight; rowInWindow++)
-                {
-                    sum += inputBatch(rowInInput, sample);
-                    rowInInput += (long) channels;
-                }
-            }
-
-            (*this)(outputIndexWithinSample, sample) = sum / windowSize;
-        }
-    }
-
+    LegacyPoolingForward(inputBatch, *this, channels, inputHeight, outputHeight, windowWidth, windowHeight, horizontalSubsample, verticalSubsample,
+                         [](const ElemType* a, ElemType* c, size_t n) { AddInto(a, c, n); });
+    ScaleAndShift(Data(), (ElemType) 1 / (windowWidth * windowHeight), (ElemType) 0, Data(), GetNumElements());
     return *this;
 }
 
@@ -4112,6 +4694,150 @@ void CPUMatrix<ElemType>::ConvolutionBackwardKernel(const CPUMatrix<ElemType>& i
     }
 }
 
+// The outputs o of a row whose kernel cell k falls into the input, i.e. 0 <= o * stride - pad + k < inSize.
+static void DepthwiseOutputRange(int k, int stride, int pad, int inSize, int outSize, int& begin, int& end)
+{
+    int lo = pad - k;
+    int hi = inSize - 1 + pad - k;
+    begin = lo <= 0 ? 0 : (lo + stride - 1) / stride;
+    end = hi < 0 ? 0 : std::min(outSize, hi / stride + 1);
+    end = std::max(begin, end);
+}
+
+// Each output plane is accumulated row by row from the kernel cells, each cell adding a (strided) row of the input,
+// which vectorizes for stride 1, the common case. Planes are independent, so the loops run in parallel over them.
+template <class ElemType>
+void CPUMatrix<ElemType>::DepthwiseConvolutionForward(const CPUMatrix<ElemType>& kernel, const DepthwiseConvolutionShape& shape, CPUMatrix<ElemType>& output) const
+{
+    const int maps = shape.m_channels * shape.m_multiplier;
+    const int inPlane = shape.m_inWidth * shape.m_inHeight;
+    const int outPlane = shape.m_outWidth * shape.m_outHeight;
+    const int kernelSize = shape.m_kernelWidth * shape.m_kernelHeight;
+    assert(GetNumRows() == (size_t)shape.m_channels * inPlane && output.GetNumRows() == (size_t)maps * outPlane);
+    assert(kernel.GetNumElements() == (size_t)maps * kernelSize);
+    const int64_t numPlanes = (int64_t)GetNumCols() * maps;
+#pragma omp parallel for
+    for (int64_t plane = 0; plane < numPlanes; plane++)
+    {
+        const int map = (int)(plane % maps);
+        const ElemType* x = Data() + (plane / maps) * GetNumRows() + (size_t)(map / shape.m_multiplier) * inPlane;
+        const ElemType* w = kernel.Data() + (size_t)map * kernelSize;
+        ElemType* y = output.Data() + plane * outPlane;
+        memset(y, 0, sizeof(ElemType) * outPlane);
+        for (int kx = 0; kx < shape.m_kernelWidth; kx++)
+        {
+            int oxBegin, oxEnd;
+            DepthwiseOutputRange(kx, shape.m_strideWidth, shape.m_padWidth, shape.m_inWidth, shape.m_outWidth, oxBegin, oxEnd);
+            for (int ky = 0; ky < shape.m_kernelHeight; ky++)
+            {
+                int oyBegin, oyEnd;
+                DepthwiseOutputRange(ky, shape.m_strideHeight, shape.m_padHeight, shape.m_inHeight, shape.m_outHeight, oyBegin, oyEnd);
+                const ElemType weight = w[ky * shape.m_kernelWidth + kx];
+                for (int oy = oyBegin; oy < oyEnd; oy++)
+                {
+                    const ElemType* xRow = x + (oy * shape.m_strideHeight - shape.m_padHeight + ky) * shape.m_inWidth - shape.m_padWidth + kx;
+                    ElemType* yRow = y + oy * shape.m_outWidth;
+                    if (shape.m_strideWidth == 1)
+                    {
+                        for (int ox = oxBegin; ox < oxEnd; ox++)
+                            yRow[ox] += weight * xRow[ox];
+                    }
+                    else
+                    {
+                        for (int ox = oxBegin; ox < oxEnd; ox++)
+                            yRow[ox] += weight * xRow[ox * shape.m_strideWidth];
+                    }
+                }
+            }
+        }
+    }
+}
+
+// The gradient of an input channel collects those of its 'multiplier' maps, so that each thread owns the input planes it adds to.
+template <class ElemType>
+void CPUMatrix<ElemType>::DepthwiseConvolutionBackwardData(const CPUMatrix<ElemType>& kernel, const DepthwiseConvolutionShape& shape, CPUMatrix<ElemType>& grad) const
+{
+    const int maps = shape.m_channels * shape.m_multiplier;
+    const int inPlane = shape.m_inWidth * shape.m_inHeight;
+    const int outPlane = shape.m_outWidth * shape.m_outHeight;
+    const int kernelSize = shape.m_kernelWidth * shape.m_kernelHeight;
+    assert(grad.GetNumRows() == (size_t)shape.m_channels * inPlane && GetNumRows() == (size_t)maps * outPlane);
+    const int64_t numPlanes = (int64_t)GetNumCols() * shape.m_channels;
+#pragma omp parallel for
+    for (int64_t plane = 0; plane < numPlanes; plane++)
+    {
+        const int channel = (int)(plane % shape.m_channels);
+        ElemType* dx = grad.Data() + plane * inPlane;
+        for (int m = 0; m < shape.m_multiplier; m++)
+        {
+            const int map = channel * shape.m_multiplier + m;
+            const ElemType* dy = Data() + (plane / shape.m_channels) * GetNumRows() + (size_t)map * outPlane;
+            const ElemType* w = kernel.Data() + (size_t)map * kernelSize;
+            for (int kx = 0; kx < shape.m_kernelWidth; kx++)
+            {
+                int oxBegin, oxEnd;
+                DepthwiseOutputRange(kx, shape.m_strideWidth, shape.m_padWidth, shape.m_inWidth, shape.m_outWidth, oxBegin, oxEnd);
+                for (int ky = 0; ky < shape.m_kernelHeight; ky++)
+                {
+                    int oyBegin, oyEnd;
+                    DepthwiseOutputRange(ky, shape.m_strideHeight, shape.m_padHeight, shape.m_inHeight, shape.m_outHeight, oyBegin, oyEnd);
+                    const ElemType weight = w[ky * shape.m_kernelWidth + kx];
+                    for (int oy = oyBegin; oy < oyEnd; oy++)
+                    {
+                        ElemType* dxRow = dx + (oy * shape.m_strideHeight - shape.m_padHeight + ky) * shape.m_inWidth - shape.m_padWidth + kx;
+                        const ElemType* dyRow = dy + oy * shape.m_outWidth;
+                        for (int ox = oxBegin; ox < oxEnd; ox++)
+                            dxRow[ox * shape.m_strideWidth] += weight * dyRow[ox];
+                    }
+                }
+            }
+        }
+    }
+}
+
+// The gradient of a kernel cell is the sum over all samples of the products of the gradient of its map with the
+// input it sees; each thread sums the cells of its own maps.
+template <class ElemType>
+void CPUMatrix<ElemType>::DepthwiseConvolutionBackwardKernel(const CPUMatrix<ElemType>& in, const DepthwiseConvolutionShape& shape, CPUMatrix<ElemType>& kernelGrad) const
+{
+    const int maps = shape.m_channels * shape.m_multiplier;
+    const int inPlane = shape.m_inWidth * shape.m_inHeight;
+    const int outPlane = shape.m_outWidth * shape.m_outHeight;
+    const int kernelSize = shape.m_kernelWidth * shape.m_kernelHeight;
+    assert(in.GetNumRows() == (size_t)shape.m_channels * inPlane && GetNumRows() == (size_t)maps * outPlane);
+    assert(kernelGrad.GetNumElements() == (size_t)maps * kernelSize);
+    const int64_t numSamples = (int64_t)GetNumCols();
+#pragma omp parallel for
+    for (int map = 0; map < maps; map++)
+    {
+        ElemType* dw = kernelGrad.Data() + (size_t)map * kernelSize;
+        for (int kx = 0; kx < shape.m_kernelWidth; kx++)
+        {
+            int oxBegin, oxEnd;
+            DepthwiseOutputRange(kx, shape.m_strideWidth, shape.m_padWidth, shape.m_inWidth, shape.m_outWidth, oxBegin, oxEnd);
+            for (int ky = 0; ky < shape.m_kernelHeight; ky++)
+            {
+                int oyBegin, oyEnd;
+                DepthwiseOutputRange(ky, shape.m_strideHeight, shape.m_padHeight, shape.m_inHeight, shape.m_outHeight, oyBegin, oyEnd);
+                ElemType sum = 0;
+                for (int64_t sample = 0; sample < numSamples; sample++)
+                {
+                    const ElemType* x = in.Data() + sample * in.GetNumRows() + (size_t)(map / shape.m_multiplier) * inPlane;
+                    const ElemType* dy = Data() + sample * GetNumRows() + (size_t)map * outPlane;
+                    for (int oy = oyBegin; oy < oyEnd; oy++)
+                    {
+                        const ElemType* xRow = x + (oy * shape.m_strideHeight - shape.m_padHeight + ky) * shape.m_inWidth - shape.m_padWidth + kx;
+                        const ElemType* dyRow = dy + oy * shape.m_outWidth;
+                        for (int ox = oxBegin; ox < oxEnd; ox++)
+                            sum += dyRow[ox] * xRow[ox * shape.m_strideWidth];
+                    }
+                }
+                dw[ky * shape.m_kernelWidth + kx] += sum;
+            }
+        }
+    }
+}
+
 template <class ElemType>
 void CPUMatrix<ElemType>::UnrollConvolutionInput(size_t unrollCols, size_t mapOutSize, const CPUMatrix<int>& mpRowCol,
                                                  const CPUMatrix<int>& mpRowRun, const CPUMatrix<int>& runs, CPUMatrix<ElemType>& output) const
@@ -4269,8 +4995,7 @@ void CPUMatrix<ElemType>::MaxPoolingBackward(const CPUMatrix<ElemType>& out, con
                 assert(0 <= colBase + dcol && colBase + dcol < grad.GetNumRows());
                 if (in(colBase + dcol, sample) >= m)
                 {
-#pragma omp atomic 
-                    grad(colBase + dcol, sample) += g;
+                    grad(colBase + dcol, sample) += g; // (no atomics needed: the threads have a sample each)
                     break; 
                 }
             }
@@ -4370,62 +5095,215 @@ void CPUMatrix<ElemType>::AveragePoolingBackward(const CPUMatrix<int>& mpRowCol,
             {
                 int dcol = indices(i0 + i, 0);
                 assert(0 <= colBase + dcol && colBase + dcol < grad.GetNumRows());
-#pragma omp atomic 
                 grad(colBase + dcol, sample) += g;
             }
         }
     }
 }
 
+// Adds the sum of the elements of each channel of a [numChannels * spatialSize x batchSize] matrix a to sums, and
+// that of their squares (b == nullptr) or of their products with the elements of b to products, in one pass.
+// Spatial channels are taken in parallel, each a run of spatialSize rows in every column; otherwise the rows are
+// taken in parallel blocks that stay in the cache, over which the accumulation runs row by row.
+template <class ElemType>
+static void BatchNormalizationSums(const ElemType* a, const ElemType* b, size_t numChannels, size_t spatialSize, size_t batchSize,
+                                   std::vector<double>& sums, std::vector<double>& products)
+{
+    if (spatialSize > 1)
+    {
+#pragma omp parallel for
+        for (long c = 0; c < (long) numChannels; c++)
+        {
+            for (size_t j = 0; j < batchSize; j++)
+            {
+                size_t offset = (j * numChannels + c) * spatialSize;
+                if (b)
+                    SumAndDot(a + offset, b + offset, spatialSize, sums[c], products[c]);
+                else
+                    SumAndSumOfSquares(a + offset, spatialSize, sums[c], products[c]);
+            }
+        }
+        return;
+    }
+
+    const size_t blockSize = 512;
+    long numBlocks = (long) ((numChannels + blockSize - 1) / blockSize);
+#pragma omp parallel for
+    for (long block = 0; block < numBlocks; block++)
+    {
+        size_t begin = block * blockSize, end = std::min(numChannels, begin + blockSize);
+        for (size_t j = 0; j < batchSize; j++)
+        {
+            const ElemType* pa = a + j * numChannels;
+            const ElemType* pb = b ? b + j * numChannels : pa;
+            for (size_t c = begin; c < end; c++)
+            {
+                sums[c] += pa[c];
+                products[c] += (double) pa[c] * pb[c];
+            }
+        }
+    }
+}
+
 template <class ElemType>
 void CPUMatrix<ElemType>::BatchNormalizationForward(const CPUMatrix<ElemType>& scale, const CPUMatrix<ElemType>& bias, bool inferenceOnly, double expAvgFactor, double blendFactor,
                                                     CPUMatrix<ElemType>& runMean, CPUMatrix<ElemType>& runVariance, CPUMatrix<ElemType>& out, double epsilon,
                                                     CPUMatrix<ElemType>& saveMean, CPUMatrix<ElemType>& saveInvStdDev) const
 {
     assert((GetNumRows() % scale.GetNumRows()) == 0);
+    assert(0 <= expAvgFactor && expAvgFactor <= 1 && 0 <= blendFactor && blendFactor <= 1);
+
+    // The statistics follow CntkBatchNormalization.cuh: the running ones are averaged with those of the batch
+    // (expAvgFactor, the unbiased variance), and the ones that normalize are blended from the new running ones and
+    // those of the batch (blendFactor, on the inverse standard deviations). Either way the normalization of a channel
+    // comes down to out = in * a + b.
+    const size_t numChannels = scale.GetNumRows();
+    const size_t spatialSize = GetNumRows() / numChannels;
+    const size_t batchSize = GetNumCols();
+    std::vector<ElemType> a(numChannels), b(numChannels);
+    bool useBatchStatistics = !inferenceOnly && (expAvgFactor != 0 || blendFactor != 1);
+    std::vector<double> sums(numChannels, 0), sumsOfSquares(numChannels, 0);
+    if (useBatchStatistics)
+        BatchNormalizationSums(Data(), (const ElemType*) nullptr, numChannels, spatialSize, batchSize, sums, sumsOfSquares);
+
+    if (inferenceOnly)
+    {
+        saveMean.Resize(0, 0); // only doing inference: these two are not produced
+        saveInvStdDev.Resize(0, 0);
+    }
+    else
+    {
+        saveMean.RequireSize(numChannels, 1);
+        saveInvStdDev.RequireSize(numChannels, 1);
+    }
+    const double n = (double) (spatialSize * batchSize);
+    for (size_t c = 0; c < numChannels; c++)
+    {
+        double mean = runMean(c, 0);
+        double invStdDev = 1 / sqrt(runVariance(c, 0) + epsilon);
+        if (useBatchStatistics)
+        {
+            double batchMean = sums[c] / n;
+            double m2 = std::max(0.0, sumsOfSquares[c] - sums[c] * batchMean); // sum of the squared deviations
+            runMean(c, 0) = (ElemType) (expAvgFactor * batchMean + (1 - expAvgFactor) * runMean(c, 0));
+            runVariance(c, 0) = (ElemType) (expAvgFactor * (n == 1 ? 0 : m2 / (n - 1)) + (1 - expAvgFactor) * runVariance(c, 0));
+            mean = blendFactor * runMean(c, 0) + (1 - blendFactor) * batchMean;
+            invStdDev = 1 / sqrt(m2 / n + epsilon);
+            if (blendFactor != 0)
+                invStdDev = blendFactor / sqrt(runVariance(c, 0) + epsilon) + (1 - blendFactor) * invStdDev;
+        }
+        if (!inferenceOnly)
+        {
+            saveMean(c, 0) = (ElemType) mean;
+            saveInvStdDev(c, 0) = (ElemType) invStdDev;
+        }
+        a[c] = (ElemType) (scale(c, 0) * invStdDev);
+        b[c] = (ElemType) (bias(c, 0) - mean * a[c]);
+    }
 
-    if (!inferenceOnly || expAvgFactor != 0 || blendFactor != 1)
-        RuntimeError("Batch normalization training on CPU is not yet implemented.");
-
-    saveMean.Resize(0, 0); // only doing inference: these two are not produced
-    saveInvStdDev.Resize(0, 0);
+    if (spatialSize > 1)
+    {
+#pragma omp parallel for
+        for (long c = 0; c < (long) numChannels; c++)
+            for (size_t j = 0; j < batchSize; j++)
+                ScaleAndShift(Data() + j * GetNumRows() + c * spatialSize, a[c], b[c], out.Data() + j * out.GetNumRows() + c * spatialSize, spatialSize);
+    }
+    else
+    {
+#pragma omp parallel for
+        for (long j = 0; j < (long) batchSize; j++)
+        {
+            const ElemType* x = Data() + j * GetNumRows();
+            ElemType* y = out.Data() + j * out.GetNumRows();
+            for (size_t c = 0; c < numChannels; c++)
+                y[c] = x[c] * a[c] + b[c];
+        }
+    }
+}
 
-    bool spatial = GetNumRows() != scale.GetNumRows();
-    if (spatial)
+template <class ElemType>
+void CPUMatrix<ElemType>::BatchNormalizationBackward(const CPUMatrix<ElemType>& in, CPUMatrix<ElemType>& grad, const CPUMatrix<ElemType>& scale, double blendFactor,
+                                                     const CPUMatrix<ElemType>& saveMean, const CPUMatrix<ElemType>& saveInvStdDev,
+                                                     CPUMatrix<ElemType>& scaleGrad, CPUMatrix<ElemType>& biasGrad) const
+{
+    assert((GetNumRows() % scale.GetNumRows()) == 0);
+    assert(saveMean.GetNumElements() == scale.GetNumRows() && saveInvStdDev.GetNumElements() == scale.GetNumRows());
+    assert(scaleGrad.GetNumElements() == scale.GetNumRows() && biasGrad.GetNumElements() == scale.GetNumRows());
+
+    // As in CntkBatchNormalization.cuh: dBias = sum(dy) and dScale = sum(dy * xHat) over each channel, and
+    // dx += scale * invStdDev * (dy - mbStatsWeight * (xHat * dScale + dBias) / m), which is linear in dy and x.
+    const size_t numChannels = scale.GetNumRows();
+    const size_t spatialSize = GetNumRows() / numChannels;
+    const size_t batchSize = GetNumCols();
+    std::vector<double> sums(numChannels, 0), products(numChannels, 0);
+    BatchNormalizationSums(Data(), in.Data(), numChannels, spatialSize, batchSize, sums, products);
+
+    const double m = (double) (spatialSize * batchSize);
+    const double mbStatsWeight = 1 - blendFactor; // weight for contribution from actual MB stats (0 if none, e.g. locked BN node)
+    std::vector<ElemType> alpha(numChannels), beta(numChannels), gamma(numChannels);
+    for (size_t c = 0; c < numChannels; c++)
+    {
+        double mean = saveMean.Data()[c], invStdDev = saveInvStdDev.Data()[c];
+        double dBias = sums[c];
+        double dScale = invStdDev * (products[c] - mean * sums[c]);
+        biasGrad.Data()[c] = (ElemType) dBias;
+        scaleGrad.Data()[c] = (ElemType) dScale;
+        double k = scale.Data()[c] * invStdDev;
+        alpha[c] = (ElemType) k;
+        beta[c] = (ElemType) (-k * mbStatsWeight * dScale * invStdDev / m);
+        gamma[c] = (ElemType) (k * mbStatsWeight * (dScale * invStdDev * mean - dBias) / m);
+    }
+
+    if (spatialSize > 1)
     {
-        size_t spatialSize = GetNumRows() / scale.GetNumRows();
 #pragma omp parallel for
-        for (long icol = 0; icol < out.GetNumCols(); icol++)
+        for (long c = 0; c < (long) numChannels; c++)
         {
-            for (long irow = 0; irow < out.GetNumRows(); irow++)
+            for (size_t j = 0; j < batchSize; j++)
             {
-                size_t imap = irow / spatialSize;
-                ElemType stdDev = sqrt(runVariance(imap, 0) + epsilon);
-                out(irow, icol) = scale(imap, 0) * ((*this)(irow, icol) - runMean(imap, 0)) / stdDev + bias(imap, 0);
+                size_t offset = (j * numChannels + c) * spatialSize;
+                AddLinearCombination(alpha[c], Data() + offset, beta[c], in.Data() + offset, gamma[c], grad.Data() + offset, spatialSize);
             }
         }
     }
     else
     {
 #pragma omp parallel for
-        for (long icol = 0; icol < out.GetNumCols(); icol++)
+        for (long j = 0; j < (long) batchSize; j++)
         {
-            for (long irow = 0; irow < out.GetNumRows(); irow++)
-            {
-                ElemType stdDev = sqrt(runVariance(irow, 0) + epsilon);
-                out(irow, icol) = scale(irow, 0) * ((*this)(irow, icol) - runMean(irow, 0)) / stdDev + bias(irow, 0);
-            }
+            const ElemType* dy = Data() + j * numChannels;
+            const ElemType* x = in.Data() + j * numChannels;
+            ElemType* dx = grad.Data() + j * numChannels;
+            for (size_t c = 0; c < numChannels; c++)
+                dx[c] += alpha[c] * dy[c] + beta[c] * x[c] + gamma[c];
         }
     }
 }
 
+#pragma region RNN Functions
+
 template <class ElemType>
-void CPUMatrix<ElemType>::BatchNormalizationBackward(const CPUMatrix<ElemType>& in, CPUMatrix<ElemType>& grad, const CPUMatrix<ElemType>& scale, double blendFactor,
-                                                     const CPUMatrix<ElemType>& saveMean, const CPUMatrix<ElemType>& saveInvStdDev,
-                                                     CPUMatrix<ElemType>& scaleGrad, CPUMatrix<ElemType>& biasGrad) const
+void CPUMatrix<ElemType>::RNNForward(const CPUMatrix<ElemType>& inputX, const CPUMatrix<ElemType>& paramW, size_t xDim, size_t yDim, const vector<size_t>& numSequencesForFrame, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    if (!m_rnnExecutor)
+        m_rnnExecutor = std::make_shared<CPURNNExecutor<ElemType>>(xDim, yDim, rnnAttributes);
+    m_rnnExecutor->ForwardCore(paramW, inputX, *this, numSequencesForFrame, rnnAttributes, reserve, workspace);
+}
+
+template <class ElemType>
+void CPUMatrix<ElemType>::RNNBackwardData(const CPUMatrix<ElemType>& outputDY, const CPUMatrix<ElemType>& paramW, CPUMatrix<ElemType>& outputDX, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
 {
-    UNUSED(in); UNUSED(grad); UNUSED(scale); UNUSED(blendFactor), UNUSED(saveMean); UNUSED(saveInvStdDev); UNUSED(scaleGrad); UNUSED(biasGrad);
-    RuntimeError("Batch normalization training on CPU is not yet implemented.");
+    if (!m_rnnExecutor)
+        LogicError("RNNBackwardData called, but RNNWrapper object is not yet initialized");
+    m_rnnExecutor->BackwardDataCore(*this, outputDY, paramW, outputDX, rnnAttributes, reserve, workspace);
+}
+
+template <class ElemType>
+void CPUMatrix<ElemType>::RNNBackwardWeights(const CPUMatrix<ElemType>& inputX, const CPUMatrix<ElemType>& outputY, CPUMatrix<ElemType>& dw, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    if (!m_rnnExecutor)
+        LogicError("RNNBackwardWeights called, but RNNWrapper object is not yet initialized");
+    m_rnnExecutor->BackwardWeightsCore(inputX, outputY, dw, rnnAttributes, reserve, workspace);
 }
 
 
@@ -4493,6 +5371,9 @@ void CPUMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPUMatrix
 
     ldc = (int) c.GetNumRows();
 
+    if (VectorizedSmallGemm(transposeA, transposeB, m, n, k, alpha, a.Data(), lda, b.Data(), ldb, beta, c.Data(), ldc))
+        return;
+
     if (sizeof(ElemType) == sizeof(double))
     {
         cblas_dgemm((CBLAS_ORDER) (int)MatrixOrder::ColMajor, mklTransA, mklTransB, m, n, k, alpha, reinterpret_cast<double*>(a.Data()), lda, reinterpret_cast<double*>(b.Data()), ldb, beta, reinterpret_cast<double*>(c.Data()), ldc);
@@ -4504,6 +5385,104 @@ void CPUMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPUMatrix
     }
 }
 
+// c[:, j] = alpha * op(a_j) * op(b_j) + beta * c[:, j], where the column j of a holds a_j of aRows rows and that of b holds b_j
+// With MKL, all products are one call of its batched GEMM; other BLAS libraries get a GEMM per column.
+template <class ElemType>
+void CPUMatrix<ElemType>::BatchMultiplyAndWeightedAdd(ElemType alpha, const CPUMatrix<ElemType>& a, const bool transposeA, size_t aRows, const CPUMatrix<ElemType>& b, const bool transposeB, size_t bRows,
+                                                      ElemType beta, CPUMatrix<ElemType>& c)
+{
+    if (a.IsEmpty() || b.IsEmpty())
+        LogicError("BatchMultiplyAndWeightedAdd: One of the input matrices is empty.");
+    if (aRows == 0 || bRows == 0 || a.GetNumRows() % aRows != 0 || b.GetNumRows() % bRows != 0)
+        InvalidArgument("BatchMultiplyAndWeightedAdd: The columns of a and b must hold matrices of %d and %d rows.", (int) aRows, (int) bRows);
+    if (a.GetNumCols() != b.GetNumCols())
+        InvalidArgument("BatchMultiplyAndWeightedAdd: a and b must have the same number of columns.");
+
+    const size_t aCols = a.GetNumRows() / aRows;
+    const size_t bCols = b.GetNumRows() / bRows;
+    const int m = (int) (transposeA ? aCols : aRows);
+    const int k = (int) (transposeA ? aRows : aCols);
+    const int l = (int) (transposeB ? bCols : bRows);
+    const int n = (int) (transposeB ? bRows : bCols);
+    if (k != l)
+        InvalidArgument("BatchMultiplyAndWeightedAdd: The inner dimensions of a and b must match.");
+
+    const size_t batchSize = a.GetNumCols();
+    if (beta == 0)
+        c.RequireSize(m * n, batchSize);
+    else
+        c.VerifySize(m * n, batchSize); // Can't resize if beta != 0
+
+    const int lda = (int) aRows, ldb = (int) bRows, ldc = m;
+    CBLAS_TRANSPOSE mklTransA = transposeA ? CBLAS_TRANSPOSE::CblasTrans : CBLAS_TRANSPOSE::CblasNoTrans;
+    CBLAS_TRANSPOSE mklTransB = transposeB ? CBLAS_TRANSPOSE::CblasTrans : CBLAS_TRANSPOSE::CblasNoTrans;
+#ifdef USE_MKL
+    std::vector<const ElemType*> aPointers(batchSize), bPointers(batchSize);
+    std::vector<ElemType*> cPointers(batchSize);
+    for (size_t j = 0; j < batchSize; j++)
+    {
+        aPointers[j] = a.Data() + j * a.GetNumRows();
+        bPointers[j] = b.Data() + j * b.GetNumRows();
+        cPointers[j] = c.Data() + j * c.GetNumRows();
+    }
+    const MKL_INT mklM = m, mklN = n, mklK = k, mklLda = lda, mklLdb = ldb, mklLdc = ldc, groupSize = (MKL_INT) batchSize;
+    if (sizeof(ElemType) == sizeof(double))
+    {
+        const double alphaD = alpha, betaD = beta;
+        cblas_dgemm_batch((CBLAS_ORDER) (int) MatrixOrder::ColMajor, &mklTransA, &mklTransB, &mklM, &mklN, &mklK, &alphaD, reinterpret_cast<const double**>(aPointers.data()), &mklLda,
+                          reinterpret_cast<const double**>(bPointers.data()), &mklLdb, &betaD, reinterpret_cast<double**>(cPointers.data()), &mklLdc, 1, &groupSize);
+    }
+    else
+    {
+        const float alphaF = (float) alpha, betaF = (float) beta;
+        cblas_sgemm_batch((CBLAS_ORDER) (int) MatrixOrder::ColMajor, &mklTransA, &mklTransB, &mklM, &mklN, &mklK, &alphaF, reinterpret_cast<const float**>(aPointers.data()), &mklLda,
+                          reinterpret_cast<const float**>(bPointers.data()), &mklLdb, &betaF, reinterpret_cast<float**>(cPointers.data()), &mklLdc, 1, &groupSize);
+    }
+#else
+    for (size_t j = 0; j < batchSize; j++)
+    {
+        const ElemType* aj = a.Data() + j * a.GetNumRows();
+        const ElemType* bj = b.Data() + j * b.GetNumRows();
+        ElemType* cj = c.Data() + j * c.GetNumRows();
+        if (sizeof(ElemType) == sizeof(double))
+        {
+            cblas_dgemm((CBLAS_ORDER) (int) MatrixOrder::ColMajor, mklTransA, mklTransB, m, n, k, alpha, reinterpret_cast<const double*>(aj), lda, reinterpret_cast<const double*>(bj), ldb, beta, reinterpret_cast<double*>(cj), ldc);
+        }
+        else
+        {
+#pragma warning(suppress : 4244)
+            cblas_sgemm((CBLAS_ORDER) (int) MatrixOrder::ColMajor, mklTransA, mklTransB, m, n, k, alpha, reinterpret_cast<const float*>(aj), lda, reinterpret_cast<const float*>(bj), ldb, beta, reinterpret_cast<float*>(cj), ldc);
+        }
+    }
+#endif
+}
+
+// c = f(a * b + bias), the GEMM of a fully connected layer with its epilogue (see AddBiasAndActivation())
+// The product is computed in tiles of columns of c, and the bias and f are applied to each tile right after
+// its GEMM, while the tile is still in the cache, instead of in two more passes over all of c.
+template <class ElemType>
+void CPUMatrix<ElemType>::MultiplyAndAddBias(const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, const CPUMatrix<ElemType>& bias, ElementWiseOperator activation, CPUMatrix<ElemType>& c)
+{
+    if (a.IsEmpty() || b.IsEmpty())
+        LogicError("MultiplyAndAddBias: One of the input matrices is empty.");
+    if (a.GetNumCols() != b.GetNumRows())
+        InvalidArgument("MultiplyAndAddBias: The inner dimensions of a and b must match.");
+
+    const size_t rows = a.GetNumRows();
+    const size_t cols = b.GetNumCols();
+    c.RequireSize(rows, cols);
+
+    // tiles of about the size of an L2 cache, but wide enough for the GEMM to run at full speed
+    const size_t tileCols = std::max((size_t) 64, (256 * 1024 / sizeof(ElemType)) / rows);
+    for (size_t j = 0; j < cols; j += tileCols)
+    {
+        const size_t n = std::min(tileCols, cols - j);
+        CPUMatrix<ElemType> cTile = c.ColumnSlice(j, n);
+        MultiplyAndWeightedAdd(1, a, false, b.ColumnSlice(j, n), false, 0, cTile);
+        cTile.AddBiasAndActivation(bias, activation);
+    }
+}
+
 template <class ElemType>
 void CPUMatrix<ElemType>::Multiply1x1AndWeightedAdd(ElemType alpha, const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b,
                                                     ElemType beta, CPUMatrix<ElemType>& c)
@@ -5242,6 +6221,19 @@ bool CPUMatrix<ElemType>::AreEqual(const CPUMatrix<ElemType>& a, const CPUMatrix
     return result;
 }
 
+template <class ElemType>
+/*static*/ void CPUMatrix<ElemType>::UpdateNonFiniteFlag(const ElemType* data, size_t numElements, CPUMatrix<ElemType>& flag)
+{
+    for (size_t i = 0; i < numElements; i++)
+    {
+        if (!std::isfinite(data[i]))
+        {
+            flag.Data()[0] = 1;
+            return;
+        }
+    }
+}
+
 // see Matrix<ElemType>::TensorShuffleScaleAndAdd() for comments
 template <class ElemType>
 void CPUMatrix<ElemType>::TensorShuffleScaleAndAdd(ElemType keepWeight, const CPUMatrix<ElemType>& a, size_t D, size_t S, size_t M, size_t K, size_t T, ElemType scaleFactor, const CPUMatrix<ElemType>& b, CPUMatrix<ElemType>& c)
@@ -5856,6 +6848,101 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignSequenceError(const ElemType hsm
     return *this;
 }
 
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignCTCScore(const CPUMatrix<ElemType>& logProbs, CPUMatrix<ElemType>& alpha, CPUMatrix<ElemType>& beta,
+                                                         const CPUMatrix<ElemType>& labelSequences, CPUMatrix<ElemType>& totalScore,
+                                                         const std::vector<size_t>& uttToChanInd, const std::vector<size_t>& uttBeginFrame, const std::vector<size_t>& uttFrameNum,
+                                                         const std::vector<size_t>& uttLabelNum, const size_t numParallelSequences, const size_t maxFrameNum, const size_t blankTokenId)
+{
+    const size_t numUtts = uttToChanInd.size();
+    const size_t maxLabelNum = labelSequences.GetNumRows();
+    const size_t maxS = 2 * maxLabelNum + 1; // labels with a blank before, between and after them
+    alpha.RequireSize(maxS, maxFrameNum * numUtts);
+    beta.RequireSize(maxS, maxFrameNum * numUtts);
+    RequireSize(logProbs.GetNumRows(), logProbs.GetNumCols());
+    SetValue(0);
+
+    auto& us = *this;
+    vector<double> logLikelihoods(numUtts, LZERO);
+#pragma omp parallel for
+    for (long u = 0; u < (long) numUtts; u++)
+    {
+        const size_t T = uttFrameNum[u];
+        const size_t S = 2 * uttLabelNum[u] + 1;
+        if (T == 0)
+            continue;
+        auto label = [&](size_t s) { return s % 2 == 0 ? blankTokenId : (size_t) labelSequences((s - 1) / 2, u); };
+        auto column = [&](size_t t) { return (uttBeginFrame[u] + t) * numParallelSequences + uttToChanInd[u]; };
+        auto canSkip = [&](size_t s, size_t s2) { return label(s) != blankTokenId && label(s) != label(s2); }; // from/to s2 = s -/+ 2
+
+        // forward and backward log scores, both including the frame's own log posterior
+        for (size_t t = 0; t < T; t++)
+        {
+            for (size_t s = 0; s < S; s++)
+            {
+                ElemType score;
+                if (t == 0)
+                    score = s < 2 ? 0 : (ElemType) LZERO;
+                else
+                {
+                    const size_t j = (t - 1) * numUtts + u;
+                    score = alpha(s, j);
+                    if (s >= 1)
+                        score = (ElemType) LogAddD(score, alpha(s - 1, j));
+                    if (s >= 2 && canSkip(s, s - 2))
+                        score = (ElemType) LogAddD(score, alpha(s - 2, j));
+                }
+                alpha(s, t * numUtts + u) = score + logProbs(label(s), column(t));
+            }
+        }
+        for (size_t t = T; t-- > 0;)
+        {
+            for (size_t s = 0; s < S; s++)
+            {
+                ElemType score;
+                if (t + 1 == T)
+                    score = s + 2 >= S ? 0 : (ElemType) LZERO;
+                else
+                {
+                    const size_t j = (t + 1) * numUtts + u;
+                    score = beta(s, j);
+                    if (s + 1 < S)
+                        score = (ElemType) LogAddD(score, beta(s + 1, j));
+                    if (s + 2 < S && canSkip(s, s + 2))
+                        score = (ElemType) LogAddD(score, beta(s + 2, j));
+                }
+                beta(s, t * numUtts + u) = score + logProbs(label(s), column(t));
+            }
+        }
+
+        const size_t last = (T - 1) * numUtts + u;
+        double logLikelihood = S > 1 ? LogAddD(alpha(S - 1, last), alpha(S - 2, last)) : alpha(0, last);
+        for (size_t t = 0; t < T; t++)
+        {
+            const size_t j = column(t);
+            if (logLikelihood < LSMALL) // the labels do not fit
+            {
+                foreach_row (k, us)
+                    us(k, j) = exp(logProbs(k, j));
+                continue;
+            }
+            for (size_t s = 0; s < S; s++)
+                us(label(s), j) += (ElemType) exp(alpha(s, t * numUtts + u) + beta(s, t * numUtts + u) - logProbs(label(s), j) - logLikelihood);
+        }
+        logLikelihoods[u] = logLikelihood;
+    }
+
+    double sum = 0;
+    for (double logLikelihood : logLikelihoods)
+    {
+        if (logLikelihood >= LSMALL)
+            sum -= logLikelihood;
+    }
+    totalScore.RequireSize(1, 1);
+    totalScore(0, 0) = (ElemType) sum;
+    return *this;
+}
+
 // note: this function does not depend on the <ElemType> parameter
 template <class ElemType>
 int CPUMatrix<ElemType>::SetNumThreads(int numThreads)
@@ -5883,6 +6970,40 @@ int CPUMatrix<ElemType>::SetNumThreads(int numThreads)
     return numThreads;
 }
 
+template <class ElemType>
+int CPUMatrix<ElemType>::GetNumThreads()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+template <class ElemType>
+int CPUMatrix<ElemType>::GetNumBlasThreads()
+{
+#ifdef USE_MKL
+    return mkl_get_max_threads();
+#elif defined(USE_OPENBLAS)
+    return openblas_get_num_threads();
+#else
+    return GetNumThreads();
+#endif
+}
+
+template <class ElemType>
+void CPUMatrix<ElemType>::SetSmallGemmThreshold(size_t maxMultiplyAdds)
+{
+    s_smallGemmThreshold = maxMultiplyAdds;
+}
+
+template <class ElemType>
+size_t CPUMatrix<ElemType>::GetSmallGemmThreshold()
+{
+    return s_smallGemmThreshold;
+}
+
 // To ensure Intel MKL calls return the same results on all Intel or Intel compatible CPUs,
 // the function set CBWR compatible mode.
 template <class ElemType>
@@ -5973,6 +7094,7 @@ struct TensorOpIteration
 
 // Special version for innermost loop with strides all being 1 and no further reduction. Compiler can use SSE.
 // This is a very common case, e.g. adding vectors or computing the Sigmoid.
+// The loop is not parallelized here, as it runs for each index of the outer dimensions; see TensorOpWithFnAndReduction().
 template <class ElemType, typename OPFN, typename ReductionOp>
 struct TensorOpIteration<ElemType, OPFN, ReductionOp, 3, true /*vectorizable*/, -1 /*no reduction*/, 0 /*innermost loop*/>
 {
@@ -5986,20 +7108,15 @@ struct TensorOpIteration<ElemType, OPFN, ReductionOp, 3, true /*vectorizable*/,
         size_t K = regularOpDims[0];
         // special-case beta and alpha to allow the compiler to short-circuit it
         if (beta != 0)
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            for (size_t k = 0; k < K; k++)
                 TensorOpIteration<ElemType, OPFN, ReductionOp, 3, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(beta, array<ElemType*, 3>{pa + k, pb + k, pc + k}, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
         else if (alpha != 1)
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            for (size_t k = 0; k < K; k++)
                 TensorOpIteration<ElemType, OPFN, ReductionOp, 3, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 3>{pa + k, pb + k, pc + k}, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
         else
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            for (size_t k = 0; k < K; k++)
                 TensorOpIteration<ElemType, OPFN, ReductionOp, 3, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 3>{pa + k, pb + k, pc + k}, 1, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
         // TODO: According to Amit, the VS compiler is not able to vectorize into lambdas. Solution: change the lambda to take an N, or to implement the loop inside (with 1 element by default).
-        // TODO: The signedness of k (required for omp) causes an extra sign-extend.
-        // TODO: OMP adds LOTS of overhead. Do we need a guard, a min size when to use it?
     }
 };
 // and unary
@@ -6015,16 +7132,13 @@ struct TensorOpIteration<ElemType, OPFN, ReductionOp, 2, true /*vectorizable*/,
         size_t K = regularOpDims[0];
         // special-case beta and alpha to allow the compiler to short-circuit it
         if (beta != 0)
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            for (size_t k = 0; k < K; k++)
                 TensorOpIteration<ElemType, OPFN, ReductionOp, 2, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(beta, array<ElemType*, 2>{pa + k, pb + k}, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
         else if (alpha != 1)
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            for (size_t k = 0; k < K; k++)
                 TensorOpIteration<ElemType, OPFN, ReductionOp, 2, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 2>{pa + k, pb + k}, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
         else
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            for (size_t k = 0; k < K; k++)
                 TensorOpIteration<ElemType, OPFN, ReductionOp, 2, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 2>{pa + k, pb + k}, 1, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
     }
 };
@@ -6050,6 +7164,56 @@ struct TensorOpIteration<ElemType, OPFN, ReductionOp, N, vectorizable, m, -1>
     }
 };
 
+// -----------------------------------------------------------------------
+// cache-blocked loop for reductions into contiguous outputs
+// -----------------------------------------------------------------------
+
+// Reduction along one dimension into a contiguous output, where the inputs are contiguous along the output, e.g. the sum
+// over the columns of a matrix (the gradient of a bias). Reducing one output element after the other would read the inputs
+// with the stride of the reduction, one element per cache line; this reduces a tile of adjacent outputs at once instead.
+// Each output element is aggregated in the same order as by TensorOpReduction, so the results are the same.
+template <class ElemType, typename OPFN, typename ReductionOp, size_t N>
+static void TensorOpWithTiledReduction(ElemType beta, const array<ElemType*, N>& pointers, ElemType alpha, const OPFN& opfn, const ReductionOp& reductionOp,
+                                       size_t outputs, size_t reducingDim, const array<SmallVector<ptrdiff_t>, N>& reducingStrides)
+{
+    const size_t tileSize = 128; // the aggregates of a tile stay in L1
+    for (size_t begin = 0; begin < outputs; begin += tileSize)
+    {
+        size_t count = std::min(tileSize, outputs - begin);
+        array<ElemType*, N> tilePointers;
+        for (size_t i = 0; i < N; i++)
+            tilePointers[i] = pointers[i] + begin;
+        auto opAt = [&](size_t t)
+        {
+            array<ElemType*, N> elementPointers;
+            for (size_t i = 0; i < N; i++) // N = a small constant, this will be unrolled
+                elementPointers[i] = tilePointers[i] + t;
+            return opfn(elementPointers);
+        };
+
+        double aggregates[tileSize];
+        for (size_t t = 0; t < count; t++)
+            aggregates[t] = opAt(t);
+        for (size_t dim = 1; dim < reducingDim; dim++)
+        {
+            for (size_t i = 0; i < N - 1; i++) // note: last pointer (result) is unused and untouched here
+                tilePointers[i] += reducingStrides[i][0];
+            for (size_t t = 0; t < count; t++)
+                aggregates[t] = reductionOp(aggregates[t], opAt(t));
+        }
+
+        ElemType* pout = pointers.back() + begin;
+        for (size_t t = 0; t < count; t++)
+        {
+            ElemType val = (ElemType) aggregates[t];
+            val *= alpha;
+            if (beta != 0)
+                val += beta * pout[t];
+            pout[t] = val;
+        }
+    }
+}
+
 // -----------------------------------------------------------------------
 // map runtime parameters N to template parameters
 // -----------------------------------------------------------------------
@@ -6066,7 +7230,15 @@ static void TensorOpWithRegularLoop(ElemType beta, const array<ElemType*, N>& po
     case 2:
         return TensorOpIteration<ElemType, OPFN, ReductionOp, N, false /*vectorizable*/, 1, k>::Loop(beta, pointers, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
     case 1:
+    {
+        // reducing e.g. the columns of a matrix into a vector: walk the outputs in tiles
+        bool contiguousOutputs = k == 0;
+        for (size_t i = 0; i < N && contiguousOutputs; i++)
+            contiguousOutputs = regularStrides[i][0] == 1;
+        if (contiguousOutputs)
+            return TensorOpWithTiledReduction(beta, pointers, alpha, opfn, reductionOp, regularOpDims[0], reducingOpDims[0], reducingStrides);
         return TensorOpIteration<ElemType, OPFN, ReductionOp, N, false /*vectorizable*/, 0, k>::Loop(beta, pointers, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+    }
     case 0:
     {
         // if all leading dimensions are 1, we can let the compiler do some unrolling
@@ -6094,20 +7266,55 @@ static void TensorOpWithFnAndReduction(ElemType beta, array<ElemType*, N> pointe
     for (size_t i = 0; i < N; i++) // N = a small constant, this will be unrolled
         pointers[i] += offsets[i];
     size_t dims = regularOpDims.size();
-    switch (dims)
-    {
-    case 4:
-        return TensorOpWithRegularLoop<ElemType, OPFN, ReductionOp, N, 3>(beta, pointers, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
-    case 3:
-        return TensorOpWithRegularLoop<ElemType, OPFN, ReductionOp, N, 2>(beta, pointers, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
-    case 2:
-        return TensorOpWithRegularLoop<ElemType, OPFN, ReductionOp, N, 1>(beta, pointers, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
-    case 1:
-        return TensorOpWithRegularLoop<ElemType, OPFN, ReductionOp, N, 0>(beta, pointers, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
-    case 0:
-        return TensorOpWithRegularLoop<ElemType, OPFN, ReductionOp, N, -1>(beta, pointers, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
-    default:
+    if (dims > 4)
         LogicError("TensorOp: %d non-flattened input dimensions are not supported.", (int)dims);
+    if (reducingOpDims.size() > 2)
+        LogicError("TensorOp: %d non-flattened reduction dimensions are not supported.", (int)reducingOpDims.size());
+
+    // Split the outermost regular dimension across the OMP threads if the operation is large enough to pay for them.
+    // The chunks write disjoint parts of the output, since the output never broadcasts along a regular dimension.
+    const size_t minElementsPerThread = 16384;
+    size_t elements = 1;
+    for (auto dim : regularOpDims)
+        elements *= dim;
+    for (auto dim : reducingOpDims)
+        elements *= dim;
+    size_t chunks = 1;
+    if (dims > 0 && !omp_in_parallel())
+        chunks = std::max((size_t) 1, std::min(std::min(elements / minElementsPerThread, (size_t) omp_get_max_threads()), regularOpDims[dims - 1]));
+
+#pragma omp parallel for if (chunks > 1)
+    for (long chunk = 0; chunk < (long) chunks; chunk++)
+    {
+        SmallVector<size_t> chunkOpDims(regularOpDims);
+        array<ElemType*, N> chunkPointers = pointers;
+        if (chunks > 1)
+        {
+            size_t outerDim = regularOpDims[dims - 1];
+            size_t begin = outerDim * chunk / chunks;
+            chunkOpDims[dims - 1] = outerDim * (chunk + 1) / chunks - begin;
+            for (size_t i = 0; i < N; i++)
+                chunkPointers[i] += (ptrdiff_t) begin * regularStrides[i][dims - 1];
+        }
+
+        switch (dims)
+        {
+        case 4:
+            TensorOpWithRegularLoop<ElemType, OPFN, ReductionOp, N, 3>(beta, chunkPointers, alpha, opfn, reductionOp, chunkOpDims, regularStrides, reducingOpDims, reducingStrides);
+            break;
+        case 3:
+            TensorOpWithRegularLoop<ElemType, OPFN, ReductionOp, N, 2>(beta, chunkPointers, alpha, opfn, reductionOp, chunkOpDims, regularStrides, reducingOpDims, reducingStrides);
+            break;
+        case 2:
+            TensorOpWithRegularLoop<ElemType, OPFN, ReductionOp, N, 1>(beta, chunkPointers, alpha, opfn, reductionOp, chunkOpDims, regularStrides, reducingOpDims, reducingStrides);
+            break;
+        case 1:
+            TensorOpWithRegularLoop<ElemType, OPFN, ReductionOp, N, 0>(beta, chunkPointers, alpha, opfn, reductionOp, chunkOpDims, regularStrides, reducingOpDims, reducingStrides);
+            break;
+        case 0:
+            TensorOpWithRegularLoop<ElemType, OPFN, ReductionOp, N, -1>(beta, chunkPointers, alpha, opfn, reductionOp, chunkOpDims, regularStrides, reducingOpDims, reducingStrides);
+            break;
+        }
     }
 }
 
@@ -6144,6 +7351,46 @@ static void TensorOpWithFn(ElemType beta, array<ElemType*, N> pointers, ElemType
     }
 }
 
+// -----------------------------------------------------------------------
+// fast paths of the unary operations through the vectorized kernels
+// -----------------------------------------------------------------------
+
+// The elementwise functions of contiguous tensors, and the sums over the contiguous or the other dimension of a matrix.
+// Returns false if the operation is not one of these, or for double.
+template <class ElemType>
+static bool TensorOpWithVectorizedKernels(ElemType beta, const ElemType* pa, ElemType* pc, ElemType alpha, ElementWiseOperator op, ElementWiseOperator reductionOp,
+                                          const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, 2>& regularStrides,
+                                          const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, 2>& reducingStrides)
+{
+    if (reducingOpDims.empty())
+    {
+        if (beta != 0 || alpha != 1 || regularOpDims.size() != 1 || regularStrides[0][0] != 1 || regularStrides[1][0] != 1)
+            return false;
+        switch (op)
+        {
+        case ElementWiseOperator::opExp:
+            return VectorizedExp(pa, pc, regularOpDims[0]);
+        case ElementWiseOperator::opSigmoid:
+            return VectorizedSigmoid(pa, pc, regularOpDims[0]);
+        case ElementWiseOperator::opTanh:
+            return VectorizedTanh(pa, pc, regularOpDims[0]);
+        default:
+            return false;
+        }
+    }
+
+    if (op != ElementWiseOperator::opCopy || reductionOp != ElementWiseOperator::opSum || reducingOpDims.size() != 1 || regularOpDims.size() > 1)
+        return false;
+    size_t outputs = regularOpDims.empty() ? 1 : regularOpDims[0];
+    ptrdiff_t aStride = regularOpDims.empty() ? 0 : regularStrides[0][0];
+    ptrdiff_t cStride = regularOpDims.empty() ? 0 : regularStrides[1][0];
+    if (reducingStrides[0][0] == 1) // sums of columns, or of all elements
+        return VectorizedColumnSums(beta, pa, reducingOpDims[0], outputs, aStride, pc, cStride, alpha);
+    if (aStride == 1 && cStride == 1 && reducingStrides[0][0] > 0) // sums of rows
+        return VectorizedRowSums(beta, pa, outputs, reducingOpDims[0], (size_t) reducingStrides[0][0], pc, alpha);
+    return false;
+}
+
 // -----------------------------------------------------------------------
 // entry points from Matrix.cpp; also map op to a lambda
 // -----------------------------------------------------------------------
@@ -6171,6 +7418,9 @@ void CPUMatrix<ElemType>::TensorOp(ElemType beta, const CPUMatrix<ElemType>& a,
                               },                                                       \
                               reductionOp, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides)
 
+    if (TensorOpWithVectorizedKernels(beta, a.Data() + offsets[0], Data() + offsets[1], alpha, op, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides))
+        return;
+
     array<ElemType*, 2> pointers = {a.Data(), Data()};
     switch (op)
     {
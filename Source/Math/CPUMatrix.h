@@ -29,6 +29,8 @@ double logadd(double x, double y);
 
 // To comply with BLAS libraries matrices are stored in ColMajor. However, by default C/C++/C# use RowMajor
 // conversion is need when passing data between CPUMatrix and C++ matrices
+template<class ElemType> class CPURNNExecutor;
+
 template <class ElemType>
 class MATH_API CPUMatrix : public BaseMatrix<ElemType>
 {
@@ -40,7 +42,6 @@ class MATH_API CPUMatrix : public BaseMatrix<ElemType>
     using Base::SetBuffer;
     using Base::SetComputeDeviceId;
     using Base::SetSizeAllocated;
-    using Base::GetSizeAllocated;
     using Base::ZeroInit;
     using Base::ZeroValues;
     using Base::m_sob;
@@ -49,6 +50,7 @@ class MATH_API CPUMatrix : public BaseMatrix<ElemType>
 
 public:
     using Base::VerifyWritable;
+    using Base::GetSizeAllocated;
     using Base::GetComputeDeviceId;
     using Base::Buffer;
     using Base::GetNumRows;
@@ -100,6 +102,13 @@ public:
                      ElemType RMS_WGT_DEC,
                      ElemType RMS_WGT_MIN,
                      const bool needAveMultiplier);
+    static bool MultiTensorUpdate(const MultiTensorUpdateParams<ElemType>& params,
+                                  const std::vector<CPUMatrix<ElemType>*>& smoothedGradients, const std::vector<CPUMatrix<ElemType>*>& gradients,
+                                  const std::vector<CPUMatrix<ElemType>*>& values, const std::vector<ElemType>& adaMuls, bool checkForNan);
+    static double MultiTensorSumOfSquares(const std::vector<const CPUMatrix<ElemType>*>& tensors);
+    void AssignAugmentedImages(const unsigned char* images, size_t numCols, const ImageAugmentationParams& params, const ElemType* mean, uint64_t key);
+    void CompressValuesInto(char* codes, size_t columnBytes, ValueCompression compression) const;
+    void AssignDecompressedValuesOf(const char* codes, size_t columnBytes, ValueCompression compression, size_t numRows, size_t numCols);
 
 
     void Reshape(const size_t numRows, const size_t numCols);
@@ -112,6 +121,7 @@ public:
     // Resize first checks to ensure that the caller has the authority to call Resize (i.e., it checks to ensure the underlying data is owned by only this matrix), and then
     // actually resizes the underlying matrix, doing any allocation as required.
     void Resize(const size_t numRows, const size_t numCols, bool growOnly = true); // by default we only reallocate if need to grow
+    void ShrinkToFit();
 
 
     ElemType* CopyToArray() const;                                                 // allocated by the callee but need to be deleted by the caller
@@ -140,6 +150,10 @@ public:
 
     void MaskColumnsValue(const CPUMatrix<char>& columnsMask, ElemType val);
 
+    // see Matrix<ElemType>::ExtractLargestMagnitudes(); 'indices' and 'values' have room for k <= GetNumElements() entries
+    size_t ExtractLargestMagnitudes(size_t k, ElemType threshold, int* indices, ElemType* values);
+    void AddValuesAtIndices(const int* indices, const ElemType* values, size_t count);
+
     void SetColumn(const ElemType* colPointer, size_t colInd);
     void SetColumn(const CPUMatrix<ElemType>& valMat, size_t colInd);
     void SetColumn(const ElemType val, size_t j);
@@ -149,6 +163,7 @@ public:
     void SetUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed = USE_TIME_BASED_SEED);
     void SetGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
     void SetUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, RNGHandle& rngHandle);
+    CPUMatrix<ElemType>& AddDropoutOf(const CPUMatrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue, uint64_t key, size_t offset, const ElemType beta);
     void AddGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
 
     CPUMatrix<ElemType> Transpose();
@@ -156,6 +171,7 @@ public:
 
     CPUMatrix<ElemType>& DoGatherColumnsOf (ElemType beta, const CPUMatrix<ElemType>& idx, const CPUMatrix<ElemType>& a, ElemType alpha);
     CPUMatrix<ElemType>& DoScatterColumnsOf(ElemType beta, const CPUMatrix<ElemType>& idx, const CPUMatrix<ElemType>& a, ElemType alpha);
+    CPUMatrix<ElemType>& AssignPackedIndicesOf(const CPUMatrix<ElemType>& idx, const CPUMatrix<ElemType>& ranges, size_t numParallelSequences);
 
     CPUMatrix<ElemType>& operator+=(const ElemType alpha);
     CPUMatrix<ElemType>  operator+(const ElemType alpha) const;
@@ -207,6 +223,8 @@ public:
     CPUMatrix<ElemType>& InplaceSigmoid();
     CPUMatrix<ElemType>& AssignSigmoidOf(const CPUMatrix<ElemType>& a);
 
+    CPUMatrix<ElemType>& AddBiasAndActivation(const CPUMatrix<ElemType>& bias, ElementWiseOperator activation);
+
     CPUMatrix<ElemType>& InplaceLinearRectifierDerivative();
     CPUMatrix<ElemType>& AssignLinearRectifierDerivativeOf(const CPUMatrix<ElemType>& a);
 
@@ -225,6 +243,10 @@ public:
     // sequence training
     CPUMatrix<ElemType>& DropFrame(const CPUMatrix<ElemType>& label, const CPUMatrix<ElemType>& gamma, const ElemType& threshhold);
     CPUMatrix<ElemType>& AssignSequenceError(const ElemType hsmoothingWeight, const CPUMatrix<ElemType>& label, const CPUMatrix<ElemType>& dnnoutput, const CPUMatrix<ElemType>& gamma, ElemType alpha);
+    CPUMatrix<ElemType>& AssignCTCScore(const CPUMatrix<ElemType>& logProbs, CPUMatrix<ElemType>& alpha, CPUMatrix<ElemType>& beta,
+                                        const CPUMatrix<ElemType>& labelSequences, CPUMatrix<ElemType>& totalScore,
+                                        const std::vector<size_t>& uttToChanInd, const std::vector<size_t>& uttBeginFrame, const std::vector<size_t>& uttFrameNum,
+                                        const std::vector<size_t>& uttLabelNum, const size_t numParallelSequences, const size_t maxFrameNum, const size_t blankTokenId);
     CPUMatrix<ElemType>& InplaceSqrt();
     CPUMatrix<ElemType>& AssignSqrtOf(const CPUMatrix<ElemType>& a);
 
@@ -357,6 +379,10 @@ public:
     void ConvolutionBackwardKernel(const CPUMatrix<ElemType>& in, const CPUMatrix<int>& mpRowCol, const CPUMatrix<int>& mpRowIwht,
                                    const CPUMatrix<int>& mpRowRun, const CPUMatrix<int>& runs, CPUMatrix<ElemType>& kernelGrad) const;
 
+    void DepthwiseConvolutionForward(const CPUMatrix<ElemType>& kernel, const DepthwiseConvolutionShape& shape, CPUMatrix<ElemType>& output) const;
+    void DepthwiseConvolutionBackwardData(const CPUMatrix<ElemType>& kernel, const DepthwiseConvolutionShape& shape, CPUMatrix<ElemType>& grad) const;
+    void DepthwiseConvolutionBackwardKernel(const CPUMatrix<ElemType>& in, const DepthwiseConvolutionShape& shape, CPUMatrix<ElemType>& kernelGrad) const;
+
     void UnrollConvolutionInput(size_t unrollCols, size_t mapOutSize, const CPUMatrix<int>& mpRowCol,
                                 const CPUMatrix<int>& mpRowRun, const CPUMatrix<int>& runs, CPUMatrix<ElemType>& output) const;
     void UnrollConvolutionOutput(size_t unrollCols, size_t mapInCount, size_t mapOutCount, const CPUMatrix<int>& mpRowCol,
@@ -379,10 +405,21 @@ public:
     void BatchNormalizationBackward(const CPUMatrix<ElemType>& in, CPUMatrix<ElemType>& grad, const CPUMatrix<ElemType>& scale, double blendFactor, const CPUMatrix<ElemType>& saveMean, const CPUMatrix<ElemType>& saveInvStdDev,
                                     CPUMatrix<ElemType>& scaleGrad, CPUMatrix<ElemType>& biasGrad) const;
 
+    // RNN support functions, see CPURNNExecutor
+    void RNNForward(const CPUMatrix<ElemType>& inputX, const CPUMatrix<ElemType>& paramW, size_t xDim, size_t yDim, const vector<size_t>& numSequencesForFrame, const struct RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace);
+    void RNNBackwardData(const CPUMatrix<ElemType>& outputDY, const CPUMatrix<ElemType>& paramW, CPUMatrix<ElemType>& outputDX, const struct RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace);
+    void RNNBackwardWeights(const CPUMatrix<ElemType>& inputX, const CPUMatrix<ElemType>& outputY, CPUMatrix<ElemType>& dw, const struct RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace);
+
 public:
     // This functions do not depend on <ElemType>, i.e. you can call them on any <ElemType>
     static int SetNumThreads(int numThreads);
+    static int GetNumThreads();     // OpenMP threads of the math functions
+    static int GetNumBlasThreads(); // threads of the BLAS library, which has a pool of its own
     static void SetCompatibleMode();
+    // float products of at most this many multiply-adds go through the CPUVectorKernels instead of the BLAS library;
+    // 0 for BLAS only
+    static void SetSmallGemmThreshold(size_t maxMultiplyAdds);
+    static size_t GetSmallGemmThreshold();
 
     // static BLAS functions
     static void SVD(const CPUMatrix<ElemType>& A, CPUMatrix<ElemType>& SIGMA, CPUMatrix<ElemType>& U, CPUMatrix<ElemType>& VT, CPUMatrix<ElemType>& W);
@@ -391,6 +428,8 @@ public:
     static void MultiplyAndAdd(const CPUMatrix<ElemType>& a, const bool transposeA, const CPUMatrix<ElemType>& b, const bool transposeB, CPUMatrix<ElemType>& c);
     static void Multiply(const CPUMatrix<ElemType>& a, const bool transposeA, const CPUMatrix<ElemType>& b, const bool transposeB, CPUMatrix<ElemType>& c);
     static void Multiply(const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, CPUMatrix<ElemType>& c);
+    static void MultiplyAndAddBias(const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, const CPUMatrix<ElemType>& bias, ElementWiseOperator activation, CPUMatrix<ElemType>& c);
+    static void BatchMultiplyAndWeightedAdd(ElemType alpha, const CPUMatrix<ElemType>& a, const bool transposeA, size_t aRows, const CPUMatrix<ElemType>& b, const bool transposeB, size_t bRows, ElemType beta, CPUMatrix<ElemType>& c);
     static void Multiply1x1AndWeightedAdd(ElemType alpha, const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, ElemType beta, CPUMatrix<ElemType>& c);
 
     static void ScaleAndAdd(ElemType alpha, const CPUMatrix<ElemType>& a, CPUMatrix<ElemType>& c);
@@ -411,6 +450,7 @@ public:
     static void ElementWisePower(ElemType alpha, const CPUMatrix<ElemType>& a, CPUMatrix<ElemType>& c);
 
     static bool AreEqual(const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>& b, const ElemType threshold = 1e-8);
+    static void UpdateNonFiniteFlag(const ElemType* data, size_t numElements, CPUMatrix<ElemType>& flag);
 
     static void TensorShuffleScaleAndAdd(ElemType keepWeight, const CPUMatrix<ElemType>& a, size_t D, size_t S, size_t M, size_t K, size_t T, ElemType scaleFactor, const CPUMatrix<ElemType>& b, CPUMatrix<ElemType>& c);
 
@@ -457,8 +497,13 @@ public:
         int format;
         stream >> matrixName >> format >> numRows >> numCols;
         ElemType* d_array = new ElemType[numRows * numCols];
-        for (size_t i = 0; i < numRows * numCols; ++i)
-            stream >> d_array[i];
+        if (stream.IsTextBased())
+        {
+            for (size_t i = 0; i < numRows * numCols; ++i)
+                stream >> d_array[i];
+        }
+        else
+            stream.GetBlock(d_array, numRows * numCols * sizeof(ElemType));
         stream.GetMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
         us.SetValue(numRows, numCols, d_array, matrixFlagNormal);
 
@@ -475,8 +520,13 @@ public:
         stream << s << format;
 
         stream << us.m_numRows << us.m_numCols;
-        for (size_t i = 0; i < us.GetNumElements(); ++i)
-            stream << us.Buffer()[i];
+        if (stream.IsTextBased())
+        {
+            for (size_t i = 0; i < us.GetNumElements(); ++i)
+                stream << us.Buffer()[i];
+        }
+        else
+            stream.PutBlock(us.Buffer(), us.GetNumElements() * sizeof(ElemType));
         stream.PutMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
         return stream;
     }
@@ -514,6 +564,9 @@ protected:
 
 private:
     void Clear();
+    void Reallocate(size_t capacity, bool keepContent);
+
+    mutable std::shared_ptr<CPURNNExecutor<ElemType>> m_rnnExecutor; // for OptimizedRNNStack
 };
 
 typedef CPUMatrix<float> CPUSingleMatrix;
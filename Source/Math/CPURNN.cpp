@@ -0,0 +1,451 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPURNN.cpp -- the CPU implementation of OptimizedRNNStack, see CPURNN.h
+//
+
+#include "stdafx.h"
+#include "CPURNN.h"
+#include <math.h>
+#include <string.h>
+
+#ifdef USE_MKL
+#include <mkl.h>
+#else
+#include <cblas.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// float/double overloads of column-major cblas_?gemm(): c = alpha * op(a) * op(b) + beta * c
+static void Gemm(bool transA, bool transB, size_t m, size_t n, size_t k, float alpha, const float* a, size_t lda, const float* b, size_t ldb, float beta, float* c, size_t ldc)
+{
+    cblas_sgemm(CblasColMajor, transA ? CblasTrans : CblasNoTrans, transB ? CblasTrans : CblasNoTrans,
+                (int) m, (int) n, (int) k, alpha, a, (int) lda, b, (int) ldb, beta, c, (int) ldc);
+}
+
+static void Gemm(bool transA, bool transB, size_t m, size_t n, size_t k, double alpha, const double* a, size_t lda, const double* b, size_t ldb, double beta, double* c, size_t ldc)
+{
+    cblas_dgemm(CblasColMajor, transA ? CblasTrans : CblasNoTrans, transB ? CblasTrans : CblasNoTrans,
+                (int) m, (int) n, (int) k, alpha, a, (int) lda, b, (int) ldb, beta, c, (int) ldc);
+}
+
+template <class ElemType>
+static inline ElemType Sigmoid(ElemType x)
+{
+    return 1 / (1 + exp(-x));
+}
+
+template <class ElemType>
+CPURNNExecutor<ElemType>::CPURNNExecutor(size_t xDim, size_t yDim, const RnnAttributes& rnnAttributes)
+    : m_xDim(xDim), m_yDim(yDim), m_rnnAttributes(rnnAttributes), m_numColumns(0), m_reserveSize(0), m_workspaceSize(0), m_backwardDataCalledYet(false)
+{
+    if      (rnnAttributes.m_recurrentOp == wstring(L"lstm"))    m_cellType = CellType::lstm,    m_numGates = 4;
+    else if (rnnAttributes.m_recurrentOp == wstring(L"gru"))     m_cellType = CellType::gru,     m_numGates = 3;
+    else if (rnnAttributes.m_recurrentOp == wstring(L"rnnReLU")) m_cellType = CellType::rnnReLU, m_numGates = 1;
+    else if (rnnAttributes.m_recurrentOp == wstring(L"rnnTanh")) m_cellType = CellType::rnnTanh, m_numGates = 1;
+    else InvalidArgument("Unknown cell type '%ls'. Supported values are 'lstm', 'gru', 'rnnReLU', 'rnnTanh'.", rnnAttributes.m_recurrentOp.c_str());
+
+    if (rnnAttributes.m_numLayers == 0 || rnnAttributes.m_hiddenSize == 0)
+        InvalidArgument("OptimizedRNNStack: The number of layers and the hidden dimension must be positive.");
+    if (yDim != NumDirections() * rnnAttributes.m_hiddenSize)
+        InvalidArgument("OptimizedRNNStack: The output dimension %d does not match the hidden dimension %d.", (int) yDim, (int) rnnAttributes.m_hiddenSize);
+}
+
+template <class ElemType>
+size_t CPURNNExecutor<ElemType>::ParameterOffset(size_t pseudoLayer) const
+{
+    const size_t numGateUnits = m_numGates * m_rnnAttributes.m_hiddenSize;
+    size_t offset = 0;
+    for (size_t p = 0; p < pseudoLayer; p++)
+        offset += (InputDim(p / NumDirections()) + m_rnnAttributes.m_hiddenSize + 2) * numGateUnits;
+    return offset;
+}
+
+template <class ElemType>
+size_t CPURNNExecutor<ElemType>::GetNumParameters() const
+{
+    return ParameterOffset(m_rnnAttributes.m_numLayers * NumDirections());
+}
+
+template <class ElemType>
+size_t CPURNNExecutor<ElemType>::NumColumnsWithPrevious(size_t direction, size_t frame) const
+{
+    if (direction == 0)
+        return frame > 0 ? m_numSequencesForFrame[frame] : 0;
+    return frame + 1 < m_numSequencesForFrame.size() ? m_numSequencesForFrame[frame + 1] : 0;
+}
+
+template <class ElemType>
+void CPURNNExecutor<ElemType>::SetLayout(size_t numColumns)
+{
+    const size_t hidden = m_rnnAttributes.m_hiddenSize;
+    const size_t numGateUnits = m_numGates * hidden;
+    const size_t numPseudoLayers = m_rnnAttributes.m_numLayers * NumDirections();
+    m_numColumns = numColumns;
+
+    size_t offset = 0;
+    m_layerOutputOffsets.resize(m_rnnAttributes.m_numLayers - 1);
+    for (auto& layerOffset : m_layerOutputOffsets)
+    {
+        layerOffset = offset;
+        offset += NumDirections() * hidden * numColumns;
+    }
+    m_gatesOffsets.resize(numPseudoLayers);
+    for (auto& gatesOffset : m_gatesOffsets)
+    {
+        gatesOffset = offset;
+        offset += (numGateUnits + (m_cellType == CellType::lstm || m_cellType == CellType::gru ? hidden : 0)) * numColumns;
+    }
+    m_reserveSize = offset;
+
+    offset = 0;
+    m_gradientOffsets.resize(numPseudoLayers);
+    for (auto& gradientOffset : m_gradientOffsets)
+    {
+        gradientOffset = offset;
+        offset += (m_cellType == CellType::gru ? 2 : 1) * numGateUnits * numColumns;
+    }
+    m_workspaceSize = offset;
+}
+
+template <class ElemType>
+const ElemType* CPURNNExecutor<ElemType>::LayerOutput(const CPUMatrix<ElemType>& reserve, const CPUMatrix<ElemType>& outputY, size_t layer) const
+{
+    return layer + 1 == m_rnnAttributes.m_numLayers ? outputY.Data() : reserve.Data() + m_layerOutputOffsets[layer];
+}
+
+// For GRU the input of the recurrent weights of h' is scaled by r, so that their gradients differ from those of the
+// input weights; for the others they are the same.
+template <class ElemType>
+ElemType* CPURNNExecutor<ElemType>::RecurrentGateInputGradients(CPUMatrix<ElemType>& workspace, size_t pseudoLayer) const
+{
+    ElemType* gradients = GateInputGradients(workspace, pseudoLayer);
+    return m_cellType == CellType::gru ? gradients + m_numGates * m_rnnAttributes.m_hiddenSize * m_numColumns : gradients;
+}
+
+template <class ElemType>
+void CPURNNExecutor<ElemType>::ForwardCore(const CPUMatrix<ElemType>& weightsW, const CPUMatrix<ElemType>& inputX, CPUMatrix<ElemType>& outputY, const vector<size_t>& numSequencesForFrame,
+                                           const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& /*workspace*/)
+{
+    if (!(rnnAttributes == m_rnnAttributes))
+        LogicError("OptimizedRNNStack: The RNN attributes changed between calls.");
+    if (inputX.GetNumRows() != m_xDim)
+        InvalidArgument("OptimizedRNNStack: The input dimension %d does not match the expected %d.", (int) inputX.GetNumRows(), (int) m_xDim);
+    if (weightsW.GetNumElements() < GetNumParameters())
+        InvalidArgument("OptimizedRNNStack: %d parameters are needed, but there are only %d.", (int) GetNumParameters(), (int) weightsW.GetNumElements());
+
+    m_numSequencesForFrame = numSequencesForFrame;
+    m_frameOffsets.assign(1, 0);
+    for (size_t t = 0; t < numSequencesForFrame.size(); t++)
+    {
+        if (t > 0 && numSequencesForFrame[t] > numSequencesForFrame[t - 1])
+            LogicError("OptimizedRNNStack: The sequences have to be packed longest first.");
+        m_frameOffsets.push_back(m_frameOffsets.back() + numSequencesForFrame[t]);
+    }
+    if (m_frameOffsets.back() != inputX.GetNumCols())
+        InvalidArgument("OptimizedRNNStack: The input has %d columns, but the frames have %d.", (int) inputX.GetNumCols(), (int) m_frameOffsets.back());
+
+    SetLayout(inputX.GetNumCols());
+    outputY.RequireSize(m_yDim, m_numColumns);
+    m_backwardDataCalledYet = false;
+    if (m_numColumns == 0)
+        return;
+    reserve.RequireSize(m_reserveSize, 1);
+
+    for (size_t layer = 0; layer < m_rnnAttributes.m_numLayers; layer++)
+    {
+        const ElemType* x = layer == 0 ? inputX.Data() : LayerOutput(reserve, outputY, layer - 1);
+        ElemType* y = const_cast<ElemType*>(LayerOutput(reserve, outputY, layer));
+        for (size_t direction = 0; direction < NumDirections(); direction++)
+        {
+            const size_t p = layer * NumDirections() + direction;
+            ForwardPseudoLayer(layer, direction, weightsW.Data() + ParameterOffset(p), x, y, Gates(reserve, p), States(reserve, p));
+        }
+    }
+}
+
+template <class ElemType>
+void CPURNNExecutor<ElemType>::ForwardPseudoLayer(size_t layer, size_t direction, const ElemType* w, const ElemType* x, ElemType* y, ElemType* gates, ElemType* states)
+{
+    const size_t inputDim = InputDim(layer);
+    const size_t hidden = m_rnnAttributes.m_hiddenSize;
+    const size_t numGateUnits = m_numGates * hidden;
+    const size_t ldy = NumDirections() * hidden;
+    const ElemType* weights = w;
+    const ElemType* recurrentWeights = weights + inputDim * numGateUnits;
+    const ElemType* bias = recurrentWeights + hidden * numGateUnits;
+    const ElemType* recurrentBias = bias + numGateUnits;
+    const CellType cellType = m_cellType;
+
+    // the input projections of all frames at once
+    Gemm(true, false, numGateUnits, m_numColumns, inputDim, 1, weights, inputDim, x, inputDim, 0, gates, numGateUnits);
+#pragma omp parallel for
+    for (long long c = 0; c < (long long) m_numColumns; c++)
+    {
+        ElemType* a = gates + c * numGateUnits;
+        for (size_t j = 0; j < numGateUnits; j++)
+            a[j] += bias[j] + (cellType == CellType::gru && j >= 2 * hidden ? 0 : recurrentBias[j]); // GRU adds the one of h' to the recurrent input only
+    }
+
+    for (size_t step = 0; step < m_numSequencesForFrame.size(); step++)
+    {
+        const size_t t = Frame(direction, step);
+        const size_t numSequences = m_numSequencesForFrame[t];
+        const size_t firstColumn = m_frameOffsets[t];
+        const size_t numWithPrevious = NumColumnsWithPrevious(direction, t);
+        const size_t previousColumn = numWithPrevious > 0 ? m_frameOffsets[PreviousFrame(direction, t)] : 0;
+        const ElemType* hPrevious = y + previousColumn * ldy + direction * hidden;
+        ElemType* a = gates + firstColumn * numGateUnits;
+
+        if (cellType == CellType::gru)
+        {
+            ElemType* aRecurrent = states + firstColumn * hidden; // R_h' h + bR_h', which r scales
+            for (size_t s = 0; s < numSequences; s++)
+                memcpy(aRecurrent + s * hidden, recurrentBias + 2 * hidden, hidden * sizeof(ElemType));
+            if (numWithPrevious > 0)
+            {
+                Gemm(true, false, 2 * hidden, numWithPrevious, hidden, 1, recurrentWeights, hidden, hPrevious, ldy, 1, a, numGateUnits);
+                Gemm(true, false, hidden, numWithPrevious, hidden, 1, recurrentWeights + 2 * hidden * hidden, hidden, hPrevious, ldy, 1, aRecurrent, hidden);
+            }
+        }
+        else if (numWithPrevious > 0)
+            Gemm(true, false, numGateUnits, numWithPrevious, hidden, 1, recurrentWeights, hidden, hPrevious, ldy, 1, a, numGateUnits);
+
+        // the nonlinearities and the state update of all sequences of the frame, which replaces the gate inputs by the gates
+#pragma omp parallel for
+        for (long long sequence = 0; sequence < (long long) numSequences; sequence++)
+        {
+            const size_t s = (size_t) sequence;
+            ElemType* as = a + s * numGateUnits;
+            ElemType* h = y + (firstColumn + s) * ldy + direction * hidden;
+            const ElemType* hp = s < numWithPrevious ? hPrevious + s * ldy : nullptr;
+            if (cellType == CellType::lstm)
+            {
+                ElemType* c = states + (firstColumn + s) * hidden;
+                const ElemType* cp = s < numWithPrevious ? states + (previousColumn + s) * hidden : nullptr;
+                for (size_t k = 0; k < hidden; k++)
+                {
+                    const ElemType i = Sigmoid(as[k]);
+                    const ElemType f = Sigmoid(as[hidden + k]);
+                    const ElemType g = tanh(as[2 * hidden + k]);
+                    const ElemType o = Sigmoid(as[3 * hidden + k]);
+                    as[k] = i, as[hidden + k] = f, as[2 * hidden + k] = g, as[3 * hidden + k] = o;
+                    c[k] = i * g + (cp ? f * cp[k] : 0);
+                    h[k] = o * tanh(c[k]);
+                }
+            }
+            else if (cellType == CellType::gru)
+            {
+                const ElemType* aRecurrent = states + (firstColumn + s) * hidden;
+                for (size_t k = 0; k < hidden; k++)
+                {
+                    const ElemType r = Sigmoid(as[k]);
+                    const ElemType z = Sigmoid(as[hidden + k]);
+                    const ElemType n = tanh(as[2 * hidden + k] + r * aRecurrent[k]);
+                    as[k] = r, as[hidden + k] = z, as[2 * hidden + k] = n;
+                    h[k] = (1 - z) * n + (hp ? z * hp[k] : 0);
+                }
+            }
+            else
+            {
+                for (size_t k = 0; k < hidden; k++)
+                {
+                    as[k] = cellType == CellType::rnnReLU ? (as[k] > 0 ? as[k] : 0) : tanh(as[k]);
+                    h[k] = as[k];
+                }
+            }
+        }
+    }
+}
+
+template <class ElemType>
+void CPURNNExecutor<ElemType>::BackwardDataCore(const CPUMatrix<ElemType>& outputY, const CPUMatrix<ElemType>& outputDY, const CPUMatrix<ElemType>& w, CPUMatrix<ElemType>& dx,
+                                                const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    if (!(rnnAttributes == m_rnnAttributes))
+        LogicError("OptimizedRNNStack: The RNN attributes changed between calls.");
+    if (outputDY.GetNumRows() != m_yDim || outputDY.GetNumCols() != m_numColumns)
+        InvalidArgument("OptimizedRNNStack: The gradient of the output does not match the output of the forward pass.");
+
+    dx.RequireSize(m_xDim, m_numColumns);
+    m_backwardDataCalledYet = true;
+    if (m_numColumns == 0)
+        return;
+    workspace.RequireSize(m_workspaceSize, 1);
+
+    const size_t numGateUnits = m_numGates * m_rnnAttributes.m_hiddenSize;
+    m_dy.assign(outputDY.Data(), outputDY.Data() + m_yDim * m_numColumns);
+    for (size_t layer = m_rnnAttributes.m_numLayers; layer-- > 0;)
+    {
+        const size_t inputDim = InputDim(layer);
+        const ElemType* y = LayerOutput(reserve, outputY, layer);
+        m_dx.resize(inputDim * m_numColumns);
+        for (size_t direction = 0; direction < NumDirections(); direction++)
+        {
+            const size_t p = layer * NumDirections() + direction;
+            const ElemType* weights = w.Data() + ParameterOffset(p);
+            ElemType* dGates = GateInputGradients(workspace, p);
+            BackwardPseudoLayer(layer, direction, weights, m_dy.data(), y, Gates(reserve, p), States(reserve, p), dGates, RecurrentGateInputGradients(workspace, p));
+
+            // the gradient of the input of the layer, for all frames at once
+            Gemm(false, false, inputDim, m_numColumns, numGateUnits, 1, weights, inputDim, dGates, numGateUnits, direction == 0 ? 0 : 1, m_dx.data(), inputDim);
+        }
+        m_dy.swap(m_dx); // the gradient of the output of the layer below
+    }
+    memcpy(dx.Data(), m_dy.data(), m_xDim * m_numColumns * sizeof(ElemType));
+}
+
+// Computes the gradients of the gate inputs of a pseudo layer, from the last step to the first one. The gradients
+// that flow to the states of the step before are carried in m_carryH and m_carryC, one column per sequence.
+template <class ElemType>
+void CPURNNExecutor<ElemType>::BackwardPseudoLayer(size_t layer, size_t direction, const ElemType* w, const ElemType* dy, const ElemType* y, const ElemType* gates, const ElemType* states,
+                                                   ElemType* dGates, ElemType* dRecurrentGates)
+{
+    const size_t inputDim = InputDim(layer);
+    const size_t hidden = m_rnnAttributes.m_hiddenSize;
+    const size_t numGateUnits = m_numGates * hidden;
+    const size_t ldy = NumDirections() * hidden;
+    const ElemType* recurrentWeights = w + inputDim * numGateUnits;
+    const CellType cellType = m_cellType;
+
+    m_carryH.resize(hidden * m_numSequencesForFrame.front());
+    m_carryC.resize(hidden * m_numSequencesForFrame.front());
+    ElemType* carryH = m_carryH.data();
+    ElemType* carryC = m_carryC.data();
+    size_t numCarried = 0;
+
+    for (size_t step = m_numSequencesForFrame.size(); step-- > 0;)
+    {
+        const size_t t = Frame(direction, step);
+        const size_t numSequences = m_numSequencesForFrame[t];
+        const size_t firstColumn = m_frameOffsets[t];
+        const size_t numWithPrevious = NumColumnsWithPrevious(direction, t);
+        const size_t previousColumn = numWithPrevious > 0 ? m_frameOffsets[PreviousFrame(direction, t)] : 0;
+        const ElemType* hPrevious = y + previousColumn * ldy + direction * hidden;
+
+#pragma omp parallel for
+        for (long long sequence = 0; sequence < (long long) numSequences; sequence++)
+        {
+            const size_t s = (size_t) sequence;
+            const ElemType* as = gates + (firstColumn + s) * numGateUnits;
+            const ElemType* dys = dy + (firstColumn + s) * ldy + direction * hidden;
+            ElemType* dgs = dGates + (firstColumn + s) * numGateUnits;
+            ElemType* drs = dRecurrentGates + (firstColumn + s) * numGateUnits;
+            ElemType* ch = carryH + s * hidden;
+            ElemType* cc = carryC + s * hidden;
+            const bool carried = s < numCarried;
+            if (cellType == CellType::lstm)
+            {
+                const ElemType* c = states + (firstColumn + s) * hidden;
+                const ElemType* cp = s < numWithPrevious ? states + (previousColumn + s) * hidden : nullptr;
+                for (size_t k = 0; k < hidden; k++)
+                {
+                    const ElemType i = as[k], f = as[hidden + k], g = as[2 * hidden + k], o = as[3 * hidden + k];
+                    const ElemType dh = dys[k] + (carried ? ch[k] : 0);
+                    const ElemType tc = tanh(c[k]);
+                    const ElemType dc = dh * o * (1 - tc * tc) + (carried ? cc[k] : 0);
+                    dgs[k] = dc * g * i * (1 - i);
+                    dgs[hidden + k] = cp ? dc * cp[k] * f * (1 - f) : 0;
+                    dgs[2 * hidden + k] = dc * i * (1 - g * g);
+                    dgs[3 * hidden + k] = dh * tc * o * (1 - o);
+                    cc[k] = dc * f;
+                    ch[k] = 0;
+                }
+            }
+            else if (cellType == CellType::gru)
+            {
+                const ElemType* aRecurrent = states + (firstColumn + s) * hidden;
+                const ElemType* hp = s < numWithPrevious ? hPrevious + s * ldy : nullptr;
+                for (size_t k = 0; k < hidden; k++)
+                {
+                    const ElemType r = as[k], z = as[hidden + k], n = as[2 * hidden + k];
+                    const ElemType dh = dys[k] + (carried ? ch[k] : 0);
+                    const ElemType dn = dh * (1 - z) * (1 - n * n);
+                    dgs[k] = drs[k] = dn * aRecurrent[k] * r * (1 - r);
+                    dgs[hidden + k] = drs[hidden + k] = dh * ((hp ? hp[k] : 0) - n) * z * (1 - z);
+                    dgs[2 * hidden + k] = dn;
+                    drs[2 * hidden + k] = dn * r;
+                    ch[k] = dh * z;
+                }
+            }
+            else
+            {
+                for (size_t k = 0; k < hidden; k++)
+                {
+                    const ElemType dh = dys[k] + (carried ? ch[k] : 0);
+                    dgs[k] = cellType == CellType::rnnReLU ? (as[k] > 0 ? dh : 0) : dh * (1 - as[k] * as[k]);
+                    ch[k] = 0;
+                }
+            }
+        }
+
+        if (numWithPrevious > 0)
+            Gemm(false, false, hidden, numWithPrevious, numGateUnits, 1, recurrentWeights, hidden, dRecurrentGates + firstColumn * numGateUnits, numGateUnits, 1, carryH, hidden);
+        numCarried = numWithPrevious;
+    }
+}
+
+template <class ElemType>
+void CPURNNExecutor<ElemType>::BackwardWeightsCore(const CPUMatrix<ElemType>& inputX, const CPUMatrix<ElemType>& outputY, CPUMatrix<ElemType>& dw,
+                                                   const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    if (!(rnnAttributes == m_rnnAttributes))
+        LogicError("OptimizedRNNStack: The RNN attributes changed between calls.");
+    if (!m_backwardDataCalledYet)
+        LogicError("OptimizedRNNStack: The gradient of the data has to be computed before the one of the weights.");
+    if (dw.GetNumElements() < GetNumParameters())
+        InvalidArgument("OptimizedRNNStack: %d parameter gradients are needed, but there are only %d.", (int) GetNumParameters(), (int) dw.GetNumElements());
+    if (m_numColumns == 0)
+        return;
+
+    // the gradients are added to dw, as in CuDNN
+    const size_t hidden = m_rnnAttributes.m_hiddenSize;
+    const size_t numGateUnits = m_numGates * hidden;
+    const size_t ldy = NumDirections() * hidden;
+    for (size_t layer = 0; layer < m_rnnAttributes.m_numLayers; layer++)
+    {
+        const size_t inputDim = InputDim(layer);
+        const ElemType* x = layer == 0 ? inputX.Data() : LayerOutput(reserve, outputY, layer - 1);
+        const ElemType* y = LayerOutput(reserve, outputY, layer);
+        for (size_t direction = 0; direction < NumDirections(); direction++)
+        {
+            const size_t p = layer * NumDirections() + direction;
+            ElemType* dWeights = dw.Data() + ParameterOffset(p);
+            ElemType* dRecurrentWeights = dWeights + inputDim * numGateUnits;
+            ElemType* dBias = dRecurrentWeights + hidden * numGateUnits;
+            ElemType* dRecurrentBias = dBias + numGateUnits;
+            const ElemType* dGates = GateInputGradients(workspace, p);
+            const ElemType* dRecurrentGates = RecurrentGateInputGradients(workspace, p);
+
+            Gemm(false, true, inputDim, numGateUnits, m_numColumns, 1, x, inputDim, dGates, numGateUnits, 1, dWeights, inputDim);
+            for (size_t t = 0; t < m_numSequencesForFrame.size(); t++)
+            {
+                const size_t numWithPrevious = NumColumnsWithPrevious(direction, t);
+                if (numWithPrevious == 0)
+                    continue;
+                const ElemType* hPrevious = y + m_frameOffsets[PreviousFrame(direction, t)] * ldy + direction * hidden;
+                Gemm(false, true, hidden, numGateUnits, numWithPrevious, 1, hPrevious, ldy, dRecurrentGates + m_frameOffsets[t] * numGateUnits, numGateUnits, 1, dRecurrentWeights, hidden);
+            }
+
+#pragma omp parallel for
+            for (long long j = 0; j < (long long) numGateUnits; j++)
+            {
+                ElemType sum = 0, recurrentSum = 0;
+                for (size_t c = 0; c < m_numColumns; c++)
+                {
+                    sum += dGates[c * numGateUnits + j];
+                    recurrentSum += dRecurrentGates[c * numGateUnits + j];
+                }
+                dBias[j] += sum;
+                dRecurrentBias[j] += recurrentSum;
+            }
+        }
+    }
+}
+
+template class CPURNNExecutor<float>;
+template class CPURNNExecutor<double>;
+
+}}}
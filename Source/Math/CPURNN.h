@@ -0,0 +1,103 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPURNN.h -- the CPU implementation of OptimizedRNNStack, the counterpart of CuDnnRNNExecutor.
+//
+
+#pragma once
+
+#include "CPUMatrix.h"
+#include "RNNCommon.h"
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// CPURNNExecutor runs a stack of LSTM, GRU or plain RNN layers, uni- or bidirectional, on CPUMatrix with the
+// parameters in the layout of CuDnnFilter, so that models move freely between CPU and GPU. Like the CuDNN one, it
+// is attached to the output matrix, and the calls of a minibatch have to go through that matrix: forward, then the
+// gradient of the data, then the gradient of the weights.
+//
+// The input has one column per sample, packed frame by frame with the sequences of a frame sorted longest first,
+// as OptimizedRNNStackNode packs them for CuDNN; frame t has numSequencesForFrame[t] columns. The parameters are
+// the pseudo layers (layer, direction) one after another, each being
+//     W  [inputDim x numGates * hidden]    the weights of the input of all gates, gate by gate (column-major)
+//     R  [hidden x numGates * hidden]      the weights of the recurrent input of all gates
+//     bW [numGates * hidden], bR [numGates * hidden]
+// with the gates in the order of CuDNN: i, f, c', o for LSTM, r, z, h' for GRU. The output of a bidirectional layer
+// is the forward hidden state followed by the backward one.
+//
+// The input projections of all frames are one GEMM per pseudo layer; the recurrence is one GEMM per frame over the
+// sequences of the frame, followed by a single pass over the gates that applies the nonlinearities and updates the
+// state, in parallel over the sequences. The gates, cell states and layer outputs are kept in 'reserve' for the
+// gradients; 'workspace' keeps the gradients of the gate inputs from the data gradient for the weight gradient.
+template <class ElemType>
+class CPURNNExecutor
+{
+public:
+    CPURNNExecutor(size_t xDim, size_t yDim, const RnnAttributes& rnnAttributes);
+
+    void ForwardCore(const CPUMatrix<ElemType>& weightsW, const CPUMatrix<ElemType>& inputX, CPUMatrix<ElemType>& outputY, const vector<size_t>& numSequencesForFrame, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace);
+    void BackwardDataCore(const CPUMatrix<ElemType>& outputY, const CPUMatrix<ElemType>& outputDY, const CPUMatrix<ElemType>& w, CPUMatrix<ElemType>& dx, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace);
+    void BackwardWeightsCore(const CPUMatrix<ElemType>& inputX, const CPUMatrix<ElemType>& outputY, CPUMatrix<ElemType>& dw, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace);
+
+    // The number of parameters the layers need, as RnnAttributes::GetNumParameters() infers them.
+    size_t GetNumParameters() const;
+
+private:
+    enum class CellType
+    {
+        lstm,
+        gru,
+        rnnReLU,
+        rnnTanh
+    };
+
+    size_t NumDirections() const { return m_rnnAttributes.m_bidirectional ? 2 : 1; }
+    size_t InputDim(size_t layer) const { return layer == 0 ? m_xDim : NumDirections() * m_rnnAttributes.m_hiddenSize; }
+
+    // Offsets of the parameters of a pseudo layer, layer * NumDirections() + direction.
+    size_t ParameterOffset(size_t pseudoLayer) const;
+
+    // The steps of a direction in the order they are computed, and the columns that have the state of the step
+    // before, which are the first ones of the step.
+    size_t Frame(size_t direction, size_t step) const { return direction == 0 ? step : m_numSequencesForFrame.size() - 1 - step; }
+    size_t PreviousFrame(size_t direction, size_t frame) const { return direction == 0 ? frame - 1 : frame + 1; }
+    size_t NumColumnsWithPrevious(size_t direction, size_t frame) const;
+
+    // Where the layer outputs and the gates of the pseudo layers are kept in 'reserve', and the gradients of the gate
+    // inputs in 'workspace'.
+    void SetLayout(size_t numColumns);
+    ElemType* Gates(CPUMatrix<ElemType>& reserve, size_t pseudoLayer) const { return reserve.Data() + m_gatesOffsets[pseudoLayer]; }
+    ElemType* States(CPUMatrix<ElemType>& reserve, size_t pseudoLayer) const { return reserve.Data() + m_gatesOffsets[pseudoLayer] + m_numGates * m_rnnAttributes.m_hiddenSize * m_numColumns; }
+    const ElemType* LayerOutput(const CPUMatrix<ElemType>& reserve, const CPUMatrix<ElemType>& outputY, size_t layer) const;
+    ElemType* GateInputGradients(CPUMatrix<ElemType>& workspace, size_t pseudoLayer) const { return workspace.Data() + m_gradientOffsets[pseudoLayer]; }
+    ElemType* RecurrentGateInputGradients(CPUMatrix<ElemType>& workspace, size_t pseudoLayer) const;
+
+    void ForwardPseudoLayer(size_t layer, size_t direction, const ElemType* w, const ElemType* x, ElemType* y, ElemType* gates, ElemType* states);
+    void BackwardPseudoLayer(size_t layer, size_t direction, const ElemType* w, const ElemType* dy, const ElemType* y, const ElemType* gates, const ElemType* states,
+                             ElemType* dGates, ElemType* dRecurrentGates);
+
+    size_t m_xDim;
+    size_t m_yDim;
+    RnnAttributes m_rnnAttributes;
+    CellType m_cellType;
+    size_t m_numGates;
+
+    // of the last forward pass
+    std::vector<size_t> m_numSequencesForFrame;
+    std::vector<size_t> m_frameOffsets; // first column of each frame, and the number of columns at the end
+    size_t m_numColumns;
+    std::vector<size_t> m_layerOutputOffsets; // in 'reserve', of the layers but the last one, whose output is the output
+    std::vector<size_t> m_gatesOffsets;       // in 'reserve', of each pseudo layer, followed by its cell states (LSTM) or recurrent h' inputs (GRU)
+    size_t m_reserveSize;
+    std::vector<size_t> m_gradientOffsets;    // in 'workspace', of each pseudo layer
+    size_t m_workspaceSize;
+    bool m_backwardDataCalledYet;
+
+    // scratch buffers of the backward pass
+    std::vector<ElemType> m_dy, m_dx;
+    std::vector<ElemType> m_carryH, m_carryC;
+};
+
+}}}
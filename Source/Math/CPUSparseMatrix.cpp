@@ -17,6 +17,7 @@
 #include <random>
 #include <chrono>
 #include <iostream>
+#include <unordered_map>
 #ifdef LEAKDETECT
 #include <vld.h>
 #endif
@@ -644,6 +645,76 @@ void CPUSparseMatrix<ElemType>::SetMatrixFromCSCFormat(const CPUSPARSE_INDEX_TYP
     memcpy(NzValues(), h_Val, sizeof(ElemType)*nz);
 }
 
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::SetMatrixFromOneHotSequences(const CPUSPARSE_INDEX_TYPE* h_indices, const CPUSPARSE_INDEX_TYPE* h_sequenceOffsets,
+                                                             const size_t numSequences, const size_t maxSequenceLength, const size_t numRows)
+{
+    if (!OwnBuffer())
+        LogicError("Cannot modify since the buffer is managed externally.");
+
+    size_t nz = h_sequenceOffsets[numSequences];
+    SetFormat(matrixFormatSparseCSC);
+    RequireSizeAndAllocate(numRows, numSequences * maxSequenceLength, nz, true, false);
+
+    // (ColLocation first, see SetMatrixFromCSCFormat())
+    CPUSPARSE_INDEX_TYPE* colStarts = ColLocation();
+    for (size_t i = 0; i < numSequences; i++)
+    {
+        CPUSPARSE_INDEX_TYPE begin = h_sequenceOffsets[i];
+        size_t length = h_sequenceOffsets[i + 1] - begin;
+        for (size_t j = 0; j < maxSequenceLength; j++)
+            colStarts[i * maxSequenceLength + j] = begin + (CPUSPARSE_INDEX_TYPE) min(j, length);
+    }
+    colStarts[numSequences * maxSequenceLength] = (CPUSPARSE_INDEX_TYPE) nz;
+    memcpy(RowLocation(), h_indices, sizeof(CPUSPARSE_INDEX_TYPE) * nz);
+    std::fill(NzValues(), NzValues() + nz, (ElemType) 1);
+}
+
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::GetBlockColumns(std::vector<size_t>& columnIds, std::vector<ElemType>& values) const
+{
+    if (GetFormat() != matrixFormatSparseBlockCol)
+        NOT_IMPLEMENTED;
+
+    const size_t numBlocks = GetBlockSize();
+    columnIds.resize(numBlocks);
+    for (size_t j = 0; j < numBlocks; j++)
+        columnIds[j] = GetBlockIds()[j] - GetBlockIdShift();
+    values.assign(Data(), Data() + numBlocks * GetNumRows());
+}
+
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::AssignSumOfBlockColumns(const size_t numRows, const size_t numCols, const std::vector<size_t>& columnIds, const std::vector<ElemType>& values)
+{
+    VerifyWritable(__func__);
+
+    if (values.size() != columnIds.size() * numRows)
+        InvalidArgument("AssignSumOfBlockColumns: Expected %d values for %d columns of %d rows, got %d.", (int) (columnIds.size() * numRows), (int) columnIds.size(), (int) numRows, (int) values.size());
+
+    // one block per distinct id, in ascending order
+    vector<size_t> blockIds(columnIds);
+    sort(blockIds.begin(), blockIds.end());
+    blockIds.erase(unique(blockIds.begin(), blockIds.end()), blockIds.end());
+    if (!blockIds.empty() && blockIds.back() >= numCols)
+        InvalidArgument("AssignSumOfBlockColumns: Column id %d is out of range for %d columns.", (int) blockIds.back(), (int) numCols);
+
+    Reset();
+    SetFormat(matrixFormatSparseBlockCol);
+    RequireSizeAndAllocate(numRows, numCols, max(blockIds.size(), (size_t) 1) * numRows, true, false);
+    memcpy(GetBlockIds(), blockIds.data(), sizeof(size_t) * blockIds.size());
+    SetBlockSize(blockIds.size());
+    memset(Data(), 0, sizeof(ElemType) * blockIds.size() * numRows);
+
+    for (size_t j = 0; j < columnIds.size(); j++)
+    {
+        size_t b = lower_bound(blockIds.begin(), blockIds.end(), columnIds[j]) - blockIds.begin();
+        ElemType* block = Data() + b * numRows;
+        const ElemType* column = values.data() + j * numRows;
+        for (size_t i = 0; i < numRows; i++)
+            block[i] += column[i];
+    }
+}
+
 template <class ElemType>
 ElemType* CPUSparseMatrix<ElemType>::Data()  const
 {
@@ -793,6 +864,32 @@ void CPUSparseMatrix<ElemType>::Reset()
     SetBlockIdShift(0);
 }
 
+// The number of threads for a sparse operation of 'work' multiply-adds that can be split into at most 'maxChunks'
+// independent parts. Small operations, and those within a parallel region, run on the calling thread.
+static size_t SparseParallelChunks(size_t work, size_t maxChunks)
+{
+    const size_t minWorkPerThread = 16384;
+    if (omp_in_parallel())
+        return 1;
+    return max((size_t) 1, min(min(work / minWorkPerThread, (size_t) omp_get_max_threads()), maxChunks));
+}
+
+// Splits the columns [0, numCols) of a CSC matrix, given by its column starts, into 'numChunks' ranges with about
+// the same number of nonzero elements. Returns the numChunks + 1 boundaries.
+static vector<size_t> PartitionColumnsByNonzeros(const CPUSPARSE_INDEX_TYPE* colStarts, size_t numCols, size_t numChunks)
+{
+    vector<size_t> boundaries(numChunks + 1, numCols);
+    boundaries[0] = 0;
+    const size_t numNonzero = numCols > 0 ? colStarts[numCols] - colStarts[0] : 0;
+    for (size_t chunk = 1; chunk < numChunks; chunk++)
+    {
+        auto target = (CPUSPARSE_INDEX_TYPE) (colStarts[0] + numNonzero * chunk / numChunks);
+        size_t col = lower_bound(colStarts, colStarts + numCols, target) - colStarts;
+        boundaries[chunk] = max(boundaries[chunk - 1], col);
+    }
+    return boundaries;
+}
+
 // Implements product of one sparse and one dense matrix updating a third dense matrix. Input matrices are optionally transposed.
 // NOTE: The only for using a class template instead of a function template was that I couldn't make the function template compile.
 template <class ElemType, bool denseTimesSparse /* false means SparseTimesDense */, bool transposeA, bool transposeB>
@@ -851,48 +948,90 @@ public:
         // * checked that the matrices are compatible in size
         // * Initialized the output matrix c
 
-        // Now do the actual multiplication.
-        ElemType* valueBuffer = sparse.Buffer() + *sparse.SecondaryIndexLocation(); // Points to the value buffer of the current view (i.e. buffer containing values of non-zero elements).
-        int* rowIndexBuffer = sparse.MajorIndexLocation();                          // Points to the index buffer of the current view (i.e. buffer containing indices of non-zero elements).
-        size_t iNonzero = 0;                                                           // Number of nonzero elements handled so far for curent slice view.
-        int numPreviosNonzero = sparse.SecondaryIndexLocation()[0];                 // Total number of nonzero values handled in previous slices.
-
-        // Loop over columns of the sparse matrix
-        for (size_t colSparse = 0; colSparse < sparse.GetNumCols(); colSparse++)
+        // Now do the actual multiplication, in parallel over parts of c that no two threads write:
+        // * if the columns of the sparse matrix index the columns (dense * sparse) or the rows (sparse^T * dense) of c,
+        //   over ranges of sparse columns with about the same number of nonzero elements;
+        // * otherwise over ranges of the outer dimension of the dense matrix.
+        // Either way each element of c adds up the same products in the same order as a single thread would.
+        const CPUSPARSE_INDEX_TYPE* colStarts = sparse.SecondaryIndexLocation(); // Start of each column in the buffers below, plus the number of nonzero values of previous slices.
+        const ElemType* valueBuffer = sparse.Buffer() + colStarts[0];                // Points to the value buffer of the current view (i.e. buffer containing values of non-zero elements).
+        const CPUSPARSE_INDEX_TYPE* rowIndexBuffer = sparse.MajorIndexLocation();   // Points to the index buffer of the current view (i.e. buffer containing indices of non-zero elements).
+        const size_t numColsSparse = sparse.GetNumCols();
+        const size_t numNonzero = colStarts[numColsSparse] - colStarts[0];
+
+        const bool partitionSparseColumns = (denseTimesSparse && !transposeB) || (!denseTimesSparse && transposeA); // evaluated at compile time
+        const size_t numChunks = SparseParallelChunks(numNonzero * outerDimensionDense, partitionSparseColumns ? numColsSparse : outerDimensionDense);
+        const vector<size_t> colBoundaries = PartitionColumnsByNonzeros(colStarts, partitionSparseColumns ? numColsSparse : 0, numChunks);
+
+#pragma omp parallel for if (numChunks > 1)
+        for (long chunk = 0; chunk < (long) numChunks; chunk++)
         {
-            size_t numNonzeroInSparseCol = sparse.SecondaryIndexLocation()[colSparse + 1] - numPreviosNonzero;
-            // Loop over the nonzero rows of the current column of the sparse matrix
-            for (; iNonzero < numNonzeroInSparseCol; iNonzero++)
+            size_t colBegin = 0, colEnd = numColsSparse;
+            size_t outerBegin = 0, outerEnd = outerDimensionDense;
+            if (partitionSparseColumns)
+            {
+                colBegin = colBoundaries[chunk];
+                colEnd   = colBoundaries[chunk + 1];
+            }
+            else
+            {
+                outerBegin = outerDimensionDense *  chunk      / numChunks;
+                outerEnd   = outerDimensionDense * (chunk + 1) / numChunks;
+            }
+
+            // sparse^T * dense, e.g. the CSC matrix of transposed weights times the input: each element of c is the dot product
+            // of a sparse column with a column of the dense matrix, summed up before c is updated once.
+            if (!denseTimesSparse && transposeA) // (evaluated at compile time)
+            {
+                for (size_t colSparse = colBegin; colSparse < colEnd; colSparse++)
+                {
+                    const size_t nonzeroBegin = colStarts[colSparse] - colStarts[0], nonzeroEnd = colStarts[colSparse + 1] - colStarts[0];
+                    for (size_t outerIndexDense = 0; outerIndexDense < outerDimensionDense; outerIndexDense++)
+                    {
+                        ElemType sum = 0;
+                        for (size_t iNonzero = nonzeroBegin; iNonzero < nonzeroEnd; iNonzero++)
+                            sum += valueBuffer[iNonzero] * (transposeB ? dense(outerIndexDense, rowIndexBuffer[iNonzero]) : dense(rowIndexBuffer[iNonzero], outerIndexDense));
+                        c(colSparse, outerIndexDense) += alpha * sum;
+                    }
+                }
+                continue;
+            }
+
+            // Loop over columns of the sparse matrix
+            for (size_t colSparse = colBegin; colSparse < colEnd; colSparse++)
             {
-                size_t rowSparse = rowIndexBuffer[iNonzero]; // RowLocation
-                ElemType sparseVal = valueBuffer[iNonzero];
-
-                // Determine the index of the 'outer' dimension of the sparse matrix and the common inner index.
-                size_t outerIndexSparse;
-                size_t innerIndex;
-                // Below if-statements are evaluated at compile time.
-                if      ( denseTimesSparse && !transposeB) { outerIndexSparse = colSparse; innerIndex = rowSparse; }
-                else if ( denseTimesSparse &&  transposeB) { outerIndexSparse = rowSparse; innerIndex = colSparse; }
-                else if (!denseTimesSparse && !transposeA) { outerIndexSparse = rowSparse; innerIndex = colSparse; }
-                else if (!denseTimesSparse &&  transposeA) { outerIndexSparse = colSparse; innerIndex = rowSparse; }
-
-                // Loop over the outer index of the dense matrix
-                for (size_t outerIndexDense = 0; outerIndexDense < outerDimensionDense; outerIndexDense++)
+                // Loop over the nonzero rows of the current column of the sparse matrix
+                for (size_t iNonzero = colStarts[colSparse] - colStarts[0]; iNonzero < colStarts[colSparse + 1] - colStarts[0]; iNonzero++)
                 {
-                    // Determine the row index of the dense input matrix.
+                    size_t rowSparse = rowIndexBuffer[iNonzero]; // RowLocation
+                    ElemType sparseVal = valueBuffer[iNonzero];
+
+                    // Determine the index of the 'outer' dimension of the sparse matrix and the common inner index.
+                    size_t outerIndexSparse;
+                    size_t innerIndex;
                     // Below if-statements are evaluated at compile time.
-                    ElemType denseVal;
-                    if      ( denseTimesSparse && !transposeA) denseVal = dense(outerIndexDense,      innerIndex);
-                    else if ( denseTimesSparse &&  transposeA) denseVal = dense(     innerIndex, outerIndexDense);
-                    else if (!denseTimesSparse && !transposeB) denseVal = dense(     innerIndex, outerIndexDense);
-                    else if (!denseTimesSparse &&  transposeB) denseVal = dense(outerIndexDense,      innerIndex);
-                    
-
-                    // Update matrix c.
-                    if (denseTimesSparse)
-                        c(outerIndexDense, outerIndexSparse) += alpha * denseVal * sparseVal;
-                    else /*Sparse times dense */
-                        c(outerIndexSparse, outerIndexDense) += alpha * denseVal * sparseVal;
+                    if      ( denseTimesSparse && !transposeB) { outerIndexSparse = colSparse; innerIndex = rowSparse; }
+                    else if ( denseTimesSparse &&  transposeB) { outerIndexSparse = rowSparse; innerIndex = colSparse; }
+                    else if (!denseTimesSparse && !transposeA) { outerIndexSparse = rowSparse; innerIndex = colSparse; }
+                    else if (!denseTimesSparse &&  transposeA) { outerIndexSparse = colSparse; innerIndex = rowSparse; }
+
+                    // Loop over the outer index of the dense matrix
+                    for (size_t outerIndexDense = outerBegin; outerIndexDense < outerEnd; outerIndexDense++)
+                    {
+                        // Determine the row index of the dense input matrix.
+                        // Below if-statements are evaluated at compile time.
+                        ElemType denseVal;
+                        if      ( denseTimesSparse && !transposeA) denseVal = dense(outerIndexDense,      innerIndex);
+                        else if ( denseTimesSparse &&  transposeA) denseVal = dense(     innerIndex, outerIndexDense);
+                        else if (!denseTimesSparse && !transposeB) denseVal = dense(     innerIndex, outerIndexDense);
+                        else if (!denseTimesSparse &&  transposeB) denseVal = dense(outerIndexDense,      innerIndex);
+
+                        // Update matrix c.
+                        if (denseTimesSparse)
+                            c(outerIndexDense, outerIndexSparse) += alpha * denseVal * sparseVal;
+                        else /*Sparse times dense */
+                            c(outerIndexSparse, outerIndexDense) += alpha * denseVal * sparseVal;
+                    }
                 }
             }
         }
@@ -974,41 +1113,62 @@ void CPUSparseMatrix<ElemType>::MultiplyAndAdd(ElemType alpha, const CPUMatrix<E
         c.SetFormat(matrixFormatSparseBlockCol);
         c.RequireSizeAndAllocate(m, n, m * min(n, rhs.NzCount()), true, false);
 
-        map<size_t, size_t> w2Id;
+        // c gets a block (column) for each row i of rhs (e.g. a word) that has nonzero elements, in the order of
+        // their first occurrence, which sums lhs(:, j) * rhs(i, j) over these elements. That way the duplicates of a
+        // row are merged without a dense [m x rhs.GetNumRows()] intermediate.
+        // The nonzero elements are grouped by block first (a counting sort, which keeps them in column order), so that
+        // the blocks can be summed up in parallel, each in the order of a single thread.
+        const CPUSPARSE_INDEX_TYPE* colStarts = rhs.SecondaryIndexLocation();
+        const CPUSPARSE_INDEX_TYPE* rowIndices = rhs.MajorIndexLocation();
+        const ElemType* values = rhs.Buffer() + colStarts[0];
+        const size_t numNonzero = colStarts[rhs.GetNumCols()] - colStarts[0];
+
+        unordered_map<size_t, size_t> w2Id;
+        w2Id.reserve(numNonzero);
+        vector<size_t> blockOf(numNonzero), colOf(numNonzero);
+        vector<size_t> blockStarts(1, 0);
         for (size_t j = 0; j < rhs.GetNumCols(); j++)
         { // j ranges over batches
-            size_t start = rhs.SecondaryIndexLocation()[j];
-            size_t end = rhs.SecondaryIndexLocation()[j + 1];
-
-            for (size_t p = start; p < end; p++)
+            for (size_t p = colStarts[j] - colStarts[0]; p < colStarts[j + 1] - colStarts[0]; p++)
             {
-                size_t i = rhs.MajorIndexLocation()[p]; // i ranges over words
-                ElemType val = rhs.Buffer()[p];  // 1 for(i, j)
-
-                bool first = true;
-                if (w2Id.find(i) == w2Id.end())
+                size_t i = rowIndices[p]; // i ranges over words
+                auto iter = w2Id.insert(make_pair(i, w2Id.size()));
+                if (iter.second)
                 {
-                    size_t id = w2Id.size();
-                    w2Id[i] = id;
                     c.GetBlockIds()[c.GetBlockSize()] = i;
                     c.SetBlockSize(c.GetBlockSize() + 1);
+                    blockStarts.push_back(0);
                 }
-                else
-                {
-                    first = false;
-                }
-                size_t pos = w2Id[i] * lhs.GetNumRows();
+                blockOf[p] = iter.first->second;
+                colOf[p] = j;
+                blockStarts[blockOf[p] + 1]++;
+            }
+        }
+        const size_t numBlocks = c.GetBlockSize();
+        for (size_t b = 0; b < numBlocks; b++)
+            blockStarts[b + 1] += blockStarts[b];
+        vector<size_t> order(numNonzero);
+        vector<size_t> next(blockStarts.begin(), blockStarts.end() - 1);
+        for (size_t p = 0; p < numNonzero; p++)
+            order[next[blockOf[p]]++] = p;
+
+        const size_t numChunks = SparseParallelChunks(numNonzero * lhs.GetNumRows(), numBlocks);
+        // (dynamic, since the frequencies of the words differ widely)
+#pragma omp parallel for schedule(dynamic) if (numChunks > 1)
+        for (long b = 0; b < (long) numBlocks; b++)
+        {
+            ElemType* block = c.Buffer() + b * lhs.GetNumRows();
+            for (size_t q = blockStarts[b]; q < blockStarts[b + 1]; q++)
+            {
+                size_t p = order[q];
+                size_t j = colOf[p];
+                ElemType val = values[p]; // 1 for(i, j)
                 for (size_t h = 0; h < lhs.GetNumRows(); h++)
                 { // h range over hidden layer
-                    if (first == true)
-                    {
-                        c.Buffer()[pos] = alpha * lhs(h, j) * val;
-                    }
+                    if (q == blockStarts[b])
+                        block[h] = alpha * lhs(h, j) * val;
                     else
-                    {
-                        c.Buffer()[pos] += alpha * lhs(h, j) * val;
-                    }
-                    pos++;
+                        block[h] += alpha * lhs(h, j) * val;
                 }
             }
         }
@@ -1027,6 +1187,73 @@ void CPUSparseMatrix<ElemType>::MultiplyAndAdd(ElemType alpha, const CPUMatrix<E
     }
 }
 
+// *this[:,idx[j]] = sum of a[:,j] * alpha as a block-column matrix, with a block for each distinct idx[j] in ascending order
+// (e.g. the gradient of an embedding w.r.t. the ids of a minibatch). 'this' must have been sized already.
+// Invalid entries (gap columns) are denoted by idx(0,j) == -1.
+template <class ElemType>
+CPUSparseMatrix<ElemType>& CPUSparseMatrix<ElemType>::AssignScatteredColumnsOf(const CPUMatrix<ElemType>& idx, const CPUMatrix<ElemType>& a, ElemType alpha)
+{
+    VerifyWritable(__func__);
+
+    if (idx.GetNumRows() != 1) // index is 1-dimensional only
+        InvalidArgument("AssignScatteredColumnsOf: Map must be a row vector.");
+    if (idx.GetNumCols() != a.GetNumCols())
+        InvalidArgument("AssignScatteredColumnsOf: Map must have width of input vector.");
+
+    const size_t numRows = a.GetNumRows();
+    const size_t numCols = GetNumCols();
+
+    // the columns of a, sorted by their id; sorting the (id, column) pairs keeps the columns of an id in order
+    vector<pair<size_t, size_t>> columnsById;
+    columnsById.reserve(a.GetNumCols());
+    for (size_t j = 0; j < a.GetNumCols(); j++)
+    {
+        auto jOutF = idx(0, j);
+        if (::isnan(jOutF) || (jOutF < 0)) // negative index means gap
+            continue;
+        if (jOutF >= numCols)
+            InvalidArgument("AssignScatteredColumnsOf: Map out of bounds. %ld >= %ld", (long int) jOutF, (long int) numCols);
+        columnsById.push_back(make_pair((size_t) jOutF, j));
+    }
+    sort(columnsById.begin(), columnsById.end());
+
+    vector<size_t> blockStarts;
+    for (size_t p = 0; p < columnsById.size(); p++)
+    {
+        if (p == 0 || columnsById[p].first != columnsById[p - 1].first)
+            blockStarts.push_back(p);
+    }
+    const size_t numBlocks = blockStarts.size();
+    blockStarts.push_back(columnsById.size());
+
+    Reset();
+    SetFormat(matrixFormatSparseBlockCol);
+    RequireSizeAndAllocate(numRows, numCols, max(numBlocks, (size_t) 1) * numRows, true, false);
+    SetBlockSize(numBlocks);
+
+    // each block is the sum over a segment of the sorted columns
+    const size_t numChunks = SparseParallelChunks(columnsById.size() * numRows, numBlocks);
+#pragma omp parallel for if (numChunks > 1)
+    for (long b = 0; b < (long) numBlocks; b++)
+    {
+        GetBlockIds()[b] = columnsById[blockStarts[b]].first;
+        ElemType* block = Data() + b * numRows;
+        for (size_t p = blockStarts[b]; p < blockStarts[b + 1]; p++)
+        {
+            const ElemType* column = a.Data() + columnsById[p].second * numRows;
+            for (size_t i = 0; i < numRows; i++)
+            {
+                if (p == blockStarts[b])
+                    block[i] = alpha * column[i];
+                else
+                    block[i] += alpha * column[i];
+            }
+        }
+    }
+
+    return *this;
+}
+
 // dense += sparse
 template <class ElemType>
 void CPUSparseMatrix<ElemType>::ScaleAndAdd(const ElemType alpha, const CPUSparseMatrix<ElemType>& lhs, CPUMatrix<ElemType>& rhs)
@@ -1044,7 +1271,10 @@ void CPUSparseMatrix<ElemType>::ScaleAndAdd(const ElemType alpha, const CPUSpars
     if (lhs.GetFormat() == MatrixFormat::matrixFormatSparseCSC || lhs.GetFormat() == MatrixFormat::matrixFormatSparseCSR)
     {
         size_t col_num = (lhs.GetFormat() == MatrixFormat::matrixFormatSparseCSC) ? lhs.GetNumCols() : lhs.GetNumRows();
-        for (size_t j = 0; j < col_num; j++)
+        // each column (CSC) or row (CSR) of lhs updates its own column or row of rhs
+        size_t numChunks = SparseParallelChunks(lhs.NzCount(), col_num);
+#pragma omp parallel for if (numChunks > 1)
+        for (long j = 0; j < (long) col_num; j++)
         {
             size_t start = lhs.SecondaryIndexLocation()[j];
             size_t end = lhs.SecondaryIndexLocation()[j + 1];
@@ -1060,10 +1290,13 @@ void CPUSparseMatrix<ElemType>::ScaleAndAdd(const ElemType alpha, const CPUSpars
     }
     else if (lhs.GetFormat() == MatrixFormat::matrixFormatSparseBlockCol || lhs.GetFormat() == MatrixFormat::matrixFormatSparseBlockRow)
     {
-        for (size_t j = 0; j < lhs.GetBlockSize(); j++)
+        // each block of lhs updates its own column or row of rhs
+        size_t len = (lhs.GetFormat() == MatrixFormat::matrixFormatSparseBlockCol) ? lhs.GetNumRows() : lhs.GetNumCols();
+        size_t numChunks = SparseParallelChunks(lhs.GetBlockSize() * len, lhs.GetBlockSize());
+#pragma omp parallel for if (numChunks > 1)
+        for (long j = 0; j < (long) lhs.GetBlockSize(); j++)
         {
             size_t i = lhs.GetBlockIds()[j] - lhs.GetBlockIdShift();
-            size_t len = (lhs.GetFormat() == MatrixFormat::matrixFormatSparseBlockCol) ? lhs.GetNumRows() : lhs.GetNumCols();
             size_t start = j * len;
             for (size_t p = start; p < start + len; p++)
             {
@@ -1081,6 +1314,86 @@ void CPUSparseMatrix<ElemType>::ScaleAndAdd(const ElemType alpha, const CPUSpars
     }
 }
 
+// Softmax and cross entropy against the CSC labels, column by column. The maximum and the sum of the exponentials
+// relative to it are found in a single pass over the column (online softmax), so that the prediction is read twice:
+// criterion(0, j) = sum_i labels(i, j) * (logsumexp(prediction(:, j)) - prediction(i, j)), softmaxMinusLabels = softmax(prediction) - labels
+template <class ElemType>
+/*static*/ void CPUSparseMatrix<ElemType>::CrossEntropyWithSoftmax(const CPUSparseMatrix<ElemType>& labels, const CPUMatrix<ElemType>& prediction, CPUMatrix<ElemType>& criterion, CPUMatrix<ElemType>& softmaxMinusLabels)
+{
+    if (labels.GetFormat() != MatrixFormat::matrixFormatSparseCSC)
+        NOT_IMPLEMENTED;
+    if (labels.GetNumRows() != prediction.GetNumRows() || labels.GetNumCols() != prediction.GetNumCols())
+        InvalidArgument("CPUSparseMatrix::CrossEntropyWithSoftmax: The dimensions of the labels and the prediction must match.");
+
+    const size_t numRows = prediction.GetNumRows();
+    const size_t numCols = prediction.GetNumCols();
+    criterion.RequireSize(1, numCols);
+    softmaxMinusLabels.RequireSize(numRows, numCols);
+    if (numRows == 0)
+    {
+        criterion.SetValue(0);
+        return;
+    }
+
+    size_t numChunks = SparseParallelChunks(numRows * numCols, numCols);
+#pragma omp parallel for if (numChunks > 1)
+    for (long j = 0; j < (long) numCols; j++)
+    {
+        const ElemType* x = prediction.Data() + j * numRows;
+        ElemType* y = softmaxMinusLabels.Data() + j * numRows;
+
+        ElemType colMax = x[0];
+        ElemType sum = 1;
+        for (size_t i = 1; i < numRows; i++)
+        {
+            if (x[i] > colMax)
+            {
+                sum = sum * exp(colMax - x[i]) + 1;
+                colMax = x[i];
+            }
+            else
+                sum += exp(x[i] - colMax);
+        }
+        const ElemType logZ = colMax + log(sum);
+
+        for (size_t i = 0; i < numRows; i++)
+            y[i] = exp(x[i] - logZ);
+
+        ElemType crossEntropy = 0;
+        for (size_t p = labels.SecondaryIndexLocation()[j]; p < labels.SecondaryIndexLocation()[j + 1]; p++)
+        {
+            size_t i = labels.MajorIndexLocation()[p];
+            ElemType label = labels.Buffer()[p];
+            crossEntropy += label * (logZ - x[i]);
+            y[i] -= label;
+        }
+        criterion(0, j) = crossEntropy;
+    }
+}
+
+// c += alpha * a, only on the columns that the block-column matrix c stores
+template <class ElemType>
+/*static*/ void CPUSparseMatrix<ElemType>::ScaleAndAddToBlockColumns(const ElemType alpha, const CPUMatrix<ElemType>& a, CPUSparseMatrix<ElemType>& c)
+{
+    if (c.GetFormat() != matrixFormatSparseBlockCol)
+        NOT_IMPLEMENTED;
+
+    if (a.GetNumRows() != c.GetNumRows() || a.GetNumCols() != c.GetNumCols())
+        InvalidArgument("CPUSparseMatrix::ScaleAndAddToBlockColumns: The dimensions of a and c must match.");
+
+    const size_t numRows = c.GetNumRows();
+    const size_t numBlocks = c.GetBlockSize();
+    const size_t numChunks = SparseParallelChunks(numBlocks * numRows, numBlocks);
+#pragma omp parallel for if (numChunks > 1)
+    for (long b = 0; b < (long) numBlocks; b++)
+    {
+        size_t j = c.GetBlockIds()[b] - c.GetBlockIdShift();
+        ElemType* block = c.Data() + b * numRows;
+        for (size_t i = 0; i < numRows; i++)
+            block[i] += alpha * a(i, j);
+    }
+}
+
 template <class ElemType>
 /*static*/ bool CPUSparseMatrix<ElemType>::AreEqual(const CPUSparseMatrix<ElemType>& a, const CPUSparseMatrix<ElemType>& b, const ElemType threshold)
 {
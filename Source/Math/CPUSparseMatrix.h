@@ -93,6 +93,8 @@ public:
 
     CPUSparseMatrix<ElemType>& DoGatherColumnsOf(ElemType beta, const CPUMatrix<ElemType>& idx, const CPUSparseMatrix<ElemType>& a, ElemType alpha);
     CPUSparseMatrix<ElemType>& DoScatterColumnsOf(ElemType beta, const CPUMatrix<ElemType>& idx, const CPUSparseMatrix<ElemType>& a, ElemType alpha);
+    // see Matrix<ElemType>::AssignScatteredColumnsOf()
+    CPUSparseMatrix<ElemType>& AssignScatteredColumnsOf(const CPUMatrix<ElemType>& idx, const CPUMatrix<ElemType>& a, ElemType alpha);
 
     size_t BufferSize() const
     {
@@ -117,6 +119,15 @@ public:
 
     void SetMatrixFromCSCFormat(const CPUSPARSE_INDEX_TYPE* h_CSCCol, const CPUSPARSE_INDEX_TYPE* h_Row, const ElemType* h_Val,
                                 const size_t nz, const size_t numRows, const size_t numCols);
+    // see Matrix<ElemType>::SetMatrixFromOneHotSequences()
+    void SetMatrixFromOneHotSequences(const CPUSPARSE_INDEX_TYPE* h_indices, const CPUSPARSE_INDEX_TYPE* h_sequenceOffsets,
+                                      const size_t numSequences, const size_t maxSequenceLength, const size_t numRows);
+
+    // The columns of a block-column matrix (e.g. the rows of an embedding that a minibatch touched) and their values,
+    // [numRows x columnIds.size()] in column-major order. AssignSumOfBlockColumns() is the inverse, which also merges
+    // columns with the same id by adding them up (e.g. to combine the block-column gradients of several workers).
+    void GetBlockColumns(std::vector<size_t>& columnIds, std::vector<ElemType>& values) const;
+    void AssignSumOfBlockColumns(const size_t numRows, const size_t numCols, const std::vector<size_t>& columnIds, const std::vector<ElemType>& values);
 
     // Dense * Sparse -> Dense
     static void MultiplyAndWeightedAdd(ElemType alpha, const CPUMatrix<ElemType>& lhs, const bool transposeA,
@@ -131,6 +142,9 @@ public:
                                const CPUSparseMatrix<ElemType>& rhs, const bool transposeB, CPUSparseMatrix<ElemType>& c);
 
     static void ScaleAndAdd(const ElemType alpha, const CPUSparseMatrix<ElemType>& lhs, CPUMatrix<ElemType>& c);
+    static void CrossEntropyWithSoftmax(const CPUSparseMatrix<ElemType>& labels, const CPUMatrix<ElemType>& prediction, CPUMatrix<ElemType>& criterion, CPUMatrix<ElemType>& softmaxMinusLabels);
+    // c += alpha * a on the columns that c stores, i.e. the lazy counterpart of a dense update for block-column c
+    static void ScaleAndAddToBlockColumns(const ElemType alpha, const CPUMatrix<ElemType>& a, CPUSparseMatrix<ElemType>& c);
 
     static bool AreEqual(const CPUSparseMatrix<ElemType>& a, const CPUSparseMatrix<ElemType>& b, const ElemType threshold = 1e-8);
 
@@ -0,0 +1,171 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorKernels.cpp -- the scalar and SSE2 kernels, and the pick of the instruction set at run time
+// (the AVX2 kernels are in CPUVectorKernelsAVX2.cpp, which is compiled for AVX2).
+//
+
+#include "stdafx.h"
+#include "CPUVectorKernels.h"
+#include "CPUVectorKernelsImpl.h"
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define CPU_VECTOR_KERNELS_X86
+#include <emmintrin.h>
+#include "BlockMultiplierPlatform.h"
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// defined in CPUVectorKernelsAVX2.cpp
+#ifdef CPU_VECTOR_KERNELS_X86
+const CPUVectorKernels& CPUVectorKernelsAVX2();
+#endif
+
+namespace {
+
+struct ScalarTraits
+{
+    typedef float Vector;
+    typedef bool Mask;
+    typedef double Accumulator;
+    static const size_t width = 1;
+
+    static inline Vector Load(const float* p) { return *p; }
+    static inline void Store(float* p, Vector x) { *p = x; }
+    static inline Vector Set1(float x) { return x; }
+    static inline Vector Add(Vector a, Vector b) { return a + b; }
+    static inline Vector Sub(Vector a, Vector b) { return a - b; }
+    static inline Vector Mul(Vector a, Vector b) { return a * b; }
+    static inline Vector Div(Vector a, Vector b) { return a / b; }
+    static inline Vector MulAdd(Vector a, Vector b, Vector c) { return a * b + c; }
+    static inline Vector Min(Vector a, Vector b) { return a < b ? a : b; } // b if either is NaN, like minps
+    static inline Vector Max(Vector a, Vector b) { return a > b ? a : b; }
+    static inline Vector Abs(Vector a) { return fabsf(a); }
+    static inline Vector CopySign(Vector magnitude, Vector sign) { return sign < 0 ? -fabsf(magnitude) : fabsf(magnitude); }
+    static inline Mask Less(Vector a, Vector b) { return a < b; }
+    static inline Mask GreaterEqual(Vector a, Vector b) { return a >= b; }
+    static inline Vector Select(Mask mask, Vector ifTrue, Vector ifFalse) { return mask ? ifTrue : ifFalse; }
+    static inline Mask TestBit(const unsigned int* p, unsigned int bit) { return (*p & bit) != 0; }
+    static inline void SetBit(unsigned int* p, Mask mask, unsigned int bit) { if (mask) *p |= bit; }
+    static inline Vector Round(Vector a) { return floorf(a + 0.5f); }
+    static inline Vector Pow2(Vector n)
+    {
+        uint32_t bits = (uint32_t) ((int32_t) n + 127) << 23;
+        float result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+    static inline float HorizontalMax(Vector a) { return a; }
+    static inline Accumulator ZeroAccumulator() { return 0; }
+    static inline void Accumulate(Accumulator& acc, Vector a) { acc += a; }
+    static inline double Total(Accumulator acc) { return acc; }
+    static inline Vector ToFloat(Accumulator acc) { return (float) acc; }
+};
+
+#ifdef CPU_VECTOR_KERNELS_X86
+struct SSE2Traits
+{
+    typedef __m128 Vector;
+    typedef __m128 Mask;
+    struct Accumulator
+    {
+        __m128d m_low, m_high;
+    };
+    static const size_t width = 4;
+
+    static inline Vector Load(const float* p) { return _mm_loadu_ps(p); }
+    static inline void Store(float* p, Vector x) { _mm_storeu_ps(p, x); }
+    static inline Vector Set1(float x) { return _mm_set1_ps(x); }
+    static inline Vector Add(Vector a, Vector b) { return _mm_add_ps(a, b); }
+    static inline Vector Sub(Vector a, Vector b) { return _mm_sub_ps(a, b); }
+    static inline Vector Mul(Vector a, Vector b) { return _mm_mul_ps(a, b); }
+    static inline Vector Div(Vector a, Vector b) { return _mm_div_ps(a, b); }
+    static inline Vector MulAdd(Vector a, Vector b, Vector c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static inline Vector Min(Vector a, Vector b) { return _mm_min_ps(a, b); }
+    static inline Vector Max(Vector a, Vector b) { return _mm_max_ps(a, b); }
+    static inline Vector Abs(Vector a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static inline Vector CopySign(Vector magnitude, Vector sign)
+    {
+        __m128 signBit = _mm_set1_ps(-0.0f);
+        return _mm_or_ps(_mm_andnot_ps(signBit, magnitude), _mm_and_ps(signBit, sign));
+    }
+    static inline Mask Less(Vector a, Vector b) { return _mm_cmplt_ps(a, b); }
+    static inline Mask GreaterEqual(Vector a, Vector b) { return _mm_cmpge_ps(a, b); }
+    static inline Vector Select(Mask mask, Vector ifTrue, Vector ifFalse) { return _mm_or_ps(_mm_and_ps(mask, ifTrue), _mm_andnot_ps(mask, ifFalse)); }
+    static inline Mask TestBit(const unsigned int* p, unsigned int bit)
+    {
+        __m128i b = _mm_set1_epi32((int) bit);
+        return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*) p), b), b));
+    }
+    static inline void SetBit(unsigned int* p, Mask mask, unsigned int bit)
+    {
+        __m128i w = _mm_loadu_si128((const __m128i*) p);
+        _mm_storeu_si128((__m128i*) p, _mm_or_si128(w, _mm_and_si128(_mm_castps_si128(mask), _mm_set1_epi32((int) bit))));
+    }
+    static inline Vector Round(Vector a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); } // round to nearest is the default mode
+    static inline Vector Pow2(Vector n) { return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127)), 23)); }
+    static inline float HorizontalMax(Vector a)
+    {
+        a = _mm_max_ps(a, _mm_movehl_ps(a, a));
+        a = _mm_max_ps(a, _mm_shuffle_ps(a, a, 1));
+        return _mm_cvtss_f32(a);
+    }
+    static inline Accumulator ZeroAccumulator() { return Accumulator{ _mm_setzero_pd(), _mm_setzero_pd() }; }
+    static inline void Accumulate(Accumulator& acc, Vector a)
+    {
+        acc.m_low = _mm_add_pd(acc.m_low, _mm_cvtps_pd(a));
+        acc.m_high = _mm_add_pd(acc.m_high, _mm_cvtps_pd(_mm_movehl_ps(a, a)));
+    }
+    static inline double Total(Accumulator acc)
+    {
+        __m128d sum = _mm_add_pd(acc.m_low, acc.m_high);
+        return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+    }
+    static inline Vector ToFloat(Accumulator acc) { return _mm_movelh_ps(_mm_cvtpd_ps(acc.m_low), _mm_cvtpd_ps(acc.m_high)); }
+};
+#endif
+
+}
+
+const CPUVectorKernels* CPUVectorKernels::Get(CPUVectorInstructionSet instructionSet)
+{
+    static const CPUVectorKernelsT<ScalarTraits, CPUVectorInstructionSet::scalar> scalarKernels("scalar");
+#ifdef CPU_VECTOR_KERNELS_X86
+    static const CPUVectorKernelsT<SSE2Traits, CPUVectorInstructionSet::sse2> sse2Kernels("SSE2");
+#endif
+
+    switch (instructionSet)
+    {
+    case CPUVectorInstructionSet::scalar:
+        return &scalarKernels;
+#ifdef CPU_VECTOR_KERNELS_X86
+    case CPUVectorInstructionSet::sse2:
+        return &sse2Kernels; // part of x64, and of every x86 that runs this
+    case CPUVectorInstructionSet::avx2:
+        return CpuSupportsAVX2() && CpuSupportsFMA() ? &CPUVectorKernelsAVX2() : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+const CPUVectorKernels& CPUVectorKernels::Best()
+{
+    static const CPUVectorKernels* best = []
+    {
+        for (auto instructionSet : { CPUVectorInstructionSet::avx2, CPUVectorInstructionSet::sse2 })
+        {
+            if (auto kernels = Get(instructionSet))
+                return kernels;
+        }
+        return Get(CPUVectorInstructionSet::scalar);
+    }();
+    return *best;
+}
+
+}}}
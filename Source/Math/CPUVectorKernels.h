@@ -0,0 +1,102 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorKernels.h -- elementwise and reduction kernels over contiguous float vectors, compiled for several
+// instruction sets, of which the best one the processor has is picked at run time.
+//
+
+#pragma once
+
+#include <stddef.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#ifdef _WIN32
+#ifdef MATH_EXPORTS
+#define MATH_API __declspec(dllexport)
+#else
+#define MATH_API __declspec(dllimport)
+#endif
+#else // no DLLs on Linux
+#define MATH_API
+#endif
+
+enum class CPUVectorInstructionSet
+{
+    scalar,
+    sse2,
+    avx2, // with FMA
+};
+
+// The kernels of one instruction set, used by CPUMatrix and MatrixQuantizerCPU for float. Exp(), Sigmoid() and Tanh() are polynomial
+// approximations that stay within 2 ulp of the exact results; the sums are accumulated in double.
+// All instruction sets compute the same approximations, so results differ between them by rounding only.
+class MATH_API CPUVectorKernels
+{
+public:
+    virtual ~CPUVectorKernels()
+    {
+    }
+
+    virtual CPUVectorInstructionSet InstructionSet() const = 0;
+    virtual const char* Name() const = 0;
+
+    // c[i] = f(a[i]); a and c may be the same
+    virtual void Exp(const float* a, float* c, size_t n) const = 0;
+    virtual void Sigmoid(const float* a, float* c, size_t n) const = 0;
+    virtual void Tanh(const float* a, float* c, size_t n) const = 0;
+
+    // sum of a[0..n)
+    virtual double Sum(const float* a, size_t n) const = 0;
+
+    // c[i] = beta * c[i] + alpha * sum_j a[i + j * lda], for the row sums of a column-major matrix; c is not read if beta is 0
+    virtual void RowSums(const float* a, size_t rows, size_t cols, size_t lda, float beta, float* c, float alpha) const = 0;
+
+    // max of a[0..n), n > 0
+    virtual float Max(const float* a, size_t n) const = 0;
+
+    // c[i] = a[i] - b, returns the sum of exp(c[i]); the inner loop of the log softmax
+    virtual double SubtractAndSumExp(const float* a, float b, float* c, size_t n) const = 0;
+
+    // c[i] += b
+    virtual void AddScalar(float b, float* c, size_t n) const = 0;
+
+    // adds the sum of a[0..n) to sum and that of the squares to sumOfSquares; the statistics of batch normalization
+    virtual void SumAndSumOfSquares(const float* a, size_t n, double& sum, double& sumOfSquares) const = 0;
+
+    // adds the sum of a[0..n) to sum and that of a[i] * b[i] to dot; the statistics of its gradient
+    virtual void SumAndDot(const float* a, const float* b, size_t n, double& sum, double& dot) const = 0;
+
+    // c[i] = a[i] * scale + shift; a and c may be the same
+    virtual void ScaleAndShift(const float* a, float scale, float shift, float* c, size_t n) const = 0;
+
+    // c[i] += alpha * a[i] + beta * b[i] + gamma
+    virtual void AddLinearCombination(float alpha, const float* a, float beta, const float* b, float gamma, float* c, size_t n) const = 0;
+
+    // c[i] = max(c[i], a[i]) and c[i] += a[i], over the rows of a pooling window
+    virtual void MaxInto(const float* a, float* c, size_t n) const = 0;
+    virtual void AddInto(const float* a, float* c, size_t n) const = 0;
+
+    // the 1-bit quantizer, over rows that share one bit position of their quantized words (see MatrixQuantizerCPU):
+    // v = a[i] + residual[i], outResidual[i] = v - (v >= threshold ? val1 : val0), and bit is set in bits[i] if v >= threshold;
+    // residual and outResidual may be the same
+    virtual void Quantize1Bit(const float* a, const float* residual, float threshold, float val0, float val1, float* outResidual, unsigned int* bits, unsigned int bit, size_t n) const = 0;
+
+    // c[i] = (add ? c[i] : 0) + (bits[i] & bit ? val1 : val0)
+    virtual void Unquantize1Bit(const unsigned int* bits, unsigned int bit, float val0, float val1, float* c, size_t n, bool add) const = 0;
+
+    // c = alpha * op(a) * op(b) + beta * c for column-major matrices, op(a) m x k and op(b) k x n, on the calling thread;
+    // for the small products of e.g. a recurrent step of one sample, which take less time than the dispatch of the BLAS
+    // library. Blocks of c are kept in registers over all of k; c is not read if beta is 0
+    virtual void SmallGemm(bool transposeA, bool transposeB, size_t m, size_t n, size_t k, float alpha, const float* a, size_t lda,
+                           const float* b, size_t ldb, float beta, float* c, size_t ldc) const = 0;
+
+    // The kernels of the best instruction set of this processor, picked at the first call.
+    static const CPUVectorKernels& Best();
+
+    // The kernels of the given instruction set, nullptr if they are not built in or the processor does not have it.
+    static const CPUVectorKernels* Get(CPUVectorInstructionSet instructionSet);
+};
+
+}}}
@@ -0,0 +1,91 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorKernelsAVX2.cpp -- the AVX2 kernels. This file is compiled with AVX2 and FMA enabled (-mavx2 -mfma,
+// /arch:AVX2), and only called after CPUVectorKernels::Get() checked the processor, so it must not include
+// anything that has inline functions (no stdafx.h, no standard library), see CPUVectorKernelsImpl.h.
+//
+
+#include "CPUVectorKernelsImpl.h"
+#include <immintrin.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+namespace {
+
+struct AVX2Traits
+{
+    typedef __m256 Vector;
+    typedef __m256 Mask;
+    struct Accumulator
+    {
+        __m256d m_low, m_high;
+    };
+    static const size_t width = 8;
+
+    static inline Vector Load(const float* p) { return _mm256_loadu_ps(p); }
+    static inline void Store(float* p, Vector x) { _mm256_storeu_ps(p, x); }
+    static inline Vector Set1(float x) { return _mm256_set1_ps(x); }
+    static inline Vector Add(Vector a, Vector b) { return _mm256_add_ps(a, b); }
+    static inline Vector Sub(Vector a, Vector b) { return _mm256_sub_ps(a, b); }
+    static inline Vector Mul(Vector a, Vector b) { return _mm256_mul_ps(a, b); }
+    static inline Vector Div(Vector a, Vector b) { return _mm256_div_ps(a, b); }
+    static inline Vector MulAdd(Vector a, Vector b, Vector c) { return _mm256_fmadd_ps(a, b, c); }
+    static inline Vector Min(Vector a, Vector b) { return _mm256_min_ps(a, b); }
+    static inline Vector Max(Vector a, Vector b) { return _mm256_max_ps(a, b); }
+    static inline Vector Abs(Vector a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static inline Vector CopySign(Vector magnitude, Vector sign)
+    {
+        __m256 signBit = _mm256_set1_ps(-0.0f);
+        return _mm256_or_ps(_mm256_andnot_ps(signBit, magnitude), _mm256_and_ps(signBit, sign));
+    }
+    static inline Mask Less(Vector a, Vector b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static inline Mask GreaterEqual(Vector a, Vector b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static inline Vector Select(Mask mask, Vector ifTrue, Vector ifFalse) { return _mm256_blendv_ps(ifFalse, ifTrue, mask); }
+    static inline Mask TestBit(const unsigned int* p, unsigned int bit)
+    {
+        __m256i b = _mm256_set1_epi32((int) bit);
+        return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_loadu_si256((const __m256i*) p), b), b));
+    }
+    static inline void SetBit(unsigned int* p, Mask mask, unsigned int bit)
+    {
+        __m256i w = _mm256_loadu_si256((const __m256i*) p);
+        _mm256_storeu_si256((__m256i*) p, _mm256_or_si256(w, _mm256_and_si256(_mm256_castps_si256(mask), _mm256_set1_epi32((int) bit))));
+    }
+    static inline Vector Round(Vector a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static inline Vector Pow2(Vector n) { return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23)); }
+    static inline float HorizontalMax(Vector a)
+    {
+        __m128 m = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_max_ps(m, _mm_shuffle_ps(m, m, 1));
+        return _mm_cvtss_f32(m);
+    }
+    static inline Accumulator ZeroAccumulator() { return Accumulator{ _mm256_setzero_pd(), _mm256_setzero_pd() }; }
+    static inline void Accumulate(Accumulator& acc, Vector a)
+    {
+        acc.m_low = _mm256_add_pd(acc.m_low, _mm256_cvtps_pd(_mm256_castps256_ps128(a)));
+        acc.m_high = _mm256_add_pd(acc.m_high, _mm256_cvtps_pd(_mm256_extractf128_ps(a, 1)));
+    }
+    static inline double Total(Accumulator acc)
+    {
+        __m256d sum = _mm256_add_pd(acc.m_low, acc.m_high);
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    }
+    static inline Vector ToFloat(Accumulator acc)
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(acc.m_low)), _mm256_cvtpd_ps(acc.m_high), 1);
+    }
+};
+
+}
+
+const CPUVectorKernels& CPUVectorKernelsAVX2()
+{
+    static const CPUVectorKernelsT<AVX2Traits, CPUVectorInstructionSet::avx2> kernels("AVX2");
+    return kernels;
+}
+
+}}}
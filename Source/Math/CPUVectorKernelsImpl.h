@@ -0,0 +1,461 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorKernelsImpl.h -- the algorithms of the CPUVectorKernels, written once against a small set of vector
+// primitives (the 'traits'), and included by each translation unit that is compiled for one instruction set.
+//
+// Everything here is in an anonymous namespace: a translation unit that is compiled with e.g. -mavx2 must not
+// emit inline functions that the linker could pick for the other instruction sets. For the same reason the
+// translation units for the wider instruction sets include nothing but this and the intrinsics headers.
+//
+
+#pragma once
+
+#include "CPUVectorKernels.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+namespace {
+
+// The traits T provide, for a vector of T::width floats:
+//   Vector, Mask, Accumulator (T::width doubles)
+//   Load, Store (unaligned), Set1, Add, Sub, Mul, Div, MulAdd (a * b + c), Min, Max, Abs, CopySign (magnitude, sign),
+//   Less, GreaterEqual -> Mask, Select (mask, ifTrue, ifFalse), Round (to nearest integer),
+//   TestBit (mask of the words p[0..width) that have the bit), SetBit (sets the bit in the words of p where mask is true),
+//   Pow2 (2^n for integer n in [-126, 127]), HorizontalMax,
+//   ZeroAccumulator, Accumulate (acc, vector), Total (sum of the lanes), ToFloat (lanes of the accumulator)
+template <class T>
+struct VectorMath
+{
+    typedef typename T::Vector Vector;
+    typedef typename T::Mask Mask;
+
+    // exp(x) = 2^n exp(r) with r = x - n log(2) in [-log(2)/2, log(2)/2] (Cody-Waite reduction), exp(r) from
+    // the minimax polynomial of Cephes' expf(). 2^n is applied in two steps, so that the results near the limits
+    // of the range (overflow to inf, denormals) come out right, NaNs go through.
+    static inline Vector Exp(Vector x)
+    {
+        x = T::Max(T::Set1(-104.0f), T::Min(T::Set1(89.0f), x)); // keeps NaN: Min/Max return the second operand for NaN
+        Vector n = T::Round(T::Mul(x, T::Set1(1.44269504088896341f)));
+        Vector r = T::MulAdd(n, T::Set1(-0.693359375f), x);
+        r = T::MulAdd(n, T::Set1(2.12194440e-4f), r);
+
+        Vector p = T::Set1(1.9875691500e-4f);
+        p = T::MulAdd(p, r, T::Set1(1.3981999507e-3f));
+        p = T::MulAdd(p, r, T::Set1(8.3334519073e-3f));
+        p = T::MulAdd(p, r, T::Set1(4.1665795894e-2f));
+        p = T::MulAdd(p, r, T::Set1(1.6666665459e-1f));
+        p = T::MulAdd(p, r, T::Set1(5.0000001201e-1f));
+        Vector y = T::Add(T::MulAdd(p, T::Mul(r, r), r), T::Set1(1.0f));
+
+        Vector n1 = T::Round(T::Mul(n, T::Set1(0.5f)));
+        Vector n2 = T::Sub(n, n1);
+        return T::Mul(T::Mul(y, T::Pow2(n1)), T::Pow2(n2));
+    }
+
+    // 1 / (1 + exp(-x)) for x >= 0 and exp(x) / (1 + exp(x)) otherwise, as in CPUMatrix::AssignSigmoidOf().
+    static inline Vector Sigmoid(Vector x)
+    {
+        Vector e = Exp(T::Sub(T::Set1(0.0f), T::Abs(x)));
+        Vector numerator = T::Select(T::GreaterEqual(x, T::Set1(0.0f)), T::Set1(1.0f), e);
+        return T::Div(numerator, T::Add(T::Set1(1.0f), e));
+    }
+
+    // Below 0.625 the odd polynomial of Cephes' tanhf(), above 1 - 2 / (exp(2|x|) + 1).
+    static inline Vector Tanh(Vector x)
+    {
+        Vector a = T::Abs(x);
+
+        Vector z = T::Mul(a, a);
+        Vector p = T::Set1(-5.70498872745e-3f);
+        p = T::MulAdd(p, z, T::Set1(2.06390887954e-2f));
+        p = T::MulAdd(p, z, T::Set1(-5.37397155531e-2f));
+        p = T::MulAdd(p, z, T::Set1(1.33314422036e-1f));
+        p = T::MulAdd(p, z, T::Set1(-3.33332819422e-1f));
+        Vector small = T::MulAdd(T::Mul(p, z), a, a);
+
+        Vector e = Exp(T::Add(a, a)); // inf for large a, which gives 1
+        Vector large = T::Sub(T::Set1(1.0f), T::Div(T::Set1(2.0f), T::Add(e, T::Set1(1.0f))));
+
+        return T::CopySign(T::Select(T::Less(a, T::Set1(0.625f)), small, large), x);
+    }
+};
+
+// c[i] = f(a[i]), the tail through a padded vector, so that it gets the same results as the rest
+template <class T, class Function>
+static inline void MapVector(const float* a, float* c, size_t n, Function f)
+{
+    size_t i = 0;
+    for (; i + T::width <= n; i += T::width)
+        T::Store(c + i, f(T::Load(a + i)));
+    if (i < n)
+    {
+        float buffer[T::width] = {};
+        for (size_t k = 0; k < n - i; k++)
+            buffer[k] = a[i + k];
+        T::Store(buffer, f(T::Load(buffer)));
+        for (size_t k = 0; k < n - i; k++)
+            c[i + k] = buffer[k];
+    }
+}
+
+template <class T, CPUVectorInstructionSet instructionSet>
+class CPUVectorKernelsT : public CPUVectorKernels
+{
+    typedef typename T::Vector Vector;
+    typedef typename T::Mask Mask;
+    typedef typename T::Accumulator Accumulator;
+    typedef VectorMath<T> M;
+
+public:
+    CPUVectorKernelsT(const char* name)
+        : m_name(name)
+    {
+    }
+
+    virtual CPUVectorInstructionSet InstructionSet() const override
+    {
+        return instructionSet;
+    }
+
+    virtual const char* Name() const override
+    {
+        return m_name;
+    }
+
+    virtual void Exp(const float* a, float* c, size_t n) const override
+    {
+        MapVector<T>(a, c, n, [](Vector x) { return M::Exp(x); });
+    }
+
+    virtual void Sigmoid(const float* a, float* c, size_t n) const override
+    {
+        MapVector<T>(a, c, n, [](Vector x) { return M::Sigmoid(x); });
+    }
+
+    virtual void Tanh(const float* a, float* c, size_t n) const override
+    {
+        MapVector<T>(a, c, n, [](Vector x) { return M::Tanh(x); });
+    }
+
+    virtual double Sum(const float* a, size_t n) const override
+    {
+        // two accumulators to hide the latency of the additions
+        Accumulator acc0 = T::ZeroAccumulator(), acc1 = T::ZeroAccumulator();
+        size_t i = 0;
+        for (; i + 2 * T::width <= n; i += 2 * T::width)
+        {
+            T::Accumulate(acc0, T::Load(a + i));
+            T::Accumulate(acc1, T::Load(a + i + T::width));
+        }
+        for (; i + T::width <= n; i += T::width)
+            T::Accumulate(acc0, T::Load(a + i));
+        double sum = T::Total(acc0) + T::Total(acc1);
+        for (; i < n; i++)
+            sum += a[i];
+        return sum;
+    }
+
+    virtual void RowSums(const float* a, size_t rows, size_t cols, size_t lda, float beta, float* c, float alpha) const override
+    {
+        size_t i = 0;
+        for (; i + T::width <= rows; i += T::width)
+        {
+            Accumulator acc = T::ZeroAccumulator();
+            for (size_t j = 0; j < cols; j++)
+                T::Accumulate(acc, T::Load(a + i + j * lda));
+            Vector sum = T::Mul(T::ToFloat(acc), T::Set1(alpha));
+            if (beta != 0)
+                sum = T::MulAdd(T::Load(c + i), T::Set1(beta), sum);
+            T::Store(c + i, sum);
+        }
+        for (; i < rows; i++)
+        {
+            double acc = 0;
+            for (size_t j = 0; j < cols; j++)
+                acc += a[i + j * lda];
+            float sum = (float) acc * alpha;
+            if (beta != 0)
+                sum += beta * c[i];
+            c[i] = sum;
+        }
+    }
+
+    virtual float Max(const float* a, size_t n) const override
+    {
+        Vector max = T::Set1(a[0]);
+        size_t i = 0;
+        for (; i + T::width <= n; i += T::width)
+            max = T::Max(max, T::Load(a + i));
+        float result = T::HorizontalMax(max);
+        for (; i < n; i++)
+            result = result < a[i] ? a[i] : result;
+        return result;
+    }
+
+    virtual double SubtractAndSumExp(const float* a, float b, float* c, size_t n) const override
+    {
+        Accumulator acc = T::ZeroAccumulator();
+        Vector vb = T::Set1(b);
+        size_t i = 0;
+        for (; i + T::width <= n; i += T::width)
+        {
+            Vector x = T::Sub(T::Load(a + i), vb);
+            T::Store(c + i, x);
+            T::Accumulate(acc, M::Exp(x));
+        }
+        double sum = T::Total(acc);
+        if (i < n)
+        {
+            float buffer[T::width] = {};
+            for (size_t k = 0; k < n - i; k++)
+                buffer[k] = c[i + k] = a[i + k] - b;
+            T::Store(buffer, M::Exp(T::Load(buffer)));
+            for (size_t k = 0; k < n - i; k++)
+                sum += buffer[k];
+        }
+        return sum;
+    }
+
+    virtual void AddScalar(float b, float* c, size_t n) const override
+    {
+        Vector vb = T::Set1(b);
+        size_t i = 0;
+        for (; i + T::width <= n; i += T::width)
+            T::Store(c + i, T::Add(T::Load(c + i), vb));
+        for (; i < n; i++)
+            c[i] += b;
+    }
+
+    virtual void SumAndSumOfSquares(const float* a, size_t n, double& sum, double& sumOfSquares) const override
+    {
+        Accumulator acc = T::ZeroAccumulator(), accSquares = T::ZeroAccumulator();
+        size_t i = 0;
+        for (; i + T::width <= n; i += T::width)
+        {
+            Vector x = T::Load(a + i);
+            T::Accumulate(acc, x);
+            T::Accumulate(accSquares, T::Mul(x, x));
+        }
+        sum += T::Total(acc);
+        sumOfSquares += T::Total(accSquares);
+        for (; i < n; i++)
+        {
+            sum += a[i];
+            sumOfSquares += (double) a[i] * a[i];
+        }
+    }
+
+    virtual void SumAndDot(const float* a, const float* b, size_t n, double& sum, double& dot) const override
+    {
+        Accumulator acc = T::ZeroAccumulator(), accDot = T::ZeroAccumulator();
+        size_t i = 0;
+        for (; i + T::width <= n; i += T::width)
+        {
+            Vector x = T::Load(a + i);
+            T::Accumulate(acc, x);
+            T::Accumulate(accDot, T::Mul(x, T::Load(b + i)));
+        }
+        sum += T::Total(acc);
+        dot += T::Total(accDot);
+        for (; i < n; i++)
+        {
+            sum += a[i];
+            dot += (double) a[i] * b[i];
+        }
+    }
+
+    virtual void ScaleAndShift(const float* a, float scale, float shift, float* c, size_t n) const override
+    {
+        Vector vScale = T::Set1(scale), vShift = T::Set1(shift);
+        size_t i = 0;
+        for (; i + T::width <= n; i += T::width)
+            T::Store(c + i, T::MulAdd(T::Load(a + i), vScale, vShift));
+        for (; i < n; i++)
+            c[i] = a[i] * scale + shift;
+    }
+
+    virtual void AddLinearCombination(float alpha, const float* a, float beta, const float* b, float gamma, float* c, size_t n) const override
+    {
+        Vector vAlpha = T::Set1(alpha), vBeta = T::Set1(beta), vGamma = T::Set1(gamma);
+        size_t i = 0;
+        for (; i + T::width <= n; i += T::width)
+            T::Store(c + i, T::Add(T::Load(c + i), T::MulAdd(T::Load(a + i), vAlpha, T::MulAdd(T::Load(b + i), vBeta, vGamma))));
+        for (; i < n; i++)
+            c[i] += alpha * a[i] + (beta * b[i] + gamma);
+    }
+
+    virtual void MaxInto(const float* a, float* c, size_t n) const override
+    {
+        size_t i = 0;
+        for (; i + T::width <= n; i += T::width)
+            T::Store(c + i, T::Max(T::Load(c + i), T::Load(a + i)));
+        for (; i < n; i++)
+            c[i] = c[i] > a[i] ? c[i] : a[i];
+    }
+
+    virtual void AddInto(const float* a, float* c, size_t n) const override
+    {
+        size_t i = 0;
+        for (; i + T::width <= n; i += T::width)
+            T::Store(c + i, T::Add(T::Load(c + i), T::Load(a + i)));
+        for (; i < n; i++)
+            c[i] += a[i];
+    }
+
+    virtual void Quantize1Bit(const float* a, const float* residual, float threshold, float val0, float val1, float* outResidual, unsigned int* bits, unsigned int bit, size_t n) const override
+    {
+        Vector t = T::Set1(threshold), v0 = T::Set1(val0), v1 = T::Set1(val1);
+        size_t i = 0;
+        for (; i + T::width <= n; i += T::width)
+        {
+            Vector v = T::Add(T::Load(a + i), T::Load(residual + i));
+            Mask q = T::GreaterEqual(v, t);
+            T::Store(outResidual + i, T::Sub(v, T::Select(q, v1, v0)));
+            T::SetBit(bits + i, q, bit);
+        }
+        for (; i < n; i++)
+        {
+            float v = a[i] + residual[i];
+            bool q = v >= threshold;
+            outResidual[i] = v - (q ? val1 : val0);
+            if (q)
+                bits[i] |= bit;
+        }
+    }
+
+    virtual void Unquantize1Bit(const unsigned int* bits, unsigned int bit, float val0, float val1, float* c, size_t n, bool add) const override
+    {
+        Vector v0 = T::Set1(val0), v1 = T::Set1(val1);
+        size_t i = 0;
+        if (add)
+        {
+            for (; i + T::width <= n; i += T::width)
+                T::Store(c + i, T::Add(T::Load(c + i), T::Select(T::TestBit(bits + i, bit), v1, v0)));
+            for (; i < n; i++)
+                c[i] += (bits[i] & bit) ? val1 : val0;
+        }
+        else
+        {
+            for (; i + T::width <= n; i += T::width)
+                T::Store(c + i, T::Select(T::TestBit(bits + i, bit), v1, v0));
+            for (; i < n; i++)
+                c[i] = (bits[i] & bit) ? val1 : val0;
+        }
+    }
+
+    virtual void SmallGemm(bool transposeA, bool transposeB, size_t m, size_t n, size_t k, float alpha, const float* a, size_t lda,
+                           const float* b, size_t ldb, float beta, float* c, size_t ldc) const override
+    {
+        // op(b)[p, j] = b[p * bRowStride + j * bColStride]
+        const size_t bRowStride = transposeB ? ldb : 1;
+        const size_t bColStride = transposeB ? 1 : ldb;
+        if (!transposeA)
+        {
+            // the columns of a are contiguous: blocks of up to 4 vectors of rows times 4 columns of c
+            for (size_t j = 0; j < n; j += 4)
+            {
+                const size_t cols = n - j < 4 ? n - j : 4;
+                const float* bj = b + j * bColStride;
+                size_t i = 0;
+                for (; i + 4 * T::width <= m; i += 4 * T::width)
+                    GemmBlock<4>(cols, k, alpha, a + i, lda, bj, bRowStride, bColStride, beta, c + i + j * ldc, ldc);
+                for (; i + T::width <= m; i += T::width)
+                    GemmBlock<1>(cols, k, alpha, a + i, lda, bj, bRowStride, bColStride, beta, c + i + j * ldc, ldc);
+                for (; i < m; i++)
+                {
+                    for (size_t jj = 0; jj < cols; jj++)
+                    {
+                        float sum = 0;
+                        for (size_t p = 0; p < k; p++)
+                            sum += a[i + p * lda] * bj[p * bRowStride + jj * bColStride];
+                        StoreGemmResult(alpha * sum, beta, c + i + (j + jj) * ldc);
+                    }
+                }
+            }
+        }
+        else
+        {
+            // the rows of op(a) are contiguous: dot products, vectorized if the columns of op(b) are contiguous as well
+            for (size_t j = 0; j < n; j++)
+            {
+                const float* bj = b + j * bColStride;
+                for (size_t i = 0; i < m; i++)
+                {
+                    const float* ai = a + i * lda;
+                    double sum = 0;
+                    size_t p = 0;
+                    if (bRowStride == 1)
+                    {
+                        Accumulator acc = T::ZeroAccumulator();
+                        for (; p + T::width <= k; p += T::width)
+                            T::Accumulate(acc, T::Mul(T::Load(ai + p), T::Load(bj + p)));
+                        sum = T::Total(acc);
+                    }
+                    for (; p < k; p++)
+                        sum += ai[p] * bj[p * bRowStride];
+                    StoreGemmResult(alpha * (float) sum, beta, c + i + j * ldc);
+                }
+            }
+        }
+    }
+
+private:
+    static inline void StoreGemmResult(float result, float beta, float* c)
+    {
+        *c = beta == 0 ? result : result + beta * *c;
+    }
+
+    template <size_t R>
+    static inline void GemmBlock(size_t cols, size_t k, float alpha, const float* a, size_t lda, const float* b, size_t bRowStride, size_t bColStride,
+                                 float beta, float* c, size_t ldc)
+    {
+        switch (cols)
+        {
+        case 1: GemmBlock<R, 1>(k, alpha, a, lda, b, bRowStride, bColStride, beta, c, ldc); break;
+        case 2: GemmBlock<R, 2>(k, alpha, a, lda, b, bRowStride, bColStride, beta, c, ldc); break;
+        case 3: GemmBlock<R, 3>(k, alpha, a, lda, b, bRowStride, bColStride, beta, c, ldc); break;
+        default: GemmBlock<R, 4>(k, alpha, a, lda, b, bRowStride, bColStride, beta, c, ldc); break;
+        }
+    }
+
+    // c[0 .. R * width, 0 .. C) of the product, with all R x C vectors of it in registers while going over k
+    template <size_t R, size_t C>
+    static inline void GemmBlock(size_t k, float alpha, const float* a, size_t lda, const float* b, size_t bRowStride, size_t bColStride,
+                                 float beta, float* c, size_t ldc)
+    {
+        Vector acc[R][C];
+        for (size_t r = 0; r < R; r++)
+            for (size_t jj = 0; jj < C; jj++)
+                acc[r][jj] = T::Set1(0.0f);
+        for (size_t p = 0; p < k; p++)
+        {
+            Vector x[R];
+            for (size_t r = 0; r < R; r++)
+                x[r] = T::Load(a + p * lda + r * T::width);
+            for (size_t jj = 0; jj < C; jj++)
+            {
+                Vector y = T::Set1(b[p * bRowStride + jj * bColStride]);
+                for (size_t r = 0; r < R; r++)
+                    acc[r][jj] = T::MulAdd(x[r], y, acc[r][jj]);
+            }
+        }
+        Vector vAlpha = T::Set1(alpha), vBeta = T::Set1(beta);
+        for (size_t jj = 0; jj < C; jj++)
+        {
+            for (size_t r = 0; r < R; r++)
+            {
+                float* cr = c + jj * ldc + r * T::width;
+                Vector result = T::Mul(acc[r][jj], vAlpha);
+                T::Store(cr, beta == 0 ? result : T::MulAdd(T::Load(cr), vBeta, result));
+            }
+        }
+    }
+
+    const char* m_name;
+};
+
+}
+
+}}}
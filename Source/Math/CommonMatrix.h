@@ -17,6 +17,8 @@
 #include <string>
 #include <stdint.h>
 #include <memory>
+#include <atomic>
+#include <algorithm>
 
 #pragma warning( disable: 4251 )
 typedef unsigned char byte;
@@ -43,15 +45,47 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 MATH_API void SetMathLibTraceLevel(int traceLevel);
 int GetMathLibTraceLevel();
 
+// The number of times that operations moved or copied a matrix to another device (CPU <-> GPU, GPU <-> GPU) because
+// its operands were on different devices, or read an element of a GPU matrix on the CPU, of all element types so far.
+// Explicit transfers (TransferFromDeviceToDevice() and the like) are not counted. Such implicit transfers synchronize
+// with the GPU, and most of them are unintended.
+MATH_API size_t GetNumImplicitMatrixTransfers();
+
+// The cuDNN auto-tuner keeps the algorithms it picks in a process-wide cache. If 'path' is not empty, the cache is also
+// loaded from and appended to that file, so that later runs skip the auto-tuning. 'maxWorkspaceBytes' (0 for no limit)
+// limits the workspace memory of any picked algorithm.
+MATH_API void SetCuDnnAlgorithmCacheOptions(const std::wstring& path, size_t maxWorkspaceBytes);
+
 class MATH_API TracingGPUMemoryAllocator
 {
 private:
     static int m_traceLevel;
+    static bool m_cachingEnabled;
+    static size_t m_cacheLimitInBytes;
+    static std::atomic<size_t> m_numDeviceMallocs;
 
 public:
     static void SetTraceLevel(int traceLevel);
     static bool IsTraceEnabled();
 
+    // When caching is enabled, freed device buffers are not returned to the driver but kept in a
+    // size-bucketed per-device cache, from which later requests of similar size are served.
+    // This keeps the synchronizing cudaMalloc()/cudaFree() calls out of the steady-state training loop.
+    static void SetCachingEnabled(bool enabled);
+    static bool IsCachingEnabled();
+
+    // upper bound on the bytes held in free cached blocks per device (0 = no limit)
+    static void SetCacheLimitInMBs(size_t limitInMBs);
+    static size_t GetCacheLimitInBytes();
+
+    // return all free cached blocks of a device to the driver
+    static void ReleaseCachedMemory(int deviceId);
+    static void PrintCacheStatistics();
+
+    // The number of buffers requested from the driver (cudaMalloc()), i.e. not served from the cache, of all devices.
+    static void CountDeviceMalloc() { m_numDeviceMallocs++; }
+    static size_t GetNumDeviceMallocs() { return m_numDeviceMallocs; }
+
     template <typename AllocatedElemType>
     static AllocatedElemType* Allocate(int deviceId, size_t numRows, size_t numCols);
 
@@ -68,6 +102,55 @@ private:
     static std::pair<size_t, size_t> GetFreeAndTotalMemoryInMBs(int deviceId);
 };
 
+// How dense matrices size their buffers in Resize(). The buffer (its capacity) is kept as long as the new size fits,
+// and a buffer that is too small grows to at least growthFactor times its capacity, so that matrices whose column
+// count varies from minibatch to minibatch stop reallocating after a few minibatches. With 'growOnly' (the default of
+// Resize()), the buffer is shrunk to the new size only when that is below shrinkThreshold times the capacity; without
+// it, and in ShrinkToFit(), the buffer fits the size exactly. A growth factor of 1 and a threshold of 0 reallocate
+// whenever a matrix grows and never shrink it, as Resize() did before.
+class MATH_API MatrixResizePolicy
+{
+private:
+    static double m_growthFactor;
+    static double m_shrinkThreshold;
+    static std::atomic<size_t> m_numReallocations;
+    static std::atomic<size_t> m_numAllocations;
+
+public:
+    static void SetGrowthFactor(double growthFactor);       // >= 1
+    static void SetShrinkThreshold(double shrinkThreshold); // in [0, 1)
+    static double GetGrowthFactor() { return m_growthFactor; }
+    static double GetShrinkThreshold() { return m_shrinkThreshold; }
+
+    // The capacity of the buffer for 'numElements' elements, which is 'capacity' if the buffer is to be kept.
+    static size_t GetCapacity(size_t numElements, size_t capacity, bool growOnly)
+    {
+        if (!growOnly || capacity == 0)
+            return numElements;
+        if (numElements > capacity)
+            return std::max(numElements, (size_t) (capacity * m_growthFactor));
+        if (numElements < capacity * m_shrinkThreshold)
+            return numElements;
+        return capacity;
+    }
+
+    // The number of buffers that Resize() and ShrinkToFit() replaced by one of another size, of all devices.
+    static void CountReallocation() { m_numReallocations++; }
+    static size_t GetNumReallocations() { return m_numReallocations; }
+    // The number of buffers that Resize() and ShrinkToFit() allocated, including the first one of a matrix.
+    static void CountAllocation() { m_numAllocations++; }
+    static size_t GetNumAllocations() { return m_numAllocations; }
+};
+
+template <class ElemType>
+struct MultiTensorUpdateParams; // (see MultiTensorUpdate.h)
+
+struct DepthwiseConvolutionShape; // (see ConvolveGeometry.h)
+
+struct ImageAugmentationParams; // (see ImageAugmentation.h)
+
+enum class ValueCompression : int; // (see ValueCompression.h)
+
 // -----------------------------------------------------------------------
 // ElementWiseOperator -- This enum represents which function to apply.
 // This is shared between all matrix types and tensors.
@@ -93,6 +176,7 @@ enum ElementWiseOperator
     opElementwiseProductWithCosDerivative, opElementwiseProductWithSinDerivative,
     opElementwiseProductWithAbsDerivative, opElementwiseProductWithSqrtDerivative,
     opElementwiseProductWithReciprocalDerivative, opSqrOfDifference,
+    opElementwiseProductWithSigmoid, opElementwiseProductWithTanh, // a * f(b)
     // binary ops for indexing
     // opIndex,
     // ternary
@@ -101,6 +185,8 @@ enum ElementWiseOperator
     opElementwiseProductWithLogSumDerivative,
     opCopyIfEqual,
     opElementwiseProductWithExpOfDiff, /* a * exp(b - c) */
+    opElementwiseProductPlus, /* a * b + c */
+    opElementwiseProductWithSigmoidDerivativeOfProduct, opElementwiseProductWithTanhDerivativeOfProduct, /* a * b * f'(c) */
     // Note: not all that's implemented in CNTK ComputationNodes has an opcode yet.
 };
 
@@ -155,6 +241,8 @@ enum ElementWiseOperator
     Macro(ElementwiseProductWithReciprocalDerivative);                \
     Macro(ElementwiseProductWithSqrtDerivative);                      \
     Macro(SqrOfDifference);                                           \
+    Macro(ElementwiseProductWithSigmoid);                             \
+    Macro(ElementwiseProductWithTanh);                                \
     //Macro(Index);
 
 #define ForAllTernaryOps(Macro)                         \
@@ -162,7 +250,10 @@ enum ElementWiseOperator
     Macro(CopyIfEqual);                                 \
     Macro(Clip);                                        \
     Macro(ElementwiseProductWithLogSumDerivative);      \
-    Macro(ElementwiseProductWithExpOfDiff);
+    Macro(ElementwiseProductWithExpOfDiff);             \
+    Macro(ElementwiseProductPlus);                      \
+    Macro(ElementwiseProductWithSigmoidDerivativeOfProduct); \
+    Macro(ElementwiseProductWithTanhDerivativeOfProduct);
 
 // -----------------------------------------------------------------------
 // various enums to describe
@@ -334,6 +425,11 @@ protected:
     CPUSPARSE_INDEX_TYPE* GetCompIndex() const { return m_compIndex; }
     void SetCompIndex(CPUSPARSE_INDEX_TYPE* parray) { m_compIndex = parray; }
 
+    size_t GetWriteVersion() const { return m_writeVersion; }
+    void BumpWriteVersion() { m_writeVersion++; m_derivedDataCache.reset(); }
+
+    std::shared_ptr<void>& GetDerivedDataCache() { return m_derivedDataCache; }
+
     void ZeroInit(const MatrixFormat matrixFormat = matrixFormatDense, const DEVICEID_TYPE computeDevice = -1)
     {
         m_externalBuffer           = false;
@@ -355,6 +451,8 @@ protected:
         m_compIndex                = nullptr; // begin ids of col/row in CSC/CSR format
         m_blockIds                 = nullptr; // block ids
         m_blockIdShift             = 0; // used to get efficient slice, actual col = blockIds[j] - m_blockIdShift
+        m_writeVersion++;
+        m_derivedDataCache.reset();
     }
 
 protected:
@@ -399,6 +497,14 @@ protected:
     size_t* m_blockIds;    // block ids
     size_t m_blockIdShift; // used to get efficient slice, actual col = blockIds[j] - m_blockIdShift
 
+    // **************************
+    // derived data
+    // **************************
+
+    // Data computed from the content, such as the other compressed format of a GPU sparse matrix, kept until the
+    // content is written to (BaseMatrix::VerifyWritable()). m_writeVersion tells apart the contents of the storage.
+    size_t m_writeVersion = 0;
+    std::shared_ptr<void> m_derivedDataCache;
 };
 
 // -----------------------------------------------------------------------
@@ -439,12 +545,14 @@ public:
     }
 
     // This is needed for Sparse Matrices to ensure they can write to the matrix. Note: writing to slices is not currently supported
+    // Since it precedes every write, it also drops the data derived from the content (GetDerivedDataCache()).
     void VerifyWritable(const char* function) const 
     {
         if (!(m_sob->GetNumStorageRows() == m_numRows && m_sob->GetNumStorageCols() == m_numCols))
         {
             LogicError("%s: Cannot write to the matrix because it is a slice.", function);
         }
+        m_sob->BumpWriteVersion();
     }
 
     bool IsView() const { return (GetNumRows() != m_sob->GetNumStorageRows() || GetNumCols() != m_sob->GetNumStorageCols() || m_sliceViewOffset != 0); }
@@ -524,6 +632,9 @@ protected:
     CPUSPARSE_INDEX_TYPE* GetCompIndex() const { return m_sob->GetCompIndex(); }
     void SetCompIndex(CPUSPARSE_INDEX_TYPE* parray) { m_sob->SetCompIndex(parray); }
 
+    size_t GetWriteVersion() const { return m_sob->GetWriteVersion(); }
+    std::shared_ptr<void>& GetDerivedDataCache() const { return m_sob->GetDerivedDataCache(); }
+
     void SetNumRows(size_t numRows) { m_numRows = numRows; }
     void SetNumCols(size_t numCols) { m_numCols = numCols; }
 
@@ -329,4 +329,133 @@ __global__ void kAveragePoolingBackward(int batchSize, const int* mpRowCol, cons
     }
 }
 
+// -----------------------------------------------------------------------
+// Direct kernels of depthwise convolutions, which take the dimensions of
+// DepthwiseConvolutionShape instead of the maps: output map 'map' convolves
+// input channel map / multiplier. Unlike the kernels above, each thread
+// computes a complete gradient element, so that no atomics are needed.
+// -----------------------------------------------------------------------
+
+template <typename ElemType>
+__global__ void kDepthwiseConvolutionForward(int batchSize, DepthwiseConvolutionShape shape, const ElemType* __restrict__ kernel,
+                                             const ElemType* __restrict__ src, int srcVecSize,
+                                             ElemType* dst, int dstVecSize)
+{
+    int row = blockIdx.x * blockDim.x + threadIdx.x;
+    if (row >= dstVecSize)
+        return;
+
+    int outPlane = shape.m_outWidth * shape.m_outHeight;
+    int map = row / outPlane;
+    int ox = (row % outPlane) % shape.m_outWidth;
+    int oy = (row % outPlane) / shape.m_outWidth;
+    int ix0 = ox * shape.m_strideWidth - shape.m_padWidth;
+    int iy0 = oy * shape.m_strideHeight - shape.m_padHeight;
+    const ElemType* w = kernel + map * shape.m_kernelWidth * shape.m_kernelHeight;
+    int inBase = (map / shape.m_multiplier) * shape.m_inWidth * shape.m_inHeight;
+
+    for (int sample = blockIdx.y; sample < batchSize; sample += gridDim.y)
+    {
+        const ElemType* x = src + sample * srcVecSize + inBase;
+        ElemType sum = 0;
+        for (int ky = 0; ky < shape.m_kernelHeight; ky++)
+        {
+            int iy = iy0 + ky;
+            if (iy < 0 || iy >= shape.m_inHeight)
+                continue;
+            for (int kx = 0; kx < shape.m_kernelWidth; kx++)
+            {
+                int ix = ix0 + kx;
+                if (ix < 0 || ix >= shape.m_inWidth)
+                    continue;
+                sum += w[ky * shape.m_kernelWidth + kx] * x[iy * shape.m_inWidth + ix];
+            }
+        }
+        dst[sample * dstVecSize + row] = sum;
+    }
+}
+
+template <typename ElemType>
+__global__ void kDepthwiseConvolutionBackwardData(int batchSize, DepthwiseConvolutionShape shape, const ElemType* __restrict__ kernel,
+                                                  const ElemType* __restrict__ srcGrad, int srcVecSize,
+                                                  ElemType* grad, int dstVecSize)
+{
+    int row = blockIdx.x * blockDim.x + threadIdx.x;
+    if (row >= dstVecSize)
+        return;
+
+    int inPlane = shape.m_inWidth * shape.m_inHeight;
+    int outPlane = shape.m_outWidth * shape.m_outHeight;
+    int kernelSize = shape.m_kernelWidth * shape.m_kernelHeight;
+    int channel = row / inPlane;
+    int ix = (row % inPlane) % shape.m_inWidth;
+    int iy = (row % inPlane) / shape.m_inWidth;
+
+    for (int sample = blockIdx.y; sample < batchSize; sample += gridDim.y)
+    {
+        ElemType sum = 0;
+        for (int m = 0; m < shape.m_multiplier; m++)
+        {
+            int map = channel * shape.m_multiplier + m;
+            const ElemType* dy = srcGrad + sample * srcVecSize + map * outPlane;
+            const ElemType* w = kernel + map * kernelSize;
+            for (int ky = 0; ky < shape.m_kernelHeight; ky++)
+            {
+                int oyStrided = iy + shape.m_padHeight - ky;
+                if (oyStrided < 0 || oyStrided % shape.m_strideHeight != 0 || oyStrided / shape.m_strideHeight >= shape.m_outHeight)
+                    continue;
+                int oy = oyStrided / shape.m_strideHeight;
+                for (int kx = 0; kx < shape.m_kernelWidth; kx++)
+                {
+                    int oxStrided = ix + shape.m_padWidth - kx;
+                    if (oxStrided < 0 || oxStrided % shape.m_strideWidth != 0 || oxStrided / shape.m_strideWidth >= shape.m_outWidth)
+                        continue;
+                    sum += w[ky * shape.m_kernelWidth + kx] * dy[oy * shape.m_outWidth + oxStrided / shape.m_strideWidth];
+                }
+            }
+        }
+        grad[sample * dstVecSize + row] += sum;
+    }
+}
+
+// One block per kernel cell, which sums over all samples and outputs of its map. BlockSize must be a power of 2.
+template <int BlockSize, typename ElemType>
+__global__ void kDepthwiseConvolutionBackwardKernel(int batchSize, DepthwiseConvolutionShape shape,
+                                                    const ElemType* __restrict__ in, int inVecSize,
+                                                    const ElemType* __restrict__ srcGrad, int outVecSize,
+                                                    ElemType* kernelGrad)
+{
+    __shared__ ElemType partials[BlockSize];
+
+    int kernelSize = shape.m_kernelWidth * shape.m_kernelHeight;
+    int map = blockIdx.x / kernelSize;
+    int kx = (blockIdx.x % kernelSize) % shape.m_kernelWidth;
+    int ky = (blockIdx.x % kernelSize) / shape.m_kernelWidth;
+    int outPlane = shape.m_outWidth * shape.m_outHeight;
+    int inBase = (map / shape.m_multiplier) * shape.m_inWidth * shape.m_inHeight;
+
+    ElemType sum = 0;
+    for (int i = threadIdx.x; i < batchSize * outPlane; i += BlockSize)
+    {
+        int sample = i / outPlane;
+        int ox = (i % outPlane) % shape.m_outWidth;
+        int oy = (i % outPlane) / shape.m_outWidth;
+        int ix = ox * shape.m_strideWidth - shape.m_padWidth + kx;
+        int iy = oy * shape.m_strideHeight - shape.m_padHeight + ky;
+        if (ix < 0 || ix >= shape.m_inWidth || iy < 0 || iy >= shape.m_inHeight)
+            continue;
+        sum += srcGrad[sample * outVecSize + map * outPlane + oy * shape.m_outWidth + ox] * in[sample * inVecSize + inBase + iy * shape.m_inWidth + ix];
+    }
+    partials[threadIdx.x] = sum;
+    __syncthreads();
+    for (int active = BlockSize / 2; active > 0; active /= 2)
+    {
+        if (threadIdx.x < active)
+            partials[threadIdx.x] += partials[threadIdx.x + active];
+        __syncthreads();
+    }
+    if (threadIdx.x == 0)
+        kernelGrad[blockIdx.x] += partials[0];
+}
+
 }}}
@@ -6,6 +6,11 @@
 #include "stdafx.h"
 #include "ConvolutionEngine.h"
 #include "CuDnnFactories.h"
+#include "CPUVectorKernels.h"
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -127,6 +132,247 @@ void ConvolutionEngine<ElemType>::MaxUnpooling(const Mat& out, const Mat& poolIn
     MaxUnpoolingCore(out, poolIn, in);
 }
 
+//------------------------------------------------------------------
+// Pooling on the CPU of the common geometries: 2D windows over the planes [W x H] of the channels (and any further
+// dimensions), without padding, so that every window is complete. A row of the output comes from the span of kh input
+// rows its windows cover, which are first combined into one, over contiguous memory, then pooled along it: through a
+// vector kernel at stride 1, otherwise unrolled for the window widths 2 and 3. The planes are taken in parallel, so the
+// backward pass needs no atomics. The geometry is taken from the maps of ConvolveGeometry, and Create() returns
+// nullptr if they are not of this form.
+//------------------------------------------------------------------
+template <class ElemType>
+class CPUPlanePooling
+{
+public:
+    static std::unique_ptr<CPUPlanePooling> Create(const ConvolveGeometry& geometry)
+    {
+        const auto& inT = geometry.InputShape();
+        const auto& outT = geometry.OutputShape();
+        const auto& kernelT = geometry.KernelShape();
+        std::unique_ptr<CPUPlanePooling> pooling(new CPUPlanePooling());
+        auto& p = *pooling;
+        p.m_inW = inT[0];
+        p.m_inH = inT.GetRank() > 1 ? inT[1] : 1;
+        p.m_outW = outT[0];
+        p.m_outH = outT.GetRank() > 1 ? outT[1] : 1;
+        p.m_kw = kernelT[0];
+        p.m_kh = kernelT.GetRank() > 1 ? kernelT[1] : 1;
+        p.m_numPlanes = inT.GetNumElements() / (p.m_inW * p.m_inH);
+        if (kernelT.GetNumElements() != p.m_kw * p.m_kh || outT.GetNumElements() != p.m_numPlanes * p.m_outW * p.m_outH)
+            return nullptr;
+
+        // the full window everywhere, the rows of a window in order
+        const auto& mpRowCol = geometry.MpRowCol();
+        const auto& mpRowIndices = geometry.MpRowIndices();
+        const auto& indices = geometry.Indices();
+        if (find_if(mpRowIndices.begin(), mpRowIndices.end(), [](int i) { return i != 0; }) != mpRowIndices.end() ||
+            indices.empty() || indices[0] != (int) (p.m_kw * p.m_kh))
+            return nullptr;
+        for (size_t dy = 0; dy < p.m_kh; dy++)
+            for (size_t dx = 0; dx < p.m_kw; dx++)
+                if (indices[1 + dx + dy * p.m_kw] != indices[1] + (int) (dx + dy * p.m_inW))
+                    return nullptr;
+
+        // the first cells of the windows, as a grid with strides
+        auto first = [&](size_t row) { return mpRowCol[row] + indices[1]; };
+        p.m_x0 = first(0) % p.m_inW;
+        p.m_y0 = first(0) / p.m_inW;
+        p.m_sw = p.m_outW > 1 ? first(1) - first(0) : 1;
+        p.m_sh = p.m_outH > 1 ? (first(p.m_outW) - first(0)) / p.m_inW : 1;
+        if (p.m_sw == 0 || p.m_sh == 0 || p.m_x0 + (p.m_outW - 1) * p.m_sw + p.m_kw > p.m_inW || p.m_y0 + (p.m_outH - 1) * p.m_sh + p.m_kh > p.m_inH)
+            return nullptr;
+        size_t row = 0;
+        for (size_t plane = 0; plane < p.m_numPlanes; plane++)
+            for (size_t y = 0; y < p.m_outH; y++)
+                for (size_t x = 0; x < p.m_outW; x++, row++)
+                    if (first(row) != (int) (p.m_x0 + x * p.m_sw + (p.m_y0 + y * p.m_sh) * p.m_inW + plane * p.m_inW * p.m_inH))
+                        return nullptr;
+        return pooling;
+    }
+
+    void Forward(PoolKind poolKind, const ElemType* in, size_t batchSize, ElemType* out) const
+    {
+        const size_t span = (m_outW - 1) * m_sw + m_kw;
+        const ElemType windowSize = (ElemType) (m_kw * m_kh);
+#pragma omp parallel for
+        for (long k = 0; k < (long) (batchSize * m_numPlanes); k++)
+        {
+            const ElemType* inPlane = in + k * m_inW * m_inH;
+            ElemType* outPlane = out + k * m_outW * m_outH;
+            std::vector<ElemType> rows(span);
+            for (size_t y = 0; y < m_outH; y++)
+            {
+                const ElemType* window = inPlane + (m_y0 + y * m_sh) * m_inW + m_x0;
+                ElemType* output = outPlane + y * m_outW;
+                memcpy(rows.data(), window, span * sizeof(ElemType));
+                for (size_t dy = 1; dy < m_kh; dy++)
+                    Combine(poolKind, window + dy * m_inW, rows.data(), span);
+                if (poolKind == PoolKind::Max)
+                    PoolRow<MaxOp>(rows.data(), output);
+                else
+                {
+                    PoolRow<SumOp>(rows.data(), output);
+                    for (size_t x = 0; x < m_outW; x++)
+                        output[x] /= windowSize;
+                }
+            }
+        }
+    }
+
+    // grad += the gradient; for max pooling it goes to the first cell of the window that has the maximum, as in
+    // CPUMatrix::MaxPoolingBackward()
+    void Backward(PoolKind poolKind, const ElemType* out, const ElemType* srcGrad, const ElemType* in, size_t batchSize, ElemType* grad) const
+    {
+        const ElemType windowSize = (ElemType) (m_kw * m_kh);
+#pragma omp parallel for
+        for (long k = 0; k < (long) (batchSize * m_numPlanes); k++)
+        {
+            const size_t inOffset = k * m_inW * m_inH, outOffset = k * m_outW * m_outH;
+            for (size_t y = 0; y < m_outH; y++)
+            {
+                for (size_t x = 0; x < m_outW; x++)
+                {
+                    size_t first = inOffset + (m_y0 + y * m_sh) * m_inW + m_x0 + x * m_sw;
+                    ElemType g = srcGrad[outOffset + y * m_outW + x];
+                    if (poolKind == PoolKind::Max)
+                    {
+                        ElemType m = out[outOffset + y * m_outW + x];
+                        bool found = false;
+                        for (size_t dy = 0; dy < m_kh && !found; dy++)
+                        {
+                            for (size_t dx = 0; dx < m_kw && !found; dx++)
+                            {
+                                found = in[first + dy * m_inW + dx] >= m;
+                                if (found)
+                                    grad[first + dy * m_inW + dx] += g;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        g /= windowSize;
+                        for (size_t dy = 0; dy < m_kh; dy++)
+                            for (size_t dx = 0; dx < m_kw; dx++)
+                                grad[first + dy * m_inW + dx] += g;
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    CPUPlanePooling()
+    {
+    }
+
+    struct MaxOp
+    {
+        static ElemType Apply(ElemType a, ElemType b) { return a > b ? a : b; }
+        static void Into(const ElemType* a, ElemType* c, size_t n) { MaxInto(a, c, n); }
+    };
+    struct SumOp
+    {
+        static ElemType Apply(ElemType a, ElemType b) { return a + b; }
+        static void Into(const ElemType* a, ElemType* c, size_t n) { AddInto(a, c, n); }
+    };
+
+    static void Combine(PoolKind poolKind, const ElemType* a, ElemType* c, size_t n)
+    {
+        if (poolKind == PoolKind::Max)
+            MaxOp::Into(a, c, n);
+        else
+            SumOp::Into(a, c, n);
+    }
+
+    // output[x] = the combination of rows[x * sw + dx] over the window
+    template <class Op>
+    void PoolRow(const ElemType* rows, ElemType* output) const
+    {
+        if (m_sw == 1)
+        {
+            memcpy(output, rows, m_outW * sizeof(ElemType));
+            for (size_t dx = 1; dx < m_kw; dx++)
+                Op::Into(rows + dx, output, m_outW);
+        }
+        else if (m_kw == 2)
+        {
+            for (size_t x = 0; x < m_outW; x++, rows += m_sw)
+                output[x] = Op::Apply(rows[0], rows[1]);
+        }
+        else if (m_kw == 3)
+        {
+            for (size_t x = 0; x < m_outW; x++, rows += m_sw)
+                output[x] = Op::Apply(Op::Apply(rows[0], rows[1]), rows[2]);
+        }
+        else
+        {
+            for (size_t x = 0; x < m_outW; x++, rows += m_sw)
+            {
+                ElemType v = rows[0];
+                for (size_t dx = 1; dx < m_kw; dx++)
+                    v = Op::Apply(v, rows[dx]);
+                output[x] = v;
+            }
+        }
+    }
+
+    static void MaxInto(const float* a, float* c, size_t n) { CPUVectorKernels::Best().MaxInto(a, c, n); }
+    static void AddInto(const float* a, float* c, size_t n) { CPUVectorKernels::Best().AddInto(a, c, n); }
+    static void MaxInto(const double* a, double* c, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+            c[i] = std::max(c[i], a[i]);
+    }
+    static void AddInto(const double* a, double* c, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+            c[i] += a[i];
+    }
+
+    size_t m_inW, m_inH, m_outW, m_outH, m_numPlanes;
+    size_t m_kw, m_kh;
+    size_t m_sw, m_sh;
+    size_t m_x0, m_y0; // the first cell of the first window
+};
+
+//------------------------------------------------------------------
+// The index tables of a ConvolveGeometry (MpRowCol, MpRowIwht, ...) as int matrices on a device, for the engines
+// that pass them to the Matrix kernels. On a GPU one copy of the tables is shared by all engines on that device whose
+// geometries are identical (ResNets have dozens of layers of the same shape), so that each is uploaded and stored
+// once. The cache only holds weak references: a table is freed with the last engine that uses it.
+// On the CPU the matrices wrap the vectors of the geometry itself, so there is nothing to share.
+//------------------------------------------------------------------
+class ConvolveGeometryTables
+{
+public:
+    static std::shared_ptr<Matrix<int>> Get(const ConvolveGeometry& geometry, DEVICEID_TYPE deviceId, const char* tableName, const ConvolveGeometry::IntVec& table)
+    {
+        if (deviceId < 0)
+            return std::make_shared<Matrix<int>>(table.size(), 1, const_cast<int*>(table.data()), deviceId, matrixFlagDontOwnBuffer);
+
+        // the string of a geometry has all of its parameters, which determine the tables
+        auto key = std::make_tuple((std::string) geometry, deviceId, std::string(tableName));
+        std::lock_guard<std::mutex> lock(s_mutex);
+        auto& entry = s_tables[key];
+        auto matrix = entry.lock();
+        if (!matrix)
+        {
+            matrix = std::make_shared<Matrix<int>>(table.size(), 1, const_cast<int*>(table.data()), deviceId, matrixFlagNormal);
+            entry = matrix;
+            for (auto iter = s_tables.begin(); iter != s_tables.end();)
+                iter = iter->second.expired() ? s_tables.erase(iter) : ++iter;
+        }
+        return matrix;
+    }
+
+private:
+    static std::mutex s_mutex;
+    static std::map<std::tuple<std::string, DEVICEID_TYPE, std::string>, std::weak_ptr<Matrix<int>>> s_tables;
+};
+
+std::mutex ConvolveGeometryTables::s_mutex;
+std::map<std::tuple<std::string, DEVICEID_TYPE, std::string>, std::weak_ptr<Matrix<int>>> ConvolveGeometryTables::s_tables;
+
 //------------------------------------------------------------------
 // Reference convolution engine implementation.
 // This engine supports arbitrary convolution geometry but does not provide efficient implementation.
@@ -143,7 +389,7 @@ public:
 public:
     ReferenceConvolutionEngine(ConvolveGeometryPtr geometry, DEVICEID_TYPE deviceId, ImageLayoutKind imageLayout, size_t maxTempMemSizeInSamples, PoolKind poolKind)
         : Base(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind), 
-        m_mpRowCol(geometry->MpRowCol().size(), 1, const_cast<int*>(geometry->MpRowCol().data()), deviceId, IsGpu(deviceId) ? matrixFlagNormal : matrixFlagDontOwnBuffer)
+        m_mpRowCol(Table("MpRowCol", geometry->MpRowCol()))
     {
     }
 
@@ -164,52 +410,51 @@ protected:
     {
         if (m_mpRowIwht == nullptr)
         {
-            auto flags = IsGpu(m_deviceId) ? matrixFlagNormal : matrixFlagDontOwnBuffer;
-            m_mpRowIwht = std::make_unique<Matrix<int>>(m_geometry->MpRowIwht().size(), 1, 
-                                                        const_cast<int*>(m_geometry->MpRowIwht().data()), m_deviceId, flags);
-            m_mpRowRun = std::make_unique<Matrix<int>>(m_geometry->MpRowRun().size(), 1,
-                                                       const_cast<int*>(m_geometry->MpRowRun().data()), m_deviceId, flags);
-            m_runs = std::make_unique<Matrix<int>>(m_geometry->Runs().size(), 1, 
-                                                   const_cast<int*>(m_geometry->Runs().data()), m_deviceId, flags);
+            m_mpRowIwht = Table("MpRowIwht", m_geometry->MpRowIwht());
+            m_mpRowRun = Table("MpRowRun", m_geometry->MpRowRun());
+            m_runs = Table("Runs", m_geometry->Runs());
         }
     }
 
     void ForwardCore(const Mat& in, const Mat& kernel, Mat& out, Mat& /*workspace*/) override
     {
-        in.ConvolutionForward(kernel, m_mpRowCol, *m_mpRowIwht, *m_mpRowRun, *m_runs, out);
+        in.ConvolutionForward(kernel, *m_mpRowCol, *m_mpRowIwht, *m_mpRowRun, *m_runs, out);
     }
 
     void BackwardDataCore(const Mat& srcGrad, const Mat& kernel, Mat& grad, Mat& /*workspace*/) override
     {
-        srcGrad.ConvolutionBackwardData(kernel, m_mpRowCol, *m_mpRowIwht, *m_mpRowRun, *m_runs, grad);
+        srcGrad.ConvolutionBackwardData(kernel, *m_mpRowCol, *m_mpRowIwht, *m_mpRowRun, *m_runs, grad);
     }
 
     void BackwardKernelCore(const Mat& srcGrad, const Mat& in, Mat& kernelGrad, bool /*allowReuse*/, Mat& /*workspace*/) override
     {
-        srcGrad.ConvolutionBackwardKernel(in, m_mpRowCol, *m_mpRowIwht, *m_mpRowRun, *m_runs, kernelGrad);
+        srcGrad.ConvolutionBackwardKernel(in, *m_mpRowCol, *m_mpRowIwht, *m_mpRowRun, *m_runs, kernelGrad);
     }
 
     void EnsurePoolingInitialized() override
     {
         if (m_indices == nullptr)
         {
-            auto flags = IsGpu(m_deviceId) ? matrixFlagNormal : matrixFlagDontOwnBuffer;
-            m_mpRowIndices = std::make_unique<Matrix<int>>(m_geometry->MpRowIndices().size(), 1,
-                                                           const_cast<int*>(m_geometry->MpRowIndices().data()), m_deviceId, flags);
-            m_indices = std::make_unique<Matrix<int>>(m_geometry->Indices().size(), 1,
-                                                      const_cast<int*>(m_geometry->Indices().data()), m_deviceId, flags);
+            m_mpRowIndices = Table("MpRowIndices", m_geometry->MpRowIndices());
+            m_indices = Table("Indices", m_geometry->Indices());
+            if (!IsGpu(m_deviceId) && (m_poolKind == PoolKind::Max || m_poolKind == PoolKind::Average))
+                m_planePooling = CPUPlanePooling<ElemType>::Create(*m_geometry);
         }
     }
 
     void ForwardPoolingCore(const Mat& in, Mat& out) override
     {
-        if (m_poolKind == PoolKind::Max)
+        if (m_planePooling)
+        {
+            m_planePooling->Forward(m_poolKind, in.Data(), in.GetNumCols(), out.Data());
+        }
+        else if (m_poolKind == PoolKind::Max)
         {
-            in.MaxPoolingForward(m_mpRowCol, *m_mpRowIndices, *m_indices, out);
+            in.MaxPoolingForward(*m_mpRowCol, *m_mpRowIndices, *m_indices, out);
         }
         else if (m_poolKind == PoolKind::Average)
         {
-            in.AveragePoolingForward(m_mpRowCol, *m_mpRowIndices, *m_indices, out);
+            in.AveragePoolingForward(*m_mpRowCol, *m_mpRowIndices, *m_indices, out);
         }
         else
             InvalidArgument("Pooling type %d is not supported.", (int)m_poolKind);
@@ -218,13 +463,17 @@ protected:
 
     void BackwardPoolingCore(const Mat& out, const Mat& srcGrad, const Mat& in, Mat& grad) override
     {
-        if (m_poolKind == PoolKind::Max)
+        if (m_planePooling)
+        {
+            m_planePooling->Backward(m_poolKind, out.Data(), srcGrad.Data(), in.Data(), in.GetNumCols(), grad.Data());
+        }
+        else if (m_poolKind == PoolKind::Max)
         {
-            srcGrad.MaxPoolingBackward(out, in, m_mpRowCol, *m_mpRowIndices, *m_indices, grad);
+            srcGrad.MaxPoolingBackward(out, in, *m_mpRowCol, *m_mpRowIndices, *m_indices, grad);
         }
         else if (m_poolKind == PoolKind::Average)
         {
-            srcGrad.AveragePoolingBackward(m_mpRowCol, *m_mpRowIndices, *m_indices, grad);
+            srcGrad.AveragePoolingBackward(*m_mpRowCol, *m_mpRowIndices, *m_indices, grad);
         }
         else
             InvalidArgument("Pooling type %d is not supported.", (int)m_poolKind);
@@ -232,7 +481,7 @@ protected:
 
     void MaxUnpoolingCore(const Mat& out, const Mat& poolIn, Mat& in) override
     {
-        out.MaxUnpooling(m_mpRowCol, *m_mpRowIndices, *m_indices, poolIn, in);
+        out.MaxUnpooling(*m_mpRowCol, *m_mpRowIndices, *m_indices, poolIn, in);
     }
 
 protected:
@@ -241,10 +490,15 @@ protected:
         return deviceId >= 0;
     }
 
+    std::shared_ptr<Matrix<int>> Table(const char* tableName, const ConvolveGeometry::IntVec& table) const
+    {
+        return ConvolveGeometryTables::Get(*m_geometry, m_deviceId, tableName, table);
+    }
+
 protected:
-    using IntMatPtr = std::unique_ptr<Matrix<int>>;
+    using IntMatPtr = std::shared_ptr<Matrix<int>>; // shared with the engines of identical geometries, see ConvolveGeometryTables
 
-    Matrix<int> m_mpRowCol;
+    IntMatPtr m_mpRowCol;
     // Convolution-specific maps.
     IntMatPtr m_mpRowIwht;
     IntMatPtr m_mpRowRun;
@@ -252,6 +506,7 @@ protected:
     // Pooling-specific maps.
     IntMatPtr m_mpRowIndices;
     IntMatPtr m_indices;
+    std::unique_ptr<CPUPlanePooling<ElemType>> m_planePooling; // for the geometries it covers, on the CPU
 };
 
 //------------------------------------------------------------------
@@ -284,6 +539,8 @@ protected:
     {
         if (m_imageLayout != ImageLayoutKind::HWC)
             RuntimeError("Legacy convolution engine supports only HWC/legacy layout.");
+        if (m_geometry->Groups() > 1)
+            RuntimeError("Legacy convolution engine does not support grouped convolutions.");
     }
 
     void EnsureConvolutionInitialized() override
@@ -636,7 +893,7 @@ protected:
 
             // Unroll inputs.
             unrolledInput.SetValue(0);
-            inputSlice.UnrollConvolutionInput(unrollCols, mapOutSize, m_mpRowCol, *m_mpRowRun, *m_runs, unrolledInput);
+            inputSlice.UnrollConvolutionInput(unrollCols, mapOutSize, *m_mpRowCol, *m_mpRowRun, *m_runs, unrolledInput);
 
             // cudnn layout uses row-major kernel weight matrix.
             auto kern = kernel.ColumnSlice(0, kernel.GetNumCols());
@@ -736,7 +993,7 @@ protected:
 
             // Unroll outputs (source gradients).
             unrolledSrcGrad.SetValue(0);
-            srcGradSlice.UnrollConvolutionOutput(unrollCols, mapInCount, mapOutCount, m_mpRowCol, *m_mpRowRun, *m_runs, unrolledSrcGrad);
+            srcGradSlice.UnrollConvolutionOutput(unrollCols, mapInCount, mapOutCount, *m_mpRowCol, *m_mpRowRun, *m_runs, unrolledSrcGrad);
 
             // Perform matrix multiplication of unrolled outputs with weights.
             // If there is just one sample in the sub-batch then compute result directly to the output matrix.
@@ -830,7 +1087,7 @@ protected:
             }
             unrolledInputSlice.Reshape(mapOutSize * curBatchSize, unrollRows);
             unrolledInputSlice.SetValue(0);
-            inputSlice.UnrollConvolutionInputForKernelBackprop(mapOutSize, m_mpRowCol, *m_mpRowRun, *m_runs, unrolledInputSlice);
+            inputSlice.UnrollConvolutionInputForKernelBackprop(mapOutSize, *m_mpRowCol, *m_mpRowRun, *m_runs, unrolledInputSlice);
 
             // cudnn layout uses row-major kernel weight matrix.
             auto kernGrad = kernelGrad.ColumnSlice(0, kernelGrad.GetNumCols());
@@ -843,11 +1100,330 @@ protected:
 public:
     static bool IsSupported(DEVICEID_TYPE deviceId, ConvolveGeometryPtr geometry)
     {
-        return deviceId < 0 &&
+        return deviceId < 0 && geometry->Groups() == 1 &&
                find(begin(geometry->Sharing()), end(geometry->Sharing()), false) == end(geometry->Sharing());
     }
 };
 
+//------------------------------------------------------------------
+// Winograd convolution engine implementation.
+// This engine supports 2D 3x3 convolutions with stride 1 and full sharing
+// and is implemented using the minimal filtering algorithm F(2x2, 3x3)
+// (Fast Algorithms for Convolutional Neural Networks; Lavin, Gray).
+// Uses GEMM engine for kernel gradients and reference engine for pooling operations.
+//------------------------------------------------------------------
+template <class ElemType>
+class WinogradConvolutionEngine : public GemmConvolutionEngine<ElemType>
+{
+public:
+    using Base = GemmConvolutionEngine<ElemType>;
+    using typename Base::Mat;
+
+public:
+    WinogradConvolutionEngine(ConvolveGeometryPtr geometry, DEVICEID_TYPE deviceId, ImageLayoutKind imageLayout, size_t maxTempMemSizeInSamples, PoolKind poolKind)
+        : Base(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind)
+    {
+    }
+
+protected:
+    using Base::m_geometry;
+    using Base::m_deviceId;
+    using Base::m_maxTempMemSizeInSamples;
+
+    void EnsureCompatible() override
+    {
+        Base::EnsureCompatible();
+        if (!IsSupported(m_deviceId, m_geometry))
+            LogicError("Winograd convolution engine supports only 2D 3x3 convolutions with stride 1 and full sharing. Geometry: %s", ((string)*m_geometry).c_str());
+    }
+
+    // Using the notation of the GEMM engine, the forward method computes each 2x2 tile of the output from a 4x4 tile of the input:
+    // 1. Transform kernel weights: [XYC x K] -> 16 matrices [K x C] (U = G g G^T for every pair of input and output maps).
+    // 2. Transform the input tiles: [WHC x N] -> 16 matrices [C x NT], T = W'H'/4 tiles per sample (V = B^T d B).
+    // 3. Multiply, the element-wise product of U and V summed over the input maps: 16 times [K x C] * [C x NT] -> [K x NT].
+    // 4. Transform the products back into output tiles: [K x NT] -> [W'H'K x N] (Y = A^T M A).
+    // That takes 16 instead of 36 multiplications per output tile and pair of maps, and the transformed input is 4 rather
+    // than 9 times the size of the input.
+    void ForwardCore(const Mat& in, const Mat& kernel, Mat& out, Mat& workspace) override
+    {
+        const auto& inT = m_geometry->InputShape();
+        const auto& outT = m_geometry->OutputShape();
+        Convolve(in, inT[0], inT[1], inT[2], kernel, false, out, outT[0], outT[1], outT[2],
+                 m_geometry->GetLowerPad(0), m_geometry->GetLowerPad(1), false, workspace);
+    }
+
+    // The backward data method is the same computation as the forward one: the gradient of the input is the convolution of the
+    // (padded) source gradients with the kernels rotated by 180 degrees, with input and output maps swapped.
+    void BackwardDataCore(const Mat& srcGrad, const Mat& kernel, Mat& grad, Mat& workspace) override
+    {
+        const auto& inT = m_geometry->InputShape();
+        const auto& outT = m_geometry->OutputShape();
+        Convolve(srcGrad, outT[0], outT[1], outT[2], kernel, true, grad, inT[0], inT[1], inT[2],
+                 2 - m_geometry->GetLowerPad(0), 2 - m_geometry->GetLowerPad(1), true, workspace);
+    }
+
+private:
+    // out = (or += if 'accumulate') the correlation of in [inW x inH x inC x N] with the 3x3 kernels, where the first kernel
+    // cell of the output cell (x, y) is the input cell (x - padW, y - padH). 'backward' uses the kernels for the backward data method.
+    void Convolve(const Mat& in, size_t inW, size_t inH, size_t inC, const Mat& kernel, bool backward,
+                  Mat& out, size_t outW, size_t outH, size_t outC, int padW, int padH, bool accumulate, Mat& workspace)
+    {
+        size_t batchSize = in.GetNumCols();
+        size_t subBatchSize = m_maxTempMemSizeInSamples == 0 ? batchSize : min(batchSize, m_maxTempMemSizeInSamples);
+        size_t tilesW = (outW + 1) / 2;
+        size_t tilesH = (outH + 1) / 2;
+        size_t maxTileCount = tilesW * tilesH * subBatchSize;
+
+        // Reserve space for:
+        // 1. Transformed kernel weights.
+        // 2. Transformed input tiles.
+        // 3. Products.
+        size_t kernSize = 16 * outC * inC;
+        workspace.Resize(1, kernSize + 16 * (inC + outC) * maxTileCount);
+
+        auto transformedKernel = workspace.ColumnSlice(0, kernSize);
+        transformedKernel.Reshape(outC, 16 * inC);
+        TransformKernel(kernel.Data(), inC, outC, backward, transformedKernel.Data());
+
+        for (size_t start = 0; start < batchSize; start += subBatchSize)
+        {
+            size_t curBatchSize = min(subBatchSize, batchSize - start);
+            size_t tileCount = tilesW * tilesH * curBatchSize;
+            auto transformedInput = workspace.ColumnSlice(kernSize, 16 * inC * tileCount);
+            transformedInput.Reshape(inC, 16 * tileCount);
+            auto products = workspace.ColumnSlice(kernSize + 16 * inC * maxTileCount, 16 * outC * tileCount);
+            products.Reshape(outC, 16 * tileCount);
+
+            TransformInput(in.ColumnSlice(start, curBatchSize).Data(), inW, inH, inC, tilesW, tilesH, curBatchSize, padW, padH, transformedInput.Data());
+            for (size_t i = 0; i < 16; i++)
+            {
+                auto productSlice = products.ColumnSlice(i * tileCount, tileCount);
+                Mat::Multiply(transformedKernel.ColumnSlice(i * inC, inC), false, transformedInput.ColumnSlice(i * tileCount, tileCount), false, productSlice);
+            }
+            TransformOutput(products.Data(), outW, outH, outC, tilesW, tilesH, curBatchSize, accumulate, out.ColumnSlice(start, curBatchSize).Data());
+        }
+    }
+
+    // U = G g G^T for every pair of maps, as 16 matrices [outC x inC]. The kernel cell (x, y) of input map c and output map k
+    // of the forward convolution is kernel[x + 3 * (y + 3 * (c + C * k))].
+    static void TransformKernel(const ElemType* kernel, size_t inC, size_t outC, bool backward, ElemType* u)
+    {
+        for (size_t k = 0; k < outC; k++)
+        {
+            for (size_t c = 0; c < inC; c++)
+            {
+                const ElemType* g = backward ? kernel + 9 * (k + outC * c) : kernel + 9 * (c + inC * k);
+                ElemType t[4][3];
+                for (size_t x = 0; x < 3; x++)
+                {
+                    ElemType g0 = backward ? g[8 - x] : g[x];
+                    ElemType g1 = backward ? g[5 - x] : g[x + 3];
+                    ElemType g2 = backward ? g[2 - x] : g[x + 6];
+                    t[0][x] = g0;
+                    t[1][x] = (g0 + g1 + g2) / 2;
+                    t[2][x] = (g0 - g1 + g2) / 2;
+                    t[3][x] = g2;
+                }
+                ElemType* dst = u + k + outC * c;
+                size_t step = outC * inC;
+                for (size_t y = 0; y < 4; y++)
+                {
+                    dst[(4 * y + 0) * step] = t[y][0];
+                    dst[(4 * y + 1) * step] = (t[y][0] + t[y][1] + t[y][2]) / 2;
+                    dst[(4 * y + 2) * step] = (t[y][0] - t[y][1] + t[y][2]) / 2;
+                    dst[(4 * y + 3) * step] = t[y][2];
+                }
+            }
+        }
+    }
+
+    // V = B^T d B for every 4x4 input tile d (zero outside of the input) and map, as 16 matrices [inC x tiles].
+    static void TransformInput(const ElemType* in, size_t inW, size_t inH, size_t inC, size_t tilesW, size_t tilesH, size_t batchSize,
+                               int padW, int padH, ElemType* v)
+    {
+        long tileCount = (long)(tilesW * tilesH * batchSize);
+        size_t step = inC * tileCount;
+#pragma omp parallel for
+        for (long p = 0; p < tileCount; p++)
+        {
+            size_t n = p / (tilesW * tilesH);
+            int x0 = (int)(2 * (p % tilesW)) - padW;
+            int y0 = (int)(2 * (p / tilesW % tilesH)) - padH;
+            for (size_t c = 0; c < inC; c++)
+            {
+                const ElemType* map = in + inW * inH * (c + inC * n);
+                ElemType d[4][4];
+                for (int y = 0; y < 4; y++)
+                {
+                    for (int x = 0; x < 4; x++)
+                    {
+                        bool inside = x0 + x >= 0 && x0 + x < (int)inW && y0 + y >= 0 && y0 + y < (int)inH;
+                        d[y][x] = inside ? map[(x0 + x) + inW * (y0 + y)] : 0;
+                    }
+                }
+                ElemType t[4][4];
+                for (size_t x = 0; x < 4; x++)
+                {
+                    t[0][x] = d[0][x] - d[2][x];
+                    t[1][x] = d[1][x] + d[2][x];
+                    t[2][x] = d[2][x] - d[1][x];
+                    t[3][x] = d[1][x] - d[3][x];
+                }
+                ElemType* dst = v + c + inC * p;
+                for (size_t y = 0; y < 4; y++)
+                {
+                    dst[(4 * y + 0) * step] = t[y][0] - t[y][2];
+                    dst[(4 * y + 1) * step] = t[y][1] + t[y][2];
+                    dst[(4 * y + 2) * step] = t[y][2] - t[y][1];
+                    dst[(4 * y + 3) * step] = t[y][1] - t[y][3];
+                }
+            }
+        }
+    }
+
+    // Y = A^T M A for the 16 products [outC x tiles], written into the 2x2 output tiles that are inside the output.
+    static void TransformOutput(const ElemType* m, size_t outW, size_t outH, size_t outC, size_t tilesW, size_t tilesH, size_t batchSize,
+                                bool accumulate, ElemType* out)
+    {
+        long tileCount = (long)(tilesW * tilesH * batchSize);
+        size_t step = outC * tileCount;
+#pragma omp parallel for
+        for (long p = 0; p < tileCount; p++)
+        {
+            size_t n = p / (tilesW * tilesH);
+            size_t x0 = 2 * (p % tilesW);
+            size_t y0 = 2 * (p / tilesW % tilesH);
+            for (size_t k = 0; k < outC; k++)
+            {
+                const ElemType* src = m + k + outC * p;
+                ElemType s[2][4];
+                for (size_t x = 0; x < 4; x++)
+                {
+                    s[0][x] = src[x * step] + src[(4 + x) * step] + src[(8 + x) * step];
+                    s[1][x] = src[(4 + x) * step] - src[(8 + x) * step] - src[(12 + x) * step];
+                }
+                ElemType* map = out + outW * outH * (k + outC * n);
+                for (size_t y = 0; y < 2 && y0 + y < outH; y++)
+                {
+                    ElemType r[2] = { s[y][0] + s[y][1] + s[y][2], s[y][1] - s[y][2] - s[y][3] };
+                    for (size_t x = 0; x < 2 && x0 + x < outW; x++)
+                    {
+                        ElemType& dst = map[(x0 + x) + outW * (y0 + y)];
+                        dst = accumulate ? dst + r[x] : r[x];
+                    }
+                }
+            }
+        }
+    }
+
+public:
+    static bool IsSupported(DEVICEID_TYPE deviceId, ConvolveGeometryPtr geometry)
+    {
+        const auto& inT = geometry->InputShape();
+        const auto& kernT = geometry->KernelShape();
+        if (!Base::IsSupported(deviceId, geometry) || inT.GetRank() != 3)
+            return false;
+        if (kernT[0] != 3 || kernT[1] != 3 || kernT[2] != inT[2] || geometry->OutputShape()[2] != geometry->GetMapCount(2))
+            return false;
+        if (geometry->GetStride(0) != 1 || geometry->GetStride(1) != 1 || geometry->GetMapCount(0) != 1 || geometry->GetMapCount(1) != 1)
+            return false;
+        // The kernel must not reach beyond the padding.
+        for (size_t i = 0; i < 2; i++)
+        {
+            int pad = geometry->GetLowerPad(i);
+            if (pad < 0 || pad > 2)
+                return false;
+        }
+        return true;
+    }
+};
+
+//------------------------------------------------------------------
+// Depthwise convolution engine implementation.
+// This engine supports grouped 2D convolutions with a single input channel per group (see ConvolveGeometry::IsDepthwise()),
+// each output map being the convolution of one input channel with a kH x kW kernel, on CPU and GPU. The reference maps
+// and the unrolling of the GEMM engine do about as much bookkeeping as arithmetic for these, and cuDNN runs the groups
+// one by one, so the engine uses the direct kernels of the matrices instead.
+// Uses reference engine for pooling operations.
+//------------------------------------------------------------------
+template <class ElemType>
+class DepthwiseConvolutionEngine : public ReferenceConvolutionEngine<ElemType>
+{
+public:
+    using Base = ReferenceConvolutionEngine<ElemType>;
+    using typename Base::Mat;
+
+public:
+    DepthwiseConvolutionEngine(ConvolveGeometryPtr geometry, DEVICEID_TYPE deviceId, ImageLayoutKind imageLayout, size_t maxTempMemSizeInSamples, PoolKind poolKind)
+        : Base(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind), m_isInitialized(false)
+    {
+    }
+
+protected:
+    using Base::m_geometry;
+    using Base::m_imageLayout;
+
+    void EnsureCompatible() override
+    {
+        if (m_imageLayout != ImageLayoutKind::CHW)
+            LogicError("Depthwise convolution engine supports only CHW/cudnn layout.");
+        if (!m_geometry->IsDepthwise())
+            LogicError("Depthwise convolution engine supports only 2D convolutions with a single input channel per group. Geometry: %s", ((string)*m_geometry).c_str());
+    }
+
+    void EnsureConvolutionInitialized() override
+    {
+        if (!m_isInitialized)
+        {
+            m_shape = m_geometry->GetDepthwiseShape();
+            m_isInitialized = true;
+        }
+    }
+
+    void ForwardCore(const Mat& in, const Mat& kernel, Mat& out, Mat& /*workspace*/) override
+    {
+        in.DepthwiseConvolutionForward(kernel, m_shape, out);
+    }
+
+    void BackwardDataCore(const Mat& srcGrad, const Mat& kernel, Mat& grad, Mat& /*workspace*/) override
+    {
+        srcGrad.DepthwiseConvolutionBackwardData(kernel, m_shape, grad);
+    }
+
+    void BackwardKernelCore(const Mat& srcGrad, const Mat& in, Mat& kernelGrad, bool /*allowReuse*/, Mat& /*workspace*/) override
+    {
+        srcGrad.DepthwiseConvolutionBackwardKernel(in, m_shape, kernelGrad);
+    }
+
+public:
+    static bool IsSupported(ConvolveGeometryPtr geometry)
+    {
+        return geometry->IsDepthwise();
+    }
+
+private:
+    bool m_isInitialized;
+    DepthwiseConvolutionShape m_shape;
+};
+
+// The legacy engine reads its geometry with width and height swapped, and pads by half the kernel on both
+// sides whenever autopadding is on. It agrees with a real convolution on the (C x W x H) tensor only for square
+// images, kernels and strides with that padding, so that cuDNN can take over only these.
+static bool IsLegacyGeometryOnCuDnn(const ConvolveGeometry& geometry)
+{
+    const auto& input = geometry.InputShape();
+    const auto& kernel = geometry.KernelShape();
+    if (input.GetRank() != 3 || kernel.GetRank() != 3 || input[0] != input[1] || kernel[0] != kernel[1] ||
+        geometry.GetStride(0) != geometry.GetStride(1) || geometry.GetAutoPad(0) != geometry.GetAutoPad(1))
+        return false;
+    for (size_t i = 0; i < 2; i++)
+    {
+        if (geometry.GetLowerPad(i) != (geometry.GetAutoPad(i) ? (int)kernel[i] / 2 : 0))
+            return false;
+    }
+    return true;
+}
+
 template <class ElemType>
 std::unique_ptr<ConvolutionEngine<ElemType>> ConvolutionEngine<ElemType>::Create(ConvolveGeometryPtr geometry, DEVICEID_TYPE deviceId,
                                                                                  ImageLayoutKind imageLayout, size_t maxTempMemSizeInSamples, PoolKind poolKind,
@@ -861,9 +1437,19 @@ std::unique_ptr<ConvolutionEngine<ElemType>> ConvolutionEngine<ElemType>::Create
     // can be called from places like MEL with default parameters and never be used. 
     // The check will be done later in engine's EnsureCompatible call if the egnine is actually used.
     auto engStr = (std::string)(*geometry);
-    // Only legacy engine supports HWC layout.
+    // Only legacy and cuDNN engines support HWC layout. cuDNN runs these convolutions on NHWC tensors instead of
+    // the legacy unpacking, for the geometries where it computes the same as the legacy engine.
     if (imageLayout == ImageLayoutKind::HWC)
     {
+        if (isEnabled(ConvolutionEngineKind::CuDnn) && poolKind == PoolKind::None && IsLegacyGeometryOnCuDnn(*geometry) &&
+            CuDnnConvolutionEngineFactory<ElemType>::IsSupported(deviceId, geometry, poolKind))
+        {
+            if (GetMathLibTraceLevel() > 0)
+                fprintf(stderr, "%lsusing cuDNN convolution engine (HWC layout) for geometry: %s.\n", logPrefix.c_str(), engStr.c_str());
+
+            return CuDnnConvolutionEngineFactory<ElemType>::Create(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind, forceDeterministicAlgorithms);
+        }
+
         if (!isEnabled(ConvolutionEngineKind::Legacy))
             RuntimeError("Trying to use Legacy convolution engine when it's disabled.");
 
@@ -873,6 +1459,15 @@ std::unique_ptr<ConvolutionEngine<ElemType>> ConvolutionEngine<ElemType>::Create
         return std::make_unique<LegacyConvolutionEngine<ElemType>>(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind);
     }
 
+    // Depthwise convolutions go to the direct kernels ahead of cuDNN, which would run one convolution per channel.
+    if (isEnabled(ConvolutionEngineKind::Depthwise) && poolKind == PoolKind::None && DepthwiseConvolutionEngine<ElemType>::IsSupported(geometry))
+    {
+        if (GetMathLibTraceLevel() > 0)
+            fprintf(stderr, "%lsusing depthwise convolution engine for geometry: %s.\n", logPrefix.c_str(), engStr.c_str());
+
+        return std::make_unique<DepthwiseConvolutionEngine<ElemType>>(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind);
+    }
+
     // Check if we can use cuDNN engine. Do not need to validate tensors as ConvolveGeometry has already done that.
     if (isEnabled(ConvolutionEngineKind::CuDnn) &&
         CuDnnConvolutionEngineFactory<ElemType>::IsSupported(deviceId, geometry, poolKind))
@@ -883,6 +1478,14 @@ std::unique_ptr<ConvolutionEngine<ElemType>> ConvolutionEngine<ElemType>::Create
         return CuDnnConvolutionEngineFactory<ElemType>::Create(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind, forceDeterministicAlgorithms);
     }
 
+    if (isEnabled(ConvolutionEngineKind::Winograd) && WinogradConvolutionEngine<ElemType>::IsSupported(deviceId, geometry))
+    {
+        if (GetMathLibTraceLevel() > 0)
+            fprintf(stderr, "%lsusing Winograd convolution engine for geometry: %s.\n", logPrefix.c_str(), engStr.c_str());
+
+        return std::make_unique<WinogradConvolutionEngine<ElemType>>(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind);
+    }
+
     if (isEnabled(ConvolutionEngineKind::Gemm) && GemmConvolutionEngine<ElemType>::IsSupported(deviceId, geometry))
     {
         if (GetMathLibTraceLevel() > 0)
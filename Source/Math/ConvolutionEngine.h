@@ -22,8 +22,10 @@ enum class ConvolutionEngineKind
     CuDnn     = 1 << 1, // cuDNN, works only for 2D/3D convos with full sharing.
     Legacy    = 1 << 2, // Legacy, for backwards compatibility. REVIEW alexeyk: implement sparse version and remove Legacy altogether.
     Gemm      = 1 << 3, // Uses convolution unrolling+GEMM technique. Works only for convos with full sharing.
+    Winograd  = 1 << 4, // Uses Winograd minimal filtering F(2x2, 3x3). Works only for 2D 3x3 convos with stride 1 and full sharing on CPU.
+    Depthwise = 1 << 5, // Direct kernels of depthwise convos, i.e. 2D grouped convos with one input channel per group.
 
-    All       = Reference | CuDnn | Legacy | Gemm
+    All       = Reference | CuDnn | Legacy | Gemm | Winograd | Depthwise
 };
 
 enum class PoolKind
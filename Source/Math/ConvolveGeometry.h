@@ -6,10 +6,26 @@
 
 #include "Basics.h"
 #include "TensorShape.h"
+#include <algorithm>
 #include <iterator>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// A depthwise convolution: a grouped 2D convolution with one input channel per group (see ConvolveGeometry::IsDepthwise()).
+// Map k of 'channels * multiplier' maps convolves input channel k / multiplier. The first kernel application of an
+// output row starts at input x = -padWidth, the next one at strideWidth further on, and likewise for the height.
+// The direct kernels of the CPU and GPU matrices (DepthwiseConvolutionForward() etc.) take this instead of the maps.
+struct DepthwiseConvolutionShape
+{
+    int m_channels;
+    int m_multiplier;
+    int m_inWidth, m_inHeight;
+    int m_outWidth, m_outHeight;
+    int m_kernelWidth, m_kernelHeight;
+    int m_strideWidth, m_strideHeight;
+    int m_padWidth, m_padHeight;
+};
+
 // Notes:
 // * ConvolveGeometry represents the application of one or more rectangular "kernels" (all of the same size)
 //   to a rectangular input to produce a rectangular output.
@@ -37,6 +53,9 @@ public:
     const BoolVec& AutoPad() const { return m_autoPad; }
     const TensorShape& LowerPad() const { return m_lowerPad; }
     const TensorShape& UpperPad() const { return m_upperPad; }
+    // Number of groups the input channels (the last dimension) and the maps are split into. Each map sees only
+    // the InputShape()[last] / Groups() channels of its group, so the kernels span that many channels.
+    size_t Groups() const { return m_groups; }
 
     // Maps from a "row" (index of output cell) to its base "col" (index of input cell). For a given row,
     // the cols that contribute to it are { MpRowCol[row] + Indices[i0 + 1 + i] | 0 <= i < Indices[i0] },
@@ -76,10 +95,14 @@ public:
     // Number of kernels (equal to MapCount if sharing is all true values).
     size_t KernelCount() const { return m_kernelCount; }
 
+    // A grouped convolution splits the input channels (the rightmost dimension) and the maps into 'groups' groups, and
+    // convolves the channels of each group with the maps of that group only, so that the kernels span
+    // InputShape()[last] / groups channels. Groups require full sharing and maps along the rightmost dimension only.
+    // The maps are computed for the input of a single group; MpRowCol then points each output to the channels of its group.
     ConvolveGeometry(const TensorShape& inputShape, const TensorShape& kernelShape, const TensorShape& mapCount, const TensorShape& stride,
-                     const BoolVec& sharing, const BoolVec& autoPad, const TensorShape& lowerPad, const TensorShape& upperPad)
-                     : m_inputShape(inputShape), m_kernelShape(kernelShape), m_mapCount(mapCount), m_stride(stride), m_sharing(sharing),
-                     m_autoPad(autoPad), m_lowerPad(lowerPad), m_upperPad(upperPad)
+                     const BoolVec& sharing, const BoolVec& autoPad, const TensorShape& lowerPad, const TensorShape& upperPad, size_t groups = 1)
+                     : m_inputShape(GroupInputShape(inputShape, groups)), m_kernelShape(kernelShape), m_mapCount(mapCount), m_stride(stride), m_sharing(sharing),
+                     m_autoPad(autoPad), m_lowerPad(lowerPad), m_upperPad(upperPad), m_groups(groups)
     {
         // Note: this ctor is a bit long so sit back and relax.
 
@@ -94,6 +117,8 @@ public:
         m_outputShape = ComputeOutputShape(m_inputShape, m_kernelShape, m_mapCount, m_stride,
                                            m_sharing, m_autoPad, m_lowerPad, m_upperPad);
         assert(m_inputShape.GetRank() == m_outputShape.GetRank());
+        if (m_groups > 1)
+            ValidateGroups(inputShape);
 
         size_t dimCount = inputShape.GetRank();
         size_t kernelSize = kernelShape.GetNumElements();
@@ -376,6 +401,17 @@ public:
             m_mpRowCol[row] = col;
             m_mpRowIwht[row] = kern * (int)kernelSize;
         }
+
+        if (m_groups > 1)
+        {
+            // The outputs of a map are contiguous, and the maps of a group come one after another.
+            size_t mapSize = outputSize / m_mapCount.GetNumElements();
+            size_t mapsPerGroup = m_mapCount.GetNumElements() / m_groups;
+            int groupInputSize = (int)m_inputShape.GetNumElements();
+            for (size_t row = 0; row < outputSize; row++)
+                m_mpRowCol[row] += (int)(row / mapSize / mapsPerGroup) * groupInputSize;
+            m_inputShape = inputShape;
+        }
     }
 
     size_t GetStride(size_t dim) const
@@ -427,10 +463,39 @@ public:
         return -(center - (kernSize - 1) / 2);
     }
 
+    // Depthwise convolutions are grouped 2D convolutions with a single input channel per group, which the
+    // direct kernels of DepthwiseConvolutionShape cover.
+    bool IsDepthwise() const
+    {
+        return m_groups > 1 && m_inputShape.GetRank() == 3 && m_inputShape[2] == m_groups && m_kernelShape[2] == 1;
+    }
+
+    DepthwiseConvolutionShape GetDepthwiseShape() const
+    {
+        assert(IsDepthwise());
+        DepthwiseConvolutionShape shape;
+        shape.m_channels = (int)m_inputShape[2];
+        shape.m_multiplier = (int)(m_mapCount.GetNumElements() / m_groups);
+        shape.m_inWidth = (int)m_inputShape[0];
+        shape.m_inHeight = (int)m_inputShape[1];
+        shape.m_outWidth = (int)m_outputShape[0];
+        shape.m_outHeight = (int)m_outputShape[1];
+        shape.m_kernelWidth = (int)m_kernelShape[0];
+        shape.m_kernelHeight = (int)m_kernelShape[1];
+        shape.m_strideWidth = (int)GetStride(0);
+        shape.m_strideHeight = (int)GetStride(1);
+        // From the "kernel-center" cell of the first output to the first cell of its kernel.
+        shape.m_padWidth = ((int)m_kernelShape[0] - 1) / 2 - m_start[0];
+        shape.m_padHeight = ((int)m_kernelShape[1] - 1) / 2 - m_start[1];
+        return shape;
+    }
+
     // Computes output shape given input shape and other convolution parameters.
-    static TensorShape ComputeOutputShape(const TensorShape& inputShape, const TensorShape& kernelShape, const TensorShape& mapCount, const TensorShape& stride,
-                                          const BoolVec& sharing, const BoolVec& autoPad, const TensorShape& lowerPad, const TensorShape& upperPad)
+    static TensorShape ComputeOutputShape(const TensorShape& inputShapeAllGroups, const TensorShape& kernelShape, const TensorShape& mapCount, const TensorShape& stride,
+                                          const BoolVec& sharing, const BoolVec& autoPad, const TensorShape& lowerPad, const TensorShape& upperPad, size_t groups = 1)
     {
+        // The output of a grouped convolution is that of a (full) convolution of a single group with all maps.
+        const TensorShape inputShape = GroupInputShape(inputShapeAllGroups, groups);
         if (inputShape.GetRank() != kernelShape.GetRank())
             InvalidArgument("Convolution input and kernel tensors must have the same rank.");
         if (mapCount.GetRank() != 1 && inputShape.GetRank() != mapCount.GetRank())
@@ -574,12 +639,44 @@ public:
         res << AutoPad().back() << ")";
         res << ", LowerPad: " << (string)LowerPad();
         res << ", UpperPad: " << (string)UpperPad();
+        if (m_groups > 1)
+            res << ", Groups: " << m_groups;
         return res.str();
     }
 
     DISABLE_COPY_AND_MOVE(ConvolveGeometry);
 
 private:
+    // The input of a single group: the rightmost dimension reduced to the channels of a group.
+    static TensorShape GroupInputShape(const TensorShape& inputShape, size_t groups)
+    {
+        if (groups == 0)
+            InvalidArgument("Convolution requires at least one group.");
+        if (groups == 1)
+            return inputShape;
+        size_t last = inputShape.GetRank() - 1;
+        if (inputShape.GetRank() == 0 || (inputShape[last] % groups) != 0)
+            InvalidArgument("Grouped convolution requires that the number of input channels is a multiple of the number of groups (%d).", (int)groups);
+        auto dims = inputShape.GetDims();
+        dims[last] /= groups;
+        return TensorShape(dims);
+    }
+
+    void ValidateGroups(const TensorShape& inputShape) const
+    {
+        size_t last = m_inputShape.GetRank() - 1;
+        if (std::find(begin(m_sharing), end(m_sharing), false) != end(m_sharing))
+            InvalidArgument("Grouped convolution requires full sharing.");
+        size_t mapCount = m_mapCount.GetNumElements();
+        if (GetMapCount(last) != mapCount || (mapCount % m_groups) != 0)
+            InvalidArgument("Grouped convolution requires that the maps are along the rightmost dimension and that their number is a multiple of the number of groups (%d).", (int)m_groups);
+        if (m_kernelShape.GetRank() != m_inputShape.GetRank() || m_kernelShape[last] != m_inputShape[last])
+            InvalidArgument("Grouped convolution requires that the kernel spans the %d input channels of a group, not %d channels, the input having %d channels in %d groups.",
+                            (int)m_inputShape[last], m_kernelShape.GetRank() == m_inputShape.GetRank() ? (int)m_kernelShape[last] : 0, (int)inputShape[last], (int)m_groups);
+        if (m_outputShape[last] != mapCount)
+            InvalidArgument("Grouped convolution requires a single kernel application along the channels of a group.");
+    }
+
     TensorShape m_inputShape;
     TensorShape m_outputShape;
     TensorShape m_kernelShape;
@@ -589,6 +686,7 @@ private:
     BoolVec m_autoPad;
     TensorShape m_lowerPad;
     TensorShape m_upperPad;
+    size_t m_groups;
 
     // There are several reasons why int type is used here rather than size_t:
     // 1. Many of these vectors contain offsets which can be negative.
@@ -23,8 +23,8 @@ public:
                         bool spatial, ImageLayoutKind imageLayout)
                         : Base(deviceId, inOutT, spatial, imageLayout),
                         m_cudnn(CuDnn::Instance()),
-                        m_inOutCuDnnT(GetInOutTensor(inOutT), CuDnnTensor::GetDataType<ElemType>()),
-                        m_scaleBiasCuDnnT(GetScaleBiasTensor(inOutT, spatial), CuDnnTensor::GetDataType<ElemType>())
+                        m_inOutCuDnnT(GetInOutTensor(inOutT, spatial, imageLayout), CuDnnTensor::GetDataType<ElemType>(), GetInOutLayout(spatial, imageLayout)),
+                        m_scaleBiasCuDnnT(GetScaleBiasTensor(inOutT, spatial, imageLayout), CuDnnTensor::GetDataType<ElemType>())
     {
     }
 
@@ -36,8 +36,8 @@ protected:
 
     void EnsureCompatible() override
     {
-        if (m_spatial && m_imageLayout == ImageLayoutKind::HWC)
-            InvalidArgument("cuDNN batch normalization supports only cudnn(CHW) layout.");
+        if (m_spatial && m_imageLayout == ImageLayoutKind::HWC && m_inOutT.GetRank() != 3)
+            InvalidArgument("cuDNN batch normalization supports legacy(HWC) layout only for 2D images.");
         if (m_inOutT.GetRank() > 4)
             InvalidArgument("cuDNN batch normalization supports tensors of max 4 dimensions.");
     }
@@ -94,8 +94,16 @@ private:
         return src.Data();
     }
 
-    static TensorShape GetInOutTensor(const TensorShape& inOutT)
+    // Spatial batch normalization of HWC images runs on the NHWC tensor (the image as (W x H x C), with HWC strides).
+    static ImageLayoutKind GetInOutLayout(bool spatial, ImageLayoutKind imageLayout)
     {
+        return spatial ? imageLayout : ImageLayoutKind::CHW;
+    }
+
+    static TensorShape GetInOutTensor(const TensorShape& inOutT, bool spatial, ImageLayoutKind imageLayout)
+    {
+        if (GetInOutLayout(spatial, imageLayout) == ImageLayoutKind::HWC && inOutT.GetRank() == 3)
+            return ImageDimensions(inOutT, ImageLayoutKind::HWC).AsTensorShape(ImageLayoutKind::CHW);
         // cuDNN supports only 3D and 4D tensors (in cuDNN docs it's 4D and 5D dues to N dimension)
         // even for non-spatial inputs so expand the tensor if needed.
         if (inOutT.GetRank() > 2)
@@ -106,12 +114,12 @@ private:
         return TensorShape(v);
     }
 
-    static TensorShape GetScaleBiasTensor(const TensorShape& inOutT, bool spatial)
+    static TensorShape GetScaleBiasTensor(const TensorShape& inOutT, bool spatial, ImageLayoutKind imageLayout)
     {
         if (!spatial)
-            return GetInOutTensor(inOutT);
+            return GetInOutTensor(inOutT, spatial, imageLayout);
 
-        const auto& t = GetInOutTensor(inOutT);
+        const auto& t = GetInOutTensor(inOutT, spatial, imageLayout);
         SmallVector<size_t> v(t.GetRank(), 1);
         v[v.size() - 1] = t[t.GetRank() - 1];
         return TensorShape(v);
@@ -18,13 +18,23 @@ const float Consts<float>::Zero = 0;
 template <>
 const double Consts<double>::Zero = 0;
 
-CuDnnTensor::CuDnnTensor(const TensorShape& src, cudnnDataType_t dataType)
+CuDnnTensor::CuDnnTensor(const TensorShape& src, cudnnDataType_t dataType, ImageLayoutKind layout, size_t groups)
     : m_tensor(nullptr)
 {
     CUDNN_CALL(cudnnCreateTensorDescriptor(&m_tensor));
     // Set cuDNN tensor dimensions. cuDNN uses row-major format while TensorShape - column-major
     // so conversion is required. N dimension will be set to 1.
-    const auto& stridesSrc = src.GetStrides();
+    SmallVector<ptrdiff_t> stridesSrc = src.GetStrides();
+    if (layout == ImageLayoutKind::HWC)
+    {
+        if (src.GetRank() != 3)
+            InvalidArgument("cuDNN supports the HWC layout only for 2D images.");
+        // The dimensions stay those of the image, only the strides are the ones of the stored (C x W x H) tensor.
+        const auto& stridesHwc = TensorShape(src[2], src[0], src[1]).GetStrides();
+        stridesSrc[0] = stridesHwc[1];
+        stridesSrc[1] = stridesHwc[2];
+        stridesSrc[2] = stridesHwc[0];
+    }
     SmallVector<int> dims(src.GetRank() + 1);
     SmallVector<int> strides(stridesSrc.size() + 1);
     assert(dims.size() == strides.size());
@@ -35,7 +45,13 @@ CuDnnTensor::CuDnnTensor(const TensorShape& src, cudnnDataType_t dataType)
     }
     // Set "minibatch"(aka N) dimension.
     dims[0] = 1;
-    strides[0] = strides[1] * dims[1];
+    strides[0] = layout == ImageLayoutKind::HWC ? (int)src.GetNumElements() : strides[1] * dims[1];
+    if (groups > 1)
+    {
+        if (layout == ImageLayoutKind::HWC || (dims[1] % groups) != 0)
+            InvalidArgument("cuDNN supports groups only in the CHW layout and for a number of channels that is a multiple of the number of groups.");
+        dims[1] /= (int)groups;
+    }
     CUDNN_CALL(cudnnSetTensorNdDescriptor(m_tensor, dataType, (int)dims.size(), dims.data(), strides.data()));
 }
 
@@ -77,32 +93,38 @@ cudnnDataType_t CuDnnTensor::GetDataType()
 template cudnnDataType_t CuDnnTensor::GetDataType<float>();
 template cudnnDataType_t CuDnnTensor::GetDataType<double>();
 
-CuDnn::ptr_t CuDnn::Instance()
+// Like the cublas handles (GPUMatrix::GetCublasHandle()), the handles are created on first use and never freed.
+CuDnn::Handle::operator cudnnHandle_t() const
 {
-    auto createNew = []()
+    static THREAD_LOCAL cudnnHandle_t t_handles[MAX_GPUS] = {};
+    static THREAD_LOCAL cudaStream_t t_streams[MAX_GPUS] = {};
+
+    int deviceId;
+    CUDA_CALL(cudaGetDevice(&deviceId));
+    if (deviceId < 0 || deviceId >= MAX_GPUS)
+        LogicError("CuDnn: Maximum GPU exceeded");
+    if (t_handles[deviceId] == nullptr)
     {
-        int deviceId;
-        CUDA_CALL(cudaGetDevice(&deviceId));
         cudaDeviceProp props = {0};
         if (cudaGetDeviceProperties(&props, deviceId) != cudaSuccess || props.major < 3)
             RuntimeError("cuDNN requires device with compute capability 3.0 or higher.");
-        cudnnHandle_t* cudnn = new cudnnHandle_t;
-        CUDNN_CALL(cudnnCreate(cudnn));
-        CUDNN_CALL(cudnnSetStream(*cudnn, GetStream()));
-        return cudnn;
-    };
-
-    static std::shared_ptr<cudnnHandle_t> m_instance = std::shared_ptr<cudnnHandle_t>(createNew(), [](cudnnHandle_t* src)
+        CUDNN_CALL(cudnnCreate(&t_handles[deviceId]));
+        CUDNN_CALL(cudnnSetStream(t_handles[deviceId], GetStream()));
+        t_streams[deviceId] = GetStream();
+    }
+    // The handle follows the stream of the GPU routines, which is not the default one while a GPUGraph is captured.
+    else if (t_streams[deviceId] != GetStream())
     {
-        assert(*src != nullptr);
-        auto err = cudnnDestroy(*src);
-        assert(err == CUDNN_STATUS_SUCCESS);
-#ifdef NDEBUG
-        UNUSED(err);
-#endif
-        delete src;
-    });
-    return m_instance;
+        CUDNN_CALL(cudnnSetStream(t_handles[deviceId], GetStream()));
+        t_streams[deviceId] = GetStream();
+    }
+    return t_handles[deviceId];
+}
+
+CuDnn::ptr_t CuDnn::Instance()
+{
+    static ptr_t s_instance = std::make_shared<Handle>();
+    return s_instance;
 }
 
 } } }
@@ -18,7 +18,9 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 class CuDnnTensor final
 {
 public:
-    CuDnnTensor(const TensorShape& src, cudnnDataType_t dataType);
+    // With the HWC layout, 'src' is the (W x H x C) image and the samples are stored as (C x W x H), i.e. NHWC.
+    // With groups, the tensor is the part of 'src' of a single group, the rightmost dimension divided by 'groups', in samples of the size of 'src'.
+    CuDnnTensor(const TensorShape& src, cudnnDataType_t dataType, ImageLayoutKind layout = ImageLayoutKind::CHW, size_t groups = 1);
     ~CuDnnTensor();
 
     void UpdateBatchSize(size_t batchSize);
@@ -36,7 +38,16 @@ private:
 
 struct CuDnn final
 {
-    using ptr_t = std::shared_ptr<cudnnHandle_t>;
+    // Converts to the cuDNN handle of the calling thread and its current device, bound to the stream of the thread
+    // (see SetStream()), so that an engine created on one thread works on the stream of whichever thread calls it.
+    // A handle is bound to one stream at a time and must not be used by two threads at once, hence one per thread.
+    class Handle final
+    {
+    public:
+        operator cudnnHandle_t() const;
+    };
+
+    using ptr_t = std::shared_ptr<Handle>;
     static ptr_t Instance();
 
     DISABLE_COPY_AND_MOVE(CuDnn);
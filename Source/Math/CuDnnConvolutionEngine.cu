@@ -8,6 +8,9 @@
 #include "GPUMatrix.h"
 #include <typeinfo>
 #include <typeindex>
+#include <map>
+#include <mutex>
+#include <cstdio>
 #include "CuDnnCommon.h"
 
 template <>
@@ -38,10 +41,12 @@ public:
         CUDNN_CALL(cudnnCreateFilterDescriptor(&m_kernel));
         // Set cuDNN kernel dimensions. cuDNN uses row-major format while TensorShape - column-major
         // so conversion is required.
+        // The kernels of a grouped convolution are those of a single group, which the engine runs one after another.
         const auto& filt = geometry.KernelShape();
         size_t mapCount = geometry.GetMapCount(geometry.InputShape().GetRank() - 1);
         if (mapCount != geometry.MapCount().GetNumElements())
             InvalidArgument("cuDNN does not support map tensor of this configuration.");
+        mapCount /= geometry.Groups();
         SmallVector<int> dims(filt.GetRank() + 1);
         for (int i = 0; i < filt.GetRank(); i++)
             dims[dims.size() - 1 - i] = (int)filt[i];
@@ -164,6 +169,103 @@ private:
     cudnnPoolingDescriptor_t m_pool;
 };
 
+// The algorithms the cuDNN auto-tuner picked, shared by all engines of the process, so that layers of the same geometry
+// (and the engines a network creates again, e.g. for evaluation) don't run cudnnFind* again. The key has everything
+// the pick depends on: operation, geometry, minibatch size, data type, workspace limit, determinism, GPU and cuDNN version.
+// If a file is set, the cache is loaded from it and every new pick is appended to it, so that later runs skip the auto-tuning.
+class CuDnnAlgorithmCache
+{
+public:
+    struct Entry
+    {
+        int Algo;
+        size_t Memory;
+        int NoWorkspaceAlgo;
+    };
+
+    static CuDnnAlgorithmCache& Instance()
+    {
+        static CuDnnAlgorithmCache cache;
+        return cache;
+    }
+
+    void SetOptions(const std::wstring& path, size_t maxWorkspaceBytes)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_maxWorkspaceBytes = maxWorkspaceBytes;
+        if (path == m_path)
+            return;
+        m_path = path;
+        if (m_path.empty())
+            return;
+        FILE* f = _wfopen(m_path.c_str(), L"r");
+        if (f == nullptr) // created by the first Put()
+            return;
+        // One entry per line: key, algo, workspace bytes and no-workspace algo, separated by tabs. Later lines win.
+        char line[4096];
+        while (fgets(line, sizeof(line), f) != nullptr)
+        {
+            std::string text(line);
+            size_t t = text.size();
+            for (int i = 0; i < 3 && t != std::string::npos && t > 0; i++)
+                t = text.rfind('\t', t - 1);
+            Entry entry;
+            unsigned long long memory;
+            if (t == std::string::npos || t == 0 ||
+                sscanf(text.c_str() + t + 1, "%d\t%llu\t%d", &entry.Algo, &memory, &entry.NoWorkspaceAlgo) != 3)
+                continue;
+            entry.Memory = (size_t)memory;
+            m_entries[text.substr(0, t)] = entry;
+        }
+        fclose(f);
+    }
+
+    // Limit of the workspace of a single algorithm, 0 for none.
+    size_t MaxWorkspaceBytes()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_maxWorkspaceBytes;
+    }
+
+    bool TryGet(const std::string& key, Entry& entry)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto found = m_entries.find(key);
+        if (found == m_entries.end())
+            return false;
+        entry = found->second;
+        return true;
+    }
+
+    void Put(const std::string& key, const Entry& entry)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries[key] = entry;
+        if (m_path.empty())
+            return;
+        // Appended line by line, so that concurrent runs that share the file lose nothing but their own duplicates.
+        FILE* f = _wfopen(m_path.c_str(), L"a");
+        if (f == nullptr)
+        {
+            fprintf(stderr, "Warning: could not write the cuDNN algorithm cache file '%ls'.\n", m_path.c_str());
+            return;
+        }
+        fprintf(f, "%s\t%d\t%llu\t%d\n", key.c_str(), entry.Algo, (unsigned long long)entry.Memory, entry.NoWorkspaceAlgo);
+        fclose(f);
+    }
+
+private:
+    CuDnnAlgorithmCache()
+        : m_maxWorkspaceBytes(0)
+    {
+    }
+
+    std::mutex m_mutex;
+    std::map<std::string, Entry> m_entries;
+    std::wstring m_path;
+    size_t m_maxWorkspaceBytes;
+};
+
 template <class ElemType>
 class CuDnnConvolutionEngine : public ConvolutionEngine<ElemType>
 {
@@ -177,8 +279,8 @@ public:
                            : Base(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind),
                            m_cudnn(CuDnn::Instance()),
                            m_dataType(CuDnnTensor::GetDataType<ElemType>()),
-                           m_inT(geometry->InputShape(), m_dataType),
-                           m_outT(geometry->OutputShape(), m_dataType),
+                           m_inT(geometry->InputShape(), m_dataType, imageLayout, geometry->Groups()),
+                           m_outT(geometry->OutputShape(), m_dataType, imageLayout, geometry->Groups()),
                            m_forceDeterministicAlgorithms(forceDeterministicAlgorithms)
     {
     }
@@ -192,8 +294,10 @@ protected:
 
     void EnsureCompatible() override
     {
-        if (m_imageLayout != ImageLayoutKind::CHW)
-            RuntimeError("cuDNN convolution engine supports only CHW/cudnn layout.");
+        if (m_imageLayout == ImageLayoutKind::HWC && m_geometry->InputShape().GetRank() != 3)
+            RuntimeError("cuDNN convolution engine supports HWC/legacy layout only for 2D images.");
+        if (m_imageLayout == ImageLayoutKind::HWC && m_geometry->Groups() > 1)
+            RuntimeError("cuDNN convolution engine supports grouped convolutions only in CHW/cudnn layout.");
         if (!IsGpu(m_deviceId))
             RuntimeError("cuDNN convolution engine supports GPU devices only.");
     }
@@ -229,25 +333,29 @@ protected:
         {
             return cudnnGetConvolutionForwardAlgorithm(*m_cudnn, m_inT, *m_kernelT, *m_conv, m_outT, CUDNN_CONVOLUTION_FWD_NO_WORKSPACE, 0, &algo);
         };
-        FindBestAlgo(batchSize, m_fwdAlgo, finder, staticFinder);
+        FindBestAlgo("forward", batchSize, m_fwdAlgo, finder, staticFinder);
+        const Mat& cudnnKernel = KernelInCuDnnOrder(kernel);
         if (m_fwdAlgo.Algo.memory > 0)
             workspace.Resize((m_fwdAlgo.Algo.memory + sizeof(ElemType) - 1) / sizeof(ElemType), 1);
-        // Perform forward convolution operation.
-        auto err = cudnnConvolutionForward(*m_cudnn, &C::One, m_inT, ptr(in), *m_kernelT, ptr(kernel), *m_conv,
-                                           m_fwdAlgo.Algo.algo, ptr(workspace), m_fwdAlgo.Algo.memory, &C::Zero, m_outT, ptr(out));
-        // There might be a case where cuDNN fails due to workspace being too small, try using no-workspace algo instead.
-        // REVIEW alexeyk: NVIDIA is currently reviewing this issue.
-        if (CUDNN_STATUS_INVALID_VALUE == err && m_fwdAlgo.Algo.memory > 0)
+        // Perform forward convolution operation, group by group.
+        for (size_t group = 0; group < m_geometry->Groups(); group++)
         {
-            if (m_forceDeterministicAlgorithms)
-                RuntimeError("Falling back of the algorithms is not allowed. Please set 'forceDeterministicAlgorithms=false'.");
-            auto err2 = cudnnConvolutionForward(*m_cudnn, &C::One, m_inT, ptr(in), *m_kernelT, ptr(kernel), *m_conv,
-                                                m_fwdAlgo.NoWorkspaceAlgo, nullptr, 0, &C::Zero, m_outT, ptr(out));
-            // Update original error in case of success.
-            if (CUDNN_STATUS_SUCCESS == err2)
-                err = CUDNN_STATUS_SUCCESS;
+            auto err = cudnnConvolutionForward(*m_cudnn, &C::One, m_inT, GroupPtr(in, group), *m_kernelT, KernelGroupPtr(cudnnKernel, group), *m_conv,
+                                               m_fwdAlgo.Algo.algo, ptr(workspace), m_fwdAlgo.Algo.memory, &C::Zero, m_outT, GroupPtr(out, group));
+            // There might be a case where cuDNN fails due to workspace being too small, try using no-workspace algo instead.
+            // REVIEW alexeyk: NVIDIA is currently reviewing this issue.
+            if (CUDNN_STATUS_INVALID_VALUE == err && m_fwdAlgo.Algo.memory > 0)
+            {
+                if (m_forceDeterministicAlgorithms)
+                    RuntimeError("Falling back of the algorithms is not allowed. Please set 'forceDeterministicAlgorithms=false'.");
+                auto err2 = cudnnConvolutionForward(*m_cudnn, &C::One, m_inT, GroupPtr(in, group), *m_kernelT, KernelGroupPtr(cudnnKernel, group), *m_conv,
+                                                    m_fwdAlgo.NoWorkspaceAlgo, nullptr, 0, &C::Zero, m_outT, GroupPtr(out, group));
+                // Update original error in case of success.
+                if (CUDNN_STATUS_SUCCESS == err2)
+                    err = CUDNN_STATUS_SUCCESS;
+            }
+            CUDNN_CALL(err);
         }
-        CUDNN_CALL(err);
     }
 
     void BackwardDataCore(const Mat& srcGrad, const Mat& kernel, Mat& grad, Mat& workspace) override
@@ -272,12 +380,16 @@ protected:
         {
             return cudnnGetConvolutionBackwardDataAlgorithm(*m_cudnn, *m_kernelT, m_outT, *m_conv, m_inT, CUDNN_CONVOLUTION_BWD_DATA_NO_WORKSPACE, 0, &algo);
         };
-        FindBestAlgo(batchSize, m_backDataAlgo, finder, staticFinder);
+        FindBestAlgo("backwardData", batchSize, m_backDataAlgo, finder, staticFinder);
+        const Mat& cudnnKernel = KernelInCuDnnOrder(kernel);
         if (m_backDataAlgo.Algo.memory > 0)
             workspace.Resize((m_backDataAlgo.Algo.memory + sizeof(ElemType) - 1) / sizeof(ElemType), 1);
         // Compute gradients with respect to the output tensor (data).
-        CUDNN_CALL(cudnnConvolutionBackwardData(*m_cudnn, &C::One, *m_kernelT, ptr(kernel), m_outT, ptr(srcGrad), *m_conv, m_backDataAlgo.Algo.algo,
-                                                ptr(workspace), m_backDataAlgo.Algo.memory, &C::One, m_inT, ptr(grad)));
+        for (size_t group = 0; group < m_geometry->Groups(); group++)
+        {
+            CUDNN_CALL(cudnnConvolutionBackwardData(*m_cudnn, &C::One, *m_kernelT, KernelGroupPtr(cudnnKernel, group), m_outT, GroupPtr(srcGrad, group), *m_conv, m_backDataAlgo.Algo.algo,
+                                                    ptr(workspace), m_backDataAlgo.Algo.memory, &C::One, m_inT, GroupPtr(grad, group)));
+        }
     }
 
     void BackwardKernelCore(const Mat& srcGrad, const Mat& in, Mat& kernelGrad, bool /*allowReuse*/, Mat& workspace) override
@@ -302,12 +414,18 @@ protected:
         {
             return cudnnGetConvolutionBackwardFilterAlgorithm(*m_cudnn, m_inT, m_outT, *m_conv, *m_kernelT, CUDNN_CONVOLUTION_BWD_FILTER_NO_WORKSPACE, 0, &algo);
         };
-        FindBestAlgo(batchSize, m_backFiltAlgo, finder, staticFinder);
+        FindBestAlgo("backwardFilter", batchSize, m_backFiltAlgo, finder, staticFinder);
         if (m_backFiltAlgo.Algo.memory > 0)
             workspace.Resize((m_backFiltAlgo.Algo.memory + sizeof(ElemType) - 1) / sizeof(ElemType), 1);
         // Compute gradients with respect to the output tensor (data).
-        CUDNN_CALL(cudnnConvolutionBackwardFilter(*m_cudnn, &C::One, m_inT, ptr(in), m_outT, ptr(srcGrad), *m_conv, m_backFiltAlgo.Algo.algo,
-                                                  ptr(workspace), m_backFiltAlgo.Algo.memory, &C::One, *m_kernelT, ptr(kernelGrad)));
+        Mat& cudnnKernelGrad = m_imageLayout == ImageLayoutKind::HWC ? TransposedKernel(kernelGrad) : kernelGrad;
+        for (size_t group = 0; group < m_geometry->Groups(); group++)
+        {
+            CUDNN_CALL(cudnnConvolutionBackwardFilter(*m_cudnn, &C::One, m_inT, GroupPtr(in, group), m_outT, GroupPtr(srcGrad, group), *m_conv, m_backFiltAlgo.Algo.algo,
+                                                      ptr(workspace), m_backFiltAlgo.Algo.memory, &C::One, *m_kernelT, KernelGroupPtr(cudnnKernelGrad, group)));
+        }
+        if (&cudnnKernelGrad != &kernelGrad)
+            kernelGrad.AssignTransposeOf(cudnnKernelGrad);
     }
 
     void EnsurePoolingInitialized() override
@@ -348,7 +466,7 @@ private:
     static const int MaxAlgoCount = 10;
 
     template <typename TAlgo, typename TFinder, typename TStaticFinder>
-    void FindBestAlgo(size_t batchSize, TAlgo& algo, TFinder finder, TStaticFinder staticFinder)
+    void FindBestAlgo(const char* operation, size_t batchSize, TAlgo& algo, TFinder finder, TStaticFinder staticFinder)
     {
         m_inT.UpdateBatchSize(batchSize);
         m_outT.UpdateBatchSize(batchSize);
@@ -357,6 +475,25 @@ private:
             return;
 
         using CuDnnAlgoT = decltype(TAlgo::Algo);
+        using CuDnnAlgoEnumT = decltype(CuDnnAlgoT::algo);
+        size_t inputSampleSize = m_geometry->InputShape().GetNumElements();
+        size_t maxMem = m_maxTempMemSizeInSamples == 0 ? (std::numeric_limits<size_t>::max)() : inputSampleSize * m_maxTempMemSizeInSamples * sizeof(ElemType);
+        auto& cache = CuDnnAlgorithmCache::Instance();
+        if (cache.MaxWorkspaceBytes() > 0)
+            maxMem = std::min(maxMem, cache.MaxWorkspaceBytes());
+
+        std::string key = AlgoCacheKey(operation, batchSize, maxMem);
+        CuDnnAlgorithmCache::Entry cached;
+        if (cache.TryGet(key, cached))
+        {
+            algo.MaxAllowedMBSizeForCurrentAlgo = batchSize;
+            algo.Algo.algo = (CuDnnAlgoEnumT)cached.Algo;
+            algo.Algo.memory = cached.Memory;
+            algo.Algo.status = CUDNN_STATUS_SUCCESS;
+            algo.NoWorkspaceAlgo = (CuDnnAlgoEnumT)cached.NoWorkspaceAlgo;
+            return;
+        }
+
         CuDnnAlgoT algoPerf[MaxAlgoCount];
         int calgo = 0;
         cudnnStatus_t err = finder(calgo, algoPerf);
@@ -378,10 +515,9 @@ private:
             algo.NoWorkspaceAlgo = noMemAlgo;
             return;
         }
+        // Not cached: the pick was forced by the memory the process had at this moment.
         CUDNN_CALL(err);
         assert(calgo > 0);
-        size_t inputSampleSize = m_geometry->InputShape().GetNumElements();
-        size_t maxMem = m_maxTempMemSizeInSamples == 0 ? (std::numeric_limits<size_t>::max)() : inputSampleSize * m_maxTempMemSizeInSamples * sizeof(ElemType);
         // Find best (fastest) algorithm which satisfies workspace requirements.
         auto res = std::find_if(algoPerf, algoPerf + calgo,
             [=](const CuDnnAlgoT& cur) { return cur.status == CUDNN_STATUS_SUCCESS && cur.memory <= maxMem; });
@@ -392,7 +528,10 @@ private:
         algo.Algo = *res;
 
         if (m_forceDeterministicAlgorithms) // does not allow fallback.
+        {
+            cache.Put(key, { (int)algo.Algo.algo, algo.Algo.memory, (int)algo.NoWorkspaceAlgo });
             return;
+        }
 
         // Find fastest algorithm that does NOT require workspace. It is used as a fallback algo in Forward function.
         // Currently all Forward algorithms are deterministic, so no need for checking.
@@ -405,6 +544,31 @@ private:
         }
         else
             algo.NoWorkspaceAlgo = (*res).algo;
+        cache.Put(key, { (int)algo.Algo.algo, algo.Algo.memory, (int)algo.NoWorkspaceAlgo });
+    }
+
+    std::string AlgoCacheKey(const char* operation, size_t batchSize, size_t maxMem) const
+    {
+        cudaDeviceProp props = {0};
+        CUDA_CALL(cudaGetDeviceProperties(&props, m_deviceId));
+        return msra::strfun::strprintf("%s %s, %s, MB: %d, %s, MaxWorkspace: %llu, Deterministic: %d, %s sm_%d%d, cuDNN %d",
+                                       operation, ((std::string)*m_geometry).c_str(), ToString(m_imageLayout).c_str(), (int)batchSize, sizeof(ElemType) == 4 ? "float" : "double",
+                                       (unsigned long long)maxMem, (int)m_forceDeterministicAlgorithms, props.name, props.major, props.minor, (int)cudnnGetVersion());
+    }
+
+    // In the HWC layout the kernel is the [K x C*kH*kW] matrix of the legacy engine, while cuDNN wants the
+    // weights of each output map contiguous, so the engine works on a transposed copy.
+    const Mat& KernelInCuDnnOrder(const Mat& kernel)
+    {
+        return m_imageLayout == ImageLayoutKind::HWC ? TransposedKernel(kernel) : kernel;
+    }
+
+    Mat& TransposedKernel(const Mat& kernel)
+    {
+        if (m_transposedKernel == nullptr)
+            m_transposedKernel = std::make_unique<Mat>(m_deviceId);
+        m_transposedKernel->AssignTransposeOf(kernel);
+        return *m_transposedKernel;
     }
 
     static ElemType* ptr(Mat& src)
@@ -416,6 +580,25 @@ private:
         return src.Data();
     }
 
+    // The channels of a group in the first sample, which the tensor descriptors describe with the strides of the whole samples,
+    // and the kernels of the maps of a group, which come one group after another.
+    const ElemType* GroupPtr(const Mat& src, size_t group) const
+    {
+        return src.Data() + group * (src.GetNumRows() / m_geometry->Groups());
+    }
+    ElemType* GroupPtr(Mat& src, size_t group) const
+    {
+        return src.Data() + group * (src.GetNumRows() / m_geometry->Groups());
+    }
+    const ElemType* KernelGroupPtr(const Mat& kernel, size_t group) const
+    {
+        return kernel.Data() + group * (kernel.GetNumElements() / m_geometry->Groups());
+    }
+    ElemType* KernelGroupPtr(Mat& kernel, size_t group) const
+    {
+        return kernel.Data() + group * (kernel.GetNumElements() / m_geometry->Groups());
+    }
+
 private:
     template <typename T>
     struct ConvAlgoInfo
@@ -454,6 +637,8 @@ private:
     // Convolution specific.
     std::unique_ptr<CuDnnKernel> m_kernelT;
     std::unique_ptr<CuDnnConv> m_conv;
+    // Transposed kernel (or its gradient) of the HWC layout.
+    std::unique_ptr<Mat> m_transposedKernel;
     // Pooling specific.
     std::unique_ptr<CuDnnPool> m_pool;
 
@@ -501,4 +686,9 @@ bool CuDnnConvolutionEngineFactory<ElemType>::IsSupported(DEVICEID_TYPE deviceId
 template class CuDnnConvolutionEngineFactory<float>;
 template class CuDnnConvolutionEngineFactory<double>;
 
+void SetCuDnnAlgorithmCacheOptions(const std::wstring& path, size_t maxWorkspaceBytes)
+{
+    CuDnnAlgorithmCache::Instance().SetOptions(path, maxWorkspaceBytes);
+}
+
 } } }
@@ -113,6 +113,12 @@ void GranularGPUDataTransferer::WaitForCopyCPUToGPU()
     cudaEventSynchronize(m_assignCompleteEvent) || "cudaEventSynchronize failed";
 }
 
+void GranularGPUDataTransferer::WaitForCopyCPUToGPUOnComputeStreamAsync()
+{
+    PrepareDevice(m_deviceId);
+    cudaStreamWaitEvent(GetStream(), m_assignCompleteEvent, 0 /*flags 'must be 0'*/) || "cudaStreamWaitEvent failed";
+}
+
 void GranularGPUDataTransferer::RecordComputeStreamSyncPoint()
 {
     PrepareDevice(m_deviceId);
@@ -210,26 +216,32 @@ void GPUDataTransferer<ElemType>::WaitForCopyCPUToGPUAsync()
     SyncEvent(m_inner->m_assignCompleteEvent);
 }
 
+template <class ElemType>
+void GPUDataTransferer<ElemType>::WaitForCopyCPUToGPUOnComputeStreamAsync()
+{
+    m_inner->WaitForCopyCPUToGPUOnComputeStreamAsync();
+}
+
 //explicit
 template class GPUDataTransferer<float>;
 template class GPUDataTransferer<double>;
 
 /// PrefetchGPUDataTransferer
 
-cudaStream_t PrefetchGPUDataTransferer::s_prefetchStream = nullptr;
 cudaStream_t PrefetchGPUDataTransferer::s_gpuToCpuStream = nullptr;
 
-PrefetchGPUDataTransferer::PrefetchGPUDataTransferer(int deviceId) : GranularGPUDataTransferer(deviceId, s_gpuToCpuStream, s_prefetchStream, true)
+// The base class keeps a reference to m_prefetchStream, which is only set here.
+PrefetchGPUDataTransferer::PrefetchGPUDataTransferer(int deviceId) : GranularGPUDataTransferer(deviceId, s_gpuToCpuStream, m_prefetchStream, true), m_prefetchStream(nullptr)
 {
-#pragma warning(disable : 4127)
-    if (s_prefetchStream == nullptr)
-    {
-        // Assign stream always stays null, not required for prefetch.
+    // Gpu to cpu stream always stays null, not required for prefetch.
+    cudaStreamCreateWithFlags(&m_prefetchStream, cudaStreamNonBlocking) || "cudaStreamCreateWithFlags failed";
+}
 
-        // TODO: Currently the s_prefetchStream is not destroyed.
-        // As static it can be used in several readers with different lifecycle so we allow it to live till the end.
-        cudaStreamCreateWithFlags(&s_prefetchStream, cudaStreamNonBlocking) || "cudaStreamCreateWithFlags failed";
-    }
+PrefetchGPUDataTransferer::~PrefetchGPUDataTransferer()
+{
+    // Copies still in flight are completed before the stream is actually released.
+    PrepareDevice(m_deviceId);
+    cudaStreamDestroy(m_prefetchStream);
 }
 
 }}}
@@ -41,6 +41,7 @@ public:
     void CopyCPUToGPUAsync(const void* cpuBuffer, size_t numElements, size_t elementSize, void* gpuBuffer) override;
     void RecordCPUToGPUCopy() override;
     void WaitForCopyCPUToGPU() override;
+    void WaitForCopyCPUToGPUOnComputeStreamAsync() override;
 
     void RecordComputeStreamSyncPoint() override;
     void WaitForSyncPointOnFetchStreamAsync() override;
@@ -89,6 +90,9 @@ public:
     void WaitForCopyGPUToCPUAsync();
     void WaitForCopyCPUToGPUAsync();
 
+    // Makes the compute stream wait for the last copy to the gpu instead of blocking the CPU.
+    void WaitForCopyCPUToGPUOnComputeStreamAsync();
+
 #ifndef CPUONLY
     static cudaStream_t GetFetchStream();
 #endif // !CPUONLY
@@ -102,14 +106,18 @@ private:
 #endif // !CPUONLY
 };
 
+// Every prefetch data transferer uploads on a stream of its own. The upload of a minibatch first waits (on the GPU) until
+// the network is done with the buffers it overwrites; on a shared stream that wait would also hold back the uploads
+// of the minibatches behind it.
 class PrefetchGPUDataTransferer : public GranularGPUDataTransferer
 {
 public:
     PrefetchGPUDataTransferer(int deviceId);
+    ~PrefetchGPUDataTransferer();
 
 private:
 #ifndef CPUONLY
-    static cudaStream_t s_prefetchStream;
+    cudaStream_t m_prefetchStream;
     static cudaStream_t s_gpuToCpuStream;
 #endif
 
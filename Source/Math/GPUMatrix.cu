@@ -24,7 +24,11 @@
 #include "cublas_v2.h"
 #include <assert.h>
 #include <memory>
+#include <map>
+#include <mutex>
+#include <unordered_map>
 #include "CntkBatchNormalization.cuh"
+#include "ConvolveGeometry.h" // for DepthwiseConvolutionShape
 #include "Convolution.cuh"
 #include "CuDnnRNN.h"
 
@@ -41,11 +45,9 @@
 
 #define UNCONST(t, c, uc) GPUMatrix<t>& uc = const_cast<GPUMatrix<t>&>(c);
 
-#ifdef _WIN32
 // thread local storage to access the current stream, initialize to default stream
-__declspec(thread)
-#endif
-    cudaStream_t t_stream = cudaStreamDefault;
+// (per thread, so that threads can issue their work to streams of their own, e.g. evaluators of several models)
+THREAD_LOCAL cudaStream_t t_stream = cudaStreamDefault;
 
 #define DEFAULT_THREAD_PER_DIM 16
 
@@ -127,6 +129,13 @@ std::vector<cudaDeviceProp> GridDim::s_cachedDeviceProps = GridDim::CacheDeviceP
     s_isSyncEnabled = true;
 }
 
+/*static*/ bool TensorOpKernels::s_areFastPathsEnabled = true;
+
+/*static*/ void TensorOpKernels::EnableFastPaths(bool enable)
+{
+    s_areFastPathsEnabled = enable;
+}
+
 SyncGuard::SyncGuard(bool forceSync /*= false*/)
     : m_forceSync(forceSync)
 {
@@ -158,6 +167,379 @@ SyncGuard::~SyncGuard()
     }
 }
 
+#pragma region GPUMemoryCache class
+
+// -----------------------------------------------------------------------
+// GPUMemoryCache -- per-device cache of device buffers
+//
+// Freed buffers are kept in free lists ordered by size, and a request is served
+// by the smallest cached block that fits (best fit) as long as the block is not
+// much larger than what was asked for. Request sizes are rounded up into buckets
+// so that the slightly varying sizes of variable-length minibatches hit the cache.
+// Each cached block remembers the stream it was released on; a block handed to a
+// different stream makes that stream wait for an event recorded at release time
+// rather than synchronizing the device.
+// -----------------------------------------------------------------------
+
+class GPUMemoryCache
+{
+    static const size_t s_smallBlockRounding = 512;     // requests below 1 MB are rounded to 512 bytes
+    static const size_t s_largeBlockThreshold = 1 << 20;
+    static const size_t s_largeBlockRounding = 1 << 20; // larger ones to whole MBs
+
+    struct Block
+    {
+        void* m_ptr;
+        size_t m_size;           // size of the underlying cudaMalloc() allocation
+        size_t m_requestedSize;  // size the current owner asked for (for fragmentation accounting)
+        cudaStream_t m_stream;   // stream the block was last released on
+        cudaEvent_t m_released;  // recorded on m_stream when the block was released
+    };
+
+public:
+    static const int s_maxNumDevices = 32;
+
+    static GPUMemoryCache* GetInstance(int deviceId)
+    {
+        // Intentionally never destroyed: buffers may still be freed from other static destructors
+        // at process exit, and the driver reclaims all device memory at that point anyway.
+        static GPUMemoryCache* caches = new GPUMemoryCache[s_maxNumDevices];
+        if (deviceId < 0 || deviceId >= s_maxNumDevices)
+            return nullptr;
+        caches[deviceId].m_deviceId = deviceId;
+        return &caches[deviceId];
+    }
+
+    GPUMemoryCache()
+        : m_deviceId(-1), m_bytesInUse(0), m_bytesCached(0), m_peakBytes(0), m_wastedBytes(0), m_numRequests(0), m_numHits(0)
+    {
+    }
+
+    void* Allocate(size_t numBytes)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        const size_t size = RoundSize(numBytes);
+        m_numRequests++;
+
+        Block block;
+        if (TryTakeFreeBlock(size, block))
+            m_numHits++;
+        else
+        {
+            block.m_ptr = nullptr;
+            block.m_size = size;
+            block.m_stream = t_stream;
+            block.m_released = nullptr;
+            TracingGPUMemoryAllocator::CountDeviceMalloc();
+            if (cudaMalloc(&block.m_ptr, size) != cudaSuccess)
+            {
+                // out of memory: give the cached blocks back to the driver and retry once
+                cudaGetLastError(); // clear the sticky error
+                ReleaseFreeBlocks(0);
+                CUDA_CALL(cudaMalloc(&block.m_ptr, size));
+            }
+        }
+
+        block.m_requestedSize = numBytes;
+        m_bytesInUse += block.m_size;
+        m_wastedBytes += block.m_size - numBytes;
+        m_peakBytes = std::max(m_peakBytes, m_bytesInUse + m_bytesCached);
+        m_liveBlocks[block.m_ptr] = block;
+        return block.m_ptr;
+    }
+
+    // Returns false if 'ptr' was not handed out by this cache, in which case the caller must free it itself.
+    // Blocks released after caching was turned off are freed right away.
+    bool Release(void* ptr, bool ignoreCUDARetCode)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto iter = m_liveBlocks.find(ptr);
+        if (iter == m_liveBlocks.end())
+            return false;
+
+        Block block = iter->second;
+        m_liveBlocks.erase(iter);
+        m_bytesInUse -= block.m_size;
+        m_wastedBytes -= block.m_size - block.m_requestedSize;
+
+        if (!TracingGPUMemoryAllocator::IsCachingEnabled())
+        {
+            DestroyBlock(block, ignoreCUDARetCode);
+            return true;
+        }
+
+        // remember where in the stream the last use of the block was, so that another stream can wait for it
+        block.m_stream = t_stream;
+        if (ignoreCUDARetCode)
+        {
+            // Frees of destructors, e.g. at teardown, must not throw. A block without an event cannot be handed to
+            // another stream, so it is freed right away if the event fails.
+            if (!block.m_released && cudaEventCreateWithFlags(&block.m_released, cudaEventDisableTiming) != cudaSuccess)
+                block.m_released = nullptr;
+            if (!block.m_released || cudaEventRecord(block.m_released, block.m_stream) != cudaSuccess)
+            {
+                cudaGetLastError(); // clear the sticky error
+                DestroyBlock(block, ignoreCUDARetCode);
+                return true;
+            }
+        }
+        else
+        {
+            if (!block.m_released)
+                CUDA_CALL(cudaEventCreateWithFlags(&block.m_released, cudaEventDisableTiming));
+            CUDA_CALL(cudaEventRecord(block.m_released, block.m_stream));
+        }
+
+        m_freeBlocks.insert(std::make_pair(block.m_size, block));
+        m_bytesCached += block.m_size;
+
+        let limit = TracingGPUMemoryAllocator::GetCacheLimitInBytes();
+        if (limit > 0 && m_bytesCached > limit)
+            ReleaseFreeBlocks(limit, ignoreCUDARetCode);
+
+        return true;
+    }
+
+    void ReleaseCachedMemory()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ReleaseFreeBlocks(0);
+    }
+
+    void PrintStatistics()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_numRequests == 0)
+            return;
+
+        const double numBytesPerMB = 1 << 20;
+        fprintf(stderr, "GPU memory cache on DeviceId = %d: %.1f MB in use, %.1f MB cached, %.1f MB peak; %llu of %llu requests served from cache (%.1f%%); %.1f MB (%.1f%%) lost to fragmentation\n",
+                m_deviceId, m_bytesInUse / numBytesPerMB, m_bytesCached / numBytesPerMB, m_peakBytes / numBytesPerMB,
+                (unsigned long long) m_numHits, (unsigned long long) m_numRequests, 100.0 * m_numHits / m_numRequests,
+                m_wastedBytes / numBytesPerMB, m_bytesInUse > 0 ? 100.0 * m_wastedBytes / m_bytesInUse : 0.0);
+    }
+
+private:
+    static size_t RoundSize(size_t numBytes)
+    {
+        if (numBytes == 0)
+            numBytes = 1;
+        let rounding = numBytes < s_largeBlockThreshold ? s_smallBlockRounding : s_largeBlockRounding;
+        return ((numBytes + rounding - 1) / rounding) * rounding;
+    }
+
+    // largest block size we are willing to hand out for a request of 'size' bytes
+    static size_t MaxAcceptableSize(size_t size)
+    {
+        return size < s_largeBlockThreshold ? 2 * size : size + size / 4;
+    }
+
+    bool TryTakeFreeBlock(size_t size, Block& block)
+    {
+        // among the best-fitting candidates, prefer one last released on our own stream, which needs no synchronization
+        static const size_t maxCandidates = 8;
+        let maxSize = MaxAcceptableSize(size);
+        let isCapturing = GPUGraph::GetCapturingGraph() != nullptr;
+        auto best = m_freeBlocks.end();
+        size_t numCandidates = 0;
+        for (auto iter = m_freeBlocks.lower_bound(size); iter != m_freeBlocks.end() && iter->first <= maxSize && numCandidates < maxCandidates; ++iter, ++numCandidates)
+        {
+            // A stream that is being captured cannot wait for an event of another stream. Blocks of the legacy default
+            // stream need no waiting, as the stream of a GPUGraph is a blocking one, which is ordered with it.
+            if (isCapturing && iter->second.m_stream != t_stream && iter->second.m_stream != nullptr)
+                continue;
+            if (best == m_freeBlocks.end())
+                best = iter;
+            if (iter->second.m_stream == t_stream)
+            {
+                best = iter;
+                break;
+            }
+        }
+        if (best == m_freeBlocks.end())
+            return false;
+
+        block = best->second;
+        m_freeBlocks.erase(best);
+        m_bytesCached -= block.m_size;
+
+        if (block.m_stream != t_stream)
+        {
+            if (!isCapturing)
+                CUDA_CALL(cudaStreamWaitEvent(t_stream, block.m_released, 0));
+            block.m_stream = t_stream;
+        }
+        return true;
+    }
+
+    // free cached blocks, largest first, until no more than 'targetBytes' remain cached
+    void ReleaseFreeBlocks(size_t targetBytes, bool ignoreCUDARetCode = false)
+    {
+        while (m_bytesCached > targetBytes && !m_freeBlocks.empty())
+        {
+            auto iter = std::prev(m_freeBlocks.end());
+            m_bytesCached -= iter->second.m_size;
+            DestroyBlock(iter->second, ignoreCUDARetCode);
+            m_freeBlocks.erase(iter);
+        }
+    }
+
+    static void DestroyBlock(const Block& block, bool ignoreCUDARetCode)
+    {
+        if (ignoreCUDARetCode)
+        {
+            if (block.m_released)
+                cudaEventDestroy(block.m_released);
+            cudaFree(block.m_ptr);
+        }
+        else
+        {
+            if (block.m_released)
+                CUDA_CALL(cudaEventDestroy(block.m_released));
+            CUDA_CALL(cudaFree(block.m_ptr));
+        }
+    }
+
+    int m_deviceId;
+    std::mutex m_mutex;
+    std::multimap<size_t, Block> m_freeBlocks;  // size -> free block
+    std::unordered_map<void*, Block> m_liveBlocks;
+
+    size_t m_bytesInUse;
+    size_t m_bytesCached;
+    size_t m_peakBytes;
+    size_t m_wastedBytes; // difference between block sizes and requested sizes of live blocks
+    uint64_t m_numRequests;
+    uint64_t m_numHits;
+};
+
+/*static*/ void TracingGPUMemoryAllocator::ReleaseCachedMemory(int deviceId)
+{
+    auto cache = GPUMemoryCache::GetInstance(deviceId);
+    if (cache)
+    {
+        PrepareDevice(deviceId);
+        cache->ReleaseCachedMemory();
+    }
+}
+
+/*static*/ void TracingGPUMemoryAllocator::PrintCacheStatistics()
+{
+    for (int deviceId = 0; deviceId < GPUMemoryCache::s_maxNumDevices; deviceId++)
+        GPUMemoryCache::GetInstance(deviceId)->PrintStatistics();
+}
+
+#pragma endregion
+
+#pragma region GPUGraph class
+
+static THREAD_LOCAL GPUGraph* t_capturingGraph = nullptr;
+
+GPUGraph::GPUGraph(DEVICEID_TYPE deviceId)
+    : m_deviceId(deviceId), m_stream(nullptr), m_callerStream(nullptr), m_graphExec(nullptr)
+{
+    if (!IsSupported())
+        RuntimeError("GPUGraph: CUDA graphs require CUDA 10.1 or later.");
+    PrepareDevice(m_deviceId);
+    // A blocking stream: the work of the legacy default stream before a launch is done before the graph runs, the
+    // work after it waits for the graph, and anything run on the default stream during a capture makes the capture fail.
+    CUDA_CALL(cudaStreamCreateWithFlags(&m_stream, cudaStreamDefault));
+}
+
+GPUGraph::~GPUGraph()
+{
+    // may run during stack unwinding, so errors are ignored
+    PrepareDevice(m_deviceId);
+    if (t_capturingGraph == this)
+        EndCapture();
+    cudaStreamSynchronize(m_stream);
+#if CUDART_VERSION >= 10010
+    if (m_graphExec)
+        cudaGraphExecDestroy(m_graphExec);
+#endif
+    for (auto bufferPtr : m_deferredFrees)
+        TracingGPUMemoryAllocator::Free<char>(m_deviceId, (char*) bufferPtr, /*ignoreCUDARetCode=*/true);
+    cudaStreamDestroy(m_stream);
+}
+
+/*static*/ bool GPUGraph::IsSupported()
+{
+#if CUDART_VERSION >= 10010
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*static*/ GPUGraph* GPUGraph::GetCapturingGraph()
+{
+    return t_capturingGraph;
+}
+
+void GPUGraph::BeginCapture()
+{
+#if CUDART_VERSION >= 10010
+    if (t_capturingGraph)
+        LogicError("GPUGraph: Captures cannot be nested.");
+    PrepareDevice(m_deviceId);
+    if (m_graphExec)
+    {
+        CUDA_CALL(cudaStreamSynchronize(m_stream));
+        CUDA_CALL(cudaGraphExecDestroy(m_graphExec));
+        m_graphExec = nullptr;
+    }
+    m_callerStream = GetStream();
+    SetStream(m_stream);
+    t_capturingGraph = this;
+    // relaxed, so that buffers can be allocated from the driver while capturing
+    CUDA_CALL(cudaStreamBeginCapture(m_stream, cudaStreamCaptureModeRelaxed));
+#endif
+}
+
+bool GPUGraph::EndCapture()
+{
+#if CUDART_VERSION >= 10010
+    if (t_capturingGraph != this)
+        LogicError("GPUGraph: EndCapture() without BeginCapture().");
+    t_capturingGraph = nullptr;
+    SetStream(m_callerStream);
+
+    cudaGraph_t graph = nullptr;
+    auto status = cudaStreamEndCapture(m_stream, &graph);
+    if (status == cudaSuccess)
+#if CUDART_VERSION >= 12000
+        status = cudaGraphInstantiate(&m_graphExec, graph, 0);
+#else
+        status = cudaGraphInstantiate(&m_graphExec, graph, nullptr, nullptr, 0);
+#endif
+    if (graph)
+        cudaGraphDestroy(graph); // the instance does not need it
+    if (status != cudaSuccess)
+    {
+        cudaGetLastError(); // errors of a capture are not sticky, but they are still reported by the next call otherwise
+        m_graphExec = nullptr;
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void GPUGraph::Launch()
+{
+#if CUDART_VERSION >= 10010
+    if (!m_graphExec)
+        LogicError("GPUGraph: Launch() without a successful capture.");
+    PrepareDevice(m_deviceId);
+    CUDA_CALL(cudaGraphLaunch(m_graphExec, m_stream));
+#endif
+}
+
+#pragma endregion
+
 template <typename AllocatedElemType>
 AllocatedElemType* TracingGPUMemoryAllocator::Allocate(int deviceId, size_t numRows, size_t numCols)
 {
@@ -201,11 +583,23 @@ AllocatedElemType* TracingGPUMemoryAllocator::Allocate(int deviceId, size_t numE
 template <typename AllocatedElemType>
 void TracingGPUMemoryAllocator::Free(int deviceId, AllocatedElemType* bufferPtr, bool ignoreCUDARetCode /*= false*/)
 {
+    // the GPU work being captured may use the buffer whenever the graph is launched
+    auto capturingGraph = GPUGraph::GetCapturingGraph();
+    if (capturingGraph)
+    {
+        capturingGraph->DeferFree((void*) bufferPtr);
+        return;
+    }
+
     PrepareDevice(deviceId);
-    if (ignoreCUDARetCode)
-        cudaFree((void*) bufferPtr);
-    else
-        CUDA_CALL(cudaFree((void*) bufferPtr));
+    auto cache = GPUMemoryCache::GetInstance(deviceId);
+    if (!cache || !cache->Release((void*) bufferPtr, ignoreCUDARetCode)) // not allocated through the cache
+    {
+        if (ignoreCUDARetCode)
+            cudaFree((void*) bufferPtr);
+        else
+            CUDA_CALL(cudaFree((void*) bufferPtr));
+    }
 
     if (IsTraceEnabled())
     {
@@ -221,7 +615,14 @@ AllocatedElemType* TracingGPUMemoryAllocator::AllocateNoTrace(int deviceId, size
     AllocatedElemType* deviceBufferPtr;
 
     PrepareDevice(deviceId);
-    CUDA_CALL(cudaMalloc((void**) &deviceBufferPtr, sizeof(AllocatedElemType) * numElements));
+    auto cache = IsCachingEnabled() ? GPUMemoryCache::GetInstance(deviceId) : nullptr;
+    if (cache)
+        deviceBufferPtr = (AllocatedElemType*) cache->Allocate(sizeof(AllocatedElemType) * numElements);
+    else
+    {
+        CountDeviceMalloc();
+        CUDA_CALL(cudaMalloc((void**) &deviceBufferPtr, sizeof(AllocatedElemType) * numElements));
+    }
 
     return deviceBufferPtr;
 }
@@ -249,6 +650,106 @@ void PrepareDevice(DEVICEID_TYPE deviceId)
     currentDevice = deviceId;
 }
 
+// Tells whether 'device' can access the memory of 'peer', enabling that once per pair of devices.
+static bool EnsurePeerAccess(DEVICEID_TYPE device, DEVICEID_TYPE peer)
+{
+    static std::mutex peerAccessMutex;
+    static std::map<std::pair<DEVICEID_TYPE, DEVICEID_TYPE>, bool> peerAccess; // of the pairs seen so far
+    std::lock_guard<std::mutex> lock(peerAccessMutex);
+    auto iter = peerAccess.find(std::make_pair(device, peer));
+    if (iter != peerAccess.end())
+        return iter->second;
+
+    int canAccessPeer = false;
+    CUDA_CALL(cudaDeviceCanAccessPeer(&canAccessPeer, device, peer));
+    if (canAccessPeer)
+    {
+        PrepareDevice(device);
+        cudaError_t status = cudaDeviceEnablePeerAccess(peer, 0);
+        if (status != cudaSuccess && status != cudaErrorPeerAccessAlreadyEnabled)
+        {
+            fprintf(stderr, "EnsurePeerAccess: Device %d cannot access the memory of device %d (%s), copies between them are staged through the host.\n",
+                    (int) device, (int) peer, cudaGetErrorString(status));
+            canAccessPeer = false;
+        }
+        cudaGetLastError(); // (clear the error)
+    }
+    peerAccess[std::make_pair(device, peer)] = canAccessPeer != 0;
+    return canAccessPeer != 0;
+}
+
+// the stream of each device for copies from its peers, created on first use
+static cudaStream_t GetPeerCopyStream(DEVICEID_TYPE device)
+{
+    static std::mutex streamsMutex;
+    static std::map<DEVICEID_TYPE, cudaStream_t> streams;
+    std::lock_guard<std::mutex> lock(streamsMutex);
+    auto& stream = streams[device];
+    if (!stream)
+    {
+        PrepareDevice(device);
+        CUDA_CALL(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
+    }
+    return stream;
+}
+
+// Copies 'numBytes' from the memory of 'srcDevice' to that of 'dstDevice', after the work queued on both devices so
+// far and before the work queued on them from now on. With peer access, this is a direct cudaMemcpyPeerAsync() on the
+// copy stream of the destination, so that the host does not wait for it; otherwise it is staged through pinned host
+// memory. Leaves 'dstDevice' as the current device.
+void CopyBetweenDevices(void* dst, DEVICEID_TYPE dstDevice, const void* src, DEVICEID_TYPE srcDevice, size_t numBytes)
+{
+    if (numBytes == 0)
+        return;
+    if (dstDevice == srcDevice)
+    {
+        PrepareDevice(dstDevice);
+        CUDA_CALL(cudaMemcpyAsync(dst, src, numBytes, cudaMemcpyDeviceToDevice, t_stream));
+        return;
+    }
+
+    if (!EnsurePeerAccess(dstDevice, srcDevice))
+    {
+        void* staged = nullptr;
+        PrepareDevice(srcDevice);
+        CUDA_CALL(cudaMallocHost(&staged, numBytes));
+        CUDA_CALL(cudaMemcpy(staged, src, numBytes, cudaMemcpyDeviceToHost));
+        PrepareDevice(dstDevice);
+        CUDA_CALL(cudaMemcpy(dst, staged, numBytes, cudaMemcpyHostToDevice));
+        CUDA_CALL(cudaFreeHost(staged));
+        return;
+    }
+    if (t_stream != cudaStreamDefault) // a stream of one of the devices; the legacy streams synchronize with it
+    {
+        PrepareDevice(dstDevice);
+        CUDA_CALL(cudaMemcpyPeer(dst, dstDevice, src, srcDevice, numBytes));
+        return;
+    }
+
+    // order the copy between the work on the (legacy default) streams of both devices by events
+    cudaStream_t copyStream = GetPeerCopyStream(dstDevice);
+    cudaEvent_t srcReady, dstReady, copied;
+    PrepareDevice(srcDevice);
+    CUDA_CALL(cudaEventCreateWithFlags(&srcReady, cudaEventDisableTiming));
+    CUDA_CALL(cudaEventRecord(srcReady, cudaStreamDefault));
+    PrepareDevice(dstDevice);
+    CUDA_CALL(cudaEventCreateWithFlags(&dstReady, cudaEventDisableTiming));
+    CUDA_CALL(cudaEventCreateWithFlags(&copied, cudaEventDisableTiming));
+    CUDA_CALL(cudaEventRecord(dstReady, cudaStreamDefault));
+    CUDA_CALL(cudaStreamWaitEvent(copyStream, srcReady, 0));
+    CUDA_CALL(cudaStreamWaitEvent(copyStream, dstReady, 0));
+    CUDA_CALL(cudaMemcpyPeerAsync(dst, dstDevice, src, srcDevice, numBytes, copyStream));
+    CUDA_CALL(cudaEventRecord(copied, copyStream));
+    CUDA_CALL(cudaStreamWaitEvent(cudaStreamDefault, copied, 0));
+    PrepareDevice(srcDevice); // the source may be freed or overwritten once the copy is done
+    CUDA_CALL(cudaStreamWaitEvent(cudaStreamDefault, copied, 0));
+    PrepareDevice(dstDevice);
+    // (events are released once they have completed)
+    CUDA_CALL(cudaEventDestroy(srcReady));
+    CUDA_CALL(cudaEventDestroy(dstReady));
+    CUDA_CALL(cudaEventDestroy(copied));
+}
+
 #pragma region DeviceBoundNumber class
 
 template <class ElemType>
@@ -376,37 +877,10 @@ void GPUMatrix<ElemType>::ChangeDeviceTo(DEVICEID_TYPE to_id)
 
     ElemType* d_dst = TracingGPUMemoryAllocator::Allocate<ElemType>(to_id, m_numRows, m_numCols);
 
+    // (on init we often have zero sized allocations)
+    CopyBetweenDevices(d_dst, to_id, Data(), GetComputeDeviceId(), sizeof(ElemType) * m_numRows * m_numCols);
     SetSizeAllocated(m_numRows * m_numCols);
 
-    // check to make sure we have something to copy (on init we often have zero sized allocations)
-    if (GetSizeAllocated() > 0)
-    {
-        // first try peer access
-        int canAccessPeer = false;
-        CUDA_CALL(cudaDeviceCanAccessPeer(&canAccessPeer, to_id, GetComputeDeviceId()));
-        if (canAccessPeer)
-        {
-            cudaError_t cudaStatus = cudaDeviceEnablePeerAccess(GetComputeDeviceId(), 0);
-            if (cudaStatus != cudaErrorPeerAccessAlreadyEnabled)
-            {
-                CUDA_CALL(cudaStatus);
-            }
-            CUDA_CALL(cudaMemcpyPeer(d_dst, to_id, Data(), GetComputeDeviceId(), sizeof(ElemType) * m_numRows * m_numCols));
-        }
-        else
-        {
-            // peer access didn't work, just copy normal
-            // make this more efficient by keeping some buffers available for each copy
-            ElemType* h_dst = NULL;
-            PrepareDevice();
-            CUDA_CALL(cudaMallocHost((void**) &h_dst, sizeof(ElemType) * m_numRows * m_numCols));
-            CUDA_CALL(cudaMemcpy(h_dst, Data(), sizeof(ElemType) * m_numRows * m_numCols, cudaMemcpyDeviceToHost));
-            PrepareDevice((DEVICEID_TYPE) to_id);
-            CUDA_CALL(cudaMemcpy(d_dst, h_dst, sizeof(ElemType) * m_numRows * m_numCols, cudaMemcpyHostToDevice));
-            CUDA_CALL(cudaFreeHost(h_dst));
-        }
-    }
-
     TracingGPUMemoryAllocator::Free<ElemType>(GetComputeDeviceId(), Buffer());
     SetBuffer(d_dst, m_numRows * m_numCols * sizeof(ElemType));
 
@@ -858,13 +1332,16 @@ GPUMatrix<ElemType> GPUMatrix<ElemType>::Transpose() const
     return c;
 }
 
-// GetCublasHandle - get a cublas handle for the given GPU, should only need one per GPU
+// GetCublasHandle - get a cublas handle for the given GPU, one per GPU and thread (a handle is bound to one stream at a
+// time, and threads may use streams of their own, see SetStream())
 // computeDevice - The compute device for which the cublas handle is desired
 // returns: cublas handle
 // NOTE: we currently don't bother to ever free the CUBLAS handle, it will be freed automatically by CUDA when the process ends
 template <class ElemType>
 cublasHandle_t GPUMatrix<ElemType>::GetCublasHandle(int computeDevice /*=-1*/)
 {
+    static THREAD_LOCAL cublasHandle_t s_cuHandle[MaxGpus] = {0};
+
     // if the compute device is not passed, get the current device from CUDA
     if (computeDevice < 0)
         cudaGetDevice(&computeDevice);
@@ -930,8 +1407,8 @@ __global__ void _doGatherColumnsOf(ElemType* us, size_t usStride, const ElemType
     if (::isnan(jInF) || jInF < 0)     // negative index means gap
         return;
     size_t jIn = (size_t)jInF;
-    //if (jIn >= aCols)
-    //    return; // actually a failure
+    if (jIn >= aCols)
+        return; // actually a failure, but the map is computed on the device (see AssignPackedIndicesOf()), so it cannot be checked on the host without a sync
 
     const ElemType&  ra = a[    i + jIn  *  aStride  ];
     ElemType&       rus = us[id/*i + jOut * usStride*/];
@@ -1001,8 +1478,8 @@ __global__ void _doScatterColumnsOf(ElemType* us, size_t usStride, size_t usCols
     if (::isnan(jOutF) || jOutF < 0)    // negative index means gap
         return;
     size_t jOut = (size_t)jOutF;
-    //if (jOut >= usCols)
-    //    return; // actually a failure  --TODO: This should not be necessary. Why is it?
+    if (jOut >= usCols)
+        return; // actually a failure, see _doGatherColumnsOf()
 
     const ElemType&  ra =  a[id/*i + jIn  *  aStride*/];
     ElemType&       rus = us[    i + jOut * usStride  ];
@@ -1057,7 +1534,8 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::DoScatterColumnsOf(ElemType beta, cons
 
     // pre-scale with beta upfront
     // Scatter may add more than one source column to the same target, so we must pre-scale with beta, and then just keep adding.
-    Scale(beta, us); // if beta is 0, then this will be a memset()
+    if (beta != 1) // (e.g. a sparse update of a large gradient must not touch the whole matrix)
+        Scale(beta, us); // if beta is 0, then this will be a memset()
 
     // launch the kernel
     CUDA_LONG NN = (CUDA_LONG)(a.GetNumElements()); // linear space identifying each individual input element
@@ -1071,6 +1549,41 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::DoScatterColumnsOf(ElemType beta, cons
     return *this;
 }
 
+template <class ElemType>
+__global__ void _assignPackedIndicesOf(ElemType* us, const ElemType* idx, const ElemType* ranges, size_t numParallelSequences, CUDA_LONG numCols)
+{
+    CUDA_LONG j = GridDim::GetLinearThreadId();
+    if (j >= numCols)
+        return;
+
+    ElemType t = idx[j]; // (NaN fails both tests)
+    if (t >= ranges[3 * j + 1] && t < ranges[3 * j + 2])
+        us[j] = ranges[3 * j] + (ElemType)((size_t)t * numParallelSequences);
+    else
+        us[j] = -1;
+}
+
+// see Matrix<ElemType>::AssignPackedIndicesOf()
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignPackedIndicesOf(const GPUMatrix<ElemType>& idx, const GPUMatrix<ElemType>& ranges, size_t numParallelSequences)
+{
+    if (idx.GetNumRows() != 1 || ranges.GetNumRows() != 3 || ranges.GetNumCols() != idx.GetNumCols())
+        InvalidArgument("AssignPackedIndicesOf: Expected a row vector of indices and a range for each of its columns.");
+    if (idx.GetComputeDeviceId() != ranges.GetComputeDeviceId() || GetComputeDeviceId() != idx.GetComputeDeviceId())
+        InvalidArgument("All matrices must be on the same GPU");
+
+    RequireSize(1, idx.GetNumCols());
+    if (IsEmpty())
+        return *this;
+    idx.PrepareDevice();
+
+    CUDA_LONG N = (CUDA_LONG)GetNumCols();
+    SyncGuard syncGuard;
+    GridDim grid(N);
+    _assignPackedIndicesOf<ElemType><<<grid.m_blocksPerGrid, grid.m_threadsPerBlock, 0, t_stream>>>(Data(), idx.Data(), ranges.Data(), numParallelSequences, N);
+    return *this;
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::SetValue(const ElemType v)
 {
@@ -1133,6 +1646,82 @@ void GPUMatrix<ElemType>::MaskColumnsValue(const GPUMatrix<char>& columnsMask, E
     _maskColumnsValue<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), columnsMask.Data(), (CUDA_LONG) GetNumCols(), (CUDA_LONG) GetNumRows(), val);
 }
 
+template <class ElemType>
+size_t GPUMatrix<ElemType>::ExtractLargestMagnitudes(size_t k, ElemType threshold, int* indices, ElemType* values)
+{
+    typedef typename MagnitudeBits<ElemType>::Type Bits;
+    CUDA_LONG N = (CUDA_LONG) GetNumElements();
+    assert(k > 0 && k <= (size_t) N);
+
+    // one device buffer for the select state, the histogram and the counters, and the selected elements
+    auto align = [](size_t bytes) { return (bytes + 15) & ~(size_t) 15; };
+    size_t stateBytes = align(sizeof(RadixSelectState<Bits>));
+    size_t countersBytes = align((256 + 2) * sizeof(unsigned int));
+    size_t indicesBytes = align(k * sizeof(int));
+    std::vector<char> packed(stateBytes + countersBytes + indicesBytes + k * sizeof(ElemType), 0);
+    reinterpret_cast<RadixSelectState<Bits>*>(packed.data())->remaining = (CUDA_LONG) k;
+
+    int deviceId = GetComputeDeviceId();
+    char* deviceBuffer = TracingGPUMemoryAllocator::Allocate<char>(deviceId, packed.size());
+    auto deviceState = reinterpret_cast<RadixSelectState<Bits>*>(deviceBuffer);
+    auto deviceHistogram = reinterpret_cast<unsigned int*>(deviceBuffer + stateBytes);
+    auto deviceCounters = deviceHistogram + 256;
+    auto deviceIndices = reinterpret_cast<int*>(deviceBuffer + stateBytes + countersBytes);
+    auto deviceValues = reinterpret_cast<ElemType*>(deviceBuffer + stateBytes + countersBytes + indicesBytes);
+    PrepareDevice();
+    CUDA_CALL(cudaMemcpyAsync(deviceBuffer, packed.data(), stateBytes + countersBytes, cudaMemcpyHostToDevice, t_stream));
+
+    // one histogram pass per digit, which stay on the device; then a single copy of the result back, the only wait for the device
+    {
+        SyncGuard syncGuard;
+        GridDim grid(N);
+        for (int shift = 8 * sizeof(Bits) - 8; shift >= 0; shift -= 8)
+        {
+            _radixSelectHistogram<ElemType><<<grid.m_blocksPerGrid, grid.m_threadsPerBlock, 0, t_stream>>>(Data(), N, deviceState, shift, deviceHistogram);
+            _radixSelectDigit<Bits><<<1, 1, 0, t_stream>>>(deviceHistogram, deviceState, shift);
+        }
+        int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+        _extractLargestMagnitudes<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), N, (CUDA_LONG) k, deviceState, threshold, deviceIndices, deviceValues, deviceCounters);
+        CUDA_CALL(cudaMemcpyAsync(packed.data(), deviceBuffer, packed.size(), cudaMemcpyDeviceToHost, t_stream));
+        CUDA_CALL(cudaStreamSynchronize(t_stream));
+    }
+    TracingGPUMemoryAllocator::Free<char>(deviceId, deviceBuffer);
+
+    // the larger elements are at the front, the ties at the back
+    auto state = reinterpret_cast<const RadixSelectState<Bits>*>(packed.data());
+    auto counters = reinterpret_cast<const unsigned int*>(packed.data() + stateBytes) + 256;
+    size_t numLarger = counters[0];
+    size_t numTies = std::min<size_t>(counters[1], state->remaining);
+    auto selectedIndices = reinterpret_cast<const int*>(packed.data() + stateBytes + countersBytes);
+    auto selectedValues = reinterpret_cast<const ElemType*>(packed.data() + stateBytes + countersBytes + indicesBytes);
+    memcpy(indices, selectedIndices, numLarger * sizeof(int));
+    memcpy(values, selectedValues, numLarger * sizeof(ElemType));
+    memcpy(indices + numLarger, selectedIndices + k - numTies, numTies * sizeof(int));
+    memcpy(values + numLarger, selectedValues + k - numTies, numTies * sizeof(ElemType));
+    return numLarger + numTies;
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::AddValuesAtIndices(const int* indices, const ElemType* values, size_t count)
+{
+    auto align = [](size_t bytes) { return (bytes + 15) & ~(size_t) 15; };
+    size_t indicesBytes = align(count * sizeof(int));
+    int deviceId = GetComputeDeviceId();
+    char* deviceBuffer = TracingGPUMemoryAllocator::Allocate<char>(deviceId, indicesBytes + count * sizeof(ElemType));
+    auto deviceIndices = reinterpret_cast<int*>(deviceBuffer);
+    auto deviceValues = reinterpret_cast<ElemType*>(deviceBuffer + indicesBytes);
+    PrepareDevice();
+    CUDA_CALL(cudaMemcpy(deviceIndices, indices, count * sizeof(int), cudaMemcpyHostToDevice));
+    CUDA_CALL(cudaMemcpy(deviceValues, values, count * sizeof(ElemType), cudaMemcpyHostToDevice));
+    {
+        SyncGuard syncGuard;
+        CUDA_LONG N = (CUDA_LONG) count;
+        int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+        _addValuesAtIndices<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), deviceIndices, deviceValues, N);
+    }
+    TracingGPUMemoryAllocator::Free<char>(deviceId, deviceBuffer);
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::SetColumn(const ElemType* colPointer, size_t colInd)
 {
@@ -1162,6 +1751,19 @@ void GPUMatrix<ElemType>::SetValue(const GPUMatrix<ElemType>& deepCopyFrom)
     SetValue(deepCopyFrom.GetNumRows(), deepCopyFrom.GetNumCols(), deepCopyFrom.GetComputeDeviceId(), deepCopyFrom.Data(), matrixFlagSetValueOnDevice);
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::AssignPeerValuesOf(const GPUMatrix<ElemType>& a)
+{
+    if (this == &a)
+        return;
+
+    RequireSize(a.GetNumRows(), a.GetNumCols());
+    if (IsEmpty())
+        return;
+
+    CopyBetweenDevices(Data(), GetComputeDeviceId(), a.Data(), a.GetComputeDeviceId(), sizeof(ElemType) * GetNumElements());
+}
+
 #if 0
 template <class ElemType>
 void GPUMatrix<ElemType>::SetValue(const CPUMatrix<ElemType>& /*deepCopyFrom*/)
@@ -1346,6 +1948,29 @@ void GPUMatrix<ElemType>::SetUniformRandomMask(const ElemType maskRate, const El
     _setMaskAndScale<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), N, maskRate, scaleValue);
 }
 
+// this = beta * this + a .* mask, where element i is masked by word (offset + i) % 4 of Philox block (offset + i) / 4 of 'key'
+// (no cuRAND generator and no mask buffer: backprop regenerates the same mask from the same key and offset)
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AddDropoutOf(const GPUMatrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue, uint64_t key, size_t offset, const ElemType beta)
+{
+    if (a.IsEmpty())
+        LogicError("AddDropoutOf: Matrix is empty.");
+
+    if (beta == 0 && this != &a)
+        RequireSize(a.GetNumRows(), a.GetNumCols());
+    else if (!(a.GetNumRows() == GetNumRows() && a.GetNumCols() == GetNumCols()))
+        InvalidArgument("AddDropoutOf: The input matrix dimensions do not match [this].");
+
+    CUDA_LONG N = (CUDA_LONG) GetNumElements();
+    uint64_t firstBlock = offset / 4;
+    CUDA_LONG numBlocks = (CUDA_LONG) ((offset + N + 3) / 4 - firstBlock);
+    int blocksPerGrid = (int) ceil(1.0 * numBlocks / GridDim::maxThreadsPerBlock);
+    a.PrepareDevice();
+    SyncGuard syncGuard;
+    _addDropoutOf<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), a.Data(), N, firstBlock, numBlocks, offset, key, (float) maskRate, scaleValue, beta);
+    return *this;
+}
+
 template <class ElemType>
 ElemType GPUMatrix<ElemType>::Adagrad(GPUMatrix<ElemType>& gradients, const bool needAveMultiplier)
 {
@@ -1493,6 +2118,154 @@ ElemType GPUMatrix<ElemType>::RmsProp(GPUMatrix<ElemType>& gradients,
     }
 }
 
+template <class ElemType>
+/*static*/ bool GPUMatrix<ElemType>::MultiTensorUpdate(const MultiTensorUpdateParams<ElemType>& params,
+                                                       const std::vector<GPUMatrix<ElemType>*>& smoothedGradients, const std::vector<GPUMatrix<ElemType>*>& gradients,
+                                                       const std::vector<GPUMatrix<ElemType>*>& values, const std::vector<ElemType>& adaMuls, bool checkForNan)
+{
+    if (values.empty())
+        return false;
+    values[0]->PrepareDevice();
+
+    // Each block updates one chunk of one tensor. The tensors and the chunks are listed in one buffer, which
+    // a single copy takes to the device, followed by the sums of the multipliers per tensor and the NaN flag (all 0).
+    const CUDA_LONG chunkSize = 16 * GridDim::maxThreadsPerBlock;
+    std::vector<MultiTensorSlot<ElemType>> slots;
+    std::vector<MultiTensorChunk> chunks;
+    for (size_t k = 0; k < values.size(); k++)
+    {
+        CUDA_LONG n = (CUDA_LONG) values[k]->GetNumElements();
+        if (n == 0)
+            continue;
+        for (CUDA_LONG begin = 0; begin < n; begin += chunkSize)
+            chunks.push_back(MultiTensorChunk{ (int) slots.size(), begin });
+        slots.push_back(MultiTensorSlot<ElemType>{ smoothedGradients[k]->Data(), gradients[k]->Data(), values[k]->Data(), n, adaMuls.empty() ? 0 : adaMuls[k] });
+    }
+    if (chunks.empty())
+        return false;
+
+    auto align = [](size_t bytes) { return (bytes + 15) & ~(size_t) 15; };
+    size_t slotsBytes = align(slots.size() * sizeof(slots[0]));
+    size_t chunksBytes = align(chunks.size() * sizeof(chunks[0]));
+    size_t sumsBytes = align(slots.size() * sizeof(ElemType));
+    std::vector<char> packed(slotsBytes + chunksBytes + sumsBytes + sizeof(int), 0);
+    memcpy(packed.data(), slots.data(), slots.size() * sizeof(slots[0]));
+    memcpy(packed.data() + slotsBytes, chunks.data(), chunks.size() * sizeof(chunks[0]));
+
+    int deviceId = values[0]->GetComputeDeviceId();
+    char* deviceBuffer = TracingGPUMemoryAllocator::Allocate<char>(deviceId, packed.size());
+    auto deviceSlots = reinterpret_cast<const MultiTensorSlot<ElemType>*>(deviceBuffer);
+    auto deviceChunks = reinterpret_cast<const MultiTensorChunk*>(deviceBuffer + slotsBytes);
+    auto deviceSums = reinterpret_cast<ElemType*>(deviceBuffer + slotsBytes + chunksBytes);
+    auto deviceNanFlag = checkForNan ? reinterpret_cast<int*>(deviceBuffer + slotsBytes + chunksBytes + sumsBytes) : nullptr;
+    // (from pageable memory, so 'packed' may go away when this returns)
+    CUDA_CALL(cudaMemcpyAsync(deviceBuffer, packed.data(), packed.size(), cudaMemcpyHostToDevice, t_stream));
+
+    int hasNan = 0;
+    {
+        SyncGuard syncGuard;
+        int blocksPerGrid = (int) chunks.size();
+        _multiTensorUpdate<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(params, deviceSlots, deviceChunks, chunkSize, deviceSums, deviceNanFlag);
+        if (params.m_needAveMultiplier)
+            _multiTensorApplyStep<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(params, deviceSlots, deviceChunks, chunkSize, deviceSums, deviceNanFlag);
+        if (checkForNan) // the only wait for the device
+        {
+            CUDA_CALL(cudaMemcpyAsync(&hasNan, deviceNanFlag, sizeof(hasNan), cudaMemcpyDeviceToHost, t_stream));
+            CUDA_CALL(cudaStreamSynchronize(t_stream));
+        }
+    }
+    TracingGPUMemoryAllocator::Free<char>(deviceId, deviceBuffer);
+    return hasNan != 0;
+}
+
+template <class ElemType>
+/*static*/ double GPUMatrix<ElemType>::MultiTensorSumOfSquares(const std::vector<const GPUMatrix<ElemType>*>& tensors)
+{
+    if (tensors.empty())
+        return 0;
+    tensors[0]->PrepareDevice();
+
+    // as in MultiTensorUpdate(): one block per chunk, the spans and chunks taken to the device with a single copy;
+    // the blocks leave one partial sum each, which a single copy brings back
+    const CUDA_LONG chunkSize = 16 * GridDim::maxThreadsPerBlock;
+    std::vector<MultiTensorSpan<ElemType>> spans;
+    std::vector<MultiTensorChunk> chunks;
+    for (auto tensor : tensors)
+    {
+        CUDA_LONG n = (CUDA_LONG) tensor->GetNumElements();
+        if (n == 0)
+            continue;
+        for (CUDA_LONG begin = 0; begin < n; begin += chunkSize)
+            chunks.push_back(MultiTensorChunk{ (int) spans.size(), begin });
+        spans.push_back(MultiTensorSpan<ElemType>{ tensor->Data(), n });
+    }
+    if (chunks.empty())
+        return 0;
+
+    auto align = [](size_t bytes) { return (bytes + 15) & ~(size_t) 15; };
+    size_t spansBytes = align(spans.size() * sizeof(spans[0]));
+    size_t chunksBytes = align(chunks.size() * sizeof(chunks[0]));
+    std::vector<char> packed(spansBytes + chunksBytes, 0);
+    memcpy(packed.data(), spans.data(), spans.size() * sizeof(spans[0]));
+    memcpy(packed.data() + spansBytes, chunks.data(), chunks.size() * sizeof(chunks[0]));
+
+    int deviceId = tensors[0]->GetComputeDeviceId();
+    char* deviceBuffer = TracingGPUMemoryAllocator::Allocate<char>(deviceId, packed.size() + chunks.size() * sizeof(double));
+    auto deviceSpans = reinterpret_cast<const MultiTensorSpan<ElemType>*>(deviceBuffer);
+    auto deviceChunks = reinterpret_cast<const MultiTensorChunk*>(deviceBuffer + spansBytes);
+    auto devicePartialSums = reinterpret_cast<double*>(deviceBuffer + spansBytes + chunksBytes);
+    CUDA_CALL(cudaMemcpyAsync(deviceBuffer, packed.data(), packed.size(), cudaMemcpyHostToDevice, t_stream));
+
+    std::vector<double> partialSums(chunks.size());
+    {
+        SyncGuard syncGuard;
+        _multiTensorSumOfSquares<ElemType><<<(int) chunks.size(), GridDim::maxThreadsPerBlock, 0, t_stream>>>(deviceSpans, deviceChunks, chunkSize, devicePartialSums);
+        CUDA_CALL(cudaMemcpyAsync(partialSums.data(), devicePartialSums, partialSums.size() * sizeof(double), cudaMemcpyDeviceToHost, t_stream));
+        CUDA_CALL(cudaStreamSynchronize(t_stream));
+    }
+    TracingGPUMemoryAllocator::Free<char>(deviceId, deviceBuffer);
+
+    double sum = 0;
+    for (double partialSum : partialSums)
+        sum += partialSum;
+    return sum;
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::AssignAugmentedImages(const unsigned char* images, size_t numCols, const ImageAugmentationParams& params, const ElemType* mean, uint64_t key)
+{
+    RequireSize((size_t) params.m_width * params.m_height * params.m_channels, numCols);
+    if (numCols == 0)
+        return;
+    PrepareDevice();
+
+    SyncGuard syncGuard;
+    _assignAugmentedImages<ElemType><<<(int) numCols, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), images, params, mean, key);
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::CompressValuesInto(char* codes, size_t columnBytes, ValueCompression compression) const
+{
+    if (IsEmpty())
+        return;
+    PrepareDevice();
+
+    SyncGuard syncGuard;
+    _compressValues<ElemType><<<(int) GetNumCols(), GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), (CUDA_LONG) GetNumRows(), codes, columnBytes, compression);
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::AssignDecompressedValuesOf(const char* codes, size_t columnBytes, ValueCompression compression, size_t numRows, size_t numCols)
+{
+    RequireSize(numRows, numCols);
+    if (IsEmpty())
+        return;
+    PrepareDevice();
+
+    SyncGuard syncGuard;
+    _decompressValues<ElemType><<<(int) numCols, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), (CUDA_LONG) numRows, codes, columnBytes, compression);
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::Reshape(const size_t numRows, const size_t numCols)
 {
@@ -1519,22 +2292,10 @@ void GPUMatrix<ElemType>::Resize(const size_t numRows, const size_t numCols, boo
     if (GetNumRows() == numRows && GetNumCols() == numCols)
         return;
 
-    size_t numElements = numRows * numCols;
-    if (numElements > GetSizeAllocated() ||                 // grow allocation
-        (!growOnly && numElements != GetSizeAllocated()))   // shrink allocation if not growOnly
-    {
-        // reallocate buffer if numElements > 0
-        ElemType* pArray = nullptr;
-        if (numElements > 0)
-            pArray = TracingGPUMemoryAllocator::Allocate<ElemType>(GetComputeDeviceId(), numRows, numCols);
-
-        // If the buffer exists, free it
-        if (Buffer())
-            TracingGPUMemoryAllocator::Free<ElemType>(GetComputeDeviceId(), Buffer());
-
-        SetBuffer(pArray, numElements * sizeof(ElemType));
-        SetSizeAllocated(numElements);
-    }
+    // grow with spare capacity, shrink as MatrixResizePolicy allows
+    size_t capacity = MatrixResizePolicy::GetCapacity(numRows * numCols, GetSizeAllocated(), growOnly);
+    if (capacity != GetSizeAllocated())
+        Reallocate(capacity, false);
     
     // success
     m_sliceViewOffset = 0;
@@ -1542,6 +2303,40 @@ void GPUMatrix<ElemType>::Resize(const size_t numRows, const size_t numCols, boo
     m_numCols = numCols;
 }
 
+// release the spare capacity that Resize() left, keeping the content
+template <class ElemType>
+void GPUMatrix<ElemType>::ShrinkToFit()
+{
+    if (GetSizeAllocated() == GetNumElements())
+        return;
+    VerifyResizable(__func__);
+    Reallocate(GetNumElements(), true);
+}
+
+// replace the buffer by one of 'capacity' elements, into which the content is moved if 'keepContent'
+template <class ElemType>
+void GPUMatrix<ElemType>::Reallocate(size_t capacity, bool keepContent)
+{
+    ElemType* pArray = nullptr;
+    if (capacity > 0)
+    {
+        pArray = TracingGPUMemoryAllocator::Allocate<ElemType>(GetComputeDeviceId(), capacity);
+        MatrixResizePolicy::CountAllocation();
+        if (keepContent && GetNumElements() > 0)
+            CUDA_CALL(cudaMemcpy(pArray, Data(), std::min(capacity, GetNumElements()) * sizeof(ElemType), cudaMemcpyDeviceToDevice));
+    }
+    if (GetSizeAllocated() > 0)
+        MatrixResizePolicy::CountReallocation();
+
+    // If the buffer exists, free it
+    if (Buffer())
+        TracingGPUMemoryAllocator::Free<ElemType>(GetComputeDeviceId(), Buffer());
+
+    SetBuffer(pArray, capacity * sizeof(ElemType));
+    SetSizeAllocated(capacity);
+    m_sliceViewOffset = 0;
+}
+
 template <class ElemType>
 size_t GPUMatrix<ElemType>::LocateElement(const size_t row, const size_t col) const
 {
@@ -1942,6 +2737,26 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignSigmoidOf(const GPUMatrix<ElemTy
 DEF_ELEMWISE_INPLACE_FUNC(SigmoidDerivative)
 DEF_ELEMWISE_ASSIGN_FUNC(SigmoidDerivative)
 
+// this = f(this + bias), with the column vector bias added to every column, in one kernel
+// This is the epilogue of the cuBLAS GEMM in Matrix::MultiplyAndAddBias(). f is opCopy, opSigmoid, opTanh or opLinearRectifier.
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AddBiasAndActivation(const GPUMatrix<ElemType>& bias, ElementWiseOperator activation)
+{
+    if (IsEmpty())
+        LogicError("AddBiasAndActivation: Matrix is empty.");
+    if (bias.GetNumElements() != GetNumRows())
+        InvalidArgument("AddBiasAndActivation: The bias must have one element per row.");
+    if (activation != opCopy && activation != opSigmoid && activation != opTanh && activation != opLinearRectifier)
+        InvalidArgument("AddBiasAndActivation: Unsupported activation %d.", (int) activation);
+
+    CUDA_LONG N = (CUDA_LONG) GetNumElements();
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    PrepareDevice();
+    SyncGuard syncGuard;
+    _addBiasAndActivation<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(Data(), bias.Data(), activation, (CUDA_LONG) GetNumRows(), N);
+    return *this;
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::AssignNoiseContrastiveEstimation(const GPUMatrix<ElemType>& a,
                                                            const GPUMatrix<ElemType>& b, const GPUMatrix<ElemType>& bias, size_t sampleCount, GPUMatrix<ElemType>& tmp, GPUMatrix<ElemType>& c)
@@ -2782,6 +3597,15 @@ void GPUMatrix<ElemType>::VectorMax(GPUMatrix<ElemType>& maxIndexes, GPUMatrix<E
     maxValues.RequireSize(topK, n);
     maxIndexes.RequireSize(topK, n);
 
+    // small k (e.g. the top-5 error): a selection per column instead of sorting the whole matrix twice
+    const int MaxSelectK = 32;
+    if (topK <= MaxSelectK)
+    {
+        const int ThreadsPerBlock = 64; // (MaxSelectK values and rows of each thread in shared memory)
+        _vectorTopKPerColumn<ThreadsPerBlock, MaxSelectK><<<n, ThreadsPerBlock, 0, t_stream>>>(us.Data(), maxIndexes.Data(), maxValues.Data(), m, topK);
+        return;
+    }
+
     // To sort matrix columns we use 2-pass _stable_ sort algorithm:
     // 1. Sort by values (descending) with corresponding row/col indexes.
     // 2. Sort by col indices (ascending) with corresponding values/row indices.
@@ -3116,6 +3940,38 @@ void GPUMatrix<ElemType>::ConvolutionBackwardKernel(const GPUMatrix<ElemType>& i
                                                                    runs.Data(), Data(), kernelGrad.Data());
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::DepthwiseConvolutionForward(const GPUMatrix<ElemType>& kernel, const DepthwiseConvolutionShape& shape, GPUMatrix<ElemType>& output) const
+{
+    const int BlockSize = 128;
+    auto gdim = dim3((output.GetNumRows() + BlockSize - 1)/ BlockSize, std::min((int)GetNumCols(), 65535));
+    PrepareDevice();
+    SyncGuard syncGuard;
+    kDepthwiseConvolutionForward<<<gdim, BlockSize, 0, t_stream>>>((int)GetNumCols(), shape, kernel.Data(), Data(), (int)GetNumRows(),
+                                                                     output.Data(), (int)output.GetNumRows());
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::DepthwiseConvolutionBackwardData(const GPUMatrix<ElemType>& kernel, const DepthwiseConvolutionShape& shape, GPUMatrix<ElemType>& grad) const
+{
+    const int BlockSize = 128;
+    auto gdim = dim3((grad.GetNumRows() + BlockSize - 1)/ BlockSize, std::min((int)GetNumCols(), 65535));
+    PrepareDevice();
+    SyncGuard syncGuard;
+    kDepthwiseConvolutionBackwardData<<<gdim, BlockSize, 0, t_stream>>>((int)GetNumCols(), shape, kernel.Data(), Data(), (int)GetNumRows(),
+                                                                          grad.Data(), (int)grad.GetNumRows());
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::DepthwiseConvolutionBackwardKernel(const GPUMatrix<ElemType>& in, const DepthwiseConvolutionShape& shape, GPUMatrix<ElemType>& kernelGrad) const
+{
+    const int BlockSize = 256;
+    PrepareDevice();
+    SyncGuard syncGuard;
+    kDepthwiseConvolutionBackwardKernel<BlockSize><<<(int)kernelGrad.GetNumElements(), BlockSize, 0, t_stream>>>((int)GetNumCols(), shape, in.Data(), (int)in.GetNumRows(),
+                                                                                                                  Data(), (int)GetNumRows(), kernelGrad.Data());
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::MaxPoolingForward(const GPUMatrix<int>& mpRowCol, const GPUMatrix<int>& mpRowIndices, const GPUMatrix<int>& indices, GPUMatrix<ElemType>& output) const
 {
@@ -3304,6 +4160,19 @@ static cublasStatus_t cublas_gemm(cublasHandle_t handle, cublasOperation_t trans
 {
     return cublasDgemm(handle, transa, transb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
 }
+#if CUDA_VERSION >= 8000
+// float/double overloads of cublasSgemmStridedBatched()/cublasDgemmStridedBatched()
+static cublasStatus_t cublas_gemmStridedBatched(cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k, const float* alpha, const float* A, int lda, long long strideA,
+                                                const float* B, int ldb, long long strideB, const float* beta, float* C, int ldc, long long strideC, int batchCount)
+{
+    return cublasSgemmStridedBatched(handle, transa, transb, m, n, k, alpha, A, lda, strideA, B, ldb, strideB, beta, C, ldc, strideC, batchCount);
+}
+static cublasStatus_t cublas_gemmStridedBatched(cublasHandle_t handle, cublasOperation_t transa, cublasOperation_t transb, int m, int n, int k, const double* alpha, const double* A, int lda, long long strideA,
+                                                const double* B, int ldb, long long strideB, const double* beta, double* C, int ldc, long long strideC, int batchCount)
+{
+    return cublasDgemmStridedBatched(handle, transa, transb, m, n, k, alpha, A, lda, strideA, B, ldb, strideB, beta, C, ldc, strideC, batchCount);
+}
+#endif
 static cublasStatus_t cublas_axpy(cublasHandle_t handle, int n, const float* alpha, const float* x, int incx, float* y, int incy)
 {
     return cublasSaxpy(handle, n, alpha, x, incx, y, incy);
@@ -3340,6 +4209,48 @@ void GPUMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const GPUMatrix
     c.m_numCols = n;
 }
 
+// c[:, j] = alpha * op(a_j) * op(b_j) + beta * c[:, j], where the column j of a holds a_j of aRows rows and that of b holds b_j
+template <class ElemType>
+void GPUMatrix<ElemType>::BatchMultiplyAndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& a, const bool transposeA, size_t aRows, const GPUMatrix<ElemType>& b, const bool transposeB, size_t bRows,
+                                                      ElemType beta, GPUMatrix<ElemType>& c)
+{
+    a.PrepareDevice();
+    if ((a.GetComputeDeviceId() != b.GetComputeDeviceId()) || (b.GetComputeDeviceId() != c.GetComputeDeviceId())) // different GPUs
+        InvalidArgument("All matrices must be on the same GPU");
+    if (a.IsEmpty() || b.IsEmpty())
+        LogicError("BatchMultiplyAndWeightedAdd: One of the input matrices is empty.");
+    if (aRows == 0 || bRows == 0 || a.m_numRows % aRows != 0 || b.m_numRows % bRows != 0)
+        InvalidArgument("BatchMultiplyAndWeightedAdd: The columns of a and b must hold matrices of %d and %d rows.", (int) aRows, (int) bRows);
+    if (a.m_numCols != b.m_numCols)
+        InvalidArgument("BatchMultiplyAndWeightedAdd: a and b must have the same number of columns.");
+
+    const size_t aCols = a.m_numRows / aRows;
+    const size_t bCols = b.m_numRows / bRows;
+    int m = int(transposeA ? aCols : aRows);
+    int k = int(transposeA ? aRows : aCols);
+    int l = int(transposeB ? bCols : bRows);
+    int n = int(transposeB ? bRows : bCols);
+    if (k != l)
+        InvalidArgument("BatchMultiplyAndWeightedAdd: The inner dimensions of a and b must match.");
+
+    const int batchSize = (int) a.m_numCols;
+    if (beta == 0)
+        c.RequireSize(m * n, batchSize);
+    else
+        c.VerifySize(m * n, batchSize); // Can't resize if beta != 0
+
+    cublasHandle_t cuHandle = GetCublasHandle(b.GetComputeDeviceId());
+    cublasOperation_t transA = transposeA ? CUBLAS_OP_T : CUBLAS_OP_N;
+    cublasOperation_t transB = transposeB ? CUBLAS_OP_T : CUBLAS_OP_N;
+#if CUDA_VERSION >= 8000
+    CUBLAS_CALL(cublas_gemmStridedBatched(cuHandle, transA, transB, m, n, k, &alpha, a.Data(), (int) aRows, (long long) a.m_numRows, b.Data(), (int) bRows, (long long) b.m_numRows,
+                                          &beta, c.Data(), m, (long long) c.m_numRows, batchSize));
+#else
+    for (int j = 0; j < batchSize; j++)
+        CUBLAS_CALL(cublas_gemm(cuHandle, transA, transB, m, n, k, &alpha, a.Data() + j * a.m_numRows, (int) aRows, b.Data() + j * b.m_numRows, (int) bRows, &beta, c.Data() + j * c.m_numRows, m));
+#endif
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::Multiply1x1AndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& b, ElemType beta, GPUMatrix<ElemType>& c)
 {
@@ -3943,6 +4854,18 @@ bool GPUMatrix<ElemType>::AreEqual(const GPUMatrix<ElemType>& a, const GPUMatrix
     return bResult;
 }
 
+template <class ElemType>
+/*static*/ void GPUMatrix<ElemType>::UpdateNonFiniteFlag(const ElemType* data, size_t numElements, GPUMatrix<ElemType>& flag)
+{
+    if (numElements == 0)
+        return;
+    flag.PrepareDevice();
+    CUDA_LONG N = (CUDA_LONG) numElements;
+    int blocksPerGrid = (int) ceil(1.0 * N / GridDim::maxThreadsPerBlock);
+    SyncGuard syncGuard;
+    _updateNonFiniteFlag<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(data, N, flag.Data());
+}
+
 // see Matrix<ElemType>::TensorShuffleScaleAndAdd() for comments
 template <class ElemType>
 void GPUMatrix<ElemType>::TensorShuffleScaleAndAdd(ElemType keepWeight, const GPUMatrix<ElemType>& a, size_t D, size_t S, size_t M, size_t K, size_t T, ElemType scaleFactor, const GPUMatrix<ElemType>& b, GPUMatrix<ElemType>& c)
@@ -4272,6 +5195,59 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignSequenceError(const ElemType hsm
     return *this;
 }
 
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignCTCScore(const GPUMatrix<ElemType>& logProbs, GPUMatrix<ElemType>& alpha, GPUMatrix<ElemType>& beta,
+                                                         const GPUMatrix<ElemType>& labelSequences, GPUMatrix<ElemType>& totalScore,
+                                                         const std::vector<size_t>& uttToChanInd, const std::vector<size_t>& uttBeginFrame, const std::vector<size_t>& uttFrameNum,
+                                                         const std::vector<size_t>& uttLabelNum, const size_t numParallelSequences, const size_t maxFrameNum, const size_t blankTokenId)
+{
+    const size_t numUtts = uttToChanInd.size();
+    const size_t maxLabelNum = labelSequences.GetNumRows();
+    const size_t maxS = 2 * maxLabelNum + 1; // labels with a blank before, between and after them
+    const size_t numClasses = logProbs.GetNumRows();
+    alpha.RequireSize(maxS, maxFrameNum * numUtts);
+    beta.RequireSize(maxS, maxFrameNum * numUtts);
+    RequireSize(numClasses, logProbs.GetNumCols());
+    totalScore.RequireSize(1, 1);
+    SetValue(0);
+    if (numUtts == 0)
+    {
+        totalScore.SetValue(0);
+        return *this;
+    }
+
+    // the utterance descriptions are the only host-to-device copy; nothing is copied back
+    std::vector<size_t> uttInfo(4 * numUtts);
+    for (size_t u = 0; u < numUtts; u++)
+    {
+        uttInfo[4 * u + 0] = uttToChanInd[u];
+        uttInfo[4 * u + 1] = uttBeginFrame[u];
+        uttInfo[4 * u + 2] = uttFrameNum[u];
+        uttInfo[4 * u + 3] = uttLabelNum[u];
+    }
+    int deviceId = GetComputeDeviceId();
+    size_t* deviceUttInfo = TracingGPUMemoryAllocator::Allocate<size_t>(deviceId, uttInfo.size());
+    PrepareDevice();
+    CUDA_CALL(cudaMemcpyAsync(deviceUttInfo, uttInfo.data(), uttInfo.size() * sizeof(size_t), cudaMemcpyHostToDevice, t_stream));
+
+    {
+        SyncGuard syncGuard;
+        GridDim positions(numUtts * maxS);
+        for (size_t t = 0; t < maxFrameNum; t++)
+            _assignCTCAlphaScore<ElemType><<<positions.m_blocksPerGrid, positions.m_threadsPerBlock, 0, t_stream>>>(alpha.Data(), logProbs.Data(), labelSequences.Data(), deviceUttInfo,
+                                                                                                                  t, numUtts, maxS, maxLabelNum, numClasses, numParallelSequences, blankTokenId);
+        for (size_t t = maxFrameNum; t-- > 0;)
+            _assignCTCBetaScore<ElemType><<<positions.m_blocksPerGrid, positions.m_threadsPerBlock, 0, t_stream>>>(beta.Data(), logProbs.Data(), labelSequences.Data(), deviceUttInfo,
+                                                                                                                 t, numUtts, maxS, maxLabelNum, numClasses, numParallelSequences, blankTokenId);
+        GridDim frames(numUtts * maxFrameNum);
+        _assignCTCOccupancy<ElemType><<<frames.m_blocksPerGrid, frames.m_threadsPerBlock, 0, t_stream>>>(Data(), logProbs.Data(), alpha.Data(), beta.Data(), labelSequences.Data(), deviceUttInfo,
+                                                                                                       numUtts, maxFrameNum, maxS, maxLabelNum, numClasses, numParallelSequences, blankTokenId);
+        _assignCTCTotalScore<ElemType><<<1, 1, 0, t_stream>>>(totalScore.Data(), alpha.Data(), deviceUttInfo, numUtts, maxS);
+    }
+    TracingGPUMemoryAllocator::Free<size_t>(deviceId, deviceUttInfo);
+    return *this;
+}
+
 #pragma endregion Static BLAS Functions
 
 /// f = logadd(f, vec) to get the logadd sum of vector elments
@@ -4515,9 +5491,6 @@ template class GPUMatrix<double>;
 template class DeviceBoundNumber<float>;
 template class DeviceBoundNumber<double>;
 
-template <class ElemType>
-cublasHandle_t GPUMatrix<ElemType>::s_cuHandle[GPUMatrix<ElemType>::MaxGpus] = {0};
-
 template <class ElemType>
 void* GPUMatrix<ElemType>::s_curandGenerator = NULL;
 
@@ -33,6 +33,8 @@ struct cublasContext;
 typedef struct cublasContext* cublasHandle_t;
 struct CUstream_st;
 typedef struct CUstream_st* cudaStream_t;
+struct CUgraphExec_st;
+typedef struct CUgraphExec_st* cudaGraphExec_t;
 
 #ifdef _WIN32
 #ifndef MATH_API
@@ -84,6 +86,59 @@ public:
     ~SyncGuard();
 };
 
+// -----------------------------------------------------------------------
+// TensorOpKernels -- selects the kernels of the elementwise tensor ops
+// -----------------------------------------------------------------------
+
+class TensorOpKernels
+{
+private:
+    static bool s_areFastPathsEnabled;
+
+public:
+    // Contiguous and simply broadcast operands are processed by vectorized kernels by default. Disabling them
+    // falls back to the generic strided kernel, e.g. for timing the two against each other.
+    static MATH_API void EnableFastPaths(bool enable);
+    static bool AreFastPathsEnabled() { return s_areFastPathsEnabled; }
+};
+
+// -----------------------------------------------------------------------
+// GPUGraph -- records the GPU work of a piece of code once and replays it
+//
+// Between BeginCapture() and EndCapture(), the GPU routines of the calling thread are recorded into a CUDA graph
+// instead of being run; Launch() then runs all of them with a single call. The graph refers to the buffers as they
+// were during the capture, so it may only be launched as long as these keep their addresses and sizes. Buffers freed
+// during the capture are kept until the graph is destroyed, as are the buffers the graph uses internally.
+// Code that synchronizes with the GPU, e.g. to read values back to the host, cannot be captured; it makes
+// EndCapture() return false. This requires CUDA 10 or later (see IsSupported()).
+// -----------------------------------------------------------------------
+
+class MATH_API GPUGraph
+{
+public:
+    GPUGraph(DEVICEID_TYPE deviceId);
+    ~GPUGraph();
+
+    static bool IsSupported();
+
+    void BeginCapture();
+    bool EndCapture(); // false if the work could not be captured, in which case it has not been run either
+    void Launch();
+
+    // for the memory allocator (see TracingGPUMemoryAllocator::Free())
+    static GPUGraph* GetCapturingGraph();
+    void DeferFree(void* bufferPtr) { m_deferredFrees.push_back(bufferPtr); }
+
+    DISABLE_COPY_AND_MOVE(GPUGraph);
+
+private:
+    DEVICEID_TYPE m_deviceId;
+    cudaStream_t m_stream;
+    cudaStream_t m_callerStream;
+    cudaGraphExec_t m_graphExec;
+    std::vector<void*> m_deferredFrees;
+};
+
 // -----------------------------------------------------------------------
 // DeviceBoundNumber -- This class represents a number which resides on a particular device. Use it to avoid unnecessary transfers between CPU and GPU
 // -----------------------------------------------------------------------
@@ -121,6 +176,9 @@ public:
 
 void PrepareDevice(DEVICEID_TYPE deviceId);
 
+// copies between the memory of two devices, directly if they have peer access (see GPUMatrix.cu)
+void CopyBetweenDevices(void* dst, DEVICEID_TYPE dstDevice, const void* src, DEVICEID_TYPE srcDevice, size_t numBytes);
+
 template<class ElemType> class CuDnnRNNExecutor;
 
 template <class ElemType>
@@ -162,7 +220,6 @@ public:
     static const int MaxGpus = MAX_GPUS;
 
 private:
-    static cublasHandle_t s_cuHandle[MaxGpus];
     static void* s_curandGenerator;
 
 // Have to use disable the warning to avoid issues with __declspec(dllexport) on Windows (C4251).
@@ -179,6 +236,7 @@ private:
     size_t LocateElement(const size_t i, const size_t j) const;
     size_t LocateColumn(const size_t j) const;
     void Clear();
+    void Reallocate(size_t capacity, bool keepContent);
     void ZeroInit(int deviceId);
     void ZeroInit() { Base::ZeroInit(); }
 
@@ -226,6 +284,13 @@ public:
     ElemType Adagrad(GPUMatrix<ElemType>& gradients, const bool needAveMultiplier);
     void FSAdagrad(GPUMatrix<ElemType>& gradients, GPUMatrix<ElemType>& functionValues, ElemType learnRatePerSample, ElemType momentum, ElemType adaWeight, ElemType adaMul);
     ElemType RmsProp(GPUMatrix<ElemType>& gradients, ElemType RMS_GAMMA, ElemType RMS_WGT_INC, ElemType RMS_WGT_MAX, ElemType RMS_WGT_DEC, ElemType RMS_WGT_MIN, const bool needAveMultiplier);
+    static bool MultiTensorUpdate(const MultiTensorUpdateParams<ElemType>& params,
+                                  const std::vector<GPUMatrix<ElemType>*>& smoothedGradients, const std::vector<GPUMatrix<ElemType>*>& gradients,
+                                  const std::vector<GPUMatrix<ElemType>*>& values, const std::vector<ElemType>& adaMuls, bool checkForNan);
+    static double MultiTensorSumOfSquares(const std::vector<const GPUMatrix<ElemType>*>& tensors);
+    void AssignAugmentedImages(const unsigned char* images, size_t numCols, const ImageAugmentationParams& params, const ElemType* mean, uint64_t key);
+    void CompressValuesInto(char* codes, size_t columnBytes, ValueCompression compression) const;
+    void AssignDecompressedValuesOf(const char* codes, size_t columnBytes, ValueCompression compression, size_t numRows, size_t numCols);
 
     void Reshape(const size_t numRows, const size_t numCols);
 
@@ -238,6 +303,7 @@ public:
     // Resize first checks to ensure that the caller has the authority to call Resize (i.e., it checks to ensure the underlying data is owned by only this matrix), and then
     // actually resizes the underlying matrix, doing any allocation as required.
     void Resize(const size_t numRows, const size_t numCols, bool growOnly = true); // by default we only reallocate if need to grow
+    void ShrinkToFit();
 
     ElemType&       operator()(const size_t /*row*/, const size_t /*col*/)       { LogicError("GPUMatrix doesn't support operator(,) on the CPU."); }
     const ElemType& operator()(const size_t /*row*/, const size_t /*col*/) const { LogicError("GPUMatrix doesn't support operator(,) on the CPU."); }
@@ -250,8 +316,14 @@ public:
 
     void MaskColumnsValue(const GPUMatrix<char>& columnsMask, ElemType val);
 
+    // see Matrix<ElemType>::ExtractLargestMagnitudes(); 'indices', 'values' (in host memory) have room for k <= GetNumElements() entries
+    size_t ExtractLargestMagnitudes(size_t k, ElemType threshold, int* indices, ElemType* values);
+    void AddValuesAtIndices(const int* indices, const ElemType* values, size_t count); // (from host memory)
+
     //void SetValue(const CPUMatrix<ElemType>& deepCopyFrom);
     void SetValue(const GPUMatrix<ElemType>& deepCopyFrom);
+    // copies the values of a matrix on another GPU into this one, which stays on its device
+    void AssignPeerValuesOf(const GPUMatrix<ElemType>& a);
     //void SetValue(const CPUSparseMatrix<ElemType>& deepCopyFrom);
     //void SetValue(const GPUSparseMatrix<ElemType>& deepCopyFrom);
     void SetValue(const size_t numRows, const size_t numCols, int deviceId, ElemType* pArray, size_t matrixFlags = matrixFlagNormal, DataTransferer* transferer = nullptr);
@@ -261,12 +333,14 @@ public:
     void SetUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed = USE_TIME_BASED_SEED);
     void SetGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
     void SetUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, RNGHandle& rngHandle);
+    GPUMatrix<ElemType>& AddDropoutOf(const GPUMatrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue, uint64_t key, size_t offset, const ElemType beta);
 
     GPUMatrix<ElemType> Transpose() const;
     GPUMatrix<ElemType>& AssignTransposeOf(const GPUMatrix<ElemType>& a);
 
     GPUMatrix<ElemType>& DoGatherColumnsOf (ElemType beta, const GPUMatrix<ElemType>& idx, const GPUMatrix<ElemType>& a, ElemType alpha);
     GPUMatrix<ElemType>& DoScatterColumnsOf(ElemType beta, const GPUMatrix<ElemType>& idx, const GPUMatrix<ElemType>& a, ElemType alpha);
+    GPUMatrix<ElemType>& AssignPackedIndicesOf(const GPUMatrix<ElemType>& idx, const GPUMatrix<ElemType>& ranges, size_t numParallelSequences);
 
     GPUMatrix<ElemType>& operator+=(const ElemType alpha);
     GPUMatrix<ElemType> operator+(const ElemType alpha) const;
@@ -323,6 +397,7 @@ public:
 
     GPUMatrix<ElemType>& InplaceSigmoid();
     GPUMatrix<ElemType>& AssignSigmoidOf(const GPUMatrix<ElemType>& a);
+    GPUMatrix<ElemType>& AddBiasAndActivation(const GPUMatrix<ElemType>& bias, ElementWiseOperator activation);
 
     GPUMatrix<ElemType>& InplaceTanh();
     GPUMatrix<ElemType>& AssignTanhOf(const GPUMatrix<ElemType>& a);
@@ -336,6 +411,10 @@ public:
     // sequence training
     GPUMatrix<ElemType>& DropFrame(const GPUMatrix<ElemType>& label, const GPUMatrix<ElemType>& gamma, const ElemType& threshhold);
     GPUMatrix<ElemType>& AssignSequenceError(const ElemType hsmoothingWeight, const GPUMatrix<ElemType>& label, const GPUMatrix<ElemType>& dnnoutput, const GPUMatrix<ElemType>& gamma, ElemType alpha);
+    GPUMatrix<ElemType>& AssignCTCScore(const GPUMatrix<ElemType>& logProbs, GPUMatrix<ElemType>& alpha, GPUMatrix<ElemType>& beta,
+                                        const GPUMatrix<ElemType>& labelSequences, GPUMatrix<ElemType>& totalScore,
+                                        const std::vector<size_t>& uttToChanInd, const std::vector<size_t>& uttBeginFrame, const std::vector<size_t>& uttFrameNum,
+                                        const std::vector<size_t>& uttLabelNum, const size_t numParallelSequences, const size_t maxFrameNum, const size_t blankTokenId);
 
     GPUMatrix<ElemType>& InplaceSqrt();
     GPUMatrix<ElemType>& AssignSqrtOf(const GPUMatrix<ElemType>& a);
@@ -463,6 +542,10 @@ public:
     void ConvolutionBackwardKernel(const GPUMatrix<ElemType>& in, const GPUMatrix<int>& mpRowCol, const GPUMatrix<int>& mpRowIwht,
                                    const GPUMatrix<int>& mpRowRun, const GPUMatrix<int>& runs, GPUMatrix<ElemType>& kernelGrad) const;
 
+    void DepthwiseConvolutionForward(const GPUMatrix<ElemType>& kernel, const DepthwiseConvolutionShape& shape, GPUMatrix<ElemType>& output) const;
+    void DepthwiseConvolutionBackwardData(const GPUMatrix<ElemType>& kernel, const DepthwiseConvolutionShape& shape, GPUMatrix<ElemType>& grad) const;
+    void DepthwiseConvolutionBackwardKernel(const GPUMatrix<ElemType>& in, const DepthwiseConvolutionShape& shape, GPUMatrix<ElemType>& kernelGrad) const;
+
     void MaxPoolingForward(const GPUMatrix<int>& mpRowCol, const GPUMatrix<int>& mpRowIndices, const GPUMatrix<int>& indices, GPUMatrix<ElemType>& output) const;
     void MaxPoolingBackward(const GPUMatrix<ElemType>& out, const GPUMatrix<ElemType>& in,
                             const GPUMatrix<int>& mpRowCol, const GPUMatrix<int>& mpRowIndices, const GPUMatrix<int>& indices,
@@ -487,6 +570,7 @@ public:
 public:
     // static BLAS functions
     static void MultiplyAndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& a, const bool transposeA, const GPUMatrix<ElemType>& b, const bool transposeB, ElemType beta, GPUMatrix<ElemType>& c);
+    static void BatchMultiplyAndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& a, const bool transposeA, size_t aRows, const GPUMatrix<ElemType>& b, const bool transposeB, size_t bRows, ElemType beta, GPUMatrix<ElemType>& c);
     static void MultiplyAndAdd(const GPUMatrix<ElemType>& a, const bool transposeA, const GPUMatrix<ElemType>& b, const bool transposeB, GPUMatrix<ElemType>& c);
     static void Multiply(const GPUMatrix<ElemType>& a, const bool transposeA, const GPUMatrix<ElemType>& b, const bool transposeB, GPUMatrix<ElemType>& c);
     static void Multiply(const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& b, GPUMatrix<ElemType>& c);
@@ -512,6 +596,7 @@ public:
     static void ElementWisePower(ElemType alpha, const GPUMatrix<ElemType>& a, GPUMatrix<ElemType>& c);
 
     static bool AreEqual(const GPUMatrix<ElemType>& a, const GPUMatrix<ElemType>& b, const ElemType threshold = 1e-8);
+    static void UpdateNonFiniteFlag(const ElemType* data, size_t numElements, GPUMatrix<ElemType>& flag);
 
     static void TensorShuffleScaleAndAdd(ElemType keepWeight, const GPUMatrix<ElemType>& a, size_t D, size_t S, size_t M, size_t K, size_t T, ElemType scaleFactor, const GPUMatrix<ElemType>& b, GPUMatrix<ElemType>& c);
 
@@ -576,8 +661,13 @@ public:
         int format;
         stream >> matrixNameDummy >> format >> numRows >> numCols;
         ElemType* d_array = new ElemType[numRows * numCols];
-        for (size_t i = 0; i < numRows * numCols; ++i)
-            stream >> d_array[i];
+        if (stream.IsTextBased())
+        {
+            for (size_t i = 0; i < numRows * numCols; ++i)
+                stream >> d_array[i];
+        }
+        else
+            stream.GetBlock(d_array, numRows * numCols * sizeof(ElemType));
         stream.GetMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
         us.SetValue(numRows, numCols, us.GetComputeDeviceId(), d_array, matrixFlagNormal | format);
         delete[] d_array;
@@ -595,8 +685,13 @@ public:
 
         stream << us.m_numRows << us.m_numCols;
         ElemType* pArray = us.CopyToArray();
-        for (size_t i = 0; i < us.GetNumElements(); ++i)
-            stream << pArray[i];
+        if (stream.IsTextBased())
+        {
+            for (size_t i = 0; i < us.GetNumElements(); ++i)
+                stream << pArray[i];
+        }
+        else
+            stream.PutBlock(pArray, us.GetNumElements() * sizeof(ElemType));
         
         delete[] pArray;
 
@@ -14,6 +14,11 @@
 #include "CommonMatrix.h"
 #include "GPUMatrix.h"
 #include "TensorOps.h" // for exp_() etc.
+#include "MultiTensorUpdate.h"
+#define PHILOX_DECL __device__ __host__
+#include "PhiloxRNG.h"
+#include "ImageAugmentation.h"
+#include "ValueCompression.h"
 #include "device_functions.h"
 #include <cuda_runtime.h>
 #include <assert.h>
@@ -985,6 +990,88 @@ __global__ void _assignColumnwiseLogSoftmaxOf512Threads(
     }
 }
 
+// softmax and cross entropy against the sparse (CSC) labels, one block of 512 threads per column: each thread finds the
+// maximum of its elements and the sum of their exponentials relative to it in a single pass (online softmax), the pairs
+// are merged across the block, and a second pass writes softmax - labels; the log-softmax is never stored.
+template <class ElemType>
+__global__ void _crossEntropyWithSoftmaxOfSparseLabels512Threads(
+    const ElemType* prediction,
+    const ElemType* labelValues,
+    const GPUSPARSE_INDEX_TYPE* labelRows,
+    const GPUSPARSE_INDEX_TYPE* labelColStarts, // absolute indices into labelValues and labelRows
+    ElemType* criterion,
+    ElemType* softmaxMinusLabels,
+    const CUDA_LONG m_numRows)
+{
+    __shared__ ElemType partialMax[512];
+    __shared__ ElemType partialSum[512];
+
+    const ElemType* x = prediction + IDX2C(0, blockIdx.x, m_numRows);
+    ElemType* y = softmaxMinusLabels + IDX2C(0, blockIdx.x, m_numRows);
+
+    ElemType threadMax = 0;
+    ElemType threadSum = 0; // 0 until the first element
+    for (CUDA_LONG i = threadIdx.x; i < m_numRows; i += 512)
+    {
+        const ElemType value = x[i];
+        if (threadSum == 0)
+        {
+            threadMax = value;
+            threadSum = 1;
+        }
+        else if (value > threadMax)
+        {
+            threadSum = threadSum * exp_(threadMax - value) + 1;
+            threadMax = value;
+        }
+        else
+            threadSum += exp_(value - threadMax);
+    }
+    partialMax[threadIdx.x] = threadMax;
+    partialSum[threadIdx.x] = threadSum;
+    __syncthreads();
+
+    for (int s = 256; s > 0; s >>= 1)
+    {
+        if (threadIdx.x < s && partialSum[threadIdx.x + s] != 0)
+        {
+            const ElemType otherMax = partialMax[threadIdx.x + s];
+            const ElemType otherSum = partialSum[threadIdx.x + s];
+            if (partialSum[threadIdx.x] == 0)
+            {
+                partialMax[threadIdx.x] = otherMax;
+                partialSum[threadIdx.x] = otherSum;
+            }
+            else
+            {
+                const ElemType ownMax = partialMax[threadIdx.x];
+                const ElemType newMax = max(ownMax, otherMax);
+                partialSum[threadIdx.x] = partialSum[threadIdx.x] * exp_(ownMax - newMax) + otherSum * exp_(otherMax - newMax);
+                partialMax[threadIdx.x] = newMax;
+            }
+        }
+        __syncthreads();
+    }
+    const ElemType logZ = partialMax[0] + log_(partialSum[0]);
+
+    for (CUDA_LONG i = threadIdx.x; i < m_numRows; i += 512)
+        y[i] = exp_(x[i] - logZ);
+    __syncthreads();
+
+    // the labels of the column, typically a single one
+    const GPUSPARSE_INDEX_TYPE start = labelColStarts[blockIdx.x];
+    const GPUSPARSE_INDEX_TYPE end = labelColStarts[blockIdx.x + 1];
+    for (GPUSPARSE_INDEX_TYPE p = start + threadIdx.x; p < end; p += 512)
+        y[labelRows[p]] -= labelValues[p];
+    if (threadIdx.x == 0)
+    {
+        ElemType sum = 0;
+        for (GPUSPARSE_INDEX_TYPE p = start; p < end; p++)
+            sum += labelValues[p] * (logZ - x[labelRows[p]]);
+        criterion[blockIdx.x] = sum;
+    }
+}
+
 template <class ElemType>
 __global__ void _logSoftMaxRowWise(
     ElemType* a,
@@ -1234,6 +1321,150 @@ __global__ void _areEqual(
     }
 }
 
+template <class ElemType>
+__global__ void _updateNonFiniteFlag(
+    const ElemType* a,
+    const CUDA_LONG N,
+    ElemType* flag)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+
+    if (!isfinite(a[id]))
+        flag[0] = 1;
+}
+
+// Radix select for GPUMatrix<ElemType>::ExtractLargestMagnitudes(): the bit patterns of the magnitudes of IEEE floats
+// order like the magnitudes, so the k-th largest magnitude is found one 8-bit digit of its bits at a time, from the
+// top: each pass histograms the digit among the elements whose higher digits match those found so far.
+template <class ElemType>
+struct MagnitudeBits;
+template <>
+struct MagnitudeBits<float>
+{
+    typedef unsigned int Type;
+    static __device__ __forceinline__ Type Of(float x) { return __float_as_uint(x) & 0x7fffffffu; }
+};
+template <>
+struct MagnitudeBits<double>
+{
+    typedef unsigned long long Type;
+    static __device__ __forceinline__ Type Of(double x) { return (unsigned long long) __double_as_longlong(x) & 0x7fffffffffffffffull; }
+};
+
+template <class Bits>
+struct RadixSelectState
+{
+    Bits prefix;         // the digits of the k-th largest magnitude found so far
+    Bits mask;           // the bits of those digits
+    CUDA_LONG remaining; // its rank among the magnitudes that match the prefix (1: the largest); in the end, the number of ties to take
+};
+
+template <class ElemType>
+__global__ void _radixSelectHistogram(
+    const ElemType* a,
+    const CUDA_LONG N,
+    const RadixSelectState<typename MagnitudeBits<ElemType>::Type>* state,
+    const int shift,
+    unsigned int* histogram) // [256]
+{
+    typedef typename MagnitudeBits<ElemType>::Type Bits;
+    __shared__ unsigned int blockHistogram[256];
+    for (int i = threadIdx.x; i < 256; i += blockDim.x)
+        blockHistogram[i] = 0;
+    __syncthreads();
+
+    const Bits prefix = state->prefix;
+    const Bits mask = state->mask;
+    for (CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x; id < N; id += blockDim.x * gridDim.x)
+    {
+        Bits bits = MagnitudeBits<ElemType>::Of(a[id]);
+        if ((bits & mask) == prefix)
+            atomicAdd(&blockHistogram[(bits >> shift) & 0xff], 1u);
+    }
+    __syncthreads();
+
+    for (int i = threadIdx.x; i < 256; i += blockDim.x)
+    {
+        if (blockHistogram[i] != 0)
+            atomicAdd(&histogram[i], blockHistogram[i]);
+    }
+}
+
+// picks the digit of the k-th largest magnitude from the histogram, and clears the histogram for the next pass (one thread)
+template <class Bits>
+__global__ void _radixSelectDigit(
+    unsigned int* histogram,
+    RadixSelectState<Bits>* state,
+    const int shift)
+{
+    CUDA_LONG remaining = state->remaining;
+    int digit = 255;
+    for (; digit > 0 && (CUDA_LONG) histogram[digit] < remaining; digit--)
+        remaining -= (CUDA_LONG) histogram[digit];
+    state->prefix |= (Bits) digit << shift;
+    state->mask |= (Bits) 0xff << shift;
+    state->remaining = remaining;
+    for (int i = 0; i < 256; i++)
+        histogram[i] = 0;
+}
+
+// Moves the elements larger than the k-th magnitude to the front of 'indices' and 'values', in no particular order, and
+// 'state->remaining' of those equal to it to the back (counters[0], counters[1] count them). Both respect 'threshold'.
+template <class ElemType>
+__global__ void _extractLargestMagnitudes(
+    ElemType* a,
+    const CUDA_LONG N,
+    const CUDA_LONG k,
+    const RadixSelectState<typename MagnitudeBits<ElemType>::Type>* state,
+    const ElemType threshold,
+    int* indices,
+    ElemType* values,
+    unsigned int* counters) // [2]
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= N)
+        return;
+
+    const ElemType v = a[id];
+    if (fabs(v) < threshold)
+        return;
+
+    auto bits = MagnitudeBits<ElemType>::Of(v);
+    auto kthBits = state->prefix;
+    CUDA_LONG slot;
+    if (bits > kthBits)
+        slot = (CUDA_LONG) atomicAdd(&counters[0], 1u);
+    else if (bits == kthBits && bits != 0)
+    {
+        CUDA_LONG tie = (CUDA_LONG) atomicAdd(&counters[1], 1u);
+        if (tie >= state->remaining)
+            return;
+        slot = k - 1 - tie;
+    }
+    else
+        return;
+
+    indices[slot] = id;
+    values[slot] = v;
+    a[id] = 0;
+}
+
+template <class ElemType>
+__global__ void _addValuesAtIndices(
+    ElemType* a,
+    const int* indices,
+    const ElemType* values,
+    const CUDA_LONG count)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= count)
+        return;
+
+    atomicAdd(&a[indices[id]], values[id]);
+}
+
 // see Matrix<ElemType>::TensorShuffleScaleAndAdd() for comments
 template <class ElemType>
 __global__ void _tensorShuffleScaleAndAdd(
@@ -1523,6 +1754,273 @@ __global__ void _rmsprop(
         multipliers[i] = temp;
 }
 
+// one tensor of a multi-tensor update (see MultiTensorUpdate.h)
+template <class ElemType>
+struct MultiTensorSlot
+{
+    ElemType* smoothed;
+    ElemType* gradient;
+    ElemType* value;
+    CUDA_LONG size;
+    ElemType adaMul;
+};
+
+// the part [begin, begin + chunkSize) of one tensor, which one block updates
+struct MultiTensorChunk
+{
+    int slot;
+    CUDA_LONG begin;
+};
+
+// grid = one block per chunk; multiplierSums[slot] accumulates the multipliers of the tensor if params.m_needAveMultiplier
+template <class ElemType>
+__global__ void _multiTensorUpdate(
+    const MultiTensorUpdateParams<ElemType> params,
+    const MultiTensorSlot<ElemType>* slots,
+    const MultiTensorChunk* chunks,
+    const CUDA_LONG chunkSize,
+    ElemType* multiplierSums,
+    int* nanFlag)
+{
+    __shared__ ElemType partials[GridDim::maxThreadsPerBlock];
+
+    const MultiTensorChunk chunk = chunks[blockIdx.x];
+    const MultiTensorSlot<ElemType> slot = slots[chunk.slot];
+    const CUDA_LONG end = min(chunk.begin + chunkSize, slot.size);
+
+    ElemType sum = 0;
+    for (CUDA_LONG i = chunk.begin + threadIdx.x; i < end; i += blockDim.x)
+    {
+        sum += MultiTensorUpdateElement(params, slot.adaMul, slot.smoothed, slot.gradient, slot.value, i, slot.size);
+        if (nanFlag && !params.m_needAveMultiplier && isnan(slot.value[i]))
+            *nanFlag = 1;
+    }
+
+    if (!params.m_needAveMultiplier)
+        return;
+
+    partials[threadIdx.x] = sum;
+    __syncthreads();
+    for (int stride = blockDim.x / 2; stride > 0; stride /= 2)
+    {
+        if (threadIdx.x < stride)
+            partials[threadIdx.x] += partials[threadIdx.x + stride];
+        __syncthreads();
+    }
+    if (threadIdx.x == 0)
+        atomicAdd(&multiplierSums[chunk.slot], partials[0]);
+}
+
+// second pass if params.m_needAveMultiplier
+template <class ElemType>
+__global__ void _multiTensorApplyStep(
+    const MultiTensorUpdateParams<ElemType> params,
+    const MultiTensorSlot<ElemType>* slots,
+    const MultiTensorChunk* chunks,
+    const CUDA_LONG chunkSize,
+    const ElemType* multiplierSums,
+    int* nanFlag)
+{
+    const MultiTensorChunk chunk = chunks[blockIdx.x];
+    const MultiTensorSlot<ElemType> slot = slots[chunk.slot];
+    const CUDA_LONG end = min(chunk.begin + chunkSize, slot.size);
+    const ElemType aveMultiplier = multiplierSums[chunk.slot] / slot.size;
+
+    for (CUDA_LONG i = chunk.begin + threadIdx.x; i < end; i += blockDim.x)
+    {
+        MultiTensorApplyStep(params, aveMultiplier, slot.gradient, slot.value, i);
+        if (nanFlag && isnan(slot.value[i]))
+            *nanFlag = 1;
+    }
+}
+
+// one tensor of a multi-tensor sum of squares
+template <class ElemType>
+struct MultiTensorSpan
+{
+    const ElemType* data;
+    CUDA_LONG size;
+};
+
+// grid = one block per chunk (MultiTensorChunk::slot indexes 'spans'); partialSums[blockIdx.x] = the sum of squares of the chunk
+template <class ElemType>
+__global__ void _multiTensorSumOfSquares(
+    const MultiTensorSpan<ElemType>* spans,
+    const MultiTensorChunk* chunks,
+    const CUDA_LONG chunkSize,
+    double* partialSums)
+{
+    __shared__ double partials[GridDim::maxThreadsPerBlock];
+
+    const MultiTensorChunk chunk = chunks[blockIdx.x];
+    const MultiTensorSpan<ElemType> span = spans[chunk.slot];
+    const CUDA_LONG end = min(chunk.begin + chunkSize, span.size);
+
+    double sum = 0;
+    for (CUDA_LONG i = chunk.begin + threadIdx.x; i < end; i += blockDim.x)
+        sum += (double) span.data[i] * span.data[i];
+
+    partials[threadIdx.x] = sum;
+    __syncthreads();
+    for (int stride = blockDim.x / 2; stride > 0; stride /= 2)
+    {
+        if (threadIdx.x < stride)
+            partials[threadIdx.x] += partials[threadIdx.x + stride];
+        __syncthreads();
+    }
+    if (threadIdx.x == 0)
+        partialSums[blockIdx.x] = partials[0];
+}
+
+// grid = one block per image (column); see ImageAugmentation.h
+template <class ElemType>
+__global__ void _assignAugmentedImages(
+    ElemType* data,
+    const unsigned char* images,
+    const ImageAugmentationParams params,
+    const ElemType* mean,
+    const uint64_t key)
+{
+    __shared__ unsigned int partials[GridDim::maxThreadsPerBlock];
+
+    const CUDA_LONG planeSize = params.m_width * params.m_height;
+    const int channels = params.m_channels;
+    const CUDA_LONG numRows = planeSize * channels;
+    const unsigned char* src = images + (size_t) blockIdx.x * numRows;
+    ElemType* dst = data + (size_t) blockIdx.x * numRows;
+
+    // (as an integer sum, so that it is the one of the CPU)
+    float imageMean = 0;
+    if (params.m_brightnessRadius > 0)
+    {
+        unsigned int sum = 0;
+        for (CUDA_LONG i = threadIdx.x; i < numRows; i += blockDim.x)
+            sum += src[i];
+        partials[threadIdx.x] = sum;
+        __syncthreads();
+        for (int stride = blockDim.x / 2; stride > 0; stride /= 2)
+        {
+            if (threadIdx.x < stride)
+                partials[threadIdx.x] += partials[threadIdx.x + stride];
+            __syncthreads();
+        }
+        imageMean = (float) partials[0] / numRows;
+    }
+
+    const ImageAugmentationDraws draws = DrawImageAugmentation(params, key, blockIdx.x);
+    for (CUDA_LONG pixel = threadIdx.x; pixel < planeSize; pixel += blockDim.x)
+    {
+        float x[4];
+        for (int c = 0; c < channels; c++)
+            x[c] = src[pixel * channels + c];
+        AugmentImagePixel(params, draws, imageMean, x);
+        for (int c = 0; c < channels; c++)
+        {
+            CUDA_LONG index = pixel * channels + c;
+            float value = mean ? x[c] - (float) mean[index] : x[c];
+            dst[params.m_transpose ? c * planeSize + pixel : index] = (ElemType) (value * params.m_scale);
+        }
+    }
+}
+
+// grid = one block per column; see ValueCompression.h
+template <class ElemType>
+__global__ void _compressValues(
+    const ElemType* data,
+    const CUDA_LONG numRows,
+    char* codes,
+    const size_t columnBytes,
+    const ValueCompression compression)
+{
+    __shared__ float minima[GridDim::maxThreadsPerBlock];
+    __shared__ float maxima[GridDim::maxThreadsPerBlock];
+
+    const ElemType* src = data + (size_t) blockIdx.x * numRows;
+    char* dst = codes + (size_t) blockIdx.x * columnBytes;
+    if (compression == ValueCompression::sign)
+    {
+        for (CUDA_LONG k = threadIdx.x; k < (CUDA_LONG) columnBytes; k += blockDim.x)
+        {
+            unsigned int bits = 0;
+            for (CUDA_LONG b = 0; b < 8 && 8 * k + b < numRows; b++)
+                bits |= (src[8 * k + b] > 0 ? 1u : 0u) << b;
+            dst[k] = (char) bits;
+        }
+    }
+    else if (compression == ValueCompression::half)
+    {
+        uint16_t* halves = reinterpret_cast<uint16_t*>(dst);
+        for (CUDA_LONG i = threadIdx.x; i < numRows; i += blockDim.x)
+            halves[i] = FloatToHalf((float) src[i]);
+    }
+    else
+    {
+        float minimum = FLT_MAX, maximum = -FLT_MAX;
+        for (CUDA_LONG i = threadIdx.x; i < numRows; i += blockDim.x)
+        {
+            minimum = fminf(minimum, (float) src[i]);
+            maximum = fmaxf(maximum, (float) src[i]);
+        }
+        minima[threadIdx.x] = minimum;
+        maxima[threadIdx.x] = maximum;
+        __syncthreads();
+        for (int stride = blockDim.x / 2; stride > 0; stride /= 2)
+        {
+            if (threadIdx.x < stride)
+            {
+                minima[threadIdx.x] = fminf(minima[threadIdx.x], minima[threadIdx.x + stride]);
+                maxima[threadIdx.x] = fmaxf(maxima[threadIdx.x], maxima[threadIdx.x + stride]);
+            }
+            __syncthreads();
+        }
+
+        // (as on the CPU)
+        minimum = numRows > 0 ? minima[0] : 0;
+        const float step = numRows > 0 ? (maxima[0] - minimum) / 255 : 0;
+        const float scale = step > 0 ? 1 / step : 0;
+        if (threadIdx.x == 0)
+        {
+            float* header = reinterpret_cast<float*>(dst);
+            header[0] = minimum;
+            header[1] = step;
+        }
+        unsigned char* bytes = reinterpret_cast<unsigned char*>(dst + 2 * sizeof(float));
+        for (CUDA_LONG i = threadIdx.x; i < numRows; i += blockDim.x)
+            bytes[i] = FloatToByteCode((float) src[i], minimum, scale);
+    }
+}
+
+// grid = one block per column; see ValueCompression.h
+template <class ElemType>
+__global__ void _decompressValues(
+    ElemType* data,
+    const CUDA_LONG numRows,
+    const char* codes,
+    const size_t columnBytes,
+    const ValueCompression compression)
+{
+    const char* src = codes + (size_t) blockIdx.x * columnBytes;
+    ElemType* dst = data + (size_t) blockIdx.x * numRows;
+    if (compression == ValueCompression::sign)
+    {
+        for (CUDA_LONG i = threadIdx.x; i < numRows; i += blockDim.x)
+            dst[i] = (ElemType) ((src[i / 8] >> (i % 8)) & 1);
+    }
+    else if (compression == ValueCompression::half)
+    {
+        const uint16_t* halves = reinterpret_cast<const uint16_t*>(src);
+        for (CUDA_LONG i = threadIdx.x; i < numRows; i += blockDim.x)
+            dst[i] = (ElemType) HalfToFloat(halves[i]);
+    }
+    else
+    {
+        const float* header = reinterpret_cast<const float*>(src);
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(src + 2 * sizeof(float));
+        for (CUDA_LONG i = threadIdx.x; i < numRows; i += blockDim.x)
+            dst[i] = (ElemType) (header[0] + bytes[i] * header[1]);
+    }
+}
+
 template <class ElemType>
 __global__ void _rescaleToRange(
     ElemType* a,
@@ -1549,6 +2047,35 @@ __global__ void _setMaskAndScale(
     a[id] = a[id] <= maskRate ? 0 : scaleValue;
 }
 
+// us = beta * us + a .* mask; one thread per Philox block, which covers the elements [4 * block - offset, 4 * block - offset + 4)
+template <class ElemType>
+__global__ void _addDropoutOf(
+    ElemType* us,
+    const ElemType* a,
+    const CUDA_LONG N,
+    const uint64_t firstBlock,
+    const CUDA_LONG numBlocks,
+    const uint64_t offset,
+    const uint64_t key,
+    const float maskRate,
+    const ElemType scaleValue,
+    const ElemType beta)
+{
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id >= numBlocks)
+        return;
+    uint64_t block = firstBlock + id;
+    PhiloxBlock random = Philox4x32_10(block, key);
+    for (int w = 0; w < 4; w++)
+    {
+        long long i = (long long) (block * 4 + w) - (long long) offset;
+        if (i < 0 || i >= N)
+            continue;
+        ElemType value = PhiloxToUniform(random.w[w]) <= maskRate ? 0 : a[i] * scaleValue;
+        us[i] = beta == 0 ? value : beta * us[i] + value;
+    }
+}
+
 template <class ElemType>
 __global__ void _vectorSum(
     ElemType* c,       // output
@@ -2448,6 +2975,27 @@ __global__ void _matrixVectorRowWiseAddWithThreadPerElem(
     us[id] = alpha * a[col] + b[id];
 }
 
+// us = f(us + bias), with the column vector bias added to every column, for GPUMatrix::AddBiasAndActivation()
+template <class ElemType>
+__global__ void _addBiasAndActivation(
+    ElemType* us,
+    const ElemType* bias,
+    const ElementWiseOperator activation,
+    const CUDA_LONG m, // number of rows
+    const CUDA_LONG N)
+{
+    CALCULATE_ELEMENTWISE_INDEX_OR_EXIT(id, N);
+
+    ElemType v = us[id] + bias[id % m];
+    if (activation == opSigmoid)
+        v = Microsoft::MSR::CNTK::Sigmoid(v);
+    else if (activation == opTanh)
+        v = tanh_(v);
+    else if (activation == opLinearRectifier)
+        v = v > 0 ? v : 0;
+    us[id] = v;
+}
+
 //this implementation uses more threads but also more memory access
 template <class ElemType>
 __global__ void _matrixVectorColumnWiseAddWithThreadPerElem(
@@ -2830,6 +3378,35 @@ __global__ void _shiftColCSCIndexFromSliceViewToAbsolute(
         colCSCIndex[cols] = nz;
 }
 
+// the CSC column starts and values of one-hot sequences, one thread per column (+1), see GPUSparseMatrix::SetMatrixFromOneHotSequences()
+template <class ElemType>
+__global__ void _oneHotSequencesToCSC(
+    GPUSPARSE_INDEX_TYPE* colCSCIndex,
+    ElemType* values,
+    const GPUSPARSE_INDEX_TYPE* sequenceOffsets,
+    const CUDA_LONG numSequences,
+    const CUDA_LONG maxSequenceLength)
+{
+    CUDA_LONG numCols = numSequences * maxSequenceLength;
+    CUDA_LONG id = blockDim.x * blockIdx.x + threadIdx.x;
+    if (id > numCols)
+        return;
+
+    if (id == numCols)
+    {
+        colCSCIndex[id] = sequenceOffsets[numSequences];
+        return;
+    }
+
+    CUDA_LONG i = id / maxSequenceLength;
+    CUDA_LONG j = id % maxSequenceLength;
+    GPUSPARSE_INDEX_TYPE begin = sequenceOffsets[i];
+    CUDA_LONG length = sequenceOffsets[i + 1] - begin;
+    colCSCIndex[id] = begin + (j < length ? j : length);
+    if (j < length)
+        values[begin + j] = 1;
+}
+
 //c = alpha * op(a) * op(b) + beta*c
 // TODO: This function can be further improved by loading the kernel in shared memory
 template <class ElemType>
@@ -3053,6 +3630,76 @@ __global__ void _determineBlockIds(
         blockId2Col[blockIndex] = index;
 }
 
+// GPUSparseMatrix::AssignScatteredColumnsOf() sorts the columns by id and sums up the segments of equal ids:
+// the ids as sort keys, with the gaps (negative ids) as 'gapKey' (the number of columns), which sorts after all ids
+template <class ElemType>
+__global__ void _idsToSortKeys(
+    const ElemType* idx, GPUSPARSE_INDEX_TYPE* keys, GPUSPARSE_INDEX_TYPE* columns, const CUDA_LONG numIds, const GPUSPARSE_INDEX_TYPE gapKey)
+{
+    const CUDA_LONG j = blockIdx.x * blockDim.x + threadIdx.x;
+    if (j >= numIds)
+        return;
+
+    const ElemType id = idx[j];
+    keys[j] = (id >= 0 && id < gapKey) ? (GPUSPARSE_INDEX_TYPE) id : gapKey; // (NaN and ids out of range are dropped, too)
+    columns[j] = j;
+}
+
+// 1 at the first of each run of equal ids in the sorted keys, else 0 (the inclusive sum of this numbers the blocks from 1)
+template <class ElemType>
+__global__ void _markSegmentStarts(
+    const GPUSPARSE_INDEX_TYPE* sortedKeys, GPUSPARSE_INDEX_TYPE* segmentStarts, const CUDA_LONG numIds, const GPUSPARSE_INDEX_TYPE gapKey)
+{
+    const CUDA_LONG p = blockIdx.x * blockDim.x + threadIdx.x;
+    if (p >= numIds)
+        return;
+
+    segmentStarts[p] = (sortedKeys[p] != gapKey && (p == 0 || sortedKeys[p] != sortedKeys[p - 1])) ? 1 : 0;
+}
+
+// the column of each block, the block of each column, and the range [blockStarts[b], blockStarts[b + 1]) of the sorted columns of block b
+template <class ElemType>
+__global__ void _setBlocksOfSegments(
+    const GPUSPARSE_INDEX_TYPE* sortedKeys, const GPUSPARSE_INDEX_TYPE* blockNumbers, GPUSPARSE_INDEX_TYPE* blockId2Col, GPUSPARSE_INDEX_TYPE* col2BlockId,
+    GPUSPARSE_INDEX_TYPE* blockStarts, const CUDA_LONG numIds, const GPUSPARSE_INDEX_TYPE gapKey)
+{
+    const CUDA_LONG p = blockIdx.x * blockDim.x + threadIdx.x;
+    if (p >= numIds)
+        return;
+
+    const GPUSPARSE_INDEX_TYPE key = sortedKeys[p];
+    if (key == gapKey)
+        return;
+    const GPUSPARSE_INDEX_TYPE b = blockNumbers[p] - 1;
+    if (p == 0 || sortedKeys[p - 1] != key)
+    {
+        blockId2Col[b] = key;
+        col2BlockId[key] = b;
+        blockStarts[b] = p;
+    }
+    if (p + 1 == numIds || sortedKeys[p + 1] == gapKey) // end of the last segment
+        blockStarts[b + 1] = p + 1;
+}
+
+// one thread per element of the result: resultValues[:, b] = alpha * sum of the columns a[:, sortedColumns[p]] of segment b.
+// Consecutive threads read consecutive rows of the same column.
+template <class ElemType>
+__global__ void _sumSortedColumnSegments(
+    const ElemType alpha, const ElemType* a, const CUDA_LONG numRows, const GPUSPARSE_INDEX_TYPE* sortedColumns,
+    const GPUSPARSE_INDEX_TYPE* blockStarts, const CUDA_LONG numBlocks, ElemType* resultValues)
+{
+    const CUDA_LONG index = blockIdx.x * blockDim.x + threadIdx.x;
+    const CUDA_LONG b = index / numRows;
+    if (b >= numBlocks)
+        return;
+    const CUDA_LONG i = index - numRows * b;
+
+    ElemType sum = 0;
+    for (GPUSPARSE_INDEX_TYPE p = blockStarts[b]; p < blockStarts[b + 1]; p++)
+        sum += a[IDX2C(i, sortedColumns[p], numRows)];
+    resultValues[IDX2C(i, b, numRows)] = alpha * sum;
+}
+
 // backward pass from hidden layer to feature weight
 //result (sparse BlockCol)= alpha * (lhs (dense) X rhs^T (sparse CSC)
 //assume resultValues are 0-initialized
@@ -4890,6 +5537,139 @@ __global__ void _AssignSequenceError(const ElemType hsmoothingWeight, ElemType*
     // error[id] -= alpha * (label[id] - dnnoutput[id] );
 }
 
+// CTC forward-backward. Each utterance has 4 entries in 'uttInfo': its parallel sequence, first time step, number of
+// frames and number of labels; the label sequence with blanks of utterance u has S = 2 * #labels + 1 positions, and its
+// log scores at frame t are column (t * numUtts + u) of alpha and beta.
+template <class ElemType>
+static __device__ inline size_t _ctcLabel(const ElemType* labelSequences, size_t maxLabelNum, size_t u, size_t s, size_t blankTokenId)
+{
+    return s % 2 == 0 ? blankTokenId : (size_t) labelSequences[u * maxLabelNum + (s - 1) / 2];
+}
+
+// one thread per utterance and position of the label sequence, for the frame t of all utterances
+template <class ElemType>
+__global__ void _assignCTCAlphaScore(ElemType* alpha, const ElemType* logProbs, const ElemType* labelSequences, const size_t* uttInfo,
+                                     const size_t t, const size_t numUtts, const size_t maxS, const size_t maxLabelNum,
+                                     const size_t numClasses, const size_t numParallelSequences, const size_t blankTokenId)
+{
+    CUDA_LONG id = GridDim::GetLinearThreadId();
+    if (id >= numUtts * maxS)
+        return;
+    const size_t u = id / maxS;
+    const size_t s = id % maxS;
+    const size_t* info = uttInfo + 4 * u;
+    const size_t S = 2 * info[3] + 1;
+    if (t >= info[2] || s >= S)
+        return;
+
+    const size_t label = _ctcLabel(labelSequences, maxLabelNum, u, s, blankTokenId);
+    ElemType score;
+    if (t == 0)
+        score = s < 2 ? 0 : LZERO;
+    else
+    {
+        const ElemType* previous = alpha + ((t - 1) * numUtts + u) * maxS;
+        score = previous[s];
+        if (s >= 1)
+            score = logaddk(score, previous[s - 1]);
+        if (s >= 2 && label != blankTokenId && label != _ctcLabel(labelSequences, maxLabelNum, u, s - 2, blankTokenId))
+            score = logaddk(score, previous[s - 2]);
+    }
+    alpha[(t * numUtts + u) * maxS + s] = score + logProbs[((info[1] + t) * numParallelSequences + info[0]) * numClasses + label];
+}
+
+template <class ElemType>
+__global__ void _assignCTCBetaScore(ElemType* beta, const ElemType* logProbs, const ElemType* labelSequences, const size_t* uttInfo,
+                                    const size_t t, const size_t numUtts, const size_t maxS, const size_t maxLabelNum,
+                                    const size_t numClasses, const size_t numParallelSequences, const size_t blankTokenId)
+{
+    CUDA_LONG id = GridDim::GetLinearThreadId();
+    if (id >= numUtts * maxS)
+        return;
+    const size_t u = id / maxS;
+    const size_t s = id % maxS;
+    const size_t* info = uttInfo + 4 * u;
+    const size_t S = 2 * info[3] + 1;
+    if (t >= info[2] || s >= S)
+        return;
+
+    const size_t label = _ctcLabel(labelSequences, maxLabelNum, u, s, blankTokenId);
+    ElemType score;
+    if (t + 1 == info[2])
+        score = s + 2 >= S ? 0 : LZERO;
+    else
+    {
+        const ElemType* next = beta + ((t + 1) * numUtts + u) * maxS;
+        score = next[s];
+        if (s + 1 < S)
+            score = logaddk(score, next[s + 1]);
+        if (s + 2 < S && label != blankTokenId && label != _ctcLabel(labelSequences, maxLabelNum, u, s + 2, blankTokenId))
+            score = logaddk(score, next[s + 2]);
+    }
+    beta[(t * numUtts + u) * maxS + s] = score + logProbs[((info[1] + t) * numParallelSequences + info[0]) * numClasses + label];
+}
+
+template <class ElemType>
+static __device__ inline ElemType _ctcLogLikelihood(const ElemType* alpha, const size_t* info, size_t u, size_t numUtts, size_t maxS)
+{
+    const size_t S = 2 * info[3] + 1;
+    const ElemType* last = alpha + ((info[2] - 1) * numUtts + u) * maxS;
+    return S > 1 ? logaddk(last[S - 1], last[S - 2]) : last[0];
+}
+
+// one thread per utterance and frame; it owns the output column, so that the positions with the same label can be summed without atomics
+template <class ElemType>
+__global__ void _assignCTCOccupancy(ElemType* occupancy, const ElemType* logProbs, const ElemType* alpha, const ElemType* beta,
+                                    const ElemType* labelSequences, const size_t* uttInfo, const size_t numUtts, const size_t maxFrameNum,
+                                    const size_t maxS, const size_t maxLabelNum, const size_t numClasses, const size_t numParallelSequences,
+                                    const size_t blankTokenId)
+{
+    CUDA_LONG id = GridDim::GetLinearThreadId();
+    if (id >= numUtts * maxFrameNum)
+        return;
+    const size_t u = id % numUtts;
+    const size_t t = id / numUtts;
+    const size_t* info = uttInfo + 4 * u;
+    if (t >= info[2])
+        return;
+
+    const size_t j = (info[1] + t) * numParallelSequences + info[0];
+    ElemType* us = occupancy + j * numClasses;
+    const ElemType* logProb = logProbs + j * numClasses;
+    const ElemType logLikelihood = _ctcLogLikelihood(alpha, info, u, numUtts, maxS);
+    if (logLikelihood < LSMALL) // the labels do not fit
+    {
+        for (size_t k = 0; k < numClasses; k++)
+            us[k] = exp(logProb[k]);
+        return;
+    }
+
+    const size_t S = 2 * info[3] + 1;
+    const ElemType* a = alpha + (t * numUtts + u) * maxS;
+    const ElemType* b = beta + (t * numUtts + u) * maxS;
+    for (size_t s = 0; s < S; s++)
+    {
+        const size_t label = _ctcLabel(labelSequences, maxLabelNum, u, s, blankTokenId);
+        us[label] += exp(a[s] + b[s] - logProb[label] - logLikelihood);
+    }
+}
+
+template <class ElemType>
+__global__ void _assignCTCTotalScore(ElemType* totalScore, const ElemType* alpha, const size_t* uttInfo, const size_t numUtts, const size_t maxS)
+{
+    ElemType sum = 0;
+    for (size_t u = 0; u < numUtts; u++)
+    {
+        const size_t* info = uttInfo + 4 * u;
+        if (info[2] == 0)
+            continue;
+        const ElemType logLikelihood = _ctcLogLikelihood(alpha, info, u, numUtts, maxS);
+        if (logLikelihood >= LSMALL)
+            sum -= logLikelihood;
+    }
+    totalScore[0] = sum;
+}
+
 template <class ElemType>
 __global__ void _copyTopKResults(const uint64_t* indexes, const ElemType* values, ElemType* maxIndexes, ElemType* maxValues,
                                  CUDA_LONG crow, CUDA_LONG ccol, int topK)
@@ -4903,6 +5683,72 @@ __global__ void _copyTopKResults(const uint64_t* indexes, const ElemType* values
     maxValues[id] = values[icol * crow + irow];
 }
 
+// Top k (at most MaxK) of each column, sorted descending, the lower row first among equal values, without sorting
+// the columns: one block per column, each thread keeps the top k of its rows sorted in shared memory (almost all
+// elements only take the comparison with the smallest of them), then the lists of the threads are merged pairwise.
+// The lists are stored [k][thread], so that the threads of a warp access different banks.
+template <int ThreadsPerBlock, int MaxK, class ElemType>
+__global__ void _vectorTopKPerColumn(const ElemType* a, ElemType* maxIndexes, ElemType* maxValues, CUDA_LONG crow, int topK)
+{
+    __shared__ ElemType values[MaxK * ThreadsPerBlock];
+    __shared__ int rows[MaxK * ThreadsPerBlock];
+    __shared__ int counts[ThreadsPerBlock];
+
+    const ElemType* column = a + (size_t) blockIdx.x * crow;
+    const int tid = threadIdx.x;
+    int count = 0;
+    for (CUDA_LONG irow = tid; irow < crow; irow += ThreadsPerBlock)
+    {
+        ElemType v = column[irow];
+        if (count == topK && !(v > values[(topK - 1) * ThreadsPerBlock + tid]))
+            continue;
+        int j = count < topK ? count++ : topK - 1;
+        for (; j > 0 && v > values[(j - 1) * ThreadsPerBlock + tid]; j--)
+        {
+            values[j * ThreadsPerBlock + tid] = values[(j - 1) * ThreadsPerBlock + tid];
+            rows[j * ThreadsPerBlock + tid] = rows[(j - 1) * ThreadsPerBlock + tid];
+        }
+        values[j * ThreadsPerBlock + tid] = v;
+        rows[j * ThreadsPerBlock + tid] = irow;
+    }
+    counts[tid] = count;
+    __syncthreads();
+
+    for (int stride = ThreadsPerBlock / 2; stride > 0; stride /= 2)
+    {
+        if (tid < stride)
+        {
+            int other = tid + stride;
+            int countA = counts[tid], countB = counts[other];
+            int mergedCount = min(countA + countB, topK);
+            ElemType mergedValues[MaxK];
+            int mergedRows[MaxK];
+            for (int j = 0, ia = 0, ib = 0; j < mergedCount; j++)
+            {
+                bool takeA = ib >= countB ||
+                             (ia < countA && (values[ia * ThreadsPerBlock + tid] > values[ib * ThreadsPerBlock + other] ||
+                                              (values[ia * ThreadsPerBlock + tid] == values[ib * ThreadsPerBlock + other] && rows[ia * ThreadsPerBlock + tid] < rows[ib * ThreadsPerBlock + other])));
+                int k = takeA ? ia++ * ThreadsPerBlock + tid : ib++ * ThreadsPerBlock + other;
+                mergedValues[j] = values[k];
+                mergedRows[j] = rows[k];
+            }
+            for (int j = 0; j < mergedCount; j++)
+            {
+                values[j * ThreadsPerBlock + tid] = mergedValues[j];
+                rows[j * ThreadsPerBlock + tid] = mergedRows[j];
+            }
+            counts[tid] = mergedCount;
+        }
+        __syncthreads();
+    }
+
+    for (int j = tid; j < topK; j += ThreadsPerBlock)
+    {
+        maxValues[(size_t) blockIdx.x * topK + j] = values[j * ThreadsPerBlock];
+        maxIndexes[(size_t) blockIdx.x * topK + j] = (ElemType) rows[j * ThreadsPerBlock];
+    }
+}
+
 template <int BlockSize, class ElemType>
 __global__ void _assignNumOfDiffCol(const ElemType* a, const ElemType* b, ElemType* c, CUDA_LONG crowB, CUDA_LONG ccol)
 {
@@ -24,13 +24,8 @@ typedef unsigned char byte;
 #pragma warning(disable : 4267) // conversion from 'size_t' to 'unsigned int'; happens in CUDA <<<a,b>>> syntax if a and b are size_t
 #pragma warning(disable : 4127) // conditional expression is constant; "if (sizeof(ElemType)==sizeof(float))" triggers this
 
-#ifdef _WIN32
-// thread local storage to access the current stream, initalize to default stream
-extern __declspec(thread)
-#else
-static
-#endif
-    cudaStream_t t_stream;
+// thread local storage to access the current stream, initalize to default stream (see GPUMatrix.cu)
+extern THREAD_LOCAL cudaStream_t t_stream;
 
 template <>
 const char* CudaErrString<cusparseStatus_t>(cusparseStatus_t)
@@ -41,6 +36,27 @@ const char* CudaErrString<cusparseStatus_t>(cusparseStatus_t)
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// GetCusparseHandle - get a cusparse handle for the given GPU, set to the stream of the calling thread
+// Like the cublas handles (GPUMatrix::GetCublasHandle()), there is one per GPU and thread, created on first use and never
+// freed; creating a handle per call costs more than most of the sparse operations it is used for. (Per thread, since a
+// handle is bound to one stream at a time, and threads may use streams of their own.)
+static cusparseHandle_t GetCusparseHandle(int computeDevice)
+{
+    static THREAD_LOCAL cusparseHandle_t s_cusparseHandle[MAX_GPUS] = {};
+
+    if (computeDevice < 0)
+        cudaGetDevice(&computeDevice);
+
+    if (computeDevice < 0 || computeDevice >= MAX_GPUS)
+        LogicError("GetCusparseHandle: Maximum GPU exceeded");
+    cusparseHandle_t& cusparseHandle = s_cusparseHandle[computeDevice];
+    if (cusparseHandle == nullptr)
+        CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    CUSPARSE_CALL(cusparseSetStream(cusparseHandle, t_stream));
+
+    return cusparseHandle;
+}
+
 #pragma region Constructors and Destructor
 
 template <class ElemType>
@@ -258,8 +274,7 @@ void GPUSparseMatrix<ElemType>::CopyToDenseMatrix(GPUMatrix<ElemType>& denseMatr
     }
 
     PrepareDevice();
-    cusparseHandle_t cusparseHandle = 0;
-    CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    cusparseHandle_t cusparseHandle = GetCusparseHandle(GetComputeDeviceId());
     cusparseMatDescr_t descr = 0;
     CUSPARSE_CALL(cusparseCreateMatDescr(&descr));
     cusparseSetMatType(descr, CUSPARSE_MATRIX_TYPE_GENERAL);
@@ -268,7 +283,6 @@ void GPUSparseMatrix<ElemType>::CopyToDenseMatrix(GPUMatrix<ElemType>& denseMatr
     denseMatrix.RequireSize(GetNumRows(), GetNumCols());
 
     SyncGuard syncGuard;
-    CUSPARSE_CALL(cusparseSetStream(cusparseHandle, t_stream));
     if (GetFormat() == MatrixFormat::matrixFormatSparseCSR)
     {
         if (sizeof(ElemType) == sizeof(float))
@@ -295,8 +309,6 @@ void GPUSparseMatrix<ElemType>::CopyToDenseMatrix(GPUMatrix<ElemType>& denseMatr
     {
         NOT_IMPLEMENTED;
     }
-    CUSPARSE_CALL(cusparseDestroy(cusparseHandle));
-
 }
 
 template <class ElemType>
@@ -318,36 +330,36 @@ void GPUSparseMatrix<ElemType>::ConvertToSparseFormat(MatrixFormat newFormat, GP
     }
 
     PrepareDevice();
-    cusparseHandle_t cusparseHandle = 0;
-    CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    cusparseHandle_t cusparseHandle = GetCusparseHandle(GetComputeDeviceId());
 
     SyncGuard syncGuard;
-    CUSPARSE_CALL(cusparseSetStream(cusparseHandle, t_stream));
 
     outMatrix.ChangeDeviceTo(GetComputeDeviceId());
     outMatrix.RequireSizeAndAllocate(GetNumRows(), GetNumCols(), NzCount(), newFormat, true, false);
 
     if ((oldFormat == matrixFormatSparseCSR && newFormat == matrixFormatSparseCSC) || (oldFormat == matrixFormatSparseCSC && newFormat == matrixFormatSparseCSR))
     {
+        // A CSC matrix is the CSR matrix of its transpose, so csr2csc() on the compressed (secondary) and the major indices
+        // converts either way: m is the number of compressed rows or columns.
+        int m = int(oldFormat == matrixFormatSparseCSR ? GetNumRows() : GetNumCols());
+        int n = int(oldFormat == matrixFormatSparseCSR ? GetNumCols() : GetNumRows());
         if (sizeof(ElemType) == sizeof(float))
         {
-            CUSPARSE_CALL(cusparseScsr2csc(cusparseHandle, int(GetNumRows()), int(GetNumCols()), int(GetSizeAllocated()),
-                                           (float*) Data(), RowLocation(), ColLocation(), (float*) outMatrix.Data(),
-                                           outMatrix.RowLocation(), outMatrix.ColLocation(), CUSPARSE_ACTION_NUMERIC, CUSPARSE_INDEX_BASE_ZERO));
+            CUSPARSE_CALL(cusparseScsr2csc(cusparseHandle, m, n, int(NzCount()),
+                                           (float*) Data(), SecondaryIndexLocation(), MajorIndexLocation(), (float*) outMatrix.Data(),
+                                           outMatrix.MajorIndexLocation(), outMatrix.SecondaryIndexLocation(), CUSPARSE_ACTION_NUMERIC, CUSPARSE_INDEX_BASE_ZERO));
         }
         else
         {
-            CUSPARSE_CALL(cusparseDcsr2csc(cusparseHandle, int(GetNumRows()), int(GetNumCols()), int(GetSizeAllocated()),
-                                           (double*) Data(), RowLocation(), ColLocation(), (double*) outMatrix.Data(),
-                                           outMatrix.RowLocation(), outMatrix.ColLocation(), CUSPARSE_ACTION_NUMERIC, CUSPARSE_INDEX_BASE_ZERO));
+            CUSPARSE_CALL(cusparseDcsr2csc(cusparseHandle, m, n, int(NzCount()),
+                                           (double*) Data(), SecondaryIndexLocation(), MajorIndexLocation(), (double*) outMatrix.Data(),
+                                           outMatrix.MajorIndexLocation(), outMatrix.SecondaryIndexLocation(), CUSPARSE_ACTION_NUMERIC, CUSPARSE_INDEX_BASE_ZERO));
         }
     }
     else
     {
         NOT_IMPLEMENTED;
     }
-
-    CUSPARSE_CALL(cusparseDestroy(cusparseHandle));
 }
 
 template <class ElemType>
@@ -369,6 +381,46 @@ void GPUSparseMatrix<ElemType>::ConvertToSparseFormat(MatrixFormat newFormat)
     *this = std::move(tempMatrix);
 }
 
+// the derived data that GetOtherCompressedFormat() keeps with the storage object
+template <class ElemType>
+struct OtherCompressedFormatOfStorage
+{
+    size_t m_writeVersion; // of the storage when converted
+    size_t m_numRows;
+    size_t m_numCols;
+    std::shared_ptr<const GPUSparseMatrix<ElemType>> m_matrix;
+};
+
+// Products that would have cuSPARSE work on the transpose of a compressed matrix are much faster on the other format. Since the operand is mostly the same across
+// many calls (a sparse input in the forward and backward pass, or a parameter), the converted matrix is kept until
+// the matrix is written to, which bumps the write version of the storage (BaseMatrix::VerifyWritable()).
+template <class ElemType>
+std::shared_ptr<const GPUSparseMatrix<ElemType>> GPUSparseMatrix<ElemType>::GetOtherCompressedFormat() const
+{
+    if (GetFormat() != matrixFormatSparseCSC && GetFormat() != matrixFormatSparseCSR)
+        LogicError("GetOtherCompressedFormat: Only the CSC and CSR formats can be converted into each other.");
+    if (IsView())
+        LogicError("GetOtherCompressedFormat: The matrix must not be a slice.");
+
+    auto& cache = GetDerivedDataCache();
+    auto entry = std::static_pointer_cast<OtherCompressedFormatOfStorage<ElemType>>(cache);
+    if (!entry || entry->m_writeVersion != GetWriteVersion() || entry->m_numRows != GetNumRows() || entry->m_numCols != GetNumCols() ||
+        entry->m_matrix->GetComputeDeviceId() != GetComputeDeviceId())
+    {
+        MatrixFormat otherFormat = GetFormat() == matrixFormatSparseCSC ? matrixFormatSparseCSR : matrixFormatSparseCSC;
+        auto other = std::make_shared<GPUSparseMatrix<ElemType>>(GetComputeDeviceId(), otherFormat);
+        ConvertToSparseFormat(otherFormat, *other);
+
+        entry = std::make_shared<OtherCompressedFormatOfStorage<ElemType>>();
+        entry->m_writeVersion = GetWriteVersion();
+        entry->m_numRows = GetNumRows();
+        entry->m_numCols = GetNumCols();
+        entry->m_matrix = other;
+        cache = entry;
+    }
+    return entry->m_matrix;
+}
+
 template <class ElemType>
 GPUMatrix<ElemType> GPUSparseMatrix<ElemType>::CopyToDenseMatrix() const
 {
@@ -395,30 +447,7 @@ void GPUSparseMatrix<ElemType>::ChangeDeviceTo(DEVICEID_TYPE to_id)
     {
         ElemType* d_dst = reinterpret_cast<ElemType*>(TracingGPUMemoryAllocator::Allocate<char>(to_id, BufferSizeAllocated()));
 
-        // first try peer access
-        int canAccessPeer = false;
-        CUDA_CALL(cudaDeviceCanAccessPeer(&canAccessPeer, to_id, GetComputeDeviceId()));
-        if (canAccessPeer)
-        {
-            cudaError_t cudaStatus = cudaDeviceEnablePeerAccess(GetComputeDeviceId(), 0);
-            if (cudaStatus != cudaErrorPeerAccessAlreadyEnabled)
-            {
-                CUDA_CALL(cudaStatus);
-            }
-            CUDA_CALL(cudaMemcpyPeer(d_dst, to_id, Buffer(), GetComputeDeviceId(), BufferSizeAllocated()));
-        }
-        else
-        {
-            // peer access didn't work, just copy normal
-            // make this more efficient by keeping some buffers available for each copy
-            ElemType* h_dst = NULL;
-            PrepareDevice();
-            CUDA_CALL(cudaMallocHost((void**) &h_dst, BufferSizeAllocated()));
-            CUDA_CALL(cudaMemcpy(h_dst, Buffer(), BufferSizeAllocated(), cudaMemcpyDeviceToHost));
-            PrepareDevice((DEVICEID_TYPE) to_id);
-            CUDA_CALL(cudaMemcpy(d_dst, h_dst, BufferSizeAllocated(), cudaMemcpyHostToDevice));
-            CUDA_CALL(cudaFreeHost(h_dst));
-        }
+        CopyBetweenDevices(d_dst, to_id, Buffer(), GetComputeDeviceId(), BufferSizeAllocated());
 
         TracingGPUMemoryAllocator::Free<ElemType>(GetComputeDeviceId(), Buffer());
         SetBuffer(d_dst, BufferSizeAllocated());
@@ -454,8 +483,7 @@ void GPUSparseMatrix<ElemType>::SetValue(const GPUMatrix<ElemType>& denseMatrix,
     }
 
     PrepareDevice();
-    cusparseHandle_t cusparseHandle = 0;
-    CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    cusparseHandle_t cusparseHandle = GetCusparseHandle(GetComputeDeviceId());
     cusparseMatDescr_t descr = 0;
     CUSPARSE_CALL(cusparseCreateMatDescr(&descr));
     cusparseSetMatType(descr, CUSPARSE_MATRIX_TYPE_GENERAL);
@@ -903,11 +931,39 @@ void GPUSparseMatrix<ElemType>::SetMatrixFromCSCFormat(const CPUSPARSE_INDEX_TYP
 
     SetComputeDeviceId(PrepareDevice(devId));
     SetFormat(matrixFormatSparseCSC);
-    RequireSizeAndAllocate(numRows, numCols, nz, true, false);
+
+    // If the row indices directly follow the values of some capacity and the column offsets the row indices of that
+    // capacity, as in the minibatches of the SequencePacker, the arrays are laid out like the buffer of a matrix with
+    // that capacity. If the buffer has it, the arrays are copied in one go.
+    size_t capacity = nz;
+    bool isContiguous = false;
+    if (!IsOnDevice && sizeof(CPUSPARSE_INDEX_TYPE) == sizeof(GPUSPARSE_INDEX_TYPE) && (const char*) h_Row >= (const char*) (h_Val + nz))
+    {
+        size_t valuesSize = (const char*) h_Row - (const char*) h_Val;
+        capacity = valuesSize / sizeof(ElemType);
+        isContiguous = valuesSize % sizeof(ElemType) == 0 && h_CSCCol == h_Row + capacity;
+        if (!isContiguous)
+            capacity = nz;
+    }
+    RequireSizeAndAllocate(numRows, numCols, capacity, true, false);
 
     if (transferer && IsOnDevice)
         RuntimeError("Currently it is prohibited to copy data asynchronous from device to device.");
 
+    if (isContiguous && GetSizeAllocated() == capacity)
+    {
+        size_t size = BufferSizeNeeded(numRows, numCols, capacity, matrixFormatSparseCSC);
+        if (transferer)
+        {
+            transferer->RecordComputeStreamSyncPoint();
+            transferer->WaitForSyncPointOnAssignStreamAsync();
+            transferer->CopyCPUToGPUAsync(h_Val, size, 1, Buffer());
+        }
+        else
+            CUDA_CALL(cudaMemcpy(Buffer(), h_Val, size, cudaMemcpyHostToDevice));
+        return;
+    }
+
     // m_nz doesn't exist anymore. How are we going to deal with the NzSize, RowSize, and ColSize? Do it ourselves of course.
 
     cudaMemcpyKind kind = IsOnDevice ? cudaMemcpyDeviceToDevice : cudaMemcpyHostToDevice;
@@ -958,6 +1014,39 @@ void GPUSparseMatrix<ElemType>::SetMatrixFromCSCFormat(const CPUSPARSE_INDEX_TYP
     }
 }
 
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::SetMatrixFromOneHotSequences(const CPUSPARSE_INDEX_TYPE* h_indices, const CPUSPARSE_INDEX_TYPE* h_sequenceOffsets,
+    const size_t numSequences, const size_t maxSequenceLength, const size_t numRows)
+{
+    VerifyWritable(__func__);
+
+    size_t nz = h_sequenceOffsets[numSequences];
+    size_t numCols = numSequences * maxSequenceLength;
+    PrepareDevice();
+    SetFormat(matrixFormatSparseCSC);
+    // the sequence offsets are uploaded behind the row indices, into extra elements that are reserved for them
+    RequireSizeAndAllocate(numRows, numCols, nz + numSequences + 1, true, false);
+
+    const GPUSPARSE_INDEX_TYPE* pIndices = (const GPUSPARSE_INDEX_TYPE*) h_indices;
+    const GPUSPARSE_INDEX_TYPE* pOffsets = (const GPUSPARSE_INDEX_TYPE*) h_sequenceOffsets;
+    if (sizeof(CPUSPARSE_INDEX_TYPE) != sizeof(GPUSPARSE_INDEX_TYPE))
+    {
+        GPUSPARSE_INDEX_TYPE* pBuffer = (GPUSPARSE_INDEX_TYPE*) ReserveTempHostBuffer(sizeof(GPUSPARSE_INDEX_TYPE) * (nz + numSequences + 1));
+        ConvertBuffer(pBuffer, h_indices, nz);
+        ConvertBuffer(pBuffer + nz, h_sequenceOffsets, numSequences + 1);
+        pIndices = pBuffer;
+        pOffsets = pBuffer + nz;
+    }
+    GPUSPARSE_INDEX_TYPE* d_offsets = RowLocation() + nz;
+    CUDA_CALL(cudaMemcpy(RowLocation(), pIndices, sizeof(GPUSPARSE_INDEX_TYPE) * nz, cudaMemcpyHostToDevice));
+    CUDA_CALL(cudaMemcpy(d_offsets, pOffsets, sizeof(GPUSPARSE_INDEX_TYPE) * (numSequences + 1), cudaMemcpyHostToDevice));
+
+    int blocksPerGrid = (int) ceil(1.0 * (numCols + 1) / GridDim::maxThreadsPerBlock);
+    SyncGuard syncGuard;
+    _oneHotSequencesToCSC<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(
+        ColLocation(), Data(), d_offsets, (CUDA_LONG) numSequences, (CUDA_LONG) maxSequenceLength);
+}
+
 // this function will allocate memory while the caller needs to release it
 template <class ElemType>
 void GPUSparseMatrix<ElemType>::GetMatrixFromCSCFormat(GPUSPARSE_INDEX_TYPE*& h_CSCCol, GPUSPARSE_INDEX_TYPE*& h_Row, ElemType*& h_Val, size_t& numElemAllocated, size_t& nz, size_t& numRows, size_t& numCols) const
@@ -1039,6 +1128,10 @@ void GPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const GPU
     {
         ConvolveAndWeightedAdd(alpha, lhs, transposeA, rhs, transposeB, beta, c, 1, 1, false, false);
     }
+    else if (rhs.GetFormat() == matrixFormatSparseCSR && !rhs.IsView())
+    {
+        MultiplyAndWeightedAdd(alpha, lhs, transposeA, *rhs.GetOtherCompressedFormat(), transposeB, beta, c);
+    }
     else if (rhs.GetFormat() == matrixFormatSparseCSR)
     {
         GPUSparseMatrix<ElemType> tempMatrix(rhs.GetComputeDeviceId(), matrixFormatSparseCSC);
@@ -1222,6 +1315,12 @@ void GPUSparseMatrix<ElemType>::MultiplyAndAdd(ElemType alpha, const GPUMatrix<E
     }
     else if (!transposeA && transposeB)
     {
+        // the gradient goes into the SparseBlockCol result directly from the CSC form of rhs
+        if (rhs.GetFormat() == matrixFormatSparseCSR && !rhs.IsView())
+        {
+            MultiplyAndAdd(alpha, lhs, transposeA, *rhs.GetOtherCompressedFormat(), transposeB, c);
+            return;
+        }
         if (rhs.GetFormat() != matrixFormatSparseCSC)
             NOT_IMPLEMENTED;
 
@@ -1335,6 +1434,75 @@ size_t GPUSparseMatrix<ElemType>::IdentifyRowsWithValues() const
     return indexer.size();
 }
 
+// *this[:,idx[j]] = sum of a[:,j] * alpha as a block-column matrix, with a block for each distinct idx[j] in ascending order.
+// The columns are sorted by id, and each segment of equal ids is summed up by a thread per row, which, unlike
+// scattering with atomics, gives the same result in every run (and does not contend on frequent ids).
+template <class ElemType>
+GPUSparseMatrix<ElemType>& GPUSparseMatrix<ElemType>::AssignScatteredColumnsOf(const GPUMatrix<ElemType>& idx, const GPUMatrix<ElemType>& a, ElemType alpha)
+{
+    VerifyWritable(__func__);
+
+    if (idx.GetNumRows() != 1) // index is 1-dimensional only
+        InvalidArgument("AssignScatteredColumnsOf: Map must be a row vector.");
+    if (idx.GetNumCols() != a.GetNumCols())
+        InvalidArgument("AssignScatteredColumnsOf: Map must have width of input vector.");
+    if (idx.GetComputeDeviceId() != a.GetComputeDeviceId() || a.GetComputeDeviceId() != GetComputeDeviceId())
+        RuntimeError("GPUSparseMatrix::AssignScatteredColumnsOf: All matrices must be on the same GPU");
+
+    const CUDA_LONG numRows = (CUDA_LONG) a.GetNumRows();
+    const size_t numCols = GetNumCols();
+    const CUDA_LONG numIds = (CUDA_LONG) a.GetNumCols();
+    const GPUSPARSE_INDEX_TYPE gapKey = (GPUSPARSE_INDEX_TYPE) numCols; // sorts after all ids
+    int numKeyBits = 1;
+    while (numKeyBits < 31 && ((size_t) 1 << numKeyBits) <= numCols)
+        numKeyBits++;
+
+    PrepareDevice();
+    SyncGuard syncGuard;
+
+    // [keys (later the segment starts) | columns | sorted keys | sorted columns | block numbers | block starts]
+    GPUSPARSE_INDEX_TYPE* workspace = TracingGPUMemoryAllocator::Allocate<GPUSPARSE_INDEX_TYPE>(GetComputeDeviceId(), 6 * (size_t) numIds + 1);
+    GPUSPARSE_INDEX_TYPE* keys = workspace;
+    GPUSPARSE_INDEX_TYPE* columns = keys + numIds;
+    GPUSPARSE_INDEX_TYPE* sortedKeys = columns + numIds;
+    GPUSPARSE_INDEX_TYPE* sortedColumns = sortedKeys + numIds;
+    GPUSPARSE_INDEX_TYPE* blockNumbers = sortedColumns + numIds;
+    GPUSPARSE_INDEX_TYPE* blockStarts = blockNumbers + numIds;
+    GPUSPARSE_INDEX_TYPE* segmentStarts = keys;
+
+    GPUSPARSE_INDEX_TYPE numBlocks = 0;
+    if (numIds > 0)
+    {
+        size_t cbSort = 0, cbScan = 0;
+        CUDA_CALL(cub::DeviceRadixSort::SortPairs(nullptr, cbSort, keys, sortedKeys, columns, sortedColumns, numIds, 0, numKeyBits, t_stream));
+        CUDA_CALL(cub::DeviceScan::InclusiveSum(nullptr, cbScan, segmentStarts, blockNumbers, numIds, t_stream));
+        char* temp = TracingGPUMemoryAllocator::Allocate<char>(GetComputeDeviceId(), max(cbSort, cbScan));
+
+        int blocksPerGrid = (int) ceil(1.0 * numIds / GridDim::maxThreadsPerBlock);
+        _idsToSortKeys<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(idx.Data(), keys, columns, numIds, gapKey);
+        CUDA_CALL(cub::DeviceRadixSort::SortPairs(temp, cbSort, keys, sortedKeys, columns, sortedColumns, numIds, 0, numKeyBits, t_stream));
+        _markSegmentStarts<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(sortedKeys, segmentStarts, numIds, gapKey);
+        CUDA_CALL(cub::DeviceScan::InclusiveSum(temp, cbScan, segmentStarts, blockNumbers, numIds, t_stream));
+        TracingGPUMemoryAllocator::Free<char>(GetComputeDeviceId(), temp);
+
+        CUDA_CALL(cudaMemcpy(&numBlocks, blockNumbers + numIds - 1, sizeof(GPUSPARSE_INDEX_TYPE), cudaMemcpyDeviceToHost));
+    }
+
+    SetFormat(matrixFormatSparseBlockCol);
+    RequireSizeAndAllocate(numRows, numCols, max((size_t) numBlocks, (size_t) 1) * numRows, true, false);
+    SetBlockSize(numBlocks);
+    if (numBlocks > 0)
+    {
+        int blocksPerGrid = (int) ceil(1.0 * numIds / GridDim::maxThreadsPerBlock);
+        _setBlocksOfSegments<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(sortedKeys, blockNumbers, BlockId2ColOrRow(), ColOrRow2BlockId(), blockStarts, numIds, gapKey);
+        blocksPerGrid = (int) ceil(1.0 * numRows * numBlocks / GridDim::maxThreadsPerBlock);
+        _sumSortedColumnSegments<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(alpha, a.Data(), numRows, sortedColumns, blockStarts, numBlocks, Data());
+    }
+
+    TracingGPUMemoryAllocator::Free<GPUSPARSE_INDEX_TYPE>(GetComputeDeviceId(), workspace);
+    return *this;
+}
+
 // used for gradients udpate
 template <class ElemType>
 void GPUSparseMatrix<ElemType>::ScaleAndAdd(const ElemType alpha, const GPUSparseMatrix<ElemType>& lhs, GPUMatrix<ElemType>& rhs)
@@ -1369,6 +1537,29 @@ void GPUSparseMatrix<ElemType>::ScaleAndAdd(const ElemType alpha, const GPUSpars
     }
 }
 
+// criterion(0, j) = sum_i labels(i, j) * (logsumexp(prediction(:, j)) - prediction(i, j)), softmaxMinusLabels = softmax(prediction) - labels
+template <class ElemType>
+/*static*/ void GPUSparseMatrix<ElemType>::CrossEntropyWithSoftmax(const GPUSparseMatrix<ElemType>& labels, const GPUMatrix<ElemType>& prediction, GPUMatrix<ElemType>& criterion, GPUMatrix<ElemType>& softmaxMinusLabels)
+{
+    if (labels.GetFormat() != matrixFormatSparseCSC)
+        NOT_IMPLEMENTED;
+    if (labels.GetNumRows() != prediction.GetNumRows() || labels.GetNumCols() != prediction.GetNumCols())
+        InvalidArgument("GPUSparseMatrix::CrossEntropyWithSoftmax: The dimensions of the labels and the prediction must match.");
+    if (labels.GetComputeDeviceId() != prediction.GetComputeDeviceId())
+        RuntimeError("GPUSparseMatrix::CrossEntropyWithSoftmax: All matrices must be on the same GPU");
+
+    criterion.RequireSize(1, prediction.GetNumCols());
+    softmaxMinusLabels.RequireSize(prediction.GetNumRows(), prediction.GetNumCols());
+    if (prediction.IsEmpty())
+        return;
+
+    labels.PrepareDevice();
+    SyncGuard syncGuard;
+    // note: kernel uses hard-coded thread dimension
+    _crossEntropyWithSoftmaxOfSparseLabels512Threads<ElemType><<<(CUDA_LONG) prediction.GetNumCols(), 512, 0, t_stream>>>(
+        prediction.Data(), labels.Buffer(), labels.RowLocation(), labels.ColLocation(), criterion.Data(), softmaxMinusLabels.Data(), (CUDA_LONG) prediction.GetNumRows());
+}
+
 template <class ElemType>
 GPUSparseMatrix<ElemType>& GPUSparseMatrix<ElemType>::InplaceTruncate(const ElemType threshold)
 {
@@ -1505,9 +1696,16 @@ void GPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const GPU
     if (a.GetComputeDeviceId() != b.GetComputeDeviceId() || (b.GetComputeDeviceId() != a.GetComputeDeviceId()))
         RuntimeError("MultiplyAndWeightedAdd: All matrices must be on the same GPU");
 
+    // csrmm() with CUSPARSE_OPERATION_TRANSPOSE is many times slower than without, so that case (e.g. a CSC input
+    // multiplied as is) goes to the other format, which is then multiplied without the transpose.
+    if (transposeA != reinterpretAsCSR && !a.IsView() && !a.IsEmpty())
+    {
+        MultiplyAndWeightedAdd(alpha, *a.GetOtherCompressedFormat(), transposeA, b, transposeB, beta, c);
+        return;
+    }
+
     a.PrepareDevice();
-    cusparseHandle_t cusparseHandle = 0;
-    CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    cusparseHandle_t cusparseHandle = GetCusparseHandle(a.GetComputeDeviceId());
     cusparseMatDescr_t descr = 0;
     CUSPARSE_CALL(cusparseCreateMatDescr(&descr));
     cusparseSetMatType(descr, CUSPARSE_MATRIX_TYPE_GENERAL);
@@ -1536,7 +1734,6 @@ void GPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const GPU
                                      aRowLocation, aColLocation, reinterpret_cast<double*>(b.Data()),
                                      (int) b.GetNumRows(), reinterpret_cast<double*>(&beta), reinterpret_cast<double*>(c.Data()), (int) c.GetNumRows()));
     }
-    CUSPARSE_CALL(cusparseDestroy(cusparseHandle));
 }
 
 template <class ElemType>
@@ -1655,8 +1852,7 @@ void GPUSparseMatrix<ElemType>::Multiply(const GPUSparseMatrix<ElemType>& S1, bo
         RuntimeError("Sparse matrix multiply: both matrices must be on the same device");
 
     S1.PrepareDevice();
-    cusparseHandle_t cusparseHandle = 0;
-    CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    cusparseHandle_t cusparseHandle = GetCusparseHandle(S1.GetComputeDeviceId());
     cusparseMatDescr_t descrA = 0, descrB = 0, descrC = 0;
     CUSPARSE_CALL(cusparseCreateMatDescr(&descrA));
     CUSPARSE_CALL(cusparseCreateMatDescr(&descrB));
@@ -1704,7 +1900,6 @@ void GPUSparseMatrix<ElemType>::Multiply(const GPUSparseMatrix<ElemType>& S1, bo
                                        descrB, nnzB, (const double*) S2.Buffer(), S2.RowLocation(), S2.ColLocation(),
                                        descrC, (double*) c.Data(), c.RowLocation(), c.ColLocation()));
     }
-    cusparseDestroy(cusparseHandle);
 }
 
 template <class ElemType>
@@ -1737,8 +1932,7 @@ void GPUSparseMatrix<ElemType>::ScaleAndAdd(ElemType alpha, const GPUSparseMatri
     int nnzB = (int) b.GetNumNZElements();
 
     a.PrepareDevice();
-    cusparseHandle_t cusparseHandle = 0;
-    CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    cusparseHandle_t cusparseHandle = GetCusparseHandle(a.GetComputeDeviceId());
     cusparseMatDescr_t descrA = 0, descrB = 0, descrC = 0;
     CUSPARSE_CALL(cusparseCreateMatDescr(&descrA));
     CUSPARSE_CALL(cusparseCreateMatDescr(&descrB));
@@ -1772,7 +1966,6 @@ void GPUSparseMatrix<ElemType>::ScaleAndAdd(ElemType alpha, const GPUSparseMatri
         CUSPARSE_CALL(cusparseDcsrgeam(cusparseHandle, m, n, reinterpret_cast<const double*>(&alpha), descrA, nnzA, reinterpret_cast<const double*>(a.Data()), a.RowLocation(), a.ColLocation(),
                                        reinterpret_cast<const double*>(&beta), descrB, nnzB, reinterpret_cast<const double*>(b.Data()), b.RowLocation(), b.ColLocation(), descrC, reinterpret_cast<double*>(c.Data()), c.RowLocation(), c.ColLocation()));
     }
-    cusparseDestroy(cusparseHandle);
 }
 
 template <class ElemType>
@@ -1854,44 +2047,21 @@ ElemType GPUSparseMatrix<ElemType>::InnerProductOfMatrices(const GPUSparseMatrix
 
     int m = (int) a.GetNumRows();
     int n = (int) a.GetNumCols();
-    int nnz = (int) a.GetNumNZElements();
-
-    ElemType* cscValA = nullptr;
-    GPUSPARSE_INDEX_TYPE* cscRowIndA = nullptr;
-    GPUSPARSE_INDEX_TYPE* cscColPtrA = nullptr;
 
-    cusparseAction_t cpVals = CUSPARSE_ACTION_NUMERIC;
     cusparseIndexBase_t idxBase = CUSPARSE_INDEX_BASE_ZERO;
-    cusparseHandle_t cusparseHandle = 0;
-
-    if (a.GetFormat() == matrixFormatSparseCSR) // need to put a in ColumnMajor format
-    {
-        cscValA = TracingGPUMemoryAllocator::Allocate<ElemType>(a.GetComputeDeviceId(), nnz);
-        cscRowIndA = TracingGPUMemoryAllocator::Allocate<GPUSPARSE_INDEX_TYPE>(a.GetComputeDeviceId(), nnz);
-        cscColPtrA = TracingGPUMemoryAllocator::Allocate<GPUSPARSE_INDEX_TYPE>(a.GetComputeDeviceId(), (n + 1));
-
-        CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
-        SyncGuard syncGuard;
-        if (sizeof(ElemType) == sizeof(float))
-        {
-            CUSPARSE_CALL(cusparseScsr2csc(cusparseHandle, m, n, nnz, reinterpret_cast<const float*>(a.Data()), a.RowLocation(), a.ColLocation(), reinterpret_cast<float*>(cscValA), cscRowIndA, cscColPtrA, cpVals, idxBase));
-        }
-        else
-        {
-            CUSPARSE_CALL(cusparseDcsr2csc(cusparseHandle, m, n, nnz, reinterpret_cast<const double*>(a.Data()), a.RowLocation(), a.ColLocation(), reinterpret_cast<double*>(cscValA), cscRowIndA, cscColPtrA, cpVals, idxBase));
-        }
-    }
-    else if (a.GetFormat() == matrixFormatSparseCSC)
-    {
-        cscValA = (ElemType*) a.Data();
-        cscRowIndA = a.RowLocation();
-        cscColPtrA = a.ColLocation();
-    }
-    else
-    {
-        NOT_IMPLEMENTED;
-    }
-    let a_nz = a.NzCount();
+    a.PrepareDevice();
+    cusparseHandle_t cusparseHandle = GetCusparseHandle(a.GetComputeDeviceId());
+
+    // need a in ColumnMajor format
+    std::shared_ptr<const GPUSparseMatrix<ElemType>> aCSC;
+    if (a.GetFormat() == matrixFormatSparseCSR)
+        aCSC = a.GetOtherCompressedFormat();
+    const GPUSparseMatrix<ElemType>& csc = aCSC ? *aCSC : a;
+    ElemType* cscValA = csc.Data();
+    GPUSPARSE_INDEX_TYPE* cscRowIndA = csc.RowLocation();
+    GPUSPARSE_INDEX_TYPE* cscColPtrA = csc.ColLocation();
+
+    let a_nz = csc.NzCount();
     // Given sparse matrix in column major format, calculate indices for corresponding sparse vector
     GPUSPARSE_INDEX_TYPE* vectArray = TracingGPUMemoryAllocator::Allocate<GPUSPARSE_INDEX_TYPE>(a.GetComputeDeviceId(), a_nz);
     CUDA_LONG M = n;
@@ -1900,8 +2070,6 @@ ElemType GPUSparseMatrix<ElemType>::InnerProductOfMatrices(const GPUSparseMatrix
     int blocksPerGrid = (int) ceil(1.0 * M / GridDim::maxThreadsPerBlock);
     SyncGuard syncGuard;
     _getSparseVectorRepresntationForCSCMatrix<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock>>>(cscColPtrA, cscRowIndA, vectArray, M, N);
-    TracingGPUMemoryAllocator::Free<GPUSPARSE_INDEX_TYPE>(a.GetComputeDeviceId(), cscRowIndA);
-    TracingGPUMemoryAllocator::Free<GPUSPARSE_INDEX_TYPE>(a.GetComputeDeviceId(), cscColPtrA);
     // CUDA_CALL(cudaMemcpy(h_vectArray,vectArray,sizeof(GPUSPARSE_INDEX_TYPE)*a.m_nz,cudaMemcpyDeviceToHost));
 
     // Actual dot product
@@ -1919,8 +2087,6 @@ ElemType GPUSparseMatrix<ElemType>::InnerProductOfMatrices(const GPUSparseMatrix
                                     reinterpret_cast<double*>(&res), idxBase));
     }
     TracingGPUMemoryAllocator::Free<GPUSPARSE_INDEX_TYPE>(a.GetComputeDeviceId(), vectArray);
-    TracingGPUMemoryAllocator::Free<ElemType>(a.GetComputeDeviceId(), cscValA);
-    CUSPARSE_CALL(cusparseDestroy(cusparseHandle));
     return res;
 }
 
@@ -2131,8 +2297,7 @@ GPUSparseMatrix<ElemType> GPUSparseMatrix<ElemType>::Transpose() const
     GPUSparseMatrix c(GetComputeDeviceId(), GetFormat());
     c.RequireSizeAndAllocate(n, m, nnz, GetFormat(), true, false);
 
-    cusparseHandle_t cusparseHandle = 0;
-    CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    cusparseHandle_t cusparseHandle = GetCusparseHandle(GetComputeDeviceId());
 
     SyncGuard syncGuard;
     if (GetFormat() == MatrixFormat::matrixFormatSparseCSR)
@@ -2179,7 +2344,6 @@ GPUSparseMatrix<ElemType> GPUSparseMatrix<ElemType>::Transpose() const
     {
         NOT_IMPLEMENTED;
     }
-    CUSPARSE_CALL(cusparseDestroy(cusparseHandle));
     return c;
 }
 
@@ -2241,15 +2405,13 @@ void GPUSparseMatrix<ElemType>::AssignColumnSliceToDense(GPUMatrix<ElemType>& sl
         NOT_IMPLEMENTED;
 
     PrepareDevice();
-    cusparseHandle_t cusparseHandle = 0;
-    CUSPARSE_CALL(cusparseCreate(&cusparseHandle));
+    cusparseHandle_t cusparseHandle = GetCusparseHandle(GetComputeDeviceId());
     cusparseMatDescr_t descr = 0;
     CUSPARSE_CALL(cusparseCreateMatDescr(&descr));
     cusparseSetMatType(descr, CUSPARSE_MATRIX_TYPE_GENERAL);
     cusparseSetMatIndexBase(descr, CUSPARSE_INDEX_BASE_ZERO);
 
     SyncGuard syncGuard;
-    CUSPARSE_CALL(cusparseSetStream(cusparseHandle, t_stream));
     if (sizeof(ElemType) == sizeof(float))
     {
         CUSPARSE_CALL(cusparseScsc2dense(cusparseHandle, m, numCols, descr, (float*) Buffer(), RowLocation(), ColLocation() + startColumn, (float*) slice.Data(), m));
@@ -2258,9 +2420,6 @@ void GPUSparseMatrix<ElemType>::AssignColumnSliceToDense(GPUMatrix<ElemType>& sl
     {
         CUSPARSE_CALL(cusparseDcsc2dense(cusparseHandle, m, numCols, descr, (double*) Buffer(), RowLocation(), ColLocation() + startColumn, (double*) slice.Data(), m));
     }
-
-    CUSPARSE_CALL(cusparseDestroy(cusparseHandle));
-
 }
 template <class ElemType>
 GPUMatrix<ElemType> GPUSparseMatrix<ElemType>::CopyColumnSliceToDense(size_t startColumn, size_t numCols) const
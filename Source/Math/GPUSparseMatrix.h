@@ -339,6 +339,11 @@ public:
                                 const size_t nz, const size_t numRows, const size_t numCols, const bool IsOnDevice = false, const DEVICEID_TYPE devId = -1);
     void SetMatrixFromCSCFormat(const CPUSPARSE_INDEX_TYPE* h_CSCCol, const CPUSPARSE_INDEX_TYPE* h_Row, const ElemType* h_Val,
         const size_t nz, const size_t numRows, const size_t numCols, const bool IsOnDevice = false, const DEVICEID_TYPE devId = -1, DataTransferer* transferer = nullptr);
+    // see Matrix<ElemType>::SetMatrixFromOneHotSequences()
+    void SetMatrixFromOneHotSequences(const CPUSPARSE_INDEX_TYPE* h_indices, const CPUSPARSE_INDEX_TYPE* h_sequenceOffsets,
+        const size_t numSequences, const size_t maxSequenceLength, const size_t numRows);
+    // see Matrix<ElemType>::AssignScatteredColumnsOf()
+    GPUSparseMatrix<ElemType>& AssignScatteredColumnsOf(const GPUMatrix<ElemType>& idx, const GPUMatrix<ElemType>& a, ElemType alpha);
 
     // Gets sparse matrix in CSR format. this acts as deep copy. All passed pointers must be NULL. the function will allocate memory itself.
     void GetMatrixFromCSRFormat(CPUSPARSE_INDEX_TYPE*& h_CSRRow, CPUSPARSE_INDEX_TYPE*& h_Col, ElemType*& h_Val, size_t& numElemAllocated, size_t& nz, size_t& numRows, size_t& numCols) const;
@@ -347,6 +352,8 @@ public:
 
     void ConvertToSparseFormat(MatrixFormat newFormat);
     void ConvertToSparseFormat(MatrixFormat newFormat, GPUSparseMatrix<ElemType>& outMatrix) const;
+    // the matrix in CSR format if it is CSC, and vice versa; kept with the storage until the matrix is written to (not for views)
+    std::shared_ptr<const GPUSparseMatrix<ElemType>> GetOtherCompressedFormat() const;
 
     bool IsValid() const;
 
@@ -404,6 +411,7 @@ public:
     static void MultiplyAndAdd(ElemType alpha, const GPUMatrix<ElemType>& lhs, const bool transposeA, const GPUSparseMatrix<ElemType>& rhs,
                                const bool transposeB, GPUSparseMatrix<ElemType>& c);
     static void ScaleAndAdd(const ElemType alpha, const GPUSparseMatrix<ElemType>& lhs, GPUMatrix<ElemType>& c);
+    static void CrossEntropyWithSoftmax(const GPUSparseMatrix<ElemType>& labels, const GPUMatrix<ElemType>& prediction, GPUMatrix<ElemType>& criterion, GPUMatrix<ElemType>& softmaxMinusLabels);
     static void ConvolveAndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& lhs, const bool transposeA, const GPUSparseMatrix<ElemType>& rhs,
                                        const bool transposeB, ElemType beta, GPUMatrix<ElemType>& c, size_t numChannels, size_t horizontalSubsample, bool padding, bool channelwise);
     static void TensorShuffleScaleAndAdd(ElemType keepWeight, const GPUSparseMatrix<ElemType>& a, size_t D, size_t S, size_t M, size_t K, size_t T, ElemType scaleFactor, const GPUSparseMatrix<ElemType>& b, GPUSparseMatrix<ElemType>& c);
@@ -32,11 +32,8 @@
 #pragma warning(disable : 4127) // conditional expression is constant; "if (sizeof(ElemType)==sizeof(float))" triggers this
 #pragma warning(disable : 4702) // unreachable code; triggered for unknown reasons
 
-#ifdef _WIN32
-// thread local storage to access the current stream, initalize to default stream
-__declspec(thread)
-#endif
-extern cudaStream_t t_stream;
+// thread local storage to access the current stream, initalize to default stream (see GPUMatrix.cu)
+extern THREAD_LOCAL cudaStream_t t_stream;
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -476,6 +473,41 @@ struct TensorOpElement<ElemType, N, M, K, /*parallelReduce=*/false, /*k=*/-1>
 
 #undef ALLOW_ATOMIC_REDUCTION // undefine to disable use of atomicAdd() below, for testing it
 
+// shuffle down within a warp (the intrinsic takes a lane mask as of CUDA 9)
+template <class T>
+static __device__ T ShuffleDown(T value, int delta)
+{
+#if CUDA_VERSION >= 9000
+    return __shfl_down_sync(0xffffffff, value, delta);
+#else
+    return __shfl_down(value, delta);
+#endif
+}
+
+// Reduces the aggregates of the threads of a block into thread 0: first within each warp through shuffles, then the
+// results of the warps by the first warp. blockDim.x must be a multiple of the warp size. The order of the
+// operations only depends on the block size, so that the result is reproducible.
+template <class ReduceElemType>
+static __device__ ReduceElemType BlockReduce(ReduceElemType aggregate, ElementWiseOperator reductionOp)
+{
+    __shared__ ReduceElemType warpAggregates[GridDim::maxWarpsPerBlock];
+    const CUDA_LONG lane = threadIdx.x % warpSize;
+    const CUDA_LONG warp = threadIdx.x / warpSize;
+    for (int delta = warpSize / 2; delta > 0; delta /= 2)
+        UpdateAggregate<ReduceElemType, ReduceElemType>(aggregate, ShuffleDown(aggregate, delta), reductionOp);
+    if (lane == 0)
+        warpAggregates[warp] = aggregate;
+    __syncthreads();
+    if (warp == 0)
+    {
+        const CUDA_LONG numWarps = blockDim.x / warpSize;
+        aggregate = lane < numWarps ? warpAggregates[lane] : NeutralValue<ReduceElemType>(reductionOp);
+        for (int delta = warpSize / 2; delta > 0; delta /= 2)
+            UpdateAggregate<ReduceElemType, ReduceElemType>(aggregate, ShuffleDown(aggregate, delta), reductionOp);
+    }
+    return aggregate;
+}
+
 // specialization for k = -1 terminates the template recursion, and computes reductions in parallel
 template <class ElemType, C_size_t N, C_int M, C_int K>
 struct TensorOpElement<ElemType, N, M, K, /*parallelReduce=*/true, /*k=*/-1>
@@ -509,25 +541,13 @@ struct TensorOpElement<ElemType, N, M, K, /*parallelReduce=*/true, /*k=*/-1>
             UpdateAggregate<ReduceElemType, ElemType>(aggregate, val, reductionOp);
         }
 
-        // reduce    --cf https://docs.nvidia.com/cuda/samples/6_Advanced/reduction/doc/reduction.pdf
-        __shared__ ReduceElemType volatile accumulators[GridDim::maxThreadsPerBlock /*tids*/];
-        accumulators[tid] = aggregate;
-        __syncthreads();
-        static_assert(GridDim::maxThreadsPerBlock <= 1024, "GridDim::maxThreadsPerBlock too large, need to add manually unrolled steps");
-        for (CUDA_LONG i = 512; i; i >>= 1)
-        {
-            if (tid < i && tid + i < tids)
-                UpdateAggregate<volatile ReduceElemType, volatile ReduceElemType>(accumulators[tid], accumulators[tid + i], reductionOp);
-
-            if (0 + i < tids)
-                __syncthreads(); // sync if condition true for at least one thread
-            // TODO: use volatile* and then we can skip the __syncthreads() for the last 32 values. See Amit's allreduce() function implementation in MatrixQuantizer_kernel.cu.
-        }
+        // reduce across the block
+        aggregate = BlockReduce<ReduceElemType>(aggregate, reductionOp);
 
         // now set final value to output coordinate
         if (tid == 0)
         {
-            ElemType val = (ElemType) accumulators[0];
+            ElemType val = (ElemType) aggregate;
             // scale
             val *= alpha;
             // combine with previous value in target matrix, then write it out
@@ -569,10 +589,227 @@ __global__ void _launchTensorOp(ElemType beta, FixedArray<ElemType*, N> pointers
         TensorOpElement<ElemType, N, M, K, false, K - 1>::Compute(id, beta, pointers, alpha, op, reductionOp, regularOpStrides, regularStrides, reducingOpDims, reducingStrides, 0, 0);
 }
 
+// -----------------------------------------------------------------------
+// kernel and launch  --no reduction, contiguous or simply broadcast operands
+// -----------------------------------------------------------------------
+
+// The regular kernel above maps the thread index to each operand with a division and a multiply-add per dimension,
+// which costs more than the memory traffic when the operands are contiguous or broadcast along one axis only, as in
+// most elementwise ops of a network (bias, scaling, gating). Such an op is computed as a [rows x cols] op where each
+// operand either has an element per row (row stride 1) or is the same for all rows (row stride 0), and moves by its
+// column stride from one column to the next. The blocks of a grid row process one column at a time, with V elements
+// per thread and vector loads where all operands are aligned, in grid-stride loops over the rows and the columns.
+
+// the op on values rather than pointers
+template <class ElemType, C_size_t N>
+struct TensorOpValues;
+
+template <class ElemType>
+struct TensorOpValues<ElemType, 2>
+{
+    static __device__ ElemType Compute(const ElemType* inputs, ElementWiseOperator op)
+    {
+        ElemType a = inputs[0];
+        switch (op)
+        {
+            ForAllUnaryOps(CaseUnaryTensorOp);
+        default:
+            return 0; // (failure)
+        }
+    }
+};
+
+template <class ElemType>
+struct TensorOpValues<ElemType, 3>
+{
+    static __device__ ElemType Compute(const ElemType* inputs, ElementWiseOperator op)
+    {
+        ElemType a = inputs[0];
+        ElemType b = inputs[1];
+        switch (op)
+        {
+            ForAllBinaryOps(CaseBinaryTensorOp);
+        default:
+            return 0; // (failure)
+        }
+    }
+};
+
+template <class ElemType>
+struct TensorOpValues<ElemType, 4>
+{
+    static __device__ ElemType Compute(const ElemType* inputs, ElementWiseOperator op)
+    {
+#define CaseTernaryTensorOpValues(oper) \
+    case ElementWiseOperator::op##oper: \
+        return Op##oper(inputs[0], inputs[1], inputs[2])
+        switch (op)
+        {
+            ForAllTernaryOps(CaseTernaryTensorOpValues);
+        default:
+            return 0; // (failure)
+        }
+    }
+};
+
+// 16-byte loads and stores
+template <class ElemType>
+struct VectorOf;
+template <>
+struct VectorOf<float>
+{
+    typedef float4 type;
+};
+template <>
+struct VectorOf<double>
+{
+    typedef double2 type;
+};
+
+template <class ElemType, C_int V>
+struct VectorAccess
+{
+    typedef typename VectorOf<ElemType>::type VectorType;
+    static_assert(sizeof(VectorType) == V * sizeof(ElemType), "VectorAccess: V must fill the vector type");
+    static __device__ void Load(const ElemType* p, ElemType* values)
+    {
+        VectorType v = *reinterpret_cast<const VectorType*>(p);
+        const ElemType* elements = reinterpret_cast<const ElemType*>(&v);
+        for (C_int c = 0; c < V; c++)
+            values[c] = elements[c];
+    }
+    static __device__ void Store(ElemType* p, const ElemType* values)
+    {
+        VectorType v;
+        ElemType* elements = reinterpret_cast<ElemType*>(&v);
+        for (C_int c = 0; c < V; c++)
+            elements[c] = values[c];
+        *reinterpret_cast<VectorType*>(p) = v;
+    }
+};
+
+template <class ElemType>
+struct VectorAccess<ElemType, 1>
+{
+    static __device__ void Load(const ElemType* p, ElemType* values) { values[0] = *p; }
+    static __device__ void Store(ElemType* p, const ElemType* values) { *p = values[0]; }
+};
+
+// computes the elements [i, i + V) of a column; 'columns' point to the column of each operand, the last one is the output
+template <class ElemType, C_size_t N, C_int V>
+static __device__ void ComputeSimpleTensorOpElements(ElemType beta, ElemType* const* columns, ElemType alpha, ElementWiseOperator op,
+                                                     const FixedArray<C_int, N>& rowStrides, CUDA_LONG i)
+{
+    ElemType inputs[N - 1][V];
+    for (C_size_t k = 0; k < N - 1; k++)
+    {
+        if (rowStrides[k] != 0)
+            VectorAccess<ElemType, V>::Load(columns[k] + i, inputs[k]);
+        else
+        {
+            const ElemType value = *columns[k]; // broadcast along the column
+            for (C_int c = 0; c < V; c++)
+                inputs[k][c] = value;
+        }
+    }
+
+    ElemType results[V];
+    for (C_int c = 0; c < V; c++)
+    {
+        ElemType values[N - 1];
+        for (C_size_t k = 0; k < N - 1; k++)
+            values[k] = inputs[k][c];
+        results[c] = TensorOpValues<ElemType, N>::Compute(values, op) * alpha;
+    }
+
+    ElemType* pout = columns[N - 1] + i;
+    if (beta != 0) // (skip memory access if not needed, and allow for ignoring NaNs)
+    {
+        ElemType previous[V];
+        VectorAccess<ElemType, V>::Load(pout, previous);
+        for (C_int c = 0; c < V; c++)
+            results[c] += beta * previous[c];
+    }
+    VectorAccess<ElemType, V>::Store(pout, results);
+}
+
+template <class ElemType, C_size_t N, C_int V>
+__global__ void _launchSimpleTensorOp(ElemType beta, FixedArray<ElemType*, N> pointers, ElemType alpha, ElementWiseOperator op,
+                                      FixedArray<C_int, N> rowStrides, FixedArray<C_int, N> colStrides, CUDA_LONG numRows, CUDA_LONG numCols)
+{
+    const CUDA_LONG numVectorRows = numRows / V * V; // the rows that are processed V at a time; the rest one by one
+    const CUDA_LONG threadId = GridDim::GetLinearThreadId();
+    const CUDA_LONG numThreads = gridDim.x * blockDim.x;
+    for (CUDA_LONG j = blockIdx.y; j < numCols; j += gridDim.y)
+    {
+        ElemType* columns[N];
+        for (C_size_t k = 0; k < N; k++)
+            columns[k] = pointers[k] + j * colStrides[k];
+        for (CUDA_LONG i = threadId * V; i < numVectorRows; i += numThreads * V)
+            ComputeSimpleTensorOpElements<ElemType, N, V>(beta, columns, alpha, op, rowStrides, i);
+        for (CUDA_LONG i = numVectorRows + threadId; i < numRows; i += numThreads)
+            ComputeSimpleTensorOpElements<ElemType, N, 1>(beta, columns, alpha, op, rowStrides, i);
+    }
+}
+
+// launches the kernel above if the op has this form; returns false otherwise
+template <class ElemType, C_size_t N, C_int K>
+static bool TryLaunchSimpleTensorOp(ElemType beta, const array<ElemType*, N>& pointerVector, ElemType alpha, ElementWiseOperator op,
+                                    const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, N>& regularStrideVectors)
+{
+    if (K > 2 || !TensorOpKernels::AreFastPathsEnabled())
+        return false;
+
+    const CUDA_LONG numRows = K > 0 ? (CUDA_LONG) regularOpDims[0] : 1;
+    const CUDA_LONG numCols = K > 1 ? (CUDA_LONG) regularOpDims[1] : 1;
+    if (numRows == 0 || numCols == 0)
+        return false;
+
+    // the vector width: 16 bytes, if every operand with a row stride of 1 is aligned in every column
+    const C_int vectorWidth = 16 / sizeof(ElemType);
+    bool vectorize = numRows >= vectorWidth;
+    array<C_int, N> rowStrideVector, colStrideVector;
+    for (C_size_t i = 0; i < N; i++)
+    {
+        const ptrdiff_t rowStride = K > 0 ? regularStrideVectors[i][0] : 0;
+        const ptrdiff_t colStride = K > 1 ? regularStrideVectors[i][1] : 0;
+        if (rowStride != 0 && rowStride != 1)
+            return false;
+        if (i == N - 1 && rowStride != 1 && numRows > 1) // (the output cannot be broadcast)
+            return false;
+        rowStrideVector[i] = (C_int) rowStride;
+        colStrideVector[i] = (C_int) colStride;
+        if (rowStride == 1 && ((size_t) pointerVector[i] % 16 != 0 || (numCols > 1 && colStride % vectorWidth != 0)))
+            vectorize = false;
+    }
+
+    FixedArray<ElemType*, N> pointers(pointerVector);
+    FixedArray<C_int, N> rowStrides(rowStrideVector);
+    FixedArray<C_int, N> colStrides(colStrideVector);
+
+    // enough blocks to fill the device; the grid-stride loops do the rest
+    const auto& props = GridDim::GetDeviceProps();
+    const CUDA_LONG maxBlocks = props.multiProcessorCount * 16;
+    const CUDA_LONG numThreadRows = vectorize ? CeilDiv(numRows, vectorWidth) : numRows;
+    const CUDA_LONG threadsPerBlock = min((CUDA_LONG) 256, CeilDiv(numThreadRows, props.warpSize) * props.warpSize);
+    const CUDA_LONG blocksX = min(CeilDiv(numThreadRows, threadsPerBlock), maxBlocks);
+    const CUDA_LONG blocksY = min(min(numCols, max(maxBlocks / blocksX, (CUDA_LONG) 1)), (CUDA_LONG) 65535);
+
+    SyncGuard syncGuard;
+    if (vectorize)
+        _launchSimpleTensorOp<ElemType, N, 16 / sizeof(ElemType)><<<dim3(blocksX, blocksY), threadsPerBlock, 0, t_stream>>>(beta, pointers, alpha, op, rowStrides, colStrides, numRows, numCols);
+    else
+        _launchSimpleTensorOp<ElemType, N, 1><<<dim3(blocksX, blocksY), threadsPerBlock, 0, t_stream>>>(beta, pointers, alpha, op, rowStrides, colStrides, numRows, numCols);
+    return true;
+}
+
 template <class ElemType, C_size_t N, C_int K>
 static void LaunchTensorOp(ElemType beta, array<ElemType*, N> pointerVector, ElemType alpha, ElementWiseOperator op,
                            const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, N>& regularStrideVectors)
 {
+    if (TryLaunchSimpleTensorOp<ElemType, N, K>(beta, pointerVector, alpha, op, regularOpDims, regularStrideVectors))
+        return;
+
     // copy all parameters to CUDA-compatible data structures
     FixedArray<ElemType*, N> pointers(pointerVector);
     SmallVector<C_size_t> regularOpStrideVector; // kernel needs the strides for converting thread index back to multi-dimensional tensor index
@@ -617,9 +854,9 @@ __global__ void _launchTensorOpWithReduction(ElemType beta, FixedArray<ElemType*
 template <class ElemType>
 static shared_ptr<ElemType> AllocateReductionBuffer(size_t N)
 {
-    ElemType* deviceBufferPtr;
-    CUDA_CALL(cudaMalloc((void**)&deviceBufferPtr, sizeof(ElemType) * N));
-    return shared_ptr<ElemType>(deviceBufferPtr, [](ElemType* deviceBufferPtr){ cudaFree((void*)deviceBufferPtr); });
+    let deviceId = GridDim::GetCurrentDeviceId();
+    ElemType* deviceBufferPtr = TracingGPUMemoryAllocator::Allocate<ElemType>(deviceId, N);
+    return shared_ptr<ElemType>(deviceBufferPtr, [deviceId](ElemType* deviceBufferPtr){ TracingGPUMemoryAllocator::Free<ElemType>(deviceId, deviceBufferPtr, /*ignoreCUDARetCode=*/true); });
 }
 
 template <class ElemType>
@@ -644,6 +881,15 @@ static shared_ptr<ElemType> GetReductionBuffer(size_t N)
     return reductionBuffersCache[deviceId];
 }
 
+// the block size for reducing 'reductionChunkSize' elements per block: the maximum for long reductions, and for short
+// ones such that each thread reduces about 4 elements before the block reduction; always a multiple of the warp size
+static CUDA_LONG ReductionThreadsPerBlock(CUDA_LONG reductionChunkSize, CUDA_LONG threadsPerWarp)
+{
+    const CUDA_LONG elementsPerThread = 4;
+    CUDA_LONG numThreads = CeilDiv(CeilDiv(reductionChunkSize, elementsPerThread), threadsPerWarp) * threadsPerWarp;
+    return min(numThreads, GridDim::maxThreadsPerBlock);
+}
+
 // All dimensions (N-ariness, number of input dimensions K and number of reduction dimensions M) are bound to template parameters now.
 template <class ElemType, C_size_t N, C_int M, C_int K>
 static void LaunchTensorOpWithReduction(ElemType beta, array<ElemType*, N> pointerVector, ElemType alpha, ElementWiseOperator op, ElementWiseOperator reductionOp,
@@ -741,13 +987,13 @@ static void LaunchTensorOpWithReduction(ElemType beta, array<ElemType*, N> point
 
         // reduction goes into thread dim X
         let reductionChunkSize = CeilDiv(reductionDim, numReductionChunks);
-        let numThreadsX = min(reductionChunkSize, GridDim::maxThreadsPerBlock); // any that's over will be done by looping inside the kernel
+        let numThreadsX = ReductionThreadsPerBlock(reductionChunkSize, props.warpSize); // any that's over will be done by looping inside the kernel
 
         // --- cases (a1) and (a2)
         // This involves no reduction across blocks.
         if (numReductionChunks == 1)
         {
-            _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, numBlocksZ), numThreadsX, numThreadsX * sizeof(ReduceElemType), t_stream>>>(
+            _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, numBlocksZ), numThreadsX, 0, t_stream>>>(
                 beta, pointers, alpha, op, reductionOp,
                 regularOpStrides, regularStrides, NN,
                 reducingOpDims, reducingStrides, /*reductionBegin*/ 0, reductionChunkSize);
@@ -784,7 +1030,7 @@ static void LaunchTensorOpWithReduction(ElemType beta, array<ElemType*, N> point
             FixedMatrix<C_int, N, K> regularStrides1(regularStrideVectors1);
             ElemType beta1  = 0;
             ElemType alpha1 = 1;
-            _launchTensorOpWithReduction<ElemType, N, M, K> << <dim3(numBlocksX, numBlocksY, numBlocksZ), numThreadsX, numThreadsX * sizeof(ReduceElemType), t_stream >> >(
+            _launchTensorOpWithReduction<ElemType, N, M, K> << <dim3(numBlocksX, numBlocksY, numBlocksZ), numThreadsX, 0, t_stream >> >(
                 beta1, pointers1, alpha1, op, reductionOp,
                 regularOpStrides, regularStrides1, NN,
                 reducingOpDims, reducingStrides, /*reductionBegin*/0, reductionChunkSize);
@@ -813,7 +1059,7 @@ static void LaunchTensorOpWithReduction(ElemType beta, array<ElemType*, N> point
                 regularOpStrides, regularStrides, grid.m_N,
                 reducingOpDims, reducingStrides);
             //for (size_t z = 0; z < numBlocksZ; z++)
-            //    _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, 1), numThreadsX, numThreadsX * sizeof(ReduceElemType), t_stream>>>(z == 0 ? beta : 1, pointers, alpha, op,
+            //    _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, 1), numThreadsX, 0, t_stream>>>(z == 0 ? beta : 1, pointers, alpha, op,
             //    regularOpStrides, regularStrides, NN,
             //    reducingOpDims, reducingStrides, reductionChunkSize * z, reductionChunkSize);
             vector<ElemType> peekPartial(NN * numBlocksZ, -42);
@@ -832,16 +1078,16 @@ static void LaunchTensorOpWithReduction(ElemType beta, array<ElemType*, N> point
         else if (beta == 1)
         {
             // no need to pre-scale; just add (common for gradients)
-            _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, numBlocksZ), numThreadsX, numThreadsX * sizeof(ReduceElemType), t_stream>>>(beta, pointers, alpha, op, reductionOp, regularOpStrides, regularStrides, NN, reducingOpDims, reducingStrides, 0, reductionChunkSize);
+            _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, numBlocksZ), numThreadsX, 0, t_stream>>>(beta, pointers, alpha, op, reductionOp, regularOpStrides, regularStrides, NN, reducingOpDims, reducingStrides, 0, reductionChunkSize);
             return;
         }
         else
         {
             // We need more than one chunk, we will use atomicAdd().
             // First reset/pre-multiply input; then do the remaining chunks using atomicAdd().
-            _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, 1), numThreadsX, numThreadsX * sizeof(ReduceElemType), t_stream>>>(beta, pointers, alpha, op, reductionOp, regularOpStrides, regularStrides, NN, reducingOpDims, reducingStrides, 0, reductionChunkSize);
+            _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, 1), numThreadsX, 0, t_stream>>>(beta, pointers, alpha, op, reductionOp, regularOpStrides, regularStrides, NN, reducingOpDims, reducingStrides, 0, reductionChunkSize);
             // We will leave it like this for a while, but eventually need to revisit using temporary memory.
-            _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, numBlocksZ - 1), numThreadsX, numThreadsX * sizeof(ReduceElemType), t_stream>>>(/*beta=*/1, pointers, alpha, op, reductionOp, regularOpStrides, regularStrides, NN, reducingOpDims, reducingStrides, reductionChunkSize, reductionChunkSize);
+            _launchTensorOpWithReduction<ElemType, N, M, K><<<dim3(numBlocksX, numBlocksY, numBlocksZ - 1), numThreadsX, 0, t_stream>>>(/*beta=*/1, pointers, alpha, op, reductionOp, regularOpStrides, regularStrides, NN, reducingOpDims, reducingStrides, reductionChunkSize, reductionChunkSize);
         }
 #endif
     }
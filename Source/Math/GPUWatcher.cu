@@ -34,23 +34,35 @@ int GPUWatcher::GetGPUIdWithTheMostFreeMemory()
     return curDev;
 }
 
+// cudaMemGetInfo() for another device than the current one, without changing the current device of the caller
+static bool GetMemoryInfoOnCUDADevice(int devId, size_t& free, size_t& total)
+{
+    int currentDevice = -1;
+    bool restore = cudaGetDevice(&currentDevice) == cudaSuccess && currentDevice != devId;
+    bool ok = cudaSetDevice(devId) == cudaSuccess && cudaMemGetInfo(&free, &total) == cudaSuccess;
+    if (restore)
+        cudaSetDevice(currentDevice);
+    return ok;
+}
+
 size_t GPUWatcher::GetFreeMemoryOnCUDADevice(int devId)
 {
-    cudaError_t result = cudaSetDevice(devId);
-    if (result != cudaSuccess)
-    {
-        return 0;
-    }
     // get the amount of free memory on the graphics card
     size_t free = 0;
     size_t total = 0;
-    result = cudaMemGetInfo(&free, &total);
-    if (result != cudaSuccess)
-    {
+    if (!GetMemoryInfoOnCUDADevice(devId, free, total))
         return 0;
-    }
-    else
-        return free;
+    return free;
+}
+
+// the amount of memory in use on the graphics card, by all processes
+size_t GPUWatcher::GetUsedMemoryOnCUDADevice(int devId)
+{
+    size_t free = 0;
+    size_t total = 0;
+    if (!GetMemoryInfoOnCUDADevice(devId, free, total))
+        return 0;
+    return total - free;
 }
 
 GPUWatcher::GPUWatcher(void)
@@ -61,4 +73,34 @@ GPUWatcher::~GPUWatcher(void)
 {
 }
 
+CudaEventTimeline::~CudaEventTimeline()
+{
+    for (auto event : m_events)
+        cudaEventDestroy(reinterpret_cast<cudaEvent_t>(event));
+}
+
+size_t CudaEventTimeline::Record()
+{
+    if (m_numRecorded == m_events.size())
+    {
+        cudaEvent_t event;
+        CUDA_CALL(cudaEventCreate(&event));
+        m_events.push_back(event);
+    }
+    CUDA_CALL(cudaEventRecord(reinterpret_cast<cudaEvent_t>(m_events[m_numRecorded]), GetStream()));
+    return m_numRecorded++;
+}
+
+void CudaEventTimeline::Resolve(std::vector<float>& milliseconds)
+{
+    milliseconds.assign(m_numRecorded, 0);
+    if (m_numRecorded > 0)
+    {
+        CUDA_CALL(cudaEventSynchronize(reinterpret_cast<cudaEvent_t>(m_events[m_numRecorded - 1])));
+        for (size_t i = 1; i < m_numRecorded; i++)
+            CUDA_CALL(cudaEventElapsedTime(&milliseconds[i], reinterpret_cast<cudaEvent_t>(m_events[0]), reinterpret_cast<cudaEvent_t>(m_events[i])));
+    }
+    m_numRecorded = 0;
+}
+
 #endif // CPUONLY
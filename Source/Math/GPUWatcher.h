@@ -6,12 +6,33 @@
 #pragma once
 
 #include "GPUMatrix.h"
+#include <vector>
 
 class MATH_API GPUWatcher
 {
 public:
     static size_t GetFreeMemoryOnCUDADevice(int devId);
+    static size_t GetUsedMemoryOnCUDADevice(int devId);
     static int GetGPUIdWithTheMostFreeMemory();
     GPUWatcher(void);
     ~GPUWatcher(void);
 };
+
+// Records CUDA events into the compute stream without waiting for them, to time asynchronous work with little overhead
+// (unlike CudaTimer, which synchronizes in Stop()). Resolve() waits for the last event once and returns the times of all.
+class MATH_API CudaEventTimeline
+{
+public:
+    CudaEventTimeline() : m_numRecorded(0) {}
+    ~CudaEventTimeline();
+    // returns the index of the event
+    size_t Record();
+    // [i] is the time of event i after event 0, in milliseconds; the events are then kept for reuse
+    void Resolve(std::vector<float>& milliseconds);
+
+    DISABLE_COPY_AND_MOVE(CudaEventTimeline);
+
+private:
+    std::vector<void*> m_events;
+    size_t m_numRecorded;
+};
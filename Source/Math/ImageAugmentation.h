@@ -0,0 +1,128 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ImageAugmentation.h -- the per-image jittering and normalization that Matrix<ElemType>::AssignAugmentedImages() applies to 8-bit images
+//
+
+#pragma once
+
+#include "PhiloxRNG.h"
+#include <math.h>
+
+#pragma push_macro("TENSOR_OPS_DECL")
+#ifndef TENSOR_OPS_DECL // to make these accessible to CUDA kernels, say '#define TENSOR_OPS_DECL __device__ __host__'
+#define TENSOR_OPS_DECL
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// ImageAugmentationParams -- what AssignAugmentedImages() does to each image
+//
+// The images are 8-bit and interleaved (HWC, BGR for 3 channels), one per column, as the image reader ships them
+// with deviceAugmentation. Each value is converted to floating point and, in the order of the reader's transforms:
+//  - contrast and brightness: x = alpha * x + beta, alpha = 1 + U(-contrastRadius, contrastRadius) and beta the mean
+//    of the image times U(-brightnessRadius, brightnessRadius) (ColorTransformer)
+//  - saturation: the S of HSV times 1 + U(-saturationRadius, saturationRadius), at most 1, for 3 channels (ColorTransformer)
+//  - PCA lighting noise: eigVec * (eigVal .* N(0, intensityStdDev)) added to each pixel (IntensityTransformer)
+// each clipped to [0, 255]. Then the mean image (if any) is subtracted, the result multiplied by 'scale' and
+// written in HWC, or CHW with 'transpose'. The random numbers of an image are the first two Philox blocks of its
+// column in the stream 'key', so that the CPU and the GPU draw the same ones.
+// -----------------------------------------------------------------------
+
+struct ImageAugmentationParams
+{
+    int m_width, m_height, m_channels; // of the images, at most 4 channels
+    bool m_transpose;                  // write CHW instead of HWC
+    float m_brightnessRadius;          // 0 for none, as the two below
+    float m_contrastRadius;
+    float m_saturationRadius;
+    float m_intensityStdDev;           // 0 for no lighting noise
+    float m_eigVal[3];
+    float m_eigVec[9];                 // row major, rows in RGB order
+    float m_scale;                     // 1 for none
+};
+
+// the random draws of one image
+struct ImageAugmentationDraws
+{
+    float m_alpha;      // contrast
+    float m_brightness; // beta as a fraction of the mean of the image
+    float m_saturation;
+    float m_shift[3];   // lighting, in RGB order
+};
+
+static inline TENSOR_OPS_DECL ImageAugmentationDraws DrawImageAugmentation(const ImageAugmentationParams& p, uint64_t key, uint64_t column)
+{
+    PhiloxBlock blocks[2] = { Philox4x32_10(2 * column, key), Philox4x32_10(2 * column + 1, key) };
+    float u[8];
+    for (int i = 0; i < 8; i++)
+        u[i] = PhiloxToUniform(blocks[i / 4].w[i % 4]);
+
+    ImageAugmentationDraws d;
+    d.m_alpha = 1 + p.m_contrastRadius * (2 * u[0] - 1);
+    d.m_brightness = p.m_brightnessRadius * (2 * u[1] - 1);
+    d.m_saturation = 1 + p.m_saturationRadius * (2 * u[2] - 1);
+
+    // Box-Muller, two normals from each pair of u[3..6]
+    float normals[4];
+    for (int i = 0; i < 2; i++)
+    {
+        float radius = sqrtf(-2 * logf(u[3 + 2 * i]));
+        float angle = 6.28318531f * u[4 + 2 * i];
+        normals[2 * i] = radius * cosf(angle);
+        normals[2 * i + 1] = radius * sinf(angle);
+    }
+    for (int row = 0; row < 3; row++)
+    {
+        float shift = 0;
+        for (int k = 0; k < 3; k++)
+            shift += p.m_eigVec[3 * row + k] * p.m_eigVal[k] * normals[k] * p.m_intensityStdDev;
+        d.m_shift[row] = shift;
+    }
+    return d;
+}
+
+static inline TENSOR_OPS_DECL float ClipToByteRange(float x)
+{
+    return fminf(fmaxf(x, 0.0f), 255.0f);
+}
+
+// Jitters the m_channels values of one pixel in place. 'imageMean' is the mean of all values of the image, only
+// needed for brightness.
+static inline TENSOR_OPS_DECL void AugmentImagePixel(const ImageAugmentationParams& p, const ImageAugmentationDraws& d, float imageMean, float* x)
+{
+    const int channels = p.m_channels;
+    if (p.m_brightnessRadius > 0 || p.m_contrastRadius > 0)
+    {
+        float beta = d.m_brightness * imageMean;
+        for (int c = 0; c < channels; c++)
+            x[c] = ClipToByteRange(x[c] * d.m_alpha + beta);
+    }
+
+    if (p.m_saturationRadius > 0 && channels == 3)
+    {
+        // Hue and value stay, so the distances of the channels to the maximum scale with the saturation.
+        float maxValue = fmaxf(x[0], fmaxf(x[1], x[2]));
+        float minValue = fminf(x[0], fminf(x[1], x[2]));
+        if (maxValue > minValue)
+        {
+            float saturation = (maxValue - minValue) / maxValue;
+            float factor = fminf(saturation * d.m_saturation, 1.0f) / saturation;
+            for (int c = 0; c < 3; c++)
+                x[c] = maxValue - (maxValue - x[c]) * factor;
+        }
+    }
+
+    if (p.m_intensityStdDev > 0 && channels <= 3)
+    {
+        // (BGR values, RGB shifts)
+        for (int c = 0; c < channels; c++)
+            x[c] = ClipToByteRange(x[c] + d.m_shift[channels - c - 1]);
+    }
+}
+
+}}}
+
+#pragma pop_macro("TENSOR_OPS_DECL")
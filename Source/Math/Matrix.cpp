@@ -12,6 +12,9 @@
 #include "GPUMatrix.h"
 #include "GPUSparseMatrix.h"
 #include "File.h"
+#include "MultiTensorUpdate.h"
+#include "ImageAugmentation.h"
+#include "ValueCompression.h"
 #include <assert.h>
 #include <math.h>
 #include "GPUWatcher.h" // bring in this class as well so that it gets exported from this DLL
@@ -154,6 +157,13 @@ int GetMathLibTraceLevel()
     return m_mathLibTraceLevel.load();
 }
 
+static std::atomic<size_t> s_numImplicitMatrixTransfers(0);
+
+size_t GetNumImplicitMatrixTransfers()
+{
+    return s_numImplicitMatrixTransfers.load();
+}
+
 MatrixBase::~MatrixBase() { }
 
 #pragma region Constructors, destructors and other static matrix builders
@@ -268,10 +278,11 @@ void Matrix<ElemType>::SetDataLocation(CurrentDataLocation location, MatrixType
 
     // set m_baseMatrix (if location is unchanged, this will not change the pointer)
     // Note: m_currentDataLocation may also be CurrentDataLocation::BOTH, in which case the base matrix will be GPU.
+    // This runs for the output of every operation, so the upcasts are static ones rather than dynamic ones.
     if (m_matrixType == MatrixType::DENSE)
-        m_baseMatrix = ((m_currentDataLocation == CurrentDataLocation::CPU) ? dynamic_cast<BaseMatrix<ElemType>*>(m_CPUMatrix.get()) : dynamic_cast<BaseMatrix<ElemType>*>(m_GPUMatrix.get()));
+        m_baseMatrix = ((m_currentDataLocation == CurrentDataLocation::CPU) ? static_cast<BaseMatrix<ElemType>*>(m_CPUMatrix.get()) : static_cast<BaseMatrix<ElemType>*>(m_GPUMatrix.get()));
     else if (m_matrixType == MatrixType::SPARSE)
-        m_baseMatrix = ((m_currentDataLocation == CurrentDataLocation::CPU) ? dynamic_cast<BaseMatrix<ElemType>*>(m_CPUSparseMatrix.get()) : dynamic_cast<BaseMatrix<ElemType>*>(m_GPUSparseMatrix.get()));
+        m_baseMatrix = ((m_currentDataLocation == CurrentDataLocation::CPU) ? static_cast<BaseMatrix<ElemType>*>(m_CPUSparseMatrix.get()) : static_cast<BaseMatrix<ElemType>*>(m_GPUSparseMatrix.get()));
     // Note: Typecasts are necessary since C++ cannot figure out the common base type (probably due to shared_ptr).
     // sanity check
     if (!m_baseMatrix && m_matrixType != MatrixType::UNDETERMINED)
@@ -1004,7 +1015,7 @@ const ElemType Matrix<ElemType>::operator()(const size_t row, const size_t col)
 {
     DISPATCH_MATRIX_ON_FLAG_USECPU_4BOTH(this, nullptr,
         { return m_CPUMatrix->operator()(row, col); },
-        { _transferFromDeviceToDevice(GetDeviceId(), CPUDEVICE, false); return m_CPUMatrix->operator()(row, col); },
+        { s_numImplicitMatrixTransfers++; _transferFromDeviceToDevice(GetDeviceId(), CPUDEVICE, false); return m_CPUMatrix->operator()(row, col); },
         { NOT_IMPLEMENTED; },
         { NOT_IMPLEMENTED; });
 }
@@ -1021,6 +1032,7 @@ ElemType& Matrix<ElemType>::operator()(const size_t row, const size_t col)
     DISPATCH_MATRIX_ON_FLAG_USECPU_4BOTH(this, nullptr,
         { return m_CPUMatrix->operator()(row, col); },
         {
+            s_numImplicitMatrixTransfers++;
             _transferFromDeviceToDevice(GetDeviceId(), CPUDEVICE, false);
             SetDataLocation(CPU, DENSE);
             return m_CPUMatrix->operator()(row, col);
@@ -1090,6 +1102,47 @@ Matrix<ElemType>& Matrix<ElemType>::DoScatterColumnsOf(ElemType beta, const Matr
     return *this;
 }
 
+// *this[0,j] = ranges[0,j] + idx[0,j] * numParallelSequences if ranges[1,j] <= idx[0,j] < ranges[2,j], else -1 (a gap)
+// Maps time indices within sequences to the columns of another minibatch for DoGatherColumnsOf() and DoScatterColumnsOf()
+// (see PackedIndexNode): for the sequence of column j, ranges[0,j] is the column of its time 0, and ranges[1,j] and ranges[2,j]
+// are the time indices of it that are in the minibatch, so that the mapping works without the MBLayout on the device.
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignPackedIndicesOf(const Matrix<ElemType>& idx, const Matrix<ElemType>& ranges, size_t numParallelSequences)
+{
+    DecideAndMoveToRightDevice(idx, ranges, *this);
+    SwitchToMatrixType(idx.GetMatrixType(), idx.GetFormat(), false);
+
+    DISPATCH_MATRIX_ON_FLAG(&idx, this,
+        { m_CPUMatrix->AssignPackedIndicesOf(*idx.m_CPUMatrix, *ranges.m_CPUMatrix, numParallelSequences); },
+        { m_GPUMatrix->AssignPackedIndicesOf(*idx.m_GPUMatrix, *ranges.m_GPUMatrix, numParallelSequences); },
+        { NOT_IMPLEMENTED; },
+        { NOT_IMPLEMENTED; });
+
+    return *this;
+}
+
+// *this[:,idx[j]] = sum of a[:,j] * alpha, as a block-sparse (SparseBlockCol) matrix: one block for each distinct idx[j],
+// holding the sum of the columns of 'a' that map to it (e.g. the gradient of an embedding w.r.t. the ids of a minibatch,
+// without touching the columns of the other ids). 'a' is dense. Like for scatter, 'this' must have been sized already.
+// Invalid entries (gap columns) are denoted by idx(0,j) == -1.
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignScatteredColumnsOf(const Matrix<ElemType>& idx, const Matrix<ElemType>& a, ElemType alpha)
+{
+    if (a.GetMatrixType() != MatrixType::DENSE)
+        NOT_IMPLEMENTED;
+
+    DecideAndMoveToRightDevice(*this, idx, a);
+    SwitchToMatrixType(MatrixType::SPARSE, matrixFormatSparseBlockCol, false);
+
+    DISPATCH_MATRIX_ON_FLAG(this, this,
+        { NOT_IMPLEMENTED; },
+        { NOT_IMPLEMENTED; },
+        { m_CPUSparseMatrix->AssignScatteredColumnsOf(*idx.m_CPUMatrix, *a.m_CPUMatrix, alpha); },
+        { m_GPUSparseMatrix->AssignScatteredColumnsOf(*idx.m_GPUMatrix, *a.m_GPUMatrix, alpha); });
+
+    return *this;
+}
+
 // set all elements of a matrix to a scalar value
 // For sparse matrices, the only allowed value is 0.
 template <class ElemType>
@@ -1241,7 +1294,12 @@ void Matrix<ElemType>::AssignValuesOf(const Matrix<ElemType>& deepCopyFrom)
             // Set GPUMatrix from:
             DISPATCH_MATRIX_ON_FLAG(&deepCopyFrom, nullptr,
                 { m_GPUMatrix->SetValue(deepCopyFrom.GetNumRows(), deepCopyFrom.GetNumCols(), this->GetDeviceId(), deepCopyFrom.m_CPUMatrix->Data()); },
-                { m_GPUMatrix->SetValue(*deepCopyFrom.m_GPUMatrix); },
+                {
+                    if (deepCopyFrom.GetDeviceId() != GetDeviceId()) // (SetValue() would move us to the other device)
+                        m_GPUMatrix->AssignPeerValuesOf(*deepCopyFrom.m_GPUMatrix);
+                    else
+                        m_GPUMatrix->SetValue(*deepCopyFrom.m_GPUMatrix);
+                },
                 {
                     CPUMatrix<ElemType> tempCPUDenseMatrix(deepCopyFrom.GetNumRows(), deepCopyFrom.GetNumCols());
                     deepCopyFrom.m_CPUSparseMatrix->AssignColumnSliceToDense(tempCPUDenseMatrix, 0, deepCopyFrom.GetNumCols());
@@ -1320,6 +1378,83 @@ void Matrix<ElemType>::SetMatrixFromCSCFormat(const CPUSPARSE_INDEX_TYPE* h_CSCC
         { m_GPUSparseMatrix->SetMatrixFromCSCFormat(h_CSCCol, h_Row, h_Val, nz, numRows, numCols, false, -1, transferer); });
 }
 
+template <class ElemType>
+void Matrix<ElemType>::SetMatrixFromOneHotSequences(const CPUSPARSE_INDEX_TYPE* h_indices, const CPUSPARSE_INDEX_TYPE* h_sequenceOffsets,
+    const size_t numSequences, const size_t maxSequenceLength, const size_t numRows)
+{
+    if (h_sequenceOffsets == nullptr || h_sequenceOffsets[0] != 0)
+        InvalidArgument("SetMatrixFromOneHotSequences: The sequence offsets must start at 0.");
+    for (size_t i = 0; i < numSequences; i++)
+    {
+        if (h_sequenceOffsets[i + 1] < h_sequenceOffsets[i] || (size_t) (h_sequenceOffsets[i + 1] - h_sequenceOffsets[i]) > maxSequenceLength)
+            InvalidArgument("SetMatrixFromOneHotSequences: Sequence %d has a negative length or is longer than %d.", (int) i, (int) maxSequenceLength);
+    }
+    if (h_indices == nullptr && h_sequenceOffsets[numSequences] > 0)
+        InvalidArgument("SetMatrixFromOneHotSequences: nullptr passed in.");
+
+    DISPATCH_MATRIX_ON_FLAG(this, this,
+        { NOT_IMPLEMENTED; },
+        { NOT_IMPLEMENTED; },
+        { m_CPUSparseMatrix->SetMatrixFromOneHotSequences(h_indices, h_sequenceOffsets, numSequences, maxSequenceLength, numRows); },
+        { m_GPUSparseMatrix->SetMatrixFromOneHotSequences(h_indices, h_sequenceOffsets, numSequences, maxSequenceLength, numRows); });
+}
+
+template <class ElemType>
+void Matrix<ElemType>::GetBlockColumns(std::vector<size_t>& columnIds, std::vector<ElemType>& values) const
+{
+    DISPATCH_MATRIX_ON_FLAG(this, nullptr,
+        { NOT_IMPLEMENTED; },
+        { NOT_IMPLEMENTED; },
+        { m_CPUSparseMatrix->GetBlockColumns(columnIds, values); },
+        { NOT_IMPLEMENTED; });
+}
+
+template <class ElemType>
+void Matrix<ElemType>::AssignSumOfBlockColumns(const size_t numRows, const size_t numCols, const std::vector<size_t>& columnIds, const std::vector<ElemType>& values)
+{
+    DISPATCH_MATRIX_ON_FLAG(this, this,
+        { NOT_IMPLEMENTED; },
+        { NOT_IMPLEMENTED; },
+        { m_CPUSparseMatrix->AssignSumOfBlockColumns(numRows, numCols, columnIds, values); },
+        { NOT_IMPLEMENTED; });
+}
+
+template <class ElemType>
+void Matrix<ElemType>::ExtractLargestMagnitudes(size_t k, ElemType threshold, std::vector<int>& indices, std::vector<ElemType>& values)
+{
+    if (GetNumElements() > (size_t) std::numeric_limits<int>::max())
+        InvalidArgument("ExtractLargestMagnitudes: The matrix has too many elements for int indices.");
+    k = std::min(k, GetNumElements());
+    indices.resize(k);
+    values.resize(k);
+    size_t count = 0;
+    if (k > 0)
+    {
+        DISPATCH_MATRIX_ON_FLAG(this, this,
+            { count = m_CPUMatrix->ExtractLargestMagnitudes(k, threshold, indices.data(), values.data()); },
+            { count = m_GPUMatrix->ExtractLargestMagnitudes(k, threshold, indices.data(), values.data()); },
+            { NOT_IMPLEMENTED; },
+            { NOT_IMPLEMENTED; });
+    }
+    indices.resize(count);
+    values.resize(count);
+}
+
+template <class ElemType>
+void Matrix<ElemType>::AddValuesAtIndices(const std::vector<int>& indices, const std::vector<ElemType>& values)
+{
+    if (indices.size() != values.size())
+        InvalidArgument("AddValuesAtIndices: There must be as many values as indices.");
+    if (indices.empty())
+        return;
+
+    DISPATCH_MATRIX_ON_FLAG(this, this,
+        { m_CPUMatrix->AddValuesAtIndices(indices.data(), values.data(), indices.size()); },
+        { m_GPUMatrix->AddValuesAtIndices(indices.data(), values.data(), indices.size()); },
+        { NOT_IMPLEMENTED; },
+        { NOT_IMPLEMENTED; });
+}
+
 template <class ElemType>
 void Matrix<ElemType>::SetDiagonalValue(const ElemType v)
 {
@@ -1444,6 +1579,32 @@ void Matrix<ElemType>::SetUniformRandomMask(const ElemType maskRate, const ElemT
                             NOT_IMPLEMENTED);
 }
 
+// this = beta * this + a .* mask, with a dropout mask that is a function of (key, offset + element index) only
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AddDropoutOf(const Matrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue, uint64_t key, size_t offset, const ElemType beta)
+{
+    if (a.IsEmpty())
+        LogicError("AddDropoutOf: Matrix is empty.");
+
+    if (beta != 0 && !(a.GetNumRows() == GetNumRows() && a.GetNumCols() == GetNumCols()))
+        InvalidArgument("AddDropoutOf: The input matrix dimensions do not match [this].");
+
+    DecideAndMoveToRightDevice(a, *this);
+    if (beta == 0)
+        SwitchToMatrixType(a.GetMatrixType(), a.GetFormat(), false);
+    else if (a.GetMatrixType() != GetMatrixType())
+        NOT_IMPLEMENTED;
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->AddDropoutOf(*a.m_CPUMatrix, maskRate, scaleValue, key, offset, beta),
+                            m_GPUMatrix->AddDropoutOf(*a.m_GPUMatrix, maskRate, scaleValue, key, offset, beta),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+
+    return *this;
+}
+
 template <class ElemType>
 void Matrix<ElemType>::NormalGrad(Matrix<ElemType>& gradients,
                                   Matrix<ElemType>& functionValues,
@@ -1572,6 +1733,153 @@ ElemType Matrix<ElemType>::RmsProp(Matrix<ElemType>& gradients,
     // Note: Since both 'this' and gradients are changed, we must call SetDataLocation() on 'this' as well.
 }
 
+template <class ElemType>
+/*static*/ bool Matrix<ElemType>::MultiTensorUpdate(const MultiTensorUpdateParams<ElemType>& params,
+                                                    const std::vector<Matrix<ElemType>*>& smoothedGradients, const std::vector<Matrix<ElemType>*>& gradients,
+                                                    const std::vector<Matrix<ElemType>*>& values, const std::vector<ElemType>& adaMuls, bool checkForNan)
+{
+    if (values.empty())
+        return false;
+    if (smoothedGradients.size() != values.size() || gradients.size() != values.size() || (!adaMuls.empty() && adaMuls.size() != values.size()))
+        InvalidArgument("MultiTensorUpdate: The numbers of tensors do not match.");
+
+    size_t smoothedFactor = params.m_kind == MultiTensorUpdateKind::FSAdaGrad ? 2 : params.m_kind == MultiTensorUpdateKind::RmsProp ? 3 : 1;
+    DEVICEID_TYPE deviceId = values[0]->GetDeviceId();
+    for (size_t k = 0; k < values.size(); k++)
+    {
+        for (auto matrix : { smoothedGradients[k], gradients[k], values[k] })
+        {
+            if (matrix->GetMatrixType() != DENSE || matrix->GetDeviceId() != deviceId)
+                LogicError("MultiTensorUpdate: All tensors must be dense and on the same device.");
+        }
+        if (gradients[k]->GetNumElements() != values[k]->GetNumElements() || smoothedGradients[k]->GetNumElements() < smoothedFactor * values[k]->GetNumElements())
+            LogicError("MultiTensorUpdate: The dimensions of tensor %d do not match.", (int) k);
+    }
+
+    bool hasNan;
+    if (deviceId == CPUDEVICE)
+    {
+        std::vector<CPUMatrix<ElemType>*> cpuSmoothedGradients, cpuGradients, cpuValues;
+        for (size_t k = 0; k < values.size(); k++)
+        {
+            cpuSmoothedGradients.push_back(smoothedGradients[k]->m_CPUMatrix.get());
+            cpuGradients.push_back(gradients[k]->m_CPUMatrix.get());
+            cpuValues.push_back(values[k]->m_CPUMatrix.get());
+        }
+        hasNan = CPUMatrix<ElemType>::MultiTensorUpdate(params, cpuSmoothedGradients, cpuGradients, cpuValues, adaMuls, checkForNan);
+    }
+    else
+    {
+        std::vector<GPUMatrix<ElemType>*> gpuSmoothedGradients, gpuGradients, gpuValues;
+        for (size_t k = 0; k < values.size(); k++)
+        {
+            gpuSmoothedGradients.push_back(smoothedGradients[k]->m_GPUMatrix.get());
+            gpuGradients.push_back(gradients[k]->m_GPUMatrix.get());
+            gpuValues.push_back(values[k]->m_GPUMatrix.get());
+        }
+        hasNan = GPUMatrix<ElemType>::MultiTensorUpdate(params, gpuSmoothedGradients, gpuGradients, gpuValues, adaMuls, checkForNan);
+    }
+
+    // all three tensors were changed
+    for (size_t k = 0; k < values.size(); k++)
+    {
+        for (auto matrix : { smoothedGradients[k], gradients[k], values[k] })
+            matrix->SetDataLocation(deviceId == CPUDEVICE ? CPU : GPU);
+    }
+    return hasNan;
+}
+
+template <class ElemType>
+/*static*/ double Matrix<ElemType>::MultiTensorSumOfSquares(const std::vector<const Matrix<ElemType>*>& tensors)
+{
+    if (tensors.empty())
+        return 0;
+
+    DEVICEID_TYPE deviceId = tensors[0]->GetDeviceId();
+    for (auto tensor : tensors)
+    {
+        if (tensor->GetMatrixType() != DENSE || tensor->GetDeviceId() != deviceId)
+            LogicError("MultiTensorSumOfSquares: All tensors must be dense and on the same device.");
+    }
+
+    if (deviceId == CPUDEVICE)
+    {
+        std::vector<const CPUMatrix<ElemType>*> cpuTensors;
+        for (auto tensor : tensors)
+            cpuTensors.push_back(tensor->m_CPUMatrix.get());
+        return CPUMatrix<ElemType>::MultiTensorSumOfSquares(cpuTensors);
+    }
+    else
+    {
+        std::vector<const GPUMatrix<ElemType>*> gpuTensors;
+        for (auto tensor : tensors)
+            gpuTensors.push_back(tensor->m_GPUMatrix.get());
+        return GPUMatrix<ElemType>::MultiTensorSumOfSquares(gpuTensors);
+    }
+}
+
+template <class ElemType>
+void Matrix<ElemType>::AssignAugmentedImages(const Matrix<char>& images, const ImageAugmentationParams& params, const Matrix<ElemType>& mean, uint64_t key)
+{
+    size_t numRows = (size_t) params.m_width * params.m_height * params.m_channels;
+    if (params.m_channels < 1 || params.m_channels > 4)
+        InvalidArgument("AssignAugmentedImages: Images have 1 to 4 channels, not %d.", params.m_channels);
+    if (images.GetNumRows() != numRows)
+        LogicError("AssignAugmentedImages: The images have %d values each, %d expected.", (int) images.GetNumRows(), (int) numRows);
+    if (!mean.IsEmpty() && mean.GetNumElements() != numRows)
+        LogicError("AssignAugmentedImages: The mean image has %d values, %d expected.", (int) mean.GetNumElements(), (int) numRows);
+    if (GetMatrixType() != DENSE || images.GetDeviceId() != GetDeviceId() || (!mean.IsEmpty() && mean.GetDeviceId() != GetDeviceId()))
+        LogicError("AssignAugmentedImages: The matrices must be dense and on the same device.");
+
+    auto bytes = reinterpret_cast<const unsigned char*>(images.Data());
+    const ElemType* meanData = mean.IsEmpty() ? nullptr : mean.Data();
+    if (GetDeviceId() == CPUDEVICE)
+    {
+        m_CPUMatrix->AssignAugmentedImages(bytes, images.GetNumCols(), params, meanData, key);
+        SetDataLocation(CPU, DENSE);
+    }
+    else
+    {
+        m_GPUMatrix->AssignAugmentedImages(bytes, images.GetNumCols(), params, meanData, key);
+        SetDataLocation(GPU, DENSE);
+    }
+}
+
+template <class ElemType>
+void Matrix<ElemType>::CompressValuesInto(Matrix<char>& codes, ValueCompression compression) const
+{
+    if (GetMatrixType() != DENSE || codes.GetDeviceId() != GetDeviceId())
+        LogicError("CompressValuesInto: The matrices must be dense and on the same device.");
+
+    const size_t columnBytes = CompressedColumnBytes(compression, GetNumRows());
+    codes.Resize(columnBytes, GetNumCols());
+    if (GetDeviceId() == CPUDEVICE)
+        m_CPUMatrix->CompressValuesInto(codes.Data(), columnBytes, compression);
+    else
+        m_GPUMatrix->CompressValuesInto(codes.Data(), columnBytes, compression);
+}
+
+template <class ElemType>
+void Matrix<ElemType>::AssignDecompressedValuesOf(const Matrix<char>& codes, ValueCompression compression, size_t numRows)
+{
+    const size_t columnBytes = CompressedColumnBytes(compression, numRows);
+    if (codes.GetNumRows() != columnBytes)
+        LogicError("AssignDecompressedValuesOf: The codes have %d bytes per column, %d expected for %d rows.", (int) codes.GetNumRows(), (int) columnBytes, (int) numRows);
+    if (GetMatrixType() != DENSE || codes.GetDeviceId() != GetDeviceId())
+        LogicError("AssignDecompressedValuesOf: The matrices must be dense and on the same device.");
+
+    if (GetDeviceId() == CPUDEVICE)
+    {
+        m_CPUMatrix->AssignDecompressedValuesOf(codes.Data(), columnBytes, compression, numRows, codes.GetNumCols());
+        SetDataLocation(CPU, DENSE);
+    }
+    else
+    {
+        m_GPUMatrix->AssignDecompressedValuesOf(codes.Data(), columnBytes, compression, numRows, codes.GetNumCols());
+        SetDataLocation(GPU, DENSE);
+    }
+}
+
 template <class ElemType>
 void Matrix<ElemType>::Reshape(const size_t numRows, const size_t numCols)
 {
@@ -1602,6 +1910,16 @@ void Matrix<ElemType>::Resize(const size_t numRows, const size_t numCols, const
 #endif
 }
 
+template <class ElemType>
+void Matrix<ElemType>::ShrinkToFit()
+{
+    DISPATCH_MATRIX_ON_FLAG_USEBOTH_4BOTH(this,
+        { m_CPUMatrix->ShrinkToFit(); },
+        { m_GPUMatrix->ShrinkToFit(); },
+        { },
+        { });
+}
+
 template <class ElemType>
 Matrix<ElemType> Matrix<ElemType>::RepMat(const Matrix<ElemType>& frmMat, const size_t rowRatio, const size_t colRatio)
 {
@@ -2439,6 +2757,23 @@ Matrix<ElemType>& Matrix<ElemType>::AssignSigmoidOf(const Matrix<ElemType>& a)
     return *this;
 }
 
+// [this] = f([this] + bias), with the column vector bias added to every column
+// f is opCopy (no activation), opSigmoid, opTanh or opLinearRectifier.
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AddBiasAndActivation(const Matrix<ElemType>& bias, ElementWiseOperator activation)
+{
+    DecideAndMoveToRightDevice(*this, bias);
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->AddBiasAndActivation(*bias.m_CPUMatrix, activation),
+                            m_GPUMatrix->AddBiasAndActivation(*bias.m_GPUMatrix, activation),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+
+    return *this;
+}
+
 //[this]=sigmoid([this]) element wise
 template <class ElemType>
 Matrix<ElemType>& Matrix<ElemType>::InplaceLinearRectifierDerivative()
@@ -3609,6 +3944,8 @@ void Matrix<ElemType>::_transferToDevice(int to_id, bool isBeingMoved /*= true*/
     if (to_id == from_id) // nothing to do
         return;
 
+    if (!emptyTransfer)
+        s_numImplicitMatrixTransfers++;
     if (OwnBuffer())
         _transferFromDeviceToDevice(from_id, to_id, isBeingMoved, emptyTransfer);
     else
@@ -4123,6 +4460,45 @@ void Matrix<ElemType>::ConvolutionBackwardData(const Matrix<ElemType>& kernel, c
                             NOT_IMPLEMENTED);
 }
 
+template <class ElemType>
+void Matrix<ElemType>::DepthwiseConvolutionForward(const Matrix<ElemType>& kernel, const DepthwiseConvolutionShape& shape, Matrix<ElemType>& output) const
+{
+    DecideAndMoveToRightDevice(*this, output);
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->DepthwiseConvolutionForward(*(kernel.m_CPUMatrix), shape, *(output.m_CPUMatrix)),
+                            m_GPUMatrix->DepthwiseConvolutionForward(*(kernel.m_GPUMatrix), shape, *(output.m_GPUMatrix)),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+template <class ElemType>
+void Matrix<ElemType>::DepthwiseConvolutionBackwardData(const Matrix<ElemType>& kernel, const DepthwiseConvolutionShape& shape, Matrix<ElemType>& grad) const
+{
+    DecideAndMoveToRightDevice(*this, grad);
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->DepthwiseConvolutionBackwardData(*(kernel.m_CPUMatrix), shape, *(grad.m_CPUMatrix)),
+                            m_GPUMatrix->DepthwiseConvolutionBackwardData(*(kernel.m_GPUMatrix), shape, *(grad.m_GPUMatrix)),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
+template <class ElemType>
+void Matrix<ElemType>::DepthwiseConvolutionBackwardKernel(const Matrix<ElemType>& in, const DepthwiseConvolutionShape& shape, Matrix<ElemType>& kernelGrad) const
+{
+    DecideAndMoveToRightDevice(*this, kernelGrad);
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->DepthwiseConvolutionBackwardKernel(*(in.m_CPUMatrix), shape, *(kernelGrad.m_CPUMatrix)),
+                            m_GPUMatrix->DepthwiseConvolutionBackwardKernel(*(in.m_GPUMatrix), shape, *(kernelGrad.m_GPUMatrix)),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
 template <class ElemType>
 void Matrix<ElemType>::ConvolutionBackwardKernel(const Matrix<ElemType>& in, const Matrix<int>& mpRowCol, const Matrix<int>& mpRowIwht,
                                                  const Matrix<int>& mpRowRun, const Matrix<int>& runs, Matrix<ElemType>& kernelGrad) const
@@ -4355,7 +4731,7 @@ void Matrix<ElemType>::RNNForward(const Matrix<ElemType> &inputX, const Matrix<E
 
     DISPATCH_MATRIX_ON_FLAG(this,
                             this,
-                            NOT_IMPLEMENTED,
+                            m_CPUMatrix->RNNForward(*(inputX.m_CPUMatrix), *(paramW.m_CPUMatrix), xDim, yDim, numSequencesForFrame, rnnAttributes, *(reserve.m_CPUMatrix), *(workspace.m_CPUMatrix)),
                             m_GPUMatrix->RNNForward(*(inputX.m_GPUMatrix), *(paramW.m_GPUMatrix), xDim, yDim, numSequencesForFrame, rnnAttributes, *(reserve.m_GPUMatrix), *(workspace.m_GPUMatrix)),
                             NOT_IMPLEMENTED,
                             NOT_IMPLEMENTED);
@@ -4370,7 +4746,7 @@ void Matrix<ElemType>::RNNBackwardData(const Matrix<ElemType>& outputDY, const M
     workspace._transferToDevice(GetDeviceId());
     DISPATCH_MATRIX_ON_FLAG(this,
                             this,
-                            NOT_IMPLEMENTED,
+                            m_CPUMatrix->RNNBackwardData(*(outputDY.m_CPUMatrix), *(paramW.m_CPUMatrix), *(outputDX.m_CPUMatrix), rnnAttributes, *(reserve.m_CPUMatrix), *(workspace.m_CPUMatrix)),
                             m_GPUMatrix->RNNBackwardData(*(outputDY.m_GPUMatrix), *(paramW.m_GPUMatrix), *(outputDX.m_GPUMatrix), rnnAttributes, *(reserve.m_GPUMatrix), *(workspace.m_GPUMatrix)),
                             NOT_IMPLEMENTED,
                             NOT_IMPLEMENTED);
@@ -4385,7 +4761,7 @@ void Matrix<ElemType>::RNNBackwardWeights(const Matrix<ElemType>& inputX, const
     workspace._transferToDevice(GetDeviceId());
     DISPATCH_MATRIX_ON_FLAG(this,
                             this,
-                            NOT_IMPLEMENTED,
+                            m_CPUMatrix->RNNBackwardWeights(*(inputX.m_CPUMatrix), *(outputY.m_CPUMatrix), *(dw.m_CPUMatrix), rnnAttributes, *(reserve.m_CPUMatrix), *(workspace.m_CPUMatrix)),
                             m_GPUMatrix->RNNBackwardWeights(*(inputX.m_GPUMatrix), *(outputY.m_GPUMatrix), *(dw.m_GPUMatrix), rnnAttributes, *(reserve.m_GPUMatrix), *(workspace.m_GPUMatrix)),
                             NOT_IMPLEMENTED,
                             NOT_IMPLEMENTED);
@@ -4555,6 +4931,59 @@ template <class ElemType>
                             NOT_IMPLEMENTED);
 }
 
+/// <summary>The fully connected layer c = f(a * b + bias), with the column vector bias added to every column of the product</summary>
+/// <param name="a">Input matrix, the weights</param>
+/// <param name="b">Input matrix</param>
+/// <param name="bias">Column vector with one element per row of a</param>
+/// <param name="activation">opCopy (none), opSigmoid, opTanh or opLinearRectifier</param>
+/// <param name="c">Resulting dense matrix</param>
+/// On the CPU the bias and the activation are applied to each tile of the GEMM's output while it is in the cache.
+/// Elsewhere (GPU, sparse inputs) the GEMM is followed by one fused pass for both.
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::MultiplyAndAddBias(const Matrix<ElemType>& a, const Matrix<ElemType>& b, const Matrix<ElemType>& bias, ElementWiseOperator activation, Matrix<ElemType>& c)
+{
+    DecideAndMoveToRightDevice(a, b, bias, c);
+
+    if (c.GetDeviceId() < 0 && a.GetMatrixType() == MatrixType::DENSE && b.GetMatrixType() == MatrixType::DENSE) // CPU, DENSE * DENSE -> DENSE
+    {
+        c.SwitchToMatrixType(MatrixType::DENSE, matrixFormatDense, false);
+        CPUMatrix<ElemType>::MultiplyAndAddBias(*a.m_CPUMatrix, *b.m_CPUMatrix, *bias.m_CPUMatrix, activation, *c.m_CPUMatrix);
+        c.SetDataLocation(CPU, DENSE);
+    }
+    else
+    {
+        Multiply(a, b, c);
+        c.AddBiasAndActivation(bias, activation);
+    }
+}
+
+/// <summary>Batched matrix-matrix multiply: c[:, j] = alpha * op(a_j) * op(b_j) + beta * c[:, j] for every column j</summary>
+/// <param name="a">Input matrix, whose column j holds the matrix a_j of aRows rows in column-major order</param>
+/// <param name="transposeA">Whether the matrices a_j are transposed</param>
+/// <param name="aRows">The number of rows of each a_j (before the transposition)</param>
+/// <param name="b">Input matrix with the same number of columns as a, whose columns hold the matrices b_j of bRows rows</param>
+/// <param name="transposeB">Whether the matrices b_j are transposed</param>
+/// <param name="bRows">The number of rows of each b_j (before the transposition)</param>
+/// <param name="c">Resulting dense matrix, one column per product, which is resized if beta is 0</param>
+/// All products are computed in one call of the batched GEMM of the BLAS library (cublasGemmStridedBatched on the GPU,
+/// cblas_?gemm_batch with MKL), e.g. the attention scores of all samples of a minibatch.
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::BatchMultiplyAndWeightedAdd(ElemType alpha, const Matrix<ElemType>& a, const bool transposeA, size_t aRows, const Matrix<ElemType>& b, const bool transposeB, size_t bRows,
+                                                             ElemType beta, Matrix<ElemType>& c)
+{
+    DecideAndMoveToRightDevice(a, b, c);
+    if (a.GetMatrixType() != MatrixType::DENSE || b.GetMatrixType() != MatrixType::DENSE)
+        NOT_IMPLEMENTED;
+    c.SwitchToMatrixType(MatrixType::DENSE, matrixFormatDense, false);
+
+    DISPATCH_MATRIX_ON_FLAG(&c,
+                            &c,
+                            CPUMatrix<ElemType>::BatchMultiplyAndWeightedAdd(alpha, *a.m_CPUMatrix, transposeA, aRows, *b.m_CPUMatrix, transposeB, bRows, beta, *c.m_CPUMatrix),
+                            GPUMatrix<ElemType>::BatchMultiplyAndWeightedAdd(alpha, *a.m_GPUMatrix, transposeA, aRows, *b.m_GPUMatrix, transposeB, bRows, beta, *c.m_GPUMatrix),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+}
+
 /// <summary>Matrix-matrix multiply with col-major matrices (a and b may be transposed): c =  op(a) * op(b) + c</summary>
 /// <param name="a">Input matrix</param>
 /// <param name="transposeA">Whether matrix a is transposed</param>
@@ -4661,6 +5090,38 @@ template <class ElemType>
     }
 }
 
+/// <summary>Softmax and cross entropy of the columns of a dense prediction against sparse (CSC) labels</summary>
+/// <param name="labels">Sparse labels, typically one-hot</param>
+/// <param name="prediction">Unnormalized log probabilities</param>
+/// <param name="criterion">Resulting [1 x #cols] cross entropy of each column</param>
+/// <param name="softmaxMinusLabels">Resulting softmax(prediction) - labels, the gradient of the criterion w.r.t. the prediction</param>
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::CrossEntropyWithSoftmax(const Matrix<ElemType>& labels, const Matrix<ElemType>& prediction, Matrix<ElemType>& criterion, Matrix<ElemType>& softmaxMinusLabels)
+{
+    if (labels.GetMatrixType() != SPARSE || labels.GetFormat() != matrixFormatSparseCSC || prediction.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+
+    DecideAndMoveToRightDevice(prediction, labels);
+    criterion._transferToDevice(prediction.GetDeviceId());
+    softmaxMinusLabels._transferToDevice(prediction.GetDeviceId());
+    criterion.SwitchToMatrixType(DENSE, matrixFormatDense, false);
+    softmaxMinusLabels.SwitchToMatrixType(DENSE, matrixFormatDense, false);
+
+    DISPATCH_MATRIX_ON_FLAG(&labels, nullptr,
+        { NOT_IMPLEMENTED; },
+        { NOT_IMPLEMENTED; },
+        {
+            CPUSparseMatrix<ElemType>::CrossEntropyWithSoftmax(*labels.m_CPUSparseMatrix, *prediction.m_CPUMatrix, *criterion.m_CPUMatrix, *softmaxMinusLabels.m_CPUMatrix);
+            criterion.SetDataLocation(CPU, DENSE);
+            softmaxMinusLabels.SetDataLocation(CPU, DENSE);
+        },
+        {
+            GPUSparseMatrix<ElemType>::CrossEntropyWithSoftmax(*labels.m_GPUSparseMatrix, *prediction.m_GPUMatrix, *criterion.m_GPUMatrix, *softmaxMinusLabels.m_GPUMatrix);
+            criterion.SetDataLocation(GPU, DENSE);
+            softmaxMinusLabels.SetDataLocation(GPU, DENSE);
+        });
+}
+
 /// <summary>Matrix-scalar multiply with col-major matrices: c = alpha * a + beta * c</summary>
 /// if a is a column vector, add to all columns of c
 /// if a is a row vector, add to all rows of c
@@ -4682,6 +5143,19 @@ template <class ElemType>
     }
 }
 
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::ScaleAndAddToStoredColumns(ElemType alpha, const Matrix<ElemType>& a, Matrix<ElemType>& c)
+{
+    if (a.GetMatrixType() == DENSE && c.GetMatrixType() == SPARSE && c.GetFormat() == matrixFormatSparseBlockCol && c.GetDeviceId() == CPUDEVICE)
+    {
+        if (a.GetDeviceId() != CPUDEVICE)
+            LogicError("ScaleAndAddToStoredColumns: The matrices must be on the same device.");
+        CPUSparseMatrix<ElemType>::ScaleAndAddToBlockColumns(alpha, *a.m_CPUMatrix, *c.m_CPUSparseMatrix);
+    }
+    else // dense, or no block-column kernel for this device yet
+        ScaleAndAdd(alpha, a, c);
+}
+
 // tensor swapping and addition: c <- keepWeight * b + scaleFactor * swap_dimensions(a, S, K)
 // where
 //  - a is interpreted as a tensor of dimension (D x S x M x K x T)         // column-major, as usual
@@ -5122,6 +5596,24 @@ size_t Matrix<ElemType>::CountNanInf() const
     return n;
 }
 
+template <class ElemType>
+void Matrix<ElemType>::UpdateNonFiniteFlag(Matrix<ElemType>& flag) const
+{
+    if (flag.GetNumElements() != 1 || flag.GetMatrixType() != DENSE)
+        LogicError("UpdateNonFiniteFlag: The flag must be a dense 1x1 matrix.");
+    if (IsEmpty())
+        return;
+
+    DecideAndMoveToRightDevice(*this, flag);
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            &flag,
+                            CPUMatrix<ElemType>::UpdateNonFiniteFlag(m_CPUMatrix->Data(), GetNumElements(), *flag.m_CPUMatrix),
+                            GPUMatrix<ElemType>::UpdateNonFiniteFlag(m_GPUMatrix->Data(), GetNumElements(), *flag.m_GPUMatrix),
+                            CPUMatrix<ElemType>::UpdateNonFiniteFlag(m_CPUSparseMatrix->NzValues(), m_CPUSparseMatrix->NzCount(), *flag.m_CPUMatrix),
+                            GPUMatrix<ElemType>::UpdateNonFiniteFlag(m_GPUSparseMatrix->NzValues(), m_GPUSparseMatrix->NzCount(), *flag.m_GPUMatrix));
+}
+
 // TODO: these are scalar operations--why are they in Matrix?
 template <class ElemType>
 ElemType Matrix<ElemType>::Exp10(ElemType num)
@@ -5421,6 +5913,41 @@ Matrix<ElemType>& Matrix<ElemType>::AssignSequenceError(const ElemType hsmoothin
                             NOT_IMPLEMENTED);
     return *this;
 }
+
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignCTCScore(const Matrix<ElemType>& logProbs, Matrix<ElemType>& alpha, Matrix<ElemType>& beta,
+                                                   const Matrix<ElemType>& labelSequences, Matrix<ElemType>& totalScore,
+                                                   const std::vector<size_t>& uttToChanInd, const std::vector<size_t>& uttBeginFrame, const std::vector<size_t>& uttFrameNum,
+                                                   const std::vector<size_t>& uttLabelNum, const size_t numParallelSequences, const size_t maxFrameNum, const size_t blankTokenId)
+{
+    DecideAndMoveToRightDevice(logProbs, *this, labelSequences);
+    alpha._transferToDevice(logProbs.GetDeviceId());
+    beta._transferToDevice(logProbs.GetDeviceId());
+    totalScore._transferToDevice(logProbs.GetDeviceId());
+
+    if (logProbs.GetMatrixType() != DENSE || labelSequences.GetMatrixType() != DENSE)
+        NOT_IMPLEMENTED;
+    SwitchToMatrixType(DENSE, matrixFormatDense, false);
+    alpha.SwitchToMatrixType(DENSE, matrixFormatDense, false);
+    beta.SwitchToMatrixType(DENSE, matrixFormatDense, false);
+    totalScore.SwitchToMatrixType(DENSE, matrixFormatDense, false);
+
+    DISPATCH_MATRIX_ON_FLAG(&logProbs,
+                            this,
+                            {
+                                m_CPUMatrix->AssignCTCScore(*logProbs.m_CPUMatrix, *alpha.m_CPUMatrix, *beta.m_CPUMatrix, *labelSequences.m_CPUMatrix, *totalScore.m_CPUMatrix,
+                                                            uttToChanInd, uttBeginFrame, uttFrameNum, uttLabelNum, numParallelSequences, maxFrameNum, blankTokenId);
+                                alpha.SetDataLocation(CPU, DENSE); beta.SetDataLocation(CPU, DENSE); totalScore.SetDataLocation(CPU, DENSE);
+                            },
+                            {
+                                m_GPUMatrix->AssignCTCScore(*logProbs.m_GPUMatrix, *alpha.m_GPUMatrix, *beta.m_GPUMatrix, *labelSequences.m_GPUMatrix, *totalScore.m_GPUMatrix,
+                                                            uttToChanInd, uttBeginFrame, uttFrameNum, uttLabelNum, numParallelSequences, maxFrameNum, blankTokenId);
+                                alpha.SetDataLocation(GPU, DENSE); beta.SetDataLocation(GPU, DENSE); totalScore.SetDataLocation(GPU, DENSE);
+                            },
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+    return *this;
+}
 #pragma endregion Static BLAS Functions
 
 // TensorView currently does not interface with sparse matrices. For now, we just catch this and throw.
@@ -201,11 +201,32 @@ public:
                          const double meanMomentum, const double varMomentum);
     ElemType RmsProp(Matrix<ElemType>& gradients, ElemType RMS_GAMMA, ElemType RMS_WGT_INC, ElemType RMS_WGT_MAX, ElemType RMS_WGT_DEC, ElemType RMS_WGT_MIN, const bool needAveMultiplier);
 
+    // Applies one of the above updates (see MultiTensorUpdate.h) to the dense tensors k = (smoothedGradients[k], gradients[k], values[k])
+    // of one device in a single pass, instead of a few kernel launches per tensor. adaMuls[k] is the FSAdaGrad multiplier of tensor k
+    // (empty for the other kinds). With 'checkForNan', returns whether any updated value is NaN, from a single flag set on the device.
+    static bool MultiTensorUpdate(const MultiTensorUpdateParams<ElemType>& params,
+                                  const std::vector<Matrix<ElemType>*>& smoothedGradients, const std::vector<Matrix<ElemType>*>& gradients,
+                                  const std::vector<Matrix<ElemType>*>& values, const std::vector<ElemType>& adaMuls, bool checkForNan);
+    // sum of the squares of all elements of the dense tensors of one device (the square of their joint Frobenius norm), with a single reduction
+    static double MultiTensorSumOfSquares(const std::vector<const Matrix<ElemType>*>& tensors);
+
+    // Converts the 8-bit images in the columns of 'images' into this matrix, jittering and normalizing them on the way
+    // (see ImageAugmentation.h), in a single pass. 'mean' is the mean image in the layout of the images (HWC), or empty.
+    void AssignAugmentedImages(const Matrix<char>& images, const ImageAugmentationParams& params, const Matrix<ElemType>& mean, uint64_t key);
+
+    // Encodes the values into the columns of 'codes' in fewer bits (see ValueCompression.h), column by column; the dense
+    // counterpart of AssignDecompressedValuesOf(), which restores a matrix of 'numRows' rows from them.
+    void CompressValuesInto(Matrix<char>& codes, ValueCompression compression) const;
+    void AssignDecompressedValuesOf(const Matrix<char>& codes, ValueCompression compression, size_t numRows);
+
     void Resize(const size_t numRows, const size_t numCols, const size_t numNZElemToReserve = 10000, bool growOnly = true); // by default we only reallocate if need to grow
     void Resize(const Matrix<ElemType>& other) // TODO: Should this carry over numNZElemToReserve for sparse matrices?
     {
         Resize(other.GetNumRows(), other.GetNumCols());
     }
+    // releases the spare capacity that Resize() leaves for later growth (see MatrixResizePolicy), keeping the content;
+    // no-op for sparse matrices
+    void ShrinkToFit();
     void VerifySize(size_t rows, size_t cols)
     {
         m_baseMatrix->VerifySize(rows, cols);
@@ -263,6 +284,20 @@ public:
     }
     void SetMatrixFromCSCFormat(const CPUSPARSE_INDEX_TYPE* h_CSCCol, const CPUSPARSE_INDEX_TYPE* h_Row, const ElemType* h_Val,
         const size_t nz, const size_t numRows, const size_t numCols, DataTransferer* transferer = nullptr);
+    // a sparse one-hot matrix [numRows x numSequences * maxSequenceLength] from the host: column i * maxSequenceLength + j has a 1 in row
+    // h_indices[h_sequenceOffsets[i] + j] for the h_sequenceOffsets[i + 1] - h_sequenceOffsets[i] steps of sequence i, and is empty after them.
+    // On the GPU only the indices and offsets are uploaded, and the CSC structure is built on the device.
+    void SetMatrixFromOneHotSequences(const CPUSPARSE_INDEX_TYPE* h_indices, const CPUSPARSE_INDEX_TYPE* h_sequenceOffsets,
+        const size_t numSequences, const size_t maxSequenceLength, const size_t numRows);
+    // a block-column sparse matrix (e.g. an embedding gradient) as the ids and values of its columns, and back (summing up duplicates)
+    void GetBlockColumns(std::vector<size_t>& columnIds, std::vector<ElemType>& values) const;
+    void AssignSumOfBlockColumns(const size_t numRows, const size_t numCols, const std::vector<size_t>& columnIds, const std::vector<ElemType>& values);
+    // Gradient sparsification: moves the (at most) k elements of the largest magnitude that is at least 'threshold' out of this dense
+    // matrix, as linear (column-major) indices and values, and sets them to 0 here. Zeros are never taken; among elements of the
+    // k-th largest magnitude, which ones are taken is unspecified. On the GPU the k-th magnitude is found by a radix select.
+    void ExtractLargestMagnitudes(size_t k, ElemType threshold, std::vector<int>& indices, std::vector<ElemType>& values);
+    // this[indices[i]] += values[i], for linear indices into this dense matrix that may repeat
+    void AddValuesAtIndices(const std::vector<int>& indices, const std::vector<ElemType>& values);
 
     void MaskColumnsValue(const Matrix<char>& columnsMask, ElemType val);
 
@@ -275,6 +310,9 @@ public:
     void SetUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed = USE_TIME_BASED_SEED);
     void SetGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
     void SetUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, RNGHandle& rngHandle);
+    // this = beta * this + a .* mask, with the dropout mask of the counter-based (Philox) stream 'key': element i of this
+    // matrix is element 'offset + i' of the stream, so that the mask can be regenerated instead of stored
+    Matrix<ElemType>& AddDropoutOf(const Matrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue, uint64_t key, size_t offset, const ElemType beta);
     void AddGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
     Matrix<ElemType>& AssignNoiseContrastiveEstimation(const Matrix<ElemType>& a, const Matrix<ElemType>& b, const Matrix<ElemType>& c, const Matrix<ElemType>& bias, Matrix<ElemType>& tmp);
 
@@ -287,6 +325,8 @@ public:
 
     Matrix<ElemType>& DoGatherColumnsOf (ElemType beta, const Matrix<ElemType>& idx, const Matrix<ElemType>& a, ElemType alpha);
     Matrix<ElemType>& DoScatterColumnsOf(ElemType beta, const Matrix<ElemType>& idx, const Matrix<ElemType>& a, ElemType alpha);
+    Matrix<ElemType>& AssignScatteredColumnsOf(const Matrix<ElemType>& idx, const Matrix<ElemType>& a, ElemType alpha);
+    Matrix<ElemType>& AssignPackedIndicesOf(const Matrix<ElemType>& idx, const Matrix<ElemType>& ranges, size_t numParallelSequences);
 
     Matrix<ElemType>& operator+=(const ElemType alpha);
     Matrix<ElemType>  operator+(const ElemType alpha) const;
@@ -347,6 +387,7 @@ public:
 
     Matrix<ElemType>& InplaceSigmoid();
     Matrix<ElemType>& AssignSigmoidOf(const Matrix<ElemType>& a);
+    Matrix<ElemType>& AddBiasAndActivation(const Matrix<ElemType>& bias, ElementWiseOperator activation); // this = f(this + bias), see MultiplyAndAddBias()
 
     Matrix<ElemType>& InplaceTanh();
     Matrix<ElemType>& AssignTanhOf(const Matrix<ElemType>& a);
@@ -360,6 +401,17 @@ public:
     // sequence training
     Matrix<ElemType>& DropFrame(const Matrix<ElemType>& label, const Matrix<ElemType>& gamma, const ElemType& threshhold);
     Matrix<ElemType>& AssignSequenceError(const ElemType hsmoothingWeight, const Matrix<ElemType>& label, const Matrix<ElemType>& dnnoutput, const Matrix<ElemType>& gamma, ElemType alpha);
+
+    // CTC forward-backward over the log posteriors 'logProbs' of a packed minibatch: utterance u is in the parallel sequence
+    // uttToChanInd[u], at the time steps uttBeginFrame[u] .. uttBeginFrame[u] + uttFrameNum[u] - 1, and has the labels
+    // labelSequences(0 .. uttLabelNum[u] - 1, u). Assigns to *this the posterior occupancy of each class in each column
+    // (0 in gaps), given the label sequence with blanks, and sets the 1x1 'totalScore' to the negative log likelihood summed
+    // over the utterances; alpha and beta receive the forward and backward log scores [2 * max #labels + 1 x maxFrameNum * #utterances].
+    // An utterance whose labels do not fit into its frames gets the occupancy exp(logProbs), that is, no gradient.
+    Matrix<ElemType>& AssignCTCScore(const Matrix<ElemType>& logProbs, Matrix<ElemType>& alpha, Matrix<ElemType>& beta,
+                                     const Matrix<ElemType>& labelSequences, Matrix<ElemType>& totalScore,
+                                     const std::vector<size_t>& uttToChanInd, const std::vector<size_t>& uttBeginFrame, const std::vector<size_t>& uttFrameNum,
+                                     const std::vector<size_t>& uttLabelNum, const size_t numParallelSequences, const size_t maxFrameNum, const size_t blankTokenId);
     Matrix<ElemType>& InplaceSqrt();
     Matrix<ElemType>& AssignSqrtOf(const Matrix<ElemType>& a);
 
@@ -450,6 +502,10 @@ public:
 
     bool HasNan(const char* name) const;
     size_t CountNanInf() const;
+    // Sets flag(0,0) to 1 if an element (of a sparse matrix: a stored one) is NaN or infinite, else leaves it alone.
+    // 'flag' is a dense 1x1 matrix on the same device. Unlike HasNan(), this does not wait for the GPU, so that
+    // many matrices can update one flag, which is then read once.
+    void UpdateNonFiniteFlag(Matrix<ElemType>& flag) const;
 
     void Print(const char* matrixName, ptrdiff_t rowFirst, ptrdiff_t rowLast, ptrdiff_t colFirst, ptrdiff_t colLast) const;
     void Print(const char* matrixName = nullptr) const; // print whole matrix. can be expensive
@@ -490,6 +546,12 @@ public:
     void ConvolutionBackwardKernel(const Matrix<ElemType>& in, const Matrix<int>& mpRowCol, const Matrix<int>& mpRowIwht,
                                    const Matrix<int>& mpRowRun, const Matrix<int>& runs, Matrix<ElemType>& kernelGrad) const;
 
+    // Direct kernels of depthwise convolutions (see DepthwiseConvolutionShape): Forward assigns the output,
+    // BackwardData and BackwardKernel add to the gradients, like the ones above.
+    void DepthwiseConvolutionForward(const Matrix<ElemType>& kernel, const DepthwiseConvolutionShape& shape, Matrix<ElemType>& output) const;
+    void DepthwiseConvolutionBackwardData(const Matrix<ElemType>& kernel, const DepthwiseConvolutionShape& shape, Matrix<ElemType>& grad) const;
+    void DepthwiseConvolutionBackwardKernel(const Matrix<ElemType>& in, const DepthwiseConvolutionShape& shape, Matrix<ElemType>& kernelGrad) const;
+
     void UnrollConvolutionInput(size_t unrollCols, size_t mapOutSize, const Matrix<int>& mpRowCol,
                                 const Matrix<int>& mpRowRun, const Matrix<int>& runs, Matrix<ElemType>& output) const;
     void UnrollConvolutionOutput(size_t unrollCols, size_t mapInCount, size_t mapOutCount, const Matrix<int>& mpRowCol,
@@ -533,14 +595,21 @@ public:
     static void Multiply(const Matrix<ElemType>& a, const bool transposeA, const Matrix<ElemType>& b, const bool transposeB, Matrix<ElemType>& c);
     static void Multiply(const Matrix<ElemType>& a, const Matrix<ElemType>& b, Matrix<ElemType>& c);
     static void Multiply1x1AndWeightedAdd(ElemType alpha, const Matrix<ElemType>& a, const Matrix<ElemType>& b, ElemType beta, Matrix<ElemType>& c);
+    static void MultiplyAndAddBias(const Matrix<ElemType>& a, const Matrix<ElemType>& b, const Matrix<ElemType>& bias, ElementWiseOperator activation, Matrix<ElemType>& c); // c = f(a * b + bias)
+    static void BatchMultiplyAndWeightedAdd(ElemType alpha, const Matrix<ElemType>& a, const bool transposeA, size_t aRows, const Matrix<ElemType>& b, const bool transposeB, size_t bRows, ElemType beta, Matrix<ElemType>& c); // a GEMM of each column
     static void ConvolveAndWeightedAdd(ElemType alpha, const Matrix<ElemType>& a, const bool transposeA, const Matrix<ElemType>& b, const bool transposeB, ElemType beta, Matrix<ElemType>& c, size_t numChannels, size_t horizontalSubsample, bool padding, bool channelwise);
 
     static void ScaleAndAdd(ElemType alpha, const Matrix<ElemType>& a, Matrix<ElemType>& c);
     static void ScaleAndAdd(ElemType alpha, const Matrix<ElemType>& a, ElemType beta, Matrix<ElemType>& c);
+    // c += alpha * a, but for a block-column sparse c only on the columns it stores (e.g. lazy L2 regularization of a sparse gradient)
+    static void ScaleAndAddToStoredColumns(ElemType alpha, const Matrix<ElemType>& a, Matrix<ElemType>& c);
     static void AddScaledDifference(const ElemType alpha, const Matrix<ElemType>& a, const Matrix<ElemType>& b, Matrix<ElemType>& c);
     static void AssignScaledDifference(const ElemType alpha, const Matrix<ElemType>& a, const Matrix<ElemType>& b, Matrix<ElemType>& c);
     static void AddScaledDifference(const Matrix<ElemType>& alpha, const Matrix<ElemType>& a, const Matrix<ElemType>& b, Matrix<ElemType>& c); // c += alpha * (a - b)
     static void AssignScaledDifference(const Matrix<ElemType>& alpha, const Matrix<ElemType>& a, const Matrix<ElemType>& b, Matrix<ElemType>& c);
+    // softmax and cross entropy against sparse (CSC) labels, without materializing the log-softmax:
+    // criterion(0, j) = sum_i labels(i, j) * (logsumexp(prediction(:, j)) - prediction(i, j)), and softmaxMinusLabels = softmax(prediction) - labels
+    static void CrossEntropyWithSoftmax(const Matrix<ElemType>& labels, const Matrix<ElemType>& prediction, Matrix<ElemType>& criterion, Matrix<ElemType>& softmaxMinusLabels);
 
     static void AddElementToElement(const Matrix<ElemType>& a, const size_t ai, const size_t aj, Matrix<ElemType>& c, const size_t ci, const size_t cj);
     // static void AddLogElementToElement(const Matrix<ElemType>& a, const size_t ai, const size_t aj, Matrix<ElemType>& c, const size_t ci, const size_t cj);
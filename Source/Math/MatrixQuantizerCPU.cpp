@@ -1,8 +1,70 @@
 #include "stdafx.h"
 #include "MatrixQuantizerCPU.h"
+#include "CPUVectorKernels.h"
+#include <algorithm>
+#include <string.h>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// 1-bit quantization of a column in the layout of ColumnQuantizer, where bit k of the quantized word i holds row
+// i + k * numWords. The rows of one bit position are thus contiguous and map to consecutive words, so that a column
+// is quantized in QWordNumBits vectorizable passes instead of word by word with a stride of numWords.
+// For float these go through the CPUVectorKernels; there are no double kernels, and double keeps the plain loops.
+static void Quantize1BitRun(const float* a, const float* residual, float threshold, float val0, float val1, float* outResidual, unsigned int* bits, unsigned int bit, size_t n)
+{
+    CPUVectorKernels::Best().Quantize1Bit(a, residual, threshold, val0, val1, outResidual, bits, bit, n);
+}
+
+static void Quantize1BitRun(const double* a, const double* residual, double threshold, double val0, double val1, double* outResidual, unsigned long long* bits, unsigned long long bit, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        double v = a[i] + residual[i];
+        bool q = v >= threshold;
+        outResidual[i] = v - (q ? val1 : val0);
+        if (q)
+            bits[i] |= bit;
+    }
+}
+
+static void Unquantize1BitRun(const unsigned int* bits, unsigned int bit, float val0, float val1, float* c, size_t n, bool add)
+{
+    CPUVectorKernels::Best().Unquantize1Bit(bits, bit, val0, val1, c, n, add);
+}
+
+static void Unquantize1BitRun(const unsigned long long* bits, unsigned long long bit, double val0, double val1, double* c, size_t n, bool add)
+{
+    for (size_t i = 0; i < n; i++)
+        c[i] = (add ? c[i] : 0) + ((bits[i] & bit) ? val1 : val0);
+}
+
+// the same results as ColumnQuantizer::Quantize() with 1 bit
+template <class ElemType, class QWord>
+static void Quantize1BitColumn(const ElemType* a, const ElemType* residual, size_t rows, ElemType lower, ElemType upper, bool zeroThreshold, QWord* bits, ElemType* outResidual)
+{
+    ValueQuantizer<ElemType> valQ(0, lower, upper);
+    const ElemType threshold = zeroThreshold ? 0 : (ElemType) (0.5f * (upper + lower)); // as ValueQuantizer::Quantize1()
+    const ElemType val0 = valQ.Unquantize(0);
+    const ElemType val1 = valQ.Unquantize(1);
+    const size_t numWords = ColumnQuantizer<ElemType>::QWordsPerCol(rows, 1);
+    memset(bits, 0, numWords * sizeof(QWord));
+    QWord bit = 1;
+    for (size_t begin = 0; begin < rows; begin += numWords, bit <<= 1)
+        Quantize1BitRun(a + begin, residual + begin, threshold, val0, val1, outResidual + begin, bits, bit, std::min(numWords, rows - begin));
+}
+
+template <class ElemType, class QWord>
+static void Unquantize1BitColumn(const QWord* bits, size_t rows, ElemType lower, ElemType upper, ElemType* c, bool add)
+{
+    ValueQuantizer<ElemType> valQ(0, lower, upper);
+    const ElemType val0 = valQ.Unquantize(0);
+    const ElemType val1 = valQ.Unquantize(1);
+    const size_t numWords = ColumnQuantizer<ElemType>::QWordsPerCol(rows, 1);
+    QWord bit = 1;
+    for (size_t begin = 0; begin < rows; begin += numWords, bit <<= 1)
+        Unquantize1BitRun(bits, bit, val0, val1, c + begin, std::min(numWords, rows - begin), add);
+}
+
 template <class ElemType>
 MatrixQuantizerCPU<ElemType>::MatrixQuantizerCPU()
     : MatrixQuantizerImpl<ElemType>(CPUDEVICE)
@@ -26,12 +88,10 @@ void MatrixQuantizerCPU<ElemType>::QuantizeAsync(const Matrix<ElemType>& inMatri
     assert((inResidual.GetNumRows() == nRow) && (inResidual.GetNumCols() == nCol));
     assert((outResidual.GetNumRows() == nRow) && (outResidual.GetNumCols() == nCol));
 
+    // the columns are independent
     const size_t ldNbits = ValueQuantizer<ElemType>::ld(nBits);
-#ifdef QUANTUSEPPL
-    Concurrency::parallel_for((size_t) 0, us.cols(), [&](size_t j)
-#else
-    for (size_t j = 0; j < nCol; j++)
-#endif
+#pragma omp parallel for if (nCol > 1)
+    for (long j = 0; j < (long) nCol; j++)
     {
         auto& qcol = *(outQMatrix.GetQuantizedColumn(j));
         if (zeroThresholdFor1Bit)
@@ -45,6 +105,13 @@ void MatrixQuantizerCPU<ElemType>::QuantizeAsync(const Matrix<ElemType>& inMatri
             ColumnQuantizer<ElemType>::template ComputeRangeStatColj<false>(inMatrix.Data(), inResidual.Data(), (long) nRow, j, nBits, qcol.lower, qcol.upper);
         }
 
+        if (nBits == 1)
+        {
+            size_t offset = j * nRow;
+            Quantize1BitColumn(inMatrix.Data() + offset, inResidual.Data() + offset, nRow, qcol.lower, qcol.upper, zeroThresholdFor1Bit, qcol.bits, outResidual.Data() + offset);
+            continue;
+        }
+
         ColumnQuantizer<ElemType> q(ldNbits, qcol.lower, qcol.upper);
         if (zeroThresholdFor1Bit)
         {
@@ -57,9 +124,6 @@ void MatrixQuantizerCPU<ElemType>::QuantizeAsync(const Matrix<ElemType>& inMatri
             q.template Quantize<false>(inMatrix.Data(), inResidual.Data(), (long) nRow, j, qcol.bits, outResidual.Data());
         }
     }
-#ifdef QUANTUSEPPL
-    );
-#endif
 }
 
 template <class ElemType>
@@ -84,19 +148,19 @@ void MatrixQuantizerCPU<ElemType>::UnquantizeAsync(QuantizedMatrix<ElemType>& in
     assert((outMatrix.GetNumRows() == nRow) && (outMatrix.GetNumCols() == nCol));
 
     const size_t ldNbits = ValueQuantizer<ElemType>::ld(nBits);
-#ifdef QUANTUSEPPL
-    Concurrency::parallel_for((size_t) 0, us.cols(), [&](size_t j)
-#else
-    for (size_t j = 0; j < nCol; j++)
-#endif
+#pragma omp parallel for if (nCol > 1)
+    for (long j = 0; j < (long) nCol; j++)
     {
         const auto& qcol = *(inQMatrix.GetQuantizedColumn(j));
+        if (nBits == 1)
+        {
+            Unquantize1BitColumn(qcol.bits, nRow, qcol.lower, qcol.upper, outMatrix.Data() + j * nRow, add);
+            continue;
+        }
+
         ColumnQuantizer<ElemType> q(ldNbits, qcol.lower, qcol.upper);
         q.Unquantize(outMatrix.Data(), (long) nRow, j, qcol.bits, add);
     }
-#ifdef QUANTUSEPPL
-    );
-#endif
 }
 
 template <class ElemType>
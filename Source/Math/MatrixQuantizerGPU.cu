@@ -89,10 +89,11 @@ cudaStream_t MatrixQuantizerGPU<ElemType>::m_fetchStream = NULL;
 template <class ElemType>
 cudaStream_t MatrixQuantizerGPU<ElemType>::m_assignStream = NULL;
 
+// without a dedicated compute stream, the quantization runs on the main compute stream, in order with the work around it
 template <class ElemType>
 cudaStream_t MatrixQuantizerGPU<ElemType>::GetComputeStream()
 {
-    return m_computeStream;
+    return (m_computeStream != NULL) ? m_computeStream : GetStream();
 }
 
 template <class ElemType>
@@ -377,6 +378,108 @@ void GPUMatrixComputeStreamEvent::SynchronizeDataTransferFetchStreamWithEvent()
     cudaStreamWaitEvent(GPUDataTransferer<ElemType>::GetFetchStream(), m_mainGPUComputeStreamCUDAEvent, 0 /*flags 'must be 0'*/) || "cudaStreamWaitEvent failed";
 }
 
+GPUMatrixComputeStreams::GPUMatrixComputeStreams(int deviceId, size_t numStreams)
+    : MatrixComputeStreams(deviceId, numStreams), m_mainStream(GetStream()), m_streams(numStreams), m_doneEvents(numStreams), m_isUsed(numStreams, false), m_currentStream(numStreams)
+{
+    PrepareDevice(deviceId);
+    cudaEventCreateWithFlags(&m_forkEvent, cudaEventDisableTiming) || "cudaEventCreateWithFlags failed";
+    for (size_t i = 0; i < numStreams; i++)
+    {
+        cudaStreamCreateWithFlags(&m_streams[i], cudaStreamNonBlocking) || "cudaStreamCreateWithFlags failed";
+        cudaEventCreateWithFlags(&m_doneEvents[i], cudaEventDisableTiming) || "cudaEventCreateWithFlags failed";
+    }
+}
+
+GPUMatrixComputeStreams::~GPUMatrixComputeStreams()
+{
+    // TODO: Check for error code and throw if !std::uncaught_exception()
+    if (m_currentStream != m_numStreams)
+        SetStream(m_mainStream);
+    for (size_t i = 0; i < m_numStreams; i++)
+    {
+        cudaStreamSynchronize(m_streams[i]) || "cudaStreamSynchronize failed";
+        cudaEventDestroy(m_doneEvents[i]) || "cudaEventDestroy failed";
+        cudaStreamDestroy(m_streams[i]) || "cudaStreamDestroy failed";
+    }
+    cudaEventDestroy(m_forkEvent) || "cudaEventDestroy failed";
+}
+
+void GPUMatrixComputeStreams::Fork()
+{
+    m_mainStream = GetStream();
+    cudaEventRecord(m_forkEvent, m_mainStream) || "cudaEventRecord failed";
+    m_isUsed.assign(m_numStreams, false);
+}
+
+void GPUMatrixComputeStreams::Begin(size_t i)
+{
+    MatrixComputeStreams::Begin(i);
+    if (m_currentStream != m_numStreams)
+        LogicError("GPUMatrixComputeStreams::Begin: Stream %d has not ended.", (int) m_currentStream);
+
+    // the first work on a stream after Fork() waits for the main stream
+    if (!m_isUsed[i])
+        cudaStreamWaitEvent(m_streams[i], m_forkEvent, 0 /*flags 'must be 0'*/) || "cudaStreamWaitEvent failed";
+    m_isUsed[i] = true;
+    m_currentStream = i;
+    SetStream(m_streams[i]);
+}
+
+void GPUMatrixComputeStreams::End()
+{
+    if (m_currentStream == m_numStreams)
+        LogicError("GPUMatrixComputeStreams::End: No stream has begun.");
+
+    cudaEventRecord(m_doneEvents[m_currentStream], m_streams[m_currentStream]) || "cudaEventRecord failed";
+    m_currentStream = m_numStreams;
+    SetStream(m_mainStream);
+}
+
+void GPUMatrixComputeStreams::Join()
+{
+    if (m_currentStream != m_numStreams)
+        End();
+    for (size_t i = 0; i < m_numStreams; i++)
+    {
+        if (m_isUsed[i])
+            cudaStreamWaitEvent(m_mainStream, m_doneEvents[i], 0 /*flags 'must be 0'*/) || "cudaStreamWaitEvent failed";
+    }
+    m_isUsed.assign(m_numStreams, false);
+}
+
+GPUMatrixComputeStream::GPUMatrixComputeStream(int deviceId)
+    : MatrixComputeStream(deviceId), m_callerStream(GetStream()), m_begun(false)
+{
+    PrepareDevice(deviceId);
+    cudaStreamCreate(&m_stream) || "cudaStreamCreate failed";
+}
+
+GPUMatrixComputeStream::~GPUMatrixComputeStream()
+{
+    // TODO: Check for error code and throw if !std::uncaught_exception()
+    if (m_begun)
+        SetStream(m_callerStream);
+    cudaStreamSynchronize(m_stream) || "cudaStreamSynchronize failed";
+    cudaStreamDestroy(m_stream) || "cudaStreamDestroy failed";
+}
+
+void GPUMatrixComputeStream::Begin()
+{
+    if (m_begun)
+        LogicError("GPUMatrixComputeStream::Begin: The stream has not ended.");
+    m_callerStream = GetStream();
+    m_begun = true;
+    SetStream(m_stream);
+}
+
+void GPUMatrixComputeStream::End()
+{
+    if (!m_begun)
+        LogicError("GPUMatrixComputeStream::End: The stream has not begun.");
+    m_begun = false;
+    SetStream(m_callerStream);
+}
+
 // Explicit template instantiations
 template void GPUMatrixComputeStreamEvent::SynchronizeQuantizationComputeStreamWithEvent<float>();
 template void GPUMatrixComputeStreamEvent::SynchronizeQuantizationComputeStreamWithEvent<double>();
@@ -102,4 +102,45 @@ private:
     cudaEvent_t m_mainGPUComputeStreamCUDAEvent;
 #endif
 };
+
+// Streams of the same priority as the main GPU compute stream, to which MatrixComputeStreams::Begin() switches
+class MATH_API GPUMatrixComputeStreams : public MatrixComputeStreams
+{
+public:
+    GPUMatrixComputeStreams(int deviceId, size_t numStreams);
+    ~GPUMatrixComputeStreams();
+
+    void Fork() override;
+    void Begin(size_t i) override;
+    void End() override;
+    void Join() override;
+
+private:
+#ifndef CPUONLY
+    cudaStream_t m_mainStream;          // the stream that was current at Fork()
+    cudaEvent_t m_forkEvent;            // recorded on m_mainStream by Fork()
+    std::vector<cudaStream_t> m_streams;
+    std::vector<cudaEvent_t> m_doneEvents; // recorded on m_streams[i] by End()
+    std::vector<bool> m_isUsed;         // whether work was issued to m_streams[i] since Fork()
+    size_t m_currentStream;             // m_numStreams if none
+#endif
+};
+
+// A blocking stream, to which MatrixComputeStream::Begin() switches
+class MATH_API GPUMatrixComputeStream : public MatrixComputeStream
+{
+public:
+    GPUMatrixComputeStream(int deviceId);
+    ~GPUMatrixComputeStream();
+
+    void Begin() override;
+    void End() override;
+
+private:
+#ifndef CPUONLY
+    cudaStream_t m_stream;
+    cudaStream_t m_callerStream; // the stream that was current at Begin()
+    bool m_begun;
+#endif
+};
 } } }
@@ -69,6 +69,66 @@ MatrixComputeStreamEvent::MatrixComputeStreamEvent(int deviceId)
 {
 }
 
+MatrixComputeStreams* MatrixComputeStreams::Create(int deviceId, size_t numStreams)
+{
+    if (deviceId >= 0)
+        return new GPUMatrixComputeStreams(deviceId, numStreams);
+    else
+        return new MatrixComputeStreams(deviceId, numStreams);
+}
+
+MatrixComputeStreams::MatrixComputeStreams(int deviceId, size_t numStreams)
+    : m_deviceId(deviceId), m_numStreams(numStreams)
+{
+}
+
+MatrixComputeStreams::~MatrixComputeStreams()
+{
+}
+
+void MatrixComputeStreams::Fork()
+{
+}
+
+void MatrixComputeStreams::Begin(size_t i)
+{
+    if (i >= m_numStreams)
+        LogicError("MatrixComputeStreams::Begin: Stream %d does not exist (there are %d).", (int) i, (int) m_numStreams);
+}
+
+void MatrixComputeStreams::End()
+{
+}
+
+void MatrixComputeStreams::Join()
+{
+}
+
+MatrixComputeStream* MatrixComputeStream::Create(int deviceId)
+{
+    if (deviceId >= 0)
+        return new GPUMatrixComputeStream(deviceId);
+    else
+        return new MatrixComputeStream(deviceId);
+}
+
+MatrixComputeStream::MatrixComputeStream(int deviceId)
+    : m_deviceId(deviceId)
+{
+}
+
+MatrixComputeStream::~MatrixComputeStream()
+{
+}
+
+void MatrixComputeStream::Begin()
+{
+}
+
+void MatrixComputeStream::End()
+{
+}
+
 // Explicit template instantiations
 template MATH_API void MatrixComputeStreamEvent::SynchronizeQuantizationComputeStreamWithEvent<float>();
 template MATH_API void MatrixComputeStreamEvent::SynchronizeQuantizationComputeStreamWithEvent<double>();
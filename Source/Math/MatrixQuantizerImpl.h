@@ -67,6 +67,64 @@ public:
 protected:
     MatrixComputeStreamEvent(int deviceId);
 
+protected:
+    int m_deviceId;
+};
+
+// A set of streams that independent work (e.g. the updates of separate parameter groups) can be issued to instead of
+// the main matrix computation work stream, so that it overlaps on the device:
+//     Fork(); for each i: { Begin(i); ...work...; End(); } Join();
+// The streams only start after the work issued to the main stream before Fork(), and Join() makes the main stream wait
+// (on events, without a host sync) for all work issued to the streams. On the CPU, all of this does nothing.
+class MATH_API MatrixComputeStreams
+{
+public:
+    static MatrixComputeStreams* Create(int deviceId, size_t numStreams);
+    virtual ~MatrixComputeStreams();
+
+    // Disallow copy and move construction and assignment
+    DISABLE_COPY_AND_MOVE(MatrixComputeStreams);
+
+    size_t GetNumStreams() const
+    {
+        return m_numStreams;
+    }
+
+    virtual void Fork();
+    // issue the Matrix operations of the calling thread to stream 'i' until End()
+    virtual void Begin(size_t i);
+    virtual void End();
+    virtual void Join();
+
+protected:
+    MatrixComputeStreams(int deviceId, size_t numStreams);
+
+protected:
+    int m_deviceId;
+    size_t m_numStreams;
+};
+
+// A stream of its own for the work of one client, e.g. of one of several models evaluated at the same time from
+// different threads, so that their kernels overlap on the device:
+//     Begin(); ...work...; End();
+// Begin() issues the Matrix operations of the calling thread to the stream until End(), which restores the stream before.
+// Unlike those of MatrixComputeStreams, the stream is synchronized with the legacy default stream, which the plain
+// cudaMemcpy() of some operations uses, so that work of any kind may be issued to it. On the CPU, all of this does nothing.
+class MATH_API MatrixComputeStream
+{
+public:
+    static MatrixComputeStream* Create(int deviceId);
+    virtual ~MatrixComputeStream();
+
+    // Disallow copy and move construction and assignment
+    DISABLE_COPY_AND_MOVE(MatrixComputeStream);
+
+    virtual void Begin();
+    virtual void End();
+
+protected:
+    MatrixComputeStream(int deviceId);
+
 protected:
     int m_deviceId;
 };
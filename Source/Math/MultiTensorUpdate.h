@@ -0,0 +1,159 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// MultiTensorUpdate.h -- the per-element learner updates that Matrix<ElemType>::MultiTensorUpdate() applies to many tensors at once
+//
+
+#pragma once
+
+#include "TensorOps.h"
+
+#pragma push_macro("TENSOR_OPS_DECL")
+#ifndef TENSOR_OPS_DECL // to make these accessible to CUDA kernels, say '#define TENSOR_OPS_DECL __device__ __host__'
+#define TENSOR_OPS_DECL
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// MultiTensorUpdateParams -- all scalars of one multi-tensor learner update
+//
+// The functions below are shared by the CPU loops and the CUDA kernels. Each one computes for one element exactly
+// what the single-tensor function it replaces computes, so that the fused and the per-tensor update agree:
+//  - MomentumSGD, Nesterov: NormalGrad() of a dense gradient
+//  - AdaGrad:               Adagrad(), then value -= learningRate / aveMultiplier * gradient
+//  - FSAdaGrad:             FSAdagrad(), with the (per-tensor) adaMul of FSAdagradUpdate()
+//  - RmsProp:               RmsProp() without the initialization, then as AdaGrad
+// The smoothed gradient of a tensor of n elements is laid out as for those functions (FSAdaGrad: 2n, RmsProp: 3n).
+// Before the update the gradient is scaled (e.g. for clipping by a norm), truncated and L2-regularized, as LearnerBase::PreProcess()
+// and SGD::UpdateWeights() do.
+// -----------------------------------------------------------------------
+
+enum class MultiTensorUpdateKind : int
+{
+    MomentumSGD,
+    Nesterov,
+    AdaGrad,
+    FSAdaGrad,
+    RmsProp
+};
+
+template <class ElemType>
+struct MultiTensorUpdateParams
+{
+    MultiTensorUpdateKind m_kind;
+    ElemType m_learningRate;
+    ElemType m_momentum;          // MomentumSGD, Nesterov, FSAdaGrad
+    ElemType m_varMomentum;       // FSAdaGrad
+    ElemType m_rmsGamma, m_rmsInc, m_rmsMax, m_rmsDec, m_rmsMin; // RmsProp
+    bool m_needAveMultiplier;     // AdaGrad, RmsProp: the step is divided by the mean multiplier of the tensor
+    ElemType m_gradientScale;     // gradients are multiplied by this first (1 for none)
+    ElemType m_clippingThreshold; // gradients are truncated to +-m_clippingThreshold (infinity for none)
+    ElemType m_l2Weight;          // gradient += m_l2Weight * value (0 for none)
+};
+
+// Updates element i of a tensor of n elements and returns its multiplier. If m_needAveMultiplier, the value itself is
+// updated afterwards by MultiTensorApplyStep(), with the mean of the multipliers of the tensor.
+template <class ElemType>
+static inline TENSOR_OPS_DECL ElemType MultiTensorUpdateElement(const MultiTensorUpdateParams<ElemType>& p, ElemType adaMul,
+                                                                ElemType* smoothed, ElemType* gradient, ElemType* value, size_t i, size_t n)
+{
+    ElemType g = gradient[i] * p.m_gradientScale;
+    if (g > p.m_clippingThreshold)
+        g = p.m_clippingThreshold;
+    else if (g < -p.m_clippingThreshold)
+        g = -p.m_clippingThreshold;
+    if (p.m_l2Weight != 0)
+        g += p.m_l2Weight * value[i];
+
+    switch (p.m_kind)
+    {
+    case MultiTensorUpdateKind::MomentumSGD:
+        smoothed[i] = (1 - p.m_momentum) * p.m_learningRate * g + p.m_momentum * smoothed[i];
+        value[i] -= smoothed[i];
+        gradient[i] = g;
+        return 1;
+    case MultiTensorUpdateKind::Nesterov:
+        smoothed[i] = (1 - p.m_momentum) * p.m_learningRate * g + p.m_momentum * smoothed[i];
+        value[i] -= p.m_momentum * smoothed[i];
+        value[i] -= (1 - p.m_momentum) * p.m_learningRate * g;
+        gradient[i] = g;
+        return 1;
+    case MultiTensorUpdateKind::AdaGrad:
+    {
+        const ElemType floor = 1e-16f;
+        smoothed[i] += g * g;
+        ElemType temp = sqrt_(smoothed[i] + floor);
+        g /= temp;
+        gradient[i] = g;
+        if (!p.m_needAveMultiplier)
+            value[i] -= p.m_learningRate * g;
+        return 1 / temp;
+    }
+    case MultiTensorUpdateKind::FSAdaGrad:
+    {
+        gradient[i] = g;
+        ElemType* smoothAda = smoothed;
+        ElemType* smoothMom = smoothed + n;
+        ElemType adaSqr = p.m_varMomentum * smoothAda[i] + (1 - p.m_varMomentum) * g * g;
+        smoothAda[i] = adaSqr;
+        if (adaSqr != 0)
+        {
+            ElemType w = adaMul / sqrt_(adaSqr);
+            if (w > 10)
+                w = 10;
+            g *= w;
+        }
+        if (p.m_momentum > 0)
+        {
+            g = p.m_momentum * smoothMom[i] + (1 - p.m_momentum) * g;
+            smoothMom[i] = g;
+        }
+        value[i] -= p.m_learningRate * g;
+        return 1;
+    }
+    case MultiTensorUpdateKind::RmsProp:
+    {
+        const ElemType floor = 1e-6f;
+        ElemType* avars = smoothed;     // accumulated variances for RMS scaling
+        ElemType* signs = smoothed + n; // sign of previous gradient
+        ElemType* steps = smoothed + 2 * n; // current step size
+        avars[i] = p.m_rmsGamma * avars[i] + (1 - p.m_rmsGamma) * (g * g);
+        const int gradSign = (ElemType(0) < g) - (g < ElemType(0));
+        if (signs[i] * gradSign > 0)
+        {
+            steps[i] *= p.m_rmsInc;
+            if (steps[i] > p.m_rmsMax)
+                steps[i] = p.m_rmsMax;
+        }
+        else
+        {
+            steps[i] *= p.m_rmsDec;
+            if (steps[i] < p.m_rmsMin)
+                steps[i] = p.m_rmsMin;
+        }
+        ElemType temp = steps[i] / sqrt_(avars[i] + floor);
+        g *= temp;
+        gradient[i] = g;
+        signs[i] = (ElemType) gradSign;
+        if (!p.m_needAveMultiplier)
+            value[i] -= p.m_learningRate * g;
+        return temp;
+    }
+    default:
+        return 0;
+    }
+}
+
+// second pass if m_needAveMultiplier: the step of element i, with the mean multiplier of its tensor
+template <class ElemType>
+static inline TENSOR_OPS_DECL void MultiTensorApplyStep(const MultiTensorUpdateParams<ElemType>& p, ElemType aveMultiplier,
+                                                        const ElemType* gradient, ElemType* value, size_t i)
+{
+    value[i] += (-p.m_learningRate / aveMultiplier) * gradient[i];
+}
+
+}}}
+
+#pragma pop_macro("TENSOR_OPS_DECL")
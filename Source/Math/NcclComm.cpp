@@ -0,0 +1,174 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "NcclComm.h"
+#include "BestGpu.h" // for CPUONLY
+#if !defined(CPUONLY) && defined(USE_NCCL)
+#include "GPUMatrix.h"
+#include <cuda_runtime_api.h>
+#include <nccl.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#if !defined(CPUONLY) && defined(USE_NCCL)
+
+inline static void CheckNcclReturnCode(ncclResult_t rc, const char* msg)
+{
+    if (rc != ncclSuccess)
+        RuntimeError("%s: %s (nccl error %d)", msg, ncclGetErrorString(rc), (int) rc);
+}
+
+inline static void CheckCudaReturnCode(cudaError_t rc, const char* msg)
+{
+    if (rc != cudaSuccess)
+        RuntimeError("%s: %s (cuda error %d)", msg, cudaGetErrorString(rc), (int) rc);
+}
+
+static ncclDataType_t GetNcclDataType(float*) { return ncclFloat; }
+static ncclDataType_t GetNcclDataType(double*) { return ncclDouble; }
+
+NcclComm::NcclComm(int deviceId, const MPIWrapperPtr& mpi)
+    : m_ncclComm(nullptr), m_deviceId(deviceId), m_numRanks(mpi ? (int) mpi->NumNodesInUse() : 1)
+{
+    if (deviceId == CPUDEVICE || !mpi || mpi->NumNodesInUse() < 2)
+        return;
+
+    // the main node creates the id of the clique and hands it to everybody else
+    ncclUniqueId ncclId;
+    if (mpi->IsMainNode())
+        CheckNcclReturnCode(ncclGetUniqueId(&ncclId), "NcclComm: ncclGetUniqueId");
+    mpi->Bcast((char*) &ncclId, sizeof(ncclId), mpi->MainNodeRank());
+
+    CheckCudaReturnCode(cudaSetDevice(deviceId), "NcclComm: cudaSetDevice");
+    ncclComm_t ncclComm;
+    CheckNcclReturnCode(ncclCommInitRank(&ncclComm, (int) mpi->NumNodesInUse(), ncclId, (int) mpi->CurrentNodeRank()), "NcclComm: ncclCommInitRank");
+    m_ncclComm = ncclComm;
+}
+
+NcclComm::~NcclComm()
+{
+    if (m_ncclComm)
+        ncclCommDestroy((ncclComm_t) m_ncclComm);
+}
+
+bool NcclComm::IsSupported() const
+{
+    return m_ncclComm != nullptr;
+}
+
+template <class ElemType>
+void NcclComm::AllReduceImpl(const std::vector<Matrix<ElemType>*>& grads)
+{
+    if (!IsSupported())
+        LogicError("NcclComm::AllReduce: NCCL is not available for this device.");
+
+    // group the calls so that NCCL can launch them together rather than one kernel at a time
+    CheckNcclReturnCode(ncclGroupStart(), "NcclComm: ncclGroupStart");
+    for (auto grad : grads)
+    {
+        if (grad->GetMatrixType() != DENSE || grad->GetDeviceId() != m_deviceId)
+            LogicError("NcclComm::AllReduce: Only dense matrices on device %d can be reduced.", m_deviceId);
+
+        ElemType* data = grad->Data();
+        CheckNcclReturnCode(ncclAllReduce(data, data, grad->GetNumElements(), GetNcclDataType(data), ncclSum, (ncclComm_t) m_ncclComm, GetStream()), "NcclComm: ncclAllReduce");
+    }
+    CheckNcclReturnCode(ncclGroupEnd(), "NcclComm: ncclGroupEnd");
+}
+
+void NcclComm::AllGather(const char* sendBuffer, char* recvBuffer, size_t bytesPerRank)
+{
+    if (!IsSupported())
+        LogicError("NcclComm::AllGather: NCCL is not available for this device.");
+
+    CheckNcclReturnCode(ncclAllGather(sendBuffer, recvBuffer, bytesPerRank, ncclChar, (ncclComm_t) m_ncclComm, GetStream()), "NcclComm: ncclAllGather");
+}
+
+bool NcclComm::IsAllToAllSupported() const
+{
+#if defined(NCCL_VERSION_CODE) && (NCCL_VERSION_CODE >= NCCL_VERSION(2, 7, 0))
+    return IsSupported();
+#else
+    return false;
+#endif
+}
+
+void NcclComm::AllToAll(const char* sendBuffer, char* recvBuffer, size_t bytesPerRank)
+{
+    if (!IsAllToAllSupported())
+        LogicError("NcclComm::AllToAll: NCCL 2.7 or later is required.");
+
+#if defined(NCCL_VERSION_CODE) && (NCCL_VERSION_CODE >= NCCL_VERSION(2, 7, 0))
+    // point-to-point sends and receives in one group, which NCCL schedules without deadlock
+    CheckNcclReturnCode(ncclGroupStart(), "NcclComm: ncclGroupStart");
+    for (int rank = 0; rank < m_numRanks; rank++)
+    {
+        CheckNcclReturnCode(ncclSend(sendBuffer + rank * bytesPerRank, bytesPerRank, ncclChar, rank, (ncclComm_t) m_ncclComm, GetStream()), "NcclComm: ncclSend");
+        CheckNcclReturnCode(ncclRecv(recvBuffer + rank * bytesPerRank, bytesPerRank, ncclChar, rank, (ncclComm_t) m_ncclComm, GetStream()), "NcclComm: ncclRecv");
+    }
+    CheckNcclReturnCode(ncclGroupEnd(), "NcclComm: ncclGroupEnd");
+#endif
+}
+
+void NcclComm::Sync()
+{
+    CheckCudaReturnCode(cudaStreamSynchronize(GetStream()), "NcclComm: cudaStreamSynchronize");
+}
+
+#else // stubs for builds without NCCL
+
+NcclComm::NcclComm(int deviceId, const MPIWrapperPtr&)
+    : m_ncclComm(nullptr), m_deviceId(deviceId), m_numRanks(1)
+{
+}
+
+NcclComm::~NcclComm()
+{
+}
+
+bool NcclComm::IsSupported() const
+{
+    return false;
+}
+
+template <class ElemType>
+void NcclComm::AllReduceImpl(const std::vector<Matrix<ElemType>*>&)
+{
+    LogicError("NcclComm::AllReduce: CNTK was built without NCCL support.");
+}
+
+void NcclComm::AllGather(const char*, char*, size_t)
+{
+    LogicError("NcclComm::AllGather: CNTK was built without NCCL support.");
+}
+
+bool NcclComm::IsAllToAllSupported() const
+{
+    return false;
+}
+
+void NcclComm::AllToAll(const char*, char*, size_t)
+{
+    LogicError("NcclComm::AllToAll: CNTK was built without NCCL support.");
+}
+
+void NcclComm::Sync()
+{
+}
+
+#endif
+
+void NcclComm::AllReduce(const std::vector<Matrix<float>*>& grads)
+{
+    AllReduceImpl(grads);
+}
+
+void NcclComm::AllReduce(const std::vector<Matrix<double>*>& grads)
+{
+    AllReduceImpl(grads);
+}
+
+}}}
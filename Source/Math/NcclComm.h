@@ -0,0 +1,52 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// NcclComm.h -- allreduce of GPU matrices across MPI ranks directly on the device, through NCCL
+//
+
+#pragma once
+
+#include "Matrix.h"
+#include "MPIWrapper.h"
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// NCCL communicator spanning the ranks of an MPI communicator, one GPU per rank.
+// Only functional in builds with USE_NCCL defined (see NCCL_PATH in the Makefile); otherwise IsSupported() returns false.
+class MATH_API NcclComm
+{
+public:
+    NcclComm(int deviceId, const MPIWrapperPtr& mpi);
+    ~NcclComm();
+
+    bool IsSupported() const;
+
+    // in-place sum of the matrices across all ranks; issued on the current compute stream, so work launched on it
+    // afterwards sees the result without further synchronization
+    void AllReduce(const std::vector<Matrix<float>*>& grads);
+    void AllReduce(const std::vector<Matrix<double>*>& grads);
+
+    // Byte-wise exchanges of device buffers, also on the current compute stream: AllGather() concatenates the
+    // 'bytesPerRank' bytes of all ranks in rank order; AllToAll() sends the i-th block of 'bytesPerRank' bytes to rank i,
+    // and receives the block of rank i into the i-th block of 'recvBuffer'. AllToAll() requires NCCL 2.7 or later.
+    void AllGather(const char* sendBuffer, char* recvBuffer, size_t bytesPerRank);
+    void AllToAll(const char* sendBuffer, char* recvBuffer, size_t bytesPerRank);
+    bool IsAllToAllSupported() const;
+
+    // waits for the reductions issued so far to complete
+    void Sync();
+
+private:
+    template <class ElemType>
+    void AllReduceImpl(const std::vector<Matrix<ElemType>*>& grads);
+
+    void* m_ncclComm; // ncclComm_t; opaque here to keep nccl.h out of the headers
+    int m_deviceId;
+    int m_numRanks;
+
+    DISABLE_COPY_AND_MOVE(NcclComm);
+};
+
+}}}
@@ -212,6 +212,12 @@ void GPUSparseMatrix<ElemType>::SetMatrixFromCSCFormat(const CPUSPARSE_INDEX_TYP
 {
 }
 
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::SetMatrixFromOneHotSequences(const CPUSPARSE_INDEX_TYPE* h_indices, const CPUSPARSE_INDEX_TYPE* h_sequenceOffsets,
+                                                             const size_t numSequences, const size_t maxSequenceLength, const size_t numRows)
+{
+}
+
 // forward pass from feature to hidden layer
 template <class ElemType>
 void GPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& lhs, const bool transposeA,
@@ -232,6 +238,17 @@ void GPUSparseMatrix<ElemType>::ScaleAndAdd(const ElemType alpha, const GPUSpars
 {
 }
 
+template <class ElemType>
+GPUSparseMatrix<ElemType>& GPUSparseMatrix<ElemType>::AssignScatteredColumnsOf(const GPUMatrix<ElemType>& idx, const GPUMatrix<ElemType>& a, ElemType alpha)
+{
+    return *this;
+}
+
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::CrossEntropyWithSoftmax(const GPUSparseMatrix<ElemType>& labels, const GPUMatrix<ElemType>& prediction, GPUMatrix<ElemType>& criterion, GPUMatrix<ElemType>& softmaxMinusLabels)
+{
+}
+
 template <class ElemType>
 GPUSparseMatrix<ElemType>& GPUSparseMatrix<ElemType>::InplaceTruncate(const ElemType threshold)
 {
@@ -682,6 +699,11 @@ template <class ElemType>
 void GPUSparseMatrix<ElemType>::ConvertToSparseFormat(MatrixFormat newFormat, GPUSparseMatrix<ElemType>& outMatrix) const
 {
 }
+template <class ElemType>
+std::shared_ptr<const GPUSparseMatrix<ElemType>> GPUSparseMatrix<ElemType>::GetOtherCompressedFormat() const
+{
+    return nullptr;
+}
 
 template <class ElemType>
 void GPUSparseMatrix<ElemType>::ConvolveAndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& lhs, const bool transposeA, const GPUSparseMatrix<ElemType>& rhs, const bool transposeB, ElemType beta, GPUMatrix<ElemType>& c, size_t numChannels, size_t horizontalSubsample, bool padding, bool channelwise){};
@@ -964,6 +986,12 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::DoScatterColumnsOf(ElemType beta, cons
     return *this;
 }
 
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignPackedIndicesOf(const GPUMatrix<ElemType>& idx, const GPUMatrix<ElemType>& ranges, size_t numParallelSequences)
+{
+    return *this;
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::SetValue(const ElemType v)
 {
@@ -988,6 +1016,17 @@ void GPUMatrix<ElemType>::MaskColumnsValue(const GPUMatrix<char>& columnsMask, E
 {
 }
 
+template <class ElemType>
+size_t GPUMatrix<ElemType>::ExtractLargestMagnitudes(size_t k, ElemType threshold, int* indices, ElemType* values)
+{
+    return 0;
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::AddValuesAtIndices(const int* indices, const ElemType* values, size_t count)
+{
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::CopyColumnsStrided(const GPUMatrix<ElemType>& fromMatrix, size_t numCols, size_t srcNumColsStride, size_t destNumColsStride)
 {
@@ -1002,6 +1041,11 @@ template <class ElemType>
 void GPUMatrix<ElemType>::SetValue(GPUMatrix<ElemType> const&)
 {
 }
+
+template <class ElemType>
+void GPUMatrix<ElemType>::AssignPeerValuesOf(const GPUMatrix<ElemType>& /*a*/)
+{
+}
 #if 0
 template <class ElemType>
 void GPUMatrix<ElemType>::SetValue(CPUSparseMatrix<ElemType> const&)
@@ -1045,6 +1089,12 @@ void GPUMatrix<ElemType>::SetUniformRandomMask(const ElemType maskRate, const El
 {
 }
 
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AddDropoutOf(const GPUMatrix<ElemType>& /*a*/, const ElemType /*maskRate*/, const ElemType /*scaleValue*/, uint64_t /*key*/, size_t /*offset*/, const ElemType /*beta*/)
+{
+    return *this;
+}
+
 template <class ElemType>
 ElemType GPUMatrix<ElemType>::Adagrad(GPUMatrix<ElemType>& gradients, const bool needAveMultiplier)
 {
@@ -1061,6 +1111,35 @@ ElemType GPUMatrix<ElemType>::RmsProp(GPUMatrix<ElemType>& gradients, ElemType R
     return 0;
 }
 
+template <class ElemType>
+/*static*/ bool GPUMatrix<ElemType>::MultiTensorUpdate(const MultiTensorUpdateParams<ElemType>& params,
+                                                       const std::vector<GPUMatrix<ElemType>*>& smoothedGradients, const std::vector<GPUMatrix<ElemType>*>& gradients,
+                                                       const std::vector<GPUMatrix<ElemType>*>& values, const std::vector<ElemType>& adaMuls, bool checkForNan)
+{
+    return false;
+}
+
+template <class ElemType>
+/*static*/ double GPUMatrix<ElemType>::MultiTensorSumOfSquares(const std::vector<const GPUMatrix<ElemType>*>& tensors)
+{
+    return 0;
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::AssignAugmentedImages(const unsigned char* images, size_t numCols, const ImageAugmentationParams& params, const ElemType* mean, uint64_t key)
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::CompressValuesInto(char* codes, size_t columnBytes, ValueCompression compression) const
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::AssignDecompressedValuesOf(const char* codes, size_t columnBytes, ValueCompression compression, size_t numRows, size_t numCols)
+{
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::Reshape(const size_t numRows, const size_t numCols)
 {
@@ -1076,6 +1155,11 @@ void GPUMatrix<ElemType>::Resize(const size_t numRows, const size_t numCols, boo
 {
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::ShrinkToFit()
+{
+}
+
 template <class ElemType>
 size_t GPUMatrix<ElemType>::LocateElement(const size_t row, const size_t col) const
 {
@@ -1299,6 +1383,12 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignSigmoidOf(const GPUMatrix<ElemTy
     return *this;
 }
 
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AddBiasAndActivation(const GPUMatrix<ElemType>& /*bias*/, ElementWiseOperator /*activation*/)
+{
+    return *this;
+}
+
 template <class ElemType>
 GPUMatrix<ElemType>& GPUMatrix<ElemType>::InplaceSigmoidDerivative()
 {
@@ -1358,6 +1448,15 @@ GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignSequenceError(const ElemType hsm
     return *this;
 }
 
+template <class ElemType>
+GPUMatrix<ElemType>& GPUMatrix<ElemType>::AssignCTCScore(const GPUMatrix<ElemType>& logProbs, GPUMatrix<ElemType>& alpha, GPUMatrix<ElemType>& beta,
+                                                         const GPUMatrix<ElemType>& labelSequences, GPUMatrix<ElemType>& totalScore,
+                                                         const std::vector<size_t>& uttToChanInd, const std::vector<size_t>& uttBeginFrame, const std::vector<size_t>& uttFrameNum,
+                                                         const std::vector<size_t>& uttLabelNum, const size_t numParallelSequences, const size_t maxFrameNum, const size_t blankTokenId)
+{
+    return *this;
+}
+
 template <class ElemType>
 GPUMatrix<ElemType>& GPUMatrix<ElemType>::InplaceSqrt()
 {
@@ -1798,6 +1897,21 @@ void GPUMatrix<ElemType>::ConvolutionBackwardKernel(const GPUMatrix<ElemType>& i
 {
 }
 
+template <class ElemType>
+void GPUMatrix<ElemType>::DepthwiseConvolutionForward(const GPUMatrix<ElemType>& kernel, const DepthwiseConvolutionShape& shape, GPUMatrix<ElemType>& output) const
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::DepthwiseConvolutionBackwardData(const GPUMatrix<ElemType>& kernel, const DepthwiseConvolutionShape& shape, GPUMatrix<ElemType>& grad) const
+{
+}
+
+template <class ElemType>
+void GPUMatrix<ElemType>::DepthwiseConvolutionBackwardKernel(const GPUMatrix<ElemType>& in, const DepthwiseConvolutionShape& shape, GPUMatrix<ElemType>& kernelGrad) const
+{
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::MaxPoolingForward(const GPUMatrix<int>& mpRowCol, const GPUMatrix<int>& mpRowIndices, const GPUMatrix<int>& indices, GPUMatrix<ElemType>& output) const
 {
@@ -1863,6 +1977,11 @@ void GPUMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const GPUMatrix
 {
 }
 template <class ElemType>
+void GPUMatrix<ElemType>::BatchMultiplyAndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& /*a*/, const bool transposeA, size_t aRows, const GPUMatrix<ElemType>& /*b*/, const bool transposeB, size_t bRows,
+                                                      ElemType beta, GPUMatrix<ElemType>& c)
+{
+}
+template <class ElemType>
 void GPUMatrix<ElemType>::Multiply1x1AndWeightedAdd(ElemType alpha, const GPUMatrix<ElemType>& lhs, const GPUMatrix<ElemType>& rhs, ElemType beta, GPUMatrix<ElemType>& c)
 {
 }
@@ -2006,6 +2125,11 @@ bool GPUMatrix<ElemType>::AreEqual(const GPUMatrix<ElemType>& /*a*/, const GPUMa
     return false;
 }
 
+template <class ElemType>
+/*static*/ void GPUMatrix<ElemType>::UpdateNonFiniteFlag(const ElemType* /*data*/, size_t /*numElements*/, GPUMatrix<ElemType>& /*flag*/)
+{
+}
+
 template <class ElemType>
 void GPUMatrix<ElemType>::TensorShuffleScaleAndAdd(ElemType keepWeight, const GPUMatrix<ElemType>& a, size_t D, size_t S, size_t M, size_t K, size_t T, ElemType scaleFactor, const GPUMatrix<ElemType>& b, GPUMatrix<ElemType>& c)
 {
@@ -2185,6 +2309,34 @@ void GPUMatrixComputeStreamEvent::SynchronizeDataTransferFetchStreamWithEvent<do
 
 #pragma endregion GPUMatrixComputeStreamEvent functions
 
+#pragma region GPUMatrixComputeStreams functions
+
+GPUMatrixComputeStreams::GPUMatrixComputeStreams(int deviceId, size_t numStreams)
+    : MatrixComputeStreams(deviceId, numStreams)
+{
+}
+
+GPUMatrixComputeStreams::~GPUMatrixComputeStreams(){};
+void GPUMatrixComputeStreams::Fork(){};
+void GPUMatrixComputeStreams::Begin(size_t){};
+void GPUMatrixComputeStreams::End(){};
+void GPUMatrixComputeStreams::Join(){};
+
+#pragma endregion GPUMatrixComputeStreams functions
+
+#pragma region GPUMatrixComputeStream functions
+
+GPUMatrixComputeStream::GPUMatrixComputeStream(int deviceId)
+    : MatrixComputeStream(deviceId)
+{
+}
+
+GPUMatrixComputeStream::~GPUMatrixComputeStream(){};
+void GPUMatrixComputeStream::Begin(){};
+void GPUMatrixComputeStream::End(){};
+
+#pragma endregion GPUMatrixComputeStream functions
+
 #pragma region GPUDataTransferer functions
 
 GranularGPUDataTransferer::~GranularGPUDataTransferer() {}
@@ -2201,6 +2353,8 @@ void GranularGPUDataTransferer::RecordCPUToGPUCopy() {}
 
 void GranularGPUDataTransferer::WaitForCopyCPUToGPU() {}
 
+void GranularGPUDataTransferer::WaitForCopyCPUToGPUOnComputeStreamAsync() {}
+
 void GranularGPUDataTransferer::RecordComputeStreamSyncPoint() {}
 
 void GranularGPUDataTransferer::WaitForSyncPointOnFetchStreamAsync() {}
@@ -2209,6 +2363,8 @@ void GranularGPUDataTransferer::WaitForSyncPointOnAssignStreamAsync() {}
 
 PrefetchGPUDataTransferer::PrefetchGPUDataTransferer(int /*deviceId*/) : GranularGPUDataTransferer() {}
 
+PrefetchGPUDataTransferer::~PrefetchGPUDataTransferer() {}
+
 template <class ElemType>
 GPUDataTransferer<ElemType>::GPUDataTransferer(int, bool)
 {
@@ -2239,6 +2395,11 @@ void GPUDataTransferer<ElemType>::WaitForCopyCPUToGPUAsync()
 {
 }
 
+template <class ElemType>
+void GPUDataTransferer<ElemType>::WaitForCopyCPUToGPUOnComputeStreamAsync()
+{
+}
+
 #pragma endregion GPUDataTransferer functions
 
 #pragma region GPURNGHandle functions
@@ -2269,9 +2430,6 @@ template void MatrixQuantizerGPU<double>::QuantizeAsync(const Matrix<double>&, c
 template class GPUDataTransferer<float>;
 template class GPUDataTransferer<double>;
 
-template <class ElemType>
-cublasHandle_t GPUMatrix<ElemType>::s_cuHandle[GPUMatrix<ElemType>::MaxGpus] = {0};
-
 template <class ElemType>
 void* GPUMatrix<ElemType>::s_curandGenerator = NULL;
 
@@ -2291,6 +2449,10 @@ bool CuDnnConvolutionEngineFactory<ElemType>::IsSupported(DEVICEID_TYPE, Convolv
 template class CuDnnConvolutionEngineFactory<float>;
 template class CuDnnConvolutionEngineFactory<double>;
 
+void SetCuDnnAlgorithmCacheOptions(const std::wstring&, size_t)
+{
+}
+
 template <class ElemType>
 std::unique_ptr<BatchNormEngine<ElemType>> CuDnnBatchNormEngineFactory<ElemType>::Create(DEVICEID_TYPE deviceId, const TensorShape& inOutT,
                                                                                          bool spatial, ImageLayoutKind imageLayout)
@@ -2318,6 +2480,44 @@ float CudaTimer::Elapsed()
 /*static*/ void SyncGuard::EnableSync()
 {
 }
+
+/*static*/ void TensorOpKernels::EnableFastPaths(bool enable)
+{
+}
+
+GPUGraph::GPUGraph(DEVICEID_TYPE deviceId)
+{
+    RuntimeError("The code is compiled with CPUONLY macro.");
+}
+GPUGraph::~GPUGraph()
+{
+}
+/*static*/ bool GPUGraph::IsSupported()
+{
+    return false;
+}
+/*static*/ GPUGraph* GPUGraph::GetCapturingGraph()
+{
+    return nullptr;
+}
+void GPUGraph::BeginCapture()
+{
+}
+bool GPUGraph::EndCapture()
+{
+    return false;
+}
+void GPUGraph::Launch()
+{
+}
+
+/*static*/ void TracingGPUMemoryAllocator::ReleaseCachedMemory(int deviceId)
+{
+}
+
+/*static*/ void TracingGPUMemoryAllocator::PrintCacheStatistics()
+{
+}
 } } }
 
 // define a dummy GPUWatcher class too
@@ -2333,6 +2533,26 @@ size_t GPUWatcher::GetFreeMemoryOnCUDADevice(int /*devId*/)
     return 0;
 }
 
+size_t GPUWatcher::GetUsedMemoryOnCUDADevice(int /*devId*/)
+{
+    return 0;
+}
+
+CudaEventTimeline::~CudaEventTimeline()
+{
+}
+
+size_t CudaEventTimeline::Record()
+{
+    return m_numRecorded++;
+}
+
+void CudaEventTimeline::Resolve(std::vector<float>& milliseconds)
+{
+    milliseconds.assign(m_numRecorded, 0);
+    m_numRecorded = 0;
+}
+
 GPUWatcher::GPUWatcher(void)
 {
 }
@@ -0,0 +1,68 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// PhiloxRNG.h -- counter-based random numbers, shared by the CPU and CUDA code
+//
+// Philox4x32-10 of J. Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3" (SC 2011): the random numbers
+// are a pure function of a 64-bit key and a 64-bit counter, so there is no generator state, any element of the
+// stream can be computed independently, and the same stream can be regenerated at any time (e.g. the dropout mask
+// in backprop, instead of storing it).
+
+#pragma once
+
+#include <stdint.h>
+
+#ifndef PHILOX_DECL // to make these accessible to CUDA kernels, say '#define PHILOX_DECL __device__ __host__'
+#define PHILOX_DECL
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// four 32-bit random words
+struct PhiloxBlock
+{
+    uint32_t w[4];
+};
+
+static inline PHILOX_DECL void PhiloxMulHiLo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo)
+{
+    uint64_t product = (uint64_t) a * b;
+    hi = (uint32_t) (product >> 32);
+    lo = (uint32_t) product;
+}
+
+// the four words of block 'counter' of the stream 'key'
+static inline PHILOX_DECL PhiloxBlock Philox4x32_10(uint64_t counter, uint64_t key)
+{
+    uint32_t c0 = (uint32_t) counter, c1 = (uint32_t) (counter >> 32), c2 = 0, c3 = 0;
+    uint32_t k0 = (uint32_t) key, k1 = (uint32_t) (key >> 32);
+    for (int round = 0; round < 10; round++)
+    {
+        uint32_t hi0, lo0, hi1, lo1;
+        PhiloxMulHiLo(0xD2511F53, c0, hi0, lo0);
+        PhiloxMulHiLo(0xCD9E8D57, c2, hi1, lo1);
+        c0 = hi1 ^ c1 ^ k0;
+        c1 = lo1;
+        c2 = hi0 ^ c3 ^ k1;
+        c3 = lo0;
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+    }
+    PhiloxBlock block = {{c0, c1, c2, c3}};
+    return block;
+}
+
+// maps a random word to a float uniformly distributed in (0,1), from its upper 24 bits
+static inline PHILOX_DECL float PhiloxToUniform(uint32_t word)
+{
+    return ((word >> 8) + 0.5f) * (1.0f / 16777216.0f);
+}
+
+// The key of the random stream of one use, e.g. of a dropout node in a minibatch.
+static inline PHILOX_DECL uint64_t PhiloxKey(uint32_t seed, uint32_t iteration)
+{
+    return ((uint64_t) iteration << 32) | seed;
+}
+
+}}}
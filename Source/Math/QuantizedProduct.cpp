@@ -0,0 +1,165 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "QuantizedProduct.h"
+#include "Quantizers.h"
+#include "BlockMultiplier.h"
+#include <climits>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// result (n x m, row major) = input (n x k, row major) * weights (k x m, row major), in integers
+class IntegerBlockProduct
+{
+public:
+    virtual ~IntegerBlockProduct() {}
+    virtual void Multiply(int16_t* input, int n, int32_t* result) = 0;
+};
+
+template <class BlockHandlerT>
+class IntegerBlockProductT : public IntegerBlockProduct
+{
+public:
+    // (with the current OpenMP thread count, so that the BlockMultiplier leaves it alone)
+    IntegerBlockProductT(int16_t* weights, int k, int m)
+        : m_multiplier(omp_get_max_threads()), m_k(k), m_m(m)
+    {
+        m_weights = m_multiplier.PrepareB(weights, k, m);
+    }
+
+    ~IntegerBlockProductT()
+    {
+        BlockMultiplier<BlockHandlerT>::FreeMatrix(m_weights);
+    }
+
+    virtual void Multiply(int16_t* input, int n, int32_t* result) override
+    {
+        m_multiplier.MultiplyMatrices(input, n, m_k, m_weights, m_m, result);
+    }
+
+private:
+    BlockMultiplier<BlockHandlerT> m_multiplier;
+    int16_t* m_weights; // in block order
+    int m_k;
+    int m_m;
+};
+
+static IntegerBlockProduct* CreateIntegerBlockProduct(int16_t* weights, int k, int m)
+{
+#ifdef SUPPORT_AVX512
+    if (BlockHandlerAVX512::IsSupported())
+        return new IntegerBlockProductT<BlockHandlerAVX512>(weights, k, m);
+#endif
+#ifdef SUPPORT_AVX2
+    if (BlockHandlerAVX::IsSupported())
+        return new IntegerBlockProductT<BlockHandlerAVX>(weights, k, m);
+#endif
+    return new IntegerBlockProductT<BlockHandlerSSE>(weights, k, m);
+}
+
+// Quantize 'values' to about 'numBits' bits and return the step size, or 0 if all values are 0.
+template <class ElemType>
+static ElemType QuantizeSymmetric(ElemType* values, size_t size, size_t numBits, int16_t* quantized)
+{
+    ElemType absMax = 0;
+    for (size_t i = 0; i < size; i++)
+        absMax = std::max(absMax, std::abs(values[i]));
+    if (absMax == 0)
+    {
+        std::fill(quantized, quantized + size, (int16_t) 0);
+        return 0;
+    }
+    SymmetricQuantizer<ElemType, short> quantizer(absMax, /*extraBits=*/16 - numBits);
+    ArrayRef<ElemType> input(values, size);
+    ArrayRef<short> output(quantized, size);
+    quantizer.Quantize(input, output);
+    return quantizer.GetStepSize();
+}
+
+template <class ElemType>
+QuantizedProduct<ElemType>::QuantizedProduct(const Matrix<ElemType>& weights, size_t numBits)
+    : m_numRows(weights.GetNumRows()), m_numCols(weights.GetNumCols())
+{
+    if (weights.GetDeviceId() != CPUDEVICE || weights.GetMatrixType() != DENSE)
+        InvalidArgument("QuantizedProduct: The weights must be a dense matrix on the CPU.");
+    if (numBits < 2 || numBits > 16)
+        InvalidArgument("QuantizedProduct: The number of bits must be between 2 and 16, not %d.", (int) numBits);
+    if (m_numRows == 0 || m_numCols == 0 || m_numRows * m_numCols > INT_MAX)
+        InvalidArgument("QuantizedProduct: Unsupported weight matrix dimensions [%d x %d].", (int) m_numRows, (int) m_numCols);
+
+    // A sum of k products of |a| <= 2^(na-1) and |w| <= 2^(nw-1) must fit into 31 bits, i.e. na + nw <= 32 - log2(k).
+    size_t log2NumCols = 0;
+    while (((size_t) 1 << log2NumCols) < m_numCols)
+        log2NumCols++;
+    size_t maxTotalBits = 32 - std::min(log2NumCols, (size_t) 32);
+    m_numBits = std::min(numBits, maxTotalBits / 2);
+    m_numInputBits = std::min(numBits, maxTotalBits - m_numBits);
+    if (m_numBits < 2)
+        InvalidArgument("QuantizedProduct: Products over %d elements are too long for 16-bit integer arithmetic.", (int) m_numCols);
+
+    // W (m x k, column major) is laid out like the k x m row-major right-hand side of the BlockMultiplier.
+    std::vector<int16_t> quantized(m_numRows * m_numCols);
+    std::vector<ElemType> row(m_numCols);
+    std::vector<int16_t> quantizedRow(m_numCols);
+    const ElemType* data = weights.Data();
+    m_rowStepSizes.resize(m_numRows);
+    for (size_t i = 0; i < m_numRows; i++)
+    {
+        for (size_t j = 0; j < m_numCols; j++)
+            row[j] = data[j * m_numRows + i];
+        m_rowStepSizes[i] = QuantizeSymmetric(row.data(), m_numCols, m_numBits, quantizedRow.data());
+        for (size_t j = 0; j < m_numCols; j++)
+            quantized[j * m_numRows + i] = quantizedRow[j];
+    }
+    m_product.reset(CreateIntegerBlockProduct(quantized.data(), (int) m_numCols, (int) m_numRows));
+}
+
+template <class ElemType>
+QuantizedProduct<ElemType>::~QuantizedProduct()
+{
+    // destroying a BlockMultiplier sets the OpenMP thread count to that outside of a parallel region (1)
+    int numThreads = omp_get_max_threads();
+    m_product.reset();
+    omp_set_num_threads(numThreads);
+}
+
+template <class ElemType>
+void QuantizedProduct<ElemType>::Multiply(const Matrix<ElemType>& input, Matrix<ElemType>& result) const
+{
+    if (input.GetDeviceId() != CPUDEVICE || input.GetMatrixType() != DENSE || result.GetDeviceId() != CPUDEVICE || result.GetMatrixType() != DENSE)
+        LogicError("QuantizedProduct: Only dense CPU matrices can be multiplied.");
+    size_t n = input.GetNumCols();
+    if (input.GetNumRows() != m_numCols || result.GetNumRows() != m_numRows || result.GetNumCols() != n)
+        LogicError("QuantizedProduct: Dimensions [%d x %d] * [%d x %d] -> [%d x %d] do not match.",
+                   (int) m_numRows, (int) m_numCols, (int) input.GetNumRows(), (int) n, (int) result.GetNumRows(), (int) result.GetNumCols());
+    if (n == 0)
+        return;
+
+    // X (k x n, column major) is laid out like the n x k row-major left-hand side, and so is the result.
+    int16_t* quantized = BlockMultiplier<BlockHandlerSSE>::CreateMatrixA((int) n, (int) m_numCols);
+    int32_t* sums = BlockMultiplier<BlockHandlerSSE>::CreateMatrixC((int) n, (int) m_numRows);
+    auto freeBuffers = MakeScopeExit([&]()
+    {
+        BlockMultiplier<BlockHandlerSSE>::FreeMatrix(quantized);
+        BlockMultiplier<BlockHandlerSSE>::FreeMatrix(sums);
+    });
+
+    std::vector<ElemType> columnStepSizes(n);
+    ElemType* inputData = input.Data();
+    for (size_t s = 0; s < n; s++)
+        columnStepSizes[s] = QuantizeSymmetric(inputData + s * m_numCols, m_numCols, m_numInputBits, quantized + s * m_numCols);
+
+    m_product->Multiply(quantized, (int) n, sums);
+
+    ElemType* resultData = result.Data();
+    for (size_t s = 0; s < n; s++)
+        for (size_t i = 0; i < m_numRows; i++)
+            resultData[s * m_numRows + i] = sums[s * m_numRows + i] * m_rowStepSizes[i] * columnStepSizes[s];
+}
+
+template class QuantizedProduct<float>;
+template class QuantizedProduct<double>;
+
+}}}
@@ -0,0 +1,56 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// QuantizedProduct.h -- matrix products in 16-bit integer arithmetic, for inference with quantized weights
+//
+#pragma once
+
+#include "Matrix.h"
+#include <memory>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+class IntegerBlockProduct; // (hides the BlockMultiplier and its intrinsics)
+
+// -----------------------------------------------------------------------
+// QuantizedProduct -- W * X with W quantized once and X quantized at every call
+//
+// The weights W (m x k) are quantized row by row, each row with its own scale, to about 'numBits' bits (sign
+// included, 2..16) of a short (see SymmetricQuantizer). Multiply() quantizes each column of X the same way,
+// multiplies through the BlockMultiplier with the widest block handler that this processor runs, and scales the
+// 32-bit sums back. To rule out overflow of the sums, W and X both get fewer bits if k is large.
+// The quantized weights are a snapshot: later changes of W are not seen. Dense CPU matrices only.
+// Multiply() may be called from several threads, which then take turns.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class MATH_API QuantizedProduct
+{
+public:
+    QuantizedProduct(const Matrix<ElemType>& weights, size_t numBits);
+    ~QuantizedProduct();
+
+    // result = W * input, where 'input' is k x n and 'result' must be m x n
+    void Multiply(const Matrix<ElemType>& input, Matrix<ElemType>& result) const;
+
+    size_t GetNumRows() const { return m_numRows; }
+    size_t GetNumCols() const { return m_numCols; }
+    // bits actually used for W and for the columns of X
+    size_t GetNumBits() const { return m_numBits; }
+    size_t GetNumInputBits() const { return m_numInputBits; }
+
+private:
+    QuantizedProduct(const QuantizedProduct&) = delete;
+    QuantizedProduct& operator=(const QuantizedProduct&) = delete;
+
+    size_t m_numRows;
+    size_t m_numCols;
+    size_t m_numBits;
+    size_t m_numInputBits;
+    std::vector<ElemType> m_rowStepSizes; // [i] value of one quantization step of row i of W
+    std::unique_ptr<IntegerBlockProduct> m_product;
+};
+
+}}}
@@ -4,6 +4,8 @@
 //
 #pragma once
 #include "Basics.h"
+#include <algorithm>
+#include <cmath>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -69,6 +71,12 @@ public:
         }
     }
 
+    // The raw value of one quantization step, i.e. the factor that Dequantize() applies.
+    RawType GetStepSize() const
+    {
+        return m_inverseQuantizerFactor;
+    }
+
     // Accept quantized collection as input, put de-quantization result into pre-allocated output collection.
     virtual void Dequantize(const ArrayRef<QuantizedType>& input, ArrayRef<RawType>& output)
     {
@@ -91,6 +91,13 @@ DECL ElemType SigmoidDerivative(ElemType z)
     return v * (1 - v);
 }
 
+template <class ElemType>
+DECL ElemType TanhDerivative(ElemType z)
+{
+    ElemType v = tanh_(z);
+    return 1 - v * v;
+}
+
 template <class ElemType>
 DECL ElemType LinearRectifierDerivative(ElemType z)
 {
@@ -245,6 +252,8 @@ DefBinaryOp(ElementwiseProductWithAbsDerivative, a * Sgn(b)); // note: b = input
 DefBinaryOp(ElementwiseProductWithReciprocalDerivative, a * -Sqr(b)); // b = output
 DefBinaryOp(ElementwiseProductWithSqrtDerivative, a / (2 * b)); // b = output; d/dx sqrt(x) = 1/(2 * sqrt(x)) --> note this is the same as ElementwiseQuotient w a constant; if more show up like this we should add more template params
 DefBinaryOp(SqrOfDifference, Sqr(a - b));
+DefBinaryOp(ElementwiseProductWithSigmoid, a * Sigmoid(b));
+DefBinaryOp(ElementwiseProductWithTanh, a * tanh_(b));
 //DefBinaryOp(Index, IndexElement(a, b, i));  // note: this one uses the third argument
 
 #pragma pop_macro("DefBinaryOp")
@@ -262,6 +271,9 @@ DefTernaryOp(CopyIfEqual, a == b ? c : 0); // CopyIfEqual(a,b)(c) -- if a==b cop
 DefTernaryOp(Clip, c < a ? a : (c > b ? b : c)); // Clip(min,max)(data) => a=min, b=max, c=data
 DefTernaryOp(ElementwiseProductWithLogSumDerivative, a * Sigmoid(c - b));
 DefTernaryOp(ElementwiseProductWithExpOfDiff, a * exp_(b - c));
+DefTernaryOp(ElementwiseProductPlus, a * b + c);
+DefTernaryOp(ElementwiseProductWithSigmoidDerivativeOfProduct, a * b * SigmoidDerivative(c)); // gradient of b * Sigmoid(c) w.r.t. c, for a = gradient
+DefTernaryOp(ElementwiseProductWithTanhDerivativeOfProduct, a * b * TanhDerivative(c));       // gradient of b * Tanh(c) w.r.t. c
 
 
 #pragma pop_macro("DefTernaryOp")
@@ -0,0 +1,62 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ValueCompression.h -- the encodings of Matrix<ElemType>::CompressValuesInto(), which keeps values in fewer bits while they are
+// not used, e.g. the values that Backprop() needs, from the end of ForwardProp() on (see ComputationNetwork::SetStashCompression())
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include "Half.h" // FloatToHalf(), HalfToFloat()
+
+#pragma push_macro("TENSOR_OPS_DECL")
+#ifndef TENSOR_OPS_DECL // to make these accessible to CUDA kernels, say '#define TENSOR_OPS_DECL __device__ __host__'
+#define TENSOR_OPS_DECL
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// ValueCompression -- how the values of a column are encoded
+//  sign: 1 bit per value, set if the value is > 0, the first value in the lowest bit of the first byte.
+//        Decompressed, the values are 1 or 0, which is all that e.g. the derivative of a ReLU needs of its output.
+//  half: IEEE half precision (see Half.h), rounded to nearest even. A relative error of at most 2^-11 for magnitudes in [6.1e-5, 65504];
+//        smaller ones keep fewer bits, larger ones become infinite.
+//  byte: 8 bits in the range of the column, value = minimum + code * step, with the minimum and the step as two floats
+//        in front of the codes. An error of at most (max - min) / 510 for finite values.
+// Each column takes CompressedColumnBytes() bytes, so that the columns are encoded independently.
+// -----------------------------------------------------------------------
+
+enum class ValueCompression : int
+{
+    sign,
+    half,
+    byte,
+};
+
+static inline size_t CompressedColumnBytes(ValueCompression compression, size_t numRows)
+{
+    switch (compression)
+    {
+    case ValueCompression::sign:
+        return (numRows + 7) / 8;
+    case ValueCompression::half:
+        return numRows * sizeof(uint16_t);
+    default: // (padded, to keep the floats of the next column aligned)
+        return 2 * sizeof(float) + (numRows + sizeof(float) - 1) / sizeof(float) * sizeof(float);
+    }
+}
+
+// 'scale' is 1 / step, or 0 for a column of equal values
+static inline TENSOR_OPS_DECL unsigned char FloatToByteCode(float value, float minimum, float scale)
+{
+    return (unsigned char) fminf(255.0f, fmaxf(0.0f, roundf((value - minimum) * scale)));
+}
+
+}}}
+
+#pragma pop_macro("TENSOR_OPS_DECL")
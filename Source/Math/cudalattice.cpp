@@ -129,7 +129,7 @@ private:
     }
 
     void forwardbackwardlattice(const size_t *batchsizeforward, const size_t *batchsizebackward,
-                                const size_t numlaunchforward, const size_t numlaunchbackward,
+                                const size_t numlaunchforward, const size_t numlaunchbackward, const sizetvector &batchsizes,
                                 const size_t spalignunitid, const size_t silalignunitid,
                                 const floatvector &edgeacscores, const edgeinfowithscoresvector &edges,
                                 const nodeinfovector &nodes, const aligninfovector &aligns,
@@ -142,6 +142,7 @@ private:
     {
         ondevice no(deviceid);
         latticefunctionsops::forwardbackwardlattice(batchsizeforward, batchsizebackward, numlaunchforward, numlaunchbackward,
+                                                    dynamic_cast<const vectorbaseimpl<sizetvector, vectorref<size_t>> &>(batchsizes),
                                                     spalignunitid, silalignunitid,
                                                     dynamic_cast<const vectorbaseimpl<floatvector, vectorref<float>> &>(edgeacscores),
                                                     dynamic_cast<const vectorbaseimpl<edgeinfowithscoresvector, vectorref<msra::lattices::edgeinfowithscores>> &>(edges),
@@ -88,7 +88,7 @@ struct latticefunctions : public vectorbase<msra::lattices::empty>
                                const uintvector& alignoffsets, ushortvector& backptrstorage, const sizetvector& backptroffsets,
                                ushortvector& alignresult, floatvector& edgeacscores) = 0; // output
     virtual void forwardbackwardlattice(const size_t* batchsizeforward, const size_t* batchsizebackward,
-                                        const size_t numlaunchforward, const size_t numlaunchbackward,
+                                        const size_t numlaunchforward, const size_t numlaunchbackward, const sizetvector& batchsizes,
                                         const size_t spalignunitid, const size_t silalignunitid,
                                         const floatvector& edgeacscores, const edgeinfowithscoresvector& edges,
                                         const nodeinfovector& nodes, const aligninfovector& aligns,
@@ -227,8 +227,69 @@ __global__ void backwardlatticej(const size_t batchsize, const size_t startindex
     }
 }
 
+// forwardbackwardlatticesingleblockj -- both passes of forwardlatticej() and backwardlatticej() in a single thread block
+// The lattices of short utterances have batches of a few edges each, for which one launch per batch costs more than
+// the batch itself. Here one block steps through all batches, forward then backward, with a __syncthreads() between
+// batches (which also makes the global writes of the batch visible to the block), so that the lattice takes one launch.
+// batchsizes[] has the sizes of the forward batches, followed by those of the backward batches.
+__global__ void forwardbackwardlatticesingleblockj(const vectorref<size_t> batchsizes, const size_t numlaunchforward, const size_t numlaunchbackward,
+                                                   const vectorref<float> edgeacscores, const size_t spalignunitid, const size_t silalignunitid,
+                                                   vectorref<msra::lattices::edgeinfowithscores> edges, vectorref<msra::lattices::nodeinfo> nodes,
+                                                   vectorref<msra::lattices::aligninfo> aligns, vectorref<unsigned short> alignments,
+                                                   vectorref<unsigned int> alignmentoffsets, vectorref<double> logpps,
+                                                   vectorref<double> logalphas, vectorref<double> logbetas,
+                                                   float lmf, float wp, float amf, const float boostingfactor,
+                                                   const vectorref<unsigned short> uids, const vectorref<unsigned short> senone2classmap,
+                                                   const bool returnEframescorrect, vectorref<double> logframescorrectedge,
+                                                   vectorref<double> logaccalphas, vectorref<double> logEframescorrect, vectorref<double> logaccbetas)
+{
+    const size_t tpb = blockDim.x * blockDim.y; // total #threads in a block
+    const size_t jinblock = threadIdx.x + threadIdx.y * blockDim.x;
+
+    // initialize log{,acc}(alhas/betas), with the initial tokens at probability 1 (0 in log)
+    for (size_t i = jinblock; i < logalphas.size(); i += tpb)
+    {
+        logalphas[i] = (i == 0) ? 0.0 : LOGZERO;
+        logbetas[i] = (i == nodes.size() - 1) ? 0.0 : LOGZERO;
+        if (returnEframescorrect)
+        {
+            logaccalphas[i] = LOGZERO;
+            logaccbetas[i] = LOGZERO;
+        }
+    }
+    __syncthreads();
+
+    // forward pass
+    size_t startindex = 0;
+    for (size_t i = 0; i < numlaunchforward; i++)
+    {
+        for (size_t j = jinblock; j < batchsizes[i]; j += tpb)
+            msra::lattices::latticefunctionskernels::forwardlatticej(j + startindex, edgeacscores, spalignunitid, silalignunitid, edges, nodes, aligns, alignments, alignmentoffsets,
+                                                                     logalphas, lmf, wp, amf, boostingfactor, uids, senone2classmap, returnEframescorrect, logframescorrectedge, logaccalphas);
+        startindex += batchsizes[i];
+        __syncthreads();
+    }
+    const double totalfwscore = logalphas[nodes.size() - 1];
+
+    // backward pass
+    startindex = edges.size();
+    for (size_t i = 0; i < numlaunchbackward; i++)
+    {
+        const size_t batchsize = batchsizes[numlaunchforward + i];
+        for (size_t j = jinblock; j < batchsize; j += tpb)
+            msra::lattices::latticefunctionskernels::backwardlatticej(j + startindex - batchsize, edgeacscores, spalignunitid, silalignunitid,
+                                                                      edges, nodes, aligns, totalfwscore, logpps, logalphas, logbetas,
+                                                                      lmf, wp, amf, boostingfactor, returnEframescorrect,
+                                                                      logframescorrectedge, logaccalphas,
+                                                                      logEframescorrect, logaccbetas);
+        startindex -= batchsize;
+        __syncthreads();
+    }
+}
+
 void latticefunctionsops::forwardbackwardlattice(const size_t *batchsizeforward, const size_t *batchsizebackward,
                                                  const size_t numlaunchforward, const size_t numlaunchbackward,
+                                                 const vectorref<size_t> &batchsizes,
                                                  const size_t spalignunitid, const size_t silalignunitid,
                                                  const vectorref<float> &edgeacscores,
                                                  const vectorref<msra::lattices::edgeinfowithscores> &edges,
@@ -244,40 +305,62 @@ void latticefunctionsops::forwardbackwardlattice(const size_t *batchsizeforward,
                                                  vectorref<double> &logEframescorrect, vectorref<double> & /*Eframescorrectbuf*/,
                                                  double &logEframescorrecttotal, double &totalfwscore) const
 {
-    // initialize log{,acc}(alhas/betas)
     dim3 t(32, 8);
     const size_t tpb = t.x * t.y;
-    dim3 b((unsigned int) ((logalphas.size() + tpb - 1) / tpb));
 
-    // TODO: is this really efficient? One thread per value?
-    setvaluej<<<b, t, 0, GetCurrentStream()>>>(logalphas, LOGZERO, logalphas.size());
-    checklaunch("setvaluej");
-    setvaluej<<<b, t, 0, GetCurrentStream()>>>(logbetas, LOGZERO, logalphas.size());
-    checklaunch("setvaluej");
-    if (returnEframescorrect)
+    // If no batch needs more than a few rounds of the threads of a block, a single launch does the whole lattice (see
+    // forwardbackwardlatticesingleblockj()); otherwise there is one launch per batch, over as many blocks as needed.
+    size_t maxbatchsize = 0;
+    for (size_t i = 0; i < numlaunchforward; i++)
+        maxbatchsize = (batchsizeforward[i] > maxbatchsize) ? batchsizeforward[i] : maxbatchsize;
+    for (size_t i = 0; i < numlaunchbackward; i++)
+        maxbatchsize = (batchsizebackward[i] > maxbatchsize) ? batchsizebackward[i] : maxbatchsize;
+    const bool singleblock = (maxbatchsize <= 4 * tpb) && (batchsizes.size() == numlaunchforward + numlaunchbackward);
+
+    if (singleblock)
     {
-        setvaluej<<<b, t, 0, GetCurrentStream()>>>(logaccalphas, LOGZERO, logalphas.size());
-        checklaunch("setvaluej");
-        setvaluej<<<b, t, 0, GetCurrentStream()>>>(logaccbetas, LOGZERO, logalphas.size());
-        checklaunch("setvaluej");
+        forwardbackwardlatticesingleblockj<<<1, t, 0, GetCurrentStream()>>>(batchsizes, numlaunchforward, numlaunchbackward, edgeacscores,
+                                                                            spalignunitid, silalignunitid, edges, nodes, aligns,
+                                                                            alignments, aligmentoffsets, logpps, logalphas, logbetas, lmf, wp, amf,
+                                                                            boostingfactor, uids, senone2classmap, returnEframescorrect,
+                                                                            logframescorrectedge, logaccalphas, logEframescorrect, logaccbetas);
+        checklaunch("forwardbackwardlatticesingleblockj");
     }
-    // set initial tokens to probability 1 (0 in log)
-    double log1 = 0.0;
-    memcpy(logalphas.get(), 0, &log1, 1);
-    memcpy(logbetas.get(), nodes.size() - 1, &log1, 1);
-
-    // forward pass
-    size_t startindex = 0;
-    for (size_t i = 0; i < numlaunchforward; i++)
+    else
     {
-        dim3 b((unsigned int) ((batchsizeforward[i] + tpb - 1) / tpb));
-        forwardlatticej<<<b, t, 0, GetCurrentStream()>>>(batchsizeforward[i], startindex, edgeacscores,
-                                                         spalignunitid, silalignunitid, edges, nodes, aligns,
-                                                         alignments, aligmentoffsets, logalphas, lmf, wp, amf,
-                                                         boostingfactor, uids, senone2classmap, returnEframescorrect,
-                                                         logframescorrectedge, logaccalphas);
-        checklaunch("edgealignment");
-        startindex += batchsizeforward[i];
+        // initialize log{,acc}(alhas/betas)
+        dim3 b((unsigned int) ((logalphas.size() + tpb - 1) / tpb));
+
+        // TODO: is this really efficient? One thread per value?
+        setvaluej<<<b, t, 0, GetCurrentStream()>>>(logalphas, LOGZERO, logalphas.size());
+        checklaunch("setvaluej");
+        setvaluej<<<b, t, 0, GetCurrentStream()>>>(logbetas, LOGZERO, logalphas.size());
+        checklaunch("setvaluej");
+        if (returnEframescorrect)
+        {
+            setvaluej<<<b, t, 0, GetCurrentStream()>>>(logaccalphas, LOGZERO, logalphas.size());
+            checklaunch("setvaluej");
+            setvaluej<<<b, t, 0, GetCurrentStream()>>>(logaccbetas, LOGZERO, logalphas.size());
+            checklaunch("setvaluej");
+        }
+        // set initial tokens to probability 1 (0 in log)
+        double log1 = 0.0;
+        memcpy(logalphas.get(), 0, &log1, 1);
+        memcpy(logbetas.get(), nodes.size() - 1, &log1, 1);
+
+        // forward pass
+        size_t startindex = 0;
+        for (size_t i = 0; i < numlaunchforward; i++)
+        {
+            dim3 b((unsigned int) ((batchsizeforward[i] + tpb - 1) / tpb));
+            forwardlatticej<<<b, t, 0, GetCurrentStream()>>>(batchsizeforward[i], startindex, edgeacscores,
+                                                             spalignunitid, silalignunitid, edges, nodes, aligns,
+                                                             alignments, aligmentoffsets, logalphas, lmf, wp, amf,
+                                                             boostingfactor, uids, senone2classmap, returnEframescorrect,
+                                                             logframescorrectedge, logaccalphas);
+            checklaunch("edgealignment");
+            startindex += batchsizeforward[i];
+        }
     }
     memcpy<double>(&totalfwscore, logalphas.get(), nodes.size() - 1, 1);
     double totalfwacc = 0;
@@ -288,17 +371,20 @@ void latticefunctionsops::forwardbackwardlattice(const size_t *batchsizeforward,
     }
 
     // backward pass
-    startindex = edges.size();
-    for (size_t i = 0; i < numlaunchbackward; i++)
+    if (!singleblock)
     {
-        dim3 b((unsigned int) ((batchsizebackward[i] + tpb - 1) / tpb));
-        backwardlatticej<<<b, t, 0, GetCurrentStream()>>>(batchsizebackward[i], startindex - batchsizebackward[i],
-                                                          edgeacscores, spalignunitid, silalignunitid, edges, nodes, aligns,
-                                                          totalfwscore, logpps, logalphas, logbetas,
-                                                          lmf, wp, amf, boostingfactor, returnEframescorrect, logframescorrectedge,
-                                                          logaccalphas, logEframescorrect, logaccbetas);
-        checklaunch("edgealignment");
-        startindex -= batchsizebackward[i];
+        size_t startindex = edges.size();
+        for (size_t i = 0; i < numlaunchbackward; i++)
+        {
+            dim3 b((unsigned int) ((batchsizebackward[i] + tpb - 1) / tpb));
+            backwardlatticej<<<b, t, 0, GetCurrentStream()>>>(batchsizebackward[i], startindex - batchsizebackward[i],
+                                                              edgeacscores, spalignunitid, silalignunitid, edges, nodes, aligns,
+                                                              totalfwscore, logpps, logalphas, logbetas,
+                                                              lmf, wp, amf, boostingfactor, returnEframescorrect, logframescorrectedge,
+                                                              logaccalphas, logEframescorrect, logaccbetas);
+            checklaunch("edgealignment");
+            startindex -= batchsizebackward[i];
+        }
     }
     double totalbwscore = 0;
     memcpy<double>(&totalbwscore, logbetas.get(), 0, 1);
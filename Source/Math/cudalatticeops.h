@@ -40,7 +40,7 @@ protected:
                        vectorref<unsigned short>& alignresult, vectorref<float>& edgeacscores) const; // output
 
     void forwardbackwardlattice(const size_t* batchsizeforward, const size_t* batchsizebackward,
-                                const size_t numlaunchforward, const size_t numlaunchbackward,
+                                const size_t numlaunchforward, const size_t numlaunchbackward, const vectorref<size_t>& batchsizes,
                                 const size_t spalignunitid, const size_t silalignunitid,
                                 const vectorref<float>& edgeacscores, const vectorref<msra::lattices::edgeinfowithscores>& edges,
                                 const vectorref<msra::lattices::nodeinfo>& nodes,
@@ -0,0 +1,301 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <algorithm>
+#include "BinaryChunkDeserializer.h"
+#include "BinarySequenceData.h"
+#include "ElementTypeUtils.h"
+#include "StringUtil.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+using namespace BinaryChunkFormat;
+
+class BinaryChunkDeserializer::BinaryChunk : public Chunk, public std::enable_shared_from_this<BinaryChunk>
+{
+public:
+    BinaryChunk(const BinaryChunkDeserializer& parent, const ChunkHeader& header)
+        : m_parent(parent), m_header(header), m_file(parent.m_file)
+    {
+        const char* stored = m_file->Data() + header.m_offset;
+        if ((Compression)header.m_compression == Compression::none)
+        {
+            // Straight from the mapping, which is paged in right away as the chunk is about to be used.
+            m_data = stored;
+            m_file->Advise(header.m_offset, header.m_size, MemoryMappedFile::Access::WillNeed);
+        }
+        else
+        {
+            m_buffer.resize(header.m_size);
+            Decompress((Compression)header.m_compression, stored, header.m_storedSize, m_buffer.data(), m_buffer.size());
+            m_data = m_buffer.data();
+        }
+    }
+
+    void GetSequence(size_t sequenceId, std::vector<SequenceDataPtr>& result) override
+    {
+        if (sequenceId < m_header.m_firstSequence || sequenceId - m_header.m_firstSequence >= m_header.m_numberOfSequences)
+            LogicError("BinaryChunkDeserializer: Sequence %" PRIu64 " does not belong to the chunk.", (uint64_t)sequenceId);
+
+        const size_t numberOfStoredStreams = m_parent.m_storedStreams.size();
+        const SequenceStreamHeader* headers = reinterpret_cast<const SequenceStreamHeader*>(m_data) +
+                                              (sequenceId - m_header.m_firstSequence) * numberOfStoredStreams;
+        for (size_t index : m_parent.m_streamIndices)
+        {
+            const Stream& stream = m_parent.m_storedStreams[index];
+            const SequenceStreamHeader& header = headers[index];
+            const size_t elementSize = GetSizeByType(stream.m_elementType);
+
+            // Sequences reference the data of their chunk, which they keep alive.
+            SequenceDataPtr sequence = CreateSequenceView(m_data, m_header.m_size, stream.m_storageType, stream.m_sampleLayout->GetNumElements(), elementSize,
+                                                          header.m_dataOffset, header.m_numberOfSamples, header.m_nnzCount);
+            if (!sequence)
+                RuntimeError("BinaryChunkDeserializer: Sequence data beyond the end of its chunk, the file '%ls' is corrupt.", m_file->Path().c_str());
+
+            sequence->m_id = sequenceId;
+            sequence->m_elementType = stream.m_elementType;
+            sequence->m_sampleLayout = stream.m_sampleLayout;
+            sequence->m_chunk = shared_from_this();
+            result.push_back(sequence);
+        }
+    }
+
+    size_t GetMemorySize() const override
+    {
+        // The pages of mapped chunks are accounted for as well, they are not freed either while the chunk is in use.
+        return m_header.m_size;
+    }
+
+private:
+    const BinaryChunkDeserializer& m_parent;
+    const ChunkHeader m_header;
+    // Keeps the mapping alive for as long as sequences of the chunk are.
+    std::shared_ptr<MemoryMappedFile> m_file;
+    std::vector<char> m_buffer;
+    const char* m_data;
+};
+
+BinaryChunkDeserializer::BinaryChunkDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& config)
+    : m_chunks(nullptr), m_sequences(nullptr)
+{
+    if (!config.ExistsCurrent(L"input"))
+        InvalidArgument("BinaryChunkDeserializer configuration does not contain \"input\" section.");
+
+    std::vector<std::pair<std::wstring, std::string>> selection;
+    const ConfigParameters& input = config(L"input");
+    for (const std::pair<std::string, ConfigParameters>& section : input)
+    {
+        // The stored name is optional.
+        std::string stored = section.first;
+        if (section.second.ExistsCurrent(L"stream"))
+            stored = (std::string)section.second(L"stream");
+        selection.push_back(std::make_pair(msra::strfun::utf16(section.first), stored));
+    }
+    if (selection.empty())
+        InvalidArgument("BinaryChunkDeserializer configuration contains an empty \"input\" section.");
+
+    std::wstring path = config(L"file");
+    Open(corpus, path, selection);
+
+    std::string precision = config.Find("precision", "float");
+    ElementType elementType = AreEqualIgnoreCase(precision, "double") ? ElementType::tdouble : ElementType::tfloat;
+    for (const auto& stream : m_streams)
+    {
+        if (stream->m_elementType != elementType)
+            InvalidArgument("BinaryChunkDeserializer: Stream '%ls' was written with a precision other than '%s'.", stream->m_name.c_str(), precision.c_str());
+    }
+
+    bool frameMode = config(L"frameMode", false);
+    for (uint64_t i = 0; frameMode && i < m_header.m_numberOfSequences; ++i)
+    {
+        if (m_sequences[i].m_numberOfSamples > 1)
+            InvalidArgument("BinaryChunkDeserializer: frameMode requires sequences of a single sample, the file has longer ones.");
+    }
+}
+
+BinaryChunkDeserializer::BinaryChunkDeserializer(CorpusDescriptorPtr corpus, const std::wstring& path)
+    : m_chunks(nullptr), m_sequences(nullptr)
+{
+    Open(corpus, path, std::vector<std::pair<std::wstring, std::string>>());
+}
+
+void BinaryChunkDeserializer::Open(CorpusDescriptorPtr corpus, const std::wstring& path, const std::vector<std::pair<std::wstring, std::string>>& selection)
+{
+    m_file = std::make_shared<MemoryMappedFile>(path);
+    if (m_file->Size() < sizeof(FileHeader))
+        RuntimeError("BinaryChunkDeserializer: '%ls' is not a binary chunk file.", path.c_str());
+    memcpy(&m_header, m_file->Data(), sizeof(m_header));
+    if (m_header.m_magic != c_magic)
+        RuntimeError("BinaryChunkDeserializer: '%ls' is not a binary chunk file.", path.c_str());
+    if (m_header.m_version != c_version)
+        RuntimeError("BinaryChunkDeserializer: '%ls' has version %u of the format, this build reads version %u.", path.c_str(), m_header.m_version, c_version);
+    if (m_header.m_indexOffset > m_file->Size() || m_header.m_indexSize > m_file->Size() - m_header.m_indexOffset)
+        RuntimeError("BinaryChunkDeserializer: The index of '%ls' is beyond the end of the file, the file is truncated.", path.c_str());
+
+    ReadIndex(corpus);
+
+    if (selection.empty())
+    {
+        for (size_t i = 0; i < m_storedStreams.size(); ++i)
+            m_streamIndices.push_back(i);
+    }
+    for (const auto& s : selection)
+    {
+        auto stored = std::find_if(m_storedStreams.begin(), m_storedStreams.end(), [&s](const Stream& stream) { return stream.m_name == s.second; });
+        if (stored == m_storedStreams.end())
+            InvalidArgument("BinaryChunkDeserializer: '%ls' has no stream '%s'.", path.c_str(), s.second.c_str());
+        m_streamIndices.push_back(stored - m_storedStreams.begin());
+    }
+
+    for (size_t i = 0; i < m_streamIndices.size(); ++i)
+    {
+        const Stream& stored = m_storedStreams[m_streamIndices[i]];
+        auto stream = std::make_shared<StreamDescription>();
+        stream->m_id = i;
+        stream->m_name = selection.empty() ? msra::strfun::utf16(stored.m_name) : selection[i].first;
+        stream->m_storageType = stored.m_storageType;
+        stream->m_elementType = stored.m_elementType;
+        stream->m_sampleLayout = stored.m_sampleLayout;
+        m_streams.push_back(stream);
+    }
+
+    for (uint64_t i = 0; i < m_header.m_numberOfChunks; ++i)
+    {
+        auto chunk = std::make_shared<ChunkDescription>();
+        chunk->m_id = (ChunkIdType)i;
+        chunk->m_numberOfSamples = m_chunks[i].m_numberOfSamples;
+        chunk->m_numberOfSequences = m_chunks[i].m_numberOfSequences;
+        m_chunkDescriptions.push_back(chunk);
+    }
+}
+
+void BinaryChunkDeserializer::ReadIndex(CorpusDescriptorPtr corpus)
+{
+    const std::wstring& path = m_file->Path();
+    const char* index = m_file->Data() + m_header.m_indexOffset;
+    const char* end = index + m_header.m_indexSize;
+    auto take = [&](size_t size) -> const char*
+    {
+        if ((size_t)(end - index) < size)
+            RuntimeError("BinaryChunkDeserializer: The index of '%ls' is truncated.", path.c_str());
+        const char* result = index;
+        index += size;
+        return result;
+    };
+
+    for (uint32_t i = 0; i < m_header.m_numberOfStreams; ++i)
+    {
+        StreamHeader header;
+        memcpy(&header, take(sizeof(header)), sizeof(header));
+        Stream stream;
+        stream.m_name.assign(take(header.m_nameLength), header.m_nameLength);
+        take(AlignUp(header.m_nameLength, sizeof(uint64_t)) - header.m_nameLength);
+        stream.m_storageType = (StorageType)header.m_storageType;
+        stream.m_elementType = (ElementType)header.m_elementType;
+        if (stream.m_storageType != StorageType::dense && stream.m_storageType != StorageType::sparse_csc)
+            RuntimeError("BinaryChunkDeserializer: Stream '%s' of '%ls' has an unknown storage type.", stream.m_name.c_str(), path.c_str());
+        if (stream.m_elementType != ElementType::tfloat && stream.m_elementType != ElementType::tdouble)
+            RuntimeError("BinaryChunkDeserializer: Stream '%s' of '%ls' has an unknown element type.", stream.m_name.c_str(), path.c_str());
+
+        const char* dimensions = take(header.m_rank * sizeof(uint64_t));
+        SmallVector<size_t> shape;
+        for (uint32_t j = 0; j < header.m_rank; ++j)
+        {
+            uint64_t dimension;
+            memcpy(&dimension, dimensions + j * sizeof(uint64_t), sizeof(dimension));
+            shape.push_back((size_t)dimension);
+        }
+        stream.m_sampleLayout = std::make_shared<TensorShape>(shape);
+        m_storedStreams.push_back(stream);
+    }
+
+    m_chunks = reinterpret_cast<const ChunkHeader*>(take(m_header.m_numberOfChunks * sizeof(ChunkHeader)));
+    m_sequences = reinterpret_cast<const SequenceHeader*>(take(m_header.m_numberOfSequences * sizeof(SequenceHeader)));
+    const char* keys = index;
+
+    uint64_t nextSequence = 0;
+    for (uint64_t i = 0; i < m_header.m_numberOfChunks; ++i)
+    {
+        const ChunkHeader& chunk = m_chunks[i];
+        // Uncompressed chunks are used straight from the mapping, so their size is bounded by the file as well.
+        if (chunk.m_offset > m_header.m_indexOffset || chunk.m_storedSize > m_header.m_indexOffset - chunk.m_offset ||
+            ((Compression)chunk.m_compression == Compression::none && chunk.m_size != chunk.m_storedSize) ||
+            chunk.m_firstSequence != nextSequence || chunk.m_size < (uint64_t)chunk.m_numberOfSequences * m_storedStreams.size() * sizeof(SequenceStreamHeader))
+            RuntimeError("BinaryChunkDeserializer: Chunk %" PRIu64 " of '%ls' is corrupt.", i, path.c_str());
+        if (!IsCompressionSupported((Compression)chunk.m_compression))
+            RuntimeError("BinaryChunkDeserializer: Chunk %" PRIu64 " of '%ls' uses compression %u, which is not supported by this build.", i, path.c_str(), chunk.m_compression);
+        nextSequence += chunk.m_numberOfSequences;
+    }
+    if (nextSequence != m_header.m_numberOfSequences)
+        RuntimeError("BinaryChunkDeserializer: The chunks of '%ls' do not cover all sequences.", path.c_str());
+
+    // The keys are registered with the corpus the same way other deserializers do, so that the file can be bundled with them.
+    auto& stringRegistry = corpus->GetStringRegistry();
+    m_sequenceKeys.reserve(m_header.m_numberOfSequences);
+    for (uint64_t i = 0; i < m_header.m_numberOfSequences; ++i)
+    {
+        const SequenceHeader& sequence = m_sequences[i];
+        if (sequence.m_keyOffset > (uint64_t)(end - keys) || sequence.m_keyLength > (uint64_t)(end - keys) - sequence.m_keyOffset)
+            RuntimeError("BinaryChunkDeserializer: The key of sequence %" PRIu64 " of '%ls' is beyond the end of the index.", i, path.c_str());
+
+        size_t key = stringRegistry[std::string(keys + sequence.m_keyOffset, sequence.m_keyLength)];
+        m_sequenceKeys.push_back(key);
+        m_keyToSequence[key] = (size_t)i;
+    }
+}
+
+ChunkDescriptions BinaryChunkDeserializer::GetChunkDescriptions()
+{
+    return m_chunkDescriptions;
+}
+
+void BinaryChunkDeserializer::GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& descriptions)
+{
+    if (chunkId >= m_header.m_numberOfChunks)
+        LogicError("BinaryChunkDeserializer: Chunk %u does not exist.", (unsigned int)chunkId);
+
+    const ChunkHeader& chunk = m_chunks[chunkId];
+    descriptions.reserve(descriptions.size() + chunk.m_numberOfSequences);
+    for (size_t i = chunk.m_firstSequence; i < chunk.m_firstSequence + chunk.m_numberOfSequences; ++i)
+    {
+        SequenceDescription description;
+        description.m_id = i;
+        description.m_numberOfSamples = m_sequences[i].m_numberOfSamples;
+        description.m_chunkId = chunkId;
+        description.m_key.m_sequence = m_sequenceKeys[i];
+        description.m_key.m_sample = 0;
+        descriptions.push_back(description);
+    }
+}
+
+bool BinaryChunkDeserializer::GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& description)
+{
+    auto sequence = m_keyToSequence.find(key.m_sequence);
+    if (sequence == m_keyToSequence.end())
+        return false;
+
+    // The chunk is the last one starting at or before the sequence.
+    size_t i = sequence->second;
+    const ChunkHeader* chunk = std::upper_bound(m_chunks, m_chunks + m_header.m_numberOfChunks, (uint64_t)i,
+                                                [](uint64_t s, const ChunkHeader& c) { return s < c.m_firstSequence; }) - 1;
+    description.m_id = i;
+    description.m_numberOfSamples = m_sequences[i].m_numberOfSamples;
+    description.m_chunkId = (ChunkIdType)(chunk - m_chunks);
+    description.m_key.m_sequence = key.m_sequence;
+    description.m_key.m_sample = 0;
+    return true;
+}
+
+ChunkPtr BinaryChunkDeserializer::GetChunk(ChunkIdType chunkId)
+{
+    if (chunkId >= m_header.m_numberOfChunks)
+        LogicError("BinaryChunkDeserializer: Chunk %u does not exist.", (unsigned int)chunkId);
+    return std::make_shared<BinaryChunk>(*this, m_chunks[chunkId]);
+}
+
+}}}
@@ -0,0 +1,81 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <unordered_map>
+#include "DataDeserializerBase.h"
+#include "Config.h"
+#include "CorpusDescriptor.h"
+#include "MemoryMappedFile.h"
+#include "BinaryChunkFormat.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Deserializer of files in the binary chunk format (see BinaryChunkFormat.h), as written by the convertToBinaryChunks action.
+// The file is memory mapped and the data of the streams is already laid out the way the sequences expose it,
+// so uncompressed chunks are handed to the packers straight from the mapped pages, without any parsing or copying.
+// Compressed chunks are decompressed into memory of the chunk when it is loaded.
+class BinaryChunkDeserializer : public DataDeserializerBase
+{
+public:
+    // Config:
+    //     file = "data.bin"
+    //     input = [
+    //         features = [ stream = "features" ]  # the name of the stored stream, defaults to the name of the section
+    //         labels = [ ]
+    //     ]
+    BinaryChunkDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& config);
+
+    // Exposes all streams of the file under their stored names.
+    BinaryChunkDeserializer(CorpusDescriptorPtr corpus, const std::wstring& path);
+
+    ChunkDescriptions GetChunkDescriptions() override;
+    void GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& descriptions) override;
+    ChunkPtr GetChunk(ChunkIdType chunkId) override;
+
+    // The chunks are read straight from the mapped file.
+    bool SupportsConcurrentGetChunk() const override
+    {
+        return true;
+    }
+
+protected:
+    bool GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& description) override;
+
+private:
+    class BinaryChunk;
+
+    struct Stream
+    {
+        std::string m_name;
+        StorageType m_storageType;
+        ElementType m_elementType;
+        TensorShapePtr m_sampleLayout;
+    };
+
+    // Maps the file and reads its index. An empty selection exposes all streams.
+    void Open(CorpusDescriptorPtr corpus, const std::wstring& path, const std::vector<std::pair<std::wstring, std::string>>& selection);
+    void ReadIndex(CorpusDescriptorPtr corpus);
+
+    std::shared_ptr<MemoryMappedFile> m_file;
+    BinaryChunkFormat::FileHeader m_header;
+
+    // Stored streams, and the stored stream of each exposed stream.
+    std::vector<Stream> m_storedStreams;
+    std::vector<size_t> m_streamIndices;
+
+    // Point into the mapped file.
+    const BinaryChunkFormat::ChunkHeader* m_chunks;
+    const BinaryChunkFormat::SequenceHeader* m_sequences;
+
+    // Key of each sequence in the string registry of the corpus, and the way back.
+    std::vector<size_t> m_sequenceKeys;
+    std::unordered_map<size_t, size_t> m_keyToSequence;
+
+    ChunkDescriptions m_chunkDescriptions;
+};
+
+}}}
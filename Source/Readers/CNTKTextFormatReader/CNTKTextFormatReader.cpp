@@ -11,6 +11,7 @@
 #include "BlockRandomizer.h"
 #include "NoRandomizer.h"
 #include "TextParser.h"
+#include "TextStreamingEnumerator.h"
 #include "SequencePacker.h"
 #include "FramePacker.h"
 
@@ -27,24 +28,38 @@ CNTKTextFormatReader::CNTKTextFormatReader(const ConfigParameters& config)
 
     try
     {
-        if (configHelper.GetElementType() == ElementType::tfloat)
-            m_deserializer = make_shared<TextParser<float>>(configHelper);
-        else
-            m_deserializer = make_shared<TextParser<double>>(configHelper);
-
-        if (configHelper.ShouldKeepDataInMemory())
-            m_deserializer = make_shared<ChunkCache>(m_deserializer);
-
-        size_t window = configHelper.GetRandomizationWindow();
-        if (window > 0)
+        if (configHelper.IsStreaming())
         {
-            // Verbosity is a general config parameter, not specific to the text format reader.
-            int verbosity = config(L"verbosity", 0);
-            m_sequenceEnumerator = make_shared<BlockRandomizer>(verbosity, window, m_deserializer, true);
+            // The enumerator reads and parses the input itself, without an index or a deserializer.
+            if (configHelper.GetElementType() == ElementType::tfloat)
+                m_sequenceEnumerator = make_shared<TextStreamingEnumerator<float>>(configHelper);
+            else
+                m_sequenceEnumerator = make_shared<TextStreamingEnumerator<double>>(configHelper);
         }
         else
         {
-            m_sequenceEnumerator = make_shared<NoRandomizer>(m_deserializer);
+            if (configHelper.GetElementType() == ElementType::tfloat)
+                m_deserializer = make_shared<TextParser<float>>(configHelper);
+            else
+                m_deserializer = make_shared<TextParser<double>>(configHelper);
+
+            if (configHelper.ShouldKeepDataInMemory())
+                m_deserializer = make_shared<ChunkCache>(m_deserializer, configHelper.GetMaxCacheSize(), configHelper.GetTraceLevel());
+
+            size_t window = configHelper.GetRandomizationWindow();
+            if (window > 0)
+            {
+                // Verbosity is a general config parameter, not specific to the text format reader.
+                int verbosity = config(L"verbosity", 0);
+                // So is the number of chunks read ahead of the randomization window.
+                size_t prefetchDepth = config(L"prefetchDepth", (size_t)1);
+                m_sequenceEnumerator = make_shared<BlockRandomizer>(verbosity, window, m_deserializer, true,
+                    BlockRandomizer::DecimationMode::chunk, false, false, prefetchDepth);
+            }
+            else
+            {
+                m_sequenceEnumerator = make_shared<NoRandomizer>(m_deserializer);
+            }
         }
 
         if (configHelper.IsInFrameMode()) 
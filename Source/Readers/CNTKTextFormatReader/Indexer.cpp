@@ -6,15 +6,49 @@
 #include "stdafx.h"
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <omp.h>
 #include "Indexer.h"
+#include "CacheFile.h"
+#include "MemoryMappedFile.h"
 #include "TextReaderConstants.h"
+#include "fileutil.h"
 
 using std::string;
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// The index cache file is a header followed by an entry for every sequence in the input file.
+// Its sequences are not filtered by the corpus descriptor, and not grouped into chunks: both are redone
+// when the cache is loaded, so that it can be shared by configurations that only differ in these respects.
+struct Indexer::CacheHeader
+{
+    uint64_t m_magic;
+    uint32_t m_version;
+    uint32_t m_skipSequenceIds;  // the setting the index was built with
+    uint32_t m_hasSequenceIds;   // the value of HasSequenceIds() after the index was built
+    uint32_t m_reserved;
+    uint64_t m_inputFileSize;    // size and modification time of the input file the index was built from
+    uint64_t m_inputFileTime;
+    uint64_t m_numberOfSequences;
+};
+
+struct Indexer::CacheEntry
+{
+    uint64_t m_key;              // the numeric sequence id (or the line number) in the input file
+    int64_t m_fileOffsetBytes;
+    uint64_t m_byteSize;
+    uint64_t m_numberOfSamples;
+};
+
+static const uint64_t s_cacheMagic = 0x5844494654434e43ULL; // "CNCTFIDX"
+static const uint32_t s_cacheVersion = 1;
+
+// Smallest byte range BuildInParallel() gives a thread.
+static const size_t s_minRangeSize = 1024 * 1024;
+
 Indexer::Indexer(FILE* file, bool skipSequenceIds, size_t chunkSize) :
     m_file(file),
+    m_mappedFile(nullptr),
     m_fileOffsetStart(0),
     m_fileOffsetEnd(0),
     m_buffer(new char[BUFFER_SIZE + 1]),
@@ -22,8 +56,10 @@ Indexer::Indexer(FILE* file, bool skipSequenceIds, size_t chunkSize) :
     m_bufferEnd(nullptr),
     m_pos(nullptr),
     m_done(false),
+    m_numThreads(1),
     m_hasSequenceIds(!skipSequenceIds),
-    m_index(chunkSize)
+    m_index(chunkSize),
+    m_cacheFile(nullptr)
 {
     if (m_file == nullptr)
     {
@@ -33,7 +69,24 @@ Indexer::Indexer(FILE* file, bool skipSequenceIds, size_t chunkSize) :
 
 void Indexer::RefillBuffer()
 {
-    if (!m_done)
+    if (!m_done && m_mappedFile)
+    {
+        // the whole file is available at once, so there is a single "refill"
+        if (m_fileOffsetEnd != 0 || m_mappedFile->Size() == 0)
+        {
+            m_done = true;
+            return;
+        }
+
+        m_fileOffsetStart = 0;
+        m_fileOffsetEnd = m_mappedFile->Size();
+        m_bufferStart = m_mappedFile->Data();
+        m_pos = m_bufferStart;
+        m_bufferEnd = m_bufferStart + m_mappedFile->Size();
+        // the index is built in one front to back pass
+        m_mappedFile->Advise(0, m_mappedFile->Size(), MemoryMappedFile::Access::Sequential);
+    }
+    else if (!m_done)
     {
         size_t bytesRead = fread(m_buffer.get(), 1, BUFFER_SIZE, m_file);
         if (bytesRead == (size_t)-1)
@@ -91,6 +144,104 @@ void Indexer::BuildFromLines(CorpusDescriptorPtr corpus)
     }
 }
 
+void Indexer::EnableCache(const std::wstring& filePath)
+{
+    m_filePath = filePath;
+}
+
+Indexer::CacheHeader Indexer::GetExpectedCacheHeader() const
+{
+    CacheHeader header = {};
+    header.m_magic = s_cacheMagic;
+    header.m_version = s_cacheVersion;
+    header.m_skipSequenceIds = !m_hasSequenceIds;
+    header.m_inputFileSize = filesize(m_file);
+    header.m_inputFileTime = GetModificationTime(m_filePath);
+    return header;
+}
+
+bool Indexer::TryLoadCache(CorpusDescriptorPtr corpus, const CacheHeader& expected)
+{
+    const auto cacheFilePath = GetCacheFilePath(m_filePath);
+    if (!fexists(cacheFilePath))
+    {
+        return false;
+    }
+
+    unique_ptr<MemoryMappedFile> cache;
+    try
+    {
+        cache = make_unique<MemoryMappedFile>(cacheFilePath);
+    }
+    catch (const std::exception&)
+    {
+        return false; // e.g. replaced by another process in the meantime
+    }
+
+    CacheHeader header;
+    if (cache->Size() < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, cache->Data(), sizeof(header));
+
+    if (header.m_magic != expected.m_magic || header.m_version != expected.m_version ||
+        header.m_skipSequenceIds != expected.m_skipSequenceIds ||
+        header.m_inputFileSize != expected.m_inputFileSize || header.m_inputFileTime != expected.m_inputFileTime ||
+        cache->Size() != sizeof(header) + header.m_numberOfSequences * sizeof(CacheEntry))
+    {
+        // outdated, or written by a process that did not finish
+        return false;
+    }
+
+    m_index.Reserve(header.m_inputFileSize);
+    m_hasSequenceIds = header.m_hasSequenceIds != 0;
+
+    const char* entries = cache->Data() + sizeof(header);
+    for (uint64_t i = 0; i < header.m_numberOfSequences; ++i)
+    {
+        CacheEntry entry;
+        memcpy(&entry, entries + i * sizeof(entry), sizeof(entry));
+
+        SequenceDescriptor sd = {};
+        sd.m_fileOffsetBytes = entry.m_fileOffsetBytes;
+        sd.m_byteSize = entry.m_byteSize;
+        sd.m_numberOfSamples = entry.m_numberOfSamples;
+        AddSequenceIfIncluded(corpus, entry.m_key, sd);
+    }
+
+    // leave the input file in the state reading it would have left it in
+    if (_fseeki64(m_file, 0, SEEK_END) != 0)
+    {
+        RuntimeError("Could not seek to the end of the input file (%ls).", m_filePath.c_str());
+    }
+    return true;
+}
+
+void Indexer::BuildAndWriteCache(CorpusDescriptorPtr corpus, const CacheHeader& header)
+{
+    WriteCacheAtomically(GetCacheFilePath(m_filePath), L"index", [&](FILE* file)
+    {
+        // the entries are written by AddSequenceIfIncluded() while the index is built
+        m_cacheFile = file;
+        auto reset = MakeScopeExit([&]() { m_cacheFile = nullptr; });
+
+        // the header is rewritten with the number of sequences at the end
+        CacheHeader completeHeader = header;
+        fwriteOrDie(&completeHeader, sizeof(completeHeader), 1, file);
+
+        BuildFromFile(corpus);
+
+        completeHeader.m_hasSequenceIds = m_hasSequenceIds;
+        completeHeader.m_numberOfSequences = (_ftelli64(file) - sizeof(completeHeader)) / sizeof(CacheEntry);
+        if (_fseeki64(file, 0, SEEK_SET) != 0)
+        {
+            RuntimeError("Could not rewind the index cache file of the input file (%ls).", m_filePath.c_str());
+        }
+        fwriteOrDie(&completeHeader, sizeof(completeHeader), 1, file);
+    });
+}
+
 void Indexer::Build(CorpusDescriptorPtr corpus)
 {
     if (!m_index.IsEmpty())
@@ -98,6 +249,21 @@ void Indexer::Build(CorpusDescriptorPtr corpus)
         return;
     }
 
+    if (m_filePath.empty())
+    {
+        BuildFromFile(corpus);
+        return;
+    }
+
+    const auto expected = GetExpectedCacheHeader();
+    LoadOrBuildCache(GetCacheFilePath(m_filePath), L"index",
+        [&]() { return TryLoadCache(corpus, expected); },
+        [&]() { BuildAndWriteCache(corpus, expected); },
+        [&]() { BuildFromFile(corpus); });
+}
+
+void Indexer::BuildFromFile(CorpusDescriptorPtr corpus)
+{
     m_index.Reserve(filesize(m_file));
 
     RefillBuffer(); // read the first block of data
@@ -116,7 +282,23 @@ void Indexer::Build(CorpusDescriptorPtr corpus)
     }
 
     // check the first byte and decide what to do next
-    if (!m_hasSequenceIds || m_bufferStart[0] == NAME_PREFIX)
+    if (m_bufferStart[0] == NAME_PREFIX)
+    {
+        m_hasSequenceIds = false;
+    }
+
+    if (m_mappedFile)
+    {
+        const size_t numThreads = (m_numThreads == 0) ? omp_get_max_threads() : m_numThreads;
+        const size_t numberOfRanges = std::min(numThreads, (size_t)(m_bufferEnd - m_pos) / s_minRangeSize);
+        if (numberOfRanges > 1)
+        {
+            BuildInParallel(corpus, numberOfRanges);
+            return;
+        }
+    }
+
+    if (!m_hasSequenceIds)
     {
         // skip sequence id parsing, treat lines as individual sequences
         BuildFromLines(corpus);
@@ -158,8 +340,165 @@ void Indexer::Build(CorpusDescriptorPtr corpus)
     AddSequenceIfIncluded(corpus, currentKey, sd);
 }
 
+// The lines starting in a byte range of the input, as found by ScanRange(). With sequence ids, a line starts
+// a new sequence when its id differs from the id of the sequence before it in the range; whether the first
+// of them continues the sequence of the previous range is only known once the ranges are merged.
+struct RangeIndex
+{
+    struct Sequence
+    {
+        int64_t m_fileOffsetBytes;
+        size_t m_key;
+        size_t m_numberOfSamples;
+    };
+
+    size_t m_leadingSamples; // lines before the first sequence of the range, belonging to the sequence before it
+    std::vector<Sequence> m_sequences; // without sequence ids, one per line
+};
+
+// Scans the lines of the input [begin, end) that start in [rangeBegin, rangeEnd), 'fileOffset' is the offset of 'begin'.
+// Resynchronizes at the first line start of the range, which is where the scan of the previous range stops.
+static void ScanRange(const char* begin, const char* end, const char* rangeBegin, const char* rangeEnd,
+                      int64_t fileOffset, bool hasSequenceIds, RangeIndex& range)
+{
+    range.m_leadingSamples = 0;
+    const char* line = rangeBegin;
+    if (line != begin && line[-1] != ROW_DELIMITER)
+    {
+        line = (const char*)memchr(line, ROW_DELIMITER, end - line);
+        line = line ? line + 1 : end;
+    }
+
+    size_t currentKey = 0;
+    while (line < rangeEnd)
+    {
+        const char* next = (const char*)memchr(line, ROW_DELIMITER, end - line);
+        next = next ? next + 1 : end;
+        const int64_t offset = fileOffset + (line - begin);
+        if (!hasSequenceIds)
+        {
+            range.m_sequences.push_back({ offset, 0, 1 });
+            line = next;
+            continue;
+        }
+
+        // the same as TryGetSequenceId()
+        size_t id = 0;
+        const char* pos = line;
+        for (; pos != end && isdigit(*pos); ++pos)
+        {
+            id = id * 10 + (*pos - '0');
+        }
+
+        if (pos == end)
+        {
+            // digits up to the end of the input, a line BuildFromFile() does not count either
+            break;
+        }
+
+        if (pos != line && (range.m_sequences.empty() || id != currentKey))
+        {
+            range.m_sequences.push_back({ offset, id, 1 });
+            currentKey = id;
+        }
+        else if (range.m_sequences.empty())
+        {
+            range.m_leadingSamples++;
+        }
+        else
+        {
+            range.m_sequences.back().m_numberOfSamples++;
+        }
+        line = next;
+    }
+}
+
+void Indexer::BuildInParallel(CorpusDescriptorPtr corpus, size_t numberOfRanges)
+{
+    const char* begin = m_pos;
+    const char* end = m_bufferEnd;
+    const int64_t fileOffset = GetFileOffset();
+    const size_t rangeSize = (end - begin) / numberOfRanges;
+
+    std::vector<RangeIndex> ranges(numberOfRanges);
+    std::vector<std::exception_ptr> exceptions(numberOfRanges);
+#pragma omp parallel for schedule(static, 1) num_threads((int)numberOfRanges)
+    for (int i = 0; i < (int)numberOfRanges; ++i)
+    {
+        try
+        {
+            const char* rangeEnd = (i + 1 == (int)numberOfRanges) ? end : begin + (i + 1) * rangeSize;
+            ScanRange(begin, end, begin + i * rangeSize, rangeEnd, fileOffset, m_hasSequenceIds, ranges[i]);
+        }
+        catch (...)
+        {
+            exceptions[i] = std::current_exception();
+        }
+    }
+
+    for (const auto& exception : exceptions)
+    {
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+    }
+
+    if (m_hasSequenceIds && (ranges[0].m_sequences.empty() || ranges[0].m_leadingSamples != 0))
+    {
+        RuntimeError("Expected a sequence id at the offset %" PRIi64 ", none was found.", fileOffset);
+    }
+
+    // merge the ranges in file order, adding the sequences as BuildFromFile() and BuildFromLines() do
+    SequenceDescriptor sd = {};
+    size_t currentKey = 0;
+    size_t lines = 0;
+    bool first = true;
+    for (const auto& range : ranges)
+    {
+        sd.m_numberOfSamples += range.m_leadingSamples;
+        for (const auto& sequence : range.m_sequences)
+        {
+            const size_t key = m_hasSequenceIds ? sequence.m_key : lines++;
+            if (!first && m_hasSequenceIds && key == currentKey)
+            {
+                // continues the sequence of the previous range
+                sd.m_numberOfSamples += sequence.m_numberOfSamples;
+                continue;
+            }
+
+            if (!first)
+            {
+                sd.m_byteSize = sequence.m_fileOffsetBytes - sd.m_fileOffsetBytes;
+                AddSequenceIfIncluded(corpus, currentKey, sd);
+            }
+
+            sd = {};
+            sd.m_fileOffsetBytes = sequence.m_fileOffsetBytes;
+            sd.m_numberOfSamples = sequence.m_numberOfSamples;
+            currentKey = key;
+            first = false;
+        }
+    }
+
+    if (!first)
+    {
+        sd.m_byteSize = m_fileOffsetEnd - sd.m_fileOffsetBytes;
+        AddSequenceIfIncluded(corpus, currentKey, sd);
+    }
+
+    m_pos = m_bufferEnd;
+    m_done = true;
+}
+
 void Indexer::AddSequenceIfIncluded(CorpusDescriptorPtr corpus, size_t sequenceKey, SequenceDescriptor& sd)
 {
+    if (m_cacheFile != nullptr)
+    {
+        CacheEntry entry = { sequenceKey, sd.m_fileOffsetBytes, sd.m_byteSize, sd.m_numberOfSamples };
+        fwriteOrDie(&entry, sizeof(entry), 1, m_cacheFile);
+    }
+
     auto& stringRegistry = corpus->GetStringRegistry();
     auto key = std::to_string(sequenceKey);
     if (corpus->IsIncluded(key))
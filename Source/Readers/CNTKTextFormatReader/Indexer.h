@@ -6,9 +6,11 @@
 #pragma once
 
 #include <stdint.h>
+#include <string>
 #include <vector>
 #include "Descriptors.h"
 #include "CorpusDescriptor.h"
+#include "MemoryMappedFile.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -26,6 +28,24 @@ public:
     // sequences.
     void Build(CorpusDescriptorPtr corpus);
 
+    // Makes Build() keep the index in a cache file next to the input file 'filePath' (the file being indexed)
+    // and reuse the cache instead of reading the input file, as long as neither the input file nor the
+    // sequence id setting have changed since. Of several processes indexing the same file at the same time,
+    // one builds the index while the others wait to reuse its cache.
+    void EnableCache(const std::wstring& filePath);
+
+    // Makes Build() read the input through the given mapping of the input file instead of the file
+    // stream, scanning the mapped pages in place. The mapping has to outlive the indexer.
+    void SetMemoryMappedInput(const MemoryMappedFile* mappedFile) { m_mappedFile = mappedFile; }
+
+    // Makes Build() split a memory mapped input (see SetMemoryMappedInput) into byte ranges of at least
+    // a megabyte and scan them with up to 'numThreads' threads (0 = as many as OpenMP provides).
+    // The index is the same as the one built by a single front to back pass.
+    void SetNumberOfThreads(size_t numThreads) { m_numThreads = numThreads; }
+
+    // Returns the path of the index cache of the given input file.
+    static std::wstring GetCacheFilePath(const std::wstring& filePath) { return filePath + L".index"; }
+
     // Returns input data index (chunk and sequence metadata)
     const Index& GetIndex() const { return m_index; }
 
@@ -36,6 +56,7 @@ public:
 
 private:
     FILE* m_file;
+    const MemoryMappedFile* m_mappedFile; // if not null, the input is read from this mapping instead of m_file
 
     int64_t m_fileOffsetStart;
     int64_t m_fileOffsetEnd;
@@ -47,17 +68,37 @@ private:
 
     bool m_done; // true, when all input was processed
 
+    size_t m_numThreads; // number of threads scanning a mapped input (0 = as many as OpenMP provides)
+
     bool m_hasSequenceIds; // true, when input contains one sequence per line 
                            // or when sequence id column was ignored during indexing.
 
     // a collection of chunk descriptors and sequence keys.
     Index m_index;
 
+    std::wstring m_filePath; // path of the input file, empty unless the index cache is enabled
+    FILE* m_cacheFile; // the cache file being written while the index is built, if any
+
+    struct CacheHeader;
+    struct CacheEntry;
+
+    // Returns the cache header matching the current input file and settings.
+    CacheHeader GetExpectedCacheHeader() const;
+
+    // Fills the index from the cache file, if it exists and matches the expected header.
+    bool TryLoadCache(CorpusDescriptorPtr corpus, const CacheHeader& expected);
+
+    // Builds the index from the input file, writing the cache file along the way.
+    void BuildAndWriteCache(CorpusDescriptorPtr corpus, const CacheHeader& header);
+
+    // Builds the index from the input file (the part of Build() that does not involve the cache).
+    void BuildFromFile(CorpusDescriptorPtr corpus);
+
     // Same function as above but with check that the sequence is included in the corpus descriptor.
     void AddSequenceIfIncluded(CorpusDescriptorPtr corpus, size_t sequenceKey, SequenceDescriptor& sd);
 
     // fills up the buffer with data from file, all previously buffered data
-    // will be overwritten.
+    // will be overwritten. With a mapped input, the buffer is the whole mapping.
     void RefillBuffer();
 
     // Moves the buffer position to the beginning of the next line.
@@ -75,6 +116,10 @@ private:
     // the corresponding sequence id.
     void BuildFromLines(CorpusDescriptorPtr corpus);
 
+    // Builds the index from the mapped input in 'numberOfRanges' byte ranges scanned in parallel,
+    // starting at the current buffer position, and merges their partial indexes in file order.
+    void BuildInParallel(CorpusDescriptorPtr corpus, size_t numberOfRanges);
+
     // Returns current offset in the input file (in bytes). 
     int64_t GetFileOffset() const { return m_fileOffsetStart + (m_pos - m_bufferStart); }
 
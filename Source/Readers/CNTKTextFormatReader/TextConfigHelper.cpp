@@ -148,7 +148,18 @@ TextConfigHelper::TextConfigHelper(const ConfigParameters& config)
     m_traceLevel = config(L"traceLevel", 1);
     m_chunkSizeBytes = config(L"chunkSizeInBytes", 32 * 1024 * 1024); // 32 MB by default
     m_keepDataInMemory = config(L"keepDataInMemory", false);
+    size_t maxCacheSizeInMB = config(L"maxCacheSizeInMB", (size_t) 0); // 0 = no limit
+    m_maxCacheSizeBytes = (maxCacheSizeInMB == 0) ? SIZE_MAX : maxCacheSizeInMB * 1024 * 1024;
     m_frameMode = config(L"frameMode", false);
+    m_numParsingThreads = config(L"numParsingThreads", 0);
+    m_numIndexingThreads = config(L"numIndexingThreads", 1);
+    m_cacheIndex = config(L"cacheIndex", false);
+    m_memoryMapInput = config(L"memoryMapInput", false);
+    m_streaming = config(L"streaming", false);
+    if (m_streaming && (m_randomizationWindow != randomizeNone || m_keepDataInMemory))
+    {
+        RuntimeError("Streaming input (streaming=true) requires randomize=false and keepDataInMemory=false.");
+    }
 }
 
 }}}
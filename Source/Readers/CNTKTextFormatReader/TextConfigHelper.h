@@ -37,8 +37,20 @@ public:
 
     bool ShouldKeepDataInMemory() const { return m_keepDataInMemory; }
 
+    size_t GetMaxCacheSize() const { return m_maxCacheSizeBytes; }
+
     bool IsInFrameMode() const { return m_frameMode; }
 
+    unsigned int GetNumParsingThreads() const { return m_numParsingThreads; }
+
+    unsigned int GetNumIndexingThreads() const { return m_numIndexingThreads; }
+
+    bool ShouldCacheIndex() const { return m_cacheIndex; }
+
+    bool ShouldMemoryMapInput() const { return m_memoryMapInput; }
+
+    bool IsStreaming() const { return m_streaming; }
+
     ElementType GetElementType() const { return m_elementType; }
 
     DISABLE_COPY_AND_MOVE(TextConfigHelper);
@@ -53,7 +65,13 @@ private:
     unsigned int m_traceLevel;
     size_t m_chunkSizeBytes; // chunks size in bytes
     bool m_keepDataInMemory; // if true the whole dataset is kept in memory
+    size_t m_maxCacheSizeBytes; // if the data is kept in memory, at most this much of it (SIZE_MAX = no limit)
     bool m_frameMode; // if true, the maximum expected sequence length in the dataset is one sample.
+    unsigned int m_numParsingThreads; // number of threads parsing the sequences of a chunk (0 = as many as OpenMP provides)
+    unsigned int m_numIndexingThreads; // number of threads scanning byte ranges of the input file to build its index (0 = as many as OpenMP provides)
+    bool m_cacheIndex; // if true, the index of the input file is kept in a cache file next to it and reused by later runs
+    bool m_memoryMapInput; // if true, the input file is mapped into memory and parsed in place instead of being read through buffers
+    bool m_streaming; // if true, the input file is read once front to back without an index (see TextStreamingEnumerator)
 };
 
 } } }
@@ -7,6 +7,14 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include <cfloat>
+#include <omp.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TEXT_PARSER_USE_SSE2
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 #include "Indexer.h"
 #include "TextParser.h"
 #include "TextReaderConstants.h"
@@ -21,6 +29,103 @@ inline bool IsDigit(char c)
     return '0' <= c && c <= '9';
 }
 
+inline unsigned int CountTrailingZeros(unsigned int mask)
+{
+    assert(mask != 0);
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// Returns the length of the run of decimal digits at the beginning of [pos, pos + maxLength),
+// testing 16 characters at a time where SSE2 is available.
+inline size_t CountDigits(const char* pos, size_t maxLength)
+{
+    size_t count = 0;
+#ifdef TEXT_PARSER_USE_SSE2
+    const __m128i belowZero = _mm_set1_epi8('0' - 1);
+    const __m128i aboveNine = _mm_set1_epi8('9' + 1);
+    for (; count + 16 <= maxLength; count += 16)
+    {
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos + count));
+        __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(chars, belowZero), _mm_cmplt_epi8(chars, aboveNine));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(isDigit);
+        if (mask != 0xFFFF)
+        {
+            return count + CountTrailingZeros(~mask);
+        }
+    }
+#endif
+    while (count < maxLength && IsDigit(pos[count]))
+    {
+        ++count;
+    }
+    return count;
+}
+
+// Appends a run of 'length' decimal digits to 'value', eight at a time.
+inline uint64_t ParseDigits(const char* pos, size_t length, uint64_t value = 0)
+{
+    for (; length >= 8; pos += 8, length -= 8)
+    {
+        // the eight characters as a little-endian word, combined pairwise into 2, 4 and 8 digit numbers
+        uint64_t chunk;
+        memcpy(&chunk, pos, sizeof(chunk));
+        chunk = ((chunk & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+        chunk = ((chunk & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+        chunk = ((chunk & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32;
+        value = value * 100000000 + chunk;
+    }
+    for (; length > 0; ++pos, --length)
+    {
+        value = value * 10 + (*pos - '0');
+    }
+    return value;
+}
+
+// Continues a run of decimal digits whose first 'count' characters have been converted into 'value' already,
+// scanning and converting the rest in blocks. Returns the length of the whole run. Kept out of line, so that
+// ReadDigits below stays small enough to be inlined into the number parsers.
+static size_t ReadLongDigitRun(const char* pos, size_t maxLength, size_t count, uint64_t& value)
+{
+    const size_t length = count + CountDigits(pos + count, maxLength - count);
+    if (length <= 19)
+    {
+        value = ParseDigits(pos + count, length - count, value);
+    }
+    return length;
+}
+
+// Returns the length of the run of decimal digits at the beginning of [pos, pos + maxLength) and
+// stores its value (only meaningful for runs of at most 19 digits). Most runs are short, so their digits
+// are converted while they are tested; only a longer run goes on to be scanned and converted in blocks.
+inline size_t ReadDigits(const char* pos, size_t maxLength, uint64_t& value)
+{
+    const size_t shortLength = min(maxLength, (size_t) 8);
+    size_t count = 0;
+    value = 0;
+    for (; count < shortLength && IsDigit(pos[count]); ++count)
+    {
+        value = value * 10 + (pos[count] - '0');
+    }
+    return (count < 8) ? count : ReadLongDigitRun(pos, maxLength, count, value);
+}
+
+// Powers of ten that are exact as doubles.
+static const double s_exactPowersOfTen[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Digit runs of up to this length accumulate exactly in a double (< 2^53),
+// so converting them at once gives the same value as the digit-by-digit parse.
+static const size_t s_maxExactDigits = 15;
+
 enum State
 {
     Init = 0,
@@ -42,6 +147,9 @@ public:
     // Gets sequences by id.
     void GetSequence(size_t sequenceId, std::vector<SequenceDataPtr>& result) override;
 
+    // Gets the size of the parsed sequence data.
+    size_t GetMemorySize() const override;
+
     // A map from sequence ids to the sequence data.
     std::vector<SequenceBuffer> m_sequenceMap;
 
@@ -72,6 +180,10 @@ TextParser(corpus, helper.GetFilePath(), helper.GetStreams())
     SetMaxAllowedErrors(helper.GetMaxAllowedErrors());
     SetChunkSize(helper.GetChunkSize());
     SetSkipSequenceIds(helper.ShouldSkipSequenceIds());
+    SetNumParsingThreads(helper.GetNumParsingThreads());
+    SetNumIndexingThreads(helper.GetNumIndexingThreads());
+    SetCacheIndex(helper.ShouldCacheIndex());
+    SetMemoryMappedInput(helper.ShouldMemoryMapInput());
 
     Initialize();
 }
@@ -95,6 +207,11 @@ TextParser<ElemType>::TextParser(CorpusDescriptorPtr corpus, const std::wstring&
     m_numAllowedErrors(0),
     m_skipSequenceIds(false),
     m_numRetries(5),
+    m_numParsingThreads(1),
+    m_numIndexingThreads(1),
+    m_useFastNumericParsing(true),
+    m_cacheIndex(false),
+    m_memoryMapInput(false),
     m_corpus(corpus)
 {
     assert(streams.size() > 0);
@@ -123,6 +240,36 @@ TextParser<ElemType>::TextParser(CorpusDescriptorPtr corpus, const std::wstring&
     m_scratch = unique_ptr<char[]>(new char[m_maxAliasLength + 1]);
 }
 
+template <class ElemType>
+TextParser<ElemType>::TextParser(const TextParser& parent, const char* buffer, int64_t fileOffsetStart, int64_t fileOffsetEnd) :
+    m_filename(parent.m_filename),
+    m_file(nullptr),
+    m_streamInfos(parent.m_streamInfos),
+    m_maxAliasLength(parent.m_maxAliasLength),
+    m_aliasToIdMap(parent.m_aliasToIdMap),
+    m_indexer(nullptr),
+    m_fileOffsetStart(fileOffsetStart),
+    m_fileOffsetEnd(fileOffsetEnd),
+    m_bufferStart(buffer),
+    m_bufferEnd(buffer + (fileOffsetEnd - fileOffsetStart)),
+    m_pos(buffer),
+    m_scratch(new char[parent.m_maxAliasLength + 1]),
+    m_chunkSizeBytes(parent.m_chunkSizeBytes),
+    m_traceLevel(parent.m_traceLevel),
+    m_hadWarnings(false),
+    m_numAllowedErrors(parent.m_numAllowedErrors),
+    m_skipSequenceIds(parent.m_skipSequenceIds),
+    m_numRetries(0),
+    m_numParsingThreads(1),
+    m_numIndexingThreads(1),
+    m_useFastNumericParsing(parent.m_useFastNumericParsing),
+    m_cacheIndex(false),
+    m_memoryMapInput(false),
+    m_corpus(parent.m_corpus)
+{
+    m_streams = parent.m_streams;
+}
+
 template <class ElemType>
 TextParser<ElemType>::~TextParser()
 {
@@ -171,13 +318,49 @@ void TextParser<ElemType>::Initialize()
                 "UTF-16 encoding is currently not supported.", m_filename.c_str());
         }
 
+        if (m_memoryMapInput && m_mappedFile == nullptr)
+        {
+            m_mappedFile = make_unique<MemoryMappedFile>(m_filename);
+        }
+
         m_indexer = make_unique<Indexer>(m_file, m_skipSequenceIds, m_chunkSizeBytes);
+        if (m_cacheIndex)
+        {
+            m_indexer->EnableCache(m_filename);
+        }
+
+        // the byte ranges are scanned in parallel through a mapping, which is only kept if parsing uses it too
+        unique_ptr<MemoryMappedFile> indexedFile;
+        if (!m_mappedFile && m_numIndexingThreads != 1)
+        {
+            indexedFile = make_unique<MemoryMappedFile>(m_filename);
+        }
+
+        if (m_mappedFile || indexedFile)
+        {
+            m_indexer->SetMemoryMappedInput(m_mappedFile ? m_mappedFile.get() : indexedFile.get());
+            m_indexer->SetNumberOfThreads(m_numIndexingThreads);
+        }
 
         m_indexer->Build(m_corpus);
+        m_indexer->SetMemoryMappedInput(nullptr);
     });
 
     assert(m_indexer != nullptr);
 
+    if (m_mappedFile)
+    {
+        // The mapping is one buffer spanning the whole file, nothing has to be read from the file anymore.
+        // Chunks are loaded in random order, so the sequential access hint of the indexer no longer holds.
+        m_mappedFile->Advise(0, m_mappedFile->Size(), MemoryMappedFile::Access::Normal);
+        m_bufferStart = m_mappedFile->Data();
+        m_bufferEnd = m_bufferStart + m_mappedFile->Size();
+        m_pos = m_bufferStart;
+        m_fileOffsetStart = 0;
+        m_fileOffsetEnd = m_mappedFile->Size();
+        return;
+    }
+
     int64_t position = _ftelli64(m_file);
     if (position == -1L)
     {
@@ -246,6 +429,31 @@ void TextParser<ElemType>::TextDataChunk::GetSequence(size_t sequenceId, std::ve
     result.insert(result.end(), sequenceData.begin(), sequenceData.end());
 }
 
+template <class ElemType>
+size_t TextParser<ElemType>::TextDataChunk::GetMemorySize() const
+{
+    size_t size = 0;
+    for (const auto& sequenceData : m_sequenceMap)
+    {
+        for (size_t j = 0; j < sequenceData.size(); ++j)
+        {
+            if (m_parser->m_streamInfos[j].m_type == StorageType::dense)
+            {
+                auto denseData = static_cast<const DenseInputStreamBuffer*>(sequenceData[j].get());
+                size += denseData->m_buffer.capacity() * sizeof(ElemType);
+            }
+            else
+            {
+                auto sparseData = static_cast<const SparseInputStreamBuffer*>(sequenceData[j].get());
+                size += sparseData->m_buffer.capacity() * sizeof(ElemType) +
+                        sparseData->m_indicesBuffer.capacity() * sizeof(IndexType) +
+                        sparseData->m_nnzCounts.capacity() * sizeof(IndexType);
+            }
+        }
+    }
+    return size;
+}
+
 template <class ElemType>
 ChunkPtr TextParser<ElemType>::GetChunk(ChunkIdType chunkId)
 {
@@ -265,16 +473,155 @@ ChunkPtr TextParser<ElemType>::GetChunk(ChunkIdType chunkId)
     return textChunk;
 }
 
+// Returns the range of the input file spanned by the sequences of the chunk, which is contiguous.
+static void GetChunkFileRange(const ChunkDescriptor& descriptor, int64_t& offsetStart, int64_t& offsetEnd)
+{
+    assert(!descriptor.m_sequences.empty());
+    offsetStart = descriptor.m_sequences.front().m_fileOffsetBytes;
+    offsetEnd = offsetStart;
+    for (const auto& sequenceDescriptor : descriptor.m_sequences)
+    {
+        offsetStart = min(offsetStart, sequenceDescriptor.m_fileOffsetBytes);
+        offsetEnd = max(offsetEnd, sequenceDescriptor.m_fileOffsetBytes + (int64_t) sequenceDescriptor.m_byteSize);
+    }
+}
+
 template <class ElemType>
 void TextParser<ElemType>::LoadChunk(TextChunkPtr& chunk, const ChunkDescriptor& descriptor)
 {
     chunk->m_sequenceMap.resize(descriptor.m_sequences.size());
+
+    if (m_mappedFile && !descriptor.m_sequences.empty())
+    {
+        // have the whole chunk paged in at once, instead of faulting it in page by page while parsing
+        int64_t chunkOffsetStart, chunkOffsetEnd;
+        GetChunkFileRange(descriptor, chunkOffsetStart, chunkOffsetEnd);
+        m_mappedFile->Advise(chunkOffsetStart, chunkOffsetEnd - chunkOffsetStart, MemoryMappedFile::Access::WillNeed);
+    }
+
+    unsigned int numThreads = (m_numParsingThreads == 0) ? omp_get_max_threads() : m_numParsingThreads;
+    numThreads = (unsigned int) min((size_t) numThreads, descriptor.m_sequences.size());
+    if (numThreads > 1)
+    {
+        LoadChunkInParallel(chunk, descriptor, numThreads);
+        return;
+    }
+
     for (const auto& sequenceDescriptor : descriptor.m_sequences)
     {
         chunk->m_sequenceMap[sequenceDescriptor.m_id] = LoadSequence(sequenceDescriptor);
     }
 }
 
+template <class ElemType>
+void TextParser<ElemType>::LoadChunkInParallel(TextChunkPtr& chunk, const ChunkDescriptor& descriptor, unsigned int numThreads)
+{
+    // The sequences of a chunk lie in one contiguous range of the file, which is read at once
+    // (or used in place, if the file is mapped).
+    int64_t chunkOffsetStart, chunkOffsetEnd;
+    GetChunkFileRange(descriptor, chunkOffsetStart, chunkOffsetEnd);
+
+    const char* chunkData;
+    std::vector<char> chunkBuffer;
+    if (m_mappedFile)
+    {
+        chunkData = m_mappedFile->Data() + chunkOffsetStart;
+    }
+    else
+    {
+        chunkBuffer.resize(chunkOffsetEnd - chunkOffsetStart);
+        int rc = _fseeki64(m_file, chunkOffsetStart, SEEK_SET);
+        if (rc)
+        {
+            PrintWarningNotification();
+            RuntimeError("Error seeking to position %" PRId64 " in the input file (%ls).",
+                chunkOffsetStart, m_filename.c_str());
+        }
+
+        if (fread(chunkBuffer.data(), 1, chunkBuffer.size(), m_file) != chunkBuffer.size())
+        {
+            PrintWarningNotification();
+            RuntimeError("Could not read %" PRIu64 " bytes at offset %" PRId64 " from the input file (%ls).",
+                chunkBuffer.size(), chunkOffsetStart, m_filename.c_str());
+        }
+
+        // The file position is now at the end of the chunk; drop the buffered data,
+        // so that the next serial read continues from there.
+        m_fileOffsetStart = chunkOffsetEnd;
+        m_fileOffsetEnd = chunkOffsetEnd;
+        m_bufferStart = m_buffer.get();
+        m_bufferEnd = m_bufferStart;
+        m_pos = m_bufferStart;
+        chunkData = chunkBuffer.data();
+    }
+
+    ParseChunkInParallel(chunk, descriptor, chunkData, chunkOffsetStart, chunkOffsetEnd, numThreads);
+}
+
+template <class ElemType>
+void TextParser<ElemType>::ParseChunkInParallel(TextChunkPtr& chunk, const ChunkDescriptor& descriptor, const char* buffer,
+                                                int64_t fileOffsetStart, int64_t fileOffsetEnd, unsigned int numThreads)
+{
+    // One parser per thread. Each sequence is parsed against the error budget left at the start of the chunk;
+    // the errors are accounted for afterwards in sequence order, so that the outcome is the same as when parsing serially.
+    std::vector<std::unique_ptr<TextParser>> workers(numThreads);
+    for (auto& worker : workers)
+    {
+        worker.reset(new TextParser(*this, buffer, fileOffsetStart, fileOffsetEnd));
+    }
+
+    const size_t numSequences = descriptor.m_sequences.size();
+    std::vector<unsigned int> numErrors(numSequences, 0);
+    std::vector<std::exception_ptr> exceptions(numSequences);
+
+#pragma omp parallel for schedule(dynamic) num_threads(numThreads)
+    for (int i = 0; i < (int) numSequences; ++i)
+    {
+        TextParser& worker = *workers[omp_get_thread_num()];
+        const auto& sequenceDescriptor = descriptor.m_sequences[i];
+        worker.m_numAllowedErrors = m_numAllowedErrors;
+        try
+        {
+            chunk->m_sequenceMap[sequenceDescriptor.m_id] = worker.LoadSequence(sequenceDescriptor);
+        }
+        catch (...)
+        {
+            exceptions[i] = std::current_exception();
+        }
+        numErrors[i] = m_numAllowedErrors - worker.m_numAllowedErrors;
+    }
+
+    for (const auto& worker : workers)
+    {
+        m_hadWarnings |= worker->m_hadWarnings;
+    }
+
+    for (size_t i = 0; i < numSequences; ++i)
+    {
+        for (unsigned int j = 0; j < numErrors[i]; ++j)
+        {
+            IncrementNumberOfErrorsOrDie();
+        }
+
+        if (exceptions[i])
+        {
+            std::rethrow_exception(exceptions[i]);
+        }
+    }
+}
+
+template <class ElemType>
+ChunkPtr TextParser<ElemType>::ParseChunkFromBuffer(const ChunkDescriptor& descriptor, const char* buffer, int64_t fileOffsetStart, int64_t fileOffsetEnd)
+{
+    auto chunk = make_shared<TextDataChunk>(descriptor, this);
+    chunk->m_sequenceMap.resize(descriptor.m_sequences.size());
+
+    unsigned int numThreads = (m_numParsingThreads == 0) ? omp_get_max_threads() : m_numParsingThreads;
+    numThreads = (unsigned int) max((size_t) 1, min((size_t) numThreads, descriptor.m_sequences.size()));
+    ParseChunkInParallel(chunk, descriptor, buffer, fileOffsetStart, fileOffsetEnd, numThreads);
+    return chunk;
+}
+
 template <class ElemType>
 void TextParser<ElemType>::IncrementNumberOfErrorsOrDie()
 {
@@ -291,6 +638,12 @@ void TextParser<ElemType>::IncrementNumberOfErrorsOrDie()
 template <class ElemType>
 bool TextParser<ElemType>::TryRefillBuffer()
 {
+    if (m_file == nullptr || m_mappedFile)
+    {
+        // parsing from an in-memory copy of a chunk or from the mapped file, there's nothing more to read
+        return false;
+    }
+
     size_t bytesRead = fread(m_buffer.get(), 1, BUFFER_SIZE, m_file);
 
     if (bytesRead == (size_t)-1)
@@ -485,11 +838,17 @@ void TextParser<ElemType>::FillSequenceMetadata(SequenceBuffer& sequenceData, si
 template <class ElemType>
 bool TextParser<ElemType>::TryReadRow(SequenceBuffer& sequence, size_t& bytesToRead)
 {
-    while (bytesToRead && CanRead() && IsDigit(*m_pos))
+    // skip sequence ids
+    while (bytesToRead && CanRead())
     {
-        // skip sequence ids
-        ++m_pos;
-        --bytesToRead;
+        size_t available = min(bytesToRead, (size_t) (m_bufferEnd - m_pos));
+        size_t numDigits = CountDigits(m_pos, available);
+        m_pos += numDigits;
+        bytesToRead -= numDigits;
+        if (numDigits < available)
+        {
+            break;
+        }
     }
 
     size_t numSampleRead = 0;
@@ -909,9 +1268,33 @@ void TextParser<ElemType>::SkipToNextInput(size_t& bytesToRead)
     }
 }
 
+template <class ElemType>
+bool TextParser<ElemType>::TryReadUint64Fast(size_t& value, size_t& bytesToRead)
+{
+    size_t available = min(bytesToRead, (size_t) (m_bufferEnd - m_pos));
+    uint64_t digits;
+    size_t numDigits = ReadDigits(m_pos, available, digits);
+
+    // the number must be terminated within the buffer and not be able to overflow
+    if (numDigits == 0 || numDigits == available || numDigits > 19)
+    {
+        return false;
+    }
+
+    value = digits;
+    m_pos += numDigits;
+    bytesToRead -= numDigits;
+    return true;
+}
+
 template <class ElemType>
 bool TextParser<ElemType>::TryReadUint64(size_t& value, size_t& bytesToRead)
 {
+    if (m_useFastNumericParsing && TryReadUint64Fast(value, bytesToRead))
+    {
+        return true;
+    }
+
     value = 0;
     bool found = false;
     while (bytesToRead && CanRead())
@@ -954,6 +1337,92 @@ bool TextParser<ElemType>::TryReadUint64(size_t& value, size_t& bytesToRead)
 
 
 
+// Handles the common forms [sign]digits[.digits][(e|E)[sign]digits] with short enough digit runs
+// that lie entirely in the buffer, computing exactly what TryReadRealNumber below computes for them.
+// Anything else (including malformed input, for the sake of its warnings) is left to TryReadRealNumber:
+// returns false without consuming any input in that case.
+template <class ElemType>
+bool TextParser<ElemType>::TryReadRealNumberFast(ElemType& value, size_t& bytesToRead)
+{
+    const size_t available = min(bytesToRead, (size_t) (m_bufferEnd - m_pos));
+    const char* const start = m_pos;
+    const char* const end = m_pos + available;
+    const char* pos = start;
+
+    bool negative = false;
+    if (pos != end && isSign(*pos))
+    {
+        negative = (*pos == '-');
+        ++pos;
+    }
+
+    uint64_t digits;
+    size_t numDigits = ReadDigits(pos, end - pos, digits);
+    if (numDigits == 0 || numDigits > s_maxExactDigits)
+    {
+        return false;
+    }
+
+    double number = (double) (int64_t) digits;
+    pos += numDigits;
+    if (pos == end)
+    {
+        return false;
+    }
+
+    double coefficient = number;
+    if (*pos == '.')
+    {
+        ++pos;
+        numDigits = ReadDigits(pos, end - pos, digits);
+        if (numDigits == 0 || numDigits > s_maxExactDigits)
+        {
+            return false;
+        }
+
+        coefficient += (double) (int64_t) digits / s_exactPowersOfTen[numDigits];
+        pos += numDigits;
+        if (pos == end)
+        {
+            return false;
+        }
+    }
+
+    if (negative)
+    {
+        coefficient = -coefficient;
+    }
+
+    if (isE(*pos))
+    {
+        ++pos;
+        bool negativeExponent = false;
+        if (pos != end && isSign(*pos))
+        {
+            negativeExponent = (*pos == '-');
+            ++pos;
+        }
+
+        numDigits = ReadDigits(pos, end - pos, digits);
+        if (numDigits == 0 || numDigits > s_maxExactDigits || pos + numDigits == end)
+        {
+            return false;
+        }
+
+        double exponent = (double) (int64_t) digits;
+        pos += numDigits;
+        value = static_cast<ElemType>(coefficient * pow(10.0, (negativeExponent) ? -exponent : exponent));
+    }
+    else
+    {
+        value = static_cast<ElemType>(coefficient);
+    }
+
+    m_pos = pos;
+    bytesToRead -= (pos - start);
+    return true;
+}
+
 // TODO: better precision (at the moment we're at parity with UCIFast)?
 // Assumes that bytesToRead is greater than the number of characters 
 // in the string representation of the floating point number
@@ -964,6 +1433,11 @@ bool TextParser<ElemType>::TryReadUint64(size_t& value, size_t& bytesToRead)
 template <class ElemType>
 bool TextParser<ElemType>::TryReadRealNumber(ElemType& value, size_t& bytesToRead)
 {
+    if (m_useFastNumericParsing && TryReadRealNumberFast(value, bytesToRead))
+    {
+        return true;
+    }
+
     State state = State::Init;
     double coefficient = .0, number = .0, divider = .0;
     bool negative = false;
@@ -1183,6 +1657,36 @@ void TextParser<ElemType>::SetNumRetries(unsigned int numRetries)
     m_numRetries = numRetries;
 }
 
+template <class ElemType>
+void TextParser<ElemType>::SetNumParsingThreads(unsigned int numThreads)
+{
+    m_numParsingThreads = numThreads;
+}
+
+template <class ElemType>
+void TextParser<ElemType>::SetNumIndexingThreads(unsigned int numThreads)
+{
+    m_numIndexingThreads = numThreads;
+}
+
+template <class ElemType>
+void TextParser<ElemType>::SetFastNumericParsing(bool enable)
+{
+    m_useFastNumericParsing = enable;
+}
+
+template <class ElemType>
+void TextParser<ElemType>::SetCacheIndex(bool cache)
+{
+    m_cacheIndex = cache;
+}
+
+template <class ElemType>
+void TextParser<ElemType>::SetMemoryMappedInput(bool enable)
+{
+    m_memoryMapInput = enable;
+}
+
 template <class ElemType>
 std::wstring TextParser<ElemType>::GetFileInfo()
 {
@@ -1206,7 +1710,7 @@ bool TextParser<ElemType>::GetSequenceDescriptionByKey(const KeyType& key, Seque
 }
 
 template <class ElemType>
-const string& TextParser<ElemType>::GetSequenceKey(const SequenceDescriptor& s) const
+string TextParser<ElemType>::GetSequenceKey(const SequenceDescriptor& s) const
 {
     return m_corpus->GetStringRegistry()[s.m_key.m_sequence];
 }
@@ -16,6 +16,9 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 template <class ElemType>
 class CNTKTextFormatReaderTestRunner;
 
+template <class ElemType>
+class TextStreamingEnumerator;
+
 // TODO: more details when tracing warnings
 // (e.g., buffer content around the char that triggered the warning)
 template <class ElemType>
@@ -105,6 +108,8 @@ private:
 
     std::unique_ptr<Indexer> m_indexer;
 
+    std::unique_ptr<MemoryMappedFile> m_mappedFile; // the input file, if it is memory-mapped
+
     int64_t m_fileOffsetStart;
     int64_t m_fileOffsetEnd;
 
@@ -123,6 +128,13 @@ private:
     bool m_skipSequenceIds;
     unsigned int m_numRetries; // specifies the number of times an unsuccessful
     // file operation should be repeated (default value is 5).
+    unsigned int m_numParsingThreads; // number of threads parsing the sequences of a chunk
+    // (0 = as many as OpenMP provides, 1 = parse serially straight from the file).
+    unsigned int m_numIndexingThreads; // number of threads building the index (see Indexer::SetNumberOfThreads),
+    // other than 1, the input file is mapped into memory for indexing even without m_memoryMapInput.
+    bool m_useFastNumericParsing; // use TryReadRealNumberFast/TryReadUint64Fast where possible
+    bool m_cacheIndex; // keep the index in a cache file next to the input file (see Indexer::EnableCache)
+    bool m_memoryMapInput; // map the input file into memory, the whole mapping then serves as the buffer
 
     // Corpus descriptor.
     CorpusDescriptorPtr m_corpus;
@@ -155,6 +167,12 @@ private:
 
     bool TryReadUint64(size_t& value, size_t& bytesToRead);
 
+    // Fast paths of the two functions above for well-formed numbers that lie entirely in the buffer,
+    // which scan digit runs in blocks. They return false without consuming any input otherwise.
+    bool TryReadRealNumberFast(ElemType& value, size_t& bytesToRead);
+
+    bool TryReadUint64Fast(size_t& value, size_t& bytesToRead);
+
     // Reads dense sample values into the provided vector.
     bool TryReadDenseSample(std::vector<ElemType>& values, size_t sampleSize, size_t& bytesToRead);
 
@@ -180,8 +198,23 @@ private:
     // Given a descriptor, retrieves the data for the corresponding chunk from the file.
     void LoadChunk(TextChunkPtr& chunk, const ChunkDescriptor& descriptor);
 
+    // Reads the whole chunk into memory (unless the input is mapped) and parses its sequences in parallel.
+    void LoadChunkInParallel(TextChunkPtr& chunk, const ChunkDescriptor& descriptor, unsigned int numThreads);
+
+    // Parses the sequences of the chunk on 'numThreads' threads from a buffer holding the input file between the given offsets.
+    void ParseChunkInParallel(TextChunkPtr& chunk, const ChunkDescriptor& descriptor, const char* buffer,
+                              int64_t fileOffsetStart, int64_t fileOffsetEnd, unsigned int numThreads);
+
+    // Same as above for sequences found without an index (see TextStreamingEnumerator),
+    // on as many threads as configured for loading chunks.
+    ChunkPtr ParseChunkFromBuffer(const ChunkDescriptor& descriptor, const char* buffer, int64_t fileOffsetStart, int64_t fileOffsetEnd);
+
     TextParser(CorpusDescriptorPtr corpus, const std::wstring& filename, const vector<StreamDescriptor>& streams);
 
+    // Creates a parser with the configuration of 'parent' that reads from an in-memory copy (or the mapping)
+    // of the input file between the given offsets instead of the file itself (see LoadChunkInParallel).
+    TextParser(const TextParser& parent, const char* buffer, int64_t fileOffsetStart, int64_t fileOffsetEnd);
+
     // Fills some metadata members to be conformant to the exposed SequenceData interface.
     void FillSequenceMetadata(SequenceBuffer& sequenceBuffer, size_t sequenceId);
 
@@ -195,9 +228,20 @@ private:
 
     void SetNumRetries(unsigned int numRetries);
 
+    void SetNumParsingThreads(unsigned int numThreads);
+
+    void SetNumIndexingThreads(unsigned int numThreads);
+
+    void SetFastNumericParsing(bool enable);
+
+    void SetCacheIndex(bool cache);
+
+    void SetMemoryMappedInput(bool enable);
+
     friend class CNTKTextFormatReaderTestRunner<ElemType>;
+    friend class TextStreamingEnumerator<ElemType>;
 
-    const std::string& GetSequenceKey(const SequenceDescriptor& s) const;
+    std::string GetSequenceKey(const SequenceDescriptor& s) const;
 
     DISABLE_COPY_AND_MOVE(TextParser);
 };
@@ -0,0 +1,536 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include "TextStreamingEnumerator.h"
+#include "TextReaderConstants.h"
+#include "DataReader.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+using namespace std;
+
+// Size of the reads that look for line boundaries around the start of the range of a worker.
+static const size_t s_lineSearchBlockSize = 64 * 1024;
+
+static void SeekOrDie(FILE* file, int64_t offset, const wstring& filename)
+{
+    if (_fseeki64(file, offset, SEEK_SET) != 0)
+    {
+        RuntimeError("Error seeking to position %" PRId64 " in the input file (%ls).", offset, filename.c_str());
+    }
+}
+
+// Reads up to 'size' bytes at 'offset', returns the number of bytes read.
+static size_t ReadAt(FILE* file, int64_t offset, char* buffer, size_t size, const wstring& filename)
+{
+    SeekOrDie(file, offset, filename);
+    size_t bytesRead = fread(buffer, 1, size, file);
+    if (bytesRead < size && ferror(file))
+    {
+        RuntimeError("Could not read %" PRIu64 " bytes at offset %" PRId64 " from the input file (%ls).", (uint64_t) size, offset, filename.c_str());
+    }
+    return bytesRead;
+}
+
+template <class ElemType>
+TextStreamingEnumerator<ElemType>::TextStreamingEnumerator(const TextConfigHelper& helper)
+    : m_filename(helper.GetFilePath()),
+      m_blockSize(max(helper.GetChunkSize(), (size_t) 1)),
+      m_fileSize(0),
+      m_dataStart(0),
+      m_hasSequenceIds(!helper.ShouldSkipSequenceIds()),
+      m_workerRank(0),
+      m_numberOfWorkers(0),
+      m_rangeBegin(0),
+      m_rangeEnd(0),
+      m_maxQueuedBatches(2),
+      m_stop(false),
+      m_positionInBatch(0),
+      m_hadSequencesInSweep(false),
+      m_nextEpochIndex(SIZE_MAX),
+      m_epochIsSweep(true),
+      m_epochSize(0),
+      m_samplePositionInEpoch(0)
+{
+    auto corpus = make_shared<CorpusDescriptor>();
+    m_parser.reset(new TextParser<ElemType>(corpus, m_filename, helper.GetStreams()));
+    m_parser->SetTraceLevel(helper.GetTraceLevel());
+    m_parser->SetMaxAllowedErrors(helper.GetMaxAllowedErrors());
+    m_parser->SetChunkSize(m_blockSize);
+    m_parser->SetSkipSequenceIds(helper.ShouldSkipSequenceIds());
+    m_parser->SetNumParsingThreads(helper.GetNumParsingThreads());
+    m_sequenceKey = corpus->GetStringRegistry()["(streamed)"];
+
+    FILE* file = fopenOrDie(m_filename, L"rbS");
+    auto closeFile = MakeScopeExit([file]() { fclose(file); });
+    if (funicode(file))
+    {
+        RuntimeError("Found a UTF-16 BOM at the beginning of the input file (%ls). "
+            "UTF-16 encoding is currently not supported.", m_filename.c_str());
+    }
+
+    m_fileSize = (int64_t) filesize(file);
+    char start[4] = {};
+    size_t bytesRead = ReadAt(file, 0, start, sizeof(start), m_filename);
+    if (bytesRead >= 3 && start[0] == '\xEF' && start[1] == '\xBB' && start[2] == '\xBF')
+    {
+        // input file contains UTF-8 BOM value, skip it.
+        m_dataStart = 3;
+    }
+
+    if (m_fileSize <= m_dataStart)
+    {
+        RuntimeError("Input file is empty");
+    }
+
+    // Same as the Indexer: input that starts with an input name has no sequence ids, every line is a sequence.
+    if (start[m_dataStart] == NAME_PREFIX)
+    {
+        m_hasSequenceIds = false;
+    }
+}
+
+template <class ElemType>
+TextStreamingEnumerator<ElemType>::~TextStreamingEnumerator()
+{
+    StopReading();
+}
+
+template <class ElemType>
+void TextStreamingEnumerator<ElemType>::StartEpoch(const EpochConfiguration& config)
+{
+    m_config = config;
+    if (m_config.m_numberOfWorkers == 0 || m_config.m_workerRank >= m_config.m_numberOfWorkers)
+    {
+        LogicError("TextStreamingEnumerator: invalid worker rank %" PRIu64 " of %" PRIu64 " workers.",
+            (uint64_t) m_config.m_workerRank, (uint64_t) m_config.m_numberOfWorkers);
+    }
+
+    m_epochIsSweep = (m_config.m_totalEpochSizeInSamples == requestDataSize);
+    if (!m_epochIsSweep)
+    {
+        size_t total = m_config.m_totalEpochSizeInSamples;
+        m_epochSize = total * (m_config.m_workerRank + 1) / m_config.m_numberOfWorkers -
+                      total * m_config.m_workerRank / m_config.m_numberOfWorkers;
+    }
+    m_samplePositionInEpoch = 0;
+
+    // Epochs continue one after another where the previous one left off. Any other epoch
+    // (e.g. after restarting from a checkpoint) can only be reached by reading from the beginning.
+    bool continues = m_reader.joinable() && m_config.m_epochIndex == m_nextEpochIndex &&
+                     m_config.m_workerRank == m_workerRank && m_config.m_numberOfWorkers == m_numberOfWorkers;
+    m_nextEpochIndex = m_config.m_epochIndex + 1;
+    if (continues)
+    {
+        return;
+    }
+
+    StopReading();
+    StartReading(m_config.m_workerRank, m_config.m_numberOfWorkers);
+    if (m_epochIsSweep || m_config.m_epochIndex == 0)
+    {
+        return;
+    }
+
+    size_t samplesToSkip = m_config.m_epochIndex * m_epochSize;
+    fprintf(stderr, "TextStreamingEnumerator: skipping %" PRIu64 " samples to get to epoch %" PRIu64 ".\n",
+        (uint64_t) samplesToSkip, (uint64_t) m_config.m_epochIndex);
+
+    while (samplesToSkip > 0)
+    {
+        if (TryFetchBatch())
+        {
+            samplesToSkip -= min(samplesToSkip, (size_t) m_current.m_numberOfSamples[m_positionInBatch++]);
+        }
+    }
+}
+
+template <class ElemType>
+Sequences TextStreamingEnumerator<ElemType>::GetNextSequences(size_t sampleCount)
+{
+    Sequences result;
+    if (!m_epochIsSweep && m_samplePositionInEpoch >= m_epochSize)
+    {
+        result.m_endOfEpoch = true;
+        return result;
+    }
+
+    // The minibatch size is global, every worker contributes its share.
+    size_t localCount = sampleCount * (m_config.m_workerRank + 1) / m_config.m_numberOfWorkers -
+                        sampleCount * m_config.m_workerRank / m_config.m_numberOfWorkers;
+    if (!m_epochIsSweep)
+    {
+        localCount = min(localCount, m_epochSize - m_samplePositionInEpoch);
+    }
+
+    auto streams = GetStreamDescriptions();
+    result.m_data.resize(streams.size());
+    size_t count = 0;
+    std::vector<SequenceDataPtr> sequence;
+    while (count == 0 || count < localCount)
+    {
+        if (!TryFetchBatch())
+        {
+            if (m_epochIsSweep)
+            {
+                result.m_endOfEpoch = true;
+                break;
+            }
+            continue;
+        }
+
+        // A sequence that does not fit any more stays for the next minibatch.
+        size_t numberOfSamples = m_current.m_numberOfSamples[m_positionInBatch];
+        if (count > 0 && count + numberOfSamples > localCount)
+        {
+            break;
+        }
+
+        sequence.clear();
+        m_current.m_chunk->GetSequence(m_positionInBatch++, sequence);
+        for (size_t i = 0; i < streams.size(); ++i)
+        {
+            result.m_data[i].push_back(sequence[i]);
+        }
+        count += numberOfSamples;
+    }
+
+    m_samplePositionInEpoch += count;
+    if (count == 0)
+    {
+        result.m_data.clear();
+    }
+    return result;
+}
+
+template <class ElemType>
+bool TextStreamingEnumerator<ElemType>::TryFetchBatch()
+{
+    while (!m_current.m_chunk || m_positionInBatch == m_current.m_numberOfSamples.size())
+    {
+        {
+            unique_lock<mutex> lock(m_lock);
+            m_batchAvailable.wait(lock, [this]() { return !m_batches.empty(); });
+            m_current = std::move(m_batches.front());
+            m_batches.pop_front();
+        }
+        m_spaceAvailable.notify_all();
+        m_positionInBatch = 0;
+
+        if (m_current.m_error)
+        {
+            std::exception_ptr error = m_current.m_error;
+            StopReading();
+            std::rethrow_exception(error);
+        }
+
+        if (m_current.m_endOfSweep)
+        {
+            if (!m_hadSequencesInSweep && !m_epochIsSweep)
+            {
+                RuntimeError("TextStreamingEnumerator: worker %" PRIu64 " found no sequences in its part of the input file (%ls).",
+                    (uint64_t) m_workerRank, m_filename.c_str());
+            }
+            m_hadSequencesInSweep = false;
+            m_current = Batch();
+            return false;
+        }
+        m_hadSequencesInSweep = true;
+    }
+    return true;
+}
+
+template <class ElemType>
+void TextStreamingEnumerator<ElemType>::StartReading(size_t workerRank, size_t numberOfWorkers)
+{
+    m_workerRank = workerRank;
+    m_numberOfWorkers = numberOfWorkers;
+    m_rangeBegin = m_fileSize * (int64_t) workerRank / (int64_t) numberOfWorkers;
+    m_rangeEnd = m_fileSize * (int64_t) (workerRank + 1) / (int64_t) numberOfWorkers;
+    m_current = Batch();
+    m_positionInBatch = 0;
+    m_hadSequencesInSweep = false;
+    m_stop = false;
+    auto statistics = ReaderStatisticsCollector::Current();
+    m_reader = thread([this, statistics]()
+    {
+        ReaderStatisticsScope statisticsScope(statistics);
+        ReadLoop();
+    });
+}
+
+template <class ElemType>
+void TextStreamingEnumerator<ElemType>::StopReading()
+{
+    if (!m_reader.joinable())
+    {
+        return;
+    }
+
+    {
+        unique_lock<mutex> lock(m_lock);
+        m_stop = true;
+    }
+    m_spaceAvailable.notify_all();
+    m_reader.join();
+    m_batches.clear();
+    m_current = Batch();
+}
+
+template <class ElemType>
+bool TextStreamingEnumerator<ElemType>::PushBatch(Batch&& batch)
+{
+    {
+        unique_lock<mutex> lock(m_lock);
+        m_spaceAvailable.wait(lock, [this]() { return m_stop || m_batches.size() < m_maxQueuedBatches; });
+        if (m_stop)
+        {
+            return false;
+        }
+        m_batches.push_back(std::move(batch));
+    }
+    m_batchAvailable.notify_all();
+    return true;
+}
+
+template <class ElemType>
+void TextStreamingEnumerator<ElemType>::ReadLoop()
+{
+    try
+    {
+        FILE* file = fopenOrDie(m_filename, L"rbS");
+        auto closeFile = MakeScopeExit([file]() { fclose(file); });
+        for (;;)
+        {
+            ReadSweep(file);
+            if (!PushBatch(Batch{ nullptr, {}, true, nullptr }))
+            {
+                return;
+            }
+        }
+    }
+    catch (...)
+    {
+        PushBatch(Batch{ nullptr, {}, false, std::current_exception() });
+    }
+}
+
+template <class ElemType>
+void TextStreamingEnumerator<ElemType>::ReadSweep(FILE* file)
+{
+    // The first line of the range, and the id of the sequence before it, whose lines belong to the previous worker.
+    int64_t start = m_dataStart;
+    bool skipping = false;
+    size_t previousId = 0;
+    if (m_rangeBegin > m_dataStart)
+    {
+        start = FindNextLineStart(file, m_rangeBegin);
+        skipping = m_hasSequenceIds && TryGetSequenceIdBefore(file, start, previousId);
+    }
+
+    if (start >= m_rangeEnd || start >= m_fileSize)
+    {
+        return;
+    }
+
+    // The data read but not parsed yet, from the file offset 'bufferOffset' on.
+    vector<char> buffer;
+    int64_t bufferOffset = start;
+    size_t scanPosition = 0; // the next line to look at
+    bool endOfFile = false;
+    SeekOrDie(file, start, m_filename);
+
+    // The sequence whose lines are being collected.
+    bool isOpen = false;
+    SequenceDescriptor current;
+    size_t currentId = 0;
+
+    ChunkDescriptor chunk;
+    bool done = false;
+    while (!done)
+    {
+        // large sequential reads, appended to what is left of the previous one
+        size_t size = buffer.size();
+        buffer.resize(size + m_blockSize);
+        size_t bytesRead = fread(buffer.data() + size, 1, m_blockSize, file);
+        if (bytesRead < m_blockSize && ferror(file))
+        {
+            RuntimeError("Could not read from the input file (%ls).", m_filename.c_str());
+        }
+        buffer.resize(size + bytesRead);
+        endOfFile = (bytesRead < m_blockSize);
+
+        // Split the complete lines into sequences, the same way the Indexer does.
+        while (!done && scanPosition < buffer.size())
+        {
+            const char* line = buffer.data() + scanPosition;
+            size_t available = buffer.size() - scanPosition;
+            const char* lineEnd = (const char*) memchr(line, ROW_DELIMITER, available);
+            if (lineEnd == nullptr && !endOfFile)
+            {
+                break; // the rest of the line comes with the next read
+            }
+            size_t lineLength = (lineEnd == nullptr) ? available : (lineEnd - line + 1);
+            int64_t lineOffset = bufferOffset + (int64_t) scanPosition;
+
+            bool hasId = false;
+            size_t id = 0;
+            for (size_t i = 0; m_hasSequenceIds && i < lineLength && isdigit(line[i]); ++i)
+            {
+                hasId = true;
+                id = id * 10 + (line[i] - '0');
+            }
+
+            if (skipping && (!hasId || id == previousId))
+            {
+                // the rest of a sequence that starts in the range of the previous worker
+                scanPosition += lineLength;
+                continue;
+            }
+            skipping = false;
+
+            if (!isOpen || !m_hasSequenceIds || (hasId && id != currentId))
+            {
+                if (isOpen)
+                {
+                    current.m_byteSize = (size_t) (lineOffset - current.m_fileOffsetBytes);
+                    current.m_id = chunk.m_sequences.size();
+                    chunk.m_sequences.push_back(current);
+                    isOpen = false;
+                }
+
+                if (lineOffset >= m_rangeEnd)
+                {
+                    // the sequence starts in the range of the next worker
+                    done = true;
+                    break;
+                }
+
+                current = SequenceDescriptor();
+                current.m_fileOffsetBytes = lineOffset;
+                current.m_key.m_sequence = m_sequenceKey;
+                currentId = id;
+                isOpen = true;
+            }
+
+            current.m_numberOfSamples++;
+            scanPosition += lineLength;
+        }
+
+        if (endOfFile && scanPosition == buffer.size())
+        {
+            if (isOpen)
+            {
+                current.m_byteSize = (size_t) (bufferOffset + (int64_t) buffer.size() - current.m_fileOffsetBytes);
+                current.m_id = chunk.m_sequences.size();
+                chunk.m_sequences.push_back(current);
+                isOpen = false;
+            }
+            done = true;
+        }
+
+        if (!chunk.m_sequences.empty())
+        {
+            Batch batch{ nullptr, {}, false, nullptr };
+            {
+                ReaderStageTimer timer(ReaderStage::deserialize);
+                batch.m_chunk = m_parser->ParseChunkFromBuffer(chunk, buffer.data(), bufferOffset, bufferOffset + (int64_t) buffer.size());
+            }
+            batch.m_numberOfSamples.reserve(chunk.m_sequences.size());
+            for (const auto& sequence : chunk.m_sequences)
+            {
+                batch.m_numberOfSamples.push_back(sequence.m_numberOfSamples);
+            }
+            chunk.m_sequences.clear();
+            if (!PushBatch(std::move(batch)))
+            {
+                return;
+            }
+        }
+        else if (m_stop)
+        {
+            return;
+        }
+
+        // Keep only the data of the sequence that is still being collected and the lines not yet looked at.
+        size_t keepFrom = isOpen ? (size_t) (current.m_fileOffsetBytes - bufferOffset) : scanPosition;
+        buffer.erase(buffer.begin(), buffer.begin() + keepFrom);
+        bufferOffset += (int64_t) keepFrom;
+        scanPosition -= keepFrom;
+    }
+}
+
+template <class ElemType>
+int64_t TextStreamingEnumerator<ElemType>::FindNextLineStart(FILE* file, int64_t offset)
+{
+    // A line starts at 'offset' if the previous character ends a line.
+    vector<char> block(s_lineSearchBlockSize);
+    for (int64_t position = offset - 1; position < m_fileSize; position += (int64_t) block.size())
+    {
+        size_t bytesRead = ReadAt(file, position, block.data(), block.size(), m_filename);
+        const char* delimiter = (const char*) memchr(block.data(), ROW_DELIMITER, bytesRead);
+        if (delimiter != nullptr)
+        {
+            return position + (delimiter - block.data()) + 1;
+        }
+        if (bytesRead == 0)
+        {
+            break;
+        }
+    }
+    return m_fileSize;
+}
+
+template <class ElemType>
+bool TextStreamingEnumerator<ElemType>::TryGetSequenceIdBefore(FILE* file, int64_t offset, size_t& id)
+{
+    vector<char> block(s_lineSearchBlockSize);
+    while (offset > m_dataStart)
+    {
+        // The line before ends at offset - 1, it starts after the previous delimiter.
+        int64_t lineStart = m_dataStart;
+        int64_t end = offset - 1;
+        while (end > m_dataStart)
+        {
+            int64_t position = max(m_dataStart, end - (int64_t) block.size());
+            size_t bytesRead = ReadAt(file, position, block.data(), (size_t) (end - position), m_filename);
+            size_t i = bytesRead;
+            while (i > 0 && block[i - 1] != ROW_DELIMITER)
+            {
+                --i;
+            }
+            if (i > 0)
+            {
+                lineStart = position + (int64_t) i;
+                break;
+            }
+            end = position;
+        }
+
+        char digits[32];
+        size_t bytesRead = ReadAt(file, lineStart, digits, (size_t) min((int64_t) sizeof(digits), offset - lineStart), m_filename);
+        bool hasId = false;
+        id = 0;
+        for (size_t i = 0; i < bytesRead && isdigit(digits[i]); ++i)
+        {
+            hasId = true;
+            id = id * 10 + (digits[i] - '0');
+        }
+        if (hasId)
+        {
+            return true;
+        }
+        offset = lineStart;
+    }
+    return false;
+}
+
+template class TextStreamingEnumerator<float>;
+template class TextStreamingEnumerator<double>;
+
+}}}
@@ -0,0 +1,118 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include "SequenceEnumerator.h"
+#include "TextParser.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// A sequence enumerator for input in the text format that is read once front to back, without an index
+// (streaming=true). Meant for very large pre-randomized corpora, for which building the index and the
+// chunk descriptions would cost about as much as the actual pass over the data.
+// A background thread reads the input in large sequential blocks (chunkSizeInBytes), splits them into
+// sequences the way the Indexer does and parses them, while the sequences parsed so far are handed out.
+// Every worker reads a contiguous byte range of the file, 1/numberOfWorkers of it. A worker owns the sequences
+// whose first line starts in its range, so no global knowledge of sequence boundaries is needed.
+// As the number of samples of the input is not known up front, an epoch of requestDataSize samples is one
+// pass of a worker over its range, and other epoch sizes are shared out among the workers in equal parts.
+// Sequences that are excluded by a corpus descriptor are not supported.
+template <class ElemType>
+class TextStreamingEnumerator : public SequenceEnumerator
+{
+public:
+    explicit TextStreamingEnumerator(const TextConfigHelper& helper);
+
+    ~TextStreamingEnumerator();
+
+    virtual std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
+    {
+        return m_parser->GetStreamDescriptions();
+    }
+
+    virtual void StartEpoch(const EpochConfiguration& config) override;
+
+    virtual Sequences GetNextSequences(size_t sampleCount) override;
+
+private:
+    // Sequences parsed from a block of the input, or the end of a pass over the range of the worker.
+    struct Batch
+    {
+        ChunkPtr m_chunk;
+        std::vector<uint32_t> m_numberOfSamples; // per sequence of the chunk
+        bool m_endOfSweep;
+        std::exception_ptr m_error; // thrown by the background thread
+    };
+
+    // Starts the background thread at the beginning of the range of the given worker.
+    void StartReading(size_t workerRank, size_t numberOfWorkers);
+
+    // Stops the background thread and drops the batches it has produced.
+    void StopReading();
+
+    // Background thread: reads the range of the worker, pass after pass.
+    void ReadLoop();
+
+    // Reads and parses one pass over the range of the worker.
+    void ReadSweep(FILE* file);
+
+    // Queues a batch for the consumer, returns false if the reading has been stopped in the meantime.
+    bool PushBatch(Batch&& batch);
+
+    // Makes sure that m_current has a sequence left at m_positionInBatch, waiting for the background thread if needed.
+    // Returns false (and moves past it) at the end of a pass.
+    bool TryFetchBatch();
+
+    // Returns the offset of the first line that starts at or after 'offset'.
+    int64_t FindNextLineStart(FILE* file, int64_t offset);
+
+    // Returns the sequence id of the last line with an id before the line that starts at 'offset', if any.
+    bool TryGetSequenceIdBefore(FILE* file, int64_t offset, size_t& id);
+
+    std::unique_ptr<TextParser<ElemType>> m_parser;
+    std::wstring m_filename;
+    size_t m_blockSize;
+    int64_t m_fileSize;
+    int64_t m_dataStart;       // offset of the first line (after a UTF-8 BOM)
+    bool m_hasSequenceIds;     // if false, every line is a sequence
+    size_t m_sequenceKey;      // the key reported for all sequences, as there is no index of their ids
+
+    // The part of the file read by this worker.
+    size_t m_workerRank;
+    size_t m_numberOfWorkers;
+    int64_t m_rangeBegin;
+    int64_t m_rangeEnd;
+
+    // Batches produced by the background thread, at most m_maxQueuedBatches of them.
+    std::thread m_reader;
+    std::mutex m_lock;
+    std::condition_variable m_batchAvailable;
+    std::condition_variable m_spaceAvailable;
+    std::deque<Batch> m_batches;
+    size_t m_maxQueuedBatches;
+    std::atomic<bool> m_stop;
+
+    // The batch that sequences are taken from, and the next sequence in it.
+    Batch m_current;
+    size_t m_positionInBatch;
+    bool m_hadSequencesInSweep; // whether there were sequences since the last end of a pass
+
+    EpochConfiguration m_config;
+    size_t m_nextEpochIndex;   // the epoch that continues where the previous one left off
+    bool m_epochIsSweep;       // the epoch ends with the pass over the range
+    size_t m_epochSize;        // samples of this worker in the epoch, unless m_epochIsSweep
+    size_t m_samplePositionInEpoch;
+
+    DISABLE_COPY_AND_MOVE(TextStreamingEnumerator);
+};
+
+}}}
@@ -15,10 +15,16 @@
 #include "Bundler.h"
 #include "BlockRandomizer.h"
 #include "NoRandomizer.h"
+#include "BucketingSequenceEnumerator.h"
+#include "SharedChunkStore.h"
+#include "DiskChunkCache.h"
+#include "CompactChunkStore.h"
+#include "ChunkCache.h"
 #include "FramePacker.h"
 #include "SequencePacker.h"
 #include "TruncatedBpttPacker.h"
 #include "CorpusDescriptor.h"
+#include "CacheFile.h"
 #include "ConfigUtil.h"
 #include "StringUtil.h"
 #include "CudaMemoryProvider.h"
@@ -70,7 +76,39 @@ CompositeDataReader::CompositeDataReader(const ConfigParameters& config) :
 
     // Creating deserializers.
     // TODO: Currently the primary deserializer defines the corpus. The logic will be moved to CorpusDescriptor class.
-    CreateDeserializers(config);
+    // With sequenceKeyCache = "<file>", the keys of the sequences are mapped read-only from the file, which the first
+    // of the workers writes after its deserializers have registered them; the keys not in the file are still added
+    // in memory, so a stale file only costs memory.
+    std::wstring sequenceKeyCache = config(L"sequenceKeyCache", L"");
+    if (sequenceKeyCache.empty())
+    {
+        CreateDeserializers(config);
+    }
+    else
+    {
+        auto& stringRegistry = m_corpus->GetStringRegistry();
+        bool loaded = false;
+        LoadOrBuildCache(sequenceKeyCache, L"sequence keys",
+            [&]() { return loaded = stringRegistry.TryLoad(sequenceKeyCache); },
+            [&]()
+            {
+                CreateDeserializers(config);
+                try
+                {
+                    stringRegistry.Save(sequenceKeyCache);
+                }
+                catch (const std::exception& e)
+                {
+                    // the keys are registered, only later runs will have to register them again
+                    fprintf(stderr, "WARNING: Could not write the sequence key cache (%ls): %s\n", sequenceKeyCache.c_str(), e.what());
+                }
+            },
+            [&]() { CreateDeserializers(config); });
+        if (loaded)
+        {
+            CreateDeserializers(config);
+        }
+    }
 
     if (m_deserializers.empty())
     {
@@ -88,6 +126,45 @@ CompositeDataReader::CompositeDataReader(const ConfigParameters& config) :
 
     int verbosity = config(L"verbosity", 0);
 
+    // With diskChunkCache = "<directory>", the chunks are written to files in the directory on first use, and read
+    // from there in later epochs and runs. diskChunkCacheName identifies the data set, diskChunkCacheMaxSizeInMB
+    // limits the size of the files (0 for no limit).
+    std::wstring diskChunkCache = config(L"diskChunkCache", L"");
+    if (!diskChunkCache.empty())
+    {
+        std::string name = config(L"diskChunkCacheName", "");
+        size_t maxSizeInMB = config(L"diskChunkCacheMaxSizeInMB", (size_t)0);
+        deserializer = std::make_shared<DiskChunkCache>(deserializer, diskChunkCache, name,
+                                                        maxSizeInMB == 0 ? SIZE_MAX : maxSizeInMB * 1024 * 1024, verbosity);
+    }
+
+    // With sharedChunkStore = "<name>", the processes on a machine that give the same name load each chunk once
+    // into shared memory, and the others take it over from there. The name has to identify the data set.
+    std::string sharedChunkStore = config(L"sharedChunkStore", "");
+    if (!sharedChunkStore.empty())
+    {
+        deserializer = std::make_shared<SharedChunkStore>(deserializer, sharedChunkStore, verbosity);
+    }
+
+    // With sharedChunkCache = "<name>", the readers of the process that give the same name (e.g. those of several
+    // trainers in one process) keep the chunks in one ChunkCache, and so load each chunk once. The name has to identify
+    // the data set; sharedChunkCacheMaxSizeInMB limits the size of the cached chunks (0 for no limit).
+    std::string sharedChunkCache = config(L"sharedChunkCache", "");
+    if (!sharedChunkCache.empty())
+    {
+        size_t maxSizeInMB = config(L"sharedChunkCacheMaxSizeInMB", (size_t)0);
+        deserializer = ChunkCache::GetShared(sharedChunkCache, deserializer,
+                                             maxSizeInMB == 0 ? SIZE_MAX : maxSizeInMB * 1024 * 1024, verbosity);
+    }
+
+    // With chunkStorage = "half" or "byte", the dense float and double streams of the chunks in the randomization
+    // window are kept in 16 or 8 bits, and widened when the minibatches are packed (see CompactChunkStore).
+    std::string chunkStorage = config(L"chunkStorage", "float");
+    if (chunkStorage != "float")
+    {
+        deserializer = std::make_shared<CompactChunkStore>(deserializer, CompactChunkStore::ParseEncoding(chunkStorage));
+    }
+
     // Pick up the randomizer, always picking up no randomization for the write mode.
     bool randomize = isActionWrite ? false : config(L"randomize", false);
 
@@ -95,35 +172,78 @@ CompositeDataReader::CompositeDataReader(const ConfigParameters& config) :
     // It makes sense to put it to true for cases when deserialization is CPU intensive,
     // i.e. decompression of images.
     bool multiThreadedDeserialization = config(L"multiThreadedDeserialization", false);
+
+    // With numDecodeThreads > 0, the multi-threaded deserialization and the transforms run on worker threads
+    // of the reader rather than in OpenMP parallel loops, so their number is independent of the OpenMP threads
+    // of the math library. decodeThreadsFirstCore >= 0 pins them to the cores starting at the given one,
+    // decodeThreadsNumaNode >= 0 to the cores of the given NUMA node (then numDecodeThreads = 0 means one per core of it).
+    // Readers with the same threads share them.
+    WorkerThreadPoolPtr workerThreadPool;
+    size_t numDecodeThreads = config(L"numDecodeThreads", (size_t)0);
+    int decodeThreadsNumaNode = config(L"decodeThreadsNumaNode", -1);
+    if (decodeThreadsNumaNode >= 0)
+    {
+        NumaTopology topology;
+        workerThreadPool = WorkerThreadPool::GetShared(numDecodeThreads, topology.Cores(decodeThreadsNumaNode % topology.NumNodes()));
+    }
+    else if (numDecodeThreads > 0)
+        workerThreadPool = WorkerThreadPool::GetShared(numDecodeThreads, (int)config(L"decodeThreadsFirstCore", -1));
+
     if (randomize)
     {
         // By default randomizing the whole data set.
         size_t randomizationWindow = config(L"randomizationWindow", requestDataSize);
         // By default using STL random number generator.
         bool useLegacyRandomization = config(L"useLegacyRandomization", false);
-        m_sequenceEnumerator = std::make_shared<BlockRandomizer>(verbosity, randomizationWindow, deserializer, true /* should Prefetch */, BlockRandomizer::DecimationMode::chunk, useLegacyRandomization, multiThreadedDeserialization);
+        // Number of chunks read ahead of the randomization window.
+        size_t prefetchDepth = config(L"prefetchDepth", (size_t)1);
+        // How the data is split among the workers of data-parallel training: by chunks (the default), or with
+        // "balancedSequence" by the sequences of each minibatch, so that the workers get about the same sum of padded
+        // sequence lengths when the lengths vary a lot (each worker then loads the chunks of its own sequences).
+        std::string decimation = config(L"decimationMode", "chunk");
+        BlockRandomizer::DecimationMode decimationMode;
+        if (decimation == "chunk")
+            decimationMode = BlockRandomizer::DecimationMode::chunk;
+        else if (decimation == "sequence")
+            decimationMode = BlockRandomizer::DecimationMode::sequence;
+        else if (decimation == "balancedSequence")
+            decimationMode = BlockRandomizer::DecimationMode::balancedSequence;
+        else
+            InvalidArgument("Unknown decimationMode '%s', expected 'chunk', 'sequence' or 'balancedSequence'.", decimation.c_str());
+        auto randomizer = std::make_shared<BlockRandomizer>(verbosity, randomizationWindow, deserializer, true /* should Prefetch */, decimationMode, useLegacyRandomization, multiThreadedDeserialization, prefetchDepth);
+        randomizer->SetWorkerThreadPool(workerThreadPool);
+        m_sequenceEnumerator = randomizer;
     }
     else
     {
-        m_sequenceEnumerator = std::make_shared<NoRandomizer>(deserializer, multiThreadedDeserialization);
+        auto randomizer = std::make_shared<NoRandomizer>(deserializer, multiThreadedDeserialization);
+        randomizer->SetWorkerThreadPool(workerThreadPool);
+        m_sequenceEnumerator = randomizer;
     }
 
     // In case when there are transforms, applying them to the data.
-    m_sequenceEnumerator = m_transforms.empty()
-        ? m_sequenceEnumerator
-        : std::make_shared<TransformController>(m_transforms, m_sequenceEnumerator);
+    if (!m_transforms.empty())
+    {
+        auto transformController = std::make_shared<TransformController>(m_transforms, m_sequenceEnumerator);
+        transformController->SetWorkerThreadPool(workerThreadPool);
+        m_sequenceEnumerator = transformController;
+    }
+
+    // With bucketingLookahead = K > 0, the next K sequences are grouped by length into minibatches,
+    // which are returned in random order, so that the minibatches need less padding.
+    size_t bucketingLookahead = isActionWrite ? 0 : config(L"bucketingLookahead", (size_t)0);
+    if (bucketingLookahead > 0)
+    {
+        if (m_packingMode != PackingMode::sequence)
+            InvalidArgument("bucketingLookahead is only supported when packing whole sequences, not with frameMode or truncated BPTT.");
+        m_sequenceEnumerator = std::make_shared<BucketingSequenceEnumerator>(m_sequenceEnumerator, bucketingLookahead);
+    }
 
     // TODO: Creating output stream descriptions - this should come from the network so that we can check 
     // that input matches what the network expects (including tensor shape, etc.).
     for (const auto& streamDescription : m_sequenceEnumerator->GetStreamDescriptions())
     {
         StreamDescriptionPtr stream = std::make_shared<StreamDescription>(*streamDescription);
-        if (m_packingMode == PackingMode::truncated)
-        {
-            // TODO: Currently BPTT does not support sparse format as output.
-            // We always require dense.
-            stream->m_storageType = StorageType::dense;
-        }
         m_streams.push_back(stream);
     }
 
@@ -137,7 +257,9 @@ CompositeDataReader::CompositeDataReader(const ConfigParameters& config) :
     case PackingMode::sequence:
         m_packer = std::make_shared<SequencePacker>(
             m_sequenceEnumerator,
-            m_streams);
+            m_streams,
+            2,
+            verbosity);
         break;
     case PackingMode::truncated:
     {
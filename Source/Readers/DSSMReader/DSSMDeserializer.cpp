@@ -0,0 +1,239 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include "DSSMDeserializer.h"
+#include "BinarySequenceData.h"
+#include "ElementTypeUtils.h"
+#include "StringUtil.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+using namespace std;
+
+// The header is packed, so the offsets of the rows are not necessarily aligned.
+static int64_t ReadInt64(const char* p)
+{
+    int64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Rows [m_firstRow, m_endRow) of all inputs, which sequences reference in the mapped files.
+class DSSMDeserializer::DSSMChunk : public Chunk, public std::enable_shared_from_this<DSSMChunk>
+{
+public:
+    DSSMChunk(const DSSMDeserializer& parent, size_t firstRow, size_t endRow)
+        : m_parent(parent), m_firstRow(firstRow), m_endRow(endRow), m_size(0)
+    {
+        // The chunk is about to be used, so its pages are read in right away, in parallel to the other prefetched chunks.
+        for (const auto& input : parent.m_inputs)
+        {
+            size_t offset, size;
+            parent.GetRowRange(input, firstRow, endRow, offset, size);
+            input.m_file->Advise(offset, size, MemoryMappedFile::Access::WillNeed);
+            m_files.push_back(input.m_file);
+            m_size += size;
+        }
+    }
+
+    void GetSequence(size_t sequenceId, std::vector<SequenceDataPtr>& result) override
+    {
+        if (sequenceId < m_firstRow || sequenceId >= m_endRow)
+            LogicError("DSSMDeserializer: Sequence %" PRIu64 " does not belong to the chunk.", (uint64_t) sequenceId);
+
+        const size_t elementSize = GetSizeByType(m_parent.m_elementType);
+        for (size_t i = 0; i < m_parent.m_inputs.size(); i++)
+        {
+            // a row: int32 nnz, nnz values, nnz int32 row indices
+            const Input& input = m_parent.m_inputs[i];
+            size_t offset = (size_t) ReadInt64(input.m_offsets + sequenceId * sizeof(int64_t));
+            int32_t nnz;
+            if (offset > input.m_dataSize || input.m_dataSize - offset < sizeof(nnz))
+                RuntimeError("DSSMDeserializer: Row %" PRIu64 " of '%ls' is beyond the end of the file, the file is corrupt.", (uint64_t) sequenceId, input.m_file->Path().c_str());
+            memcpy(&nnz, input.m_data + offset, sizeof(nnz));
+            if (nnz < 0 || (input.m_dataSize - offset - sizeof(nnz)) / (elementSize + sizeof(IndexType)) < (size_t) nnz)
+                RuntimeError("DSSMDeserializer: Row %" PRIu64 " of '%ls' is beyond the end of the file, the file is corrupt.", (uint64_t) sequenceId, input.m_file->Path().c_str());
+
+            auto sparse = make_shared<BinarySparseSequenceData>();
+            sparse->m_data = input.m_data + offset + sizeof(nnz);
+            sparse->m_indices = const_cast<IndexType*>(reinterpret_cast<const IndexType*>(sparse->m_data + nnz * elementSize));
+            sparse->m_nnzCounts.assign(1, (IndexType) nnz);
+            sparse->m_totalNnzCount = nnz;
+            sparse->m_id = sequenceId;
+            sparse->m_numberOfSamples = 1;
+            sparse->m_elementType = m_parent.m_elementType;
+            sparse->m_sampleLayout = m_parent.m_streams[i]->m_sampleLayout;
+            sparse->m_chunk = shared_from_this();
+            result.push_back(sparse);
+        }
+    }
+
+    size_t GetMemorySize() const override
+    {
+        // the mapped pages of the chunk, which are not freed either while the chunk is in use
+        return m_size;
+    }
+
+private:
+    const DSSMDeserializer& m_parent;
+    const size_t m_firstRow;
+    const size_t m_endRow;
+    size_t m_size;
+    // Keep the mappings alive for as long as sequences of the chunk are.
+    vector<shared_ptr<MemoryMappedFile>> m_files;
+};
+
+DSSMDeserializer::DSSMDeserializer(CorpusDescriptorPtr /*corpus*/, const ConfigParameters& config, bool /*primary*/)
+    : m_numberOfRows(0)
+{
+    string precision = config.Find("precision", "float");
+    m_elementType = AreEqualIgnoreCase(precision, "double") ? ElementType::tdouble : ElementType::tfloat;
+
+    if (!config.ExistsCurrent(L"input"))
+        InvalidArgument("DSSMDeserializer configuration does not contain \"input\" section.");
+
+    const ConfigParameters& input = config(L"input");
+    for (const pair<string, ConfigParameters>& section : input)
+    {
+        const ConfigParameters& streamConfig = section.second;
+        if (!streamConfig.ExistsCurrent(L"file"))
+            InvalidArgument("DSSMDeserializer: Input '%s' does not specify a file.", section.first.c_str());
+
+        size_t dimension = streamConfig(L"dim", (size_t) 0);
+        if (dimension == 0)
+            InvalidArgument("DSSMDeserializer: Input '%s' does not specify its dimension 'dim'.", section.first.c_str());
+
+        OpenInput(streamConfig(L"file"));
+        auto stream = make_shared<StreamDescription>();
+        stream->m_id = m_streams.size();
+        stream->m_name = msra::strfun::utf16(section.first);
+        stream->m_storageType = StorageType::sparse_csc;
+        stream->m_elementType = m_elementType;
+        stream->m_sampleLayout = make_shared<TensorShape>(dimension);
+        m_streams.push_back(stream);
+    }
+    if (m_inputs.empty())
+        InvalidArgument("DSSMDeserializer configuration contains an empty \"input\" section.");
+
+    size_t chunkSizeInBytes = config(L"chunkSizeInBytes", (size_t) 32 * 1024 * 1024);
+    CreateChunks(chunkSizeInBytes);
+
+    fprintf(stderr, "DSSMDeserializer: %" PRIu64 " rows in %" PRIu64 " chunks\n", (uint64_t) m_numberOfRows, (uint64_t) m_chunkDescriptions.size());
+}
+
+// The layout of a file (see DSSM_BinaryInput::Init()):
+//     int64 number of rows, int32 number of columns, int64 total number of non zero values
+//     int64 offsets of the rows, relative to the start of the data
+//     data: the rows
+void DSSMDeserializer::OpenInput(const wstring& path)
+{
+    const size_t headerSize = 2 * sizeof(int64_t) + sizeof(int32_t);
+
+    Input input;
+    input.m_file = make_shared<MemoryMappedFile>(path);
+    const char* data = input.m_file->Data();
+    if (input.m_file->Size() < headerSize)
+        RuntimeError("DSSMDeserializer: '%ls' is not a DSSM binary file.", path.c_str());
+
+    int64_t numberOfRows = ReadInt64(data);
+    if (numberOfRows < 0 || (uint64_t) numberOfRows > (input.m_file->Size() - headerSize) / sizeof(int64_t))
+        RuntimeError("DSSMDeserializer: The row offsets of '%ls' are beyond the end of the file, the file is truncated.", path.c_str());
+    if (!m_inputs.empty() && (size_t) numberOfRows != m_numberOfRows)
+        InvalidArgument("DSSMDeserializer: '%ls' has %" PRId64 " rows, the other inputs %" PRIu64 ".", path.c_str(), numberOfRows, (uint64_t) m_numberOfRows);
+
+    input.m_offsets = data + headerSize;
+    input.m_data = data + headerSize + numberOfRows * sizeof(int64_t);
+    input.m_dataSize = input.m_file->Size() - (input.m_data - data);
+
+    // The offsets are all that is read of the file up front; the rows are only read by the workers that own them.
+    input.m_file->Advise(headerSize, numberOfRows * sizeof(int64_t), MemoryMappedFile::Access::Sequential);
+    m_numberOfRows = (size_t) numberOfRows;
+    m_inputs.push_back(input);
+}
+
+void DSSMDeserializer::GetRowRange(const Input& input, size_t begin, size_t end, size_t& offset, size_t& size) const
+{
+    size_t first = begin < m_numberOfRows ? (size_t) ReadInt64(input.m_offsets + begin * sizeof(int64_t)) : input.m_dataSize;
+    size_t last = end < m_numberOfRows ? (size_t) ReadInt64(input.m_offsets + end * sizeof(int64_t)) : input.m_dataSize;
+    if (first > last || last > input.m_dataSize)
+        RuntimeError("DSSMDeserializer: The row offsets of '%ls' are invalid, the file is corrupt.", input.m_file->Path().c_str());
+    offset = (size_t) (input.m_data - input.m_file->Data()) + first;
+    size = last - first;
+}
+
+void DSSMDeserializer::CreateChunks(size_t chunkSizeInBytes)
+{
+    // Rows are added to a chunk until the chunk reaches the size, summed over the inputs.
+    size_t chunkSize = 0;
+    for (size_t row = 0; row < m_numberOfRows; row++)
+    {
+        if (m_chunkFirstRows.empty() || chunkSize >= chunkSizeInBytes)
+        {
+            m_chunkFirstRows.push_back(row);
+            chunkSize = 0;
+        }
+        for (const auto& input : m_inputs)
+        {
+            size_t offset, size;
+            GetRowRange(input, row, row + 1, offset, size);
+            chunkSize += size;
+        }
+    }
+
+    for (size_t i = 0; i < m_chunkFirstRows.size(); i++)
+    {
+        size_t end = i + 1 < m_chunkFirstRows.size() ? m_chunkFirstRows[i + 1] : m_numberOfRows;
+        auto description = make_shared<ChunkDescription>();
+        description->m_id = (ChunkIdType) i;
+        description->m_numberOfSamples = end - m_chunkFirstRows[i];
+        description->m_numberOfSequences = end - m_chunkFirstRows[i];
+        m_chunkDescriptions.push_back(description);
+    }
+    m_chunkFirstRows.push_back(m_numberOfRows);
+}
+
+ChunkDescriptions DSSMDeserializer::GetChunkDescriptions()
+{
+    return m_chunkDescriptions;
+}
+
+void DSSMDeserializer::GetSequencesForChunk(ChunkIdType chunkId, vector<SequenceDescription>& result)
+{
+    size_t begin = m_chunkFirstRows[chunkId], end = m_chunkFirstRows[chunkId + 1];
+    result.reserve(result.size() + end - begin);
+    for (size_t i = begin; i < end; i++)
+    {
+        SequenceDescription description;
+        description.m_id = i;
+        description.m_numberOfSamples = 1;
+        description.m_chunkId = chunkId;
+        description.m_key.m_sequence = i; // the files have no keys, the rows are identified by their position
+        description.m_key.m_sample = 0;
+        result.push_back(description);
+    }
+}
+
+ChunkPtr DSSMDeserializer::GetChunk(ChunkIdType chunkId)
+{
+    return make_shared<DSSMChunk>(*this, m_chunkFirstRows[chunkId], m_chunkFirstRows[chunkId + 1]);
+}
+
+bool DSSMDeserializer::GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& result)
+{
+    if (key.m_sequence >= m_numberOfRows)
+        return false;
+
+    auto chunk = upper_bound(m_chunkFirstRows.begin(), m_chunkFirstRows.end(), (size_t) key.m_sequence) - 1;
+    result.m_id = key.m_sequence;
+    result.m_numberOfSamples = 1;
+    result.m_chunkId = (ChunkIdType) (chunk - m_chunkFirstRows.begin());
+    result.m_key = key;
+    return true;
+}
+
+}}}
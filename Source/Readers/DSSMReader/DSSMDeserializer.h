@@ -0,0 +1,66 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include "DataDeserializerBase.h"
+#include "Config.h"
+#include "CorpusDescriptor.h"
+#include "MemoryMappedFile.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Deserializer of the binary sparse files of the DSSMReader (see DSSM_BinaryInput), for use with the composite reader,
+// so that the query/document inputs get randomization, distributed reading and prefetch. Each input is a file of its
+// own with one sparse sample per row; all of them must have the same number of rows, row i of the query file being the
+// query of the document in row i of the document file. The files are memory mapped; a chunk is a range of rows, which
+// is paged in when the chunk is loaded, and the samples are handed to the packer straight from the mapped pages.
+// With chunk decimation, each worker only ever touches the pages of its own chunks.
+class DSSMDeserializer : public DataDeserializerBase
+{
+public:
+    // Config:
+    //     precision = "float"             # as the files were written
+    //     chunkSizeInBytes = 33554432     # rows are grouped into chunks of about this size, summed over the inputs
+    //     input = [
+    //         query = [ file = "query.bin" ; dim = 49292 ]
+    //         doc = [ file = "doc.bin" ; dim = 49292 ]
+    //     ]
+    DSSMDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& config, bool primary);
+
+    ChunkDescriptions GetChunkDescriptions() override;
+    void GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& descriptions) override;
+    ChunkPtr GetChunk(ChunkIdType chunkId) override;
+
+protected:
+    bool GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& description) override;
+
+private:
+    class DSSMChunk;
+
+    // A mapped file and where its rows are.
+    struct Input
+    {
+        std::shared_ptr<MemoryMappedFile> m_file;
+        const char* m_offsets; // int64 per row, relative to m_data, in the mapping and not aligned
+        const char* m_data;
+        size_t m_dataSize;
+    };
+
+    void OpenInput(const std::wstring& path);
+    void CreateChunks(size_t chunkSizeInBytes);
+
+    // [offset, offset + size) of rows [begin, end) in the file of an input
+    void GetRowRange(const Input& input, size_t begin, size_t end, size_t& offset, size_t& size) const;
+
+    ElementType m_elementType;
+    std::vector<Input> m_inputs; // one per stream
+    size_t m_numberOfRows;
+
+    std::vector<size_t> m_chunkFirstRows; // and m_numberOfRows at the end
+    ChunkDescriptions m_chunkDescriptions;
+};
+
+}}}
@@ -11,10 +11,13 @@
 #define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
 #endif
 
+#include "Platform.h"
+#ifdef __WINDOWS__
 #define WIN32_LEAN_AND_MEAN // Exclude rarely-used stuff from Windows headers
 // Windows Header Files:
 #define NOMINMAX
 #include "Windows.h"
+#endif
 
 // standard C stuff
 #include <stdio.h>
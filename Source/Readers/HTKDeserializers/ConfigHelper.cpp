@@ -7,6 +7,7 @@
 #include "ConfigHelper.h"
 #include "DataReader.h"
 #include "StringUtil.h"
+#include "../HTKMLFReader/htkfeatio.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -172,6 +173,25 @@ vector<wstring> ConfigHelper::GetMlfPaths() const
     return result;
 }
 
+vector<wstring> ConfigHelper::GetKaldiAlignmentPaths() const
+{
+    vector<wstring> result;
+    if (m_config.ExistsCurrent(L"kaldiAlignmentFile"))
+    {
+        result.push_back(m_config(L"kaldiAlignmentFile"));
+    }
+    else if (m_config.ExistsCurrent(L"kaldiAlignmentFileList"))
+    {
+        wstring list = m_config(L"kaldiAlignmentFileList");
+        for (msra::files::textreader r(list); r;)
+        {
+            result.push_back(r.wgetline());
+        }
+    }
+
+    return result;
+}
+
 size_t ConfigHelper::GetRandomizationWindow()
 {
     size_t result = randomizeAuto;
@@ -209,9 +229,9 @@ wstring ConfigHelper::GetRandomizer()
         InvalidArgument("'readMethod' must be 'none' for write action.");
     }
 
-    if (randomizer == L"blockRandomize" && GetRandomizationWindow() == randomizeNone)
+    if ((randomizer == L"blockRandomize" || randomizer == L"rollingWindow") && GetRandomizationWindow() == randomizeNone)
     {
-        InvalidArgument("'randomize' cannot be 'none' when 'readMethod' is 'blockRandomize'.");
+        InvalidArgument("'randomize' cannot be 'none' when 'readMethod' is '%ls'.", randomizer.c_str());
     }
 
     return randomizer;
@@ -242,6 +262,22 @@ vector<wstring> ConfigHelper::GetSequencePaths()
 
     fprintf(stderr, " %d entries\n", static_cast<int>(filelist.size()));
 
+    // Kaldi .scp lines 'key path.ark:offset' are turned into 'key=path.ark:offset', and get their frame range below
+    const bool kaldi = IsKaldiScp();
+    if (kaldi)
+    {
+        for (auto& entry : filelist)
+        {
+            size_t separator = entry.find_first_of(L" \t");
+            size_t path = separator == wstring::npos ? wstring::npos : entry.find_first_not_of(L" \t", separator);
+            if (path == wstring::npos)
+                RuntimeError("Invalid Kaldi script file entry '%ls', expected 'key path.ark:offset'.", entry.c_str());
+            entry = entry.substr(0, separator) + L"=" + entry.substr(path);
+            while (!entry.empty() && (entry.back() == L'\r' || entry.back() == L' ' || entry.back() == L'\t'))
+                entry.pop_back();
+        }
+    }
+
     // post processing file list :
     //  - if users specified PrefixPath, add the prefix to each of path in filelist
     //  - else do the dotdotdot expansion if necessary
@@ -301,9 +337,73 @@ vector<wstring> ConfigHelper::GetSequencePaths()
         }
     }
 
+    if (kaldi)
+        AddKaldiFrameRanges(filelist);
+
     return filelist;
 }
 
+bool ConfigHelper::IsKaldiScp() const
+{
+    wstring format = m_config(L"scpFormat", L"htk");
+    if (AreEqualIgnoreCase(format, wstring(L"kaldi")))
+        return true;
+    if (!AreEqualIgnoreCase(format, wstring(L"htk")))
+        InvalidArgument("scpFormat must be 'htk' or 'kaldi'.");
+    return false;
+}
+
+// Appends '[0,n-1]' to the Kaldi entries, with the number of frames n taken from the utt2numFramesFile (Kaldi's
+// utt2num_frames) if given, else read from the matrix headers in the archives, once.
+// Empty matrices are dropped.
+void ConfigHelper::AddKaldiFrameRanges(vector<wstring>& filelist) const
+{
+    unordered_map<wstring, size_t> numberOfFrames;
+    wstring utt2NumFramesPath = m_config(L"utt2numFramesFile", L"");
+    if (!utt2NumFramesPath.empty())
+    {
+        for (msra::files::textreader r(utt2NumFramesPath); r;)
+        {
+            vector<wstring> fields = msra::strfun::split(r.wgetline(), L" \t\r");
+            if (fields.empty())
+                continue;
+            if (fields.size() != 2)
+                RuntimeError("Invalid line in utt2numFramesFile '%ls', expected 'key frames'.", utt2NumFramesPath.c_str());
+            numberOfFrames[fields[0]] = msra::strfun::toint(fields[1]);
+        }
+    }
+
+    msra::asr::htkfeatreader reader;
+    size_t kept = 0;
+    for (const auto& entry : filelist)
+    {
+        wstring key = entry.substr(0, entry.find(L'='));
+        size_t frames;
+        if (!numberOfFrames.empty())
+        {
+            auto frame = numberOfFrames.find(key);
+            if (frame == numberOfFrames.end())
+                RuntimeError("Utterance '%ls' is missing from the utt2numFramesFile.", key.c_str());
+            frames = frame->second;
+        }
+        else
+        {
+            msra::asr::htkfeatreader::parsedpath path(entry);
+            if (!path.iskaldi())
+                RuntimeError("Invalid Kaldi script file entry '%ls', expected 'key path.ark:offset'.", entry.c_str());
+            frames = reader.getkaldinumframes(path);
+        }
+
+        if (frames == 0)
+            continue;
+        filelist[kept++] = msra::strfun::wstrprintf(L"%ls[0,%d]", entry.c_str(), (int) frames - 1);
+    }
+
+    if (kept != filelist.size())
+        fprintf(stderr, "Dropped %d empty utterances of the Kaldi script file.\n", (int) (filelist.size() - kept));
+    filelist.resize(kept);
+}
+
 intargvector ConfigHelper::GetNumberOfUtterancesPerMinibatchForAllEppochs()
 {
     intargvector numberOfUtterances = m_config(L"nbruttsineachrecurrentiter", ConfigParameters::Array(intargvector(vector<int>{1})));
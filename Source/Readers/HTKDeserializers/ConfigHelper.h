@@ -49,6 +49,10 @@ public:
     // Gets mlf file paths from the configuraiton.
     std::vector<std::wstring> GetMlfPaths() const;
 
+    // Gets the paths of the Kaldi alignment archives (kaldiAlignmentFile or kaldiAlignmentFileList), empty if the
+    // labels come from mlf files.
+    std::vector<std::wstring> GetKaldiAlignmentPaths() const;
+
     // Gets utterance paths from the configuration.
     std::vector<std::wstring> GetSequencePaths();
 
@@ -67,6 +71,12 @@ private:
     // Expands ... in the name of the feature path.
     void ExpandDotDotDot(std::wstring& featPath, const std::wstring& scpPath, std::wstring& scpDirCached);
 
+    // Whether the scpFile is a Kaldi script file (scpFormat = "kaldi") rather than an HTK one.
+    bool IsKaldiScp() const;
+
+    // Adds the frame ranges to the entries of a Kaldi script file.
+    void AddKaldiFrameRanges(std::vector<std::wstring>& filelist) const;
+
     const ConfigParameters& m_config;
 };
 
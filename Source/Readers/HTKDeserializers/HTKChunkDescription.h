@@ -7,10 +7,12 @@
 
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <atomic>
 #include "DataDeserializer.h"
 #include "../HTKMLFReader/htkfeatio.h"
 #include "UtteranceDescription.h"
 #include "ssematrix.h"
+#include "WorkerThreadPool.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -36,6 +38,9 @@ class HTKChunkDescription
     // Chunk id.
     ChunkIdType m_chunkId;
 
+    // Parts of a chunk that are read in parallel are at least this large.
+    static const size_t c_minPartBytes = 4 * 1024 * 1024;
+
 public:
 
     HTKChunkDescription() : m_chunkId(CHUNKID_MAX) { };
@@ -118,7 +123,11 @@ public:
     // Pages-in the data for this chunk.
     // this function supports retrying since we read from the unreliable network, i.e. do not return in a broken state
     // We pass in the feature info variables to check that that data being read has expected properties.
-    void RequireData(const string& featureKind, size_t featureDimension, unsigned int samplePeriod, int verbosity = 0) const
+    // Utterances that follow each other in the same archive are read with a single read straight into the frames
+    // of the chunk. With a thread pool, the utterances are split into about as many parts as the pool has threads,
+    // which are read in parallel.
+    void RequireData(const string& featureKind, size_t featureDimension, unsigned int samplePeriod, int verbosity = 0,
+                     const WorkerThreadPoolPtr& pool = nullptr) const
     {
         if (GetNumberOfUtterances() == 0)
         {
@@ -132,26 +141,68 @@ public:
 
         try
         {
-            // feature reader (we reinstantiate it for each block, i.e. we reopen the file actually)
-            // if this is the first feature read ever, we explicitly open the first file to get the information such as feature dimension
-            msra::asr::htkfeatreader reader;
-
-            // read all utterances; if they are in the same archive, htkfeatreader will be efficient in not closing the file
             m_frames.resize(featureDimension, m_totalFrames);
-            foreach_index(i, m_utterances)
+
+            // Parts of consecutive utterances, given by their first utterance.
+            const size_t minPartFrames = c_minPartBytes / (sizeof(float) * featureDimension) + 1;
+            const size_t partFrames = pool ? std::max((m_totalFrames + pool->NumThreads() - 1) / pool->NumThreads(), minPartFrames) : m_totalFrames;
+            std::vector<size_t> parts;
+            for (size_t i = 0; i < m_utterances.size(); ++i)
+            {
+                if (parts.empty() || m_firstFrames[i] - m_firstFrames[parts.back()] >= partFrames)
+                    parts.push_back(i);
+            }
+            parts.push_back(m_utterances.size());
+
+            std::atomic<size_t> numberOfReads(0);
+            auto readPart = [&](size_t part)
+            {
+                // feature reader (we reinstantiate it for each part, i.e. we reopen the file actually)
+                // if the utterances are in the same archive, htkfeatreader will be efficient in not closing the file
+                msra::asr::htkfeatreader reader;
+                for (size_t i = parts[part]; i < parts[part + 1];)
+                {
+                    size_t end = i + 1;
+                    while (end < parts[part + 1] && m_utterances[end].GetPath().follows(m_utterances[end - 1].GetPath()))
+                        end++;
+
+                    const size_t frames = m_firstFrames[end - 1] + m_utterances[end - 1].GetNumberOfFrames() - m_firstFrames[i];
+                    if (reader.readframes(m_utterances[i].GetPath(), featureKind, samplePeriod, frames, m_frames, m_firstFrames[i]))
+                    {
+                        numberOfReads++;
+                    }
+                    else
+                    {
+                        // the frames need to be converted, reading them one utterance at a time
+                        for (size_t j = i; j < end; ++j)
+                        {
+                            auto framesWrapper = GetUtteranceFrames(j);
+                            reader.read(m_utterances[j].GetPath(), featureKind, samplePeriod, framesWrapper);
+                            numberOfReads++;
+                        }
+                    }
+                    i = end;
+                }
+            };
+
+            if (pool && parts.size() > 2)
+            {
+                pool->ParallelFor(parts.size() - 1, readPart);
+            }
+            else
             {
-                // read features for this file
-                auto framesWrapper = GetUtteranceFrames(i);
-                reader.read(m_utterances[i].GetPath(), featureKind, samplePeriod, framesWrapper);
+                for (size_t part = 0; part + 1 < parts.size(); ++part)
+                    readPart(part);
             }
 
             if (verbosity)
             {
-                fprintf(stderr, "HTKChunkDescription::RequireData: read physical chunk %u (%" PRIu64 " utterances, %" PRIu64 " frames, %" PRIu64 " bytes)\n",
+                fprintf(stderr, "HTKChunkDescription::RequireData: read physical chunk %u (%" PRIu64 " utterances, %" PRIu64 " frames, %" PRIu64 " bytes) in %" PRIu64 " reads\n",
                         m_chunkId,
                         m_utterances.size(),
                         m_totalFrames,
-                        sizeof(float) * m_frames.rows() * m_frames.cols());
+                        sizeof(float) * m_frames.rows() * m_frames.cols(),
+                        (uint64_t)numberOfReads.load());
             }
         }
         catch (...)
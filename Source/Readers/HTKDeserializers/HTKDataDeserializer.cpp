@@ -36,6 +36,11 @@ HTKDataDeserializer::HTKDataDeserializer(
 
     m_verbosity = cfg(L"verbosity", 0);
 
+    // With numChunkLoadThreads != 1, the utterances of a chunk are read by as many threads, 0 means one per core.
+    size_t numChunkLoadThreads = cfg(L"numChunkLoadThreads", (size_t)1);
+    if (numChunkLoadThreads != 1)
+        m_chunkLoadThreadPool = make_shared<WorkerThreadPool>(numChunkLoadThreads);
+
     argvector<ConfigValue> inputs = cfg("input");
     if (inputs.size() != 1)
     {
@@ -84,6 +89,10 @@ HTKDataDeserializer::HTKDataDeserializer(
 
     m_verbosity = feature(L"verbosity", 0);
 
+    size_t numChunkLoadThreads = feature(L"numChunkLoadThreads", (size_t)1);
+    if (numChunkLoadThreads != 1)
+        m_chunkLoadThreadPool = make_shared<WorkerThreadPool>(numChunkLoadThreads);
+
     auto context = config.GetContextWindow();
     m_elementType = config.GetElementType();
 
@@ -337,7 +346,7 @@ public:
         // making several attempts
         msra::util::attempt(5, [&]()
         {
-            chunkDescription.RequireData(m_parent->m_featureKind, m_parent->m_ioFeatureDimension, m_parent->m_samplePeriod, m_parent->m_verbosity);
+            chunkDescription.RequireData(m_parent->m_featureKind, m_parent->m_ioFeatureDimension, m_parent->m_samplePeriod, m_parent->m_verbosity, m_parent->m_chunkLoadThreadPool);
         });
     }
 
@@ -34,6 +34,12 @@ public:
     // Retrieves data for a chunk.
     virtual ChunkPtr GetChunk(ChunkIdType chunkId) override;
 
+    // Each chunk pages in its own utterances, with readers of its own.
+    virtual bool SupportsConcurrentGetChunk() const override
+    {
+        return true;
+    }
+
     // Gets sequence description by the primary one.
     virtual bool GetSequenceDescription(const SequenceDescription& primary, SequenceDescription&) override;
 
@@ -67,6 +73,9 @@ private:
     // General configuration
     int m_verbosity;
 
+    // Threads that read the utterances of a chunk in parallel, none if the chunk is read by the loading thread alone.
+    WorkerThreadPoolPtr m_chunkLoadThreadPool;
+
     // Total number of frames.
     size_t m_totalNumberOfFrames = 0;
 
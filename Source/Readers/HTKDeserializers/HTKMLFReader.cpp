@@ -114,13 +114,29 @@ HTKMLFReader::HTKMLFReader(const ConfigParameters& readerConfig)
     {
         m_sequenceEnumerator = std::make_shared<BlockRandomizer>(verbosity, window, bundler, true  /* should Prefetch */, BlockRandomizer::DecimationMode::chunk, true /* useLegacyRandomization */);
     }
+    else if (AreEqualIgnoreCase(readMethod, std::wstring(L"rollingWindow")))
+    {
+        // The rolling window of the legacy reader holds all frames in a (paged) vector and randomizes them inside a
+        // window that moves over it. The block randomizer gives the same frame-level randomization with a window of
+        // the same size, but only keeps the chunks of the window in memory and reads them from the feature files
+        // (as whole chunks, in the background), so that neither the page file nor the RAM for all frames is needed.
+        if (!frameMode)
+        {
+            InvalidArgument("readMethod 'rollingWindow' requires frameMode.");
+        }
+        if (readerConfig.Exists(L"pageFilePath"))
+        {
+            fprintf(stderr, "HTKMLFReader: WARNING: 'pageFilePath' is ignored, the frames are paged in from the feature files as the window moves.\n");
+        }
+        m_sequenceEnumerator = std::make_shared<BlockRandomizer>(verbosity, window, bundler, true  /* should Prefetch */, BlockRandomizer::DecimationMode::chunk, true /* useLegacyRandomization */);
+    }
     else if (AreEqualIgnoreCase(readMethod, std::wstring(L"none")))
     {
         m_sequenceEnumerator = std::make_shared<NoRandomizer>(bundler);
     }
     else
     {
-        RuntimeError("readMethod must be 'blockRandomize' or 'none'.");
+        RuntimeError("readMethod must be 'blockRandomize', 'rollingWindow' or 'none'.");
     }
 
     // Create output stream descriptions (all dense)
@@ -0,0 +1,198 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include "LatticeDeserializer.h"
+#include "fileutil.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+using namespace std;
+
+// The lattices of a chunk, read when the chunk is paged in.
+class LatticeDeserializer::LatticeChunk : public Chunk
+{
+    size_t m_firstSequence;
+    vector<shared_ptr<const msra::dbn::latticepair>> m_lattices; // [sequence id - m_firstSequence]
+
+public:
+    LatticeChunk(LatticeDeserializer& parent, ChunkIdType chunkId)
+    {
+        const auto& description = parent.m_chunks[chunkId];
+        m_firstSequence = chunkId * parent.m_chunkSize;
+        m_lattices.reserve(description->m_numberOfSequences);
+        for (size_t i = 0; i < description->m_numberOfSequences; ++i)
+        {
+            m_lattices.push_back(parent.ReadLattices(m_firstSequence + i));
+        }
+    }
+
+    virtual void GetSequence(size_t sequenceId, vector<SequenceDataPtr>& result) override
+    {
+        assert(sequenceId >= m_firstSequence && sequenceId < m_firstSequence + m_lattices.size());
+        auto sequence = make_shared<LatticeSequenceData>();
+        sequence->m_id = sequenceId;
+        sequence->m_lattices = m_lattices[sequenceId - m_firstSequence];
+        sequence->m_numberOfSamples = (uint32_t) sequence->m_lattices->second.getnumframes();
+        result.push_back(sequence);
+    }
+};
+
+LatticeDeserializer::LatticeDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& cfg, bool primary)
+{
+    // Lattices cannot control chunking.
+    if (primary)
+    {
+        LogicError("Lattice deserializer does not support primary mode - it cannot control chunking.");
+    }
+
+    // The lattices cover whole utterances.
+    bool frameMode = (ConfigValue) cfg("frameMode", "true");
+    if (frameMode)
+    {
+        LogicError("Lattice deserializer requires frameMode=false.");
+    }
+
+    argvector<ConfigValue> inputs = cfg("input");
+    if (inputs.size() != 1)
+    {
+        LogicError("LatticeDeserializer supports a single input stream only.");
+    }
+
+    ConfigParameters input = inputs.front();
+    auto inputName = input.GetMemberIds().front();
+    ConfigParameters streamConfig = input(inputName);
+
+    // The same settings as of the lattice and HMM sections of the HTKMLFReader.
+    pair<vector<wstring>, vector<wstring>> latticeTocs;
+    expand_wildcards(streamConfig(L"denLatTocFile"), latticeTocs.second);
+    if (streamConfig.Exists(L"numLatTocFile"))
+    {
+        expand_wildcards(streamConfig(L"numLatTocFile"), latticeTocs.first);
+    }
+    wstring prefixPathInToc = streamConfig(L"prefixPathInToc", L"");
+
+    wstring phoneFile = streamConfig(L"phoneFile");
+    wstring stateListFile = streamConfig(L"labelMappingFile");
+    wstring transPFile = streamConfig(L"transPFile", L"");
+    m_hset.loadfromfile(phoneFile, stateListFile, transPFile);
+
+    m_chunkSize = streamConfig(L"latticesPerChunk", (size_t) 256);
+    if (m_chunkSize == 0)
+    {
+        InvalidArgument("LatticeDeserializer: latticesPerChunk must be greater than 0.");
+    }
+
+    m_lattices.reset(new msra::dbn::latticesource(latticeTocs, m_hset.getsymmap(), prefixPathInToc));
+    if (m_lattices->empty())
+    {
+        RuntimeError("LatticeDeserializer: No lattices found in '%ls'.", ((wstring) streamConfig(L"denLatTocFile")).c_str());
+    }
+
+    InitializeChunkDescriptions(corpus);
+    InitializeStream(inputName);
+}
+
+void LatticeDeserializer::InitializeChunkDescriptions(CorpusDescriptorPtr corpus)
+{
+    const auto& stringRegistry = corpus->GetStringRegistry();
+
+    // Only the lattices of utterances known to the corpus are kept, in the order of the archives.
+    for (const auto& key : m_lattices->getkeys())
+    {
+        size_t id = 0;
+        if (!stringRegistry.TryGet(msra::strfun::utf8(key), id) || !m_lattices->haslattice(key))
+        {
+            continue;
+        }
+
+        if (m_keyToSequence.size() <= id)
+        {
+            m_keyToSequence.resize(id + 1, SIZE_MAX);
+        }
+        m_keyToSequence[id] = m_keys.size();
+        m_keys.push_back(key);
+        m_keyIds.push_back(id);
+    }
+
+    for (size_t firstSequence = 0; firstSequence < m_keys.size(); firstSequence += m_chunkSize)
+    {
+        auto chunk = make_shared<ChunkDescription>();
+        chunk->m_id = (ChunkIdType) m_chunks.size();
+        chunk->m_numberOfSequences = min(m_chunkSize, m_keys.size() - firstSequence);
+        chunk->m_numberOfSamples = 0; // not known before the lattices are read
+        m_chunks.push_back(chunk);
+    }
+
+    fprintf(stderr, "LatticeDeserializer: %" PRIu64 " lattices in %" PRIu64 " chunks\n", (uint64_t) m_keys.size(), (uint64_t) m_chunks.size());
+}
+
+void LatticeDeserializer::InitializeStream(const wstring& name)
+{
+    // A single stream of lattices.
+    StreamDescriptionPtr stream = make_shared<StreamDescription>();
+    stream->m_id = 0;
+    stream->m_name = name;
+    stream->m_sampleLayout = make_shared<TensorShape>(1);
+    stream->m_storageType = StorageType::dense;
+    stream->m_elementType = ElementType::tvariant;
+    m_streams.push_back(stream);
+}
+
+ChunkDescriptions LatticeDeserializer::GetChunkDescriptions()
+{
+    return m_chunks;
+}
+
+void LatticeDeserializer::GetSequencesForChunk(ChunkIdType chunkId, vector<SequenceDescription>& result)
+{
+    const auto& chunk = m_chunks[chunkId];
+    size_t firstSequence = chunkId * m_chunkSize;
+    result.reserve(result.size() + chunk->m_numberOfSequences);
+    for (size_t i = firstSequence; i < firstSequence + chunk->m_numberOfSequences; ++i)
+    {
+        SequenceDescription description;
+        description.m_id = i;
+        description.m_numberOfSamples = 0;
+        description.m_chunkId = chunkId;
+        description.m_key.m_sequence = m_keyIds[i];
+        description.m_key.m_sample = 0;
+        result.push_back(description);
+    }
+}
+
+ChunkPtr LatticeDeserializer::GetChunk(ChunkIdType chunkId)
+{
+    return make_shared<LatticeChunk>(*this, chunkId);
+}
+
+bool LatticeDeserializer::GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& result)
+{
+    auto sequenceId = key.m_sequence < m_keyToSequence.size() ? m_keyToSequence[key.m_sequence] : SIZE_MAX;
+    if (sequenceId == SIZE_MAX)
+    {
+        return false;
+    }
+
+    result.m_id = sequenceId;
+    result.m_chunkId = (ChunkIdType) (sequenceId / m_chunkSize);
+    result.m_key = key;
+
+    // The number of frames is only known after the lattice is read; the bundler takes that of the features.
+    result.m_numberOfSamples = 0;
+    return true;
+}
+
+shared_ptr<const msra::dbn::latticepair> LatticeDeserializer::ReadLattices(size_t sequenceId)
+{
+    shared_ptr<const msra::dbn::latticepair> lattices;
+    lock_guard<mutex> lock(m_readLock);
+    m_lattices->getlattices(m_keys[sequenceId], lattices, SIZE_MAX, /*compact=*/true);
+    return lattices;
+}
+
+}}}
@@ -0,0 +1,79 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <mutex>
+#include "DataDeserializerBase.h"
+#include "CorpusDescriptor.h"
+#include "Config.h"
+#include "latticesource.h"
+#include "simplesenonehmm.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// The lattices of an utterance, as returned by the lattice deserializer (the stream has element type tvariant):
+// GetDataBuffer() points to the msra::dbn::latticepair.
+struct LatticeSequenceData : DenseSequenceData
+{
+    std::shared_ptr<const msra::dbn::latticepair> m_lattices;
+
+    const void* GetDataBuffer() override
+    {
+        return m_lattices.get();
+    }
+};
+
+// Provides the lattices of the utterances for sequence training (MMI, sMBR), one sequence per utterance.
+// It cannot control chunking: the bundler looks the lattices up by the keys of the primary (HTK feature)
+// deserializer. A chunk is a run of lattices that are consecutive in the archives, so that the lattices of a
+// feature chunk are mostly read sequentially; they are kept as long as the chunk, in the compact form of the archive.
+class LatticeDeserializer : public DataDeserializerBase
+{
+public:
+    // Expects new configuration.
+    LatticeDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& config, bool primary);
+
+    // Gets description of all chunks.
+    virtual ChunkDescriptions GetChunkDescriptions() override;
+
+    // Get sequence descriptions of a particular chunk.
+    virtual void GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& result) override;
+
+    // Retrieves a chunk with data.
+    virtual ChunkPtr GetChunk(ChunkIdType chunkId) override;
+
+    // The HMM set the lattices are mapped to, as needed by the sequence training criterion.
+    const msra::asr::simplesenonehmm& GetHmm() const
+    {
+        return m_hset;
+    }
+
+protected:
+    // Retrieves sequence description by its key. Used for deserializers that are not in "primary"/"driving" mode.
+    virtual bool GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& result) override;
+
+private:
+    class LatticeChunk;
+    DISABLE_COPY_AND_MOVE(LatticeDeserializer);
+
+    void InitializeChunkDescriptions(CorpusDescriptorPtr corpus);
+    void InitializeStream(const std::wstring& name);
+
+    // Reads the lattices of an utterance (serialized, the archive has a single file handle).
+    std::shared_ptr<const msra::dbn::latticepair> ReadLattices(size_t sequenceId);
+
+    msra::asr::simplesenonehmm m_hset;
+    std::unique_ptr<msra::dbn::latticesource> m_lattices; // refers to the symbol map of m_hset
+    std::mutex m_readLock;
+
+    std::vector<std::wstring> m_keys;      // [sequence id] -> utterance key, in archive order
+    std::vector<size_t> m_keyIds;          // [sequence id] -> corpus key id
+    std::vector<size_t> m_keyToSequence;   // [corpus key id] -> sequence id, or SIZE_MAX if there is no lattice
+    ChunkDescriptions m_chunks;            // chunk i holds the sequences [i * m_chunkSize, (i + 1) * m_chunkSize)
+    size_t m_chunkSize;                    // in lattices
+};
+
+}}}
@@ -8,6 +8,7 @@
 #include <inttypes.h>
 #include <limits>
 #include "MLFDataDeserializer.h"
+#include "CacheFile.h"
 #include "ConfigHelper.h"
 #include "SequenceData.h"
 #include "../HTKMLFReader/htkfeatio.h"
@@ -39,12 +40,47 @@ public:
     }
 };
 
-// Inner class for an utterance.
-struct MLFUtterance : SequenceDescription
+// The label cache file is memory mapped and consists of
+//   LabelCacheHeader
+//   LabelCacheUtterance[m_numberOfUtterances]
+//   LabelRun[m_numberOfRuns]
+//   the utf8 keys of the utterances, m_keysSize bytes in total
+// It contains all utterances of the MLF files, not only those of the corpus, which are picked when the cache is loaded.
+struct MLFDataDeserializer::LabelCacheHeader
 {
-    size_t m_sequenceStart;
+    uint64_t m_magic;
+    uint32_t m_version;
+    uint32_t m_reserved;
+    uint64_t m_sourceHash; // of the paths, sizes and modification times of the MLF files and the state list, and of the label dimension
+    uint64_t m_numberOfUtterances;
+    uint64_t m_numberOfRuns;
+    uint64_t m_keysSize;
 };
 
+struct MLFDataDeserializer::LabelCacheUtterance
+{
+    uint64_t m_keyOffset;
+    uint64_t m_firstRun;
+    uint32_t m_numberOfRuns;
+    uint32_t m_numberOfFrames;
+    uint32_t m_keyLength;
+    uint32_t m_maxClassId;
+};
+
+// Labels as parsed from the MLF files, in the layout of the label cache.
+struct MLFDataDeserializer::ParsedLabels
+{
+    vector<LabelCacheUtterance> m_utterances;
+    vector<LabelRun> m_runs;
+    string m_keys;
+};
+
+static const uint64_t s_labelCacheMagic = 0x48434c424c464d43ULL; // "CMFLBLCH"
+static const uint32_t s_labelCacheVersion = 1;
+
+// TODO: Currently we still use the old IO module. This will be refactored later.
+static const double s_htkTimeToFrame = 100000.0; // default is 10ms
+
 MLFDataDeserializer::MLFDataDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& cfg, bool primary)
 {
     // TODO: This should be read in one place, potentially given by SGD.
@@ -71,7 +107,8 @@ MLFDataDeserializer::MLFDataDeserializer(CorpusDescriptorPtr corpus, const Confi
     size_t dimension = config.GetLabelDimension();
 
     wstring labelMappingFile = streamConfig(L"labelMappingFile", L"");
-    InitializeChunkDescriptions(corpus, config, labelMappingFile, dimension);
+    wstring labelCache = streamConfig(L"labelCache", L"");
+    InitializeChunkDescriptions(corpus, config, labelMappingFile, labelCache, dimension);
     InitializeStream(inputName, dimension);
 }
 
@@ -94,12 +131,88 @@ MLFDataDeserializer::MLFDataDeserializer(CorpusDescriptorPtr corpus, const Confi
     }
 
     wstring labelMappingFile = labelConfig(L"labelMappingFile", L"");
-    InitializeChunkDescriptions(corpus, config, labelMappingFile, dimension);
+    wstring labelCache = labelConfig(L"labelCache", L"");
+    InitializeChunkDescriptions(corpus, config, labelMappingFile, labelCache, dimension);
     InitializeStream(name, dimension);
 }
 
 // Currently we create a single chunk only.
-void MLFDataDeserializer::InitializeChunkDescriptions(CorpusDescriptorPtr corpus, const ConfigHelper& config, const wstring& stateListPath, size_t dimension)
+void MLFDataDeserializer::InitializeChunkDescriptions(CorpusDescriptorPtr corpus, const ConfigHelper& config, const wstring& stateListPath,
+                                                      const wstring& labelCachePath, size_t dimension)
+{
+    m_elementType = config.GetElementType();
+
+    auto useParsedLabels = [&](ParsedLabels& labels)
+    {
+        m_parsedRuns = move(labels.m_runs);
+        m_runs = m_parsedRuns.data();
+        IndexUtterances(corpus, labels.m_utterances.data(), labels.m_utterances.size(), labels.m_keys.data());
+    };
+
+    if (labelCachePath.empty())
+    {
+        ParsedLabels labels;
+        ParseLabels(corpus, config, stateListPath, dimension, false, labels);
+        useParsedLabels(labels);
+    }
+    else
+    {
+        // One process parses the MLF files into the cache, all others (and later runs) only map it.
+        const auto expected = GetExpectedCacheHeader(config, stateListPath, dimension);
+        LoadOrBuildCache(labelCachePath, L"labels",
+            [&]() { return TryLoadCache(corpus, labelCachePath, expected); },
+            [&]()
+            {
+                ParsedLabels labels;
+                ParseLabels(corpus, config, stateListPath, dimension, true, labels);
+                WriteCache(labelCachePath, expected, labels);
+
+                // the mapped labels are shared with other processes, the parsed ones are not
+                if (!TryLoadCache(corpus, labelCachePath, expected))
+                    useParsedLabels(labels);
+            },
+            [&]()
+            {
+                ParsedLabels labels;
+                ParseLabels(corpus, config, stateListPath, dimension, false, labels);
+                useParsedLabels(labels);
+            });
+    }
+
+    m_totalNumberOfFrames = m_utteranceIndex.back();
+
+    fprintf(stderr, "MLFDataDeserializer::MLFDataDeserializer: %" PRIu64 " utterances with %" PRIu64 " frames in %" PRIu64 " classes\n",
+            m_numberOfSequences,
+            m_totalNumberOfFrames,
+            m_numberOfClasses);
+
+    // Initializing array of labels.
+    m_categories.reserve(dimension);
+    m_categoryIndices.reserve(dimension);
+    for (size_t i = 0; i < dimension; ++i)
+    {
+        auto category = make_shared<CategorySequenceData>();
+        m_categoryIndices.push_back(static_cast<IndexType>(i));
+        category->m_indices = &(m_categoryIndices[i]);
+        category->m_nnzCounts.resize(1);
+        category->m_nnzCounts[0] = 1;
+        category->m_totalNnzCount = 1;
+        category->m_numberOfSamples = 1;
+        if (m_elementType == ElementType::tfloat)
+        {
+            category->m_data = &s_oneFloat;
+        }
+        else
+        {
+            assert(m_elementType == ElementType::tdouble);
+            category->m_data = &s_oneDouble;
+        }
+        m_categories.push_back(category);
+    }
+}
+
+void MLFDataDeserializer::ParseLabels(CorpusDescriptorPtr corpus, const ConfigHelper& config, const wstring& stateListPath, size_t dimension,
+                                      bool allUtterances, ParsedLabels& result)
 {
     // TODO: Similarly to the old reader, currently we assume all Mlfs will have same root name (key)
     // restrict MLF reader to these files--will make stuff much faster without having to use shortened input files
@@ -107,11 +220,15 @@ void MLFDataDeserializer::InitializeChunkDescriptions(CorpusDescriptorPtr corpus
     // TODO: currently we do not use symbol and word tables.
     const msra::lm::CSymbolSet* wordTable = nullptr;
     unordered_map<const char*, int>* symbolTable = nullptr;
+    vector<wstring> alignmentPaths = config.GetKaldiAlignmentPaths();
+    if (!alignmentPaths.empty())
+    {
+        ParseKaldiAlignments(corpus, alignmentPaths, dimension, allUtterances, result);
+        return;
+    }
     vector<wstring> mlfPaths = config.GetMlfPaths();
 
-    // TODO: Currently we still use the old IO module. This will be refactored later.
-    const double htkTimeToFrame = 100000.0; // default is 10ms
-    msra::asr::htkmlfreader<msra::asr::htkmlfentry, msra::lattices::lattice::htkmlfwordsequence> labels(mlfPaths, set<wstring>(), stateListPath, wordTable, symbolTable, htkTimeToFrame);
+    msra::asr::htkmlfreader<msra::asr::htkmlfentry, msra::lattices::lattice::htkmlfwordsequence> labels(mlfPaths, set<wstring>(), stateListPath, wordTable, symbolTable, s_htkTimeToFrame);
 
     // Make sure 'msra::asr::htkmlfreader' type has a move constructor
     static_assert(
@@ -120,30 +237,24 @@ void MLFDataDeserializer::InitializeChunkDescriptions(CorpusDescriptorPtr corpus
         msra::lattices::lattice::htkmlfwordsequence >> ::value,
         "Type 'msra::asr::htkmlfreader' should be move constructible!");
 
-    m_elementType = config.GetElementType();
-
-    MLFUtterance description;
-    size_t numClasses = 0;
-    size_t totalFrames = 0;
-
     const auto& stringRegistry = corpus->GetStringRegistry();
 
-    // TODO resize m_keyToSequence with number of IDs from string registry
-
     for (const auto& l : labels)
     {
         // Currently the string registry contains only utterances described in scp.
-        // So here we skip all others.
+        // So here we skip all others, unless they go into the cache.
+        const string key = msra::strfun::utf8(l.first);
         size_t id = 0;
-        if (!stringRegistry.TryGet(msra::strfun::utf8(l.first), id))
+        if (!allUtterances && !stringRegistry.TryGet(key, id))
             continue;
 
-        description.m_key.m_sequence = id;
+        LabelCacheUtterance description = {};
+        description.m_keyOffset = result.m_keys.size();
+        description.m_keyLength = (uint32_t)key.size();
+        description.m_firstRun = result.m_runs.size();
+        result.m_keys += key;
 
         const auto& utterance = l.second;
-        description.m_sequenceStart = m_classIds.size();
-        uint32_t numberOfFrames = 0;
-
         foreach_index(i, utterance)
         {
             const auto& timespan = utterance[i];
@@ -168,59 +279,247 @@ void MLFDataDeserializer::InitializeChunkDescriptions(CorpusDescriptorPtr corpus
                 RuntimeError("Maximum number of sample per sequence exceeded.");
             }
 
-            numClasses = max(numClasses, (size_t)(1u + timespan.classid));
+            description.m_maxClassId = max(description.m_maxClassId, (uint32_t)timespan.classid);
 
-            for (size_t t = timespan.firstframe; t < timespan.firstframe + timespan.numframes; t++)
+            // consecutive spans of the same class make a single run
+            if (timespan.numframes > 0 &&
+                (description.m_numberOfRuns == 0 || result.m_runs.back().m_classId != timespan.classid))
             {
-                m_classIds.push_back(timespan.classid);
-                numberOfFrames++;
+                result.m_runs.push_back(LabelRun{ (uint32_t)timespan.firstframe, (uint32_t)timespan.classid });
+                description.m_numberOfRuns++;
             }
+
+            description.m_numberOfFrames += (uint32_t)timespan.numframes;
         }
 
-        description.m_numberOfSamples = numberOfFrames;
-        m_utteranceIndex.push_back(totalFrames);
-        totalFrames += numberOfFrames;
+        result.m_utterances.push_back(description);
+    }
+}
 
-        if (m_keyToSequence.size() <= description.m_key.m_sequence)
+// A Kaldi alignment archive is a sequence of 'key ' followed by a binary integer vector: "\0B", the number of
+// elements and the elements, all as Kaldi integers.
+void MLFDataDeserializer::ParseKaldiAlignments(CorpusDescriptorPtr corpus, const vector<wstring>& paths, size_t dimension,
+                                               bool allUtterances, ParsedLabels& result)
+{
+    const auto& stringRegistry = corpus->GetStringRegistry();
+    vector<int> classIds;
+    for (const auto& path : paths)
+    {
+        auto_file_ptr f(fopenOrDie(path, L"rb"));
+        for (;;)
         {
-            m_keyToSequence.resize(description.m_key.m_sequence + 1, SIZE_MAX);
+            string key;
+            int c;
+            while ((c = fgetc(f)) != EOF && c != ' ')
+                key.push_back((char)c);
+            if (c == EOF)
+            {
+                if (!key.empty())
+                    RuntimeError("Kaldi alignment archive '%ls' ends within the key '%s'.", path.c_str(), key.c_str());
+                break;
+            }
+
+            char binary[2];
+            freadOrDie(binary, sizeof(binary), 1, f);
+            if (binary[0] != '\0' || binary[1] != 'B')
+                RuntimeError("Only binary Kaldi alignment archives are supported: '%ls'.", path.c_str());
+            int size = msra::asr::htkfeatreader::readkaldiint(f, path);
+            if (size < 0 || SEQUENCELEN_MAX < (size_t)size)
+                RuntimeError("Invalid alignment length %d of utterance '%s' in '%ls'.", size, key.c_str(), path.c_str());
+            classIds.resize(size);
+            for (auto& classId : classIds)
+                classId = msra::asr::htkfeatreader::readkaldiint(f, path);
+
+            // Same as for the MLF files: only utterances of the corpus are kept, unless all go into the cache.
+            size_t id = 0;
+            if (!allUtterances && !stringRegistry.TryGet(key, id))
+                continue;
+
+            LabelCacheUtterance description = {};
+            description.m_keyOffset = result.m_keys.size();
+            description.m_keyLength = (uint32_t)key.size();
+            description.m_firstRun = result.m_runs.size();
+            description.m_numberOfFrames = (uint32_t)classIds.size();
+            result.m_keys += key;
+            for (size_t t = 0; t < classIds.size(); ++t)
+            {
+                if (classIds[t] < 0 || (size_t)classIds[t] >= dimension)
+                {
+                    RuntimeError("Class id %d of utterance '%s' exceeds the model output dimension %d.", classIds[t], key.c_str(), (int)dimension);
+                }
+
+                description.m_maxClassId = max(description.m_maxClassId, (uint32_t)classIds[t]);
+                if (t == 0 || classIds[t] != classIds[t - 1])
+                {
+                    result.m_runs.push_back(LabelRun{ (uint32_t)t, (uint32_t)classIds[t] });
+                    description.m_numberOfRuns++;
+                }
+            }
+
+            result.m_utterances.push_back(description);
         }
-        assert(m_keyToSequence[description.m_key.m_sequence] == SIZE_MAX);
-        m_keyToSequence[description.m_key.m_sequence] = m_utteranceIndex.size() - 1;
-        m_numberOfSequences++;
     }
-    m_utteranceIndex.push_back(totalFrames);
+}
 
-    m_totalNumberOfFrames = totalFrames;
+// 64-bit FNV-1a.
+static void HashBytes(uint64_t& hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+}
 
-    fprintf(stderr, "MLFDataDeserializer::MLFDataDeserializer: %" PRIu64 " utterances with %" PRIu64 " frames in %" PRIu64 " classes\n",
-            m_numberOfSequences,
-            m_totalNumberOfFrames,
-            numClasses);
+MLFDataDeserializer::LabelCacheHeader MLFDataDeserializer::GetExpectedCacheHeader(const ConfigHelper& config, const wstring& stateListPath, size_t dimension)
+{
+    // The MLF files are not read to check the cache, which would take about as long as parsing them,
+    // they are identified by their size and modification time instead.
+    vector<wstring> sources = config.GetKaldiAlignmentPaths();
+    if (sources.empty())
+        sources = config.GetMlfPaths();
+    if (!stateListPath.empty())
+        sources.push_back(stateListPath);
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const auto& path : sources)
+    {
+        const string utf8Path = msra::strfun::utf8(path);
+        const uint64_t size = filesize(path.c_str());
+        const uint64_t time = GetModificationTime(path);
+        HashBytes(hash, utf8Path.data(), utf8Path.size() + 1);
+        HashBytes(hash, &size, sizeof(size));
+        HashBytes(hash, &time, sizeof(time));
+    }
+    const uint64_t labelDimension = dimension;
+    HashBytes(hash, &labelDimension, sizeof(labelDimension));
+    HashBytes(hash, &s_htkTimeToFrame, sizeof(s_htkTimeToFrame));
+
+    LabelCacheHeader header = {};
+    header.m_magic = s_labelCacheMagic;
+    header.m_version = s_labelCacheVersion;
+    header.m_sourceHash = hash;
+    return header;
+}
 
-    // Initializing array of labels.
-    m_categories.reserve(dimension);
-    m_categoryIndices.reserve(dimension);
-    for (size_t i = 0; i < dimension; ++i)
+bool MLFDataDeserializer::TryLoadCache(CorpusDescriptorPtr corpus, const wstring& labelCachePath, const LabelCacheHeader& expected)
+{
+    static_assert(sizeof(LabelCacheHeader) == 48, "LabelCacheHeader must not have padding.");
+    static_assert(sizeof(LabelCacheUtterance) == 32, "LabelCacheUtterance must not have padding.");
+    static_assert(sizeof(LabelRun) == 8, "LabelRun must not have padding.");
+
+    if (!fexists(labelCachePath))
     {
-        auto category = make_shared<CategorySequenceData>();
-        m_categoryIndices.push_back(static_cast<IndexType>(i));
-        category->m_indices = &(m_categoryIndices[i]);
-        category->m_nnzCounts.resize(1);
-        category->m_nnzCounts[0] = 1;
-        category->m_totalNnzCount = 1;
-        category->m_numberOfSamples = 1;
-        if (m_elementType == ElementType::tfloat)
+        return false;
+    }
+
+    unique_ptr<MemoryMappedFile> cache;
+    try
+    {
+        cache = make_unique<MemoryMappedFile>(labelCachePath);
+    }
+    catch (const std::exception&)
+    {
+        return false; // e.g. replaced by another process in the meantime
+    }
+
+    LabelCacheHeader header;
+    if (cache->Size() < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, cache->Data(), sizeof(header));
+
+    const size_t utterancesOffset = sizeof(header);
+    const size_t runsOffset = utterancesOffset + header.m_numberOfUtterances * sizeof(LabelCacheUtterance);
+    const size_t keysOffset = runsOffset + header.m_numberOfRuns * sizeof(LabelRun);
+    if (header.m_magic != expected.m_magic || header.m_version != expected.m_version ||
+        header.m_sourceHash != expected.m_sourceHash ||
+        cache->Size() != keysOffset + header.m_keysSize)
+    {
+        // outdated, or written by a process that did not finish
+        return false;
+    }
+
+    // The runs and keys are mapped in place, only the utterances need to be checked.
+    const auto utterances = reinterpret_cast<const LabelCacheUtterance*>(cache->Data() + utterancesOffset);
+    for (size_t i = 0; i < header.m_numberOfUtterances; ++i)
+    {
+        const auto& u = utterances[i];
+        if (u.m_firstRun + u.m_numberOfRuns > header.m_numberOfRuns || u.m_keyOffset + u.m_keyLength > header.m_keysSize)
         {
-            category->m_data = &s_oneFloat;
+            fprintf(stderr, "WARNING: The label cache (%ls) is corrupt, ignoring it.\n", labelCachePath.c_str());
+            return false;
         }
-        else
+    }
+
+    // Labels are looked up in the order of the randomized sequences.
+    cache->Advise(runsOffset, keysOffset - runsOffset, MemoryMappedFile::Access::Random);
+
+    m_runs = reinterpret_cast<const LabelRun*>(cache->Data() + runsOffset);
+    m_labelCache = move(cache);
+    IndexUtterances(corpus, utterances, header.m_numberOfUtterances, m_labelCache->Data() + keysOffset);
+    return true;
+}
+
+void MLFDataDeserializer::WriteCache(const wstring& labelCachePath, const LabelCacheHeader& header, const ParsedLabels& labels)
+{
+    WriteCacheAtomically(labelCachePath, L"label", [&](FILE* file)
+    {
+        LabelCacheHeader completeHeader = header;
+        completeHeader.m_numberOfUtterances = labels.m_utterances.size();
+        completeHeader.m_numberOfRuns = labels.m_runs.size();
+        completeHeader.m_keysSize = labels.m_keys.size();
+        fwriteOrDie(&completeHeader, sizeof(completeHeader), 1, file);
+        if (!labels.m_utterances.empty())
+            fwriteOrDie(labels.m_utterances.data(), sizeof(LabelCacheUtterance), labels.m_utterances.size(), file);
+        if (!labels.m_runs.empty())
+            fwriteOrDie(labels.m_runs.data(), sizeof(LabelRun), labels.m_runs.size(), file);
+        if (!labels.m_keys.empty())
+            fwriteOrDie(labels.m_keys.data(), 1, labels.m_keys.size(), file);
+    });
+}
+
+void MLFDataDeserializer::IndexUtterances(CorpusDescriptorPtr corpus, const LabelCacheUtterance* utterances, size_t numberOfUtterances, const char* keys)
+{
+    const auto& stringRegistry = corpus->GetStringRegistry();
+
+    // TODO resize m_keyToSequence with number of IDs from string registry
+
+    size_t totalFrames = 0;
+    string key;
+    for (size_t i = 0; i < numberOfUtterances; ++i)
+    {
+        const auto& utterance = utterances[i];
+        key.assign(keys + utterance.m_keyOffset, utterance.m_keyLength);
+        size_t id = 0;
+        if (!stringRegistry.TryGet(key, id))
+            continue;
+
+        m_sequenceRuns.push_back(make_pair((size_t)utterance.m_firstRun, (size_t)(utterance.m_firstRun + utterance.m_numberOfRuns)));
+        m_utteranceIndex.push_back(totalFrames);
+        totalFrames += utterance.m_numberOfFrames;
+        m_numberOfClasses = max(m_numberOfClasses, (size_t)utterance.m_maxClassId + 1);
+
+        if (m_keyToSequence.size() <= id)
         {
-            assert(m_elementType == ElementType::tdouble);
-            category->m_data = &s_oneDouble;
+            m_keyToSequence.resize(id + 1, SIZE_MAX);
         }
-        m_categories.push_back(category);
+        assert(m_keyToSequence[id] == SIZE_MAX);
+        m_keyToSequence[id] = m_utteranceIndex.size() - 1;
+        m_numberOfSequences++;
     }
+    m_utteranceIndex.push_back(totalFrames);
+}
+
+size_t MLFDataDeserializer::GetClassId(size_t sequenceId, size_t frame) const
+{
+    const auto& runs = m_sequenceRuns[sequenceId];
+    const LabelRun* run = upper_bound(m_runs + runs.first, m_runs + runs.second, frame,
+                                      [](size_t f, const LabelRun& r) { return f < r.m_firstFrame; });
+    assert(run != m_runs + runs.first);
+    return (run - 1)->m_classId;
 }
 
 void MLFDataDeserializer::InitializeStream(const wstring& name, size_t dimension)
@@ -297,7 +596,9 @@ void MLFDataDeserializer::GetSequenceById(size_t sequenceId, vector<SequenceData
 {
     if (m_frameMode)
     {
-        size_t label = m_classIds[sequenceId];
+        // Sequence ids are frame indices, the utterance is the last one starting at or before the frame.
+        size_t utterance = upper_bound(m_utteranceIndex.begin(), m_utteranceIndex.end(), sequenceId) - m_utteranceIndex.begin() - 1;
+        size_t label = GetClassId(utterance, sequenceId - m_utteranceIndex[utterance]);
         assert(label < m_categories.size());
         result.push_back(m_categories[label]);
     }
@@ -317,11 +618,15 @@ void MLFDataDeserializer::GetSequenceById(size_t sequenceId, vector<SequenceData
             s = make_shared<MLFSequenceData<double>>(numberOfSamples);
         }
 
-        for (size_t i = 0; i < numberOfSamples; i++)
+        const auto& runs = m_sequenceRuns[sequenceId];
+        for (size_t i = runs.first; i < runs.second; ++i)
         {
-            size_t frameIndex = startFrameIndex + i;
-            size_t label = m_classIds[frameIndex];
-            s->m_indices[i] = static_cast<IndexType>(label);
+            size_t end = i + 1 < runs.second ? m_runs[i + 1].m_firstFrame : numberOfSamples;
+            IndexType label = static_cast<IndexType>(m_runs[i].m_classId);
+            for (size_t frame = m_runs[i].m_firstFrame; frame < end; frame++)
+            {
+                s->m_indices[frame] = label;
+            }
         }
         result.push_back(s);
     }
@@ -7,8 +7,8 @@
 
 #include "DataDeserializer.h"
 #include "HTKDataDeserializer.h"
-#include "../HTKMLFReader/biggrowablevectors.h"
 #include "CorpusDescriptor.h"
+#include "MemoryMappedFile.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -37,15 +37,58 @@ public:
     // TODO: After we switch the timeline to work in chunks, we will also introduce chunking of labels.
     virtual ChunkPtr GetChunk(ChunkIdType) override;
 
+    // The labels are all in memory already.
+    virtual bool SupportsConcurrentGetChunk() const override
+    {
+        return true;
+    }
+
 private:
     class MLFChunk;
     DISABLE_COPY_AND_MOVE(MLFDataDeserializer);
 
-    void InitializeChunkDescriptions(CorpusDescriptorPtr corpus, const ConfigHelper& config, const std::wstring& stateListPath, size_t dimension);
+    // A run of frames with the same label. The runs of an utterance are stored in the order of its frames,
+    // a run lasts until the first frame of the next one, or until the end of the utterance.
+    struct LabelRun
+    {
+        uint32_t m_firstFrame; // relative to the start of the utterance
+        uint32_t m_classId;
+    };
+
+    struct LabelCacheHeader;
+    struct LabelCacheUtterance;
+    struct ParsedLabels;
+
+    void InitializeChunkDescriptions(CorpusDescriptorPtr corpus, const ConfigHelper& config, const std::wstring& stateListPath,
+                                     const std::wstring& labelCachePath, size_t dimension);
     void InitializeStream(const std::wstring& name, size_t dimension);
 
     void GetSequenceById(size_t sequenceId, std::vector<SequenceDataPtr>& result);
 
+    // Parses the MLF files (and the state list) into runs of labels.
+    // Only utterances known to the corpus are kept, unless all of them are needed for the label cache.
+    void ParseLabels(CorpusDescriptorPtr corpus, const ConfigHelper& config, const std::wstring& stateListPath, size_t dimension,
+                     bool allUtterances, ParsedLabels& labels);
+
+    // Parses Kaldi alignment archives of pdf ids (as written by ali-to-pdf) into runs of labels.
+    static void ParseKaldiAlignments(CorpusDescriptorPtr corpus, const std::vector<std::wstring>& paths, size_t dimension,
+                                     bool allUtterances, ParsedLabels& labels);
+
+    // Returns the header the label cache is expected to have for the current MLF files and state list.
+    static LabelCacheHeader GetExpectedCacheHeader(const ConfigHelper& config, const std::wstring& stateListPath, size_t dimension);
+
+    // Maps the label cache and indexes its utterances, if it exists and matches the expected header.
+    bool TryLoadCache(CorpusDescriptorPtr corpus, const std::wstring& labelCachePath, const LabelCacheHeader& expected);
+
+    // Writes the parsed labels to the label cache.
+    static void WriteCache(const std::wstring& labelCachePath, const LabelCacheHeader& header, const ParsedLabels& labels);
+
+    // Indexes the utterances known to the corpus, with their labels in m_runs.
+    void IndexUtterances(CorpusDescriptorPtr corpus, const LabelCacheUtterance* utterances, size_t numberOfUtterances, const char* keys);
+
+    // Returns the class id of the given frame of a sequence.
+    size_t GetClassId(size_t sequenceId, size_t frame) const;
+
     // Vector that maps KeyType.m_sequence into an utterance ID (or SIZE_MAX if the key is not assigned).
     // This assumes that IDs introduced by the corpus are dense (which they right now, depending on the number of invalid / filtered sequences).
     // TODO compare perf to map we had before.
@@ -54,11 +97,20 @@ private:
     // Number of sequences
     size_t m_numberOfSequences = 0;
 
-    // Array of all labels.
-    msra::dbn::biggrowablevector<msra::dbn::CLASSIDTYPE> m_classIds;
+    // Labels of all utterances, run-length encoded. Points either into the mapped label cache
+    // or to m_parsedRuns.
+    const LabelRun* m_runs = nullptr;
+    std::vector<LabelRun> m_parsedRuns;
+    std::unique_ptr<MemoryMappedFile> m_labelCache;
+
+    // The first and the end run of every sequence in m_runs.
+    std::vector<std::pair<size_t, size_t>> m_sequenceRuns;
+
+    // Index of the first frame of every sequence, followed by the total number of frames.
+    std::vector<size_t> m_utteranceIndex;
 
-    // Index of utterances in the m_classIds.
-    msra::dbn::biggrowablevector<size_t> m_utteranceIndex;
+    // Number of classes (the largest class id + 1) of the sequences.
+    size_t m_numberOfClasses = 0;
 
     // Type of the data this serializer provides.
     ElementType m_elementType;
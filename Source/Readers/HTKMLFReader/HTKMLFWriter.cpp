@@ -18,6 +18,8 @@
 #include "DataWriter.h"
 #include "Config.h"
 #include "HTKMLFWriter.h"
+#include <cmath>
+#include <limits>
 #ifdef LEAKDETECT
 #include <vld.h> // for memory leak detection
 #endif
@@ -33,6 +35,8 @@ void HTKMLFWriter<ElemType>::InitFromConfig(const ConfigRecordType& writerConfig
 {
     m_tempArray = nullptr;
     m_tempArraySize = 0;
+    m_tempIndexArray = nullptr;
+    m_tempIndexArraySize = 0;
 
     vector<wstring> scriptpaths;
     vector<wstring> filelist;
@@ -69,6 +73,48 @@ void HTKMLFWriter<ElemType>::InitFromConfig(const ConfigRecordType& writerConfig
         {
             RuntimeError("HTKMLFWriter::Init: output type for writer output expected to be Real");
         }
+
+        OutputOptions options;
+        wstring format = thisOutput(L"format", "htk");
+        if (format != L"htk" && format != L"kaldi")
+            InvalidArgument("HTKMLFWriter::Init: format of output '%ls' must be 'htk' or 'kaldi'", outputNames[i].c_str());
+        options.kaldiFormat = format == L"kaldi";
+        wstring quantization = thisOutput(L"quantization", "none");
+        if (quantization != L"none" && quantization != L"8bit")
+            InvalidArgument("HTKMLFWriter::Init: quantization of output '%ls' must be 'none' or '8bit'", outputNames[i].c_str());
+        options.quantize = quantization == L"8bit";
+        if (options.quantize && !options.kaldiFormat)
+            InvalidArgument("HTKMLFWriter::Init: quantization=8bit of output '%ls' requires format=kaldi", outputNames[i].c_str());
+        options.applyLog = thisOutput(L"applyLog", false);
+        options.topK = thisOutput(L"topK", (size_t) 0);
+        if (options.topK > udims[i])
+            InvalidArgument("HTKMLFWriter::Init: topK of output '%ls' exceeds its dim", outputNames[i].c_str());
+
+        // the priors, one or more per line, are normalized to sum up to 1
+        if (thisOutput.Exists("priorFile"))
+        {
+            wstring priorFile = thisOutput(L"priorFile");
+            vector<double> priors;
+            for (msra::files::textreader reader(priorFile); reader;)
+            {
+                for (const auto& token : msra::strfun::split(reader.getline(), " \t"))
+                    priors.push_back(atof(token.c_str()));
+            }
+            if (priors.size() != udims[i])
+                RuntimeError("HTKMLFWriter::Init: priorFile '%ls' has %d values, but output '%ls' has dim %d", priorFile.c_str(), (int) priors.size(), outputNames[i].c_str(), (int) udims[i]);
+            double sum = 0;
+            for (auto prior : priors)
+            {
+                if (prior < 0)
+                    RuntimeError("HTKMLFWriter::Init: priorFile '%ls' has negative values", priorFile.c_str());
+                sum += prior;
+            }
+            if (sum <= 0)
+                RuntimeError("HTKMLFWriter::Init: priorFile '%ls' has no positive values", priorFile.c_str());
+            for (auto prior : priors)
+                options.logPriors.push_back((ElemType) log(max(prior / sum, 1e-30)));
+        }
+        m_outputOptions.push_back(options);
     }
 
     numFiles = 0;
@@ -100,9 +146,20 @@ void HTKMLFWriter<ElemType>::InitFromConfig(const ConfigRecordType& writerConfig
 template <class ElemType>
 void HTKMLFWriter<ElemType>::Destroy()
 {
+    WaitForPendingWrite();
     delete[] m_tempArray;
     m_tempArray = nullptr;
     m_tempArraySize = 0;
+    delete[] m_tempIndexArray;
+    m_tempIndexArray = nullptr;
+    m_tempIndexArraySize = 0;
+}
+
+template <class ElemType>
+void HTKMLFWriter<ElemType>::WaitForPendingWrite()
+{
+    if (m_pendingWrite.valid())
+        m_pendingWrite.get(); // rethrows the error of the write
 }
 
 template <class ElemType>
@@ -129,7 +186,7 @@ bool HTKMLFWriter<ElemType>::SaveData(size_t /*recordStart*/, const std::map<std
         assert(outputData.GetNumRows() == dim);
         dim;
 
-        Save(outFile, outputData);
+        Save(outFile, outputData, m_outputOptions[id]);
     }
 
     outputFileIndex++;
@@ -137,33 +194,100 @@ bool HTKMLFWriter<ElemType>::SaveData(size_t /*recordStart*/, const std::map<std
     return true;
 }
 
+// a Matrix on the given device, reused across calls
+template <class ElemType>
+static Matrix<ElemType>& DeviceMatrix(shared_ptr<Matrix<ElemType>>& matrix, DEVICEID_TYPE deviceId)
+{
+    if (!matrix || matrix->GetDeviceId() != deviceId)
+        matrix = make_shared<Matrix<ElemType>>(deviceId);
+    return *matrix;
+}
+
 template <class ElemType>
-void HTKMLFWriter<ElemType>::Save(std::wstring& outputFile, Matrix<ElemType>& outputData)
+void HTKMLFWriter<ElemType>::Save(const std::wstring& outputFile, Matrix<ElemType>& outputData, OutputOptions& options)
 {
-    msra::dbn::matrix output;
-    output.resize(outputData.GetNumRows(), outputData.GetNumCols());
-    outputData.CopyToArray(m_tempArray, m_tempArraySize);
-    ElemType* pValue = m_tempArray;
+    const size_t dim = outputData.GetNumRows();
+    const size_t numFrames = outputData.GetNumCols();
+    const DEVICEID_TYPE deviceId = outputData.GetDeviceId();
+
+    const Matrix<ElemType>* result = &outputData;
+    if (options.applyLog || !options.logPriors.empty() || options.topK > 0)
+    {
+        auto& work = DeviceMatrix(options.work, deviceId);
+        work.SetValue(outputData);
+        if (options.applyLog)
+        {
+            work.InplaceTruncateBottom(std::numeric_limits<ElemType>::min());
+            work.InplaceLog();
+        }
+        if (!options.logPriors.empty())
+        {
+            if (!options.logPriorMatrix || options.logPriorMatrix->GetDeviceId() != deviceId)
+                options.logPriorMatrix = make_shared<Matrix<ElemType>>(dim, 1, options.logPriors.data(), deviceId);
+            Matrix<ElemType>::ScaleAndAdd(-1, *options.logPriorMatrix, work); // column vector, subtracted from each frame
+        }
+        result = &work;
+    }
 
-    for (int j = 0; j < outputData.GetNumCols(); j++)
+    auto output = make_shared<msra::dbn::matrix>();
+    output->resize(dim, numFrames);
+    if (options.topK > 0)
     {
-        for (int i = 0; i < outputData.GetNumRows(); i++)
+        auto& indices = DeviceMatrix(options.topKIndices, deviceId);
+        auto& values = DeviceMatrix(options.topKValues, deviceId);
+        result->VectorMax(indices, values, /*isColWise=*/true, (int) options.topK);
+        values.CopyToArray(m_tempArray, m_tempArraySize);
+        indices.CopyToArray(m_tempIndexArray, m_tempIndexArraySize);
+        for (size_t j = 0; j < numFrames; j++)
         {
-            output(i, j) = (float) *pValue++;
+            const ElemType* frameValues = m_tempArray + j * options.topK;
+            const ElemType* frameIndices = m_tempIndexArray + j * options.topK;
+            const ElemType floor = *std::min_element(frameValues, frameValues + options.topK);
+            for (size_t i = 0; i < dim; i++)
+                (*output)(i, j) = (float) floor;
+            for (size_t k = 0; k < options.topK; k++)
+                (*output)((size_t) frameIndices[k], j) = (float) frameValues[k];
+        }
+    }
+    else
+    {
+        result->CopyToArray(m_tempArray, m_tempArraySize);
+        const ElemType* pValue = m_tempArray;
+        for (size_t j = 0; j < numFrames; j++)
+        {
+            for (size_t i = 0; i < dim; i++)
+            {
+                (*output)(i, j) = (float) *pValue++;
+            }
         }
     }
 
-    const size_t nansinf = output.countnaninf();
+    const size_t nansinf = output->countnaninf();
     if (nansinf > 0)
-        fprintf(stderr, "chunkeval: %d NaNs or INF detected in '%ls' (%d frames)\n", (int) nansinf, outputFile.c_str(), (int) output.cols());
-    // save it
-    msra::files::make_intermediate_dirs(outputFile);
-    msra::util::attempt(5, [&]()
-                        {
-                            msra::asr::htkfeatwriter::write(outputFile, "USER", this->sampPeriod, output);
-                        });
-
-    fprintf(stderr, "evaluate: writing %d frames of %ls\n", (int) output.cols(), outputFile.c_str());
+        fprintf(stderr, "chunkeval: %d NaNs or INF detected in '%ls' (%d frames)\n", (int) nansinf, outputFile.c_str(), (int) output->cols());
+
+    // save it, in the background; the key of a Kaldi archive is the file name without directory and extension
+    WaitForPendingWrite();
+    const bool kaldiFormat = options.kaldiFormat;
+    const bool quantize = options.quantize;
+    const unsigned int period = sampPeriod;
+    m_pendingWrite = std::async(std::launch::async, [outputFile, output, kaldiFormat, quantize, period]()
+    {
+        msra::files::make_intermediate_dirs(outputFile);
+        msra::util::attempt(5, [&]()
+                            {
+                                if (kaldiFormat)
+                                {
+                                    wstring key = outputFile.substr(outputFile.find_last_of(L"/\\") + 1);
+                                    key = key.substr(0, key.find_last_of(L'.'));
+                                    msra::asr::htkfeatwriter::writekaldi(outputFile, msra::strfun::utf8(key), *output, quantize);
+                                }
+                                else
+                                    msra::asr::htkfeatwriter::write(outputFile, "USER", period, *output);
+                            });
+
+        fprintf(stderr, "evaluate: writing %d frames of %ls\n", (int) output->cols(), outputFile.c_str());
+    });
 }
 
 template <class ElemType>
@@ -7,7 +7,9 @@
 #pragma once
 #include "DataWriter.h"
 #include "ScriptableObjects.h"
+#include <future>
 #include <map>
+#include <memory>
 #include <vector>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -25,9 +27,36 @@ private:
     std::map<std::wstring, size_t> outputNameToTypeMap;
     unsigned int sampPeriod;
     size_t outputFileIndex;
-    void Save(std::wstring& outputFile, Matrix<ElemType>& outputData);
     ElemType* m_tempArray;
     size_t m_tempArraySize;
+    ElemType* m_tempIndexArray;
+    size_t m_tempIndexArraySize;
+
+    // Per output: what is done to the values before they are written. The log, the prior division and the top-k
+    // selection run on the device of the output, so that with topK only k values and indices per frame are copied
+    // to the host; the others are written as the smallest of the k values of the frame.
+    struct OutputOptions
+    {
+        bool kaldiFormat;               // format=kaldi: a single-entry Kaldi archive per file, else an HTK feature file
+        bool quantize;                  // quantization=8bit (Kaldi format only)
+        bool applyLog;                  // the output is a posterior
+        size_t topK;                    // 0: all values
+        std::vector<ElemType> logPriors; // from priorFile, subtracted (empty: none)
+
+        // device buffers, allocated on first use
+        std::shared_ptr<Matrix<ElemType>> logPriorMatrix;
+        std::shared_ptr<Matrix<ElemType>> work;
+        std::shared_ptr<Matrix<ElemType>> topKIndices;
+        std::shared_ptr<Matrix<ElemType>> topKValues;
+    };
+    std::vector<OutputOptions> m_outputOptions; // [output id]
+
+    // The files are written by a background thread, one at a time, so that writing an utterance overlaps with the
+    // evaluation of the next one. A failed write is reported by the next SaveData() or by Destroy().
+    std::future<void> m_pendingWrite;
+    void WaitForPendingWrite();
+
+    void Save(const std::wstring& outputFile, Matrix<ElemType>& outputData, OutputOptions& options);
 
     enum OutputTypes
     {
@@ -313,6 +313,74 @@ public:
         // (This would only fail in strange circumstances such as accidental multiple processes writing to the same file.)
         renameOrDie(tmppath, path);
     }
+
+    // write an entire utterance as a binary Kaldi archive with the single entry 'key' (rows = frames), either as
+    // floats ("FM") or, with 'quantize', as one byte per value between the global minimum and maximum ("CM3", the
+    // format of Kaldi's copy-feats --compression-method=7). The reader above reads either back.
+    template <class MATRIX>
+    static void writekaldi(const wstring& path, const string& key, const MATRIX& feat, bool quantize)
+    {
+        wstring tmppath = path + L"$$"; // tmp path for make-mode compliant
+        unlinkOrDie(path);              // delete if old file is already there
+        const size_t featdim = feat.rows();
+        const size_t numframes = feat.cols();
+        if (featdim > INT_MAX || numframes > INT_MAX)
+            RuntimeError("htkfeatwriter: matrix too large for a Kaldi archive");
+        auto_file_ptr f(fopenOrDie(tmppath, L"wbS"));
+        fwriteOrDie(key.data(), sizeof(char), key.size(), f);
+        fwriteOrDie(" \0B", sizeof(char), 3, f);
+        const int32_t rows = (int32_t) numframes, cols = (int32_t) featdim;
+        if (!quantize)
+        {
+            fwriteOrDie("FM ", sizeof(char), 3, f);
+            writekaldiint(f, rows);
+            writekaldiint(f, cols);
+            vector<float> v(featdim);
+            for (size_t i = 0; i < numframes; i++)
+            {
+                foreach_index (k, v)
+                    v[k] = feat(k, i);
+                fwriteOrDie(v, f);
+            }
+        }
+        else
+        {
+            float minvalue = numframes > 0 ? feat(0, 0) : 0.0f, maxvalue = minvalue;
+            for (size_t i = 0; i < numframes; i++)
+                for (size_t k = 0; k < featdim; k++)
+                {
+                    minvalue = min(minvalue, (float) feat(k, i));
+                    maxvalue = max(maxvalue, (float) feat(k, i));
+                }
+            float range = maxvalue - minvalue;
+            if (range == 0.0f) // as Kaldi
+                range = 1.0f;
+            fwriteOrDie("CM3 ", sizeof(char), 4, f);
+            fwriteOrDie(&minvalue, sizeof(minvalue), 1, f);
+            fwriteOrDie(&range, sizeof(range), 1, f);
+            fwriteOrDie(&rows, sizeof(rows), 1, f);
+            fwriteOrDie(&cols, sizeof(cols), 1, f);
+            const float scale = 255.0f / range;
+            vector<unsigned char> v(featdim);
+            for (size_t i = 0; i < numframes; i++)
+            {
+                foreach_index (k, v)
+                    v[k] = (unsigned char) min(255.0f, max(0.0f, (feat(k, i) - minvalue) * scale + 0.5f));
+                fwriteOrDie(v, f);
+            }
+        }
+        fflushOrDie(f);
+        f = NULL;
+        renameOrDie(tmppath, path);
+    }
+
+private:
+    static void writekaldiint(FILE* f, int32_t value)
+    {
+        const char size = sizeof(value);
+        fwriteOrDie(&size, sizeof(size), 1, f);
+        fwriteOrDie(&value, sizeof(value), 1, f);
+    }
 };
 
 // ===========================================================================
@@ -345,6 +413,8 @@ class htkfeatreader : protected htkfeatio
     size_t curframe;                     // current # samples read so far
     size_t numframes;                    // number of samples for current logical file
     size_t energyElements;               // how many energy elements to add if addEnergy is true
+    vector<float> kaldiframes;           // the decoded matrix if a Kaldi archive is open, frames * featdim
+    size_t kaldifirstframe;              // frame of kaldiframes that is read first
 
 public:
     // parser for complex a=b[s,e] syntax
@@ -371,6 +441,7 @@ public:
         bool isarchive;      // true if archive (range specified)
         bool isidxformat;    // support reading of features in idxformat as well (it's a hack, but different format's are not supported yet)
         size_t s, e;         // first and last frame inside the archive file; (0, INT_MAX) if not given
+        uint64_t kaldioffset; // byte offset of the matrix if a Kaldi archive is given as 'path.ark:offset', else UINT64_MAX
         void malformed(const wstring& path) const
         {
             RuntimeError("parsedpath: malformed path '%ls'", path.c_str());
@@ -433,6 +504,15 @@ public:
                 }
             }
 
+            // Kaldi rxfilename 'path.ark:offset', as in Kaldi .scp files
+            kaldioffset = UINT64_MAX;
+            size_t colon = archivepath.find_last_of(L':');
+            if (colon != wstring::npos && colon + 1 < archivepath.size() && archivepath.find_first_not_of(L"0123456789", colon + 1) == wstring::npos)
+            {
+                kaldioffset = msra::strfun::toint(archivepath.substr(colon + 1));
+                archivepath.resize(colon);
+            }
+
             auto iter = archivePathStringMap.find(archivepath);
             if (iter != archivePathStringMap.end())
             {
@@ -481,6 +561,18 @@ public:
                 RuntimeError("parsedpath: this mode requires an input script with start and end frames given");
             return e - s + 1;
         }
+
+        // test whether the frames of this path directly follow those of 'other' in the same archive
+        // (never for Kaldi archives, where each matrix has its own header)
+        bool follows(const parsedpath& other) const
+        {
+            return isarchive && other.isarchive && archivePathIdx == other.archivePathIdx && s == other.e + 1 && kaldioffset == UINT64_MAX && other.kaldioffset == UINT64_MAX;
+        }
+
+        bool iskaldi() const
+        {
+            return kaldioffset != UINT64_MAX;
+        }
     };
 
     // Make sure 'parsedpath' type has a move constructor
@@ -596,6 +688,158 @@ private:
         this->vecbytesize = H.sampsize;
         this->hascrcc = hascrcc;
     }
+
+    // Kaldi binary matrices: "\0B", a type token, and the data. Floating-point matrices ("FM ", "DM ") have the
+    // dimensions as Kaldi integers (a size byte and the value) followed by the rows (frames). Compressed matrices
+    // have a global header (min, range, rows, cols) followed by the data in one of three formats (see Kaldi's
+    // compressed-matrix.cc): "CM " one byte per value, quantized between three percentiles stored per column,
+    // column-major; "CM2 " two bytes per value, row-major; "CM3 " one byte per value, row-major.
+    // Kaldi writes in the byte order of the host; this assumes it is the same as ours.
+public:
+    // read a Kaldi integer (also used for the integer vectors of Kaldi alignment archives)
+    static int readkaldiint(FILE* f, const wstring& path)
+    {
+        char size;
+        int32_t value;
+        freadOrDie(&size, sizeof(size), 1, f);
+        if (size != sizeof(value))
+            RuntimeError("htkfeatreader: unexpected integer size %d in Kaldi archive '%ls'", (int) size, path.c_str());
+        freadOrDie(&value, sizeof(value), 1, f);
+        return value;
+    }
+
+    static string readkalditoken(FILE* f, const wstring& path)
+    {
+        string token;
+        for (;;)
+        {
+            char c;
+            freadOrDie(&c, sizeof(c), 1, f);
+            if (c == ' ')
+                return token;
+            if (token.size() > 8)
+                RuntimeError("htkfeatreader: malformed matrix in Kaldi archive '%ls'", path.c_str());
+            token.push_back(c);
+        }
+    }
+
+private:
+    // reads the matrix at the current position of 'f' into 'frames' (row = frame); returns the number of frames
+    static size_t readkaldimatrix(FILE* f, const wstring& path, vector<float>& frames, size_t& dim)
+    {
+        char binary[2];
+        freadOrDie(binary, sizeof(binary), 1, f);
+        if (binary[0] != '\0' || binary[1] != 'B')
+            RuntimeError("htkfeatreader: only binary Kaldi archives are supported: '%ls'", path.c_str());
+        const string type = readkalditoken(f, path);
+
+        int32_t rows, cols;
+        auto checkdims = [&]()
+        {
+            if (rows < 0 || cols <= 0)
+                RuntimeError("htkfeatreader: invalid matrix dimensions %d x %d in Kaldi archive '%ls'", (int) rows, (int) cols, path.c_str());
+        };
+        if (type == "FM" || type == "DM")
+        {
+            rows = readkaldiint(f, path);
+            cols = readkaldiint(f, path);
+            checkdims();
+            frames.resize((size_t) rows * cols);
+            if (type == "FM")
+                freadOrDie(frames.data(), sizeof(float), frames.size(), f);
+            else
+            {
+                vector<double> values(frames.size());
+                freadOrDie(values.data(), sizeof(double), values.size(), f);
+                for (size_t i = 0; i < values.size(); i++)
+                    frames[i] = (float) values[i];
+            }
+        }
+        else if (type == "CM" || type == "CM2" || type == "CM3")
+        {
+            float minvalue, range;
+            freadOrDie(&minvalue, sizeof(minvalue), 1, f);
+            freadOrDie(&range, sizeof(range), 1, f);
+            freadOrDie(&rows, sizeof(rows), 1, f);
+            freadOrDie(&cols, sizeof(cols), 1, f);
+            checkdims();
+            frames.resize((size_t) rows * cols);
+            if (type == "CM")
+            {
+                vector<unsigned short> percentiles((size_t) cols * 4); // 0, 25, 75 and 100th percentile of each column
+                vector<unsigned char> values(frames.size());
+                freadOrDie(percentiles.data(), sizeof(unsigned short), percentiles.size(), f);
+                freadOrDie(values.data(), sizeof(unsigned char), values.size(), f);
+                const float step = range / 65535.0f;
+                for (size_t k = 0; k < (size_t) cols; k++)
+                {
+                    const float p0 = minvalue + step * percentiles[4 * k], p25 = minvalue + step * percentiles[4 * k + 1];
+                    const float p75 = minvalue + step * percentiles[4 * k + 2], p100 = minvalue + step * percentiles[4 * k + 3];
+                    const unsigned char* column = &values[k * rows];
+                    for (size_t t = 0; t < (size_t) rows; t++)
+                    {
+                        const unsigned char v = column[t];
+                        frames[t * cols + k] = v <= 64 ? p0 + (p25 - p0) * v * (1.0f / 64)
+                                             : v <= 192 ? p25 + (p75 - p25) * (v - 64) * (1.0f / 128)
+                                                        : p75 + (p100 - p75) * (v - 192) * (1.0f / 63);
+                    }
+                }
+            }
+            else if (type == "CM2")
+            {
+                vector<unsigned short> values(frames.size());
+                freadOrDie(values.data(), sizeof(unsigned short), values.size(), f);
+                const float step = range / 65535.0f;
+                for (size_t i = 0; i < values.size(); i++)
+                    frames[i] = minvalue + step * values[i];
+            }
+            else
+            {
+                vector<unsigned char> values(frames.size());
+                freadOrDie(values.data(), sizeof(unsigned char), values.size(), f);
+                const float step = range / 255.0f;
+                for (size_t i = 0; i < values.size(); i++)
+                    frames[i] = minvalue + step * values[i];
+            }
+        }
+        else
+            RuntimeError("htkfeatreader: unsupported matrix type '%s' in Kaldi archive '%ls'", type.c_str(), path.c_str());
+
+        dim = cols;
+        return rows;
+    }
+
+    // open a matrix of a Kaldi archive and decode it into kaldiframes
+    // Kaldi features have no kind and sampling period; they are reported as USER with period 0.
+    void openkaldi(const parsedpath& ppath)
+    {
+        wstring physpath = ppath.physicallocation();
+        if (f == NULL || physpath != physicalpath)
+        {
+            auto_file_ptr f(fopenOrDie(physpath, L"rb"));
+            this->f.swap(f);
+            this->physicalpath.swap(physpath);
+        }
+        try
+        {
+            fsetpos(f, ppath.kaldioffset);
+            size_t dim;
+            physicalframes = readkaldimatrix(f, physicalpath, kaldiframes, dim);
+            auto location = ((std::wstring)ppath).empty() ? ppath.physicallocation() : (std::wstring)ppath;
+            setkind("USER", dim, 0, location); // this checks consistency
+        }
+        catch (...)
+        {
+            close();
+            throw;
+        }
+        this->compressed = false;
+        this->isidxformat = false;
+        this->needbyteswapping = false;
+        this->hascrcc = false;
+        this->vecbytesize = featdim * sizeof(float);
+    }
+
     void close() // force close the open file --use this in case of read failure
     {
         f = NULL; // assigning a new FILE* to f will close the old FILE* if any
@@ -607,6 +851,50 @@ public:
     {
         addEnergy = false;
         energyElements = 0;
+        kaldifirstframe = 0;
+    }
+
+    // get the number of frames of a matrix in a Kaldi archive, from its header only
+    // The file stays open, so that this is efficient for the matrices of an archive in order.
+    size_t getkaldinumframes(const parsedpath& ppath)
+    {
+        if (!ppath.iskaldi())
+            LogicError("getkaldinumframes: '%ls' is not a Kaldi archive", ppath.physicallocation().c_str());
+        wstring physpath = ppath.physicallocation();
+        if (f == NULL || physpath != physicalpath)
+        {
+            auto_file_ptr f(fopenOrDie(physpath, L"rb"));
+            this->f.swap(f);
+            this->physicalpath.swap(physpath);
+        }
+        try
+        {
+            fsetpos(f, ppath.kaldioffset);
+            char binary[2];
+            freadOrDie(binary, sizeof(binary), 1, f);
+            if (binary[0] != '\0' || binary[1] != 'B')
+                RuntimeError("htkfeatreader: only binary Kaldi archives are supported: '%ls'", physicalpath.c_str());
+            const string type = readkalditoken(f, physicalpath);
+            int32_t rows;
+            if (type == "FM" || type == "DM")
+                rows = readkaldiint(f, physicalpath);
+            else if (type == "CM" || type == "CM2" || type == "CM3")
+            {
+                float minvalueandrange[2];
+                freadOrDie(minvalueandrange, sizeof(float), 2, f);
+                freadOrDie(&rows, sizeof(rows), 1, f);
+            }
+            else
+                RuntimeError("htkfeatreader: unsupported matrix type '%s' in Kaldi archive '%ls'", type.c_str(), physicalpath.c_str());
+            if (rows < 0)
+                RuntimeError("htkfeatreader: invalid number of rows %d in Kaldi archive '%ls'", (int) rows, physicalpath.c_str());
+            return rows;
+        }
+        catch (...)
+        {
+            close();
+            throw;
+        }
     }
 
     // helper to create a parsed-path object
@@ -621,6 +909,18 @@ public:
     // This understands the more complex syntax a=b[s,e] and optimizes a little
     size_t open(const parsedpath& ppath)
     {
+        if (ppath.iskaldi())
+        {
+            openkaldi(ppath);
+            if (ppath.isarchive && (ppath.s > ppath.e || ppath.e >= physicalframes))
+                RuntimeError("open: frame range [%d,%d] exceeds the %d frames of the Kaldi matrix in '%ls'", (int)ppath.s, (int)ppath.e, (int)physicalframes, ((wstring)ppath).c_str());
+            kaldifirstframe = ppath.isarchive ? ppath.s : 0;
+            curframe = 0;
+            numframes = ppath.isarchive ? ppath.e + 1 - ppath.s : physicalframes;
+            return numframes;
+        }
+        kaldiframes.clear();
+
         // do not reopen the file if it is the same; use fsetpos() instead
         if (f == NULL || ppath.physicallocation() != physicalpath)
             openphysical(ppath);
@@ -674,7 +974,12 @@ public:
     {
         if (curframe >= numframes)
             RuntimeError("htkfeatreader:attempted to read beyond end");
-        if (!compressed && !isidxformat) // not compressed--the easy one
+        if (!kaldiframes.empty()) // decoded when the Kaldi matrix was opened
+        {
+            const float* frame = &kaldiframes[(kaldifirstframe + curframe) * featdim];
+            v.assign(frame, frame + featdim);
+        }
+        else if (!compressed && !isidxformat) // not compressed--the easy one
         {
             freadOrDie(v, featdim, f);
             if (needbyteswapping)
@@ -769,6 +1074,62 @@ public:
             throw;
         }
     }
+    // read 'frames' frames starting at the first frame of an archive path, e.g. those of several utterances that follow
+    // each other in the archive, with a single read into the already allocated columns [ts, ts + frames) of a matrix
+    // Matrix type needs to have operator(i,j) and getcolstride().
+    // Returns false without reading anything if the frames need to be converted one by one (compressed, idx format, added energy).
+    template <class MATRIX>
+    bool readframes(const parsedpath& ppath, const string& kindstr, const unsigned int period, size_t frames, MATRIX& feat, size_t ts)
+    {
+        open(ppath);
+        if (kindstr != featkind || period != featperiod)
+            LogicError("readframes: attempting to mixing different feature kinds");
+        if (compressed || isidxformat || addEnergy)
+            return false;
+        if (feat.rows() != featdim || ts + frames > feat.cols())
+            LogicError("readframes: called with wrong dimensions");
+        if (ppath.s + frames > physicalframes)
+            RuntimeError("readframes: frames exceed archive's total number of frames %d in '%ls'", (int)physicalframes, ((wstring)ppath).c_str());
+        if (frames == 0)
+            return true;
+
+        if (ppath.iskaldi()) // a single matrix, already decoded
+        {
+            if (frames > numframes)
+                LogicError("readframes: frames of several Kaldi matrices cannot be read at once");
+            for (size_t t = 0; t < frames; t++)
+                memcpy(&feat(0, ts + t), &kaldiframes[(kaldifirstframe + t) * featdim], featdim * sizeof(float));
+            curframe = numframes;
+            return true;
+        }
+
+        try
+        {
+            // the frames are read packed into the start of the columns, and then moved to their padded columns,
+            // back to front, so that no frame is overwritten before it is moved
+            float* data = &feat(0, ts);
+            const size_t colstride = feat.getcolstride();
+            freadOrDie(data, sizeof(float), frames * featdim, f);
+            if (colstride != featdim)
+            {
+                for (size_t t = frames - 1; t > 0; t--)
+                    memmove(data + t * colstride, data + t * featdim, featdim * sizeof(float));
+            }
+            if (needbyteswapping)
+            {
+                for (size_t t = 0; t < frames; t++)
+                    for (size_t k = 0; k < featdim; k++)
+                        msra::util::bytereverse(data[t * colstride + k]);
+            }
+            curframe = numframes;
+        }
+        catch (...)
+        {
+            close();
+            throw;
+        }
+        return true;
+    }
     // read an entire utterance into a virgen, allocatable matrix
     // Matrix type needs to have operator(i,j) and resize(n,m)
     template <class MATRIX>
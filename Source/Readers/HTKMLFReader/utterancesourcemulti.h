@@ -134,11 +134,11 @@ class minibatchutterancesourcemulti : public minibatchsource
             const size_t n = numframes(i);
             return msra::dbn::matrixstripe(frames, ts, n);
         }
-        shared_ptr<const latticesource::latticepair> getutterancelattice(size_t i) const // return the frame set for a given utterance
+        shared_ptr<const latticesource::latticepair> getutterancelattice(size_t i) const // return the lattice for a given utterance, expanded
         {
             if (!isinram())
                 LogicError("getutteranceframes: called when data have not been paged in");
-            return lattices[i];
+            return latticesource::expanded(lattices[i]);
         }
 
         // paging
@@ -177,9 +177,9 @@ class minibatchutterancesourcemulti : public minibatchsource
                     // read features for this file
                     auto uttframes = getutteranceframes(i);                                                    // matrix stripe for this utterance (currently unfilled)
                     reader.read(utteranceset[i].parsedpath, (const string &)featkind, sampperiod, uttframes, utteranceset[i].needsExpansion);  // note: file info here used for checkuing only
-                    // page in lattice data
+                    // page in lattice data, compact until an utterance goes into a minibatch (see getutterancelattice())
                     if (!latticesource.empty())
-                        latticesource.getlattices(utteranceset[i].key(), lattices[i], uttframes.cols());
+                        latticesource.getlattices(utteranceset[i].key(), lattices[i], uttframes.cols(), /*compact=*/true);
                 }
                 if (verbosity)
                 {
@@ -6,11 +6,13 @@
 #pragma once
 #include <opencv2/core/mat.hpp>
 #include "Config.h"
+#include "ConcStack.h"
+#include "GpuJpegDecoder.h"
 #ifdef USE_ZIP
 #include <zip.h>
 #include <unordered_map>
 #include <memory>
-#include "ConcStack.h"
+#include "MemoryMappedFile.h"
 #endif
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -18,12 +20,32 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 class ByteReader
 {
 public:
-    ByteReader() = default;
+    ByteReader() : m_minDecodeSide(0) {}
     virtual ~ByteReader() = default;
 
     virtual void Register(const std::map<std::string, size_t>& sequences) = 0;
     virtual cv::Mat Read(size_t seqId, const std::string& path, bool grayscale) = 0;
 
+    // The images only need to have their smaller side at least this long, so that JPEG images can be decoded
+    // at 1/2, 1/4 or 1/8 of their resolution. 0 to always decode at full resolution.
+    void SetMinimumDecodeSide(size_t side)
+    {
+        m_minDecodeSide = side;
+    }
+
+    // JPEG images are decoded by this decoder, when set, and the others by OpenCV.
+    void SetGpuDecoder(const std::shared_ptr<GpuJpegDecoder>& decoder)
+    {
+        m_gpuDecoder = decoder;
+    }
+
+protected:
+    // Decodes the image, on the GPU or at reduced resolution if possible.
+    cv::Mat Decode(const unsigned char* data, size_t size, bool grayscale) const;
+
+    size_t m_minDecodeSide;
+    std::shared_ptr<GpuJpegDecoder> m_gpuDecoder;
+
     DISABLE_COPY_AND_MOVE(ByteReader);
 };
 
@@ -32,6 +54,9 @@ class FileByteReader : public ByteReader
 public:
     void Register(const std::map<std::string, size_t>&) override {}
     cv::Mat Read(size_t seqId, const std::string& path, bool grayscale) override;
+
+private:
+    conc_stack<std::vector<unsigned char>> m_workspace;
 };
 
 #ifdef USE_ZIP
@@ -47,10 +72,18 @@ private:
     using ZipPtr = std::unique_ptr<zip_t, void(*)(zip_t*)>;
     ZipPtr OpenZip();
 
+    // Maps the archive and finds where the data of its uncompressed entries starts.
+    void MapStoredEntries(const std::unordered_map<std::string, size_t>& storedEntries);
+
     std::string m_zipPath;
+    // Every thread reading compressed entries uses a handle of its own, taken from and returned to the pool.
     conc_stack<ZipPtr> m_zips;
     std::unordered_map<size_t, std::pair<zip_uint64_t, zip_uint64_t>> m_seqIdToIndex;
     conc_stack<std::vector<unsigned char>> m_workspace;
+
+    // Uncompressed entries are decoded straight from the mapped archive, by offset of their data and size.
+    std::unique_ptr<MemoryMappedFile> m_mappedFile;
+    std::unordered_map<size_t, std::pair<uint64_t, uint64_t>> m_seqIdToStoredData;
 };
 #endif
 
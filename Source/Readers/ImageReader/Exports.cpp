@@ -67,6 +67,8 @@ extern "C" DATAREADER_API bool CreateTransformer(Transformer** transformer, cons
         *transformer = new TransposeTransformer(config);
     else if (type == L"Cast")
         *transformer = new CastTransformer(config);
+    else if (type == L"CropScaleMean")
+        *transformer = new CropScaleMeanTransformer(config);
     else
         // Unknown type.
         return false;
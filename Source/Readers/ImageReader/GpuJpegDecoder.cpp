@@ -0,0 +1,271 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "GpuJpegDecoder.h"
+#include "Basics.h"
+
+#ifdef USE_NVJPEG
+#include <nvjpeg.h>
+#include <cuda_runtime.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#ifdef USE_NVJPEG
+
+static void CheckCuda(cudaError_t status, const char* what)
+{
+    if (status != cudaSuccess)
+        RuntimeError("GpuJpegDecoder: %s failed: %s", what, cudaGetErrorString(status));
+}
+
+static void CheckNvJpeg(nvjpegStatus_t status, const char* what)
+{
+    if (status != NVJPEG_STATUS_SUCCESS)
+        RuntimeError("GpuJpegDecoder: %s failed with nvJPEG status %d", what, (int)status);
+}
+
+// Restores the device of the calling thread, which e.g. the network on it relies on.
+class CudaDeviceScope
+{
+public:
+    CudaDeviceScope(int deviceId) : m_previous(-1)
+    {
+        CheckCuda(cudaGetDevice(&m_previous), "cudaGetDevice");
+        CheckCuda(cudaSetDevice(deviceId), "cudaSetDevice");
+    }
+
+    ~CudaDeviceScope()
+    {
+        if (m_previous >= 0)
+            cudaSetDevice(m_previous);
+    }
+
+private:
+    int m_previous;
+};
+
+// The batches are decoded by a thread of their own, which only does the host part of nvJPEG and waits for the GPU.
+class NvJpegDecoder : public GpuJpegDecoder
+{
+public:
+    NvJpegDecoder(int deviceId)
+        : m_deviceId(deviceId), m_stop(false), m_warned(false),
+          m_deviceBuffer(nullptr), m_hostBuffer(nullptr), m_bufferSize(0)
+    {
+        CudaDeviceScope scope(deviceId);
+        CheckNvJpeg(nvjpegCreateSimple(&m_handle), "nvjpegCreateSimple");
+        CheckNvJpeg(nvjpegJpegStateCreate(m_handle, &m_state), "nvjpegJpegStateCreate");
+        CheckCuda(cudaStreamCreateWithFlags(&m_stream, cudaStreamNonBlocking), "cudaStreamCreateWithFlags");
+        m_thread = std::thread([this]() { Run(); });
+    }
+
+    ~NvJpegDecoder()
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_stop = true;
+        }
+        m_wakeUp.notify_all();
+        m_thread.join();
+
+        cudaSetDevice(m_deviceId);
+        cudaFree(m_deviceBuffer);
+        cudaFreeHost(m_hostBuffer);
+        cudaStreamDestroy(m_stream);
+        nvjpegJpegStateDestroy(m_state);
+        nvjpegDestroy(m_handle);
+    }
+
+    bool Decode(const unsigned char* data, size_t size, bool grayscale, cv::Mat& image) override
+    {
+        Request request = { data, size, grayscale, &image, false, false };
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_pending.push_back(&request);
+        }
+        m_wakeUp.notify_one();
+
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_done.wait(lock, [&request]() { return request.done; });
+        return request.decoded;
+    }
+
+private:
+    struct Request
+    {
+        const unsigned char* data;
+        size_t size;
+        bool grayscale;
+        cv::Mat* image;
+        bool decoded;
+        bool done;
+    };
+
+    static const size_t s_maxBatchSize = 128;
+
+    void Run()
+    {
+        cudaSetDevice(m_deviceId);
+        for (;;)
+        {
+            std::vector<Request*> batch;
+            bool grayscale;
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_wakeUp.wait(lock, [this]() { return m_stop || !m_pending.empty(); });
+                if (m_pending.empty())
+                    return;
+
+                // The output format is that of the whole batch.
+                grayscale = m_pending.front()->grayscale;
+                for (auto r = m_pending.begin(); r != m_pending.end() && batch.size() < s_maxBatchSize;)
+                {
+                    if ((*r)->grayscale == grayscale)
+                    {
+                        batch.push_back(*r);
+                        r = m_pending.erase(r);
+                    }
+                    else
+                        ++r;
+                }
+            }
+
+            try
+            {
+                DecodeBatch(batch, grayscale);
+            }
+            catch (const std::exception& e)
+            {
+                // The images are then decoded by OpenCV, e.g. progressive JPEGs that older nvJPEG versions reject.
+                if (!m_warned.exchange(true))
+                    fprintf(stderr, "WARNING: %s; decoding on the CPU instead.\n", e.what());
+                for (auto r : batch)
+                    r->decoded = false;
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                for (auto r : batch)
+                    r->done = true;
+            }
+            m_done.notify_all();
+        }
+    }
+
+    void DecodeBatch(const std::vector<Request*>& batch, bool grayscale)
+    {
+        const size_t channels = grayscale ? 1 : 3;
+        std::vector<Request*> jpegs;
+        std::vector<const unsigned char*> data;
+        std::vector<size_t> sizes;
+        std::vector<size_t> offsets;
+        size_t total = 0;
+        for (auto r : batch)
+        {
+            int numComponents;
+            nvjpegChromaSubsampling_t subsampling;
+            int widths[NVJPEG_MAX_COMPONENT], heights[NVJPEG_MAX_COMPONENT];
+            if (nvjpegGetImageInfo(m_handle, r->data, r->size, &numComponents, &subsampling, widths, heights) != NVJPEG_STATUS_SUCCESS ||
+                subsampling == NVJPEG_CSS_UNKNOWN || widths[0] <= 0 || heights[0] <= 0)
+            {
+                r->decoded = false; // not a JPEG nvJPEG knows
+                continue;
+            }
+            r->image->create(heights[0], widths[0], grayscale ? CV_8UC1 : CV_8UC3);
+            jpegs.push_back(r);
+            data.push_back(r->data);
+            sizes.push_back(r->size);
+            offsets.push_back(total);
+            total += (size_t)widths[0] * heights[0] * channels;
+        }
+        if (jpegs.empty())
+            return;
+
+        if (total > m_bufferSize)
+        {
+            cudaFree(m_deviceBuffer);
+            cudaFreeHost(m_hostBuffer);
+            m_deviceBuffer = m_hostBuffer = nullptr;
+            m_bufferSize = 0;
+            size_t size = total + total / 2; // so that slightly larger batches fit as well
+            CheckCuda(cudaMalloc((void**)&m_deviceBuffer, size), "cudaMalloc");
+            CheckCuda(cudaMallocHost((void**)&m_hostBuffer, size), "cudaMallocHost");
+            m_bufferSize = size;
+        }
+
+        std::vector<nvjpegImage_t> outputs(jpegs.size());
+        for (size_t i = 0; i < jpegs.size(); i++)
+        {
+            memset(&outputs[i], 0, sizeof(outputs[i]));
+            outputs[i].channel[0] = m_deviceBuffer + offsets[i];
+            outputs[i].pitch[0] = jpegs[i]->image->cols * channels;
+        }
+
+        // Interleaved BGR is the layout of OpenCV.
+        CheckNvJpeg(nvjpegDecodeBatchedInitialize(m_handle, m_state, (int)jpegs.size(), 1, grayscale ? NVJPEG_OUTPUT_Y : NVJPEG_OUTPUT_BGRI), "nvjpegDecodeBatchedInitialize");
+        CheckNvJpeg(nvjpegDecodeBatched(m_handle, m_state, data.data(), sizes.data(), outputs.data(), m_stream), "nvjpegDecodeBatched");
+        CheckCuda(cudaMemcpyAsync(m_hostBuffer, m_deviceBuffer, total, cudaMemcpyDeviceToHost, m_stream), "cudaMemcpyAsync");
+        CheckCuda(cudaStreamSynchronize(m_stream), "cudaStreamSynchronize");
+
+        for (size_t i = 0; i < jpegs.size(); i++)
+        {
+            const cv::Mat& image = *jpegs[i]->image;
+            memcpy(image.data, m_hostBuffer + offsets[i], image.total() * channels);
+            jpegs[i]->decoded = true;
+        }
+    }
+
+    int m_deviceId;
+    nvjpegHandle_t m_handle;
+    nvjpegJpegState_t m_state;
+    cudaStream_t m_stream;
+
+    std::thread m_thread;
+    std::mutex m_lock;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_done;
+    std::deque<Request*> m_pending;
+    bool m_stop;
+    std::atomic<bool> m_warned;
+
+    // The decoded images of a batch, one after the other.
+    unsigned char* m_deviceBuffer;
+    unsigned char* m_hostBuffer;
+    size_t m_bufferSize;
+};
+
+#endif
+
+/*static*/ std::shared_ptr<GpuJpegDecoder> GpuJpegDecoder::GetShared(int deviceId)
+{
+#ifdef USE_NVJPEG
+    static std::mutex sharedLock;
+    static std::map<int, std::weak_ptr<GpuJpegDecoder>> sharedDecoders;
+    std::unique_lock<std::mutex> lock(sharedLock);
+    auto decoder = sharedDecoders[deviceId].lock();
+    if (!decoder)
+    {
+        decoder = std::make_shared<NvJpegDecoder>(deviceId);
+        sharedDecoders[deviceId] = decoder;
+        fprintf(stderr, "GpuJpegDecoder: decoding JPEG images on GPU %d with nvJPEG.\n", deviceId);
+    }
+    return decoder;
+#else
+    UNUSED(deviceId);
+    return nullptr;
+#endif
+}
+
+}}}
@@ -0,0 +1,29 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+#include <opencv2/core/mat.hpp>
+#include <memory>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Decodes JPEG images on a GPU with nvJPEG, for hosts with too few cores to decode for their GPUs.
+// The decode threads of the reader hand their compressed images to it and wait; the images that arrive while
+// a batch is on the GPU form the next batch, so that as many images are decoded at once as there are threads
+// waiting. The decoded images are copied back into cv::Mats, on which the transforms run as before.
+// The pixels may differ from those of OpenCV by the rounding of the IDCT and of the color conversion.
+class GpuJpegDecoder
+{
+public:
+    virtual ~GpuJpegDecoder() {}
+
+    // Returns false if the data is not a JPEG image nvJPEG can decode; it is then left to OpenCV.
+    virtual bool Decode(const unsigned char* data, size_t size, bool grayscale, cv::Mat& image) = 0;
+
+    // The decoder of the given GPU, shared by the readers of the process; nullptr if built without nvJPEG (USE_NVJPEG).
+    static std::shared_ptr<GpuJpegDecoder> GetShared(int deviceId);
+};
+
+}}}
@@ -58,6 +58,7 @@ ImageConfigHelper::ImageConfigHelper(const ConfigParameters& config)
     m_streams.push_back(labelSection);
 
     m_mapPath = config(L"file");
+    m_cacheMapFile = config(L"cacheMapFile", false);
 
     m_grayscale = config(L"grayscale", c == 1);
     std::string rand = config(L"randomize", "auto");
@@ -93,6 +94,8 @@ ImageConfigHelper::ImageConfigHelper(const ConfigParameters& config)
     }
 
     m_cpuThreadCount = config(L"numCPUThreads", 0);
+    m_decodeThreadCount = config(L"numDecodeThreads", (size_t)0);
+    m_decodeThreadsFirstCore = config(L"decodeThreadsFirstCore", -1);
 
     m_cropType = ParseCropType(featureSection(L"cropType", ""));
 }
@@ -38,6 +38,12 @@ public:
     // Get the map file path that describes mapping of images into their labels.
     std::string GetMapPath() const;
 
+    // Whether the parsed map file is kept in a cache file next to it (see ImageDataDeserializer).
+    bool ShouldCacheMapFile() const
+    {
+        return m_cacheMapFile;
+    }
+
     ImageLayoutKind GetDataFormat() const
     {
         return m_dataFormat;
@@ -48,6 +54,18 @@ public:
         return m_cpuThreadCount;
     }
 
+    // Number of threads decoding and transforming images, independent of the OpenMP threads; 0 to use OpenMP instead.
+    size_t GetDecodeThreadCount() const
+    {
+        return m_decodeThreadCount;
+    }
+
+    // First core to pin the decoding threads to, or -1 to leave them unpinned.
+    int GetDecodeThreadsFirstCore() const
+    {
+        return m_decodeThreadsFirstCore;
+    }
+
     bool ShouldRandomize() const
     {
         return m_randomize;
@@ -75,9 +93,12 @@ private:
     ImageConfigHelper& operator=(const ImageConfigHelper&) = delete;
 
     std::string m_mapPath;
+    bool m_cacheMapFile;
     std::vector<StreamDescriptionPtr> m_streams;
     ImageLayoutKind m_dataFormat;
     int m_cpuThreadCount;
+    size_t m_decodeThreadCount;
+    int m_decodeThreadsFirstCore;
     bool m_randomize;
     bool m_grayscale;
     CropType m_cropType;
@@ -9,6 +9,9 @@
 #include <opencv2/opencv.hpp>
 #include <numeric>
 #include <limits>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
 #include "ImageDataDeserializer.h"
 #include "ImageConfigHelper.h"
 #include "StringUtil.h"
@@ -17,6 +20,14 @@
 #include "ImageTransformers.h"
 #include "SequenceData.h"
 #include "ImageUtil.h"
+#include "CacheFile.h"
+#include "WorkerThreadPool.h"
+#include "GpuJpegDecoder.h"
+
+// Decoding at reduced resolution (cv::IMREAD_REDUCED_*) is available from OpenCV 3.2 on.
+#if CV_VERSION_MAJOR > 3 || (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 2)
+#define IMAGE_READER_USE_REDUCED_DECODE
+#endif
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -81,7 +92,7 @@ public:
         image->m_image = std::move(m_parent.ReadImage(m_description.m_id, imageSequence.m_path, m_parent.m_grayscale));
         auto& cvImage = image->m_image;
         if (!cvImage.data)
-            RuntimeError("Cannot open file '%s'", imageSequence.m_path.c_str());
+            RuntimeError("Cannot open file '%s'", imageSequence.m_path);
 
         // Convert element type.
         ElementType dataType = ConvertImageToSupportedDataType(cvImage);
@@ -170,10 +181,36 @@ ImageDataDeserializer::ImageDataDeserializer(CorpusDescriptorPtr corpus, const C
 
     m_grayscale = config(L"grayscale", false);
 
+    // With gpuDecodeDevice, JPEG images are decoded on that GPU, normally the one the network is trained on.
+    m_gpuDecodeDevice = config(L"gpuDecodeDevice", -1);
+
+    // With reducedDecode, the images are decoded at the lowest resolution that is enough
+    // for the crop and scale transforms at the beginning of the feature transforms.
+    m_minDecodeSide = 0;
+    if (config(L"reducedDecode", false) && featureSection.ExistsCurrent(L"transforms"))
+    {
+        const ConfigParameters* crop = nullptr;
+        argvector<ConfigParameters> transforms = featureSection("transforms");
+        for (size_t i = 0; i < transforms.size(); ++i)
+        {
+            std::wstring type = transforms[i](L"type", L"");
+            if (type == L"Crop" && !crop)
+                crop = &transforms[i];
+            else if (type == L"Scale" || type == L"CropScaleMean")
+            {
+                // CropScaleMean has the crop parameters in its own section.
+                m_minDecodeSide = GetMinimumDecodeSide(crop && type == L"Scale" ? *crop : transforms[i], transforms[i]);
+                break;
+            }
+            else // anything else needs the image at its original resolution
+                break;
+        }
+    }
+
     // TODO: multiview should be done on the level of randomizer/transformers - it is responsiblity of the
     // TODO: randomizer to collect how many copies each transform needs and request same sequence several times.
     bool multiViewCrop = config(L"multiViewCrop", false);
-    CreateSequenceDescriptions(corpus, config(L"file"), labelDimension, multiViewCrop);
+    CreateSequenceDescriptions(corpus, config(L"file"), labelDimension, multiViewCrop, config(L"cacheMapFile", false));
 }
 
 // TODO: Should be removed at some point.
@@ -204,6 +241,15 @@ ImageDataDeserializer::ImageDataDeserializer(const ConfigParameters& config)
 
     size_t labelDimension = label->m_sampleLayout->GetDim(0);
 
+    // With reducedDecode, the images are decoded at the lowest resolution that is enough for crop and scale.
+    m_minDecodeSide = 0;
+    if (config(L"reducedDecode", false))
+    {
+        ConfigParameters featureSection = config(feature->m_name);
+        m_minDecodeSide = GetMinimumDecodeSide(featureSection, featureSection);
+    }
+    m_gpuDecodeDevice = config(L"gpuDecodeDevice", -1);
+
     if (label->m_elementType == ElementType::tfloat)
     {
         m_labelGenerator = std::make_shared<TypedLabelGenerator<float>>(labelDimension);
@@ -217,7 +263,24 @@ ImageDataDeserializer::ImageDataDeserializer(const ConfigParameters& config)
         RuntimeError("Unsupported label element type '%d'.", (int)label->m_elementType);
     }
 
-    CreateSequenceDescriptions(std::make_shared<CorpusDescriptor>(), configHelper.GetMapPath(), labelDimension, configHelper.IsMultiViewCrop());
+    CreateSequenceDescriptions(std::make_shared<CorpusDescriptor>(), configHelper.GetMapPath(), labelDimension, configHelper.IsMultiViewCrop(), configHelper.ShouldCacheMapFile());
+}
+
+// The length the smaller side of a decoded image needs at least, so that all crops of the given crop transform
+// config are still at least as large as the target of the given scale transform config.
+/*static*/ size_t ImageDataDeserializer::GetMinimumDecodeSide(const ConfigParameters& crop, const ConfigParameters& scale)
+{
+    size_t width = scale(L"width");
+    size_t height = scale(L"height");
+
+    floatargvector cropRatio = crop(L"cropRatio", "1.0");
+    doubleargvector aspectRatioRadius = crop(L"aspectRatioRadius", ConfigParameters::Array(doubleargvector(vector<double>{0.0})));
+    double maxAspectRatioRadius = *std::max_element(aspectRatioRadius.begin(), aspectRatioRadius.end());
+
+    // The crop is a square of the smaller side times the crop ratio, of which a changed
+    // aspect ratio may shrink one side by up to sqrt(1 + aspectRatioRadius).
+    double shortestCropRatio = cropRatio[0] / std::sqrt(1.0 + maxAspectRatioRadius);
+    return (size_t)std::ceil(std::max(width, height) / shortestCropRatio);
 }
 
 // Descriptions of chunks exposed by the image reader.
@@ -243,42 +306,377 @@ void ImageDataDeserializer::GetSequencesForChunk(ChunkIdType chunkId, std::vecto
     result.push_back(m_imageSequences[chunkId]);
 }
 
-void ImageDataDeserializer::CreateSequenceDescriptions(CorpusDescriptorPtr corpus, std::string mapPath, size_t labelDimension, bool isMultiCrop)
+// The map file cache is memory mapped and consists of
+//   MapFileCacheHeader
+//   MapFileLine[m_numberOfLines]
+//   the sequence keys, m_keysSize bytes in total
+//   the image paths, each followed by a zero, m_pathsSize bytes in total
+// It has all lines of the map file, not only those of the corpus, which are picked when the cache is loaded.
+struct ImageDataDeserializer::MapFileCacheHeader
+{
+    uint64_t m_magic;
+    uint32_t m_version;
+    uint32_t m_reserved;
+    uint64_t m_mapFileSize;
+    uint64_t m_mapFileTime;
+    uint64_t m_numberOfLines;
+    uint64_t m_keysSize;
+    uint64_t m_pathsSize;
+};
+
+struct ImageDataDeserializer::MapFileLine
+{
+    uint64_t m_keyOffset;
+    uint64_t m_pathOffset;
+    uint64_t m_classId;    // s_invalidClassId if the label is not a number
+    uint32_t m_keyLength;  // 0 in the old format without sequence keys, where the key is the line number
+    uint32_t m_pathLength;
+};
+
+struct ImageDataDeserializer::ParsedMapFile
+{
+    vector<MapFileLine> m_lines;
+    vector<char> m_keys;
+    vector<char> m_paths;
+};
+
+static const uint64_t s_mapFileCacheMagic = 0x48434150414d4943ULL; // "CIMAPACH"
+static const uint32_t s_mapFileCacheVersion = 1;
+static const uint64_t s_invalidClassId = UINT64_MAX;
+
+// The class id of a map file line, read like strtoull() does but without leaving the field:
+// white space, an optional '+' and decimal digits, after which anything else is ignored.
+static uint64_t ParseClassId(const char* begin, const char* end)
+{
+    while (begin != end && isspace((unsigned char)*begin))
+        ++begin;
+    if (begin != end && *begin == '+')
+        ++begin;
+    if (begin == end || !isdigit((unsigned char)*begin))
+        return s_invalidClassId;
+
+    uint64_t value = 0;
+    for (; begin != end && isdigit((unsigned char)*begin); ++begin)
+    {
+        uint64_t digit = *begin - '0';
+        if (value > (s_invalidClassId - 1 - digit) / 10)
+            return s_invalidClassId; // out of range
+        value = value * 10 + digit;
+    }
+    return value;
+}
+
+// Parses the lines [begin, end) of a map file, which are either <key> <path> <label> or <path> <label>,
+// tab-delimited. Returns the number of lines, or sets errorLine to the first line that is neither.
+size_t ImageDataDeserializer::ParseMapFileLines(const char* begin, const char* end, vector<MapFileLine>& lines,
+                                                vector<char>& keys, vector<char>& paths, size_t& errorLine)
 {
-    std::ifstream mapFile(mapPath);
-    if (!mapFile)
+    auto append = [](vector<char>& strings, const char* b, const char* e)
+    {
+        strings.insert(strings.end(), b, e);
+    };
+
+    size_t lineIndex = 0;
+    for (const char* lineBegin = begin; lineBegin != end; ++lineIndex)
+    {
+        const char* lineEnd = std::find(lineBegin, end, '\n');
+        const char* next = lineEnd == end ? end : lineEnd + 1;
+        if (lineEnd != lineBegin && lineEnd[-1] == '\r')
+            --lineEnd;
+
+        // The columns as std::getline() splits them: a column is missing if nothing is left for it.
+        const char* tab1 = std::find(lineBegin, lineEnd, '\t');
+        bool hasSecond = tab1 != lineEnd && tab1 + 1 != lineEnd;
+        const char* tab2 = hasSecond ? std::find(tab1 + 1, lineEnd, '\t') : lineEnd;
+        bool hasThird = hasSecond && tab2 != lineEnd && tab2 + 1 != lineEnd;
+
+        MapFileLine line = {};
+        const char *path, *pathEnd, *label, *labelEnd;
+        if (hasThird)
+        {
+            line.m_keyOffset = keys.size();
+            line.m_keyLength = (uint32_t)(tab1 - lineBegin);
+            append(keys, lineBegin, tab1);
+            path = tab1 + 1;
+            pathEnd = tab2;
+            label = tab2 + 1;
+            labelEnd = std::find(label, lineEnd, '\t');
+        }
+        else
+        {
+            // In case when the sequence key is not specified it is the line number inside the mapping file.
+            // Assume that only image path and class label is given (old format).
+            path = lineBegin;
+            pathEnd = tab1;
+            label = hasSecond ? tab1 + 1 : lineEnd;
+            labelEnd = tab2;
+            if (label == labelEnd || path == pathEnd)
+            {
+                errorLine = lineIndex;
+                return lineIndex;
+            }
+        }
+
+        line.m_pathOffset = paths.size();
+        line.m_pathLength = (uint32_t)(pathEnd - path);
+        append(paths, path, pathEnd);
+        paths.push_back('\0');
+        line.m_classId = ParseClassId(label, labelEnd);
+        lines.push_back(line);
+
+        lineBegin = next;
+    }
+    return lineIndex;
+}
+
+// The map file is split into blocks at line ends, which are parsed in parallel. The strings of the lines
+// are only copied into the compact key and path arrays, so that it does not matter for how many lines of
+// the map file the CPU has to wait.
+void ImageDataDeserializer::ParseMapFile(const std::string& mapPath, ParsedMapFile& parsed)
+{
+    const std::wstring path = msra::strfun::utf16(mapPath);
+    unique_ptr<MemoryMappedFile> mapFile;
+    try
+    {
+        mapFile = make_unique<MemoryMappedFile>(path);
+    }
+    catch (const std::exception&)
     {
         RuntimeError("Could not open %s for reading.", mapPath.c_str());
     }
+    mapFile->Advise(0, mapFile->Size(), MemoryMappedFile::Access::Sequential);
+    const char* data = mapFile->Data();
+    const size_t size = mapFile->Size();
 
+    struct Block
+    {
+        const char* m_begin;
+        const char* m_end;
+        vector<MapFileLine> m_lines;
+        vector<char> m_keys, m_paths;
+        size_t m_numberOfLines;
+        size_t m_errorLine;
+    };
+
+    const size_t minBlockSize = 1024 * 1024;
+    auto pool = size > minBlockSize ? WorkerThreadPool::GetShared(0) : nullptr;
+    const size_t numberOfBlocks = pool ? std::min(4 * pool->NumThreads(), (size + minBlockSize - 1) / minBlockSize) : 1;
+    vector<Block> blocks(numberOfBlocks);
+    const char* blockBegin = data;
+    for (size_t i = 0; i < numberOfBlocks; ++i)
+    {
+        // a block ends after the first line end at or after its share of the file
+        const char* blockEnd = data + size;
+        if (i + 1 < numberOfBlocks)
+        {
+            const char* target = std::max(blockBegin, data + size * (i + 1) / numberOfBlocks);
+            blockEnd = std::find(target, data + size, '\n');
+            blockEnd = blockEnd == data + size ? blockEnd : blockEnd + 1;
+        }
+        blocks[i].m_begin = blockBegin;
+        blocks[i].m_end = blockEnd;
+        blocks[i].m_errorLine = SIZE_MAX;
+        blockBegin = blockEnd;
+    }
+
+    auto parseBlock = [&](size_t i)
+    {
+        auto& block = blocks[i];
+        block.m_numberOfLines = ParseMapFileLines(block.m_begin, block.m_end, block.m_lines, block.m_keys, block.m_paths, block.m_errorLine);
+    };
+    if (pool)
+        pool->ParallelFor(numberOfBlocks, parseBlock);
+    else
+        parseBlock(0);
+
+    size_t numberOfLines = 0, keysSize = 0, pathsSize = 0;
+    for (const auto& block : blocks)
+    {
+        if (block.m_errorLine != SIZE_MAX)
+            RuntimeError("Invalid map file format, must contain 2 or 3 tab-delimited columns, line %" PRIu64 " in file %s.", numberOfLines + block.m_errorLine, mapPath.c_str());
+        numberOfLines += block.m_numberOfLines;
+        keysSize += block.m_keys.size();
+        pathsSize += block.m_paths.size();
+    }
+
+    parsed.m_lines.reserve(numberOfLines);
+    parsed.m_keys.reserve(keysSize);
+    parsed.m_paths.reserve(pathsSize);
+    for (auto& block : blocks)
+    {
+        for (auto line : block.m_lines)
+        {
+            line.m_keyOffset += parsed.m_keys.size();
+            line.m_pathOffset += parsed.m_paths.size();
+            parsed.m_lines.push_back(line);
+        }
+        parsed.m_keys.insert(parsed.m_keys.end(), block.m_keys.begin(), block.m_keys.end());
+        parsed.m_paths.insert(parsed.m_paths.end(), block.m_paths.begin(), block.m_paths.end());
+        block = Block(); // frees its memory
+    }
+}
+
+void ImageDataDeserializer::CreateSequenceDescriptions(CorpusDescriptorPtr corpus, std::string mapPath, size_t labelDimension, bool isMultiCrop, bool cacheMapFile)
+{
+    Timer timer;
+    timer.Start();
+
+    auto useParsedMapFile = [&](ParsedMapFile& parsed)
+    {
+        m_paths = move(parsed.m_paths);
+        IndexMapFile(corpus, mapPath, parsed.m_lines.data(), parsed.m_lines.size(), parsed.m_keys.data(), m_paths.data(), labelDimension, isMultiCrop);
+    };
+
+    if (!cacheMapFile)
+    {
+        ParsedMapFile parsed;
+        ParseMapFile(mapPath, parsed);
+        useParsedMapFile(parsed);
+    }
+    else
+    {
+        // One process parses the map file into the cache, all others (and later runs) only map it.
+        const std::wstring path = msra::strfun::utf16(mapPath);
+        const std::wstring cachePath = path + L".cache";
+        if (!fexists(path))
+            RuntimeError("Could not open %s for reading.", mapPath.c_str());
+        const auto expected = GetExpectedCacheHeader(path);
+        LoadOrBuildCache(cachePath, L"image map",
+            [&]() { return TryLoadCache(corpus, mapPath, cachePath, expected, labelDimension, isMultiCrop); },
+            [&]()
+            {
+                ParsedMapFile parsed;
+                ParseMapFile(mapPath, parsed);
+                WriteCache(cachePath, expected, parsed);
+
+                // the mapped paths are shared with other processes, the parsed ones are not
+                if (!TryLoadCache(corpus, mapPath, cachePath, expected, labelDimension, isMultiCrop))
+                    useParsedMapFile(parsed);
+            },
+            [&]()
+            {
+                ParsedMapFile parsed;
+                ParseMapFile(mapPath, parsed);
+                useParsedMapFile(parsed);
+            });
+    }
+
+    timer.Stop();
+    if (m_verbosity > 1)
+    {
+        fprintf(stderr, "ImageDeserializer: Read information about %d images in %.6g seconds\n", (int)m_imageSequences.size(), timer.ElapsedSeconds());
+    }
+}
+
+ImageDataDeserializer::MapFileCacheHeader ImageDataDeserializer::GetExpectedCacheHeader(const std::wstring& mapPath)
+{
+    // The map file is not read to check the cache, it is identified by its size and modification time instead.
+    MapFileCacheHeader header = {};
+    header.m_magic = s_mapFileCacheMagic;
+    header.m_version = s_mapFileCacheVersion;
+    header.m_mapFileSize = filesize(mapPath.c_str());
+    header.m_mapFileTime = GetModificationTime(mapPath);
+    return header;
+}
+
+bool ImageDataDeserializer::TryLoadCache(CorpusDescriptorPtr corpus, const std::string& mapPath, const std::wstring& cachePath, const MapFileCacheHeader& expected,
+                                         size_t labelDimension, bool isMultiCrop)
+{
+    static_assert(sizeof(MapFileCacheHeader) == 56, "MapFileCacheHeader must not have padding.");
+    static_assert(sizeof(MapFileLine) == 32, "MapFileLine must not have padding.");
+
+    if (!fexists(cachePath))
+    {
+        return false;
+    }
+
+    unique_ptr<MemoryMappedFile> cache;
+    try
+    {
+        cache = make_unique<MemoryMappedFile>(cachePath);
+    }
+    catch (const std::exception&)
+    {
+        return false; // e.g. replaced by another process in the meantime
+    }
+
+    MapFileCacheHeader header;
+    if (cache->Size() < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, cache->Data(), sizeof(header));
+
+    const size_t linesOffset = sizeof(header);
+    const size_t keysOffset = linesOffset + header.m_numberOfLines * sizeof(MapFileLine);
+    const size_t pathsOffset = keysOffset + header.m_keysSize;
+    if (header.m_magic != expected.m_magic || header.m_version != expected.m_version ||
+        header.m_mapFileSize != expected.m_mapFileSize || header.m_mapFileTime != expected.m_mapFileTime ||
+        cache->Size() != pathsOffset + header.m_pathsSize)
+    {
+        // outdated, or written by a process that did not finish
+        return false;
+    }
+
+    // The keys and paths are used in place, only the lines need to be checked.
+    const auto lines = reinterpret_cast<const MapFileLine*>(cache->Data() + linesOffset);
+    const char* paths = cache->Data() + pathsOffset;
+    for (size_t i = 0; i < header.m_numberOfLines; ++i)
+    {
+        const auto& line = lines[i];
+        if (line.m_keyOffset + line.m_keyLength > header.m_keysSize || line.m_pathOffset + line.m_pathLength >= header.m_pathsSize ||
+            paths[line.m_pathOffset + line.m_pathLength] != '\0')
+        {
+            fprintf(stderr, "WARNING: The image map cache (%ls) is corrupt, ignoring it.\n", cachePath.c_str());
+            return false;
+        }
+    }
+
+    m_mapFileCache = move(cache);
+    IndexMapFile(corpus, mapPath, lines, header.m_numberOfLines, m_mapFileCache->Data() + keysOffset, paths, labelDimension, isMultiCrop);
+    return true;
+}
+
+void ImageDataDeserializer::WriteCache(const std::wstring& cachePath, const MapFileCacheHeader& header, const ParsedMapFile& parsed)
+{
+    WriteCacheAtomically(cachePath, L"image map", [&](FILE* file)
+    {
+        MapFileCacheHeader completeHeader = header;
+        completeHeader.m_numberOfLines = parsed.m_lines.size();
+        completeHeader.m_keysSize = parsed.m_keys.size();
+        completeHeader.m_pathsSize = parsed.m_paths.size();
+        fwriteOrDie(&completeHeader, sizeof(completeHeader), 1, file);
+        if (!parsed.m_lines.empty())
+            fwriteOrDie(parsed.m_lines.data(), sizeof(MapFileLine), parsed.m_lines.size(), file);
+        if (!parsed.m_keys.empty())
+            fwriteOrDie(parsed.m_keys.data(), 1, parsed.m_keys.size(), file);
+        if (!parsed.m_paths.empty())
+            fwriteOrDie(parsed.m_paths.data(), 1, parsed.m_paths.size(), file);
+    });
+}
+
+void ImageDataDeserializer::IndexMapFile(CorpusDescriptorPtr corpus, const std::string& mapPath, const MapFileLine* lines, size_t numberOfLines,
+                                         const char* keys, const char* paths, size_t labelDimension, bool isMultiCrop)
+{
     size_t itemsPerLine = isMultiCrop ? 10 : 1;
     size_t curId = 0;
-    std::string line;
     PathReaderMap knownReaders;
     ReaderSequenceMap readerSequences;
     ImageSequenceDescription description;
     description.m_numberOfSamples = 1;
 
-    Timer timer;
-    timer.Start();
+    m_imageSequences.reserve(numberOfLines * itemsPerLine);
+    m_keyToSequence.reserve(numberOfLines * itemsPerLine);
 
     auto& stringRegistry = corpus->GetStringRegistry();
-    for (size_t lineIndex = 0; std::getline(mapFile, line); ++lineIndex)
+    std::string sequenceKey;
+    for (size_t lineIndex = 0; lineIndex < numberOfLines; ++lineIndex)
     {
-        std::stringstream ss(line);
-        std::string imagePath, classId, sequenceKey;
-        // Try to parse sequence id, file path and label.
-        if (!std::getline(ss, sequenceKey, '\t') || !std::getline(ss, imagePath, '\t') || !std::getline(ss, classId, '\t'))
-        {
-            // In case when the sequence key is not specified we set it to the line number inside the mapping file.
-            // Assume that only image path and class label is given (old format).
-            classId = imagePath;
-            imagePath = sequenceKey;
+        const auto& line = lines[lineIndex];
+        if (line.m_keyLength == 0)
             sequenceKey = std::to_string(lineIndex);
-
-            if (classId.empty() || imagePath.empty())
-                RuntimeError("Invalid map file format, must contain 2 or 3 tab-delimited columns, line %" PRIu64 " in file %s.", lineIndex, mapPath.c_str());
-        }
+        else
+            sequenceKey.assign(keys + line.m_keyOffset, line.m_keyLength);
 
         // Skipping sequences that are not included in corpus.
         if (!corpus->IsIncluded(sequenceKey))
@@ -286,17 +684,16 @@ void ImageDataDeserializer::CreateSequenceDescriptions(CorpusDescriptorPtr corpu
             continue;
         }
 
-        char* eptr;
-        errno = 0;
-        size_t cid = strtoull(classId.c_str(), &eptr, 10);
-        if (classId.c_str() == eptr || errno == ERANGE)
+        const char* imagePath = paths + line.m_pathOffset;
+        if (line.m_classId == s_invalidClassId)
             RuntimeError("Cannot parse label value on line %" PRIu64 ", second column, in file %s.", lineIndex, mapPath.c_str());
 
+        size_t cid = line.m_classId;
         if (cid >= labelDimension)
         {
             RuntimeError(
                 "Image '%s' has invalid class id '%" PRIu64 "'. It is exceeding the label dimension of '%" PRIu64 "'. Line %" PRIu64 " in file %s.",
-                imagePath.c_str(), cid, labelDimension, lineIndex, mapPath.c_str());
+                imagePath, cid, labelDimension, lineIndex, mapPath.c_str());
         }
 
         if (CHUNKID_MAX < curId + itemsPerLine)
@@ -319,15 +716,31 @@ void ImageDataDeserializer::CreateSequenceDescriptions(CorpusDescriptorPtr corpu
         }
     }
 
-    for (auto& reader : knownReaders)
+    if (m_minDecodeSide != 0)
     {
-        reader.second->Register(readerSequences[reader.first]);
+#ifdef IMAGE_READER_USE_REDUCED_DECODE
+        if (m_verbosity > 0)
+            fprintf(stderr, "ImageDeserializer: Decoding JPEG images at reduced resolution, to at least %d on the smaller side\n", (int)m_minDecodeSide);
+#else
+        fprintf(stderr, "WARNING: ImageDeserializer: reducedDecode needs OpenCV 3.2 or newer, decoding at full resolution\n");
+#endif
     }
 
-    timer.Stop();
-    if (m_verbosity > 1)
+    std::shared_ptr<GpuJpegDecoder> gpuDecoder;
+    if (m_gpuDecodeDevice >= 0)
     {
-        fprintf(stderr, "ImageDeserializer: Read information about %d images in %.6g seconds\n", (int)m_imageSequences.size(), timer.ElapsedSeconds());
+        gpuDecoder = GpuJpegDecoder::GetShared(m_gpuDecodeDevice);
+        if (!gpuDecoder)
+            fprintf(stderr, "WARNING: ImageDeserializer: gpuDecodeDevice needs a build with nvJPEG, decoding on the CPU\n");
+    }
+
+    m_defaultReader.SetMinimumDecodeSide(m_minDecodeSide);
+    m_defaultReader.SetGpuDecoder(gpuDecoder);
+    for (auto& reader : knownReaders)
+    {
+        reader.second->SetMinimumDecodeSide(m_minDecodeSide);
+        reader.second->SetGpuDecoder(gpuDecoder);
+        reader.second->Register(readerSequences[reader.first]);
     }
 }
 
@@ -337,14 +750,15 @@ ChunkPtr ImageDataDeserializer::GetChunk(ChunkIdType chunkId)
     return std::make_shared<ImageChunk>(sequenceDescription, *this);
 }
 
-void ImageDataDeserializer::RegisterByteReader(size_t seqId, const std::string& path, PathReaderMap& knownReaders, ReaderSequenceMap& readerSequences)
+void ImageDataDeserializer::RegisterByteReader(size_t seqId, const char* imagePath, PathReaderMap& knownReaders, ReaderSequenceMap& readerSequences)
 {
-    assert(!path.empty());
+    assert(*imagePath != '\0');
 
-    auto atPos = path.find_first_of('@');
     // Is it container or plain image file?
-    if (atPos == std::string::npos)
+    if (strchr(imagePath, '@') == nullptr)
         return;
+    const std::string path(imagePath);
+    auto atPos = path.find_first_of('@');
     // REVIEW alexeyk: only .zip container support for now.
 #ifdef USE_ZIP
     assert(atPos > 0);
@@ -391,9 +805,56 @@ cv::Mat FileByteReader::Read(size_t, const std::string& path, bool grayscale)
 {
     assert(!path.empty());
 
+    // The GPU decoder gets the compressed bytes, and for reduced decode the header has to be looked at first,
+    // so then the file is read into memory and decoded from there.
+    bool decodeFromMemory = m_gpuDecoder != nullptr;
+#ifdef IMAGE_READER_USE_REDUCED_DECODE
+    decodeFromMemory = decodeFromMemory || m_minDecodeSide != 0;
+#endif
+    if (decodeFromMemory)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return cv::Mat(); // same as cv::imread for a missing file
+        size_t size = (size_t)file.tellg();
+        auto contents = m_workspace.pop_or_create([size]() { return vector<unsigned char>(size); });
+        contents.resize(size);
+        file.seekg(0);
+        cv::Mat image;
+        if (size > 0 && file.read(reinterpret_cast<char*>(contents.data()), size))
+            image = Decode(contents.data(), size, grayscale);
+        m_workspace.push(std::move(contents));
+        return image;
+    }
+
     return cv::imread(path, grayscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
 }
 
+cv::Mat ByteReader::Decode(const unsigned char* data, size_t size, bool grayscale) const
+{
+    cv::Mat image;
+    if (m_gpuDecoder && m_gpuDecoder->Decode(data, size, grayscale, image))
+        return image; // at full resolution, nvJPEG has no reduced decode
+
+    int flags = grayscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR;
+#ifdef IMAGE_READER_USE_REDUCED_DECODE
+    int width, height;
+    if (m_minDecodeSide != 0 && GetJpegImageSize(data, size, width, height))
+    {
+        // Pick the smallest of the scales libjpeg supports that keeps the smaller side long enough.
+        size_t side = (size_t)std::min(width, height);
+        if (side >= 8 * m_minDecodeSide)
+            flags = grayscale ? cv::IMREAD_REDUCED_GRAYSCALE_8 : cv::IMREAD_REDUCED_COLOR_8;
+        else if (side >= 4 * m_minDecodeSide)
+            flags = grayscale ? cv::IMREAD_REDUCED_GRAYSCALE_4 : cv::IMREAD_REDUCED_COLOR_4;
+        else if (side >= 2 * m_minDecodeSide)
+            flags = grayscale ? cv::IMREAD_REDUCED_GRAYSCALE_2 : cv::IMREAD_REDUCED_COLOR_2;
+    }
+#endif
+    cv::Mat buffer(1, (int)size, CV_8U, const_cast<unsigned char*>(data));
+    return cv::imdecode(buffer, flags);
+}
+
 bool ImageDataDeserializer::GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& result)
 {
     auto index = m_keyToSequence.find(key.m_sequence);
@@ -10,6 +10,7 @@
 #include "ByteReader.h"
 #include <unordered_map>
 #include "CorpusDescriptor.h"
+#include "MemoryMappedFile.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -31,6 +32,12 @@ public:
     // Gets sequences by specified ids. Order of returned sequences corresponds to the order of provided ids.
     virtual ChunkPtr GetChunk(ChunkIdType chunkId) override;
 
+    // The images are only read when their sequences are requested.
+    virtual bool SupportsConcurrentGetChunk() const override
+    {
+        return true;
+    }
+
     // Gets chunk descriptions.
     virtual ChunkDescriptions GetChunkDescriptions() override;
 
@@ -45,16 +52,38 @@ public:
    typedef std::shared_ptr<LabelGenerator> LabelGeneratorPtr;
 
 private:
-    // Creates a set of sequence descriptions.
-    void CreateSequenceDescriptions(CorpusDescriptorPtr corpus, std::string mapPath, size_t labelDimension, bool isMultiCrop);
+    // The length the smaller side of the decoded images needs for the given crop and scale transforms.
+    static size_t GetMinimumDecodeSide(const ConfigParameters& crop, const ConfigParameters& scale);
+
+    // Creates a set of sequence descriptions, from the map file or from its cache.
+    void CreateSequenceDescriptions(CorpusDescriptorPtr corpus, std::string mapPath, size_t labelDimension, bool isMultiCrop, bool cacheMapFile);
+
+    // The lines of the map file as parsed, in the layout of the map file cache (see ImageDataDeserializer.cpp).
+    struct MapFileCacheHeader;
+    struct MapFileLine;
+    struct ParsedMapFile;
+    static void ParseMapFile(const std::string& mapPath, ParsedMapFile& parsed);
+    static size_t ParseMapFileLines(const char* begin, const char* end, std::vector<MapFileLine>& lines,
+                                    std::vector<char>& keys, std::vector<char>& paths, size_t& errorLine);
+    static MapFileCacheHeader GetExpectedCacheHeader(const std::wstring& mapPath);
+    static void WriteCache(const std::wstring& cachePath, const MapFileCacheHeader& header, const ParsedMapFile& parsed);
+    bool TryLoadCache(CorpusDescriptorPtr corpus, const std::string& mapPath, const std::wstring& cachePath, const MapFileCacheHeader& expected, size_t labelDimension, bool isMultiCrop);
+
+    // Creates the sequence descriptions of the lines of the corpus; 'paths' has to outlive them.
+    void IndexMapFile(CorpusDescriptorPtr corpus, const std::string& mapPath, const MapFileLine* lines, size_t numberOfLines,
+                      const char* keys, const char* paths, size_t labelDimension, bool isMultiCrop);
 
     // Image sequence descriptions. Currently, a sequence contains a single sample only.
     struct ImageSequenceDescription : public SequenceDescription
     {
-        std::string m_path;
+        const char* m_path; // zero-terminated, in m_paths or m_mapFileCache
         size_t m_classId;
     };
 
+    // The image paths of all lines of the map file, one after another, or the mapped cache that has them.
+    std::vector<char> m_paths;
+    std::unique_ptr<MemoryMappedFile> m_mapFileCache;
+
     class ImageChunk;
     
     LabelGeneratorPtr m_labelGenerator;
@@ -63,7 +92,7 @@ private:
     std::vector<ImageSequenceDescription> m_imageSequences;
 
     // Mapping of logical sequence key into sequence description.
-    std::map<size_t, size_t> m_keyToSequence;
+    std::unordered_map<size_t, size_t> m_keyToSequence;
 
     // Precision required by the network.
     ElementType m_precision;
@@ -74,7 +103,7 @@ private:
     // Not using nocase_compare here as it's not correct on Linux.
     using PathReaderMap = std::unordered_map<std::string, std::shared_ptr<ByteReader>>;
     using ReaderSequenceMap = std::map<std::string, std::map<std::string, size_t>>;
-    void RegisterByteReader(size_t seqId, const std::string& path, PathReaderMap& knownReaders, ReaderSequenceMap& readerSequences);
+    void RegisterByteReader(size_t seqId, const char* path, PathReaderMap& knownReaders, ReaderSequenceMap& readerSequences);
     cv::Mat ReadImage(size_t seqId, const std::string& path, bool grayscale);
 
     // REVIEW alexeyk: can potentially use vector instead of map. Need to handle default reader and resizing though.
@@ -83,6 +112,12 @@ private:
 
     FileByteReader m_defaultReader;
     int m_verbosity;
+
+    // The images are decoded at a reduced resolution that still has this length on the smaller side, 0 for full resolution.
+    size_t m_minDecodeSide;
+
+    // The GPU the JPEG images are decoded on, -1 to decode them on the CPU.
+    int m_gpuDecodeDevice;
 };
 
 }}}
@@ -12,7 +12,6 @@
 #include "NoRandomizer.h"
 #include "ImageDataDeserializer.h"
 #include "FramePacker.h"
-#include <omp.h>
 #include "TransformController.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -32,14 +31,19 @@ ImageReader::ImageReader(const ConfigParameters& config)
     m_streams = configHelper.GetStreams();
     assert(m_streams.size() == 2);
 
-    int threadCount = configHelper.GetCpuThreadCount();
-    if (threadCount > 0)
-    {
-        omp_set_num_threads(threadCount);
-    }
-
     auto deserializer = std::make_shared<ImageDataDeserializer>(config);
 
+    // With numDecodeThreads, decoding and transforms run on threads of their own instead of the OpenMP ones,
+    // which are shared with the math library. numCPUThreads of the reader used to set the number of OpenMP threads
+    // of the whole process, the math library's included; it now is the number of these threads if numDecodeThreads
+    // is not given.
+    WorkerThreadPoolPtr workerThreadPool;
+    size_t decodeThreadCount = configHelper.GetDecodeThreadCount();
+    if (decodeThreadCount == 0 && configHelper.GetCpuThreadCount() > 0)
+        decodeThreadCount = configHelper.GetCpuThreadCount();
+    if (decodeThreadCount > 0)
+        workerThreadPool = WorkerThreadPool::GetShared(decodeThreadCount, configHelper.GetDecodeThreadsFirstCore());
+
     SequenceEnumeratorPtr randomizer;
     // Request multi-threaded randomizer operation to speed up CPU-intensive image-decoding and transformations.
     const bool multithreadedGetNextSequences = true;
@@ -49,11 +53,15 @@ ImageReader::ImageReader(const ConfigParameters& config)
         bool useLegacyRandomization = false;
         // We do not do io prefetching, because chunks are single images currently.
         bool ioPrefetch = false;
-        randomizer = std::make_shared<BlockRandomizer>(0, 1, deserializer, ioPrefetch, BlockRandomizer::DecimationMode::sequence, useLegacyRandomization, multithreadedGetNextSequences);
+        auto blockRandomizer = std::make_shared<BlockRandomizer>(0, 1, deserializer, ioPrefetch, BlockRandomizer::DecimationMode::sequence, useLegacyRandomization, multithreadedGetNextSequences);
+        blockRandomizer->SetWorkerThreadPool(workerThreadPool);
+        randomizer = blockRandomizer;
     }
     else
     {
-        randomizer = std::make_shared<NoRandomizer>(deserializer, multithreadedGetNextSequences);
+        auto noRandomizer = std::make_shared<NoRandomizer>(deserializer, multithreadedGetNextSequences);
+        noRandomizer->SetWorkerThreadPool(workerThreadPool);
+        randomizer = noRandomizer;
     }
 
     // Create transformations for a single feature stream.
@@ -61,22 +69,46 @@ ImageReader::ImageReader(const ConfigParameters& config)
     ConfigParameters featureStream = config(featureName);
 
     std::vector<Transformation> transformations;
-    transformations.push_back(Transformation{ std::make_shared<CropTransformer>(featureStream), featureName });
-    transformations.push_back(Transformation{ std::make_shared<ScaleTransformer>(featureStream), featureName });
-    transformations.push_back(Transformation{ std::make_shared<ColorTransformer>(featureStream), featureName });
-    transformations.push_back(Transformation{ std::make_shared<IntensityTransformer>(featureStream), featureName });
-    transformations.push_back(Transformation{ std::make_shared<MeanTransformer>(featureStream), featureName });
-
-    if (configHelper.GetDataFormat() == CHW)
+    bool deviceAugmentation = featureStream(L"deviceAugmentation", false);
+    if (deviceAugmentation)
+    {
+        // Crop and scale as for fuseTransforms, then the 8-bit images go to the device as they are, which does
+        // the color and intensity jittering, mean, transpose and cast (see DeviceImageAugmentation).
+        auto transform = std::make_shared<CropScaleMeanTransformer>(featureStream, configHelper.GetDataFormat() == CHW, true);
+        transformations.push_back(Transformation{ transform, featureName });
+        auto& features = m_streams[configHelper.GetFeatureStreamId()];
+        features->m_elementType = ElementType::tuchar;
+        features->m_deviceAugmentation = transform->GetDeviceAugmentation();
+    }
+    else if (featureStream(L"fuseTransforms", false))
     {
-        transformations.push_back(Transformation{ std::make_shared<TransposeTransformer>(featureStream), featureName });
+        // Crop, scale, mean, transpose and cast in a single stage, which has no room for color and intensity jittering.
+        if (!ColorTransformer(featureStream).IsIdentity() || !IntensityTransformer(featureStream).IsIdentity())
+            InvalidArgument("ImageReader: fuseTransforms cannot be combined with color or intensity jittering.");
+
+        transformations.push_back(Transformation{ std::make_shared<CropScaleMeanTransformer>(featureStream, configHelper.GetDataFormat() == CHW), featureName });
     }
+    else
+    {
+        transformations.push_back(Transformation{ std::make_shared<CropTransformer>(featureStream), featureName });
+        transformations.push_back(Transformation{ std::make_shared<ScaleTransformer>(featureStream), featureName });
+        transformations.push_back(Transformation{ std::make_shared<ColorTransformer>(featureStream), featureName });
+        transformations.push_back(Transformation{ std::make_shared<IntensityTransformer>(featureStream), featureName });
+        transformations.push_back(Transformation{ std::make_shared<MeanTransformer>(featureStream), featureName });
+
+        if (configHelper.GetDataFormat() == CHW)
+        {
+            transformations.push_back(Transformation{ std::make_shared<TransposeTransformer>(featureStream), featureName });
+        }
 
-    // We should always have cast at the end. 
-    // It is noop if the matrix element type is already expected by the packer.
-    transformations.push_back(Transformation{ std::make_shared<CastTransformer>(featureStream), featureName });
+        // We should always have cast at the end. 
+        // It is noop if the matrix element type is already expected by the packer.
+        transformations.push_back(Transformation{ std::make_shared<CastTransformer>(featureStream), featureName });
+    }
 
-    m_sequenceEnumerator = std::make_shared<TransformController>(transformations, randomizer);
+    auto transformController = std::make_shared<TransformController>(transformations, randomizer);
+    transformController->SetWorkerThreadPool(workerThreadPool);
+    m_sequenceEnumerator = transformController;
 
     m_packer = std::make_shared<FramePacker>(
         m_sequenceEnumerator,
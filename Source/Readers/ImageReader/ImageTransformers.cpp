@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <unordered_map>
 #include <random>
+#include <type_traits>
 #include <boost/random/bernoulli_distribution.hpp>
 #include <boost/random/normal_distribution.hpp>
 #include "ImageTransformers.h"
@@ -16,6 +17,11 @@
 #include "SequenceData.h"
 #include "ImageUtil.h"
 
+#if defined(__SSE4_1__) || defined(_M_X64)
+#include <smmintrin.h>
+#define IMAGE_TRANSFORMS_USE_SSE4_1
+#endif
+
 namespace Microsoft { namespace MSR { namespace CNTK 
 {
 
@@ -84,6 +90,16 @@ void CropTransformer::StartEpoch(const EpochConfiguration &config)
 }
 
 void CropTransformer::Apply(size_t id, cv::Mat &mat)
+{
+    bool flip;
+    mat = mat(GetCrop(id, mat.rows, mat.cols, flip));
+    if (flip)
+    {
+        cv::flip(mat, mat, 1);
+    }
+}
+
+cv::Rect CropTransformer::GetCrop(size_t id, int rows, int cols, bool& flip)
 {
     auto seed = GetSeed();
     auto rng = m_rngs.pop_or_create([seed]() { return std::make_unique<std::mt19937>(seed); });
@@ -111,15 +127,12 @@ void CropTransformer::Apply(size_t id, cv::Mat &mat)
 
     int viewIndex = m_cropType == CropType::MultiView10 ? (int)(id % 10) : 0;
 
-    mat = mat(GetCropRect(m_cropType, viewIndex, mat.rows, mat.cols, ratio, *rng));
+    cv::Rect crop = GetCropRect(m_cropType, viewIndex, rows, cols, ratio, *rng);
     // for MultiView10 m_hFlip is false, hence the first 5 will be unflipped, the later 5 will be flipped
-    if ((m_hFlip && boost::random::bernoulli_distribution<>()(*rng)) ||
-        viewIndex >= 5)
-    {
-        cv::flip(mat, mat, 1);
-    }
+    flip = (m_hFlip && boost::random::bernoulli_distribution<>()(*rng)) || viewIndex >= 5;
 
     m_rngs.push(std::move(rng));
+    return crop;
 }
 
 CropTransformer::RatioJitterType
@@ -280,16 +293,24 @@ StreamDescription ScaleTransformer::Transform(const StreamDescription& inputStre
     return m_outputStream;
 }
 
-void ScaleTransformer::Apply(size_t id, cv::Mat &mat)
+int ScaleTransformer::GetInterpolation()
 {
-    UNUSED(id);
-
     auto seed = GetSeed();
     auto rng = m_rngs.pop_or_create([seed]() { return std::make_unique<std::mt19937>(seed); });
 
     auto index = UniIntT(0, static_cast<int>(m_interp.size()) - 1)(*rng);
     assert(m_interp.size() > 0);
 
+    m_rngs.push(std::move(rng));
+    return m_interp[index];
+}
+
+void ScaleTransformer::Apply(size_t id, cv::Mat &mat)
+{
+    UNUSED(id);
+
+    int interpolation = GetInterpolation();
+
     // Skip cv::resize depending on interpolation only
     // There is no point in interpolation of the image of the same size, this
     // will only lower its sharpness.
@@ -297,10 +318,8 @@ void ScaleTransformer::Apply(size_t id, cv::Mat &mat)
     {
         // If matrix has not been converted to the right type, do it now as rescaling requires floating point type.
         ConvertToFloatingPointIfRequired(mat);
-        cv::resize(mat, mat, cv::Size((int)m_imgWidth, (int)m_imgHeight), 0, 0, m_interp[index]);
+        cv::resize(mat, mat, cv::Size((int)m_imgWidth, (int)m_imgHeight), 0, 0, interpolation);
     }
-
-    m_rngs.push(std::move(rng));
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -498,6 +517,12 @@ void IntensityTransformer::StartEpoch(const EpochConfiguration &config)
     ImageTransformerBase::StartEpoch(config);
 }
 
+bool IntensityTransformer::IsIdentity() const
+{
+    return m_eigVal.empty() || m_eigVec.empty() ||
+        std::all_of(m_stdDev.begin(), m_stdDev.end(), [](double stdDev) { return stdDev == 0; });
+}
+
 void IntensityTransformer::Apply(size_t id, cv::Mat &mat)
 {
     UNUSED(id);
@@ -577,6 +602,12 @@ void ColorTransformer::StartEpoch(const EpochConfiguration &config)
     ImageTransformerBase::StartEpoch(config);
 }
 
+bool ColorTransformer::IsIdentity() const
+{
+    auto isZero = [](const doubleargvector& radius) { return std::all_of(radius.begin(), radius.end(), [](double r) { return r == 0; }); };
+    return isZero(m_brightnessRadius) && isZero(m_contrastRadius) && isZero(m_saturationRadius);
+}
+
 void ColorTransformer::Apply(size_t id, cv::Mat &mat)
 {
     UNUSED(id);
@@ -660,6 +691,244 @@ void ColorTransformer::Apply(cv::Mat &mat)
     m_rngs.push(std::move(rng));
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Puts the mean image in the layout of the output of CropScaleMeanTransformer.
+template <class TElement>
+static std::vector<TElement> GetMeanInOutputLayout(const cv::Mat& meanImage, cv::Size size, size_t channels, bool transpose)
+{
+    std::vector<TElement> result;
+    // Just as MeanTransformer, ignore a mean image that does not match the size of the images.
+    if (meanImage.empty() || meanImage.size() != size || (size_t)meanImage.channels() != channels)
+        return result;
+
+    cv::Mat mean;
+    meanImage.convertTo(mean, sizeof(TElement) == sizeof(float) ? CV_32F : CV_64F);
+    const size_t planeSize = (size_t)size.width * size.height;
+    result.resize(planeSize * channels);
+    for (int y = 0; y < size.height; ++y)
+    {
+        const TElement* src = mean.ptr<TElement>(y);
+        for (int x = 0; x < size.width; ++x)
+        {
+            for (size_t c = 0; c < channels; ++c)
+            {
+                size_t pixel = (size_t)y * size.width + x;
+                result[transpose ? c * planeSize + pixel : pixel * channels + c] = src[x * channels + c];
+            }
+        }
+    }
+    return result;
+}
+
+CropScaleMeanTransformer::CropScaleMeanTransformer(const ConfigParameters& config)
+    : CropScaleMeanTransformer(config, config(L"transpose", true))
+{
+}
+
+CropScaleMeanTransformer::CropScaleMeanTransformer(const ConfigParameters& config, bool transpose, bool deviceAugmentation)
+    : TransformBase(config), m_crop(config), m_scale(config), m_transpose(transpose), m_color(config), m_intensity(config)
+{
+    MeanTransformer mean(config);
+    if (deviceAugmentation)
+    {
+        // The mean is subtracted before the transpose there.
+        m_deviceAugmentation = std::make_shared<DeviceImageAugmentation>();
+        m_deviceAugmentation->m_mean = GetMeanInOutputLayout<float>(mean.GetMeanImage(), m_scale.GetSize(), m_scale.GetChannels(), false);
+        m_deviceAugmentation->m_seed = GetSeed();
+        ImageAugmentationParams& params = m_deviceAugmentation->m_params;
+        memset(&params, 0, sizeof(params));
+        params.m_width = m_scale.GetSize().width;
+        params.m_height = m_scale.GetSize().height;
+        params.m_channels = (int)m_scale.GetChannels();
+        params.m_transpose = transpose;
+        params.m_scale = config(L"valueScale", 1.0f);
+        if (params.m_channels > 4)
+            InvalidArgument("CropScaleMean transform: deviceAugmentation supports images of up to 4 channels.");
+        return;
+    }
+
+    m_floatMean = GetMeanInOutputLayout<float>(mean.GetMeanImage(), m_scale.GetSize(), m_scale.GetChannels(), m_transpose);
+    m_doubleMean = GetMeanInOutputLayout<double>(mean.GetMeanImage(), m_scale.GetSize(), m_scale.GetChannels(), m_transpose);
+}
+
+void CropScaleMeanTransformer::StartEpoch(const EpochConfiguration &config)
+{
+    m_crop.StartEpoch(config);
+    m_scale.StartEpoch(config);
+    if (m_deviceAugmentation)
+    {
+        // The jittering of this epoch, done on the device.
+        m_color.StartEpoch(config);
+        m_intensity.StartEpoch(config);
+        ImageAugmentationParams& params = m_deviceAugmentation->m_params;
+        params.m_brightnessRadius = (float)m_color.GetBrightnessRadius();
+        params.m_contrastRadius = (float)m_color.GetContrastRadius();
+        params.m_saturationRadius = (float)m_color.GetSaturationRadius();
+        const cv::Mat& eigVal = m_intensity.GetEigenValues();
+        const cv::Mat& eigVec = m_intensity.GetEigenVectors();
+        params.m_intensityStdDev = eigVal.empty() || eigVec.empty() ? 0 : (float)m_intensity.GetStdDev();
+        for (int i = 0; params.m_intensityStdDev != 0 && i < 3; i++)
+        {
+            params.m_eigVal[i] = eigVal.at<float>(i);
+            for (int j = 0; j < 3; j++)
+                params.m_eigVec[3 * i + j] = eigVec.at<float>(i, j);
+        }
+    }
+    TransformBase::StartEpoch(config);
+}
+
+StreamDescription CropScaleMeanTransformer::Transform(const StreamDescription& inputStream)
+{
+    m_outputStream = TransformBase::Transform(inputStream);
+    m_outputStream.m_elementType = m_precision;
+    cv::Size size = m_scale.GetSize();
+    ImageDimensions dimensions(size.width, size.height, m_scale.GetChannels());
+    m_outputStream.m_sampleLayout = std::make_shared<TensorShape>(dimensions.AsTensorShape(m_transpose ? CHW : HWC));
+    if (m_deviceAugmentation)
+    {
+        // 8-bit HWC images, which the device converts into the above
+        m_outputStream.m_elementType = ElementType::tuchar;
+        m_outputStream.m_deviceAugmentation = m_deviceAugmentation;
+    }
+    return m_outputStream;
+}
+
+SequenceDataPtr CropScaleMeanTransformer::Transform(SequenceDataPtr sequence)
+{
+    auto inputSequence = dynamic_cast<ImageSequenceData*>(sequence.get());
+    if (inputSequence == nullptr)
+        RuntimeError("Currently CropScaleMean transform only works with images.");
+
+    const cv::Mat& image = inputSequence->m_image;
+    if ((size_t)image.channels() != m_scale.GetChannels())
+        RuntimeError("CropScaleMean transform: the image has %d channels, %d expected.", image.channels(), (int)m_scale.GetChannels());
+
+    // Crop and flip are not applied to the pixels yet, the flip is done when writing the result.
+    bool flip;
+    cv::Mat cropped = image(m_crop.GetCrop(sequence->m_id, image.rows, image.cols, flip));
+
+    int interpolation = m_scale.GetInterpolation();
+    std::unique_ptr<cv::Mat> scaled;
+    if (cropped.size() != m_scale.GetSize())
+    {
+        // Scaled in the type of the image, i.e. 8-bit images are scaled in 8 bit.
+        scaled = m_scaledImages.pop_or_create([]() { return std::make_unique<cv::Mat>(); });
+        cv::resize(cropped, *scaled, m_scale.GetSize(), 0, 0, interpolation);
+    }
+
+    const cv::Mat& source = scaled ? *scaled : cropped;
+    if (m_deviceAugmentation && source.depth() != CV_8U)
+        RuntimeError("CropScaleMean transform: deviceAugmentation needs 8-bit images.");
+    SequenceDataPtr result = m_deviceAugmentation ? Apply<unsigned char>(source, flip, m_byteBuffers, std::vector<unsigned char>()) :
+        m_precision == ElementType::tfloat ?
+        Apply<float>(source, flip, m_floatBuffers, m_floatMean) :
+        Apply<double>(source, flip, m_doubleBuffers, m_doubleMean);
+
+    if (scaled)
+        m_scaledImages.push(std::move(scaled));
+
+    result->m_numberOfSamples = inputSequence->m_numberOfSamples;
+    result->m_elementType = m_deviceAugmentation ? ElementType::tuchar : m_precision;
+    return result;
+}
+
+// Writes the (flipped) image into dst in the output layout, subtracting the mean if there is one.
+template <class TElementTo, class TElementFrom>
+static void WriteImage(const cv::Mat& image, bool flip, bool transpose, const TElementTo* mean, TElementTo* dst)
+{
+    const int rows = image.rows;
+    const int cols = image.cols;
+    const int channels = image.channels();
+    const size_t planeSize = (size_t)rows * cols;
+
+    for (int y = 0; y < rows; ++y)
+    {
+        const TElementFrom* src = image.ptr<TElementFrom>(y);
+        auto writePixel = [&](int x)
+        {
+            const TElementFrom* pixel = src + (flip ? cols - 1 - x : x) * channels;
+            for (int c = 0; c < channels; ++c)
+            {
+                size_t index = transpose ? c * planeSize + (size_t)y * cols + x : ((size_t)y * cols + x) * channels + c;
+                TElementTo value = static_cast<TElementTo>(pixel[c]);
+                dst[index] = mean ? value - mean[index] : value;
+            }
+        };
+
+        int x = 0;
+#ifdef IMAGE_TRANSFORMS_USE_SSE4_1
+        // The most common case: BGR bytes to float planes. Four pixels at a time,
+        // each channel is gathered into the low bytes with a shuffle and widened to floats.
+        if (std::is_same<TElementTo, float>::value && std::is_same<TElementFrom, unsigned char>::value && channels == 3 && transpose)
+        {
+            const __m128i forward[3] = {
+                _mm_setr_epi8(0, 3, 6, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+                _mm_setr_epi8(1, 4, 7, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+                _mm_setr_epi8(2, 5, 8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1) };
+            const __m128i backward[3] = {
+                _mm_setr_epi8(9, 6, 3, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+                _mm_setr_epi8(10, 7, 4, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+                _mm_setr_epi8(11, 8, 5, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1) };
+            const __m128i* shuffle = flip ? backward : forward;
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(src);
+
+            // The 16-byte load reads two pixels beyond the four, which have to be within the row:
+            // these are the last two pixels of the row, written first if flipped, last otherwise.
+            const int begin = flip ? std::min(2, cols) : 0;
+            const int end = flip ? cols : cols - 2;
+            for (; x < begin; ++x)
+                writePixel(x);
+            for (; x + 4 <= end; x += 4)
+            {
+                int first = flip ? cols - 4 - x : x;
+                __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + first * 3));
+                for (int c = 0; c < 3; ++c)
+                {
+                    size_t index = c * planeSize + (size_t)y * cols + x;
+                    __m128 values = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_shuffle_epi8(pixels, shuffle[c])));
+                    if (mean)
+                        values = _mm_sub_ps(values, _mm_loadu_ps(reinterpret_cast<const float*>(mean) + index));
+                    _mm_storeu_ps(reinterpret_cast<float*>(dst) + index, values);
+                }
+            }
+        }
+#endif
+        for (; x < cols; ++x)
+            writePixel(x);
+    }
+}
+
+template <class TElementTo>
+SequenceDataPtr CropScaleMeanTransformer::Apply(const cv::Mat& image, bool flip, conc_stack<std::vector<TElementTo>>& memBuffers, const std::vector<TElementTo>& mean)
+{
+    assert(image.size() == m_scale.GetSize());
+    auto result = std::make_shared<DenseSequenceWithBuffer<TElementTo>>(memBuffers, image.total() * image.channels());
+    const TElementTo* meanData = mean.empty() ? nullptr : mean.data();
+
+    // (the device transposes the 8-bit images of deviceAugmentation)
+    const bool transpose = m_transpose && !m_deviceAugmentation;
+    switch (image.depth())
+    {
+    case CV_8U:
+        WriteImage<TElementTo, unsigned char>(image, flip, transpose, meanData, result->GetBuffer());
+        break;
+    case CV_32F:
+        WriteImage<TElementTo, float>(image, flip, transpose, meanData, result->GetBuffer());
+        break;
+    case CV_64F:
+        WriteImage<TElementTo, double>(image, flip, transpose, meanData, result->GetBuffer());
+        break;
+    default:
+        RuntimeError("Unsupported type. Please apply a cast transform with 'double' or 'float' precision.");
+    }
+
+    result->m_sampleLayout = m_outputStream.m_sampleLayout;
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 CastTransformer::CastTransformer(const ConfigParameters& config) : TransformBase(config), m_floatTransform(this), m_doubleTransform(this)
 {
 }
@@ -82,6 +82,12 @@ class CropTransformer : public ImageTransformerBase
 public:
     explicit CropTransformer(const ConfigParameters& config);
 
+    void StartEpoch(const EpochConfiguration &config) override;
+
+    // Draws the crop of an image of the given size the way Apply() does: the crop rectangle,
+    // and whether the crop is to be flipped horizontally.
+    cv::Rect GetCrop(size_t id, int rows, int cols, bool& flip);
+
 private:
     void Apply(size_t id, cv::Mat &mat) override;
 
@@ -94,8 +100,6 @@ private:
         UniArea = 3
     };
 
-    void StartEpoch(const EpochConfiguration &config) override;
-
     RatioJitterType ParseJitterType(const std::string &src);
     cv::Rect GetCropRect(CropType type, int viewIndex, int crow, int ccol, double cropRatio, std::mt19937 &rng);
 
@@ -118,6 +122,20 @@ public:
 
     StreamDescription Transform(const StreamDescription& inputStream) override;
 
+    // Size of the scaled images.
+    cv::Size GetSize() const
+    {
+        return cv::Size((int)m_imgWidth, (int)m_imgHeight);
+    }
+
+    size_t GetChannels() const
+    {
+        return m_imgChannels;
+    }
+
+    // Draws the interpolation for the next image the way Apply() does.
+    int GetInterpolation();
+
 private:
     void Apply(size_t id, cv::Mat &mat) override;
 
@@ -137,6 +155,12 @@ class MeanTransformer : public ImageTransformerBase
 public:
     explicit MeanTransformer(const ConfigParameters& config);
 
+    // The mean image, empty if there is none.
+    const cv::Mat& GetMeanImage() const
+    {
+        return m_meanImg;
+    }
+
 private:
     void Apply(size_t id, cv::Mat &mat) override;
 
@@ -186,9 +210,18 @@ class IntensityTransformer : public ImageTransformerBase
 public:
     explicit IntensityTransformer(const ConfigParameters& config);
 
-private:
+    // Whether the transform leaves the images as they are in all epochs.
+    bool IsIdentity() const;
+
     void StartEpoch(const EpochConfiguration &config) override;
 
+    // The standard deviation of the current epoch, and the PCA of the colors (empty if there is none).
+    double GetStdDev() const { return m_curStdDev; }
+    const cv::Mat& GetEigenValues() const { return m_eigVal; }
+    const cv::Mat& GetEigenVectors() const { return m_eigVec; }
+
+private:
+
     void Apply(size_t id, cv::Mat &mat) override;
     template <typename ElemType>
     void Apply(cv::Mat &mat);
@@ -209,9 +242,18 @@ class ColorTransformer : public ImageTransformerBase
 public:
     explicit ColorTransformer(const ConfigParameters& config);
 
-private:
+    // Whether the transform leaves the images as they are in all epochs.
+    bool IsIdentity() const;
+
     void StartEpoch(const EpochConfiguration &config) override;
 
+    // The radii of the current epoch.
+    double GetBrightnessRadius() const { return m_curBrightnessRadius; }
+    double GetContrastRadius() const { return m_curContrastRadius; }
+    double GetSaturationRadius() const { return m_curSaturationRadius; }
+
+private:
+
     void Apply(size_t id, cv::Mat &mat) override;
     template <typename ElemType>
     void Apply(cv::Mat &mat);
@@ -227,6 +269,55 @@ private:
     conc_stack<std::unique_ptr<cv::Mat>> m_hsvTemp;
 };
 
+// Crop, scale and mean transforms, followed by the transpose from HWC to CHW (unless 'transpose' is false) and the cast
+// to the required precision, as a single stage. Draws the same random crops, flips and interpolations as Crop and
+// Scale with the same configuration, but instead of a copy of the image per step it takes the crop of the decoded
+// image as is, scales 8-bit images in 8 bit, and writes the flipped, mean-subtracted and transposed result in one pass.
+// Color and intensity jittering have to be applied before the mean, so they are not supported here.
+// With 'deviceAugmentation' the cropped and scaled images are shipped as they are, 8-bit and HWC, and color and
+// intensity jittering, mean, 'valueScale', transpose and cast are done on the device (see DeviceImageAugmentation).
+class CropScaleMeanTransformer : public TransformBase
+{
+public:
+    explicit CropScaleMeanTransformer(const ConfigParameters& config);
+    CropScaleMeanTransformer(const ConfigParameters& config, bool transpose, bool deviceAugmentation = false);
+
+    // What the device does to the images, null unless 'deviceAugmentation'.
+    const DeviceImageAugmentationPtr& GetDeviceAugmentation() const
+    {
+        return m_deviceAugmentation;
+    }
+
+    void StartEpoch(const EpochConfiguration &config) override;
+
+    // Transformation of the stream.
+    StreamDescription Transform(const StreamDescription& inputStream) override;
+
+    // Transformation of the sequence.
+    SequenceDataPtr Transform(SequenceDataPtr sequence) override;
+
+private:
+    template <class TElementTo>
+    SequenceDataPtr Apply(const cv::Mat& image, bool flip, conc_stack<std::vector<TElementTo>>& memBuffers, const std::vector<TElementTo>& mean);
+
+    CropTransformer m_crop;
+    ScaleTransformer m_scale;
+    bool m_transpose;
+
+    ColorTransformer m_color;
+    IntensityTransformer m_intensity;
+    DeviceImageAugmentationPtr m_deviceAugmentation;
+    conc_stack<std::vector<unsigned char>> m_byteBuffers;
+
+    // The mean image in the output layout, empty if there is none.
+    std::vector<float> m_floatMean;
+    std::vector<double> m_doubleMean;
+
+    conc_stack<std::vector<float>> m_floatBuffers;
+    conc_stack<std::vector<double>> m_doubleBuffers;
+    conc_stack<std::unique_ptr<cv::Mat>> m_scaledImages;
+};
+
 // Cast the input to a particular type.
 // Images coming from the deserializer/transformers could come in different types,
 // i.e. as a uchar due to performance reasons. On the other hand, the packer/network
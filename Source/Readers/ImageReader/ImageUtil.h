@@ -37,4 +37,48 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         return result;
     }
 
+    // Reads the size of a JPEG image from its frame header, without decoding the image.
+    // Returns false if the data is not a JPEG image or has no frame header.
+    inline bool GetJpegImageSize(const unsigned char* data, size_t size, int& width, int& height)
+    {
+        if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+            return false;
+
+        size_t pos = 2;
+        while (pos + 4 <= size)
+        {
+            if (data[pos] != 0xFF)
+                return false;
+
+            unsigned char marker = data[pos + 1];
+            if (marker == 0xFF) // fill byte
+            {
+                pos++;
+                continue;
+            }
+
+            if (marker == 0x01 || (0xD0 <= marker && marker <= 0xD7)) // markers without a segment
+            {
+                pos += 2;
+                continue;
+            }
+
+            if (marker == 0xD9 || marker == 0xDA) // end of image or start of scan before any frame header
+                return false;
+
+            // Start of frame, all but DHT, JPG and DAC in C0..CF: length, precision, height, width.
+            if (0xC0 <= marker && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+            {
+                if (pos + 9 > size)
+                    return false;
+                height = (data[pos + 5] << 8) | data[pos + 6];
+                width = (data[pos + 7] << 8) | data[pos + 8];
+                return width > 0 && height > 0;
+            }
+
+            pos += 2 + ((data[pos + 2] << 8) | data[pos + 3]);
+        }
+        return false;
+    }
+
 }}}
@@ -9,9 +9,98 @@
 
 #ifdef USE_ZIP
 #include <File.h>
+#include <cstring>
+#include "StringUtil.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// Little-endian fields of the zip headers.
+static uint64_t ReadZipField(const char* data, size_t bytes)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i)
+        value |= (uint64_t)(unsigned char)data[i] << (8 * i);
+    return value;
+}
+
+// Reads the offsets of the local headers of all entries from the central directory of the archive, by entry name.
+// libzip does not expose these. Returns false if the central directory cannot be read.
+static bool ReadLocalHeaderOffsets(const char* data, size_t size, std::unordered_map<std::string, uint64_t>& offsets)
+{
+    // The end of central directory record is at the end of the archive, followed only by a comment of up to 64K.
+    const size_t eocdSize = 22;
+    if (size < eocdSize)
+        return false;
+    size_t eocd = SIZE_MAX;
+    for (size_t pos = size - eocdSize; size - pos <= eocdSize + 0xFFFF; --pos)
+    {
+        if (ReadZipField(data + pos, 4) == 0x06054b50)
+        {
+            eocd = pos;
+            break;
+        }
+        if (pos == 0)
+            break;
+    }
+    if (eocd == SIZE_MAX)
+        return false;
+
+    uint64_t numEntries = ReadZipField(data + eocd + 10, 2);
+    uint64_t directoryOffset = ReadZipField(data + eocd + 16, 4);
+    // Zip64 archives have the real values in the zip64 end of central directory record, found through the locator before.
+    if (eocd >= 20 && ReadZipField(data + eocd - 20, 4) == 0x07064b50)
+    {
+        uint64_t zip64Eocd = ReadZipField(data + eocd - 20 + 8, 8);
+        if (zip64Eocd + 56 > size || ReadZipField(data + zip64Eocd, 4) != 0x06064b50)
+            return false;
+        numEntries = ReadZipField(data + zip64Eocd + 32, 8);
+        directoryOffset = ReadZipField(data + zip64Eocd + 48, 8);
+    }
+
+    uint64_t pos = directoryOffset;
+    for (uint64_t i = 0; i < numEntries; ++i)
+    {
+        if (pos + 46 > size || ReadZipField(data + pos, 4) != 0x02014b50)
+            return false;
+        uint64_t compressedSize = ReadZipField(data + pos + 20, 4);
+        uint64_t uncompressedSize = ReadZipField(data + pos + 24, 4);
+        size_t nameLength = (size_t)ReadZipField(data + pos + 28, 2);
+        size_t extraLength = (size_t)ReadZipField(data + pos + 30, 2);
+        size_t commentLength = (size_t)ReadZipField(data + pos + 32, 2);
+        uint64_t offset = ReadZipField(data + pos + 42, 4);
+        if (pos + 46 + nameLength + extraLength > size)
+            return false;
+
+        if (offset == 0xFFFFFFFF)
+        {
+            // The zip64 extended information has the 64-bit values of exactly those fields that do not fit,
+            // in the order uncompressed size, compressed size, local header offset.
+            const char* extra = data + pos + 46 + nameLength;
+            const char* extraEnd = extra + extraLength;
+            while (extra + 4 <= extraEnd)
+            {
+                size_t fieldLength = (size_t)ReadZipField(extra + 2, 2);
+                if (ReadZipField(extra, 2) == 0x0001)
+                {
+                    const char* field = extra + 4;
+                    field += (uncompressedSize == 0xFFFFFFFF) ? 8 : 0;
+                    field += (compressedSize == 0xFFFFFFFF) ? 8 : 0;
+                    if (field + 8 <= extra + 4 + fieldLength && field + 8 <= extraEnd)
+                        offset = ReadZipField(field, 8);
+                    break;
+                }
+                extra += 4 + fieldLength;
+            }
+            if (offset == 0xFFFFFFFF)
+                return false;
+        }
+
+        offsets[std::string(data + pos + 46, nameLength)] = offset;
+        pos += 46 + nameLength + extraLength + commentLength;
+    }
+    return true;
+}
+
 std::string GetZipError(int err)
 {
     zip_error_t error;
@@ -52,6 +141,7 @@ void ZipByteReader::Register(const std::map<std::string, size_t>& sequences)
     zip_stat_init(&stat);
 
     size_t numberOfEntries = 0;
+    std::unordered_map<std::string, size_t> storedEntries;
     size_t numEntries = zip_get_num_entries(zipFile.get(), 0);
     for (size_t i = 0; i < numEntries; ++i) {
         int err = zip_stat_index(zipFile.get(), i, 0, &stat);
@@ -67,10 +157,18 @@ void ZipByteReader::Register(const std::map<std::string, size_t>& sequences)
         {
             m_seqIdToIndex[sequenceId->second] = std::make_pair(stat.index, stat.size);
             numberOfEntries++;
+
+            bool isStored = (stat.valid & ZIP_STAT_COMP_METHOD) && stat.comp_method == ZIP_CM_STORE &&
+                            (!(stat.valid & ZIP_STAT_ENCRYPTION_METHOD) || stat.encryption_method == ZIP_EM_NONE);
+            if (isStored)
+                storedEntries[stat.name] = sequenceId->second;
         }
     }
     m_zips.push(std::move(zipFile));
 
+    if (!storedEntries.empty())
+        MapStoredEntries(storedEntries);
+
     if (numberOfEntries != sequences.size())
     {
         // Not all sequences have been found. Let's print them out and throw.
@@ -87,8 +185,59 @@ void ZipByteReader::Register(const std::map<std::string, size_t>& sequences)
     }
 }
 
+void ZipByteReader::MapStoredEntries(const std::unordered_map<std::string, size_t>& storedEntries)
+{
+    try
+    {
+        m_mappedFile.reset(new MemoryMappedFile(msra::strfun::utf16(m_zipPath)));
+    }
+    catch (const std::exception& e)
+    {
+        // Not fatal, the entries are still read through libzip.
+        fprintf(stderr, "WARNING: ZipByteReader: Cannot map %s (%s), reading all entries through libzip.\n", m_zipPath.c_str(), e.what());
+        return;
+    }
+
+    const char* data = m_mappedFile->Data();
+    const size_t size = m_mappedFile->Size();
+    std::unordered_map<std::string, uint64_t> localHeaderOffsets;
+    if (!ReadLocalHeaderOffsets(data, size, localHeaderOffsets))
+    {
+        fprintf(stderr, "WARNING: ZipByteReader: Cannot read the central directory of %s, reading all entries through libzip.\n", m_zipPath.c_str());
+        m_mappedFile.reset();
+        return;
+    }
+
+    for (const auto& entry : storedEntries)
+    {
+        auto offset = localHeaderOffsets.find(entry.first);
+        if (offset == localHeaderOffsets.end())
+            continue;
+
+        // The data follows the local header, which has a name and extra field of its own length.
+        uint64_t header = offset->second;
+        if (header + 30 > size || ReadZipField(data + header, 4) != 0x04034b50)
+            continue;
+        uint64_t dataOffset = header + 30 + ReadZipField(data + header + 26, 2) + ReadZipField(data + header + 28, 2);
+        uint64_t dataSize = m_seqIdToIndex[entry.second].second;
+        if (dataOffset + dataSize > size)
+            continue;
+        m_seqIdToStoredData[entry.second] = std::make_pair(dataOffset, dataSize);
+    }
+
+    if (m_seqIdToStoredData.empty())
+        m_mappedFile.reset();
+}
+
 cv::Mat ZipByteReader::Read(size_t seqId, const std::string& path, bool grayscale)
 {
+    auto stored = m_seqIdToStoredData.find(seqId);
+    if (stored != m_seqIdToStoredData.end())
+    {
+        // No copy, the image is decoded from the pages of the archive.
+        return Decode(reinterpret_cast<const unsigned char*>(m_mappedFile->Data()) + stored->second.first, (size_t)stored->second.second, grayscale);
+    }
+
     // Find index of the file in .zip file.
     auto r = m_seqIdToIndex.find(seqId);
     if (r == m_seqIdToIndex.end())
@@ -131,7 +280,7 @@ cv::Mat ZipByteReader::Read(size_t seqId, const std::string& path, bool grayscal
     });
     m_zips.push(std::move(zipFile));
 
-    cv::Mat img = cv::imdecode(contents, grayscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
+    cv::Mat img = Decode(contents.data(), size, grayscale);
     assert(nullptr != img.data);
     m_workspace.push(std::move(contents));
     return img;
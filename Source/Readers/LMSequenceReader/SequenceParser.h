@@ -15,6 +15,7 @@
 #include <stdint.h>
 #include "Basics.h"
 #include "fileutil.h"
+#include "StringHashMap.h"
 
 using namespace std;
 
@@ -637,6 +638,51 @@ public:
 
     //void ParseInit(LPCWSTR fileName, size_t dimFeatures, size_t dimLabelsIn, size_t dimLabelsOut, std::string beginSequenceIn = "<s>", std::string endSequenceIn = "</s>", std::string beginSequenceOut = "O", std::string endSequenceOut = "O");
 
+    // ParseTokens - Parse the data like Parse(), but without creating a string per token: each token is handed to
+    // 'onToken(const char* token, size_t length)' right from the line buffer, e.g. to look it up in a StringHashMap.
+    // One SentenceInfo is appended per line, its positions count the tokens passed to 'onToken' since the last clear.
+    // recordsRequested - number of records (tokens) requested
+    // returns - number of lines read, if the end of file is reached the return value will be < requested records
+    template <class TokenFunction>
+    long ParseTokens(size_t recordsRequested, TokenFunction&& onToken)
+    {
+        if (this->mFile == nullptr)
+            RuntimeError("File %ls can not be loaded\n", this->mFileName.c_str());
+
+        m_line.resize(MAXSTRING);
+        size_t position = mSentenceIndex2SentenceInfo.empty() ? 0 : mSentenceIndex2SentenceInfo.back().sBegin + mSentenceIndex2SentenceInfo.back().sLen;
+        size_t tokenCount = 0;
+        long lineCount = 0;
+        while (tokenCount < recordsRequested && fgets(m_line.data(), (int) m_line.size(), this->mFile) != nullptr)
+        {
+            const char* line = m_line.data();
+            m_tokens.clear();
+            Microsoft::MSR::CNTK::ForEachToken(line, line + strlen(line), [this](const char* token, size_t length)
+            {
+                m_tokens.push_back(std::make_pair(token, length));
+            });
+            if (m_tokens.size() < 3) // same as in LMSequenceParser::Parse()
+                continue;
+
+            for (const auto& token : m_tokens)
+                onToken(token.first, token.second);
+
+            SentenceInfo stinfo;
+            stinfo.sBegin = position;
+            stinfo.sLen = m_tokens.size();
+            mSentenceIndex2SentenceInfo.push_back(stinfo);
+
+            position += m_tokens.size();
+            tokenCount += m_tokens.size();
+            lineCount++;
+        }
+        return lineCount;
+    }
+
+private:
+    std::vector<char> m_line;                              // line buffer of ParseTokens()
+    std::vector<std::pair<const char*, size_t>> m_tokens; // tokens of the current line, pointing into m_line
+
     // Parse - Parse the data
     // recordsRequested - number of records requested
     // labels - pointer to vector to return the labels
@@ -14,6 +14,7 @@
 #endif
 #include "DataWriter.h"
 #include "fileutil.h" // for fexists()
+#include "CacheFile.h" // for GetModificationTime()
 #include <iostream>
 #include <vector>
 #include <string>
@@ -71,15 +72,21 @@ size_t SequenceReader<ElemType>::RecordsToRead(size_t mbStartSample, bool tail)
 template <class ElemType>
 IDataReader::LabelIdType SequenceReader<ElemType>::GetIdFromLabel(const std::string& labelValue, LabelInfo& labelInfo)
 {
-    auto found = labelInfo.mapLabelToId.find(labelValue);
-    // not yet found, add to the map
-    if (found == labelInfo.mapLabelToId.end())
+    return GetIdFromLabel(labelValue.data(), labelValue.size(), labelInfo);
+}
+
+// same, for a label that is not a string of its own, e.g. a token in a line buffer
+template <class ElemType>
+IDataReader::LabelIdType SequenceReader<ElemType>::GetIdFromLabel(const char* label, size_t length, const LabelInfo& labelInfo)
+{
+    auto found = labelInfo.mapLabelToId.Find(label, length);
+    if (!found)
     {
-        found = labelInfo.mapLabelToId.find(mUnk);
-        if (found == labelInfo.mapLabelToId.end())
-            RuntimeError("%s not in vocabulary", labelValue.c_str());
+        found = labelInfo.mapLabelToId.Find(mUnk);
+        if (!found)
+            RuntimeError("%s not in vocabulary", std::string(label, length).c_str());
     }
-    return found->second;
+    return *found;
 }
 
 template <class ElemType>
@@ -87,12 +94,10 @@ bool SequenceReader<ElemType>::CheckIdFromLabel(const std::string& labelValue, c
 {
     FailBecauseDeprecated(__FUNCTION__);    // DEPRECATED CLASS, SHOULD NOT BE USED ANYMORE
 
-    auto found = labelInfo.mapLabelToId.find(labelValue);
-
-    // not yet found, add to the map
-    if (found == labelInfo.mapLabelToId.end())
+    auto found = labelInfo.mapLabelToId.Find(labelValue);
+    if (!found)
         return false;
-    labelId = found->second;
+    labelId = *found;
     return true;
 }
 
@@ -489,7 +494,7 @@ void SequenceReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConf
                 {
                     LabelType label = arrayLabels[i];
                     m_labelInfo[index].mapIdToLabel[i] = label;
-                    m_labelInfo[index].mapLabelToId[label] = i;
+                    m_labelInfo[index].mapLabelToId.Set(label, i);
                 }
                 m_labelInfo[index].numIds = (LabelIdType) arrayLabels.size();
                 m_labelInfo[index].mapName = labelPath;
@@ -512,7 +517,7 @@ void SequenceReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConf
                         i = ptr->second;
                         iMax = max(i, iMax);
                         m_labelInfo[index].mapIdToLabel[i] = label;
-                        m_labelInfo[index].mapLabelToId[label] = i;
+                        m_labelInfo[index].mapLabelToId.Set(label, i);
                     }
                     m_labelInfo[index].numIds = (LabelIdType)(iMax + 1);
                 }
@@ -1336,10 +1341,10 @@ void SequenceReader<ElemType>::SetLabelMapping(const std::wstring& /*sectionName
     LabelInfo& labelInfo = m_labelInfo[(m_labelInfo[labelInfoOut].type == labelNextWord) ? labelInfoIn : labelInfoOut];
 
     labelInfo.mapIdToLabel = labelMapping;
-    labelInfo.mapLabelToId.clear();
+    labelInfo.mapLabelToId.Clear();
     for (std::pair<unsigned, LabelType> var : labelMapping)
     {
-        labelInfo.mapLabelToId[var.second] = var.first;
+        labelInfo.mapLabelToId.Set(var.second, var.first);
     }
 }
 
@@ -1498,7 +1503,7 @@ void BatchSequenceReader<ElemType>::InitFromConfig(const ConfigRecordType& reade
                 {
                     LabelType label = arrayLabels[i];
                     labelInfo.mapIdToLabel[i] = label;
-                    labelInfo.mapLabelToId[label] = i;
+                    labelInfo.mapLabelToId.Set(label, i);
                 }
                 labelInfo.numIds = (LabelIdType) arrayLabels.size();
                 labelInfo.mapName = labelPath;
@@ -1533,7 +1538,7 @@ void BatchSequenceReader<ElemType>::InitFromConfig(const ConfigRecordType& reade
                         i = ptr->second;
                         iMax = max(i, iMax);
                         labelInfo.mapIdToLabel[i] = label;
-                        labelInfo.mapLabelToId[label] = i;
+                        labelInfo.mapLabelToId.Set(label, i);
                     }
                     labelInfo.numIds = (LabelIdType)(iMax + 1);
                 }
@@ -1573,6 +1578,23 @@ void BatchSequenceReader<ElemType>::InitFromConfig(const ConfigRecordType& reade
 
     mRequestedNumParallelSequences = readerConfig(L"nbruttsineachrecurrentiter", (size_t) 1); // 0 indicates auto-fill mbSize
     // TODO: ^^ This should depend on the sequences themselves.
+
+    // the class of each word, looked up for every output token in class mode
+    m_wordClass.clear();
+    for (const auto& wordClass : idx4class)
+    {
+        if (wordClass.first < 0)
+            continue;
+        if (m_wordClass.size() <= (size_t) wordClass.first)
+            m_wordClass.resize(wordClass.first + 1, 0);
+        m_wordClass[wordClass.first] = wordClass.second;
+    }
+
+    std::wstring binaryCorpusPath = readerConfig(L"binaryCorpusFile", L"");
+    m_binaryCorpusPath = binaryCorpusPath;
+    m_binaryCorpusTemporaryPath = m_binaryCorpusPath + L"." + std::to_wstring(GetCurrentProcessId()) + L".tmp";
+    m_textFileSize = m_binaryCorpusPath.empty() ? 0 : filesize64(pathName.c_str());
+    m_textFileTime = m_binaryCorpusPath.empty() ? 0 : GetModificationTime(pathName);
 }
 
 template <class ElemType>
@@ -1585,13 +1607,213 @@ void BatchSequenceReader<ElemType>::Reset()
     mLastPosInSentence = 0;
     mNumRead = 0;
 
-    if (m_labelTemp.size() > 0)
-        m_labelTemp.clear();
-    if (m_featureTemp.size() > 0)
-        m_featureTemp.clear();
+    m_inputIdTemp.clear();
+    m_outputIdTemp.clear();
+    m_missingTokens.clear();
     m_parser.mSentenceIndex2SentenceInfo.clear();
 }
 
+// The binary corpus holds the token ids of the sentences of the text, in the order of the text:
+//   BinaryCorpusHeader
+//   per sentence: uint32 number of tokens, the input label ids, and unless the output labels are of type 'none' the output label ids
+// It is only valid for the text file of the size and the modification time, and the label configuration it was created for.
+struct BinaryCorpusHeader
+{
+    char m_magic[8];
+    uint32_t m_version;
+    uint32_t m_outputLabelType;
+    int64_t m_textFileSize;
+    uint64_t m_textFileTime;
+    uint32_t m_inputLabelDim;
+    uint32_t m_outputLabelDim;
+    uint64_t m_numberOfSentences;
+};
+
+static const char s_binaryCorpusMagic[8] = { 'L', 'M', 'T', 'O', 'K', 'E', 'N', 'S' };
+static const uint32_t s_binaryCorpusVersion = 2;
+
+// Opens the binary corpus at the start of the data, if one is configured. If it does not exist yet or is out of date,
+// it is written during the following pass over the text instead.
+template <class ElemType>
+void BatchSequenceReader<ElemType>::OpenBinaryCorpus()
+{
+    CloseBinaryCorpus();
+    if (m_binaryCorpusPath.empty())
+        return;
+
+    const LabelInfo& labelIn = m_labelInfo[labelInfoIn];
+    const LabelInfo& labelOut = m_labelInfo[labelInfoOut];
+    BinaryCorpusHeader expected = {};
+    memcpy(expected.m_magic, s_binaryCorpusMagic, sizeof(expected.m_magic));
+    expected.m_version = s_binaryCorpusVersion;
+    expected.m_outputLabelType = (uint32_t) labelOut.type;
+    expected.m_textFileSize = m_textFileSize;
+    expected.m_textFileTime = m_textFileTime;
+    expected.m_inputLabelDim = (uint32_t) labelIn.dim;
+    expected.m_outputLabelDim = (uint32_t) labelOut.dim;
+
+    if (fexists(m_binaryCorpusPath))
+    {
+        m_binaryCorpus = fopenOrDie(m_binaryCorpusPath, L"rb");
+        BinaryCorpusHeader header;
+        if (fread(&header, sizeof(header), 1, m_binaryCorpus) == 1 &&
+            memcmp(header.m_magic, expected.m_magic, sizeof(header.m_magic)) == 0 &&
+            header.m_version == expected.m_version && header.m_outputLabelType == expected.m_outputLabelType &&
+            header.m_textFileSize == expected.m_textFileSize && header.m_textFileTime == expected.m_textFileTime &&
+            header.m_inputLabelDim == expected.m_inputLabelDim &&
+            header.m_outputLabelDim == expected.m_outputLabelDim)
+        {
+            m_binaryCorpusSentencesLeft = header.m_numberOfSentences;
+            if (m_traceLevel > 0)
+                fprintf(stderr, "LMSequenceReader: Reading the token ids of %d sentences from the binary corpus '%ls'.\n", (int) header.m_numberOfSentences, m_binaryCorpusPath.c_str());
+            return;
+        }
+        fprintf(stderr, "LMSequenceReader: The binary corpus '%ls' does not match the input and the label configuration, it is created again.\n", m_binaryCorpusPath.c_str());
+        fclose(m_binaryCorpus);
+        m_binaryCorpus = nullptr;
+    }
+
+    // The header is written again with the number of sentences at the end of the pass, and only then the file gets its name.
+    m_binaryCorpusOut = fopenOrDie(m_binaryCorpusTemporaryPath, L"wb");
+    m_binaryCorpusSentencesWritten = 0;
+    fwriteOrDie(&expected, sizeof(expected), 1, m_binaryCorpusOut);
+}
+
+template <class ElemType>
+void BatchSequenceReader<ElemType>::CloseBinaryCorpus()
+{
+    if (m_binaryCorpus)
+        fclose(m_binaryCorpus);
+    m_binaryCorpus = nullptr;
+    m_binaryCorpusSentencesLeft = 0;
+
+    // a pass that did not reach the end of the text leaves an incomplete file
+    if (m_binaryCorpusOut)
+    {
+        fclose(m_binaryCorpusOut);
+        m_binaryCorpusOut = nullptr;
+        _wunlink(m_binaryCorpusTemporaryPath.c_str()); // (not OrDie, this is also called from the destructor)
+    }
+}
+
+// Reads whole sentences from the binary corpus until there are at least 'tokensRequested' tokens, like the text parser.
+// Returns the number of sentences read.
+template <class ElemType>
+long BatchSequenceReader<ElemType>::ReadBinaryCorpus(size_t tokensRequested)
+{
+    const bool hasOutputIds = m_labelInfo[labelInfoOut].type != labelNone;
+    auto& sentences = m_parser.mSentenceIndex2SentenceInfo;
+    size_t position = m_inputIdTemp.size();
+    size_t tokenCount = 0;
+    long sentenceCount = 0;
+    while (tokenCount < tokensRequested && m_binaryCorpusSentencesLeft > 0)
+    {
+        uint32_t length;
+        freadOrDie(&length, sizeof(length), 1, m_binaryCorpus);
+        m_inputIdTemp.resize(position + length);
+        freadOrDie(m_inputIdTemp.data() + position, sizeof(LabelIdType), length, m_binaryCorpus);
+        if (hasOutputIds)
+        {
+            m_outputIdTemp.resize(position + length);
+            freadOrDie(m_outputIdTemp.data() + position, sizeof(LabelIdType), length, m_binaryCorpus);
+        }
+
+        SentenceInfo stinfo;
+        stinfo.sBegin = position;
+        stinfo.sLen = length;
+        sentences.push_back(stinfo);
+
+        position += length;
+        tokenCount += length;
+        sentenceCount++;
+        m_binaryCorpusSentencesLeft--;
+    }
+    return sentenceCount;
+}
+
+// Appends the sentences parsed from the text, starting with 'firstSentence', to the binary corpus being written.
+template <class ElemType>
+void BatchSequenceReader<ElemType>::WriteBinaryCorpus(size_t firstSentence)
+{
+    const bool hasOutputIds = m_labelInfo[labelInfoOut].type != labelNone;
+    const auto& sentences = m_parser.mSentenceIndex2SentenceInfo;
+    for (size_t i = firstSentence; i < sentences.size(); i++)
+    {
+        uint32_t length = (uint32_t) sentences[i].sLen;
+        fwriteOrDie(&length, sizeof(length), 1, m_binaryCorpusOut);
+        fwriteOrDie(m_inputIdTemp.data() + sentences[i].sBegin, sizeof(LabelIdType), length, m_binaryCorpusOut);
+        if (hasOutputIds)
+            fwriteOrDie(m_outputIdTemp.data() + sentences[i].sBegin, sizeof(LabelIdType), length, m_binaryCorpusOut);
+        m_binaryCorpusSentencesWritten++;
+    }
+}
+
+// Reads the next cache block of sentences (m_cacheBlockSize tokens) as token ids into m_inputIdTemp and m_outputIdTemp,
+// from the binary corpus if there is one and from the text otherwise. Returns the number of sentences read.
+template <class ElemType>
+long BatchSequenceReader<ElemType>::ParseCacheBlock()
+{
+    if (m_binaryCorpus)
+        return ReadBinaryCorpus(m_cacheBlockSize);
+
+    const LabelInfo& labelIn = m_labelInfo[labelInfoIn];
+    const LabelInfo& labelOut = m_labelInfo[labelInfoOut];
+
+    // Unknown tokens are only an error if they are used, e.g. the last token of a sentence is no input.
+    auto getId = [this](const char* token, size_t length, const LabelInfo& labelInfo)
+    {
+        auto found = labelInfo.mapLabelToId.Find(token, length);
+        if (!found)
+            found = labelInfo.mapLabelToId.Find(mUnk);
+        if (found)
+            return *found;
+        m_missingTokens[m_inputIdTemp.size()] = std::string(token, length);
+        return c_missingLabelId;
+    };
+
+    size_t firstSentence = m_parser.mSentenceIndex2SentenceInfo.size();
+    long numRead = m_parser.ParseTokens(m_cacheBlockSize, [&](const char* token, size_t length)
+    {
+        if (labelOut.type == labelCategory)
+            m_outputIdTemp.push_back(getId(token, length, labelOut));
+        else if (labelOut.type == labelNextWord)
+        {
+            // end symbol may differ between input and output
+            if (length == labelIn.endSequence.size() && _strnicmp(token, labelIn.endSequence.c_str(), length) == 0)
+                m_outputIdTemp.push_back(getId(labelIn.endSequence.c_str(), length, labelIn));
+            else
+                m_outputIdTemp.push_back(getId(token, length, labelIn));
+        }
+        m_inputIdTemp.push_back(getId(token, length, labelIn));
+    });
+
+    if (m_binaryCorpusOut)
+    {
+        if (!m_missingTokens.empty())
+        {
+            fprintf(stderr, "LMSequenceReader: Not writing the binary corpus '%ls', since the input has tokens that are not in the vocabulary.\n", m_binaryCorpusPath.c_str());
+            CloseBinaryCorpus();
+        }
+        else if (numRead > 0)
+        {
+            WriteBinaryCorpus(firstSentence);
+        }
+        else // at the end of the text: complete the header, the following passes read the file
+        {
+            fseekOrDie(m_binaryCorpusOut, offsetof(BinaryCorpusHeader, m_numberOfSentences));
+            fwriteOrDie(&m_binaryCorpusSentencesWritten, sizeof(m_binaryCorpusSentencesWritten), 1, m_binaryCorpusOut);
+            fcloseOrDie(m_binaryCorpusOut);
+            m_binaryCorpusOut = nullptr;
+            if (fexists(m_binaryCorpusPath))
+                unlinkOrDie(m_binaryCorpusPath);
+            renameOrDie(m_binaryCorpusTemporaryPath, m_binaryCorpusPath);
+            if (m_traceLevel > 0)
+                fprintf(stderr, "LMSequenceReader: Wrote the token ids of %d sentences to the binary corpus '%ls'.\n", (int) m_binaryCorpusSentencesWritten, m_binaryCorpusPath.c_str());
+        }
+    }
+    return numRead;
+}
+
 template <class ElemType>
 void BatchSequenceReader<ElemType>::StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples)
 {
@@ -1673,6 +1895,7 @@ void BatchSequenceReader<ElemType>::StartMinibatchLoop(size_t mbSize, size_t epo
     m_idx2clsRead = false;
 
     m_parser.ParseReset();
+    OpenBinaryCorpus();
 
     Reset();
 }
@@ -1783,9 +2006,8 @@ bool BatchSequenceReader<ElemType>::GetMinibatchData(size_t& /*out*/ firstPosInS
     {
         Reset();
 
-        std::vector<SequencePosition> seqPos;
         fprintf(stderr, "LMSequenceReader: Reading epoch data..."), fflush(stderr);
-        mNumRead = m_parser.Parse(m_cacheBlockSize, &m_labelTemp, &m_featureTemp, &seqPos);
+        mNumRead = ParseCacheBlock();
         fprintf(stderr, " %d sequences read.\n", (int) mNumRead);
         firstPosInSentence = mLastPosInSentence;
         if (mNumRead == 0)
@@ -1815,6 +2037,14 @@ bool BatchSequenceReader<ElemType>::GetMinibatchData(size_t& /*out*/ firstPosInS
     LabelInfo& labelIn = m_labelInfo[labelInfoIn];
     LabelInfo& labelOut = m_labelInfo[labelInfoOut];
 
+    auto checkId = [this](LabelIdType id, size_t pos)
+    {
+        if (id != c_missingLabelId)
+            return;
+        auto token = m_missingTokens.find(pos);
+        RuntimeError("%s not in vocabulary", token != m_missingTokens.end() ? token->second.c_str() : "token");
+    };
+
     firstPosInSentence = mLastPosInSentence;
 
     size_t & i = mLastPosInSentence;
@@ -1831,13 +2061,14 @@ bool BatchSequenceReader<ElemType>::GetMinibatchData(size_t& /*out*/ firstPosInS
             size_t pos = m_parser.mSentenceIndex2SentenceInfo[seq].sBegin + i;
 
             // labelIn should be a category label
-            const auto& labelValue = m_labelTemp[pos];
+            LabelIdType inputId = m_inputIdTemp[pos];
+            checkId(inputId, pos);
             pos++; // consume it
 
             // generate the feature token
             if (labelIn.type == labelCategory)
             {
-                LabelIdType labelId = GetIdFromLabel(labelValue, labelIn);
+                LabelIdType labelId = inputId;
 
                 // use the found value, and set the appropriate location to a 1.0
                 assert(labelIn.dim > labelId); // if this goes off labelOut dimension is too small
@@ -1849,22 +2080,12 @@ bool BatchSequenceReader<ElemType>::GetMinibatchData(size_t& /*out*/ firstPosInS
             // generate the output label token
             if (labelOut.type != labelNone)
             {
-                const auto& labelValue = m_labelTemp[pos];
-                LabelIdType labelId;
+                // the output ids were looked up by ParseCacheBlock() according to the label type
+                LabelIdType labelId = m_outputIdTemp[pos];
+                checkId(labelId, pos);
                 if (labelOut.type == labelCategory)
-                {
                     pos++; // consume it   --TODO: value is not used after this
-                    labelId = GetIdFromLabel(labelValue, labelOut);
-                }
-                else if (nextWord)
-                {
-                    // this is the next word (pos was already incremented above when reading out labelValue)
-                    if (EqualCI(labelValue, labelIn.endSequence)) // end symbol may differ between input and output
-                        labelId = GetIdFromLabel(labelIn.endSequence, labelIn);
-                    else
-                        labelId = GetIdFromLabel(labelValue, labelIn);
-                }
-                else
+                else if (!nextWord) // for the next word, pos was already incremented above when reading the input
                     LogicError("Unexpected output label type."); // should never get here
 
                 m_labelIdData.push_back(labelId);
@@ -2108,6 +2329,13 @@ void BatchSequenceReader<ElemType>::GetLabelOutput(StreamMinibatchInputs& matric
 
     ElemType epsilon = (ElemType) 1e-6; // avoid all zero, although this is almost impossible.
 
+    // the noise words of all samples, drawn in one go (in the same order as one by one)
+    if (readerMode == ReaderMode::NCE)
+    {
+        m_noiseWords.resize(actualmbsize * m_noiseSampleSize);
+        m_noiseSampler.sample(m_noiseWords.data(), m_noiseWords.size());
+    }
+
     for (size_t jSample = mbStartSample; j < actualmbsize; ++j, ++jSample)
     {
         // get the token
@@ -2122,14 +2350,14 @@ void BatchSequenceReader<ElemType>::GetLabelOutput(StreamMinibatchInputs& matric
             labels.SetValue(1, j, (ElemType) m_noiseSampler.logprob(wrd));
             for (size_t noiseid = 0; noiseid < m_noiseSampleSize; noiseid++)
             {
-                int wid = m_noiseSampler.sample();
+                int wid = (int) m_noiseWords[j * m_noiseSampleSize + noiseid];
                 labels.SetValue(2 * (noiseid + 1), j, (ElemType) wid);
                 labels.SetValue(2 * (noiseid + 1) + 1, j, -(ElemType) m_noiseSampler.logprob(wid));
             }
         }
         else if (readerMode == ReaderMode::Class)
         {
-            int clsidx = idx4class[wrd];
+            int clsidx = wrd < m_wordClass.size() ? m_wordClass[wrd] : 0;
             if (m_classSize > 0)
             {
                 labels.SetValue(1, j, (ElemType) clsidx);
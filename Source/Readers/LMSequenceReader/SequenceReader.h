@@ -12,6 +12,8 @@
 #include "Config.h"
 #include "SequenceParser.h"
 #include "RandomOrdering.h"
+#include "StringHashMap.h"
+#include "AliasSampler.h"
 #include <string>
 #include <map>
 #include <vector>
@@ -42,15 +44,15 @@ enum ReaderMode
     None = 4, // some other type of label
 };
 
+// Draws noise words for NCE with the probabilities of their counts, through an alias table (O(1) per draw).
 template <typename Count>
 class noiseSampler
 {
     std::vector<double> m_prob, m_log_prob;
-    std::uniform_int_distribution<Count> unif_int;
     bool uniform_sampling;
     double uniform_prob;
     double uniform_log_prob;
-    std::piecewise_constant_distribution<double> d;
+    AliasSampler m_sampler;
     std::mt19937 rng;
 
 public:
@@ -58,20 +60,18 @@ public:
     {
     }
     noiseSampler(const std::vector<double>& counts, bool xuniform_sampling = false)
-        : uniform_sampling(xuniform_sampling), rng(1234)
+        : uniform_sampling(xuniform_sampling), m_sampler(counts), rng(1234)
     {
         size_t k = counts.size();
         uniform_prob = 1.0 / k;
         uniform_log_prob = std::log(uniform_prob);
-        std::vector<double> vn(counts.size() + 1);
-        for (int i = 0; i < vn.size(); i++)
-            vn[i] = i;
-        d = std::piecewise_constant_distribution<double>(vn.begin(), vn.end(), counts.begin());
-        unif_int = std::uniform_int_distribution<Count>(0, (long) counts.size() - 1);
-        m_prob = d.densities();
-        m_log_prob.resize(m_prob.size());
+        m_prob.resize(k);
+        m_log_prob.resize(k);
         for (int i = 0; i < k; i++)
+        {
+            m_prob[i] = m_sampler.Probability(i);
             m_log_prob[i] = std::log(m_prob[i]);
+        }
     }
     int size() const
     {
@@ -95,16 +95,27 @@ public:
     template <typename Engine>
     int sample(Engine& eng)
     {
-        int m = unif_int(eng);
         if (uniform_sampling)
-            return m;
-        return (int) d(eng);
+            return (int) ((eng() - Engine::min()) % m_prob.size());
+        return (int) m_sampler.Sample(eng);
     }
 
     int sample()
     {
         return sample(this->rng);
     }
+
+    // draws 'count' noise words into 'samples'
+    void sample(Count* samples, size_t count)
+    {
+        if (uniform_sampling)
+        {
+            for (size_t i = 0; i < count; i++)
+                samples[i] = (Count) sample();
+        }
+        else
+            m_sampler.Sample(rng, samples, count);
+    }
 };
 
 // Note: This class is deprecated for standalone use, only used as a base for BatchSequenceReader which overrides most of the functions.
@@ -197,7 +208,7 @@ protected:
     {
         LabelKind type; // labels are categories, create mapping table
         std::map<LabelIdType, LabelType> mapIdToLabel;
-        std::map<LabelType, LabelIdType> mapLabelToId;
+        StringHashMap<char, LabelIdType> mapLabelToId; // looked up for every token, so a hash map
         LabelIdType numIds;        // maximum label ID we have encountered so far
         LabelIdType dim;           // maximum label ID we will ever see (used for array dimensions)
         std::string beginSequence; // starting sequence string (i.e. <s>)
@@ -220,6 +231,7 @@ protected:
     void WriteLabelFile();
 
     LabelIdType GetIdFromLabel(const std::string& label, LabelInfo& labelInfo);
+    LabelIdType GetIdFromLabel(const char* label, size_t length, const LabelInfo& labelInfo);
     bool CheckIdFromLabel(const std::string& labelValue, const LabelInfo& labelInfo, unsigned& labelId);
 
     virtual bool EnsureDataAvailable(size_t mbStartSample, bool endOfDataCheck = false);
@@ -368,8 +380,26 @@ private:
     size_t mLastPosInSentence;
     size_t m_truncationLength;     // sequences longer than this get chopped up
 
-    std::vector<ElemType> m_featureTemp;
-    std::vector<LabelType> m_labelTemp;
+    // The tokens of the sentences in the current cache block, as ids of the input labels and, unless the output
+    // labels are of type 'none', as ids of the output labels.
+    std::vector<LabelIdType> m_inputIdTemp;
+    std::vector<LabelIdType> m_outputIdTemp;
+    std::map<size_t, std::string> m_missingTokens; // [token position] tokens not in the vocabulary, which has no unk symbol either
+    static const LabelIdType c_missingLabelId = (LabelIdType) -1; // the id of such tokens, an error only once they are used
+
+    std::vector<int> m_wordClass; // [word id] class of the word, from idx4class
+    std::vector<long> m_noiseWords; // [sample * m_noiseSampleSize + i] noise words drawn for the samples of a minibatch
+
+    // Optional precompiled corpus (binaryCorpusFile): the token ids of the whole input, which are read instead
+    // of the text from the second pass on, or from the start if the file exists.
+    std::wstring m_binaryCorpusPath;
+    std::wstring m_binaryCorpusTemporaryPath; // of this process, since the workers of a parallel job all write the file
+    FILE* m_binaryCorpus;
+    FILE* m_binaryCorpusOut; // the file being written during the first pass over the text
+    int64_t m_textFileSize;  // the size and the modification time of the text, recorded in the binary
+    uint64_t m_textFileTime; // corpus to detect that it is out of date
+    uint64_t m_binaryCorpusSentencesLeft;
+    uint64_t m_binaryCorpusSentencesWritten;
 
     bool mSentenceEnd;
     //bool mSentenceBegin;
@@ -387,6 +417,17 @@ public:
         mLastPosInSentence = 0;
         mNumRead = 0;
         mSentenceEnd = false;
+        m_binaryCorpus = nullptr;
+        m_binaryCorpusOut = nullptr;
+        m_binaryCorpusSentencesLeft = 0;
+        m_binaryCorpusSentencesWritten = 0;
+        m_textFileSize = 0;
+        m_textFileTime = 0;
+    }
+
+    ~BatchSequenceReader()
+    {
+        CloseBinaryCorpus();
     }
 
     template <class ConfigRecordType>
@@ -401,6 +442,11 @@ public:
     }
 private:
     void Reset();
+    long ParseCacheBlock();
+    void OpenBinaryCorpus();
+    void CloseBinaryCorpus();
+    long ReadBinaryCorpus(size_t tokensRequested);
+    void WriteBinaryCorpus(size_t firstSentence);
     size_t DetermineSequencesToProcess();
     bool GetMinibatchData(size_t& firstPosInSentence);
     void GetLabelOutput(StreamMinibatchInputs& matrices, size_t m_mbStartSample, size_t actualmbsize);
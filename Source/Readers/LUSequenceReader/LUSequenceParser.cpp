@@ -44,8 +44,22 @@ template class LUSequenceParser<double, double>;
 template class LUSequenceParser<double, std::string>;
 template class LUSequenceParser<double, std::wstring>;
 
+// the id of a token, or of the unk symbol if the token is not in the vocabulary
 template <class NumType, class LabelType>
-long BatchLUSequenceParser<NumType, LabelType>::Parse(size_t recordsRequested, std::vector<long> *labels, std::vector<vector<long>> *input, std::vector<SequencePosition> *seqPos, const map<wstring, long> &inputlabel2id, const map<wstring, long> &outputlabel2id, bool canMultiplePassData)
+long BatchLUSequenceParser<NumType, LabelType>::GetId(const std::pair<const wchar_t*, size_t>& token, const StringHashMap<wchar_t, long>& label2id, const char* labelKind) const
+{
+    auto found = label2id.Find(token.first, token.second);
+    if (!found)
+    {
+        found = label2id.Find(mUnkStr);
+        if (!found)
+            LogicError("cannot find item %ls and unk str %ls in %s label", wstring(token.first, token.second).c_str(), mUnkStr.c_str(), labelKind);
+    }
+    return *found;
+}
+
+template <class NumType, class LabelType>
+long BatchLUSequenceParser<NumType, LabelType>::Parse(size_t recordsRequested, std::vector<long> *labels, std::vector<vector<long>> *input, std::vector<SequencePosition> *seqPos, const StringHashMap<wchar_t, long> &inputlabel2id, const StringHashMap<wchar_t, long> &outputlabel2id, bool canMultiplePassData)
 {
     fprintf(stderr, "BatchLUSequenceParser: Parsing input data...\n");
 
@@ -77,7 +91,6 @@ long BatchLUSequenceParser<NumType, LabelType>::Parse(size_t recordsRequested, s
                 break;
         }
 
-        std::vector<wstring> vstr;
         bool bBlankLine = (ch.length() == 0);
         if (bBlankLine && !bAtEOS && input->size() > 0 && labels->size() > 0)
         {
@@ -89,37 +102,25 @@ long BatchLUSequenceParser<NumType, LabelType>::Parse(size_t recordsRequested, s
         // got a token
         tokenCount++;
 
-        vstr = SplitString(ch, L" \n\r\t");
-        if (vstr.size() < 2)
+        m_tokens.clear();
+        ForEachToken(ch.data(), ch.data() + ch.size(), [this](const wchar_t* token, size_t length)
+        {
+            m_tokens.push_back(std::make_pair(token, length));
+        });
+        if (m_tokens.size() < 2)
             continue;
 
         bAtEOS = false;
         vector<long> vtmp;
-        for (size_t i = 0; i < vstr.size() - 1; i++)
-        {
-            if (inputlabel2id.find(vstr[i]) == inputlabel2id.end())
-            {
-                if (inputlabel2id.find(mUnkStr) == inputlabel2id.end())
-                {
-                    LogicError("cannot find item %ls and unk str %ls in input label", vstr[i].c_str(), mUnkStr.c_str());
-                }
-                vtmp.push_back(inputlabel2id.find(mUnkStr)->second);
-            }
-            else
-                vtmp.push_back(inputlabel2id.find(vstr[i])->second);
-        }
-        if (outputlabel2id.find(vstr[vstr.size() - 1]) == outputlabel2id.end())
-        {
-            if (outputlabel2id.find(mUnkStr) == outputlabel2id.end())
-                LogicError("cannot find item %ls and unk str %ls in output label", vstr[vstr.size() - 1].c_str(), mUnkStr.c_str());
-            labels->push_back(outputlabel2id.find(mUnkStr)->second);
-        }
-        else
-            labels->push_back(outputlabel2id.find(vstr[vstr.size() - 1])->second);
-        input->push_back(vtmp);
-        if ((vstr[vstr.size() - 1] == m_endSequenceOut ||
+        vtmp.reserve(m_tokens.size() - 1);
+        for (size_t i = 0; i < m_tokens.size() - 1; i++)
+            vtmp.push_back(GetId(m_tokens[i], inputlabel2id, "input"));
+        const auto& last = m_tokens.back();
+        labels->push_back(GetId(last, outputlabel2id, "output"));
+        input->push_back(std::move(vtmp));
+        if ((m_endSequenceOut.compare(0, wstring::npos, last.first, last.second) == 0 ||
              // below is for backward support
-             vstr[0] == m_endTag) &&
+             m_endTag.compare(0, wstring::npos, m_tokens[0].first, m_tokens[0].second) == 0) &&
             input->size() > 0 && labels->size() > 0)
         {
             AddOneItem(labels, input, seqPos, lineCount, recordCount, orgRecordCount, sequencePositionLast);
@@ -16,6 +16,7 @@
 #include <stdint.h>
 #include "Platform.h"
 #include "DataReader.h"
+#include "StringHashMap.h"
 
 using namespace std;
 
@@ -143,6 +144,11 @@ public:
     std::wstring mFileName;
     vector<SentenceInfo> mSentenceIndex2SentenceInfo;
 
+private:
+    std::vector<std::pair<const wchar_t*, size_t>> m_tokens; // tokens of the current line, pointing into the line
+
+    long GetId(const std::pair<const wchar_t*, size_t>& token, const StringHashMap<wchar_t, long>& label2id, const char* labelKind) const;
+
 public:
     using LUSequenceParser<NumType, LabelType>::m_dimFeatures;
     using LUSequenceParser<NumType, LabelType>::m_dimLabelsIn;
@@ -228,7 +234,8 @@ public:
     // numbers - pointer to vector to return the numbers
     // seqPos - pointers to the other two arrays showing positions of each sequence
     // returns - number of records actually read, if the end of file is reached the return value will be < requested records
-    long Parse(size_t recordsRequested, std::vector<long>* labels, std::vector<vector<long>>* input, std::vector<SequencePosition>* seqPos, const map<wstring, long>& inputlabel2id, const map<wstring, long>& outputlabel2id, bool mAllowMultPassData = false);
+    // inputlabel2id, outputlabel2id - the vocabularies, which are looked up for every token without creating a string for it
+    long Parse(size_t recordsRequested, std::vector<long>* labels, std::vector<vector<long>>* input, std::vector<SequencePosition>* seqPos, const StringHashMap<wchar_t, long>& inputlabel2id, const StringHashMap<wchar_t, long>& outputlabel2id, bool mAllowMultPassData = false);
 };
 }
 }
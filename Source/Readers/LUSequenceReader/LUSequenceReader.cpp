@@ -402,6 +402,19 @@ void BatchLUSequenceReader<ElemType>::InitFromConfig(const ConfigRecordType& rea
                 if (m_labelInfo[index].busewordmap)
                     ChangeMaping(mWordMapping, mUnkStr, m_labelInfo[index].word4idx);
                 m_labelInfo[index].dim = (long) m_labelInfo[index].idx4word.size();
+
+                m_labelInfo[index].word4idxHash.Clear();
+                for (const auto& word : m_labelInfo[index].word4idx)
+                    m_labelInfo[index].word4idxHash.Set(word.first, word.second);
+                m_labelInfo[index].wordClass.clear();
+                for (const auto& wordClass : m_labelInfo[index].idx4class)
+                {
+                    if (wordClass.first < 0)
+                        continue;
+                    if (m_labelInfo[index].wordClass.size() <= (size_t) wordClass.first)
+                        m_labelInfo[index].wordClass.resize(wordClass.first + 1, 0);
+                    m_labelInfo[index].wordClass[wordClass.first] = wordClass.second;
+                }
             }
         }
     }
@@ -660,7 +673,7 @@ bool BatchLUSequenceReader<ElemType>::EnsureDataAvailable(size_t /*mbStartSample
         {
             Reset();
 
-            mNumRead = m_parser.Parse(CACHE_BLOCK_SIZE, &m_labelTemp, &m_featureTemp, &seqPos, featIn.word4idx, labelIn.word4idx, mAllowMultPassData);
+            mNumRead = m_parser.Parse(CACHE_BLOCK_SIZE, &m_labelTemp, &m_featureTemp, &seqPos, featIn.word4idxHash, labelIn.word4idxHash, mAllowMultPassData);
             if (mNumRead == 0)
             {
                 fprintf(stderr, "EnsureDataAvailable: No more data.\n");
@@ -947,7 +960,7 @@ size_t BatchLUSequenceReader<ElemType>::GetLabelOutput(StreamMinibatchInputs& ma
             labels.SetValue(0, j, (ElemType) wrd);
 
             long clsidx = -1;
-            clsidx = labelInfo.idx4class[wrd];
+            clsidx = wrd >= 0 && wrd < (long) labelInfo.wordClass.size() ? labelInfo.wordClass[wrd] : 0;
 
             labels.SetValue(1, j, (ElemType) clsidx);
             // save the [beginning ending_indx) of the class
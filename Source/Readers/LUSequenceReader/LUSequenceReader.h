@@ -122,6 +122,7 @@ protected:
     {
         LabelKind type; // labels are categories, create mapping table
         map<LabelType, LabelIdType> word4idx;
+        StringHashMap<wchar_t, LabelIdType> word4idxHash; // word4idx for the lookups of the parser, set up with it by InitFromConfig()
         map<LabelIdType, LabelType> idx4word;
         long dim;                // maximum label ID we will ever see (used for array dimensions)
         LabelType beginSequence; // starting sequence string (i.e. <s>)
@@ -142,6 +143,7 @@ protected:
         */
         map<wstring, long> word4cls;
         map<long, long> idx4class;
+        std::vector<long> wordClass; // [word id] idx4class for the lookups of GetLabelOutput()
         Matrix<ElemType>* m_id2classLocal;  // CPU version
         Matrix<ElemType>* m_classInfoLocal; // CPU version
         int mNbrClasses;
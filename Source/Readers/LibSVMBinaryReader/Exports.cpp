@@ -9,6 +9,8 @@
 #define DATAREADER_EXPORTS
 #include "DataReader.h"
 #include "LibSVMBinaryReader.h"
+#include "LibSVMBinaryDeserializer.h"
+#include "StringUtil.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -21,4 +23,22 @@ extern "C" DATAREADER_API void GetReaderD(IDataReader** preader)
     *preader = new LibSVMBinaryReader<double>();
 }
 
+// A factory method for creating LibSVM binary deserializers, for the composite reader.
+extern "C" DATAREADER_API bool CreateDeserializer(IDataDeserializer** deserializer, const std::wstring& type, const ConfigParameters& deserializerConfig, CorpusDescriptorPtr corpus, bool primary)
+{
+    string precision = deserializerConfig.Find("precision", "float");
+    if (!AreEqualIgnoreCase(precision, "float") && !AreEqualIgnoreCase(precision, "double"))
+    {
+        InvalidArgument("Unsupported precision '%s'", precision.c_str());
+    }
+
+    if (type == L"LibSVMBinaryDeserializer")
+        *deserializer = new LibSVMBinaryDeserializer(corpus, deserializerConfig, primary);
+    else
+        InvalidArgument("Unknown deserializer type '%ls'", type.c_str());
+
+    // Deserializer created.
+    return true;
+}
+
 }}}
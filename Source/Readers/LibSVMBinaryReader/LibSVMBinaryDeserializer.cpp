@@ -0,0 +1,319 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include "LibSVMBinaryDeserializer.h"
+#include "ElementTypeUtils.h"
+#include "StringUtil.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+using namespace std;
+
+// Sequences that reference the blocks of their chunk, which they keep alive through m_chunk.
+struct LibSVMBinaryDenseSequenceData : DenseSequenceData
+{
+    const void* GetDataBuffer() override
+    {
+        return m_data;
+    }
+
+    const char* m_data;
+};
+
+struct LibSVMBinarySparseSequenceData : SparseSequenceData
+{
+    const void* GetDataBuffer() override
+    {
+        return m_data;
+    }
+
+    const char* m_data;
+};
+
+// The blocks of a chunk, as read from the file, and where the streams of each block start.
+class LibSVMBinaryDeserializer::LibSVMBinaryChunk : public Chunk, public std::enable_shared_from_this<LibSVMBinaryChunk>
+{
+    // a stream of a block: values, and for sparse streams row indices and column offsets of the samples
+    struct BlockStream
+    {
+        const char* m_values;
+        const IndexType* m_rowIndices;
+        const IndexType* m_columnOffsets;
+    };
+
+public:
+    LibSVMBinaryChunk(const LibSVMBinaryDeserializer& parent, const ChunkInfo& chunk)
+        : m_parent(parent), m_chunk(chunk)
+    {
+        const Block& first = parent.m_blocks[chunk.m_firstBlock];
+        const Block& last = parent.m_blocks[chunk.m_firstBlock + chunk.m_numberOfBlocks - 1];
+        m_buffer.resize(last.m_offset + last.m_size - first.m_offset);
+        parent.m_file->Read(first.m_offset, m_buffer.size(), m_buffer.data());
+
+        const size_t numberOfStreams = parent.m_streams.size();
+        const size_t elementSize = GetSizeByType(parent.m_elementType);
+        m_blockStreams.resize(chunk.m_numberOfBlocks * numberOfStreams);
+        for (size_t b = 0; b < chunk.m_numberOfBlocks; b++)
+        {
+            const Block& block = parent.m_blocks[chunk.m_firstBlock + b];
+            const char* data = m_buffer.data() + (block.m_offset - first.m_offset);
+            const char* end = data + block.m_size;
+            auto take = [&](size_t size) -> const char*
+            {
+                if ((size_t) (end - data) < size)
+                    RuntimeError("LibSVMBinaryDeserializer: Block %" PRIu64 " of '%ls' is truncated.", (uint64_t) (chunk.m_firstBlock + b), parent.m_file->Path().c_str());
+                const char* result = data;
+                data += size;
+                return result;
+            };
+
+            int32_t numberOfSamples = *(const int32_t*) take(sizeof(int32_t));
+            if (numberOfSamples != (int32_t) block.m_numberOfSamples)
+                LogicError("LibSVMBinaryDeserializer: Block %" PRIu64 " has changed since the file was opened.", (uint64_t) (chunk.m_firstBlock + b));
+
+            for (size_t s = 0; s < numberOfStreams; s++)
+            {
+                BlockStream& stream = m_blockStreams[b * numberOfStreams + s];
+                if (s < parent.m_numberOfFeatureStreams)
+                {
+                    int32_t nnz = *(const int32_t*) take(sizeof(int32_t));
+                    stream.m_values = take(nnz * elementSize);
+                    stream.m_rowIndices = (const IndexType*) take(nnz * sizeof(IndexType));
+                    stream.m_columnOffsets = (const IndexType*) take((numberOfSamples + 1) * sizeof(IndexType));
+                }
+                else
+                {
+                    stream.m_values = take(numberOfSamples * parent.m_streams[s]->m_sampleLayout->GetNumElements() * elementSize);
+                    stream.m_rowIndices = nullptr;
+                    stream.m_columnOffsets = nullptr;
+                }
+            }
+        }
+    }
+
+    void GetSequence(size_t sequenceId, std::vector<SequenceDataPtr>& result) override
+    {
+        if (sequenceId < m_chunk.m_firstSample || sequenceId - m_chunk.m_firstSample >= m_chunk.m_numberOfSamples)
+            LogicError("LibSVMBinaryDeserializer: Sequence %" PRIu64 " does not belong to the chunk.", (uint64_t) sequenceId);
+
+        // the block of the sample
+        const auto& blocks = m_parent.m_blocks;
+        auto block = upper_bound(blocks.begin() + m_chunk.m_firstBlock, blocks.begin() + m_chunk.m_firstBlock + m_chunk.m_numberOfBlocks, sequenceId,
+                                 [](size_t sample, const Block& b) { return sample < b.m_firstSample; }) - 1;
+        const size_t sample = sequenceId - block->m_firstSample;
+        const size_t numberOfStreams = m_parent.m_streams.size();
+        const BlockStream* streams = &m_blockStreams[(block - blocks.begin() - m_chunk.m_firstBlock) * numberOfStreams];
+        const size_t elementSize = GetSizeByType(m_parent.m_elementType);
+
+        for (size_t s = 0; s < numberOfStreams; s++)
+        {
+            const auto& description = m_parent.m_streams[s];
+            SequenceDataPtr sequence;
+            if (s < m_parent.m_numberOfFeatureStreams)
+            {
+                // the CSC column of the sample, as stored
+                auto sparse = make_shared<LibSVMBinarySparseSequenceData>();
+                IndexType begin = streams[s].m_columnOffsets[sample], nnz = streams[s].m_columnOffsets[sample + 1] - begin;
+                sparse->m_data = streams[s].m_values + begin * elementSize;
+                sparse->m_indices = const_cast<IndexType*>(streams[s].m_rowIndices + begin);
+                sparse->m_nnzCounts.assign(1, nnz);
+                sparse->m_totalNnzCount = nnz;
+                sequence = sparse;
+            }
+            else
+            {
+                auto dense = make_shared<LibSVMBinaryDenseSequenceData>();
+                dense->m_data = streams[s].m_values + sample * description->m_sampleLayout->GetNumElements() * elementSize;
+                sequence = dense;
+            }
+            sequence->m_id = sequenceId;
+            sequence->m_numberOfSamples = 1;
+            sequence->m_elementType = m_parent.m_elementType;
+            sequence->m_sampleLayout = description->m_sampleLayout;
+            sequence->m_chunk = shared_from_this();
+            result.push_back(sequence);
+        }
+    }
+
+    size_t GetMemorySize() const override
+    {
+        return m_buffer.size();
+    }
+
+private:
+    const LibSVMBinaryDeserializer& m_parent;
+    const ChunkInfo m_chunk;
+    vector<char> m_buffer;
+    vector<BlockStream> m_blockStreams; // [block of the chunk * number of streams + stream]
+};
+
+LibSVMBinaryDeserializer::LibSVMBinaryDeserializer(CorpusDescriptorPtr /*corpus*/, const ConfigParameters& config, bool /*primary*/)
+    : m_numberOfFeatureStreams(0)
+{
+    string precision = config.Find("precision", "float");
+    m_elementType = AreEqualIgnoreCase(precision, "double") ? ElementType::tdouble : ElementType::tfloat;
+
+    // The same renaming as of the LibSVMBinaryReader.
+    map<wstring, wstring> rename;
+    for (const auto& id : config.GetMemberIds())
+    {
+        if (!config.CanBeConfigRecord(id))
+            continue;
+        const ConfigParameters& stream = config(id);
+        if (stream.ExistsCurrent(L"rename"))
+            rename[msra::strfun::utf16(id)] = (wstring) stream(L"rename");
+    }
+
+    wstring path = config(L"file");
+    m_file = make_shared<PositionalFile>(path);
+    ReadHeader(rename);
+
+    size_t chunkSizeInBytes = config(L"chunkSizeInBytes", (size_t) 32 * 1024 * 1024);
+    CreateChunks(chunkSizeInBytes);
+
+    fprintf(stderr, "LibSVMBinaryDeserializer: %" PRIu64 " samples in %" PRIu64 " blocks and %" PRIu64 " chunks\n",
+            (uint64_t) (m_blocks.empty() ? 0 : m_blocks.back().m_firstSample + m_blocks.back().m_numberOfSamples), (uint64_t) m_blocks.size(), (uint64_t) m_chunks.size());
+}
+
+// The layout of the file (see SparseBinaryInput::Init()):
+//     int64 number of samples, int64 number of blocks, int32 number of feature streams, int32 number of label streams
+//     per stream: int32 name length, name, int32 dimension
+//     int64 offsets of the blocks, relative to the start of the data
+//     data: int32 samples per block, then the blocks
+void LibSVMBinaryDeserializer::ReadHeader(const map<wstring, wstring>& rename)
+{
+    size_t offset = 0;
+    m_file->ReadValue<int64_t>(offset); // number of samples, they are counted per block instead
+    offset += sizeof(int64_t);
+    int64_t numberOfBlocks = m_file->ReadValue<int64_t>(offset);
+    offset += sizeof(int64_t);
+    int32_t numberOfFeatures = m_file->ReadValue<int32_t>(offset);
+    offset += sizeof(int32_t);
+    int32_t numberOfLabels = m_file->ReadValue<int32_t>(offset);
+    offset += sizeof(int32_t);
+    if (numberOfBlocks < 0 || numberOfFeatures < 0 || numberOfLabels < 0)
+        RuntimeError("LibSVMBinaryDeserializer: '%ls' is not a LibSVM binary file.", m_file->Path().c_str());
+
+    for (int32_t i = 0; i < numberOfFeatures + numberOfLabels; i++)
+    {
+        int32_t length = m_file->ReadValue<int32_t>(offset);
+        offset += sizeof(int32_t);
+        if (length < 0)
+            RuntimeError("LibSVMBinaryDeserializer: '%ls' is not a LibSVM binary file.", m_file->Path().c_str());
+        string name(length, '\0');
+        m_file->Read(offset, length, &name[0]);
+        offset += length;
+        int32_t dimension = m_file->ReadValue<int32_t>(offset);
+        offset += sizeof(int32_t);
+
+        auto stream = make_shared<StreamDescription>();
+        stream->m_id = m_streams.size();
+        stream->m_name = msra::strfun::utf16(name);
+        auto renamed = rename.find(stream->m_name);
+        if (renamed != rename.end())
+            stream->m_name = renamed->second;
+        stream->m_storageType = i < numberOfFeatures ? StorageType::sparse_csc : StorageType::dense;
+        stream->m_elementType = m_elementType;
+        stream->m_sampleLayout = make_shared<TensorShape>((size_t) dimension);
+        m_streams.push_back(stream);
+    }
+    m_numberOfFeatureStreams = numberOfFeatures;
+
+    ReadBlocks(numberOfBlocks, offset, offset + numberOfBlocks * sizeof(int64_t));
+}
+
+void LibSVMBinaryDeserializer::ReadBlocks(size_t numberOfBlocks, size_t offsetsStart, size_t dataStart)
+{
+    vector<int64_t> offsets(numberOfBlocks);
+    if (numberOfBlocks > 0)
+        m_file->Read(offsetsStart, numberOfBlocks * sizeof(int64_t), offsets.data());
+
+    // The number of samples of a block is the first value of the block.
+    m_blocks.resize(numberOfBlocks);
+    size_t firstSample = 0;
+    for (size_t i = 0; i < numberOfBlocks; i++)
+    {
+        Block& block = m_blocks[i];
+        block.m_offset = dataStart + offsets[i];
+        size_t end = i + 1 < numberOfBlocks ? dataStart + offsets[i + 1] : m_file->Size();
+        if (offsets[i] < 0 || block.m_offset > end || end > m_file->Size())
+            RuntimeError("LibSVMBinaryDeserializer: The offset of block %" PRIu64 " of '%ls' is invalid, the file is corrupt.", (uint64_t) i, m_file->Path().c_str());
+        block.m_size = end - block.m_offset;
+        int32_t numberOfSamples = m_file->ReadValue<int32_t>(block.m_offset);
+        if (numberOfSamples < 0)
+            RuntimeError("LibSVMBinaryDeserializer: Block %" PRIu64 " of '%ls' is corrupt.", (uint64_t) i, m_file->Path().c_str());
+        block.m_numberOfSamples = numberOfSamples;
+        block.m_firstSample = firstSample;
+        firstSample += numberOfSamples;
+    }
+}
+
+void LibSVMBinaryDeserializer::CreateChunks(size_t chunkSizeInBytes)
+{
+    for (size_t i = 0; i < m_blocks.size(); i++)
+    {
+        if (m_chunks.empty() || m_blocks[i - 1].m_offset + m_blocks[i - 1].m_size - m_blocks[m_chunks.back().m_firstBlock].m_offset >= chunkSizeInBytes)
+        {
+            ChunkInfo chunk = { i, 0, m_blocks[i].m_firstSample, 0 };
+            m_chunks.push_back(chunk);
+        }
+        m_chunks.back().m_numberOfBlocks++;
+        m_chunks.back().m_numberOfSamples += m_blocks[i].m_numberOfSamples;
+    }
+
+    for (size_t i = 0; i < m_chunks.size(); i++)
+    {
+        auto description = make_shared<ChunkDescription>();
+        description->m_id = (ChunkIdType) i;
+        description->m_numberOfSamples = m_chunks[i].m_numberOfSamples;
+        description->m_numberOfSequences = m_chunks[i].m_numberOfSamples;
+        m_chunkDescriptions.push_back(description);
+    }
+}
+
+ChunkDescriptions LibSVMBinaryDeserializer::GetChunkDescriptions()
+{
+    return m_chunkDescriptions;
+}
+
+void LibSVMBinaryDeserializer::GetSequencesForChunk(ChunkIdType chunkId, vector<SequenceDescription>& result)
+{
+    const ChunkInfo& chunk = m_chunks[chunkId];
+    result.reserve(result.size() + chunk.m_numberOfSamples);
+    for (size_t i = chunk.m_firstSample; i < chunk.m_firstSample + chunk.m_numberOfSamples; i++)
+    {
+        SequenceDescription description;
+        description.m_id = i;
+        description.m_numberOfSamples = 1;
+        description.m_chunkId = chunkId;
+        description.m_key.m_sequence = i; // the file has no keys, the samples are identified by their position
+        description.m_key.m_sample = 0;
+        result.push_back(description);
+    }
+}
+
+ChunkPtr LibSVMBinaryDeserializer::GetChunk(ChunkIdType chunkId)
+{
+    return make_shared<LibSVMBinaryChunk>(*this, m_chunks[chunkId]);
+}
+
+bool LibSVMBinaryDeserializer::GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& result)
+{
+    auto chunk = upper_bound(m_chunks.begin(), m_chunks.end(), (size_t) key.m_sequence,
+                             [](size_t sample, const ChunkInfo& c) { return sample < c.m_firstSample; });
+    if (chunk == m_chunks.begin() || key.m_sequence >= (chunk - 1)->m_firstSample + (chunk - 1)->m_numberOfSamples)
+        return false;
+
+    result.m_id = key.m_sequence;
+    result.m_numberOfSamples = 1;
+    result.m_chunkId = (ChunkIdType) (chunk - 1 - m_chunks.begin());
+    result.m_key = key;
+    return true;
+}
+
+}}}
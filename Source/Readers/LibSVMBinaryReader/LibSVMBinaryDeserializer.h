@@ -0,0 +1,69 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include "DataDeserializerBase.h"
+#include "Config.h"
+#include "CorpusDescriptor.h"
+#include "PositionalFile.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Deserializer of the files of the LibSVMBinaryReader, for use with the composite reader (randomization, distributed
+// reading and prefetch). The file is a sequence of precomputed blocks of samples (its "minibatches"); every sparse
+// feature stream of a block is stored in CSC format and every label stream dense. A chunk is a run of consecutive
+// blocks that is read with a single positional read, so that the chunks the randomizer prefetches are read in parallel.
+// The samples, one sequence each, point into the blocks as they were read; nothing is decoded or copied.
+class LibSVMBinaryDeserializer : public DataDeserializerBase
+{
+public:
+    // Config:
+    //     file = "data.bin"
+    //     precision = "float"             # as the file was written
+    //     chunkSizeInBytes = 33554432     # blocks are grouped into chunks of about this size
+    //     features = [ rename = "x" ]     # optional, exposes the stream 'features' of the file as 'x'
+    LibSVMBinaryDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& config, bool primary);
+
+    ChunkDescriptions GetChunkDescriptions() override;
+    void GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& descriptions) override;
+    ChunkPtr GetChunk(ChunkIdType chunkId) override;
+
+protected:
+    bool GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& description) override;
+
+private:
+    class LibSVMBinaryChunk;
+
+    struct Block
+    {
+        size_t m_offset; // in the file
+        size_t m_size;   // in bytes
+        size_t m_firstSample;
+        uint32_t m_numberOfSamples;
+    };
+
+    struct ChunkInfo
+    {
+        size_t m_firstBlock;
+        size_t m_numberOfBlocks;
+        size_t m_firstSample;
+        size_t m_numberOfSamples;
+    };
+
+    void ReadHeader(const std::map<std::wstring, std::wstring>& rename);
+    void ReadBlocks(size_t numberOfBlocks, size_t offsetsStart, size_t dataStart);
+    void CreateChunks(size_t chunkSizeInBytes);
+
+    std::shared_ptr<PositionalFile> m_file;
+    ElementType m_elementType;
+    size_t m_numberOfFeatureStreams; // the first streams are the sparse features, then the dense labels
+
+    std::vector<Block> m_blocks;
+    std::vector<ChunkInfo> m_chunks;
+    ChunkDescriptions m_chunkDescriptions;
+};
+
+}}}
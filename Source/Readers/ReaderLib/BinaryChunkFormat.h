@@ -0,0 +1,157 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Definition of the binary chunk format, written by BinaryChunkWriter and read by the BinaryChunkDeserializer.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "Basics.h"
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace BinaryChunkFormat {
+
+// The file is meant to be memory mapped, so all headers are plain little-endian structs of fixed size,
+// laid out so that they need no padding. The file consists of:
+//   FileHeader
+//   chunk data, each starting at a multiple of c_alignment
+//   index at FileHeader::m_indexOffset:
+//     per stream: StreamHeader, the utf8 name padded to 8 bytes, the dimensions of the sample layout (uint64_t each)
+//     ChunkHeader[m_numberOfChunks]
+//     SequenceHeader[m_numberOfSequences], the sequences of all chunks, in chunk order
+//     the keys of all sequences, as utf8 strings without terminator
+//
+// The (uncompressed) data of a chunk consists of a SequenceStreamHeader per sequence and stream, sequence-major,
+// followed by the data of the sequences, each block starting at a multiple of c_alignment:
+//   dense streams: the samples of the sequence, one after another, as DenseSequenceData expects them
+//   sparse streams: the non zero values of all samples, then their row indices (IndexType), the number of
+//                   non zero values per sample (IndexType) and the CSC column offsets of the samples
+//                   (m_numberOfSamples + 1 values of IndexType, starting with 0), as SparseSequenceData expects them
+// All offsets within the data of a chunk are relative to its start.
+
+const uint64_t c_magic = 0x4b4843424b544e43ull; // "CNTKBCHK"
+const uint32_t c_version = 2;
+const size_t c_alignment = 16;
+
+enum class Compression : uint32_t
+{
+    none = 0,
+    lz4 = 1,
+};
+
+struct FileHeader
+{
+    uint64_t m_magic;
+    uint32_t m_version;
+    uint32_t m_numberOfStreams;
+    uint64_t m_numberOfChunks;
+    uint64_t m_numberOfSequences;
+    uint64_t m_indexOffset;
+    uint64_t m_indexSize;
+};
+static_assert(sizeof(FileHeader) == 48, "FileHeader must not have padding.");
+
+struct StreamHeader
+{
+    uint32_t m_storageType; // StorageType
+    uint32_t m_elementType; // ElementType
+    uint32_t m_nameLength;  // in bytes
+    uint32_t m_rank;        // of the sample layout
+};
+static_assert(sizeof(StreamHeader) == 16, "StreamHeader must not have padding.");
+
+struct ChunkHeader
+{
+    uint64_t m_offset;            // of the chunk data in the file
+    uint64_t m_storedSize;        // of the chunk data in the file, after compression
+    uint64_t m_size;              // of the uncompressed chunk data
+    uint64_t m_firstSequence;     // index of the first sequence of the chunk in the sequence table
+    uint64_t m_numberOfSamples;
+    uint32_t m_numberOfSequences;
+    uint32_t m_compression;       // Compression
+};
+static_assert(sizeof(ChunkHeader) == 48, "ChunkHeader must not have padding.");
+
+struct SequenceHeader
+{
+    uint64_t m_keyOffset;       // in the key section of the index
+    uint32_t m_keyLength;
+    uint32_t m_numberOfSamples; // maximum over all streams
+};
+static_assert(sizeof(SequenceHeader) == 16, "SequenceHeader must not have padding.");
+
+struct SequenceStreamHeader
+{
+    uint64_t m_dataOffset; // in the chunk data
+    uint32_t m_numberOfSamples;
+    uint32_t m_nnzCount;   // total number of non zero values, sparse streams only
+};
+static_assert(sizeof(SequenceStreamHeader) == 16, "SequenceStreamHeader must not have padding.");
+
+inline size_t AlignUp(size_t value, size_t alignment = c_alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+inline bool IsCompressionSupported(Compression compression)
+{
+#ifdef USE_LZ4
+    return compression == Compression::none || compression == Compression::lz4;
+#else
+    return compression == Compression::none;
+#endif
+}
+
+// Compresses the data of a chunk into 'compressed'.
+inline void Compress(Compression compression, const char* data, size_t size, std::vector<char>& compressed)
+{
+    if (compression == Compression::none)
+    {
+        compressed.assign(data, data + size);
+        return;
+    }
+#ifdef USE_LZ4
+    if (compression == Compression::lz4)
+    {
+        if (size > LZ4_MAX_INPUT_SIZE)
+            RuntimeError("BinaryChunkFormat: Chunk of %llu bytes is too large for LZ4 compression.", (unsigned long long)size);
+        compressed.resize(LZ4_compressBound((int)size));
+        int compressedSize = LZ4_compress_default(data, compressed.data(), (int)size, (int)compressed.size());
+        if (compressedSize <= 0)
+            RuntimeError("BinaryChunkFormat: LZ4 compression of a chunk failed.");
+        compressed.resize(compressedSize);
+        return;
+    }
+#endif
+    RuntimeError("BinaryChunkFormat: Compression %u is not supported by this build.", (unsigned int)compression);
+}
+
+// Decompresses the data of a chunk, of known uncompressed size, into 'data'.
+inline void Decompress(Compression compression, const char* stored, size_t storedSize, char* data, size_t size)
+{
+    if (compression == Compression::none)
+    {
+        if (storedSize != size)
+            RuntimeError("BinaryChunkFormat: Chunk of %llu bytes has %llu bytes stored.", (unsigned long long)size, (unsigned long long)storedSize);
+        memcpy(data, stored, size);
+        return;
+    }
+#ifdef USE_LZ4
+    if (compression == Compression::lz4)
+    {
+        int decompressedSize = LZ4_decompress_safe(stored, data, (int)storedSize, (int)size);
+        if (decompressedSize < 0 || (size_t)decompressedSize != size)
+            RuntimeError("BinaryChunkFormat: LZ4 decompression of a chunk failed.");
+        return;
+    }
+#endif
+    RuntimeError("BinaryChunkFormat: Compression %u is not supported by this build.", (unsigned int)compression);
+}
+
+}}}}
@@ -0,0 +1,255 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <limits>
+#include "BinaryChunkWriter.h"
+#include "BinarySequenceData.h"
+#include "ElementTypeUtils.h"
+#include "fileutil.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+using namespace BinaryChunkFormat;
+
+BinaryChunkWriter::BinaryChunkWriter(const std::wstring& path, const std::vector<StreamDescriptionPtr>& streams,
+                                     size_t chunkSizeInBytes, Compression compression)
+    : m_path(path),
+      m_temporaryPath(path + L".tmp"),
+      m_file(nullptr),
+      m_position(0),
+      m_chunkSizeInBytes(chunkSizeInBytes),
+      m_compression(compression),
+      m_chunkNumberOfSamples(0)
+{
+    if (streams.empty())
+        InvalidArgument("BinaryChunkWriter: There are no streams to write.");
+    if (!IsCompressionSupported(compression))
+        InvalidArgument("BinaryChunkWriter: Compression %u is not supported by this build.", (unsigned int)compression);
+
+    for (const auto& description : streams)
+    {
+        if (description->m_storageType != StorageType::dense && description->m_storageType != StorageType::sparse_csc)
+            InvalidArgument("BinaryChunkWriter: Stream '%ls' has an unsupported storage type.", description->m_name.c_str());
+
+        Stream stream;
+        stream.m_header.m_storageType = (uint32_t)description->m_storageType;
+        stream.m_header.m_elementType = (uint32_t)description->m_elementType;
+        stream.m_name = msra::strfun::utf8(description->m_name);
+        stream.m_header.m_nameLength = (uint32_t)stream.m_name.size();
+        stream.m_header.m_rank = 0;
+        stream.m_sampleSize = 0;
+        if (description->m_sampleLayout)
+        {
+            for (auto dimension : description->m_sampleLayout->GetDims())
+                stream.m_dimensions.push_back(dimension);
+            stream.m_header.m_rank = (uint32_t)stream.m_dimensions.size();
+            stream.m_sampleSize = description->m_sampleLayout->GetNumElements();
+        }
+        m_streams.push_back(stream);
+    }
+
+    m_file = fopenOrDie(m_temporaryPath, L"wb");
+
+    // The header is rewritten by Close() once the index is known.
+    FileHeader header = {};
+    Write(&header, sizeof(header));
+    Write(nullptr, AlignUp(m_position) - m_position);
+}
+
+BinaryChunkWriter::~BinaryChunkWriter()
+{
+    if (m_file)
+    {
+        // Not closed, so the file is incomplete.
+        fclose(m_file);
+        _wunlink(m_temporaryPath.c_str());
+    }
+}
+
+void BinaryChunkWriter::Write(const void* data, size_t size)
+{
+    if (size == 0)
+        return;
+    if (data)
+    {
+        fwriteOrDie(data, 1, size, m_file);
+    }
+    else
+    {
+        static const char zeros[c_alignment] = {};
+        assert(size <= sizeof(zeros));
+        fwriteOrDie(zeros, 1, size, m_file);
+    }
+    m_position += size;
+}
+
+void BinaryChunkWriter::InitializeStream(Stream& stream, const SequenceDataPtr& data)
+{
+    if (stream.m_header.m_elementType == (uint32_t)ElementType::tvariant)
+    {
+        stream.m_header.m_elementType = (uint32_t)data->m_elementType;
+        if (data->m_elementType != ElementType::tfloat && data->m_elementType != ElementType::tdouble)
+            RuntimeError("BinaryChunkWriter: Stream '%s' has neither float nor double elements.", stream.m_name.c_str());
+    }
+
+    if (stream.m_sampleSize == 0)
+    {
+        if (!data->m_sampleLayout)
+            RuntimeError("BinaryChunkWriter: Neither stream '%s' nor its sequences have a sample layout.", stream.m_name.c_str());
+        for (auto dimension : data->m_sampleLayout->GetDims())
+            stream.m_dimensions.push_back(dimension);
+        stream.m_header.m_rank = (uint32_t)stream.m_dimensions.size();
+        stream.m_sampleSize = data->m_sampleLayout->GetNumElements();
+    }
+}
+
+void BinaryChunkWriter::AddSequence(const std::string& key, const std::vector<SequenceDataPtr>& data)
+{
+    if (data.size() != m_streams.size())
+        LogicError("BinaryChunkWriter: Sequence '%s' has data for %d streams, expected %d.", key.c_str(), (int)data.size(), (int)m_streams.size());
+
+    uint32_t numberOfSamples = 0;
+    for (size_t i = 0; i < m_streams.size(); ++i)
+    {
+        Stream& stream = m_streams[i];
+        const auto& sequence = data[i];
+        if (m_sequences.empty())
+            InitializeStream(stream, sequence);
+
+        // Packers go by the element type of the stream, sequences need not have one of their own.
+        if (sequence->m_elementType != ElementType::tvariant && (uint32_t)sequence->m_elementType != stream.m_header.m_elementType)
+            RuntimeError("BinaryChunkWriter: Sequence '%s' of stream '%s' has an element type different from the stream.", key.c_str(), stream.m_name.c_str());
+        if (sequence->m_sampleLayout && sequence->m_sampleLayout->GetNumElements() != stream.m_sampleSize)
+            RuntimeError("BinaryChunkWriter: Sequence '%s' of stream '%s' has samples of %d elements, expected %d. "
+                         "Only streams with a fixed sample layout can be written.",
+                         key.c_str(), stream.m_name.c_str(), (int)sequence->m_sampleLayout->GetNumElements(), (int)stream.m_sampleSize);
+
+        const size_t elementSize = GetSizeByType((ElementType)stream.m_header.m_elementType);
+        SequenceStreamHeader header;
+        header.m_dataOffset = m_chunkData.size();
+        header.m_numberOfSamples = sequence->m_numberOfSamples;
+
+        if (!AppendSequenceData(m_chunkData, (StorageType)stream.m_header.m_storageType, stream.m_sampleSize, elementSize, *sequence, header.m_nnzCount))
+            LogicError("BinaryChunkWriter: Sequence '%s' of stream '%s' has non zero counts that do not match its samples or add up to its total.",
+                       key.c_str(), stream.m_name.c_str());
+        m_chunkHeaders.push_back(header);
+        numberOfSamples = std::max(numberOfSamples, sequence->m_numberOfSamples);
+    }
+
+    SequenceHeader sequence;
+    sequence.m_keyOffset = m_keys.size();
+    sequence.m_keyLength = (uint32_t)key.size();
+    sequence.m_numberOfSamples = numberOfSamples;
+    m_keys += key;
+    m_sequences.push_back(sequence);
+    m_chunkNumberOfSamples += numberOfSamples;
+
+    if (m_chunkData.size() >= m_chunkSizeInBytes || m_chunkHeaders.size() / m_streams.size() == std::numeric_limits<uint32_t>::max())
+        FlushChunk();
+}
+
+void BinaryChunkWriter::FlushChunk()
+{
+    const size_t numberOfSequences = m_chunkHeaders.size() / m_streams.size();
+    if (numberOfSequences == 0)
+        return;
+
+    // The headers go in front of the data, so the offsets move by their size,
+    // which is a multiple of the alignment.
+    const size_t headersSize = m_chunkHeaders.size() * sizeof(SequenceStreamHeader);
+    static_assert(sizeof(SequenceStreamHeader) % c_alignment == 0, "Sequence headers must keep the data aligned.");
+    for (auto& header : m_chunkHeaders)
+        header.m_dataOffset += headersSize;
+
+    std::vector<char> chunk(headersSize + m_chunkData.size());
+    memcpy(chunk.data(), m_chunkHeaders.data(), headersSize);
+    if (!m_chunkData.empty())
+        memcpy(chunk.data() + headersSize, m_chunkData.data(), m_chunkData.size());
+    Compress(m_compression, chunk.data(), chunk.size(), m_compressed);
+
+    ChunkHeader header;
+    header.m_offset = m_position;
+    header.m_storedSize = m_compressed.size();
+    header.m_size = chunk.size();
+    header.m_firstSequence = m_sequences.size() - numberOfSequences;
+    header.m_numberOfSamples = m_chunkNumberOfSamples;
+    header.m_numberOfSequences = (uint32_t)numberOfSequences;
+    header.m_compression = (uint32_t)m_compression;
+    m_chunks.push_back(header);
+
+    Write(m_compressed.data(), m_compressed.size());
+    Write(nullptr, AlignUp(m_position) - m_position);
+
+    m_chunkHeaders.clear();
+    m_chunkData.clear();
+    m_chunkNumberOfSamples = 0;
+}
+
+void BinaryChunkWriter::AddSequences(IDataDeserializer& deserializer, const std::function<std::string(const KeyType&)>& keyToString, int verbosity)
+{
+    std::vector<SequenceDescription> sequences;
+    std::vector<SequenceDataPtr> data;
+    auto chunks = deserializer.GetChunkDescriptions();
+    for (const auto& chunkDescription : chunks)
+    {
+        sequences.clear();
+        deserializer.GetSequencesForChunk(chunkDescription->m_id, sequences);
+        ChunkPtr chunk = deserializer.GetChunk(chunkDescription->m_id);
+        for (const auto& sequence : sequences)
+        {
+            data.clear();
+            chunk->GetSequence(sequence.m_id, data);
+            AddSequence(keyToString(sequence.m_key), data);
+        }
+
+        if (verbosity > 0)
+            fprintf(stderr, "BinaryChunkWriter: Read chunk %u of %u, %" PRIu64 " sequences written.\n",
+                    (unsigned int)chunkDescription->m_id + 1, (unsigned int)chunks.size(), (uint64_t)m_sequences.size());
+    }
+}
+
+void BinaryChunkWriter::Close()
+{
+    if (!m_file)
+        LogicError("BinaryChunkWriter: The file is already closed.");
+
+    FlushChunk();
+
+    FileHeader header;
+    header.m_magic = c_magic;
+    header.m_version = c_version;
+    header.m_numberOfStreams = (uint32_t)m_streams.size();
+    header.m_numberOfChunks = m_chunks.size();
+    header.m_numberOfSequences = m_sequences.size();
+    header.m_indexOffset = m_position;
+
+    for (const auto& stream : m_streams)
+    {
+        Write(&stream.m_header, sizeof(stream.m_header));
+        Write(stream.m_name.data(), stream.m_name.size());
+        Write(nullptr, AlignUp(m_position, sizeof(uint64_t)) - m_position);
+        Write(stream.m_dimensions.data(), stream.m_dimensions.size() * sizeof(uint64_t));
+    }
+    Write(m_chunks.data(), m_chunks.size() * sizeof(ChunkHeader));
+    Write(m_sequences.data(), m_sequences.size() * sizeof(SequenceHeader));
+    Write(m_keys.data(), m_keys.size());
+    header.m_indexSize = m_position - header.m_indexOffset;
+
+    fsetpos(m_file, (uint64_t)0);
+    fwriteOrDie(&header, sizeof(header), 1, m_file);
+    fflushOrDie(m_file);
+    fcloseOrDie(m_file);
+    m_file = nullptr;
+
+    if (fexists(m_path))
+        unlinkOrDie(m_path);
+    renameOrDie(m_temporaryPath, m_path);
+}
+
+}}}
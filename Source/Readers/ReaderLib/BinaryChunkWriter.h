@@ -0,0 +1,74 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "DataDeserializer.h"
+#include "BinaryChunkFormat.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Writes sequences into a file of the binary chunk format (see BinaryChunkFormat.h), which the BinaryChunkDeserializer
+// reads without any parsing. The file is written under a temporary name and renamed once it is complete.
+class BinaryChunkWriter
+{
+public:
+    // Streams without a sample layout take the one of their first sequence, which then has to be the same for all sequences.
+    // A chunk is completed as soon as its data is at least chunkSizeInBytes large.
+    BinaryChunkWriter(const std::wstring& path, const std::vector<StreamDescriptionPtr>& streams,
+                      size_t chunkSizeInBytes, BinaryChunkFormat::Compression compression);
+    ~BinaryChunkWriter();
+
+    // Appends a sequence given by its data for each stream, in the order of the streams.
+    void AddSequence(const std::string& key, const std::vector<SequenceDataPtr>& data);
+
+    // Appends all sequences of the deserializer, in the order of its chunks.
+    void AddSequences(IDataDeserializer& deserializer, const std::function<std::string(const KeyType&)>& keyToString, int verbosity = 0);
+
+    // Writes the last chunk and the index and gives the file its final name.
+    void Close();
+
+    size_t NumberOfSequences() const { return m_sequences.size(); }
+    size_t NumberOfChunks() const { return m_chunks.size(); }
+
+private:
+    struct Stream
+    {
+        BinaryChunkFormat::StreamHeader m_header;
+        std::string m_name;
+        std::vector<uint64_t> m_dimensions;
+        size_t m_sampleSize; // in elements
+    };
+
+    void InitializeStream(Stream& stream, const SequenceDataPtr& data);
+    void FlushChunk();
+    void Write(const void* data, size_t size);
+
+    std::wstring m_path;
+    std::wstring m_temporaryPath;
+    FILE* m_file;
+    uint64_t m_position;
+
+    std::vector<Stream> m_streams;
+    size_t m_chunkSizeInBytes;
+    BinaryChunkFormat::Compression m_compression;
+
+    // The current chunk.
+    std::vector<BinaryChunkFormat::SequenceStreamHeader> m_chunkHeaders;
+    std::vector<char> m_chunkData;
+    size_t m_chunkNumberOfSamples;
+    std::vector<char> m_compressed;
+
+    std::vector<BinaryChunkFormat::ChunkHeader> m_chunks;
+    std::vector<BinaryChunkFormat::SequenceHeader> m_sequences;
+    std::string m_keys;
+
+    DISABLE_COPY_AND_MOVE(BinaryChunkWriter);
+};
+
+}}}
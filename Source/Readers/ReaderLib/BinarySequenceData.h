@@ -0,0 +1,116 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Sequences laid out in a flat buffer the way the sequence data classes expose them, as in the chunks of
+// the binary chunk format (see BinaryChunkFormat.h) and in the segments of the SharedChunkStore.
+//
+
+#pragma once
+
+#include <vector>
+#include "DataDeserializer.h"
+#include "BinaryChunkFormat.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Sequences that reference the data of a buffer, which has to be kept alive through m_chunk.
+struct BinaryDenseSequenceData : DenseSequenceData
+{
+    const void* GetDataBuffer() override
+    {
+        return m_data;
+    }
+
+    const char* m_data;
+};
+
+struct BinarySparseSequenceData : SparseSequenceData
+{
+    const void* GetDataBuffer() override
+    {
+        return m_data;
+    }
+
+    const char* m_data;
+};
+
+// Appends the data of a sequence of one stream to 'buffer', padded to a multiple of c_alignment:
+//   dense: the samples of the sequence, one after another
+//   sparse: the non zero values of all samples, then their row indices, the number of non zero values per sample
+//           and the CSC column offsets of the samples (m_numberOfSamples + 1 values, starting with 0)
+// Returns false if the non zero counts of a sparse sequence do not match its samples or its total.
+inline bool AppendSequenceData(std::vector<char>& buffer, StorageType storageType, size_t sampleSize, size_t elementSize,
+                               SequenceDataBase& sequence, uint32_t& nnzCount)
+{
+    nnzCount = 0;
+    const char* values = (const char*)sequence.GetDataBuffer();
+    if (storageType == StorageType::dense)
+    {
+        size_t size = sequence.m_numberOfSamples * sampleSize * elementSize;
+        buffer.insert(buffer.end(), values, values + size);
+    }
+    else
+    {
+        auto& sparse = static_cast<SparseSequenceData&>(sequence);
+        if (sparse.m_nnzCounts.size() != sequence.m_numberOfSamples)
+            return false;
+
+        nnzCount = sparse.m_totalNnzCount;
+        const char* indices = (const char*)sparse.m_indices;
+        const char* nnzCounts = (const char*)sparse.m_nnzCounts.data();
+        buffer.insert(buffer.end(), values, values + sparse.m_totalNnzCount * elementSize);
+        buffer.resize(BinaryChunkFormat::AlignUp(buffer.size(), sizeof(IndexType)));
+        buffer.insert(buffer.end(), indices, indices + sparse.m_totalNnzCount * sizeof(IndexType));
+        buffer.insert(buffer.end(), nnzCounts, nnzCounts + sparse.m_nnzCounts.size() * sizeof(IndexType));
+
+        // Column offsets, so that the packer can take the sequence over as a whole.
+        IndexType columnOffset = 0;
+        for (size_t sample = 0; sample <= sparse.m_nnzCounts.size(); ++sample)
+        {
+            buffer.insert(buffer.end(), (const char*)&columnOffset, (const char*)&columnOffset + sizeof(IndexType));
+            if (sample < sparse.m_nnzCounts.size())
+                columnOffset += sparse.m_nnzCounts[sample];
+        }
+        if (columnOffset != sparse.m_totalNnzCount)
+            return false;
+    }
+    buffer.resize(BinaryChunkFormat::AlignUp(buffer.size()));
+    return true;
+}
+
+// Creates a sequence over data appended by AppendSequenceData at 'offset' of a buffer of 'size' bytes.
+// Only m_data, m_indices, m_nnzCounts, m_columnOffsets, m_totalNnzCount and m_numberOfSamples are set.
+// Returns nullptr if the data of the sequence would reach beyond the end of the buffer.
+inline SequenceDataPtr CreateSequenceView(const char* data, uint64_t size, StorageType storageType, size_t sampleSize, size_t elementSize,
+                                          uint64_t offset, uint32_t numberOfSamples, uint32_t nnzCount)
+{
+    auto inBounds = [size](uint64_t o, uint64_t s) { return o <= size && s <= size - o; };
+
+    SequenceDataPtr sequence;
+    if (storageType == StorageType::dense)
+    {
+        if (!inBounds(offset, (uint64_t)numberOfSamples * sampleSize * elementSize))
+            return nullptr;
+        auto dense = std::make_shared<BinaryDenseSequenceData>();
+        dense->m_data = data + offset;
+        sequence = dense;
+    }
+    else
+    {
+        uint64_t indicesOffset = BinaryChunkFormat::AlignUp(offset + (uint64_t)nnzCount * elementSize, sizeof(IndexType));
+        if (!inBounds(offset, indicesOffset - offset + ((uint64_t)nnzCount + 2 * numberOfSamples + 1) * sizeof(IndexType)))
+            return nullptr;
+        auto sparse = std::make_shared<BinarySparseSequenceData>();
+        sparse->m_data = data + offset;
+        sparse->m_indices = const_cast<IndexType*>(reinterpret_cast<const IndexType*>(data + indicesOffset));
+        sparse->m_nnzCounts.assign(sparse->m_indices + nnzCount, sparse->m_indices + nnzCount + numberOfSamples);
+        sparse->m_columnOffsets = sparse->m_indices + nnzCount + numberOfSamples;
+        sparse->m_totalNnzCount = nnzCount;
+        sequence = sparse;
+    }
+    sequence->m_numberOfSamples = numberOfSamples;
+    return sequence;
+}
+
+}}}
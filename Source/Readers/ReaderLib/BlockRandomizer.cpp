@@ -9,11 +9,15 @@
 #include <inttypes.h>
 #include "BlockRandomizer.h"
 #include <algorithm>
+#include <numeric>
 #include <utility>
 #include <deque>
+#include <set>
 
 #include "DataReader.h"
-#include "ExceptionCapture.h"
+#include "WorkerThreadPool.h"
+#include "ReaderStatistics.h"
+#include "TimerUtility.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -24,7 +28,8 @@ BlockRandomizer::BlockRandomizer(
     bool shouldPrefetch,
     DecimationMode decimationMode,
     bool useLegacyRandomization,
-    bool multithreadedGetNextSequence)
+    bool multithreadedGetNextSequence,
+    size_t prefetchDepth)
     : m_verbosity(verbosity),
       m_deserializer(deserializer),
       m_decimationMode(decimationMode),
@@ -35,11 +40,16 @@ BlockRandomizer::BlockRandomizer(
       m_sweepTotalNumberOfSamples(0),
       m_chunkRandomizer(std::make_shared<ChunkRandomizer>(deserializer, randomizationRangeInSamples, useLegacyRandomization)),
       m_multithreadedGetNextSequences(multithreadedGetNextSequence),
-      m_prefetchedChunk(CHUNKID_MAX)
+      m_stopPrefetches(false),
+      m_prefetchDepth(prefetchDepth),
+      m_concurrentGetChunk(deserializer->SupportsConcurrentGetChunk()),
+      m_prefetchStatistics()
 {
     assert(deserializer != nullptr);
-
-    m_launchType = shouldPrefetch ? launch::async : launch::deferred;
+    if (m_prefetchDepth == 0)
+    {
+        InvalidArgument("BlockRandomizer: The prefetch depth must be at least 1.");
+    }
 
     m_streams = m_deserializer->GetStreamDescriptions();
     m_sequenceRandomizer = std::make_shared<SequenceRandomizer>(verbosity, m_deserializer, m_chunkRandomizer);
@@ -50,6 +60,26 @@ BlockRandomizer::BlockRandomizer(
     {
         m_sweepTotalNumberOfSamples += chunk->m_numberOfSamples;
     }
+
+    // Without prefetch, the chunks to prefetch are only loaded when needed.
+    for (size_t i = 0; shouldPrefetch && i < m_prefetchDepth; ++i)
+    {
+        m_ioThreads.emplace_back([this]() { RunPrefetches(); });
+    }
+}
+
+BlockRandomizer::~BlockRandomizer()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_prefetchLock);
+        m_stopPrefetches = true;
+        m_prefetchQueue.clear();
+    }
+    m_prefetchQueued.notify_all();
+    for (auto& thread : m_ioThreads)
+    {
+        thread.join();
+    }
 }
 
 // Start a new epoch.
@@ -87,6 +117,14 @@ void BlockRandomizer::StartEpoch(const EpochConfiguration& config)
                 m_globalSamplePosition,
                 config.m_workerRank,
                 config.m_numberOfWorkers);
+
+        const auto& stats = m_prefetchStatistics;
+        if (stats.m_numPrefetchedChunks + stats.m_numSynchronousLoads > 0)
+            fprintf(stderr, "BlockRandomizer::StartEpoch: chunks loaded so far: %" PRIu64 " prefetched (%" PRIu64 " of them waited for), %" PRIu64 " not prefetched, %.3f seconds spent waiting\n",
+                    stats.m_numPrefetchedChunks,
+                    stats.m_numBlockedWaits,
+                    stats.m_numSynchronousLoads,
+                    stats.m_blockedSeconds);
     }
 }
 
@@ -115,6 +153,8 @@ void BlockRandomizer::PrepareNewSweepIfNeeded(size_t samplePosition)
 // Gets next sequences not exceeding sampleCount.
 Sequences BlockRandomizer::GetNextSequences(size_t sampleCount)
 {
+    ReaderStageTimer randomizeTimer(ReaderStage::randomize);
+
     // Get next sequence descriptions.
     Sequences result;
     std::vector<RandomizedSequenceDescription> sequences;
@@ -125,60 +165,63 @@ Sequences BlockRandomizer::GetNextSequences(size_t sampleCount)
         return result;
     }
 
-    // Decimate sequences.
-    std::vector<RandomizedSequenceDescription> decimated;
-    decimated.reserve(sequences.size());
-    Decimate(sequences, decimated);
+    // Decimate sequences, in place.
+    size_t numberOfSequences = sequences.size();
+    Decimate(sequences);
+    const auto& decimated = sequences;
     if (decimated.size() == 0)
     {
         return result;
     }
 
     // Retrieve new data chunks if required.
-    LoadDataChunks(windowRange);
+    LoadDataChunks(windowRange, decimated);
 
     if (m_verbosity >= Debug)
         fprintf(stderr, "BlockRandomizer::GetNextSequences(): getting %" PRIu64 " out of %" PRIu64 " sequences for %" PRIu64 " requested samples in sweep %" PRIu64 "\n",
             decimated.size(),
-            sequences.size(),
+            numberOfSequences,
             sampleCount,
             m_sweep);
 
+    // The output is preallocated and the chunks are looked up before, so that the threads
+    // only read shared state and write their own slots of the result.
     result.m_data.resize(m_streams.size(), std::vector<SequenceDataPtr>(decimated.size()));
-
-    auto process = [&](int i) -> void {
-        const auto& description = decimated[i];
-        std::vector<SequenceDataPtr> sequence;
-        auto it = m_chunks.find(description.m_chunk->m_original->m_id);
+    std::vector<Chunk*> chunks(decimated.size());
+    for (size_t i = 0; i < decimated.size(); ++i)
+    {
+        auto it = m_chunks.find(decimated[i].m_chunk->m_original->m_id);
         if (it == m_chunks.end())
         {
             LogicError("Invalid chunk requested.");
         }
+        chunks[i] = it->second.get();
+    }
 
-        it->second->GetSequence(description.m_id, sequence);
+    auto process = [&](int i) -> void {
+        std::vector<SequenceDataPtr> sequence;
+        chunks[i]->GetSequence(decimated[i].m_id, sequence);
         for (int j = 0; j < m_streams.size(); ++j)
         {
-            result.m_data[j][i] = sequence[j];
+            result.m_data[j][i] = std::move(sequence[j]);
         }
     };
 
-    if (m_multithreadedGetNextSequences)
     {
-        ExceptionCapture capture;
-#pragma omp parallel for schedule(dynamic)
-        for (int i = 0; i < decimated.size(); ++i)
-            capture.SafeRun(process, i);
-        capture.RethrowIfHappened();
-    }
-    else
-    {
-        for (int i = 0; i < decimated.size(); ++i)
-            process(i);
+        ReaderStageTimer deserializeTimer(ReaderStage::deserialize);
+        if (m_multithreadedGetNextSequences)
+        {
+            ParallelFor(m_workerThreadPool, decimated.size(), [&process](size_t i) { process((int)i); });
+        }
+        else
+        {
+            for (int i = 0; i < decimated.size(); ++i)
+                process(i);
+        }
     }
 
-    // Now it is safe to start the new chunk prefetch.
-    ChunkIdType chunkToPrefetchNext = GetChunkToPrefetch(windowRange);
-    Prefetch(chunkToPrefetchNext);
+    // Now it is safe to start the new chunk prefetches.
+    Prefetch(GetChunksToPrefetch(windowRange));
 
     return result;
 }
@@ -209,33 +252,82 @@ bool BlockRandomizer::GetNextSequenceDescriptions(size_t sampleCount, std::vecto
     return false;
 }
 
-// Decimates sequences and load/unloads chunks using infromation of the SequenceRandomizer.
-void BlockRandomizer::Decimate(const std::vector<RandomizedSequenceDescription>& all, std::vector<RandomizedSequenceDescription>& decimated)
+// Decimates sequences in place, keeping the ones of this worker, and moves the cursor past all of them.
+void BlockRandomizer::Decimate(std::vector<RandomizedSequenceDescription>& sequences)
 {
     // Moving the cursor to the end of read sequences.
-    for (const auto& sequence : all)
+    for (const auto& sequence : sequences)
     {
         m_globalSamplePosition += sequence.m_numberOfSamples;
     }
 
-    decimated.reserve(all.size());
+    if (m_config.m_numberOfWorkers == 1)
+    {
+        return;
+    }
+
     if (m_decimationMode == DecimationMode::chunk)
     {
-        for (const auto& sequence : all)
-        {
-            if (sequence.m_chunk->m_chunkId % m_config.m_numberOfWorkers == m_config.m_workerRank)
-            {
-                decimated.push_back(sequence);
-            }
-        }
+        sequences.erase(std::remove_if(sequences.begin(), sequences.end(),
+                                       [this](const RandomizedSequenceDescription& s) { return !IsChunkOfWorker(*s.m_chunk); }),
+                        sequences.end());
     }
     // TODO: This mode should go away. Decimation based on chunks only should be sufficient.
     // Currently this mode is used only for image reader, which uses one chunk for each image.
     else if (m_decimationMode == DecimationMode::sequence)
     {
-        size_t strideBegin = all.size() * m_config.m_workerRank / m_config.m_numberOfWorkers;
-        size_t strideEnd = all.size() * (m_config.m_workerRank + 1) / m_config.m_numberOfWorkers;
-        decimated.assign(all.begin() + strideBegin, all.begin() + strideEnd);
+        size_t strideBegin, strideEnd;
+        GetWorkerRange(m_config, sequences.size(), strideBegin, strideEnd);
+        sequences.erase(sequences.begin() + strideEnd, sequences.end());
+        sequences.erase(sequences.begin(), sequences.begin() + strideBegin);
+    }
+    // The cost of the minibatch of a worker is estimated as the sum of the padded lengths of its sequences, i.e. their
+    // number times the length of its longest sequence. Longest sequence first, each goes to the worker whose cost grows
+    // the least above its share (the lowest rank on ties; equal shares unless m_workerShares gives them). Since the
+    // first sequence of a worker is its longest, every further one adds that length. This keeps the cost of each
+    // worker in proportion to its share, so that sequences of very different lengths do not leave the other workers
+    // waiting in the gradient aggregation. All workers see the same sequences and come to the same assignment; every
+    // worker keeps its sequences in the randomized order.
+    else if (m_decimationMode == DecimationMode::balancedSequence)
+    {
+        std::vector<size_t> order(sequences.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(),
+                         [&sequences](size_t a, size_t b) { return sequences[a].m_numberOfSamples > sequences[b].m_numberOfSamples; });
+
+        std::vector<double> workerCost(m_config.m_numberOfWorkers, 0);
+        std::vector<uint32_t> workerLongest(m_config.m_numberOfWorkers, 0);
+        std::vector<double> workerShares = m_config.m_workerShares;
+        if (workerShares.size() != m_config.m_numberOfWorkers)
+            workerShares.assign(m_config.m_numberOfWorkers, 1.0);
+        auto costWith = [&](size_t worker, uint32_t numberOfSamples)
+        {
+            return workerCost[worker] + (workerLongest[worker] == 0 ? numberOfSamples : workerLongest[worker]);
+        };
+
+        std::vector<bool> isOfWorker(sequences.size(), false);
+        for (size_t i : order)
+        {
+            const uint32_t numberOfSamples = sequences[i].m_numberOfSamples;
+            size_t worker = 0;
+            for (size_t w = 1; w < workerCost.size(); ++w)
+            {
+                if (costWith(w, numberOfSamples) * workerShares[worker] < costWith(worker, numberOfSamples) * workerShares[w])
+                    worker = w;
+            }
+            workerCost[worker] = costWith(worker, numberOfSamples);
+            if (workerLongest[worker] == 0)
+                workerLongest[worker] = numberOfSamples;
+            isOfWorker[i] = (worker == m_config.m_workerRank);
+        }
+
+        size_t numKept = 0;
+        for (size_t i = 0; i < sequences.size(); ++i)
+        {
+            if (isOfWorker[i])
+                sequences[numKept++] = sequences[i];
+        }
+        sequences.erase(sequences.begin() + numKept, sequences.end());
     }
     else
     {
@@ -243,10 +335,35 @@ void BlockRandomizer::Decimate(const std::vector<RandomizedSequenceDescription>&
     }
 }
 
+// Chunks are dealt out to the workers round robin in randomized order, so every worker gets every
+// m_numberOfWorkers-th chunk of each randomization window and loads about 1/m_numberOfWorkers of the data.
+// Workers with consecutive ranks, which usually run on the same host, get consecutive chunks of the window.
+bool BlockRandomizer::IsChunkOfWorker(const RandomizedChunk& chunk) const
+{
+    return chunk.m_chunkId % m_config.m_numberOfWorkers == m_config.m_workerRank;
+}
+
 // Retrieves chunk data based on the window information provided by SequenceRandomizer
-void BlockRandomizer::LoadDataChunks(const ClosedOpenChunkInterval& windowRange)
+// With decimation by sequences, only the chunks of the decimated sequences are loaded, in addition to the ones
+// of the window that are in memory already.
+void BlockRandomizer::LoadDataChunks(const ClosedOpenChunkInterval& windowRange, const std::vector<RandomizedSequenceDescription>& decimated)
 {
-    if (windowRange == m_currentWindowRange)
+    // Original ids of the chunks the decimated sequences need, only for decimation by sequences.
+    std::set<ChunkIdType> referenced;
+    if (m_decimationMode != DecimationMode::chunk && m_config.m_numberOfWorkers > 1)
+    {
+        for (const auto& sequence : decimated)
+        {
+            if (m_chunks.find(sequence.m_chunk->m_original->m_id) == m_chunks.end())
+                referenced.insert(sequence.m_chunk->m_original->m_id);
+        }
+
+        if (windowRange == m_currentWindowRange && referenced.empty())
+        {
+            return;
+        }
+    }
+    else if (windowRange == m_currentWindowRange)
     {
         // Nothing to do.
         return;
@@ -268,7 +385,7 @@ void BlockRandomizer::LoadDataChunks(const ClosedOpenChunkInterval& windowRange)
     for (size_t i = windowRange.m_begin; i < windowRange.m_end; ++i)
     {
         auto const& chunk = m_chunkRandomizer->GetRandomizedChunks()[i];
-        if (m_decimationMode == DecimationMode::chunk && chunk.m_chunkId % m_config.m_numberOfWorkers != m_config.m_workerRank)
+        if (m_decimationMode == DecimationMode::chunk && !IsChunkOfWorker(chunk))
         {
             continue;
         }
@@ -278,7 +395,8 @@ void BlockRandomizer::LoadDataChunks(const ClosedOpenChunkInterval& windowRange)
         {
             chunks[chunk.m_original->m_id] = it->second;
         }
-        else
+        else if (m_decimationMode == DecimationMode::chunk || m_config.m_numberOfWorkers == 1 ||
+                 referenced.find(chunk.m_original->m_id) != referenced.end())
         {
             needed[i - windowRange.m_begin] = true;
         }
@@ -297,25 +415,36 @@ void BlockRandomizer::LoadDataChunks(const ClosedOpenChunkInterval& windowRange)
         }
 
         auto const& chunk = m_chunkRandomizer->GetRandomizedChunks()[i];
-        if (chunk.m_original->m_id == m_prefetchedChunk && m_prefetch.valid())
+        Timer waitTimer;
+        waitTimer.Start();
+        ChunkPtr prefetched;
+        bool blocked = false;
+        if (TakePrefetch(chunk.m_original->m_id, prefetched, blocked))
         {
             // Taking prefetched chunk.
-            m_chunks[chunk.m_original->m_id] = m_prefetch.get();
+            m_prefetchStatistics.m_numPrefetchedChunks++;
+            m_chunks[chunk.m_original->m_id] = prefetched;
+            if (blocked)
+            {
+                waitTimer.Stop();
+                m_prefetchStatistics.m_numBlockedWaits++;
+                m_prefetchStatistics.m_blockedSeconds += waitTimer.ElapsedSeconds();
+            }
+
             if (m_verbosity >= Information)
-                fprintf(stderr, "BlockRandomizer::RetrieveDataChunks: paged in prefetched chunk %u (original chunk: %u), now %" PRIu64 " chunks in memory\n",
+                fprintf(stderr, "BlockRandomizer::RetrieveDataChunks: paged in prefetched chunk %u (original chunk: %u)%s, now %" PRIu64 " chunks in memory\n",
                 chunk.m_chunkId,
                 chunk.m_original->m_id,
+                blocked ? " after waiting for it" : "",
                 ++numLoadedChunks);
         }
         else
         {
-            // Make sure we have no outstanding prefetches.
-            if (m_prefetch.valid())
-            {
-                m_prefetch.wait();
-            }
+            m_chunks[chunk.m_original->m_id] = GetChunkFromDeserializer(chunk.m_original->m_id);
+            waitTimer.Stop();
+            m_prefetchStatistics.m_numSynchronousLoads++;
+            m_prefetchStatistics.m_blockedSeconds += waitTimer.ElapsedSeconds();
 
-            m_chunks[chunk.m_original->m_id] = m_deserializer->GetChunk(chunk.m_original->m_id);
             if (m_verbosity >= Information)
                 fprintf(stderr, "BlockRandomizer::RetrieveDataChunks: paged in randomized chunk %u (original chunk: %u), now %" PRIu64 " chunks in memory\n",
                 chunk.m_chunkId,
@@ -331,11 +460,11 @@ void BlockRandomizer::LoadDataChunks(const ClosedOpenChunkInterval& windowRange)
                 m_chunkRandomizer->GetRandomizedChunks()[windowRange.m_end - 1].m_chunkId);
 }
 
-// Identifies chunk id that should be prefetched.
+// Identifies chunk ids that should be prefetched, in the order they are going to be needed.
 // TODO: DecimationMode::sequence is not supported because it should eventually go away.
-ChunkIdType BlockRandomizer::GetChunkToPrefetch(const ClosedOpenChunkInterval& windowRange)
+std::vector<ChunkIdType> BlockRandomizer::GetChunksToPrefetch(const ClosedOpenChunkInterval& windowRange)
 {
-    ChunkIdType toBePrefetched = CHUNKID_MAX;
+    std::vector<ChunkIdType> toBePrefetched;
     if (m_decimationMode != DecimationMode::chunk)
     {
         // For non chunked mode, we do not do prefetch currently.
@@ -343,38 +472,166 @@ ChunkIdType BlockRandomizer::GetChunkToPrefetch(const ClosedOpenChunkInterval& w
     }
 
     auto current = windowRange.m_end;
-    while (current < m_chunkRandomizer->GetRandomizedChunks().size())
+    while (current < m_chunkRandomizer->GetRandomizedChunks().size() && toBePrefetched.size() < m_prefetchDepth)
     {
         const auto& chunk = m_chunkRandomizer->GetRandomizedChunks()[current];
-        if (chunk.m_chunkId % m_config.m_numberOfWorkers == m_config.m_workerRank &&
+        if (IsChunkOfWorker(chunk) &&
             m_chunks.find(chunk.m_original->m_id) == m_chunks.end())
         {
-            toBePrefetched = chunk.m_original->m_id;
-            break;
+            toBePrefetched.push_back(chunk.m_original->m_id);
         }
         ++current;
     }
     return toBePrefetched;
 }
 
-// Performs io prefetch of the specified chunk if needed.
-void BlockRandomizer::Prefetch(ChunkIdType chunkId)
+// Performs io prefetch of the specified chunks if needed.
+void BlockRandomizer::Prefetch(const std::vector<ChunkIdType>& chunkIds)
 {
-    // Start new prefetch if necessary.
-    if (m_prefetchedChunk != chunkId && chunkId != CHUNKID_MAX)
+    std::vector<ChunkPtr> dropped; // released once the lock is released
     {
-        // Wait to make sure there is no outstanding prefetches.
-        if (m_prefetch.valid())
+        std::unique_lock<std::mutex> lock(m_prefetchLock);
+
+        // Drop the prefetches that are not going to be needed anymore, e.g. after the chunks were rerandomized.
+        // The ones in flight are left to their I/O threads, which drop them once done.
+        for (auto prefetch = m_prefetches.begin(); prefetch != m_prefetches.end();)
         {
-            m_prefetch.wait();
+            auto& state = *prefetch->second;
+            if (std::find(chunkIds.begin(), chunkIds.end(), prefetch->first) != chunkIds.end())
+            {
+                state.m_dropped = false;
+                ++prefetch;
+                continue;
+            }
+
+            if (!state.m_started)
+            {
+                m_prefetchQueue.erase(std::find(m_prefetchQueue.begin(), m_prefetchQueue.end(), prefetch->first));
+            }
+            else if (!state.m_done)
+            {
+                state.m_dropped = true;
+                ++prefetch;
+                continue;
+            }
+
+            dropped.push_back(std::move(state.m_chunk));
+            prefetch = m_prefetches.erase(prefetch);
         }
 
-        m_prefetchedChunk = chunkId;
-        m_prefetch = std::async(m_launchType, [this, chunkId]() { return m_deserializer->GetChunk(chunkId); });
+        // Queue new prefetches if necessary.
+        for (auto chunkId : chunkIds)
+        {
+            if (m_prefetches.find(chunkId) != m_prefetches.end())
+            {
+                continue;
+            }
+
+            auto prefetch = std::make_shared<PrefetchedChunk>();
+            prefetch->m_statistics = ReaderStatisticsCollector::Current();
+            prefetch->m_started = false;
+            prefetch->m_done = false;
+            prefetch->m_dropped = false;
+            m_prefetches[chunkId] = prefetch;
+            m_prefetchQueue.push_back(chunkId);
 
-        if (m_verbosity >= Debug)
-            fprintf(stderr, "BlockRandomizer::Prefetch: prefetching original chunk: %u\n", chunkId);
+            if (m_verbosity >= Debug)
+                fprintf(stderr, "BlockRandomizer::Prefetch: prefetching original chunk: %u, %" PRIu64 " prefetches outstanding\n", chunkId, m_prefetches.size());
+        }
     }
+    m_prefetchQueued.notify_all();
+}
+
+void BlockRandomizer::RunPrefetches()
+{
+    for (;;)
+    {
+        ChunkIdType chunkId;
+        std::shared_ptr<PrefetchedChunk> prefetch;
+        {
+            std::unique_lock<std::mutex> lock(m_prefetchLock);
+            m_prefetchQueued.wait(lock, [this]() { return m_stopPrefetches || !m_prefetchQueue.empty(); });
+            if (m_stopPrefetches)
+            {
+                return;
+            }
+
+            chunkId = m_prefetchQueue.front();
+            m_prefetchQueue.pop_front();
+            prefetch = m_prefetches[chunkId];
+            prefetch->m_started = true;
+        }
+
+        ChunkPtr chunk;
+        std::exception_ptr error;
+        try
+        {
+            ReaderStatisticsScope statisticsScope(prefetch->m_statistics);
+            chunk = GetChunkFromDeserializer(chunkId);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(m_prefetchLock);
+            prefetch->m_done = true;
+            if (prefetch->m_dropped)
+            {
+                m_prefetches.erase(chunkId);
+            }
+            else
+            {
+                prefetch->m_chunk = std::move(chunk);
+                prefetch->m_error = error;
+            }
+        }
+        m_prefetchDone.notify_all();
+    }
+}
+
+bool BlockRandomizer::TakePrefetch(ChunkIdType chunkId, ChunkPtr& chunk, bool& blocked)
+{
+    std::unique_lock<std::mutex> lock(m_prefetchLock);
+    auto found = m_prefetches.find(chunkId);
+    if (found == m_prefetches.end())
+    {
+        return false;
+    }
+
+    auto prefetch = found->second;
+    m_prefetches.erase(found);
+    prefetch->m_dropped = false;
+    blocked = !prefetch->m_done;
+    if (!prefetch->m_started)
+    {
+        // Not waiting for the I/O threads to get to it.
+        m_prefetchQueue.erase(std::find(m_prefetchQueue.begin(), m_prefetchQueue.end(), chunkId));
+        lock.unlock();
+        chunk = GetChunkFromDeserializer(chunkId);
+        return true;
+    }
+
+    m_prefetchDone.wait(lock, [&prefetch]() { return prefetch->m_done; });
+    if (prefetch->m_error)
+    {
+        std::rethrow_exception(prefetch->m_error);
+    }
+    chunk = std::move(prefetch->m_chunk);
+    return true;
+}
+
+ChunkPtr BlockRandomizer::GetChunkFromDeserializer(ChunkIdType chunkId)
+{
+    std::unique_lock<std::mutex> lock(m_deserializerLock, std::defer_lock);
+    if (!m_concurrentGetChunk)
+    {
+        lock.lock();
+    }
+
+    ReaderStageTimer timer(ReaderStage::deserialize);
+    return m_deserializer->GetChunk(chunkId);
 }
 
 }}}
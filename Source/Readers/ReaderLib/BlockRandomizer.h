@@ -11,7 +11,13 @@
 #include "DataDeserializer.h"
 #include "ChunkRandomizer.h"
 #include "SequenceRandomizer.h"
-#include <future>
+#include "WorkerThreadPool.h"
+#include "ReaderStatistics.h"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -31,15 +37,22 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 //
 // This class is responsible for decimation and loading the data chunks in to memory.
 // Actual randomization happens in ChunkRandomizer and SequenceRandomizer.
+// With prefetch, the next 'prefetchDepth' chunks after the current window (in randomized order) are loaded ahead of
+// time by as many I/O threads of the randomizer, at the same time if the deserializer supports concurrent GetChunk()
+// calls, and one after another otherwise.
 // TODO: The behavior can be simplified by only randomizing sequences forward.
 class BlockRandomizer : public SequenceEnumerator
 {
 public:
     // Currently, decimation based on sequences or chunks is supported.
+    // With balancedSequence, the sequences of each minibatch are dealt out so that the sums of the padded sequence
+    // lengths of the workers are about the same, instead of the numbers of sequences; like sequence, it loads the
+    // chunks of the own sequences only.
     enum class DecimationMode
     {
         chunk,
-        sequence
+        sequence,
+        balancedSequence
     };
 
     BlockRandomizer(
@@ -49,7 +62,8 @@ public:
         bool shouldPrefetch,
         DecimationMode decimationMode = DecimationMode::chunk,
         bool useLegacyRandomization = false,
-        bool multithreadedGetNextSequences = false);
+        bool multithreadedGetNextSequences = false,
+        size_t prefetchDepth = 1);
 
     // Starts a new epoch.
     virtual void StartEpoch(const EpochConfiguration& config) override;
@@ -63,33 +77,62 @@ public:
         return m_deserializer->GetStreamDescriptions();
     }
 
-    ~BlockRandomizer()
+    // Retrieves the sequences of a minibatch on the given pool instead of in OpenMP parallel loops
+    // (only if multithreadedGetNextSequences is set).
+    void SetWorkerThreadPool(const WorkerThreadPoolPtr& pool)
     {
-        if (m_prefetch.valid())
-        {
-            m_prefetch.wait();
-        }
+        m_workerThreadPool = pool;
+    }
+
+    // Waits for the prefetches in flight, which use the deserializer.
+    ~BlockRandomizer();
+
+    // Counters of the chunk loads, cumulative over the lifetime of the randomizer.
+    struct PrefetchStatistics
+    {
+        size_t m_numPrefetchedChunks; // chunks taken from a prefetch
+        size_t m_numBlockedWaits;     // prefetched chunks that were not loaded yet when needed
+        size_t m_numSynchronousLoads; // chunks that were not prefetched at all
+        double m_blockedSeconds;      // time GetNextSequences() spent waiting for chunks in the two cases above
+    };
+
+    const PrefetchStatistics& GetPrefetchStatistics() const
+    {
+        return m_prefetchStatistics;
     }
 
 private:
     // Load data for chunks if needed.
-    void LoadDataChunks(const ClosedOpenChunkInterval& windowRange);
+    void LoadDataChunks(const ClosedOpenChunkInterval& windowRange, const std::vector<RandomizedSequenceDescription>& decimated);
 
     // Get next sequence descriptions that do not exceed sample count.
     // Returns true if epoch end is reached.
     bool GetNextSequenceDescriptions(size_t sampleCount, std::vector<RandomizedSequenceDescription>& result, ClosedOpenChunkInterval& windowRange);
 
-    // Decimates sequence descriptions and loads chunks of data.
-    void Decimate(const std::vector<RandomizedSequenceDescription>& all, std::vector<RandomizedSequenceDescription>& decimated);
+    // Removes the sequence descriptions of other workers, without copying the ones that stay.
+    void Decimate(std::vector<RandomizedSequenceDescription>& sequences);
+
+    // Whether the chunk belongs to this worker with decimation by chunks.
+    bool IsChunkOfWorker(const RandomizedChunk& chunk) const;
 
     // Prepares a new sweep if needed.
     void PrepareNewSweepIfNeeded(size_t samplePosition);
 
-    // Performs io prefetch of the specified chunk if needed.
-    void Prefetch(ChunkIdType chunkId);
+    // Performs io prefetch of the specified chunks if needed, dropping other outstanding prefetches.
+    void Prefetch(const std::vector<ChunkIdType>& chunkIds);
+
+    // Returns the next candidates for the prefetch after the given range, at most m_prefetchDepth of them.
+    std::vector<ChunkIdType> GetChunksToPrefetch(const ClosedOpenChunkInterval& windowRange);
+
+    // Retrieves a chunk from the deserializer, one call at a time if it does not support concurrent calls.
+    ChunkPtr GetChunkFromDeserializer(ChunkIdType chunkId);
+
+    // The loop of an I/O thread, which runs the queued prefetches.
+    void RunPrefetches();
 
-    // Returns next candidate for the prefetch in the given range.
-    ChunkIdType GetChunkToPrefetch(const ClosedOpenChunkInterval& windowRange);
+    // Takes the chunk of a prefetch, if there is one, loading it on the calling thread if no I/O thread has started it yet.
+    // Sets 'blocked' if the chunk was not loaded yet.
+    bool TakePrefetch(ChunkIdType chunkId, ChunkPtr& chunk, bool& blocked);
 
     // Global sample position on the timeline.
     size_t m_globalSamplePosition;
@@ -132,6 +175,7 @@ private:
     // Whether to get sequences using multiple thread.
     // TODO temporary; should go away when transformers are moved closer to the deserializer
     bool m_multithreadedGetNextSequences;
+    WorkerThreadPoolPtr m_workerThreadPool;
 
     // General configuration
     // TODO generalize those for ReaderLib / Reader / CNTK
@@ -145,12 +189,34 @@ private:
 
     int m_verbosity;
 
-    // Prefetch future.
-    std::future<ChunkPtr> m_prefetch;
-    // Whether to have async or deferred prefetch.
-    launch m_launchType;
-    // Prefetched original chunk id.
-    ChunkIdType m_prefetchedChunk;
+    struct PrefetchedChunk
+    {
+        ReaderStatisticsCollector* m_statistics; // of the reader that requested the prefetch
+        bool m_started;
+        bool m_done;
+        bool m_dropped; // no longer needed, dropped by the I/O thread once done
+        ChunkPtr m_chunk;
+        std::exception_ptr m_error;
+    };
+
+    // Outstanding prefetches by original chunk id: queued, in flight, or done and not taken yet.
+    std::map<ChunkIdType, std::shared_ptr<PrefetchedChunk>> m_prefetches;
+    // Ids of the prefetches that are not started yet, in the order they are needed.
+    std::deque<ChunkIdType> m_prefetchQueue;
+    // Guards the prefetches and the queue; signals new prefetches to the I/O threads, and prefetches done to the others.
+    std::mutex m_prefetchLock;
+    std::condition_variable m_prefetchQueued;
+    std::condition_variable m_prefetchDone;
+    bool m_stopPrefetches;
+    // The I/O threads, none if the prefetches are deferred (i.e. loaded only when needed).
+    std::vector<std::thread> m_ioThreads;
+    // Maximum number of outstanding prefetches.
+    size_t m_prefetchDepth;
+    // Serializes the calls into the deserializer if it does not support concurrent calls.
+    std::mutex m_deserializerLock;
+    bool m_concurrentGetChunk;
+
+    PrefetchStatistics m_prefetchStatistics;
 
     // Current loaded chunks.
     ClosedOpenChunkInterval m_currentWindowRange;
@@ -0,0 +1,107 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <algorithm>
+#include <numeric>
+#include "BucketingSequenceEnumerator.h"
+#include "RandomOrdering.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+BucketingSequenceEnumerator::BucketingSequenceEnumerator(SequenceEnumeratorPtr sequenceProvider, size_t lookahead)
+    : m_sequenceProvider(sequenceProvider),
+      m_lookahead(lookahead),
+      m_endOfEpoch(false)
+{
+    assert(m_sequenceProvider != nullptr);
+    if (m_lookahead == 0)
+        InvalidArgument("BucketingSequenceEnumerator: The lookahead must be at least one sequence.");
+}
+
+void BucketingSequenceEnumerator::StartEpoch(const EpochConfiguration& config)
+{
+    m_sequenceProvider->StartEpoch(config);
+    m_minibatches.clear();
+    m_endOfEpoch = false;
+
+    // The same order of minibatches for the same epoch.
+    m_rng.seed((unsigned long)config.m_epochIndex);
+}
+
+Sequences BucketingSequenceEnumerator::GetNextSequences(size_t sampleCount)
+{
+    if (m_minibatches.empty())
+        FillBuckets(sampleCount);
+
+    if (m_minibatches.empty())
+    {
+        Sequences result;
+        result.m_endOfEpoch = true;
+        return result;
+    }
+
+    Sequences result = std::move(m_minibatches.front());
+    m_minibatches.pop_front();
+    result.m_endOfEpoch = m_endOfEpoch && m_minibatches.empty();
+    return result;
+}
+
+void BucketingSequenceEnumerator::FillBuckets(size_t sampleCount)
+{
+    // Sequences ahead, per stream.
+    std::vector<std::vector<SequenceDataPtr>> sequences;
+    while (!m_endOfEpoch && (sequences.empty() || sequences.front().size() < m_lookahead))
+    {
+        Sequences next = m_sequenceProvider->GetNextSequences(sampleCount);
+        m_endOfEpoch = next.m_endOfEpoch;
+        if (next.m_data.empty() || next.m_data.front().empty())
+            break;
+
+        if (sequences.empty())
+            sequences.resize(next.m_data.size());
+        for (size_t stream = 0; stream < next.m_data.size(); ++stream)
+            sequences[stream].insert(sequences[stream].end(), next.m_data[stream].begin(), next.m_data[stream].end());
+    }
+
+    if (sequences.empty())
+        return;
+
+    // The length of a sequence is the one of its longest stream, as for the randomizers.
+    const size_t numberOfSequences = sequences.front().size();
+    std::vector<size_t> lengths(numberOfSequences, 0);
+    for (const auto& stream : sequences)
+        for (size_t i = 0; i < numberOfSequences; ++i)
+            lengths[i] = std::max(lengths[i], (size_t)stream[i]->m_numberOfSamples);
+
+    std::vector<size_t> order(numberOfSequences);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&lengths](size_t a, size_t b) { return lengths[a] < lengths[b]; });
+
+    // Cutting the sorted sequences into minibatches, each gets at least one sequence.
+    std::vector<Sequences> minibatches;
+    size_t minibatchSamples = 0;
+    for (size_t index : order)
+    {
+        if (minibatches.empty() || (minibatchSamples > 0 && minibatchSamples + lengths[index] > sampleCount))
+        {
+            minibatches.push_back(Sequences());
+            minibatches.back().m_data.resize(sequences.size());
+            minibatchSamples = 0;
+        }
+
+        auto& minibatch = minibatches.back();
+        for (size_t stream = 0; stream < sequences.size(); ++stream)
+            minibatch.m_data[stream].push_back(sequences[stream][index]);
+        minibatchSamples += lengths[index];
+    }
+
+    RandomShuffleMT(minibatches, m_rng);
+    for (auto& minibatch : minibatches)
+        m_minibatches.push_back(std::move(minibatch));
+}
+
+}}}
@@ -0,0 +1,50 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <deque>
+#include <random>
+#include "SequenceEnumerator.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// A sequence enumerator that groups sequences of similar length into the same minibatch, so that the packer
+// pads them less. It reads the given number of sequences ahead from another sequence enumerator (i.e. the randomizer),
+// sorts them by length and cuts them into minibatches, which are returned in random order.
+// Sequences of the same length keep the order in which they were delivered.
+// The sequences are held while the provider moves on, so sequences that point into the memory of their chunk
+// have to keep it alive through SequenceDataBase::m_chunk.
+class BucketingSequenceEnumerator : public SequenceEnumerator
+{
+public:
+    BucketingSequenceEnumerator(SequenceEnumeratorPtr sequenceProvider, size_t lookahead);
+
+    virtual std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
+    {
+        return m_sequenceProvider->GetStreamDescriptions();
+    }
+
+    virtual void StartEpoch(const EpochConfiguration& config) override;
+
+    virtual Sequences GetNextSequences(size_t sampleCount) override;
+
+private:
+    // Reads the next lookahead sequences and cuts them into minibatches of up to sampleCount samples.
+    void FillBuckets(size_t sampleCount);
+
+    SequenceEnumeratorPtr m_sequenceProvider;
+    size_t m_lookahead;
+
+    // Minibatches of the current lookahead, in the order they are returned.
+    std::deque<Sequences> m_minibatches;
+
+    // Whether the sequence provider has reached the end of the epoch.
+    bool m_endOfEpoch;
+
+    std::mt19937_64 m_rng;
+};
+
+}}}
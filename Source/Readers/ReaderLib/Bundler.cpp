@@ -7,7 +7,7 @@
 #include "Bundler.h"
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
-#include <set>
+#include <algorithm>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -16,16 +16,40 @@ struct Bundler::BundlerChunkDescription : public ChunkDescription
 {
     ChunkDescriptionPtr m_original;
 
-    // Sequences that are invalid in at least one deserializer.
-    std::set<size_t> m_invalid;
+    // Sequences that are invalid in at least one deserializer, sorted.
+    std::vector<size_t> m_invalid;
 };
 
+/*static*/ bool Bundler::IsInvalid(const BundlerChunkDescription& chunk, size_t sequenceIndex)
+{
+    return !chunk.m_invalid.empty() && std::binary_search(chunk.m_invalid.begin(), chunk.m_invalid.end(), sequenceIndex);
+}
+
+bool Bundler::GetAlignedSequences(size_t deserializerIndex, ChunkIdType chunkId, const std::vector<SequenceDescription>& primary,
+                                  std::vector<SequenceDescription>& result)
+{
+    if (!m_hasDriverChunks[deserializerIndex])
+        return false;
+
+    result.clear();
+    m_deserializers[deserializerIndex]->GetSequencesForChunk(chunkId, result);
+    if (result.size() != primary.size())
+        return false;
+
+    for (size_t i = 0; i < primary.size(); ++i)
+    {
+        if (result[i].m_key.m_sequence != primary[i].m_key.m_sequence || result[i].m_key.m_sample != primary[i].m_key.m_sample)
+            return false;
+    }
+    return true;
+}
+
 Bundler::Bundler(
     const ConfigParameters& readerConfig,
     IDataDeserializerPtr driver,
     std::vector<IDataDeserializerPtr> deserializers,
     bool cleanse)
-    : m_deserializers(deserializers), m_driver(driver)
+    : m_deserializers(deserializers), m_driver(driver), m_takePrimarySequenceLength(false)
 {
     m_verbosity = readerConfig(L"verbosity", 0);
 
@@ -61,9 +85,22 @@ void Bundler::CreateChunkDescriptions()
     }
 
     // Creating a table of weak chunks for non driving deserializers.
+    // Deserializers of the same corpus often have the same chunks as the driver (e.g. the features and labels of a
+    // corpus in the same format); their chunks are checked to hold the same sequences when they are needed, and
+    // the sequences are joined by position.
+    m_hasDriverChunks.assign(m_deserializers.size(), false);
     for (size_t i = 0; i < m_deserializers.size(); ++i)
     {
-        m_weakChunkTable.push_back(std::vector<std::weak_ptr<Chunk>>(m_deserializers[i]->GetChunkDescriptions().size()));
+        auto deserializerChunks = m_deserializers[i]->GetChunkDescriptions();
+        m_weakChunkTable.push_back(std::vector<std::weak_ptr<Chunk>>(deserializerChunks.size()));
+
+        bool hasDriverChunks = i > 0 && deserializerChunks.size() == chunks.size();
+        for (size_t c = 0; hasDriverChunks && c < chunks.size(); ++c)
+        {
+            hasDriverChunks = deserializerChunks[c]->m_id == chunks[c]->m_id &&
+                              deserializerChunks[c]->m_numberOfSequences == chunks[c]->m_numberOfSequences;
+        }
+        m_hasDriverChunks[i] = hasDriverChunks;
     }
 
     m_chunks.reserve(chunks.size());
@@ -94,6 +131,8 @@ void Bundler::CreateChunkDescriptions()
     // Otherwise build bundling chunks using underlying deserializers.
     std::vector<SequenceDescription> sequenceDescriptions;
     sequenceDescriptions.reserve(chunks.front()->m_numberOfSequences);
+    std::vector<std::vector<SequenceDescription>> alignedSequences(m_deserializers.size());
+    std::vector<bool> isAligned(m_deserializers.size(), false);
     SequenceDescription s;
     for (ChunkIdType chunkIndex = 0; chunkIndex < chunks.size(); ++chunkIndex)
     {
@@ -103,7 +142,10 @@ void Bundler::CreateChunkDescriptions()
 
         // Iterating thru all sequences and identifying whether they are valid among all deserializers.
         m_driver->GetSequencesForChunk(chunks[chunkIndex]->m_id, sequenceDescriptions);
-        std::set<size_t> invalid;
+        for (size_t deserializerIndex = 1; deserializerIndex < m_deserializers.size(); ++deserializerIndex)
+            isAligned[deserializerIndex] = GetAlignedSequences(deserializerIndex, chunks[chunkIndex]->m_id, sequenceDescriptions, alignedSequences[deserializerIndex]);
+
+        std::vector<size_t> invalid;
         for (size_t sequenceIndex = 0; sequenceIndex < sequenceDescriptions.size(); ++sequenceIndex)
         {
             auto sequence = sequenceDescriptions[sequenceIndex];
@@ -111,10 +153,13 @@ void Bundler::CreateChunkDescriptions()
             size_t sequenceSamples = sequence.m_numberOfSamples;
             for (size_t deserializerIndex = 1; deserializerIndex < m_deserializers.size(); ++deserializerIndex)
             {
-                isValid = m_deserializers[deserializerIndex]->GetSequenceDescription(sequenceDescriptions[sequenceIndex], s);
+                if (isAligned[deserializerIndex])
+                    s = alignedSequences[deserializerIndex][sequenceIndex];
+                else
+                    isValid = m_deserializers[deserializerIndex]->GetSequenceDescription(sequenceDescriptions[sequenceIndex], s);
                 if (!isValid)
                 {
-                    invalid.insert(sequenceIndex);
+                    invalid.push_back(sequenceIndex);
                     break;
                 }
 
@@ -169,7 +214,7 @@ void Bundler::GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDesc
         result.reserve(sequences.size());
         for (size_t sequenceIndex = 0; sequenceIndex < sequences.size(); ++sequenceIndex)
         {
-            if (chunk->m_invalid.find(sequenceIndex) != chunk->m_invalid.end())
+            if (IsInvalid(*chunk, sequenceIndex))
             {
                 continue;
             }
@@ -182,10 +227,15 @@ void Bundler::GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDesc
          // TODO: This will change when the sequence length will be exposed per stream.
     {
         result.reserve(sequences.size());
+        std::vector<std::vector<SequenceDescription>> alignedSequences(m_deserializers.size());
+        std::vector<bool> isAligned(m_deserializers.size(), false);
+        for (size_t deserializerIndex = 1; deserializerIndex < m_deserializers.size(); ++deserializerIndex)
+            isAligned[deserializerIndex] = GetAlignedSequences(deserializerIndex, original->m_id, sequences, alignedSequences[deserializerIndex]);
+
         SequenceDescription s;
         for (size_t sequenceIndex = 0; sequenceIndex < sequences.size(); ++sequenceIndex)
         {
-            if (chunk->m_invalid.find(sequenceIndex) != chunk->m_invalid.end())
+            if (IsInvalid(*chunk, sequenceIndex))
             {
                 continue;
             }
@@ -194,7 +244,10 @@ void Bundler::GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDesc
             uint32_t sequenceSamples = sequence.m_numberOfSamples;
             for (size_t deserializerIndex = 1; deserializerIndex < m_deserializers.size(); ++deserializerIndex)
             {
-                m_deserializers[deserializerIndex]->GetSequenceDescription(sequence, s);
+                if (isAligned[deserializerIndex])
+                    s = alignedSequences[deserializerIndex][sequenceIndex];
+                else
+                    m_deserializers[deserializerIndex]->GetSequenceDescription(sequence, s);
                 sequenceSamples = std::max(sequenceSamples, s.m_numberOfSamples);
             }
             sequence.m_numberOfSamples = sequenceSamples;
@@ -241,7 +294,7 @@ public:
         m_innerChunks.resize(deserializers.size() * sequences.size());
         for (size_t sequenceIndex = 0; sequenceIndex < sequences.size(); ++sequenceIndex)
         {
-            if (chunk->m_invalid.find(sequenceIndex) != chunk->m_invalid.end())
+            if (IsInvalid(*chunk, sequenceIndex))
             {
                 continue;
             }
@@ -253,20 +306,26 @@ public:
 
         // Creating sequence mapping and requiring underlying chunks.
         SequenceDescription s;
+        std::vector<SequenceDescription> alignedSequences;
         for (size_t deserializerIndex = 1; deserializerIndex < deserializers.size(); ++deserializerIndex)
         {
             auto& chunkTable = m_parent->m_weakChunkTable[deserializerIndex];
+            bool isAligned = m_parent->GetAlignedSequences(deserializerIndex, original->m_id, sequences, alignedSequences);
             for (size_t sequenceIndex = 0; sequenceIndex < sequences.size(); ++sequenceIndex)
             {
-                if (chunk->m_invalid.find(sequenceIndex) != chunk->m_invalid.end())
+                if (IsInvalid(*chunk, sequenceIndex))
                 {
                     continue;
                 }
 
                 size_t currentIndex = sequenceIndex * deserializers.size() + deserializerIndex;
-                deserializers[deserializerIndex]->GetSequenceDescription(sequences[sequenceIndex], s);
+                if (isAligned)
+                    s = alignedSequences[sequenceIndex];
+                else
+                    deserializers[deserializerIndex]->GetSequenceDescription(sequences[sequenceIndex], s);
                 m_sequenceToSequence[currentIndex] = s.m_id;
 
+                std::lock_guard<std::mutex> lock(m_parent->m_weakChunkTableLock);
                 ChunkPtr secondaryChunk = chunkTable[s.m_chunkId].lock();
                 if (!secondaryChunk)
                 {
@@ -298,4 +357,9 @@ ChunkPtr Bundler::GetChunk(ChunkIdType chunkId)
     return std::make_shared<BundlingChunk>(m_streams.size(), this, chunkId);
 }
 
+bool Bundler::SupportsConcurrentGetChunk() const
+{
+    return std::all_of(m_deserializers.begin(), m_deserializers.end(), [](const IDataDeserializerPtr& d) { return d->SupportsConcurrentGetChunk(); });
+}
+
 }}}
@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <mutex>
 #include "DataDeserializer.h"
 #include "DataDeserializerBase.h"
 #include "Config.h"
@@ -28,6 +29,9 @@ public:
     // Gets a chunk with data.
     virtual ChunkPtr GetChunk(ChunkIdType chunkId) override;
 
+    // If all the deserializers support it.
+    virtual bool SupportsConcurrentGetChunk() const override;
+
 private:
     DISABLE_COPY_AND_MOVE(Bundler);
 
@@ -38,6 +42,15 @@ private:
     // Creates chunk descriptions based on chunks of underlying deserializers.
     void CreateChunkDescriptions();
 
+    // Gets the sequences of a chunk of a non driving deserializer that has the chunks of the driver, if they are the
+    // driver's sequences of the chunk in the same order. The sequences are then joined by their position in the chunk,
+    // without looking up their keys.
+    bool GetAlignedSequences(size_t deserializerIndex, ChunkIdType chunkId, const std::vector<SequenceDescription>& primary,
+                             std::vector<SequenceDescription>& result);
+
+    // Whether the sequence of a chunk description is invalid in one of the deserializers.
+    static bool IsInvalid(const BundlerChunkDescription& chunk, size_t sequenceIndex);
+
     // Underlying deserializers.
     std::vector<IDataDeserializerPtr> m_deserializers;
 
@@ -47,6 +60,9 @@ private:
     // Chunk descriptions.
     std::vector<BundlerChunkDescriptionPtr> m_chunks;
 
+    // Per deserializer, whether it declares the chunks of the driver: the same ids with the same numbers of sequences.
+    std::vector<bool> m_hasDriverChunks;
+
     // A flag that indicates whether there is a need to clean data between different deserializers.
     // It is possible that some sequence is valid in one deserializer but invalid in another. This sequences should be removed.
     // At the same time this introduces unnecessary overhead when the data is clean, because all chunks should be checked in advance to expose
@@ -62,6 +78,8 @@ private:
     // A table of loaded chunks to make sure we do not load same chunk twice.
     // Inner vector is the table of chunk id into weak pointer, the outer vector has an element per deserializer.
     std::vector<std::vector<std::weak_ptr<Chunk>>> m_weakChunkTable;
+    // Guards the table, and is held while a chunk of it is loaded, since the chunks of the driver share them.
+    std::mutex m_weakChunkTableLock;
 
     // General configuration
     int m_verbosity;
@@ -0,0 +1,214 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <Windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "Basics.h"
+#include "fileutil.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Helpers for the files in which readers cache what they derive from their input files
+// (indices, parsed labels), so that later runs do not have to read the input again.
+
+// Returns the modification time of a file, in platform-specific units.
+inline uint64_t GetModificationTime(const std::wstring& path)
+{
+#ifdef _WIN32
+    FILETIME time;
+    if (!getfiletime(path, time))
+        RuntimeError("Could not determine the modification time of the input file (%ls).", path.c_str());
+    return ((uint64_t) time.dwHighDateTime << 32) | time.dwLowDateTime;
+#else
+    struct stat buf;
+    if (stat(wtocharpath(path).c_str(), &buf) != 0)
+        RuntimeError("Could not determine the modification time of the input file (%ls).", path.c_str());
+    return (uint64_t) buf.st_mtim.tv_sec * 1000000000 + buf.st_mtim.tv_nsec;
+#endif
+}
+
+// The lock file that marks the cache as being built. The lock is held through an open file, locked with fcntl()
+// on Linux (as in CrossProcessMutex) and opened without sharing on Windows, so the system releases it if the
+// process dies while building the cache; a lock file left behind does not hold up later runs.
+class CacheLockFile
+{
+public:
+    explicit CacheLockFile(const std::wstring& path)
+        : m_path(path),
+#ifdef _WIN32
+          m_handle(INVALID_HANDLE_VALUE)
+#else
+          m_fd(-1)
+#endif
+    {
+    }
+
+    // Takes the lock if no other process holds it. Returns false otherwise, with 'busy' telling whether another
+    // process holds it or it could not be taken at all (e.g. in a read-only directory).
+    bool TryAcquire(bool& busy)
+    {
+#ifdef _WIN32
+        m_handle = CreateFileW(m_path.c_str(), GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+        busy = m_handle == INVALID_HANDLE_VALUE && GetLastError() == ERROR_SHARING_VIOLATION;
+        return m_handle != INVALID_HANDLE_VALUE;
+#else
+        const std::string path = wtocharpath(m_path);
+        for (;;)
+        {
+            busy = false;
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+            if (fd == -1)
+                return false;
+
+            struct flock lock = {};
+            lock.l_type = F_WRLCK;
+            lock.l_whence = SEEK_SET;
+            if (fcntl(fd, F_SETLK, &lock) != 0)
+            {
+                busy = errno == EACCES || errno == EAGAIN;
+                close(fd);
+                return false;
+            }
+
+            // The previous holder removes the file before it releases the lock; the lock is then on a file
+            // that is gone, and has to be taken on the new one.
+            struct stat opened, current;
+            if (fstat(fd, &opened) != 0 || stat(path.c_str(), &current) != 0 || opened.st_ino != current.st_ino)
+            {
+                close(fd);
+                continue;
+            }
+
+            m_fd = fd;
+            return true;
+        }
+#endif
+    }
+
+    ~CacheLockFile()
+    {
+#ifdef _WIN32
+        if (m_handle != INVALID_HANDLE_VALUE)
+            CloseHandle(m_handle); // deletes the file
+#else
+        if (m_fd != -1)
+        {
+            unlink(wtocharpath(m_path).c_str());
+            close(m_fd);
+        }
+#endif
+    }
+
+private:
+    DISABLE_COPY_AND_MOVE(CacheLockFile);
+
+    std::wstring m_path;
+#ifdef _WIN32
+    HANDLE m_handle;
+#else
+    int m_fd;
+#endif
+};
+
+// Writes the cache file 'cacheFilePath' with write(). The file is written under a temporary name and only renamed once
+// complete, so that a cache file of the expected name is always complete. 'what' names the cache in the warning if it
+// cannot be renamed, which only means that later runs have to derive its data again; errors of write() are passed on.
+inline void WriteCacheAtomically(const std::wstring& cacheFilePath, const wchar_t* what, const std::function<void(FILE*)>& write)
+{
+    const auto temporaryFilePath = cacheFilePath + L".tmp";
+
+    FILE* file = fopenOrDie(temporaryFilePath, L"wb");
+    auto cleanup = MakeScopeExit([&]()
+    {
+        if (file != nullptr)
+        {
+            fclose(file);
+            _wunlink(temporaryFilePath.c_str());
+        }
+    });
+    setvbuf(file, nullptr, _IOFBF, 1024 * 1024);
+
+    write(file);
+    fcloseOrDie(file);
+    file = nullptr;
+
+    try
+    {
+        renameOrDie(temporaryFilePath, cacheFilePath);
+    }
+    catch (const std::exception& e)
+    {
+        fprintf(stderr, "WARNING: Could not write the %ls cache (%ls): %s\n", what, cacheFilePath.c_str(), e.what());
+        _wunlink(temporaryFilePath.c_str());
+    }
+}
+
+// Loads the cache file 'cacheFilePath' with tryLoad(), which returns false if the cache is missing or outdated.
+// In that case the process that manages to lock the file <cacheFilePath>.lock builds the cache with build(),
+// while the others wait and then load it. If the lock cannot be taken (e.g. in a read-only directory) or the
+// wait takes more than three hours, buildWithoutCache() is called instead.
+// build() is expected to write the cache with WriteCacheAtomically().
+inline void LoadOrBuildCache(const std::wstring& cacheFilePath, const wchar_t* what,
+                             const std::function<bool()>& tryLoad,
+                             const std::function<void()>& build,
+                             const std::function<void()>& buildWithoutCache)
+{
+    static const std::chrono::seconds maxWait(3 * 60 * 60);
+
+    const auto lockFilePath = cacheFilePath + L".lock";
+    const auto deadline = std::chrono::steady_clock::now() + maxWait;
+    bool waiting = false;
+    for (;;)
+    {
+        if (tryLoad())
+        {
+            return;
+        }
+
+        CacheLockFile lock(lockFilePath);
+        bool busy;
+        if (lock.TryAcquire(busy))
+        {
+            // the cache may have been completed between the attempt to load it and taking the lock
+            if (!tryLoad())
+            {
+                build();
+            }
+            return;
+        }
+
+        if (!busy || std::chrono::steady_clock::now() > deadline)
+        {
+            // e.g. the directory of the cache is read-only, or the process holding the lock is stuck
+            fprintf(stderr, "WARNING: Could not use the cache file (%ls), building the %ls without it.\n", cacheFilePath.c_str(), what);
+            buildWithoutCache();
+            return;
+        }
+
+        if (!waiting)
+        {
+            fprintf(stderr, "Waiting for another process to build the %ls in the cache file (%ls).\n", what, cacheFilePath.c_str());
+            waiting = true;
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+}
+
+}}}
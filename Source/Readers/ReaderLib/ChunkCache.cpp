@@ -5,22 +5,169 @@
 
 #define _CRT_SECURE_NO_WARNINGS
 
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
 #include "ChunkCache.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+ChunkCache::ChunkCache(IDataDeserializerPtr deserializer, size_t maxSizeInBytes, int verbosity)
+    : m_deserializer(deserializer),
+      m_maxSizeInBytes(maxSizeInBytes),
+      m_verbosity(verbosity),
+      m_statistics(),
+      m_warnedAboutSize(false),
+      m_sampleSizeInBytes(0)
+{
+}
+
+ChunkCache::~ChunkCache()
+{
+    if (m_verbosity >= 1)
+        fprintf(stderr, "ChunkCache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " chunks (%" PRIu64 " bytes) evicted, %" PRIu64 " bytes in use\n",
+                m_statistics.m_numHits,
+                m_statistics.m_numMisses,
+                m_statistics.m_numEvictions,
+                m_statistics.m_evictedBytes,
+                m_statistics.m_sizeInBytes);
+}
+
+std::shared_ptr<ChunkCache> ChunkCache::GetShared(const std::string& name, IDataDeserializerPtr deserializer, size_t maxSizeInBytes, int verbosity)
+{
+    static std::mutex sharedLock;
+    static std::map<std::string, std::weak_ptr<ChunkCache>> sharedCaches;
+    std::unique_lock<std::mutex> lock(sharedLock);
+    auto cache = sharedCaches[name].lock();
+    if (cache)
+    {
+        if (verbosity >= 1)
+            fprintf(stderr, "ChunkCache: sharing the chunks of '%s' with the other readers of the process\n", name.c_str());
+        return cache;
+    }
+
+    cache = std::make_shared<ChunkCache>(deserializer, maxSizeInBytes, verbosity);
+    sharedCaches[name] = cache;
+    return cache;
+}
+
 ChunkPtr ChunkCache::GetChunk(ChunkIdType chunkId)
 {
-    auto it = m_chunkMap.find(chunkId);
-    if (it != m_chunkMap.end())
+    std::unique_lock<std::mutex> lock(m_lock);
+    for (;;)
+    {
+        auto it = m_chunkMap.find(chunkId);
+        if (it != m_chunkMap.end())
+        {
+            m_statistics.m_numHits++;
+            m_lru.splice(m_lru.begin(), m_lru, it->second.m_lruPosition);
+            return it->second.m_chunk;
+        }
+
+        // Another reader is loading the chunk.
+        if (m_loading.find(chunkId) == m_loading.end())
+            break;
+        m_loaded.wait(lock);
+    }
+
+    m_statistics.m_numMisses++;
+    m_loading.insert(chunkId);
+    ChunkPtr chunk;
+    try
     {
-        return it->second;
+        lock.unlock();
+        if (m_deserializer->SupportsConcurrentGetChunk())
+        {
+            chunk = m_deserializer->GetChunk(chunkId);
+        }
+        else
+        {
+            std::unique_lock<std::mutex> loadLock(m_loadLock);
+            chunk = m_deserializer->GetChunk(chunkId);
+        }
+        lock.lock();
     }
- 
-    ChunkPtr chunk = m_deserializer->GetChunk(chunkId);
-    m_chunkMap[chunkId] = chunk;
- 
+    catch (...)
+    {
+        if (!lock.owns_lock())
+            lock.lock();
+        m_loading.erase(chunkId);
+        m_loaded.notify_all();
+        throw;
+    }
+    m_loading.erase(chunkId);
+    m_loaded.notify_all();
+
+    CacheEntry& entry = m_chunkMap[chunkId];
+    entry.m_chunk = chunk;
+    entry.m_sizeInBytes = GetChunkSize(chunkId, chunk);
+    entry.m_lruPosition = m_lru.insert(m_lru.begin(), chunkId);
+    m_statistics.m_sizeInBytes += entry.m_sizeInBytes;
+
+    EvictIfNeeded();
     return chunk;
 }
 
+size_t ChunkCache::GetChunkSize(ChunkIdType chunkId, const ChunkPtr& chunk)
+{
+    size_t size = chunk->GetMemorySize();
+    if (size != 0 || m_maxSizeInBytes == SIZE_MAX)
+    {
+        return size;
+    }
+
+    if (m_numberOfSamples.empty())
+    {
+        for (const auto& description : m_deserializer->GetChunkDescriptions())
+        {
+            if (m_numberOfSamples.size() <= description->m_id)
+                m_numberOfSamples.resize(description->m_id + 1, 0);
+            m_numberOfSamples[description->m_id] = description->m_numberOfSamples;
+        }
+
+        // as if all streams were dense, which overestimates sparse ones
+        for (const auto& stream : m_deserializer->GetStreamDescriptions())
+        {
+            size_t elementSize = (stream->m_elementType == ElementType::tdouble) ? sizeof(double) :
+                                 (stream->m_elementType == ElementType::tuchar) ? sizeof(unsigned char) : sizeof(float);
+            if (stream->m_sampleLayout)
+                m_sampleSizeInBytes += stream->m_sampleLayout->GetNumElements() * elementSize;
+        }
+    }
+
+    return (chunkId < m_numberOfSamples.size()) ? m_numberOfSamples[chunkId] * m_sampleSizeInBytes : 0;
+}
+
+void ChunkCache::EvictIfNeeded()
+{
+    // The most recently used chunk, which was just added, is never evicted.
+    auto candidate = m_lru.end();
+    while (m_statistics.m_sizeInBytes > m_maxSizeInBytes && candidate != std::next(m_lru.begin()))
+    {
+        --candidate;
+        auto it = m_chunkMap.find(*candidate);
+        assert(it != m_chunkMap.end());
+
+        // A chunk that is referenced elsewhere stays in memory anyway.
+        if (it->second.m_chunk.use_count() > 1)
+            continue;
+
+        if (m_verbosity >= 2)
+            fprintf(stderr, "ChunkCache: evicting chunk %u (%" PRIu64 " bytes)\n", *candidate, it->second.m_sizeInBytes);
+
+        m_statistics.m_numEvictions++;
+        m_statistics.m_evictedBytes += it->second.m_sizeInBytes;
+        m_statistics.m_sizeInBytes -= it->second.m_sizeInBytes;
+        m_chunkMap.erase(it);
+        candidate = m_lru.erase(candidate);
+    }
+
+    if (m_statistics.m_sizeInBytes > m_maxSizeInBytes && m_verbosity >= 1 && !m_warnedAboutSize)
+    {
+        m_warnedAboutSize = true;
+        fprintf(stderr, "ChunkCache: WARNING: the chunks in use take %" PRIu64 " bytes, more than the cache size of %" PRIu64 " bytes\n",
+                m_statistics.m_sizeInBytes,
+                m_maxSizeInBytes);
+    }
+}
+
 } } }
@@ -5,22 +5,44 @@
 
 #pragma once
 
+#include <condition_variable>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
 #include "DataDeserializer.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
-// A cache to store the complete dataset (all chunks) in memory. The caching can
-// be switched on/off by a boolean flag in the reader config section, independent 
-// of the randomization and chunking parameters. The caching should only be enabled 
+// A cache to store the dataset (all chunks, or as many as fit into a memory budget) in memory.
+// The caching can be switched on/off by a boolean flag in the reader config section, independent
+// of the randomization and chunking parameters. Without a budget, the caching should only be enabled
 // when the whole dataset fits in memory.
 // Implemented as a wrapping proxy around a deserializer that stores pointers to
-// all chunks it sees in an internal map.
+// the chunks it sees in an internal map. With a budget, the least recently used chunks are evicted
+// once the cached chunks take more than the budget. Chunks that are still referenced outside of the cache
+// (e.g. by the randomization window) are never evicted, since that would not free any memory. The cache
+// is not reset between epochs, so the chunks used last in one epoch are still there for the next one.
+// The readers of a process that read the same data (e.g. those of several trainers that train in one process) can
+// share a cache through GetShared(), so that each chunk is loaded and kept once for all of them. GetChunk() is thread
+// safe; the chunks are used by the readers at the same time, as with multithreaded deserialization.
 class ChunkCache : public IDataDeserializer
 {
 public:
+    // Evicts chunks when the cached chunks take more than 'maxSizeInBytes'. With 'verbosity' >= 1,
+    // warns when the budget cannot be kept and reports the cache statistics at the end; with 'verbosity' >= 2,
+    // also reports each eviction.
+    ChunkCache(IDataDeserializerPtr deserializer, size_t maxSizeInBytes = SIZE_MAX, int verbosity = 0);
 
-    ChunkCache(IDataDeserializerPtr deserializer) : m_deserializer(deserializer) { }
+    ~ChunkCache();
+
+    // Returns the cache of the process with the given name, creating it around 'deserializer' if there is none; it is
+    // released once none of its readers hold it. The name has to identify the data set and the deserializer
+    // configuration, since a reader that gets an existing cache reads the chunks of the deserializer it was created with.
+    static std::shared_ptr<ChunkCache> GetShared(const std::string& name, IDataDeserializerPtr deserializer,
+                                                 size_t maxSizeInBytes = SIZE_MAX, int verbosity = 0);
 
     virtual std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
     {
@@ -45,10 +67,61 @@ public:
     // Gets chunk data given its id.
     virtual ChunkPtr GetChunk(ChunkIdType chunkId);
 
+    virtual bool SupportsConcurrentGetChunk() const override
+    {
+        return true;
+    }
+
+    struct Statistics
+    {
+        size_t m_numHits;
+        size_t m_numMisses;
+        size_t m_numEvictions;
+        size_t m_evictedBytes;
+        size_t m_sizeInBytes; // the size of the chunks currently cached
+    };
+
+    Statistics GetStatistics() const
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        return m_statistics;
+    }
+
 private:
+    struct CacheEntry
+    {
+        ChunkPtr m_chunk;
+        size_t m_sizeInBytes;
+        std::list<ChunkIdType>::iterator m_lruPosition;
+    };
+
+    // Returns the memory size of a chunk, estimated from the number of samples if the chunk does not know it.
+    size_t GetChunkSize(ChunkIdType chunkId, const ChunkPtr& chunk);
+
+    // Evicts least recently used chunks until the cache is within its budget (if possible).
+    void EvictIfNeeded();
+
+    // Guards all of the below; it is not held while a chunk is loaded, so that the other readers get the cached ones.
+    mutable std::mutex m_lock;
+    // Loads one chunk at a time if the deserializer does not support more.
+    std::mutex m_loadLock;
+    // Ids of the chunks that are being loaded, and the readers that wait for them.
+    std::set<ChunkIdType> m_loading;
+    std::condition_variable m_loaded;
+
     // A map of currently loaded chunks
-    std::map<size_t, ChunkPtr> m_chunkMap;
+    std::map<ChunkIdType, CacheEntry> m_chunkMap;
+    // Ids of the cached chunks, the most recently used first.
+    std::list<ChunkIdType> m_lru;
     IDataDeserializerPtr m_deserializer;
+    size_t m_maxSizeInBytes;
+    int m_verbosity;
+    Statistics m_statistics;
+    bool m_warnedAboutSize;
+
+    // For the size estimates: the number of samples of each chunk and the size of a sample, set up on first use.
+    std::vector<size_t> m_numberOfSamples;
+    size_t m_sampleSizeInBytes;
 
     DISABLE_COPY_AND_MOVE(ChunkCache);
 };
@@ -0,0 +1,212 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <map>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "ChunkImage.h"
+#include "BinarySequenceData.h"
+#include "ElementTypeUtils.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+using BinaryChunkFormat::AlignUp;
+
+static const uint64_t s_imageMagic = 0x4b4e484353544e43ULL; // "CNTSCHNK"
+static const uint32_t s_imageVersion = 1;
+
+uint64_t GetCurrentProcessId()
+{
+#ifdef _WIN32
+    return ::GetCurrentProcessId();
+#else
+    return (uint64_t)getpid();
+#endif
+}
+
+bool ReadChunkImageHeader(const char* data, size_t size, ChunkImageHeader& header)
+{
+    if (size < sizeof(header))
+        return false;
+    memcpy(&header, data, sizeof(header));
+    return header.m_magic == s_imageMagic && header.m_version == s_imageVersion && header.m_size <= size;
+}
+
+void ChunkImageChunk::Attach(const char* data, size_t size, size_t numberOfStreams, const std::string& name)
+{
+    m_name = name;
+    if (!ReadChunkImageHeader(data, size, m_header))
+        RuntimeError("ChunkImage: %s is not a complete chunk image.", m_name.c_str());
+    if (m_header.m_numberOfStreams != numberOfStreams)
+        RuntimeError("ChunkImage: %s has %u streams, expected %d.", m_name.c_str(), m_header.m_numberOfStreams, (int)numberOfStreams);
+
+    const uint64_t streamsOffset = sizeof(ChunkImageHeader);
+    const uint64_t idsOffset = streamsOffset + numberOfStreams * sizeof(ChunkImageStream);
+    const uint64_t headersOffset = idsOffset + m_header.m_numberOfSequences * sizeof(uint64_t);
+    if (headersOffset + m_header.m_numberOfSequences * numberOfStreams * sizeof(ChunkImageSequenceStream) > m_header.m_layoutsOffset ||
+        m_header.m_layoutsOffset > m_header.m_dataOffset || m_header.m_dataOffset > m_header.m_size)
+        RuntimeError("ChunkImage: %s is corrupt.", m_name.c_str());
+
+    m_streams = reinterpret_cast<const ChunkImageStream*>(data + streamsOffset);
+    m_headers = reinterpret_cast<const ChunkImageSequenceStream*>(data + headersOffset);
+    m_data = data + m_header.m_dataOffset;
+    m_dataSize = m_header.m_size - m_header.m_dataOffset;
+
+    const uint64_t* ids = reinterpret_cast<const uint64_t*>(data + idsOffset);
+    m_sequenceIndex.reserve(m_header.m_numberOfSequences);
+    for (uint64_t i = 0; i < m_header.m_numberOfSequences; ++i)
+        m_sequenceIndex[ids[i]] = i;
+
+    // Sequences of the same layout share it, as they do when they come from the deserializer.
+    const uint64_t* layouts = reinterpret_cast<const uint64_t*>(data + m_header.m_layoutsOffset);
+    const uint64_t numberOfLayoutValues = (m_header.m_dataOffset - m_header.m_layoutsOffset) / sizeof(uint64_t);
+    std::map<uint64_t, TensorShapePtr> shapes;
+    m_layouts.resize(m_header.m_numberOfSequences * numberOfStreams);
+    for (size_t i = 0; i < m_layouts.size(); ++i)
+    {
+        const uint64_t offset = m_headers[i].m_layoutOffset / sizeof(uint64_t);
+        auto& shape = shapes[offset];
+        if (!shape)
+        {
+            if (offset >= numberOfLayoutValues || layouts[offset] > numberOfLayoutValues - offset - 1)
+                RuntimeError("ChunkImage: %s is corrupt.", m_name.c_str());
+            shape = std::make_shared<TensorShape>(std::vector<size_t>(layouts + offset + 1, layouts + offset + 1 + layouts[offset]));
+        }
+        m_layouts[i] = shape;
+    }
+}
+
+void ChunkImageChunk::GetSequence(size_t sequenceId, std::vector<SequenceDataPtr>& result)
+{
+    auto index = m_sequenceIndex.find(sequenceId);
+    if (index == m_sequenceIndex.end())
+        LogicError("ChunkImage: Sequence %" PRIu64 " does not belong to the chunk.", (uint64_t)sequenceId);
+
+    for (size_t stream = 0; stream < m_header.m_numberOfStreams; ++stream)
+    {
+        const size_t i = index->second * m_header.m_numberOfStreams + stream;
+        const ChunkImageSequenceStream& header = m_headers[i];
+        const ElementType elementType = (ElementType)m_streams[stream].m_elementType;
+        SequenceDataPtr sequence = CreateSequenceView(m_data, m_dataSize, (StorageType)m_streams[stream].m_storageType,
+                                                      m_layouts[i]->GetNumElements(), GetSizeByType(elementType),
+                                                      header.m_dataOffset, header.m_numberOfSamples, header.m_nnzCount);
+        if (!sequence)
+            RuntimeError("ChunkImage: Sequence data beyond the end of %s.", m_name.c_str());
+
+        sequence->m_id = sequenceId;
+        sequence->m_elementType = elementType;
+        sequence->m_sampleLayout = m_layouts[i];
+        sequence->m_chunk = shared_from_this();
+        result.push_back(sequence);
+    }
+}
+
+bool WriteChunkImage(IDataDeserializer& deserializer, ChunkIdType chunkId, uint64_t processId,
+                     const std::function<char*(size_t)>& allocate)
+{
+    const auto descriptions = deserializer.GetStreamDescriptions();
+    std::vector<ChunkImageStream> streams(descriptions.size());
+    for (size_t i = 0; i < descriptions.size(); ++i)
+    {
+        if (descriptions[i]->m_storageType != StorageType::dense && descriptions[i]->m_storageType != StorageType::sparse_csc)
+            RuntimeError("ChunkImage: Stream '%ls' has an unsupported storage type.", descriptions[i]->m_name.c_str());
+        streams[i].m_storageType = (uint32_t)descriptions[i]->m_storageType;
+        streams[i].m_elementType = (uint32_t)descriptions[i]->m_elementType;
+    }
+
+    ChunkPtr chunk = deserializer.GetChunk(chunkId);
+    std::vector<SequenceDescription> sequences;
+    deserializer.GetSequencesForChunk(chunkId, sequences);
+
+    std::vector<uint64_t> ids;
+    std::vector<ChunkImageSequenceStream> headers;
+    std::vector<uint64_t> layouts;
+    std::map<const TensorShape*, uint64_t> layoutOffsets;
+    std::vector<char> data;
+    std::vector<SequenceDataPtr> sequenceData;
+    ids.reserve(sequences.size());
+    headers.reserve(sequences.size() * streams.size());
+    for (const auto& description : sequences)
+    {
+        sequenceData.clear();
+        chunk->GetSequence(description.m_id, sequenceData);
+        if (sequenceData.size() != streams.size())
+            LogicError("ChunkImage: Sequence %" PRIu64 " has data for %d streams, expected %d.", (uint64_t)description.m_id, (int)sequenceData.size(), (int)streams.size());
+        ids.push_back(description.m_id);
+
+        for (size_t i = 0; i < streams.size(); ++i)
+        {
+            SequenceDataBase& sequence = *sequenceData[i];
+
+            // The element type of a stream may only be known from its sequences.
+            if (streams[i].m_elementType == (uint32_t)ElementType::tvariant)
+                streams[i].m_elementType = (uint32_t)sequence.m_elementType;
+            if (streams[i].m_elementType != (uint32_t)ElementType::tfloat && streams[i].m_elementType != (uint32_t)ElementType::tdouble)
+                RuntimeError("ChunkImage: Stream '%ls' has neither float nor double elements.", descriptions[i]->m_name.c_str());
+
+            const TensorShapePtr& layout = sequence.m_sampleLayout ? sequence.m_sampleLayout : descriptions[i]->m_sampleLayout;
+            if (!layout)
+                RuntimeError("ChunkImage: Neither stream '%ls' nor its sequences have a sample layout.", descriptions[i]->m_name.c_str());
+            auto layoutOffset = layoutOffsets.find(layout.get());
+            if (layoutOffset == layoutOffsets.end())
+            {
+                layoutOffset = layoutOffsets.insert(std::make_pair(layout.get(), (uint64_t)(layouts.size() * sizeof(uint64_t)))).first;
+                layouts.push_back(layout->GetRank());
+                for (auto dimension : layout->GetDims())
+                    layouts.push_back(dimension);
+            }
+
+            ChunkImageSequenceStream header;
+            header.m_dataOffset = data.size();
+            header.m_layoutOffset = layoutOffset->second;
+            header.m_numberOfSamples = sequence.m_numberOfSamples;
+            if (!AppendSequenceData(data, (StorageType)streams[i].m_storageType, layout->GetNumElements(),
+                                    GetSizeByType((ElementType)streams[i].m_elementType), sequence, header.m_nnzCount))
+                LogicError("ChunkImage: Sequence %" PRIu64 " of stream '%ls' has non zero counts that do not match its samples or add up to its total.",
+                           (uint64_t)description.m_id, descriptions[i]->m_name.c_str());
+            headers.push_back(header);
+        }
+    }
+    // The sequences are copied, the chunk is no longer needed.
+    sequenceData.clear();
+    chunk.reset();
+
+    ChunkImageHeader header = {};
+    header.m_version = s_imageVersion;
+    header.m_numberOfStreams = (uint32_t)streams.size();
+    header.m_numberOfSequences = ids.size();
+    header.m_processId = processId;
+    const uint64_t streamsOffset = sizeof(ChunkImageHeader);
+    const uint64_t idsOffset = streamsOffset + streams.size() * sizeof(ChunkImageStream);
+    const uint64_t headersOffset = idsOffset + ids.size() * sizeof(uint64_t);
+    header.m_layoutsOffset = headersOffset + headers.size() * sizeof(ChunkImageSequenceStream);
+    header.m_dataOffset = AlignUp(header.m_layoutsOffset + layouts.size() * sizeof(uint64_t));
+    header.m_size = header.m_dataOffset + data.size();
+
+    char* target = allocate(header.m_size);
+    if (!target)
+        return false;
+
+    memcpy(target, &header, sizeof(header));
+    memcpy(target + streamsOffset, streams.data(), streams.size() * sizeof(ChunkImageStream));
+    memcpy(target + idsOffset, ids.data(), ids.size() * sizeof(uint64_t));
+    memcpy(target + headersOffset, headers.data(), headers.size() * sizeof(ChunkImageSequenceStream));
+    memcpy(target + header.m_layoutsOffset, layouts.data(), layouts.size() * sizeof(uint64_t));
+    memcpy(target + header.m_dataOffset, data.data(), data.size());
+
+    // Marks the image complete.
+    header.m_magic = s_imageMagic;
+    memcpy(target, &header.m_magic, sizeof(header.m_magic));
+    return true;
+}
+
+}}}
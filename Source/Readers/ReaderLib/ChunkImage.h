@@ -0,0 +1,92 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ChunkImage.h -- a chunk laid out in one block of memory, as in the segments of the SharedChunkStore and in the
+// files of the DiskChunkCache
+//
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "DataDeserializer.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// An image consists of
+//   ChunkImageHeader
+//   ChunkImageStream[m_numberOfStreams]
+//   the ids of the sequences (uint64_t each)
+//   ChunkImageSequenceStream[m_numberOfSequences * m_numberOfStreams], sequence-major
+//   the sample layouts at m_layoutsOffset: the rank followed by the dimensions (uint64_t each)
+//   the data of the sequences at m_dataOffset, laid out as by AppendSequenceData
+struct ChunkImageHeader
+{
+    uint64_t m_magic;          // written last, i.e. only set if the image is complete
+    uint32_t m_version;
+    uint32_t m_numberOfStreams;
+    uint64_t m_numberOfSequences;
+    uint64_t m_size;           // the memory of the image may be larger, e.g. rounded up to whole pages
+    uint64_t m_layoutsOffset;
+    uint64_t m_dataOffset;
+    uint64_t m_processId;      // of the process that wrote the image
+};
+static_assert(sizeof(ChunkImageHeader) == 56, "ChunkImageHeader must not have padding.");
+
+struct ChunkImageStream
+{
+    uint32_t m_storageType; // StorageType
+    uint32_t m_elementType; // ElementType
+};
+
+struct ChunkImageSequenceStream
+{
+    uint64_t m_dataOffset;   // relative to m_dataOffset of the image
+    uint64_t m_layoutOffset; // relative to m_layoutsOffset of the image
+    uint32_t m_numberOfSamples;
+    uint32_t m_nnzCount;
+};
+static_assert(sizeof(ChunkImageSequenceStream) == 24, "ChunkImageSequenceStream must not have padding.");
+
+// Of the calling process, e.g. for ChunkImageHeader::m_processId.
+uint64_t GetCurrentProcessId();
+
+// Reads the header of the image in the 'size' bytes at 'data', returns false if there is no complete image of this version.
+bool ReadChunkImageHeader(const char* data, size_t size, ChunkImageHeader& header);
+
+// Loads a chunk from the deserializer and writes its image into the memory that allocate(size) returns.
+// Returns false if allocate() returns nullptr. Only dense and sparse streams of float and double are supported.
+bool WriteChunkImage(IDataDeserializer& deserializer, ChunkIdType chunkId, uint64_t processId,
+                     const std::function<char*(size_t)>& allocate);
+
+// A chunk whose sequences point into an image, which the derived classes keep in memory as long as the chunk exists.
+class ChunkImageChunk : public Chunk, public std::enable_shared_from_this<ChunkImageChunk>
+{
+public:
+    void GetSequence(size_t sequenceId, std::vector<SequenceDataPtr>& result) override;
+
+    size_t GetMemorySize() const override
+    {
+        return m_header.m_size;
+    }
+
+protected:
+    // Sets the chunk up over the image in the 'size' bytes at 'data'; 'name' of the image is for the error messages.
+    void Attach(const char* data, size_t size, size_t numberOfStreams, const std::string& name);
+
+private:
+    std::string m_name;
+    ChunkImageHeader m_header;
+    const ChunkImageStream* m_streams;
+    const ChunkImageSequenceStream* m_headers;
+    const char* m_data;
+    uint64_t m_dataSize;
+    std::unordered_map<size_t, size_t> m_sequenceIndex;
+    std::vector<TensorShapePtr> m_layouts; // per sequence and stream
+};
+
+}}}
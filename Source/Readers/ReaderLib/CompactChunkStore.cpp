@@ -0,0 +1,231 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <math.h>
+#include <unordered_map>
+#include "CompactChunkStore.h"
+#include "BinarySequenceData.h"
+#include "ElementTypeUtils.h"
+#include "Half.h"
+#include "SequenceData.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+using BinaryChunkFormat::AlignUp;
+
+// All 65536 values, since widening is what the minibatches wait for.
+static const float* HalfToFloatTable()
+{
+    static const std::vector<float> table = []()
+    {
+        std::vector<float> values(65536);
+        for (size_t i = 0; i < values.size(); ++i)
+            values[i] = HalfToFloat((uint16_t)i);
+        return values;
+    }();
+    return table.data();
+}
+
+// A chunk with the compact streams encoded in its buffer, and the others laid out as by AppendSequenceData.
+class CompactChunkStore::CompactChunk : public Chunk, public std::enable_shared_from_this<CompactChunk>
+{
+public:
+    CompactChunk(IDataDeserializer& deserializer, ChunkIdType chunkId, Encoding encoding, const std::shared_ptr<Buffers>& buffers)
+        : m_encoding(encoding), m_buffers(buffers)
+    {
+        const auto descriptions = deserializer.GetStreamDescriptions();
+        m_numberOfStreams = descriptions.size();
+
+        ChunkPtr chunk = deserializer.GetChunk(chunkId);
+        std::vector<SequenceDescription> sequences;
+        deserializer.GetSequencesForChunk(chunkId, sequences);
+
+        std::vector<SequenceDataPtr> sequenceData;
+        m_sequences.reserve(sequences.size() * m_numberOfStreams);
+        for (size_t s = 0; s < sequences.size(); ++s)
+        {
+            sequenceData.clear();
+            chunk->GetSequence(sequences[s].m_id, sequenceData);
+            if (sequenceData.size() != m_numberOfStreams)
+                LogicError("CompactChunkStore: Sequence %" PRIu64 " has data for %d streams, expected %d.", (uint64_t)sequences[s].m_id, (int)sequenceData.size(), (int)m_numberOfStreams);
+            m_sequenceIndex[sequences[s].m_id] = s;
+
+            for (size_t i = 0; i < m_numberOfStreams; ++i)
+            {
+                SequenceDataBase& data = *sequenceData[i];
+                SequenceStream stream = {};
+                stream.m_storageType = descriptions[i]->m_storageType;
+                stream.m_elementType = descriptions[i]->m_elementType == ElementType::tvariant ? data.m_elementType : descriptions[i]->m_elementType;
+                stream.m_layout = data.m_sampleLayout ? data.m_sampleLayout : descriptions[i]->m_sampleLayout;
+                stream.m_numberOfSamples = data.m_numberOfSamples;
+                if (!stream.m_layout)
+                    RuntimeError("CompactChunkStore: Neither stream '%ls' nor its sequences have a sample layout.", descriptions[i]->m_name.c_str());
+                if (stream.m_storageType != StorageType::dense && stream.m_storageType != StorageType::sparse_csc)
+                    RuntimeError("CompactChunkStore: Stream '%ls' has an unsupported storage type.", descriptions[i]->m_name.c_str());
+
+                stream.m_offset = m_data.size();
+                stream.m_compact = stream.m_storageType == StorageType::dense &&
+                                   (stream.m_elementType == ElementType::tfloat || stream.m_elementType == ElementType::tdouble);
+                if (stream.m_compact)
+                {
+                    const size_t numberOfValues = stream.m_numberOfSamples * stream.m_layout->GetNumElements();
+                    if (stream.m_elementType == ElementType::tfloat)
+                        Encode(stream, (const float*)data.GetDataBuffer(), numberOfValues);
+                    else
+                        Encode(stream, (const double*)data.GetDataBuffer(), numberOfValues);
+                }
+                else if (!AppendSequenceData(m_data, stream.m_storageType, stream.m_layout->GetNumElements(),
+                                             GetSizeByType(stream.m_elementType), data, stream.m_nnzCount))
+                {
+                    LogicError("CompactChunkStore: Sequence %" PRIu64 " of stream '%ls' has non zero counts that do not match its samples or add up to its total.",
+                               (uint64_t)sequences[s].m_id, descriptions[i]->m_name.c_str());
+                }
+                m_sequences.push_back(stream);
+            }
+        }
+        // Of the exact size, since the randomization window holds many chunks. The chunk of the deserializer goes with this scope.
+        m_data.shrink_to_fit();
+    }
+
+    void GetSequence(size_t sequenceId, std::vector<SequenceDataPtr>& result) override
+    {
+        auto index = m_sequenceIndex.find(sequenceId);
+        if (index == m_sequenceIndex.end())
+            LogicError("CompactChunkStore: Sequence %" PRIu64 " does not belong to the chunk.", (uint64_t)sequenceId);
+
+        for (size_t i = 0; i < m_numberOfStreams; ++i)
+        {
+            const SequenceStream& stream = m_sequences[index->second * m_numberOfStreams + i];
+            SequenceDataPtr sequence;
+            if (!stream.m_compact)
+            {
+                sequence = CreateSequenceView(m_data.data(), m_data.size(), stream.m_storageType, stream.m_layout->GetNumElements(),
+                                              GetSizeByType(stream.m_elementType), stream.m_offset, stream.m_numberOfSamples, stream.m_nnzCount);
+                if (!sequence)
+                    LogicError("CompactChunkStore: Sequence data beyond the end of the chunk.");
+            }
+            else if (stream.m_elementType == ElementType::tfloat)
+            {
+                auto widened = std::make_shared<DenseSequenceWithBuffer<float>>(m_buffers->m_float, stream.m_numberOfSamples * stream.m_layout->GetNumElements());
+                Decode(stream, widened->GetBuffer());
+                sequence = widened;
+            }
+            else
+            {
+                auto widened = std::make_shared<DenseSequenceWithBuffer<double>>(m_buffers->m_double, stream.m_numberOfSamples * stream.m_layout->GetNumElements());
+                Decode(stream, widened->GetBuffer());
+                sequence = widened;
+            }
+
+            sequence->m_id = sequenceId;
+            sequence->m_numberOfSamples = stream.m_numberOfSamples;
+            sequence->m_elementType = stream.m_elementType;
+            sequence->m_sampleLayout = stream.m_layout;
+            sequence->m_chunk = shared_from_this();
+            result.push_back(sequence);
+        }
+    }
+
+    size_t GetMemorySize() const override
+    {
+        return m_data.capacity() + m_sequences.capacity() * sizeof(SequenceStream);
+    }
+
+private:
+    struct SequenceStream
+    {
+        StorageType m_storageType;
+        ElementType m_elementType;
+        bool m_compact;
+        uint32_t m_numberOfSamples;
+        uint32_t m_nnzCount;  // of sparse streams
+        uint64_t m_offset;    // in m_data
+        float m_minimum;      // byte: value = m_minimum + code * m_step
+        float m_step;
+        TensorShapePtr m_layout;
+    };
+
+    template <class ElemType>
+    void Encode(SequenceStream& stream, const ElemType* values, size_t numberOfValues)
+    {
+        if (m_encoding == Encoding::half)
+        {
+            m_data.resize(AlignUp(m_data.size(), sizeof(uint16_t)));
+            stream.m_offset = m_data.size();
+            m_data.resize(m_data.size() + numberOfValues * sizeof(uint16_t));
+            uint16_t* codes = reinterpret_cast<uint16_t*>(m_data.data() + stream.m_offset);
+            for (size_t j = 0; j < numberOfValues; ++j)
+                codes[j] = FloatToHalf((float)values[j]);
+            return;
+        }
+
+        float minimum = 0, maximum = 0;
+        for (size_t j = 0; j < numberOfValues; ++j)
+        {
+            const float value = (float)values[j];
+            minimum = (j == 0 || value < minimum) ? value : minimum;
+            maximum = (j == 0 || value > maximum) ? value : maximum;
+        }
+        stream.m_minimum = minimum;
+        stream.m_step = (maximum - minimum) / 255;
+        const float scale = stream.m_step > 0 ? 1 / stream.m_step : 0;
+        stream.m_offset = m_data.size();
+        m_data.resize(m_data.size() + numberOfValues);
+        unsigned char* codes = reinterpret_cast<unsigned char*>(m_data.data() + stream.m_offset);
+        for (size_t j = 0; j < numberOfValues; ++j)
+            codes[j] = (unsigned char)std::min(255.0f, std::max(0.0f, roundf(((float)values[j] - minimum) * scale)));
+    }
+
+    template <class ElemType>
+    void Decode(const SequenceStream& stream, ElemType* values) const
+    {
+        const size_t numberOfValues = stream.m_numberOfSamples * stream.m_layout->GetNumElements();
+        if (m_encoding == Encoding::half)
+        {
+            const float* table = HalfToFloatTable();
+            const uint16_t* codes = reinterpret_cast<const uint16_t*>(m_data.data() + stream.m_offset);
+            for (size_t j = 0; j < numberOfValues; ++j)
+                values[j] = (ElemType)table[codes[j]];
+        }
+        else
+        {
+            const unsigned char* codes = reinterpret_cast<const unsigned char*>(m_data.data() + stream.m_offset);
+            for (size_t j = 0; j < numberOfValues; ++j)
+                values[j] = (ElemType)(stream.m_minimum + codes[j] * stream.m_step);
+        }
+    }
+
+    Encoding m_encoding;
+    std::shared_ptr<Buffers> m_buffers;
+    size_t m_numberOfStreams;
+    std::vector<char> m_data;
+    std::vector<SequenceStream> m_sequences; // per sequence and stream
+    std::unordered_map<size_t, size_t> m_sequenceIndex;
+};
+
+/*static*/ CompactChunkStore::Encoding CompactChunkStore::ParseEncoding(const std::string& encoding)
+{
+    if (encoding == "half")
+        return Encoding::half;
+    if (encoding == "byte")
+        return Encoding::byte;
+    InvalidArgument("CompactChunkStore: Unknown encoding '%s', expected 'half' or 'byte'.", encoding.c_str());
+}
+
+CompactChunkStore::CompactChunkStore(IDataDeserializerPtr deserializer, Encoding encoding)
+    : m_deserializer(deserializer), m_encoding(encoding), m_buffers(std::make_shared<Buffers>())
+{
+}
+
+ChunkPtr CompactChunkStore::GetChunk(ChunkIdType chunkId)
+{
+    return std::make_shared<CompactChunk>(*m_deserializer, chunkId, m_encoding, m_buffers);
+}
+
+}}}
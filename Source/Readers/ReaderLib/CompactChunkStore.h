@@ -0,0 +1,78 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "DataDeserializer.h"
+#include "ConcStack.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Keeps the dense float and double streams of the chunks of a deserializer in 16 bits (half precision) or in 8 bits
+// with a range per sequence, so that the chunks in the randomization window take a half or a quarter of the memory.
+// The values are widened again to their type when the randomizer asks for the sequences of a minibatch.
+// Implemented as a wrapping proxy around a deserializer, like the ChunkCache. The chunk of the deserializer is
+// released once converted; the other streams are copied as they are.
+//   half: a relative error of at most 2^-11 for magnitudes in [6.1e-5, 65504]; smaller ones keep fewer bits,
+//         larger ones become infinite.
+//   byte: an error of at most (max - min) / 510, with max and min the values of the sequence in the stream.
+class CompactChunkStore : public IDataDeserializer
+{
+public:
+    enum class Encoding
+    {
+        half,
+        byte,
+    };
+
+    // "half" or "byte".
+    static Encoding ParseEncoding(const std::string& encoding);
+
+    CompactChunkStore(IDataDeserializerPtr deserializer, Encoding encoding);
+
+    virtual std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
+    {
+        return m_deserializer->GetStreamDescriptions();
+    }
+
+    virtual ChunkDescriptions GetChunkDescriptions() override
+    {
+        return m_deserializer->GetChunkDescriptions();
+    }
+
+    virtual void GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& descriptions) override
+    {
+        return m_deserializer->GetSequencesForChunk(chunkId, descriptions);
+    }
+
+    virtual bool GetSequenceDescription(const SequenceDescription& primary, SequenceDescription& description) override
+    {
+        return m_deserializer->GetSequenceDescription(primary, description);
+    }
+
+    // Gets the chunk from the deserializer and converts it.
+    virtual ChunkPtr GetChunk(ChunkIdType chunkId) override;
+
+private:
+    class CompactChunk;
+
+    // Of the widened sequences, which give them back once packed.
+    struct Buffers
+    {
+        conc_stack<std::vector<float>> m_float;
+        conc_stack<std::vector<double>> m_double;
+    };
+
+    IDataDeserializerPtr m_deserializer;
+    Encoding m_encoding;
+    std::shared_ptr<Buffers> m_buffers;
+
+    DISABLE_COPY_AND_MOVE(CompactChunkStore);
+};
+
+}}}
@@ -90,11 +90,18 @@ typedef std::shared_ptr<DenseSequenceData> DenseSequenceDataPtr;
 // All samples in the sequence should have the same layout.
 struct SparseSequenceData : SequenceDataBase
 {
+    SparseSequenceData() : m_indices(nullptr), m_totalNnzCount(0), m_columnOffsets(nullptr) {}
+
     IndexType* m_indices; // an index for every value in the m_data array
     std::vector<IndexType> m_nnzCounts; // nnz count for each sample in the sequence
     IndexType m_totalNnzCount; // sum of all nzzCounts of all samples
     // Using IndexType for both properties above since the nnzCount should fit inside
     // the index type (in CSC format, the last value in the column index array == nnzCount)
+
+    // Optional CSC column offsets of the samples (m_numberOfSamples + 1 values, starting with 0 and ending
+    // with m_totalNnzCount). Deserializers that keep sequences in this layout, e.g. in the memory of their chunk,
+    // set it, so that the packer does not have to compute the offsets from m_nnzCounts.
+    const IndexType* m_columnOffsets;
 };
 typedef std::shared_ptr<SparseSequenceData> SparseSequenceDataPtr;
 
@@ -120,6 +127,9 @@ public:
     // deallocated till all its sequences are released.
     virtual void GetSequence(size_t sequenceId, std::vector<SequenceDataPtr>& result) = 0;
 
+    // Gets the number of bytes of memory the chunk data takes, 0 if unknown.
+    virtual size_t GetMemorySize() const { return 0; }
+
     virtual ~Chunk() {};
 
 protected:
@@ -172,6 +182,13 @@ public:
     // Gets chunk data given its id.
     virtual ChunkPtr GetChunk(ChunkIdType chunkId) = 0;
 
+    // Whether GetChunk() can be called for different chunks from several threads at the same time, e.g. by the
+    // prefetches of the randomizer; otherwise the calls are made one after another.
+    virtual bool SupportsConcurrentGetChunk() const
+    {
+        return false;
+    }
+
     virtual ~IDataDeserializer() {};
 };
 
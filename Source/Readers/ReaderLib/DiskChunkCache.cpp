@@ -0,0 +1,235 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include "DiskChunkCache.h"
+#include "ChunkImage.h"
+#include "MemoryMappedFile.h"
+#include "fileutil.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// A chunk whose sequences point into the mapping of its file, which they keep alive.
+class DiskChunkCache::FileChunk : public ChunkImageChunk
+{
+public:
+    FileChunk(std::unique_ptr<MemoryMappedFile>&& file, size_t numberOfStreams)
+        : m_file(std::move(file))
+    {
+        Attach(m_file->Data(), m_file->Size(), numberOfStreams, "file " + msra::strfun::utf8(m_file->Path()));
+    }
+
+private:
+    std::unique_ptr<MemoryMappedFile> m_file;
+};
+
+DiskChunkCache::DiskChunkCache(IDataDeserializerPtr deserializer, const std::wstring& directory, const std::string& name,
+                               size_t maxSizeInBytes, int verbosity)
+    : m_deserializer(deserializer),
+      m_directory(directory),
+      m_name(name),
+      m_maxSizeInBytes(maxSizeInBytes),
+      m_verbosity(verbosity),
+      m_statistics(),
+      m_warnedAboutSize(false)
+{
+    // The name goes into the names of the files.
+    if (m_name.empty() || m_name.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-.") != std::string::npos)
+        InvalidArgument("DiskChunkCache: The name '%s' must be non-empty and consist of letters, digits, '_', '-' and '.' only.", m_name.c_str());
+    if (m_directory.empty())
+        InvalidArgument("DiskChunkCache: No directory given for the cache '%s'.", m_name.c_str());
+
+    for (const auto& description : m_deserializer->GetChunkDescriptions())
+    {
+        if (m_numberOfSequences.size() <= description->m_id)
+            m_numberOfSequences.resize(description->m_id + 1, 0);
+        m_numberOfSequences[description->m_id] = description->m_numberOfSequences;
+    }
+
+    m_chunkLocks.reserve(m_numberOfSequences.size());
+    for (size_t i = 0; i < m_numberOfSequences.size(); ++i)
+        m_chunkLocks.push_back(std::make_unique<std::mutex>());
+
+    msra::files::make_intermediate_dirs(GetFilePath(0));
+}
+
+DiskChunkCache::~DiskChunkCache()
+{
+    if (m_verbosity >= 2)
+        fprintf(stderr, "DiskChunkCache: %" PRIu64 " chunks read from files, %" PRIu64 " chunks written, %" PRIu64 " chunks not cached, %" PRIu64 " files deleted, %" PRIu64 " bytes in use\n",
+                (uint64_t)m_statistics.m_numHits,
+                (uint64_t)m_statistics.m_numWritten,
+                (uint64_t)m_statistics.m_numFailed,
+                (uint64_t)m_statistics.m_numEvictions,
+                (uint64_t)m_statistics.m_sizeInBytes);
+}
+
+std::wstring DiskChunkCache::GetFilePath(ChunkIdType chunkId) const
+{
+    return m_directory + L"/" + msra::strfun::utf16(m_name) + L"-" + std::to_wstring(chunkId) + L".chunk";
+}
+
+ChunkPtr DiskChunkCache::GetChunk(ChunkIdType chunkId)
+{
+    if (chunkId >= m_chunkLocks.size())
+        LogicError("DiskChunkCache: Invalid chunk id %u.", chunkId);
+
+    std::lock_guard<std::mutex> chunkLock(*m_chunkLocks[chunkId]);
+    try
+    {
+        auto chunk = Map(chunkId);
+        const bool hit = chunk != nullptr;
+        if (!hit)
+        {
+            Write(chunkId);
+            chunk = Map(chunkId);
+            if (!chunk)
+                RuntimeError("DiskChunkCache: The file written for chunk %u cannot be read back.", chunkId);
+            if (m_verbosity >= 2)
+                fprintf(stderr, "DiskChunkCache: Wrote chunk %u (%" PRIu64 " bytes).\n", chunkId, (uint64_t)chunk->GetMemorySize());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            ++(hit ? m_statistics.m_numHits : m_statistics.m_numWritten);
+        }
+        Use(chunkId, chunk);
+        return chunk;
+    }
+    catch (const std::exception& e)
+    {
+        // e.g. the disk is full, or the chunk has streams that are not supported
+        bool first;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            first = m_statistics.m_numFailed++ == 0;
+        }
+        if (first)
+            fprintf(stderr, "WARNING: DiskChunkCache: Chunk %u cannot be cached (%s), loading it without the cache.\n", chunkId, e.what());
+        return m_deserializer->GetChunk(chunkId);
+    }
+}
+
+std::shared_ptr<DiskChunkCache::FileChunk> DiskChunkCache::Map(ChunkIdType chunkId)
+{
+    const std::wstring path = GetFilePath(chunkId);
+    if (!fexists(path))
+        return nullptr;
+
+    std::unique_ptr<MemoryMappedFile> file;
+    try
+    {
+        file = std::make_unique<MemoryMappedFile>(path);
+    }
+    catch (const std::exception&)
+    {
+        return nullptr; // e.g. replaced by another process in the meantime
+    }
+
+    // A file of other data, e.g. of an earlier version of the data set, is written again.
+    const size_t numberOfStreams = m_deserializer->GetStreamDescriptions().size();
+    ChunkImageHeader header;
+    if (!ReadChunkImageHeader(file->Data(), file->Size(), header) ||
+        header.m_numberOfStreams != numberOfStreams || header.m_numberOfSequences != m_numberOfSequences[chunkId])
+        return nullptr;
+
+    // The randomizer goes over all sequences of the chunk.
+    file->Advise(0, file->Size(), MemoryMappedFile::Access::WillNeed);
+    try
+    {
+        return std::make_shared<FileChunk>(std::move(file), numberOfStreams);
+    }
+    catch (const std::exception&)
+    {
+        return nullptr; // corrupt, written again
+    }
+}
+
+void DiskChunkCache::Write(ChunkIdType chunkId)
+{
+    std::vector<char> image;
+    WriteChunkImage(*m_deserializer, chunkId, GetCurrentProcessId(), [&image](size_t size)
+    {
+        image.resize(size);
+        return image.data();
+    });
+
+    // The file is written under a temporary name of this process and only renamed once complete,
+    // so that a file of the expected name is always complete, also when other processes write it at the same time.
+    const std::wstring path = GetFilePath(chunkId);
+    const std::wstring temporaryPath = path + L"." + std::to_wstring(GetCurrentProcessId()) + L".tmp";
+    FILE* file = fopenOrDie(temporaryPath, L"wb");
+    bool renamed = false;
+    auto cleanup = MakeScopeExit([&]()
+    {
+        if (file != nullptr)
+            fclose(file);
+        if (!renamed)
+            _wunlink(temporaryPath.c_str());
+    });
+    fwriteOrDie(image.data(), 1, image.size(), file);
+    fflushOrDie(file);
+    fcloseOrDie(file);
+    file = nullptr;
+    renameOrDie(temporaryPath, path);
+    renamed = true;
+}
+
+void DiskChunkCache::Use(ChunkIdType chunkId, const ChunkPtr& chunk)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto it = m_files.find(chunkId);
+    if (it == m_files.end())
+    {
+        it = m_files.insert(std::make_pair(chunkId, CacheEntry())).first;
+        it->second.m_sizeInBytes = 0;
+        it->second.m_lruPosition = m_lru.insert(m_lru.begin(), chunkId);
+    }
+    else
+    {
+        m_lru.splice(m_lru.begin(), m_lru, it->second.m_lruPosition);
+    }
+
+    // The file may have been written again since this process last used it.
+    m_statistics.m_sizeInBytes += chunk->GetMemorySize() - it->second.m_sizeInBytes;
+    it->second.m_sizeInBytes = chunk->GetMemorySize();
+    it->second.m_chunk = chunk;
+
+    // The most recently used file, which was just used, is never deleted.
+    auto candidate = m_lru.end();
+    while (m_statistics.m_sizeInBytes > m_maxSizeInBytes && candidate != std::next(m_lru.begin()))
+    {
+        --candidate;
+        auto entry = m_files.find(*candidate);
+        assert(entry != m_files.end());
+
+        // The file of a chunk that is in use stays mapped anyway.
+        if (!entry->second.m_chunk.expired())
+            continue;
+
+        if (m_verbosity >= 2)
+            fprintf(stderr, "DiskChunkCache: Deleting the file of chunk %u (%" PRIu64 " bytes).\n", *candidate, (uint64_t)entry->second.m_sizeInBytes);
+
+        // A file that cannot be deleted (on Windows, e.g. while another process maps it) is no longer counted either.
+        _wunlink(GetFilePath(*candidate).c_str());
+        m_statistics.m_numEvictions++;
+        m_statistics.m_sizeInBytes -= entry->second.m_sizeInBytes;
+        m_files.erase(entry);
+        candidate = m_lru.erase(candidate);
+    }
+
+    if (m_statistics.m_sizeInBytes > m_maxSizeInBytes && m_verbosity >= 1 && !m_warnedAboutSize)
+    {
+        m_warnedAboutSize = true;
+        fprintf(stderr, "DiskChunkCache: WARNING: the files of the chunks in use take %" PRIu64 " bytes, more than the cache size of %" PRIu64 " bytes\n",
+                (uint64_t)m_statistics.m_sizeInBytes,
+                (uint64_t)m_maxSizeInBytes);
+    }
+}
+
+}}}
@@ -0,0 +1,122 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "DataDeserializer.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// A cache of the chunks of a deserializer in files on a local disk, for data that is expensive to fetch (e.g. from
+// remote storage) or to parse, and that does not fit in memory (for that, see the ChunkCache).
+// Implemented as a wrapping proxy around a deserializer, like the ChunkCache: the first time a chunk is asked for,
+// it is loaded from the deserializer and its image (see ChunkImage.h) written to <directory>/<name>-<chunk id>.chunk.
+// From then on, in later epochs and runs, the file is mapped and the sequences point into the mapping.
+// The files hold the chunks as the deserializer gives them, whole and independent of the worker, so that distributed
+// readers decimate the same as without the cache, and the workers of a machine can share the directory: each file
+// is written under a temporary name and renamed once complete.
+// With a size limit, the least recently used files are deleted once the files this process has used take more than
+// the limit; files of chunks that are in use are kept, like in the ChunkCache. Chunks that cannot be written (e.g. the
+// disk is full, or a stream is neither float nor double) are used straight from the deserializer.
+class DiskChunkCache : public IDataDeserializer
+{
+public:
+    // 'name' identifies the data set and the configuration of its deserializers, it has to change when they do.
+    // With 'verbosity' >= 1, warns when the files cannot be kept within 'maxSizeInBytes'; with 'verbosity' >= 2,
+    // reports the chunks written and deleted, and the cache statistics.
+    DiskChunkCache(IDataDeserializerPtr deserializer, const std::wstring& directory, const std::string& name,
+                   size_t maxSizeInBytes = SIZE_MAX, int verbosity = 0);
+
+    ~DiskChunkCache();
+
+    virtual std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
+    {
+        return m_deserializer->GetStreamDescriptions();
+    }
+
+    virtual ChunkDescriptions GetChunkDescriptions() override
+    {
+        return m_deserializer->GetChunkDescriptions();
+    }
+
+    virtual void GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& descriptions) override
+    {
+        return m_deserializer->GetSequencesForChunk(chunkId, descriptions);
+    }
+
+    virtual bool GetSequenceDescription(const SequenceDescription& primary, SequenceDescription& description) override
+    {
+        return m_deserializer->GetSequenceDescription(primary, description);
+    }
+
+    // Gets chunk data given its id, from its file if possible.
+    virtual ChunkPtr GetChunk(ChunkIdType chunkId) override;
+
+    struct Statistics
+    {
+        size_t m_numHits;      // chunks mapped from an existing file
+        size_t m_numWritten;   // chunks loaded from the deserializer and written to a file
+        size_t m_numFailed;    // chunks that could not be cached and were used straight from the deserializer
+        size_t m_numEvictions; // files deleted to keep within the size limit
+        size_t m_sizeInBytes;  // the size of the files this process has used, and not deleted
+    };
+
+    Statistics GetStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_statistics;
+    }
+
+private:
+    class FileChunk;
+
+    std::wstring GetFilePath(ChunkIdType chunkId) const;
+
+    // Maps the file of a chunk, returns nullptr if there is no valid one.
+    std::shared_ptr<FileChunk> Map(ChunkIdType chunkId);
+
+    // Loads the chunk from the deserializer and writes its file.
+    void Write(ChunkIdType chunkId);
+
+    // Marks the file of the chunk as most recently used, and deletes the least recently used ones if over the limit.
+    void Use(ChunkIdType chunkId, const ChunkPtr& chunk);
+
+    IDataDeserializerPtr m_deserializer;
+    std::wstring m_directory;
+    std::string m_name;
+    size_t m_maxSizeInBytes;
+    int m_verbosity;
+
+    // Of the chunks, to recognize files of other data.
+    std::vector<size_t> m_numberOfSequences;
+
+    // Threads asking for the same chunk are serialized by a mutex per chunk.
+    std::vector<std::unique_ptr<std::mutex>> m_chunkLocks;
+
+    struct CacheEntry
+    {
+        std::weak_ptr<Chunk> m_chunk; // while in use
+        size_t m_sizeInBytes;
+        std::list<ChunkIdType>::iterator m_lruPosition;
+    };
+
+    // For the following.
+    mutable std::mutex m_lock;
+    // The files this process has used, the most recently used first.
+    std::map<ChunkIdType, CacheEntry> m_files;
+    std::list<ChunkIdType> m_lru;
+    Statistics m_statistics;
+    bool m_warnedAboutSize;
+
+    DISABLE_COPY_AND_MOVE(DiskChunkCache);
+};
+
+}}}
@@ -8,7 +8,8 @@
 
 #include "NoRandomizer.h"
 #include "DataReader.h"
-#include "ExceptionCapture.h"
+#include "WorkerThreadPool.h"
+#include "ReaderStatistics.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -145,6 +146,7 @@ std::vector<SequenceDescription> NoRandomizer::GetNextSequenceDescriptions(size_
 
 Sequences NoRandomizer::GetNextSequences(size_t sampleCount)
 {
+    ReaderStageTimer randomizeTimer(ReaderStage::randomize);
     Sequences result;
     if (m_config.m_totalEpochSizeInSamples <= m_samplePositionInEpoch)
     {
@@ -161,8 +163,8 @@ Sequences NoRandomizer::GetNextSequences(size_t sampleCount)
     std::vector<SequenceDescription> descriptions = GetNextSequenceDescriptions(sampleCount);
 
     // Retrieve only sequences that are required by this worker.
-    size_t start = descriptions.size() * m_config.m_workerRank / m_config.m_numberOfWorkers;
-    size_t end = descriptions.size() * (m_config.m_workerRank + 1) / m_config.m_numberOfWorkers;
+    size_t start, end;
+    GetWorkerRange(m_config, descriptions.size(), start, end);
     size_t subsetSize = end - start;
     if (subsetSize == 0)
     {
@@ -172,6 +174,7 @@ Sequences NoRandomizer::GetNextSequences(size_t sampleCount)
     result.m_data.resize(m_streams.size(), std::vector<SequenceDataPtr>(subsetSize));
 
     // Collect all the chunks that we need
+    ReaderStageTimer deserializeTimer(ReaderStage::deserialize);
     std::map<ChunkIdType, ChunkPtr> chunks;
 
     if (m_currentChunk != nullptr)
@@ -209,11 +212,7 @@ Sequences NoRandomizer::GetNextSequences(size_t sampleCount)
     // TODO: This will be changed, when we move transformers under the (no-) randomizer, should not deal with multithreading here.
     if (m_multithreadedGetNextSequences)
     {
-        ExceptionCapture capture;
-#pragma omp parallel for schedule(dynamic)
-        for (int i = 0; i < subsetSize; ++i)
-            capture.SafeRun(process, i);
-        capture.RethrowIfHappened();
+        ParallelFor(m_workerThreadPool, subsetSize, [&process](size_t i) { process((int)i); });
     }
     else
     {
@@ -8,6 +8,7 @@
 #include <vector>
 #include "SequenceEnumerator.h"
 #include "DataDeserializer.h"
+#include "WorkerThreadPool.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -27,6 +28,13 @@ public:
         return m_deserializer->GetStreamDescriptions();
     }
 
+    // Retrieves the sequences of a minibatch on the given pool instead of in OpenMP parallel loops
+    // (only if multithreadedGetNextSequences is set).
+    void SetWorkerThreadPool(const WorkerThreadPoolPtr& pool)
+    {
+        m_workerThreadPool = pool;
+    }
+
 private:
     // Gets next sequence descriptions with total size less than sampleCount.
     std::vector<SequenceDescription> GetNextSequenceDescriptions(size_t sampleCount);
@@ -42,6 +50,7 @@ private:
     // Whether to get sequences using multiple thread.
     // TODO temporary; should go away when transformers are moved closer to the deserializer
     bool m_multithreadedGetNextSequences;
+    WorkerThreadPoolPtr m_workerThreadPool;
 
     // Stream descriptions
     std::vector<StreamDescriptionPtr> m_streams;
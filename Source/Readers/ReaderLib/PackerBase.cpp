@@ -6,6 +6,9 @@
 #define _CRT_SECURE_NO_WARNINGS
 #define _SCL_SECURE_NO_WARNINGS
 
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <limits>
 #include "PackerBase.h"
 #include "ElementTypeUtils.h"
 
@@ -78,15 +81,16 @@ PackerBase::PackerBase(SequenceEnumeratorPtr sequenceEnumerator,
         const auto& stream = m_outputStreamDescriptions[i];
         UNUSED(stream);
 
-        // Check the input.
+        // Check the input. 8-bit images are also packed as they are, if they are converted on the device.
+        bool convertedOnDevice = m_inputStreamDescriptions[i]->m_elementType == ElementType::tuchar && m_inputStreamDescriptions[i]->m_deviceAugmentation;
         if(m_inputStreamDescriptions[i]->m_elementType != ElementType::tdouble &&
-            m_inputStreamDescriptions[i]->m_elementType != ElementType::tfloat)
+            m_inputStreamDescriptions[i]->m_elementType != ElementType::tfloat && !convertedOnDevice)
         {
             RuntimeError("Please specify the type of the '%ls' stream. You can use 'Cast' transform for that.", m_inputStreamDescriptions[i]->m_name.c_str());
         }
 
         // Input and output should match in everything except for sparse/dense storage type.
-        assert(stream->m_elementType == ElementType::tfloat || stream->m_elementType == ElementType::tdouble);
+        assert(stream->m_elementType == ElementType::tfloat || stream->m_elementType == ElementType::tdouble || convertedOnDevice);
         assert(stream->m_name == m_inputStreamDescriptions[i]->m_name);
         assert(stream->m_id == m_inputStreamDescriptions[i]->m_id);
 
@@ -110,6 +114,51 @@ PackerBase::PackerBase(SequenceEnumeratorPtr sequenceEnumerator,
     }
 }
 
+SparseStreamMinibatchHeader PackerBase::PrepareSparseBuffer(size_t streamIndex, size_t nnzCount, size_t numberOfColumns)
+{
+    if (nnzCount > numeric_limits<IndexType>::max())
+    {
+        RuntimeError("Minibatch NNZ count (%" PRIu64 ") exceeds the maximum allowed "
+            "value (%" PRIu64 ")\n", nnzCount, (size_t)numeric_limits<IndexType>::max());
+    }
+
+    const size_t elementSize = GetSizeByType(m_inputStreamDescriptions[streamIndex]->m_elementType);
+    const size_t indexSize = sizeof(IndexType);
+
+    // The values and row indices are laid out for a capacity of non zero values, as in the buffer of a GPUSparseMatrix
+    // (see SparseStreamMinibatchHeader). The capacity follows from a buffer size that only grows, to the size of the CSC
+    // arrays when they did not fit. The GPU matrix then allocates a buffer of exactly that size once, and as the number
+    // of columns changes from one minibatch to the next, derives the same capacity from it that the packer does.
+    const size_t columnOffsetsSize = indexSize * (numberOfColumns + 1);
+    if (m_sparseBufferSizes.size() != m_outputStreamDescriptions.size())
+        m_sparseBufferSizes.assign(m_outputStreamDescriptions.size(), 0);
+    size_t& sparseBufferSize = m_sparseBufferSizes[streamIndex];
+    auto capacityOf = [&](size_t size) { return size > columnOffsetsSize ? (size - columnOffsetsSize) / (elementSize + indexSize) : 0; };
+    if (capacityOf(sparseBufferSize) < nnzCount)
+    {
+        // with some room, so that the minibatches to come with a few more values fit as well
+        sparseBufferSize = (nnzCount + nnzCount / 8) * (elementSize + indexSize) + columnOffsetsSize;
+    }
+    SparseStreamMinibatchHeader header = { nnzCount, capacityOf(sparseBufferSize) };
+
+    size_t requiredSize = sizeof(header) + sparseBufferSize;
+    auto& buffer = m_streamBuffers[m_currentBufferIndex][streamIndex];
+    if (buffer.m_size < requiredSize)
+    {
+        buffer.Resize(requiredSize);
+    }
+
+    char* destination = buffer.m_data.get();
+    memcpy(destination, &header, sizeof(header));
+
+    // The capacity beyond the values is copied to the GPU along with them, so it is not left uninitialized.
+    char* dataDst = destination + sizeof(header);
+    char* indicesDst = dataDst + elementSize * header.m_nnzCapacity;
+    memset(dataDst + elementSize * nnzCount, 0, elementSize * (header.m_nnzCapacity - nnzCount));
+    memset(indicesDst + indexSize * nnzCount, 0, indexSize * (header.m_nnzCapacity - nnzCount));
+    return header;
+}
+
 // Gets samples size in bytes.
 size_t PackerBase::GetSampleSize(StreamDescriptionPtr stream)
 {
@@ -56,6 +56,15 @@ protected:
     // (sampleOffset is equal to the sum of sample sizes of all preceding samples).
     void PackDenseSample(char* destination, SequenceDataPtr sequence, size_t sampleOffset, size_t sampleSize);
 
+    // Writes the count column offsets of a sparse sequence to destination, shifted by offset
+    // (the number of non zero values packed in front of the sequence). If the sequence does not provide
+    // its column offsets, they are computed from its nnz counts.
+    static void PackColumnOffsets(IndexType* destination, const SparseSequenceData& sequence, size_t count, IndexType offset);
+
+    // Makes room in the current buffer of a sparse stream for nnzCount values in numberOfColumns columns, laid out as
+    // described in SparseStreamMinibatchHeader, and writes the header. The padding of the capacity is zeroed.
+    SparseStreamMinibatchHeader PrepareSparseBuffer(size_t streamIndex, size_t nnzCount, size_t numberOfColumns);
+
     SequenceEnumeratorPtr m_sequenceEnumerator;
 
     // Input stream descriptions provided by the transformer.
@@ -85,6 +94,9 @@ protected:
     // Memory providers. Each stream has its own memory provider.
     std::vector<MemoryProviderPtr> m_memoryProviders;
 
+    // Size of the CSC arrays of each sparse stream, which determines the capacity of its minibatches.
+    std::vector<size_t> m_sparseBufferSizes;
+
 public:
     // Sets current epoch configuration.
     virtual void StartEpoch(const EpochConfiguration& config, const std::vector<MemoryProviderPtr>& memoryProviders) override;
@@ -119,4 +131,23 @@ inline void PackerBase::PackDenseSample(char* destination, SequenceDataPtr seque
     memcpy(destination, (const char*)(sequence->GetDataBuffer()) + sampleOffset, sampleSize);
 }
 
+inline void PackerBase::PackColumnOffsets(IndexType* destination, const SparseSequenceData& sequence, size_t count, IndexType offset)
+{
+    const IndexType* source = sequence.m_columnOffsets;
+    if (source)
+    {
+        // A plain loop over contiguous arrays, which the compiler vectorizes.
+        for (size_t i = 0; i < count; ++i)
+            destination[i] = source[i] + offset;
+        return;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        destination[i] = offset;
+        if (i < sequence.m_nnzCounts.size())
+            offset += sequence.m_nnzCounts[i];
+    }
+}
+
 }}}
@@ -9,6 +9,7 @@
 #include <memory>
 #include "Sequences.h"
 #include "TensorShape.h"
+#include "ImageAugmentation.h"
 #include <unordered_set>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -31,8 +32,33 @@ struct EpochConfiguration
     size_t m_totalEpochSizeInSamples;       // Total size of the epoch in samples
     size_t m_epochIndex;                    // Current epoch index [0 .. max number of epochs)
     size_t m_truncationSize;                // Truncation size in samples for truncated BPTT mode.
+    std::vector<double> m_workerShares;     // The share of the data of each worker, if not equal ones (see GetWorkerRange).
 };
 
+// The range [begin, end) of 'count' items, e.g. the sequences of a minibatch that all workers see, that is of the worker
+// of 'config': to each worker its part of m_workerShares, if there is one per worker, else an equal part. All workers
+// come to the same boundaries, so that the ranges add up to all items.
+inline void GetWorkerRange(const EpochConfiguration& config, size_t count, size_t& begin, size_t& end)
+{
+    const auto& shares = config.m_workerShares;
+    if (shares.size() != config.m_numberOfWorkers)
+    {
+        begin = count * config.m_workerRank / config.m_numberOfWorkers;
+        end = count * (config.m_workerRank + 1) / config.m_numberOfWorkers;
+        return;
+    }
+
+    double total = 0, before = 0;
+    for (size_t i = 0; i < shares.size(); ++i)
+    {
+        if (i == config.m_workerRank)
+            before = total;
+        total += shares[i];
+    }
+    begin = (size_t)(count * (before / total) + 0.5);
+    end = config.m_workerRank + 1 == shares.size() ? count : (size_t)(count * ((before + shares[config.m_workerRank]) / total) + 0.5);
+}
+
 // Supported primitive element types, will be extended in the future.
 enum class ElementType
 {
@@ -53,6 +79,16 @@ enum class StorageType
 
 typedef size_t StreamId;
 
+// How the 8-bit images of a stream (tuchar) are converted into the precision of the network once they are on the
+// device, by Matrix::AssignAugmentedImages(). The transform that ships them updates it at the start of each epoch.
+struct DeviceImageAugmentation
+{
+    ImageAugmentationParams m_params;
+    std::vector<float> m_mean; // in the layout of the images (HWC), empty for none
+    unsigned int m_seed;
+};
+typedef std::shared_ptr<DeviceImageAugmentation> DeviceImageAugmentationPtr;
+
 // This class describes a particular stream: its name, element type, storage, etc.
 struct StreamDescription
 {
@@ -62,6 +98,7 @@ struct StreamDescription
     ElementType m_elementType;     // Element type of the stream
     TensorShapePtr m_sampleLayout; // Layout of the sample for the stream
                                    // If not specified - can be specified per sequence
+    DeviceImageAugmentationPtr m_deviceAugmentation; // For 8-bit images converted on the device, null otherwise
 };
 typedef std::shared_ptr<StreamDescription> StreamDescriptionPtr;
 
@@ -76,6 +113,15 @@ struct StreamMinibatch
 };
 typedef std::shared_ptr<StreamMinibatch> StreamMinibatchPtr;
 
+// The data of a sparse stream minibatch is this header, followed by m_nnzCapacity values, m_nnzCapacity row indices
+// (of both the first m_nnzCount are used) and the column offsets, one per column of the layout plus one. This is the
+// layout of the buffer of a GPUSparseMatrix in CSC format, so that the minibatch is moved to the GPU in one copy.
+struct SparseStreamMinibatchHeader
+{
+    size_t m_nnzCount;
+    size_t m_nnzCapacity;
+};
+
 // Represents a single minibatch, that contains information about all streams.
 struct Minibatch
 {
@@ -7,12 +7,14 @@
 #include "ReaderBase.h"
 #include "CudaMemoryProvider.h"
 #include "HeapMemoryProvider.h"
+#include "ReaderStatistics.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 std::vector<StreamDescriptionPtr> ReaderBase::GetStreamDescriptions()
 {
-    return m_deserializer->GetStreamDescriptions();
+    // Readers that enumerate their input without a deserializer describe the streams by the enumerator.
+    return m_deserializer ? m_deserializer->GetStreamDescriptions() : m_sequenceEnumerator->GetStreamDescriptions();
 }
 
 ReaderBase::~ReaderBase()
@@ -60,6 +62,7 @@ void ReaderBase::StartEpoch(const EpochConfiguration& config, const std::map<std
 Minibatch ReaderBase::ReadMinibatch()
 {
     assert(m_packer != nullptr);
+    ReaderStageTimer timer(ReaderStage::pack);
     return m_packer->ReadMinibatch();
 }
 
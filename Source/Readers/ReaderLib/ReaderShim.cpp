@@ -23,7 +23,8 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
 template <class ElemType>
 ReaderShim<ElemType>::ReaderShim(ReaderFactory factory)
-    : m_factory(factory), m_deviceId(CPUDEVICE), m_dataTransferers(2, DataTransfererPtr()), m_currentDataTransferIndex(0)
+    : m_factory(factory), m_deviceId(CPUDEVICE), m_prefetchDepth(1), m_currentSlot(0), m_dataTransferers(2, DataTransfererPtr()), m_currentDataTransferIndex(0),
+      m_numAugmentedMinibatches(0)
 {
 }
 
@@ -38,6 +39,16 @@ void ReaderShim<ElemType>::Init(const ConfigParameters& config)
     // otherwise deferring - synchronous execution during .get() call
     m_launchType = prefetch ? launch::async : launch::deferred;
 
+    // Number of minibatches read and copied to the device ahead of the network. The reads are still done one after
+    // another, but with more than one in flight a slow minibatch can be absorbed by the ones already prefetched.
+    m_prefetchDepth = config(L"minibatchPrefetchDepth", (size_t)1);
+    if (m_prefetchDepth == 0)
+        InvalidArgument("ReaderShim: minibatchPrefetchDepth must be at least 1.");
+    m_prefetchTasks.resize(m_prefetchDepth);
+    m_prefetchBuffers.resize(m_prefetchDepth);
+    // One data transferer per prefetch in flight, plus the one the main thread is waiting on.
+    m_dataTransferers.assign(m_prefetchDepth + 1, DataTransfererPtr());
+
     m_numParallelSequences = numberOfuttsPerMinibatchForAllEpochs[0];
 
     m_reader = m_factory(config);
@@ -64,10 +75,7 @@ void ReaderShim<ElemType>::StartDistributedMinibatchLoop(
     size_t requestedEpochSamples /*= requestDataSize*/)
 {
     // For adaptive minibatch, make sure there are no outstanding reads.
-    if (m_prefetchTask.valid())
-    {
-        m_prefetchTask.wait();
-    }
+    WaitForPrefetches();
 
     EpochConfiguration config;
     config.m_workerRank = subsetNum;
@@ -75,11 +83,15 @@ void ReaderShim<ElemType>::StartDistributedMinibatchLoop(
     config.m_minibatchSizeInSamples = requestedMBSize;
     config.m_totalEpochSizeInSamples = requestedEpochSamples;
     config.m_epochIndex = epoch;
+    config.m_workerShares = m_workerShares;
 
     // Let's check that there is no outstanding copies.
     // Wait on all events if there are any pending copy operations in flight.
-    if (m_dataTransferers[m_currentDataTransferIndex])
-        m_dataTransferers[m_currentDataTransferIndex]->WaitForCopyCPUToGPU();
+    for (auto& dataTransferer : m_dataTransferers)
+    {
+        if (dataTransferer)
+            dataTransferer->WaitForCopyCPUToGPU();
+    }
 
     // Now we can be sure, no prefetch thread is running and there are no outstanding memcopies.
     // Let's check that requested devices are ok and see whether we need to change our data transferers.
@@ -99,37 +111,94 @@ void ReaderShim<ElemType>::StartDistributedMinibatchLoop(
     {
         // Device changed. Let's change the data transferers.
         m_deviceId = deviceId;
-        m_dataTransferers.clear();
-        // We need two in order to support two operations in flight.
-        m_dataTransferers.push_back(m_deviceId == CPUDEVICE ? nullptr : CreatePrefetchDataTransferer(m_deviceId));
-        m_dataTransferers.push_back(m_deviceId == CPUDEVICE ? nullptr : CreatePrefetchDataTransferer(m_deviceId));
+        // We need one more than the prefetch depth in order to support that many operations in flight.
+        for (auto& dataTransferer : m_dataTransferers)
+            dataTransferer = m_deviceId == CPUDEVICE ? nullptr : CreatePrefetchDataTransferer(m_deviceId);
     }
 
-    // Let's create the buffers for the prefetch thread.
+    // Let's create the buffers for the prefetch threads.
     std::map<std::wstring, int> inputDescriptions;
+    m_currentImages.clear();
     for (const auto& i : inputs)
     {
         inputDescriptions[i.GetStreamName()] = i.GetDeviceId();
+        auto stream = m_nameToStreamId.find(i.GetStreamName());
+        bool deviceAugmentation = stream != m_nameToStreamId.end() && m_streams[stream->second]->m_deviceAugmentation;
+        if (deviceAugmentation)
+            m_currentImages[i.GetStreamName()] = std::make_shared<Matrix<char>>(i.GetDeviceId());
+
         // Creating buffers with the same properties the network expects.
-        m_prefetchBuffers[i.GetStreamName()] = StreamPrefetchBuffer
+        for (auto& prefetchBuffers : m_prefetchBuffers)
         {
-            std::make_shared<Matrix<ElemType>>(0, 0, i.GetDeviceId(), i.GetMatrixType(), i.GetMatrixFormat()),
-            nullptr
-        };
+            prefetchBuffers[i.GetStreamName()] = StreamPrefetchBuffer
+            {
+                std::make_shared<Matrix<ElemType>>(0, 0, i.GetDeviceId(), i.GetMatrixType(), i.GetMatrixFormat()),
+                nullptr,
+                deviceAugmentation ? std::make_shared<Matrix<char>>(i.GetDeviceId()) : nullptr
+            };
+        }
     }
 
     m_endOfEpoch = false;
-    m_reader->StartEpoch(config, inputDescriptions);
-
-    auto localCurrentDataTransferIndex = m_currentDataTransferIndex;
-    // Starting the prefetch task. There is always a single async read in flight.
-    // When the network requests a new minibatch, we wait for the current async to finish, swap the buffers
-    // and kick off the new prefetch.
-    m_prefetchTask = std::async(m_launchType,
-    [this, localCurrentDataTransferIndex]()
     {
-        return PrefetchMinibatch(localCurrentDataTransferIndex);
-    });
+        // Chunks may already be loaded here.
+        ReaderStatisticsScope statisticsScope(&m_statistics);
+        m_reader->StartEpoch(config, inputDescriptions);
+    }
+
+    // The mean images of the augmentation, which the reader knows once its transforms are set up.
+    m_imageMeans.clear();
+    for (const auto& images : m_currentImages)
+    {
+        const auto& mean = m_streams[m_nameToStreamId[images.first]]->m_deviceAugmentation->m_mean;
+        std::vector<ElemType> values(mean.begin(), mean.end());
+        m_imageMeans[images.first] = values.empty() ?
+            std::make_shared<Matrix<ElemType>>(images.second->GetDeviceId()) :
+            std::make_shared<Matrix<ElemType>>(values.size(), 1, values.data(), images.second->GetDeviceId(), matrixFlagNormal);
+    }
+
+    // Starting the prefetch tasks. There are always m_prefetchDepth async reads in flight.
+    // When the network requests a new minibatch, we wait for the oldest one to finish, swap the buffers
+    // and kick off the next prefetch into the freed slot.
+    for (auto& prefetchTask : m_prefetchTasks)
+        prefetchTask = std::shared_future<PrefetchResult>(); // no chaining to the tasks of the previous epoch
+    m_currentSlot = 0;
+    for (size_t slot = 0; slot < m_prefetchDepth; ++slot)
+        StartPrefetch(slot, slot);
+}
+
+template <class ElemType>
+void ReaderShim<ElemType>::StartPrefetch(size_t slot, size_t minibatchesAhead)
+{
+    // Tasks are started in the order of their minibatches, so the previous one is in the slot before this.
+    auto previousTask = m_prefetchTasks[(slot + m_prefetchDepth - 1) % m_prefetchDepth];
+    auto dataTransferIndex = (m_currentDataTransferIndex + minibatchesAhead) % m_dataTransferers.size();
+    if (m_prefetchTasks[slot].valid()) // i.e. not the first task of the epoch, so the transferer's buffers are in use by the network
+    {
+        // Record an event that prefetch can wait on to ensure that prior compute has finished.
+        if (m_dataTransferers[dataTransferIndex])
+            m_dataTransferers[dataTransferIndex]->RecordComputeStreamSyncPoint();
+    }
+
+    m_prefetchTasks[slot] = std::async(m_launchType,
+    [this, slot, dataTransferIndex, previousTask]()
+    {
+        // The reader is not thread safe, and the minibatches have to be read in order.
+        if (previousTask.valid() && previousTask.get().m_isEndOfEpoch)
+            return PrefetchResult{ true, false };
+        ReaderStatisticsScope statisticsScope(&m_statistics);
+        return PrefetchMinibatch(slot, dataTransferIndex);
+    }).share();
+}
+
+template <class ElemType>
+void ReaderShim<ElemType>::WaitForPrefetches()
+{
+    for (const auto& prefetchTask : m_prefetchTasks)
+    {
+        if (prefetchTask.valid())
+            prefetchTask.wait();
+    }
 }
 
 string EnumerateInputs(const unordered_map<wstring, size_t>& nameToStreamId)
@@ -179,9 +248,21 @@ bool ReaderShim<ElemType>::GetMinibatch(StreamMinibatchInputs& matrices)
         }
     }
 
-    // Make sure the prefetch has finished.
-    assert(m_prefetchTask.valid());
-    auto result = m_prefetchTask.get();
+    // Make sure the prefetch has finished. How many prefetches are done at this point tells whether the reader keeps up.
+    size_t readyMinibatches = 0;
+    for (const auto& prefetchTask : m_prefetchTasks)
+    {
+        if (prefetchTask.valid() && prefetchTask.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            readyMinibatches++;
+    }
+
+    auto slot = m_currentSlot;
+    assert(m_prefetchTasks[slot].valid());
+    Timer waitTimer;
+    waitTimer.Start();
+    auto result = m_prefetchTasks[slot].get();
+    waitTimer.Stop();
+    m_statistics.AddWait(waitTimer.ElapsedSeconds(), readyMinibatches);
 
     // Ok, prefetch is done.
     m_endOfEpoch = result.m_isEndOfEpoch;
@@ -194,18 +275,15 @@ bool ReaderShim<ElemType>::GetMinibatch(StreamMinibatchInputs& matrices)
     // Remember current data transfer, async memcpy for it already started on the prefetch thread.
     auto currentDataTransferIndex = m_currentDataTransferIndex;
 
-    // Let's update the current data transferer.
-    m_currentDataTransferIndex = (m_currentDataTransferIndex + 1) % 2;
-
-    // Record an event that prefetch can wait on to ensure that prior compute has finished.
-    if (m_dataTransferers[m_currentDataTransferIndex])
-        m_dataTransferers[m_currentDataTransferIndex]->RecordComputeStreamSyncPoint();
+    auto& prefetchBuffers = m_prefetchBuffers[slot];
 
     // We have some data - let's swap the matrices.
     // We cannot simply change pointers because it seems they are remembered deeper in the network.
     for (auto i = matrices.begin(); i != matrices.end(); ++i)
     {
-        std::swap(i->second.GetMatrix<ElemType>(), *m_prefetchBuffers[i->first].m_matrix);
+        std::swap(i->second.GetMatrix<ElemType>(), *prefetchBuffers[i->first].m_matrix);
+        if (prefetchBuffers[i->first].m_images)
+            std::swap(m_currentImages[i->first], prefetchBuffers[i->first].m_images);
 
         // Resetting layouts.
         i->second.pMBLayout->Init(1, 0);
@@ -217,7 +295,7 @@ bool ReaderShim<ElemType>::GetMinibatch(StreamMinibatchInputs& matrices)
     // Let's now check the layouts and throw if the same layout is being assigned twice.
     for (auto i = matrices.begin(); i != matrices.end(); ++i)
     {
-        auto streamLayout = m_prefetchBuffers[i->first].m_mbLayout;
+        auto streamLayout = prefetchBuffers[i->first].m_mbLayout;
         auto& layout = i->second.pMBLayout;
         if (layout->GetNumCols() == 0) // just initialized, let's take the layout of the reader.
         {
@@ -238,26 +316,49 @@ bool ReaderShim<ElemType>::GetMinibatch(StreamMinibatchInputs& matrices)
     // So pick up the first one.
     m_numParallelSequences = matrices.begin()->second.pMBLayout->GetNumParallelSequences();
 
-    // It is time to issue the next prefetch.
+    // It is time to issue the next prefetch, into the slot we have just freed.
+    // Its data transferer is not the current one, so the copy below cannot be confused with the new one.
     if (!m_endOfEpoch)
-    {
-        // Starting the prefetch task. There is always a single async read in flight.
-        // When the network requests a new minibatch, we wait for the current async to finish, swap the buffers
-        // and kick off the new prefetch.
-        auto localCurrentDataTransferIndex = m_currentDataTransferIndex;
-        m_prefetchTask = std::async(m_launchType, [this, localCurrentDataTransferIndex]() { return PrefetchMinibatch(localCurrentDataTransferIndex); });
-    }
+        StartPrefetch(slot, m_prefetchDepth);
+
+    // Let's update the current slot and data transferer.
+    m_currentSlot = (m_currentSlot + 1) % m_prefetchDepth;
+    m_currentDataTransferIndex = (m_currentDataTransferIndex + 1) % m_dataTransferers.size();
 
-    // Let's wait till the previous memcopy has finished.
+    // The network must not touch the new data before its memcopy has finished. Instead of blocking here,
+    // let the compute stream wait for it, so that the copy overlaps with whatever the CPU does until then.
     if (m_dataTransferers[currentDataTransferIndex])
-        m_dataTransferers[currentDataTransferIndex]->WaitForCopyCPUToGPU();
+        m_dataTransferers[currentDataTransferIndex]->WaitForCopyCPUToGPUOnComputeStreamAsync();
+
+    // 8-bit images are converted into the input matrices now, on the compute stream after their copy. Their buffer
+    // goes back to a prefetch slot only once the network is done with this minibatch (see StartPrefetch()).
+    if (!m_currentImages.empty())
+    {
+        for (auto i = matrices.begin(); i != matrices.end(); ++i)
+        {
+            auto images = m_currentImages.find(i->first);
+            if (images == m_currentImages.end())
+                continue;
+            const auto& augmentation = *m_streams[m_nameToStreamId[i->first]]->m_deviceAugmentation;
+            i->second.GetMatrix<ElemType>().AssignAugmentedImages(*images->second, augmentation.m_params, *m_imageMeans[i->first],
+                                                                  PhiloxKey(augmentation.m_seed, (uint32_t)m_numAugmentedMinibatches));
+        }
+        m_numAugmentedMinibatches++;
+    }
 
     return result.m_isDataAvailable;
 }
 
 template <class ElemType>
-typename ReaderShim<ElemType>::PrefetchResult ReaderShim<ElemType>::PrefetchMinibatch(size_t currentDataTransferIndex)
+typename ReaderShim<ElemType>::PrefetchResult ReaderShim<ElemType>::PrefetchMinibatch(size_t slot, size_t currentDataTransferIndex)
 {
+    // The packers alternate between two buffers, so the one we are about to pack into could still be the source
+    // of the copy of the minibatch before last, as the main thread does not wait for the copies on the CPU.
+    // (With a single minibatch in flight that is the previous copy of this very transferer.)
+    auto& previousTransferer = m_dataTransferers[(currentDataTransferIndex + m_dataTransferers.size() - 2) % m_dataTransferers.size()];
+    if (previousTransferer)
+        previousTransferer->WaitForCopyCPUToGPU();
+
     Minibatch minibatch = m_reader->ReadMinibatch();
 
     // If there is no data we can simply return.
@@ -271,15 +372,39 @@ typename ReaderShim<ElemType>::PrefetchResult ReaderShim<ElemType>::PrefetchMini
     if (m_dataTransferers[currentDataTransferIndex])
         m_dataTransferers[currentDataTransferIndex]->WaitForSyncPointOnAssignStreamAsync();
 
-    for (auto& mx : m_prefetchBuffers)
+    ReaderStageTimer transferTimer(ReaderStage::transfer);
+    size_t numberOfSamples = 0;
+    size_t sizeInBytes = 0;
+    for (auto& mx : m_prefetchBuffers[slot])
     {
         size_t streamId = m_nameToStreamId[mx.first];
         const auto& stream = minibatch.m_data[streamId];
-        mx.second.m_mbLayout = stream->m_layout;
+        if (m_prefetchDepth > 1)
+        {
+            // Some packers reuse their layouts for the next minibatch, which may be read before this one is consumed.
+            mx.second.m_mbLayout = std::make_shared<MBLayout>();
+            mx.second.m_mbLayout->CopyFrom(stream->m_layout);
+        }
+        else
+            mx.second.m_mbLayout = stream->m_layout;
 
         size_t sampleSize = m_streams[streamId]->m_sampleLayout->GetNumElements();
-        FillMatrixFromStream(m_streams[streamId]->m_storageType, mx.second.m_matrix.get(), sampleSize, stream, m_dataTransferers[currentDataTransferIndex].get());
+        if (mx.second.m_images)
+        {
+            // 8-bit images, converted by the main thread (see GetMinibatch())
+            size_t numCols = stream->m_layout->GetNumCols();
+            mx.second.m_images->SetValue(sampleSize, numCols, mx.second.m_images->GetDeviceId(), reinterpret_cast<char*>(stream->m_data), matrixFlagNormal, m_dataTransferers[currentDataTransferIndex].get());
+            sizeInBytes += sampleSize * numCols;
+        }
+        else
+        {
+            FillMatrixFromStream(m_streams[streamId]->m_storageType, mx.second.m_matrix.get(), sampleSize, stream, m_dataTransferers[currentDataTransferIndex].get());
+            sizeInBytes += GetStreamSizeInBytes(m_streams[streamId]->m_storageType, sampleSize, stream);
+        }
+
+        numberOfSamples = std::max(numberOfSamples, stream->m_layout->GetActualNumSamples());
     }
+    m_statistics.AddMinibatch(numberOfSamples, sizeInBytes);
 
     // Let's record that we started the copy, so that the main thread can wait afterwards.
     if (m_dataTransferers[currentDataTransferIndex])
@@ -289,6 +414,18 @@ typename ReaderShim<ElemType>::PrefetchResult ReaderShim<ElemType>::PrefetchMini
 }
 
 
+template <class ElemType>
+/*static*/ size_t ReaderShim<ElemType>::GetStreamSizeInBytes(StorageType type, size_t numRows, const StreamMinibatchPtr& stream)
+{
+    size_t numCols = stream->m_layout->GetNumCols();
+    if (type == StorageType::dense)
+        return numRows * numCols * sizeof(ElemType);
+
+    // See the layout in SparseStreamMinibatchHeader; the whole capacity is transferred.
+    const auto* header = reinterpret_cast<const SparseStreamMinibatchHeader*>(stream->m_data);
+    return sizeof(*header) + header->m_nnzCapacity * (sizeof(ElemType) + sizeof(IndexType)) + (numCols + 1) * sizeof(IndexType);
+}
+
 template <class ElemType>
 /*static*/ void ReaderShim<ElemType>::FillMatrixFromStream(StorageType type, Matrix<ElemType>* matrix, size_t numRows, const StreamMinibatchPtr& stream, DataTransferer* transferer)
 {
@@ -302,13 +439,13 @@ template <class ElemType>
     else if (type == StorageType::sparse_csc)
     {
         // In the sparse case the m_data layout is identical to CUDA's CSC layout
-        // (see http://docs.nvidia.com/cuda/cusparse/#compressed-sparse-column-format-csc).
-        size_t* data = reinterpret_cast<size_t*>(stream->m_data);
-        size_t nnzCount = *data;
-        ElemType* values = reinterpret_cast<ElemType*>(data + 1);
-        IndexType* rows = reinterpret_cast<IndexType*>(values + nnzCount);
-        IndexType* columns = reinterpret_cast<IndexType*>(rows + nnzCount);
-        matrix->SetMatrixFromCSCFormat(columns, rows, values, nnzCount, numRows, numCols, transferer);
+        // (see http://docs.nvidia.com/cuda/cusparse/#compressed-sparse-column-format-csc),
+        // with the values and row indices of the capacity of the buffer of a GPUSparseMatrix.
+        const auto* header = reinterpret_cast<const SparseStreamMinibatchHeader*>(stream->m_data);
+        ElemType* values = reinterpret_cast<ElemType*>(reinterpret_cast<char*>(stream->m_data) + sizeof(SparseStreamMinibatchHeader));
+        IndexType* rows = reinterpret_cast<IndexType*>(values + header->m_nnzCapacity);
+        IndexType* columns = reinterpret_cast<IndexType*>(rows + header->m_nnzCapacity);
+        matrix->SetMatrixFromCSCFormat(columns, rows, values, header->m_nnzCount, numRows, numCols, transferer);
     }
     else
         RuntimeError("Storage type %d is not supported.", (int)type);
@@ -42,10 +42,13 @@ public:
         // Make sure there are no outstanding reads.
         // Future destructor does not wait as of 2013 so probably it is not in VS2013:
         // More info can be found here http://www.open-std.org/jtc1/sc22/wg21/docs/papers/2013/n3679.html.
-        if (m_prefetchTask.valid())
+        for (const auto& prefetchTask : m_prefetchTasks)
         {
-            // If there are some, give them time to finish.
-            m_prefetchTask.wait_for(std::chrono::seconds(5));
+            if (prefetchTask.valid())
+            {
+                // If there are some, give them time to finish.
+                prefetchTask.wait_for(std::chrono::seconds(5));
+            }
         }
 
         delete this;
@@ -82,6 +85,19 @@ public:
 
     virtual size_t GetNumParallelSequencesForFixingBPTTMode() override;
 
+    virtual bool GetAndResetStatistics(ReaderStatistics& statistics) override
+    {
+        statistics = m_statistics.GetAndReset();
+        return true;
+    }
+
+    // (the randomizers split the sequences of each minibatch by them; decimation by chunks keeps equal shares)
+    virtual bool SetWorkerShares(const std::vector<double>& shares) override
+    {
+        m_workerShares = shares;
+        return true;
+    }
+
 private:
     struct PrefetchResult
     {
@@ -89,9 +105,18 @@ private:
         bool m_isDataAvailable;
     };
 
-    PrefetchResult PrefetchMinibatch(size_t currentDataTransferIndex);
+    PrefetchResult PrefetchMinibatch(size_t slot, size_t currentDataTransferIndex);
 
-    std::future<PrefetchResult> m_prefetchTask;
+    // Starts the prefetch into the given slot of the minibatch that many minibatches after the current one.
+    // Its read follows the one of the previously started prefetch.
+    void StartPrefetch(size_t slot, size_t minibatchesAhead);
+
+    // Waits for all prefetches in flight.
+    void WaitForPrefetches();
+
+    // Prefetch tasks, one per slot. Each task reads its minibatch only after the previously started
+    // task is done, so the minibatches are read in order.
+    std::vector<std::shared_future<PrefetchResult>> m_prefetchTasks;
     ReaderPtr m_reader;
     ReaderFactory m_factory;
     bool m_endOfEpoch;
@@ -107,25 +132,47 @@ private:
     {
         std::shared_ptr<Matrix<ElemType>> m_matrix;
         MBLayoutPtr m_mbLayout;
+        std::shared_ptr<Matrix<char>> m_images; // of a stream of 8-bit images converted on the device, instead of m_matrix
     };
 
-    // Intermediate buffer where the prefetch thread puts its data to.
-    // When the main thread enters GetMinibatch it swaps the matrices from this buffer,
-    // triggers the next prefetch and waits if memCpy is still in progress.
-    std::unordered_map<std::wstring, StreamPrefetchBuffer> m_prefetchBuffers;
+    // Intermediate buffers where the prefetch threads put their data to, one set per slot.
+    // When the main thread enters GetMinibatch it swaps the matrices from the buffers of the current slot,
+    // triggers the next prefetch into this slot and waits if memCpy is still in progress.
+    std::vector<std::unordered_map<std::wstring, StreamPrefetchBuffer>> m_prefetchBuffers;
+
+    // Number of minibatches prefetched ahead of the one being consumed (the number of slots).
+    size_t m_prefetchDepth;
+
+    // Slot of the next minibatch to be consumed.
+    size_t m_currentSlot;
 
-    // Alternating data transfer operations. In the current version these are only two - 
-    // currently waiting on the main thread and the one that can be started by the prefetch thread 
-    // in the meantime.
+    // Rotating data transfer operations, one more than there are slots - one for each prefetch in flight
+    // and the one currently waiting on the main thread.
     std::vector<DataTransfererPtr> m_dataTransferers;
 
-    // Current data transfer. Flips 0 and 1.
-    // Can be changed only from the main thread with no ongoing prefetch.
-    size_t m_currentDataTransferIndex; 
+    // Data transfer for the next minibatch to be consumed, cycles through m_dataTransferers.
+    // Can be changed only from the main thread.
+    size_t m_currentDataTransferIndex;
 
     // Device id.
     int m_deviceId;
 
+    // The 8-bit images of the current minibatch per stream converted on the device (see DeviceImageAugmentation),
+    // swapped with those of its prefetch buffer, and the mean images of these streams.
+    std::unordered_map<std::wstring, std::shared_ptr<Matrix<char>>> m_currentImages;
+    std::unordered_map<std::wstring, std::shared_ptr<Matrix<ElemType>>> m_imageMeans;
+    // Minibatches converted so far, the random stream of the augmentation of each.
+    size_t m_numAugmentedMinibatches;
+
+    // Timers of the stages of the reader, which run on the prefetch threads.
+    ReaderStatisticsCollector m_statistics;
+
+    // of the workers in the distributed minibatch loops, see SetWorkerShares()
+    std::vector<double> m_workerShares;
+
+    // Returns the size of the data of a stream of a minibatch.
+    static size_t GetStreamSizeInBytes(StorageType type, size_t numRows, const StreamMinibatchPtr& stream);
+
     static void FillMatrixFromStream(
         StorageType type,
         Matrix<ElemType>* matrix,
@@ -36,6 +36,13 @@ MBLayoutPtr SequencePacker::CreateMBLayout(const StreamBatch& batch)
     return pMBLayout;
 }
 
+void SequencePacker::StartEpoch(const EpochConfiguration& config, const std::vector<MemoryProviderPtr>& memoryProviders)
+{
+    PackerBase::StartEpoch(config, memoryProviders);
+    m_epochColumns = 0;
+    m_epochGaps = 0;
+}
+
 Minibatch SequencePacker::ReadMinibatch()
 {
     auto sequences = m_sequenceEnumerator->GetNextSequences(m_minibatchSize);
@@ -44,6 +51,8 @@ Minibatch SequencePacker::ReadMinibatch()
     Minibatch minibatch(sequences.m_endOfEpoch);
     if (batch.empty())
     {
+        if (m_verbosity > 0)
+            ReportPadding(minibatch);
         return minibatch;
     }
 
@@ -73,9 +82,40 @@ Minibatch SequencePacker::ReadMinibatch()
     }
 
     m_currentBufferIndex = (m_currentBufferIndex + 1) % m_numberOfBuffers;
+
+    if (m_verbosity > 0)
+        ReportPadding(minibatch);
     return minibatch;
 }
 
+void SequencePacker::ReportPadding(const Minibatch& minibatch)
+{
+    // Streams can have sequences of different lengths, the largest layout is the one that takes most compute.
+    MBLayoutPtr layout;
+    for (const auto& stream : minibatch.m_data)
+    {
+        if (!layout || stream->m_layout->GetNumCols() > layout->GetNumCols())
+            layout = stream->m_layout;
+    }
+
+    if (layout)
+    {
+        const size_t columns = layout->GetNumCols();
+        const size_t gaps = columns - layout->GetActualNumSamples();
+        m_epochColumns += columns;
+        m_epochGaps += gaps;
+
+        if (m_verbosity > 1)
+            fprintf(stderr, "SequencePacker: minibatch of %" PRIu64 " sequences in %" PRIu64 " parallel sequences x %" PRIu64 " time steps, padding ratio %.2f%%\n",
+                    (uint64_t)layout->GetNumSequences(), (uint64_t)layout->GetNumParallelSequences(), (uint64_t)layout->GetNumTimeSteps(),
+                    columns > 0 ? 100.0 * gaps / columns : 0.0);
+    }
+
+    if (minibatch.m_endOfEpoch)
+        fprintf(stderr, "SequencePacker: epoch padding ratio %.2f%% (%" PRIu64 " gap frames out of %" PRIu64 ")\n",
+                m_epochColumns > 0 ? 100.0 * m_epochGaps / m_epochColumns : 0.0, (uint64_t)m_epochGaps, (uint64_t)m_epochColumns);
+}
+
 void SequencePacker::CheckSampleShape(const std::vector<SequenceDataPtr>& minibatch, StreamDescriptionPtr outputStream)
 {
     assert(!minibatch.empty());
@@ -190,40 +230,30 @@ MBLayoutPtr SequencePacker::PackSparseStream(const StreamBatch& batch, size_t st
         nnzCount += sparseSequence->m_totalNnzCount;
     }
 
-    if (nnzCount > numeric_limits<IndexType>::max())
-    {
-        RuntimeError("Minibatch NNZ count (%" PRIu64 ") exceeds the maximum allowed "
-            "value (%" PRIu64 ")\n", nnzCount, (size_t)numeric_limits<IndexType>::max());
-    }
-
     const auto& stream = m_inputStreamDescriptions[streamIndex];
     assert(stream->m_storageType == StorageType::sparse_csc);
     auto elementSize = GetSizeByType(stream->m_elementType);
     auto indexSize = sizeof(IndexType);
     auto pMBLayout = CreateMBLayout(batch);
 
-    // Compute the required buffer size:
-    // size of nnz type + nnz * (size of the element type) + nnz * (size of the row index type) + 
-    // (number of columns + 1) * (size of the column index type). 
-    size_t requiredSize =
-        sizeof(nnzCount) +
-        nnzCount * (elementSize + indexSize) +
-        indexSize * (pMBLayout->GetNumCols() + 1);
-
+    SparseStreamMinibatchHeader header = PrepareSparseBuffer(streamIndex, nnzCount, pMBLayout->GetNumCols());
     auto& buffer = m_streamBuffers[m_currentBufferIndex][streamIndex];
-    if (buffer.m_size < requiredSize)
-    {
-        buffer.Resize(requiredSize);
-    }
-
     auto* destination = buffer.m_data.get();
-    // insert the nnzCount as the first element in the buffer.
-    memcpy(destination, &nnzCount, sizeof(nnzCount));
 
     // create two pointers to the memory blocks inside the buffer,
     // one for data portion and anther -- for indices.
-    auto* dataDst = destination + sizeof(nnzCount);
-    auto* indicesDst = dataDst + elementSize* nnzCount;
+    auto* dataDst = destination + sizeof(header);
+    auto* indicesDst = dataDst + elementSize * header.m_nnzCapacity;
+
+    // If the samples of each sequence take consecutive columns (a single parallel sequence, or a single
+    // time step as in frame mode), the sequences are taken over as a whole: their values and row indices
+    // are copied in one go and their column offsets are shifted by the number of non zero values in front of them.
+    if (pMBLayout->GetNumParallelSequences() == 1 || pMBLayout->GetNumTimeSteps() == 1)
+    {
+        PackSparseSequences(batch, pMBLayout, nnzCount, header.m_nnzCapacity, elementSize, dataDst, indicesDst);
+        return pMBLayout;
+    }
+
     // column index for the current sample (= number of nnz value packed so far).
     IndexType columnOffset = 0;
     // a vector to store column index for each sample in the resulting (packed) matrix.
@@ -296,7 +326,7 @@ MBLayoutPtr SequencePacker::PackSparseStream(const StreamBatch& batch, size_t st
     assert(accumulate(sequenceOffsets.begin(), sequenceOffsets.end(), 0) == nnzCount);
 
     // check the distance between data and index destination pointers.
-    assert(indicesDst == dataDst + nnzCount * indexSize);
+    assert(indicesDst == dataDst + (header.m_nnzCapacity - nnzCount) * elementSize + nnzCount * indexSize);
     // after we packed all samples, the column offset must be equal to the total nnz count.
     assert(columnOffset == nnzCount);
     sparseColumnIndices.push_back(columnOffset);
@@ -304,12 +334,72 @@ MBLayoutPtr SequencePacker::PackSparseStream(const StreamBatch& batch, size_t st
     // column in the packed matrix)
     assert((pMBLayout->GetNumCols() + 1) == sparseColumnIndices.size());
 
+    // the column indices follow the row indices of the whole capacity.
+    indicesDst += (header.m_nnzCapacity - nnzCount) * indexSize;
     // verify that there's enough space in the buffer for the array of column indices.
-    assert(indicesDst + sparseColumnIndices.size()*indexSize <= destination + requiredSize);
+    assert(indicesDst + sparseColumnIndices.size()*indexSize <= destination + buffer.m_size);
     // copy column indices into the buffer.
     memcpy(indicesDst, sparseColumnIndices.data(), sparseColumnIndices.size() * indexSize);
 
     return pMBLayout;
 }
 
+void SequencePacker::PackSparseSequences(const StreamBatch& batch, const MBLayoutPtr& pMBLayout, size_t nnzCount, size_t nnzCapacity,
+                                         size_t elementSize, char* dataDst, char* indicesDst)
+{
+    const auto& sequenceInfos = pMBLayout->GetAllSequences();
+    const size_t numberOfColumns = pMBLayout->GetNumCols();
+    const size_t numberOfParallelSequences = pMBLayout->GetNumParallelSequences();
+
+    // the sequences in the order of their first column.
+    vector<size_t> order(sequenceInfos.size());
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        return sequenceInfos[a].tBegin * numberOfParallelSequences + sequenceInfos[a].s <
+               sequenceInfos[b].tBegin * numberOfParallelSequences + sequenceInfos[b].s;
+    });
+
+    // the column indices follow the row indices of the whole capacity.
+    IndexType* columnIndicesDst = reinterpret_cast<IndexType*>(indicesDst + nnzCapacity * sizeof(IndexType));
+
+    // column index for the current sample (= number of nnz value packed so far).
+    IndexType columnOffset = 0;
+    size_t column = 0;
+    for (size_t index : order)
+    {
+        const auto& sequenceInfo = sequenceInfos[index];
+        assert(sequenceInfo.tBegin >= 0 && sequenceInfo.tEnd <= (ptrdiff_t)pMBLayout->GetNumTimeSteps());
+        assert(column == sequenceInfo.tBegin * numberOfParallelSequences + sequenceInfo.s);
+        const size_t numberOfSamples = sequenceInfo.GetNumTimeSteps();
+
+        // Each sequence writes the offsets of its columns and of the column after it,
+        // the latter is overwritten by the next sequence.
+        if (sequenceInfo.seqId == GAP_SEQUENCE_ID)
+        {
+            fill(columnIndicesDst + column, columnIndicesDst + column + numberOfSamples + 1, columnOffset);
+        }
+        else
+        {
+            const auto& sequence = static_cast<const SparseSequenceData&>(*batch[sequenceInfo.seqId]);
+            assert(sequence.m_numberOfSamples == numberOfSamples);
+            PackColumnOffsets(columnIndicesDst + column, sequence, numberOfSamples + 1, columnOffset);
+
+            const size_t nnz = sequence.m_totalNnzCount;
+            memcpy(dataDst, batch[sequenceInfo.seqId]->GetDataBuffer(), nnz * elementSize);
+            dataDst += nnz * elementSize;
+            memcpy(indicesDst, sequence.m_indices, nnz * sizeof(IndexType));
+            indicesDst += nnz * sizeof(IndexType);
+            columnOffset += sequence.m_totalNnzCount;
+        }
+        column += numberOfSamples;
+    }
+
+    // all columns have been packed, and all values have been copied.
+    assert(column == numberOfColumns);
+    assert(columnOffset == nnzCount);
+    assert(columnIndicesDst[numberOfColumns] == columnOffset);
+    UNUSED(numberOfColumns);
+}
+
 }}}
@@ -14,13 +14,21 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 class SequencePacker : public PackerBase
 {
 public:
+    // With verbosity > 0 the padding of the minibatches (gap frames in their layout) is reported at the end of an epoch,
+    // with verbosity > 1 also for each minibatch.
     SequencePacker(
         SequenceEnumeratorPtr sequenceEnumerator,
         const std::vector<StreamDescriptionPtr>& streams,
-        size_t numberOfBuffers = 2) :
-        PackerBase(sequenceEnumerator, streams, numberOfBuffers)
+        size_t numberOfBuffers = 2,
+        int verbosity = 0) :
+        PackerBase(sequenceEnumerator, streams, numberOfBuffers),
+        m_verbosity(verbosity),
+        m_epochColumns(0),
+        m_epochGaps(0)
     {}
 
+    virtual void StartEpoch(const EpochConfiguration& config, const std::vector<MemoryProviderPtr>& memoryProviders) override;
+
     virtual Minibatch ReadMinibatch() override;
 
 protected:
@@ -28,12 +36,25 @@ protected:
 
     virtual MBLayoutPtr PackSparseStream(const StreamBatch& batch, size_t streamIndex);
 
+    // Packs sparse sequences that take consecutive columns of the layout, a sequence at a time.
+    void PackSparseSequences(const StreamBatch& batch, const MBLayoutPtr& pMBLayout, size_t nnzCount, size_t nnzCapacity,
+                             size_t elementSize, char* dataDst, char* indicesDst);
+
     // Given a number of sequences, creates an MB layout that is used to guide
     // the actual packing.
     virtual MBLayoutPtr CreateMBLayout(const StreamBatch& batch);
 
     // Helper function to check the sample shape of input samples.
     void CheckSampleShape(const std::vector<SequenceDataPtr>& minibatch, StreamDescriptionPtr outputStream);
+
+    // Reports the padding of the minibatch and accumulates it for the epoch.
+    void ReportPadding(const Minibatch& minibatch);
+
+    int m_verbosity;
+
+    // Columns of the packed layouts and how many of them are gaps, in the current epoch.
+    size_t m_epochColumns;
+    size_t m_epochGaps;
 };
 
 typedef std::shared_ptr<SequencePacker> SequencePackerPtr;
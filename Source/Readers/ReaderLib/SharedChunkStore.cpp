@@ -0,0 +1,175 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include "SharedChunkStore.h"
+#include "SharedMemorySegment.h"
+#include "ChunkImage.h"
+#include "../../Common/CrossProcessMutex.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// The process that creates a segment holds the owner lock of the segment for as long as the segment exists. The system
+// releases the lock if the process dies, so a segment whose lock can be taken was left behind, whatever became of the
+// id of its process (e.g. reused, or of another PID namespace). On Windows segments go away with their processes anyway.
+static std::unique_ptr<CrossProcessMutex> TryAcquireOwnerLock(const std::string& segmentName, bool wait)
+{
+#ifdef _WIN32
+    UNUSED(segmentName);
+    UNUSED(wait);
+    return nullptr;
+#else
+    auto lock = std::make_unique<CrossProcessMutex>(segmentName + ".owner");
+    if (!lock->Acquire(wait))
+        return nullptr;
+    return lock;
+#endif
+}
+
+// A chunk whose sequences point into a segment, which they keep alive.
+class SharedChunkStore::SharedChunk : public ChunkImageChunk
+{
+public:
+    // 'ownerLock' is that of the segment if this process created it (null on Windows).
+    SharedChunk(std::unique_ptr<SharedMemorySegment>&& segment, bool owner, std::unique_ptr<CrossProcessMutex>&& ownerLock, size_t numberOfStreams)
+        : m_ownerLock(std::move(ownerLock)), m_segment(std::move(segment)), m_owner(owner)
+    {
+        Attach(m_segment->Data(), m_segment->Size(), numberOfStreams, "segment " + m_segment->Name());
+    }
+
+    ~SharedChunk()
+    {
+        // Processes that ask for the chunk from now on load it again.
+        if (m_owner)
+            m_segment->Unlink();
+    }
+
+private:
+    std::unique_ptr<CrossProcessMutex> m_ownerLock; // released after the segment was unlinked
+    std::unique_ptr<SharedMemorySegment> m_segment;
+    bool m_owner;
+};
+
+SharedChunkStore::SharedChunkStore(IDataDeserializerPtr deserializer, const std::string& name, int verbosity)
+    : m_deserializer(deserializer),
+      m_name(name),
+      m_verbosity(verbosity),
+      m_numLoaded(0),
+      m_numAttached(0),
+      m_numFailed(0)
+{
+    // The name goes into the names of files and shared memory segments.
+    if (m_name.empty() || m_name.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-.") != std::string::npos)
+        InvalidArgument("SharedChunkStore: The name '%s' must be non-empty and consist of letters, digits, '_', '-' and '.' only.", m_name.c_str());
+
+    const size_t numberOfChunks = m_deserializer->GetChunkDescriptions().size();
+    m_chunkLocks.reserve(numberOfChunks);
+    for (size_t i = 0; i < numberOfChunks; ++i)
+        m_chunkLocks.push_back(std::make_unique<std::mutex>());
+}
+
+SharedChunkStore::~SharedChunkStore()
+{
+    if (m_verbosity >= 2)
+        fprintf(stderr, "SharedChunkStore: %" PRIu64 " chunks loaded, %" PRIu64 " chunks taken over from other processes, %" PRIu64 " chunks not shared.\n",
+                (uint64_t)m_numLoaded, (uint64_t)m_numAttached, (uint64_t)m_numFailed);
+}
+
+std::string SharedChunkStore::GetSegmentName(ChunkIdType chunkId) const
+{
+    return "cntk-chunks-" + m_name + "-" + std::to_string(chunkId);
+}
+
+ChunkPtr SharedChunkStore::GetChunk(ChunkIdType chunkId)
+{
+    if (chunkId >= m_chunkLocks.size())
+        LogicError("SharedChunkStore: Invalid chunk id %u.", chunkId);
+
+    std::lock_guard<std::mutex> chunkLock(*m_chunkLocks[chunkId]);
+    const std::string segmentName = GetSegmentName(chunkId);
+    try
+    {
+        CrossProcessMutex mutex(segmentName + ".lock");
+        if (!mutex.Acquire(true))
+            RuntimeError("SharedChunkStore: Could not acquire the lock of segment %s.", segmentName.c_str());
+
+        std::unique_ptr<CrossProcessMutex> ownerLock;
+        auto segment = SharedMemorySegment::Open(segmentName);
+        if (segment)
+        {
+            // (the owner lock of a segment of this process, of another store, would be taken by the process itself)
+            ChunkImageHeader header;
+            bool leftBehind = !ReadChunkImageHeader(segment->Data(), segment->Size(), header);
+            if (!leftBehind && header.m_processId != GetCurrentProcessId())
+            {
+                ownerLock = TryAcquireOwnerLock(segmentName, false);
+                leftBehind = !!ownerLock;
+            }
+            if (leftBehind)
+            {
+                // by a process that failed while writing it, or that died without releasing it
+                segment.reset();
+                SharedMemorySegment::Unlink(segmentName);
+            }
+        }
+
+        bool owner = !segment;
+        if (owner)
+        {
+#ifndef _WIN32
+            // (waits for a previous owner that unlinked its segment but is still about to release its lock)
+            if (!ownerLock)
+                ownerLock = TryAcquireOwnerLock(segmentName, true);
+            if (!ownerLock)
+                RuntimeError("SharedChunkStore: Could not acquire the owner lock of segment %s.", segmentName.c_str());
+#endif
+            segment = CreateSegment(chunkId, segmentName);
+            if (!segment)
+                RuntimeError("SharedChunkStore: Segment %s was created by another process while the lock was held.", segmentName.c_str());
+        }
+
+        const size_t size = segment->Size();
+        std::shared_ptr<SharedChunk> chunk;
+        try
+        {
+            chunk = std::make_shared<SharedChunk>(std::move(segment), owner, std::move(ownerLock), m_deserializer->GetStreamDescriptions().size());
+        }
+        catch (...)
+        {
+            if (owner)
+                SharedMemorySegment::Unlink(segmentName);
+            throw;
+        }
+        mutex.Release();
+
+        if (m_verbosity >= 2)
+            fprintf(stderr, "SharedChunkStore: %s chunk %u (%" PRIu64 " bytes).\n", owner ? "Loaded" : "Took over", chunkId, (uint64_t)size);
+        ++(owner ? m_numLoaded : m_numAttached);
+        return chunk;
+    }
+    catch (const std::exception& e)
+    {
+        // e.g. no shared memory, or no space left in it
+        if (m_numFailed++ == 0)
+            fprintf(stderr, "WARNING: SharedChunkStore: Chunk %u cannot be shared (%s), loading it without shared memory.\n", chunkId, e.what());
+        return m_deserializer->GetChunk(chunkId);
+    }
+}
+
+std::unique_ptr<SharedMemorySegment> SharedChunkStore::CreateSegment(ChunkIdType chunkId, const std::string& segmentName)
+{
+    std::unique_ptr<SharedMemorySegment> segment;
+    WriteChunkImage(*m_deserializer, chunkId, GetCurrentProcessId(), [&](size_t size)
+    {
+        segment = SharedMemorySegment::Create(segmentName, size);
+        return segment ? segment->Data() : nullptr;
+    });
+    return segment;
+}
+
+}}}
@@ -0,0 +1,98 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "DataDeserializer.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+class SharedMemorySegment;
+
+// A store of chunks in named shared memory, for the processes on a machine that read the same data
+// (e.g. one process per GPU, each with its randomizer that decimates the sequences for its own worker).
+// Implemented as a wrapping proxy around a deserializer, like the ChunkCache: the first process that asks for a
+// chunk loads it from the deserializer and copies its sequences into a shared memory segment, the other processes
+// map that segment read-only and hand out sequences that point into it. A cross process mutex per chunk makes
+// sure that a chunk is loaded only once while its segment exists.
+// The segment of a chunk goes away once the process that loaded it releases it. Processes that ask for the chunk
+// later load it again, so the store saves most when the processes go over the chunks in about the same order.
+// The loading process holds a lock of the segment as long as the segment exists, which the system releases if the process
+// dies, so that the segments of processes that died are loaded again.
+class SharedChunkStore : public IDataDeserializer
+{
+public:
+    // 'name' identifies the data set, it has to be the same for all processes that share chunks, and must not be
+    // used in the meantime by other processes that read different data. With 'verbosity' >= 2, reports the chunks
+    // that are loaded and the ones taken over from other processes.
+    SharedChunkStore(IDataDeserializerPtr deserializer, const std::string& name, int verbosity = 0);
+
+    ~SharedChunkStore();
+
+    virtual std::vector<StreamDescriptionPtr> GetStreamDescriptions() const override
+    {
+        return m_deserializer->GetStreamDescriptions();
+    }
+
+    virtual ChunkDescriptions GetChunkDescriptions() override
+    {
+        return m_deserializer->GetChunkDescriptions();
+    }
+
+    virtual void GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& descriptions) override
+    {
+        return m_deserializer->GetSequencesForChunk(chunkId, descriptions);
+    }
+
+    virtual bool GetSequenceDescription(const SequenceDescription& primary, SequenceDescription& description) override
+    {
+        return m_deserializer->GetSequenceDescription(primary, description);
+    }
+
+    // Gets chunk data given its id, from shared memory if possible.
+    virtual ChunkPtr GetChunk(ChunkIdType chunkId) override;
+
+    struct Statistics
+    {
+        size_t m_numLoaded;   // chunks loaded from the deserializer into shared memory by this process
+        size_t m_numAttached; // chunks taken over from the shared memory of another process
+        size_t m_numFailed;   // chunks that could not be shared and were used straight from the deserializer
+    };
+
+    Statistics GetStatistics() const
+    {
+        return Statistics{ m_numLoaded, m_numAttached, m_numFailed };
+    }
+
+private:
+    class SharedChunk;
+
+    // Name of the segment of a chunk.
+    std::string GetSegmentName(ChunkIdType chunkId) const;
+
+    // Loads the chunk from the deserializer and copies it into a new segment, returns nullptr if the segment exists already.
+    std::unique_ptr<SharedMemorySegment> CreateSegment(ChunkIdType chunkId, const std::string& segmentName);
+
+    IDataDeserializerPtr m_deserializer;
+    std::string m_name;
+    int m_verbosity;
+
+    // The cross process mutex is held by the process, so threads of the same process asking for
+    // the same chunk are serialized by a mutex per chunk.
+    std::vector<std::unique_ptr<std::mutex>> m_chunkLocks;
+
+    std::atomic<size_t> m_numLoaded;
+    std::atomic<size_t> m_numAttached;
+    std::atomic<size_t> m_numFailed;
+
+    DISABLE_COPY_AND_MOVE(SharedChunkStore);
+};
+
+}}}
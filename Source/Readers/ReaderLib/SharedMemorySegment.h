@@ -0,0 +1,192 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <memory>
+#include <string>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "Basics.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// A named segment of shared memory, which processes on the same machine can map under its name.
+// On Linux the segment lives in /dev/shm until it is unlinked, even if no process maps it any more;
+// on Windows it is backed by the paging file and goes away with the last process that maps it.
+class SharedMemorySegment
+{
+public:
+    // Maps an existing segment read-only, returns nullptr if there is no segment of the name.
+    static std::unique_ptr<SharedMemorySegment> Open(const std::string& name)
+    {
+        std::unique_ptr<SharedMemorySegment> segment(new SharedMemorySegment(name));
+        return segment->Map(false, 0) ? std::move(segment) : nullptr;
+    }
+
+    // Creates a new segment of the given size and maps it for writing, returns nullptr if a segment of the name exists already.
+    static std::unique_ptr<SharedMemorySegment> Create(const std::string& name, size_t size)
+    {
+        std::unique_ptr<SharedMemorySegment> segment(new SharedMemorySegment(name));
+        return segment->Map(true, size) ? std::move(segment) : nullptr;
+    }
+
+    ~SharedMemorySegment()
+    {
+#ifdef _WIN32
+        if (m_data != nullptr)
+            UnmapViewOfFile(m_data);
+        if (m_mapping != NULL)
+            CloseHandle(m_mapping);
+#else
+        if (m_data != nullptr)
+            munmap(m_data, m_size);
+#endif
+    }
+
+    // Writable only if the segment was created by this process.
+    char* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+    const std::string& Name() const { return m_name; }
+
+    // Removes the name of the segment, so that no other process can open it any more.
+    // Existing mappings stay valid, the memory is freed once the last one is gone.
+    void Unlink()
+    {
+#ifndef _WIN32
+        shm_unlink(SystemName().c_str());
+#endif
+    }
+
+    // Removes the name of a segment that is not mapped by this process, e.g. an incomplete one.
+    static void Unlink(const std::string& name)
+    {
+        SharedMemorySegment(name).Unlink();
+    }
+
+private:
+    explicit SharedMemorySegment(const std::string& name)
+        : m_name(name), m_data(nullptr), m_size(0)
+#ifdef _WIN32
+        , m_mapping(NULL)
+#endif
+    {
+    }
+
+    std::string SystemName() const
+    {
+#ifdef _WIN32
+        return "Local\\" + m_name;
+#else
+        return "/" + m_name;
+#endif
+    }
+
+    bool Map(bool create, size_t size)
+    {
+        const std::string name = SystemName();
+#ifdef _WIN32
+        if (create)
+        {
+            m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, name.c_str());
+            if (m_mapping == NULL)
+                RuntimeError("SharedMemorySegment: Unable to create segment %s, error 0x%x.", name.c_str(), (unsigned int)GetLastError());
+            if (GetLastError() == ERROR_ALREADY_EXISTS)
+                return false;
+        }
+        else
+        {
+            m_mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+            if (m_mapping == NULL)
+            {
+                if (GetLastError() == ERROR_FILE_NOT_FOUND)
+                    return false;
+                RuntimeError("SharedMemorySegment: Unable to open segment %s, error 0x%x.", name.c_str(), (unsigned int)GetLastError());
+            }
+        }
+
+        m_data = (char*)MapViewOfFile(m_mapping, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+        if (m_data == nullptr)
+            RuntimeError("SharedMemorySegment: Unable to map segment %s, error 0x%x.", name.c_str(), (unsigned int)GetLastError());
+
+        if (create)
+        {
+            m_size = size;
+        }
+        else
+        {
+            // the size of the view, rounded up to whole pages
+            MEMORY_BASIC_INFORMATION info;
+            if (VirtualQuery(m_data, &info, sizeof(info)) == 0)
+                RuntimeError("SharedMemorySegment: Unable to get the size of segment %s, error 0x%x.", name.c_str(), (unsigned int)GetLastError());
+            m_size = info.RegionSize;
+        }
+#else
+        int fd = create ? shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600) : shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd == -1)
+        {
+            if (errno == (create ? EEXIST : ENOENT))
+                return false;
+            RuntimeError("SharedMemorySegment: Unable to %s segment %s, errno %d.", create ? "create" : "open", name.c_str(), errno);
+        }
+
+        if (create)
+        {
+            // allocated right away, so that a full /dev/shm fails here rather than with a SIGBUS on writing
+            int error = posix_fallocate(fd, 0, size);
+            if (error != 0)
+            {
+                close(fd);
+                shm_unlink(name.c_str());
+                RuntimeError("SharedMemorySegment: Unable to allocate %llu bytes for segment %s, errno %d.", (unsigned long long)size, name.c_str(), error);
+            }
+            m_size = size;
+        }
+        else
+        {
+            struct stat buf;
+            if (fstat(fd, &buf) != 0)
+            {
+                close(fd);
+                RuntimeError("SharedMemorySegment: Unable to get the size of segment %s, errno %d.", name.c_str(), errno);
+            }
+            m_size = (size_t)buf.st_size;
+        }
+
+        if (m_size > 0)
+        {
+            void* data = mmap(nullptr, m_size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                close(fd);
+                if (create)
+                    shm_unlink(name.c_str());
+                RuntimeError("SharedMemorySegment: Unable to map segment %s, errno %d.", name.c_str(), errno);
+            }
+            m_data = (char*)data;
+        }
+        close(fd); // the mapping keeps the segment referenced
+#endif
+        return true;
+    }
+
+    std::string m_name;
+    char* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    HANDLE m_mapping;
+#endif
+
+    DISABLE_COPY_AND_MOVE(SharedMemorySegment);
+};
+
+}}}
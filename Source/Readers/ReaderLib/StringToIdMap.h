@@ -5,86 +5,318 @@
 
 #pragma once
 
+#include <algorithm>
 #include <string>
 #include <memory>
+#include <type_traits>
 #include <vector>
-#include <map>
+#include <stdint.h>
 #include "Basics.h"
+#include "fileutil.h"
+#include "MemoryMappedFile.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 // This class represents a string registry pattern to share strings between different deserializers if needed.
 // It associates a unique key for a given string.
-// Currently it is implemented in-memory, but can be unloaded to external disk if needed.
+// The strings are interned: their characters are stored one after another in a single buffer, and an open
+// addressing hash table of 32-bit ids refers to them, so that a string costs its characters and about 16 bytes
+// instead of a string object and a tree node. The table can be saved to a file and later mapped read-only with
+// TryLoad(), e.g. by all the workers of a job; strings added after that are kept in memory and get the ids after
+// those of the file.
 // TODO: Move this class to Basics.h when it is required by more than one reader.
 template<class TString>
 class TStringToIdMap
 {
+    typedef typename TString::value_type CharType;
+
 public:
-    TStringToIdMap()
+    TStringToIdMap() : m_mappedChars(nullptr), m_mappedOffsets(nullptr), m_mappedSlots(nullptr), m_mappedCount(0), m_mappedSlotCount(0), m_offsets(1, 0)
     {}
 
     // Adds string value to the registry.
     size_t AddValue(const TString& value)
     {
-        auto iter = m_values.insert(std::make_pair(value, m_indexedValues.size()));
-        m_indexedValues.push_back(&((iter.first)->first));
-        return m_indexedValues.size() - 1;
+        return (*this)[value];
     }
 
     // Tries to get a value by id.
     bool TryGet(const TString& value, size_t& id) const
     {
-        const auto& it = m_values.find(value);
-        if (it == m_values.end())
+        size_t slot;
+        const uint64_t hash = Hash(value.data(), value.size());
+        if (m_mappedCount > 0 && Find(m_mappedChars, m_mappedOffsets, m_mappedSlots, m_mappedSlotCount, value, hash, slot))
         {
-            return false;
+            id = m_mappedSlots[slot] - 1;
+            return true;
         }
-        else
+        if (!m_slots.empty() && Find(m_chars.data(), m_offsets.data(), m_slots.data(), m_slots.size(), value, hash, slot))
         {
-            id = it->second;
+            id = m_mappedCount + m_slots[slot] - 1;
             return true;
         }
+        return false;
     }
 
     // Get integer id for the string value, adding if not exists.
     size_t operator[](const TString& value)
     {
-        const auto& it = m_values.find(value);
-        if (it == m_values.end())
+        size_t id;
+        if (TryGet(value, id))
+        {
+            return id;
+        }
+
+        id = Size();
+        if (id >= UINT32_MAX)
         {
-            return AddValue(value);
+            RuntimeError("StringToIdMap: More than %u strings cannot be registered.", (unsigned int) (UINT32_MAX - 1));
         }
-        return it->second;
+
+        // the hash table is kept at most half full
+        if (2 * m_offsets.size() > m_slots.size())
+        {
+            Rehash(std::max<size_t>(16, 2 * m_slots.size()));
+        }
+
+        m_chars.insert(m_chars.end(), value.begin(), value.end());
+        m_offsets.push_back(m_chars.size());
+        Insert(m_slots, (uint32_t) (m_offsets.size() - 1), Hash(value.data(), value.size()));
+        return id;
     }
 
     // Get integer id for the string value.
     size_t operator[](const TString& value) const
     {
-        const auto& it = m_values.find(value);
-        assert(it != m_values.end());
-        return it->second;
+        size_t id = SIZE_MAX;
+        bool found = TryGet(value, id);
+        assert(found);
+        UNUSED(found);
+        return id;
     }
 
     // Get string value by its integer id.
-    const TString& operator[](size_t id) const
+    TString operator[](size_t id) const
     {
-        assert(id < m_indexedValues.size());
-        return *m_indexedValues[id];
+        assert(id < Size());
+        if (id < m_mappedCount)
+        {
+            return TString(m_mappedChars + m_mappedOffsets[id], m_mappedChars + m_mappedOffsets[id + 1]);
+        }
+        id -= m_mappedCount;
+        return TString(m_chars.begin() + m_offsets[id], m_chars.begin() + m_offsets[id + 1]);
     }
 
     // Checks whether the value exists.
     bool Contains(const TString& value) const
     {
-        return m_values.find(value) != m_values.end();
+        size_t id;
+        return TryGet(value, id);
+    }
+
+    // Number of registered strings.
+    size_t Size() const
+    {
+        return m_mappedCount + m_offsets.size() - 1;
+    }
+
+    // Writes all registered strings to a file, which TryLoad() can map later on. The file is written under a temporary
+    // name and renamed once complete.
+    void Save(const std::wstring& path) const
+    {
+        const size_t count = Size();
+        FileHeader header = GetExpectedHeader();
+        header.m_count = count;
+        header.m_slotCount = 16;
+        while (header.m_slotCount < 2 * count)
+        {
+            header.m_slotCount *= 2;
+        }
+
+        std::vector<uint64_t> offsets;
+        offsets.reserve(count + 1);
+        offsets.push_back(0);
+        for (size_t id = 0; id < count; ++id)
+        {
+            offsets.push_back(offsets.back() + GetLength(id));
+        }
+        header.m_charCount = offsets.back();
+
+        std::vector<uint32_t> slots(header.m_slotCount, 0);
+        for (size_t id = 0; id < count; ++id)
+        {
+            const CharType* chars = GetChars(id);
+            Insert(slots, (uint32_t) (id + 1), Hash(chars, GetLength(id)));
+        }
+
+        const std::wstring temporaryPath = path + L".tmp";
+        FILE* f = fopenOrDie(temporaryPath, L"wb");
+        auto cleanup = MakeScopeExit([&]()
+        {
+            if (f != nullptr)
+            {
+                fclose(f);
+                _wunlink(temporaryPath.c_str());
+            }
+        });
+        fwriteOrDie(&header, sizeof(header), 1, f);
+        fwriteOrDie(offsets, f);
+        fwriteOrDie(slots, f);
+        if (m_mappedCount > 0)
+        {
+            fwriteOrDie(m_mappedChars, sizeof(CharType), m_mappedOffsets[m_mappedCount], f);
+        }
+        fwriteOrDie(m_chars, f);
+        fcloseOrDie(f);
+        f = nullptr;
+        renameOrDie(temporaryPath, path);
+    }
+
+    // Maps the strings of a file written by Save() read-only. Has to be called before any string is registered.
+    // Returns false if the file does not exist or is not a complete file of this kind of registry.
+    bool TryLoad(const std::wstring& path)
+    {
+        if (Size() != 0)
+        {
+            LogicError("StringToIdMap: Strings can only be loaded into an empty registry.");
+        }
+        if (!fexists(path))
+        {
+            return false;
+        }
+
+        auto file = std::make_shared<MemoryMappedFile>(path);
+        FileHeader header;
+        if (file->Size() < sizeof(header))
+        {
+            return false;
+        }
+        memcpy(&header, file->Data(), sizeof(header));
+
+        const FileHeader expected = GetExpectedHeader();
+        if (header.m_magic != expected.m_magic || header.m_version != expected.m_version || header.m_charSize != expected.m_charSize ||
+            header.m_count >= UINT32_MAX || header.m_slotCount < 2 * header.m_count || (header.m_slotCount & (header.m_slotCount - 1)) != 0 ||
+            file->Size() != sizeof(header) + (header.m_count + 1) * sizeof(uint64_t) + header.m_slotCount * sizeof(uint32_t) + header.m_charCount * sizeof(CharType))
+        {
+            return false;
+        }
+
+        const char* data = file->Data() + sizeof(header);
+        m_mappedOffsets = reinterpret_cast<const uint64_t*>(data);
+        m_mappedSlots = reinterpret_cast<const uint32_t*>(data + (header.m_count + 1) * sizeof(uint64_t));
+        m_mappedChars = reinterpret_cast<const CharType*>(data + (header.m_count + 1) * sizeof(uint64_t) + header.m_slotCount * sizeof(uint32_t));
+        if (m_mappedOffsets[header.m_count] != header.m_charCount)
+        {
+            m_mappedOffsets = nullptr;
+            m_mappedSlots = nullptr;
+            m_mappedChars = nullptr;
+            return false;
+        }
+        m_mappedCount = (size_t) header.m_count;
+        m_mappedSlotCount = (size_t) header.m_slotCount;
+        m_file = file;
+        return true;
     }
 
 private:
     // TODO: Move NonCopyable as a separate class to Basics.h
     DISABLE_COPY_AND_MOVE(TStringToIdMap);
 
-    std::map<TString, size_t> m_values;
-    std::vector<const TString*> m_indexedValues;
+    // Followed by the offsets of the strings in the characters (and the number of characters at the end),
+    // the hash table and the characters.
+    struct FileHeader
+    {
+        uint64_t m_magic;
+        uint32_t m_version;
+        uint32_t m_charSize;
+        uint64_t m_count;
+        uint64_t m_slotCount;
+        uint64_t m_charCount;
+    };
+
+    static FileHeader GetExpectedHeader()
+    {
+        FileHeader header = {};
+        header.m_magic = 0x454c424154525453; // "STRTABLE"
+        header.m_version = 1;
+        header.m_charSize = sizeof(CharType);
+        return header;
+    }
+
+    // FNV-1a
+    static uint64_t Hash(const CharType* chars, size_t length)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < length; ++i)
+        {
+            hash = (hash ^ (uint64_t) (typename std::make_unsigned<CharType>::type) chars[i]) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // Looks for a string in a table whose slots are an id + 1 or 0 if empty, with linear probing. Returns the slot
+    // of the string, or false if it is not in the table.
+    static bool Find(const CharType* chars, const uint64_t* offsets, const uint32_t* slots, size_t slotCount,
+                     const TString& value, uint64_t hash, size_t& slot)
+    {
+        const size_t mask = slotCount - 1;
+        for (slot = (size_t) hash & mask; slots[slot] != 0; slot = (slot + 1) & mask)
+        {
+            const size_t id = slots[slot] - 1;
+            if (offsets[id + 1] - offsets[id] == value.size() &&
+                std::equal(value.begin(), value.end(), chars + offsets[id]))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void Insert(std::vector<uint32_t>& slots, uint32_t idPlusOne, uint64_t hash)
+    {
+        const size_t mask = slots.size() - 1;
+        size_t slot = (size_t) hash & mask;
+        while (slots[slot] != 0)
+        {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = idPlusOne;
+    }
+
+    // Rebuilds the table of the strings kept in memory with a new number of slots.
+    void Rehash(size_t slotCount)
+    {
+        std::vector<uint32_t> slots(slotCount, 0);
+        for (size_t i = 0; i + 1 < m_offsets.size(); ++i)
+        {
+            Insert(slots, (uint32_t) (i + 1), Hash(m_chars.data() + m_offsets[i], m_offsets[i + 1] - m_offsets[i]));
+        }
+        m_slots.swap(slots);
+    }
+
+    const CharType* GetChars(size_t id) const
+    {
+        return id < m_mappedCount ? m_mappedChars + m_mappedOffsets[id] : m_chars.data() + m_offsets[id - m_mappedCount];
+    }
+
+    size_t GetLength(size_t id) const
+    {
+        return id < m_mappedCount ? (size_t) (m_mappedOffsets[id + 1] - m_mappedOffsets[id])
+                                  : (size_t) (m_offsets[id - m_mappedCount + 1] - m_offsets[id - m_mappedCount]);
+    }
+
+    // The strings mapped from a file, with the ids [0, m_mappedCount).
+    std::shared_ptr<MemoryMappedFile> m_file;
+    const CharType* m_mappedChars;
+    const uint64_t* m_mappedOffsets;
+    const uint32_t* m_mappedSlots;
+    size_t m_mappedCount;
+    size_t m_mappedSlotCount;
+
+    // The strings registered in memory, with the ids from m_mappedCount on.
+    std::vector<CharType> m_chars;
+    std::vector<uint64_t> m_offsets; // of the strings in m_chars, and the size of m_chars at the end
+    std::vector<uint32_t> m_slots;   // local id + 1, or 0 if empty
 };
 
 typedef TStringToIdMap<std::wstring> WStringToIdMap;
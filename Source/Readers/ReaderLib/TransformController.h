@@ -9,7 +9,8 @@
 
 #include "Transformer.h"
 #include "SequenceEnumerator.h"
-#include "ExceptionCapture.h"
+#include "WorkerThreadPool.h"
+#include "ReaderStatistics.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -65,29 +66,30 @@ public:
     virtual Sequences GetNextSequences(size_t sampleCount) override
     {
         assert(m_sequenceProvider != nullptr);
+        ReaderStageTimer timer(ReaderStage::transform);
         Sequences sequences = m_sequenceProvider->GetNextSequences(sampleCount);
         if (sequences.m_data.empty())
         {
             return sequences;
         }
 
-        ExceptionCapture capture;
-#pragma omp parallel for schedule(dynamic)
-        for (int j = 0; j < sequences.m_data.front().size(); ++j)
+        ParallelFor(m_workerThreadPool, sequences.m_data.front().size(), [this, &sequences](size_t sequenceId)
         {
-            capture.SafeRun([this, &sequences](int sequenceId)
+            for (auto& t : m_transformations)
             {
-                for (auto& t : m_transformations)
-                {
-                    sequences.m_data[t.second][sequenceId] = t.first.m_transformer->Transform(sequences.m_data[t.second][sequenceId]);
-                }
-            }, j);
-        }
+                sequences.m_data[t.second][sequenceId] = t.first.m_transformer->Transform(sequences.m_data[t.second][sequenceId]);
+            }
+        });
 
-        capture.RethrowIfHappened();
         return sequences;
     }
 
+    // Runs the transforms on the given pool instead of in OpenMP parallel loops.
+    void SetWorkerThreadPool(const WorkerThreadPoolPtr& pool)
+    {
+        m_workerThreadPool = pool;
+    }
+
 private:
     size_t GetStreamId(const std::wstring streamName, const std::vector<StreamDescriptionPtr>& streams) const
     {
@@ -106,6 +108,7 @@ private:
     SequenceEnumeratorPtr m_sequenceProvider;
     std::vector<StreamDescriptionPtr> m_outputStreams;
     std::vector<std::pair<Transformation, size_t>> m_transformations;
+    WorkerThreadPoolPtr m_workerThreadPool;
 };
 
 }}}
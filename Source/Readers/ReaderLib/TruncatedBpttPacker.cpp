@@ -112,20 +112,8 @@ TruncatedBPTTPacker::TruncatedBPTTPacker(
     : PackerBase(sequenceEnumerator, streams, numberOfBuffers),
     m_truncationSize(0)
 {
-    auto sparseOutput = find_if(m_outputStreamDescriptions.begin(), m_outputStreamDescriptions.end(), [](const StreamDescriptionPtr& s){ return s->m_storageType == StorageType::sparse_csc; });
-    if (sparseOutput != m_outputStreamDescriptions.end())
-    {
-        // TODO: add support for sparse.
-        RuntimeError("Sparse output is not supported in BPTT mode.");
-    }
-
-    // Preparing layouts.
-    for (int i = 0; i < m_outputStreamDescriptions.size(); ++i)
-    {
-        auto pMBLayout = make_shared<MBLayout>();
-        pMBLayout->SetUniqueAxisName(L"TruncatedBPTTPacker");
-        m_currentLayouts.push_back(pMBLayout);
-    }
+    m_currentLayout = make_shared<MBLayout>();
+    m_currentLayout->SetUniqueAxisName(L"TruncatedBPTTPacker");
 }
 
 void TruncatedBPTTPacker::StartEpoch(const EpochConfiguration& config, const std::vector<MemoryProviderPtr>& memoryProviders)
@@ -167,8 +155,11 @@ void TruncatedBPTTPacker::StartEpoch(const EpochConfiguration& config, const std
             {
                 const auto& stream = m_outputStreamDescriptions[i];
                 auto& buffer = m_streamBuffers[j][i];
-                buffer.Resize(m_numParallelSequences * m_truncationSize * GetSampleSize(stream));
-                m_sequenceBufferPerStream.push_back(make_shared<SequenceBuffer>(m_numParallelSequences));
+                // sparse streams get their buffers as the minibatches need them
+                if (stream->m_storageType == StorageType::dense)
+                    buffer.Resize(m_numParallelSequences * m_truncationSize * GetSampleSize(stream));
+                if (j == 0)
+                    m_sequenceBufferPerStream.push_back(make_shared<SequenceBuffer>(m_numParallelSequences));
             }
     }
 
@@ -192,18 +183,29 @@ Minibatch TruncatedBPTTPacker::ReadMinibatch()
     }
 
     // Iterating over the streams/slots and packing them into the minibatch.
+    m_currentLayout->Init(m_numParallelSequences, m_truncationSize);
     for (size_t streamIndex = 0; streamIndex < m_outputStreamDescriptions.size(); ++streamIndex)
     {
-        m_currentLayouts[streamIndex]->Init(m_numParallelSequences, m_truncationSize);
+        const bool sparse = m_outputStreamDescriptions[streamIndex]->m_storageType == StorageType::sparse_csc;
+        if (sparse)
+        {
+            m_sparseColumns.assign(m_numParallelSequences * m_truncationSize, SparseColumn());
+        }
+
         size_t sequenceId = 0;
         for (size_t slotIndex = 0; slotIndex < m_numParallelSequences; ++slotIndex)
         {
             PackSlot(streamIndex, slotIndex, sequenceId);
         }
 
+        if (sparse)
+        {
+            PackSparseColumns(streamIndex);
+        }
+
         StreamMinibatchPtr m = make_shared<StreamMinibatch>();
         m->m_data = m_streamBuffers[m_currentBufferIndex][streamIndex].m_data.get();
-        m->m_layout = m_currentLayouts[streamIndex];
+        m->m_layout = m_currentLayout;
         result.m_data.push_back(m);
     }
 
@@ -220,12 +222,16 @@ void TruncatedBPTTPacker::PackSlot(size_t streamIndex, size_t slotIndex, size_t&
     // Fill free space in the slot.
     ReadSequencesToSlot(slotIndex);
 
+    // The layout is the same for all streams, it is built with the first one.
+    MBLayout* layout = streamIndex == 0 ? m_currentLayout.get() : nullptr;
+
     // Let's see how much samples we need to read.
     size_t numberOfSamples = min(m_truncationSize, slot.AvailableNumberOfSamples());
     if (numberOfSamples == 0)
     {
         // Reached the end of the data, put the corresponding row in the minibatch layout to gap.
-        m_currentLayouts[streamIndex]->AddSequence(GAP_SEQUENCE_ID, slotIndex, 0, m_truncationSize);
+        if (layout)
+            layout->AddSequence(GAP_SEQUENCE_ID, slotIndex, 0, m_truncationSize);
 
         // Check that nothing is in the slot any more.
         assert(slot.IsEmpty());
@@ -234,63 +240,76 @@ void TruncatedBPTTPacker::PackSlot(size_t streamIndex, size_t slotIndex, size_t&
 
     size_t sampleSize = GetSampleSize(m_inputStreamDescriptions[streamIndex]);
     StorageType storageType = m_inputStreamDescriptions[streamIndex]->m_storageType;
+    bool sparseOutput = m_outputStreamDescriptions[streamIndex]->m_storageType == StorageType::sparse_csc;
     size_t elementSize = GetSizeByType(m_inputStreamDescriptions[streamIndex]->m_elementType);
 
     // Distance between two samples of the same sequence in bytes.
     size_t strideSize = m_numParallelSequences * sampleSize;
+    char* buffer = m_streamBuffers[m_currentBufferIndex][streamIndex].m_data.get();
 
-    // Add current sequence to the minibatch layout.
-    m_currentLayouts[streamIndex]->AddSequence(
-        sequenceId++,
-        slotIndex,
-        -(int)slot.m_sampleCursor,
-        slot.FrontSequence()->m_numberOfSamples - slot.m_sampleCursor);
-
-    // Ok, now fill in the buffer with data.
-    for (size_t currentTimestep = 0; currentTimestep < numberOfSamples; ++currentTimestep)
+    // The window is filled with runs of samples of the same sequence.
+    size_t currentTimestep = 0;
+    while (currentTimestep < numberOfSamples)
     {
         // Check if reach the end of the front sequence.
         if (slot.m_sampleCursor >= slot.FrontSequence()->m_numberOfSamples)
         {
-            // Starting a new sequence. Have to reset current pointers and add it to the minibatch layout.
+            // Starting a new sequence. Have to reset current pointers.
             slot.PopSequence();
-
-            //Adding next sequence to the minibatch.
-            m_currentLayouts[streamIndex]->AddSequence(
-                sequenceId++,
-                slotIndex,
-                currentTimestep,
-                currentTimestep + slot.FrontSequence()->m_numberOfSamples);
         }
 
-        // Fill in the data from the first sequence in the slot.
+        // Add the sequence to the minibatch layout, the sequence in front may have started in an earlier window.
         auto data = slot.FrontSequence();
-        // Get buffer destination for the current sample.
-        auto& buffer = m_streamBuffers[m_currentBufferIndex][streamIndex];
-        auto offset = strideSize * currentTimestep + slotIndex * sampleSize;
-        assert(offset >= 0 && offset < buffer.m_size);
-        char* destination = buffer.m_data.get() + offset;
-
-        // Pack the sample.
-        if (storageType == StorageType::dense)
+        if (layout)
+        {
+            ptrdiff_t beginTime = (ptrdiff_t)currentTimestep - (ptrdiff_t)slot.m_sampleCursor;
+            layout->AddSequence(sequenceId, slotIndex, beginTime, beginTime + data->m_numberOfSamples);
+        }
+        sequenceId++;
+
+        size_t runLength = min(numberOfSamples - currentTimestep, data->m_numberOfSamples - slot.m_sampleCursor);
+        if (sparseOutput)
+        {
+            // The samples are copied once the nnz counts of all columns are known.
+            SparseSequenceDataPtr sparseSequence = static_pointer_cast<SparseSequenceData>(data);
+            for (size_t i = 0; i < runLength; ++i)
+            {
+                auto& column = m_sparseColumns[(currentTimestep + i) * m_numParallelSequences + slotIndex];
+                column.m_sequence = sparseSequence;
+                column.m_sampleIndex = slot.m_sampleCursor + i;
+                column.m_sampleOffset = slot.m_sampleOffset;
+                slot.m_sampleOffset += sparseSequence->m_nnzCounts[slot.m_sampleCursor + i];
+            }
+        }
+        else if (storageType == StorageType::dense)
         {
             assert(slot.m_sampleOffset == slot.m_sampleCursor * sampleSize);
-            PackDenseSample(destination, data, slot.m_sampleOffset, sampleSize);
-            slot.m_sampleOffset += sampleSize;
+            const char* source = (const char*)data->GetDataBuffer() + slot.m_sampleOffset;
+            char* destination = buffer + strideSize * currentTimestep + slotIndex * sampleSize;
+            for (size_t i = 0; i < runLength; ++i)
+            {
+                memcpy(destination + i * strideSize, source + i * sampleSize, sampleSize);
+            }
+            slot.m_sampleOffset += runLength * sampleSize;
         }
         else
         {
             assert(storageType == StorageType::sparse_csc);
             // TODO: make type casts members of the SparseSequenceData
             SparseSequenceDataPtr sparseSequence = static_pointer_cast<SparseSequenceData>(data);
-            assert(slot.m_sampleCursor < sparseSequence->m_nnzCounts.size());
-            PackSparseSampleAsDense(destination, sparseSequence, slot.m_sampleCursor, 
-                slot.m_sampleOffset, sampleSize, elementSize);
-            slot.m_sampleOffset += sparseSequence->m_nnzCounts[slot.m_sampleCursor];
-            assert(slot.m_sampleOffset <= sparseSequence->m_totalNnzCount);
+            for (size_t i = 0; i < runLength; ++i)
+            {
+                size_t sampleIndex = slot.m_sampleCursor + i;
+                assert(sampleIndex < sparseSequence->m_nnzCounts.size());
+                char* destination = buffer + strideSize * (currentTimestep + i) + slotIndex * sampleSize;
+                PackSparseSampleAsDense(destination, sparseSequence, sampleIndex, slot.m_sampleOffset, sampleSize, elementSize);
+                slot.m_sampleOffset += sparseSequence->m_nnzCounts[sampleIndex];
+                assert(slot.m_sampleOffset <= sparseSequence->m_totalNnzCount);
+            }
         }
 
-        slot.m_sampleCursor++;
+        slot.m_sampleCursor += runLength;
+        currentTimestep += runLength;
     }
 
     // Cleaning up the last sequence we have just read if needed.
@@ -300,9 +319,9 @@ void TruncatedBPTTPacker::PackSlot(size_t streamIndex, size_t slotIndex, size_t&
     }
 
     // Adding the last gap if there is one.
-    if (numberOfSamples < m_truncationSize)
+    if (numberOfSamples < m_truncationSize && layout)
     {
-        m_currentLayouts[streamIndex]->AddSequence(
+        layout->AddSequence(
             GAP_SEQUENCE_ID,
             slotIndex,
             numberOfSamples,
@@ -310,6 +329,41 @@ void TruncatedBPTTPacker::PackSlot(size_t streamIndex, size_t slotIndex, size_t&
     }
 }
 
+void TruncatedBPTTPacker::PackSparseColumns(size_t streamIndex)
+{
+    size_t nnzCount = 0;
+    for (const auto& column : m_sparseColumns)
+    {
+        if (column.m_sequence)
+            nnzCount += column.m_sequence->m_nnzCounts[column.m_sampleIndex];
+    }
+
+    const size_t elementSize = GetSizeByType(m_inputStreamDescriptions[streamIndex]->m_elementType);
+    SparseStreamMinibatchHeader header = PrepareSparseBuffer(streamIndex, nnzCount, m_sparseColumns.size());
+    char* dataDst = m_streamBuffers[m_currentBufferIndex][streamIndex].m_data.get() + sizeof(header);
+    IndexType* indicesDst = reinterpret_cast<IndexType*>(dataDst + elementSize * header.m_nnzCapacity);
+    IndexType* columnOffsetsDst = indicesDst + header.m_nnzCapacity;
+
+    IndexType columnOffset = 0;
+    for (size_t i = 0; i < m_sparseColumns.size(); ++i)
+    {
+        columnOffsetsDst[i] = columnOffset;
+        const auto& column = m_sparseColumns[i];
+        if (!column.m_sequence)
+            continue;
+
+        IndexType nnz = column.m_sequence->m_nnzCounts[column.m_sampleIndex];
+        memcpy(dataDst + columnOffset * elementSize, (const char*)column.m_sequence->GetDataBuffer() + column.m_sampleOffset * elementSize, nnz * elementSize);
+        memcpy(indicesDst + columnOffset, column.m_sequence->m_indices + column.m_sampleOffset, nnz * sizeof(IndexType));
+        columnOffset += nnz;
+    }
+    assert(columnOffset == nnzCount);
+    columnOffsetsDst[m_sparseColumns.size()] = columnOffset;
+
+    // the sequences are not referenced beyond the minibatch
+    m_sparseColumns.clear();
+}
+
 void TruncatedBPTTPacker::ReadSequencesToSlot(size_t slotIndex)
 {
     const auto& slot = m_sequenceBufferPerStream.front()->m_slots[slotIndex];
@@ -16,6 +16,9 @@ struct SequenceBuffer;
 typedef std::shared_ptr<SequenceBuffer> SequenceBufferPtr;
 
 // A bptt packer that densely packs samples in parallel for GPU consumptions.
+// Each parallel sequence (slot) keeps references to the sequences it has not consumed yet, and a truncation window
+// is copied straight from them into the minibatch, a run of samples of the same sequence at a time. Sparse streams
+// may be packed as sparse, so that only their non zero values are transferred.
 // TODO: Currently supports only packing of streams with sequences of equal length.
 class TruncatedBPTTPacker : public PackerBase
 {
@@ -41,6 +44,9 @@ private:
     // inputs to have consistent sequence ids.
     void PackSlot(size_t streamIndex, size_t slotIndex, size_t& sequenceId);
 
+    // Packs the samples that PackSlot() has assigned to the columns of a sparse stream into its CSC buffer.
+    void PackSparseColumns(size_t streamIndex);
+
     virtual MBLayoutPtr CreateMBLayout(const StreamBatch& batch)
     {
         UNUSED(batch);
@@ -59,9 +65,18 @@ private:
     // that get filled with sequences.
     std::vector<SequenceBufferPtr> m_sequenceBufferPerStream;
 
-    // Layout per stream.
-    // TODO: currently assume that layout is the same between different streams, this will change.
-    std::vector<MBLayoutPtr> m_currentLayouts;
+    // Layout of the current minibatch. The sequences of all streams have the same lengths, so the layout
+    // is only built when packing the first stream, and shared by the others.
+    MBLayoutPtr m_currentLayout;
+
+    // The sample of a sparse stream that goes into a column of the minibatch (time step * parallel sequences + slot).
+    struct SparseColumn
+    {
+        SparseSequenceDataPtr m_sequence; // null for a gap
+        size_t m_sampleIndex;
+        size_t m_sampleOffset; // number of non zero values of the sequence in front of the sample
+    };
+    std::vector<SparseColumn> m_sparseColumns;
 };
 
 typedef std::shared_ptr<TruncatedBPTTPacker> TruncatedBPTTPackerPtr;
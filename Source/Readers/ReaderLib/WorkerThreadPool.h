@@ -0,0 +1,273 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#include "Basics.h"
+#include "ExceptionCapture.h"
+#include "NumaTopology.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// A fixed set of worker threads of the reader, for CPU-intensive per-sequence work such as image decoding and transforms.
+// Unlike OpenMP parallel loops it does not share the thread count (omp_set_num_threads) with the math library,
+// and its threads can be pinned to cores of their own.
+// The items of a loop are split into one contiguous range per thread. Every thread takes the items of its own range
+// one after another and then steals the remaining items of the other ranges, all through atomic counters, so the
+// threads do not take a lock per item. Consecutive items (e.g. sequences of the same chunk, or adjacent output slots)
+// thus mostly stay on the same thread, and uneven items are balanced out at the end.
+// The readers of a process normally use the pools of GetShared(), so that e.g. the training and the cross-validation
+// readers, or the deserializers of one composite reader, do not each start threads of their own.
+class WorkerThreadPool
+{
+public:
+    // numThreads includes the thread calling ParallelFor(), which takes part in the work; 0 means one per core.
+    // If firstCore >= 0, the workers are pinned to the cores firstCore, firstCore + 1, ...
+    WorkerThreadPool(size_t numThreads, int firstCore = -1)
+        : m_generation(0), m_stop(false), m_activeWorkers(0), m_body(nullptr), m_capture(nullptr)
+    {
+        if (numThreads == 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        std::vector<size_t> cores;
+        for (size_t i = 1; firstCore >= 0 && i < numThreads; ++i)
+            cores.push_back(firstCore + i - 1);
+        Start(numThreads, cores);
+    }
+
+    // The workers are pinned to the given cores, one after another, e.g. to the cores of a NUMA node
+    // (see NumaTopology); numThreads = 0 means one per core.
+    WorkerThreadPool(size_t numThreads, const std::vector<size_t>& cores)
+        : m_generation(0), m_stop(false), m_activeWorkers(0), m_body(nullptr), m_capture(nullptr)
+    {
+        if (cores.empty())
+            InvalidArgument("WorkerThreadPool: No cores to pin the threads to.");
+        Start(numThreads == 0 ? cores.size() : numThreads, cores);
+    }
+
+    ~WorkerThreadPool()
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_stop = true;
+        }
+        m_wakeUp.notify_all();
+        for (auto& worker : m_workers)
+            worker.join();
+    }
+
+    size_t NumThreads() const
+    {
+        return m_workers.size() + 1;
+    }
+
+    // Returns the pool of the process with the given threads, creating it if there is none; it is released once
+    // none of its users hold it. Arguments as for the constructors, with no cores meaning no pinning.
+    static std::shared_ptr<WorkerThreadPool> GetShared(size_t numThreads, const std::vector<size_t>& cores = std::vector<size_t>())
+    {
+        if (numThreads == 0)
+            numThreads = cores.empty() ? std::max(1u, std::thread::hardware_concurrency()) : cores.size();
+
+        static std::mutex sharedLock;
+        static std::vector<SharedPool> sharedPools;
+        std::unique_lock<std::mutex> lock(sharedLock);
+        sharedPools.erase(std::remove_if(sharedPools.begin(), sharedPools.end(), [](const SharedPool& p) { return p.m_pool.expired(); }), sharedPools.end());
+        for (const auto& p : sharedPools)
+        {
+            if (p.m_numThreads == numThreads && p.m_cores == cores)
+            {
+                auto pool = p.m_pool.lock();
+                if (pool)
+                    return pool;
+            }
+        }
+
+        auto pool = cores.empty() ? std::make_shared<WorkerThreadPool>(numThreads) : std::make_shared<WorkerThreadPool>(numThreads, cores);
+        sharedPools.push_back(SharedPool{ numThreads, cores, pool });
+        fprintf(stderr, "WorkerThreadPool: started %d reader worker threads%s.\n", (int)pool->NumThreads() - 1, cores.empty() ? "" : " pinned to cores");
+        return pool;
+    }
+
+    static std::shared_ptr<WorkerThreadPool> GetShared(size_t numThreads, int firstCore)
+    {
+        if (numThreads == 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        std::vector<size_t> cores;
+        for (size_t i = 1; firstCore >= 0 && i < numThreads; ++i)
+            cores.push_back(firstCore + i - 1);
+        return GetShared(numThreads, cores);
+    }
+
+    // Runs body(i) for all i in [0, count) and returns when all of them are done.
+    // Rethrows the first exception thrown by body. Loops from different threads are run one after another;
+    // a loop started from within a loop of the pool (as a shared pool may see) runs on the calling thread.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& body)
+    {
+        if (count == 0)
+            return;
+
+        if (IsRunningLoop())
+        {
+            for (size_t i = 0; i < count; ++i)
+                body(i);
+            return;
+        }
+
+        std::unique_lock<std::mutex> callGuard(m_callLock);
+        ExceptionCapture capture;
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_caller = std::this_thread::get_id();
+            m_body = &body;
+            m_capture = &capture;
+            for (size_t i = 0; i < m_ranges.size(); ++i)
+            {
+                m_ranges[i].m_next = count * i / m_ranges.size();
+                m_ranges[i].m_end = count * (i + 1) / m_ranges.size();
+            }
+            m_generation++;
+        }
+        m_wakeUp.notify_all();
+
+        RunItems(0);
+
+        {
+            // Once the counter is exhausted, only the workers that are still busy with an item have to be waited on.
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_done.wait(lock, [this]() { return m_activeWorkers == 0; });
+            m_body = nullptr; // workers that wake up only now have nothing to do
+            m_capture = nullptr;
+            m_caller = std::thread::id();
+        }
+
+        capture.RethrowIfHappened();
+    }
+
+private:
+    struct SharedPool
+    {
+        size_t m_numThreads;
+        std::vector<size_t> m_cores;
+        std::weak_ptr<WorkerThreadPool> m_pool;
+    };
+
+    // Whether the calling thread is one of the workers, or the thread of the loop being run.
+    bool IsRunningLoop()
+    {
+        const auto self = std::this_thread::get_id();
+        for (const auto& worker : m_workers)
+            if (worker.get_id() == self)
+                return true;
+        std::unique_lock<std::mutex> lock(m_lock);
+        return m_caller == self;
+    }
+
+    void WorkerLoop(size_t index)
+    {
+        size_t generation = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_wakeUp.wait(lock, [this, generation]() { return m_stop || m_generation != generation; });
+                if (m_stop)
+                    return;
+                generation = m_generation;
+                if (!m_body)
+                    continue;
+                m_activeWorkers++;
+            }
+
+            RunItems(index);
+
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_activeWorkers--;
+            }
+            m_done.notify_all();
+        }
+    }
+
+    // Runs the items of the own range, then the ones left in the ranges of the other threads.
+    void RunItems(size_t index)
+    {
+        const auto& body = *m_body;
+        for (size_t r = 0; r < m_ranges.size(); ++r)
+        {
+            auto& range = m_ranges[(index + r) % m_ranges.size()];
+            for (size_t i = range.m_next++; i < range.m_end; i = range.m_next++)
+                m_capture->SafeRun([&body](size_t item) { body(item); }, i);
+        }
+    }
+
+    // Starts the workers, pinning worker i to cores[(i - 1) % cores.size()] unless there are no cores.
+    void Start(size_t numThreads, const std::vector<size_t>& cores)
+    {
+        m_ranges = std::vector<Range>(numThreads);
+        for (size_t i = 1; i < numThreads; ++i)
+        {
+            m_workers.emplace_back([this, i]() { WorkerLoop(i); });
+            if (!cores.empty())
+                NumaTopology::PinToCore(m_workers.back(), cores[(i - 1) % cores.size()]);
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_callLock;
+    std::mutex m_lock;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_done;
+    size_t m_generation;
+    bool m_stop;
+    size_t m_activeWorkers;
+    std::thread::id m_caller; // of the loop being run
+
+    // The remaining items of the current loop, one range per thread, each on a cache line of its own.
+    struct Range
+    {
+        Range() : m_next(0), m_end(0) {}
+        Range(const Range&) : Range() {}
+
+        std::atomic<size_t> m_next;
+        size_t m_end;
+        char m_padding[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+    };
+    std::vector<Range> m_ranges;
+    const std::function<void(size_t)>* m_body;
+    ExceptionCapture* m_capture;
+
+    DISABLE_COPY_AND_MOVE(WorkerThreadPool);
+};
+
+typedef std::shared_ptr<WorkerThreadPool> WorkerThreadPoolPtr;
+
+// Runs body(i) for all i in [0, count) on the given pool, or in an OpenMP parallel loop if there is none.
+inline void ParallelFor(const WorkerThreadPoolPtr& pool, size_t count, const std::function<void(size_t)>& body)
+{
+    if (pool)
+    {
+        pool->ParallelFor(count, body);
+        return;
+    }
+
+    ExceptionCapture capture;
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < (int)count; ++i)
+        capture.SafeRun([&body](size_t item) { body(item); }, (size_t)i);
+    capture.RethrowIfHappened();
+}
+
+}}}
@@ -0,0 +1,435 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include "SparsePCDeserializer.h"
+#include "BinarySequenceData.h"
+#include "CacheFile.h"
+#include "ElementTypeUtils.h"
+#include "StringUtil.h"
+#include "fileutil.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+using namespace std;
+
+// The index cache is a header followed by the offsets of the records and of the end of the last one.
+struct SparsePCDeserializer::CacheHeader
+{
+    uint64_t m_magic;
+    uint32_t m_version;
+    uint32_t m_numberOfFeatureStreams; // the settings the index was built with
+    uint32_t m_elementSize;
+    int32_t m_verificationCode;
+    uint64_t m_inputFileSize;          // size and modification time of the input file the index was built from
+    uint64_t m_inputFileTime;
+    uint64_t m_numberOfRecords;
+};
+
+static const uint64_t s_cacheMagic = 0x5844494350525053ULL; // "SPRPCIDX"
+static const uint32_t s_cacheVersion = 1;
+
+// Sequences of several records, which are not contiguous in the file, are gathered into memory of their own.
+struct SparsePCDenseSequenceData : DenseSequenceData
+{
+    const void* GetDataBuffer() override
+    {
+        return m_buffer.data();
+    }
+
+    vector<char> m_buffer;
+};
+
+struct SparsePCSparseSequenceData : SparseSequenceData
+{
+    const void* GetDataBuffer() override
+    {
+        return m_buffer.data();
+    }
+
+    vector<char> m_buffer;
+    vector<IndexType> m_rowIndices;
+};
+
+// Records of sequences [m_firstSequence, m_endSequence), which sequences of a single sample reference in the mapped file.
+class SparsePCDeserializer::SparsePCChunk : public Chunk, public std::enable_shared_from_this<SparsePCChunk>
+{
+public:
+    SparsePCChunk(const SparsePCDeserializer& parent, size_t firstSequence, size_t endSequence)
+        : m_parent(parent), m_file(parent.m_file), m_firstSequence(firstSequence), m_endSequence(endSequence)
+    {
+        // The chunk is about to be used, so its pages are read in right away, in parallel to the other prefetched chunks.
+        size_t offset = parent.m_recordOffsets[firstSequence * parent.m_microbatchSize];
+        m_size = parent.m_recordOffsets[endSequence * parent.m_microbatchSize] - offset;
+        m_file->Advise(offset, m_size, MemoryMappedFile::Access::WillNeed);
+    }
+
+    void GetSequence(size_t sequenceId, std::vector<SequenceDataPtr>& result) override
+    {
+        if (sequenceId < m_firstSequence || sequenceId >= m_endSequence)
+            LogicError("SparsePCDeserializer: Sequence %" PRIu64 " does not belong to the chunk.", (uint64_t) sequenceId);
+
+        const size_t elementSize = GetSizeByType(m_parent.m_elementType);
+        const size_t numberOfSamples = m_parent.m_microbatchSize;
+        const size_t firstRecord = sequenceId * numberOfSamples;
+
+        // a record: per feature stream int32 nnz, nnz values, nnz int32 row indices; then the label (the file was checked when indexed)
+        for (size_t s = 0; s <= m_parent.m_numberOfFeatureStreams; s++)
+        {
+            SequenceDataPtr sequence;
+            if (numberOfSamples == 1)
+            {
+                const char* data = Find(firstRecord, s);
+                if (s < m_parent.m_numberOfFeatureStreams)
+                {
+                    int32_t nnz;
+                    memcpy(&nnz, data, sizeof(nnz));
+                    auto sparse = make_shared<BinarySparseSequenceData>();
+                    sparse->m_data = data + sizeof(nnz);
+                    sparse->m_indices = const_cast<IndexType*>(reinterpret_cast<const IndexType*>(sparse->m_data + nnz * elementSize));
+                    sparse->m_nnzCounts.assign(1, (IndexType) nnz);
+                    sparse->m_totalNnzCount = nnz;
+                    sequence = sparse;
+                }
+                else
+                {
+                    auto dense = make_shared<BinaryDenseSequenceData>();
+                    dense->m_data = data;
+                    sequence = dense;
+                }
+            }
+            else if (s < m_parent.m_numberOfFeatureStreams)
+            {
+                auto sparse = make_shared<SparsePCSparseSequenceData>();
+                for (size_t r = firstRecord; r < firstRecord + numberOfSamples; r++)
+                {
+                    const char* data = Find(r, s);
+                    int32_t nnz;
+                    memcpy(&nnz, data, sizeof(nnz));
+                    const char* values = data + sizeof(nnz);
+                    const IndexType* rows = reinterpret_cast<const IndexType*>(values + nnz * elementSize);
+                    sparse->m_buffer.insert(sparse->m_buffer.end(), values, values + nnz * elementSize);
+                    sparse->m_rowIndices.insert(sparse->m_rowIndices.end(), rows, rows + nnz);
+                    sparse->m_nnzCounts.push_back((IndexType) nnz);
+                }
+                sparse->m_indices = sparse->m_rowIndices.data();
+                sparse->m_totalNnzCount = (IndexType) sparse->m_rowIndices.size();
+                sequence = sparse;
+            }
+            else
+            {
+                auto dense = make_shared<SparsePCDenseSequenceData>();
+                for (size_t r = firstRecord; r < firstRecord + numberOfSamples; r++)
+                {
+                    const char* label = Find(r, s);
+                    dense->m_buffer.insert(dense->m_buffer.end(), label, label + elementSize);
+                }
+                sequence = dense;
+            }
+
+            sequence->m_id = sequenceId;
+            sequence->m_numberOfSamples = (uint32_t) numberOfSamples;
+            sequence->m_elementType = m_parent.m_elementType;
+            sequence->m_sampleLayout = m_parent.m_streams[s]->m_sampleLayout;
+            sequence->m_chunk = shared_from_this();
+            result.push_back(sequence);
+        }
+    }
+
+    size_t GetMemorySize() const override
+    {
+        // the mapped pages of the chunk, which are not freed either while the chunk is in use
+        return m_size;
+    }
+
+private:
+    // Where stream 's' of record 'record' starts.
+    const char* Find(size_t record, size_t s) const
+    {
+        const size_t elementSize = GetSizeByType(m_parent.m_elementType);
+        const char* data = m_file->Data() + m_parent.m_recordOffsets[record];
+        for (size_t i = 0; i < s; i++)
+        {
+            int32_t nnz;
+            memcpy(&nnz, data, sizeof(nnz));
+            data += sizeof(nnz) + nnz * (elementSize + sizeof(IndexType));
+        }
+        return data;
+    }
+
+    const SparsePCDeserializer& m_parent;
+    // Keeps the mapping alive for as long as sequences of the chunk are.
+    shared_ptr<MemoryMappedFile> m_file;
+    const size_t m_firstSequence;
+    const size_t m_endSequence;
+    size_t m_size;
+};
+
+SparsePCDeserializer::SparsePCDeserializer(CorpusDescriptorPtr /*corpus*/, const ConfigParameters& config, bool /*primary*/)
+    : m_numberOfFeatureStreams(0), m_numberOfSequences(0)
+{
+    string precision = config.Find("precision", "float");
+    m_elementType = AreEqualIgnoreCase(precision, "double") ? ElementType::tdouble : ElementType::tfloat;
+    m_microbatchSize = config(L"microbatchSize", (size_t) 1);
+    m_verificationCode = (int32_t) config(L"verificationCode", (size_t) 0);
+    if (m_microbatchSize == 0)
+        InvalidArgument("SparsePCDeserializer: microbatchSize must be at least 1.");
+
+    if (!config.ExistsCurrent(L"input"))
+        InvalidArgument("SparsePCDeserializer configuration does not contain \"input\" section.");
+
+    // The sections are not kept in the order of the config, so the order of the streams in the records is given separately.
+    // By default it is the one of the SparsePCReader, the reverse of the names of the sections (e.g. 'query' before 'doc').
+    const ConfigParameters& input = config(L"input");
+    vector<string> names;
+    for (const pair<string, ConfigParameters>& section : input)
+        names.insert(names.begin(), section.first);
+    if (config.ExistsCurrent(L"featureOrder"))
+    {
+        ConfigArray order = config(L"featureOrder");
+        if (order.size() != names.size())
+            InvalidArgument("SparsePCDeserializer: featureOrder has %d streams, the \"input\" section %d.", (int) order.size(), (int) names.size());
+        names.clear();
+        for (const auto& name : order)
+        {
+            names.push_back(name);
+            if (!input.ExistsCurrent(names.back()))
+                InvalidArgument("SparsePCDeserializer: Stream '%s' of featureOrder is not in the \"input\" section.", names.back().c_str());
+        }
+    }
+
+    for (const auto& name : names)
+    {
+        ConfigParameters section = input(name);
+        size_t dimension = section(L"dim", (size_t) 0);
+        if (dimension == 0)
+            InvalidArgument("SparsePCDeserializer: Input '%s' does not specify its dimension 'dim'.", name.c_str());
+
+        auto stream = make_shared<StreamDescription>();
+        stream->m_id = m_streams.size();
+        stream->m_name = msra::strfun::utf16(name);
+        stream->m_storageType = StorageType::sparse_csc;
+        stream->m_elementType = m_elementType;
+        stream->m_sampleLayout = make_shared<TensorShape>(dimension);
+        m_streams.push_back(stream);
+    }
+    if (m_streams.empty())
+        InvalidArgument("SparsePCDeserializer configuration contains an empty \"input\" section.");
+    m_numberOfFeatureStreams = m_streams.size();
+
+    // a single label value per record
+    auto label = make_shared<StreamDescription>();
+    label->m_id = m_streams.size();
+    label->m_name = (wstring) config(L"label", L"labels");
+    label->m_storageType = StorageType::dense;
+    label->m_elementType = m_elementType;
+    label->m_sampleLayout = make_shared<TensorShape>(1);
+    m_streams.push_back(label);
+
+    wstring path = config(L"file");
+    m_file = make_shared<MemoryMappedFile>(path);
+    BuildIndex(config(L"cacheIndex", false));
+
+    CreateChunks(config(L"chunkSizeInBytes", (size_t) 32 * 1024 * 1024));
+
+    fprintf(stderr, "SparsePCDeserializer: %" PRIu64 " records in %" PRIu64 " sequences and %" PRIu64 " chunks\n",
+            (uint64_t) (m_recordOffsets.size() - 1), (uint64_t) m_numberOfSequences, (uint64_t) m_chunkDescriptions.size());
+}
+
+SparsePCDeserializer::CacheHeader SparsePCDeserializer::GetExpectedCacheHeader() const
+{
+    CacheHeader header = {};
+    header.m_magic = s_cacheMagic;
+    header.m_version = s_cacheVersion;
+    header.m_numberOfFeatureStreams = (uint32_t) m_numberOfFeatureStreams;
+    header.m_elementSize = (uint32_t) GetSizeByType(m_elementType);
+    header.m_verificationCode = m_verificationCode;
+    header.m_inputFileSize = m_file->Size();
+    header.m_inputFileTime = GetModificationTime(m_file->Path());
+    return header;
+}
+
+void SparsePCDeserializer::BuildIndex(bool cacheIndex)
+{
+    if (!cacheIndex)
+    {
+        IndexFile();
+        return;
+    }
+
+    const wstring cachePath = m_file->Path() + L".index";
+    const auto expected = GetExpectedCacheHeader();
+    LoadOrBuildCache(cachePath, L"index",
+        [&]() { return TryLoadIndexCache(cachePath, expected); },
+        [&]() { IndexFile(); WriteIndexCache(cachePath, expected); },
+        [&]() { IndexFile(); });
+}
+
+// A pass over the file that only reads the non zero counts of the records (and their verification codes).
+void SparsePCDeserializer::IndexFile()
+{
+    const size_t elementSize = GetSizeByType(m_elementType);
+    const char* data = m_file->Data();
+    const size_t size = m_file->Size();
+    m_file->Advise(0, size, MemoryMappedFile::Access::Sequential);
+
+    m_recordOffsets.clear();
+    size_t offset = 0;
+    while (offset < size)
+    {
+        const size_t record = m_recordOffsets.size();
+        m_recordOffsets.push_back(offset);
+        auto skip = [&](size_t bytes)
+        {
+            if (size - offset < bytes)
+                RuntimeError("SparsePCDeserializer: Record %" PRIu64 " of '%ls' is beyond the end of the file, the file is truncated.", (uint64_t) record, m_file->Path().c_str());
+            offset += bytes;
+        };
+
+        for (size_t s = 0; s < m_numberOfFeatureStreams; s++)
+        {
+            int32_t nnz;
+            size_t nnzOffset = offset;
+            skip(sizeof(nnz));
+            memcpy(&nnz, data + nnzOffset, sizeof(nnz));
+            if (nnz < 0 || (size_t) nnz > m_streams[s]->m_sampleLayout->GetNumElements())
+                RuntimeError("SparsePCDeserializer: Record %" PRIu64 " of '%ls' has %d non zero values in stream '%ls', the file is corrupt.", (uint64_t) record, m_file->Path().c_str(), (int) nnz, m_streams[s]->m_name.c_str());
+            skip(nnz * (elementSize + sizeof(IndexType)));
+        }
+        skip(elementSize); // the label
+
+        if (m_verificationCode != 0)
+        {
+            int32_t code;
+            size_t codeOffset = offset;
+            skip(sizeof(code));
+            memcpy(&code, data + codeOffset, sizeof(code));
+            if (code != m_verificationCode)
+                RuntimeError("SparsePCDeserializer: Verification code of record %" PRIu64 " of '%ls' did not match (expected %d) - error in reading data", (uint64_t) record, m_file->Path().c_str(), (int) m_verificationCode);
+        }
+    }
+    m_recordOffsets.push_back(offset);
+
+    // Chunks are loaded in random order, so the sequential access hint no longer holds.
+    m_file->Advise(0, size, MemoryMappedFile::Access::Normal);
+}
+
+bool SparsePCDeserializer::TryLoadIndexCache(const wstring& cachePath, const CacheHeader& expected)
+{
+    if (!fexists(cachePath))
+        return false;
+
+    unique_ptr<MemoryMappedFile> cache;
+    try
+    {
+        cache = make_unique<MemoryMappedFile>(cachePath);
+    }
+    catch (const std::exception&)
+    {
+        return false; // e.g. replaced by another process in the meantime
+    }
+
+    CacheHeader header;
+    if (cache->Size() < sizeof(header))
+        return false;
+    memcpy(&header, cache->Data(), sizeof(header));
+    if (header.m_magic != expected.m_magic || header.m_version != expected.m_version ||
+        header.m_numberOfFeatureStreams != expected.m_numberOfFeatureStreams || header.m_elementSize != expected.m_elementSize ||
+        header.m_verificationCode != expected.m_verificationCode ||
+        header.m_inputFileSize != expected.m_inputFileSize || header.m_inputFileTime != expected.m_inputFileTime ||
+        cache->Size() != sizeof(header) + (header.m_numberOfRecords + 1) * sizeof(uint64_t))
+    {
+        // outdated, or written by a process that did not finish
+        return false;
+    }
+
+    m_recordOffsets.resize(header.m_numberOfRecords + 1);
+    memcpy(m_recordOffsets.data(), cache->Data() + sizeof(header), m_recordOffsets.size() * sizeof(uint64_t));
+    return true;
+}
+
+void SparsePCDeserializer::WriteIndexCache(const wstring& cachePath, const CacheHeader& header)
+{
+    CacheHeader completeHeader = header;
+    completeHeader.m_numberOfRecords = m_recordOffsets.size() - 1;
+    try
+    {
+        WriteCacheAtomically(cachePath, L"index", [&](FILE* f)
+        {
+            fwriteOrDie(&completeHeader, sizeof(completeHeader), 1, f);
+            fwriteOrDie(m_recordOffsets, f);
+        });
+    }
+    catch (const std::exception& e)
+    {
+        // the index itself is fine, only later runs will have to build it again
+        fprintf(stderr, "WARNING: Could not write the index cache (%ls): %s\n", cachePath.c_str(), e.what());
+    }
+}
+
+void SparsePCDeserializer::CreateChunks(size_t chunkSizeInBytes)
+{
+    m_numberOfSequences = (m_recordOffsets.size() - 1) / m_microbatchSize;
+    for (size_t i = 0; i < m_numberOfSequences; i++)
+    {
+        if (m_chunkFirstSequences.empty() ||
+            m_recordOffsets[i * m_microbatchSize] - m_recordOffsets[m_chunkFirstSequences.back() * m_microbatchSize] >= chunkSizeInBytes)
+            m_chunkFirstSequences.push_back(i);
+    }
+
+    for (size_t i = 0; i < m_chunkFirstSequences.size(); i++)
+    {
+        size_t end = i + 1 < m_chunkFirstSequences.size() ? m_chunkFirstSequences[i + 1] : m_numberOfSequences;
+        auto description = make_shared<ChunkDescription>();
+        description->m_id = (ChunkIdType) i;
+        description->m_numberOfSamples = (end - m_chunkFirstSequences[i]) * m_microbatchSize;
+        description->m_numberOfSequences = end - m_chunkFirstSequences[i];
+        m_chunkDescriptions.push_back(description);
+    }
+    m_chunkFirstSequences.push_back(m_numberOfSequences);
+}
+
+ChunkDescriptions SparsePCDeserializer::GetChunkDescriptions()
+{
+    return m_chunkDescriptions;
+}
+
+void SparsePCDeserializer::GetSequencesForChunk(ChunkIdType chunkId, vector<SequenceDescription>& result)
+{
+    size_t begin = m_chunkFirstSequences[chunkId], end = m_chunkFirstSequences[chunkId + 1];
+    result.reserve(result.size() + end - begin);
+    for (size_t i = begin; i < end; i++)
+    {
+        SequenceDescription description;
+        description.m_id = i;
+        description.m_numberOfSamples = (uint32_t) m_microbatchSize;
+        description.m_chunkId = chunkId;
+        description.m_key.m_sequence = i; // the file has no keys, the sequences are identified by their position
+        description.m_key.m_sample = 0;
+        result.push_back(description);
+    }
+}
+
+ChunkPtr SparsePCDeserializer::GetChunk(ChunkIdType chunkId)
+{
+    return make_shared<SparsePCChunk>(*this, m_chunkFirstSequences[chunkId], m_chunkFirstSequences[chunkId + 1]);
+}
+
+bool SparsePCDeserializer::GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& result)
+{
+    if (key.m_sequence >= m_numberOfSequences)
+        return false;
+
+    auto chunk = upper_bound(m_chunkFirstSequences.begin(), m_chunkFirstSequences.end(), (size_t) key.m_sequence) - 1;
+    result.m_id = key.m_sequence;
+    result.m_numberOfSamples = (uint32_t) m_microbatchSize;
+    result.m_chunkId = (ChunkIdType) (chunk - m_chunkFirstSequences.begin());
+    result.m_key = key;
+    return true;
+}
+
+}}}
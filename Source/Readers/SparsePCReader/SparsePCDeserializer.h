@@ -0,0 +1,74 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include "DataDeserializerBase.h"
+#include "Config.h"
+#include "CorpusDescriptor.h"
+#include "MemoryMappedFile.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Deserializer of the files of the SparsePCReader (sparse parallel corpus), for use with the composite reader,
+// so that they get randomization, distributed reading and prefetch. The file is a sequence of records, each of
+// them a sparse sample of every feature stream followed by a label and optionally a verification code. The file
+// is memory mapped; a chunk is a range of records, which is paged in when the chunk is loaded, and single-sample
+// sequences are handed to the packer straight from the mapped pages.
+// The file has no index, so the offsets of the records are found in a pass over the file; with 'cacheIndex' they
+// are kept in <file>.index, which only the first of the workers has to build.
+class SparsePCDeserializer : public DataDeserializerBase
+{
+public:
+    // Config:
+    //     file = "data.bin"
+    //     precision = "float"             # as the file was written
+    //     microbatchSize = 1              # consecutive records that form a sequence, as of the SparsePCReader
+    //     verificationCode = 0            # if not 0, the code stored after every record
+    //     label = "labels"                # name of the label stream
+    //     chunkSizeInBytes = 33554432     # records are grouped into chunks of about this size
+    //     cacheIndex = false
+    //     input = [                       # the feature streams
+    //         query = [ dim = 49292 ]
+    //         doc = [ dim = 49292 ]
+    //     ]
+    //     featureOrder = "query:doc"      # the order of the feature streams in the records, by default that of the
+    //                                     # SparsePCReader: the reverse of the sorted names
+    SparsePCDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& config, bool primary);
+
+    ChunkDescriptions GetChunkDescriptions() override;
+    void GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& descriptions) override;
+    ChunkPtr GetChunk(ChunkIdType chunkId) override;
+
+protected:
+    bool GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& description) override;
+
+private:
+    class SparsePCChunk;
+    struct CacheHeader;
+
+    // Finds the records of the file, from the cache or with a pass over the file.
+    void BuildIndex(bool cacheIndex);
+    void IndexFile();
+    bool TryLoadIndexCache(const std::wstring& cachePath, const CacheHeader& expected);
+    void WriteIndexCache(const std::wstring& cachePath, const CacheHeader& header);
+    CacheHeader GetExpectedCacheHeader() const;
+
+    void CreateChunks(size_t chunkSizeInBytes);
+
+    std::shared_ptr<MemoryMappedFile> m_file;
+    ElementType m_elementType;
+    size_t m_numberOfFeatureStreams; // the streams are the features, then the label
+    size_t m_microbatchSize;
+    int32_t m_verificationCode;
+
+    std::vector<uint64_t> m_recordOffsets; // and the end of the last record
+    size_t m_numberOfSequences;             // of m_microbatchSize records each; a partial one at the end is dropped
+
+    std::vector<size_t> m_chunkFirstSequences; // and m_numberOfSequences at the end
+    ChunkDescriptions m_chunkDescriptions;
+};
+
+}}}
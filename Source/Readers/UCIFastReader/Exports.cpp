@@ -8,7 +8,9 @@
 #include "stdafx.h"
 #define DATAREADER_EXPORTS
 #include "DataReader.h"
-#include "UCIFastReader.h"
+#include "UCIDeserializer.h"
+#include "StringUtil.h"
+#include "UCIFastReader.h" // defines min
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -21,4 +23,22 @@ extern "C" DATAREADER_API void GetReaderD(IDataReader** preader)
     *preader = new UCIFastReader<double>();
 }
 
+// A factory method for creating UCI deserializers, for the composite reader.
+extern "C" DATAREADER_API bool CreateDeserializer(IDataDeserializer** deserializer, const std::wstring& type, const ConfigParameters& deserializerConfig, CorpusDescriptorPtr corpus, bool primary)
+{
+    string precision = deserializerConfig.Find("precision", "float");
+    if (!AreEqualIgnoreCase(precision, "float") && !AreEqualIgnoreCase(precision, "double"))
+    {
+        InvalidArgument("Unsupported precision '%s'", precision.c_str());
+    }
+
+    if (type == L"UCIDeserializer")
+        *deserializer = new UCIDeserializer(corpus, deserializerConfig, primary);
+    else
+        InvalidArgument("Unknown deserializer type '%ls'", type.c_str());
+
+    // Deserializer created.
+    return true;
+}
+
 }}}
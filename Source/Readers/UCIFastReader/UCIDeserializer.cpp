@@ -0,0 +1,398 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <fstream>
+#include "UCIDeserializer.h"
+#include "BinarySequenceData.h"
+#include "ElementTypeUtils.h"
+#include "StringUtil.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+using namespace std;
+
+static const size_t s_unusedColumn = SIZE_MAX;
+
+// Exact powers of ten; a mantissa of up to 53 bits scaled by one of them is rounded correctly.
+static const double s_powersOfTen[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Parses the number [begin, end): the digits are accumulated into an integer, which is scaled by an exact power
+// of ten. Numbers that this cannot do exactly (more than 19 digits, large exponents, nan, inf) go to strtod.
+static bool ParseNumber(const char* begin, const char* end, char decimalPoint, double& value)
+{
+    const char* p = begin;
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false, exact = true;
+    for (; p != end && *p >= '0' && *p <= '9'; ++p, any = true)
+    {
+        if (digits < 19)
+            mantissa = mantissa * 10 + (*p - '0'), digits += mantissa != 0;
+        else
+            exponent++, exact = false;
+    }
+    if (p != end && (*p == '.' || *p == decimalPoint))
+    {
+        for (++p; p != end && *p >= '0' && *p <= '9'; ++p, any = true)
+        {
+            if (digits < 19)
+                mantissa = mantissa * 10 + (*p - '0'), digits += mantissa != 0, exponent--;
+            else
+                exact = false;
+        }
+    }
+    if (any && p != end && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        bool negativeExponent = false;
+        if (p != end && (*p == '-' || *p == '+'))
+            negativeExponent = *p++ == '-';
+        if (p == end || *p < '0' || *p > '9')
+            return false;
+        int e = 0;
+        for (; p != end && *p >= '0' && *p <= '9'; ++p)
+            e = e < 10000 ? e * 10 + (*p - '0') : e;
+        exponent += negativeExponent ? -e : e;
+    }
+
+    if (any && p == end && exact && mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22)
+    {
+        double magnitude = exponent < 0 ? mantissa / s_powersOfTen[-exponent] : mantissa * s_powersOfTen[exponent];
+        value = negative ? -magnitude : magnitude;
+        return true;
+    }
+
+    string token(begin, end);
+    if (decimalPoint != 0)
+        replace(token.begin(), token.end(), decimalPoint, '.');
+    char* parsed;
+    value = strtod(token.c_str(), &parsed);
+    return !token.empty() && parsed == token.c_str() + token.size();
+}
+
+// Non empty lines are samples; the empty and those with just a carriage return are skipped.
+static bool IsEmptyLine(const char* begin, const char* end)
+{
+    return begin == end || (end - begin == 1 && *begin == '\r');
+}
+
+// Lines [m_firstLine, m_endLine) parsed into a buffer per stream, which the sequences reference.
+class UCIDeserializer::UCIChunk : public Chunk, public std::enable_shared_from_this<UCIChunk>
+{
+public:
+    UCIChunk(const UCIDeserializer& parent, ChunkIdType chunkId)
+        : m_parent(parent), m_firstLine(parent.m_chunkFirstLines[chunkId]), m_endLine(parent.m_chunkFirstLines[chunkId + 1])
+    {
+        const char* data = parent.m_file->Data();
+        const char* begin = data + parent.m_chunkOffsets[chunkId];
+        const char* end = data + parent.m_chunkOffsets[chunkId + 1];
+        if (parent.m_elementType == ElementType::tfloat)
+            parent.ParseLines<float>(begin, end, m_firstLine, m_buffers);
+        else
+            parent.ParseLines<double>(begin, end, m_firstLine, m_buffers);
+    }
+
+    void GetSequence(size_t sequenceId, std::vector<SequenceDataPtr>& result) override
+    {
+        if (sequenceId < m_firstLine || sequenceId >= m_endLine)
+            LogicError("UCIDeserializer: Sequence %" PRIu64 " does not belong to the chunk.", (uint64_t) sequenceId);
+
+        const size_t elementSize = GetSizeByType(m_parent.m_elementType);
+        for (size_t i = 0; i < m_buffers.size(); i++)
+        {
+            auto dense = make_shared<BinaryDenseSequenceData>();
+            dense->m_data = m_buffers[i].data() + (sequenceId - m_firstLine) * m_parent.m_inputs[i].m_dimension * elementSize;
+            dense->m_id = sequenceId;
+            dense->m_numberOfSamples = 1;
+            dense->m_elementType = m_parent.m_elementType;
+            dense->m_sampleLayout = m_parent.m_streams[i]->m_sampleLayout;
+            dense->m_chunk = shared_from_this();
+            result.push_back(dense);
+        }
+    }
+
+    size_t GetMemorySize() const override
+    {
+        size_t size = 0;
+        for (const auto& buffer : m_buffers)
+            size += buffer.size();
+        return size;
+    }
+
+private:
+    const UCIDeserializer& m_parent;
+    const size_t m_firstLine;
+    const size_t m_endLine;
+    vector<vector<char>> m_buffers;
+};
+
+UCIDeserializer::UCIDeserializer(CorpusDescriptorPtr /*corpus*/, const ConfigParameters& config, bool /*primary*/)
+    : m_numberOfLines(0)
+{
+    string precision = config.Find("precision", "float");
+    m_elementType = AreEqualIgnoreCase(precision, "double") ? ElementType::tdouble : ElementType::tfloat;
+
+    string delimiter = config(L"customDelimiter", "");
+    m_delimiter = delimiter.empty() ? char(0) : delimiter[0];
+    string decimalPoint = config(L"customDecimalPoint", "");
+    m_decimalPoint = decimalPoint.empty() ? char(0) : decimalPoint[0];
+    if (m_delimiter == m_decimalPoint && m_delimiter != 0)
+        InvalidArgument("UCIDeserializer: The delimiter and decimal point cannot be the same.");
+
+    if (!config.ExistsCurrent(L"file"))
+        InvalidArgument("UCIDeserializer configuration does not contain \"file\".");
+    if (!config.ExistsCurrent(L"input"))
+        InvalidArgument("UCIDeserializer configuration does not contain \"input\" section.");
+
+    const ConfigParameters& input = config(L"input");
+    for (const pair<string, ConfigParameters>& section : input)
+    {
+        const ConfigParameters& streamConfig = section.second;
+        Input stream;
+        stream.m_start = streamConfig(L"start", (size_t) 0);
+        size_t numberOfColumns = streamConfig(L"dim", (size_t) 0);
+        if (numberOfColumns == 0)
+            InvalidArgument("UCIDeserializer: Input '%s' does not specify its dimension 'dim'.", section.first.c_str());
+
+        string labelType = streamConfig(L"labelType", "regression");
+        stream.m_isCategory = AreEqualIgnoreCase(labelType, "category");
+        stream.m_dimension = numberOfColumns;
+        if (stream.m_isCategory)
+        {
+            if (numberOfColumns != 1)
+                InvalidArgument("UCIDeserializer: The category labels of input '%s' have to be a single column.", section.first.c_str());
+            stream.m_dimension = streamConfig(L"labelDim", (size_t) 0);
+
+            wstring mappingPath = streamConfig(L"labelMappingFile", L"");
+            if (!mappingPath.empty())
+            {
+                ifstream mapping(msra::strfun::utf8(mappingPath));
+                if (!mapping)
+                    RuntimeError("UCIDeserializer: Cannot open the label mapping file '%ls'.", mappingPath.c_str());
+                string line;
+                while (getline(mapping, line))
+                {
+                    line.erase(line.find_last_not_of(" \t\r") + 1);
+                    if (!line.empty())
+                        stream.m_labelIds.insert(make_pair(line, stream.m_labelIds.size()));
+                }
+                // if the dimension is not big enough for the labels, it is made so, as by the UCIFastReader
+                stream.m_dimension = max(stream.m_dimension, stream.m_labelIds.size());
+            }
+            if (stream.m_dimension == 0)
+                InvalidArgument("UCIDeserializer: Input '%s' specifies neither 'labelDim' nor 'labelMappingFile'.", section.first.c_str());
+        }
+        else if (!AreEqualIgnoreCase(labelType, "regression") && !AreEqualIgnoreCase(labelType, "none"))
+            InvalidArgument("UCIDeserializer: Unknown label type '%s' of input '%s'.", labelType.c_str(), section.first.c_str());
+
+        size_t streamId = m_inputs.size();
+        if (m_columns.size() < stream.m_start + numberOfColumns)
+            m_columns.resize(stream.m_start + numberOfColumns, make_pair(s_unusedColumn, (size_t) 0));
+        for (size_t c = 0; c < numberOfColumns; c++)
+        {
+            auto& column = m_columns[stream.m_start + c];
+            if (column.first != s_unusedColumn)
+                InvalidArgument("UCIDeserializer: Column %" PRIu64 " is used by more than one input.", (uint64_t) (stream.m_start + c));
+            column = make_pair(streamId, c);
+        }
+
+        auto description = make_shared<StreamDescription>();
+        description->m_id = streamId;
+        description->m_name = msra::strfun::utf16(section.first);
+        description->m_storageType = StorageType::dense;
+        description->m_elementType = m_elementType;
+        description->m_sampleLayout = make_shared<TensorShape>(stream.m_dimension);
+        m_streams.push_back(description);
+        m_inputs.push_back(move(stream));
+    }
+    if (m_inputs.empty())
+        InvalidArgument("UCIDeserializer configuration contains an empty \"input\" section.");
+
+    m_file = make_shared<MemoryMappedFile>(config(L"file"));
+    size_t chunkSizeInBytes = config(L"chunkSizeInBytes", (size_t) 32 * 1024 * 1024);
+    IndexFile(chunkSizeInBytes);
+
+    fprintf(stderr, "UCIDeserializer: %" PRIu64 " lines in %" PRIu64 " chunks\n", (uint64_t) m_numberOfLines, (uint64_t) m_chunkDescriptions.size());
+}
+
+// Finds the lines of the file, which are grouped into chunks; memchr() scans for the line ends a vector at a time.
+void UCIDeserializer::IndexFile(size_t chunkSizeInBytes)
+{
+    const char* data = m_file->Data();
+    const size_t size = m_file->Size();
+    m_file->Advise(0, size, MemoryMappedFile::Access::Sequential);
+
+    for (size_t offset = 0; offset < size;)
+    {
+        const char* line = data + offset;
+        const char* newline = (const char*) memchr(line, '\n', size - offset);
+        const char* lineEnd = newline ? newline : data + size;
+        if (!IsEmptyLine(line, lineEnd))
+        {
+            if (m_chunkOffsets.empty() || offset - m_chunkOffsets.back() >= chunkSizeInBytes)
+            {
+                m_chunkOffsets.push_back(offset);
+                m_chunkFirstLines.push_back(m_numberOfLines);
+            }
+            m_numberOfLines++;
+        }
+        offset = newline ? newline - data + 1 : size;
+    }
+
+    for (size_t i = 0; i < m_chunkFirstLines.size(); i++)
+    {
+        size_t end = i + 1 < m_chunkFirstLines.size() ? m_chunkFirstLines[i + 1] : m_numberOfLines;
+        auto description = make_shared<ChunkDescription>();
+        description->m_id = (ChunkIdType) i;
+        description->m_numberOfSamples = end - m_chunkFirstLines[i];
+        description->m_numberOfSequences = end - m_chunkFirstLines[i];
+        m_chunkDescriptions.push_back(description);
+    }
+    m_chunkFirstLines.push_back(m_numberOfLines);
+    m_chunkOffsets.push_back(size);
+
+    // From here on the file is only read by chunks, in the order of the randomization.
+    m_file->Advise(0, size, MemoryMappedFile::Access::Random);
+}
+
+template <class ElemType>
+void UCIDeserializer::ParseLines(const char* begin, const char* end, size_t firstLine, vector<vector<char>>& buffers) const
+{
+    m_file->Advise(begin - m_file->Data(), end - begin, MemoryMappedFile::Access::WillNeed);
+
+    size_t endLine = (size_t) (upper_bound(m_chunkFirstLines.begin(), m_chunkFirstLines.end(), firstLine) - m_chunkFirstLines.begin());
+    size_t numberOfLines = m_chunkFirstLines[endLine] - firstLine;
+
+    // Categories are one hot, so the buffers start out with zeros.
+    buffers.resize(m_inputs.size());
+    vector<ElemType*> samples(m_inputs.size());
+    for (size_t i = 0; i < m_inputs.size(); i++)
+        buffers[i].assign(numberOfLines * m_inputs[i].m_dimension * sizeof(ElemType), 0);
+
+    size_t line = 0;
+    for (const char* p = begin; p < end;)
+    {
+        const char* newline = (const char*) memchr(p, '\n', end - p);
+        const char* lineEnd = newline ? newline : end;
+        if (!IsEmptyLine(p, lineEnd))
+        {
+            if (line == numberOfLines)
+                RuntimeError("UCIDeserializer: '%ls' has changed since it was indexed.", m_file->Path().c_str());
+            for (size_t i = 0; i < m_inputs.size(); i++)
+                samples[i] = reinterpret_cast<ElemType*>(buffers[i].data()) + line * m_inputs[i].m_dimension;
+            ParseLine(p, lineEnd, firstLine + line, samples);
+            line++;
+        }
+        p = newline ? newline + 1 : end;
+    }
+    if (line != numberOfLines)
+        RuntimeError("UCIDeserializer: '%ls' has changed since it was indexed.", m_file->Path().c_str());
+}
+
+template <class ElemType>
+void UCIDeserializer::ParseLine(const char* begin, const char* end, size_t line, vector<ElemType*>& samples) const
+{
+    auto isDelimiter = [this](char c) { return c == ' ' || c == '\t' || c == '\r' || (c == m_delimiter && c != 0); };
+
+    const char* p = begin;
+    size_t column = 0;
+    for (; column < m_columns.size(); column++)
+    {
+        while (p != end && isDelimiter(*p))
+            ++p;
+        if (p == end)
+            break;
+        const char* token = p;
+        while (p != end && !isDelimiter(*p))
+            ++p;
+
+        const auto& target = m_columns[column];
+        if (target.first == s_unusedColumn)
+            continue;
+
+        const Input& input = m_inputs[target.first];
+        if (input.m_isCategory)
+        {
+            size_t id = SIZE_MAX;
+            if (!input.m_labelIds.empty())
+            {
+                auto label = input.m_labelIds.find(string(token, p));
+                if (label == input.m_labelIds.end())
+                    RuntimeError("UCIDeserializer: Label '%s' in line %" PRIu64 " is not in the label mapping file.", string(token, p).c_str(), (uint64_t) (line + 1));
+                id = label->second;
+            }
+            else
+            {
+                double value;
+                if (ParseNumber(token, p, m_decimalPoint, value) && value >= 0 && value < input.m_dimension && value == floor(value))
+                    id = (size_t) value;
+                else
+                    RuntimeError("UCIDeserializer: Label '%s' in line %" PRIu64 " is not a label id less than %" PRIu64 ".", string(token, p).c_str(), (uint64_t) (line + 1), (uint64_t) input.m_dimension);
+            }
+            samples[target.first][id] = 1;
+        }
+        else
+        {
+            double value;
+            if (!ParseNumber(token, p, m_decimalPoint, value))
+                RuntimeError("UCIDeserializer: '%s' in line %" PRIu64 " is not a number.", string(token, p).c_str(), (uint64_t) (line + 1));
+            samples[target.first][target.second] = (ElemType) value;
+        }
+    }
+    if (column < m_columns.size())
+        RuntimeError("UCIDeserializer: Line %" PRIu64 " has %" PRIu64 " columns, %" PRIu64 " are expected.", (uint64_t) (line + 1), (uint64_t) column, (uint64_t) m_columns.size());
+}
+
+ChunkDescriptions UCIDeserializer::GetChunkDescriptions()
+{
+    return m_chunkDescriptions;
+}
+
+void UCIDeserializer::GetSequencesForChunk(ChunkIdType chunkId, vector<SequenceDescription>& result)
+{
+    size_t begin = m_chunkFirstLines[chunkId], end = m_chunkFirstLines[chunkId + 1];
+    result.reserve(result.size() + end - begin);
+    for (size_t i = begin; i < end; i++)
+    {
+        SequenceDescription description;
+        description.m_id = i;
+        description.m_numberOfSamples = 1;
+        description.m_chunkId = chunkId;
+        description.m_key.m_sequence = i; // the file has no keys, the lines are identified by their position
+        description.m_key.m_sample = 0;
+        result.push_back(description);
+    }
+}
+
+ChunkPtr UCIDeserializer::GetChunk(ChunkIdType chunkId)
+{
+    return make_shared<UCIChunk>(*this, chunkId);
+}
+
+bool UCIDeserializer::GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& result)
+{
+    if (key.m_sequence >= m_numberOfLines)
+        return false;
+
+    auto chunk = upper_bound(m_chunkFirstLines.begin(), m_chunkFirstLines.end(), (size_t) key.m_sequence) - 1;
+    result.m_id = key.m_sequence;
+    result.m_numberOfSamples = 1;
+    result.m_chunkId = (ChunkIdType) (chunk - m_chunkFirstLines.begin());
+    result.m_key = key;
+    return true;
+}
+
+}}}
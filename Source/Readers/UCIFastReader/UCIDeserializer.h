@@ -0,0 +1,82 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <map>
+#include "DataDeserializerBase.h"
+#include "Config.h"
+#include "CorpusDescriptor.h"
+#include "MemoryMappedFile.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Deserializer of the dense text files of the UCIFastReader, for use with the composite reader, so that UCI
+// datasets get block randomization, distributed reading and prefetch. Every line is a sample, a list of numbers
+// separated by whitespace (or 'customDelimiter'); each stream is a range of columns of the line. The file is
+// memory mapped and only its line ends are found up front; a chunk is a range of lines, which is parsed when
+// the chunk is loaded, so that the prefetch threads parse the chunks in parallel.
+class UCIDeserializer : public DataDeserializerBase
+{
+public:
+    // Config:
+    //     file = "data.txt"
+    //     precision = "float"
+    //     chunkSizeInBytes = 33554432     # lines are grouped into chunks of about this size
+    //     customDelimiter = ","           # in addition to whitespace
+    //     customDecimalPoint = ","
+    //     input = [
+    //         features = [ start = 1 ; dim = 784 ]
+    //         labels = [ start = 0 ; dim = 1 ; labelType = "category" ; labelDim = 10 ; labelMappingFile = "labels.txt" ]
+    //     ]
+    // A stream is the values of its columns, unless labelType is "category": then it is a single column with the
+    // label, which is turned into a one hot vector of labelDim. The labels are the lines of labelMappingFile; without
+    // one, the label has to be the id itself, an integer less than labelDim.
+    UCIDeserializer(CorpusDescriptorPtr corpus, const ConfigParameters& config, bool primary);
+
+    ChunkDescriptions GetChunkDescriptions() override;
+    void GetSequencesForChunk(ChunkIdType chunkId, std::vector<SequenceDescription>& descriptions) override;
+    ChunkPtr GetChunk(ChunkIdType chunkId) override;
+
+protected:
+    bool GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& description) override;
+
+private:
+    class UCIChunk;
+
+    // The columns of a stream.
+    struct Input
+    {
+        size_t m_start;
+        size_t m_dimension; // of the stream; the number of columns is 1 for categories
+        bool m_isCategory;
+        std::map<std::string, size_t> m_labelIds; // from labelMappingFile
+    };
+
+    void IndexFile(size_t chunkSizeInBytes);
+
+    // Parses the lines [begin, end) of the file into a buffer per stream, with the samples one after another.
+    template <class ElemType>
+    void ParseLines(const char* begin, const char* end, size_t firstLine, std::vector<std::vector<char>>& buffers) const;
+
+    template <class ElemType>
+    void ParseLine(const char* begin, const char* end, size_t line, std::vector<ElemType*>& samples) const;
+
+    std::shared_ptr<MemoryMappedFile> m_file;
+    ElementType m_elementType;
+    char m_delimiter;
+    char m_decimalPoint;
+    std::vector<Input> m_inputs; // one per stream
+    // For each of the columns that are used, the stream and the position in the sample of that stream;
+    // SIZE_MAX for the columns in between.
+    std::vector<std::pair<size_t, size_t>> m_columns;
+    size_t m_numberOfLines;
+
+    std::vector<size_t> m_chunkFirstLines; // and m_numberOfLines at the end
+    std::vector<size_t> m_chunkOffsets;    // and the size of the file at the end
+    ChunkDescriptions m_chunkDescriptions;
+};
+
+}}}
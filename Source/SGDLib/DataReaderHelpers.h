@@ -176,8 +176,17 @@ namespace Microsoft { namespace MSR { namespace CNTK {
                 LogicError("ERROR: MBLayout borked, GetNumTimeSteps() mismatches minibatch number of columns\n");
 
             auto matrixp = make_shared<Matrix<ElemType>>(deviceId);
-            matrixp->AssignRowSliceValuesOf(mat.Reshaped(numRows * numParallelSequences, nT), st * numRows, (en - st) * numRows);
-            matrixp->Reshape(numRows, numNewParallelSequence * nT);
+            if (mat.GetMatrixType() == SPARSE) // (e.g. one-hot labels; in frame mode, the parallel sequences are the columns)
+            {
+                if (nT != 1)
+                    RuntimeError("DecimateMinibatch: Sparse inputs can only be decimated in frame mode.");
+                matrixp->SetValue(mat.ColumnSlice(st, numNewParallelSequence));
+            }
+            else
+            {
+                matrixp->AssignRowSliceValuesOf(mat.Reshaped(numRows * numParallelSequences, nT), st * numRows, (en - st) * numRows);
+                matrixp->Reshape(numRows, numNewParallelSequence * nT);
+            }
             decimatedMB.AddInput(name, matrixp, input.pMBLayout, input.sampleLayout);
             // If we had a RowSlice function, we would like to write in this way
             // decimatedMB[name]->SetValue(mat.Reshaped(nRows*nSequence, nT).RowSlice( st*nRows , (en-st)*nRows).Reshaped(nRows, nNewParallelSequence*nT));
@@ -258,6 +267,26 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         return 0;
     }
 
+    // The number of subminibatches for which one forward-backward pass over a minibatch of the given layout takes no more than
+    // 'budgetInBytes', with 'fixedBytes' taken regardless of the minibatch and 'bytesPerColumn' for each of its columns
+    // (the memory plan of the network, see MatrixPool::GetPlannedBytes()). SubminibatchDispatcher splits the parallel
+    // sequences, so a subminibatch has all time steps of at most ceil(#sequences / n) of them.
+    // Returns the number of parallel sequences, i.e. the finest split there is, if even that does not fit.
+    static size_t GetNumSubminibatchesToFit(const MBLayout& layout, size_t fixedBytes, size_t bytesPerColumn, size_t budgetInBytes)
+    {
+        const size_t numParallelSequences = layout.GetNumParallelSequences();
+        const size_t numTimeSteps = layout.GetNumTimeSteps();
+        if (budgetInBytes <= fixedBytes)
+            return numParallelSequences;
+        if (bytesPerColumn == 0 || numTimeSteps == 0)
+            return 1;
+
+        const size_t maxSequences = (budgetInBytes - fixedBytes) / bytesPerColumn / numTimeSteps;
+        if (maxSequences == 0)
+            return numParallelSequences;
+        return (numParallelSequences + maxSequences - 1) / maxSequences;
+    }
+
     // ===================================================================
     // SubminibatchHelpers -- helper for sub-minibatch implementation
     // TODO: Can this just exist inside SGD.cpp?
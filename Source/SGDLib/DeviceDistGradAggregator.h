@@ -0,0 +1,271 @@
+#pragma once
+
+#include "IDistGradAggregator.h"
+#include "NcclComm.h"
+#include "TimerUtility.h"
+#include "MatrixQuantizerImpl.h"
+#include "QuantizedMatrix.h"
+#include <memory>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Aggregates GPU gradients directly in device memory, without staging them through host buffers: through NCCL if CNTK
+// was built with it, else through an MPI that can operate on device memory (see MPIWrapper::IsCudaAware()).
+// Check IsSupported() after construction and fall back to SimpleDistGradAggregator if neither is available.
+//
+// With fewer gradient bits than the element type has, the gradients are quantized with error feedback as in 1-bit SGD,
+// but on the device and over packed buckets of gradients rather than gradient by gradient: each bucket is quantized
+// as a whole into a column-quantized matrix (with its residuals in one matrix of the same layout), whose column stripes are
+// exchanged with an all-to-all (so that every rank receives its stripe from everybody), summed up by the owner of the stripe,
+// quantized again (with a second residual) and all-gathered. All of it is issued in order on the compute stream (with NCCL)
+// without events or host syncs; with a CUDA-aware MPI, the host waits for the compute stream before each exchange.
+template <class ElemType>
+class DeviceDistGradAggregator : public IDistGradAggregator<ElemType>
+{
+    UsingIDistGradAggregatorMembers;
+
+    // height of the columns that the packed buckets are quantized in (each column has its own quantization range)
+    static const size_t QuantizedBucketColumnHeight = 2048;
+
+public:
+    DeviceDistGradAggregator(const MPIWrapperPtr& mpi, DEVICEID_TYPE deviceId, int syncStatsTrace,
+                             int numGradientBits = 8 * sizeof(ElemType), bool zeroThresholdFor1Bit = true, size_t gradientBucketSizeInBytes = 0)
+        : IDistGradAggregator<ElemType>(mpi), m_deviceId(deviceId), m_syncStatsTrace(syncStatsTrace), m_iterationCount(0), m_initialized(false),
+          m_numGradientBits(numGradientBits), m_zeroThresholdFor1Bit(zeroThresholdFor1Bit), m_gradientBucketSizeInBytes(gradientBucketSizeInBytes)
+    {
+        // all ranks have to take part in the creation of the NCCL communicator
+        m_nccl.reset(new NcclComm(deviceId, mpi));
+        bool ncclIsUsable = m_nccl->IsSupported() && (!IsQuantized() || m_nccl->IsAllToAllSupported());
+        m_useCudaAwareMpi = !ncclIsUsable && (deviceId != CPUDEVICE) && MPIWrapper::IsCudaAware();
+    }
+
+    bool IsSupported() const
+    {
+        return UseNccl() || m_useCudaAwareMpi;
+    }
+    const char* BackendName() const
+    {
+        return UseNccl() ? "NCCL" : "CUDA-aware MPI";
+    }
+
+    bool IsQuantized() const
+    {
+        return m_numGradientBits < (int) (8 * sizeof(ElemType));
+    }
+
+    bool AggregateGradients(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, bool /*resetState*/) override
+    {
+        if (!IsSupported())
+            LogicError("DeviceDistGradAggregator: Neither NCCL nor a CUDA-aware MPI is available.");
+
+        if (!m_initialized)
+        {
+            m_initialized = true;
+            for (size_t i = 0; i < gradients.size(); i++)
+            {
+                // Make sure none of the gradient matrixes are sparse - we currently do not support aggregation of sparse gradient matrices
+                if (gradients[i]->GetMatrixType() != DENSE)
+                    RuntimeError("Gradient aggregation for sparse gradient matrices is currently unsupported!");
+                if (gradients[i]->GetDeviceId() != m_deviceId)
+                    LogicError("DeviceDistGradAggregator: Gradient matrix on device %d, expected %d.", (int) gradients[i]->GetDeviceId(), (int) m_deviceId);
+            }
+
+            if (IsQuantized())
+                InitQuantizedBuckets(gradients);
+        }
+
+        bool showSyncPerfStats = (m_syncStatsTrace > 0) && ((m_iterationCount % m_syncStatsTrace) == 0);
+        m_iterationCount++;
+
+        Timer aggregationTimer;
+        if (showSyncPerfStats)
+        {
+            std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(m_deviceId));
+            mainStreamSyncEvent->SynchronizeEvent();
+            aggregationTimer.Start();
+        }
+
+        // If the current node did not process any samples, the gradients should be zero'd
+        if (headerCPU->numSamples == 0)
+        {
+            for (size_t i = 0; i < gradients.size(); ++i)
+                gradients[i]->SetValue(0);
+        }
+
+        // The header is summed up with a single allreduce of its fields, which overlaps with the gradient reduction
+        PackHeader(headerCPU, m_headerBuffer);
+        MPI_Request headerRequest;
+        MPI_Iallreduce(MPI_IN_PLACE, m_headerBuffer.data(), (int) m_headerBuffer.size(), MPI_DOUBLE, MPI_SUM, m_mpi->Communicator(), &headerRequest) || MpiFail("MPI_Iallreduce");
+
+        if (IsQuantized())
+        {
+            for (auto& bucket : m_quantizedBuckets)
+                AggregateQuantizedBucket(*bucket, gradients);
+        }
+        else if (UseNccl())
+        {
+            // issued on the compute stream, behind the backprop that produced the gradients and ahead of the update that consumes them
+            m_nccl->AllReduce(gradients);
+        }
+        else
+        {
+            // MPI reads the device memory directly, not in stream order, so the gradients must be complete first
+            std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(m_deviceId));
+            mainStreamSyncEvent->SynchronizeEvent();
+
+            std::vector<MPIAllReduceRequest> allReduceRequests(gradients.size());
+            for (size_t i = 0; i < gradients.size(); ++i)
+                m_mpi->AllReduceAsync(gradients[i]->Data(), gradients[i]->GetNumElements(), &allReduceRequests[i]);
+            for (size_t i = 0; i < gradients.size(); ++i)
+                m_mpi->Wait(&allReduceRequests[i]);
+        }
+
+        MPI_Wait(&headerRequest, MPI_STATUS_IGNORE) || MpiFail("MPI_Wait");
+        UnpackHeader(headerCPU, m_headerBuffer);
+
+        if (showSyncPerfStats)
+        {
+            m_nccl->Sync();
+            aggregationTimer.Stop();
+            double gradientAggregationTime = aggregationTimer.ElapsedSeconds();
+            fprintf(stderr, "Actual gradient aggregation time: %.6g\n", gradientAggregationTime);
+        }
+
+        return (headerCPU->numSamples != 0);
+    }
+
+private:
+    // the gradients packed into columns of QuantizedBucketColumnHeight elements, padded to a multiple of the number
+    // of ranks, so that every rank owns the same number of columns (its stripe)
+    struct QuantizedBucket
+    {
+        std::vector<size_t> m_gradientIndices;
+        size_t m_numStripeCols;
+        std::unique_ptr<Matrix<ElemType>> m_packedGradients;
+        std::unique_ptr<Matrix<ElemType>> m_residuals;
+        std::unique_ptr<QuantizedMatrix<ElemType>> m_quantizedGradients;  // sent to the owners of the stripes
+        std::unique_ptr<QuantizedMatrix<ElemType>> m_receivedStripes;     // this rank's stripe from every rank, in rank order
+        std::vector<QuantizedMatrix<ElemType>> m_receivedStripeSlices;
+        std::unique_ptr<Matrix<ElemType>> m_stripeSum;
+        std::unique_ptr<Matrix<ElemType>> m_stripeResiduals;
+        std::unique_ptr<QuantizedMatrix<ElemType>> m_quantizedStripeSum;
+        std::unique_ptr<QuantizedMatrix<ElemType>> m_gatheredStripeSums;  // the aggregate of all stripes
+    };
+
+    bool UseNccl() const
+    {
+        return m_nccl->IsSupported() && (!IsQuantized() || m_nccl->IsAllToAllSupported());
+    }
+
+    void InitQuantizedBuckets(const std::vector<Matrix<ElemType>*>& gradients)
+    {
+        m_quantizer.reset(MatrixQuantizerImpl<ElemType>::Create(m_deviceId, /*useAsync =*/ false));
+        size_t numRanks = NumProc();
+        size_t bucketSizeInElements = m_gradientBucketSizeInBytes / sizeof(ElemType); // (0: one bucket)
+        for (size_t i = 0; i < gradients.size();)
+        {
+            std::unique_ptr<QuantizedBucket> bucket(new QuantizedBucket());
+            size_t numElements = 0;
+            do
+            {
+                bucket->m_gradientIndices.push_back(i);
+                numElements += gradients[i]->GetNumElements();
+                i++;
+            } while ((i < gradients.size()) && ((bucketSizeInElements == 0) || (numElements + gradients[i]->GetNumElements() <= bucketSizeInElements)));
+
+            size_t numRows = QuantizedBucketColumnHeight;
+            size_t numCols = (numElements + numRows - 1) / numRows;
+            bucket->m_numStripeCols = (numCols + numRanks - 1) / numRanks;
+            numCols = bucket->m_numStripeCols * numRanks;
+
+            bucket->m_packedGradients.reset(new Matrix<ElemType>(numRows, numCols, m_deviceId));
+            bucket->m_packedGradients->SetValue(0); // (the padding stays zero)
+            bucket->m_residuals.reset(new Matrix<ElemType>(numRows, numCols, m_deviceId));
+            bucket->m_residuals->SetValue(0);
+            bucket->m_quantizedGradients.reset(new QuantizedMatrix<ElemType>(numRows, numCols, m_numGradientBits, m_deviceId));
+            bucket->m_receivedStripes.reset(new QuantizedMatrix<ElemType>(numRows, numCols, m_numGradientBits, m_deviceId));
+            for (size_t rank = 0; rank < numRanks; rank++)
+                bucket->m_receivedStripeSlices.push_back(bucket->m_receivedStripes->ColumnSlice(rank * bucket->m_numStripeCols, bucket->m_numStripeCols));
+            bucket->m_stripeSum.reset(new Matrix<ElemType>(numRows, bucket->m_numStripeCols, m_deviceId));
+            bucket->m_stripeResiduals.reset(new Matrix<ElemType>(numRows, bucket->m_numStripeCols, m_deviceId));
+            bucket->m_stripeResiduals->SetValue(0);
+            bucket->m_quantizedStripeSum.reset(new QuantizedMatrix<ElemType>(numRows, bucket->m_numStripeCols, m_numGradientBits, m_deviceId));
+            bucket->m_gatheredStripeSums.reset(new QuantizedMatrix<ElemType>(numRows, numCols, m_numGradientBits, m_deviceId));
+            m_quantizedBuckets.push_back(std::move(bucket));
+        }
+    }
+
+    void AggregateQuantizedBucket(QuantizedBucket& bucket, const std::vector<Matrix<ElemType>*>& gradients)
+    {
+        Matrix<ElemType>& packedGradients = *bucket.m_packedGradients;
+        Matrix<ElemType> flatGradients = packedGradients.Reshaped(1, packedGradients.GetNumElements());
+        size_t offset = 0;
+        for (auto i : bucket.m_gradientIndices)
+        {
+            size_t numElements = gradients[i]->GetNumElements();
+            flatGradients.ColumnSlice(offset, numElements).AssignValuesOf(gradients[i]->Reshaped(1, numElements));
+            offset += numElements;
+        }
+
+        // reduce-scatter: every rank sums up the quantized values of its stripe from all ranks
+        m_quantizer->QuantizeAsync(packedGradients, *bucket.m_residuals, *bucket.m_quantizedGradients, *bucket.m_residuals, m_zeroThresholdFor1Bit);
+        size_t stripeSize = bucket.m_quantizedStripeSum->GetSize();
+        Exchange(/*allToAll =*/ true, bucket.m_quantizedGradients->Buffer(), bucket.m_receivedStripes->Buffer(), stripeSize);
+        for (size_t rank = 0; rank < bucket.m_receivedStripeSlices.size(); rank++)
+            m_quantizer->UnquantizeAsync(bucket.m_receivedStripeSlices[rank], *bucket.m_stripeSum, /*add =*/ rank > 0);
+
+        // allgather of the quantized sums
+        m_quantizer->QuantizeAsync(*bucket.m_stripeSum, *bucket.m_stripeResiduals, *bucket.m_quantizedStripeSum, *bucket.m_stripeResiduals, m_zeroThresholdFor1Bit);
+        Exchange(/*allToAll =*/ false, bucket.m_quantizedStripeSum->Buffer(), bucket.m_gatheredStripeSums->Buffer(), stripeSize);
+        m_quantizer->UnquantizeAsync(*bucket.m_gatheredStripeSums, packedGradients, /*add =*/ false);
+
+        offset = 0;
+        for (auto i : bucket.m_gradientIndices)
+        {
+            size_t numElements = gradients[i]->GetNumElements();
+            gradients[i]->AssignValuesOf(flatGradients.ColumnSlice(offset, numElements).Reshaped(gradients[i]->GetNumRows(), gradients[i]->GetNumCols()));
+            offset += numElements;
+        }
+    }
+
+    void Exchange(bool allToAll, char* sendBuffer, char* recvBuffer, size_t bytesPerRank)
+    {
+        if (UseNccl())
+        {
+            if (allToAll)
+                m_nccl->AllToAll(sendBuffer, recvBuffer, bytesPerRank);
+            else
+                m_nccl->AllGather(sendBuffer, recvBuffer, bytesPerRank);
+            return;
+        }
+
+        // MPI reads the device memory directly, not in stream order
+        std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(m_deviceId));
+        mainStreamSyncEvent->SynchronizeEvent();
+        if (allToAll)
+            MPI_Alltoall(sendBuffer, (int) bytesPerRank, MPI_CHAR, recvBuffer, (int) bytesPerRank, MPI_CHAR, m_mpi->Communicator()) || MpiFail("MPI_Alltoall");
+        else
+            MPI_Allgather(sendBuffer, (int) bytesPerRank, MPI_CHAR, recvBuffer, (int) bytesPerRank, MPI_CHAR, m_mpi->Communicator()) || MpiFail("MPI_Allgather");
+    }
+
+    DEVICEID_TYPE m_deviceId;
+    std::unique_ptr<NcclComm> m_nccl;
+    bool m_useCudaAwareMpi;
+
+    int m_numGradientBits;
+    bool m_zeroThresholdFor1Bit;
+    size_t m_gradientBucketSizeInBytes;
+    std::unique_ptr<MatrixQuantizerImpl<ElemType>> m_quantizer;
+    std::vector<std::unique_ptr<QuantizedBucket>> m_quantizedBuckets;
+
+    std::vector<double> m_headerBuffer;
+
+    int m_syncStatsTrace;
+
+    // Only used for controlling frequency of measuring/showing gradient aggregation perf stats
+    size_t m_iterationCount;
+
+    bool m_initialized;
+};
+} } }
@@ -0,0 +1,277 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include "ComputationNetwork.h"
+#include "ComputationNode.h"
+#include "TrainingNodes.h"
+#include "Criterion.h"
+#include "DataReaderHelpers.h"
+#include "Matrix.h"
+#include <future>
+#include <list>
+#include <memory>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Data-parallel training on the GPUs of one process: the main network, on its own device, and replicas of it on further
+// devices each process a share of the parallel sequences of every minibatch that the main network read, the replicas
+// on threads of their own. The gradients of the replicas are then added into those of the main network with peer copies
+// (staged through the host by the driver where the devices have no peer access), the main network takes the update
+// step, and the updated parameters are copied back. The learner state exists only on the main device. The criteria
+// are accumulated on each device and summed up when read. The running statistics of BatchNormalization are those of
+// the share of the main network.
+template <class ElemType>
+class DeviceReplicas
+{
+    typedef std::shared_ptr<ComputationNode<ElemType>> ComputationNodePtr;
+
+public:
+    // 'replicaNets' are compiled, allocated copies of 'net' on other devices; nodes are matched by name
+    DeviceReplicas(const ComputationNetworkPtr& net, const std::vector<ComputationNetworkPtr>& replicaNets,
+                   const ComputationNodeBasePtr& criterionNode, const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                   const std::list<ComputationNodeBasePtr>& learnableNodes, const StreamMinibatchInputs& inputMatrices)
+        : m_transferBuffer(net->GetDeviceId())
+    {
+        for (const auto& replicaNet : replicaNets)
+        {
+            auto replica = std::make_shared<Replica>();
+            replica->m_net = replicaNet;
+            replica->m_criterionNodes.push_back(replicaNet->GetNodeFromName(criterionNode->NodeName()));
+            for (const auto& node : evaluationNodes)
+                replica->m_evaluationNodes.push_back(replicaNet->GetNodeFromName(node->NodeName()));
+            for (const auto& node : learnableNodes)
+                replica->m_learnableNodes.push_back(dynamic_pointer_cast<ComputationNode<ElemType>>(replicaNet->GetNodeFromName(node->NodeName())));
+            for (const auto& iter : inputMatrices)
+            {
+                auto node = replicaNet->GetNodeFromName(iter.first);
+                replica->m_inputNodes.push_back(node);
+                replica->m_inputMatrices.AddInput(iter.first, node->ValuePtr(), node->GetMBLayout(), node->GetSampleLayout());
+            }
+            replica->m_dropoutNodes = replicaNet->GetNodesWithType(OperationNameOf(DropoutNode), replica->m_criterionNodes[0]);
+            replica->m_batchNormalizationNodes = replicaNet->GetNodesWithType(OperationNameOf(BatchNormalizationNode), replica->m_criterionNodes[0]);
+            m_replicas.push_back(replica);
+        }
+    }
+
+    size_t GetNumDevices() const { return m_replicas.size() + 1; }
+
+    // Copies the model values of the main network (also those that are not learned) and the per-epoch settings of its
+    // Dropout and BatchNormalization nodes to the replicas, which draw their own dropout masks.
+    void StartEpoch(const ComputationNetworkPtr& net, size_t epochNumber, size_t maxEpochs)
+    {
+        for (size_t r = 0; r < m_replicas.size(); r++)
+        {
+            auto& replica = *m_replicas[r];
+            for (const auto& node : net->GetAllNodes())
+            {
+                if (!node->IsModelValue() || !node->As<ComputationNode<ElemType>>()->ValuePtr())
+                    continue;
+                auto replicaNode = replica.m_net->GetNodeFromName(node->NodeName());
+                CopyToDevice(node->As<ComputationNode<ElemType>>()->Value(), replicaNode->template As<ComputationNode<ElemType>>()->Value());
+                replicaNode->BumpEvalTimeStamp();
+            }
+
+            // the seeds of ComputationNetwork::SetDropoutRate() for parallel worker r + 1
+            size_t randSeed = ((r + 1) * maxEpochs + epochNumber) * replica.m_dropoutNodes.size();
+            for (const auto& node : replica.m_dropoutNodes)
+            {
+                auto dropoutNode = dynamic_pointer_cast<DropoutNode<ElemType>>(node);
+                dropoutNode->SetDropoutRate(dynamic_pointer_cast<DropoutNode<ElemType>>(net->GetNodeFromName(node->NodeName()))->GetDropoutRate());
+                dropoutNode->SetRandomSeed((unsigned long) randSeed++);
+            }
+            for (const auto& node : replica.m_batchNormalizationNodes)
+            {
+                auto mainNode = dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(net->GetNodeFromName(node->NodeName()));
+                auto undefined = std::numeric_limits<double>::quiet_NaN(); // (never equal, so both are set)
+                dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(node)->SetNormalizationTimeConstants(mainNode->NormalizationTimeConstant(), undefined, mainNode->BlendTimeConstant(), undefined);
+            }
+
+            replica.m_net->Environment().SetOperationMode(NetworkOperationMode::training);
+            replica.m_net->StartEvaluateMinibatchLoop(replica.m_evaluationNodes);
+            replica.m_net->StartEvaluateMinibatchLoop(replica.m_criterionNodes[0]);
+            replica.m_epochCriterion = std::make_shared<CriterionAccumulator<ElemType>>(1, replica.m_net->GetDeviceId());
+            replica.m_epochEvalErrors = std::make_shared<CriterionAccumulator<ElemType>>(replica.m_evaluationNodes.size(), replica.m_net->GetDeviceId());
+        }
+    }
+
+    // Called after the main network read a minibatch: hands the shares of the other devices to the replicas, which
+    // start their forward (and, with 'computeGradient', backward) passes, and decimates the inputs of the main network
+    // to its own share. Returns the number of columns of that share.
+    size_t StartMinibatch(const ComputationNetworkPtr& net, StreamMinibatchInputs& inputMatrices, bool computeGradient)
+    {
+        auto& pMBLayout = net->GetMBLayoutPtrOfNetwork();
+        for (const auto& iter : inputMatrices)
+        {
+            if (iter.second.pMBLayout != pMBLayout)
+                RuntimeError("DeviceReplicas: The input '%ls' has a layout of its own; a minibatch can only be split across devices if all inputs share the layout of the network.", iter.first.c_str());
+        }
+
+        for (size_t r = 0; r < m_replicas.size(); r++)
+        {
+            auto& replica = *m_replicas[r];
+            StreamMinibatchInputs share;
+            MBLayoutPtr pShareMBLayout;
+            DataReaderHelpers::DecimateMinibatch<ElemType>(inputMatrices, share, pMBLayout, pShareMBLayout, GetNumDevices(), r + 1);
+            for (const auto& iter : share)
+            {
+                auto& matrix = share.GetInputMatrix<ElemType>(iter.first);
+                matrix.TransferToDeviceIfNotThere(replica.m_net->GetDeviceId(), /*isBeingMoved=*/true); // (also for sparse inputs)
+                replica.m_inputMatrices.template GetInputMatrix<ElemType>(iter.first).SetValue(matrix);
+            }
+            replica.m_net->GetMBLayoutPtrOfNetwork()->CopyFrom(pShareMBLayout);
+            DataReaderHelpers::NotifyChangedNodes<ElemType>(replica.m_net, replica.m_inputMatrices);
+            replica.m_numSamples = replica.m_net->DetermineActualMBSizeFromFeatures();
+            replica.m_hasGradients = computeGradient && replica.m_numSamples > 0;
+            ComputationNetwork::BumpEvalTimeStamp(replica.m_inputNodes);
+
+            auto* replicaPtr = &replica;
+            replica.m_pendingMinibatch = std::async(std::launch::async, [replicaPtr]() { replicaPtr->RunMinibatch(); });
+        }
+
+        DataReaderHelpers::DecimateMinibatchInPlace<ElemType>(inputMatrices, GetNumDevices(), 0, pMBLayout);
+        DataReaderHelpers::NotifyChangedNodes<ElemType>(net, inputMatrices);
+        return net->DetermineActualMBSizeFromFeatures();
+    }
+
+    // Waits for the replicas to complete the minibatch, and adds the number of their samples to those of the main network
+    // (all samples, and those with a label, as in SGD::TrainOneEpoch()).
+    void EndMinibatch(size_t& numSamples, size_t& numSamplesWithLabel)
+    {
+        for (auto& replica : m_replicas)
+        {
+            replica->m_pendingMinibatch.get(); // (rethrows an exception of the replica)
+            numSamples += replica->m_numSamples;
+            numSamplesWithLabel += replica->m_numSamplesWithLabel;
+        }
+    }
+
+    // Adds the gradients of the replicas into those of the learnable nodes of the main network. If the main network
+    // did not compute gradients for this minibatch (e.g. its share was empty), they are overwritten instead.
+    void ReduceGradients(const std::list<ComputationNodeBasePtr>& learnableNodes, bool mainHasGradients)
+    {
+        size_t i = 0;
+        for (const auto& node : learnableNodes)
+        {
+            size_t index = i++;
+            if (!node->IsParameterUpdateRequired())
+                continue;
+
+            auto mainNode = node->As<ComputationNode<ElemType>>();
+            mainNode->CreateGradientMatrixIfNull();
+            auto& gradient = mainNode->Gradient();
+            bool assign = !mainHasGradients;
+            for (const auto& replica : m_replicas)
+            {
+                if (!replica->m_hasGradients)
+                    continue;
+
+                const auto& replicaGradient = replica->m_learnableNodes[index]->Gradient();
+                if (replicaGradient.GetMatrixType() != DENSE || (!assign && gradient.GetMatrixType() != DENSE))
+                    RuntimeError("DeviceReplicas: The gradient of %ls is sparse; only dense gradients can be reduced across devices.", node->NodeDescription().c_str());
+                if (assign)
+                {
+                    gradient.AssignValuesOf(replicaGradient);
+                    assign = false;
+                }
+                else
+                {
+                    m_transferBuffer.AssignValuesOf(replicaGradient);
+                    Matrix<ElemType>::ScaleAndAdd(1, m_transferBuffer, gradient);
+                }
+            }
+        }
+    }
+
+    // Copies the updated learnable parameters of the main network to the replicas.
+    void BroadcastParameters(const std::list<ComputationNodeBasePtr>& learnableNodes)
+    {
+        for (const auto& replica : m_replicas)
+        {
+            size_t i = 0;
+            for (const auto& node : learnableNodes)
+            {
+                const auto& replicaNode = replica->m_learnableNodes[i++];
+                if (!node->IsParameterUpdateRequired())
+                    continue;
+                CopyToDevice(node->As<ComputationNode<ElemType>>()->Value(), replicaNode->Value());
+                replicaNode->BumpEvalTimeStamp();
+            }
+        }
+    }
+
+    // Adds the criteria that the replicas accumulated since StartEpoch().
+    void AddEpochCriteria(EpochCriterion& epochCriterion, std::vector<EpochCriterion>& epochEvalErrors) const
+    {
+        for (const auto& replica : m_replicas)
+        {
+            epochCriterion += replica->m_epochCriterion->GetCriterion(0);
+            for (size_t i = 0; i < epochEvalErrors.size(); i++)
+                epochEvalErrors[i] += replica->m_epochEvalErrors->GetCriterion(i);
+        }
+    }
+
+private:
+    // copies values into a matrix that keeps its device
+    static void CopyToDevice(const Matrix<ElemType>& from, Matrix<ElemType>& to)
+    {
+        if (from.GetMatrixType() == DENSE && to.GetMatrixType() == DENSE)
+            to.AssignValuesOf(from); // (a peer copy between GPUs)
+        else
+        {
+            Matrix<ElemType> value = from.DeepClone();
+            value.TransferToDeviceIfNotThere(to.GetDeviceId(), /*isBeingMoved=*/true);
+            to.SetValue(value);
+        }
+    }
+
+    struct Replica
+    {
+        ComputationNetworkPtr m_net;
+        std::vector<ComputationNodeBasePtr> m_criterionNodes; // (a single one, as CriterionAccumulator takes vectors)
+        std::vector<ComputationNodeBasePtr> m_evaluationNodes;
+        std::vector<ComputationNodePtr> m_learnableNodes; // in the order of the learnable nodes of the main network
+        std::vector<ComputationNodeBasePtr> m_inputNodes;
+        StreamMinibatchInputs m_inputMatrices;
+        std::list<ComputationNodeBasePtr> m_dropoutNodes;
+        std::list<ComputationNodeBasePtr> m_batchNormalizationNodes;
+
+        std::shared_ptr<CriterionAccumulator<ElemType>> m_epochCriterion;
+        std::shared_ptr<CriterionAccumulator<ElemType>> m_epochEvalErrors;
+
+        // of the current minibatch
+        size_t m_numSamples = 0;
+        size_t m_numSamplesWithLabel = 0;
+        bool m_hasGradients = false;
+        std::future<void> m_pendingMinibatch;
+
+        // the forward and backward passes of SGD::TrainOneEpoch() on the share of the replica
+        void RunMinibatch()
+        {
+            m_numSamplesWithLabel = 0;
+            if (m_numSamples == 0)
+                return;
+
+            for (const auto& node : m_dropoutNodes) // (a new mask in every minibatch)
+                node->SetEvalTimeStampOutdatedWrtAll();
+            m_net->ForwardProp(m_evaluationNodes);
+            m_net->ForwardProp(m_criterionNodes[0]);
+            if (m_hasGradients)
+                m_net->Backprop(m_criterionNodes[0]);
+
+            size_t numSamplesWithLabelOfNetwork = m_net->GetNumSamplesWithLabelOfNetwork(m_numSamples);
+            m_epochCriterion->Add(m_criterionNodes, 0, numSamplesWithLabelOfNetwork);
+            for (size_t i = 0; i < m_evaluationNodes.size(); i++)
+                m_epochEvalErrors->Add(m_evaluationNodes, i, numSamplesWithLabelOfNetwork);
+            m_numSamplesWithLabel = CriterionAccumulator<ElemType>::GetNumSamples(m_criterionNodes[0], numSamplesWithLabelOfNetwork);
+        }
+    };
+
+    std::vector<std::shared_ptr<Replica>> m_replicas;
+    Matrix<ElemType> m_transferBuffer; // for a gradient of a replica, on the main device
+};
+
+}}}
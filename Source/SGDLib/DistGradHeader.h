@@ -52,6 +52,38 @@ public:
         return DistGradHeaderSize(numEvalNode);
     }
 
+    // The header as a fixed layout of numbers, so that it can be summed up across nodes with a single allreduce:
+    // numSamples, numSamplesWithLabel, criterion, then numerator and denominator of each eval node.
+    // Doubles represent the sample counts exactly up to 2^53.
+    size_t NumPackedValues() const
+    {
+        return 3 + 2 * (size_t) numEvalNode;
+    }
+
+    void Pack(double* values) const
+    {
+        values[0] = (double) numSamples;
+        values[1] = (double) numSamplesWithLabel;
+        values[2] = criterion;
+        for (int i = 0; i < numEvalNode; i++)
+        {
+            values[3 + 2 * i] = evalErrors[i].first;
+            values[4 + 2 * i] = (double) evalErrors[i].second;
+        }
+    }
+
+    void Unpack(const double* values)
+    {
+        numSamples = (size_t) values[0];
+        numSamplesWithLabel = (size_t) values[1];
+        criterion = values[2];
+        for (int i = 0; i < numEvalNode; i++)
+        {
+            evalErrors[i].first  = values[3 + 2 * i];
+            evalErrors[i].second = (size_t) values[4 + 2 * i];
+        }
+    }
+
     void Clear()
     {
         numSamples = 0;
@@ -0,0 +1,186 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include "ComputationNetwork.h"
+#include "ComputationNode.h"
+#include "GPUMatrix.h"
+#include "Matrix.h"
+#include <functional>
+#include <memory>
+#include <set>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Runs the forward and backward pass of training steps through a GPUGraph, so that the many small kernel launches of
+// a step are replaced by a single one. Steps are identified by the layouts and sizes of the inputs: the first step of
+// a kind runs as usual, the second one is captured into a graph, and the graph is replayed for all further steps of
+// that kind as long as no step of another kind comes in between, which would resize the matrices the graph refers to.
+// The graph reads the inputs from buffers of its own, into which each step copies the values of the input nodes,
+// since the reader swaps the buffers of the input nodes from minibatch to minibatch.
+// Steps run as usual if any node cannot be captured (see ComputationNodeBase::CanBeCapturedInGPUGraph()), for sparse
+// inputs, and for layouts with gaps. If the capture of a step fails, e.g. because a node reads values back to the host,
+// the step is run as usual, and graphs are given up after a few failures.
+template <class ElemType>
+class GPUGraphStep
+{
+public:
+    GPUGraphStep(const ComputationNetworkPtr& net, const std::vector<ComputationNodeBasePtr>& inputNodes, const std::vector<ComputationNodeBasePtr>& rootNodes, int traceLevel)
+        : m_net(net), m_inputNodes(inputNodes), m_traceLevel(traceLevel), m_isEnabled(true), m_numRepeats(0), m_numFailures(0)
+    {
+        if (net->GetDeviceId() < 0 || !GPUGraph::IsSupported())
+        {
+            Disable(L"it requires a GPU and CUDA 10.1 or later");
+            return;
+        }
+        for (const auto& root : rootNodes)
+        {
+            for (const auto& node : net->GetEvalOrder(root))
+            {
+                if (!node->CanBeCapturedInGPUGraph())
+                {
+                    Disable(msra::strfun::wstrprintf(L"%ls %ls operation cannot be captured", node->NodeName().c_str(), node->OperationName().c_str()));
+                    return;
+                }
+            }
+        }
+    }
+
+    bool IsEnabled() const { return m_isEnabled; }
+
+    // Runs 'step', which does the forward and backward pass of the current minibatch on the GPU and nothing else,
+    // either as usual or through the graph. 'computeGradient' tells whether 'step' includes the backward pass.
+    void Run(bool computeGradient, const std::function<void()>& step)
+    {
+        auto key = m_isEnabled ? GetKey(computeGradient) : std::vector<size_t>();
+        if (key.empty() || key != m_key)
+        {
+            m_graph.reset();
+            m_key = key;
+            m_numRepeats = 0;
+            step();
+            return;
+        }
+
+        m_numRepeats++;
+        if (!m_graph)
+        {
+            if (!Capture(step))
+            {
+                step();
+                return;
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < m_inputNodes.size(); i++)
+                m_capturedInputs[i]->SetValue(InputValue(i));
+        }
+        m_graph->Launch();
+    }
+
+private:
+    Matrix<ElemType>& InputValue(size_t i) { return dynamic_pointer_cast<ComputationNode<ElemType>>(m_inputNodes[i])->Value(); }
+
+    // The layouts and sizes of the inputs that the work of a step depends on, or empty if it cannot be captured.
+    std::vector<size_t> GetKey(bool computeGradient)
+    {
+        std::vector<size_t> key{ computeGradient ? 1U : 0U };
+        std::set<MBLayoutPtr> layouts;
+        for (size_t i = 0; i < m_inputNodes.size(); i++)
+        {
+            const auto& value = InputValue(i);
+            if (value.GetMatrixType() != DENSE)
+                return std::vector<size_t>();
+            key.push_back(value.GetNumRows());
+            key.push_back(value.GetNumCols());
+            const auto& layout = m_inputNodes[i]->GetMBLayout();
+            if (!layout || !layouts.insert(layout).second)
+                continue;
+            if (layout->HasGaps())
+                return std::vector<size_t>();
+            key.push_back(layout->GetNumParallelSequences());
+            key.push_back(layout->GetNumTimeSteps());
+            for (const auto& sequence : layout->GetAllSequences())
+            {
+                key.push_back(sequence.s);
+                key.push_back((size_t) sequence.tBegin);
+                key.push_back(sequence.tEnd);
+            }
+        }
+        return key;
+    }
+
+    // Captures the step into m_graph while the input nodes refer to the buffers of the graph. The captured work has
+    // not been run yet; returns false if the capture failed.
+    bool Capture(const std::function<void()>& step)
+    {
+        std::unique_ptr<GPUGraph> graph(new GPUGraph(m_net->GetDeviceId()));
+        m_capturedInputs.resize(m_inputNodes.size());
+        for (size_t i = 0; i < m_inputNodes.size(); i++)
+        {
+            if (!m_capturedInputs[i])
+                m_capturedInputs[i] = std::make_shared<Matrix<ElemType>>(m_net->GetDeviceId());
+            m_capturedInputs[i]->SetValue(InputValue(i));
+            std::swap(InputValue(i), *m_capturedInputs[i]);
+        }
+        ComputationNetwork::BumpEvalTimeStamp(m_inputNodes); // everything depending on the inputs is to be captured
+
+        std::string error;
+        graph->BeginCapture();
+        try
+        {
+            step();
+        }
+        catch (const std::exception& e) // the capture failed; if it was a genuine error, running the step as usual reports it again
+        {
+            error = e.what();
+        }
+        bool captured = graph->EndCapture() && error.empty();
+
+        for (size_t i = 0; i < m_inputNodes.size(); i++)
+            std::swap(InputValue(i), *m_capturedInputs[i]);
+        ComputationNetwork::BumpEvalTimeStamp(m_inputNodes);
+
+        if (!captured)
+        {
+            if (++m_numFailures >= s_maxNumFailures)
+                Disable(L"their capture failed repeatedly");
+            else if (m_traceLevel > 0)
+                fprintf(stderr, "GPUGraphStep: The capture of a training step failed, it is run as usual%s%s.\n", error.empty() ? "" : ": ", error.c_str());
+            m_key.clear(); // try again once the step has been run as usual
+            return false;
+        }
+        if (m_traceLevel > 0)
+            fprintf(stderr, "GPUGraphStep: Captured a training step after %d steps of its kind.\n", (int) m_numRepeats);
+        m_graph = std::move(graph);
+        return true;
+    }
+
+    void Disable(const std::wstring& reason)
+    {
+        if (m_traceLevel > 0)
+            fprintf(stderr, "GPUGraphStep: Training steps are not run through GPU graphs, since %ls.\n", reason.c_str());
+        m_isEnabled = false;
+        m_graph.reset();
+        m_key.clear();
+    }
+
+    static const size_t s_maxNumFailures = 3;
+
+    ComputationNetworkPtr m_net;
+    std::vector<ComputationNodeBasePtr> m_inputNodes;
+    int m_traceLevel;
+    bool m_isEnabled;
+
+    std::vector<size_t> m_key; // of the last step
+    size_t m_numRepeats;       // steps of that kind since the first one
+    size_t m_numFailures;
+    std::unique_ptr<GPUGraph> m_graph;                                // of m_key, once captured
+    std::vector<std::shared_ptr<Matrix<ElemType>>> m_capturedInputs; // the buffers of the inputs the graph reads
+};
+
+}}}
@@ -2,6 +2,9 @@
 
 #include "DistGradHeader.h"
 #include "MPIWrapper.h"
+#include "StragglerMonitor.h"
+#include <memory>
+#include <vector>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -19,6 +22,13 @@ public:
     // Returns a boolean indicating if any samples were processed
     virtual bool AggregateGradients(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, bool resetState) = 0;
 
+    // Called during backprop for a gradient matrix as soon as it is complete, so that its aggregation can start
+    // while the rest of the backward pass is still running. Optional; AggregateGradients() handles all gradients
+    // that were not announced this way.
+    virtual void OnGradientReady(Matrix<ElemType>* /*gradient*/)
+    {
+    }
+
     size_t NumProc()
     {
         return m_mpi->NumNodesInUse();
@@ -34,14 +44,40 @@ public:
         m_mpi->WaitAll();
     }
 
+    // per-rank timing to go along with the header, see StragglerMonitor
+    void SetStragglerMonitor(const std::shared_ptr<StragglerMonitor>& monitor)
+    {
+        m_stragglerMonitor = monitor;
+    }
+
 protected:
+    // The header in the layout of DistGradHeader::Pack(), followed by the values of the StragglerMonitor if there is one,
+    // all of them to be summed up across the nodes by a single allreduce.
+    void PackHeader(const DistGradHeader* header, std::vector<double>& buffer) const
+    {
+        buffer.resize(header->NumPackedValues() + (m_stragglerMonitor ? m_stragglerMonitor->NumPackedValues() : 0));
+        header->Pack(buffer.data());
+        if (m_stragglerMonitor)
+            m_stragglerMonitor->Pack(buffer.data() + header->NumPackedValues());
+    }
+
+    void UnpackHeader(DistGradHeader* header, const std::vector<double>& buffer) const
+    {
+        header->Unpack(buffer.data());
+        if (m_stragglerMonitor)
+            m_stragglerMonitor->Unpack(buffer.data() + header->NumPackedValues());
+    }
+
     MPIWrapperPtr m_mpi;
+    std::shared_ptr<StragglerMonitor> m_stragglerMonitor;
 };
 
-#define UsingIDistGradAggregatorMembers           \
+#define UsingIDistGradAggregatorMembers              \
     \
-protected:                                        \
-    using IDistGradAggregator<ElemType>::m_mpi;   \
-    using IDistGradAggregator<ElemType>::NumProc; \
-    using IDistGradAggregator<ElemType>::MyRank
+protected:                                           \
+    using IDistGradAggregator<ElemType>::m_mpi;      \
+    using IDistGradAggregator<ElemType>::NumProc;    \
+    using IDistGradAggregator<ElemType>::MyRank;     \
+    using IDistGradAggregator<ElemType>::PackHeader; \
+    using IDistGradAggregator<ElemType>::UnpackHeader
 } } }
@@ -0,0 +1,300 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include "Basics.h"
+#include "ComputationNetwork.h"
+#include "TrainingNodes.h"
+#include "File.h"
+#include "Matrix.h"
+#include <list>
+#include <memory>
+#include <string.h>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Incremental checkpoints: between full checkpoints (the model file and the .ckp file of an epoch), SGD writes a
+// delta file per epoch with only the columns of the model values and smoothed gradients that differ from those of
+// the last full checkpoint (its base), together with the counters of the .ckp file. A column is one embedding vector
+// of a LookupTable or a sparse-input Times, so a delta of a model whose epochs touch few of the embeddings is a small
+// fraction of the full checkpoint. The changed columns are found by comparing with a copy of the base on the CPU,
+// which finds every change, also those of dense momentum and regularization that a sparse gradient does not show
+// (then the delta is as large as the full checkpoint). Loading a delta loads its base and applies it; the deltas are
+// cumulative, so only the latest one is needed.
+template <class ElemType>
+class IncrementalCheckpoint
+{
+public:
+    IncrementalCheckpoint() : m_baseEpoch(-1) { }
+
+    bool HasBase() const { return m_baseEpoch >= 0; }
+    int BaseEpoch() const { return m_baseEpoch; }
+
+    // Takes the copy of a full checkpoint that the following deltas are relative to.
+    void SetBase(int epoch, const ComputationNetworkPtr& net, const std::list<Matrix<ElemType>>& smoothedGradients)
+    {
+        m_baseValues.clear();
+        for (const auto& node : ModelValueNodes(net))
+            m_baseValues.push_back(ToCPU(node->Value()));
+        m_baseSmoothedGradients.clear();
+        for (const auto& smoothedGradient : smoothedGradients)
+            m_baseSmoothedGradients.push_back(ToCPU(smoothedGradient));
+        m_baseEpoch = epoch;
+    }
+
+    void Save(const std::wstring& fileName, const ComputationNetworkPtr& net, const std::list<Matrix<ElemType>>& smoothedGradients,
+              const std::vector<double>& smoothedCounts, size_t totalSamplesSeen, double learnRatePerSample, double prevCriterion,
+              size_t minibatchSize, size_t numWorkers) const
+    {
+        if (!HasBase())
+            LogicError("IncrementalCheckpoint: Save() called without a base.");
+
+        // (written to a temporary file and renamed, as the .ckp files)
+        std::wstring tempFileName = fileName + L".tmp";
+        size_t numChangedColumns = 0, numColumns = 0;
+        {
+            File fstream(tempFileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
+            fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BDelta");
+            fstream << (int) m_baseEpoch;
+            fstream << totalSamplesSeen << learnRatePerSample << prevCriterion << minibatchSize << numWorkers;
+
+            auto nodes = ModelValueNodes(net);
+            if (nodes.size() != m_baseValues.size())
+                LogicError("IncrementalCheckpoint: The model has changed since the base was taken.");
+            fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BValues");
+            fstream << nodes.size();
+            auto baseIter = m_baseValues.begin();
+            for (const auto& node : nodes)
+            {
+                fstream << node->NodeName();
+                WriteChangedColumns(fstream, node->Value(), **baseIter++, numChangedColumns, numColumns);
+            }
+            fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EValues");
+
+            fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BSamplesSeen");
+            for (const auto& node : net->GetAllNodes())
+            {
+                if (auto batchNormalizationNode = std::dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(node))
+                    fstream << node->NodeName() << batchNormalizationNode->SamplesSeen();
+            }
+            fstream << std::wstring();
+            fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ESamplesSeen");
+
+            if (smoothedGradients.size() != m_baseSmoothedGradients.size())
+                LogicError("IncrementalCheckpoint: The number of smoothed gradients has changed since the base was taken.");
+            fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BGradient");
+            baseIter = m_baseSmoothedGradients.begin();
+            for (const auto& smoothedGradient : smoothedGradients)
+                WriteChangedColumns(fstream, smoothedGradient, **baseIter++, numChangedColumns, numColumns);
+            fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EGradient");
+
+            fstream << smoothedCounts;
+            fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EDelta");
+            fstream.Sync();
+        }
+        _wunlink(fileName.c_str());
+        renameOrDie(tempFileName, fileName);
+        fprintf(stderr, "IncrementalCheckpoint: %d of %d columns changed since the checkpoint of epoch %d.\n",
+                (int) numChangedColumns, (int) numColumns, m_baseEpoch + 1);
+    }
+
+    // the epoch of the full checkpoint that a delta file is relative to
+    static int ReadBaseEpoch(const std::wstring& fileName)
+    {
+        File fstream(fileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+        fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BDelta");
+        int baseEpoch;
+        fstream >> baseEpoch;
+        return baseEpoch;
+    }
+
+    // Applies the model values of a delta file to a network loaded from its base.
+    static void ApplyModelValues(const std::wstring& fileName, const ComputationNetworkPtr& net)
+    {
+        File fstream(fileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+        ReadHeader(fstream);
+        size_t totalSamplesSeen, minibatchSize, numWorkers;
+        double learnRatePerSample, prevCriterion;
+        fstream >> totalSamplesSeen >> learnRatePerSample >> prevCriterion >> minibatchSize >> numWorkers;
+        ReadModelValues(fstream, net);
+    }
+
+    // Applies the training state of a delta file to the training state loaded from the .ckp file of its base.
+    static void ApplyTrainingState(const std::wstring& fileName, std::list<Matrix<ElemType>>& smoothedGradients, std::vector<double>& smoothedCounts,
+                                   /*out*/ size_t& totalSamplesSeen, /*out*/ double& learnRatePerSample, /*out*/ double& prevCriterion,
+                                   /*out*/ size_t& minibatchSize, /*out*/ size_t& numWorkers)
+    {
+        File fstream(fileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+        ReadHeader(fstream);
+        fstream >> totalSamplesSeen >> learnRatePerSample >> prevCriterion >> minibatchSize >> numWorkers;
+        ReadModelValues(fstream, nullptr);
+
+        fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BGradient");
+        for (auto& smoothedGradient : smoothedGradients)
+            ReadChangedColumns(fstream, smoothedGradient);
+        fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EGradient");
+
+        std::vector<double> counts;
+        fstream >> counts;
+        if (counts.size() != smoothedCounts.size())
+            RuntimeError("IncrementalCheckpoint: '%ls' has %d smoothed counts instead of %d.", fileName.c_str(), (int) counts.size(), (int) smoothedCounts.size());
+        smoothedCounts = counts;
+        fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EDelta");
+    }
+
+private:
+    static std::vector<std::shared_ptr<ComputationNode<ElemType>>> ModelValueNodes(const ComputationNetworkPtr& net)
+    {
+        std::vector<std::shared_ptr<ComputationNode<ElemType>>> nodes;
+        for (const auto& node : net->GetAllNodes())
+        {
+            auto valueNode = std::dynamic_pointer_cast<ComputationNode<ElemType>>(node);
+            if (valueNode && node->IsModelValue() && valueNode->ValuePtr())
+                nodes.push_back(valueNode);
+        }
+        return nodes;
+    }
+
+    static std::shared_ptr<Matrix<ElemType>> ToCPU(const Matrix<ElemType>& matrix)
+    {
+        // (sparse matrices are kept on their device and always written whole)
+        auto copy = std::make_shared<Matrix<ElemType>>(matrix.GetMatrixType() == DENSE ? CPUDEVICE : matrix.GetDeviceId());
+        if (matrix.GetMatrixType() == DENSE)
+            copy->AssignValuesOf(matrix);
+        else
+            copy->SetValue(matrix);
+        return copy;
+    }
+
+    // [isWhole, (the matrix) | (numRows, numCols, the indices of the changed columns, their values)]
+    static void WriteChangedColumns(File& fstream, const Matrix<ElemType>& matrix, const Matrix<ElemType>& base, size_t& numChangedColumns, size_t& numColumns)
+    {
+        size_t numRows = matrix.GetNumRows(), numCols = matrix.GetNumCols();
+        numColumns += numCols;
+        if (matrix.GetMatrixType() != DENSE || base.GetMatrixType() != DENSE || base.GetNumRows() != numRows || base.GetNumCols() != numCols)
+        {
+            fstream << true << matrix;
+            numChangedColumns += numCols;
+            return;
+        }
+
+        auto current = ToCPU(matrix);
+        std::vector<size_t> columns;
+        std::vector<ElemType> values;
+        for (size_t j = 0; j < numCols; j++)
+        {
+            const ElemType* column = current->Data() + j * numRows;
+            if (memcmp(column, base.Data() + j * numRows, numRows * sizeof(ElemType)) != 0)
+            {
+                columns.push_back(j);
+                values.insert(values.end(), column, column + numRows);
+            }
+        }
+        numChangedColumns += columns.size();
+        fstream << false << numRows << numCols << columns;
+        if (!columns.empty())
+            fstream << Matrix<ElemType>(numRows, columns.size(), values.data(), CPUDEVICE);
+    }
+
+    static void ReadChangedColumns(File& fstream, Matrix<ElemType>& matrix)
+    {
+        bool isWhole;
+        fstream >> isWhole;
+        if (isWhole)
+        {
+            fstream >> matrix;
+            return;
+        }
+
+        size_t numRows, numCols;
+        std::vector<size_t> columns;
+        fstream >> numRows >> numCols >> columns;
+        if (numRows != matrix.GetNumRows() || numCols != matrix.GetNumCols())
+            RuntimeError("IncrementalCheckpoint: A matrix of the delta has dimensions [%d x %d] instead of [%d x %d].",
+                         (int) numRows, (int) numCols, (int) matrix.GetNumRows(), (int) matrix.GetNumCols());
+        if (columns.empty())
+            return;
+        Matrix<ElemType> values(CPUDEVICE);
+        fstream >> values;
+        auto current = ToCPU(matrix);
+        for (size_t k = 0; k < columns.size(); k++)
+            memcpy(current->Data() + columns[k] * numRows, values.Data() + k * numRows, numRows * sizeof(ElemType));
+        matrix.AssignValuesOf(*current);
+    }
+
+    static void ReadHeader(File& fstream)
+    {
+        fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BDelta");
+        int baseEpoch;
+        fstream >> baseEpoch;
+    }
+
+    // reads the values into 'net', or skips them if it is null
+    static void ReadModelValues(File& fstream, const ComputationNetworkPtr& net)
+    {
+        fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BValues");
+        size_t numNodes;
+        fstream >> numNodes;
+        for (size_t i = 0; i < numNodes; i++)
+        {
+            std::wstring name;
+            fstream >> name;
+            if (net)
+            {
+                auto node = std::dynamic_pointer_cast<ComputationNode<ElemType>>(net->GetNodeFromName(name));
+                if (!node)
+                    RuntimeError("IncrementalCheckpoint: Node '%ls' of the delta has the wrong precision.", name.c_str());
+                ReadChangedColumns(fstream, node->Value());
+                node->BumpEvalTimeStamp();
+            }
+            else
+            {
+                Matrix<ElemType> ignored(CPUDEVICE);
+                SkipChangedColumns(fstream, ignored);
+            }
+        }
+        fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EValues");
+
+        fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BSamplesSeen");
+        for (;;)
+        {
+            std::wstring name;
+            fstream >> name;
+            if (name.empty())
+                break;
+            size_t samplesSeen;
+            fstream >> samplesSeen;
+            if (net)
+            {
+                if (auto batchNormalizationNode = std::dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(net->GetNodeFromName(name)))
+                    batchNormalizationNode->SetSamplesSeen(samplesSeen);
+            }
+        }
+        fstream.GetMarker(FileMarker::fileMarkerEndSection, L"ESamplesSeen");
+    }
+
+    static void SkipChangedColumns(File& fstream, Matrix<ElemType>& buffer)
+    {
+        bool isWhole;
+        fstream >> isWhole;
+        if (isWhole)
+        {
+            fstream >> buffer;
+            return;
+        }
+        size_t numRows, numCols;
+        std::vector<size_t> columns;
+        fstream >> numRows >> numCols >> columns;
+        if (!columns.empty())
+            fstream >> buffer;
+    }
+
+    int m_baseEpoch; // -1: none yet
+    std::vector<std::shared_ptr<Matrix<ElemType>>> m_baseValues; // in the order of ModelValueNodes()
+    std::vector<std::shared_ptr<Matrix<ElemType>>> m_baseSmoothedGradients;
+};
+
+}}}
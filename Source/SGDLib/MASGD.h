@@ -11,12 +11,18 @@
 #include "SGD.h"
 #include "Matrix.h"
 #include "MPIWrapper.h"
+#include "NcclComm.h"
+#include "MatrixQuantizerImpl.h"
 #include "TimerUtility.h"
+#include "StragglerMonitor.h"
 #include <vector>
 #include <string>
 #include <stdexcept>
+#include <algorithm>
 #include <chrono> 
+#include <limits>
 #include <random>
+#include <thread>
 
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -130,9 +136,14 @@ namespace Microsoft { namespace MSR { namespace CNTK {
              m_myRank(pMPI->CurrentNodeRank()),
              m_pMPI(pMPI), 
              m_deviceId(devId),
-             m_perfReporter(pMPI->CurrentNodeRank(), pMPI->NumNodesInUse())
+             m_perfReporter(pMPI->CurrentNodeRank(), pMPI->NumNodesInUse()),
+             m_flatModel(devId),
+             m_flatModelReducedByNccl(false)
          {
              m_perfReporter.SetReportFrequency(perfReportFreq);
+             // all ranks have to take part in the creation of the NCCL communicator
+             m_nccl.reset(new NcclComm(devId, pMPI));
+             m_useDeviceMemory = (devId == CPUDEVICE) || MPIWrapper::IsCudaAware();
          }
          virtual ~IMASGD()
          {
@@ -189,9 +200,18 @@ namespace Microsoft { namespace MSR { namespace CNTK {
                  m_numSyncPerformed++;
                  ModelAggregationProcessing(samplesSinceLastSync, LearnableNodes, smoothedGradient, totalSamplesProcessed, secondsOnCommunication);
                  m_perfReporter.OnMAPerformed(samplesSinceLastSync, totalSamplesProcessed, secondsOnCommunication);
+                 // (all workers take part in the aggregation, so they can take part in this collective as well)
+                 if (m_stragglerMonitor)
+                     m_stragglerMonitor->Exchange(*m_pMPI);
              }
              return read2Sync;
          }
+
+         // per-rank timing, exchanged at the synchronous sync points of OnArrivingAtSyncPoint(), see StragglerMonitor
+         void SetStragglerMonitor(const std::shared_ptr<StragglerMonitor>& monitor)
+         {
+             m_stragglerMonitor = monitor;
+         }
          
          virtual void ModelAggregationProcessing(
              size_t samplesSinceLastSync,                                       /* in: */
@@ -304,6 +324,116 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
             return retval;
         }
+
+        // Copies the values of the parameters to update into consecutive sections of m_flatModel, a row vector on the training device
+        void PackModel(const std::list<ComputationNodeBasePtr>& learnableNodes)
+        {
+            size_t numElements = 0;
+            for (auto& pBaseNode : learnableNodes)
+            {
+                if (pBaseNode->IsParameterUpdateRequired())
+                    numElements += DownCast(pBaseNode)->Value().GetNumElements();
+            }
+            m_flatModel.Resize(1, numElements);
+
+            size_t offset = 0;
+            for (auto& pBaseNode : learnableNodes)
+            {
+                if (!pBaseNode->IsParameterUpdateRequired())
+                    continue;
+
+                const auto& value = DownCast(pBaseNode)->Value();
+                size_t nx = value.GetNumElements();
+                m_flatModel.ColumnSlice(offset, nx).AssignValuesOf(value.Reshaped(1, nx));
+                offset += nx;
+            }
+        }
+
+        void UnpackModel(const std::list<ComputationNodeBasePtr>& learnableNodes)
+        {
+            size_t offset = 0;
+            for (auto& pBaseNode : learnableNodes)
+            {
+                if (!pBaseNode->IsParameterUpdateRequired())
+                    continue;
+
+                auto& value = DownCast(pBaseNode)->Value();
+                size_t nx = value.GetNumElements();
+                value.AssignValuesOf(m_flatModel.ColumnSlice(offset, nx).Reshaped(value.GetNumRows(), value.GetNumCols()));
+                offset += nx;
+            }
+        }
+
+        // Sums m_flatModel over all workers in place: on the device through NCCL or a CUDA-aware MPI, else through a host buffer
+        // in chunks, where the copy of a chunk to (or from) the host overlaps with the reduction of the previous one
+        void AllReduceFlatModel()
+        {
+            StartFlatModelAllReduce(/*useNccl =*/ true);
+            FinishFlatModelAllReduce();
+        }
+
+        // The reduction of m_flatModel started here runs until FinishFlatModelAllReduce(), and m_flatModel must not be touched
+        // meanwhile. NCCL runs on the compute stream, where it would hold up the computation behind it until all workers join.
+        void StartFlatModelAllReduce(bool useNccl)
+        {
+            size_t numElements = m_flatModel.GetNumElements();
+            m_flatModelReducedByNccl = useNccl && m_nccl->IsSupported() && (numElements > 0);
+            if (m_flatModelReducedByNccl)
+            {
+                m_nccl->AllReduce(std::vector<Matrix<ElemType>*>{ &m_flatModel });
+                return;
+            }
+
+            size_t numChunks = (numElements + AllReduceChunkSize - 1) / AllReduceChunkSize;
+            m_allReduceRequests.clear();
+            m_allReduceRequests.resize(numChunks);
+            if (m_useDeviceMemory)
+            {
+                // MPI reads the device memory directly, not in stream order, so the values must be complete first
+                if ((numChunks > 0) && (m_flatModel.GetDeviceId() != CPUDEVICE))
+                {
+                    std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(m_flatModel.GetDeviceId()));
+                    mainStreamSyncEvent->SynchronizeEvent();
+                }
+
+                for (size_t i = 0; i < numChunks; i++)
+                    m_pMPI->AllReduceAsync(m_flatModel.Data() + i * AllReduceChunkSize, ChunkSize(i, numElements), &m_allReduceRequests[i]);
+                return;
+            }
+
+            m_hostBuffer.resize(numElements);
+            for (size_t i = 0; i < numChunks; i++)
+            {
+                ElemType* chunk = m_hostBuffer.data() + i * AllReduceChunkSize;
+                m_flatModel.ColumnSlice(i * AllReduceChunkSize, ChunkSize(i, numElements)).CopySection(1, ChunkSize(i, numElements), chunk, 1);
+                m_pMPI->AllReduceAsync(chunk, ChunkSize(i, numElements), &m_allReduceRequests[i]);
+            }
+        }
+
+        void FinishFlatModelAllReduce()
+        {
+            if (m_flatModelReducedByNccl)
+            {
+                m_nccl->Sync(); // (for the communication time)
+                return;
+            }
+
+            size_t numElements = m_flatModel.GetNumElements();
+            for (size_t i = 0; i < m_allReduceRequests.size(); i++)
+            {
+                m_pMPI->Wait(&m_allReduceRequests[i]);
+                if (!m_useDeviceMemory)
+                    m_flatModel.ColumnSlice(i * AllReduceChunkSize, ChunkSize(i, numElements)).SetValue(1, ChunkSize(i, numElements), m_flatModel.GetDeviceId(), m_hostBuffer.data() + i * AllReduceChunkSize);
+            }
+            m_allReduceRequests.clear();
+        }
+
+        static size_t ChunkSize(size_t chunk, size_t numElements)
+        {
+            size_t remainingElements = numElements - chunk * AllReduceChunkSize;
+            return remainingElements < AllReduceChunkSize ? remainingElements : AllReduceChunkSize;
+        }
+
         // borrow DownCast function from ComputationNetwork
         ComputationNodePtr DownCast(ComputationNodeBasePtr inode)
         {
@@ -320,6 +450,16 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         MASGDPerfStats              m_perfReporter;
         MPIWrapperPtr m_pMPI;
         DEVICEID_TYPE               m_deviceId;
+
+        // the models of the workers are averaged as one flat vector (see PackModel())
+        static const size_t AllReduceChunkSize = 4 * 1024 * 1024; // elements
+        Matrix<ElemType>            m_flatModel;
+        std::vector<ElemType>       m_hostBuffer;
+        std::unique_ptr<NcclComm>   m_nccl;
+        bool                        m_useDeviceMemory; // MPI can operate on the memory of m_flatModel (without NCCL)
+        bool                        m_flatModelReducedByNccl;
+        std::vector<MPIAllReduceRequest> m_allReduceRequests; // of the chunks of m_flatModel
+        std::shared_ptr<StragglerMonitor> m_stragglerMonitor;
  };
 
 
@@ -329,13 +469,17 @@ namespace Microsoft { namespace MSR { namespace CNTK {
     {
         typedef IMASGD<ElemType> Base; 
         using Base::m_pMPI;
-        using Base::DownCast;
+        using Base::m_nccl;
+        using Base::m_flatModel;
+        using Base::PackModel;
+        using Base::UnpackModel;
+        using Base::AllReduceFlatModel;
 
     public:
         BasicModelAveragingSGD(const MPIWrapperPtr& pMPI, size_t reportFreq, DEVICEID_TYPE devID)
             : Base(pMPI, reportFreq, devID)
         {
-            fprintf(stderr, "Parallel training (%d workers) using ModelAveraging\n",(int)m_pMPI->NumNodesInUse());
+            fprintf(stderr, "Parallel training (%d workers) using ModelAveraging%s\n", (int)m_pMPI->NumNodesInUse(), m_nccl->IsSupported() ? " (NCCL)" : "");
         }
 
         void ModelAggregationProcessing(
@@ -373,35 +517,376 @@ namespace Microsoft { namespace MSR { namespace CNTK {
             }
 
             //----------------------------------------
-            // 2. process for each individual node
+            // 2. average the models, with all parameters packed into one buffer
             //----------------------------------------
-            for (auto& pBaseNode : learnableNodes)
+            // 2.1. normalize the weights of this worker's model
+            PackModel(learnableNodes);
+            Matrix<ElemType>::Scale((ElemType)factor, m_flatModel);
+            // 2.2. inplace sum over all workers
+            commTimer.Restart();
+            AllReduceFlatModel();
+            commTimer.Stop();
+            secondsOnCommunication += (float)commTimer.ElapsedSeconds();
+            // 2.3. set the values
+            UnpackModel(learnableNodes);
+        }
+
+    };
+
+    // Model averaging that does not hold up the workers at the sync points (local SGD with a delayed merge):
+    // at each sync point a worker starts a non-blocking reduction of how far its model moved since the previous one (its delta,
+    // weighted by its number of samples) and continues training; at the next sync point, it replaces its own delta
+    // of the previous period by the average of all workers. So the models of the workers differ by the local progress of at most
+    // two periods, and a slow worker only delays the others when it is a whole period behind.
+    // With a block learning rate and block momentum (as in BlockMomentumSGD), the average delta is the block gradient.
+    // The reductions of all workers must match, which is why workers that ran out of data keep contributing empty deltas in
+    // OnEpochEnd() until all workers did; the models of all workers are the same after OnEpochEnd().
+    template<typename ElemType>
+    class AsyncModelAveragingSGD : public IMASGD<ElemType>
+    {
+        typedef IMASGD<ElemType> Base;
+        using Base::m_pMPI;
+        using Base::m_numWorkers;
+        using Base::m_numSyncPerformed;
+        using Base::m_perfReporter;
+        using Base::m_flatModel;
+        using Base::PackModel;
+        using Base::UnpackModel;
+        using Base::StartFlatModelAllReduce;
+        using Base::FinishFlatModelAllReduce;
+
+    public:
+        AsyncModelAveragingSGD(const MPIWrapperPtr& pMPI, size_t reportFreq, DEVICEID_TYPE devID, double blockLearningRate, double blockMomentum)
+            : Base(pMPI, reportFreq, devID),
+              m_blockLearningRate(blockLearningRate), m_blockMomentum(blockMomentum),
+              m_anchorModel(devID), m_localDelta(devID), m_blockMomentumDelta(devID),
+              m_mergePending(false), m_sampleCounts(2)
+        {
+            fprintf(stderr, "Parallel training (%d workers) using asynchronous ModelAveraging (blockLearningRate = %.4g, blockMomentum = %.4g)\n",
+                    (int)m_pMPI->NumNodesInUse(), m_blockLearningRate, m_blockMomentum);
+        }
+
+        void OnEpochStart(const std::list<ComputationNodeBasePtr>& learnableNodes) override
+        {
+            Base::OnEpochStart(learnableNodes);
+
+            // (the models of all workers are the same here)
+            PackModel(learnableNodes);
+            m_anchorModel.SetValue(m_flatModel);
+            m_mergePending = false;
+        }
+
+        void OnEpochEnd(const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& /*smoothedGradient*/, size_t samplesSinceLastSync) override
+        {
+            // until the reduction in which all workers say that they are done
+            Timer syncPointTimer;
+            syncPointTimer.Start();
+            while (!SyncModel(learnableNodes, samplesSinceLastSync, /*isDone =*/ true))
+                samplesSinceLastSync = 0;
+            syncPointTimer.Stop();
+            m_perfReporter.OnArriveAtSyncPoint(syncPointTimer.ElapsedSeconds(), true);
+
+            m_pMPI->WaitAll();
+            m_perfReporter.OnEpochEnd();
+        }
+
+        bool OnArrivingAtSyncPoint(const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& /*smoothedGradient*/, size_t samplesSinceLastSync) override
+        {
+            Timer syncPointTimer;
+            syncPointTimer.Start();
+            SyncModel(learnableNodes, samplesSinceLastSync, /*isDone =*/ false);
+            syncPointTimer.Stop();
+            m_perfReporter.OnArriveAtSyncPoint(syncPointTimer.ElapsedSeconds(), true);
+            return true;
+        }
+
+        void ModelAggregationProcessing(size_t /*samplesSinceLastSync*/, const std::list<ComputationNodeBasePtr>& /*learnableNodes*/, std::list<Matrix<ElemType>>& /*smoothedGradient*/,
+                                        size_t& /*totalSamplesProcessed*/, float& /*secondsOnCommunication*/) override
+        {
+            LogicError("AsyncModelAveragingSGD: Models are merged in OnArrivingAtSyncPoint() and OnEpochEnd().");
+        }
+
+    private:
+        // Merges the average delta of the previous period into the model, and starts the reduction of the delta of this one.
+        // Returns true if all workers were done in the previous reduction, in which case nothing is left to merge.
+        bool SyncModel(const std::list<ComputationNodeBasePtr>& learnableNodes, size_t samplesSinceLastSync, bool isDone)
+        {
+            Timer commTimer;
+            commTimer.Start();
+            bool allDone = false;
+            bool merged = m_mergePending;
+            size_t totalSamplesProcessed = 0;
+            if (merged)
             {
-                if (!pBaseNode->IsParameterUpdateRequired())
+                // correction of the model: m_localDelta = blockLearningRate * (block momentum of the) average delta - own delta
+                FinishFlatModelAllReduce();
+                m_pMPI->Wait(&m_sampleCountsRequest);
+                m_mergePending = false;
+                totalSamplesProcessed = (size_t)m_sampleCounts[0];
+                allDone = (m_sampleCounts[1] == m_numWorkers);
+
+                ElemType averageFactor = totalSamplesProcessed > 0 ? (ElemType)(1.0 / totalSamplesProcessed) : 0;
+                Matrix<ElemType>::Scale(-1, m_localDelta);
+                if (m_blockMomentum != 0)
                 {
-                    continue;
+                    if (m_blockMomentumDelta.GetNumElements() != m_flatModel.GetNumElements())
+                    {
+                        m_blockMomentumDelta.Resize(1, m_flatModel.GetNumElements());
+                        m_blockMomentumDelta.SetValue(0);
+                    }
+                    Matrix<ElemType>::Scale((ElemType)m_blockMomentum, m_blockMomentumDelta);
+                    Matrix<ElemType>::ScaleAndAdd(averageFactor, m_flatModel, m_blockMomentumDelta);
+                    Matrix<ElemType>::ScaleAndAdd((ElemType)m_blockLearningRate, m_blockMomentumDelta, m_localDelta);
                 }
-                // 2.1 model averaging
-                auto pNode = DownCast(pBaseNode);
-                // 2.1.1. average model from individual models 
-                Matrix<ElemType> mat(pNode->Value().DeepClone()); // pNode->Value returns lvalue, so a deep copy is invoked here
-                // 2.1.2. normalize the weight matrix 
-                Matrix<ElemType>::Scale(factor, mat);
-                // 2.1.3. send weight matrix over MPI nodes; 
-                unique_ptr<ElemType[]> px(mat.CopyToArray());
-                //ElemType* px = mat.CopyToArray();
-                size_t    nx = mat.GetNumElements();
-                // 2.1.4. inplace sum 
-                commTimer.Restart();
-                m_pMPI->AllReduce(px.get(), nx);
+                else
+                    Matrix<ElemType>::ScaleAndAdd((ElemType)(m_blockLearningRate * averageFactor), m_flatModel, m_localDelta);
+            }
+            commTimer.Stop();
+
+            // m_anchorModel = delta of this period; model += correction
+            PackModel(learnableNodes);
+            Matrix<ElemType>::Scale(-1, m_anchorModel);
+            Matrix<ElemType>::ScaleAndAdd(1, m_flatModel, m_anchorModel);
+            if (merged)
+            {
+                Matrix<ElemType>::ScaleAndAdd(1, m_localDelta, m_flatModel);
+                UnpackModel(learnableNodes);
+            }
+            m_localDelta.SetValue(m_anchorModel);
+            m_anchorModel.SetValue(m_flatModel);
+
+            if (!allDone)
+            {
+                commTimer.Start();
+                m_flatModel.SetValue(m_localDelta);
+                Matrix<ElemType>::Scale((ElemType)samplesSinceLastSync, m_flatModel);
+                StartFlatModelAllReduce(/*useNccl =*/ false);
+                m_sampleCounts[0] = (double)samplesSinceLastSync;
+                m_sampleCounts[1] = isDone ? 1 : 0;
+                m_pMPI->AllReduceAsync(m_sampleCounts.data(), m_sampleCounts.size(), &m_sampleCountsRequest);
+                m_mergePending = true;
+                m_numSyncPerformed++;
                 commTimer.Stop();
-                secondsOnCommunication += (float)commTimer.ElapsedSeconds();
-                // 2.1.5. set value 
-                pNode->Value().SetValue(mat.GetNumRows(), mat.GetNumCols(), mat.GetDeviceId(), px.get());
-                // 2.1.6. clean up 
-                //delete[]px;
             }
+
+            if (totalSamplesProcessed > 0)
+                m_perfReporter.OnMAPerformed(samplesSinceLastSync, totalSamplesProcessed, (float)commTimer.ElapsedSeconds());
+            return allDone;
         }
+
+        double m_blockLearningRate;
+        double m_blockMomentum;
+
+        Matrix<ElemType> m_anchorModel;        // the model at the previous sync point, after the merge
+        Matrix<ElemType> m_localDelta;         // own delta in the pending reduction (then the correction of the model)
+        Matrix<ElemType> m_blockMomentumDelta; // with block momentum: the smoothed average delta
+        bool m_mergePending;                   // a reduction of the deltas (in m_flatModel) is running
+
+        std::vector<double> m_sampleCounts;    // [samples in the delta, whether the worker is done], summed over the workers
+        MPIAllReduceRequest m_sampleCountsRequest;
+    };
+
+    // Asynchronous SGD with a sharded parameter server (bounded-staleness SGD, see "More Effective Distributed ML via a
+    // Stale Synchronous Parallel Parameter Server", Ho et al. 2013): the global model is cut into one shard per worker,
+    // and each worker serves its shard in an MPI window, so that the other workers read and update it with one-sided
+    // operations (passive target) and no server process or thread is needed. At each sync point a worker pushes how far
+    // its model moved since the previous one and, in the same atomic operation, pulls the global model it is added to;
+    // it then continues from that model and only waits when it got more than 'maxStaleness' sync points ahead of the
+    // slowest worker (the clocks of the workers are kept in a window of rank 0). So fast workers are not held up by slow
+    // ones, and a slow worker's updates are never more than 'maxStaleness' periods old.
+    // The passive-target operations progress in the MPI library of the target; with an MPI library without asynchronous
+    // progress (e.g. MPICH without MPICH_ASYNC_PROGRESS=1), they may wait until the target enters MPI at its next sync point.
+    // The models of all workers are the same after OnEpochEnd().
+    template<typename ElemType>
+    class ParameterServerSGD : public IMASGD<ElemType>
+    {
+        typedef IMASGD<ElemType> Base;
+        using Base::m_pMPI;
+        using Base::m_numWorkers;
+        using Base::m_myRank;
+        using Base::m_numSyncPerformed;
+        using Base::m_perfReporter;
+        using Base::m_flatModel;
+        using Base::AllReduceChunkSize;
+        using Base::PackModel;
+        using Base::UnpackModel;
+
+    public:
+        ParameterServerSGD(const MPIWrapperPtr& pMPI, size_t reportFreq, DEVICEID_TYPE devID, size_t maxStaleness)
+            : Base(pMPI, reportFreq, devID),
+              m_maxStaleness(maxStaleness), m_anchorModel(devID), m_localDelta(devID),
+              m_shardSize(0), m_shardWindow(MPI_WIN_NULL), m_clockWindow(MPI_WIN_NULL), m_clock(0), m_lastTotalSamples(0)
+        {
+            fprintf(stderr, "Parallel training (%d workers) using ParameterServerSGD (maxStaleness = %d)\n",
+                    (int)m_pMPI->NumNodesInUse(), (int)m_maxStaleness);
+        }
+
+        ~ParameterServerSGD()
+        {
+            if (m_shardWindow != MPI_WIN_NULL)
+                MPI_Win_free(&m_shardWindow);
+            if (m_clockWindow != MPI_WIN_NULL)
+                MPI_Win_free(&m_clockWindow);
+        }
+
+        void OnEpochStart(const std::list<ComputationNodeBasePtr>& learnableNodes) override
+        {
+            Base::OnEpochStart(learnableNodes);
+
+            // (the models of all workers are the same here)
+            PackModel(learnableNodes);
+            if (m_shardWindow == MPI_WIN_NULL)
+                CreateWindows();
+            m_anchorModel.SetValue(m_flatModel);
+        }
+
+        void OnEpochEnd(const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& /*smoothedGradient*/, size_t samplesSinceLastSync) override
+        {
+            Timer syncPointTimer;
+            syncPointTimer.Start();
+            PushAndPull(learnableNodes, samplesSinceLastSync);
+            // nobody waits for a worker that is done
+            long long done = std::numeric_limits<long long>::max() / 2;
+            UpdateClock(done, MPI_REPLACE);
+            m_pMPI->WaitAll();
+
+            // all updates are in the shards now: everybody continues from the same model (pushing an empty delta)
+            PushAndPull(learnableNodes, 0);
+            m_clock = 0;
+            UpdateClock(0, MPI_REPLACE);
+            syncPointTimer.Stop();
+            m_perfReporter.OnArriveAtSyncPoint(syncPointTimer.ElapsedSeconds(), true);
+
+            m_pMPI->WaitAll();
+            m_perfReporter.OnEpochEnd();
+        }
+
+        bool OnArrivingAtSyncPoint(const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& /*smoothedGradient*/, size_t samplesSinceLastSync) override
+        {
+            Timer syncPointTimer;
+            syncPointTimer.Start();
+            PushAndPull(learnableNodes, samplesSinceLastSync);
+
+            // bounded staleness: wait while the slowest worker is more than m_maxStaleness sync points behind
+            m_clock++;
+            UpdateClock(1, MPI_SUM);
+            while (m_clock - MinClock() > (long long)m_maxStaleness)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            syncPointTimer.Stop();
+            m_perfReporter.OnArriveAtSyncPoint(syncPointTimer.ElapsedSeconds(), true);
+            return true;
+        }
+
+        void ModelAggregationProcessing(size_t /*samplesSinceLastSync*/, const std::list<ComputationNodeBasePtr>& /*learnableNodes*/, std::list<Matrix<ElemType>>& /*smoothedGradient*/,
+                                        size_t& /*totalSamplesProcessed*/, float& /*secondsOnCommunication*/) override
+        {
+            LogicError("ParameterServerSGD: Models are exchanged in OnArrivingAtSyncPoint() and OnEpochEnd().");
+        }
+
+    private:
+        // Rank r serves the elements [r * m_shardSize, (r + 1) * m_shardSize) of the flat model, and rank 0 also the
+        // clocks of the workers and the total number of samples, which are initialized from the flat model here.
+        void CreateWindows()
+        {
+            size_t numElements = m_flatModel.GetNumElements();
+            m_shardSize = (numElements + m_numWorkers - 1) / m_numWorkers;
+            size_t begin = min(m_myRank * m_shardSize, numElements);
+            size_t end = min(begin + m_shardSize, numElements);
+            ElemType* shard;
+            MPI_Win_allocate((MPI_Aint)((end - begin) * sizeof(ElemType)), sizeof(ElemType), MPI_INFO_NULL, m_pMPI->Communicator(), &shard, &m_shardWindow) || MpiFail("ParameterServerSGD: MPI_Win_allocate");
+            size_t numCounters = m_myRank == 0 ? m_numWorkers + 1 : 0;
+            long long* counters;
+            MPI_Win_allocate((MPI_Aint)(numCounters * sizeof(long long)), sizeof(long long), MPI_INFO_NULL, m_pMPI->Communicator(), &counters, &m_clockWindow) || MpiFail("ParameterServerSGD: MPI_Win_allocate");
+
+            MPI_Win_lock(MPI_LOCK_EXCLUSIVE, (int)m_myRank, 0, m_shardWindow) || MpiFail("ParameterServerSGD: MPI_Win_lock");
+            if (end > begin)
+                m_flatModel.ColumnSlice(begin, end - begin).CopySection(1, end - begin, shard, 1);
+            MPI_Win_unlock((int)m_myRank, m_shardWindow) || MpiFail("ParameterServerSGD: MPI_Win_unlock");
+            MPI_Win_lock(MPI_LOCK_EXCLUSIVE, (int)m_myRank, 0, m_clockWindow) || MpiFail("ParameterServerSGD: MPI_Win_lock");
+            std::fill(counters, counters + numCounters, 0);
+            MPI_Win_unlock((int)m_myRank, m_clockWindow) || MpiFail("ParameterServerSGD: MPI_Win_unlock");
+
+            m_hostDelta.resize(numElements);
+            m_hostModel.resize(numElements);
+            m_pMPI->WaitAll();
+        }
+
+        // Adds the delta since the previous sync point to the shards, and continues from the global model, including the delta.
+        void PushAndPull(const std::list<ComputationNodeBasePtr>& learnableNodes, size_t samplesSinceLastSync)
+        {
+            PackModel(learnableNodes);
+            m_localDelta.AssignDifferenceOf(m_flatModel, m_anchorModel);
+
+            Timer commTimer;
+            commTimer.Start();
+            size_t numElements = m_flatModel.GetNumElements();
+            m_localDelta.CopySection(1, numElements, m_hostDelta.data(), 1);
+            MPI_Datatype dataType = MPIWrapper::GetDataType(m_hostDelta.data());
+            MPI_Win_lock_all(0, m_shardWindow) || MpiFail("ParameterServerSGD: MPI_Win_lock_all");
+            for (size_t begin = 0, end; begin < numElements; begin = end)
+            {
+                // (chunks do not cross shards)
+                int targetRank = (int)(begin / m_shardSize);
+                end = min(min(begin + AllReduceChunkSize, numElements), (targetRank + 1) * m_shardSize);
+                MPI_Get_accumulate(m_hostDelta.data() + begin, (int)(end - begin), dataType,
+                                   m_hostModel.data() + begin, (int)(end - begin), dataType,
+                                   targetRank, (MPI_Aint)(begin - targetRank * m_shardSize), (int)(end - begin), dataType,
+                                   MPI_SUM, m_shardWindow) || MpiFail("ParameterServerSGD: MPI_Get_accumulate");
+            }
+            MPI_Win_unlock_all(m_shardWindow) || MpiFail("ParameterServerSGD: MPI_Win_unlock_all");
+
+            // the samples of all workers since our previous sync point
+            long long samples = (long long)samplesSinceLastSync, totalSamples = 0;
+            MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, m_clockWindow) || MpiFail("ParameterServerSGD: MPI_Win_lock");
+            MPI_Get_accumulate(&samples, 1, MPI_LONG_LONG, &totalSamples, 1, MPI_LONG_LONG, 0, (MPI_Aint)m_numWorkers, 1, MPI_LONG_LONG, MPI_SUM, m_clockWindow) || MpiFail("ParameterServerSGD: MPI_Get_accumulate");
+            MPI_Win_unlock(0, m_clockWindow) || MpiFail("ParameterServerSGD: MPI_Win_unlock");
+            totalSamples += samples;
+            commTimer.Stop();
+
+            // the pulled model does not include our own delta yet
+            m_flatModel.SetValue(1, numElements, m_flatModel.GetDeviceId(), m_hostModel.data());
+            Matrix<ElemType>::ScaleAndAdd(1, m_localDelta, m_flatModel);
+            UnpackModel(learnableNodes);
+            m_anchorModel.SetValue(m_flatModel);
+
+            size_t totalSamplesProcessed = (size_t)(totalSamples - m_lastTotalSamples);
+            m_lastTotalSamples = totalSamples;
+            if (samplesSinceLastSync > 0)
+            {
+                m_numSyncPerformed++;
+                m_perfReporter.OnMAPerformed(samplesSinceLastSync, totalSamplesProcessed, (float)commTimer.ElapsedSeconds());
+            }
+        }
+
+        void UpdateClock(long long value, MPI_Op op)
+        {
+            MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, m_clockWindow) || MpiFail("ParameterServerSGD: MPI_Win_lock");
+            MPI_Accumulate(&value, 1, MPI_LONG_LONG, 0, (MPI_Aint)m_myRank, 1, MPI_LONG_LONG, op, m_clockWindow) || MpiFail("ParameterServerSGD: MPI_Accumulate");
+            MPI_Win_unlock(0, m_clockWindow) || MpiFail("ParameterServerSGD: MPI_Win_unlock");
+        }
+
+        long long MinClock()
+        {
+            std::vector<long long> clocks(m_numWorkers);
+            // (an atomic read, unlike MPI_Get, which may see an MPI_Accumulate of another worker half done)
+            MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, m_clockWindow) || MpiFail("ParameterServerSGD: MPI_Win_lock");
+            MPI_Get_accumulate(nullptr, 0, MPI_LONG_LONG, clocks.data(), (int)m_numWorkers, MPI_LONG_LONG, 0, 0, (int)m_numWorkers, MPI_LONG_LONG, MPI_NO_OP, m_clockWindow) || MpiFail("ParameterServerSGD: MPI_Get_accumulate");
+            MPI_Win_unlock(0, m_clockWindow) || MpiFail("ParameterServerSGD: MPI_Win_unlock");
+            return *std::min_element(clocks.begin(), clocks.end());
+        }
+
+        size_t m_maxStaleness;           // in sync points
+
+        Matrix<ElemType> m_anchorModel;  // the model at the previous sync point, after the pull
+        Matrix<ElemType> m_localDelta;   // how far the model moved since then
+        std::vector<ElemType> m_hostDelta;
+        std::vector<ElemType> m_hostModel;
+
+        size_t m_shardSize;              // elements per worker
+        MPI_Win m_shardWindow;           // our shard of the global model
+        MPI_Win m_clockWindow;           // on rank 0: the number of sync points of each worker, and the total number of samples
+        long long m_clock;               // our number of sync points in this epoch
+        long long m_lastTotalSamples;
     };
 
 } } }
@@ -0,0 +1,89 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include "ComputationNode.h"
+#include "Matrix.h"
+#include "ParameterSnapshot.h"
+#include <list>
+#include <memory>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Checks the learnable parameters for NaN and Inf without a host sync per parameter: every parameter update ORs
+// into a 1x1 flag on the device (Matrix::UpdateNonFiniteFlag()), and the host reads that flag only every
+// 'interval' minibatches. If the flag is set, either training stops with the name of the first parameter that is
+// not finite, or, with 'rollback', the parameters and their smoothed gradients are reset to the snapshot taken at
+// the last check that passed, and training continues (the minibatches since then are lost).
+template <class ElemType>
+class NonFiniteCheck
+{
+public:
+    NonFiniteCheck(DEVICEID_TYPE deviceId, size_t interval, bool rollback)
+        : m_flag(1, 1, deviceId), m_interval(interval), m_rollback(rollback), m_numMinibatches(0), m_numRollbacks(0)
+    {
+        m_flag.SetValue(0);
+    }
+
+    bool IsEnabled() const { return m_interval > 0; }
+
+    void Add(const Matrix<ElemType>& value)
+    {
+        if (IsEnabled())
+            value.UpdateNonFiniteFlag(m_flag);
+    }
+
+    // Call after the parameter update of each minibatch. Returns true if the parameters were rolled back.
+    bool EndMinibatch(const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& smoothedGradients, std::vector<double>& smoothedCounts)
+    {
+        if (!IsEnabled() || ++m_numMinibatches % m_interval != 0)
+            return false;
+
+        if (m_flag.Get00Element() == 0) // (the only host sync)
+        {
+            if (m_rollback)
+                m_snapshot.Take(learnableNodes, smoothedGradients, smoothedCounts);
+            return false;
+        }
+
+        std::wstring culprit = FindCulprit(learnableNodes);
+        if (!m_rollback || !m_snapshot.IsTaken())
+            RuntimeError("NonFiniteCheck: Parameter %ls has NaN or Inf values after the parameter update.", culprit.c_str());
+
+        m_snapshot.Restore(smoothedGradients, smoothedCounts);
+        m_flag.SetValue(0);
+        m_numRollbacks++;
+        fprintf(stderr, "WARNING: Parameter %ls has NaN or Inf values after the parameter update; the parameters were reset to their values of %d minibatches ago (rollback %d).\n",
+                culprit.c_str(), (int) m_interval, (int) m_numRollbacks);
+        return true;
+    }
+
+    size_t GetNumRollbacks() const { return m_numRollbacks; }
+
+private:
+    std::wstring FindCulprit(const std::list<ComputationNodeBasePtr>& learnableNodes) const
+    {
+        Matrix<ElemType> flag(1, 1, m_flag.GetDeviceId());
+        for (const auto& node : learnableNodes)
+        {
+            flag.SetValue(0);
+            std::dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value().UpdateNonFiniteFlag(flag);
+            if (flag.Get00Element() != 0)
+                return node->NodeName();
+        }
+        return L"(unknown)";
+    }
+
+    Matrix<ElemType> m_flag; // 1 if any value added since the last check was not finite
+    size_t m_interval;       // read the flag every this many minibatches (0: no checks)
+    bool m_rollback;
+    size_t m_numMinibatches;
+    size_t m_numRollbacks;
+
+    ParameterSnapshot<ElemType> m_snapshot; // at the last check that passed (only with m_rollback)
+};
+
+}}}
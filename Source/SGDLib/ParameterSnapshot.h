@@ -0,0 +1,110 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include "ComputationNode.h"
+#include "TrainingNodes.h"
+#include "Matrix.h"
+#include <list>
+#include <memory>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// A copy of the training state in device memory, to roll back to without reading a checkpoint file: the values of
+// the model-value nodes (parameters, also those that are not learned, such as the running statistics of batch
+// normalization), the sample counts of the BatchNormalization nodes, and the smoothed gradients and counts of the
+// learner. Other nodes of the list are ignored. Taking the snapshot again for the same nodes reuses its matrices, so
+// that only the first Take() allocates; all copies are device-to-device.
+template <class ElemType>
+class ParameterSnapshot
+{
+public:
+    ParameterSnapshot() : m_taken(false) { }
+
+    bool IsTaken() const { return m_taken; }
+
+    void Take(const std::list<ComputationNodeBasePtr>& nodes, const std::list<Matrix<ElemType>>& smoothedGradients, const std::vector<double>& smoothedCounts)
+    {
+        bool reuse = m_taken && nodes == m_nodes;
+        if (!reuse)
+        {
+            m_nodes = nodes;
+            m_values.clear();
+            m_smoothedGradients.clear();
+        }
+
+        auto valueIter = m_values.begin();
+        m_samplesSeen.clear();
+        for (const auto& node : m_nodes)
+        {
+            if (auto batchNormalizationNode = std::dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(node))
+                m_samplesSeen.push_back(batchNormalizationNode->SamplesSeen());
+
+            auto valueNode = std::dynamic_pointer_cast<ComputationNode<ElemType>>(node);
+            if (!valueNode || !node->IsModelValue() || !valueNode->ValuePtr())
+                continue;
+            if (reuse)
+                (*valueIter++)->SetValue(valueNode->Value());
+            else
+                m_values.push_back(std::make_shared<Matrix<ElemType>>(valueNode->Value().DeepClone()));
+        }
+
+        if (reuse)
+        {
+            auto smoothedGradientIter = m_smoothedGradients.begin();
+            for (const auto& smoothedGradient : smoothedGradients)
+                (*smoothedGradientIter++)->SetValue(smoothedGradient);
+        }
+        else
+        {
+            for (const auto& smoothedGradient : smoothedGradients)
+                m_smoothedGradients.push_back(std::make_shared<Matrix<ElemType>>(smoothedGradient.DeepClone()));
+        }
+        m_smoothedCounts = smoothedCounts;
+        m_taken = true;
+    }
+
+    // restores the nodes passed to Take()
+    void Restore(std::list<Matrix<ElemType>>& smoothedGradients, std::vector<double>& smoothedCounts) const
+    {
+        if (!m_taken)
+            LogicError("ParameterSnapshot: Restore() called without a prior Take().");
+
+        auto valueIter = m_values.begin();
+        auto samplesSeenIter = m_samplesSeen.begin();
+        for (const auto& node : m_nodes)
+        {
+            if (auto batchNormalizationNode = std::dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(node))
+                batchNormalizationNode->SetSamplesSeen(*samplesSeenIter++);
+
+            auto valueNode = std::dynamic_pointer_cast<ComputationNode<ElemType>>(node);
+            if (!valueNode || !node->IsModelValue() || !valueNode->ValuePtr())
+                continue;
+            valueNode->Value().SetValue(**valueIter++);
+            node->BumpEvalTimeStamp();
+        }
+
+        if (smoothedGradients.size() != m_smoothedGradients.size())
+            LogicError("ParameterSnapshot: The number of smoothed gradients has changed since the snapshot was taken.");
+        auto smoothedGradientIter = m_smoothedGradients.begin();
+        for (auto& smoothedGradient : smoothedGradients)
+            smoothedGradient.SetValue(**smoothedGradientIter++);
+        smoothedCounts = m_smoothedCounts;
+    }
+
+private:
+    bool m_taken;
+    std::list<ComputationNodeBasePtr> m_nodes;
+
+    // in the order of m_nodes
+    std::vector<std::shared_ptr<Matrix<ElemType>>> m_values;
+    std::vector<size_t> m_samplesSeen;
+
+    std::vector<std::shared_ptr<Matrix<ElemType>>> m_smoothedGradients;
+    std::vector<double> m_smoothedCounts;
+};
+
+}}}
@@ -8,6 +8,7 @@
 #include "SpecialPurposeNodes.h"        // for SequenceWithSoftmaxNode
 #include "DataReaderHelpers.h"
 #include "MatrixQuantizerImpl.h"
+#include "MultiTensorUpdate.h"
 
 #ifdef CNTK_PARALLEL_TRAINING_SUPPORT
 //static inline bool operator==(const std::pair<double,size_t>& a, double b) { assert(b==0); return a.first == b; }
@@ -17,7 +18,17 @@
 #endif
 
 #include "SimpleDistGradAggregator.h"
+#include "DeviceDistGradAggregator.h"
+#include "SparsifiedDistGradAggregator.h"
+#include "NonFiniteCheck.h"
+#include "ParameterSnapshot.h"
+#include "DeviceReplicas.h"
+#include "GPUGraphStep.h"
+#include "PreComputeAccumulation.h"
 #include "ProgressTracing.h"
+#include "TrainingTelemetry.h"
+#include "StragglerMonitor.h"
+#include "GPUWatcher.h"
 
 #include <map>
 #include <set>
@@ -86,7 +97,7 @@ void SGD<ElemType>::Adapt(wstring origModelFileName, wstring refNodeName,
     {
         wstring modelFileName = GetModelNameForEpoch(int(startEpoch) - 1);
         LOGPRINTF(stderr, "Starting from checkpoint. Loading network from '%ls'.\n", modelFileName.c_str());
-        net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelFileName);
+        net = LoadNetworkForEpoch(deviceId, int(startEpoch) - 1);
         networkLoadedFromCheckpoint = true;
     }
     else
@@ -122,6 +133,9 @@ void SGD<ElemType>::Adapt(wstring origModelFileName, wstring refNodeName,
 // -----------------------------------------------------------------------
 
 static double MomentumPerMB(double momentumPerSample, size_t minibatchSize);
+static std::list<ComputationNodeBasePtr> TrialStateNodes(ComputationNetworkPtr net,
+                                                         const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                                                         const std::vector<ComputationNodeBasePtr>& evaluationNodes);
 
 template <class ElemType>
 void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
@@ -152,6 +166,23 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         }
     }
 
+    // Parallel training continues from the epoch of the main node. Each rank determines its start epoch from the files it
+    // sees, and one that sees others (e.g. a replacement machine without the checkpoint) would take other branches below
+    // and hang in their collectives; it takes over the model of the main node instead.
+    bool takeMainNodeModel = false;
+    if (m_mpi != nullptr && m_mpi->NumNodesInUse() > 1)
+    {
+        int mainNodeState[2] = { startEpoch, networkLoadedFromCheckpoint ? 1 : 0 };
+        m_mpi->Bcast(mainNodeState, 2, m_mpi->MainNodeRank());
+        int numRanksDiverged = (mainNodeState[0] != startEpoch) ? 1 : 0;
+        if (numRanksDiverged)
+            LOGPRINTF(stderr, "Starting from epoch %d of the main node instead of epoch %d, taking over the model of the main node.\n", mainNodeState[0] + 1, startEpoch + 1);
+        m_mpi->AllReduce(&numRanksDiverged, 1);
+        takeMainNodeModel = numRanksDiverged > 0;
+        startEpoch = mainNodeState[0];
+        networkLoadedFromCheckpoint = mainNodeState[1] != 0;
+    }
+
     // This code is only relevant for the new (V2) readers. It exist because of
     // a shortcoming in DecimateMinibatchInPlace, which does not yet work when inputs 
     // in the same minibatch have different layouts, which is something only V2 readers can
@@ -200,6 +231,8 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
     additionalNodesToEvaluate.insert(additionalNodesToEvaluate.end(), preComputeNodesList.cbegin(), preComputeNodesList.cend());
 
     // allocate memory for forward and backward computation
+    net->SetRecomputeSegments(m_recomputeSegmentLength, m_recomputeCheckpointNodeNames);
+    net->SetStashCompression(m_stashCompression);
     net->AllocateAllMatrices(evaluationNodes, additionalNodesToEvaluate, criterionNodes[0]); // TODO: use criterionNodes.front() throughout
 
     // get feature and label nodes into an array of matrices that will be passed to GetMinibatch()
@@ -267,7 +300,7 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         // V2 API fixes this.
         smoothedGradients.push_back(Matrix<ElemType>(node->Value().GetNumRows(),
                                                      node->Value().GetNumCols(),
-                                                     net->GetDeviceId()));
+                                                     node->GetDeviceId())); // (parameters may be placed on other devices)
         smoothedCounts.push_back(0);
         if (node->IsParameterUpdateRequired())
         {
@@ -317,16 +350,23 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
 
     m_prevChosenMinibatchSize = m_mbSize[startEpoch];
 
+    // (before the aggregators, which exchange its values)
+    if (m_stragglerDetection && GetParallelizationMethod() != ParallelizationMethod::none && m_mpi->NumNodesInUse() > 1 && !m_stragglerMonitor)
+        m_stragglerMonitor = make_shared<StragglerMonitor>(m_mpi->NumNodesInUse(), m_mpi->CurrentNodeRank(), m_stragglerThreshold, m_stragglerMinExchanges);
+
     int currentNumGradientBits = 0; // this remembers the last #gradient bits we set for dataParallelSGD (init val 0 has no meaning, just keep compiler happy)
     if (GetParallelizationMethod() == ParallelizationMethod::dataParallelSGD)
     {
         currentNumGradientBits = m_numGradientBits[startEpoch]; // remember so that we can detect a change
-        InitDistGradAgg(evaluationNodes.size(), currentNumGradientBits, m_traceLevel);
+        InitDistGradAgg(evaluationNodes.size(), currentNumGradientBits, net->GetDeviceId(), m_traceLevel);
+        m_distGradAgg->SetStragglerMonitor(m_stragglerMonitor);
     }
     else if (GetParallelizationMethod() == ParallelizationMethod::modelAveragingSGD || 
-             GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD)
+             GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD ||
+             GetParallelizationMethod() == ParallelizationMethod::parameterServerSGD)
     {
         InitModelAggregationHandler(m_syncStatsTrace, net->GetDeviceId());
+        m_pMASGDHelper->SetStragglerMonitor(m_stragglerMonitor);
     }
 
     // precompute mean and invStdDev nodes and save initial model
@@ -347,6 +387,19 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
             net->Save(GetModelNameForEpoch(int(startEpoch) - 1));
     }
 
+    if (m_asyncCrossValidation)
+    {
+        if (m_mpi != nullptr && m_mpi->NumNodesInUse() > 1)
+            InvalidArgument("asyncCrossValidation cannot be combined with parallelTrain.");
+        if (m_autoLearnRateSearchType == LearningRateSearchAlgorithm::AdjustAfterEpoch && m_loadBestModel && m_useCVSetControlLRIfCVExists)
+            InvalidArgument("asyncCrossValidation: The validation criterion arrives one epoch late, too late to roll back to the best model; "
+                            "set loadBestModel=false, or useCVSetControlLRIfCVExists=false to control the learning rate with the training criterion.");
+    }
+
+    // in-process data parallelism: replicate the network onto the further devices
+    if (!m_replicaDeviceIds.empty())
+        InitDeviceReplicas(net, criterionNodes[0], evaluationNodes, learnableNodes, *inputMatrices);
+
     size_t totalTrainingSamplesSeen = 0; // aggregated over all epochs, for logging purposes only
 
     bool learnRateInitialized = false;
@@ -360,10 +413,19 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                                                      smoothedCounts,
                                                      /*out*/ prevCriterion,
                                                      /*out*/ m_prevChosenMinibatchSize);
-        if (learnRateInitialized)
-            prevLearnRates[startEpoch % m_numPrevLearnRates] = learnRatePerSample;
     }
 
+    // Parallel training resumes from the state of the main node, so that a rank that read other files (e.g. a
+    // replacement machine without the checkpoint info) cannot diverge; the number of ranks may differ from the run
+    // that wrote the checkpoint, since the readers split the data among the ranks of this run. All ranks agree on
+    // whether to broadcast, see above.
+    if (m_mpi != nullptr && m_mpi->NumNodesInUse() > 1 && (startEpoch > 0 || takeMainNodeModel))
+        BroadcastTrainingState(TrialStateNodes(net, criterionNodes, evaluationNodes), smoothedGradients, smoothedCounts,
+                               totalTrainingSamplesSeen, learnRatePerSample, prevCriterion, m_prevChosenMinibatchSize, learnRateInitialized);
+
+    if (startEpoch > 0 && learnRateInitialized)
+        prevLearnRates[startEpoch % m_numPrevLearnRates] = learnRatePerSample;
+
     if (m_autoLearnRateSearchType == LearningRateSearchAlgorithm::AdjustAfterEpoch &&
         !learnRateInitialized && m_learningRatesParam.size() <= startEpoch)
     {
@@ -408,17 +470,19 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
             currentNumGradientBits != m_numGradientBits[i])
         {
             currentNumGradientBits = m_numGradientBits[i];
-            InitDistGradAgg(evaluationNodes.size(), currentNumGradientBits, m_traceLevel);
+            InitDistGradAgg(evaluationNodes.size(), currentNumGradientBits, net->GetDeviceId(), m_traceLevel);
+            m_distGradAgg->SetStragglerMonitor(m_stragglerMonitor);
         }
 
         Timer timer;
         timer.Start();
+        size_t numReallocationsBefore = MatrixResizePolicy::GetNumReallocations();
 
         // set dropout rate for this epoch
         // We use the same seed across workers until parallel training kicks in to ensure that the workers have identical models
         size_t parallelWorkerIdx = ((m_mpi == nullptr) || !UsingParallelTrain(i)) ? 0 : m_mpi->CurrentNodeRank();
         size_t dropoutRandSeedBase = (parallelWorkerIdx * m_maxEpochs) + i;
-        ComputationNetwork::SetDropoutRate<ElemType>(net, criterionNodes[0], m_dropoutRates[i], prevDropoutRate, dropoutRandSeedBase);
+        ComputationNetwork::SetDropoutRate<ElemType>(net, criterionNodes[0], m_dropoutRates[i], prevDropoutRate, dropoutRandSeedBase, m_statelessDropout);
         ComputationNetwork::SetBatchNormalizationTimeConstants<ElemType>(net, criterionNodes[0], 
                                                                          m_batchNormalizationTimeConstant[i], prevNormalizationTimeConstant,
                                                                          m_batchNormalizationBlendTimeConstant[i], prevNormalizationBlendTimeConstant);
@@ -550,6 +614,9 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         for (size_t j = 0; j < epochEvalErrors.size(); j++)
             epochEvalErrors[j].LogCriterion(evaluationNodes[j]->NodeName());
         fprintf(stderr, "totalSamplesSeen = %d; learningRatePerSample = %.8g; epochTime=%.6gs\n", (int)totalTrainingSamplesSeen, learnRatePerSample, epochTime);
+        if (m_traceLevel > 0)
+            LOGPRINTF(stderr, "Finished Epoch[%2d of %d]: %d matrix buffers were reallocated.\n",
+                      i + 1, (int)m_maxEpochs, (int)(MatrixResizePolicy::GetNumReallocations() - numReallocationsBefore));
 #if 0
         // TODO: This was only printed if >1 eval criterion. Why? Needed?
         LOGPRINTF(stderr, "Finished Epoch[%2d of %d]:     Criterion Node [%ls] Per Sample = %.8g\n",
@@ -564,7 +631,6 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
 
         if (validationSetDataReader != trainSetDataReader && validationSetDataReader != nullptr)
         {
-            SimpleEvaluator<ElemType> evalforvalidation(net, m_mpi, m_enableDistributedMBReading);
             vector<wstring> cvSetTrainAndEvalNodes;
             if (criterionNodes.size() > 0)
             {
@@ -575,17 +641,28 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                 cvSetTrainAndEvalNodes.push_back(node->NodeName());
             }
 
-            // BUGBUG: We should not use the training MB size. The training MB size is constrained by both convergence and memory. Eval is only constrained by memory.
-            let vScore = evalforvalidation.Evaluate(validationSetDataReader, cvSetTrainAndEvalNodes, m_mbSize[i]);
-            LOGPRINTF(stderr, "Finished Epoch[%2d of %d]: [Validate] ", i + 1, (int)m_maxEpochs);
-            for (size_t k = 0; k < vScore.size() /*&& k < 2*/; k++)
-                vScore[k].LogCriterion(cvSetTrainAndEvalNodes[k], /*addSemicolon=*/k + 1 < vScore.size());
-                //fprintf(stderr, "%s %ls = %.8f * %d", k ? ";" : "", cvSetTrainAndEvalNodes[k].c_str(), vScore[k].Average(), (int)vScore[k].second);
-            fprintf(stderr, "\n");
+            // The training MB size is constrained by both convergence and memory, eval only by memory, so it can be set on its own.
+            size_t cvMBSize = m_mbSizeCV[i] > 0 ? m_mbSizeCV[i] : m_mbSize[i];
+            vector<EpochCriterion> vScore;
+            bool haveScore = true;
+            if (m_asyncCrossValidation)
+            {
+                // that of the previous epoch, which the learning rate control then uses one epoch late
+                haveScore = WaitForCrossValidation(vScore);
+                StartCrossValidationAsync(net, i, validationSetDataReader, cvSetTrainAndEvalNodes, cvMBSize);
+            }
+            else
+            {
+                SimpleEvaluator<ElemType> evalforvalidation(net, m_mpi, m_enableDistributedMBReading, 100, 0, 0, /*maxSamplesInRAM =*/ m_maxSamplesInRAM);
+                vScore = evalforvalidation.Evaluate(validationSetDataReader, cvSetTrainAndEvalNodes, cvMBSize);
+                LogCrossValidation(i, cvSetTrainAndEvalNodes, vScore);
+            }
 
             if (m_useCVSetControlLRIfCVExists)
             {
-                if (m_useEvalCriterionControlLR && vScore.size() > 1)
+                if (!haveScore)
+                    lrControlCriterion = numeric_limits<double>::infinity(); // (none yet after the first epoch, so no decision)
+                else if (m_useEvalCriterionControlLR && vScore.size() > 1)
                     lrControlCriterion = vScore[1].Average(); // use the first of possibly multiple eval criteria
                 else
                     lrControlCriterion = vScore[0].Average(); // the first one is the training criterion
@@ -595,7 +672,9 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         // broadcast epochCriterion to make sure each processor will have the same learning rate schedule
         if ((GetParallelizationMethod() == ParallelizationMethod::modelAveragingSGD 
             ||
-            GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD) 
+            GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD
+            ||
+            GetParallelizationMethod() == ParallelizationMethod::parameterServerSGD) 
             && (m_mpi->NumNodesInUse() > 1))
         {
             m_mpi->Bcast(&epochCriterion.first,  1, m_mpi->MainNodeRank());
@@ -625,9 +704,10 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                 if (m_loadBestModel)
                 {
                     // roll back
+                    WaitForCheckpointFiles();
                     auto bestModelPath = GetModelNameForEpoch(i - m_learnRateAdjustInterval);
                     LOGPRINTF(stderr, "Loading (rolling back to) previous model with best training-criterion value: %ls.\n", bestModelPath.c_str());
-                    net->RereadPersistableParameters<ElemType>(bestModelPath);
+                    RereadPersistableParametersForEpoch(net, i - m_learnRateAdjustInterval);
                     LoadCheckPointInfo(i - m_learnRateAdjustInterval,
                                        /*out*/ totalTrainingSamplesSeen,
                                        /*out*/ learnRatePerSample,
@@ -711,6 +791,9 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         {
             if (loadedPrevModel)
             {
+                if (m_pendingCheckpoint.valid()) // (the files below may still be written)
+                    m_pendingCheckpoint.get();
+
                 // If previous best model is loaded, we will first remove epochs that lead to worse results
                 for (int j = 1; j < m_learnRateAdjustInterval; j++)
                 {
@@ -727,30 +810,73 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
             }
             else
             {
-                SaveCheckPointInfo(i, totalTrainingSamplesSeen, learnRatePerSample, smoothedGradients, smoothedCounts, prevCriterion, chosenMinibatchSize);
-                auto modelName = GetModelNameForEpoch(i);
-                if (m_traceLevel > 0)
-                    LOGPRINTF(stderr, "SGD: Saving checkpoint model '%ls'\n", modelName.c_str());
-                net->Save(modelName);
+                // previous checkpoint files to delete to save space
+                vector<wstring> filesToDelete;
                 if (!m_keepCheckPointFiles)
                 {
-                    // delete previous checkpoint file to save space
                     if (m_autoLearnRateSearchType == LearningRateSearchAlgorithm::AdjustAfterEpoch && m_loadBestModel)
                     {
                         if (epochsSinceLastLearnRateAdjust != 1)
                         {
-                            _wunlink(GetCheckPointFileNameForEpoch(i - 1).c_str());
+                            filesToDelete.push_back(GetCheckPointFileNameForEpoch(i - 1));
                         }
                         if (epochsSinceLastLearnRateAdjust == m_learnRateAdjustInterval)
                         {
-                            _wunlink(GetCheckPointFileNameForEpoch(i - m_learnRateAdjustInterval).c_str());
+                            filesToDelete.push_back(GetCheckPointFileNameForEpoch(i - m_learnRateAdjustInterval));
                         }
                     }
                     else
                     {
-                        _wunlink(GetCheckPointFileNameForEpoch(i - 1).c_str());
+                        filesToDelete.push_back(GetCheckPointFileNameForEpoch(i - 1));
                     }
                 }
+
+                // incremental checkpoints: a delta of the changes since the last full checkpoint (its base), unless
+                // this is a full one; the deltas are cumulative, so only the latest is kept, and the .ckp file of its base
+                bool saveDelta = m_incrementalCheckpointInterval > 0 && m_incrementalCheckpoint.HasBase() &&
+                                 (i + 1) % m_incrementalCheckpointInterval != 0 && i + 1 < (int) m_maxEpochs;
+                if (m_incrementalCheckpointInterval > 0 && !m_keepCheckPointFiles)
+                {
+                    wstring baseCheckPointFileName = m_incrementalCheckpoint.HasBase() ? GetCheckPointFileNameForEpoch(m_incrementalCheckpoint.BaseEpoch()) : L"";
+                    if (saveDelta)
+                        filesToDelete.erase(remove(filesToDelete.begin(), filesToDelete.end(), baseCheckPointFileName), filesToDelete.end());
+                    else if (!baseCheckPointFileName.empty() && find(filesToDelete.begin(), filesToDelete.end(), baseCheckPointFileName) == filesToDelete.end())
+                        filesToDelete.push_back(baseCheckPointFileName);
+                    filesToDelete.push_back(GetDeltaFileNameForEpoch(i - 1));
+                }
+
+                if (saveDelta)
+                {
+                    if (m_pendingCheckpoint.valid())
+                        m_pendingCheckpoint.get();
+                    auto deltaFileName = GetDeltaFileNameForEpoch(i);
+                    if (m_traceLevel > 0)
+                        LOGPRINTF(stderr, "SGD: Saving incremental checkpoint '%ls'\n", deltaFileName.c_str());
+                    // (files of an earlier run would take precedence over the delta)
+                    _wunlink(GetModelNameForEpoch(i).c_str());
+                    _wunlink(GetCheckPointFileNameForEpoch(i).c_str());
+                    m_incrementalCheckpoint.Save(deltaFileName, net, smoothedGradients, smoothedCounts, totalTrainingSamplesSeen, learnRatePerSample,
+                                                 prevCriterion, chosenMinibatchSize, m_mpi != nullptr ? m_mpi->NumNodesInUse() : 1);
+                    for (const auto& file : filesToDelete)
+                        _wunlink(file.c_str());
+                }
+                else if (m_asyncCheckpoint)
+                    SaveCheckpointAsync(net, i, totalTrainingSamplesSeen, learnRatePerSample, smoothedGradients, smoothedCounts, prevCriterion, chosenMinibatchSize, filesToDelete);
+                else
+                {
+                    SaveCheckPointInfo(i, totalTrainingSamplesSeen, learnRatePerSample, smoothedGradients, smoothedCounts, prevCriterion, chosenMinibatchSize);
+                    auto modelName = GetModelNameForEpoch(i);
+                    if (m_traceLevel > 0)
+                        LOGPRINTF(stderr, "SGD: Saving checkpoint model '%ls'\n", modelName.c_str());
+                    net->Save(modelName);
+                    for (const auto& file : filesToDelete)
+                        _wunlink(file.c_str());
+                }
+                if (m_incrementalCheckpointInterval > 0 && !saveDelta)
+                {
+                    _wunlink(GetDeltaFileNameForEpoch(i).c_str());
+                    m_incrementalCheckpoint.SetBase(i, net, smoothedGradients);
+                }
             }
         }
         else
@@ -770,6 +896,11 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
     }
     // --- END OF MAIN EPOCH LOOP
 
+    WaitForCheckpointFiles();
+    vector<EpochCriterion> lastCrossValidation;
+    WaitForCrossValidation(lastCrossValidation); // (logged by its thread)
+    m_crossValidationNet.reset();
+
     // Synchronize all ranks before proceeding to ensure that
     // rank 0 has finished writing the model file
     if (m_mpi != nullptr)
@@ -831,11 +962,20 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 
     int numMBsRun = 0;
     int numMBsRunSinceLastLogged = 0;
+    size_t numImplicitTransfersLastLogged = GetNumImplicitMatrixTransfers();
 
     bool useGradientAggregation = UsingGradientAggregation(epochNumber);
     bool useModelAggregation = UsingModelAggregation(epochNumber);
     bool useParallelTrain = UsingParallelTrain(epochNumber);
 
+    // NaN/Inf checks of the updated parameters, see NonFiniteCheck
+#ifdef _DEBUG
+    size_t nonFiniteCheckInterval = m_nonFiniteCheckInterval > 0 ? m_nonFiniteCheckInterval : 1;
+#else
+    size_t nonFiniteCheckInterval = m_nonFiniteCheckInterval;
+#endif
+    NonFiniteCheck<ElemType> nonFiniteCheck(net->GetDeviceId(), nonFiniteCheckInterval, m_rollbackOnNonFinite);
+
     // MA-related variables
     size_t nSamplesSinceLastModelSync = 0;
     size_t blockSizePerWorker = 0;
@@ -854,6 +994,29 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     bool useDistributedMBReading = useParallelTrain &&
                                    m_enableDistributedMBReading &&
                                    trainSetDataReader->SupportsDistributedMBRead();
+
+    // The statistics of the reader are logged for the same intervals as the criterion, starting with this epoch.
+    ReaderStatistics readerStatistics;
+    trainSetDataReader->GetAndResetStatistics(readerStatistics);
+
+    // the per-rank timing of this epoch, with the data split by that of the last ones
+    StragglerMonitor* stragglerMonitor = useParallelTrain ? m_stragglerMonitor.get() : nullptr;
+    if (stragglerMonitor)
+        stragglerMonitor->StartEpoch();
+    if (stragglerMonitor && m_stragglerRebalance && useDistributedMBReading)
+    {
+        auto shares = stragglerMonitor->GetWorkerShares();
+        if (!trainSetDataReader->SetWorkerShares(shares))
+            fprintf(stderr, "WARNING: stragglerRebalance: The reader cannot split the data in shares other than equal ones.\n");
+        else if (!shares.empty() && m_traceLevel > 0 && m_mpi->IsMainNode())
+        {
+            LOGPRINTF(stderr, "Starting Epoch %d: shares of the data of the ranks:", epochNumber + 1);
+            for (size_t r = 0; r < shares.size(); r++)
+                fprintf(stderr, " %.3f", shares[r]);
+            fprintf(stderr, "\n");
+        }
+    }
+
     if (useDistributedMBReading)
     {
         trainSetDataReader->StartDistributedMinibatchLoop(tunedMBSize, epochNumber, m_mpi->CurrentNodeRank(),
@@ -870,6 +1033,8 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     {
         refNet->StartEvaluateMinibatchLoop(refNode);
     }
+    if (m_deviceReplicas)
+        m_deviceReplicas->StartEpoch(net, epochNumber, m_maxEpochs);
 
     // prepare for sub-minibatching
     // Sub-minibatching is used if a single minibatch is too large to fit into GPU RAM.
@@ -880,6 +1045,20 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     if (numSubminibatchesNeeded > 1)
         smbDispatcher.Init(net, learnableNodes, criterionNodes, evaluationNodes);
 
+    // Without a user-specified split, it may be derived for each minibatch from the memory plan of the network instead, so that
+    // minibatches of longer sequences are split more. The budget is what the buffers of the plan hold plus the free memory,
+    // once the cached blocks of the allocator, which cudaMemGetInfo() does not count as free, are returned.
+    const bool autoSubminibatches = numSubminibatchesNeeded <= 1 && m_autoSubminibatchesMemoryFraction > 0 && net->GetDeviceId() != CPUDEVICE;
+    size_t subminibatchBudgetInBytes = 0;
+    size_t lastAutoNumSubminibatches = 1;
+    if (autoSubminibatches)
+    {
+        smbDispatcher.Init(net, learnableNodes, criterionNodes, evaluationNodes);
+        TracingGPUMemoryAllocator::ReleaseCachedMemory(net->GetDeviceId());
+        subminibatchBudgetInBytes = (size_t) (m_autoSubminibatchesMemoryFraction *
+                                              (GPUWatcher::GetFreeMemoryOnCUDADevice(net->GetDeviceId()) + net->GetMatrixPool().GetAllocatedBytes(net->GetDeviceId())));
+    }
+
     // The following is a special feature only supported by the Kaldi2Reader for more efficient sequence training.
     // This attemps to compute the error signal for the whole utterance, which will
     // be fed to the neural network as features. Currently it is a workaround
@@ -904,6 +1083,9 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         if (useDistributedMBReading)
             fprintf(stderr, ", distributed reading is ENABLED");
 
+        if (m_deviceReplicas)
+            fprintf(stderr, ", split across %d devices", (int) m_deviceReplicas->GetNumDevices());
+
         if (numSubminibatchesNeeded > 1)
         {
             if (m_maxSamplesInRAM < SIZE_MAX)
@@ -911,6 +1093,8 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             else
                 fprintf(stderr, ", with %d subminibatch", (int)numSubminibatchesNeeded);
         }
+        else if (autoSubminibatches)
+            fprintf(stderr, ", with subminibatches to fit %.1f MB", subminibatchBudgetInBytes / (1024.0 * 1024.0));
         fprintf(stderr, ".\n");
     }
 
@@ -950,27 +1134,102 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         }
     }
 
+    // Let backprop announce completed gradients to the aggregator, so that their aggregation overlaps with the
+    // remainder of the backward pass. Only done in the last sub-minibatch, since gradients accumulate across sub-minibatches.
+    bool announceCompletedGradients = false;
+    if (useGradientAggregation)
+    {
+        net->SetGradientReadyCallback(criterionNodes[0], [&](const ComputationNodeBasePtr& node)
+        {
+            auto gradient = dynamic_pointer_cast<ComputationNode<ElemType>>(node)->GradientPtr();
+            if (announceCompletedGradients && gradient)
+                m_distGradAgg->OnGradientReady(gradient.get());
+        });
+    }
+    auto removeGradientReadyCallback = MakeScopeExit([&]() { if (useGradientAggregation) net->SetGradientReadyCallback(criterionNodes[0], nullptr); });
+
+    // Record the memory of the nodes over the first minibatches, as a trace for chrome://tracing (first epoch only).
+    shared_ptr<MemoryProfiler> memoryProfiler;
+    if (m_numMBsToMemoryProfile > 0)
+    {
+        wstring fileName = m_memoryProfileFile;
+        if (m_mpi && m_mpi->NumNodesInUse() > 1)
+            fileName += L"." + to_wstring(m_mpi->CurrentNodeRank());
+        memoryProfiler = make_shared<MemoryProfiler>(fileName, m_numMBsToMemoryProfile, net->GetDeviceId());
+        net->SetMemoryProfiler(memoryProfiler);
+        m_numMBsToMemoryProfile = 0;
+    }
+    auto removeMemoryProfiler = MakeScopeExit([&]() { if (memoryProfiler) net->SetMemoryProfiler(nullptr); });
+
+    // Time the nodes and the phases of the training loop, summarized at the end of each epoch, and traced over the first minibatches of the first.
+    shared_ptr<TimingProfiler> timingProfiler;
+    if (m_timingProfile)
+    {
+        wstring fileName = m_numMBsToTimingTrace > 0 ? m_timingTraceFile : wstring();
+        if (!fileName.empty() && m_mpi && m_mpi->NumNodesInUse() > 1)
+            fileName += L"." + to_wstring(m_mpi->CurrentNodeRank());
+        timingProfiler = make_shared<TimingProfiler>(net->GetDeviceId(), fileName, m_numMBsToTimingTrace);
+        net->SetTimingProfiler(timingProfiler);
+        m_numMBsToTimingTrace = 0;
+    }
+    auto removeTimingProfiler = MakeScopeExit([&]() { if (timingProfiler) net->SetTimingProfiler(nullptr); });
+
+    // Export the progress lines with where the time went as JSON lines, for monitoring, see TrainingTelemetry.
+    if (!m_telemetryFile.empty() && !m_telemetry)
+    {
+        wstring fileName = m_telemetryFile;
+        int rank = m_mpi ? (int) m_mpi->CurrentNodeRank() : 0;
+        if (m_mpi && m_mpi->NumNodesInUse() > 1)
+            fileName += L"." + to_wstring(rank);
+        m_telemetry = make_shared<TrainingTelemetry>(fileName, rank, /*phasesSynchronized=*/m_perfTraceLevel > 0);
+    }
+
+    // Replay the forward and backward pass of minibatches of the same shape from GPU graphs, see GPUGraphStep.
+    // Not where a step does more than that, and not with the profilers, which would not see the nodes of replayed steps.
+    unique_ptr<GPUGraphStep<ElemType>> gpuGraphStep;
+    if (m_useGPUGraphs && numSubminibatchesNeeded <= 1 && !autoSubminibatches && !m_deviceReplicas && !m_doGradientCheck && !memoryProfiler && !timingProfiler &&
+        !(m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && refNode))
+    {
+        vector<ComputationNodeBasePtr> inputNodes(featureNodes.begin(), featureNodes.end());
+        inputNodes.insert(inputNodes.end(), labelNodes.begin(), labelNodes.end());
+        vector<ComputationNodeBasePtr> rootNodes(evaluationNodes.begin(), evaluationNodes.end());
+        rootNodes.push_back(criterionNodes[0]);
+        gpuGraphStep.reset(new GPUGraphStep<ElemType>(net, inputNodes, rootNodes, m_traceLevel));
+        if (!gpuGraphStep->IsEnabled())
+            gpuGraphStep.reset();
+    }
+
     bool noMoreSamplesToProcess = false;
     bool isFirstMinibatch = true;
+    Timer stragglerTimer; // since the end of the last exchange
+    if (stragglerMonitor)
+        stragglerTimer.Start();
     for (;;)
     {
-        // Per-minibatch performance measurements; only enabled when perfTraceLevel > 0
+        // Per-minibatch performance measurements; only enabled when perfTraceLevel > 0, except for the host-side
+        // waits for the reader and the aggregation, which are also timed for the telemetry and the straggler detection
         Timer fineGrainedPerfMeasurementTimer;
         double readTime = 0;
         double computeTime = 0;
+        double aggregationTime = 0;
         double parameterUpdateTime = 0;
-        if (m_perfTraceLevel > 0)
+        if (m_perfTraceLevel > 0 || m_telemetry || stragglerMonitor)
             fineGrainedPerfMeasurementTimer.Start();
 
         // get minibatch
         // TODO: is it guaranteed that the GPU is already completed at this point, is it safe to overwrite the buffers?
         size_t actualMBSize = 0;
+        size_t timingBegin = timingProfiler ? timingProfiler->Begin() : 0;
         bool wasDataRead = DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(*trainSetDataReader, net, criterionNodes[0],
                                                                                 useDistributedMBReading, useParallelTrain, *inputMatrices, actualMBSize, m_mpi);
         if (!wasDataRead && (!useDistributedMBReading || noMoreSamplesToProcess)) // in case of distributed reading, we do a few more loops until all ranks have completed
             break;                                                                // end of epoch
+        if (memoryProfiler)
+            memoryProfiler->BeginMinibatch();
+        if (timingProfiler)
+            timingProfiler->End(L"read", TimingProfiler::Track::phase, timingBegin);
 
-        if (m_perfTraceLevel > 0)
+        if (m_perfTraceLevel > 0 || m_telemetry || stragglerMonitor)
         {
             fineGrainedPerfMeasurementTimer.Stop();
             readTime = fineGrainedPerfMeasurementTimer.ElapsedSeconds();
@@ -983,6 +1242,10 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         if (!wasDataRead)
             actualMBSize = 0; // (undefined if !wasDataRead)
 
+        // hand the shares of the other devices to the replicas, which process them while we process ours
+        if (m_deviceReplicas && wasDataRead)
+            actualMBSize = m_deviceReplicas->StartMinibatch(net, *inputMatrices, /*computeGradient=*/learnRatePerSample > 0.01 * m_minLearnRate);
+
         nSamplesSinceLastModelSync += actualMBSize;
 
         // Dropout nodes have an implicit input in the form of the random mask that is applied to its explicit input
@@ -1025,7 +1288,18 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 
             // We optionally break the minibatch into sub-minibatches.
             // This, when enabled, is used when a full minibatch does not fit into GPU RAM.
-            size_t actualNumSubminibatches = numSubminibatchesNeeded <= 1 ? 1 : smbDispatcher.GetMinibatchIntoCache(*trainSetDataReader, *net, *inputMatrices, numSubminibatchesNeeded);
+            size_t numSubminibatches = numSubminibatchesNeeded;
+            if (autoSubminibatches)
+            {
+                const MatrixPool& matrixPool = net->GetMatrixPool();
+                numSubminibatches = DataReaderHelpers::GetNumSubminibatchesToFit(*net->GetMBLayoutPtrOfNetwork(), matrixPool.GetPlannedBytes(/*mbScale=*/false),
+                                                                                 matrixPool.GetPlannedBytes(/*mbScale=*/true), subminibatchBudgetInBytes);
+                if (numSubminibatches != lastAutoNumSubminibatches && m_traceLevel > 1)
+                    LOGPRINTF(stderr, "Splitting minibatches of %d x %d columns into %d subminibatches.\n",
+                              (int) net->GetMBLayoutPtrOfNetwork()->GetNumTimeSteps(), (int) net->GetMBLayoutPtrOfNetwork()->GetNumParallelSequences(), (int) numSubminibatches);
+                lastAutoNumSubminibatches = numSubminibatches;
+            }
+            size_t actualNumSubminibatches = numSubminibatches <= 1 ? 1 : smbDispatcher.GetMinibatchIntoCache(*trainSetDataReader, *net, *inputMatrices, numSubminibatches);
             for (size_t ismb = 0; ismb < actualNumSubminibatches; ismb++)
             {
                 if (actualNumSubminibatches > 1)
@@ -1039,22 +1313,35 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                 // forward prop for evaluate eval nodes
                 // ===========================================================
 
-                // compute eval node first since when gradient is computed the forward function values
-                // may be changed and need to be recomputed when gradient and function value share the same matrix
-                net->ForwardProp(evaluationNodes); // the bulk of this evaluation is reused in ComputeGradient() below
+                const bool computeGradient = learnRatePerSample > 0.01 * m_minLearnRate; // only compute gradient when learning rate is large enough
+                auto forwardAndBackprop = [&]()
+                {
+                    // compute eval node first since when gradient is computed the forward function values
+                    // may be changed and need to be recomputed when gradient and function value share the same matrix
+                    net->ForwardProp(evaluationNodes); // the bulk of this evaluation is reused in ComputeGradient() below
 
-                // ===========================================================
-                // forward prop for training criterion
-                // ===========================================================
+                    // ===========================================================
+                    // forward prop for training criterion
+                    // ===========================================================
 
-                net->ForwardProp(criterionNodes[0]);
+                    net->ForwardProp(criterionNodes[0]);
 
-                // ===========================================================
-                // backprop
-                // ===========================================================
+                    // ===========================================================
+                    // backprop
+                    // ===========================================================
 
-                if (learnRatePerSample > 0.01 * m_minLearnRate) // only compute gradient when learning rate is large enough
-                    net->Backprop(criterionNodes[0]);
+                    if (computeGradient)
+                    {
+                        // not while steps may be captured, when the gradients are only complete once the graph has run
+                        announceCompletedGradients = !gpuGraphStep && (ismb + 1 == actualNumSubminibatches);
+                        net->Backprop(criterionNodes[0]);
+                        announceCompletedGradients = false;
+                    }
+                };
+                if (gpuGraphStep)
+                    gpuGraphStep->Run(computeGradient, forwardAndBackprop);
+                else
+                    forwardAndBackprop();
 
                 // house-keeping for sub-minibatching
                 if (actualNumSubminibatches > 1)
@@ -1086,6 +1373,16 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         size_t aggregateNumSamples = actualMBSize; // (0 for empty MB)
         size_t aggregateNumSamplesWithLabel = CriterionAccumulator<ElemType>::GetNumSamples(criterionNodes[0], numSamplesWithLabelOfNetwork); // (0 for empty MB)
 
+        // add the gradients and sample counts of the device replicas
+        if (m_deviceReplicas && wasDataRead)
+        {
+            timingBegin = timingProfiler ? timingProfiler->Begin() : 0;
+            m_deviceReplicas->EndMinibatch(aggregateNumSamples, aggregateNumSamplesWithLabel);
+            m_deviceReplicas->ReduceGradients(learnableNodes, /*mainHasGradients=*/actualMBSize > 0 && learnRatePerSample > 0.01 * m_minLearnRate);
+            if (timingProfiler)
+                timingProfiler->End(L"gradient aggregation", TimingProfiler::Track::phase, timingBegin);
+        }
+
         if (!useGradientAggregation)
         {
             // accumulate criterion values (objective, eval)
@@ -1137,8 +1434,26 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 
             // aggregate
             m_gradHeader->numEvalNode = evaluationNodes.size(); // TODO: rename numEvalNode (plural)
+            timingBegin = timingProfiler ? timingProfiler->Begin() : 0;
+            if (stragglerMonitor) // (the time of this wait goes with the next exchange)
+                stragglerMonitor->AddLocal(aggregateNumSamples, readTime, max(stragglerTimer.ElapsedSeconds() - readTime, 0.0), 0);
+            Timer aggregationTimer;
+            if (m_telemetry || stragglerMonitor)
+                aggregationTimer.Start();
             bool samplesProcessed = m_distGradAgg->AggregateGradients(learnParamsGradients, m_gradHeader.get(), isFirstMinibatch);
             noMoreSamplesToProcess = !samplesProcessed;
+            if (m_telemetry || stragglerMonitor)
+            {
+                aggregationTimer.Stop();
+                aggregationTime = aggregationTimer.ElapsedSeconds();
+            }
+            if (stragglerMonitor)
+            {
+                stragglerMonitor->AddLocal(0, 0, 0, aggregationTime);
+                stragglerTimer.Restart();
+            }
+            if (timingProfiler)
+                timingProfiler->End(L"gradient aggregation", TimingProfiler::Track::phase, timingBegin);
 
             // read out the header--now everything is aggregated
             aggregateNumSamples          = m_gradHeader->numSamples;
@@ -1161,36 +1476,25 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             if (numSamplesInMinibatch != aggregateNumSamples)
                 fprintf(stderr, "SGD: using true #samples %d instead of MB size %d\n", (int)numSamplesInMinibatch, (int)aggregateNumSamples);
 #endif
-            auto smoothedGradientIter = smoothedGradients.begin();
-            auto smoothedCountIter = smoothedCounts.begin();
-            for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++, smoothedCountIter++)
+            timingBegin = timingProfiler ? timingProfiler->Begin() : 0;
+            // BUGBUG (Issue #95): Access to net MBLayout can no longer be done if we have multiple input layouts
+            double momentumPerSample = GetMomentumPerSample(epochNumber /*BUGBUG workaround:*/, net->GetMBLayoutPtrOfNetwork()->GetNumParallelSequences());
+            UpdateLearnableNodes(learnableNodes, smoothedGradients, smoothedCounts,
+                                 learnRatePerSample, momentumPerSample, numSamplesInMinibatch,
+                                 batchNormalizationWeights);
+            for (const auto& node : learnableNodes)
             {
-                ComputationNodeBasePtr node = *nodeIter;
                 if (node->IsParameterUpdateRequired())
                 {
-#ifdef _DEBUG
-                    if (smoothedGradientIter->HasNan("TrainOneEpoch/UpdateWeights(): "))
-                        LogicError("%ls %ls operation has NaNs in smoothedGradient.", node->NodeName().c_str(), node->OperationName().c_str());
-#endif
-                    double nodeDependentLearningRatePerSample = learnRatePerSample * node->GetLearningRateMultiplier();
-                    double momentumPerSample = GetMomentumPerSample(epochNumber /*BUGBUG workaround:*/, net->GetMBLayoutPtrOfNetwork()->GetNumParallelSequences());
-                    double l2Factor = batchNormalizationWeights.find(node) == batchNormalizationWeights.end() ? 1.0 : 0.0;
-                    // TODO: Check why l2Factor is not applied to L1. Bug?
-                    // BUGBUG (Issue #95): Access to net MBLayout can no longer be done if we have multiple input layouts
-                    UpdateWeights(dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value(),
-                                  dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Gradient(),
-                                  *smoothedGradientIter, *smoothedCountIter,
-                                  nodeDependentLearningRatePerSample, momentumPerSample,
-                                  numSamplesInMinibatch,
-                                  m_L2RegWeight * l2Factor, m_L1RegWeight,
-                                  m_needAveMultiplier, m_useNesterovMomentum);
                     node->BumpEvalTimeStamp();
-#ifdef _DEBUG
-                    if (dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value().HasNan("TrainOneEpoch/UpdateWeights(): "))
-                        LogicError("%ls %ls operation has NaNs in functionValues after parameter update.", node->NodeName().c_str(), node->OperationName().c_str());
-#endif
+                    nonFiniteCheck.Add(dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value());
                 }
             }
+            nonFiniteCheck.EndMinibatch(learnableNodes, smoothedGradients, smoothedCounts);
+            if (m_deviceReplicas)
+                m_deviceReplicas->BroadcastParameters(learnableNodes);
+            if (timingProfiler)
+                timingProfiler->End(L"weight update", TimingProfiler::Track::phase, timingBegin);
         }
 
         if (m_perfTraceLevel > 0)
@@ -1204,12 +1508,36 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             fprintf(stderr, "Perf trace: Worker MB size = %d, Read = %.5gs; Compute = %.5gs; Parameter update = %.5gs, Aggregate MB size = %d\n", (int)actualMBSize, readTime, computeTime, parameterUpdateTime, (int)aggregateNumSamples);
         }
 
+        // (the parameter update time includes the gradient aggregation)
+        double updateTime = max(parameterUpdateTime - aggregationTime, 0.0);
+
         // aggregation by model averaging or block momentum 
         if (useModelAggregation)
         {
+            if (stragglerMonitor)
+            {
+                stragglerMonitor->AddLocal(actualMBSize, readTime, max(stragglerTimer.ElapsedSeconds() - readTime, 0.0), 0);
+                stragglerTimer.Restart();
+            }
             if (nSamplesSinceLastModelSync >= blockSizePerWorker)
             {
+                timingBegin = timingProfiler ? timingProfiler->Begin() : 0;
+                Timer aggregationTimer;
+                if (m_telemetry || stragglerMonitor)
+                    aggregationTimer.Start();
                 bool synced = m_pMASGDHelper->OnArrivingAtSyncPoint(learnableNodes, smoothedGradients, nSamplesSinceLastModelSync);
+                if (m_telemetry || stragglerMonitor)
+                {
+                    aggregationTimer.Stop();
+                    aggregationTime += aggregationTimer.ElapsedSeconds();
+                }
+                if (stragglerMonitor)
+                {
+                    stragglerMonitor->AddLocal(0, 0, 0, aggregationTimer.ElapsedSeconds());
+                    stragglerTimer.Restart();
+                }
+                if (timingProfiler)
+                    timingProfiler->End(L"model aggregation", TimingProfiler::Track::phase, timingBegin);
                 if (synced)
                 {
                     nSamplesSinceLastModelSync = 0;
@@ -1222,6 +1550,9 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             }
         }
 
+        if (m_telemetry)
+            m_telemetry->AddMinibatch(readTime, computeTime, aggregationTime, updateTime);
+
         timer.Stop();
         numMBsRun++;
 
@@ -1240,6 +1571,8 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                 epochCriterion = localEpochCriterion.GetCriterion(0);
                 for (size_t i = 0; i < epochEvalErrors.size(); i++)
                     epochEvalErrors[i] = localEpochEvalErrors.GetCriterion(i);
+                if (m_deviceReplicas)
+                    m_deviceReplicas->AddEpochCriteria(epochCriterion, epochEvalErrors);
                 timer.Stop();
 
                 // Add the last trailing compute
@@ -1270,6 +1603,9 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             // progress tracing for compute cluster management
             let wasProgressPrinted = ProgressTracing::TraceProgressPercentage(epochNumber, mbProg, false);
 
+            // (shared by the log and the telemetry, since reading them resets them)
+            bool haveReaderStatistics = (m_perfTraceLevel > 0 || m_telemetry) && trainSetDataReader->GetAndResetStatistics(readerStatistics);
+
             // progress tracing for regular log
             if (m_traceLevel > 0)
             {
@@ -1286,12 +1622,51 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 
                 fprintf(stderr, ("time = " + GeneratePaddedFloatOrExpFormat(0, 4, totalTimeInMBs) + "s; samplesPerSecond = %.1f\n").c_str(),
                         totalTimeInMBs, trainSamplesSinceLastLogged / totalTimeInMBs);
+
+                // where the time of the reader went, and whether the network had to wait for it
+                if (m_perfTraceLevel > 0 && haveReaderStatistics)
+                {
+                    PREPENDTS(stderr);
+                    readerStatistics.Print(stderr, "Reader statistics: ", totalTimeInMBs);
+                }
+
+                // matrices that operations moved between devices implicitly, mostly unintended sync points
+                size_t numImplicitTransfers = GetNumImplicitMatrixTransfers();
+                if (m_perfTraceLevel > 0 && numImplicitTransfers != numImplicitTransfersLastLogged)
+                {
+                    PREPENDTS(stderr);
+                    fprintf(stderr, "Implicit matrix transfers between devices: %.1f per minibatch\n",
+                            (numImplicitTransfers - numImplicitTransfersLastLogged) / (double)(numMBsRun - numMBsRunSinceLastLogged));
+                }
+                numImplicitTransfersLastLogged = numImplicitTransfers;
             }
 
             // progress tracing for compute cluster management
             if (wasProgressPrinted)
                 ProgressTracing::TraceTrainLoss(trainLossSinceLastLogged);
 
+            if (m_telemetry)
+            {
+                TrainingTelemetry::Sample sample;
+                sample.epoch = epochNumber + 1;
+                sample.firstMinibatch = numMBsRunSinceLastLogged + 1;
+                sample.lastMinibatch = numMBsRun;
+                sample.samples = trainSamplesSinceLastLogged;
+                sample.seconds = totalTimeInMBs;
+                sample.loss = trainLossSinceLastLogged;
+                sample.learningRatePerSample = learnRatePerSample;
+                sample.haveReaderStatistics = haveReaderStatistics;
+                sample.reader = readerStatistics;
+                if (net->GetDeviceId() >= 0)
+                {
+                    sample.deviceFreeBytes = GPUWatcher::GetFreeMemoryOnCUDADevice(net->GetDeviceId());
+                    sample.deviceUsedBytes = GPUWatcher::GetUsedMemoryOnCUDADevice(net->GetDeviceId());
+                }
+                sample.poolFixedBytes = net->GetMatrixPool().GetPlannedBytes(/*mbScale=*/false);
+                sample.poolBytesPerSample = net->GetMatrixPool().GetPlannedBytes(/*mbScale=*/true);
+                m_telemetry->Write(sample);
+            }
+
             if (m_traceLevel > 0)
                 fflush(stderr);
 
@@ -1322,17 +1697,27 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         AttemptUtteranceDerivativeFeatures(net, trainSetDataReader, featureNodes, inputMatrices);
 
         profiler.NextSample();
+        if (memoryProfiler)
+            memoryProfiler->EndMinibatch();
+        if (timingProfiler)
+            timingProfiler->EndMinibatch();
         isFirstMinibatch = false;
     }
 
     // --- END MAIN MINIBATCH LOOP
 
+    if (timingProfiler)
+        timingProfiler->Finish(epochNumber + 1);
+
     if (useModelAggregation )
     {
         m_pMASGDHelper->OnEpochEnd(learnableNodes, smoothedGradients, nSamplesSinceLastModelSync);
         nSamplesSinceLastModelSync = 0;
     }
 
+    if (stragglerMonitor)
+        stragglerMonitor->LogEpoch(epochNumber);
+
     // hoist the accumulated criterion value from GPU side to our 'out'  variables
     // (unless we useGradientAggregation, in which case they are accumulated in the 'out' variables directly)
     if (!useGradientAggregation)
@@ -1340,6 +1725,8 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         epochCriterion = localEpochCriterion.GetCriterion(0);
         for (size_t i = 0; i < epochEvalErrors.size(); i++)
             epochEvalErrors[i] = localEpochEvalErrors.GetCriterion(i);
+        if (m_deviceReplicas)
+            m_deviceReplicas->AddEpochCriteria(epochCriterion, epochEvalErrors);
     }
 
     // in case of model averaging, do one more final aggregation of criteria
@@ -1428,6 +1815,18 @@ bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
 {
     std::list<ComputationNodeBasePtr> nodes = net->GetNodesRequiringPreComputation(); // this tests all HasComputed() flags
 
+    // In parallel training, which merges the statistics of all ranks, the ranks precompute if the main node does: a rank
+    // that started from other files than the main node takes over its model, see TrainOrAdaptModel().
+    if (m_mpi != nullptr && m_mpi->NumNodesInUse() > 1)
+    {
+        int mainNodePreComputes = nodes.empty() ? 0 : 1;
+        m_mpi->Bcast(&mainNodePreComputes, 1, m_mpi->MainNodeRank());
+        if (!mainNodePreComputes)
+            nodes.clear();
+        else if (nodes.empty())
+            nodes = net->GetNodesRequiringPreComputation(nullptr, /*checkComputed=*/false);
+    }
+
     if (nodes.size() == 0)
     {
         if (m_traceLevel > 0)
@@ -1448,32 +1847,78 @@ bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
     // compute
     ScopedNetworkOperationMode modeGuard(net, NetworkOperationMode::preComputing);
 
-    // trainSetDataReader->StartMinibatchLoop(m_mbSize[0],  0 , requestDataSize);
-    // trainSetDataReader->StartMinibatchLoop(m_mbSize[0],  0 , m_epochSize); // only based on one epoch
-    // To support large dataset, we usually partition whole dataset into several epoch's,
-    // so we need to use all the data to do precomputing
-    if (m_useAllDataForPreComputedNode) // using all the data
-        trainSetDataReader->StartMinibatchLoop(m_mbSize[0], 0, inputMatrices->GetStreamDescriptions());
-    else // using only one epoch. Note: One epoch is often enough for feature mean/stddev, but not for estimating priors.
-        trainSetDataReader->StartMinibatchLoop(m_mbSize[0], 0, inputMatrices->GetStreamDescriptions(), m_epochSize);
-    net->StartEvaluateMinibatchLoop(nodes);
-
     // initialize
     for (auto & node : nodes)
         dynamic_pointer_cast<IPreComputeNode>(node)->MarkComputed(false /*begin accumulating*/);
 
-    const size_t numIterationsBeforePrintingProgress = 100;
-    size_t numItersSinceLastPrintOfProgress = 0;
-    size_t actualMBSizeDummy;
-    while (DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(*trainSetDataReader, net, nullptr, false, false, *inputMatrices, actualMBSizeDummy, m_mpi))
+    // The statistics of an earlier run, if the cache fits on all ranks
+    bool fromCache = false;
+    if (!m_preComputeCacheFile.empty())
     {
-        // TODO: move these into GetMinibatchIntoNetwork()  --but those are passed around; necessary? Can't we get them from 'net'?
-        ComputationNetwork::BumpEvalTimeStamp(featureNodes);
-        ComputationNetwork::BumpEvalTimeStamp(labelNodes);
+        PreComputeCache cache;
+        std::string whyNot;
+        fromCache = ReadPreComputeCache(m_preComputeCacheFile, nodes, cache, whyNot);
+        if (m_mpi)
+        {
+            int numRanksWithCache = fromCache ? 1 : 0;
+            m_mpi->AllReduce(&numRanksWithCache, 1);
+            if (fromCache && numRanksWithCache != (int) m_mpi->NumNodesInUse())
+            {
+                fromCache = false;
+                whyNot = "other ranks cannot use it";
+            }
+        }
+
+        if (fromCache)
+        {
+            ApplyPreComputeCache(nodes, cache);
+            LOGPRINTF(stderr, "Precomputing --> Taken from cache file %ls.\n", m_preComputeCacheFile.c_str());
+        }
+        else
+            LOGPRINTF(stderr, "Precomputing --> Not using cache file %ls, since %s.\n", m_preComputeCacheFile.c_str(), whyNot.c_str());
+    }
+
+    if (!fromCache)
+    {
+        // In parallel training each rank reads only its part of the data, either through distributed reading or by decimating
+        // the minibatches of a legacy reader, and the statistics of the parts are merged in the end
+        bool useDistributedMBReading = m_mpi && m_enableDistributedMBReading && trainSetDataReader->SupportsDistributedMBRead();
+        bool useDecimation = m_mpi && !useDistributedMBReading && trainSetDataReader->IsLegacyReader();
+
+        // trainSetDataReader->StartMinibatchLoop(m_mbSize[0],  0 , requestDataSize);
+        // trainSetDataReader->StartMinibatchLoop(m_mbSize[0],  0 , m_epochSize); // only based on one epoch
+        // To support large dataset, we usually partition whole dataset into several epoch's,
+        // so we need to use all the data to do precomputing
+        size_t epochSize = m_useAllDataForPreComputedNode ? requestDataSize : m_epochSize; // Note: One epoch is often enough for feature mean/stddev, but not for estimating priors.
+        if (useDistributedMBReading)
+            trainSetDataReader->StartDistributedMinibatchLoop(m_mbSize[0], 0, m_mpi->CurrentNodeRank(), m_mpi->NumNodesInUse(), inputMatrices->GetStreamDescriptions(), epochSize);
+        else
+            trainSetDataReader->StartMinibatchLoop(m_mbSize[0], 0, inputMatrices->GetStreamDescriptions(), epochSize);
+        net->StartEvaluateMinibatchLoop(nodes);
+
+        const size_t numIterationsBeforePrintingProgress = 100;
+        size_t numItersSinceLastPrintOfProgress = 0;
+        size_t numMinibatchesRead = 0;
+        size_t actualMBSizeDummy;
+        while (DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(*trainSetDataReader, net, nullptr, useDistributedMBReading, useDecimation, *inputMatrices, actualMBSizeDummy, m_mpi))
+        {
+            if (numMinibatchesRead++ % m_preComputeDecimation != 0)
+                continue;
 
-        net->ForwardProp(nodes);
+            // TODO: move these into GetMinibatchIntoNetwork()  --but those are passed around; necessary? Can't we get them from 'net'?
+            ComputationNetwork::BumpEvalTimeStamp(featureNodes);
+            ComputationNetwork::BumpEvalTimeStamp(labelNodes);
 
-        numItersSinceLastPrintOfProgress = ProgressTracing::TraceFakeProgress(numIterationsBeforePrintingProgress, numItersSinceLastPrintOfProgress);
+            net->ForwardProp(nodes);
+
+            numItersSinceLastPrintOfProgress = ProgressTracing::TraceFakeProgress(numIterationsBeforePrintingProgress, numItersSinceLastPrintOfProgress);
+        }
+
+        if (useDistributedMBReading || useDecimation)
+            MergePreComputeAccumulations(nodes, m_mpi);
+
+        if (!m_preComputeCacheFile.empty() && (!m_mpi || m_mpi->IsMainNode()))
+            SavePreComputeCache(m_preComputeCacheFile, nodes);
     }
 
     // finalize
@@ -1486,6 +1931,27 @@ bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
     return true;
 }
 
+// the nodes whose state the trial mini-epochs of the learning-rate and minibatch-size searches change, for ParameterSnapshot
+static std::list<ComputationNodeBasePtr> TrialStateNodes(ComputationNetworkPtr net,
+                                                         const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                                                         const std::vector<ComputationNodeBasePtr>& evaluationNodes)
+{
+    std::list<ComputationNodeBasePtr> nodes;
+    std::set<ComputationNodeBasePtr> visited;
+    for (const auto& roots : { criterionNodes, evaluationNodes })
+    {
+        for (const auto& root : roots)
+        {
+            for (const auto& node : net->GetAllNodesForRoot(root))
+            {
+                if (visited.insert(node).second)
+                    nodes.push_back(node);
+            }
+        }
+    }
+    return nodes;
+}
+
 // return a reasonable initial learning rate based on the initial mbsize
 template <class ElemType>
 double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
@@ -1522,7 +1988,8 @@ double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
     }
 
     int baseModelEpoch = epochNumber - 1;
-    net->RereadPersistableParameters<ElemType>(GetModelNameForEpoch(baseModelEpoch));
+    WaitForCheckpointFiles();
+    RereadPersistableParametersForEpoch(net, baseModelEpoch);
 
     double learnRate = learnRatePerSample;
     size_t dummyMinibatchSize;            // (not used)
@@ -1536,6 +2003,10 @@ double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
                        /*out*/ prevCriterion,
                        /*out*/ dummyMinibatchSize);
 
+    // each trial rolls back to this copy in device memory instead of reading the checkpoint again
+    ParameterSnapshot<ElemType> snapshot;
+    snapshot.Take(TrialStateNodes(net, criterionNodes, evaluationNodes), smoothedGradients, smoothedCounts);
+
     // if model is not changed this is what we will get
     EpochCriterion baseCriterion;
     vector<EpochCriterion> epochEvalErrors(evaluationNodes.size(), EpochCriterion::Infinity()); // these are ignored in this entire method
@@ -1545,6 +2016,7 @@ double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
                                     criterionNodes, evaluationNodes,
                                     inputMatrices, learnableNodes,
                                     smoothedGradients, smoothedCounts,
+                                    snapshot,
                                     /*out*/ baseCriterion, /*out*/ epochEvalErrors,
                                     "BaseAdaptiveLearnRateSearch:");
 
@@ -1572,6 +2044,7 @@ double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
                                         labelNodes, criterionNodes,
                                         evaluationNodes, inputMatrices,
                                         learnableNodes, smoothedGradients, smoothedCounts,
+                                        snapshot,
                                         /*out*/ epochCriterion, /*out*/ epochEvalErrors,
                                         "AdaptiveLearnRateSearch:");
     } while (epochCriterion.IsNan() || (epochCriterion.Average() > baseCriterion.Average() && learnRatePerSample > minLearnRate));
@@ -1593,6 +2066,7 @@ double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
                                         criterionNodes, evaluationNodes,
                                         inputMatrices, learnableNodes,
                                         smoothedGradients, smoothedCounts,
+                                        snapshot,
                                         /*out*/ leftCriterion, /*out*/ epochEvalErrors,
                                         "DetailBaseAdaptiveLearnRateSearch:");
 
@@ -1612,6 +2086,7 @@ double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
                                                 inputMatrices,
                                                 learnableNodes,
                                                 smoothedGradients, smoothedCounts,
+                                                snapshot,
                                                 /*out*/ rightCriterion,
                                                 /*out*/ epochEvalErrors,
                                                 "DetailRightAdaptiveLearnRateSearch:");
@@ -1630,6 +2105,7 @@ double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
                                                 inputMatrices,
                                                 learnableNodes,
                                                 smoothedGradients, smoothedCounts,
+                                                snapshot,
                                                 /*out*/ leftCriterion,
                                                 /*out*/ epochEvalErrors,
                                                 "DetailLeftAdaptiveLearnRateSearch:");
@@ -1776,6 +2252,10 @@ size_t SGD<ElemType>::SearchForBestMinibatchSize(ComputationNetworkPtr net,
         return maxMinibatchSize;
     }
 
+    // each trial rolls back to this copy in device memory, the state the epoch starts from
+    ParameterSnapshot<ElemType> snapshot;
+    snapshot.Take(TrialStateNodes(net, criterionNodes, evaluationNodes), smoothedGradients, smoothedCounts);
+
     size_t trialMinibatchSize = 0;
     bool isFirstIteration = true;
     EpochCriterion baseCriterion(0);
@@ -1810,6 +2290,7 @@ size_t SGD<ElemType>::SearchForBestMinibatchSize(ComputationNetworkPtr net,
                                         labelNodes, criterionNodes,
                                         evaluationNodes, inputMatrices,
                                         learnableNodes, smoothedGradients, smoothedCounts,
+                                        snapshot,
                                         /*out*/ epochCriterion, /*out*/ epochEvalErrors,
                                         isFirstIteration ? "BaseAdaptiveMinibatchSearch:" : "AdaptiveMinibatchSearch:");
 
@@ -1871,6 +2352,7 @@ void SGD<ElemType>::TrainOneMiniEpochAndReloadModel(ComputationNetworkPtr net,
                                                     StreamMinibatchInputs* inputMatrices,
                                                     const std::list<ComputationNodeBasePtr>& learnableNodes,
                                                     std::list<Matrix<ElemType>>& smoothedGradients, vector<double> smoothedCounts,
+                                                    const ParameterSnapshot<ElemType>& snapshot,
                                                     /*out*/ EpochCriterion& epochCriterion,
                                                     /*out*/ std::vector<EpochCriterion>& epochEvalErrors,
                                                     std::string prefixMsg)
@@ -1888,23 +2370,8 @@ void SGD<ElemType>::TrainOneMiniEpochAndReloadModel(ComputationNetworkPtr net,
         epochEvalErrors[j].LogCriterion(evaluationNodes[j]->NodeName());
     fprintf(stderr, "learningRatePerSample = %.8g; minibatchSize = %d\n", learnRatePerSample, (int)minibatchSize);
 
-    // go back to where we came from
-    int baseModelEpoch = epochNumber - 1;
-    let path = GetModelNameForEpoch(baseModelEpoch);
-    //fprintf(stderr, "Reverting parameters back to %ls\n", path.c_str());
-    net->RereadPersistableParameters<ElemType>(path);
-
-    double dummyLearnRate;
-    double dummyPrevCriterion;
-    size_t dummyTotalTrainingSamplesSeen; // (not used)
-    size_t dummyMinibatchSize;
-    LoadCheckPointInfo(baseModelEpoch,
-                       /*out*/ dummyTotalTrainingSamplesSeen,
-                       /*out*/ dummyLearnRate,
-                       smoothedGradients,
-                       smoothedCounts,
-                       /*out*/ dummyPrevCriterion,
-                       /*out*/ dummyMinibatchSize);
+    // go back to where we came from (device-to-device copies rather than rereading the model and checkpoint files)
+    snapshot.Restore(smoothedGradients, smoothedCounts);
 }
 
 // Attemps to compute the error signal for the whole utterance, which will
@@ -1940,24 +2407,116 @@ void SGD<ElemType>::AttemptUtteranceDerivativeFeatures(ComputationNetworkPtr net
 }
 
 template <class ElemType>
-void SGD<ElemType>::InitDistGradAgg(int numEvalNodes, int numGradientBits, int traceLevel)
+void SGD<ElemType>::InitDistGradAgg(int numEvalNodes, int numGradientBits, DEVICEID_TYPE deviceId, int traceLevel)
 {
     assert(GetParallelizationMethod() == ParallelizationMethod::dataParallelSGD);
     if (traceLevel > 0)
         fprintf(stderr, "Initializing dataParallelSGD for %d-bit quantization.\n", numGradientBits);
 
+    m_gradHeader.reset(DistGradHeader::Create(numEvalNodes), [](DistGradHeader* ptr) { DistGradHeader::Destroy(ptr); });
+
+    if (m_useHierarchicalAggregation)
+        m_mpi->EnableHierarchicalReduction(traceLevel);
+
+    // Sparsification takes the place of quantization: only the largest gradient entries are sent, in full precision
+    if (m_gradientDensity < 1 || m_gradientThreshold > 0)
+    {
+        if (numGradientBits != (8 * sizeof(ElemType)))
+            InvalidArgument("gradientDensity and gradientThreshold cannot be combined with gradient quantization (gradientBits).");
+        if (m_bufferedAsyncGradientAggregation)
+            InvalidArgument("gradientDensity and gradientThreshold cannot be combined with useBufferedAsyncGradientAggregation.");
+        if (traceLevel > 0)
+            fprintf(stderr, "Aggregating sparsified gradients (density %g, threshold %g).\n", m_gradientDensity, m_gradientThreshold);
+        m_distGradAgg = std::make_shared<SparsifiedDistGradAggregator<ElemType>>(m_mpi, m_gradientDensity, m_gradientThreshold, m_syncStatsTrace, m_gradientBucketSizeInBytes);
+        return;
+    }
+
+    // GPU gradients can be reduced (and quantized) in device memory; otherwise, or if neither NCCL nor a CUDA-aware MPI
+    // is available, fall back to the aggregators that stage the gradients through host buffers
+    if (m_useDeviceGradientAggregation && deviceId != CPUDEVICE)
+    {
+        if (m_bufferedAsyncGradientAggregation)
+            fprintf(stderr, "Device gradient aggregation is not supported with buffered async aggregation, using host aggregation.\n");
+        else
+        {
+            auto deviceDistGradAgg = std::make_shared<DeviceDistGradAggregator<ElemType>>(m_mpi, deviceId, m_syncStatsTrace, numGradientBits, m_zeroThresholdFor1Bit, m_gradientBucketSizeInBytes);
+            if (deviceDistGradAgg->IsSupported())
+            {
+                if (traceLevel > 0)
+                    fprintf(stderr, "Aggregating %sgradients in device memory through %s.\n", deviceDistGradAgg->IsQuantized() ? "quantized " : "", deviceDistGradAgg->BackendName());
+                m_distGradAgg = deviceDistGradAgg;
+                return;
+            }
+            fprintf(stderr, "Device gradient aggregation requested, but neither NCCL (2.7 or later with gradient quantization) nor a CUDA-aware MPI is available, using host aggregation.\n");
+        }
+    }
+
 #ifdef CNTK_PARALLEL_TRAINING_SUPPORT
     m_distGradAgg = std::make_shared<AllReduceDistGradAggregator<ElemType>>(m_mpi, numGradientBits, m_zeroThresholdFor1Bit, true /*useQuantizationForSelfStripe*/, m_bufferedAsyncGradientAggregation, traceLevel, m_syncStatsTrace);
 #else
-    if (numGradientBits != (8 * sizeof(ElemType)))
+    // 16 bits exchange the gradients as half-precision floats, while the model and its update stay in full precision
+    bool useHalfPrecision = (numGradientBits == 16);
+    if (numGradientBits != (8 * sizeof(ElemType)) && !useHalfPrecision)
     {
-        RuntimeError("Gradient quantization is unsupported in CNTK binaries built without quantized gradient aggregation support!");
+        RuntimeError("Gradient quantization is unsupported in CNTK binaries built without quantized gradient aggregation support (except for gradientBits=16, half precision)!");
     }
 
-    m_distGradAgg = std::make_shared<SimpleDistGradAggregator<ElemType>>(m_mpi, m_bufferedAsyncGradientAggregation, m_syncStatsTrace);
+    m_distGradAgg = std::make_shared<SimpleDistGradAggregator<ElemType>>(m_mpi, m_bufferedAsyncGradientAggregation, m_syncStatsTrace, m_gradientBucketSizeInBytes, useHalfPrecision);
 #endif // !CNTK_PARALLEL_TRAINING_SUPPORT
+}
 
-    m_gradHeader.reset(DistGradHeader::Create(numEvalNodes), [](DistGradHeader* ptr) { DistGradHeader::Destroy(ptr); });
+// InitDeviceReplicas() - load a replica of the network onto each of m_replicaDeviceIds, see DeviceReplicas
+template <class ElemType>
+void SGD<ElemType>::InitDeviceReplicas(const ComputationNetworkPtr& net, const ComputationNodeBasePtr& criterionNode, const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                                       const std::list<ComputationNodeBasePtr>& learnableNodes, const StreamMinibatchInputs& inputMatrices)
+{
+    if (net->GetDeviceId() == CPUDEVICE)
+        InvalidArgument("replicaDeviceIds: The network must be on a GPU.");
+    if (GetParallelizationMethod() != ParallelizationMethod::none)
+        InvalidArgument("replicaDeviceIds cannot be combined with parallelTrain.");
+    if (m_numSubminiBatches > 1 || m_maxSamplesInRAM < SIZE_MAX || m_autoSubminibatchesMemoryFraction > 0)
+        InvalidArgument("replicaDeviceIds cannot be combined with sub-minibatches (numSubminibatches, maxSamplesInRAM, autoSubminibatchesMemoryFraction).");
+    if (m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL)
+        InvalidArgument("replicaDeviceIds cannot be combined with KL-regularized adaptation.");
+    if (criterionNode->OperationName() == L"SequenceWithSoftmax")
+        InvalidArgument("replicaDeviceIds cannot be combined with sequence training.");
+
+    set<DEVICEID_TYPE> deviceIds = { net->GetDeviceId() };
+    for (size_t i = 0; i < m_replicaDeviceIds.size(); i++)
+    {
+        if (m_replicaDeviceIds[i] < 0 || !deviceIds.insert((DEVICEID_TYPE) m_replicaDeviceIds[i]).second)
+            InvalidArgument("replicaDeviceIds: %d is not a GPU, or used twice (the network is on GPU %d).", m_replicaDeviceIds[i], (int) net->GetDeviceId());
+    }
+
+    // The replicas are loaded from a model file, so that every node is constructed on its device.
+    wstring replicaModelFileName = m_modelPath + L".replica";
+    net->Save(replicaModelFileName);
+    vector<ComputationNetworkPtr> replicaNets;
+    for (size_t i = 0; i < m_replicaDeviceIds.size(); i++)
+    {
+        auto replicaNet = ComputationNetwork::CreateFromFile<ElemType>((DEVICEID_TYPE) m_replicaDeviceIds[i], replicaModelFileName);
+        auto replicaCriterionNode = replicaNet->GetNodeFromName(criterionNode->NodeName());
+        vector<ComputationNodeBasePtr> replicaEvaluationNodes;
+        for (const auto& node : evaluationNodes)
+            replicaEvaluationNodes.push_back(replicaNet->GetNodeFromName(node->NodeName()));
+
+        // set up like the network in TrainOrAdaptModel()
+        ComputationNetwork::SetMaxTempMemSizeForCNN(replicaNet, replicaCriterionNode, m_maxTempMemSizeInSamplesForCNN);
+        replicaNet->SetRecomputeSegments(m_recomputeSegmentLength, m_recomputeCheckpointNodeNames);
+        replicaNet->SetStashCompression(m_stashCompression);
+        replicaNet->AllocateAllMatrices(replicaEvaluationNodes, {}, replicaCriterionNode);
+        replicaNets.push_back(replicaNet);
+    }
+    _wunlink(replicaModelFileName.c_str());
+
+    m_deviceReplicas = make_shared<DeviceReplicas<ElemType>>(net, replicaNets, criterionNode, evaluationNodes, learnableNodes, inputMatrices);
+    if (m_traceLevel > 0)
+    {
+        LOGPRINTF(stderr, "Splitting each minibatch across the network on GPU %d and replicas on GPU", (int) net->GetDeviceId());
+        for (size_t i = 0; i < m_replicaDeviceIds.size(); i++)
+            fprintf(stderr, " %d", m_replicaDeviceIds[i]);
+        fprintf(stderr, ".\n");
+    }
 }
 
 template <class ElemType>
@@ -1969,19 +2528,30 @@ void SGD<ElemType>::InitModelAggregationHandler(int traceLevel, DEVICEID_TYPE de
     }
     if (GetParallelizationMethod() == ParallelizationMethod::modelAveragingSGD)
     {
-        m_pMASGDHelper = make_shared<BasicModelAveragingSGD<ElemType>>(m_mpi, traceLevel, devID);
+        if (m_useAsyncModelAggregation)
+            m_pMASGDHelper = make_shared<AsyncModelAveragingSGD<ElemType>>(m_mpi, traceLevel, devID, /*blockLearningRate =*/ 1.0, /*blockMomentum =*/ 0.0);
+        else
+            m_pMASGDHelper = make_shared<BasicModelAveragingSGD<ElemType>>(m_mpi, traceLevel, devID);
     }
     else if (GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD)
     {
 #ifndef CNTK_PARALLEL_TRAINING_SUPPORT
         RuntimeError("Block Momentum is not supported in the main CNTK repo. You need to enable 1bit submodule.");
 #else
-        m_pMASGDHelper = make_shared<BlockMomentumSGD<ElemType>>(m_mpi, traceLevel, devID, 
-                                                                 m_useNesterovBlockMomentum, m_resetSGDMomentum, 
-                                                                 m_blockLearningRate, m_blockMomentumAsTimeConstant, 
-                                                                 m_modelAggregationBlockSize);
+        if (m_useAsyncModelAggregation)
+            m_pMASGDHelper = make_shared<AsyncModelAveragingSGD<ElemType>>(m_mpi, traceLevel, devID, m_blockLearningRate,
+                                                                          BlockMomentumSGD<double>::TimeConstant2Momentum(m_blockMomentumAsTimeConstant, m_modelAggregationBlockSize));
+        else
+            m_pMASGDHelper = make_shared<BlockMomentumSGD<ElemType>>(m_mpi, traceLevel, devID, 
+                                                                     m_useNesterovBlockMomentum, m_resetSGDMomentum, 
+                                                                     m_blockLearningRate, m_blockMomentumAsTimeConstant, 
+                                                                     m_modelAggregationBlockSize);
 #endif 
     }
+    else if (GetParallelizationMethod() == ParallelizationMethod::parameterServerSGD)
+    {
+        m_pMASGDHelper = make_shared<ParameterServerSGD<ElemType>>(m_mpi, traceLevel, devID, m_maxStaleness);
+    }
 }
 
 // public:
@@ -2028,7 +2598,8 @@ void SGD<ElemType>::UpdateWeights(Matrix<ElemType>& functionValues, Matrix<ElemT
     if (L2RegWeight > 0)
     {
         // multiply by actualMBSize so that it's invariant to minibatch size since learning rate is per sample
-        Matrix<ElemType>::ScaleAndAdd((ElemType)(L2RegWeight * actualMBSize), functionValues, gradientValues);
+        // (a sparse gradient is regularized lazily, only on the columns that the minibatch touched)
+        Matrix<ElemType>::ScaleAndAddToStoredColumns((ElemType)(L2RegWeight * actualMBSize), functionValues, gradientValues);
     }
 
     if (adpType == GradientsUpdateType::None)
@@ -2082,6 +2653,168 @@ void SGD<ElemType>::UpdateWeights(Matrix<ElemType>& functionValues, Matrix<ElemT
 #endif
 }
 
+// UpdateLearnableNodes() - UpdateWeights() of all learnable nodes of a minibatch
+// The dense parameters of a device that share the learning rate and the L2 weight are updated together by one fused kernel
+// (Matrix::MultiTensorUpdate()), which clips the gradient, adds the L2 term, applies the momentum or adaptive step and writes
+// the parameter in a single pass over the tensors. Sparse gradients, noise injection, and FSAdaGrad and RmsProp before their
+// first update (which creates their state) go through UpdateWeights() one parameter at a time.
+// With m_gradientClippingWithGlobalNorm, the gradients are clipped by their joint norm, with one reduction per device.
+template <class ElemType>
+void SGD<ElemType>::UpdateLearnableNodes(const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                         std::list<Matrix<ElemType>>& smoothedGradients, std::vector<double>& smoothedCounts,
+                                         const double learnRatePerSample, const double momentumPerSample,
+                                         size_t actualMBSize,
+                                         const std::unordered_set<ComputationNodeBasePtr>& batchNormalizationWeights) const
+{
+    struct ParameterUpdate
+    {
+        Matrix<ElemType>* value;
+        Matrix<ElemType>* gradient;
+        Matrix<ElemType>* smoothedGradient;
+        double* smoothedCount;
+        double learnRatePerSample;
+        double L2RegWeight;
+    };
+    std::vector<ParameterUpdate> updates;
+    auto smoothedGradientIter = smoothedGradients.begin();
+    auto smoothedCountIter = smoothedCounts.begin();
+    for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++, smoothedCountIter++)
+    {
+        ComputationNodeBasePtr node = *nodeIter;
+        if (!node->IsParameterUpdateRequired())
+            continue;
+        auto valueNode = dynamic_pointer_cast<ComputationNode<ElemType>>(node);
+        // TODO: Check why l2Factor is not applied to L1. Bug?
+        double l2Factor = batchNormalizationWeights.find(node) == batchNormalizationWeights.end() ? 1.0 : 0.0;
+        updates.push_back(ParameterUpdate{ &valueNode->Value(), &valueNode->Gradient(), &*smoothedGradientIter, &*smoothedCountIter,
+                                           learnRatePerSample * node->GetLearningRateMultiplier(), m_L2RegWeight * l2Factor });
+    }
+
+    // the norm over all parameters, for m_gradientClippingWithGlobalNorm (ClipGradient() then leaves the gradients alone)
+    bool clipping = m_clippingThresholdPerSample != std::numeric_limits<double>::infinity();
+    double maxGradientPerMB = m_clippingThresholdPerSample * actualMBSize;
+    double gradientScale = 1;
+    if (clipping && !m_gradientClippingWithTruncation && m_gradientClippingWithGlobalNorm)
+    {
+        std::map<DEVICEID_TYPE, std::vector<const Matrix<ElemType>*>> denseGradients;
+        double sumOfSquares = 0;
+        for (const auto& update : updates)
+        {
+            if (update.gradient->GetMatrixType() == DENSE)
+                denseGradients[update.gradient->GetDeviceId()].push_back(update.gradient);
+            else
+            {
+                double norm = update.gradient->FrobeniusNorm();
+                sumOfSquares += norm * norm;
+            }
+        }
+        for (const auto& deviceGradients : denseGradients)
+            sumOfSquares += Matrix<ElemType>::MultiTensorSumOfSquares(deviceGradients.second);
+
+        double gradientNorm = sqrt(sumOfSquares);
+        if (gradientNorm > maxGradientPerMB)
+            gradientScale = maxGradientPerMB / gradientNorm;
+    }
+
+    // the size of the state of the update rule, which the fused kernel expects to exist (see MultiTensorUpdate.h)
+    GradientsUpdateType adpType = GradUpdateType();
+    size_t smoothedFactor = adpType == GradientsUpdateType::FSAdaGrad ? 2 : adpType == GradientsUpdateType::RmsProp ? 3 : 1;
+    std::vector<bool> done(updates.size(), false);
+    for (size_t k = 0; k < updates.size(); k++)
+    {
+        const auto& update = updates[k];
+        bool fusable = GradientUpdateNoiseStd() == 0 &&
+                       update.value->GetMatrixType() == DENSE && update.gradient->GetMatrixType() == DENSE && update.smoothedGradient->GetMatrixType() == DENSE &&
+                       update.smoothedGradient->GetNumElements() >= smoothedFactor * update.value->GetNumElements();
+        if (fusable)
+            continue;
+
+        if (gradientScale != 1)
+            *update.gradient *= (ElemType) gradientScale;
+        UpdateWeights(*update.value, *update.gradient, *update.smoothedGradient, *update.smoothedCount,
+                      update.learnRatePerSample, momentumPerSample, actualMBSize,
+                      update.L2RegWeight, m_L1RegWeight,
+                      m_needAveMultiplier, m_useNesterovMomentum);
+        done[k] = true;
+    }
+
+    // the scalars of UpdateWeights()
+    const double momentum = MomentumPerMB(momentumPerSample, actualMBSize);
+    const double varMomentum = exp(-1.0 * actualMBSize / m_gradType.varianceTimeConstant);
+    MultiTensorUpdateParams<ElemType> params = {};
+    switch (adpType)
+    {
+    case GradientsUpdateType::None:
+        params.m_kind = m_useNesterovMomentum ? MultiTensorUpdateKind::Nesterov : MultiTensorUpdateKind::MomentumSGD;
+        break;
+    case GradientsUpdateType::AdaGrad:
+        params.m_kind = MultiTensorUpdateKind::AdaGrad;
+        params.m_needAveMultiplier = m_needAveMultiplier;
+        break;
+    case GradientsUpdateType::FSAdaGrad:
+        params.m_kind = MultiTensorUpdateKind::FSAdaGrad;
+        break;
+    case GradientsUpdateType::RmsProp:
+        params.m_kind = MultiTensorUpdateKind::RmsProp;
+        params.m_needAveMultiplier = m_needAveMultiplier;
+        break;
+    default:
+        LogicError("UpdateLearnableNodes: Unexpected gradient update type %d.", (int) adpType);
+    }
+    params.m_momentum = (ElemType) momentum;
+    params.m_varMomentum = (ElemType) varMomentum;
+    params.m_rmsGamma = (ElemType) m_rpi.gamma;
+    params.m_rmsInc = (ElemType) m_rpi.inc;
+    params.m_rmsMax = (ElemType) m_rpi.max;
+    params.m_rmsDec = (ElemType) m_rpi.dec;
+    params.m_rmsMin = (ElemType) m_rpi.min;
+    params.m_gradientScale = (ElemType) gradientScale;
+    params.m_clippingThreshold = clipping && m_gradientClippingWithTruncation ? (ElemType) maxGradientPerMB : std::numeric_limits<ElemType>::infinity();
+
+    // one fused update per device, learning rate and L2 weight
+    for (size_t first = 0; first < updates.size(); first++)
+    {
+        if (done[first])
+            continue;
+
+        const auto& group = updates[first];
+        std::vector<Matrix<ElemType>*> groupSmoothedGradients, groupGradients, groupValues;
+        std::vector<ElemType> adaMuls;
+        for (size_t k = first; k < updates.size(); k++)
+        {
+            const auto& update = updates[k];
+            if (done[k] || update.value->GetDeviceId() != group.value->GetDeviceId() ||
+                update.learnRatePerSample != group.learnRatePerSample || update.L2RegWeight != group.L2RegWeight)
+                continue;
+
+            done[k] = true;
+            if (clipping && !m_gradientClippingWithTruncation && !m_gradientClippingWithGlobalNorm)
+                ClipGradient(*update.gradient, actualMBSize); // (by the norm of this parameter, which is not elementwise)
+            if (adpType == GradientsUpdateType::FSAdaGrad)
+            {
+                // the multiplier that FSAdagradUpdate() computes, and the count it advances
+                *update.smoothedCount = varMomentum * *update.smoothedCount + (1.0 - varMomentum) * actualMBSize;
+                adaMuls.push_back((ElemType) (m_gradType.targetAdagradAvDenom * sqrt(*update.smoothedCount)));
+            }
+            groupSmoothedGradients.push_back(update.smoothedGradient);
+            groupGradients.push_back(update.gradient);
+            groupValues.push_back(update.value);
+        }
+
+        // multiplied by actualMBSize so that it's invariant to minibatch size since learning rate is per sample
+        params.m_learningRate = (ElemType) group.learnRatePerSample;
+        params.m_l2Weight = group.L2RegWeight > 0 ? (ElemType) (group.L2RegWeight * actualMBSize) : 0;
+        Matrix<ElemType>::MultiTensorUpdate(params, groupSmoothedGradients, groupGradients, groupValues, adaMuls, /*checkForNan=*/false);
+
+        // L1 regularizer with proximal gradient descent method, as in UpdateWeights()
+        if (m_L1RegWeight > 0)
+        {
+            for (auto value : groupValues)
+                value->InplaceSoftThreshold((ElemType) (group.learnRatePerSample * m_L1RegWeight * actualMBSize));
+        }
+    }
+}
+
 // protected:
 
 template <class ElemType>
@@ -2092,7 +2825,7 @@ void SGD<ElemType>::ClipGradient(Matrix<ElemType>& gradient, const size_t actual
         double maxGradientPerMB = m_clippingThresholdPerSample * actualMBSize;
         if (m_gradientClippingWithTruncation)
             gradient.InplaceTruncate((ElemType)(maxGradientPerMB));
-        else
+        else if (!m_gradientClippingWithGlobalNorm) // (otherwise UpdateLearnableNodes() has scaled all gradients already)
         {
             // norm2 normalized
             double gradientNorm = gradient.FrobeniusNorm();
@@ -2111,7 +2844,8 @@ void SGD<ElemType>::SaveCheckPointInfo(const size_t epoch, const size_t totalSam
                                        const std::list<Matrix<ElemType>>& smoothedGradients,
                                        const std::vector<double>& smoothedCounts,
                                        const double prevCriterion,
-                                       const size_t minibatchSize)
+                                       const size_t minibatchSize,
+                                       bool sync)
 {
     // In case of parallel training only the main node should we saving the checkpoint to prevent
     // the parallel training nodes from colliding to write the same file
@@ -2137,6 +2871,10 @@ void SGD<ElemType>::SaveCheckPointInfo(const size_t epoch, const size_t totalSam
             fstream << minibatchSize;
             fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EMinibatchSize");
 
+            fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BNumWorkers");
+            fstream << (size_t) (m_mpi != nullptr ? m_mpi->NumNodesInUse() : 1);
+            fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ENumWorkers");
+
             fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BGradient");
 
             for (auto smoothedGradientIter = smoothedGradients.begin(); smoothedGradientIter != smoothedGradients.end(); smoothedGradientIter++)
@@ -2158,7 +2896,10 @@ void SGD<ElemType>::SaveCheckPointInfo(const size_t epoch, const size_t totalSam
             if (m_pMASGDHelper)
                 m_pMASGDHelper->SaveToCheckPoint(fstream);
             // Ensuring that data is written
-            fstream.Flush();
+            if (sync)
+                fstream.Sync();
+            else
+                fstream.Flush();
         }
 
         _wunlink(checkPointFileName.c_str());
@@ -2166,6 +2907,142 @@ void SGD<ElemType>::SaveCheckPointInfo(const size_t epoch, const size_t totalSam
     }
 }
 
+// Save the model and the checkpoint info of an epoch on a background thread, while training goes on.
+// The training thread only waits for copies of the parameters and smoothed gradients on the CPU (and for the
+// previous checkpoint, if it is still being written). The two files are then written concurrently and synced to
+// the disk, and only after that are the older 'filesToDelete' removed, so that a complete checkpoint always exists.
+// Errors are reported by the next SaveCheckpointAsync() or WaitForCheckpointFiles().
+template <class ElemType>
+void SGD<ElemType>::SaveCheckpointAsync(const ComputationNetworkPtr& net, const size_t epoch, const size_t totalSamplesSeen,
+                                        const double learnRatePerSample,
+                                        const std::list<Matrix<ElemType>>& smoothedGradients,
+                                        const std::vector<double>& smoothedCounts,
+                                        const double prevCriterion,
+                                        const size_t minibatchSize,
+                                        const std::vector<std::wstring>& filesToDelete)
+{
+    if (m_pendingCheckpoint.valid())
+        m_pendingCheckpoint.get();
+
+    auto modelSnapshot = net->CloneModelValuesToCPU();
+    auto gradientsSnapshot = make_shared<list<Matrix<ElemType>>>();
+    for (const auto& smoothedGradient : smoothedGradients)
+    {
+        if (smoothedGradient.GetMatrixType() == DENSE)
+        {
+            gradientsSnapshot->emplace_back(CPUDEVICE);
+            gradientsSnapshot->back().AssignValuesOf(smoothedGradient);
+        }
+        else // (sparse matrices cannot be written from the CPU)
+        {
+            gradientsSnapshot->emplace_back(smoothedGradient.GetDeviceId());
+            gradientsSnapshot->back().SetValue(smoothedGradient);
+        }
+    }
+
+    auto modelName = GetModelNameForEpoch(int(epoch));
+    if (m_traceLevel > 0)
+        LOGPRINTF(stderr, "SGD: Saving checkpoint model '%ls' in the background\n", modelName.c_str());
+    m_pendingCheckpoint = async(launch::async, [=]()
+    {
+        auto checkPointInfo = async(launch::async, [=]()
+        {
+            SaveCheckPointInfo(epoch, totalSamplesSeen, learnRatePerSample, *gradientsSnapshot, smoothedCounts, prevCriterion, minibatchSize, /*sync=*/true);
+        });
+        modelSnapshot->Save(modelName, FileOptions::fileOptionsBinary, /*sync=*/true);
+        checkPointInfo.get();
+        for (const auto& file : filesToDelete)
+            _wunlink(file.c_str());
+    });
+}
+
+// Evaluate the parameters at the end of 'epoch' on the validation set on a background thread, while training goes on.
+// They are copied into a network of its own, loaded once from a model file onto m_asyncCrossValidationDeviceId, whose
+// evaluation runs on a compute stream of its own. Copying on the stream of the training, before the next minibatch
+// updates the parameters, is all the training thread waits for. The result is logged by the background thread as soon as
+// it is there, and returned by WaitForCrossValidation().
+template <class ElemType>
+void SGD<ElemType>::StartCrossValidationAsync(const ComputationNetworkPtr& net, const int epoch, IDataReader* validationSetDataReader,
+                                              const std::vector<std::wstring>& nodeNames, const size_t mbSize)
+{
+    if (m_pendingCrossValidation.valid())
+        LogicError("StartCrossValidationAsync: The evaluation of the previous epoch is still running.");
+
+    if (!m_crossValidationNet)
+    {
+        DEVICEID_TYPE deviceId = m_asyncCrossValidationDeviceId == DEVICEID_NOTYETDETERMINED ? net->GetDeviceId() : (DEVICEID_TYPE) m_asyncCrossValidationDeviceId;
+        wstring modelFileName = m_modelPath + L".cv";
+        net->Save(modelFileName);
+        m_crossValidationNet = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelFileName);
+        _wunlink(modelFileName.c_str());
+        if (!nodeNames.empty()) // set up like the network in TrainOrAdaptModel()
+            ComputationNetwork::SetMaxTempMemSizeForCNN(m_crossValidationNet, m_crossValidationNet->GetNodeFromName(nodeNames[0]), m_maxTempMemSizeInSamplesForCNN);
+        if (m_traceLevel > 0)
+            LOGPRINTF(stderr, "SGD: Evaluating the validation set in the background, on %s.\n", deviceId == CPUDEVICE ? "the CPU" : ("GPU " + to_string(deviceId)).c_str());
+    }
+    else
+    {
+        // the model values and the sample counts of batch normalization, as kept by ParameterSnapshot
+        for (const auto& node : net->GetAllNodes())
+        {
+            auto cvNode = dynamic_pointer_cast<ComputationNode<ElemType>>(m_crossValidationNet->GetNodeFromName(node->NodeName()));
+            if (auto batchNormalizationNode = dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(node))
+                dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(cvNode)->SetSamplesSeen(batchNormalizationNode->SamplesSeen());
+
+            auto valueNode = dynamic_pointer_cast<ComputationNode<ElemType>>(node);
+            if (!valueNode || !node->IsModelValue() || !valueNode->ValuePtr())
+                continue;
+            cvNode->Value().AssignValuesOf(valueNode->Value());
+            cvNode->BumpEvalTimeStamp();
+        }
+    }
+
+    auto cvNet = m_crossValidationNet;
+    m_pendingCrossValidation = async(launch::async, [=]()
+    {
+        unique_ptr<MatrixComputeStream> stream(MatrixComputeStream::Create(cvNet->GetDeviceId()));
+        stream->Begin();
+        auto endStream = MakeScopeExit([&]() { stream->End(); });
+        // (not distributed: parallelTrain is rejected, and the MPI calls of the training thread must not interleave with others)
+        SimpleEvaluator<ElemType> evalforvalidation(cvNet, nullptr, false, 100, 0, 0, /*maxSamplesInRAM =*/ m_maxSamplesInRAM);
+        auto vScore = evalforvalidation.Evaluate(validationSetDataReader, nodeNames, mbSize);
+        LogCrossValidation(epoch, nodeNames, vScore);
+        return vScore;
+    });
+}
+
+// the result of the evaluation of StartCrossValidationAsync(), once it is complete; false if none was started since the start
+// of training or the last call. Errors of the evaluation are thrown here.
+template <class ElemType>
+bool SGD<ElemType>::WaitForCrossValidation(/*out*/ std::vector<EpochCriterion>& result)
+{
+    if (!m_pendingCrossValidation.valid())
+        return false;
+    result = m_pendingCrossValidation.get();
+    return true;
+}
+
+template <class ElemType>
+void SGD<ElemType>::LogCrossValidation(const int epoch, const std::vector<std::wstring>& nodeNames, const std::vector<EpochCriterion>& result) const
+{
+    LOGPRINTF(stderr, "Finished Epoch[%2d of %d]: [Validate] ", epoch + 1, (int) m_maxEpochs);
+    for (size_t k = 0; k < result.size(); k++)
+        result[k].LogCriterion(nodeNames[k], /*addSemicolon=*/k + 1 < result.size());
+    fprintf(stderr, "\n");
+}
+
+// wait until the files of SaveCheckpointAsync() are complete, including on the other ranks, which must call this as well
+template <class ElemType>
+void SGD<ElemType>::WaitForCheckpointFiles()
+{
+    if (!m_asyncCheckpoint)
+        return;
+    if (m_pendingCheckpoint.valid())
+        m_pendingCheckpoint.get();
+    if (m_mpi != nullptr)
+        m_mpi->WaitAll();
+}
+
 template <class ElemType>
 bool SGD<ElemType>::TryLoadCheckPointInfo(const size_t epochNumber,
                                           /*out*/ size_t& totalSamplesSeen,
@@ -2179,7 +3056,7 @@ bool SGD<ElemType>::TryLoadCheckPointInfo(const size_t epochNumber,
     // This means a user wanted to continue training from an older model, but that model had no checkpoint info anymore.
     // This is valid, we just don't get the features that require previous models, such as LR or MBSize control.
     let checkPointFileName = GetCheckPointFileNameForEpoch(int(epochNumber));
-    if (!fexists(checkPointFileName.c_str()))
+    if (!fexists(checkPointFileName.c_str()) && !IsIncrementalCheckpoint(int(epochNumber)))
     {
         // initialize as if nothing
         totalSamplesSeen = 0;
@@ -2204,6 +3081,17 @@ void SGD<ElemType>::LoadCheckPointInfo(const size_t epochNumber,
                                        /*out*/ double& prevCriterion,
                                        /*out*/ size_t& minibatchSize)
 {
+    if (IsIncrementalCheckpoint(int(epochNumber)))
+    {
+        let deltaFileName = GetDeltaFileNameForEpoch(int(epochNumber));
+        int baseEpoch = IncrementalCheckpoint<ElemType>::ReadBaseEpoch(deltaFileName);
+        LoadCheckPointInfo(baseEpoch, totalSamplesSeen, learnRatePerSample, smoothedGradients, smoothedCounts, prevCriterion, minibatchSize);
+        size_t numWorkers;
+        IncrementalCheckpoint<ElemType>::ApplyTrainingState(deltaFileName, smoothedGradients, smoothedCounts,
+                                                            totalSamplesSeen, learnRatePerSample, prevCriterion, minibatchSize, numWorkers);
+        return;
+    }
+
     let checkPointFileName = GetCheckPointFileNameForEpoch(int(epochNumber));
     //fprintf(stderr, "Loading checkpoint info from %ls\n", checkPointFileName.c_str());
     File fstream(checkPointFileName,
@@ -2233,6 +3121,19 @@ void SGD<ElemType>::LoadCheckPointInfo(const size_t epochNumber,
         minibatchSize = m_mbSize[epochNumber];
     }
 
+    if (ckpVersion >= CNTK_CHECKPOINT_VERSION_3)
+    {
+        size_t numWorkers;
+        fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BNumWorkers");
+        fstream >> numWorkers;
+        fstream.GetMarker(FileMarker::fileMarkerEndSection, L"ENumWorkers");
+
+        size_t currentNumWorkers = m_mpi != nullptr ? m_mpi->NumNodesInUse() : 1;
+        if (numWorkers != currentNumWorkers)
+            LOGPRINTF(stderr, "Resuming the training of %d workers with %d workers; the data is split among the %d workers from here on.\n",
+                      (int) numWorkers, (int) currentNumWorkers, (int) currentNumWorkers);
+    }
+
     fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BGradient");
 
     for (auto smoothedGradientIter = smoothedGradients.begin(); smoothedGradientIter != smoothedGradients.end(); smoothedGradientIter++)
@@ -2261,12 +3162,97 @@ void SGD<ElemType>::LoadCheckPointInfo(const size_t epochNumber,
     return;
 }
 
+// Sets the values of the model-value nodes among 'nodes', the smoothed gradients and counts, and the counters of the
+// checkpoint on all ranks to those of the main node. All ranks must call this with the same nodes.
+template <class ElemType>
+void SGD<ElemType>::BroadcastTrainingState(const std::list<ComputationNodeBasePtr>& nodes,
+                                           std::list<Matrix<ElemType>>& smoothedGradients,
+                                           std::vector<double>& smoothedCounts,
+                                           /*in/out*/ size_t& totalSamplesSeen,
+                                           /*in/out*/ double& learnRatePerSample,
+                                           /*in/out*/ double& prevCriterion,
+                                           /*in/out*/ size_t& minibatchSize,
+                                           /*in/out*/ bool& learnRateInitialized)
+{
+    // (dense matrices only, through a buffer on the CPU)
+    Matrix<ElemType> buffer(CPUDEVICE);
+    auto broadcast = [&](Matrix<ElemType>& matrix)
+    {
+        if (matrix.GetMatrixType() != DENSE)
+            LogicError("BroadcastTrainingState: Only dense matrices are supported.");
+        buffer.AssignValuesOf(matrix);
+        m_mpi->Bcast(buffer.Data(), buffer.GetNumElements(), m_mpi->MainNodeRank());
+        matrix.AssignValuesOf(buffer);
+    };
+
+    for (const auto& node : nodes)
+    {
+        auto valueNode = dynamic_pointer_cast<ComputationNode<ElemType>>(node);
+        if (!valueNode || !node->IsModelValue() || !valueNode->ValuePtr())
+            continue;
+        broadcast(valueNode->Value());
+        node->BumpEvalTimeStamp();
+    }
+    for (auto& smoothedGradient : smoothedGradients)
+        broadcast(smoothedGradient);
+
+    std::vector<double> values = { (double) totalSamplesSeen, learnRatePerSample, prevCriterion, (double) minibatchSize, learnRateInitialized ? 1.0 : 0.0 };
+    values.insert(values.end(), smoothedCounts.begin(), smoothedCounts.end());
+    m_mpi->Bcast(values.data(), values.size(), m_mpi->MainNodeRank());
+    totalSamplesSeen = (size_t) values[0];
+    learnRatePerSample = values[1];
+    prevCriterion = values[2];
+    minibatchSize = (size_t) values[3];
+    learnRateInitialized = values[4] != 0;
+    std::copy(values.begin() + 5, values.end(), smoothedCounts.begin());
+}
+
 template <class ElemType>
 wstring SGD<ElemType>::GetCheckPointFileNameForEpoch(const int epoch)
 {
     return GetModelNameForEpoch(epoch) + L".ckp";
 }
 
+template <class ElemType>
+wstring SGD<ElemType>::GetDeltaFileNameForEpoch(const int epoch)
+{
+    return GetModelNameForEpoch(epoch) + L".delta";
+}
+
+template <class ElemType>
+bool SGD<ElemType>::IsIncrementalCheckpoint(const int epoch)
+{
+    return !fexists(GetModelNameForEpoch(epoch).c_str()) && fexists(GetDeltaFileNameForEpoch(epoch).c_str());
+}
+
+template <class ElemType>
+ComputationNetworkPtr SGD<ElemType>::LoadNetworkForEpoch(DEVICEID_TYPE deviceId, const int epoch)
+{
+    if (!IsIncrementalCheckpoint(epoch))
+        return ComputationNetwork::CreateFromFile<ElemType>(deviceId, GetModelNameForEpoch(epoch));
+
+    let deltaFileName = GetDeltaFileNameForEpoch(epoch);
+    int baseEpoch = IncrementalCheckpoint<ElemType>::ReadBaseEpoch(deltaFileName);
+    LOGPRINTF(stderr, "Loading the incremental checkpoint '%ls' onto the model of epoch %d.\n", deltaFileName.c_str(), baseEpoch + 1);
+    auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, GetModelNameForEpoch(baseEpoch));
+    IncrementalCheckpoint<ElemType>::ApplyModelValues(deltaFileName, net);
+    return net;
+}
+
+template <class ElemType>
+void SGD<ElemType>::RereadPersistableParametersForEpoch(const ComputationNetworkPtr& net, const int epoch)
+{
+    if (!IsIncrementalCheckpoint(epoch))
+    {
+        net->RereadPersistableParameters<ElemType>(GetModelNameForEpoch(epoch));
+        return;
+    }
+
+    let deltaFileName = GetDeltaFileNameForEpoch(epoch);
+    net->RereadPersistableParameters<ElemType>(GetModelNameForEpoch(IncrementalCheckpoint<ElemType>::ReadBaseEpoch(deltaFileName)));
+    IncrementalCheckpoint<ElemType>::ApplyModelValues(deltaFileName, net);
+}
+
 template <class ElemType>
 wstring SGD<ElemType>::GetModelNameForEpoch(const int epoch, bool bLastModel)
 {
@@ -2294,10 +3280,15 @@ int SGD<ElemType>::DetermineStartEpoch(const bool makeMode)
 
     int firstEpoch = -1;
 
-    wstring curEpochFile = GetModelNameForEpoch(int(m_maxEpochs) - 1);
+    // (the checkpoint of an epoch is either its model file or its delta file, see IncrementalCheckpoint)
+    auto checkPointModelFile = [this](int epoch)
+    {
+        return IsIncrementalCheckpoint(epoch) ? GetDeltaFileNameForEpoch(epoch) : GetModelNameForEpoch(epoch);
+    };
+    wstring curEpochFile = checkPointModelFile(int(m_maxEpochs) - 1);
     for (int e = int(m_maxEpochs) - 1; e >= -1; e--)
     {
-        const wstring prevEpochFile = GetModelNameForEpoch(e - 1);
+        const wstring prevEpochFile = checkPointModelFile(e - 1);
 
         if (msra::files::fuptodate(curEpochFile, prevEpochFile, false))
         {
@@ -2456,7 +3447,8 @@ static ParallelizationMethod ParseParallelizationMethod(const wstring& s)
     else if (EqualCI(s, L"DataParallelSGD"))         return ParallelizationMethod::dataParallelSGD;
     else if (EqualCI(s, L"ModelAveragingSGD"))       return ParallelizationMethod::modelAveragingSGD;
     else if (EqualCI(s, L"BlockMomentumSGD"))        return ParallelizationMethod::blockMomentumSGD;
-    else InvalidArgument("ParseParallelizationMethod: Invalid Parallelization Method. Valid values are (none | DataParallelSGD | ModelAveragingSGD | BlockMomentumSGD)");
+    else if (EqualCI(s, L"ParameterServerSGD"))      return ParallelizationMethod::parameterServerSGD;
+    else InvalidArgument("ParseParallelizationMethod: Invalid Parallelization Method. Valid values are (none | DataParallelSGD | ModelAveragingSGD | BlockMomentumSGD | ParameterServerSGD)");
 }
 
 static LearningRateSearchAlgorithm ParseLearningRateSearchType(const wstring& s)
@@ -2511,9 +3503,13 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     //       mbSize = total number of samples after which a model update should happen
     //       truncated = truncation length
     m_mbSize = configSGD(L"minibatchSize", ConfigRecordType::Array(intargvector(vector<int>{256})));
+    m_mbSizeCV = configSGD(L"cvMinibatchSize", ConfigRecordType::Array(intargvector(vector<int>{0})));
     m_truncated = configSGD(L"truncated", false);
     m_maxSamplesInRAM = configSGD(L"maxSamplesInRAM", (size_t) SIZE_MAX);
     m_numSubminiBatches = configSGD(L"numSubminibatches", (size_t) 1);
+    m_autoSubminibatchesMemoryFraction = configSGD(L"autoSubminibatchesMemoryFraction", 0.0);
+    if (m_autoSubminibatchesMemoryFraction < 0 || m_autoSubminibatchesMemoryFraction > 1)
+        InvalidArgument("autoSubminibatchesMemoryFraction must be in [0, 1].");
 
     // the number of samples in each epoch (0 means, use all the samples in each epoch).
     m_epochSize = configSGD(L"epochSize", (size_t) 0);
@@ -2541,9 +3537,19 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_numMBsToShowResult = configSGD(L"numMBsToShowResult", (size_t)10);
     m_firstMBsToShowResult = configSGD(L"firstMBsToShowResult", (size_t)0);
     m_numMBsToCUDAProfile = configSGD(L"numMBsToCUDAProfile", (size_t)0);
+    m_numMBsToMemoryProfile = configSGD(L"numMBsToMemoryProfile", (size_t)0);
+    m_useGPUGraphs = configSGD(L"useGPUGraphs", false);
+    m_memoryProfileFile = (wstring) configSGD(L"memoryProfileFile", L"MemoryProfile.json");
+    m_timingProfile = configSGD(L"timingProfile", false);
+    m_numMBsToTimingTrace = configSGD(L"numMBsToTimingTrace", (size_t)20);
+    m_timingTraceFile = (wstring) configSGD(L"timingTraceFile", L"TimingProfile.json");
+    m_telemetryFile = (wstring) configSGD(L"telemetryFile", L"");
 
     m_gradientClippingWithTruncation = configSGD(L"gradientClippingWithTruncation", true);
+    m_gradientClippingWithGlobalNorm = configSGD(L"gradientClippingWithGlobalNorm", false);
     m_clippingThresholdPerSample = configSGD(L"clippingThresholdPerSample", numeric_limits<double>::infinity());
+    if (m_gradientClippingWithGlobalNorm && m_gradientClippingWithTruncation)
+        InvalidArgument("gradientClippingWithGlobalNorm requires gradientClippingWithTruncation=false.");
 
     // sequence-training parameters
     m_hSmoothingWeight = configSGD(L"hSmoothingWeight", 0.95);
@@ -2558,6 +3564,7 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_disableWkInBatchNormal = configSGD(L"disableWkInBatchNormal", false);
 
     m_dropoutRates = configSGD(L"dropoutRate", ConfigRecordType::Array(doubleargvector(vector<double>{0.0})));
+    m_statelessDropout = configSGD(L"statelessDropout", false);
     m_batchNormalizationTimeConstant = configSGD(L"batchNormalizationTimeConstant", ConfigRecordType::Array(doubleargvector(vector<double>{0})));
     m_batchNormalizationBlendTimeConstant = configSGD(L"batchNormalizationBlendTimeConstant", ConfigRecordType::Array(doubleargvector(vector<double>{0})));
 
@@ -2597,6 +3604,10 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     }
 
     m_useAllDataForPreComputedNode = configSGD(L"UseAllDataForPreComputedNode", true);
+    m_preComputeDecimation = configSGD(L"preComputeDecimation", (size_t) 1);
+    m_preComputeCacheFile = (wstring) configSGD(L"preComputeCacheFile", L"");
+    if (m_preComputeDecimation == 0)
+        InvalidArgument("preComputeDecimation must be at least 1.");
 
     // consistency checks
     for (size_t i = 0; i < m_mbSize.size(); i++)
@@ -2701,9 +3712,20 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_numGradientBits = vector<int>{8 * (int)sizeofElemType}; // means no quantization
     m_zeroThresholdFor1Bit = true;
     m_bufferedAsyncGradientAggregation = false;
+    m_gradientBucketSizeInBytes = 0;
+    m_useDeviceGradientAggregation = false;
+    m_useHierarchicalAggregation = false;
+    m_gradientDensity = 1;
+    m_gradientThreshold = 0;
+    m_stragglerDetection = false;
+    m_stragglerThreshold = 1.25;
+    m_stragglerMinExchanges = 50;
+    m_stragglerRebalance = false;
     m_enableDistributedMBReading = false;
     m_parallelizationStartEpochNum = 0;
     m_modelAggregationBlockSize = 0; 
+    m_useAsyncModelAggregation = false;
+    m_maxStaleness = 4;
 
     if (configSGD.Exists(L"ParallelTrain"))
     {
@@ -2726,6 +3748,14 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
         m_enableDistributedMBReadingNotSpecified = !configParallelTrain.Exists(L"distributedMBReading");
         m_enableDistributedMBReading = configParallelTrain(L"distributedMBReading", false);
         m_syncStatsTrace = configParallelTrain(L"syncPerfStats", (int) 0);
+        m_stragglerDetection = configParallelTrain(L"stragglerDetection", false);
+        m_stragglerThreshold = configParallelTrain(L"stragglerThreshold", 1.25);
+        m_stragglerMinExchanges = configParallelTrain(L"stragglerMinExchanges", (size_t) 50);
+        m_stragglerRebalance = configParallelTrain(L"stragglerRebalance", false);
+        if (m_stragglerDetection && !(m_stragglerThreshold > 1))
+            InvalidArgument("stragglerThreshold must be greater than 1.");
+        if (m_stragglerRebalance && !m_stragglerDetection)
+            InvalidArgument("stragglerRebalance requires stragglerDetection.");
 
         if (configParallelTrain.Exists(L"DataParallelSGD"))
         {
@@ -2734,11 +3764,20 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
             m_numGradientBits = configDataParallelSGD(L"gradientBits", ConfigRecordType::Array(intargvector(vector<int>{defaultGradientBits})));
             m_zeroThresholdFor1Bit = configDataParallelSGD(L"useZeroThresholdFor1BitQuantization", true);
             m_bufferedAsyncGradientAggregation = configDataParallelSGD(L"useBufferedAsyncGradientAggregation", false);
+            m_gradientBucketSizeInBytes = (size_t)(configDataParallelSGD(L"gradientBucketSizeInMB", 25.0) * 1024 * 1024);
+            m_useDeviceGradientAggregation = configDataParallelSGD(L"useDeviceGradientAggregation", false);
+            m_useHierarchicalAggregation = configDataParallelSGD(L"useHierarchicalAggregation", false);
+            m_gradientDensity = configDataParallelSGD(L"gradientDensity", 1.0);
+            m_gradientThreshold = configDataParallelSGD(L"gradientThreshold", 0.0);
             for (size_t i = 0; i < m_numGradientBits.size(); i++)
             {
                 if (m_numGradientBits[i] < 1 || m_numGradientBits[i] > defaultGradientBits)
                     InvalidArgument("gradientBits values must be in the range [1, 32] when using precision=float and in range [1, 64] when using precision=double.");
             }
+            if (!(m_gradientDensity > 0 && m_gradientDensity <= 1))
+                InvalidArgument("gradientDensity must be in the range (0, 1].");
+            if (!(m_gradientThreshold >= 0))
+                InvalidArgument("gradientThreshold must not be negative.");
         }
         if (configParallelTrain.Exists(L"ModelAveragingSGD"))
         {
@@ -2772,6 +3811,23 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
                     fprintf(stderr, "WARNING: option syncPeroid in ModelAveragingSGD is going to be deprecated. Please use blockSizePerWorker instead in the future.\n");
             }
 #endif
+            m_useAsyncModelAggregation = configMASGD(L"useAsyncModelAggregation", false);
+        }
+        if (configParallelTrain.Exists(L"ParameterServerSGD"))
+        {
+            const ConfigRecordType& configPSSGD(configParallelTrain(L"ParameterServerSGD", ConfigRecordType::Record()));
+            if (configPSSGD.Exists(L"blockSizePerWorker") && configPSSGD.Exists(L"blockSize"))
+                InvalidArgument("It is only allowed to set blockSizePerWorker or blockSize, not both of them");
+            else if (configPSSGD.Exists(L"blockSize"))
+                m_modelAggregationBlockSize = configPSSGD(L"blockSize");
+            else if (configPSSGD.Exists(L"blockSizePerWorker"))
+            {
+                m_modelAggregationBlockSize = configPSSGD(L"blockSizePerWorker");
+                m_modelAggregationBlockSize *= numMPIWorkers;
+            }
+            else
+                m_modelAggregationBlockSize = 40000 * numMPIWorkers; // default value
+            m_maxStaleness = configPSSGD(L"maxStaleness", (size_t)4);
         }
         if (configParallelTrain.Exists(L"BlockMomentumSGD"))
         {
@@ -2803,6 +3859,7 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
             m_resetSGDMomentum = configBMSGD(L"resetSGDMomentum", true);
             m_useNesterovBlockMomentum = configBMSGD(L"useNesterovMomentum", true);
             m_blockLearningRate = configBMSGD(L"blockLearningRate", 1.0); 
+            m_useAsyncModelAggregation = configBMSGD(L"useAsyncModelAggregation", false);
 
             if (configBMSGD.Exists(L"blockMomentumPerSync") && configBMSGD.Exists(L"blockMomentumAsTimeConstant"))
             {
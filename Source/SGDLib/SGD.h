@@ -16,15 +16,19 @@
 #include "fileutil.h"
 #include "Config.h"
 #include <chrono>
+#include <future>
 #include <random>
+#include <unordered_set>
 #include "Profiler.h"
 #include "MASGD.h"
+#include "IncrementalCheckpoint.h"
 
 using namespace std; // ugh! TODO: get rid of this from .h files!!!
 
 #define CNTK_CHECKPOINT_VERSION_1 1     // 1 -> no version number 
 #define CNTK_CHECKPOINT_VERSION_2 2      
-#define CURRENT_CNTK_CHECKPOINT_VERSION CNTK_CHECKPOINT_VERSION_2
+#define CNTK_CHECKPOINT_VERSION_3 3     // 3 -> number of workers that wrote it
+#define CURRENT_CNTK_CHECKPOINT_VERSION CNTK_CHECKPOINT_VERSION_3
 
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -50,8 +54,8 @@ enum class GradientsUpdateType : int
     FSAdaGrad
 };
 
-// modelParallelSGD can be combined with dataParallelSGD/modelAveragingSGD/blockMomentumSGD 
-// but dataParallelSGD/modelAveragingSGD/blockMomentumSGD are mutually exclusive (at least at the moment)
+// modelParallelSGD can be combined with dataParallelSGD/modelAveragingSGD/blockMomentumSGD/parameterServerSGD
+// but dataParallelSGD/modelAveragingSGD/blockMomentumSGD/parameterServerSGD are mutually exclusive (at least at the moment)
 // we assign the lower 8 bits to the enumerate data parallelization methods 
 // and next 8 bits to model parallelization methods
 enum class ParallelizationMethod : int
@@ -60,6 +64,7 @@ enum class ParallelizationMethod : int
     dataParallelSGD = 1,
     modelAveragingSGD = 2,
     blockMomentumSGD = 3,
+    parameterServerSGD = 4,
     modelParallelSGD = (1 << 8) // Currently unsupported
 };
 
@@ -168,6 +173,7 @@ protected:
     // bool m_needToNormalizeMomentumByParallUtterance;
 
     intargvector m_mbSize;
+    intargvector m_mbSizeCV; // of the evaluation on the validation set per epoch (0: m_mbSize); keeps no gradients, so may be larger
     bool m_truncated; // do BPTT
     // BUGBUG: The 'Truncated' option is duplicated in the reader and must be set to the same there (e.g. by defining in the config on an outer enclosing level, like current samples).
     //         We really should only read it in SGD and pass it ourselves on to the Reader, instead of it being a Reader parameter.
@@ -185,6 +191,9 @@ protected:
     // default is 1, which means no subminibatch is used
     // if m_maxTempMemSizeInSamples = SIZE_MAX (which means users do not specify the option) and m_numSubminiBatches > 1
     // we divide one minibatch to m_numSubminiBatches subMinibatches
+    double m_autoSubminibatchesMemoryFraction;
+    // if > 0 and neither of the above is specified, the split is derived for each minibatch instead, from the memory plan of the
+    // network and this fraction of the free GPU memory (see DataReaderHelpers::GetNumSubminibatchesToFit()); default 0 is off
 
     // the number of samples in each epoch (0 means, use all the samples in each epoch).
     size_t m_epochSize;
@@ -194,6 +203,7 @@ protected:
     size_t m_maxEpochs;
 
     bool m_gradientClippingWithTruncation;
+    bool m_gradientClippingWithGlobalNorm; // clip by the norm over all parameters rather than that of each parameter
     double m_clippingThresholdPerSample;
 
     intargvector m_numMiniBatch4LRSearch;
@@ -224,6 +234,7 @@ protected:
     size_t m_minibatchSizeTuningMax;
 
     doubleargvector m_dropoutRates;
+    bool m_statelessDropout; // regenerate the dropout masks in backprop from a counter-based RNG instead of storing them
     doubleargvector m_batchNormalizationTimeConstant;
     doubleargvector m_batchNormalizationBlendTimeConstant;
     size_t m_maxTempMemSizeInSamplesForCNN;
@@ -240,6 +251,13 @@ protected:
     size_t m_numMBsToShowResult = 0;
     size_t m_firstMBsToShowResult = 0;
     int m_numMBsToCUDAProfile;
+    size_t m_numMBsToMemoryProfile; // see MemoryProfiler
+    bool m_useGPUGraphs;            // see GPUGraphStep
+    std::wstring m_memoryProfileFile;
+    bool m_timingProfile; // see TimingProfiler
+    size_t m_numMBsToTimingTrace;
+    std::wstring m_timingTraceFile;
+    std::wstring m_telemetryFile; // progress as JSON lines for monitoring, see TrainingTelemetry (empty: none)
 
     bool m_doGradientCheck;
     double m_gradientCheckSigDigit;
@@ -247,6 +265,8 @@ protected:
     bool m_doUnitTest;
 
     bool m_useAllDataForPreComputedNode;
+    size_t m_preComputeDecimation;      // precompute over every this many minibatches only
+    std::wstring m_preComputeCacheFile; // if not empty, the precomputed statistics are taken from and kept in this file (see PreComputeAccumulation.h)
 
     int m_perfTraceLevel;
 
@@ -270,10 +290,21 @@ protected:
     // n > 1: Show stats after every n sync
     int m_syncStatsTrace;
 
+    // per-rank timing of distributed training, to tell which ranks the others wait for, see StragglerMonitor
+    bool m_stragglerDetection;
+    double m_stragglerThreshold;    // a straggler spends more than this many times the median time of the ranks outside the exchanges
+    size_t m_stragglerMinExchanges; // for this many exchanges in a row
+    bool m_stragglerRebalance;      // at each epoch, shares of the data in proportion to the speed of each rank (distributed reading only)
+
     // Data parallel SGD training parameters
     intargvector m_numGradientBits;
     bool m_bufferedAsyncGradientAggregation;
     bool m_zeroThresholdFor1Bit;
+    size_t m_gradientBucketSizeInBytes; // 0: one allreduce per gradient matrix after backprop
+    bool m_useDeviceGradientAggregation; // reduce GPU gradients in device memory (NCCL or CUDA-aware MPI) if possible
+    bool m_useHierarchicalAggregation;   // reduce within each host first, then across hosts
+    double m_gradientDensity;            // < 1: send at most this fraction of the gradient entries of each bucket (SparsifiedDistGradAggregator)
+    double m_gradientThreshold;          // > 0: send only the gradient entries of at least this magnitude (SparsifiedDistGradAggregator)
 
     // Parallel training related with MA / BM
     size_t m_modelAggregationBlockSize;
@@ -281,6 +312,8 @@ protected:
     bool   m_useNesterovBlockMomentum;
     double m_blockLearningRate; 
     double m_blockMomentumAsTimeConstant;
+    bool   m_useAsyncModelAggregation; // merge the models one sync period later, without waiting for the other workers (AsyncModelAveragingSGD)
+    size_t m_maxStaleness;             // ParameterServerSGD: how many sync points a worker may get ahead of the slowest one
 
     bool m_needAveMultiplier;
     double m_L2RegWeight;
@@ -302,6 +335,15 @@ protected:
 template <class ElemType>
 class IDistGradAggregator;
 
+template <class ElemType>
+class ParameterSnapshot;
+
+template <class ElemType>
+class DeviceReplicas;
+
+class TrainingTelemetry;
+class StragglerMonitor;
+
 // -----------------------------------------------------------------------
 // class SGD
 // -----------------------------------------------------------------------
@@ -323,17 +365,29 @@ public:
           // TODO: The next few do not belong into SGD any more than the network or reader we operate on. Either move network and reader in here, or move these out.
           m_modelPath((const wstring&) configSGD(L"modelPath")),
           m_keepCheckPointFiles(configSGD(L"keepCheckPointFiles", false)),
+          m_asyncCheckpoint(configSGD(L"asyncCheckpoint", false)),
+          m_incrementalCheckpointInterval(configSGD(L"incrementalCheckpointInterval", (size_t) 0)),
+          m_nonFiniteCheckInterval(configSGD(L"nonFiniteCheckInterval", (size_t) 0)),
+          m_rollbackOnNonFinite(configSGD(L"rollbackOnNonFinite", false)),
           m_trainCriterionNodeName((const wstring&) configSGD(L"trainCriterionNodeName", L"")),
           m_evalCriterionNodeName ((const wstring&) configSGD(L"evalCriterionNodeName", L"")),
           m_traceNodeNamesReal    (configSGD(L"traceNodeNamesReal",     ConfigRecordType::Array(stringargvector()))),
           m_traceNodeNamesCategory(configSGD(L"traceNodeNamesCategory", ConfigRecordType::Array(stringargvector()))),
           m_traceNodeNamesSparse  (configSGD(L"traceNodeNamesSparse",   ConfigRecordType::Array(stringargvector()))),
+          m_recomputeSegmentLength      (configSGD(L"recomputeSegmentLength",   (size_t) 0)),
+          m_recomputeCheckpointNodeNames(configSGD(L"recomputeCheckpointNodes", ConfigRecordType::Array(stringargvector()))),
+          m_stashCompression((const wstring&) configSGD(L"stashCompression", L"none")),
+          m_replicaDeviceIds(configSGD(L"replicaDeviceIds", ConfigRecordType::Array(intargvector()))),
+          m_asyncCrossValidation(configSGD(L"asyncCrossValidation", false)),
+          m_asyncCrossValidationDeviceId(configSGD(L"asyncCrossValidationDeviceId", (int) DEVICEID_NOTYETDETERMINED)),
           m_prevChosenMinibatchSize(0),
           m_lastFinishedEpochTrainLoss(0.0),
           m_distGradAgg(nullptr),
           m_gradHeader(nullptr)
     {
         msra::files::make_intermediate_dirs(m_modelPath);
+        if (m_incrementalCheckpointInterval > 0 && m_autoLearnRateSearchType == LearningRateSearchAlgorithm::AdjustAfterEpoch && m_loadBestModel)
+            InvalidArgument("incrementalCheckpointInterval cannot be combined with AdjustAfterEpoch and loadBestModel, which roll back to the files of earlier epochs.");
     }
     // note: This must be in the header, as we cannot properly specialize this constructor in the CPP to make sure all versions are generated.
 
@@ -396,6 +450,7 @@ protected:
                                   const bool learnRateInitialized,
                                   const double largestPrevLearnRatePerSample);
 
+    // trains on a few minibatches, then rolls the model and the learner back to 'snapshot'
     void TrainOneMiniEpochAndReloadModel(ComputationNetworkPtr net,
                                          ComputationNetworkPtr refNet,
                                          const ComputationNodeBasePtr& refNode, const int epochNumber,
@@ -409,6 +464,7 @@ protected:
                                          StreamMinibatchInputs* inputMatrices,
                                          const std::list<ComputationNodeBasePtr>& learnableNodes,
                                          std::list<Matrix<ElemType>>& smoothedGradients, std::vector<double> smoothedCounts,
+                                         const ParameterSnapshot<ElemType>& snapshot,
                                          /*out*/ EpochCriterion& epochCriterion,
                                          /*out*/ std::vector<EpochCriterion>& epochEvalErrors,
                                          std::string prefixMsg = "");
@@ -477,7 +533,9 @@ protected:
                          /*out*/ std::vector<EpochCriterion>& epochEvalErrors,
                          const std::string& prefixMsg = "");
 
-    void InitDistGradAgg(int numEvalNodes, int numGradientBits, int traceLevel);
+    void InitDistGradAgg(int numEvalNodes, int numGradientBits, DEVICEID_TYPE deviceId, int traceLevel);
+    void InitDeviceReplicas(const ComputationNetworkPtr& net, const ComputationNodeBasePtr& criterionNode, const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                            const std::list<ComputationNodeBasePtr>& learnableNodes, const StreamMinibatchInputs& inputMatrices);
     void InitModelAggregationHandler(int traceLevel, DEVICEID_TYPE devID);
 public:
     // UpdateWeights() - actual weight update, implementing various update rules
@@ -488,11 +546,20 @@ public:
                        const double L2RegWeight, const double L1RegWeight,
                        const bool needAveMultiplier,
                        const bool useNesterovMomentum) const;
+    // UpdateWeights() of all learnable nodes of a minibatch, with fused updates where possible
+    void UpdateLearnableNodes(const std::list<ComputationNodeBasePtr>& learnableNodes,
+                              std::list<Matrix<ElemType>>& smoothedGradients, std::vector<double>& smoothedCounts,
+                              const double learnRatePerSample, const double momentumPerSample,
+                              size_t actualMBSize,
+                              const std::unordered_set<ComputationNodeBasePtr>& batchNormalizationWeights) const;
     // return -1 if nothing exists
     int DetermineStartEpoch(const bool makeMode);
 
     wstring GetModelNameForEpoch(const int epoch, bool bLastModel = false);
 
+    // the network of a checkpoint, also of an incremental one (see IncrementalCheckpoint)
+    ComputationNetworkPtr LoadNetworkForEpoch(DEVICEID_TYPE deviceId, const int epoch);
+
 protected:
     void ClipGradient(Matrix<ElemType>& gradient, const size_t actualMBSize) const;
 
@@ -501,7 +568,21 @@ protected:
                             const std::list<Matrix<ElemType>>& smoothedGradients,
                             const std::vector<double>& smoothedCounts,
                             const double prevCriterion,
-                            const size_t minibatchSize);
+                            const size_t minibatchSize,
+                            bool sync = false);
+    void SaveCheckpointAsync(const ComputationNetworkPtr& net, const size_t epoch, const size_t totalSamplesSeen,
+                             const double learnRatePerSample,
+                             const std::list<Matrix<ElemType>>& smoothedGradients,
+                             const std::vector<double>& smoothedCounts,
+                             const double prevCriterion,
+                             const size_t minibatchSize,
+                             const std::vector<std::wstring>& filesToDelete);
+    void WaitForCheckpointFiles();
+
+    void StartCrossValidationAsync(const ComputationNetworkPtr& net, const int epoch, IDataReader* validationSetDataReader,
+                                   const std::vector<std::wstring>& nodeNames, const size_t mbSize);
+    bool WaitForCrossValidation(/*out*/ std::vector<EpochCriterion>& result);
+    void LogCrossValidation(const int epoch, const std::vector<std::wstring>& nodeNames, const std::vector<EpochCriterion>& result) const;
 
     bool TryLoadCheckPointInfo(const size_t epochNumber,
                                /*out*/ size_t& totalSamplesSeen,
@@ -518,7 +599,19 @@ protected:
                             /*out*/ double& prevCriterion,
                             /*out*/ size_t& minibatchSize);
 
+    void BroadcastTrainingState(const std::list<ComputationNodeBasePtr>& nodes,
+                                std::list<Matrix<ElemType>>& smoothedGradients,
+                                std::vector<double>& smoothedCounts,
+                                /*in/out*/ size_t& totalSamplesSeen,
+                                /*in/out*/ double& learnRatePerSample,
+                                /*in/out*/ double& prevCriterion,
+                                /*in/out*/ size_t& minibatchSize,
+                                /*in/out*/ bool& learnRateInitialized);
+
     wstring GetCheckPointFileNameForEpoch(const int epoch);
+    wstring GetDeltaFileNameForEpoch(const int epoch);
+    bool IsIncrementalCheckpoint(const int epoch); // the checkpoint of 'epoch' is a delta file
+    void RereadPersistableParametersForEpoch(const ComputationNetworkPtr& net, const int epoch);
 
     GradientsUpdateType GradUpdateType() const
     {
@@ -540,6 +633,18 @@ public:
 protected:
     std::wstring m_modelPath;
     bool m_keepCheckPointFiles;
+    bool m_asyncCheckpoint;                // write model and checkpoint files of an epoch on a background thread, see SaveCheckpointAsync()
+    std::future<void> m_pendingCheckpoint; // (main node only)
+
+    // > 0: only every this many epochs (and the last one) write a full checkpoint; the others write the changes since
+    // then into a delta file instead of the model file and .ckp file, see IncrementalCheckpoint
+    size_t m_incrementalCheckpointInterval;
+    IncrementalCheckpoint<ElemType> m_incrementalCheckpoint; // (main node only)
+
+    // check the parameters for NaN/Inf every this many minibatches (0: never; debug builds check every minibatch),
+    // and either stop or roll back to the parameters of the last check, see NonFiniteCheck
+    size_t m_nonFiniteCheckInterval;
+    bool m_rollbackOnNonFinite;
 
     std::wstring m_trainCriterionNodeName;
     std::wstring m_evalCriterionNodeName;
@@ -549,6 +654,26 @@ protected:
     std::vector<std::wstring> m_traceNodeNamesCategory;
     std::vector<std::wstring> m_traceNodeNamesSparse;
 
+    // gradient checkpointing: values inside segments of this many nodes, or ending at these nodes, are recomputed during backprop
+    size_t m_recomputeSegmentLength;
+    std::vector<std::wstring> m_recomputeCheckpointNodeNames;
+    // the values kept for backprop are stashed in fewer bits in between: "none", "half" or "byte" (see ComputationNetwork::SetStashCompression())
+    std::wstring m_stashCompression;
+
+    // in-process data parallelism: further GPUs with a replica of the network each, see DeviceReplicas
+    intargvector m_replicaDeviceIds;
+    std::shared_ptr<DeviceReplicas<ElemType>> m_deviceReplicas;
+
+    // evaluate the validation set on a background thread, on a copy of the parameters in a network of its own (by default
+    // on the device of the training), while the next epoch trains; see StartCrossValidationAsync()
+    bool m_asyncCrossValidation;
+    int m_asyncCrossValidationDeviceId; // (DEVICEID_NOTYETDETERMINED: the device of the network)
+    ComputationNetworkPtr m_crossValidationNet;
+    std::future<std::vector<EpochCriterion>> m_pendingCrossValidation;
+
+    std::shared_ptr<TrainingTelemetry> m_telemetry; // opened at the first epoch, if m_telemetryFile is set
+    std::shared_ptr<StragglerMonitor> m_stragglerMonitor; // with m_stragglerDetection, once parallel training starts
+
     size_t m_prevChosenMinibatchSize;
     double m_lastFinishedEpochTrainLoss;
 
@@ -567,7 +692,8 @@ private:
     bool UsingModelAggregation(size_t epochNumber) const
     {
         return ((GetParallelizationMethod() == ParallelizationMethod::modelAveragingSGD ||
-                 GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD) &&
+                 GetParallelizationMethod() == ParallelizationMethod::blockMomentumSGD ||
+                 GetParallelizationMethod() == ParallelizationMethod::parameterServerSGD) &&
                 (epochNumber >= m_parallelizationStartEpochNum));
     }
     bool UsingParallelTrain(size_t epochNumber) const
@@ -15,22 +15,37 @@ class SimpleDistGradAggregator : public IDistGradAggregator<ElemType>
     UsingIDistGradAggregatorMembers;
 
 public:
-    SimpleDistGradAggregator(const MPIWrapperPtr& mpi, bool useAsyncAggregation, int syncStatsTrace)
-        : IDistGradAggregator<ElemType>(mpi), m_useAsyncAggregation(useAsyncAggregation), m_initialized(false), m_bufferedGradHeader(nullptr), m_syncStatsTrace(syncStatsTrace), m_iterationCount(0)
+    // 'gradientBucketSizeInBytes' > 0 packs the gradients into contiguous buckets of about that size, each reduced with a single
+    // allreduce that is started as soon as backprop has produced all gradients of the bucket (see OnGradientReady())
+    // 'useHalfPrecision' exchanges the dense gradients as half-precision floats, with dynamic loss scaling (see FinishHalfPrecisionReductions())
+    SimpleDistGradAggregator(const MPIWrapperPtr& mpi, bool useAsyncAggregation, int syncStatsTrace, size_t gradientBucketSizeInBytes = 0, bool useHalfPrecision = false)
+        : IDistGradAggregator<ElemType>(mpi), m_deviceId(CPUDEVICE), m_useAsyncAggregation(useAsyncAggregation), m_initialized(false), m_bufferedGradHeader(nullptr), m_syncStatsTrace(syncStatsTrace), m_iterationCount(0),
+          m_gradientBucketSizeInBytes(gradientBucketSizeInBytes), m_nextBucketToReduce(0),
+          m_useHalfPrecision(useHalfPrecision), m_lossScaleExponent(InitialLossScaleExponent), m_numReductionsWithoutOverflow(0), m_overflowed(false)
     {}
 
     ~SimpleDistGradAggregator()
     {
-        for (size_t i = 0; i < m_recvHeaders.size(); ++i)
-            DistGradHeader::Destroy(m_recvHeaders[i]);
-
         if (m_bufferedGradHeader != nullptr)
             DistGradHeader::Destroy(m_bufferedGradHeader);
     }
 
     // Aggregate the gradient matrices across all nodes
-    bool AggregateGradients(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, bool resetState) override
+    bool AggregateGradients(const std::vector<Matrix<ElemType>*>& allGradients, DistGradHeader* headerCPU, bool resetState) override
     {
+        // Block-column sparse gradients (of embeddings) are summed up by gathering the columns that each node touched,
+        // which is much less data than a dense allreduce over the whole vocabulary. Only the dense gradients go through
+        // the (bucketed or async) allreduce below.
+        m_deviceId = allGradients[0]->GetDeviceId();
+        std::vector<Matrix<ElemType>*> gradients, sparseGradients;
+        SplitGradients(allGradients, gradients, sparseGradients);
+        if (!sparseGradients.empty())
+        {
+            if (m_useAsyncAggregation)
+                RuntimeError("Asynchronous aggregation of sparse gradient matrices is currently unsupported!");
+            AggregateSparseGradients(sparseGradients, headerCPU->numSamples != 0);
+        }
+
         ResetState(gradients, headerCPU->numEvalNode, resetState);
         bool showSyncPerfStats = (m_syncStatsTrace > 0) && ((m_iterationCount % m_syncStatsTrace) == 0);
         m_iterationCount++;
@@ -81,7 +96,7 @@ public:
             // Initiate aggregation only if any samples were processed in previous iteration
             if (resetState || (headerCPU->numSamples != 0))
             {
-                int deviceId = gradients[0]->GetDeviceId();
+                int deviceId = m_deviceId;
                 DistGradHeader* newGradHeader = m_bufferedGradHeader;
 
                 // Since we will be aggregating the gradients assynchronously, let us
@@ -116,7 +131,231 @@ public:
         }
     }
 
+    // Called from backprop once a gradient is complete. When all gradients of a bucket are complete, the bucket is packed
+    // and its transfer to the CPU is started; the reduction of the bucket before it (whose transfer has had time to finish
+    // meanwhile) is started right away, so communication overlaps with the remainder of the backward pass.
+    void OnGradientReady(Matrix<ElemType>* gradient) override
+    {
+        auto iter = m_bucketOfGradient.find(gradient);
+        if (iter == m_bucketOfGradient.end()) // not bucketed, or buckets not formed yet (first minibatch)
+            return;
+
+        size_t bucketIndex = iter->second;
+        GradientBucket& bucket = m_buckets[bucketIndex];
+        if (bucket.m_numPendingGradients == 0)
+            LogicError("OnGradientReady: Gradient announced twice in the same minibatch.");
+
+        if (--bucket.m_numPendingGradients == 0)
+        {
+            StartBucketTransfer(bucketIndex);
+            StartBucketReductions(bucketIndex);
+        }
+
+        // give MPI the chance to make progress on the reductions in flight
+        for (size_t i = 0; i < m_nextBucketToReduce; i++)
+            m_mpi->Test(&m_buckets[i].m_allReduceRequest);
+    }
+
 private:
+    static void SplitGradients(const std::vector<Matrix<ElemType>*>& allGradients, std::vector<Matrix<ElemType>*>& denseGradients, std::vector<Matrix<ElemType>*>& sparseGradients)
+    {
+        for (auto gradient : allGradients)
+        {
+            if (gradient->GetMatrixType() == DENSE)
+                denseGradients.push_back(gradient);
+            else if (gradient->GetDeviceId() == CPUDEVICE && gradient->GetFormat() == matrixFormatSparseBlockCol)
+                sparseGradients.push_back(gradient);
+            else
+                RuntimeError("Gradient aggregation is currently only supported for dense and for block-column sparse gradient matrices on the CPU!");
+        }
+    }
+
+    // Sum up each sparse gradient across the nodes: all nodes gather the ids and values of the columns that every node
+    // touched, in rank order, and merge them into a gradient with a block for each distinct column. A node that did not
+    // process any samples contributes no columns.
+    void AggregateSparseGradients(const std::vector<Matrix<ElemType>*>& gradients, bool contribute)
+    {
+        for (auto gradient : gradients)
+        {
+            if (contribute)
+                gradient->GetBlockColumns(m_sparseColumnIds, m_sparseValues);
+            else
+            {
+                m_sparseColumnIds.clear();
+                m_sparseValues.clear();
+            }
+
+            m_mpi->AllGather(m_sparseColumnIds, m_gatheredSparseColumnIds);
+            m_mpi->AllGather(m_sparseValues, m_gatheredSparseValues);
+            gradient->AssignSumOfBlockColumns(gradient->GetNumRows(), gradient->GetNumCols(), m_gatheredSparseColumnIds, m_gatheredSparseValues);
+        }
+    }
+
+    // A contiguous group of gradients that is reduced with a single allreduce
+    struct GradientBucket
+    {
+        std::vector<Matrix<ElemType>*> m_gradients;
+        std::vector<size_t> m_offsets;                        // of the gradients inside the packed buffer
+        size_t m_numElements;
+        std::unique_ptr<Matrix<ElemType>> m_packedGradients;  // only if the bucket holds more than one gradient
+        std::shared_ptr<ElemType> m_intermediateCPUBuffer;    // only for GPU devices
+        std::unique_ptr<GPUDataTransferer<ElemType>> m_gpuDataTransferer;
+
+        size_t m_numPendingGradients;                         // gradients not yet announced by OnGradientReady() in this minibatch
+        bool m_transferStarted;
+        MPIAllReduceRequest m_allReduceRequest;
+
+        ElemType* Data() const
+        {
+            return m_packedGradients ? m_packedGradients->Data() : m_gradients[0]->Data();
+        }
+    };
+
+    // form the buckets in reverse order of the gradients, which is about the order in which backprop completes them
+    void CreateBuckets(const std::vector<Matrix<ElemType>*>& gradients)
+    {
+        int deviceId = gradients[0]->GetDeviceId();
+        for (size_t i = gradients.size(); i-- > 0;)
+        {
+            size_t numElements = gradients[i]->GetNumElements();
+            if (m_buckets.empty() || (m_buckets.back().m_numElements + numElements) * sizeof(ElemType) > m_gradientBucketSizeInBytes)
+            {
+                m_buckets.push_back(GradientBucket());
+                m_buckets.back().m_numElements = 0;
+            }
+
+            GradientBucket& bucket = m_buckets.back();
+            bucket.m_gradients.push_back(gradients[i]);
+            bucket.m_offsets.push_back(bucket.m_numElements);
+            bucket.m_numElements += numElements;
+            m_bucketOfGradient[gradients[i]] = m_buckets.size() - 1;
+        }
+
+        for (auto& bucket : m_buckets)
+        {
+            if (bucket.m_gradients.size() > 1)
+                bucket.m_packedGradients.reset(new Matrix<ElemType>(1, bucket.m_numElements, deviceId));
+
+            if (deviceId != CPUDEVICE)
+            {
+                bucket.m_gpuDataTransferer.reset(new GPUDataTransferer<ElemType>(deviceId, m_useAsyncAggregation));
+                bucket.m_intermediateCPUBuffer = AllocateIntermediateBuffer(deviceId, bucket.m_numElements);
+            }
+
+            bucket.m_numPendingGradients = bucket.m_gradients.size();
+            bucket.m_transferStarted = false;
+        }
+    }
+
+    void StartBucketTransfer(size_t bucketIndex)
+    {
+        GradientBucket& bucket = m_buckets[bucketIndex];
+        if (bucket.m_packedGradients)
+        {
+            for (size_t i = 0; i < bucket.m_gradients.size(); i++)
+            {
+                size_t numElements = bucket.m_gradients[i]->GetNumElements();
+                bucket.m_packedGradients->ColumnSlice(bucket.m_offsets[i], numElements).AssignValuesOf(bucket.m_gradients[i]->Reshaped(1, numElements));
+            }
+        }
+
+        if (bucket.m_gpuDataTransferer)
+            bucket.m_gpuDataTransferer->CopyGPUToCPUAsync(bucket.Data(), bucket.m_numElements, bucket.m_intermediateCPUBuffer.get());
+
+        bucket.m_transferStarted = true;
+    }
+
+    // Start the reductions of all transferred buckets below 'endBucketIndex'. All ranks must issue the allreduce
+    // operations in the same order, hence buckets are reduced strictly in index order, independent of the order
+    // in which they became ready.
+    void StartBucketReductions(size_t endBucketIndex)
+    {
+        for (; m_nextBucketToReduce < endBucketIndex && m_buckets[m_nextBucketToReduce].m_transferStarted; m_nextBucketToReduce++)
+        {
+            GradientBucket& bucket = m_buckets[m_nextBucketToReduce];
+            ElemType* reductionBuffer = bucket.Data();
+            if (bucket.m_gpuDataTransferer)
+            {
+                bucket.m_gpuDataTransferer->WaitForCopyGPUToCPUAsync();
+                reductionBuffer = bucket.m_intermediateCPUBuffer.get();
+            }
+
+            StartReduction(reductionBuffer, bucket.m_numElements, &bucket.m_allReduceRequest);
+        }
+    }
+
+    void StartReduction(ElemType* data, size_t count, MPIAllReduceRequest* request)
+    {
+        if (m_useHalfPrecision)
+            m_mpi->AllReduceHalfAsync(data, count, ldexpf(1, m_lossScaleExponent), request);
+        else
+            m_mpi->AllReduceAsync(data, count, request);
+    }
+
+    // Wait for a reduction. A half-precision sum that overflowed is redone in full precision, which all nodes do alike.
+    void WaitForReduction(ElemType* data, size_t count, MPIAllReduceRequest* request)
+    {
+        m_mpi->Wait(request);
+        if (request->Overflowed())
+        {
+            m_mpi->AllReduce(data, count);
+            m_overflowed = true;
+        }
+    }
+
+    // Dynamic loss scaling: the gradients are scaled up before they are rounded to half precision as much as possible without
+    // overflowing the half range. The scale is halved after an overflow and doubled after LossScaleGrowthInterval reductions
+    // without one. Since the sums are the same on all nodes, so are the scales.
+    void FinishHalfPrecisionReductions(bool showSyncPerfStats)
+    {
+        if (!m_useHalfPrecision)
+            return;
+        if (m_overflowed)
+        {
+            m_lossScaleExponent = std::max<int>(m_lossScaleExponent - 1, MinLossScaleExponent);
+            m_numReductionsWithoutOverflow = 0;
+            if (showSyncPerfStats)
+                fprintf(stderr, "Half-precision gradient aggregation overflowed, loss scale reduced to 2^%d.\n", m_lossScaleExponent);
+        }
+        else if (++m_numReductionsWithoutOverflow >= LossScaleGrowthInterval)
+        {
+            m_lossScaleExponent = std::min<int>(m_lossScaleExponent + 1, MaxLossScaleExponent);
+            m_numReductionsWithoutOverflow = 0;
+        }
+        m_overflowed = false;
+    }
+
+    // wait for all bucket reductions, copy the results back and unpack them; then reset the buckets for the next minibatch
+    void FinishBucketReductions()
+    {
+        for (auto& bucket : m_buckets)
+        {
+            WaitForReduction(bucket.m_gpuDataTransferer ? bucket.m_intermediateCPUBuffer.get() : bucket.Data(), bucket.m_numElements, &bucket.m_allReduceRequest);
+            if (bucket.m_gpuDataTransferer)
+                bucket.m_gpuDataTransferer->CopyCPUToGPUAsync(bucket.m_intermediateCPUBuffer.get(), bucket.m_numElements, bucket.Data());
+        }
+
+        for (auto& bucket : m_buckets)
+        {
+            // The unpacking below runs on the compute stream, which only needs to wait for the copy on the GPU
+            if (bucket.m_gpuDataTransferer)
+                bucket.m_gpuDataTransferer->WaitForCopyCPUToGPUOnComputeStreamAsync();
+
+            if (bucket.m_packedGradients)
+            {
+                for (size_t i = 0; i < bucket.m_gradients.size(); i++)
+                {
+                    Matrix<ElemType>* gradient = bucket.m_gradients[i];
+                    gradient->AssignValuesOf(bucket.m_packedGradients->ColumnSlice(bucket.m_offsets[i], gradient->GetNumElements()).Reshaped(gradient->GetNumRows(), gradient->GetNumCols()));
+                }
+            }
+
+            bucket.m_numPendingGradients = bucket.m_gradients.size();
+            bucket.m_transferStarted = false;
+        }
+        m_nextBucketToReduce = 0;
+    }
+
     std::shared_ptr<ElemType> AllocateIntermediateBuffer(int deviceID, size_t numElements)
     {
         assert(deviceID >= 0);
@@ -135,17 +374,16 @@ private:
         if (!m_initialized)
         {
             m_initialized = true;
-            int deviceId = gradients[0]->GetDeviceId();
+            int deviceId = m_deviceId;
             if (deviceId != CPUDEVICE)
                 m_allocator.reset(new CUDAPageLockedMemAllocator(deviceId));
 
+            // Buckets must be formed on the gradients that backprop announces, which are not the ones passed in here
+            // when double-buffering for async aggregation
+            bool useBuckets = (m_gradientBucketSizeInBytes > 0) && !m_useAsyncAggregation;
             for (size_t i = 0; i < gradients.size(); i++)
             {
-                // Make sure none of the gradient matrixes are sparse - we currently do not support aggregation of sparse gradient matrices
-                if (gradients[i]->GetMatrixType() != DENSE)
-                    RuntimeError("Gradient aggregation for sparse gradient matrices is currently unsupported!");
-
-                if (deviceId != CPUDEVICE)
+                if (deviceId != CPUDEVICE && !useBuckets)
                 {
                     m_gpuDataTransferers.push_back(std::unique_ptr<GPUDataTransferer<ElemType>>(new GPUDataTransferer<ElemType>(deviceId, m_useAsyncAggregation)));
                     m_intermediateCPUBuffers.push_back(AllocateIntermediateBuffer(deviceId, gradients[i]->GetNumElements()));
@@ -155,17 +393,14 @@ private:
                     m_bufferedGradients[gradients[i]].reset(new Matrix<ElemType>(gradients[i]->GetNumRows(), gradients[i]->GetNumCols(), deviceId));
             }
 
+            if (useBuckets && !gradients.empty())
+                CreateBuckets(gradients);
+
             if (m_useAsyncAggregation)
             {
                 m_bufferedGradHeader = DistGradHeader::Create(numEvalNodes);
                 m_bufferedGradHeader->Clear();
             }
-
-            if (m_mpi->IsMainNode())
-            {
-                for (size_t i = 0; i < NumProc() - 1; ++i)
-                    m_recvHeaders.push_back(DistGradHeader::Create(numEvalNodes));
-            }
         }
         else if (resetState)
         {
@@ -187,7 +422,7 @@ private:
     void AggregateGradientsImpl(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, bool showSyncPerfStats)
     {
         Timer aggregationTimer;
-        int deviceId = gradients[0]->GetDeviceId();
+        int deviceId = m_deviceId;
         if (showSyncPerfStats)
         {
             std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(deviceId));
@@ -215,33 +450,27 @@ private:
             }
         }
 
-        // Initiate transfer of the gradient matrices to the CPU if needed
-        if (deviceId >= 0)
+        // Initiate transfer of the gradient matrices to the CPU if needed; with buckets, only for those that backprop did not announce
+        bool useBuckets = !m_buckets.empty();
+        if (useBuckets)
         {
-            for (size_t i = 0; i < numGradMatrices; ++i)
-                m_gpuDataTransferers[i]->CopyGPUToCPUAsync(gradients[i]->Data(), gradients[i]->GetNumElements(), m_intermediateCPUBuffers[i].get());
-        }
-
-        // Initiate receive of the header on the main node
-        std::vector<MPI_Request> recvHeaderRequests(NumProc() - 1);
-        if (m_mpi->IsMainNode())
-        {
-            for (size_t j = 0; j < NumProc() - 1; ++j)
+            for (size_t i = 0; i < m_buckets.size(); ++i)
             {
-                int source = (j >= MyRank()) ? (j + 1) : j;
-                // We use a tag of 'numGradMatrices' for the pre-aggregation header
-                MPI_Irecv(m_recvHeaders[j], m_recvHeaders[j]->Size(), MPI_CHAR, source, numGradMatrices, m_mpi->Communicator(), &(recvHeaderRequests[j])) || MpiFail("MPI_Irecv");
+                if (!m_buckets[i].m_transferStarted)
+                    StartBucketTransfer(i);
             }
         }
-
-        // Send the headers from all nodes but the main node
-        MPI_Request sendHeaderRequest;
-        if (!m_mpi->IsMainNode())
-            MPI_Isend(headerCPU, headerCPU->Size(), MPI_CHAR, m_mpi->MainNodeRank(), numGradMatrices, m_mpi->Communicator(), &sendHeaderRequest) || MpiFail("MPI_Isend");
+        else if (deviceId >= 0)
+        {
+            for (size_t i = 0; i < numGradMatrices; ++i)
+                m_gpuDataTransferers[i]->CopyGPUToCPUAsync(gradients[i]->Data(), gradients[i]->GetNumElements(), m_intermediateCPUBuffers[i].get());
+        }
 
         // Perform MPI async allreduce on the gradient data
-        std::vector<MPI_Request> allReduceRequests(numGradMatrices);
-        for (size_t i = 0; i < numGradMatrices; ++i)
+        std::vector<MPIAllReduceRequest> allReduceRequests(useBuckets ? 0 : numGradMatrices);
+        if (useBuckets)
+            StartBucketReductions(m_buckets.size());
+        for (size_t i = 0; i < allReduceRequests.size(); ++i)
         {
             ElemType* reductionBuffer = gradients[i]->Data();
             if (deviceId >= 0)
@@ -250,73 +479,43 @@ private:
                 reductionBuffer = m_intermediateCPUBuffers[i].get();
             }
 
-            // On Windows this async MPI_Iallreduce call requires MS MPI v7 or higher to be installed
-            MPI_Iallreduce(MPI_IN_PLACE, reductionBuffer, gradients[i]->GetNumElements(), MPIWrapper::GetDataType(reductionBuffer), MPI_SUM, m_mpi->Communicator(), &allReduceRequests[i]) || MpiFail("MPI_Iallreduce");
+            StartReduction(reductionBuffer, gradients[i]->GetNumElements(), &allReduceRequests[i]);
         }
 
-        // On the main node wait for the headers to arrive and aggregate
-        if (m_mpi->IsMainNode())
-        {
-            size_t numNodesHeadersReceivedFrom = 0;
-            while (numNodesHeadersReceivedFrom < (NumProc() - 1))
-            {
-                int idx = MPI_UNDEFINED;
-                MPI_Waitany(recvHeaderRequests.size(), recvHeaderRequests.data(), &idx, MPI_STATUS_IGNORE) || MpiFail("MPI_Waitany");
-                if (idx == MPI_UNDEFINED)
-                {
-                    break;
-                }
-
-                numNodesHeadersReceivedFrom++;
-
-                headerCPU->Aggregate(m_recvHeaders[idx], true);
-            }
-
-            assert(numNodesHeadersReceivedFrom == (NumProc() - 1));
-        }
-
-        // Initiate receive of the aggregate header
-        MPI_Request recvAggHeaderRequest;
-        if (!m_mpi->IsMainNode())
-            MPI_Irecv(headerCPU, headerCPU->Size(), MPI_CHAR, m_mpi->MainNodeRank(), numGradMatrices + 1 + numGradMatrices, m_mpi->Communicator(), &recvAggHeaderRequest) || MpiFail("MPI_Irecv");
-
-        // Intiate send of the aggregate header from main node
-        std::vector<MPI_Request> sendAggHeaderRequests(NumProc() - 1);
-        if (m_mpi->IsMainNode())
-        {
-            for (size_t j = 0; j < NumProc() - 1; ++j)
-            {
-                int dest = (j >= MyRank()) ? (j + 1) : j;
-                // TODO: Should we use MPI_Bcast instead for better performance
-                MPI_Isend(headerCPU, headerCPU->Size(), MPI_CHAR, dest, numGradMatrices + 1 + numGradMatrices, m_mpi->Communicator(), &(sendAggHeaderRequests[j])) || MpiFail("MPI_Isend");
-            }
-        }
+        // The header is summed up alongside the gradients with a single allreduce of its fields. It is started after all
+        // gradient reductions, so that all nodes issue the collectives in the same order.
+        PackHeader(headerCPU, m_headerBuffer);
+        MPI_Request headerRequest;
+        MPI_Iallreduce(MPI_IN_PLACE, m_headerBuffer.data(), (int) m_headerBuffer.size(), MPI_DOUBLE, MPI_SUM, m_mpi->Communicator(), &headerRequest) || MpiFail("MPI_Iallreduce");
 
         // Wait for the allreduce operations to finish and initiate transfer back to the GPU if needed
-        for (size_t i = 0; i < numGradMatrices; ++i)
+        for (size_t i = 0; i < allReduceRequests.size(); ++i)
         {
-            MPI_Wait(&allReduceRequests[i], MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+            WaitForReduction(deviceId >= 0 ? m_intermediateCPUBuffers[i].get() : gradients[i]->Data(), gradients[i]->GetNumElements(), &allReduceRequests[i]);
             if (deviceId >= 0)
                 m_gpuDataTransferers[i]->CopyCPUToGPUAsync(m_intermediateCPUBuffers[i].get(), gradients[i]->GetNumElements(), gradients[i]->Data());
         }
 
-        // Wait to receive aggregate header
-        if (!m_mpi->IsMainNode())
-            MPI_Wait(&recvAggHeaderRequest, MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+        // Wait for the aggregate header
+        MPI_Wait(&headerRequest, MPI_STATUS_IGNORE) || MpiFail("MPI_Wait");
+        UnpackHeader(headerCPU, m_headerBuffer);
 
-        // Wait for all the transfers to finish
-        if (deviceId >= 0)
+        // Wait for all the transfers to finish. Unless the time is measured, only the compute stream has to wait
+        // for them: the next copies out of the intermediate buffers are issued after compute that comes later.
+        if (useBuckets)
+            FinishBucketReductions();
+        FinishHalfPrecisionReductions(showSyncPerfStats);
+        if (!useBuckets && deviceId >= 0)
         {
             for (size_t i = 0; i < numGradMatrices; ++i)
-                m_gpuDataTransferers[i]->WaitForCopyCPUToGPUAsync();
+            {
+                if (showSyncPerfStats)
+                    m_gpuDataTransferers[i]->WaitForCopyCPUToGPUAsync();
+                else
+                    m_gpuDataTransferers[i]->WaitForCopyCPUToGPUOnComputeStreamAsync();
+            }
         }
 
-        // Wait for completion of the async send requests
-        if (!m_mpi->IsMainNode())
-            MPI_Wait(&sendHeaderRequest, MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
-        else
-            MPI_Waitall(sendAggHeaderRequests.size(), sendAggHeaderRequests.data(), MPI_STATUSES_IGNORE) || MpiFail("MPI_Waitall");
-
         if (showSyncPerfStats)
         {
             aggregationTimer.Stop();
@@ -331,7 +530,14 @@ private:
 
     std::vector<std::unique_ptr<GPUDataTransferer<ElemType>>> m_gpuDataTransferers;
 
-    std::vector<DistGradHeader*> m_recvHeaders;
+    std::vector<double> m_headerBuffer; // the header in the layout of PackHeader(), as reduced across nodes
+
+    // the device of the gradients (there may be no dense gradient to take it from)
+    int m_deviceId;
+
+    // the touched columns of a sparse gradient on this node, and of all nodes
+    std::vector<size_t> m_sparseColumnIds, m_gatheredSparseColumnIds;
+    std::vector<ElemType> m_sparseValues, m_gatheredSparseValues;
 
     // Perform aysnchronous gradient aggregation using double buffering of the gradient matrices
     bool m_useAsyncAggregation;
@@ -349,5 +555,18 @@ private:
     size_t m_iterationCount;
 
     bool m_initialized;
+
+    // Gradient bucketing; empty if disabled
+    size_t m_gradientBucketSizeInBytes;
+    std::vector<GradientBucket> m_buckets;
+    std::unordered_map<Matrix<ElemType>*, size_t> m_bucketOfGradient;
+    size_t m_nextBucketToReduce; // buckets below this index have their allreduce in flight
+
+    // Half-precision exchange of the gradients, with the loss scale 2^m_lossScaleExponent
+    enum { InitialLossScaleExponent = 10, MinLossScaleExponent = -24, MaxLossScaleExponent = 24, LossScaleGrowthInterval = 1000 };
+    bool m_useHalfPrecision;
+    int m_lossScaleExponent;
+    size_t m_numReductionsWithoutOverflow;
+    bool m_overflowed; // in the current minibatch
 };
 } } }
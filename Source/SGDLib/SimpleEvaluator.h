@@ -41,7 +41,6 @@ public:
         m_maxSamplesInRAM(maxSamplesInRAM), 
         m_numSubminiBatches(numSubminiBatches), 
         m_mpi(mpi), 
-        m_distGradAgg(nullptr),
         m_gradHeader(nullptr),
         m_enableDistributedMBReading(enableDistributedMBReading)
     {
@@ -116,7 +115,6 @@ public:
 
         m_net->StartEvaluateMinibatchLoop(evalNodes);
 
-        std::vector<Matrix<ElemType>*> learnParamsGradients;
         DataReaderHelpers::SubminibatchDispatcher<ElemType> smbDispatcher;
         size_t numSubminibatchesNeeded = DataReaderHelpers::GetNumSubminibatchesNeeded<ElemType>(dataReader, m_maxSamplesInRAM, m_numSubminiBatches, mbSize);
 
@@ -126,24 +124,19 @@ public:
         if (numSubminibatchesNeeded > 1)
             smbDispatcher.Init(m_net, learnableNodes, criterionNodes, evalNodes);
 
+        // In parallel evaluation, every rank accumulates the criteria over its own part of the data (on the device, so
+        // without a host sync per minibatch), and the sums of all ranks are taken once at the end. The ranks thus run
+        // independently and need not process the same number of minibatches; the progress shown is that of this rank.
         CriterionAccumulator<ElemType> localEpochEvalErrors(evalNodes.size(), m_net->GetDeviceId());
 
         const size_t numIterationsBeforePrintingProgress = 100;
         size_t numItersSinceLastPrintOfProgress = 0;
-        bool noMoreSamplesToProcess = false;
         for (;;)
         {
             size_t actualMBSize = 0;
             bool wasDataRead = DataReaderHelpers::GetMinibatchIntoNetwork<ElemType>(*dataReader, m_net, nullptr, useDistributedMBReading, useParallelTrain, inputMatrices, actualMBSize, m_mpi);
-            // in case of distributed reading, we do a few more loops until all ranks have completed
-            // end of epoch
-            if (!wasDataRead && (!useDistributedMBReading || noMoreSamplesToProcess)) 
-                break;
-
-            // Note: If !wasDataRead then the data that GetMinibatchIntoNetwork() was supposed to full in are undefined.
-            // Must not touch them.
             if (!wasDataRead)
-                actualMBSize = 0; // (undefined if !wasDataRead)
+                break;
 
             if (actualMBSize > 0)
         {
@@ -171,61 +164,24 @@ public:
             } // if (actualMBSize > 0)
 
             // BUGBUG (Issue #95): Once we have multiple layouts, this must be done on a per-node basis.
-            size_t numSamplesWithLabel = wasDataRead ? m_net->GetNumSamplesWithLabelOfNetwork(actualMBSize) : 0;
-            size_t aggregateNumSamplesWithLabel = numSamplesWithLabel;
-            if (useParallelTrain)
-            {
-                if (m_gradHeader == nullptr)
-                {
-                    m_gradHeader.reset(DistGradHeader::Create(evalNodes.size()), [](DistGradHeader* ptr) {
-                        DistGradHeader::Destroy(ptr);
-                    });
-                    m_distGradAgg = make_shared<SimpleDistGradAggregator<ElemType>>(m_mpi, false /*useAsyncAggregation*/, 0 /*syncStatsTrace*/);
-                }
-
-                m_gradHeader->numEvalNode = evalNodes.size();
-                m_gradHeader->numSamples = actualMBSize;
-                m_gradHeader->numSamplesWithLabel = numSamplesWithLabel;
-                m_gradHeader->criterion = 0.0; // (not used here)
-                for (size_t i = 0; i < evalNodes.size(); i++)
-                    m_gradHeader->evalErrors[i] = localEpochEvalErrors.Assign(evalNodes, i, numSamplesWithLabel).GetCriterion(i);
-
-                // TODO: We are reusing the aggregation logic inside SimpleDistGradAggregator, which has a heavy dependency
-                // on the gradient matrix. At some point we should refactor the aggregator class to be able to only calculating
-                // eval results and then remove this hack.
-                if (learnParamsGradients.size() == 0)
-                {
-                    Matrix<ElemType>* matrix = new Matrix<ElemType>((DEVICEID_TYPE)m_net->GetDeviceId());
-                    learnParamsGradients.push_back(matrix);
-                }
-
-                // Using SimpleDistAggregator for eval results only. At some point we should rename the class to be just
-                // IDistAggregator and SimpleDistAggregator.
-                bool samplesProcessed = m_distGradAgg->AggregateGradients(learnParamsGradients, m_gradHeader.get(), /*resetState =*/ false);
-                noMoreSamplesToProcess = !samplesProcessed;
-
-                aggregateNumSamplesWithLabel = m_gradHeader->numSamplesWithLabel;
-                for (size_t i = 0; i < evalResults.size(); i++)
-                    evalResults[i] += m_gradHeader->evalErrors[i];
-            }
-            else
+            size_t numSamplesWithLabel = m_net->GetNumSamplesWithLabelOfNetwork(actualMBSize);
+            if (actualMBSize != 0)
             {
-                if (actualMBSize != 0)
-                {
                 for (int i = 0; i < evalNodes.size(); i++)
-                    evalResults[i] += localEpochEvalErrors.Assign(evalNodes, i, numSamplesWithLabel).GetCriterion(i);
-                }
+                    localEpochEvalErrors.Add(evalNodes, i, numSamplesWithLabel);
             }
 
-            totalEpochSamples += aggregateNumSamplesWithLabel;
+            totalEpochSamples += numSamplesWithLabel;
             numMBsRun++;
 
             if (m_traceLevel > 0)
             {
-                numSamplesLastLogged += aggregateNumSamplesWithLabel;
+                numSamplesLastLogged += numSamplesWithLabel;
 
                 if (numMBsRun <= m_firstMBsToShowResult || (m_numMBsToShowResult && (numMBsRun % m_numMBsToShowResult == 0)))
                 {
+                    for (size_t i = 0; i < evalResults.size(); i++)
+                        evalResults[i] = localEpochEvalErrors.GetCriterion(i);
                     DisplayEvalStatistics(numMBsRunLastLogged + 1, numMBsRun, numSamplesLastLogged, evalNodes, evalResults, evalResultsLastLogged);
 
                     for (int i = 0; i < evalResults.size(); i++)
@@ -242,12 +198,32 @@ public:
             dataReader->DataEnd();
         }
 
+        for (size_t i = 0; i < evalResults.size(); i++)
+            evalResults[i] = localEpochEvalErrors.GetCriterion(i);
+
         // show last batch of results
         if (m_traceLevel > 0 && numSamplesLastLogged > 0)
         {
             DisplayEvalStatistics(numMBsRunLastLogged + 1, numMBsRun, numSamplesLastLogged, evalNodes, evalResults, evalResultsLastLogged);
         }
 
+        // the sums over all ranks, with a single allreduce
+        if (useParallelTrain)
+        {
+            std::vector<double> sums;
+            for (const auto& evalResult : evalResults)
+            {
+                sums.push_back(evalResult.first);
+                sums.push_back((double) evalResult.second);
+            }
+            sums.push_back((double) totalEpochSamples);
+            m_mpi->AllReduce(sums);
+
+            for (size_t i = 0; i < evalResults.size(); i++)
+                evalResults[i] = EpochCriterion(sums[2 * i], (size_t) sums[2 * i + 1]);
+            totalEpochSamples = (size_t) sums.back();
+        }
+
         // final statistics
         for (int i = 0; i < evalResultsLastLogged.size(); i++)
             evalResultsLastLogged[i] = EpochCriterion(0); // clear this since statistics display will subtract the previous value
@@ -449,8 +425,7 @@ protected:
     MPIWrapperPtr m_mpi;
     bool m_enableDistributedMBReading;
 
-    std::shared_ptr<IDistGradAggregator<ElemType>> m_distGradAgg;
-    std::shared_ptr<struct DistGradHeader> m_gradHeader;
+    std::shared_ptr<struct DistGradHeader> m_gradHeader; // (EvaluateBN() only)
     int m_traceLevel;
     void operator=(const SimpleEvaluator&); // (not assignable)
 };
@@ -16,6 +16,12 @@
 #include <stdexcept>
 #include <fstream>
 #include <cstdio>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include "ProgressTracing.h"
 #include "ComputationNetworkBuilder.h"
 
@@ -23,18 +29,132 @@ using namespace std;
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// -----------------------------------------------------------------------
+// AsyncWriteQueue -- runs write jobs in order on a thread of its own
+// Submit() blocks while 'maxQueued' jobs are waiting, so that the copies of the values that the jobs hold stay bounded.
+// An error in a job is rethrown by the next Submit() or by Finish(); the jobs after it are dropped.
+// -----------------------------------------------------------------------
+
+class AsyncWriteQueue
+{
+public:
+    AsyncWriteQueue(size_t maxQueued)
+        : m_maxQueued(max(maxQueued, (size_t) 1)), m_finishing(false)
+    {
+        m_thread = thread([this]() { Run(); });
+    }
+
+    ~AsyncWriteQueue()
+    {
+        try
+        {
+            Finish();
+        }
+        catch (...) // must not throw from a destructor, which may run while unwinding
+        {
+        }
+    }
+
+    void Submit(function<void()>&& job)
+    {
+        unique_lock<mutex> lock(m_mutex);
+        m_changed.wait(lock, [this]() { return m_queue.size() < m_maxQueued || m_error; });
+        RethrowError();
+        m_queue.push_back(move(job));
+        m_changed.notify_all();
+    }
+
+    // wait until all jobs are done
+    void Finish()
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_finishing = true;
+            m_changed.notify_all();
+        }
+        if (m_thread.joinable())
+            m_thread.join();
+        lock_guard<mutex> lock(m_mutex);
+        RethrowError();
+    }
+
+private:
+    void Run()
+    {
+        for (;;)
+        {
+            function<void()> job;
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_changed.wait(lock, [this]() { return m_finishing || !m_queue.empty(); });
+                if (m_queue.empty())
+                    return;
+                job = move(m_queue.front());
+                m_queue.pop_front();
+                m_changed.notify_all();
+            }
+            try
+            {
+                job();
+            }
+            catch (...)
+            {
+                lock_guard<mutex> lock(m_mutex);
+                m_error = current_exception();
+                m_changed.notify_all();
+                return;
+            }
+        }
+    }
+
+    void RethrowError()
+    {
+        if (m_error)
+        {
+            auto error = m_error;
+            m_error = nullptr; // (once)
+            rethrow_exception(error);
+        }
+    }
+
+    const size_t m_maxQueued;
+    mutex m_mutex; // guards all below
+    condition_variable m_changed;
+    deque<function<void()>> m_queue;
+    bool m_finishing;
+    exception_ptr m_error;
+    thread m_thread;
+};
 
 template <class ElemType>
 class SimpleOutputWriter
 {
     typedef shared_ptr<ComputationNode<ElemType>> ComputationNodePtr;
 
+    // a copy of the value of an output node, which the next minibatch does not overwrite
+    struct OutputValues
+    {
+        unique_ptr<ElemType[]> m_data;
+        size_t m_numRows;
+        size_t m_numCols;
+        MBLayoutPtr m_pMBLayout; // (null if the node has none)
+    };
+
 public:
     SimpleOutputWriter(ComputationNetworkPtr net, int verbosity = 0)
-        : m_net(net), m_verbosity(verbosity)
+        : m_net(net), m_verbosity(verbosity), m_asyncWrite(false), m_binaryOutput(false)
     {
     }
 
+    // let WriteOutput() to an output path format and write the outputs of a minibatch on background threads, one per
+    // output file, while the next minibatches are evaluated. Up to two minibatches per file are waiting to be written.
+    void SetAsyncWrite(bool asyncWrite) { m_asyncWrite = asyncWrite; }
+
+    // let WriteOutput() to an output path write the values as they are instead of formatting them as text: for each
+    // sequence, its number of frames as an int64, then its frames (each a column of ElemTypes). Prologue, epilogue and
+    // separators are not written.
+    void SetBinaryOutput(bool binaryOutput) { m_binaryOutput = binaryOutput; }
+
     void WriteOutput(IDataReader& dataReader, size_t mbSize, IDataWriter& dataWriter, const std::vector<std::wstring>& outputNodeNames, size_t numOutputSamples = requestDataSize, bool doWriterUnitTest = false)
     {
         ScopedNetworkOperationMode modeGuard(m_net, NetworkOperationMode::inferring);
@@ -134,6 +254,67 @@ public:
             valueFormatString, gradient);
     }
 
+    shared_ptr<OutputValues> CopyOutputValues(const ComputationNodePtr& node)
+    {
+        auto values = make_shared<OutputValues>();
+        const auto& value = node->Value();
+        values->m_data.reset(value.CopyToArray());
+        values->m_numRows = value.GetNumRows();
+        values->m_numCols = value.GetNumCols();
+        if (node->HasMBLayout())
+        {
+            values->m_pMBLayout = make_shared<MBLayout>();
+            values->m_pMBLayout->CopyFrom(node->GetMBLayout());
+        }
+        return values;
+    }
+
+    void WriteOutputValues(FILE* f, const ComputationNodePtr& node, OutputValues& values,
+                           const WriteFormattingOptions& formattingOptions, const std::string& valueFormatString, const std::vector<std::string>& labelMapping,
+                           size_t numMBsRun)
+    {
+        if (m_binaryOutput)
+        {
+            WriteBinaryValues(f, values);
+            return;
+        }
+        const auto sequenceSeparator = formattingOptions.Processed(node->NodeName(), formattingOptions.sequenceSeparator, numMBsRun);
+        const auto sequencePrologue =  formattingOptions.Processed(node->NodeName(), formattingOptions.sequencePrologue,  numMBsRun);
+        const auto sequenceEpilogue =  formattingOptions.Processed(node->NodeName(), formattingOptions.sequenceEpilogue,  numMBsRun);
+        const auto elementSeparator =  formattingOptions.Processed(node->NodeName(), formattingOptions.elementSeparator,  numMBsRun);
+        const auto sampleSeparator =   formattingOptions.Processed(node->NodeName(), formattingOptions.sampleSeparator,   numMBsRun);
+
+        ComputationNode<ElemType>::WriteMinibatchDataWithFormatting(f, values.m_data.get(), values.m_numRows, values.m_numCols, node->GetSampleLayout(), values.m_pMBLayout,
+            FrameRange(), SIZE_MAX, SIZE_MAX, formattingOptions.transpose, formattingOptions.isCategoryLabel, formattingOptions.isSparse, labelMapping,
+            sequenceSeparator, sequencePrologue, sequenceEpilogue, elementSeparator, sampleSeparator, valueFormatString);
+    }
+
+    // see SetBinaryOutput()
+    static void WriteBinaryValues(FILE* f, const OutputValues& values)
+    {
+        if (!values.m_pMBLayout) // one sequence over all columns
+        {
+            int64_t numFrames = values.m_numCols;
+            fwriteOrDie(&numFrames, sizeof(numFrames), 1, f);
+            fwriteOrDie(values.m_data.get(), sizeof(ElemType), values.m_numRows * values.m_numCols, f);
+            return;
+        }
+        const auto& pMBLayout = values.m_pMBLayout;
+        const ptrdiff_t width = pMBLayout->GetNumTimeSteps();
+        for (const auto& seqInfo : pMBLayout->GetAllSequences())
+        {
+            if (seqInfo.seqId == GAP_SEQUENCE_ID)
+                continue;
+            const ptrdiff_t tBegin = max(seqInfo.tBegin, (ptrdiff_t) 0);
+            const ptrdiff_t tEnd = min((ptrdiff_t) seqInfo.tEnd, width);
+            int64_t numFrames = tEnd - tBegin;
+            fwriteOrDie(&numFrames, sizeof(numFrames), 1, f);
+            for (ptrdiff_t t = tBegin; t < tEnd; t++)
+                fwriteOrDie(values.m_data.get() + (t * pMBLayout->GetNumParallelSequences() + seqInfo.s) * values.m_numRows, sizeof(ElemType), values.m_numRows, f);
+        }
+        fflushOrDie(f);
+    }
+
     void InsertNode(std::vector<ComputationNodeBasePtr>& allNodes, ComputationNodeBasePtr parent, ComputationNodeBasePtr newNode)
     {
         newNode->SetInput(0, parent);
@@ -211,10 +392,25 @@ public:
             std::wstring nodeOutputPath = outputPath;
             if (nodeOutputPath != L"-")
                 nodeOutputPath += L"." + onode->NodeName();
-            auto f = make_shared<File>(nodeOutputPath, fileOptionsWrite | fileOptionsText);
+            auto f = make_shared<File>(nodeOutputPath, fileOptionsWrite | (m_binaryOutput ? fileOptionsBinary : fileOptionsText));
             outputStreams[onode] = f;
         }
 
+        // one write thread per file (all outputs go to stdout for "-"); the back-prop unit test writes in sequence
+        bool asyncWrite = m_asyncWrite && !nodeUnitTest;
+        std::map<ComputationNodeBasePtr, shared_ptr<AsyncWriteQueue>> writeQueues;
+        if (asyncWrite)
+        {
+            shared_ptr<AsyncWriteQueue> stdoutQueue;
+            for (auto & onode : outputNodes)
+            {
+                if (outputPath != L"-")
+                    writeQueues[onode] = make_shared<AsyncWriteQueue>(2);
+                else
+                    writeQueues[onode] = stdoutQueue ? stdoutQueue : (stdoutQueue = make_shared<AsyncWriteQueue>(2));
+            }
+        }
+
         // evaluate with minibatches
         dataReader.StartMinibatchLoop(mbSize, 0, inputMatrices.GetStreamDescriptions(), numOutputSamples);
 
@@ -225,7 +421,8 @@ public:
         for (auto & onode : outputNodes)
         {
             FILE* f = *outputStreams[onode];
-            fprintfOrDie(f, "%s", formattingOptions.prologue.c_str());
+            if (!m_binaryOutput)
+                fprintfOrDie(f, "%s", formattingOptions.prologue.c_str());
         }
 
         size_t actualMBSize;
@@ -245,7 +442,19 @@ public:
                 m_net->ForwardProp(onode);
 
                 FILE* file = *outputStreams[onode];
-                WriteMinibatch(file, dynamic_pointer_cast<ComputationNode<ElemType>>(onode), formattingOptions, formatChar, valueFormatString, labelMapping, numMBsRun, /* gradient */ false);
+                auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(onode);
+                if (asyncWrite) // format and write a copy of the value while the next minibatch is evaluated
+                {
+                    auto values = CopyOutputValues(node);
+                    writeQueues[onode]->Submit([this, file, node, values, &formattingOptions, valueFormatString, &labelMapping, numMBsRun]()
+                    {
+                        WriteOutputValues(file, node, *values, formattingOptions, valueFormatString, labelMapping, numMBsRun);
+                    });
+                }
+                else if (m_binaryOutput)
+                    WriteOutputValues(file, node, *CopyOutputValues(node), formattingOptions, valueFormatString, labelMapping, numMBsRun);
+                else
+                    WriteMinibatch(file, node, formattingOptions, formatChar, valueFormatString, labelMapping, numMBsRun, /* gradient */ false);
 
                 if (nodeUnitTest)
                     m_net->Backprop(onode);
@@ -269,8 +478,13 @@ public:
             totalEpochSamples += actualMBSize;
 
             fprintf(stderr, "Minibatch[%zu]: ActualMBSize = %zu\n", numMBsRun, actualMBSize);
-            if (outputPath == L"-") // if we mush all nodes together on stdout, add some visual separator
-                fprintf(stdout, "\n");
+            if (outputPath == L"-" && !m_binaryOutput) // if we mush all nodes together on stdout, add some visual separator
+            {
+                if (asyncWrite)
+                    writeQueues[outputNodes[0]]->Submit([]() { fprintf(stdout, "\n"); });
+                else
+                    fprintf(stdout, "\n");
+            }
 
             numItersSinceLastPrintOfProgress = ProgressTracing::TraceFakeProgress(numIterationsBeforePrintingProgress, numItersSinceLastPrintOfProgress);
 
@@ -279,10 +493,14 @@ public:
             dataReader.DataEnd();
         } // end loop over minibatches
 
+        for (auto & queue : writeQueues)
+            queue.second->Finish();
+
         for (auto & stream : outputStreams)
         {
             FILE* f = *stream.second;
-            fprintfOrDie(f, "%s", formattingOptions.epilogue.c_str());
+            if (!m_binaryOutput)
+                fprintfOrDie(f, "%s", formattingOptions.epilogue.c_str());
         }
 
         fprintf(stderr, "Written to %ls*\nTotal Samples Evaluated = %zu\n", outputPath.c_str(), totalEpochSamples);
@@ -295,6 +513,8 @@ public:
 private:
     ComputationNetworkPtr m_net;
     int m_verbosity;
+    bool m_asyncWrite;   // see SetAsyncWrite()
+    bool m_binaryOutput; // see SetBinaryOutput()
     void operator=(const SimpleOutputWriter&); // (not assignable)
 };
 
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "IDistGradAggregator.h"
+#include "TimerUtility.h"
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Sends only the largest gradient entries: the gradients are packed into buckets of about 'gradientBucketSizeInBytes'
+// (0: a single bucket), and each bucket is added to a residual of all that this node did not send so far (error feedback).
+// The entries of the largest magnitude, at most 'density' of the entries of the bucket and none below 'threshold', are
+// moved out of the residual (Matrix::ExtractLargestMagnitudes(), a radix select on the GPU), and all nodes gather the
+// (index, value) pairs of all nodes and sum them up. Gradients with little activity, where most entries are (nearly) zero,
+// thus cost a small fraction of the traffic of the dense allreduce of SimpleDistGradAggregator.
+template <class ElemType>
+class SparsifiedDistGradAggregator : public IDistGradAggregator<ElemType>
+{
+    UsingIDistGradAggregatorMembers;
+
+public:
+    SparsifiedDistGradAggregator(const MPIWrapperPtr& mpi, double density, double threshold, int syncStatsTrace, size_t gradientBucketSizeInBytes = 0)
+        : IDistGradAggregator<ElemType>(mpi), m_density(density), m_threshold((ElemType) threshold), m_syncStatsTrace(syncStatsTrace), m_iterationCount(0),
+          m_gradientBucketSizeInBytes(gradientBucketSizeInBytes)
+    {
+        if (!(density > 0 && density <= 1))
+            InvalidArgument("SparsifiedDistGradAggregator: The gradient density must be in (0, 1].");
+        if (!(threshold >= 0))
+            InvalidArgument("SparsifiedDistGradAggregator: The gradient threshold must not be negative.");
+    }
+
+    bool AggregateGradients(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, bool resetState) override
+    {
+        for (auto gradient : gradients)
+        {
+            if (gradient->GetMatrixType() != DENSE)
+                RuntimeError("SparsifiedDistGradAggregator: Only dense gradient matrices are supported.");
+        }
+
+        if (m_buckets.empty() && !gradients.empty())
+            CreateBuckets(gradients);
+        else if (resetState)
+        {
+            for (auto& bucket : m_buckets)
+                bucket.m_residual->SetValue(0);
+        }
+
+        bool showSyncPerfStats = (m_syncStatsTrace > 0) && ((m_iterationCount % m_syncStatsTrace) == 0);
+        m_iterationCount++;
+        Timer aggregationTimer;
+        if (showSyncPerfStats)
+        {
+            std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(gradients[0]->GetDeviceId()));
+            mainStreamSyncEvent->SynchronizeEvent();
+            aggregationTimer.Start();
+        }
+
+        // The header is summed up with a single allreduce of its fields, which overlaps with the selection of the first bucket
+        PackHeader(headerCPU, m_headerBuffer);
+        MPI_Request headerRequest;
+        MPI_Iallreduce(MPI_IN_PLACE, m_headerBuffer.data(), (int) m_headerBuffer.size(), MPI_DOUBLE, MPI_SUM, m_mpi->Communicator(), &headerRequest) || MpiFail("MPI_Iallreduce");
+
+        // A node that did not process any samples sends only from its residual
+        bool contribute = (headerCPU->numSamples != 0);
+        size_t numSent = 0, numElements = 0;
+        for (auto& bucket : m_buckets)
+        {
+            for (size_t i = 0; i < bucket.m_gradients.size(); i++)
+            {
+                Matrix<ElemType>* gradient = bucket.m_gradients[i];
+                if (contribute)
+                {
+                    auto residual = bucket.m_residual->ColumnSlice(bucket.m_offsets[i], gradient->GetNumElements());
+                    Matrix<ElemType>::ScaleAndAdd(1, gradient->Reshaped(1, gradient->GetNumElements()), residual);
+                }
+            }
+
+            size_t k = std::max<size_t>(1, (size_t) ceil(m_density * bucket.m_numElements));
+            bucket.m_residual->ExtractLargestMagnitudes(k, m_threshold, m_indices, m_values);
+            m_mpi->AllGather(m_indices, m_gatheredIndices);
+            m_mpi->AllGather(m_values, m_gatheredValues);
+            numSent += m_indices.size();
+            numElements += bucket.m_numElements;
+
+            auto sum = m_sum->ColumnSlice(0, bucket.m_numElements);
+            sum.SetValue(0);
+            sum.AddValuesAtIndices(m_gatheredIndices, m_gatheredValues);
+            for (size_t i = 0; i < bucket.m_gradients.size(); i++)
+            {
+                Matrix<ElemType>* gradient = bucket.m_gradients[i];
+                gradient->AssignValuesOf(sum.ColumnSlice(bucket.m_offsets[i], gradient->GetNumElements()).Reshaped(gradient->GetNumRows(), gradient->GetNumCols()));
+            }
+        }
+
+        MPI_Wait(&headerRequest, MPI_STATUS_IGNORE) || MpiFail("MPI_Wait");
+        UnpackHeader(headerCPU, m_headerBuffer);
+
+        if (showSyncPerfStats)
+        {
+            std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(gradients[0]->GetDeviceId()));
+            mainStreamSyncEvent->SynchronizeEvent();
+            aggregationTimer.Stop();
+            fprintf(stderr, "Actual gradient aggregation time: %.6g (%.3g%% of the gradient entries sent)\n",
+                    aggregationTimer.ElapsedSeconds(), numElements > 0 ? 100.0 * numSent / numElements : 0.0);
+        }
+
+        return (headerCPU->numSamples != 0);
+    }
+
+private:
+    // A contiguous group of gradients whose largest entries are selected together
+    struct GradientBucket
+    {
+        std::vector<Matrix<ElemType>*> m_gradients;
+        std::vector<size_t> m_offsets;                // of the gradients inside the residual
+        size_t m_numElements;
+        std::unique_ptr<Matrix<ElemType>> m_residual; // [1 x m_numElements], what this node has not sent yet
+    };
+
+    void CreateBuckets(const std::vector<Matrix<ElemType>*>& gradients)
+    {
+        int deviceId = gradients[0]->GetDeviceId();
+        size_t maxNumElements = 0;
+        for (auto gradient : gradients)
+        {
+            size_t numElements = gradient->GetNumElements();
+            if (m_buckets.empty() || (m_gradientBucketSizeInBytes > 0 && (m_buckets.back().m_numElements + numElements) * sizeof(ElemType) > m_gradientBucketSizeInBytes))
+            {
+                m_buckets.push_back(GradientBucket());
+                m_buckets.back().m_numElements = 0;
+            }
+
+            GradientBucket& bucket = m_buckets.back();
+            bucket.m_gradients.push_back(gradient);
+            bucket.m_offsets.push_back(bucket.m_numElements);
+            bucket.m_numElements += numElements;
+            maxNumElements = std::max(maxNumElements, bucket.m_numElements);
+        }
+
+        for (auto& bucket : m_buckets)
+        {
+            bucket.m_residual.reset(new Matrix<ElemType>(1, bucket.m_numElements, deviceId));
+            bucket.m_residual->SetValue(0);
+        }
+        m_sum.reset(new Matrix<ElemType>(1, maxNumElements, deviceId));
+    }
+
+    double m_density;     // fraction of the entries of a bucket that are sent at most
+    ElemType m_threshold; // smallest magnitude that is sent
+    int m_syncStatsTrace;
+    size_t m_iterationCount;
+
+    size_t m_gradientBucketSizeInBytes;
+    std::vector<GradientBucket> m_buckets;
+    std::unique_ptr<Matrix<ElemType>> m_sum; // the aggregated bucket, before it is unpacked into the gradients
+
+    // the selected entries of a bucket on this node, and of all nodes
+    std::vector<int> m_indices, m_gatheredIndices;
+    std::vector<ElemType> m_values, m_gatheredValues;
+
+    std::vector<double> m_headerBuffer; // the header in the layout of PackHeader(), as reduced across nodes
+};
+
+} } }
@@ -0,0 +1,214 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// StragglerMonitor.h -- per-rank timing of distributed training, to tell which rank the others wait for
+//
+#pragma once
+
+#include "Basics.h"
+#include "MPIWrapper.h"
+#include "ProgressTracing.h"
+#include <algorithm>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Each rank adds the samples it processed and the seconds it spent reading, computing and waiting in the exchanges of
+// the gradients (or of the model) to the values summed up by the allreduce of the DistGradHeader: every rank writes its
+// own slots of a per-rank array and zeros into those of the others, so that the sum gives all ranks the values of all
+// ranks, without a collective of its own. The wait is that of the previous exchange, which is not over yet when the
+// values are sent.
+// From these, all ranks keep the same rolling (exponentially weighted) per-rank statistics. A rank is a straggler if
+// the time it spends outside the exchanges, reading and computing, is more than 'threshold' times the median of all
+// ranks for 'minExchanges' exchanges in a row, and stops being one once that is less than half way to the threshold.
+// The main node logs both, and the per-rank breakdown at the end of each epoch.
+// Unless perfTraceLevel > 0 synchronizes the device before the exchange, the wait includes the rest of the device work
+// of the rank; either way, the rank the others wait for is the one that waits least.
+// GetWorkerShares() gives each rank a share of the data in proportion to the samples per second it processes, the
+// same on all ranks, since they have the same values.
+class StragglerMonitor
+{
+public:
+    StragglerMonitor(size_t numRanks, size_t rank, double threshold, size_t minExchanges)
+        : m_numRanks(numRanks), m_rank(rank), m_threshold(threshold), m_minExchanges(minExchanges),
+          m_average(numRanks * NumValues, 0), m_epochTotals(numRanks * NumValues, 0),
+          m_numExchanges(0), m_numEpochExchanges(0), m_slowInARow(numRanks, 0), m_isStraggler(numRanks, false)
+    {
+        if (!(threshold > 1))
+            InvalidArgument("StragglerMonitor: The threshold must be greater than 1.");
+        std::fill(m_local, m_local + NumValues, 0.0);
+    }
+
+    // of this rank, since the values were last sent
+    void AddLocal(size_t samples, double readSeconds, double computeSeconds, double waitSeconds)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_local[Samples] += samples;
+        m_local[ReadSeconds] += readSeconds;
+        m_local[ComputeSeconds] += computeSeconds;
+        m_local[WaitSeconds] += waitSeconds;
+    }
+
+    size_t NumPackedValues() const
+    {
+        return m_numRanks * NumValues;
+    }
+
+    // Writes the values of this rank into its slots and zeros into the others, and starts over with the local values.
+    void Pack(double* values)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        std::fill(values, values + NumPackedValues(), 0.0);
+        std::copy(m_local, m_local + NumValues, values + m_rank * NumValues);
+        std::fill(m_local, m_local + NumValues, 0.0);
+    }
+
+    // the sum of Pack() over all ranks
+    void Unpack(const double* values)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        const double weight = m_numExchanges == 0 ? 1.0 : 0.1; // (about the last 10 exchanges)
+        for (size_t i = 0; i < NumPackedValues(); i++)
+        {
+            m_average[i] += weight * (values[i] - m_average[i]);
+            m_epochTotals[i] += values[i];
+        }
+        m_numExchanges++;
+        m_numEpochExchanges++;
+        DetectStragglers();
+    }
+
+    // for the exchanges that have no header to go with, e.g. those of model averaging; a collective of all ranks
+    void Exchange(const MPIWrapper& mpi)
+    {
+        std::vector<double> values(NumPackedValues());
+        Pack(values.data());
+        mpi.AllReduce(values);
+        Unpack(values.data());
+    }
+
+    void StartEpoch()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        std::fill(m_epochTotals.begin(), m_epochTotals.end(), 0.0);
+        m_numEpochExchanges = 0;
+    }
+
+    // On the main node, the time per exchange of each rank since StartEpoch().
+    void LogEpoch(int epoch) const
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_rank != 0 || m_numEpochExchanges == 0)
+            return;
+        LOGPRINTF(stderr, "Epoch[%2d]: Time per exchange of each rank (%d exchanges):\n", epoch + 1, (int) m_numEpochExchanges);
+        for (size_t r = 0; r < m_numRanks; r++)
+        {
+            const double* totals = &m_epochTotals[r * NumValues];
+            const double busySeconds = totals[ReadSeconds] + totals[ComputeSeconds];
+            LOGPRINTF(stderr, "\trank %d: read = %.3fms; compute = %.3fms; wait = %.3fms; %.1f samples/s outside the waits%s\n", (int) r,
+                      1000 * totals[ReadSeconds] / m_numEpochExchanges, 1000 * totals[ComputeSeconds] / m_numEpochExchanges,
+                      1000 * totals[WaitSeconds] / m_numEpochExchanges, busySeconds > 0 ? totals[Samples] / busySeconds : 0.0,
+                      m_isStraggler[r] ? " (straggler)" : "");
+        }
+    }
+
+    // The share of the data of each rank, in proportion to its rolling samples per second outside the exchanges, but at
+    // least half of an equal share. Empty before the first exchange.
+    std::vector<double> GetWorkerShares() const
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        std::vector<double> shares;
+        if (m_numExchanges == 0)
+            return shares;
+        double total = 0;
+        for (size_t r = 0; r < m_numRanks; r++)
+        {
+            const double busySeconds = BusySeconds(r);
+            if (!(busySeconds > 0) || !(m_average[r * NumValues + Samples] > 0))
+                return std::vector<double>(); // (a rank without samples gives no rate to go by)
+            shares.push_back(m_average[r * NumValues + Samples] / busySeconds);
+            total += shares.back();
+        }
+        double floorTotal = 0;
+        for (auto& share : shares)
+        {
+            share = std::max(share / total, 0.5 / m_numRanks);
+            floorTotal += share;
+        }
+        for (auto& share : shares)
+            share /= floorTotal;
+        return shares;
+    }
+
+    bool IsStraggler(size_t rank) const
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_isStraggler[rank];
+    }
+
+private:
+    enum Value
+    {
+        Samples,
+        ReadSeconds,
+        ComputeSeconds,
+        WaitSeconds,
+        NumValues
+    };
+
+    double BusySeconds(size_t rank) const
+    {
+        return m_average[rank * NumValues + ReadSeconds] + m_average[rank * NumValues + ComputeSeconds];
+    }
+
+    void DetectStragglers()
+    {
+        std::vector<double> busySeconds(m_numRanks);
+        for (size_t r = 0; r < m_numRanks; r++)
+            busySeconds[r] = BusySeconds(r);
+        std::vector<double> sorted = busySeconds;
+        // (the lower one of an even number of ranks, so that of two ranks, the slower one is compared with the faster one)
+        std::nth_element(sorted.begin(), sorted.begin() + (m_numRanks - 1) / 2, sorted.end());
+        const double median = sorted[(m_numRanks - 1) / 2];
+        if (!(median > 0))
+            return;
+
+        for (size_t r = 0; r < m_numRanks; r++)
+        {
+            const double ratio = busySeconds[r] / median;
+            m_slowInARow[r] = ratio > m_threshold ? m_slowInARow[r] + 1 : 0;
+            if (!m_isStraggler[r] && m_slowInARow[r] >= m_minExchanges)
+            {
+                m_isStraggler[r] = true;
+                if (m_rank == 0)
+                    LOGPRINTF(stderr, "StragglerMonitor: Rank %d is a straggler: %.3fms reading and computing per exchange, %.2f times the median of the ranks (%.3fms).\n",
+                              (int) r, 1000 * busySeconds[r], ratio, 1000 * median);
+            }
+            else if (m_isStraggler[r] && ratio < (1 + m_threshold) / 2)
+            {
+                m_isStraggler[r] = false;
+                if (m_rank == 0)
+                    LOGPRINTF(stderr, "StragglerMonitor: Rank %d is no longer a straggler: %.2f times the median of the ranks.\n", (int) r, ratio);
+            }
+        }
+    }
+
+    const size_t m_numRanks;
+    const size_t m_rank;
+    const double m_threshold;
+    const size_t m_minExchanges;
+
+    mutable std::mutex m_lock; // (the exchanges of asynchronous aggregation run on a thread of their own)
+    double m_local[NumValues];
+    std::vector<double> m_average;     // per rank and value, rolling over the exchanges
+    std::vector<double> m_epochTotals; // per rank and value, since StartEpoch()
+    size_t m_numExchanges;
+    size_t m_numEpochExchanges;
+    std::vector<size_t> m_slowInARow;
+    std::vector<bool> m_isStraggler;
+};
+
+}}}
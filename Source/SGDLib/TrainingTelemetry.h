@@ -0,0 +1,124 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// TrainingTelemetry.h -- structured training progress for monitoring, one JSON object per line
+//
+#pragma once
+
+#include "Basics.h"
+#include "fileutil.h"
+#include "ReaderStatistics.h"
+#include <chrono>
+#include <stdio.h>
+#include <string>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Writes what SGD logs at each progress line (samples/s, the criteria) together with where the time went and the
+// memory in use, as one JSON object per line, so that jobs can be monitored without scraping their logs:
+//   {"time":..., "rank":0, "epoch":1, "minibatch":[1,10], "samples":..., "samplesPerSecond":..., "loss":...,
+//    "seconds":{"total":..., "read":..., "aggregation":..., "compute":..., "update":...},
+//    "reader":{"wait":..., "samples":...}, "memory":{"deviceFree":..., "deviceUsed":..., "poolFixed":..., "poolPerSample":...}}
+// The phases are summed over the minibatches since the last line. Read and aggregation are host-side waits and are
+// always timed; compute and update are only timed (and written) with perfTraceLevel > 0, which synchronizes the
+// device after each phase. Nothing else is added to the minibatch loop, so the overhead is that of the progress lines.
+// The file is appended to, so that a restarted job continues it.
+class TrainingTelemetry
+{
+public:
+    TrainingTelemetry(const std::wstring& fileName, int rank, bool phasesSynchronized)
+        : m_rank(rank), m_phasesSynchronized(phasesSynchronized)
+    {
+        m_file = fopenOrDie(fileName, L"a");
+        ResetPhases();
+    }
+
+    ~TrainingTelemetry()
+    {
+        fclose(m_file);
+    }
+
+    // per minibatch, in seconds
+    void AddMinibatch(double readSeconds, double computeSeconds, double aggregationSeconds, double updateSeconds)
+    {
+        m_readSeconds += readSeconds;
+        m_computeSeconds += computeSeconds;
+        m_aggregationSeconds += aggregationSeconds;
+        m_updateSeconds += updateSeconds;
+    }
+
+    struct Sample
+    {
+        Sample()
+            : epoch(0), firstMinibatch(0), lastMinibatch(0), samples(0), seconds(0), loss(0), learningRatePerSample(0),
+              haveReaderStatistics(false), deviceFreeBytes(0), deviceUsedBytes(0), poolFixedBytes(0), poolBytesPerSample(0)
+        {
+        }
+
+        int epoch;                // 1-based
+        size_t firstMinibatch;    // 1-based, inclusive
+        size_t lastMinibatch;
+        size_t samples;           // of all workers, since the last line
+        double seconds;           // wall clock time of these samples
+        double loss;              // training criterion per sample
+        double learningRatePerSample;
+        bool haveReaderStatistics;
+        ReaderStatistics reader;
+        size_t deviceFreeBytes;   // 0 on the CPU
+        size_t deviceUsedBytes;
+        size_t poolFixedBytes;    // planned by the MatrixPool
+        size_t poolBytesPerSample;
+    };
+
+    // Writes a line with the phases since the last one, and resets them.
+    void Write(const Sample& sample)
+    {
+        double time = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+        fprintf(m_file, "{\"time\":%.3f,\"rank\":%d,\"epoch\":%d,\"minibatch\":[%d,%d],\"samples\":%llu,\"samplesPerSecond\":%.1f,\"loss\":%s,\"learningRatePerSample\":%.6g",
+                time, m_rank, sample.epoch, (int) sample.firstMinibatch, (int) sample.lastMinibatch, (unsigned long long) sample.samples,
+                sample.seconds > 0 ? sample.samples / sample.seconds : 0.0, JsonNumber(sample.loss).c_str(), sample.learningRatePerSample);
+        fprintf(m_file, ",\"seconds\":{\"total\":%.6g,\"read\":%.6g,\"aggregation\":%.6g", sample.seconds, m_readSeconds, m_aggregationSeconds);
+        if (m_phasesSynchronized)
+            fprintf(m_file, ",\"compute\":%.6g,\"update\":%.6g", m_computeSeconds, m_updateSeconds);
+        fprintf(m_file, "}");
+        if (sample.haveReaderStatistics)
+        {
+            fprintf(m_file, ",\"reader\":{\"wait\":%.6g,\"minibatches\":%llu,\"samples\":%llu,\"bytes\":%llu}",
+                    sample.reader.m_waitSeconds, (unsigned long long) sample.reader.m_minibatches, (unsigned long long) sample.reader.m_samples, (unsigned long long) sample.reader.m_bytes);
+        }
+        fprintf(m_file, ",\"memory\":{\"deviceFree\":%llu,\"deviceUsed\":%llu,\"poolFixed\":%llu,\"poolPerSample\":%llu}}\n",
+                (unsigned long long) sample.deviceFreeBytes, (unsigned long long) sample.deviceUsedBytes,
+                (unsigned long long) sample.poolFixedBytes, (unsigned long long) sample.poolBytesPerSample);
+        fflush(m_file);
+        ResetPhases();
+    }
+
+    DISABLE_COPY_AND_MOVE(TrainingTelemetry);
+
+private:
+    void ResetPhases()
+    {
+        m_readSeconds = m_computeSeconds = m_aggregationSeconds = m_updateSeconds = 0;
+    }
+
+    // JSON has no NaN or Inf
+    static std::string JsonNumber(double value)
+    {
+        if (value != value || value - value != 0)
+            return "null";
+        char buffer[32];
+        sprintf(buffer, "%.7g", value);
+        return buffer;
+    }
+
+    FILE* m_file;
+    int m_rank;
+    bool m_phasesSynchronized;
+    double m_readSeconds;
+    double m_computeSeconds;
+    double m_aggregationSeconds;
+    double m_updateSeconds;
+};
+
+}}}
@@ -7,6 +7,8 @@
 #include "ssematrix.h"
 #include "Matrix.h"
 #include "CUDAPageLockedMemAllocator.h"
+#include "GPUDataTransferer.h"
+#include "MatrixQuantizerImpl.h"
 
 #include <memory>
 #include <vector>
@@ -126,31 +128,14 @@ public:
             assert(T == pMBLayout->GetNumTimeSteps());
         }
 
-        size_t mapi = 0; // parallel-sequence index for utterance [i]
-        // cal gamma for each utterance
-        size_t ts = 0;
-        for (size_t i = 0; i < lattices.size(); i++)
+        // first time step of each utterance within its parallel sequence
+        std::vector<size_t> uttbegins(lattices.size());
+        if (samplesInRecurrentStep > 1)
         {
-            const size_t numframes = lattices[i]->getnumframes();
-
-            msra::dbn::matrixstripe predstripe(pred, ts, numframes);           // logLLs for this utterance
-            msra::dbn::matrixstripe dengammasstripe(dengammas, ts, numframes); // denominator gammas
-
-            if (samplesInRecurrentStep == 1) // no sequence parallelism
+            for (size_t i = 0; i < lattices.size(); i++)
             {
-                tempmatrix = loglikelihood.ColumnSlice(ts, numframes);
-                // if (m_deviceid == CPUDEVICE)
-                {
-                    CopyFromCNTKMatrixToSSEMatrix(tempmatrix, numframes, predstripe);
-                }
-
-                if (m_deviceid != CPUDEVICE)
-                    parallellattice.setloglls(tempmatrix);
-            }
-            else // multiple parallel sequences
-            {
-                // get number of frames for the utterance
-                mapi = extrauttmap[i]; // parallel-sequence index; in case of >1 utterance within this parallel sequence, this is in order of concatenation
+                const size_t numframes = lattices[i]->getnumframes();
+                const size_t mapi = extrauttmap[i]; // parallel-sequence index; in case of >1 utterance within this parallel sequence, this is in order of concatenation
 
                 // scan MBLayout for end of utterance
                 size_t mapframenum = SIZE_MAX; // duration of utterance [i] as determined from MBLayout
@@ -169,21 +154,50 @@ public:
                     LogicError("gammacalculation: IsEnd() not working, numframes (%d) vs. mapframenum (%d)", (int) numframes, (int) mapframenum);
                 assert(numframes == mapframenum);
 
+                uttbegins[i] = validframes[mapi];
+                validframes[mapi] += numframes; // advance the cursor within the parallel sequence
+            }
+        }
+
+        // On a GPU, the logLLs of utterance [i + 1] are copied down while the lattice of utterance [i] is processed (see StartLLsTransfer()).
+        const bool overlaptransfers = (m_deviceid != CPUDEVICE);
+        if (overlaptransfers && !lattices.empty())
+            StartLLsTransfer(0, loglikelihood, lattices[0]->getnumframes(), 0, samplesInRecurrentStep > 1 ? extrauttmap[0] : 0, uttbegins[0], samplesInRecurrentStep);
+
+        size_t mapi = 0; // parallel-sequence index for utterance [i]
+        // cal gamma for each utterance
+        size_t ts = 0;
+        for (size_t i = 0; i < lattices.size(); i++)
+        {
+            const size_t numframes = lattices[i]->getnumframes();
+            if (samplesInRecurrentStep > 1)
+                mapi = extrauttmap[i];
+
+            msra::dbn::matrixstripe predstripe(pred, ts, numframes);           // logLLs for this utterance
+            msra::dbn::matrixstripe dengammasstripe(dengammas, ts, numframes); // denominator gammas
+
+            if (overlaptransfers)
+            {
+                LLsTransfer& transfer = m_llsTransfers[i % 2];
+                transfer.m_transferer->WaitForCopyGPUToCPUAsync();
+                CopyFromBufferToSSEMatrix(transfer.m_hostLLs.get(), numrows, numframes, predstripe);
+                parallellattice.setloglls(transfer.m_deviceLLs);
+                if (i + 1 < lattices.size())
+                    StartLLsTransfer(i + 1, loglikelihood, lattices[i + 1]->getnumframes(), ts + numframes, samplesInRecurrentStep > 1 ? extrauttmap[i + 1] : 0, uttbegins[i + 1], samplesInRecurrentStep);
+            }
+            else if (samplesInRecurrentStep == 1) // no sequence parallelism
+            {
+                tempmatrix = loglikelihood.ColumnSlice(ts, numframes);
+                CopyFromCNTKMatrixToSSEMatrix(tempmatrix, numframes, predstripe);
+            }
+            else // multiple parallel sequences
+            {
                 if (numframes > tempmatrix.GetNumCols())
                     tempmatrix.Resize(numrows, numframes);
 
-                Microsoft::MSR::CNTK::Matrix<ElemType> loglikelihoodForCurrentParallelUtterance = loglikelihood.ColumnSlice(mapi + (validframes[mapi] * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
+                Microsoft::MSR::CNTK::Matrix<ElemType> loglikelihoodForCurrentParallelUtterance = loglikelihood.ColumnSlice(mapi + (uttbegins[i] * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
                 tempmatrix.CopyColumnsStrided(loglikelihoodForCurrentParallelUtterance, numframes, samplesInRecurrentStep, 1);
-
-                // if (doreferencealign || m_deviceid == CPUDEVICE)
-                {
-                    CopyFromCNTKMatrixToSSEMatrix(tempmatrix, numframes, predstripe);
-                }
-
-                if (m_deviceid != CPUDEVICE)
-                {
-                    parallellattice.setloglls(tempmatrix);
-                }
+                CopyFromCNTKMatrixToSSEMatrix(tempmatrix, numframes, predstripe);
             }
 
             array_ref<size_t> uidsstripe(&uids[ts], numframes);
@@ -227,7 +241,7 @@ public:
             // set gamma for multi channel
             if (samplesInRecurrentStep > 1)
             {
-                Microsoft::MSR::CNTK::Matrix<ElemType> gammaFromLatticeForCurrentParallelUtterance = gammafromlattice.ColumnSlice(mapi + (validframes[mapi] * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
+                Microsoft::MSR::CNTK::Matrix<ElemType> gammaFromLatticeForCurrentParallelUtterance = gammafromlattice.ColumnSlice(mapi + (uttbegins[i] * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
                 gammaFromLatticeForCurrentParallelUtterance.CopyColumnsStrided(tempmatrix, numframes, 1, samplesInRecurrentStep);
             }
 
@@ -237,13 +251,11 @@ public:
                 {
                     size_t uid = uidsstripe[nframe];
                     if (samplesInRecurrentStep > 1)
-                        labels(uid, (nframe + validframes[mapi]) * samplesInRecurrentStep + mapi) = 1.0;
+                        labels(uid, (nframe + uttbegins[i]) * samplesInRecurrentStep + mapi) = 1.0;
                     else
                         labels(uid, ts + nframe) = 1.0;
                 }
             }
-            if (samplesInRecurrentStep > 1)
-                validframes[mapi] += numframes; // advance the cursor within the parallel sequence
             fprintf(stderr, "dengamma value %f\n", denavlogp);
             ts += numframes;
         }
@@ -251,27 +263,63 @@ public:
     }
 
 private:
-    // Helper methods for copying between ssematrix objects and CNTK matrices
-    void CopyFromCNTKMatrixToSSEMatrix(const Microsoft::MSR::CNTK::Matrix<ElemType>& src, size_t numCols, msra::math::ssematrixbase& dest)
+    // The logLLs of an utterance, on their way to the host (for the numerator scores and the parts of the lattice pass that run on
+    // the CPU). There are two of these, used by alternate utterances, so that one can be copied while the other one is in use.
+    struct LLsTransfer
     {
-        if (!std::is_same<ElemType, float>::value)
+        Microsoft::MSR::CNTK::Matrix<ElemType> m_deviceLLs;        // the logLLs of the utterance, contiguous (a view into the minibatch or into m_deviceLLsStorage)
+        Microsoft::MSR::CNTK::Matrix<ElemType> m_deviceLLsStorage; // for utterances of parallel sequences, whose columns are strided in the minibatch
+        std::shared_ptr<ElemType> m_hostLLs;                       // pinned
+        size_t m_hostLLsSize;
+        std::unique_ptr<Microsoft::MSR::CNTK::GPUDataTransferer<ElemType>> m_transferer;
+
+        LLsTransfer()
+            : m_deviceLLs(CPUDEVICE), m_deviceLLsStorage(CPUDEVICE), m_hostLLsSize(0)
         {
-            LogicError("Cannot copy between a SSE matrix and a non-float type CNTK Matrix object!");
         }
+    };
 
-        size_t numRows = src.GetNumRows();
-        const Microsoft::MSR::CNTK::Matrix<ElemType> srcSlice = src.ColumnSlice(0, numCols);
-        if ((m_intermediateCUDACopyBuffer == nullptr) || (m_intermediateCUDACopyBufferSize < srcSlice.GetNumElements()))
+    // Starts copying the logLLs of utterance [i] to the pinned buffer of m_llsTransfers[i % 2], on the fetch stream of
+    // GPUDataTransferer, after the work issued so far to the compute stream. The utterance starts at column 'ts' without
+    // sequence parallelism, else at time step 'uttbegin' of parallel sequence 'mapi'.
+    void StartLLsTransfer(size_t i, const Microsoft::MSR::CNTK::Matrix<ElemType>& loglikelihood, size_t numframes, size_t ts,
+                          size_t mapi, size_t uttbegin, size_t samplesInRecurrentStep)
+    {
+        LLsTransfer& transfer = m_llsTransfers[i % 2];
+        const size_t numrows = loglikelihood.GetNumRows();
+
+        if (samplesInRecurrentStep == 1)
+            transfer.m_deviceLLs = loglikelihood.ColumnSlice(ts, numframes);
+        else
         {
-            m_intermediateCUDACopyBuffer = AllocateIntermediateBuffer(srcSlice.GetDeviceId(), srcSlice.GetNumElements());
-            m_intermediateCUDACopyBufferSize = srcSlice.GetNumElements();
+            if (transfer.m_deviceLLsStorage.GetDeviceId() != m_deviceid)
+                transfer.m_deviceLLsStorage = Microsoft::MSR::CNTK::Matrix<ElemType>(m_deviceid);
+            if (numframes > transfer.m_deviceLLsStorage.GetNumCols())
+                transfer.m_deviceLLsStorage.Resize(numrows, numframes);
+            Microsoft::MSR::CNTK::Matrix<ElemType> loglikelihoodForParallelUtterance = loglikelihood.ColumnSlice(mapi + (uttbegin * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
+            transfer.m_deviceLLsStorage.CopyColumnsStrided(loglikelihoodForParallelUtterance, numframes, samplesInRecurrentStep, 1);
+            transfer.m_deviceLLs = transfer.m_deviceLLsStorage.ColumnSlice(0, numframes);
         }
 
-        ElemType* pBuf = m_intermediateCUDACopyBuffer.get();
-        srcSlice.CopyToArray(pBuf, m_intermediateCUDACopyBufferSize);
-        if (pBuf != m_intermediateCUDACopyBuffer.get())
+        if (!transfer.m_hostLLs || transfer.m_hostLLsSize < numrows * numframes)
         {
-            LogicError("Unexpected re-allocation of destination CPU buffer in Matrix::CopyToArray!");
+            transfer.m_hostLLs = AllocateIntermediateBuffer(m_deviceid, numrows * numframes);
+            transfer.m_hostLLsSize = numrows * numframes;
+        }
+        if (!transfer.m_transferer)
+            transfer.m_transferer.reset(new Microsoft::MSR::CNTK::GPUDataTransferer<ElemType>(m_deviceid, /*useConcurrentStreams=*/true));
+
+        std::unique_ptr<Microsoft::MSR::CNTK::MatrixComputeStreamEvent> computeStreamEvent(Microsoft::MSR::CNTK::MatrixComputeStreamEvent::Create(m_deviceid));
+        computeStreamEvent->SynchronizeDataTransferFetchStreamWithEvent<ElemType>();
+        transfer.m_transferer->CopyGPUToCPUAsync(transfer.m_deviceLLs.Data(), numrows * numframes, transfer.m_hostLLs.get());
+    }
+
+    // Helper methods for copying between ssematrix objects and CNTK matrices
+    void CopyFromBufferToSSEMatrix(const ElemType* pBuf, size_t numRows, size_t numCols, msra::math::ssematrixbase& dest)
+    {
+        if (!std::is_same<ElemType, float>::value)
+        {
+            LogicError("Cannot copy between a SSE matrix and a non-float type CNTK Matrix object!");
         }
 
         if ((dest.getcolstride() == dest.rows()) && (numRows == dest.rows()))
@@ -288,6 +336,26 @@ private:
         }
     }
 
+    void CopyFromCNTKMatrixToSSEMatrix(const Microsoft::MSR::CNTK::Matrix<ElemType>& src, size_t numCols, msra::math::ssematrixbase& dest)
+    {
+        size_t numRows = src.GetNumRows();
+        const Microsoft::MSR::CNTK::Matrix<ElemType> srcSlice = src.ColumnSlice(0, numCols);
+        if ((m_intermediateCUDACopyBuffer == nullptr) || (m_intermediateCUDACopyBufferSize < srcSlice.GetNumElements()))
+        {
+            m_intermediateCUDACopyBuffer = AllocateIntermediateBuffer(srcSlice.GetDeviceId(), srcSlice.GetNumElements());
+            m_intermediateCUDACopyBufferSize = srcSlice.GetNumElements();
+        }
+
+        ElemType* pBuf = m_intermediateCUDACopyBuffer.get();
+        srcSlice.CopyToArray(pBuf, m_intermediateCUDACopyBufferSize);
+        if (pBuf != m_intermediateCUDACopyBuffer.get())
+        {
+            LogicError("Unexpected re-allocation of destination CPU buffer in Matrix::CopyToArray!");
+        }
+
+        CopyFromBufferToSSEMatrix(pBuf, numRows, numCols, dest);
+    }
+
     void CopyFromSSEMatrixToCNTKMatrix(const msra::math::ssematrixbase& src, size_t numRows, size_t numCols, Microsoft::MSR::CNTK::Matrix<ElemType>& dest, int deviceId)
     {
         if (!std::is_same<ElemType, float>::value)
@@ -381,6 +449,7 @@ private:
     std::unique_ptr<Microsoft::MSR::CNTK::CUDAPageLockedMemAllocator> m_cudaAllocator;
     std::shared_ptr<ElemType> m_intermediateCUDACopyBuffer;
     size_t m_intermediateCUDACopyBufferSize;
+    LLsTransfer m_llsTransfers[2]; // (GPU only)
 };
 
 }}
@@ -23,7 +23,7 @@ void latticefunctionsops::edgealignment(const vectorref<lrhmmdef>& hmms, const v
 }
 
 void latticefunctionsops::forwardbackwardlattice(const size_t* batchsizeforward, const size_t* batchsizebackward,
-                                                 const size_t numlaunchforward, const size_t numlaunchbackward,
+                                                 const size_t numlaunchforward, const size_t numlaunchbackward, const vectorref<size_t>& batchsizes,
                                                  const size_t spalignunitid, const size_t silalignunitid,
                                                  const vectorref<float>& edgeacscores, const vectorref<msra::lattices::edgeinfowithscores>& edges,
                                                  const vectorref<msra::lattices::nodeinfo>& nodes,
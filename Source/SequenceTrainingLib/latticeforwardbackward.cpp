@@ -952,7 +952,8 @@ void lattice::forwardbackwardalign(parallelstate &parallelstate,
             parallelstate.getedgeacscores(edgeacscoresgpu);
             parallelstate.copyalignments(thisedgealignmentsgpu);
         }
-        foreach_index (j, edges)
+        // the edges are independent of each other (each has its own abcs[j] and alignment), so they are processed in parallel
+        auto processedge = [&](size_t j)
         {
             const edgeinfowithscores &e = edges[j];
             const size_t ts = nodes[e.S].t;
@@ -970,8 +971,35 @@ void lattice::forwardbackwardalign(parallelstate &parallelstate,
                 else
                     edgeacscores[j] = alignedge(aligntokens, hset, edgeLLs, *abcs[j], j, returnsenoneids, thisedgealignments[j]);
             }
-            if (cpuverification)
+        };
+        if (!cpuverification)
+        {
+            std::exception_ptr exception;
+#pragma omp parallel for schedule(dynamic, 16)
+            for (long j = 0; j < (long) edges.size(); j++)
+            {
+                try
+                {
+                    processedge(j);
+                }
+                catch (...) // exceptions must not leave the parallel region
+                {
+#pragma omp critical
+                    if (!exception)
+                        exception = std::current_exception();
+                }
+            }
+            if (exception)
+                std::rethrow_exception(exception);
+        }
+        else // verification against the GPU, in edge order
+        {
+            foreach_index (j, edges)
             {
+                processedge(j);
+                const edgeinfowithscores &e = edges[j];
+                const size_t ts = nodes[e.S].t;
+                const size_t te = nodes[e.E].t;
                 const auto &aligntokens = getaligninfo(j); // get alignment tokens
                 bool edgehassil = false;
                 foreach_index (i, aligntokens)
@@ -398,7 +398,8 @@ struct parallelstateimpl
           errorsignalgpustorage(new Microsoft::MSR::CNTK::Matrix<float>((int) deviceid)),
           errorsignalneggpustorage(new Microsoft::MSR::CNTK::Matrix<float>((int) deviceid)),
           backptrstoragegpu(msra::cuda::newushortvector(deviceid)),
-          backptroffsetsgpu(msra::cuda::newsizetvector(deviceid))
+          backptroffsetsgpu(msra::cuda::newsizetvector(deviceid)),
+          batchsizesgpu(msra::cuda::newsizetvector(deviceid))
     {
     }
 
@@ -534,6 +535,7 @@ struct parallelstateimpl
 
     std::unique_ptr<ushortvector> backptrstoragegpu;
     std::unique_ptr<sizetvector> backptroffsetsgpu;
+    std::unique_ptr<sizetvector> batchsizesgpu; // forward batch sizes followed by the backward ones, for the single-launch forward-backward of small lattices
 
     std::unique_ptr<ushortvector> uidsgpu;
     std::unique_ptr<ushortvector> senone2classmapgpu;
@@ -847,8 +849,13 @@ double lattice::parallelforwardbackwardlattice(parallelstate& parallelstate, con
         const bool allocateaccvectors = returnEframescorrect;
         parallelstate->allocfwbwvectors(edges, nodes, uidsuint, allocateframescorrect, copyuids, allocateaccvectors);
 
+        std::vector<size_t> batchsizes(batchsizeforward);
+        batchsizes.insert(batchsizes.end(), batchsizebackward.begin(), batchsizebackward.end());
+        parallelstate->batchsizesgpu->assign(batchsizes, false);
+
         std::unique_ptr<latticefunctions> latticefunctions(msra::cuda::newlatticefunctions(parallelstate.getdevice())); // final CUDA call
         latticefunctions->forwardbackwardlattice(&batchsizeforward[0], &batchsizebackward[0], batchsizeforward.size(), batchsizebackward.size(),
+                                                 *parallelstate->batchsizesgpu.get(),
                                                  parallelstate->spalignunitid, parallelstate->silalignunitid,
                                                  *parallelstate->edgeacscoresgpu.get(), *parallelstate->edgesgpu.get(),
                                                  *parallelstate->nodesgpu.get(), *parallelstate->aligngpu.get(),
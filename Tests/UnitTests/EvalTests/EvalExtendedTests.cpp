@@ -5,8 +5,11 @@
 
 #include "stdafx.h"
 #include "EvalTestHelper.h"
+#include "EvalModelHost.h"
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <cmath>
+#include <thread>
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -129,6 +132,350 @@ BOOST_AUTO_TEST_CASE(EvalScalarTimesTest)
     eval->Destroy();
 }
 
+BOOST_AUTO_TEST_CASE(EvalCloneTest)
+{
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(1) \n"
+        "o1 = Times(Constant(3), i1, tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float> *eval;
+    eval = SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts);
+
+    // The clones share the parameters, and outlive the original
+    std::vector<IEvaluateModelExtended<float>*> clones{ eval->Clone(), eval->Clone() };
+    eval->Destroy();
+
+    std::vector<std::vector<float>> results(clones.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < clones.size(); i++)
+    {
+        threads.push_back(std::thread([&, i]()
+        {
+            Values<float> inputBuffer(1);
+            Values<float> outputBuffer = outputLayouts.CreateBuffers<float>({ 1 });
+            for (int n = 0; n < 100; n++)
+            {
+                inputBuffer[0].m_buffer = { (float)(i + 1) };
+                clones[i]->ForwardPass(inputBuffer, outputBuffer);
+            }
+            results[i] = outputBuffer[0].m_buffer;
+        }));
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    for (size_t i = 0; i < clones.size(); i++)
+    {
+        std::vector<float> expected{ 3.0f * (i + 1) };
+        BOOST_CHECK_EQUAL_COLLECTIONS(results[i].begin(), results[i].end(), expected.begin(), expected.end());
+        clones[i]->Destroy();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(EvalBatchingTest)
+{
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(1) \n"
+        "o1 = Times(Constant(3), i1, tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float> *eval;
+    eval = SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts);
+
+    // Sequences of different lengths: request i has i + 1 samples of value i
+    const size_t numRequests = 8;
+    std::vector<std::vector<float>> inputData(numRequests), outputData(numRequests);
+    std::vector<ValueRefs<float>> inputs(numRequests, ValueRefs<float>(1)), outputs(numRequests, ValueRefs<float>(1));
+    for (size_t i = 0; i < numRequests; i++)
+    {
+        inputData[i].assign(i + 1, (float)i);
+        outputData[i].resize(numRequests);
+        inputs[i][0].m_buffer.InitFrom(inputData[i]);
+        outputs[i][0].m_buffer.InitFrom(outputData[i].data(), outputData[i].size(), 0);
+    }
+
+    BatchingStatistics statistics;
+    {
+        BatchingEvaluator<float> batcher(eval, /*maxBatchSize=*/4, /*maxWaitMicroseconds=*/100000);
+        std::vector<std::future<void>> futures;
+        for (size_t i = 0; i < numRequests; i++)
+            futures.push_back(batcher.Submit(inputs[i], outputs[i]));
+        for (auto& future : futures)
+            future.get();
+        statistics = batcher.GetStatistics();
+    }
+
+    for (size_t i = 0; i < numRequests; i++)
+    {
+        std::vector<float> expected(i + 1, 3.0f * i);
+        auto& buf = outputs[i][0].m_buffer;
+        BOOST_CHECK_EQUAL_COLLECTIONS(buf.begin(), buf.end(), expected.begin(), expected.end());
+    }
+    BOOST_CHECK_EQUAL(statistics.m_numRequests, numRequests);
+    BOOST_CHECK_EQUAL(statistics.m_batchSizeHistogram[4], 2);
+
+    eval->Destroy();
+}
+
+BOOST_AUTO_TEST_CASE(EvalModelHostTest)
+{
+    auto modelDefinition = [](const std::string& output)
+    {
+        return "deviceId = -1 \n"
+               "precision = \"float\" \n"
+               "traceLevel = 1 \n"
+               "run=NDLNetworkBuilder \n"
+               "NDLNetworkBuilder=[ \n"
+               "i1 = Input(1) \n"
+               "o1 = " + output + " \n"
+               "FeatureNodes = (i1) \n"
+               "] \n";
+    };
+
+    // 3 * i, and i + 2 with a part that depends on constants only, which is computed again after the buffers are released
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float>* evals[2];
+    evals[0] = SetupNetworkAndGetLayouts(modelDefinition("Times(Constant(3), i1, tag=\"output\")"), inputLayouts, outputLayouts);
+    evals[1] = SetupNetworkAndGetLayouts(modelDefinition("Plus(i1, Plus(Constant(1), Constant(1)), tag=\"output\")"), inputLayouts, outputLayouts);
+    ForwardEvaluationOptions options;
+    options.m_maxBatchSize = 2;
+    options.m_maxSequenceLength = 4;
+    options.m_ownComputeStream = true;
+    options.m_releaseBuffersAfterCall = true;
+    for (auto eval : evals)
+        eval->StartForwardEvaluation({ outputLayouts[0].m_name }, options);
+
+    // request i goes to model i % 2, with i % 4 + 1 samples of value i
+    const size_t numRequests = 12;
+    std::vector<std::vector<float>> inputData(numRequests), outputData(numRequests);
+    std::vector<ValueRefs<float>> inputs(numRequests, ValueRefs<float>(1)), outputs(numRequests, ValueRefs<float>(1));
+    for (size_t i = 0; i < numRequests; i++)
+    {
+        inputData[i].assign(i % 4 + 1, (float)i);
+        outputData[i].resize(4);
+        inputs[i][0].m_buffer.InitFrom(inputData[i]);
+        outputs[i][0].m_buffer.InitFrom(outputData[i].data(), outputData[i].size(), 0);
+    }
+
+    size_t numRequestsOfModels = 0;
+    {
+        ModelHost<float> host(/*maxConcurrentPasses=*/1, /*maxWaitMicroseconds=*/1000);
+        for (auto eval : evals)
+            host.AddModel(eval, /*maxBatchSize=*/2);
+        BOOST_REQUIRE_THROW(host.Submit(2, inputs[0], outputs[0]), std::invalid_argument);
+
+        std::vector<std::future<void>> futures;
+        for (size_t i = 0; i < numRequests; i++)
+            futures.push_back(host.Submit(i % 2, inputs[i], outputs[i]));
+        for (auto& future : futures)
+            future.get();
+        for (size_t model = 0; model < host.GetNumModels(); model++)
+            numRequestsOfModels += host.GetStatistics(model).m_numRequests;
+    }
+
+    for (size_t i = 0; i < numRequests; i++)
+    {
+        std::vector<float> expected(i % 4 + 1, i % 2 == 0 ? 3.0f * i : i + 2.0f);
+        auto& buf = outputs[i][0].m_buffer;
+        BOOST_CHECK_EQUAL_COLLECTIONS(buf.begin(), buf.end(), expected.begin(), expected.end());
+    }
+    BOOST_CHECK_EQUAL(numRequestsOfModels, numRequests);
+
+    for (auto eval : evals)
+        eval->Destroy();
+}
+
+BOOST_AUTO_TEST_CASE(EvalPreallocationTest)
+{
+    // Running sum: o1(t) = i1(t) + o1(t-1)
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(1) \n"
+        "p1 = PastValue(1, o1, defaultHiddenActivity=0) \n"
+        "o1 = Plus(i1, p1, tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float> *eval;
+    eval = SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts);
+    BOOST_REQUIRE_THROW(eval->GetNumAllocationsSinceWarmup(), std::exception);
+
+    ForwardEvaluationOptions options;
+    options.m_maxBatchSize = 4;
+    options.m_maxSequenceLength = 6;
+    eval->StartForwardEvaluation({ outputLayouts[0].m_name }, options);
+
+    // batches of all sizes and lengths within the options, sequence s of batch b has s + 1 ones and then b + 1 twos
+    for (size_t b = 0; b < 4; b++)
+    {
+        std::vector<std::vector<float>> inputData(b + 1), outputData(b + 1, std::vector<float>(6));
+        std::vector<ValueRefs<float>> inputs(b + 1, ValueRefs<float>(1)), outputs(b + 1, ValueRefs<float>(1));
+        for (size_t s = 0; s <= b; s++)
+        {
+            inputData[s].assign(s + 1, 1.0f);
+            inputData[s].insert(inputData[s].end(), b + 1, 2.0f);
+            inputData[s].resize(std::min(inputData[s].size(), (size_t)6));
+            inputs[s][0].m_buffer.InitFrom(inputData[s]);
+            outputs[s][0].m_buffer.InitFrom(outputData[s].data(), outputData[s].size(), 0);
+        }
+        eval->ForwardPassBatch(inputs, outputs);
+
+        for (size_t s = 0; s <= b; s++)
+        {
+            std::vector<float> expected;
+            float sum = 0;
+            for (auto value : inputData[s])
+                expected.push_back(sum += value);
+            auto& buf = outputs[s][0].m_buffer;
+            BOOST_CHECK_EQUAL_COLLECTIONS(buf.begin(), buf.end(), expected.begin(), expected.end());
+        }
+    }
+    BOOST_CHECK_EQUAL(eval->GetNumAllocationsSinceWarmup(), 0);
+
+    eval->Destroy();
+}
+
+BOOST_AUTO_TEST_CASE(EvalStreamsTest)
+{
+    // Running sum: o1(t) = i1(t) + o1(t-1)
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(1) \n"
+        "p1 = PastValue(1, o1, defaultHiddenActivity=0) \n"
+        "o1 = Plus(i1, p1, tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float> *eval;
+    eval = SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts);
+
+    // Evaluates one chunk per stream, in one minibatch, and returns the outputs
+    auto forward = [&](const std::vector<size_t>& streams, std::vector<std::vector<float>> chunks)
+    {
+        std::vector<std::vector<float>> results(chunks.size(), std::vector<float>(10));
+        std::vector<ValueRefs<float>> inputs(chunks.size(), ValueRefs<float>(1)), outputs(chunks.size(), ValueRefs<float>(1));
+        for (size_t s = 0; s < chunks.size(); s++)
+        {
+            inputs[s][0].m_buffer.InitFrom(chunks[s]);
+            outputs[s][0].m_buffer.InitFrom(results[s].data(), results[s].size(), 0);
+        }
+        eval->ForwardPassStreams(streams, inputs, outputs);
+        for (size_t s = 0; s < chunks.size(); s++)
+            results[s].resize(outputs[s][0].m_buffer.size());
+        return results;
+    };
+
+    size_t a = eval->CreateStreamState();
+    size_t b = eval->CreateStreamState();
+    auto results = forward({ a, b }, { { 1, 2 }, { 10 } });
+    BOOST_CHECK(results[0] == std::vector<float>({ 1, 3 }));
+    BOOST_CHECK(results[1] == std::vector<float>({ 10 }));
+
+    // the streams continue where they stopped, in any order, next to a new one
+    size_t c = eval->CreateStreamState();
+    results = forward({ b, c, a }, { { 20, 30 }, { 5 }, { 3 } });
+    BOOST_CHECK(results[0] == std::vector<float>({ 30, 60 }));
+    BOOST_CHECK(results[1] == std::vector<float>({ 5 }));
+    BOOST_CHECK(results[2] == std::vector<float>({ 6 }));
+
+    // a released state is reused as a new stream
+    eval->ReleaseStreamState(a);
+    size_t d = eval->CreateStreamState();
+    results = forward({ d }, { { 7 } });
+    BOOST_CHECK(results[0] == std::vector<float>({ 7 }));
+    BOOST_REQUIRE_THROW(forward({ b, b }, { { 1 }, { 1 } }), std::exception);
+    eval->ReleaseStreamState(d);
+    BOOST_REQUIRE_THROW(forward({ d }, { { 1 } }), std::exception);
+
+    eval->Destroy();
+}
+
+BOOST_AUTO_TEST_CASE(EvalBeamSearchTest)
+{
+    // The log-probabilities of the next token are LogSoftmax(c1 + onehot(previous token)), for the tokens
+    // 0 (start), 1 and 2 (end).
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(3) \n"
+        "c1 = Input(3) \n"
+        "o1 = LogSoftmax(Plus(c1, i1), tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float> *eval;
+    eval = SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts);
+
+    std::vector<float> condition = { -10, 0, 0.5 };
+    std::vector<ValueRefs<float>> sources(1, ValueRefs<float>(1));
+    sources[0][0].m_buffer.InitFrom(condition);
+    BeamSearchOptions options;
+    options.m_tokenInputName = L"i1";
+    options.m_startToken = 0;
+    options.m_endToken = 2;
+    options.m_beamWidth = 2;
+    options.m_maxLength = 5;
+    std::vector<std::vector<BeamSearchHypothesis>> results;
+    eval->BeamSearch(sources, options, results);
+
+    // the log-probabilities of 1 and 2 after the tokens 0 and 1
+    auto logProbability = [&](size_t previous, size_t token)
+    {
+        double sum = 0;
+        for (size_t i = 0; i < 3; i++)
+            sum += std::exp(condition[i] + (i == previous ? 1 : 0));
+        return condition[token] + (token == previous ? 1 : 0) - std::log(sum);
+    };
+    BOOST_REQUIRE_EQUAL(results.size(), 1);
+    BOOST_REQUIRE_EQUAL(results[0].size(), 2);
+    BOOST_CHECK(results[0][0].m_tokens == std::vector<size_t>({ 2 }));
+    BOOST_CHECK(results[0][0].m_isFinished);
+    BOOST_CHECK_CLOSE(results[0][0].m_score, logProbability(0, 2), 1e-3);
+    BOOST_CHECK(results[0][1].m_tokens == std::vector<size_t>({ 1, 2 }));
+    BOOST_CHECK(results[0][1].m_isFinished);
+    BOOST_CHECK_CLOSE(results[0][1].m_score, logProbability(0, 1) + logProbability(1, 2), 1e-3);
+
+    options.m_tokenInputName = L"none";
+    BOOST_REQUIRE_THROW(eval->BeamSearch(sources, options, results), std::exception);
+
+    eval->Destroy();
+}
+
 BOOST_AUTO_TEST_CASE(EvalScalarTimesDualOutputTest)
 {
     std::string modelDefinition =
@@ -219,6 +566,149 @@ BOOST_AUTO_TEST_CASE(EvalDenseTimesTest)
     eval->Destroy();
 }
 
+BOOST_AUTO_TEST_CASE(EvalQuantizedTimesTest)
+{
+    auto modelDefinition = [](const std::string& options)
+    {
+        return options +
+            "deviceId = -1 \n"
+            "precision = \"float\" \n"
+            "traceLevel = 1 \n"
+            "run=NDLNetworkBuilder \n"
+            "NDLNetworkBuilder=[ \n"
+            "i1 = Input(20) \n"
+            "w1 = Parameter(3, 20, init=\"uniform\", randomSeed=1) \n"
+            "o1 = Times(w1, i1, tag=\"output\") \n"
+            "FeatureNodes = (i1) \n"
+            "] \n";
+    };
+
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float>* eval = SetupNetworkAndGetLayouts(modelDefinition(""), inputLayouts, outputLayouts);
+    IEvaluateModelExtended<float>* quantizedEval = SetupNetworkAndGetLayouts(modelDefinition("quantizedTimesBits = 12 \n"), inputLayouts, outputLayouts);
+
+    // two samples
+    std::vector<float> input(40);
+    for (size_t i = 0; i < input.size(); i++)
+        input[i] = (float) ((int) (i * 7 % 11) - 5) / 5;
+    ValueRefs<float> inputRefs(1);
+    inputRefs[0].m_buffer.InitFrom(input);
+    std::vector<float> expected(6), output(6);
+    ValueRefs<float> outputRefs(1);
+    outputRefs[0].m_buffer.InitFrom(expected);
+    eval->ForwardPass(inputRefs, outputRefs);
+    outputRefs[0].m_buffer.InitFrom(output);
+    quantizedEval->ForwardPass(inputRefs, outputRefs);
+
+    for (size_t i = 0; i < output.size(); i++)
+        BOOST_CHECK_SMALL(output[i] - expected[i], 0.05f);
+    BOOST_CHECK(output != expected); // (really quantized)
+
+    eval->Destroy();
+    quantizedEval->Destroy();
+}
+
+BOOST_AUTO_TEST_CASE(EvalSparseWeightsTimesTest)
+{
+    auto modelDefinition = [](const std::string& options)
+    {
+        return options +
+            "deviceId = -1 \n"
+            "precision = \"float\" \n"
+            "traceLevel = 1 \n"
+            "run=NDLNetworkBuilder \n"
+            "NDLNetworkBuilder=[ \n"
+            "i1 = Input(20) \n"
+            "w1 = Parameter(3, 20, init=\"uniform\", randomSeed=1) \n"
+            "w2 = Parameter(20, 4, init=\"uniform\", randomSeed=2) \n"
+            "o1 = Times(w1, i1, tag=\"output\") \n"
+            "o2 = TransposeTimes(w2, i1, tag=\"output\") \n"
+            "FeatureNodes = (i1) \n"
+            "] \n";
+    };
+
+    // all weights made sparse, which takes precedence over the quantization (that would be off by more than the tolerance)
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float>* eval = SetupNetworkAndGetLayouts(modelDefinition(""), inputLayouts, outputLayouts);
+    IEvaluateModelExtended<float>* sparseEval = SetupNetworkAndGetLayouts(modelDefinition("sparseTimesMinSparsity = 0 \n quantizedTimesBits = 12 \n"), inputLayouts, outputLayouts);
+
+    // two samples
+    std::vector<float> input(40);
+    for (size_t i = 0; i < input.size(); i++)
+        input[i] = (float) ((int) (i * 7 % 11) - 5) / 5;
+    ValueRefs<float> inputRefs(1);
+    inputRefs[0].m_buffer.InitFrom(input);
+    BOOST_REQUIRE_EQUAL(outputLayouts.size(), 2);
+    std::vector<std::vector<float>> expected(2), output(2);
+    for (size_t k = 0; k < 2; k++)
+        expected[k].resize(outputLayouts[k].m_numElements * 2);
+    output = expected;
+    ValueRefs<float> outputRefs(2);
+    for (size_t k = 0; k < 2; k++)
+        outputRefs[k].m_buffer.InitFrom(expected[k]);
+    eval->ForwardPass(inputRefs, outputRefs);
+    for (size_t k = 0; k < 2; k++)
+        outputRefs[k].m_buffer.InitFrom(output[k]);
+    sparseEval->ForwardPass(inputRefs, outputRefs);
+
+    for (size_t k = 0; k < 2; k++)
+        for (size_t i = 0; i < output[k].size(); i++)
+            BOOST_CHECK_SMALL(output[k][i] - expected[k][i], 1e-5f);
+
+    eval->Destroy();
+    sparseEval->Destroy();
+}
+
+BOOST_AUTO_TEST_CASE(EvalFoldNodesTest)
+{
+    auto modelDefinition = [](const std::string& options)
+    {
+        return options +
+            "deviceId = -1 \n"
+            "precision = \"float\" \n"
+            "traceLevel = 1 \n"
+            "run=NDLNetworkBuilder \n"
+            "NDLNetworkBuilder=[ \n"
+            "i1 = Input(4) \n"
+            "l1 = Input(3) \n"
+            "m1 = Parameter(4, init=\"uniform\", randomSeed=1) \n"
+            "s1 = Parameter(4, init=\"uniform\", randomSeed=2) \n"
+            "w1 = Parameter(3, 4, init=\"uniform\", randomSeed=3) \n"
+            "w2 = Parameter(3, init=\"uniform\", randomSeed=4) \n"
+            "n1 = ElementTimes(Minus(i1, m1), s1) \n"
+            "o1 = Plus(Times(w1, n1), Exp(w2), tag=\"output\") \n"
+            "ce = SquareError(l1, o1, tag=\"criterion\") \n"
+            "FeatureNodes = (i1) \n"
+            "LabelNodes = (l1) \n"
+            "] \n";
+    };
+
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float>* eval = SetupNetworkAndGetLayouts(modelDefinition(""), inputLayouts, outputLayouts);
+    IEvaluateModelExtended<float>* foldedEval = SetupNetworkAndGetLayouts(modelDefinition("foldNodesForInference = true \n" "removeUnusedNodes = true \n"), inputLayouts, outputLayouts);
+    BOOST_CHECK_EQUAL(inputLayouts.size(), 1);
+
+    // two samples
+    std::vector<float> input = { 1, -2, 0.5f, 3, -1, 0, 2, -0.5f };
+    ValueRefs<float> inputRefs(1);
+    inputRefs[0].m_buffer.InitFrom(input);
+    std::vector<float> expected(6), output(6);
+    ValueRefs<float> outputRefs(1);
+    outputRefs[0].m_buffer.InitFrom(expected);
+    eval->ForwardPass(inputRefs, outputRefs);
+    outputRefs[0].m_buffer.InitFrom(output);
+    foldedEval->ForwardPass(inputRefs, outputRefs);
+
+    for (size_t i = 0; i < output.size(); i++)
+        BOOST_CHECK_SMALL(output[i] - expected[i], 1e-5f);
+
+    eval->Destroy();
+    foldedEval->Destroy();
+}
+
 BOOST_AUTO_TEST_CASE(EvalSparseTimesTest)
 {
     std::string modelDefinition =
@@ -0,0 +1,229 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Benchmark.h -- runs named benchmarks, writes their results as JSON and compares them with a baseline
+//
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// What a benchmark times: Run() does one iteration, Wait() waits until the work issued by the iterations so far is
+// done (for the asynchronous work of a GPU; may be empty).
+struct BenchmarkBody
+{
+    std::function<void()> Run;
+    std::function<void()> Wait;
+};
+
+struct BenchmarkResult
+{
+    std::string name;
+    double seconds;    // per iteration, the median of the batches
+    double minSeconds; // of the fastest batch
+    size_t iterations; // per batch
+    double work;       // per iteration, in 'unit'
+    std::string unit;
+};
+
+// A set of benchmarks, named e.g. "gemm/GPU/float/1024x1024x1024", that are set up only when they are run.
+// Each of them is run once to warm up and to estimate the number of iterations that take a fifth of 'minSeconds',
+// then timed in five batches of that many iterations; the median of the batches is the result, so that single
+// disturbances do not count.
+// The results go to stdout, and to a JSON file ({ "benchmarks": [ { "name": ..., "seconds": ..., ... } ] }) that
+// serves as a baseline of later runs: a benchmark regresses if it takes more than (1 + tolerance) times as long.
+class BenchmarkSuite
+{
+public:
+    BenchmarkSuite()
+        : m_minSeconds(0.2)
+    {
+    }
+
+    void SetFilter(const std::string& filter) { m_filter = filter; }
+    void SetMinSeconds(double minSeconds) { m_minSeconds = minSeconds; }
+
+    // 'work' is the amount of work of one iteration in 'unit' (e.g. flops, bytes), for the throughput
+    void Add(const std::string& name, double work, const std::string& unit, const std::function<BenchmarkBody()>& setup)
+    {
+        m_benchmarks.push_back(Benchmark{ name, work, unit, setup });
+    }
+
+    void List() const
+    {
+        for (const auto& benchmark : m_benchmarks)
+            std::cout << benchmark.name << std::endl;
+    }
+
+    void Run()
+    {
+        for (const auto& benchmark : m_benchmarks)
+        {
+            if (!m_filter.empty() && benchmark.name.find(m_filter) == std::string::npos)
+                continue;
+            try
+            {
+                m_results.push_back(RunOne(benchmark));
+                Print(m_results.back());
+            }
+            catch (const std::exception& e)
+            {
+                std::cout << benchmark.name << ": failed: " << e.what() << std::endl;
+            }
+        }
+    }
+
+    void WriteJson(const std::string& path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+            RuntimeError("Cannot write the benchmark results to %s.", path.c_str());
+        file.precision(6);
+        file << "{\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < m_results.size(); i++)
+        {
+            const auto& result = m_results[i];
+            file << "    { \"name\": \"" << result.name << "\", \"seconds\": " << std::scientific << result.seconds
+                 << ", \"minSeconds\": " << result.minSeconds << std::defaultfloat << ", \"iterations\": " << result.iterations
+                 << ", \"work\": " << result.work << ", \"unit\": \"" << result.unit << "\" }" << (i + 1 < m_results.size() ? "," : "") << "\n";
+        }
+        file << "  ]\n}\n";
+    }
+
+    // Compares the results with those of a file written by WriteJson(). Returns the number of regressions.
+    size_t CompareWithBaseline(const std::string& path, double tolerance) const
+    {
+        auto baseline = ReadJson(path);
+        size_t numRegressions = 0, numImprovements = 0;
+        std::cout << std::endl << "Comparison with " << path << " (tolerance " << tolerance * 100 << "%):" << std::endl;
+        for (const auto& result : m_results)
+        {
+            auto found = baseline.find(result.name);
+            if (found == baseline.end())
+            {
+                std::cout << "  new          " << result.name << std::endl;
+                continue;
+            }
+            double ratio = result.seconds / found->second;
+            const char* verdict = "  ok         ";
+            if (ratio > 1 + tolerance)
+            {
+                verdict = "  REGRESSION ";
+                numRegressions++;
+            }
+            else if (ratio < 1 - tolerance)
+            {
+                verdict = "  faster     ";
+                numImprovements++;
+            }
+            std::cout << verdict << " " << result.name << ": " << FormatSeconds(result.seconds) << " vs. " << FormatSeconds(found->second)
+                      << " (" << (ratio - 1) * 100 << "%)" << std::endl;
+        }
+        std::cout << numRegressions << " regression(s), " << numImprovements << " improvement(s)." << std::endl;
+        return numRegressions;
+    }
+
+private:
+    struct Benchmark
+    {
+        std::string name;
+        double work;
+        std::string unit;
+        std::function<BenchmarkBody()> setup;
+    };
+
+    static const int s_numBatches = 5;
+
+    BenchmarkResult RunOne(const Benchmark& benchmark) const
+    {
+        auto body = benchmark.setup();
+        auto wait = [&]()
+        {
+            if (body.Wait)
+                body.Wait();
+        };
+        auto timeIterations = [&](size_t iterations)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (size_t i = 0; i < iterations; i++)
+                body.Run();
+            wait();
+            return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        };
+
+        double warmUp = timeIterations(1);
+        size_t iterations = (size_t) std::max(1.0, m_minSeconds / s_numBatches / std::max(warmUp, 1e-9));
+        std::vector<double> batches;
+        for (int batch = 0; batch < s_numBatches; batch++)
+            batches.push_back(timeIterations(iterations) / iterations);
+        std::sort(batches.begin(), batches.end());
+        return BenchmarkResult{ benchmark.name, batches[s_numBatches / 2], batches.front(), iterations, benchmark.work, benchmark.unit };
+    }
+
+    static std::string FormatSeconds(double seconds)
+    {
+        std::ostringstream text;
+        text.precision(4);
+        if (seconds >= 1)
+            text << seconds << " s";
+        else if (seconds >= 1e-3)
+            text << seconds * 1e3 << " ms";
+        else
+            text << seconds * 1e6 << " us";
+        return text.str();
+    }
+
+    static void Print(const BenchmarkResult& result)
+    {
+        std::cout << result.name << ": " << FormatSeconds(result.seconds) << " (min " << FormatSeconds(result.minSeconds) << ", " << result.iterations << " iteration(s) per batch)";
+        if (result.work > 0)
+        {
+            double throughput = result.work / result.seconds;
+            if (result.unit == "flops")
+                std::cout << ", " << throughput * 1e-9 << " GFLOPS";
+            else if (result.unit == "bytes")
+                std::cout << ", " << throughput * 1e-9 << " GB/s";
+            else
+                std::cout << ", " << throughput << " " << result.unit << "/s";
+        }
+        std::cout << std::endl;
+    }
+
+    // Reads the names and seconds of a file written by WriteJson(), one benchmark per line.
+    static std::map<std::string, double> ReadJson(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file)
+            RuntimeError("Cannot read the benchmark baseline %s.", path.c_str());
+        std::map<std::string, double> results;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            const std::string nameKey = "\"name\": \"", secondsKey = "\"seconds\": ";
+            size_t name = line.find(nameKey), seconds = line.find(secondsKey);
+            if (name == std::string::npos || seconds == std::string::npos)
+                continue;
+            name += nameKey.size();
+            size_t nameEnd = line.find('"', name);
+            results[line.substr(name, nameEnd - name)] = atof(line.c_str() + seconds + secondsKey.size());
+        }
+        return results;
+    }
+
+    std::vector<Benchmark> m_benchmarks;
+    std::vector<BenchmarkResult> m_results;
+    std::string m_filter;
+    double m_minSeconds;
+};
+
+}}}}
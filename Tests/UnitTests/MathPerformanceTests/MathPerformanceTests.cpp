@@ -4,158 +4,39 @@
 //
 // MathPerformanceTests.cpp : Defines the entry point for the console application.
 //
+// Runs the benchmarks of the Math library (see Benchmark.h) on the CPU and, if there is one, on the GPU:
+//     MathPerformanceTests [-filter <substring>] [-minTime <seconds>] [-cpuOnly] [-list]
+//                          [-json <results.json>] [-baseline <baseline.json> [-tolerance <fraction>]]
+// With a baseline, the exit code is the number of benchmarks that regressed beyond the tolerance (default 0.1).
+//
 #include "stdafx.h"
 //#define NOMINMAX
 //#include "Windows.h"
 #include "Matrix.h"
 #include "CPUMatrix.h"
+#include "GPUMatrix.h"
+#include "CPUSparseMatrix.h"
 #include "TensorView.h"
 #include "Sequences.h"
+#include "BlockMultiplier.h"
+#include "ConvolutionEngine.h"
+#include "BatchNormalizationEngine.h"
+#include "MatrixQuantizerImpl.h"
+#include "ColumnQuantizer.h"
+#include "QuantizedMatrix.h"
+#include "QuantizedProduct.h"
+#include "Benchmark.h"
 #include <chrono>
 #include <iostream>
 #include <vector>
+#include <array>
 #include <algorithm>
+#include <omp.h>
 
 using namespace Microsoft::MSR::CNTK;
+using namespace Microsoft::MSR::CNTK::Test;
 using namespace std;
 
-template <class ElemType>
-void randomInitializeCPUMatrix(CPUMatrix<ElemType>& M, float min = -10, float max = 10)
-{
-    foreach_coord (i, j, M)
-    {
-        M(i, j) = (1.0 * rand() / RAND_MAX) * max + min;
-    }
-}
-
-template <class ElemType>
-void randomInitializeMatrix(Matrix<ElemType>& M, float min = -10, float max = 10)
-{
-    foreach_coord (i, j, M)
-    {
-        M(i, j) = (1.0 * rand() / RAND_MAX) * max + min;
-    }
-}
-
-template <class ElemType>
-void MultiplyAndWeightedAddTest(int n, int k, int m)
-{
-    cout << "Testing CPUMatrix" << endl;
-    cout << "A(" << n << "x" << k << ") and B(" << k << "," << m << ")" << endl;
-    CPUMatrix<ElemType> A(n, k);
-    randomInitializeCPUMatrix<ElemType>(A);
-    CPUMatrix<ElemType> B(k, m);
-    randomInitializeCPUMatrix<ElemType>(B);
-    CPUMatrix<ElemType> C(n, m);
-    auto t_start = clock();
-    CPUMatrix<ElemType>::MultiplyAndWeightedAdd(0.324, A, false, B, false, 0.632, C);
-    auto t_end = clock();
-    std::cout << "CPU Matrix in: " << 1.0 * (t_end - t_start) / CLOCKS_PER_SEC << " seconds" << endl;
-    std::cout << n << " " << k << " " << m << endl;
-
-    cout << "Testing Matrix" << endl;
-    Matrix<ElemType> AG((size_t) n, (size_t) k);
-    randomInitializeMatrix<ElemType>(AG);
-    Matrix<ElemType> BG((size_t) k, (size_t) m);
-    randomInitializeMatrix<ElemType>(BG);
-    Matrix<ElemType> CG((size_t) n, (size_t) m);
-    auto t_startG = clock();
-    Matrix<ElemType>::MultiplyAndWeightedAdd(0.324, AG, false, BG, false, 0.632, CG);
-    auto t_endG = clock();
-    std::cout << "Matrix in: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
-}
-
-template <class ElemType>
-void AddMultiplyAndInplaceSigmoidTest(int n, int k, int m)
-{
-    cout << "Testing CPUMatrix" << endl;
-    cout << "A(" << n << "x" << k << ") and B(" << k << "," << m << ")" << endl;
-    CPUMatrix<ElemType> A(n, k);
-    randomInitializeCPUMatrix<ElemType>(A);
-    CPUMatrix<ElemType> B(k, m);
-    randomInitializeCPUMatrix<ElemType>(B);
-    CPUMatrix<ElemType> D(n, m);
-    randomInitializeCPUMatrix<ElemType>(D);
-    CPUMatrix<ElemType> C(n, m);
-    auto t_start = clock();
-    C = A * B + D;
-    // C.InplaceSigmoid();
-    auto t_end = clock();
-    std::cout << "CPU Matrix in: " << 1.0 * (t_end - t_start) / CLOCKS_PER_SEC << " seconds" << endl;
-    std::cout << n << " " << k << " " << m << endl;
-
-    cout << "Testing Matrix" << endl;
-    Matrix<ElemType> AG((size_t) n, (size_t) k);
-    randomInitializeMatrix<ElemType>(AG);
-    Matrix<ElemType> BG((size_t) k, (size_t) m);
-    randomInitializeMatrix<ElemType>(BG);
-    Matrix<ElemType> DG((size_t) n, (size_t) m);
-    randomInitializeMatrix<ElemType>(DG);
-    Matrix<ElemType> CG((size_t) n, (size_t) m);
-    auto t_startG = clock();
-    CG = AG * BG + DG;
-    // CG.InplaceSigmoid();
-    auto t_endG = clock();
-    std::cout << "Matrix in: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
-}
-
-template <class ElemType>
-void SquareMultiplyAndAdd10TimesAvgTest(int n, int count)
-{
-    cout << "Testing CPUMatrix" << endl;
-    cout << "A(" << n << "x" << n << ") and B(" << n << "," << n << ")" << endl;
-
-    double cpu_avg = 0;
-    for (int i = 0; i < count; ++i)
-    {
-        CPUMatrix<ElemType> A(n, n);
-        randomInitializeCPUMatrix<ElemType>(A);
-        CPUMatrix<ElemType> B(n, n);
-        randomInitializeCPUMatrix<ElemType>(B);
-        CPUMatrix<ElemType> C(n, n);
-        auto t_start = clock();
-        CPUMatrix<ElemType>::MultiplyAndWeightedAdd(0.324, A, false, B, false, 0.632, C);
-        auto t_end = clock();
-        double val = 1.0 * (t_end - t_start) / CLOCKS_PER_SEC;
-        if (i == 0)
-        {
-            cpu_avg = val;
-        }
-        else
-        {
-            cpu_avg = cpu_avg * (i - 1) / i + val / i;
-        }
-    }
-
-    cout << "Testing Matrix" << endl;
-    double m_avg = 0;
-    for (int i = 0; i < count; ++i)
-    {
-        Matrix<ElemType> AG((size_t) n, (size_t) n);
-        randomInitializeMatrix<ElemType>(AG);
-        Matrix<ElemType> BG((size_t) n, (size_t) n);
-        randomInitializeMatrix<ElemType>(BG);
-        Matrix<ElemType> CG((size_t) n, (size_t) n);
-        auto t_startG = clock();
-        Matrix<ElemType>::MultiplyAndWeightedAdd(0.324, AG, false, BG, false, 0.632, CG);
-        auto t_endG = clock();
-        double val = 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC;
-        if (i == 0)
-        {
-            m_avg = val;
-        }
-        else
-        {
-            m_avg = m_avg * (i - 1) / i + val / i;
-        }
-    }
-
-    cout << "Based on " << count << " runs:" << endl;
-    cout << "Average time for CPUMatrix is: " << cpu_avg << " seconds" << endl;
-    cout << "Average time for Matrix is: " << m_avg << " seconds" << endl;
-    cout << "CPUMatrix/Matrix ratio is: " << cpu_avg / m_avg << " seconds" << endl;
-}
-
 // simple test suite for TensorView
 //  - this is meant for performance optimization
 //  - correctness is defined as same result between GPU and CPU
@@ -279,81 +160,594 @@ struct TensorTest
     }
 };
 
+// -----------------------------------------------------------------------
+// benchmarks
+// -----------------------------------------------------------------------
+
+static string DeviceName(DEVICEID_TYPE deviceId)
+{
+    return deviceId < 0 ? "CPU" : "GPU" + to_string(deviceId);
+}
+
+template <class ElemType>
+static string TypeName()
+{
+    return sizeof(ElemType) == sizeof(float) ? "float" : "double";
+}
+
+static bool IsDeviceAvailable(DEVICEID_TYPE deviceId)
+{
+#ifdef CPUONLY
+    return deviceId < 0;
+#else
+    try
+    {
+        Matrix<float> probe(1, 1, deviceId);
+        probe.SetValue(0);
+        return true;
+    }
+    catch (const exception&)
+    {
+        return false;
+    }
+#endif
+}
+
+template <class ElemType>
+static shared_ptr<Matrix<ElemType>> RandomMatrix(size_t rows, size_t cols, DEVICEID_TYPE deviceId, unsigned long seed, ElemType low = -1, ElemType high = 1)
+{
+    return make_shared<Matrix<ElemType>>(Matrix<ElemType>::RandomUniform(rows, cols, deviceId, low, high, seed));
+}
+
+// The work issued to a GPU is done once an element of a result has been read back.
+template <class ElemType>
+static function<void()> WaitFor(const shared_ptr<Matrix<ElemType>>& result)
+{
+    return [result]()
+    {
+        result->Get00Element();
+    };
+}
+
+// C = A * B in the shapes of fully connected layers (forward, gradient of the input and of the weights),
+// of inference with a single sample, and square.
+template <class ElemType>
+void AddGemmBenchmarks(BenchmarkSuite& suite, DEVICEID_TYPE deviceId)
+{
+    struct Shape
+    {
+        size_t m, k, n;
+        bool transposeA, transposeB;
+    };
+    vector<Shape> shapes = { { 1024, 1024, 1024, false, false }, { 2048, 512, 256, false, false }, { 512, 2048, 256, true, false },
+                             { 2048, 256, 512, false, true }, { 4096, 1024, 1, false, false } };
+    if (deviceId >= 0)
+        shapes.push_back({ 4096, 4096, 4096, false, false });
+
+    // the products of a recurrent step or of a batch of one, below CPUMatrix::GetSmallGemmThreshold(); for float on
+    // the CPU, also through the BLAS library ("/blas"), to compare with
+    vector<Shape> smallShapes = { { 128, 512, 1, false, false }, { 512, 128, 1, false, false }, { 512, 128, 1, true, false },
+                                  { 256, 256, 4, false, false }, { 64, 64, 16, false, true } };
+    shapes.insert(shapes.end(), smallShapes.begin(), smallShapes.end());
+
+    for (const auto& shape : shapes)
+    {
+        const bool small = sizeof(ElemType) == sizeof(float) && shape.m * shape.k * shape.n <= CPUMatrix<ElemType>::GetSmallGemmThreshold();
+        for (bool blas : { false, true })
+        {
+            if (blas && (deviceId >= 0 || !small))
+                continue;
+            string name = "gemm/" + DeviceName(deviceId) + "/" + TypeName<ElemType>() + "/" + to_string(shape.m) + "x" + to_string(shape.k) + "x" + to_string(shape.n) +
+                          (shape.transposeA ? "/AT" : "") + (shape.transposeB ? "/BT" : "") + (blas ? "/blas" : "");
+            suite.Add(name, 2.0 * shape.m * shape.k * shape.n, "flops", [=]()
+            {
+                auto a = shape.transposeA ? RandomMatrix<ElemType>(shape.k, shape.m, deviceId, 1) : RandomMatrix<ElemType>(shape.m, shape.k, deviceId, 1);
+                auto b = shape.transposeB ? RandomMatrix<ElemType>(shape.n, shape.k, deviceId, 2) : RandomMatrix<ElemType>(shape.k, shape.n, deviceId, 2);
+                auto c = make_shared<Matrix<ElemType>>(shape.m, shape.n, deviceId);
+                return BenchmarkBody{ [=]()
+                {
+                    const size_t threshold = CPUMatrix<ElemType>::GetSmallGemmThreshold();
+                    if (blas)
+                        CPUMatrix<ElemType>::SetSmallGemmThreshold(0);
+                    Matrix<ElemType>::MultiplyAndWeightedAdd(1, *a, shape.transposeA, *b, shape.transposeB, 0, *c);
+                    CPUMatrix<ElemType>::SetSmallGemmThreshold(threshold);
+                }, WaitFor(c) };
+            });
+        }
+    }
+}
+
+// One elementwise TensorView op with 'numInputs' full operands of [rows x cols]. The inputs are positive, so that
+// ops like Log and Sqrt time the same work as the others.
+template <class ElemType>
+void AddTensorOpBenchmark(BenchmarkSuite& suite, const string& op, int numInputs, size_t rows, size_t cols, DEVICEID_TYPE deviceId,
+                          const function<void(TensorView<ElemType>&, const vector<TensorView<ElemType>>&)>& fn)
+{
+    string name = "tensor/" + op + "/" + DeviceName(deviceId) + "/" + TypeName<ElemType>() + "/" + to_string(rows) + "x" + to_string(cols);
+    suite.Add(name, (numInputs + 1.0) * rows * cols * sizeof(ElemType), "bytes", [=]()
+    {
+        auto inputs = make_shared<vector<TensorView<ElemType>>>();
+        for (int i = 0; i < numInputs; i++)
+            inputs->push_back(TensorView<ElemType>(RandomMatrix<ElemType>(rows, cols, deviceId, i + 1, (ElemType) 0.5, (ElemType) 1.5), TensorShape(rows, cols)));
+        auto resultMatrix = make_shared<Matrix<ElemType>>(rows, cols, deviceId);
+        auto result = make_shared<TensorView<ElemType>>(resultMatrix, TensorShape(rows, cols));
+        return BenchmarkBody{ [=]() { fn(*result, *inputs); }, WaitFor(resultMatrix) };
+    });
+}
+
+// Broadcasting and reductions, as of biases and their gradients, with the fast paths of the GPU and without them
+// (TensorOpKernels::EnableFastPaths()).
+template <class ElemType>
+void AddTensorBroadcastBenchmarks(BenchmarkSuite& suite, size_t rows, size_t cols, DEVICEID_TYPE deviceId)
+{
+    struct Case
+    {
+        string what;
+        size_t inputRows, inputCols, resultRows, resultCols;
+        ElementWiseOperator reductionOp;
+    };
+    vector<Case> cases = { { "broadcast/column", rows, 1, rows, cols, ElementWiseOperator::opSum }, { "broadcast/row", 1, cols, rows, cols, ElementWiseOperator::opSum },
+                           { "reduce/Sum/rows", rows, cols, rows, 1, ElementWiseOperator::opSum }, { "reduce/Sum/columns", rows, cols, 1, cols, ElementWiseOperator::opSum },
+                           { "reduce/Sum/all", rows, cols, 1, 1, ElementWiseOperator::opSum }, { "reduce/Max/rows", rows, cols, rows, 1, ElementWiseOperator::opMax },
+                           { "reduce/LogSum/rows", rows, cols, rows, 1, ElementWiseOperator::opLogSum } };
+
+    for (const auto& c : cases)
+    {
+        for (bool fastPaths : { true, false })
+        {
+            if (!fastPaths && deviceId < 0)
+                continue;
+            bool isBroadcast = c.resultRows * c.resultCols == rows * cols;
+            string name = "tensor/" + c.what + "/" + DeviceName(deviceId) + "/" + TypeName<ElemType>() + "/" + to_string(rows) + "x" + to_string(cols) + (fastPaths ? "" : "/generic");
+            suite.Add(name, (isBroadcast ? 2.0 : 1.0) * rows * cols * sizeof(ElemType), "bytes", [=]()
+            {
+                auto a = TensorView<ElemType>(RandomMatrix<ElemType>(rows, cols, deviceId, 1), TensorShape(rows, cols));
+                auto input = TensorView<ElemType>(RandomMatrix<ElemType>(c.inputRows, c.inputCols, deviceId, 2), TensorShape(c.inputRows, c.inputCols));
+                auto resultMatrix = make_shared<Matrix<ElemType>>(c.resultRows, c.resultCols, deviceId);
+                auto result = make_shared<TensorView<ElemType>>(resultMatrix, TensorShape(c.resultRows, c.resultCols));
+                return BenchmarkBody{ [=]()
+                                      {
+                                          TensorOpKernels::EnableFastPaths(fastPaths);
+                                          if (isBroadcast)
+                                              result->AssignSumOf(a, input);
+                                          else
+                                              result->DoUnaryOpOf(0, input, 1, ElementWiseOperator::opCopy, c.reductionOp);
+                                          TensorOpKernels::EnableFastPaths(true);
+                                      },
+                                      WaitFor(resultMatrix) };
+            });
+        }
+    }
+}
+
+// every elementwise op of TensorView (see ForAllUnaryOps() etc.), and broadcasting and reductions
 template <class ElemType>
-void MandSTest(int count, int devId)
+void AddTensorBenchmarks(BenchmarkSuite& suite, DEVICEID_TYPE deviceId)
 {
-    ElemType* arr = new ElemType[count];
-    for (int i = 0; i < count; ++i)
-        arr[i] = (1.0 * rand()) / RAND_MAX + 1;
-
-    ElemType* data1 = new ElemType[1024 * 4096];
-    for (int i = 0; i < 1024 * 4096; ++i)
-        data1[i] = (1.0 * rand()) / RAND_MAX + 1;
-
-    ElemType* data2 = new ElemType[1024 * 4096];
-    for (int i = 0; i < 1024 * 4096; ++i)
-        data2[i] = (1.0 * rand()) / RAND_MAX + 1;
-
-    ElemType* data3 = new ElemType[1024];
-    for (int i = 0; i < 1024; ++i)
-        data3[i] = (1.0 * rand()) / RAND_MAX + 1;
-
-    cout << "Testing Matrix" << endl;
-    Matrix<ElemType> A(1024, 4096, data1, true, devId);
-    Matrix<ElemType> B(4096, 1024, data2, true, devId);
-    Matrix<ElemType> V(1024, 1, data3, true, devId);
-    Matrix<ElemType> C(1024, 1024, devId);
-
-    auto t_startG = clock();
-    for (int i = 0; i < count; ++i)
+    typedef TensorView<ElemType> Tensor;
+    const size_t rows = 512, cols = 4096;
+#define AddUnaryTensorOpBenchmark(oper) \
+    AddTensorOpBenchmark<ElemType>(suite, "unary/" #oper, 1, rows, cols, deviceId, [](Tensor& r, const vector<Tensor>& in) { r.Assign##oper##Of(in[0]); })
+#define AddBinaryTensorOpBenchmark(oper) \
+    AddTensorOpBenchmark<ElemType>(suite, "binary/" #oper, 2, rows, cols, deviceId, [](Tensor& r, const vector<Tensor>& in) { r.Assign##oper##Of(in[0], in[1]); })
+#define AddTernaryTensorOpBenchmark(oper) \
+    AddTensorOpBenchmark<ElemType>(suite, "ternary/" #oper, 3, rows, cols, deviceId, [](Tensor& r, const vector<Tensor>& in) { r.Assign##oper##Of(in[0], in[1], in[2]); })
+    ForAllUnaryOps(AddUnaryTensorOpBenchmark);
+    ForAllBinaryOps(AddBinaryTensorOpBenchmark);
+    ForAllTernaryOps(AddTernaryTensorOpBenchmark);
+#undef AddUnaryTensorOpBenchmark
+#undef AddBinaryTensorOpBenchmark
+#undef AddTernaryTensorOpBenchmark
+
+    AddTensorBroadcastBenchmarks<ElemType>(suite, rows, cols, deviceId);
+    AddTensorBroadcastBenchmarks<ElemType>(suite, 1000003, 1, deviceId);
+}
+
+// The products of a sparse CSC minibatch (e.g. of one-hot or multi-hot click features) of the given density as
+// they occur in training an embedding: the lookup W * x, and the block-sparse gradient of W, dense * x^T.
+template <class ElemType>
+void AddSparseBenchmarks(BenchmarkSuite& suite, DEVICEID_TYPE deviceId)
+{
+    const size_t vocabularySize = 100000, embeddingSize = 128, minibatchSize = 256;
+    for (double density : { 0.0001, 0.001, 0.01 })
     {
-        // Matrix<ElemType>::MultiplyAndWeightedAdd(arr[i],A,false,B,false,3.2*arr[i],C);
-        C += (A * arr[i]) * (B * (arr[i] * 2.3));
+        auto createInput = [=]()
+        {
+            vector<CPUSPARSE_INDEX_TYPE> columnStarts(1, 0), rowIndices;
+            mt19937 rng(1);
+            for (size_t j = 0; j < minibatchSize; j++)
+            {
+                for (size_t i = 0; i < vocabularySize; i++)
+                    if (uniform_real_distribution<double>(0, 1)(rng) < density)
+                        rowIndices.push_back((CPUSPARSE_INDEX_TYPE) i);
+                columnStarts.push_back((CPUSPARSE_INDEX_TYPE) rowIndices.size());
+            }
+            vector<ElemType> values(rowIndices.size(), 1);
+            auto x = make_shared<Matrix<ElemType>>(vocabularySize, minibatchSize, deviceId, SPARSE, matrixFormatSparseCSC);
+            x->SetMatrixFromCSCFormat(columnStarts.data(), rowIndices.data(), values.data(), values.size(), vocabularySize, minibatchSize);
+            return x;
+        };
+        double nonzeros = density * vocabularySize * minibatchSize;
+        string shape = "/" + DeviceName(deviceId) + "/" + TypeName<ElemType>() + "/density" + to_string(density).substr(0, 6);
+
+        suite.Add("sparse/lookup" + shape, 2.0 * embeddingSize * nonzeros, "flops", [=]()
+        {
+            auto x = createInput();
+            auto w = RandomMatrix<ElemType>(embeddingSize, vocabularySize, deviceId, 1);
+            auto y = make_shared<Matrix<ElemType>>(embeddingSize, minibatchSize, deviceId);
+            return BenchmarkBody{ [=]() { Matrix<ElemType>::MultiplyAndWeightedAdd(1, *w, false, *x, false, 0, *y); }, WaitFor(y) };
+        });
+        suite.Add("sparse/gradient" + shape, 2.0 * embeddingSize * nonzeros, "flops", [=]()
+        {
+            auto x = createInput();
+            auto gradient = RandomMatrix<ElemType>(embeddingSize, minibatchSize, deviceId, 1);
+            auto gradientW = make_shared<Matrix<ElemType>>(embeddingSize, vocabularySize, deviceId, SPARSE, matrixFormatSparseBlockCol);
+            return BenchmarkBody{ [=]()
+                                  {
+                                      gradientW->Reset();
+                                      Matrix<ElemType>::MultiplyAndAdd(*gradient, false, *x, true, *gradientW);
+                                  },
+                                  [=]() { gradient->Get00Element(); } };
+        });
     }
-    auto t_endG = clock();
-    double valM = 1.0 * (t_endG - t_startG) / (CLOCKS_PER_SEC * count);
-    cout << "Matrix C+=alpha*A*beta*B in: " << valM << " seconds" << endl;
-
-    cout << "Testing CPUMatrix" << endl;
-    CPUMatrix<ElemType> AC(1024, 4096, data1, true);
-    CPUMatrix<ElemType> BC(4096, 1024, data2, true);
-    CPUMatrix<ElemType> VC(1024, 1, data3, true);
-    CPUMatrix<ElemType> CC(1024, 1024);
-
-    auto t_startC = clock();
-    for (int i = 0; i < count; ++i)
+}
+
+// forward, backward data and backward kernel of 3x3 stride 1 convolutions (with auto padding) with each engine
+// of the device
+template <class ElemType>
+void AddConvolutionBenchmarks(BenchmarkSuite& suite, DEVICEID_TYPE deviceId)
+{
+    vector<pair<ConvolutionEngineKind, string>> engines;
+    if (deviceId < 0)
+        engines = { { ConvolutionEngineKind::Reference, "Reference" }, { ConvolutionEngineKind::Gemm, "GEMM" }, { ConvolutionEngineKind::Winograd, "Winograd" } };
+    else
+        engines = { { ConvolutionEngineKind::CuDnn, "cuDNN" }, { ConvolutionEngineKind::Gemm, "GEMM" } };
+    const size_t minibatchSize = 8;
+
+    for (auto shape : { array<size_t, 3>{ 56, 64, 64 }, array<size_t, 3>{ 28, 128, 128 }, array<size_t, 3>{ 14, 256, 256 } })
     {
-        CPUMatrix<ElemType>::MultiplyAndWeightedAdd(arr[i], AC, false, BC, false, 3.2 * arr[i], CC);
-        // CC+=(arr[i]*AC)*((arr[i]*2.3)*BC);
+        size_t size = shape[0], inMaps = shape[1], outMaps = shape[2];
+        for (const auto& engine : engines)
+        {
+            if (engine.first == ConvolutionEngineKind::Reference && size > 28)
+                continue; // (too slow to be of use)
+            auto setup = [=](int pass)
+            {
+                auto geometry = make_shared<ConvolveGeometry>(TensorShape(size, size, inMaps), TensorShape(3, 3, inMaps), TensorShape(outMaps),
+                                                              TensorShape(1, 1, inMaps), ConvolveGeometry::BoolVec{ true },
+                                                              ConvolveGeometry::BoolVec{ true, true, false }, TensorShape(0), TensorShape(0));
+                shared_ptr<ConvolutionEngine<ElemType>> convolution(ConvolutionEngine<ElemType>::Create(geometry, deviceId, ImageLayoutKind::CHW, 0, PoolKind::None, engine.first).release());
+                auto in = RandomMatrix<ElemType>(geometry->InputShape().GetNumElements(), minibatchSize, deviceId, 1);
+                auto kernel = RandomMatrix<ElemType>(outMaps, geometry->KernelShape().GetNumElements(), deviceId, 2);
+                auto out = RandomMatrix<ElemType>(geometry->OutputShape().GetNumElements(), minibatchSize, deviceId, 3);
+                auto grad = make_shared<Matrix<ElemType>>(in->GetNumRows(), minibatchSize, deviceId);
+                grad->SetValue(0);
+                auto kernelGrad = make_shared<Matrix<ElemType>>(kernel->GetNumRows(), kernel->GetNumCols(), deviceId);
+                kernelGrad->SetValue(0);
+                auto workspace = make_shared<Matrix<ElemType>>(deviceId);
+                auto run = [=]()
+                {
+                    if (pass == 0)
+                        convolution->Forward(*in, *kernel, *out, *workspace);
+                    else if (pass == 1)
+                        convolution->BackwardData(*out, *kernel, *grad, *workspace);
+                    else
+                        convolution->BackwardKernel(*out, *in, *kernelGrad, false, *workspace);
+                };
+                return BenchmarkBody{ run, WaitFor(pass == 0 ? out : pass == 1 ? grad : kernelGrad) };
+            };
+            string name = "/" + engine.second + "/" + DeviceName(deviceId) + "/" + TypeName<ElemType>() + "/" + to_string(size) + "x" + to_string(size) + "x" +
+                          to_string(inMaps) + "-" + to_string(outMaps) + "/mb" + to_string(minibatchSize);
+            double flops = 2.0 * size * size * 9 * inMaps * outMaps * minibatchSize;
+            suite.Add("convolution/forward" + name, flops, "flops", [=]() { return setup(0); });
+            suite.Add("convolution/backwardData" + name, flops, "flops", [=]() { return setup(1); });
+            suite.Add("convolution/backwardKernel" + name, flops, "flops", [=]() { return setup(2); });
+        }
     }
-    auto t_endC = clock();
-    double valMC = 1.0 * (t_endC - t_startC) / (CLOCKS_PER_SEC * count);
-    cout << "CPUMatrix C+=alpha*A*beta*B in: " << valMC << " seconds" << endl;
-
-    delete[] arr;
-    delete[] data1;
-    delete[] data2;
-    delete[] data3;
 }
 
-int wmain()
+// spatial batch normalization in training, forward and backward
+template <class ElemType>
+void AddBatchNormalizationBenchmarks(BenchmarkSuite& suite, DEVICEID_TYPE deviceId)
 {
-    // MandSTest<float>(100, 2);
+    for (auto shape : { array<size_t, 3>{ 56, 64, 32 }, array<size_t, 3>{ 14, 256, 32 } })
+    {
+        size_t size = shape[0], maps = shape[1], minibatchSize = shape[2];
+        auto setup = [=](bool backward)
+        {
+            TensorShape inOutShape(size, size, maps);
+            shared_ptr<BatchNormEngine<ElemType>> engine(BatchNormEngine<ElemType>::Create(deviceId, inOutShape, true, ImageLayoutKind::CHW).release());
+            auto in = RandomMatrix<ElemType>(inOutShape.GetNumElements(), minibatchSize, deviceId, 1);
+            auto scale = RandomMatrix<ElemType>(maps, 1, deviceId, 2);
+            auto bias = RandomMatrix<ElemType>(maps, 1, deviceId, 3);
+            auto runMean = make_shared<Matrix<ElemType>>(Matrix<ElemType>::Zeros(maps, 1, deviceId));
+            auto runVariance = make_shared<Matrix<ElemType>>(Matrix<ElemType>::Ones(maps, 1, deviceId));
+            auto saveMean = make_shared<Matrix<ElemType>>(maps, 1, deviceId);
+            auto saveInvStdDev = make_shared<Matrix<ElemType>>(maps, 1, deviceId);
+            auto out = make_shared<Matrix<ElemType>>(in->GetNumRows(), minibatchSize, deviceId);
+            auto srcGrad = RandomMatrix<ElemType>(in->GetNumRows(), minibatchSize, deviceId, 4);
+            auto grad = make_shared<Matrix<ElemType>>(Matrix<ElemType>::Zeros(in->GetNumRows(), minibatchSize, deviceId));
+            auto scaleGrad = make_shared<Matrix<ElemType>>(maps, 1, deviceId);
+            auto biasGrad = make_shared<Matrix<ElemType>>(maps, 1, deviceId);
+            auto forward = [=]() { engine->Forward(*in, *scale, *bias, false, 0.1, 0, *runMean, *runVariance, *out, 1e-5, *saveMean, *saveInvStdDev); };
+            forward();
+            if (!backward)
+                return BenchmarkBody{ forward, WaitFor(out) };
+            return BenchmarkBody{ [=]() { engine->Backward(*in, *srcGrad, *grad, *scale, 0, *saveMean, *saveInvStdDev, *scaleGrad, *biasGrad); }, WaitFor(grad) };
+        };
+        string name = "/" + DeviceName(deviceId) + "/" + TypeName<ElemType>() + "/" + to_string(size) + "x" + to_string(size) + "x" + to_string(maps) + "/mb" + to_string(minibatchSize);
+        double bytes = 2.0 * size * size * maps * minibatchSize * sizeof(ElemType);
+        suite.Add("batchnorm/forward" + name, bytes, "bytes", [=]() { return setup(false); });
+        suite.Add("batchnorm/backward" + name, 1.5 * bytes, "bytes", [=]() { return setup(true); });
+    }
+}
 
-    /*cout<<endl<<"********************Matrix SquareMultiplyAndWeightedAdd10TimesAvg TEST********************"<<endl;
-    SquareMultiplyAndAdd10TimesAvgTest<float>(4096,10);
+// log softmax and cross entropy with one-hot labels of an output layer, column by column
+template <class ElemType>
+void AddSoftmaxBenchmarks(BenchmarkSuite& suite, DEVICEID_TYPE deviceId)
+{
+    for (auto shape : { array<size_t, 2>{ 1000, 256 }, array<size_t, 2>{ 30000, 256 } })
+    {
+        size_t classes = shape[0], minibatchSize = shape[1];
+        string name = "softmaxce/" + DeviceName(deviceId) + "/" + TypeName<ElemType>() + "/" + to_string(classes) + "x" + to_string(minibatchSize);
+        suite.Add(name, 3.0 * classes * minibatchSize * sizeof(ElemType), "bytes", [=]()
+        {
+            auto z = RandomMatrix<ElemType>(classes, minibatchSize, deviceId, 1, -5, 5);
+            vector<ElemType> oneHot(classes * minibatchSize, 0);
+            for (size_t j = 0; j < minibatchSize; j++)
+                oneHot[j * classes + (j * 7919) % classes] = 1;
+            auto labels = make_shared<Matrix<ElemType>>(classes, minibatchSize, oneHot.data(), deviceId);
+            auto logSoftmax = make_shared<Matrix<ElemType>>(classes, minibatchSize, deviceId);
+            auto crossEntropy = make_shared<Matrix<ElemType>>(1, 1, deviceId);
+            return BenchmarkBody{ [=]()
+                                  {
+                                      logSoftmax->AssignLogSoftmaxOf(*z, true);
+                                      crossEntropy->AssignInnerProductOfMatrices(*labels, *logSoftmax);
+                                  },
+                                  WaitFor(crossEntropy) };
+        });
+    }
+}
 
-    cout<<endl<<"********************Matrix AddMultiplyAndInplaceSigmoid TEST********************"<<endl;    
-    AddMultiplyAndInplaceSigmoidTest<float>(11,10,12);    
-    AddMultiplyAndInplaceSigmoidTest<float>(110,100,120);    
-    AddMultiplyAndInplaceSigmoidTest<float>(1100,1000,1200);    
-    AddMultiplyAndInplaceSigmoidTest<float>(11000,10000,1200);
+// 1-bit quantization of gradients with residuals and back (as for data-parallel SGD), and the 16-bit products of
+// quantized inference
+template <class ElemType>
+void AddQuantizerBenchmarks(BenchmarkSuite& suite, DEVICEID_TYPE deviceId)
+{
+    for (auto shape : { array<size_t, 2>{ 2048, 2048 }, array<size_t, 2>{ 512, 9216 } })
+    {
+        size_t rows = shape[0], cols = shape[1];
+        string name = "quantizer/1bit/" + DeviceName(deviceId) + "/" + TypeName<ElemType>() + "/" + to_string(rows) + "x" + to_string(cols);
+        suite.Add(name, 2.0 * rows * cols * sizeof(ElemType), "bytes", [=]()
+        {
+            shared_ptr<MatrixQuantizerImpl<ElemType>> quantizer(MatrixQuantizerImpl<ElemType>::Create(deviceId, false));
+            auto gradient = RandomMatrix<ElemType>(rows, cols, deviceId, 1);
+            auto residual = make_shared<Matrix<ElemType>>(Matrix<ElemType>::Zeros(rows, cols, deviceId));
+            auto quantized = make_shared<QuantizedMatrix<ElemType>>(rows, cols, 1, deviceId);
+            auto unquantized = make_shared<Matrix<ElemType>>(rows, cols, deviceId);
+            return BenchmarkBody{ [=]()
+                                  {
+                                      quantizer->QuantizeAsync(*gradient, *residual, *quantized, *residual, true);
+                                      quantizer->WaitQuantizeAsyncDone();
+                                      quantizer->UnquantizeAsync(*quantized, *unquantized, false);
+                                      quantizer->WaitUnquantizeAsyncDone();
+                                  },
+                                  WaitFor(unquantized) };
+        });
+    }
+
+    if (deviceId >= 0)
+        return;
+
+    // the word-by-word column loop that MatrixQuantizerCPU used before its 1-bit path, on one thread, as the baseline of the above
+    for (auto shape : { array<size_t, 2>{ 2048, 2048 }, array<size_t, 2>{ 512, 9216 } })
+    {
+        size_t rows = shape[0], cols = shape[1];
+        string name = "quantizer/1bit-columns/" + DeviceName(deviceId) + "/" + TypeName<ElemType>() + "/" + to_string(rows) + "x" + to_string(cols);
+        suite.Add(name, 2.0 * rows * cols * sizeof(ElemType), "bytes", [=]()
+        {
+            auto gradient = RandomMatrix<ElemType>(rows, cols, deviceId, 1);
+            auto residual = make_shared<Matrix<ElemType>>(Matrix<ElemType>::Zeros(rows, cols, deviceId));
+            auto quantized = make_shared<QuantizedMatrix<ElemType>>(rows, cols, 1, deviceId);
+            auto unquantized = make_shared<Matrix<ElemType>>(rows, cols, deviceId);
+            return BenchmarkBody{ [=]()
+                                  {
+                                      for (size_t j = 0; j < cols; j++)
+                                      {
+                                          auto& qcol = *quantized->GetQuantizedColumn(j);
+                                          ColumnQuantizer<ElemType>::template ComputeRangeStatColj<true>(gradient->Data(), residual->Data(), (long) rows, j, 1, qcol.lower, qcol.upper);
+                                          ColumnQuantizer<ElemType> q(0, qcol.lower, qcol.upper);
+                                          q.template Quantize<true>(gradient->Data(), residual->Data(), (long) rows, j, qcol.bits, residual->Data());
+                                      }
+                                      for (size_t j = 0; j < cols; j++)
+                                      {
+                                          const auto& qcol = *quantized->GetQuantizedColumn(j);
+                                          ColumnQuantizer<ElemType> q(0, qcol.lower, qcol.upper);
+                                          q.Unquantize(unquantized->Data(), (long) rows, j, qcol.bits, false);
+                                      }
+                                  },
+                                  nullptr };
+        });
+    }
 
-    cout<<endl<<"********************Matrix MultiplyAndWeightedAdd TEST********************"<<endl;    
-    MultiplyAndWeightedAddTest<float>(11,10,12);    
-    MultiplyAndWeightedAddTest<float>(110,100,120);    
-    MultiplyAndWeightedAddTest<float>(1100,1000,1200);    
-    MultiplyAndWeightedAddTest<float>(11000,10000,12000);*/
+    for (auto shape : { array<size_t, 3>{ 2048, 512, 1 }, array<size_t, 3>{ 2048, 512, 32 }, array<size_t, 3>{ 1024, 1024, 256 } })
+    {
+        size_t m = shape[0], k = shape[1], n = shape[2];
+        string name = "quantizer/product16/" + DeviceName(deviceId) + "/" + TypeName<ElemType>() + "/" + to_string(m) + "x" + to_string(k) + "x" + to_string(n);
+        suite.Add(name, 2.0 * m * k * n, "flops", [=]()
+        {
+            auto w = RandomMatrix<ElemType>(m, k, deviceId, 1);
+            auto x = RandomMatrix<ElemType>(k, n, deviceId, 2);
+            auto y = make_shared<Matrix<ElemType>>(m, n, deviceId);
+            auto product = make_shared<QuantizedProduct<ElemType>>(*w, 16);
+            return BenchmarkBody{ [=]() { product->Multiply(*x, *y); }, nullptr };
+        });
+    }
+}
+
+// The 16-bit quantized BlockMultiplier with the given block handler, so that the handlers (SSE, AVX2, AVX-512)
+// can be compared on the shapes of quantized inference.
+template <class BlockHandlerT>
+void AddBlockMultiplierBenchmark(BenchmarkSuite& suite, const string& handlerName, int m, int k, int n, int numThreads = 1)
+{
+    if (!BlockHandlerT::IsSupported())
+        return;
+
+    string name = "quantizer/blockMultiplier/" + handlerName + "/" + to_string(m) + "x" + to_string(k) + "x" + to_string(n) + "/threads" + to_string(numThreads);
+    suite.Add(name, 2.0 * m * k * n, "ops", [=]()
+    {
+        typedef BlockMultiplier<BlockHandlerT> MultiplierT;
+        auto mult = make_shared<MultiplierT>(numThreads);
+        auto A = MultiplierT::CreateMatrixA(m, k);
+        auto B = MultiplierT::CreateMatrixB(k, n);
+        int32_t* C = MultiplierT::CreateMatrixC(m, n);
+        RandInitIntMatrix<typename MultiplierT::ScalarAT>(A, m, k, 63);
+        RandInitIntMatrix<typename MultiplierT::ScalarBT>(B, k, n, 63);
+        auto preparedB = mult->PrepareB(B, k, n);
+        MultiplierT::FreeMatrix(B);
+        // the matrices are released with the body
+        shared_ptr<void> matrices(nullptr, [=](void*)
+        {
+            MultiplierT::FreeMatrix(A);
+            MultiplierT::FreeMatrix(C);
+            MultiplierT::FreeMatrix(preparedB);
+        });
+        return BenchmarkBody{ [=]()
+                              {
+                                  (void) matrices;
+                                  memset(C, 0, sizeof(int32_t) * m * n);
+                                  mult->MultiplyMatrices(A, m, k, preparedB, n, C);
+                              },
+                              nullptr };
+    });
+}
+
+// the same multiplications with all handlers that are compiled in
+void AddBlockMultiplierBenchmarks(BenchmarkSuite& suite)
+{
+    for (auto shape : { array<int, 4>{ 1, 512, 2048, 1 }, array<int, 4>{ 4, 512, 2048, 1 }, array<int, 4>{ 32, 1024, 1024, 1 }, array<int, 4>{ 32, 1024, 1024, 4 } })
+    {
+        AddBlockMultiplierBenchmark<BlockHandlerSSE>(suite, "SSE", shape[0], shape[1], shape[2], shape[3]);
+#ifdef SUPPORT_AVX2
+        AddBlockMultiplierBenchmark<BlockHandlerAVX>(suite, "AVX2", shape[0], shape[1], shape[2], shape[3]);
+#endif
+#ifdef SUPPORT_AVX512
+        AddBlockMultiplierBenchmark<BlockHandlerAVX512>(suite, "AVX-512", shape[0], shape[1], shape[2], shape[3]);
+#endif
+    }
+}
+
+// copies of 64 MB between the host and a GPU, and between GPUs
+template <class ElemType>
+void AddTransferBenchmarks(BenchmarkSuite& suite, DEVICEID_TYPE deviceId)
+{
+    const size_t rows = 4096, cols = 64 * 1024 * 1024 / sizeof(ElemType) / rows;
+    const double bytes = (double) rows * cols * sizeof(ElemType);
+    string shape = "/" + TypeName<ElemType>() + "/64MB";
+
+    suite.Add("transfer/CPU-" + DeviceName(deviceId) + shape, bytes, "bytes", [=]()
+    {
+        auto host = make_shared<vector<ElemType>>(rows * cols, (ElemType) 1);
+        auto device = make_shared<Matrix<ElemType>>(rows, cols, deviceId);
+        return BenchmarkBody{ [=]() { device->SetValue(rows, cols, deviceId, host->data()); }, WaitFor(device) };
+    });
+    suite.Add("transfer/" + DeviceName(deviceId) + "-CPU" + shape, bytes, "bytes", [=]()
+    {
+        auto device = RandomMatrix<ElemType>(rows, cols, deviceId, 1);
+        auto host = make_shared<vector<ElemType>>(rows * cols);
+        return BenchmarkBody{ [=]()
+                              {
+                                  ElemType* data = host->data();
+                                  size_t size = host->size();
+                                  device->CopyToArray(data, size);
+                              },
+                              nullptr };
+    });
+
+    const DEVICEID_TYPE peer = deviceId + 1;
+    if (!IsDeviceAvailable(peer))
+        return;
+    suite.Add("transfer/" + DeviceName(deviceId) + "-" + DeviceName(peer) + shape, bytes, "bytes", [=]()
+    {
+        auto matrix = RandomMatrix<ElemType>(rows, cols, deviceId, 1);
+        auto atDevice = make_shared<bool>(true);
+        return BenchmarkBody{ [=]()
+                              {
+                                  matrix->TransferToDeviceIfNotThere(*atDevice ? peer : deviceId, true);
+                                  *atDevice = !*atDevice;
+                              },
+                              WaitFor(matrix) };
+    });
+}
+
+template <class ElemType>
+void AddBenchmarks(BenchmarkSuite& suite, DEVICEID_TYPE deviceId)
+{
+    AddGemmBenchmarks<ElemType>(suite, deviceId);
+    AddTensorBenchmarks<ElemType>(suite, deviceId);
+    AddSparseBenchmarks<ElemType>(suite, deviceId);
+    AddConvolutionBenchmarks<ElemType>(suite, deviceId);
+    AddBatchNormalizationBenchmarks<ElemType>(suite, deviceId);
+    AddSoftmaxBenchmarks<ElemType>(suite, deviceId);
+    AddQuantizerBenchmarks<ElemType>(suite, deviceId);
+    if (deviceId >= 0)
+        AddTransferBenchmarks<ElemType>(suite, deviceId);
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    string jsonPath, baselinePath, filter;
+    double tolerance = 0.1, minSeconds = 0.2;
+    bool cpuOnly = false, list = false;
+    for (int i = 1; i < argc; i++)
+    {
+        wstring arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == L"-json" && hasValue)
+            jsonPath = msra::strfun::utf8(argv[++i]);
+        else if (arg == L"-baseline" && hasValue)
+            baselinePath = msra::strfun::utf8(argv[++i]);
+        else if (arg == L"-tolerance" && hasValue)
+            tolerance = wcstod(argv[++i], nullptr);
+        else if (arg == L"-filter" && hasValue)
+            filter = msra::strfun::utf8(argv[++i]);
+        else if (arg == L"-minTime" && hasValue)
+            minSeconds = wcstod(argv[++i], nullptr);
+        else if (arg == L"-cpuOnly")
+            cpuOnly = true;
+        else if (arg == L"-list")
+            list = true;
+        else
+        {
+            fprintf(stderr, "Usage: MathPerformanceTests [-filter <substring>] [-minTime <seconds>] [-cpuOnly] [-list] [-json <results.json>] [-baseline <baseline.json> [-tolerance <fraction>]]\n");
+            return -1;
+        }
+    }
+
+    BenchmarkSuite suite;
+    suite.SetFilter(filter);
+    suite.SetMinSeconds(minSeconds);
+    vector<DEVICEID_TYPE> devices = { CPUDEVICE };
+    if (!cpuOnly && IsDeviceAvailable(0))
+        devices.push_back(0);
+    for (auto deviceId : devices)
+    {
+        AddBenchmarks<float>(suite, deviceId);
+        AddGemmBenchmarks<double>(suite, deviceId);
+    }
+    AddBlockMultiplierBenchmarks(suite);
+
+    if (list)
+    {
+        suite.List();
+        return 0;
+    }
 
+    cout << "Running the benchmarks on " << (devices.size() > 1 ? "the CPU and GPU 0" : "the CPU") << " with " << omp_get_max_threads() << " thread(s)" << endl;
+    suite.Run();
+    if (!jsonPath.empty())
+        suite.WriteJson(jsonPath);
+    if (!baselinePath.empty())
+        return (int) suite.CompareWithBaseline(baselinePath, tolerance);
     return 0;
 }
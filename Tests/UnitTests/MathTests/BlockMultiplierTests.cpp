@@ -137,6 +137,17 @@ template<typename ScalarAT, typename ScalarBT, typename ScalarCT, typename Multi
     TestMultiplierSub<ScalarAT, ScalarBT, ScalarCT, MultiplierT>(m, k, n, testMult, numThreads, epsilon);
 }
 
+// The AVX2 and AVX-512 handlers are only tested on machines that have the instructions.
+template<typename BlockHandlerT>static void TestHandlerIfSupported(int m, int k, int n, int numThreads = 1)
+{
+    if (!BlockHandlerT::IsSupported())
+    {
+        BOOST_TEST_MESSAGE("Skipping, the processor does not support the instruction set of the block handler.");
+        return;
+    }
+    TestMultiplierSub<int16_t, int16_t, int32_t, BlockMultiplier<BlockHandlerT>>(m, k, n, numThreads);
+}
+
 BOOST_AUTO_TEST_SUITE(BlockMultiplierSuite)
 
 BOOST_AUTO_TEST_CASE(BlockMultiplyTest8x128x8SingleThread)
@@ -185,5 +196,38 @@ BOOST_AUTO_TEST_CASE(BlockMultiplyTestAllKFourRowsMultiThread)
     TestMultiplierSub<int16_t, int16_t, int32_t, BlockMultiplier<BlockHandlerSSE>>(4, 128 + 64 + 32 + 16 + 8 + 1, 1, 2);
 }
 
+#ifdef SUPPORT_AVX2
+// Several blocks of 128, single row (the 128x1 handler takes two blocks at a time)
+BOOST_AUTO_TEST_CASE(BlockMultiplyTestAVXThreeBlocksSingleRow)
+{
+    TestHandlerIfSupported<BlockHandlerAVX>(1, 3 * 128 + 64 + 32 + 16 + 8 + 1, 3);
+}
+#endif
+
+#ifdef SUPPORT_AVX512
+BOOST_AUTO_TEST_CASE(BlockMultiplyTestAVX512_8x128x8SingleThread)
+{
+    TestHandlerIfSupported<BlockHandlerAVX512>(8, 128, 8);
+}
+
+// Test that hits all the kernel functions in BlockMultiplier (single row)
+BOOST_AUTO_TEST_CASE(BlockMultiplyTestAVX512AllKSingleRow)
+{
+    TestHandlerIfSupported<BlockHandlerAVX512>(1, 3 * 128 + 64 + 32 + 16 + 8 + 1, 3);
+}
+
+// Test that hits all the kernel functions in BlockMultiplier (four rows)
+BOOST_AUTO_TEST_CASE(BlockMultiplyTestAVX512AllKFourRows)
+{
+    TestHandlerIfSupported<BlockHandlerAVX512>(4, 3 * 128 + 64 + 32 + 16 + 8 + 1, 3);
+}
+
+BOOST_AUTO_TEST_CASE(BlockMultiplyTestAVX512AllKMultiThread)
+{
+    TestHandlerIfSupported<BlockHandlerAVX512>(8, 2 * 128 + 64 + 32 + 16 + 8 + 1, 5, 2);
+    TestHandlerIfSupported<BlockHandlerAVX512>(7, 2 * 128 + 64 + 32 + 16 + 8 + 1, 5, 2);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
 }}}} //end namespaces
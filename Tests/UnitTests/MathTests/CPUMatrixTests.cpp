@@ -4,6 +4,8 @@
 //
 #include "stdafx.h"
 #include "../../../Source/Math/CPUMatrix.h"
+#include "../../../Source/Math/ImageAugmentation.h"
+#include "../../../Source/Math/ValueCompression.h"
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -61,6 +63,28 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixConstructorFormatRowMajor, RandomSeedFixture)
     BOOST_CHECK_EQUAL(m(1, 2), 12);
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUMatrixSetValueExternalBuffer, RandomSeedFixture)
+{
+    std::array<float, 6> array1 = {1, 2, 3, 4, 5, 6};
+    std::array<float, 6> array2 = {7, 8, 9, 10, 11, 12};
+    SMatrix m;
+
+    // binding does not copy, and rebinding does not free the previous buffer
+    m.SetValue(2, 3, array1.data(), matrixFlagDontOwnBuffer);
+    BOOST_CHECK(!m.OwnBuffer());
+    BOOST_CHECK_EQUAL(m.Data(), array1.data());
+    m.SetValue(3, 2, array2.data(), matrixFlagDontOwnBuffer);
+    BOOST_CHECK_EQUAL(m.Data(), array2.data());
+    BOOST_CHECK_EQUAL(m(2, 1), 12);
+
+    // copying a value into it gets an own buffer again, leaving the borrowed one alone
+    m.SetValue(3, 2, array1.data(), matrixFlagNormal);
+    BOOST_CHECK(m.OwnBuffer());
+    BOOST_CHECK_NE(m.Data(), array2.data());
+    BOOST_CHECK_EQUAL(m(2, 1), 6);
+    BOOST_CHECK_EQUAL(array2[5], 12);
+}
+
 BOOST_FIXTURE_TEST_CASE(CPUMatrixAddAndSub, RandomSeedFixture)
 {
     DMatrix m0(2, 3);
@@ -220,6 +244,79 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixMultiplyAndDiv, RandomSeedFixture)
     BOOST_CHECK(m3.IsEqualTo(m2));
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUMatrixMultiplyAndAddBias, RandomSeedFixture)
+{
+    // tall enough for the product to be computed in several tiles of columns
+    const size_t rows = 600, inner = 20, cols = 300;
+    SMatrix a(rows, inner), b(inner, cols), bias(rows, 1);
+    a.SetUniformRandomValue(-1, 1, IncrementCounter());
+    b.SetUniformRandomValue(-1, 1, IncrementCounter());
+    bias.SetUniformRandomValue(-1, 1, IncrementCounter());
+
+    SMatrix product;
+    SMatrix::Multiply(a, b, product);
+    for (auto activation : { opCopy, opSigmoid, opTanh, opLinearRectifier })
+    {
+        SMatrix c;
+        SMatrix::MultiplyAndAddBias(a, b, bias, activation, c);
+        BOOST_REQUIRE_EQUAL(c.GetNumRows(), rows);
+        BOOST_REQUIRE_EQUAL(c.GetNumCols(), cols);
+        foreach_coord (i, j, c)
+        {
+            double z = (double) product(i, j) + bias(i, 0);
+            double expected = activation == opSigmoid ? 1 / (1 + exp(-z)) : activation == opTanh ? tanh(z) : activation == opLinearRectifier ? std::max(z, 0.0) : z;
+            BOOST_CHECK_SMALL(c(i, j) - expected, 1e-5);
+        }
+    }
+
+    DMatrix bias2(2, 1);
+    bias2(0, 0) = -100;
+    bias2(1, 0) = 1;
+    DMatrix m0(2, 3), m1(3, 1), m2;
+    m0.SetValue(1);
+    m1.SetValue(2);
+    DMatrix::MultiplyAndAddBias(m0, m1, bias2, opLinearRectifier, m2);
+    BOOST_CHECK_EQUAL(m2(0, 0), 0);
+    BOOST_CHECK_EQUAL(m2(1, 0), 7);
+    BOOST_CHECK_THROW(DMatrix::MultiplyAndAddBias(m0, m1, m0, opCopy, m2), std::exception);
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixBatchMultiplyAndWeightedAdd, RandomSeedFixture)
+{
+    // the products of 5 pairs of matrices op(a_j) [3 x 4] and op(b_j) [4 x 2], each in a column of a and b
+    const size_t m = 3, k = 4, n = 2, batchSize = 5;
+    for (int transposeA = 0; transposeA < 2; transposeA++)
+    {
+        for (int transposeB = 0; transposeB < 2; transposeB++)
+        {
+            const size_t aRows = transposeA ? k : m, bRows = transposeB ? n : k;
+            DMatrix a(m * k, batchSize), b(k * n, batchSize), c(m * n, batchSize);
+            a.SetUniformRandomValue(-1, 1, IncrementCounter());
+            b.SetUniformRandomValue(-1, 1, IncrementCounter());
+            c.SetUniformRandomValue(-1, 1, IncrementCounter());
+            DMatrix previous(c);
+            DMatrix::BatchMultiplyAndWeightedAdd(2, a, transposeA != 0, aRows, b, transposeB != 0, bRows, 0.5, c);
+            BOOST_REQUIRE_EQUAL(c.GetNumRows(), m * n);
+            BOOST_REQUIRE_EQUAL(c.GetNumCols(), batchSize);
+
+            for (size_t j = 0; j < batchSize; j++)
+            {
+                DMatrix aj(aRows, m * k / aRows), bj(bRows, k * n / bRows), cj;
+                memcpy(aj.Data(), a.Data() + j * m * k, m * k * sizeof(double));
+                memcpy(bj.Data(), b.Data() + j * k * n, k * n * sizeof(double));
+                DMatrix::MultiplyAndWeightedAdd(2, aj, transposeA != 0, bj, transposeB != 0, 0, cj);
+                for (size_t i = 0; i < m * n; i++)
+                    BOOST_CHECK_SMALL(c(i, j) - cj.Data()[i] - 0.5 * previous(i, j), 1e-12);
+            }
+        }
+    }
+
+    DMatrix a(6, 2), b(6, 3), c;
+    BOOST_CHECK_THROW(DMatrix::BatchMultiplyAndWeightedAdd(1, a, false, 2, b, false, 3, 0, c), std::exception); // different batch sizes
+    DMatrix b2(6, 2);
+    BOOST_CHECK_THROW(DMatrix::BatchMultiplyAndWeightedAdd(1, a, false, 2, b2, false, 2, 0, c), std::exception); // [2 x 3] * [2 x 3]
+}
+
 BOOST_FIXTURE_TEST_CASE(CPUMatrixElementOperations, RandomSeedFixture)
 {
     // TODO: consider splitting this large test
@@ -874,6 +971,116 @@ BOOST_FIXTURE_TEST_CASE(CPUColumnElementOperations, RandomSeedFixture)
     BOOST_CHECK(m0.IsEqualTo(m2, c_epsilonFloatE4));
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUMatrixScatterColumnsWithRepeatedTargets, RandomSeedFixture)
+{
+    // several source columns go into the same target column, as for the gradient of a context window
+    DMatrix a = DMatrix::RandomUniform(130, 6, -1, 1, IncrementCounter());
+    double map[] = { 0, 0, 1, -1, 0, 2 };
+    DMatrix idx(1, 6, map);
+    DMatrix m0 = DMatrix::RandomUniform(130, 3, -1, 1, IncrementCounter());
+
+    DMatrix m1;
+    m1.SetValue(m0);
+    m1.DoScatterColumnsOf(/*beta=*/1, idx, a, /*alpha=*/2);
+
+    DMatrix m2;
+    m2.SetValue(m0);
+    for (long i = 0; i < 130; i++)
+    {
+        m2(i, 0) += 2 * (a(i, 0) + a(i, 1) + a(i, 4));
+        m2(i, 1) += 2 * a(i, 2);
+        m2(i, 2) += 2 * a(i, 5);
+    }
+
+    BOOST_CHECK(m1.IsEqualTo(m2, c_epsilonFloatE4));
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixAssignPackedIndices, RandomSeedFixture)
+{
+    // two parallel sequences: the first starts one frame before the minibatch and has frames 1..3 in it,
+    // the second has frames 0..1; the last column is a gap
+    double index[] = { 1, 0, 3, 1, 2, std::numeric_limits<double>::quiet_NaN(), 0, 5 };
+    double ranges[] = { -2, 1, 4,  1, 0, 2,  -2, 1, 4,  1, 0, 2,  -2, 1, 4,  1, 0, 2,  -2, 1, 4,  0, 0, 0 };
+    DMatrix idx(1, 8, index);
+    DMatrix rangeMatrix(3, 8, ranges);
+
+    DMatrix m;
+    m.AssignPackedIndicesOf(idx, rangeMatrix, /*numParallelSequences=*/2);
+
+    // out of the range of a sequence, NaN and gaps become -1
+    double expected[] = { 0, 1, 4, 3, 2, -1, -1, -1 };
+    BOOST_REQUIRE_EQUAL(m.GetNumRows(), 1);
+    BOOST_REQUIRE_EQUAL(m.GetNumCols(), 8);
+    for (size_t j = 0; j < 8; j++)
+        BOOST_CHECK_EQUAL(m(0, j), expected[j]);
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixCTCScore, RandomSeedFixture)
+{
+    // two utterances in two parallel sequences: labels 0 1 in 4 frames, and label 1 in 3 frames followed by a gap;
+    // the classes are 0, 1 and the blank 2
+    const size_t numClasses = 3, numParallelSequences = 2, maxFrameNum = 4, blank = 2;
+    DMatrix logProbs = DMatrix::RandomUniform(numClasses, numParallelSequences * maxFrameNum, -2, 0, IncrementCounter());
+    foreach_column (j, logProbs)
+    {
+        double logSum = log(exp(logProbs(0, j)) + exp(logProbs(1, j)) + exp(logProbs(2, j)));
+        foreach_row (k, logProbs)
+            logProbs(k, j) -= logSum;
+    }
+    double labels[] = { 0, 1, 1, -1 };
+    DMatrix labelSequences(2, 2, labels);
+    std::vector<size_t> uttToChanInd = { 0, 1 }, uttBeginFrame = { 0, 0 }, uttFrameNum = { 4, 3 }, uttLabelNum = { 2, 1 };
+
+    DMatrix occupancy, alpha, beta, totalScore;
+    occupancy.AssignCTCScore(logProbs, alpha, beta, labelSequences, totalScore, uttToChanInd, uttBeginFrame, uttFrameNum, uttLabelNum, numParallelSequences, maxFrameNum, blank);
+
+    // reference: the sum over all paths that collapse to the labels
+    DMatrix expectedOccupancy(numClasses, numParallelSequences * maxFrameNum);
+    expectedOccupancy.SetValue(0);
+    double expectedScore = 0;
+    for (size_t u = 0; u < 2; u++)
+    {
+        const size_t T = uttFrameNum[u];
+        size_t numPaths = 1;
+        for (size_t t = 0; t < T; t++)
+            numPaths *= numClasses;
+        double total = 0;
+        std::vector<double> pathProbs(numPaths, 0);
+        for (size_t path = 0; path < numPaths; path++)
+        {
+            std::vector<size_t> collapsed;
+            double prob = 1;
+            size_t previous = blank;
+            for (size_t t = 0, rest = path; t < T; t++, rest /= numClasses)
+            {
+                size_t k = rest % numClasses;
+                prob *= exp(logProbs(k, t * numParallelSequences + uttToChanInd[u]));
+                if (k != blank && k != previous)
+                    collapsed.push_back(k);
+                previous = k;
+            }
+            bool matches = collapsed.size() == uttLabelNum[u];
+            for (size_t l = 0; matches && l < collapsed.size(); l++)
+                matches = collapsed[l] == (size_t) labelSequences(l, u);
+            if (matches)
+            {
+                pathProbs[path] = prob;
+                total += prob;
+            }
+        }
+        for (size_t path = 0; path < numPaths; path++)
+        {
+            for (size_t t = 0, rest = path; t < T; t++, rest /= numClasses)
+                expectedOccupancy(rest % numClasses, t * numParallelSequences + uttToChanInd[u]) += pathProbs[path] / total;
+        }
+        expectedScore -= log(total);
+    }
+
+    // (the log additions skip terms below exp(MINLOGEXP) of the larger one)
+    BOOST_CHECK_CLOSE(totalScore(0, 0), expectedScore, 0.1);
+    BOOST_CHECK(occupancy.IsEqualTo(expectedOccupancy, c_epsilonFloatE3));
+}
+
 BOOST_FIXTURE_TEST_CASE(CPUMatrixSeedingFloat, RandomSeedFixture)
 {
     const float low = 0;
@@ -898,6 +1105,248 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixSeedingDouble, RandomSeedFixture)
     BOOST_CHECK(m1.IsEqualTo(m2));
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUMatrixAddDropoutOf, RandomSeedFixture)
+{
+    const float rate = 0.3f;
+    const float scale = 1 / (1 - rate);
+    const uint64_t key = 4711;
+
+    CPUMatrix<float> a = CPUMatrix<float>::RandomUniform(37, 50, 1, 2, IncrementCounter());
+    CPUMatrix<float> full;
+    full.AddDropoutOf(a, rate, scale, key, 0, 0);
+
+    // the mask only depends on the element index in the stream: computed column by column, it is the same
+    size_t dropped = 0;
+    for (size_t j = 0; j < a.GetNumCols(); j++)
+    {
+        CPUMatrix<float> column = a.ColumnSlice(j, 1);
+        CPUMatrix<float> masked;
+        masked.AddDropoutOf(column, rate, scale, key, j * a.GetNumRows(), 0);
+        for (size_t i = 0; i < a.GetNumRows(); i++)
+        {
+            BOOST_CHECK_EQUAL(masked(i, 0), full(i, j));
+            BOOST_CHECK(full(i, j) == 0 || fabs(full(i, j) - a(i, j) * scale) < c_epsilonFloatE5);
+            dropped += full(i, j) == 0;
+        }
+    }
+    BOOST_CHECK_CLOSE(dropped / (double) a.GetNumElements(), rate, 10);
+
+    // with beta = 1 the same mask is applied again and added (as in backprop)
+    CPUMatrix<float> twice(full); // (a deep copy)
+    twice.AddDropoutOf(a, rate, scale, key, 0, 1);
+    for (size_t i = 0; i < a.GetNumElements(); i++)
+        BOOST_CHECK_CLOSE(twice.Data()[i], 2 * full.Data()[i], 1e-4);
+
+    // another key gives another mask
+    CPUMatrix<float> other;
+    other.AddDropoutOf(a, rate, scale, key + 1, 0, 0);
+    BOOST_CHECK(!other.IsEqualTo(full));
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixBatchNormalization, RandomSeedFixture)
+{
+    // spatial (3 channels of 6 elements) and per activation (5 rows), compared with the formulas in double
+    for (size_t spatialSize : { 6, 1 })
+    {
+        const size_t numChannels = spatialSize > 1 ? 3 : 5, batchSize = 7, rows = numChannels * spatialSize;
+        const double epsilon = 1e-5, expAvgFactor = 0.1, m = (double) (spatialSize * batchSize);
+        CPUMatrix<float> in = CPUMatrix<float>::RandomUniform(rows, batchSize, -2, 3, IncrementCounter());
+        CPUMatrix<float> scale = CPUMatrix<float>::RandomUniform(numChannels, 1, 0.5, 1.5, IncrementCounter());
+        CPUMatrix<float> bias = CPUMatrix<float>::RandomUniform(numChannels, 1, -1, 1, IncrementCounter());
+        CPUMatrix<float> runMean(numChannels, 1), runVariance(numChannels, 1);
+        runMean.SetValue(0.5f);
+        runVariance.SetValue(2);
+        CPUMatrix<float> out(rows, batchSize), saveMean, saveInvStdDev;
+        in.BatchNormalizationForward(scale, bias, false, expAvgFactor, 0, runMean, runVariance, out, epsilon, saveMean, saveInvStdDev);
+
+        std::vector<double> mean(numChannels, 0), variance(numChannels, 0);
+        for (size_t i = 0; i < rows; i++)
+            for (size_t j = 0; j < batchSize; j++)
+                mean[i / spatialSize] += in(i, j) / m;
+        for (size_t i = 0; i < rows; i++)
+            for (size_t j = 0; j < batchSize; j++)
+                variance[i / spatialSize] += (in(i, j) - mean[i / spatialSize]) * (in(i, j) - mean[i / spatialSize]) / m;
+        for (size_t c = 0; c < numChannels; c++)
+        {
+            BOOST_CHECK_CLOSE(saveMean(c, 0), mean[c], 1e-3);
+            BOOST_CHECK_CLOSE(saveInvStdDev(c, 0), 1 / sqrt(variance[c] + epsilon), 1e-3);
+            BOOST_CHECK_CLOSE(runMean(c, 0), 0.1 * mean[c] + 0.9 * 0.5, 1e-3);
+            BOOST_CHECK_CLOSE(runVariance(c, 0), 0.1 * variance[c] * m / (m - 1) + 0.9 * 2, 1e-3);
+        }
+        for (size_t i = 0; i < rows; i++)
+        {
+            for (size_t j = 0; j < batchSize; j++)
+            {
+                size_t c = i / spatialSize;
+                BOOST_CHECK_SMALL(out(i, j) - (scale(c, 0) * (in(i, j) - mean[c]) / sqrt(variance[c] + epsilon) + bias(c, 0)), 1e-4);
+            }
+        }
+
+        // the gradients of the loss sum(out * dy)
+        CPUMatrix<float> dy = CPUMatrix<float>::RandomUniform(rows, batchSize, -1, 1, IncrementCounter());
+        CPUMatrix<float> dx(rows, batchSize), scaleGrad(numChannels, 1), biasGrad(numChannels, 1);
+        dx.SetValue(1); // the gradient is added
+        dy.BatchNormalizationBackward(in, dx, scale, 0, saveMean, saveInvStdDev, scaleGrad, biasGrad);
+        std::vector<double> dBias(numChannels, 0), dScale(numChannels, 0);
+        for (size_t i = 0; i < rows; i++)
+        {
+            for (size_t j = 0; j < batchSize; j++)
+            {
+                size_t c = i / spatialSize;
+                dBias[c] += dy(i, j);
+                dScale[c] += dy(i, j) * (in(i, j) - mean[c]) / sqrt(variance[c] + epsilon);
+            }
+        }
+        for (size_t i = 0; i < rows; i++)
+        {
+            for (size_t j = 0; j < batchSize; j++)
+            {
+                size_t c = i / spatialSize;
+                double invStdDev = 1 / sqrt(variance[c] + epsilon), xHat = (in(i, j) - mean[c]) * invStdDev;
+                double expected = scale(c, 0) * invStdDev * (dy(i, j) - (xHat * dScale[c] + dBias[c]) / m);
+                BOOST_CHECK_SMALL(dx(i, j) - 1 - expected, 1e-4);
+            }
+        }
+        for (size_t c = 0; c < numChannels; c++)
+        {
+            BOOST_CHECK_SMALL(biasGrad(c, 0) - dBias[c], 1e-4);
+            BOOST_CHECK_SMALL(scaleGrad(c, 0) - dScale[c], 1e-4);
+        }
+
+        // inference with the running statistics
+        in.BatchNormalizationForward(scale, bias, true, 0, 1, runMean, runVariance, out, epsilon, saveMean, saveInvStdDev);
+        BOOST_CHECK(saveMean.IsEmpty());
+        size_t c = (rows - 1) / spatialSize;
+        BOOST_CHECK_SMALL(out(rows - 1, 0) - (scale(c, 0) * (in(rows - 1, 0) - runMean(c, 0)) / sqrt(runVariance(c, 0) + epsilon) + bias(c, 0)), 1e-4);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CPUMatrixResizeCapacity)
+{
+    const double growthFactor = MatrixResizePolicy::GetGrowthFactor(), shrinkThreshold = MatrixResizePolicy::GetShrinkThreshold();
+    MatrixResizePolicy::SetGrowthFactor(2);
+    MatrixResizePolicy::SetShrinkThreshold(0.25);
+
+    CPUMatrix<float> m(10, 8);
+    size_t numReallocations = MatrixResizePolicy::GetNumReallocations();
+    // growing by a column doubles the capacity, which the following columns fit into
+    m.Resize(10, 9);
+    BOOST_CHECK_EQUAL(m.GetSizeAllocated(), 160);
+    for (size_t numCols = 10; numCols <= 16; numCols++)
+        m.Resize(10, numCols);
+    m.Resize(10, 5);
+    BOOST_CHECK_EQUAL(m.GetSizeAllocated(), 160);
+    BOOST_CHECK_EQUAL(MatrixResizePolicy::GetNumReallocations() - numReallocations, 1);
+
+    // below a quarter of the capacity the buffer is shrunk to fit
+    m.Resize(10, 3);
+    BOOST_CHECK_EQUAL(m.GetSizeAllocated(), 30);
+
+    // without growOnly, and on demand, the buffer fits exactly
+    m.Resize(10, 4, false);
+    BOOST_CHECK_EQUAL(m.GetSizeAllocated(), 40);
+    m.Resize(10, 5);
+    BOOST_CHECK_EQUAL(m.GetSizeAllocated(), 80);
+    for (size_t i = 0; i < m.GetNumElements(); i++)
+        m.Data()[i] = (float) i;
+    m.ShrinkToFit();
+    BOOST_CHECK_EQUAL(m.GetSizeAllocated(), 50);
+    for (size_t i = 0; i < m.GetNumElements(); i++)
+        BOOST_CHECK_EQUAL(m.Data()[i], (float) i);
+    BOOST_CHECK_EQUAL(MatrixResizePolicy::GetNumReallocations() - numReallocations, 5);
+
+    MatrixResizePolicy::SetGrowthFactor(growthFactor);
+    MatrixResizePolicy::SetShrinkThreshold(shrinkThreshold);
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixAssignAugmentedImages, RandomSeedFixture)
+{
+    // 2x3 images of 3 channels, HWC
+    const int width = 2, height = 3, channels = 3, size = width * height * channels, numCols = 4;
+    std::vector<unsigned char> images(size * numCols);
+    std::vector<float> mean(size);
+    for (int i = 0; i < size * numCols; i++)
+        images[i] = (unsigned char) (i * 37 % 256);
+    for (int i = 0; i < size; i++)
+        mean[i] = (float) i;
+
+    ImageAugmentationParams params;
+    memset(&params, 0, sizeof(params));
+    params.m_width = width;
+    params.m_height = height;
+    params.m_channels = channels;
+    params.m_transpose = true;
+    params.m_scale = 0.5f;
+
+    // without jittering: the mean subtracted, scaled and in CHW
+    SMatrix m;
+    m.AssignAugmentedImages(images.data(), numCols, params, mean.data(), 1);
+    BOOST_CHECK_EQUAL(m.GetNumRows(), size);
+    BOOST_CHECK_EQUAL(m.GetNumCols(), numCols);
+    for (int j = 0; j < numCols; j++)
+        for (int p = 0; p < width * height; p++)
+            for (int c = 0; c < channels; c++)
+                BOOST_CHECK_EQUAL(m(c * width * height + p, j), (images[j * size + p * channels + c] - mean[p * channels + c]) * 0.5f);
+
+    // with jittering, within the range of 8-bit values, and the same for the same key
+    params.m_brightnessRadius = 0.2f;
+    params.m_contrastRadius = 0.3f;
+    params.m_saturationRadius = 0.4f;
+    SMatrix jittered, again;
+    jittered.AssignAugmentedImages(images.data(), numCols, params, nullptr, 7);
+    again.AssignAugmentedImages(images.data(), numCols, params, nullptr, 7);
+    for (int i = 0; i < size * numCols; i++)
+    {
+        BOOST_CHECK(jittered.Data()[i] >= 0 && jittered.Data()[i] <= 255 * 0.5f);
+        BOOST_CHECK_EQUAL(jittered.Data()[i], again.Data()[i]);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixCompressValues, RandomSeedFixture)
+{
+    const size_t numRows = 13, numCols = 3;
+    SMatrix m(numRows, numCols);
+    m.SetUniformRandomValue(-3, 5, IncrementCounter());
+    m(4, 1) = 0;
+
+    const ValueCompression compressions[] = { ValueCompression::sign, ValueCompression::half, ValueCompression::byte };
+    for (auto compression : compressions)
+    {
+        const size_t columnBytes = CompressedColumnBytes(compression, numRows);
+        std::vector<char> codes(columnBytes * numCols);
+        m.CompressValuesInto(codes.data(), columnBytes, compression);
+        SMatrix restored;
+        restored.AssignDecompressedValuesOf(codes.data(), columnBytes, compression, numRows, numCols);
+        BOOST_CHECK_EQUAL(restored.GetNumRows(), numRows);
+        BOOST_CHECK_EQUAL(restored.GetNumCols(), numCols);
+
+        for (size_t j = 0; j < numCols; j++)
+        {
+            float minimum = m(0, j), maximum = m(0, j);
+            for (size_t i = 0; i < numRows; i++)
+            {
+                minimum = std::min(minimum, m(i, j));
+                maximum = std::max(maximum, m(i, j));
+            }
+            for (size_t i = 0; i < numRows; i++)
+            {
+                if (compression == ValueCompression::sign)
+                    BOOST_CHECK_EQUAL(restored(i, j), m(i, j) > 0 ? 1.0f : 0.0f);
+                else if (compression == ValueCompression::half)
+                    BOOST_CHECK_LE(fabs(restored(i, j) - m(i, j)), fabs(m(i, j)) / 2048 + 6e-8f);
+                else
+                    BOOST_CHECK_LE(fabs(restored(i, j) - m(i, j)), (maximum - minimum) / 510 * 1.001f);
+            }
+        }
+    }
+
+    // special values of half precision
+    BOOST_CHECK_EQUAL(HalfToFloat(FloatToHalf(65504.0f)), 65504.0f);
+    BOOST_CHECK(std::isinf(HalfToFloat(FloatToHalf(1e6f))));
+    BOOST_CHECK_EQUAL(HalfToFloat(FloatToHalf(-0.25f)), -0.25f);
+    BOOST_CHECK_EQUAL(HalfToFloat(FloatToHalf(1.0f / 16777216)), 1.0f / 16777216);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
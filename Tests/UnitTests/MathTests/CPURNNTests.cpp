@@ -0,0 +1,114 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "../../../Source/Math/CPUMatrix.h"
+#include "../../../Source/Math/RNNCommon.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(CPURNNSuite)
+
+// sum_ij y(i, j) * g(i, j) of the forward pass, whose gradient with respect to y is g
+static double Loss(const CPUMatrix<double>& w, const CPUMatrix<double>& x, const CPUMatrix<double>& g, const vector<size_t>& numSequencesForFrame, const RnnAttributes& attributes)
+{
+    CPUMatrix<double> y, reserve, workspace;
+    y.RNNForward(x, w, x.GetNumRows(), g.GetNumRows(), numSequencesForFrame, attributes, reserve, workspace);
+    double loss = 0;
+    for (size_t i = 0; i < y.GetNumElements(); i++)
+        loss += y.Data()[i] * g.Data()[i];
+    return loss;
+}
+
+// Compares the gradients of the data and the weights with finite differences, for sequences of the lengths 4, 4, 2
+// and 1, packed longest first.
+static void CheckGradients(const RnnAttributes& attributes)
+{
+    const size_t xDim = 3;
+    const size_t yDim = (attributes.m_bidirectional ? 2 : 1) * attributes.m_hiddenSize;
+    const vector<size_t> numSequencesForFrame = { 4, 3, 2, 2 };
+    const size_t numColumns = 11;
+    const auto numParameters = attributes.GetNumParameters(xDim);
+
+    CPUMatrix<double> w(numParameters.first, numParameters.second);
+    w.SetUniformRandomValue(-0.5, 0.5, 1);
+    CPUMatrix<double> x(xDim, numColumns);
+    x.SetUniformRandomValue(-1, 1, 2);
+    CPUMatrix<double> g(yDim, numColumns);
+    g.SetUniformRandomValue(-1, 1, 3);
+
+    CPUMatrix<double> y, reserve, workspace, dx;
+    y.RNNForward(x, w, xDim, yDim, numSequencesForFrame, attributes, reserve, workspace);
+    BOOST_REQUIRE_EQUAL(y.GetNumRows(), yDim);
+    BOOST_REQUIRE_EQUAL(y.GetNumCols(), numColumns);
+    y.RNNBackwardData(g, w, dx, attributes, reserve, workspace);
+    CPUMatrix<double> dw(w.GetNumRows(), w.GetNumCols());
+    dw.SetValue(1); // the gradients are added
+    y.RNNBackwardWeights(x, y, dw, attributes, reserve, workspace);
+
+    const double epsilon = 1e-5;
+    for (size_t i = 0; i < x.GetNumElements(); i++)
+    {
+        const double value = x.Data()[i];
+        x.Data()[i] = value + epsilon;
+        const double plus = Loss(w, x, g, numSequencesForFrame, attributes);
+        x.Data()[i] = value - epsilon;
+        const double minus = Loss(w, x, g, numSequencesForFrame, attributes);
+        x.Data()[i] = value;
+        BOOST_CHECK_SMALL(dx.Data()[i] - (plus - minus) / (2 * epsilon), 1e-6);
+    }
+    for (size_t i = 0; i < w.GetNumElements(); i++)
+    {
+        const double value = w.Data()[i];
+        w.Data()[i] = value + epsilon;
+        const double plus = Loss(w, x, g, numSequencesForFrame, attributes);
+        w.Data()[i] = value - epsilon;
+        const double minus = Loss(w, x, g, numSequencesForFrame, attributes);
+        w.Data()[i] = value;
+        BOOST_CHECK_SMALL(dw.Data()[i] - 1 - (plus - minus) / (2 * epsilon), 1e-6);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CPURNNLstmGradients)
+{
+    CheckGradients(RnnAttributes(true, 2, 3, L"lstm", -1));
+}
+
+BOOST_AUTO_TEST_CASE(CPURNNGruGradients)
+{
+    CheckGradients(RnnAttributes(true, 2, 3, L"gru", -1));
+}
+
+BOOST_AUTO_TEST_CASE(CPURNNPlainGradients)
+{
+    CheckGradients(RnnAttributes(false, 2, 3, L"rnnTanh", -1));
+    CheckGradients(RnnAttributes(true, 1, 2, L"rnnReLU", -1));
+}
+
+BOOST_AUTO_TEST_CASE(CPURNNLstmForward)
+{
+    // A single LSTM unit with all weights 0 but the biases: every gate has the same input b, the sum of the two
+    // biases, so that c_t = s(b) * (c_t-1 + tanh(b)) and h_t = s(b) * tanh(c_t).
+    RnnAttributes attributes(false, 1, 1, L"lstm", -1);
+    CPUMatrix<double> w(1, attributes.GetNumParameters(2).second);
+    w.SetValue(0);
+    for (size_t j = 0; j < 8; j++)
+        w.Data()[(2 + 1) * 4 + j] = 0.25; // bW and bR
+    CPUMatrix<double> x(2, 3);
+    x.SetUniformRandomValue(-1, 1, 1);
+
+    CPUMatrix<double> y, reserve, workspace;
+    y.RNNForward(x, w, 2, 1, vector<size_t>{ 2, 1 }, attributes, reserve, workspace);
+    const double s = 1 / (1 + exp(-0.5)), g = tanh(0.5);
+    const double c0 = s * g, c1 = s * c0 + s * g;
+    BOOST_CHECK_CLOSE(y(0, 0), s * tanh(c0), 1e-10);
+    BOOST_CHECK_CLOSE(y(0, 1), s * tanh(c0), 1e-10);
+    BOOST_CHECK_CLOSE(y(0, 2), s * tanh(c1), 1e-10);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
@@ -61,6 +61,179 @@ BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixCopyColumnSliceToDense, RandomSeedFixture
     BOOST_CHECK(dm1.IsEqualTo(dm2, c_epsilonFloatE4));
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixMultiplyAndAdd, RandomSeedFixture)
+{
+    // a sparse 'minibatch' with about 5% nonzero elements, large enough for the products to run in parallel,
+    // against the same products of dense matrices
+    const size_t m = 400;
+    const size_t n = 300;
+    const size_t h = 200;
+    DenseMatrix mask(m, n);
+    mask.SetUniformRandomValue(0, 1, IncrementCounter());
+    DenseMatrix dm0(m, n);
+    dm0.SetUniformRandomValue(-1, 1, IncrementCounter());
+    SparseMatrix sm0(MatrixFormat::matrixFormatSparseCSC, m, n, 0);
+    foreach_coord (row, col, dm0)
+    {
+        if (mask(row, col) < 0.05)
+            sm0.SetValue(row, col, dm0(row, col));
+        else
+            dm0(row, col) = 0;
+    }
+
+    auto check = [&](const DenseMatrix& a, bool transposeA, const DenseMatrix& aSparse, bool sparseLeft, const SparseMatrix& s, bool transposeS)
+    {
+        DenseMatrix expected;
+        DenseMatrix result;
+        if (sparseLeft)
+        {
+            DenseMatrix::MultiplyAndWeightedAdd(0.5, aSparse, transposeS, a, transposeA, 0, expected);
+            SparseMatrix::MultiplyAndWeightedAdd(0.5, s, transposeS, a, transposeA, 0, result);
+        }
+        else
+        {
+            DenseMatrix::MultiplyAndWeightedAdd(0.5, a, transposeA, aSparse, transposeS, 0, expected);
+            SparseMatrix::MultiplyAndWeightedAdd(0.5, a, transposeA, s, transposeS, 0, result);
+        }
+        BOOST_CHECK(result.IsEqualTo(expected, c_epsilonFloatE4));
+    };
+
+    DenseMatrix dhm(h, m), dmh(m, h), dhn(h, n), dnh(n, h);
+    dhm.SetUniformRandomValue(-1, 1, IncrementCounter());
+    dmh.SetUniformRandomValue(-1, 1, IncrementCounter());
+    dhn.SetUniformRandomValue(-1, 1, IncrementCounter());
+    dnh.SetUniformRandomValue(-1, 1, IncrementCounter());
+    check(dhm, false, dm0, false, sm0, false); // dense * sparse
+    check(dmh, true,  dm0, false, sm0, false); // dense^T * sparse
+    check(dhn, false, dm0, false, sm0, true);  // dense * sparse^T
+    check(dnh, false, dm0, true,  sm0, false); // sparse * dense
+    check(dmh, false, dm0, true,  sm0, true);  // sparse^T * dense
+
+    // the gradient of an embedding, a sparse block matrix with a block for each row of sm0 that has nonzero elements
+    SparseMatrix gradient(MatrixFormat::matrixFormatSparseBlockCol);
+    SparseMatrix::MultiplyAndAdd(0.5, dhn, false, sm0, true, gradient);
+    DenseMatrix expected;
+    DenseMatrix::MultiplyAndWeightedAdd(0.5, dhn, false, dm0, true, 0, expected);
+    DenseMatrix result(h, m);
+    result.SetValue(0);
+    SparseMatrix::ScaleAndAdd(1, gradient, result);
+    BOOST_CHECK(result.IsEqualTo(expected, c_epsilonFloatE4));
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixBlockColumns, RandomSeedFixture)
+{
+    // the block-column gradients of two 'workers', merged as after gathering their columns, against the dense sum
+    const size_t rows = 7;
+    const size_t cols = 50;
+    DenseMatrix w(rows, cols);
+    w.SetUniformRandomValue(-1, 1, IncrementCounter());
+    DenseMatrix expected(rows, cols);
+    expected.SetValue(0);
+
+    std::vector<size_t> allIds;
+    std::vector<double> allValues;
+    for (auto ids : { std::vector<size_t>{ 3, 17, 42 }, std::vector<size_t>{ 42, 0, 3, 49 } })
+    {
+        DenseMatrix columns(rows, ids.size());
+        columns.SetUniformRandomValue(-1, 1, IncrementCounter());
+        SparseMatrix gradient(MatrixFormat::matrixFormatSparseBlockCol);
+        gradient.AssignSumOfBlockColumns(rows, cols, ids, std::vector<double>(columns.Data(), columns.Data() + columns.GetNumElements()));
+        SparseMatrix::ScaleAndAdd(1, gradient, expected);
+
+        std::vector<size_t> gotIds;
+        std::vector<double> gotValues;
+        gradient.GetBlockColumns(gotIds, gotValues);
+        BOOST_CHECK_EQUAL(gotIds.size(), ids.size());
+        allIds.insert(allIds.end(), gotIds.begin(), gotIds.end());
+        allValues.insert(allValues.end(), gotValues.begin(), gotValues.end());
+    }
+
+    SparseMatrix sum(MatrixFormat::matrixFormatSparseBlockCol);
+    sum.AssignSumOfBlockColumns(rows, cols, allIds, allValues);
+    std::vector<size_t> sumIds;
+    std::vector<double> sumValues;
+    sum.GetBlockColumns(sumIds, sumValues);
+    BOOST_CHECK(sumIds == (std::vector<size_t>{ 0, 3, 17, 42, 49 }));
+    DenseMatrix result(rows, cols);
+    result.SetValue(0);
+    SparseMatrix::ScaleAndAdd(1, sum, result);
+    BOOST_CHECK(result.IsEqualTo(expected, c_epsilonFloatE4));
+
+    // L2 regularization of the touched columns only
+    SparseMatrix::ScaleAndAddToBlockColumns(0.5, w, sum);
+    result.SetValue(0);
+    SparseMatrix::ScaleAndAdd(1, sum, result);
+    for (size_t j : { 0, 3, 17, 42, 49 })
+    {
+        for (size_t i = 0; i < rows; i++)
+            expected(i, j) += 0.5 * w(i, j);
+    }
+    BOOST_CHECK(result.IsEqualTo(expected, c_epsilonFloatE4));
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixAssignScatteredColumnsOf, RandomSeedFixture)
+{
+    // the embedding gradient for repeated ids and a gap (-1), against the dense scatter
+    const size_t rows = 6;
+    const size_t cols = 30;
+    const std::vector<double> ids = { 4, 29, 4, -1, 0, 29, 4 };
+    DenseMatrix idx(1, ids.size());
+    for (size_t j = 0; j < ids.size(); j++)
+        idx(0, j) = ids[j];
+    DenseMatrix a(rows, ids.size());
+    a.SetUniformRandomValue(-1, 1, IncrementCounter());
+
+    DenseMatrix expected(rows, cols);
+    expected.SetValue(0);
+    expected.DoScatterColumnsOf(1, idx, a, 0.5);
+
+    SparseMatrix gradient(MatrixFormat::matrixFormatSparseBlockCol);
+    gradient.AssignScatteredColumnsOf(idx, a, 0.5);
+    std::vector<size_t> gotIds;
+    std::vector<double> gotValues;
+    gradient.GetBlockColumns(gotIds, gotValues);
+    BOOST_CHECK(gotIds == (std::vector<size_t>{ 0, 4, 29 }));
+
+    DenseMatrix result(rows, cols);
+    result.SetValue(0);
+    SparseMatrix::ScaleAndAdd(1, gradient, result);
+    BOOST_CHECK(result.IsEqualTo(expected, c_epsilonFloatE4));
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixCrossEntropyWithSoftmax, RandomSeedFixture)
+{
+    // one-hot labels over a large 'vocabulary', with logits too large for a softmax without the maximum subtracted,
+    // against the dense log-softmax
+    const size_t rows = 5000;
+    const size_t cols = 40;
+    DenseMatrix prediction(rows, cols);
+    prediction.SetUniformRandomValue(-10, 10, IncrementCounter());
+    prediction(17, 3) = 800;
+
+    SparseMatrix labels(MatrixFormat::matrixFormatSparseCSC, rows, cols, 0);
+    std::vector<size_t> labelIds(cols);
+    for (size_t j = 0; j < cols; j++)
+    {
+        labelIds[j] = (j * 7919) % rows;
+        labels.SetValue(labelIds[j], j, 1);
+    }
+
+    DenseMatrix logSoftmax;
+    logSoftmax.AssignLogSoftmaxOf(prediction, true);
+    DenseMatrix expectedCriterion(1, cols);
+    DenseMatrix expectedGradient(rows, cols);
+    foreach_coord (row, col, logSoftmax)
+        expectedGradient(row, col) = exp(logSoftmax(row, col)) - (row == labelIds[col] ? 1 : 0);
+    for (size_t j = 0; j < cols; j++)
+        expectedCriterion(0, j) = -logSoftmax(labelIds[j], j);
+
+    DenseMatrix criterion;
+    DenseMatrix gradient;
+    SparseMatrix::CrossEntropyWithSoftmax(labels, prediction, criterion, gradient);
+    BOOST_CHECK(criterion.IsEqualTo(expectedCriterion, c_epsilonFloatE4));
+    BOOST_CHECK(gradient.IsEqualTo(expectedGradient, c_epsilonFloatE4));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
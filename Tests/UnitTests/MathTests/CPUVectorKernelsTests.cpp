@@ -0,0 +1,296 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include "../../../Source/Math/CPUMatrix.h"
+#include "../../../Source/Math/CPUVectorKernels.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// the kernels of all instruction sets this processor can run
+static std::vector<const CPUVectorKernels*> AllKernels()
+{
+    std::vector<const CPUVectorKernels*> kernels;
+    for (auto instructionSet : { CPUVectorInstructionSet::scalar, CPUVectorInstructionSet::sse2, CPUVectorInstructionSet::avx2 })
+    {
+        if (auto k = CPUVectorKernels::Get(instructionSet))
+            kernels.push_back(k);
+    }
+    return kernels;
+}
+
+// distance of two floats in units in the last place
+static int64_t UlpDistance(float a, float b)
+{
+    if (isnan(a) || isnan(b))
+        return isnan(a) && isnan(b) ? 0 : INT32_MAX;
+    auto ordered = [](float f)
+    {
+        int32_t i;
+        memcpy(&i, &f, sizeof(i));
+        return i < 0 ? (int64_t) INT32_MIN - i : (int64_t) i;
+    };
+    int64_t d = ordered(a) - ordered(b);
+    return d < 0 ? -d : d;
+}
+
+// a dense range around 0, a coarse one beyond the limits of exp(), and the special values
+static std::vector<float> TestInputs()
+{
+    std::vector<float> x;
+    for (float v = -3; v < 3; v += 0.000731f)
+        x.push_back(v);
+    for (float v = -120; v < 120; v += 0.0173f)
+        x.push_back(v);
+    x.push_back(0.0f);
+    x.push_back(-0.0f);
+    x.push_back(INFINITY);
+    x.push_back(-INFINITY);
+    x.push_back(NAN);
+    return x;
+}
+
+template <class Function, class Reference>
+static void CheckUlps(const char* name, const CPUVectorKernels& kernels, Function f, Reference reference)
+{
+    std::vector<float> x = TestInputs();
+    std::vector<float> c(x.size());
+    f(x.data(), c.data(), x.size());
+    int64_t maxUlps = 0;
+    for (size_t i = 0; i < x.size(); i++)
+        maxUlps = std::max(maxUlps, UlpDistance(c[i], (float) reference((double) x[i])));
+    BOOST_CHECK_MESSAGE(maxUlps <= 2, kernels.Name() << " " << name << ": " << maxUlps << " ulps");
+}
+
+BOOST_AUTO_TEST_SUITE(CPUVectorKernelsSuite)
+
+BOOST_AUTO_TEST_CASE(CPUVectorKernelsAvailable)
+{
+    BOOST_REQUIRE(CPUVectorKernels::Get(CPUVectorInstructionSet::scalar) != nullptr);
+    const CPUVectorKernels& best = CPUVectorKernels::Best();
+    BOOST_CHECK(CPUVectorKernels::Get(best.InstructionSet()) == &best);
+}
+
+BOOST_AUTO_TEST_CASE(CPUVectorKernelsTranscendentals)
+{
+    for (auto kernels : AllKernels())
+    {
+        CheckUlps("exp", *kernels, [=](const float* a, float* c, size_t n) { kernels->Exp(a, c, n); },
+                  [](double x) { return exp(x); });
+        CheckUlps("sigmoid", *kernels, [=](const float* a, float* c, size_t n) { kernels->Sigmoid(a, c, n); },
+                  [](double x) { return x >= 0 ? 1 / (1 + exp(-x)) : exp(x) / (1 + exp(x)); });
+        CheckUlps("tanh", *kernels, [=](const float* a, float* c, size_t n) { kernels->Tanh(a, c, n); },
+                  [](double x) { return tanh(x); });
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CPUVectorKernelsReductions)
+{
+    // odd sizes, so that all kernels have tails
+    const size_t rows = 37, cols = 13;
+    std::vector<float> a(rows * cols);
+    for (size_t i = 0; i < a.size(); i++)
+        a[i] = (float) sin(i * 0.37) * 5;
+
+    for (auto kernels : AllKernels())
+    {
+        double sum = 0;
+        float max = a[0];
+        for (size_t i = 0; i < rows; i++)
+        {
+            sum += a[i];
+            max = std::max(max, a[i]);
+        }
+        BOOST_CHECK_CLOSE(kernels->Sum(a.data(), rows), sum, 1e-10);
+        BOOST_CHECK_EQUAL(kernels->Max(a.data(), rows), max);
+
+        std::vector<float> c(rows, 1.0f);
+        kernels->RowSums(a.data(), rows, cols, rows, 0.5f, c.data(), 2.0f);
+        for (size_t i = 0; i < rows; i++)
+        {
+            double rowSum = 0;
+            for (size_t j = 0; j < cols; j++)
+                rowSum += a[i + j * rows];
+            BOOST_CHECK_SMALL(c[i] - (0.5 + 2 * rowSum), 1e-5);
+        }
+        c.assign(rows, NAN); // not read for beta = 0
+        kernels->RowSums(a.data(), rows, cols, rows, 0.0f, c.data(), 1.0f);
+        BOOST_CHECK(!isnan(c[0]) && !isnan(c[rows - 1]));
+
+        double expSum = 0;
+        for (size_t i = 0; i < rows; i++)
+            expSum += exp((double) a[i] - max);
+        BOOST_CHECK_CLOSE(kernels->SubtractAndSumExp(a.data(), max, c.data(), rows), expSum, 1e-4);
+        BOOST_CHECK_EQUAL(c[rows - 1], a[rows - 1] - max);
+
+        kernels->AddScalar(1.5f, c.data(), rows);
+        BOOST_CHECK_EQUAL(c[rows - 1], (a[rows - 1] - max) + 1.5f);
+
+        // the kernels of batch normalization and pooling
+        const float* b = a.data() + rows;
+        double sumOfSquares = 0, dot = 0;
+        for (size_t i = 0; i < rows; i++)
+        {
+            sumOfSquares += (double) a[i] * a[i];
+            dot += (double) a[i] * b[i];
+        }
+        double s = 1, ss = 2;
+        kernels->SumAndSumOfSquares(a.data(), rows, s, ss);
+        BOOST_CHECK_CLOSE(s, 1 + sum, 1e-10);
+        BOOST_CHECK_CLOSE(ss, 2 + sumOfSquares, 1e-5);
+        double d = 0;
+        s = 0;
+        kernels->SumAndDot(a.data(), b, rows, s, d);
+        BOOST_CHECK_CLOSE(s, sum, 1e-10);
+        BOOST_CHECK_CLOSE(d, dot, 1e-5);
+
+        kernels->ScaleAndShift(a.data(), 2.0f, -1.0f, c.data(), rows);
+        BOOST_CHECK_CLOSE(c[rows - 1], a[rows - 1] * 2 - 1, 1e-5);
+        c.assign(rows, 1.0f);
+        kernels->AddLinearCombination(2.0f, a.data(), -0.5f, b, 3.0f, c.data(), rows);
+        for (size_t i = 0; i < rows; i++)
+            BOOST_CHECK_SMALL(c[i] - (1 + 2 * a[i] - 0.5 * b[i] + 3), 1e-5);
+        c.assign(b, b + rows);
+        kernels->MaxInto(a.data(), c.data(), rows);
+        for (size_t i = 0; i < rows; i++)
+            BOOST_CHECK_EQUAL(c[i], std::max(a[i], b[i]));
+        kernels->AddInto(a.data(), c.data(), rows);
+        BOOST_CHECK_EQUAL(c[rows - 1], std::max(a[rows - 1], b[rows - 1]) + a[rows - 1]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CPUVectorKernelsQuantize1Bit)
+{
+    const size_t n = 37;
+    const float threshold = 0.25f, val0 = -1.5f, val1 = 2.0f;
+    const unsigned int bit = 1u << 31, otherBits = 0x15;
+    std::vector<float> a(n), residual(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        a[i] = (float) sin(i * 0.37) * 2;
+        residual[i] = (float) cos(i * 0.91) * 0.5f;
+    }
+    a[3] = residual[3] = threshold / 2; // ties go to val1
+
+    for (auto kernels : AllKernels())
+    {
+        std::vector<float> outResidual(n), inPlace(residual), c(n, 1.0f);
+        std::vector<unsigned int> bits(n, otherBits), inPlaceBits(n, otherBits);
+        kernels->Quantize1Bit(a.data(), residual.data(), threshold, val0, val1, outResidual.data(), bits.data(), bit, n);
+        kernels->Quantize1Bit(a.data(), inPlace.data(), threshold, val0, val1, inPlace.data(), inPlaceBits.data(), bit, n);
+        for (size_t i = 0; i < n; i++)
+        {
+            float v = a[i] + residual[i];
+            bool q = v >= threshold;
+            BOOST_CHECK_EQUAL(bits[i], q ? (otherBits | bit) : otherBits);
+            BOOST_CHECK_EQUAL(outResidual[i], v - (q ? val1 : val0));
+            BOOST_CHECK_EQUAL(inPlaceBits[i], bits[i]);
+            BOOST_CHECK_EQUAL(inPlace[i], outResidual[i]);
+        }
+        BOOST_CHECK(bits[3] & bit);
+
+        kernels->Unquantize1Bit(bits.data(), bit, val0, val1, c.data(), n, true);
+        for (size_t i = 0; i < n; i++)
+            BOOST_CHECK_EQUAL(c[i], 1.0f + ((bits[i] & bit) ? val1 : val0));
+        kernels->Unquantize1Bit(bits.data(), otherBits & 4, val0, val1, c.data(), n, false);
+        BOOST_CHECK_EQUAL(c[n - 1], val1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CPUVectorKernelsSmallGemm)
+{
+    // odd sizes and leading dimensions, so that the register blocks have tails in rows and columns
+    const size_t m = 37, n = 6, k = 13;
+    for (auto kernels : AllKernels())
+    {
+        for (int transpose = 0; transpose < 4; transpose++)
+        {
+            const bool transposeA = (transpose & 1) != 0, transposeB = (transpose & 2) != 0;
+            const size_t lda = (transposeA ? k : m) + 3, ldb = (transposeB ? n : k) + 1, ldc = m + 2;
+            std::vector<float> a(lda * (transposeA ? m : k)), b(ldb * (transposeB ? k : n)), c(ldc * n);
+            for (size_t i = 0; i < a.size(); i++)
+                a[i] = (float) sin(i * 0.37);
+            for (size_t i = 0; i < b.size(); i++)
+                b[i] = (float) cos(i * 0.91);
+            auto product = [&](size_t i, size_t j)
+            {
+                double sum = 0;
+                for (size_t p = 0; p < k; p++)
+                    sum += (double) (transposeA ? a[p + i * lda] : a[i + p * lda]) * (transposeB ? b[j + p * ldb] : b[p + j * ldb]);
+                return sum;
+            };
+
+            c.assign(c.size(), NAN); // not read for beta = 0
+            kernels->SmallGemm(transposeA, transposeB, m, n, k, 2.0f, a.data(), lda, b.data(), ldb, 0.0f, c.data(), ldc);
+            for (size_t j = 0; j < n; j++)
+                for (size_t i = 0; i < m; i++)
+                    BOOST_CHECK_SMALL(c[i + j * ldc] - 2 * product(i, j), 1e-5);
+
+            c.assign(c.size(), 1.0f);
+            kernels->SmallGemm(transposeA, transposeB, m, n, k, 1.0f, a.data(), lda, b.data(), ldb, -0.5f, c.data(), ldc);
+            for (size_t j = 0; j < n; j++)
+                for (size_t i = 0; i < m; i++)
+                    BOOST_CHECK_SMALL(c[i + j * ldc] - (product(i, j) - 0.5), 1e-5);
+            BOOST_CHECK_EQUAL(c[m], 1.0f); // beyond the rows
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixVectorizedFunctions, RandomSeedFixture)
+{
+    // the float matrices go through the kernels, the double ones through the C library
+    CPUSingleMatrix s(53, 17);
+    s.SetUniformRandomValue(-10, 10, IncrementCounter());
+    CPUDoubleMatrix d(53, 17);
+    foreach_coord (i, j, s)
+        d(i, j) = s(i, j);
+
+    CPUSingleMatrix sr;
+    CPUDoubleMatrix dr;
+    auto check = [&](double tolerance)
+    {
+        BOOST_REQUIRE_EQUAL(sr.GetNumElements(), dr.GetNumElements());
+        foreach_coord (i, j, sr)
+            BOOST_CHECK_SMALL(sr(i, j) - dr(i, j), tolerance * std::max(1.0, fabs(dr(i, j))));
+    };
+
+    sr.AssignSigmoidOf(s);
+    dr.AssignSigmoidOf(d);
+    check(1e-6);
+    sr.AssignTanhOf(s);
+    dr.AssignTanhOf(d);
+    check(1e-6);
+    sr.AssignExpOf(s);
+    dr.AssignExpOf(d);
+    check(1e-6);
+    sr.AssignLogSoftmaxOf(s, true);
+    dr.AssignLogSoftmaxOf(d, true);
+    check(1e-6);
+    CPUSingleMatrix::VectorSum(s, sr, true);
+    CPUDoubleMatrix::VectorSum(d, dr, true);
+    check(1e-6);
+    CPUSingleMatrix::VectorSum(s, sr, false);
+    CPUDoubleMatrix::VectorSum(d, dr, false);
+    check(1e-6);
+
+    // a product below the threshold of the small GEMM kernels, and the same through the BLAS library
+    BOOST_REQUIRE(53 * 17 * 53 <= CPUSingleMatrix::GetSmallGemmThreshold());
+    CPUSingleMatrix::MultiplyAndWeightedAdd(1, s, false, s, true, 0, sr);
+    CPUDoubleMatrix::MultiplyAndWeightedAdd(1, d, false, d, true, 0, dr);
+    check(1e-5);
+    const size_t threshold = CPUSingleMatrix::GetSmallGemmThreshold();
+    CPUSingleMatrix::SetSmallGemmThreshold(0);
+    CPUSingleMatrix::MultiplyAndWeightedAdd(1, s, false, s, true, 0, sr);
+    CPUSingleMatrix::SetSmallGemmThreshold(threshold);
+    check(1e-5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}
+} } }
@@ -61,6 +61,11 @@ std::vector<std::tuple<ConvolutionEngineKind, DEVICEID_TYPE, size_t>> GetTestEng
     res.push_back(std::make_tuple(ConvolutionEngineKind::Gemm, -1, 0));
     res.push_back(std::make_tuple(ConvolutionEngineKind::Gemm, -1, 1));
     res.push_back(std::make_tuple(ConvolutionEngineKind::Gemm, -1, 3));
+
+    // Winograd engine, CPU only. Falls back to Gemm engine for the configurations it does not support.
+    auto winogradOrGemm = (ConvolutionEngineKind)((int)ConvolutionEngineKind::Winograd | (int)ConvolutionEngineKind::Gemm);
+    res.push_back(std::make_tuple(winogradOrGemm, -1, 0));
+    res.push_back(std::make_tuple(winogradOrGemm, -1, 3));
     return res;
 }
 
@@ -370,6 +375,167 @@ BOOST_AUTO_TEST_CASE(ConvolutionBackwardKernel)
     }
 }
 
+BOOST_AUTO_TEST_CASE(ConvolutionHwcCuDnnVsLegacy)
+{
+    std::mt19937 rng(0);
+    boost::random::normal_distribution<float> nd;
+    auto randomMat = [&](size_t r, size_t c) -> SingleMatrix
+    {
+        vec buf(r * c);
+        std::generate(begin(buf), end(buf), [&] { return nd(rng); });
+        return SingleMatrix(r, c, buf.data(), 0, matrixFlagNormal);
+    };
+
+    // The square geometries of the legacy nodes, which cuDNN takes over in the HWC layout.
+    int deviceId = 0;
+    for (size_t k : {1, 3, 5})
+    {
+        for (size_t stride : {1, 2})
+        {
+            for (bool pad : {false, true})
+            {
+                size_t inW = 9, inC = 3, mapCount = 4, n = 5;
+                auto g = std::make_shared<ConvolveGeometry>(TensorShape(inW, inW, inC), TensorShape(k, k, inC), TensorShape(mapCount),
+                                                            TensorShape(stride, stride, inC), ConvolveGeometry::BoolVec{true},
+                                                            ConvolveGeometry::BoolVec{pad, pad, false}, TensorShape(0), TensorShape(0));
+                auto legacyEng = ConvEng::Create(g, deviceId, ImageLayoutKind::HWC, 0, PoolKind::None, ConvolutionEngineKind::Legacy);
+                auto cudnnEng = ConvEng::Create(g, deviceId, ImageLayoutKind::HWC, 0, PoolKind::None, ConvolutionEngineKind::CuDnn);
+
+                SingleMatrix in = randomMat(g->InputShape().GetNumElements(), n);
+                SingleMatrix kernel = randomMat(mapCount, g->KernelShape().GetNumElements());
+                SingleMatrix srcGrad = randomMat(g->OutputShape().GetNumElements(), n);
+                SingleMatrix workspace(deviceId);
+
+                SingleMatrix out(g->OutputShape().GetNumElements(), n, deviceId);
+                SingleMatrix outB(g->OutputShape().GetNumElements(), n, deviceId);
+                legacyEng->Forward(in, kernel, out, workspace);
+                cudnnEng->Forward(in, kernel, outB, workspace);
+
+                SingleMatrix grad(g->InputShape().GetNumElements(), n, deviceId);
+                grad.SetValue(0);
+                SingleMatrix gradB(grad.DeepClone(), deviceId);
+                legacyEng->BackwardData(srcGrad, kernel, grad, workspace);
+                cudnnEng->BackwardData(srcGrad, kernel, gradB, workspace);
+
+                SingleMatrix kernelGrad = randomMat(mapCount, g->KernelShape().GetNumElements());
+                SingleMatrix kernelGradB(kernelGrad.DeepClone(), deviceId);
+                legacyEng->BackwardKernel(srcGrad, in, kernelGrad, false, workspace);
+                cudnnEng->BackwardKernel(srcGrad, in, kernelGradB, false, workspace);
+
+                std::string msg = " are not equal, Geometry: " + (std::string)(*g);
+                std::string emsg;
+                BOOST_REQUIRE_MESSAGE(CheckEqual(out, outB, emsg, Err<float>::Rel * 4, Err<float>::Abs * 14), "out" << msg << ". " << emsg);
+                BOOST_REQUIRE_MESSAGE(CheckEqual(grad, gradB, emsg, Err<float>::Rel * 16, Err<float>::Abs * 16), "grad" << msg << ". " << emsg);
+                BOOST_REQUIRE_MESSAGE(CheckEqual(kernelGrad, kernelGradB, emsg, Err<float>::Rel * 192, Err<float>::Abs * 32), "kernel" << msg << ". " << emsg);
+            }
+        }
+    }
+}
+
+// A grouped convolution is a convolution of each group of input channels with its own maps, so the grouped engines
+// are compared with the reference engine running the groups one by one.
+BOOST_AUTO_TEST_CASE(GroupedConvolution)
+{
+    std::mt19937 rng(0);
+    boost::random::normal_distribution<float> nd;
+    auto randomVec = [&](size_t size) -> vec
+    {
+        vec buf(size);
+        std::generate(begin(buf), end(buf), [&] { return nd(rng); });
+        return buf;
+    };
+    // rows [begin, begin + count) of each column of the (rows x n) buffer
+    auto rowSlice = [](const vec& buf, size_t rows, size_t n, size_t begin, size_t count) -> vec
+    {
+        vec res;
+        for (size_t j = 0; j < n; j++)
+            res.insert(res.end(), buf.begin() + j * rows + begin, buf.begin() + j * rows + begin + count);
+        return res;
+    };
+
+    int deviceId = -1;
+    size_t inW = 7, inH = 6, inC = 4, n = 3;
+    // (groups, maps), the first two are depthwise
+    for (auto groupsAndMaps : std::vector<std::pair<size_t, size_t>>{ { 4, 4 }, { 4, 8 }, { 2, 4 } })
+    {
+        size_t groups = groupsAndMaps.first, mapCount = groupsAndMaps.second;
+        size_t groupC = inC / groups, groupMaps = mapCount / groups;
+        for (size_t stride : {1, 2})
+        {
+            for (bool pad : {false, true})
+            {
+                auto g = std::make_shared<ConvolveGeometry>(TensorShape(inW, inH, inC), TensorShape(3, 3, groupC), TensorShape(mapCount),
+                                                            TensorShape(stride, stride, groupC), ConvolveGeometry::BoolVec{true},
+                                                            ConvolveGeometry::BoolVec{pad, pad, false}, TensorShape(0), TensorShape(0), groups);
+                auto gg = std::make_shared<ConvolveGeometry>(TensorShape(inW, inH, groupC), TensorShape(3, 3, groupC), TensorShape(groupMaps),
+                                                             TensorShape(stride, stride, groupC), ConvolveGeometry::BoolVec{true},
+                                                             ConvolveGeometry::BoolVec{pad, pad, false}, TensorShape(0), TensorShape(0));
+                BOOST_REQUIRE_EQUAL(g->IsDepthwise(), groupC == 1);
+                size_t inRows = g->InputShape().GetNumElements(), outRows = g->OutputShape().GetNumElements();
+                size_t kernelSize = g->KernelShape().GetNumElements();
+                size_t groupInRows = inRows / groups, groupOutRows = outRows / groups;
+                BOOST_REQUIRE_EQUAL(gg->OutputShape().GetNumElements(), groupOutRows);
+
+                vec in = randomVec(inRows * n), kernel = randomVec(kernelSize * mapCount), srcGrad = randomVec(outRows * n);
+                vec out(outRows * n), grad(inRows * n), kernelGrad(kernelSize * mapCount);
+                auto refEng = ConvEng::Create(gg, deviceId, ImageLayoutKind::CHW, 0, PoolKind::None, ConvolutionEngineKind::Reference);
+                for (size_t group = 0; group < groups; group++)
+                {
+                    SingleMatrix inG(groupInRows, n, rowSlice(in, inRows, n, group * groupInRows, groupInRows).data(), deviceId, matrixFlagNormal);
+                    SingleMatrix kernelG(kernelSize, groupMaps, kernel.data() + group * groupMaps * kernelSize, deviceId, matrixFlagNormal);
+                    SingleMatrix srcGradG(groupOutRows, n, rowSlice(srcGrad, outRows, n, group * groupOutRows, groupOutRows).data(), deviceId, matrixFlagNormal);
+                    SingleMatrix workspace(deviceId);
+                    SingleMatrix outG(groupOutRows, n, deviceId);
+                    refEng->Forward(inG, kernelG, outG, workspace);
+                    SingleMatrix gradG(groupInRows, n, deviceId);
+                    gradG.SetValue(0);
+                    refEng->BackwardData(srcGradG, kernelG, gradG, workspace);
+                    SingleMatrix kernelGradG(kernelSize, groupMaps, deviceId);
+                    kernelGradG.SetValue(0);
+                    refEng->BackwardKernel(srcGradG, inG, kernelGradG, false, workspace);
+                    for (size_t j = 0; j < n; j++)
+                    {
+                        for (size_t i = 0; i < groupOutRows; i++)
+                            out[j * outRows + group * groupOutRows + i] = outG(i, j);
+                        for (size_t i = 0; i < groupInRows; i++)
+                            grad[j * inRows + group * groupInRows + i] = gradG(i, j);
+                    }
+                    std::copy(kernelGradG.Data(), kernelGradG.Data() + kernelSize * groupMaps, kernelGrad.begin() + group * groupMaps * kernelSize);
+                }
+                SingleMatrix outB(outRows, n, out.data(), deviceId, matrixFlagNormal);
+                SingleMatrix gradB(inRows, n, grad.data(), deviceId, matrixFlagNormal);
+                SingleMatrix kernelGradB(kernelSize, mapCount, kernelGrad.data(), deviceId, matrixFlagNormal);
+
+                std::vector<ConvolutionEngineKind> kinds{ ConvolutionEngineKind::Reference };
+                if (g->IsDepthwise())
+                    kinds.push_back(ConvolutionEngineKind::Depthwise);
+                for (auto kind : kinds)
+                {
+                    auto eng = ConvEng::Create(g, deviceId, ImageLayoutKind::CHW, 0, PoolKind::None, kind);
+                    SingleMatrix inM(inRows, n, in.data(), deviceId, matrixFlagNormal);
+                    SingleMatrix kernelM(kernelSize, mapCount, kernel.data(), deviceId, matrixFlagNormal);
+                    SingleMatrix srcGradM(outRows, n, srcGrad.data(), deviceId, matrixFlagNormal);
+                    SingleMatrix workspace(deviceId);
+                    SingleMatrix outM(outRows, n, deviceId);
+                    eng->Forward(inM, kernelM, outM, workspace);
+                    SingleMatrix gradM(inRows, n, deviceId);
+                    gradM.SetValue(0);
+                    eng->BackwardData(srcGradM, kernelM, gradM, workspace);
+                    SingleMatrix kernelGradM(kernelSize, mapCount, deviceId);
+                    kernelGradM.SetValue(0);
+                    eng->BackwardKernel(srcGradM, inM, kernelGradM, false, workspace);
+
+                    std::string msg = " are not equal, engine: " + std::to_string((int)kind) + ", Geometry: " + (std::string)(*g);
+                    std::string emsg;
+                    BOOST_REQUIRE_MESSAGE(CheckEqual(outM, outB, emsg, Err<float>::Rel * 4, Err<float>::Abs * 14), "out" << msg << ". " << emsg);
+                    BOOST_REQUIRE_MESSAGE(CheckEqual(gradM, gradB, emsg, Err<float>::Rel * 16, Err<float>::Abs * 16), "grad" << msg << ". " << emsg);
+                    BOOST_REQUIRE_MESSAGE(CheckEqual(kernelGradM, kernelGradB, emsg, Err<float>::Rel * 192, Err<float>::Abs * 32), "kernel" << msg << ". " << emsg);
+                }
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(PoolingForward)
 {
     std::mt19937 rng(0);
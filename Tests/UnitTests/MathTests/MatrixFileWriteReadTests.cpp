@@ -37,6 +37,28 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixFileWriteRead, RandomSeedFixture)
     BOOST_CHECK(matrixCpuCopy.IsEqualTo(matrixCpuRead, c_epsilonFloatE5));
 }
 
+// Binary matrices large enough for File::PutBlock() to take the whole pages past stdio, at an unaligned offset and
+// in several requests, followed by a small one that does not.
+BOOST_FIXTURE_TEST_CASE(CPUMatrixBinaryFileWriteRead, RandomSeedFixture)
+{
+    CPUMatrix<float> matrixLarge = CPUMatrix<float>::RandomUniform(2999, 1001, -26.3f, 30.2f, IncrementCounter());
+    CPUMatrix<float> matrixSmall = CPUMatrix<float>::RandomUniform(43, 10, -26.3f, 30.2f, IncrementCounter());
+
+    std::wstring fileName(L"MCPU.bin");
+    {
+        File file(fileName, fileOptionsBinary | fileOptionsWrite);
+        file << matrixLarge << matrixSmall;
+    }
+
+    File file(fileName, fileOptionsBinary | fileOptionsRead);
+    CPUMatrix<float> matrixLargeRead, matrixSmallRead;
+    file >> matrixLargeRead >> matrixSmallRead;
+    BOOST_CHECK_EQUAL(file.GetPosition(), file.Size());
+
+    BOOST_CHECK(matrixLarge.IsEqualTo(matrixLargeRead, 0));
+    BOOST_CHECK(matrixSmall.IsEqualTo(matrixSmallRead, 0));
+}
+
 BOOST_FIXTURE_TEST_CASE(MatrixFileWriteRead, RandomSeedFixture)
 {
     // Test Matrix in Dense mode
@@ -6,6 +6,10 @@
 #include "../../../Source/Math/Matrix.h"
 #include "../../../Source/Math/CPUMatrix.h"
 #include "../../../Source/Math/Helpers.h"
+#include "../../../Source/Math/MultiTensorUpdate.h"
+#include <algorithm>
+#include <random>
+#include <set>
 
 #define IDX2C(i, j, ld) (((j) * (ld)) + (i)) // 0 based indexing
 
@@ -1094,6 +1098,44 @@ BOOST_FIXTURE_TEST_CASE(MatrixVectorMax, RandomSeedFixture)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(MatrixVectorMaxTopKSelection, RandomSeedFixture)
+{
+    // many equal values: the top k are sorted descending, the lower row first among equal values
+    const int rows = 1000, cols = 7, topK = 5;
+    std::mt19937 rng(0);
+    std::vector<float> src(rows * cols);
+    for (auto& v : src)
+        v = (float) (rng() % 20);
+
+    std::vector<float> expectedIdx, expectedVal;
+    for (int j = 0; j < cols; j++)
+    {
+        std::vector<int> order(rows);
+        for (int i = 0; i < rows; i++)
+            order[i] = i;
+        const float* column = src.data() + j * rows;
+        std::stable_sort(order.begin(), order.end(), [column](int a, int b) { return column[a] > column[b]; });
+        for (int k = 0; k < topK; k++)
+        {
+            expectedIdx.push_back((float) order[k]);
+            expectedVal.push_back(column[order[k]]);
+        }
+    }
+
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        Matrix<float> expIdx(topK, cols, expectedIdx.data(), deviceId, matrixFlagNormal);
+        Matrix<float> expVal(topK, cols, expectedVal.data(), deviceId, matrixFlagNormal);
+
+        Matrix<float> actual(rows, cols, src.data(), deviceId, matrixFlagNormal);
+        Matrix<float> actualIdx(deviceId);
+        Matrix<float> actualVal(deviceId);
+        actual.VectorMax(actualIdx, actualVal, true, topK);
+        BOOST_CHECK(actualIdx.IsEqualTo(expIdx));
+        BOOST_CHECK(actualVal.IsEqualTo(expVal));
+    }
+}
+
 BOOST_FIXTURE_TEST_CASE(MatrixAssignNumOfDiff, RandomSeedFixture)
 {
     float labels[] = {1.0f, 2.0f, 3.0f};
@@ -1116,6 +1158,203 @@ BOOST_FIXTURE_TEST_CASE(MatrixAssignNumOfDiff, RandomSeedFixture)
         BOOST_CHECK_EQUAL(expectedDiff, actual.Get00Element());
     }
 }
+
+BOOST_FIXTURE_TEST_CASE(MatrixMultiTensorUpdate, RandomSeedFixture)
+{
+    // the fused update of several tensors must match the per-tensor updates (after scaling, truncation and L2 regularization)
+    const size_t rows = 7;
+    const size_t mbSize = 10;
+    const std::vector<size_t> cols = { 3, 1, 5 };
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        for (auto kind : { MultiTensorUpdateKind::MomentumSGD, MultiTensorUpdateKind::Nesterov, MultiTensorUpdateKind::AdaGrad,
+                           MultiTensorUpdateKind::FSAdaGrad, MultiTensorUpdateKind::RmsProp })
+        {
+            MultiTensorUpdateParams<float> params = {};
+            params.m_kind = kind;
+            params.m_learningRate = 0.1f;
+            params.m_momentum = 0.9f;
+            params.m_varMomentum = 0.99f;
+            params.m_rmsGamma = 0.99f;
+            params.m_rmsInc = 1.2f;
+            params.m_rmsMax = 10.0f;
+            params.m_rmsDec = 0.75f;
+            params.m_rmsMin = 0.1f;
+            params.m_needAveMultiplier = kind == MultiTensorUpdateKind::AdaGrad || kind == MultiTensorUpdateKind::RmsProp;
+            params.m_gradientScale = 0.8f;
+            params.m_clippingThreshold = 0.5f;
+            params.m_l2Weight = 0.01f;
+
+            // (the number of columns of the smoothed gradient that the per-tensor functions expect, and how many of them hold state)
+            size_t factor = 1, stateFactor = 1;
+            if (kind == MultiTensorUpdateKind::AdaGrad)
+                factor = deviceId == CPUDEVICE ? 1 : 2;
+            else if (kind == MultiTensorUpdateKind::FSAdaGrad)
+                factor = stateFactor = 2;
+            else if (kind == MultiTensorUpdateKind::RmsProp)
+            {
+                factor = deviceId == CPUDEVICE ? 3 : 4;
+                stateFactor = 3;
+            }
+
+            std::vector<std::unique_ptr<SingleMatrix>> matrices;
+            std::vector<SingleMatrix*> smoothedGradients, gradients, values;
+            std::vector<float> adaMuls;
+            double smoothedCount = 0;
+            for (size_t c : cols)
+            {
+                SingleMatrix value = SingleMatrix::RandomUniform(rows, c, deviceId, -1.0f, 1.0f, IncrementCounter());
+                SingleMatrix gradient = SingleMatrix::RandomUniform(rows, c, deviceId, -1.0f, 1.0f, IncrementCounter());
+                SingleMatrix smoothed = SingleMatrix::RandomUniform(rows, factor * c, deviceId, 0.0f, 1.0f, IncrementCounter());
+                matrices.emplace_back(new SingleMatrix(value.DeepClone()));
+                values.push_back(matrices.back().get());
+                matrices.emplace_back(new SingleMatrix(gradient.DeepClone()));
+                gradients.push_back(matrices.back().get());
+                matrices.emplace_back(new SingleMatrix(smoothed.DeepClone()));
+                smoothedGradients.push_back(matrices.back().get());
+
+                gradient *= params.m_gradientScale;
+                gradient.InplaceTruncate(params.m_clippingThreshold);
+                SingleMatrix::ScaleAndAdd(params.m_l2Weight, value, gradient);
+                switch (kind)
+                {
+                case MultiTensorUpdateKind::MomentumSGD:
+                case MultiTensorUpdateKind::Nesterov:
+                    smoothed.NormalGrad(gradient, value, params.m_learningRate, params.m_momentum, kind == MultiTensorUpdateKind::Nesterov);
+                    break;
+                case MultiTensorUpdateKind::AdaGrad:
+                {
+                    float aveMultiplier = smoothed.Adagrad(gradient, true);
+                    SingleMatrix::ScaleAndAdd(-params.m_learningRate / aveMultiplier, gradient, value);
+                    break;
+                }
+                case MultiTensorUpdateKind::FSAdaGrad:
+                    smoothed.FSAdagradUpdate(mbSize, gradient, value, smoothedCount, params.m_learningRate, 0.0025, params.m_momentum, params.m_varMomentum);
+                    adaMuls.push_back((float) (0.0025 * sqrt(smoothedCount)));
+                    break;
+                case MultiTensorUpdateKind::RmsProp:
+                {
+                    float aveMultiplier = smoothed.RmsProp(gradient, params.m_rmsGamma, params.m_rmsInc, params.m_rmsMax, params.m_rmsDec, params.m_rmsMin, true);
+                    SingleMatrix::ScaleAndAdd(-params.m_learningRate / aveMultiplier, gradient, value);
+                    break;
+                }
+                }
+
+                matrices.emplace_back(new SingleMatrix(value.DeepClone()));
+                matrices.emplace_back(new SingleMatrix(smoothed.ColumnSlice(0, stateFactor * c).DeepClone()));
+            }
+
+            BOOST_CHECK(!SingleMatrix::MultiTensorUpdate(params, smoothedGradients, gradients, values, adaMuls, /*checkForNan=*/true));
+            for (size_t k = 0; k < cols.size(); k++)
+            {
+                const auto& expectedValue = *matrices[5 * k + 3];
+                const auto& expectedSmoothed = *matrices[5 * k + 4];
+                BOOST_CHECK(values[k]->IsEqualTo(expectedValue, c_epsilonFloatE5));
+                BOOST_CHECK(smoothedGradients[k]->ColumnSlice(0, stateFactor * cols[k]).IsEqualTo(expectedSmoothed, c_epsilonFloatE5));
+            }
+
+            // a NaN in a gradient shows in the flag
+            gradients[1]->SetValue(std::numeric_limits<float>::quiet_NaN());
+            BOOST_CHECK(SingleMatrix::MultiTensorUpdate(params, smoothedGradients, gradients, values, adaMuls, /*checkForNan=*/true));
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixMultiTensorSumOfSquares, RandomSeedFixture)
+{
+    // one reduction over all tensors, the last one larger than a chunk of the GPU implementation
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        std::vector<SingleMatrix> tensors;
+        for (size_t cols : { 3, 1, 5, 2000 })
+            tensors.push_back(SingleMatrix::RandomUniform(17, cols, deviceId, -1.0f, 1.0f, IncrementCounter()));
+        tensors.push_back(SingleMatrix(0, 0, deviceId));
+
+        std::vector<const SingleMatrix*> pointers;
+        double expected = 0;
+        for (const auto& tensor : tensors)
+        {
+            pointers.push_back(&tensor);
+            double norm = tensor.GetNumElements() > 0 ? tensor.FrobeniusNorm() : 0;
+            expected += norm * norm;
+        }
+
+        BOOST_CHECK_CLOSE(SingleMatrix::MultiTensorSumOfSquares(pointers), expected, 1e-3);
+        BOOST_CHECK_EQUAL(SingleMatrix::MultiTensorSumOfSquares({}), 0.0);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixUpdateNonFiniteFlag, RandomSeedFixture)
+{
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        SingleMatrix flag(1, 1, deviceId);
+        flag.SetValue(0);
+        SingleMatrix m = SingleMatrix::RandomUniform(13, 5, deviceId, -1.0f, 1.0f, IncrementCounter());
+        m.UpdateNonFiniteFlag(flag);
+        BOOST_CHECK_EQUAL(flag.Get00Element(), 0.0f);
+
+        for (float value : { std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::quiet_NaN() })
+        {
+            flag.SetValue(0);
+            SingleMatrix withValue = m.DeepClone();
+            withValue.SetValue(7, 3, value);
+            withValue.UpdateNonFiniteFlag(flag);
+            m.UpdateNonFiniteFlag(flag); // (does not reset it)
+            BOOST_CHECK_EQUAL(flag.Get00Element(), 1.0f);
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixExtractLargestMagnitudes, RandomSeedFixture)
+{
+    // magnitudes 0, 0.1, ..., 1.1, 0 with alternating signs, and a tie of 0.5 (elements 5 and 12)
+    std::vector<float> data = { 0.0f, 0.1f, -0.2f, 0.3f, -0.4f, 0.5f, -0.6f, 0.7f, -0.8f, 0.9f, -1.0f, 1.1f, -0.5f, 0.0f };
+    for (auto deviceId : {CPUDEVICE, c_deviceIdZero})
+    {
+        const SingleMatrix original(2, 7, data.data(), deviceId);
+        std::vector<int> indices;
+        std::vector<float> values;
+
+        // the five largest, which leave zeros behind; adding them back restores the matrix
+        SingleMatrix m = original.DeepClone();
+        m.ExtractLargestMagnitudes(5, 0, indices, values);
+        std::set<int> taken(indices.begin(), indices.end());
+        BOOST_CHECK(taken == std::set<int>({ 7, 8, 9, 10, 11 }));
+        for (size_t i = 0; i < indices.size(); i++)
+            BOOST_CHECK_EQUAL(values[i], data[indices[i]]);
+        std::vector<float> rest = data;
+        for (int i : taken)
+            rest[i] = 0;
+        BOOST_CHECK(m.IsEqualTo(SingleMatrix(2, 7, rest.data(), deviceId)));
+        m.AddValuesAtIndices(indices, values);
+        BOOST_CHECK(m.IsEqualTo(original));
+
+        // one of the two elements of the k-th magnitude
+        m = original.DeepClone();
+        m.ExtractLargestMagnitudes(8, 0, indices, values);
+        BOOST_CHECK_EQUAL(indices.size(), 8);
+        taken = std::set<int>(indices.begin(), indices.end());
+        BOOST_CHECK_EQUAL(taken.count(5) + taken.count(12), 1);
+
+        // the threshold (and the zeros) limit the count below k
+        m = original.DeepClone();
+        m.ExtractLargestMagnitudes(10, 0.95f, indices, values);
+        taken = std::set<int>(indices.begin(), indices.end());
+        BOOST_CHECK(taken == std::set<int>({ 10, 11 }));
+        m.SetValue(0);
+        m.ExtractLargestMagnitudes(3, 0, indices, values);
+        BOOST_CHECK(indices.empty() && values.empty());
+
+        // repeated indices add up
+        m.AddValuesAtIndices(std::vector<int>{ 3, 3, 13 }, std::vector<float>{ 1.0f, 2.0f, -1.0f });
+        std::vector<float> sums(data.size(), 0.0f);
+        sums[3] = 3.0f;
+        sums[13] = -1.0f;
+        BOOST_CHECK(m.IsEqualTo(SingleMatrix(2, 7, sums.data(), deviceId)));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
@@ -0,0 +1,48 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "../../../Source/Math/QuantizedProduct.h"
+
+using namespace Microsoft::MSR::CNTK;
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(QuantizedProductUnitTests)
+
+BOOST_FIXTURE_TEST_CASE(QuantizedProductMatchesFloatProduct, RandomSeedFixture)
+{
+    const size_t m = 13, k = 70, n = 9;
+    SingleMatrix weights = SingleMatrix::RandomUniform(m, k, CPUDEVICE, -1.0f, 1.0f, IncrementCounter());
+    SingleMatrix input = SingleMatrix::RandomUniform(k, n, CPUDEVICE, -1.0f, 1.0f, IncrementCounter());
+    input.ColumnSlice(2, 1).SetValue(0); // a column without a scale
+    SingleMatrix expected(m, n, CPUDEVICE);
+    SingleMatrix::MultiplyAndWeightedAdd(1, weights, false, input, false, 0, expected);
+
+    // each of the k terms is off by at most half a step of either factor
+    for (size_t numBits : { 8, 12, 16 })
+    {
+        QuantizedProduct<float> product(weights, numBits);
+        BOOST_CHECK_EQUAL(product.GetNumBits(), numBits <= 12 ? numBits : 12);
+        SingleMatrix result(m, n, CPUDEVICE);
+        product.Multiply(input, result);
+        float threshold = k * (1.0f / (1 << (product.GetNumBits() - 1)) + 1.0f / (1 << (product.GetNumInputBits() - 1)));
+        BOOST_CHECK(result.IsEqualTo(expected, threshold));
+        for (size_t i = 0; i < m; i++)
+            BOOST_CHECK_EQUAL(result(i, 2), 0.0f);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(QuantizedProductChecksDimensions, RandomSeedFixture)
+{
+    SingleMatrix weights = SingleMatrix::RandomUniform(4, 8, CPUDEVICE, -1.0f, 1.0f, IncrementCounter());
+    QuantizedProduct<float> product(weights, 8);
+    SingleMatrix input(7, 2, CPUDEVICE);
+    SingleMatrix result(4, 2, CPUDEVICE);
+    BOOST_CHECK_THROW(product.Multiply(input, result), std::logic_error);
+    BOOST_CHECK_THROW(QuantizedProduct<float>(weights, 1), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} } } }
@@ -85,6 +85,26 @@ BOOST_AUTO_TEST_CASE(BiasGradient2)
     });
 }
 
+BOOST_AUTO_TEST_CASE(ReductionAcrossBlocks)
+{
+    Test::TensorTest<float> tensorTester;
+
+    // few outputs with long reductions, which the GPU splits across blocks and reduces in two passes
+    tensorTester.OneTensorTest("reduction to a scalar", 1e-1, [&tensorTester](DEVICEID_TYPE deviceId)
+    {
+        return tensorTester.BiasGradientTest(TensorShape{ 1009, 997 }, TensorShape(1), deviceId);
+    });
+    tensorTester.OneTensorTest("reduction to a short vector", 1e-2, [&tensorTester](DEVICEID_TYPE deviceId)
+    {
+        return tensorTester.BiasGradientTest(TensorShape{ 7, 100003 }, TensorShape(7), deviceId);
+    });
+
+    // the order of the operations is fixed, so the sums are the same in every run
+    let first = tensorTester.BiasGradientTest(TensorShape{ 1009, 997 }, TensorShape(1), 0);
+    let second = tensorTester.BiasGradientTest(TensorShape{ 1009, 997 }, TensorShape(1), 0);
+    BOOST_CHECK_EQUAL(first.GetSOB().Get00Element(), second.GetSOB().Get00Element());
+}
+
 BOOST_AUTO_TEST_CASE(ColumnSliceMultAndAdd)
 {
     ColumnSliceMultAndAddTest<float>(2048, 2048, 256, 0);
@@ -100,6 +120,47 @@ BOOST_AUTO_TEST_CASE(OldRnnForwardProp)
     TestOldRnnForwardPropSRP<float>();
 }
 
+BOOST_AUTO_TEST_CASE(FusedElementwiseOps)
+{
+    // the fused ops of FusedElementwiseNode against the nodes they replace, on the CPU, with broadcasting of one operand
+    Test::TensorTest<float> tensorTester;
+    TensorShape shape{ 67, 5, 3 };
+    let a = tensorTester.CreateTensor(shape, 1, CPUDEVICE);
+    let b = tensorTester.CreateTensor(shape, 2, CPUDEVICE);
+    let c = tensorTester.CreateTensor(TensorShape{ 67, 1, 3 }, 3, CPUDEVICE);
+    auto fused = tensorTester.CreateTensor(shape, 4, CPUDEVICE);
+    auto expected = tensorTester.CreateTensor(shape, 5, CPUDEVICE);
+    auto temp = tensorTester.CreateTensor(shape, 6, CPUDEVICE);
+
+    fused.AssignElementwiseProductWithSigmoidOf(a, b);
+    temp.AssignSigmoidOf(b);
+    expected.AssignElementwiseProductOf(a, temp);
+    BOOST_CHECK(fused.GetSOB().IsEqualTo(expected.GetSOB(), 1e-6f));
+
+    fused.AssignElementwiseProductWithTanhOf(a, b);
+    temp.AssignTanhOf(b);
+    expected.AssignElementwiseProductOf(a, temp);
+    BOOST_CHECK(fused.GetSOB().IsEqualTo(expected.GetSOB(), 1e-6f));
+
+    fused.AssignElementwiseProductPlusOf(a, b, c);
+    expected.AssignElementwiseProductOf(a, b);
+    expected.AddCopyOf(c);
+    BOOST_CHECK(fused.GetSOB().IsEqualTo(expected.GetSOB(), 1e-6f));
+
+    // the gradients, which the nodes compute from their outputs
+    fused.AssignElementwiseProductWithSigmoidDerivativeOfProductOf(a, b, c);
+    temp.AssignSigmoidOf(c);
+    expected.AssignElementwiseProductOf(a, b);
+    expected.AssignElementwiseProductWithSigmoidDerivativeFromOutputOf(expected, temp);
+    BOOST_CHECK(fused.GetSOB().IsEqualTo(expected.GetSOB(), 1e-6f));
+
+    fused.AssignElementwiseProductWithTanhDerivativeOfProductOf(a, b, c);
+    temp.AssignTanhOf(c);
+    expected.AssignElementwiseProductOf(a, b);
+    expected.AssignElementwiseProductWithTanhDerivativeFromOutputOf(expected, temp);
+    BOOST_CHECK(fused.GetSOB().IsEqualTo(expected.GetSOB(), 1e-6f));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 }}}}
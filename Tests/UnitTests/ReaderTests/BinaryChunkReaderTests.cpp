@@ -0,0 +1,410 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "BinaryChunkWriter.h"
+#include "BinaryChunkDeserializer.h"
+#include "SequentialDeserializer.h"
+#include "FramePacker.h"
+#include "TruncatedBpttPacker.h"
+#include "HeapMemoryProvider.h"
+
+using namespace Microsoft::MSR::CNTK;
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(BinaryChunkReaderTests)
+
+struct MockSparseSequenceData : SparseSequenceData
+{
+    const void* GetDataBuffer() override
+    {
+        return m_values.data();
+    }
+
+    vector<float> m_values;
+    vector<IndexType> m_rowIndices;
+};
+
+// A deserializer with a single chunk of sequences that have a dense and a sparse stream.
+class MockSparseDeserializer : public IDataDeserializer
+{
+public:
+    struct MockChunk : Chunk
+    {
+        MockChunk(MockSparseDeserializer& parent) : m_parent(parent) {}
+
+        void GetSequence(size_t sequenceId, vector<SequenceDataPtr>& result) override
+        {
+            auto dense = make_shared<MockDenseSequenceData>();
+            dense->m_data = m_parent.m_dense[sequenceId].data();
+            dense->m_numberOfSamples = (uint32_t)m_parent.m_dense[sequenceId].size() / 2;
+            dense->m_elementType = ElementType::tfloat;
+            dense->m_sampleLayout = make_shared<TensorShape>(2);
+            result.push_back(dense);
+
+            auto sparse = make_shared<MockSparseSequenceData>(*m_parent.m_sparse[sequenceId]);
+            sparse->m_indices = sparse->m_rowIndices.data();
+            result.push_back(sparse);
+        }
+
+        MockSparseDeserializer& m_parent;
+    };
+
+    // Sequence i has i + 1 samples, or a single one for frame mode.
+    explicit MockSparseDeserializer(bool frameMode = false) : m_numberOfSamples(0)
+    {
+        for (size_t i = 0; i < 3; ++i)
+        {
+            const uint32_t numberOfSamples = frameMode ? 1 : (uint32_t)(i + 1);
+            m_dense.push_back(vector<float>(2 * numberOfSamples, (float)i));
+            m_numberOfSamples += numberOfSamples;
+
+            // Sample j of sequence i has j non zero values (i + 1 in frame mode), at rows j, j + 1, ...
+            auto sparse = make_shared<MockSparseSequenceData>();
+            sparse->m_numberOfSamples = numberOfSamples;
+            sparse->m_elementType = ElementType::tfloat;
+            sparse->m_sampleLayout = make_shared<TensorShape>(1000);
+            sparse->m_totalNnzCount = 0;
+            for (IndexType j = 0; j < (IndexType)sparse->m_numberOfSamples; ++j)
+            {
+                const IndexType nnz = frameMode ? (IndexType)(i + 1) : j;
+                sparse->m_nnzCounts.push_back(nnz);
+                for (IndexType k = 0; k < nnz; ++k)
+                {
+                    sparse->m_rowIndices.push_back(j + k);
+                    sparse->m_values.push_back((float)(100 * i + 10 * j + k));
+                }
+                sparse->m_totalNnzCount += nnz;
+            }
+            m_sparse.push_back(sparse);
+        }
+    }
+
+    vector<StreamDescriptionPtr> GetStreamDescriptions() const override
+    {
+        return vector<StreamDescriptionPtr>
+        {
+            make_shared<StreamDescription>(StreamDescription{ L"dense", 0, StorageType::dense, ElementType::tfloat, make_shared<TensorShape>(2) }),
+            make_shared<StreamDescription>(StreamDescription{ L"sparse", 1, StorageType::sparse_csc, ElementType::tfloat, make_shared<TensorShape>(1000) }),
+        };
+    }
+
+    ChunkDescriptions GetChunkDescriptions() override
+    {
+        return ChunkDescriptions{ make_shared<ChunkDescription>(ChunkDescription{ 0, m_numberOfSamples, 3 }) };
+    }
+
+    void GetSequencesForChunk(ChunkIdType chunkId, vector<SequenceDescription>& descriptions) override
+    {
+        for (size_t i = 0; i < m_dense.size(); ++i)
+        {
+            KeyType key;
+            key.m_sequence = i;
+            key.m_sample = 0;
+            descriptions.push_back(SequenceDescription{ i, m_sparse[i]->m_numberOfSamples, chunkId, key });
+        }
+    }
+
+    bool GetSequenceDescription(const SequenceDescription&, SequenceDescription&) override
+    {
+        throw logic_error("Not implemented");
+    }
+
+    ChunkPtr GetChunk(ChunkIdType) override
+    {
+        return make_shared<MockChunk>(*this);
+    }
+
+    vector<vector<float>> m_dense;
+    vector<shared_ptr<MockSparseSequenceData>> m_sparse;
+    size_t m_numberOfSamples;
+};
+
+static string KeyToString(const KeyType& key)
+{
+    return "sequence" + to_string(key.m_sequence);
+}
+
+BOOST_AUTO_TEST_CASE(BinaryChunkDenseRoundTrip)
+{
+    const size_t sweepNumberOfSamples = 5000;
+    SequentialDeserializer source(0, 100, sweepNumberOfSamples, 20);
+
+    const wstring path = L"BinaryChunkDenseRoundTrip.bin";
+    {
+        // Small chunks, so that there are many of them.
+        BinaryChunkWriter writer(path, source.GetStreamDescriptions(), 1024, BinaryChunkFormat::Compression::none);
+        writer.AddSequences(source, KeyToString);
+        writer.Close();
+        BOOST_CHECK_GT(writer.NumberOfChunks(), 10);
+    }
+
+    auto deserializer = make_shared<BinaryChunkDeserializer>(make_shared<CorpusDescriptor>(), path);
+    auto streams = deserializer->GetStreamDescriptions();
+    BOOST_REQUIRE_EQUAL(streams.size(), 1);
+    BOOST_CHECK(streams[0]->m_name == L"input");
+    BOOST_CHECK(streams[0]->m_storageType == StorageType::dense);
+    BOOST_CHECK_EQUAL(streams[0]->m_sampleLayout->GetNumElements(), 1);
+
+    size_t numberOfSequences = 0, numberOfSamples = 0;
+    for (const auto& chunk : deserializer->GetChunkDescriptions())
+    {
+        numberOfSequences += chunk->m_numberOfSequences;
+        numberOfSamples += chunk->m_numberOfSamples;
+    }
+    size_t expectedNumberOfSequences = 0;
+    for (const auto& chunk : source.Chunks())
+        expectedNumberOfSequences += chunk->SizeInSequences();
+    BOOST_CHECK_EQUAL(numberOfSequences, expectedNumberOfSequences);
+    BOOST_CHECK_EQUAL(numberOfSamples, sweepNumberOfSamples);
+
+    // The samples come back in order.
+    auto randomizer = make_shared<NoRandomizer>(deserializer);
+    auto epoch = ReadFullSweep(randomizer, 0, sweepNumberOfSamples);
+    vector<float> expected(sweepNumberOfSamples);
+    iota(expected.begin(), expected.end(), 0.0f);
+    BOOST_CHECK_EQUAL_COLLECTIONS(epoch.begin(), epoch.end(), expected.begin(), expected.end());
+
+    _wunlink(path.c_str());
+}
+
+static void CheckSparseRoundTrip(BinaryChunkFormat::Compression compression)
+{
+    MockSparseDeserializer source;
+    const wstring path = L"BinaryChunkSparseRoundTrip.bin";
+    {
+        BinaryChunkWriter writer(path, source.GetStreamDescriptions(), 64, compression);
+        writer.AddSequences(source, KeyToString);
+        writer.Close();
+    }
+
+    auto corpus = make_shared<CorpusDescriptor>();
+    BinaryChunkDeserializer deserializer(corpus, path);
+    auto streams = deserializer.GetStreamDescriptions();
+    BOOST_REQUIRE_EQUAL(streams.size(), 2);
+    BOOST_CHECK(streams[1]->m_storageType == StorageType::sparse_csc);
+    BOOST_CHECK_EQUAL(streams[1]->m_sampleLayout->GetNumElements(), 1000);
+
+    for (size_t i = 0; i < source.m_dense.size(); ++i)
+    {
+        // Sequences are found by their key in the corpus.
+        KeyType key;
+        key.m_sequence = corpus->GetStringRegistry()["sequence" + to_string(i)];
+        key.m_sample = 0;
+        SequenceDescription primary = {}, description;
+        primary.m_key = key;
+        BOOST_REQUIRE(deserializer.GetSequenceDescription(primary, description));
+        BOOST_CHECK_EQUAL(description.m_numberOfSamples, i + 1);
+
+        vector<SequenceDataPtr> data;
+        deserializer.GetChunk(description.m_chunkId)->GetSequence(description.m_id, data);
+        BOOST_REQUIRE_EQUAL(data.size(), 2);
+
+        const auto& dense = source.m_dense[i];
+        BOOST_REQUIRE_EQUAL(data[0]->m_numberOfSamples, dense.size() / 2);
+        const float* denseValues = (const float*)data[0]->GetDataBuffer();
+        BOOST_CHECK_EQUAL_COLLECTIONS(denseValues, denseValues + dense.size(), dense.begin(), dense.end());
+
+        const auto& expected = *source.m_sparse[i];
+        auto sparse = static_pointer_cast<SparseSequenceData>(data[1]);
+        BOOST_REQUIRE_EQUAL(sparse->m_totalNnzCount, expected.m_totalNnzCount);
+        BOOST_CHECK_EQUAL_COLLECTIONS(sparse->m_nnzCounts.begin(), sparse->m_nnzCounts.end(), expected.m_nnzCounts.begin(), expected.m_nnzCounts.end());
+        BOOST_CHECK_EQUAL_COLLECTIONS(sparse->m_indices, sparse->m_indices + sparse->m_totalNnzCount, expected.m_rowIndices.begin(), expected.m_rowIndices.end());
+        const float* sparseValues = (const float*)sparse->GetDataBuffer();
+        BOOST_CHECK_EQUAL_COLLECTIONS(sparseValues, sparseValues + sparse->m_totalNnzCount, expected.m_values.begin(), expected.m_values.end());
+    }
+
+    KeyType unknown;
+    unknown.m_sequence = corpus->GetStringRegistry()["unknown"];
+    unknown.m_sample = 0;
+    SequenceDescription primary = {}, description;
+    primary.m_key = unknown;
+    BOOST_CHECK(!deserializer.GetSequenceDescription(primary, description));
+
+    _wunlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(BinaryChunkSparseRoundTrip)
+{
+    CheckSparseRoundTrip(BinaryChunkFormat::Compression::none);
+}
+
+#ifdef USE_LZ4
+BOOST_AUTO_TEST_CASE(BinaryChunkSparseRoundTripLz4)
+{
+    CheckSparseRoundTrip(BinaryChunkFormat::Compression::lz4);
+}
+#endif
+
+// Packs all sequences of the deserializer into a single frame mode minibatch and returns its sparse stream.
+static vector<char> PackSparseFrames(IDataDeserializerPtr deserializer, size_t numberOfSamples)
+{
+    auto randomizer = make_shared<NoRandomizer>(deserializer);
+    FramePacker packer(randomizer, deserializer->GetStreamDescriptions());
+
+    EpochConfiguration config;
+    config.m_numberOfWorkers = 1;
+    config.m_workerRank = 0;
+    config.m_minibatchSizeInSamples = numberOfSamples;
+    config.m_totalEpochSizeInSamples = numberOfSamples;
+    config.m_epochIndex = 0;
+    config.m_truncationSize = 0;
+    randomizer->StartEpoch(config);
+    auto memoryProvider = make_shared<HeapMemoryProvider>();
+    packer.StartEpoch(config, { memoryProvider, memoryProvider });
+
+    auto minibatch = packer.ReadMinibatch();
+    BOOST_REQUIRE_EQUAL(minibatch.m_data.size(), 2);
+    BOOST_REQUIRE_EQUAL(minibatch.m_data[1]->m_layout->GetNumCols(), numberOfSamples);
+
+    // header, values and row indices of the capacity and column offsets.
+    const char* data = (const char*)minibatch.m_data[1]->m_data;
+    const auto& header = *(const SparseStreamMinibatchHeader*)data;
+    BOOST_REQUIRE_GE(header.m_nnzCapacity, header.m_nnzCount);
+    size_t size = sizeof(header) + header.m_nnzCapacity * (sizeof(float) + sizeof(IndexType)) + (numberOfSamples + 1) * sizeof(IndexType);
+    return vector<char>(data, data + size);
+}
+
+BOOST_AUTO_TEST_CASE(BinaryChunkSparseFramePacking)
+{
+    auto source = make_shared<MockSparseDeserializer>(true);
+    const wstring path = L"BinaryChunkSparseFramePacking.bin";
+    {
+        BinaryChunkWriter writer(path, source->GetStreamDescriptions(), 64, BinaryChunkFormat::Compression::none);
+        writer.AddSequences(*source, KeyToString);
+        writer.Close();
+    }
+
+    // Sequence i has i + 1 values, all of them in its only column.
+    vector<float> values;
+    vector<IndexType> rowIndices, columnOffsets(1, 0);
+    for (const auto& sequence : source->m_sparse)
+    {
+        values.insert(values.end(), sequence->m_values.begin(), sequence->m_values.end());
+        rowIndices.insert(rowIndices.end(), sequence->m_rowIndices.begin(), sequence->m_rowIndices.end());
+        columnOffsets.push_back(columnOffsets.back() + sequence->m_totalNnzCount);
+    }
+    // The capacity is the number of values and an eighth of it, rounded down, which is no room at this size.
+    SparseStreamMinibatchHeader header = { values.size(), values.size() };
+    vector<char> expected((const char*)&header, (const char*)(&header + 1));
+    expected.insert(expected.end(), (const char*)values.data(), (const char*)(values.data() + values.size()));
+    expected.insert(expected.end(), (const char*)rowIndices.data(), (const char*)(rowIndices.data() + rowIndices.size()));
+    expected.insert(expected.end(), (const char*)columnOffsets.data(), (const char*)(columnOffsets.data() + columnOffsets.size()));
+
+    // The source computes column offsets from the nnz counts, the binary chunks provide them.
+    auto fromSource = PackSparseFrames(source, 3);
+    BOOST_CHECK_EQUAL_COLLECTIONS(fromSource.begin(), fromSource.end(), expected.begin(), expected.end());
+    auto fromFile = PackSparseFrames(make_shared<BinaryChunkDeserializer>(make_shared<CorpusDescriptor>(), path), 3);
+    BOOST_CHECK_EQUAL_COLLECTIONS(fromFile.begin(), fromFile.end(), expected.begin(), expected.end());
+
+    _wunlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TruncatedBPTTPackerPacksSparseWindows)
+{
+    auto source = make_shared<MockSparseDeserializer>();
+    auto randomizer = make_shared<NoRandomizer>(source);
+    TruncatedBPTTPacker packer(randomizer, source->GetStreamDescriptions());
+
+    // Two parallel sequences of two time steps: the first one gets the sequences 0 and 1, the second one the sequence 2.
+    EpochConfiguration config;
+    config.m_numberOfWorkers = 1;
+    config.m_workerRank = 0;
+    config.m_minibatchSizeInSamples = 4;
+    config.m_totalEpochSizeInSamples = source->m_numberOfSamples;
+    config.m_epochIndex = 0;
+    config.m_truncationSize = 2;
+    randomizer->StartEpoch(config);
+    auto memoryProvider = make_shared<HeapMemoryProvider>();
+    packer.StartEpoch(config, { memoryProvider, memoryProvider });
+
+    // The columns are the samples of the parallel sequences at each time step, the dense stream has the sequence index
+    // in both rows, the sparse one the values of MockSparseDeserializer.
+    auto checkWindow = [&](const vector<float>& dense, const vector<float>& values, const vector<IndexType>& rowIndices,
+                           const vector<IndexType>& columnOffsets, size_t numberOfGaps)
+    {
+        auto minibatch = packer.ReadMinibatch();
+        BOOST_REQUIRE(!minibatch.m_endOfEpoch);
+        BOOST_REQUIRE_EQUAL(minibatch.m_data.size(), 2);
+        const auto& layout = minibatch.m_data[0]->m_layout;
+        BOOST_REQUIRE(layout == minibatch.m_data[1]->m_layout);
+        BOOST_REQUIRE_EQUAL(layout->GetNumCols(), 4);
+        BOOST_CHECK_EQUAL(layout->GetActualNumSamples(), 4 - numberOfGaps);
+
+        const float* denseData = (const float*)minibatch.m_data[0]->m_data;
+        BOOST_CHECK_EQUAL_COLLECTIONS(denseData, denseData + dense.size(), dense.begin(), dense.end());
+
+        const char* data = (const char*)minibatch.m_data[1]->m_data;
+        const auto& header = *(const SparseStreamMinibatchHeader*)data;
+        BOOST_REQUIRE_EQUAL(header.m_nnzCount, values.size());
+        BOOST_REQUIRE_GE(header.m_nnzCapacity, header.m_nnzCount);
+        const float* sparseValues = (const float*)(data + sizeof(header));
+        const IndexType* sparseRowIndices = (const IndexType*)(sparseValues + header.m_nnzCapacity);
+        const IndexType* sparseColumnOffsets = sparseRowIndices + header.m_nnzCapacity;
+        BOOST_CHECK_EQUAL_COLLECTIONS(sparseValues, sparseValues + values.size(), values.begin(), values.end());
+        BOOST_CHECK_EQUAL_COLLECTIONS(sparseRowIndices, sparseRowIndices + rowIndices.size(), rowIndices.begin(), rowIndices.end());
+        BOOST_CHECK_EQUAL_COLLECTIONS(sparseColumnOffsets, sparseColumnOffsets + 5, columnOffsets.begin(), columnOffsets.end());
+    };
+
+    // sample 0 of sequence 0, 0 of 2, 0 of 1, 1 of 2
+    checkWindow({ 0, 0, 2, 2, 1, 1, 2, 2 }, { 210 }, { 1 }, { 0, 0, 0, 0, 1 }, 0);
+    // sample 1 of sequence 1, 2 of 2, and gaps at the end of the data
+    checkWindow({ 1, 1, 2, 2 }, { 110, 220, 221 }, { 1, 2, 3 }, { 0, 1, 3, 3, 3 }, 2);
+    BOOST_CHECK(packer.ReadMinibatch().m_endOfEpoch);
+}
+
+BOOST_AUTO_TEST_CASE(BinaryChunkRejectsOtherFiles)
+{
+    const wstring path = L"BinaryChunkRejectsOtherFiles.bin";
+    {
+        ofstream file(msra::strfun::utf8(path));
+        file << "This is not a binary chunk file, but long enough to have a header." << endl;
+    }
+    BOOST_CHECK_THROW(BinaryChunkDeserializer(make_shared<CorpusDescriptor>(), path), std::runtime_error);
+    _wunlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(BinaryChunkRejectsChunksBeyondTheFile)
+{
+    SequentialDeserializer source(0, 100, 500, 20);
+    const wstring path = L"BinaryChunkRejectsChunksBeyondTheFile.bin";
+    {
+        BinaryChunkWriter writer(path, source.GetStreamDescriptions(), 1024, BinaryChunkFormat::Compression::none);
+        writer.AddSequences(source, KeyToString);
+        writer.Close();
+    }
+    BinaryChunkDeserializer(make_shared<CorpusDescriptor>(), path);
+
+    // Makes the first chunk larger than what is stored of it. The index starts with the header
+    // of the stream "input", its name padded to 8 bytes and its single dimension, then the chunks follow.
+    vector<char> contents;
+    {
+        ifstream file(msra::strfun::utf8(path), ios::binary);
+        contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    }
+    BinaryChunkFormat::FileHeader header;
+    BOOST_REQUIRE_GE(contents.size(), sizeof(header));
+    memcpy(&header, contents.data(), sizeof(header));
+    const size_t chunkOffset = header.m_indexOffset + sizeof(BinaryChunkFormat::StreamHeader) + 2 * sizeof(uint64_t);
+    BOOST_REQUIRE_GE(contents.size(), chunkOffset + sizeof(BinaryChunkFormat::ChunkHeader));
+    BinaryChunkFormat::ChunkHeader chunk;
+    memcpy(&chunk, contents.data() + chunkOffset, sizeof(chunk));
+    BOOST_REQUIRE_EQUAL(chunk.m_size, chunk.m_storedSize);
+    chunk.m_size = contents.size();
+    memcpy(contents.data() + chunkOffset, &chunk, sizeof(chunk));
+    {
+        ofstream file(msra::strfun::utf8(path), ios::binary);
+        file.write(contents.data(), contents.size());
+    }
+
+    BOOST_CHECK_THROW(BinaryChunkDeserializer(make_shared<CorpusDescriptor>(), path), std::runtime_error);
+    _wunlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
@@ -13,9 +13,12 @@
 #define _fileno fileno
 #endif
 #include <cstdio>
+#include <chrono>
+#include <random>
 #include <boost/scope_exit.hpp>
 #include "Common/ReaderTestHelper.h"
 #include "TextParser.h"
+#include "TextStreamingEnumerator.h"
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -31,13 +34,14 @@ public:
     ChunkPtr m_chunk;
 
     CNTKTextFormatReaderTestRunner(const string& filename,
-        const vector<StreamDescriptor>& streams, unsigned int maxErrors) :
+        const vector<StreamDescriptor>& streams, unsigned int maxErrors, bool memoryMapInput = false) :
         m_parser(std::make_shared<CorpusDescriptor>(), wstring(filename.begin(), filename.end()), streams)
     {
         m_parser.SetMaxAllowedErrors(maxErrors);
         m_parser.SetTraceLevel(TextParser<ElemType>::TraceLevel::Info);
         m_parser.SetChunkSize(SIZE_MAX);
         m_parser.SetNumRetries(0);
+        m_parser.SetMemoryMappedInput(memoryMapInput);
         m_parser.Initialize();
     }
     // Retrieves a chunk of data.
@@ -45,6 +49,21 @@ public:
     {
         m_chunk = m_parser.GetChunk(0);
     }
+
+    void SetTraceLevel(unsigned int traceLevel)
+    {
+        m_parser.SetTraceLevel(traceLevel);
+    }
+
+    void SetFastNumericParsing(bool enable)
+    {
+        m_parser.SetFastNumericParsing(enable);
+    }
+
+    void SetNumParsingThreads(unsigned int numThreads)
+    {
+        m_parser.SetNumParsingThreads(numThreads);
+    }
 };
 
 namespace Test {
@@ -807,6 +826,427 @@ BOOST_AUTO_TEST_CASE(CompositeCNTKTextFormatReader_5x5_and_5x10_jagged_minibatch
         false);
 };
 
+// Writes 'numRows' single-row sequences with a dense input A of dimension 'denseDim' and a sparse input B
+// of dimension 'sparseDim', using a mix of number formats (including ones the fast path leaves to the general parser).
+void WriteNumericTokenizationInput(const string& filename, size_t numRows, size_t denseDim, size_t sparseDim)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<double> magnitude(-8, 8);
+    std::uniform_int_distribution<int> format(0, 9);
+    std::uniform_int_distribution<int> precision(0, 17);
+    std::uniform_int_distribution<size_t> index(0, sparseDim - 1);
+    std::uniform_int_distribution<size_t> nnz(0, 30);
+
+    auto number = [&]()
+    {
+        char buffer[64];
+        double value = pow(10.0, magnitude(rng)) * ((rng() % 2) ? -1 : 1);
+        switch (format(rng))
+        {
+        case 0: sprintf(buffer, "%d", (int) value); break;
+        case 1: sprintf(buffer, "%.*e", precision(rng), value); break;
+        case 2: sprintf(buffer, "%.*E", precision(rng), value); break;
+        case 3: sprintf(buffer, "%g", value); break;
+        case 4: sprintf(buffer, "+%.3f", fabs(value)); break;
+        case 5: sprintf(buffer, "%.0f.", value); break;                   // trailing period
+        case 6: sprintf(buffer, "%.25f", value); break;                   // digit runs too long for the fast path
+        default: sprintf(buffer, "%.*f", precision(rng), value); break;
+        }
+        return string(buffer);
+    };
+
+    ofstream output(filename);
+    for (size_t row = 0; row < numRows; ++row)
+    {
+        output << "|A";
+        for (size_t i = 0; i < denseDim; ++i)
+        {
+            output << " " << number();
+        }
+
+        output << "\t|B";
+        size_t numValues = nnz(rng);
+        for (size_t i = 0; i < numValues; ++i)
+        {
+            output << " " << index(rng) << ":" << number();
+        }
+        output << "\n";
+    }
+}
+
+// Requires the first 'numSequences' sequences of two chunks with a dense input of dimension 'denseDim'
+// followed by a sparse input (see WriteNumericTokenizationInput) to be identical.
+template <class ElemType>
+void CheckChunksAreEqual(const ChunkPtr& expectedChunk, const ChunkPtr& actualChunk, size_t numSequences, size_t denseDim)
+{
+    for (size_t i = 0; i < numSequences; ++i)
+    {
+        std::vector<SequenceDataPtr> expected, actual;
+        expectedChunk->GetSequence(i, expected);
+        actualChunk->GetSequence(i, actual);
+        BOOST_REQUIRE_EQUAL(expected.size(), actual.size());
+
+        // dense input: values must be identical bit for bit
+        BOOST_REQUIRE_EQUAL(expected[0]->m_numberOfSamples, actual[0]->m_numberOfSamples);
+        size_t denseBytes = expected[0]->m_numberOfSamples * denseDim * sizeof(ElemType);
+        BOOST_REQUIRE(memcmp(expected[0]->GetDataBuffer(), actual[0]->GetDataBuffer(), denseBytes) == 0);
+
+        // sparse input: indices, nnz counts and values must be identical
+        auto expectedSparse = static_cast<SparseSequenceData*>(expected[1].get());
+        auto actualSparse = static_cast<SparseSequenceData*>(actual[1].get());
+        BOOST_REQUIRE(expectedSparse->m_nnzCounts == actualSparse->m_nnzCounts);
+        BOOST_REQUIRE_EQUAL(expectedSparse->m_totalNnzCount, actualSparse->m_totalNnzCount);
+        size_t nnz = expectedSparse->m_totalNnzCount;
+        BOOST_REQUIRE(memcmp(expectedSparse->m_indices, actualSparse->m_indices, nnz * sizeof(IndexType)) == 0);
+        BOOST_REQUIRE(memcmp(expectedSparse->GetDataBuffer(), actualSparse->GetDataBuffer(), nnz * sizeof(ElemType)) == 0);
+    }
+}
+
+template <class ElemType>
+void CompareNumericTokenization(const string& filename, const vector<StreamDescriptor>& streams, size_t numSequences)
+{
+    std::vector<ChunkPtr> chunks;
+    double parseSeconds[2];
+    for (bool fast : { false, true })
+    {
+        CNTKTextFormatReaderTestRunner<ElemType> testRunner(filename, streams, 0);
+        testRunner.SetTraceLevel(0);
+        testRunner.SetFastNumericParsing(fast);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        testRunner.LoadChunk();
+        parseSeconds[fast] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        chunks.push_back(testRunner.m_chunk);
+    }
+
+    BOOST_TEST_MESSAGE("Numeric tokenization (" << sizeof(ElemType) * 8 << " bit): " << parseSeconds[0] << "s general parser, "
+                       << parseSeconds[1] << "s fast path");
+
+    CheckChunksAreEqual<ElemType>(chunks[0], chunks[1], numSequences, streams[0].m_sampleDimension);
+}
+
+// Parses generated input with and without the fast numeric tokenization path,
+// reports the parsing times and requires the parsed data to be identical.
+BOOST_AUTO_TEST_CASE(CNTKTextFormatReader_numeric_tokenization_benchmark)
+{
+    const size_t numRows = 20000;
+    vector<StreamDescriptor> streams(2);
+    streams[0].m_alias = "A";
+    streams[0].m_name = L"A";
+    streams[0].m_storageType = StorageType::dense;
+    streams[0].m_sampleDimension = 10;
+
+    streams[1].m_alias = "B";
+    streams[1].m_name = L"B";
+    streams[1].m_storageType = StorageType::sparse_csc;
+    streams[1].m_sampleDimension = 1000;
+
+    string filename = "numeric_tokenization_benchmark.txt";
+    WriteNumericTokenizationInput(filename, numRows, streams[0].m_sampleDimension, streams[1].m_sampleDimension);
+    BOOST_SCOPE_EXIT(&filename)
+    {
+        boost::filesystem::remove(filename);
+    } BOOST_SCOPE_EXIT_END
+
+    CompareNumericTokenization<float>(filename, streams, numRows);
+    CompareNumericTokenization<double>(filename, streams, numRows);
+};
+
+// Builds the index of a CTF file, through its cache if 'cacheIndex' is set,
+// and with 'numThreads' other than 1 from a mapping of the file scanned by that many threads.
+unique_ptr<Indexer> BuildIndex(const wstring& path, bool skipSequenceIds, bool cacheIndex, size_t numThreads = 1)
+{
+    FILE* file = fopenOrDie(path, L"rbS");
+    unique_ptr<Indexer> indexer = make_unique<Indexer>(file, skipSequenceIds);
+    if (cacheIndex)
+    {
+        indexer->EnableCache(path);
+    }
+    unique_ptr<MemoryMappedFile> mappedFile;
+    if (numThreads != 1)
+    {
+        mappedFile = make_unique<MemoryMappedFile>(path);
+        indexer->SetMemoryMappedInput(mappedFile.get());
+        indexer->SetNumberOfThreads(numThreads);
+    }
+    indexer->Build(std::make_shared<CorpusDescriptor>());
+    fclose(file);
+    return indexer;
+}
+
+// Requires two indices to consist of the same chunks and sequences.
+void CheckIndicesAreEqual(const Index& expected, const Index& actual)
+{
+    BOOST_REQUIRE_EQUAL(expected.m_chunks.size(), actual.m_chunks.size());
+    for (size_t i = 0; i < expected.m_chunks.size(); ++i)
+    {
+        const auto& expectedChunk = expected.m_chunks[i];
+        const auto& actualChunk = actual.m_chunks[i];
+        BOOST_REQUIRE_EQUAL(expectedChunk.m_id, actualChunk.m_id);
+        BOOST_REQUIRE_EQUAL(expectedChunk.m_byteSize, actualChunk.m_byteSize);
+        BOOST_REQUIRE_EQUAL(expectedChunk.m_numberOfSamples, actualChunk.m_numberOfSamples);
+        BOOST_REQUIRE_EQUAL(expectedChunk.m_sequences.size(), actualChunk.m_sequences.size());
+        for (size_t j = 0; j < expectedChunk.m_sequences.size(); ++j)
+        {
+            const auto& expectedSequence = expectedChunk.m_sequences[j];
+            const auto& actualSequence = actualChunk.m_sequences[j];
+            BOOST_REQUIRE_EQUAL(expectedSequence.m_id, actualSequence.m_id);
+            BOOST_REQUIRE_EQUAL(expectedSequence.m_chunkId, actualSequence.m_chunkId);
+            BOOST_REQUIRE_EQUAL(expectedSequence.m_key.m_sequence, actualSequence.m_key.m_sequence);
+            BOOST_REQUIRE_EQUAL(expectedSequence.m_numberOfSamples, actualSequence.m_numberOfSamples);
+            BOOST_REQUIRE_EQUAL(expectedSequence.m_fileOffsetBytes, actualSequence.m_fileOffsetBytes);
+            BOOST_REQUIRE_EQUAL(expectedSequence.m_byteSize, actualSequence.m_byteSize);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CNTKTextFormatReader_index_cache)
+{
+    string filename = "index_cache.txt";
+    wstring path(filename.begin(), filename.end());
+    string cacheFilename = msra::strfun::utf8(Indexer::GetCacheFilePath(path));
+    auto writeInput = [&](size_t numSequences, size_t firstSequenceId)
+    {
+        ofstream output(filename);
+        for (size_t i = 0; i < numSequences; ++i)
+        {
+            for (size_t j = 0; j <= i % 3; ++j)
+            {
+                output << (firstSequenceId + i) << "\t|A " << j << "\n";
+            }
+        }
+        output.close();
+        // a fixed modification time, so that it can be restored after rewriting the file
+        boost::filesystem::last_write_time(filename, 1000000000);
+    };
+
+    boost::filesystem::remove(cacheFilename);
+    writeInput(1000, 1000);
+    BOOST_SCOPE_EXIT(&filename, &cacheFilename)
+    {
+        boost::filesystem::remove(filename);
+        boost::filesystem::remove(cacheFilename);
+    } BOOST_SCOPE_EXIT_END
+
+    auto reference = BuildIndex(path, false, false);
+    BOOST_REQUIRE(!boost::filesystem::exists(cacheFilename));
+
+    // the first run builds the index and writes the cache, the second one reads it
+    auto built = BuildIndex(path, false, true);
+    BOOST_REQUIRE(boost::filesystem::exists(cacheFilename));
+    CheckIndicesAreEqual(reference->GetIndex(), built->GetIndex());
+    auto loaded = BuildIndex(path, false, true);
+    CheckIndicesAreEqual(reference->GetIndex(), loaded->GetIndex());
+    BOOST_REQUIRE_EQUAL(reference->HasSequenceIds(), loaded->HasSequenceIds());
+
+    // the cache is keyed by size and modification time of the input: same size and time, different
+    // sequence ids, still the cached index (which shows it is read from the cache and not rebuilt)
+    writeInput(1000, 2000);
+    CheckIndicesAreEqual(reference->GetIndex(), BuildIndex(path, false, true)->GetIndex());
+
+    // a different setting for sequence ids invalidates the cache
+    CheckIndicesAreEqual(BuildIndex(path, true, false)->GetIndex(), BuildIndex(path, true, true)->GetIndex());
+    BOOST_REQUIRE(!BuildIndex(path, true, true)->HasSequenceIds());
+
+    // so does a change of the input file
+    writeInput(1200, 1000);
+    auto changed = BuildIndex(path, false, false);
+    CheckIndicesAreEqual(changed->GetIndex(), BuildIndex(path, false, true)->GetIndex());
+    CheckIndicesAreEqual(changed->GetIndex(), BuildIndex(path, false, true)->GetIndex());
+    BOOST_REQUIRE_GT(changed->GetIndex().m_chunks[0].m_numberOfSequences, reference->GetIndex().m_chunks[0].m_numberOfSequences);
+};
+
+// Builds the index of generated input of a few megabytes in byte ranges scanned in parallel, and requires it
+// to be the one of the serial pass: with sequences that span the ranges, lines without a sequence id in them,
+// consecutive sequences of the same id (which are one) and a last line without a newline.
+BOOST_AUTO_TEST_CASE(CNTKTextFormatReader_parallel_index)
+{
+    string filename = "parallel_index.txt";
+    wstring path(filename.begin(), filename.end());
+    BOOST_SCOPE_EXIT(&filename)
+    {
+        boost::filesystem::remove(filename);
+    } BOOST_SCOPE_EXIT_END
+
+    for (bool withBom : { false, true })
+    {
+        {
+            std::mt19937 random(withBom ? 7 : 3);
+            ofstream output(filename, ios::binary);
+            if (withBom)
+            {
+                output << "\xEF\xBB\xBF";
+            }
+            size_t id = 0;
+            for (size_t i = 0; output.tellp() < 5 * 1024 * 1024; ++i)
+            {
+                // the id of the previous sequence repeats now and then, and sequences get up to a few thousand lines
+                id = (i > 0 && random() % 10 == 0) ? id : 1000 + i;
+                const size_t numberOfLines = (random() % 50 == 0) ? random() % 3000 + 1 : random() % 5 + 1;
+                for (size_t j = 0; j < numberOfLines; ++j)
+                {
+                    if (j == 0 || random() % 4 != 0)
+                    {
+                        output << id << "\t";
+                    }
+                    output << "|A " << i << " " << j << "\n";
+                }
+            }
+            output << "99\t|A 0 0";
+        }
+
+        for (bool skipSequenceIds : { false, true })
+        {
+            auto reference = BuildIndex(path, skipSequenceIds, false);
+            BOOST_REQUIRE_GT(reference->GetIndex().m_chunks.size(), 0);
+            for (size_t numThreads : { 0, 2, 3, 8 })
+            {
+                auto parallel = BuildIndex(path, skipSequenceIds, false, numThreads);
+                CheckIndicesAreEqual(reference->GetIndex(), parallel->GetIndex());
+                BOOST_REQUIRE_EQUAL(reference->HasSequenceIds(), parallel->HasSequenceIds());
+            }
+        }
+    }
+};
+
+// Parses generated input from the memory-mapped input file, serially and in parallel,
+// and requires the parsed data to be identical to the one read through the file buffers.
+BOOST_AUTO_TEST_CASE(CNTKTextFormatReader_memory_mapped_input)
+{
+    const size_t numRows = 2000;
+    vector<StreamDescriptor> streams(2);
+    streams[0].m_alias = "A";
+    streams[0].m_name = L"A";
+    streams[0].m_storageType = StorageType::dense;
+    streams[0].m_sampleDimension = 10;
+
+    streams[1].m_alias = "B";
+    streams[1].m_name = L"B";
+    streams[1].m_storageType = StorageType::sparse_csc;
+    streams[1].m_sampleDimension = 1000;
+
+    string filename = "memory_mapped_input.txt";
+    WriteNumericTokenizationInput(filename, numRows, streams[0].m_sampleDimension, streams[1].m_sampleDimension);
+    BOOST_SCOPE_EXIT(&filename)
+    {
+        boost::filesystem::remove(filename);
+    } BOOST_SCOPE_EXIT_END
+
+    CNTKTextFormatReaderTestRunner<float> reference(filename, streams, 0);
+    reference.SetTraceLevel(0);
+    reference.LoadChunk();
+
+    for (unsigned int numThreads : { 1, 4 })
+    {
+        CNTKTextFormatReaderTestRunner<float> mapped(filename, streams, 0, true);
+        mapped.SetTraceLevel(0);
+        mapped.SetNumParsingThreads(numThreads);
+        mapped.LoadChunk();
+        CheckChunksAreEqual<float>(reference.m_chunk, mapped.m_chunk, numRows, streams[0].m_sampleDimension);
+    }
+};
+
+// Reads all sequences of an epoch of requestDataSize samples from the streaming enumerator of one worker.
+vector<SequenceDataPtr> ReadStreamedEpoch(TextStreamingEnumerator<float>& enumerator, size_t epochIndex, size_t workerRank, size_t numberOfWorkers)
+{
+    EpochConfiguration config;
+    config.m_numberOfWorkers = numberOfWorkers;
+    config.m_workerRank = workerRank;
+    config.m_minibatchSizeInSamples = 0;
+    config.m_totalEpochSizeInSamples = requestDataSize;
+    config.m_epochIndex = epochIndex;
+    enumerator.StartEpoch(config);
+
+    vector<SequenceDataPtr> result;
+    Sequences sequences;
+    do
+    {
+        sequences = enumerator.GetNextSequences(7);
+        if (!sequences.m_data.empty())
+        {
+            result.insert(result.end(), sequences.m_data[0].begin(), sequences.m_data[0].end());
+        }
+    } while (!sequences.m_endOfEpoch);
+    return result;
+}
+
+// Reads input with and without sequence ids without an index, on one and several workers and in blocks
+// smaller than a line as well as larger than the file, and requires the workers together to return
+// the sequences of the indexed parser, each once and in order.
+BOOST_AUTO_TEST_CASE(CNTKTextFormatReader_streaming_input)
+{
+    string filename = "streaming_input.txt";
+    BOOST_SCOPE_EXIT(&filename)
+    {
+        boost::filesystem::remove(filename);
+    } BOOST_SCOPE_EXIT_END
+
+    vector<StreamDescriptor> streams(1);
+    streams[0].m_alias = "A";
+    streams[0].m_name = L"A";
+    streams[0].m_storageType = StorageType::dense;
+    streams[0].m_sampleDimension = 2;
+
+    for (bool withSequenceIds : { true, false })
+    {
+        const size_t numSequences = 300;
+        {
+            ofstream output(filename);
+            for (size_t i = 0; i < numSequences; ++i)
+            {
+                for (size_t j = 0; j <= (withSequenceIds ? i % 4 : 0); ++j)
+                {
+                    if (withSequenceIds)
+                        output << (1000 + i) << "\t";
+                    output << "|A " << i << " " << j << "\n";
+                }
+            }
+        }
+
+        CNTKTextFormatReaderTestRunner<float> reference(filename, streams, 0);
+        reference.SetTraceLevel(0);
+        reference.LoadChunk();
+
+        for (size_t numberOfWorkers : { 1, 3 })
+        {
+            for (size_t blockSize : { 5, 1 << 20 })
+            {
+                ConfigParameters config;
+                config.Parse("file=" + filename + "\nrandomize=false\nstreaming=true\ntraceLevel=0\n"
+                             "chunkSizeInBytes=" + to_string(blockSize) + "\ninput=[A=[dim=2\nformat=dense]]\n");
+                TextConfigHelper helper(config);
+
+                vector<SequenceDataPtr> actual;
+                for (size_t rank = 0; rank < numberOfWorkers; ++rank)
+                {
+                    TextStreamingEnumerator<float> enumerator(helper);
+                    auto first = ReadStreamedEpoch(enumerator, 0, rank, numberOfWorkers);
+                    BOOST_REQUIRE(!first.empty());
+
+                    // the next epoch is the next pass over the same part of the file
+                    auto second = ReadStreamedEpoch(enumerator, 1, rank, numberOfWorkers);
+                    BOOST_REQUIRE_EQUAL(first.size(), second.size());
+                    for (size_t i = 0; i < first.size(); ++i)
+                    {
+                        BOOST_REQUIRE(memcmp(first[i]->GetDataBuffer(), second[i]->GetDataBuffer(), 2 * sizeof(float)) == 0);
+                    }
+                    actual.insert(actual.end(), first.begin(), first.end());
+                }
+
+                BOOST_REQUIRE_EQUAL(actual.size(), numSequences);
+                for (size_t i = 0; i < numSequences; ++i)
+                {
+                    std::vector<SequenceDataPtr> expected;
+                    reference.m_chunk->GetSequence(i, expected);
+                    BOOST_REQUIRE_EQUAL(expected[0]->m_numberOfSamples, actual[i]->m_numberOfSamples);
+                    size_t bytes = expected[0]->m_numberOfSamples * streams[0].m_sampleDimension * sizeof(float);
+                    BOOST_REQUIRE(memcmp(expected[0]->GetDataBuffer(), actual[i]->GetDataBuffer(), bytes) == 0);
+                }
+            }
+        }
+    }
+};
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } } } }
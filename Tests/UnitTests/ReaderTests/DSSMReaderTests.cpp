@@ -0,0 +1,119 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "DSSMDeserializer.h"
+
+using namespace Microsoft::MSR::CNTK;
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(DSSMReaderTests)
+
+template <class T>
+static void Append(vector<char>& buffer, const T& value)
+{
+    buffer.insert(buffer.end(), (const char*)&value, (const char*)&value + sizeof(value));
+}
+
+// Row r has r + 1 non zero values r + 1 + first at rows 0..r, the layout of DSSM_BinaryInput.
+static void WriteDSSMFile(const wstring& path, int64_t numberOfRows, float first)
+{
+    vector<char> data;
+    vector<int64_t> offsets;
+    int64_t totalNnz = 0;
+    for (int32_t r = 0; r < numberOfRows; ++r)
+    {
+        offsets.push_back((int64_t)data.size());
+        Append(data, r + 1);
+        for (int32_t i = 0; i <= r; ++i)
+            Append(data, r + 1 + first);
+        for (int32_t i = 0; i <= r; ++i)
+            Append(data, i);
+        totalNnz += r + 1;
+    }
+
+    vector<char> file;
+    Append(file, numberOfRows);
+    Append(file, (int32_t)100);
+    Append(file, totalNnz);
+    for (int64_t offset : offsets)
+        Append(file, offset);
+    file.insert(file.end(), data.begin(), data.end());
+
+    ofstream stream(msra::strfun::utf8(path), ios::binary);
+    stream.write(file.data(), file.size());
+}
+
+BOOST_AUTO_TEST_CASE(DSSMDeserializerReadsQueryDocumentPairs)
+{
+    const wstring query = L"DSSMDeserializerQuery.bin", doc = L"DSSMDeserializerDoc.bin";
+    WriteDSSMFile(query, 5, 0.0f);
+    WriteDSSMFile(doc, 5, 100.0f);
+
+    {
+        ConfigParameters config;
+        config.Parse("chunkSizeInBytes=60\ninput=[\nquery=[file=" + msra::strfun::utf8(query) + "\ndim=100]\ndoc=[file=" + msra::strfun::utf8(doc) + "\ndim=100]\n]\n");
+        DSSMDeserializer deserializer(make_shared<CorpusDescriptor>(), config, true);
+
+        auto streams = deserializer.GetStreamDescriptions();
+        BOOST_REQUIRE_EQUAL(streams.size(), 2);
+        BOOST_CHECK((streams[0]->m_name == L"query" && streams[1]->m_name == L"doc") || (streams[0]->m_name == L"doc" && streams[1]->m_name == L"query"));
+        BOOST_CHECK(streams[0]->m_storageType == StorageType::sparse_csc);
+
+        // rows of 12, 20, 28, ... bytes in each of the two files, two rows per chunk
+        auto chunks = deserializer.GetChunkDescriptions();
+        BOOST_REQUIRE_EQUAL(chunks.size(), 3);
+        size_t rows = 0;
+        for (ChunkIdType chunkId = 0; chunkId < chunks.size(); ++chunkId)
+        {
+            vector<SequenceDescription> descriptions;
+            deserializer.GetSequencesForChunk(chunkId, descriptions);
+            BOOST_REQUIRE_EQUAL(descriptions.size(), chunks[chunkId]->m_numberOfSequences);
+
+            auto chunk = deserializer.GetChunk(chunkId);
+            for (const auto& description : descriptions)
+            {
+                BOOST_REQUIRE_EQUAL(description.m_id, rows++);
+                vector<SequenceDataPtr> data;
+                chunk->GetSequence(description.m_id, data);
+                BOOST_REQUIRE_EQUAL(data.size(), 2);
+                for (size_t s = 0; s < 2; ++s)
+                {
+                    auto sparse = static_pointer_cast<SparseSequenceData>(data[s]);
+                    BOOST_REQUIRE_EQUAL(sparse->m_totalNnzCount, description.m_id + 1);
+                    BOOST_CHECK_EQUAL(sparse->m_indices[description.m_id], (IndexType)description.m_id);
+                    BOOST_CHECK_EQUAL(((const float*)sparse->GetDataBuffer())[0], description.m_id + 1 + (streams[s]->m_name == L"query" ? 0.0f : 100.0f));
+                }
+
+                SequenceDescription secondary;
+                BOOST_REQUIRE(deserializer.GetSequenceDescription(description, secondary));
+                BOOST_CHECK_EQUAL(secondary.m_chunkId, chunkId);
+            }
+        }
+        BOOST_CHECK_EQUAL(rows, 5);
+    }
+    _wunlink(query.c_str());
+    _wunlink(doc.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(DSSMDeserializerRejectsInputsOfDifferentLength)
+{
+    const wstring query = L"DSSMDeserializerShortQuery.bin", doc = L"DSSMDeserializerLongDoc.bin";
+    WriteDSSMFile(query, 2, 0.0f);
+    WriteDSSMFile(doc, 3, 0.0f);
+
+    ConfigParameters config;
+    config.Parse("input=[\nquery=[file=" + msra::strfun::utf8(query) + "\ndim=100]\ndoc=[file=" + msra::strfun::utf8(doc) + "\ndim=100]\n]\n");
+    BOOST_CHECK_THROW(DSSMDeserializer(make_shared<CorpusDescriptor>(), config, true), std::exception);
+
+    _wunlink(query.c_str());
+    _wunlink(doc.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
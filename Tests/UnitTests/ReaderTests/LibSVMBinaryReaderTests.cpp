@@ -0,0 +1,155 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "LibSVMBinaryDeserializer.h"
+
+using namespace Microsoft::MSR::CNTK;
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(LibSVMBinaryReaderTests)
+
+template <class T>
+static void Append(vector<char>& buffer, const T& value)
+{
+    buffer.insert(buffer.end(), (const char*)&value, (const char*)&value + sizeof(value));
+}
+
+static void AppendName(vector<char>& buffer, const string& name, int32_t dimension)
+{
+    Append(buffer, (int32_t)name.size());
+    buffer.insert(buffer.end(), name.begin(), name.end());
+    Append(buffer, dimension);
+}
+
+// Sample s of the file has the feature s + 1 at row s and the labels (s, -s).
+static void WriteLibSVMBinaryFile(const wstring& path, const vector<int32_t>& samplesPerBlock)
+{
+    vector<vector<char>> blocks;
+    int32_t sample = 0;
+    for (int32_t numberOfSamples : samplesPerBlock)
+    {
+        vector<char> block;
+        Append(block, numberOfSamples);
+        Append(block, numberOfSamples); // nnz
+        for (int32_t s = 0; s < numberOfSamples; ++s)
+            Append(block, (float)(sample + s + 1));
+        for (int32_t s = 0; s < numberOfSamples; ++s)
+            Append(block, sample + s);
+        for (int32_t s = 0; s <= numberOfSamples; ++s)
+            Append(block, s);
+        for (int32_t s = 0; s < numberOfSamples; ++s)
+        {
+            Append(block, (float)(sample + s));
+            Append(block, -(float)(sample + s));
+        }
+        blocks.push_back(block);
+        sample += numberOfSamples;
+    }
+
+    vector<char> file;
+    Append(file, (int64_t)sample);
+    Append(file, (int64_t)blocks.size());
+    Append(file, (int32_t)1);
+    Append(file, (int32_t)1);
+    AppendName(file, "features", 10);
+    AppendName(file, "labels", 2);
+    int64_t offset = sizeof(int32_t);
+    for (const auto& block : blocks)
+    {
+        Append(file, offset);
+        offset += block.size();
+    }
+    Append(file, samplesPerBlock.front());
+    for (const auto& block : blocks)
+        file.insert(file.end(), block.begin(), block.end());
+
+    ofstream stream(msra::strfun::utf8(path), ios::binary);
+    stream.write(file.data(), file.size());
+}
+
+BOOST_AUTO_TEST_CASE(LibSVMBinaryDeserializerReadsBlocks)
+{
+    const wstring path = L"LibSVMBinaryDeserializerReadsBlocks.bin";
+    WriteLibSVMBinaryFile(path, vector<int32_t>{ 3, 2 });
+
+    {
+        ConfigParameters config;
+        config.Parse("file=" + msra::strfun::utf8(path) + "\nchunkSizeInBytes=1\nlabels=[rename=y]\n");
+        LibSVMBinaryDeserializer deserializer(make_shared<CorpusDescriptor>(), config, true);
+
+        auto streams = deserializer.GetStreamDescriptions();
+        BOOST_REQUIRE_EQUAL(streams.size(), 2);
+        BOOST_CHECK(streams[0]->m_name == L"features" && streams[0]->m_storageType == StorageType::sparse_csc);
+        BOOST_CHECK_EQUAL(streams[0]->m_sampleLayout->GetNumElements(), 10);
+        BOOST_CHECK(streams[1]->m_name == L"y" && streams[1]->m_storageType == StorageType::dense);
+
+        // one block per chunk
+        auto chunks = deserializer.GetChunkDescriptions();
+        BOOST_REQUIRE_EQUAL(chunks.size(), 2);
+        BOOST_CHECK_EQUAL(chunks[0]->m_numberOfSamples, 3);
+        BOOST_CHECK_EQUAL(chunks[1]->m_numberOfSamples, 2);
+
+        for (ChunkIdType chunkId = 0; chunkId < chunks.size(); ++chunkId)
+        {
+            vector<SequenceDescription> descriptions;
+            deserializer.GetSequencesForChunk(chunkId, descriptions);
+            BOOST_REQUIRE_EQUAL(descriptions.size(), chunks[chunkId]->m_numberOfSequences);
+
+            auto chunk = deserializer.GetChunk(chunkId);
+            for (const auto& description : descriptions)
+            {
+                vector<SequenceDataPtr> data;
+                chunk->GetSequence(description.m_id, data);
+                BOOST_REQUIRE_EQUAL(data.size(), 2);
+
+                auto sparse = static_pointer_cast<SparseSequenceData>(data[0]);
+                BOOST_REQUIRE_EQUAL(sparse->m_totalNnzCount, 1);
+                BOOST_CHECK_EQUAL(sparse->m_indices[0], (IndexType)description.m_id);
+                BOOST_CHECK_EQUAL(((const float*)sparse->GetDataBuffer())[0], description.m_id + 1.0f);
+
+                const float* labels = (const float*)data[1]->GetDataBuffer();
+                BOOST_CHECK_EQUAL(labels[0], (float)description.m_id);
+                BOOST_CHECK_EQUAL(labels[1], -(float)description.m_id);
+
+                SequenceDescription secondary;
+                BOOST_REQUIRE(deserializer.GetSequenceDescription(description, secondary));
+                BOOST_CHECK_EQUAL(secondary.m_chunkId, chunkId);
+            }
+        }
+
+        SequenceDescription beyond = {}, secondary;
+        beyond.m_key.m_sequence = 5;
+        BOOST_CHECK(!deserializer.GetSequenceDescription(beyond, secondary));
+    }
+    _wunlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(LibSVMBinaryDeserializerGroupsBlocksIntoChunks)
+{
+    const wstring path = L"LibSVMBinaryDeserializerGroupsBlocksIntoChunks.bin";
+    WriteLibSVMBinaryFile(path, vector<int32_t>{ 4, 4, 4, 1 });
+
+    {
+        ConfigParameters config;
+        config.Parse("file=" + msra::strfun::utf8(path) + "\n");
+        LibSVMBinaryDeserializer deserializer(make_shared<CorpusDescriptor>(), config, true);
+
+        auto chunks = deserializer.GetChunkDescriptions();
+        BOOST_REQUIRE_EQUAL(chunks.size(), 1);
+        BOOST_CHECK_EQUAL(chunks[0]->m_numberOfSamples, 13);
+
+        vector<SequenceDataPtr> data;
+        deserializer.GetChunk(0)->GetSequence(12, data);
+        BOOST_CHECK_EQUAL(((const float*)data[0]->GetDataBuffer())[0], 13.0f);
+    }
+    _wunlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
@@ -6,12 +6,23 @@
 #include "stdafx.h"
 #include <numeric>
 #include <random>
+#include <thread>
 #include <boost/random/uniform_int_distribution.hpp>
 #include "NoRandomizer.h"
+#include "BucketingSequenceEnumerator.h"
 #include "DataDeserializer.h"
 #include "BlockRandomizer.h"
+#include "ChunkCache.h"
+#include "SharedChunkStore.h"
+#include "SharedMemorySegment.h"
+#include "ChunkImage.h"
+#include "DiskChunkCache.h"
+#include "CompactChunkStore.h"
+#include "WorkerThreadPool.h"
 #include "CorpusDescriptor.h"
 #include "SequentialDeserializer.h"
+#include "ReaderStatistics.h"
+#include "Bundler.h"
 
 using namespace Microsoft::MSR::CNTK;
 using namespace std;
@@ -296,6 +307,99 @@ BOOST_AUTO_TEST_CASE(RandRollbackToSameEpochInBigRandomizationWindow)
 }
 
 
+BOOST_AUTO_TEST_CASE(RandPrefetchDepth)
+{
+    size_t chunkSizeInSamples = 10000;
+    size_t sweepNumberOfSamples = 500000;
+    uint32_t maxSequenceLength = 300;
+    size_t randomizationWindow = chunkSizeInSamples * 3;
+    auto deserializer = make_shared<SequentialDeserializer>(0, chunkSizeInSamples, sweepNumberOfSamples, maxSequenceLength);
+
+    // The baseline, with a single prefetch in flight.
+    auto randomizer = make_shared<BlockRandomizer>(0, randomizationWindow, deserializer, true, BlockRandomizer::DecimationMode::chunk, false);
+    auto firstSweep = ReadFullSweep(randomizer, 0, sweepNumberOfSamples);
+    auto secondSweep = ReadFullSweep(randomizer, 1, sweepNumberOfSamples);
+
+    // Prefetching deeper must not change the data, only how it is loaded.
+    for (bool prefetch : { false, true })
+    {
+        auto deepRandomizer = make_shared<BlockRandomizer>(0, randomizationWindow, deserializer, prefetch, BlockRandomizer::DecimationMode::chunk, false, false, 4);
+        auto current = ReadFullSweep(deepRandomizer, 0, sweepNumberOfSamples);
+        BOOST_CHECK_EQUAL_COLLECTIONS(firstSweep.begin(), firstSweep.end(), current.begin(), current.end());
+        current = ReadFullSweep(deepRandomizer, 1, sweepNumberOfSamples);
+        BOOST_CHECK_EQUAL_COLLECTIONS(secondSweep.begin(), secondSweep.end(), current.begin(), current.end());
+
+        // Every chunk of the two sweeps was loaded once, all but the ones of the first window through a prefetch.
+        const auto& stats = deepRandomizer->GetPrefetchStatistics();
+        size_t numChunks = deserializer->GetChunkDescriptions().size();
+        BOOST_CHECK_EQUAL(stats.m_numPrefetchedChunks + stats.m_numSynchronousLoads, 2 * numChunks);
+        BOOST_CHECK_GT(stats.m_numPrefetchedChunks, numChunks);
+        BOOST_CHECK_LE(stats.m_numBlockedWaits, stats.m_numPrefetchedChunks);
+        if (!prefetch)
+        {
+            // deferred prefetches are only loaded when needed
+            BOOST_CHECK_EQUAL(stats.m_numBlockedWaits, stats.m_numPrefetchedChunks);
+        }
+    }
+
+    BOOST_CHECK_THROW(make_shared<BlockRandomizer>(0, randomizationWindow, deserializer, true, BlockRandomizer::DecimationMode::chunk, false, false, 0), std::invalid_argument);
+}
+
+// Counts the GetChunk() calls that are made at the same time.
+class ConcurrencyCountingDeserializer : public SequentialDeserializer
+{
+public:
+    ConcurrencyCountingDeserializer(bool concurrent, size_t chunkSizeInSamples, size_t sweepNumberOfSamples, uint32_t maxSequenceLength)
+        : SequentialDeserializer(0, chunkSizeInSamples, sweepNumberOfSamples, maxSequenceLength),
+          m_concurrent(concurrent), m_numCalls(0), m_maxCalls(0)
+    {}
+
+    ChunkPtr GetChunk(ChunkIdType chunkId) override
+    {
+        size_t calls = ++m_numCalls;
+        for (size_t max = m_maxCalls; calls > max && !m_maxCalls.compare_exchange_weak(max, calls);)
+            ;
+        auto chunk = SequentialDeserializer::GetChunk(chunkId);
+        --m_numCalls;
+        return chunk;
+    }
+
+    bool SupportsConcurrentGetChunk() const override
+    {
+        return m_concurrent;
+    }
+
+    size_t MaxConcurrentCalls() const
+    {
+        return m_maxCalls;
+    }
+
+private:
+    bool m_concurrent;
+    std::atomic<size_t> m_numCalls;
+    std::atomic<size_t> m_maxCalls;
+};
+
+BOOST_AUTO_TEST_CASE(RandPrefetchConcurrentGetChunk)
+{
+    size_t chunkSizeInSamples = 10000;
+    size_t sweepNumberOfSamples = 500000;
+    size_t randomizationWindow = chunkSizeInSamples * 3;
+
+    // The prefetches load their chunks at the same time only if the deserializer supports it.
+    for (bool concurrent : { false, true })
+    {
+        auto deserializer = make_shared<ConcurrencyCountingDeserializer>(concurrent, chunkSizeInSamples, sweepNumberOfSamples, 300);
+        auto randomizer = make_shared<BlockRandomizer>(0, randomizationWindow, deserializer, true, BlockRandomizer::DecimationMode::chunk, false, false, 4);
+        ReadFullSweep(randomizer, 0, sweepNumberOfSamples);
+        if (concurrent)
+            BOOST_CHECK_GT(deserializer->MaxConcurrentCalls(), 1);
+        else
+            BOOST_CHECK_EQUAL(deserializer->MaxConcurrentCalls(), 1);
+    }
+}
+
+
 BOOST_AUTO_TEST_CASE(BlockRandomizerInstantiate)
 {
     BlockRandomizerInstantiateTest(false);
@@ -536,6 +640,166 @@ BOOST_AUTO_TEST_CASE(BlockRandomizerOneEpochLegacyRandomization)
     BlockRandomizerOneEpochLegacyRandomizationTest(true);
 }
 
+BOOST_AUTO_TEST_CASE(BlockRandomizerSequenceDecimationLoadsOwnChunks)
+{
+    // One sequence per chunk, as with the image reader.
+    vector<float> data(100);
+    iota(data.begin(), data.end(), 0.0f);
+    auto mockDeserializer = make_shared<MockDeserializer>(100, 1, data);
+
+    const size_t numberOfWorkers = 2;
+    vector<float> actual;
+    for (size_t rank = 0; rank < numberOfWorkers; ++rank)
+    {
+        auto randomizer = make_shared<BlockRandomizer>(0, 20, mockDeserializer, false, BlockRandomizer::DecimationMode::sequence, false);
+
+        EpochConfiguration epochConfiguration;
+        epochConfiguration.m_numberOfWorkers = numberOfWorkers;
+        epochConfiguration.m_workerRank = rank;
+        epochConfiguration.m_minibatchSizeInSamples = 0;
+        epochConfiguration.m_totalEpochSizeInSamples = data.size();
+        epochConfiguration.m_epochIndex = 0;
+        randomizer->StartEpoch(epochConfiguration);
+
+        size_t numberOfSequences = 0;
+        Sequences sequences;
+        do
+        {
+            sequences = randomizer->GetNextSequences(10);
+            for (const auto& sequence : sequences.m_data.empty() ? vector<SequenceDataPtr>() : sequences.m_data[0])
+            {
+                actual.push_back(*((float*)sequence->GetDataBuffer()));
+                numberOfSequences++;
+            }
+        } while (!sequences.m_endOfEpoch);
+
+        // Only the chunks of the own sequences were loaded, not the whole windows.
+        BOOST_CHECK_EQUAL(numberOfSequences, data.size() / numberOfWorkers);
+        BOOST_CHECK_EQUAL(randomizer->GetPrefetchStatistics().m_numSynchronousLoads, numberOfSequences);
+    }
+
+    // Together, the workers got every sequence once.
+    sort(actual.begin(), actual.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), actual.begin(), actual.end());
+}
+
+BOOST_AUTO_TEST_CASE(BlockRandomizerSequenceDecimationByWorkerShares)
+{
+    vector<float> data(100);
+    iota(data.begin(), data.end(), 0.0f);
+    auto mockDeserializer = make_shared<MockDeserializer>(100, 1, data);
+
+    const size_t numberOfWorkers = 2;
+    const vector<double> shares = { 0.75, 0.25 };
+    vector<float> actual;
+    for (size_t rank = 0; rank < numberOfWorkers; ++rank)
+    {
+        auto randomizer = make_shared<BlockRandomizer>(0, 20, mockDeserializer, false, BlockRandomizer::DecimationMode::sequence, false);
+
+        EpochConfiguration epochConfiguration;
+        epochConfiguration.m_numberOfWorkers = numberOfWorkers;
+        epochConfiguration.m_workerRank = rank;
+        epochConfiguration.m_minibatchSizeInSamples = 0;
+        epochConfiguration.m_totalEpochSizeInSamples = data.size();
+        epochConfiguration.m_epochIndex = 0;
+        epochConfiguration.m_workerShares = shares;
+        randomizer->StartEpoch(epochConfiguration);
+
+        size_t numberOfMinibatches = 0;
+        Sequences sequences;
+        do
+        {
+            sequences = randomizer->GetNextSequences(8);
+            size_t numberOfSequences = 0;
+            for (const auto& sequence : sequences.m_data.empty() ? vector<SequenceDataPtr>() : sequences.m_data[0])
+            {
+                actual.push_back(*((float*)sequence->GetDataBuffer()));
+                numberOfSequences++;
+            }
+            // (not the last minibatch, of the 4 sequences that are left)
+            if (numberOfMinibatches++ < data.size() / 8)
+                BOOST_CHECK_EQUAL(numberOfSequences, rank == 0 ? 6u : 2u);
+        } while (!sequences.m_endOfEpoch);
+    }
+
+    // Together, the workers got every sequence once.
+    sort(actual.begin(), actual.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), actual.begin(), actual.end());
+
+    // The ranges of the workers follow each other, also when they do not divide evenly.
+    EpochConfiguration config;
+    config.m_numberOfWorkers = 3;
+    config.m_workerShares = { 0.2, 0.5, 0.3 };
+    size_t previousEnd = 0;
+    for (config.m_workerRank = 0; config.m_workerRank < config.m_numberOfWorkers; ++config.m_workerRank)
+    {
+        size_t begin, end;
+        GetWorkerRange(config, 7, begin, end);
+        BOOST_CHECK_EQUAL(begin, previousEnd);
+        BOOST_CHECK_LE(begin, end);
+        previousEnd = end;
+    }
+    BOOST_CHECK_EQUAL(previousEnd, 7u);
+}
+
+BOOST_AUTO_TEST_CASE(BlockRandomizerBalancedSequenceDecimation)
+{
+    const size_t sweepNumberOfSamples = 20000;
+    const uint32_t maxSequenceLength = 100;
+    auto deserializer = make_shared<SequentialDeserializer>(0, 1000, sweepNumberOfSamples, maxSequenceLength);
+
+    const size_t numberOfWorkers = 3;
+    vector<vector<size_t>> minibatchCost(numberOfWorkers); // sum of the padded sequence lengths, per worker and minibatch
+    vector<float> actual;
+    for (size_t rank = 0; rank < numberOfWorkers; ++rank)
+    {
+        auto randomizer = make_shared<BlockRandomizer>(0, 5000, deserializer, false, BlockRandomizer::DecimationMode::balancedSequence, false);
+
+        EpochConfiguration epochConfiguration;
+        epochConfiguration.m_numberOfWorkers = numberOfWorkers;
+        epochConfiguration.m_workerRank = rank;
+        epochConfiguration.m_minibatchSizeInSamples = 0;
+        epochConfiguration.m_totalEpochSizeInSamples = sweepNumberOfSamples;
+        epochConfiguration.m_epochIndex = 0;
+        randomizer->StartEpoch(epochConfiguration);
+
+        Sequences sequences;
+        do
+        {
+            sequences = randomizer->GetNextSequences(1000);
+            size_t numberOfSequences = 0, longest = 0;
+            for (const auto& sequence : sequences.m_data.empty() ? vector<SequenceDataPtr>() : sequences.m_data[0])
+            {
+                const float* values = (const float*)sequence->GetDataBuffer();
+                actual.insert(actual.end(), values, values + sequence->m_numberOfSamples);
+                numberOfSequences++;
+                longest = max(longest, (size_t)sequence->m_numberOfSamples);
+            }
+            minibatchCost[rank].push_back(numberOfSequences * longest);
+        } while (!sequences.m_endOfEpoch);
+    }
+
+    // The workers agree on the minibatches, and the cost of no worker exceeds that of another by more than the longest sequence.
+    for (size_t rank = 1; rank < numberOfWorkers; ++rank)
+        BOOST_REQUIRE_EQUAL(minibatchCost[rank].size(), minibatchCost[0].size());
+    for (size_t i = 0; i < minibatchCost[0].size(); ++i)
+    {
+        size_t least = SIZE_MAX, most = 0;
+        for (size_t rank = 0; rank < numberOfWorkers; ++rank)
+        {
+            least = min(least, minibatchCost[rank][i]);
+            most = max(most, minibatchCost[rank][i]);
+        }
+        BOOST_CHECK_LE(most - least, maxSequenceLength);
+    }
+
+    // Together, the workers got every sample once.
+    vector<float> expected(sweepNumberOfSamples);
+    iota(expected.begin(), expected.end(), 0.0f);
+    sort(actual.begin(), actual.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+}
+
 BOOST_AUTO_TEST_CASE(NoRandomizerOneEpoch)
 {
     vector<float> data(10);
@@ -573,6 +837,508 @@ BOOST_AUTO_TEST_CASE(NoRandomizerOneEpoch)
                                   actual.begin(), actual.end());
 }
 
+BOOST_AUTO_TEST_CASE(BundlerJoinsIdenticalChunksByPosition)
+{
+    vector<float> features(12), labels(12);
+    iota(features.begin(), features.end(), 0.0f);
+    iota(labels.begin(), labels.end(), 100.0f);
+    auto driver = make_shared<MockDeserializer>(3, 4, features);
+    auto secondary = make_shared<MockDeserializer>(3, 4, labels);
+
+    // The mock deserializers cannot look up sequences by key, so the sequences have to be joined by position.
+    ConfigParameters config;
+    Bundler bundler(config, driver, { driver, secondary }, /*cleanse =*/ true);
+
+    auto chunks = bundler.GetChunkDescriptions();
+    BOOST_REQUIRE_EQUAL(chunks.size(), 3);
+    for (const auto& chunk : chunks)
+    {
+        BOOST_CHECK_EQUAL(chunk->m_numberOfSequences, 4);
+
+        vector<SequenceDescription> sequences;
+        bundler.GetSequencesForChunk(chunk->m_id, sequences);
+        BOOST_REQUIRE_EQUAL(sequences.size(), 4);
+
+        auto bundled = bundler.GetChunk(chunk->m_id);
+        for (const auto& sequence : sequences)
+        {
+            vector<SequenceDataPtr> data;
+            bundled->GetSequence(sequence.m_id, data);
+            BOOST_REQUIRE_EQUAL(data.size(), 2);
+            float feature = *(const float*)data[0]->GetDataBuffer();
+            BOOST_CHECK_EQUAL(feature, (float)(chunk->m_id * 4 + sequence.m_id));
+            BOOST_CHECK_EQUAL(*(const float*)data[1]->GetDataBuffer(), feature + 100);
+        }
+    }
+}
+
+// Reads an epoch in minibatches of the given number of samples, returns the samples
+// and the padding of the minibatches had the sequences been laid out one per parallel sequence.
+static vector<float> ReadPaddedEpoch(SequenceEnumeratorPtr enumerator, size_t epochSize, size_t minibatchSize, size_t& padding)
+{
+    EpochConfiguration config;
+    config.m_numberOfWorkers = 1;
+    config.m_workerRank = 0;
+    config.m_minibatchSizeInSamples = minibatchSize;
+    config.m_totalEpochSizeInSamples = epochSize;
+    config.m_epochIndex = 0;
+    enumerator->StartEpoch(config);
+
+    padding = 0;
+    vector<float> epoch;
+    for (;;)
+    {
+        auto sequences = enumerator->GetNextSequences(minibatchSize);
+        if (!sequences.m_data.empty())
+        {
+            size_t samples = 0, maxLength = 0;
+            for (const auto& s : sequences.m_data[0])
+            {
+                const float* values = (const float*)s->GetDataBuffer();
+                epoch.insert(epoch.end(), values, values + s->m_numberOfSamples);
+                samples += s->m_numberOfSamples;
+                maxLength = max(maxLength, (size_t)s->m_numberOfSamples);
+            }
+            BOOST_CHECK(samples <= minibatchSize || sequences.m_data[0].size() == 1);
+            padding += maxLength * sequences.m_data[0].size() - samples;
+        }
+        if (sequences.m_endOfEpoch)
+            break;
+    }
+    return epoch;
+}
+
+BOOST_AUTO_TEST_CASE(BucketingSequenceEnumeratorGroupsByLength)
+{
+    const size_t sweepNumberOfSamples = 5000;
+    auto deserializer = make_shared<SequentialDeserializer>(0, 100, sweepNumberOfSamples, 30);
+
+    size_t padding = 0, bucketedPadding = 0;
+    auto data = ReadPaddedEpoch(make_shared<NoRandomizer>(deserializer), sweepNumberOfSamples, 100, padding);
+    auto bucketed = ReadPaddedEpoch(
+        make_shared<BucketingSequenceEnumerator>(make_shared<NoRandomizer>(deserializer), 200),
+        sweepNumberOfSamples, 100, bucketedPadding);
+
+    // The same samples come out, in a different order and with less padding.
+    BOOST_CHECK(bucketed != data);
+    sort(bucketed.begin(), bucketed.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(bucketed.begin(), bucketed.end(), data.begin(), data.end());
+    BOOST_CHECK_LT(bucketedPadding * 2, padding);
+}
+
+BOOST_AUTO_TEST_CASE(WorkerThreadPoolParallelFor)
+{
+    auto pool = make_shared<WorkerThreadPool>(4);
+    BOOST_CHECK_EQUAL(pool->NumThreads(), 4u);
+
+    // Every item is run exactly once, also when the pool is reused.
+    vector<atomic<int>> counts(1000);
+    for (int round = 0; round < 20; ++round)
+        pool->ParallelFor(counts.size(), [&counts](size_t i) { counts[i]++; });
+    for (const auto& c : counts)
+        BOOST_CHECK_EQUAL(c.load(), 20);
+
+    // An exception of any item is rethrown on the calling thread, and the pool stays usable.
+    BOOST_CHECK_THROW(pool->ParallelFor(100, [](size_t i) { if (i == 42) RuntimeError("item %d", (int)i); }), std::runtime_error);
+    atomic<size_t> sum(0);
+    pool->ParallelFor(100, [&sum](size_t i) { sum += i; });
+    BOOST_CHECK_EQUAL(sum.load(), 4950u);
+
+    // Items that take very different times are balanced out by stealing, every one still runs once.
+    vector<atomic<int>> uneven(37);
+    pool->ParallelFor(uneven.size(), [&uneven](size_t i)
+    {
+        if (i < 9)
+            this_thread::sleep_for(chrono::milliseconds(20));
+        uneven[i]++;
+    });
+    for (const auto& c : uneven)
+        BOOST_CHECK_EQUAL(c.load(), 1);
+
+    // A randomizer using the pool returns the sequences in order.
+    vector<float> data(10);
+    iota(data.begin(), data.end(), 0.0f);
+    auto mockDeserializer = make_shared<MockDeserializer>(5, 2, data);
+    auto randomizer = make_shared<NoRandomizer>(mockDeserializer, true);
+    randomizer->SetWorkerThreadPool(pool);
+
+    EpochConfiguration epochConfiguration;
+    epochConfiguration.m_numberOfWorkers = 1;
+    epochConfiguration.m_workerRank = 0;
+    epochConfiguration.m_minibatchSizeInSamples = 0;
+    epochConfiguration.m_totalEpochSizeInSamples = data.size();
+    epochConfiguration.m_epochIndex = 0;
+    randomizer->StartEpoch(epochConfiguration);
+
+    Sequences sequences = randomizer->GetNextSequences(data.size());
+    BOOST_REQUIRE_EQUAL(sequences.m_data.size(), 1u);
+    vector<float> actual;
+    for (const auto& s : sequences.m_data[0])
+        actual.push_back(*((float*)reinterpret_cast<DenseSequenceData&>(*s).GetDataBuffer()));
+    BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), actual.begin(), actual.end());
+}
+
+BOOST_AUTO_TEST_CASE(WorkerThreadPoolOnNumaNode)
+{
+    // Every node has cores, and every core is on a single node.
+    NumaTopology topology;
+    BOOST_REQUIRE_GE(topology.NumNodes(), 1u);
+    set<size_t> cores;
+    for (size_t node = 0; node < topology.NumNodes(); ++node)
+    {
+        BOOST_REQUIRE(!topology.Cores(node).empty());
+        for (size_t core : topology.Cores(node))
+            BOOST_CHECK(cores.insert(core).second);
+    }
+
+    // By default a pool on a node has a thread per core of it.
+    WorkerThreadPool pool(0, topology.Cores(0));
+    BOOST_CHECK_EQUAL(pool.NumThreads(), topology.Cores(0).size());
+    atomic<size_t> sum(0);
+    pool.ParallelFor(100, [&sum](size_t i) { sum += i; });
+    BOOST_CHECK_EQUAL(sum.load(), 4950u);
+
+    BOOST_CHECK_THROW(WorkerThreadPool(2, vector<size_t>()), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(SharedWorkerThreadPool)
+{
+    // Users asking for the same threads get the same pool, as long as one of them holds it.
+    auto pool = WorkerThreadPool::GetShared(3);
+    BOOST_CHECK_EQUAL(pool->NumThreads(), 3u);
+    BOOST_CHECK(WorkerThreadPool::GetShared(3, -1) == pool);
+    BOOST_CHECK(WorkerThreadPool::GetShared(2) != pool);
+
+    // A loop started from within a loop of the pool runs on the calling thread instead of waiting for the outer one.
+    atomic<size_t> sum(0);
+    pool->ParallelFor(10, [&](size_t i)
+    {
+        pool->ParallelFor(10, [&](size_t j) { sum += i * 10 + j; });
+    });
+    BOOST_CHECK_EQUAL(sum.load(), 4950u);
+
+    weak_ptr<WorkerThreadPool> released = pool;
+    pool.reset();
+    BOOST_CHECK(released.expired());
+}
+
+BOOST_AUTO_TEST_CASE(ReaderStatisticsStageTimers)
+{
+    // Without a collector the timers do nothing.
+    {
+        ReaderStageTimer timer(ReaderStage::pack);
+    }
+
+    ReaderStatisticsCollector collector;
+    vector<float> data(10);
+    iota(data.begin(), data.end(), 0.0f);
+    auto randomizer = make_shared<NoRandomizer>(make_shared<MockDeserializer>(5, 2, data));
+
+    EpochConfiguration epochConfiguration;
+    epochConfiguration.m_numberOfWorkers = 1;
+    epochConfiguration.m_workerRank = 0;
+    epochConfiguration.m_minibatchSizeInSamples = 0;
+    epochConfiguration.m_totalEpochSizeInSamples = data.size();
+    epochConfiguration.m_epochIndex = 0;
+    randomizer->StartEpoch(epochConfiguration);
+
+    double packSeconds;
+    {
+        ReaderStatisticsScope scope(&collector);
+        Timer timer;
+        timer.Start();
+        {
+            // The time of the nested stages is not counted for the outer one.
+            ReaderStageTimer packTimer(ReaderStage::pack);
+            this_thread::sleep_for(chrono::milliseconds(20));
+            randomizer->GetNextSequences(data.size());
+        }
+        timer.Stop();
+        packSeconds = timer.ElapsedSeconds();
+        collector.AddMinibatch(10, 40);
+        collector.AddWait(0.5, 2);
+        collector.AddWait(0.25, 0);
+    }
+    BOOST_CHECK(ReaderStatisticsCollector::Current() == nullptr);
+
+    ReaderStatistics statistics = collector.GetAndReset();
+    double nestedSeconds = statistics.m_stageSeconds[(size_t)ReaderStage::randomize] + statistics.m_stageSeconds[(size_t)ReaderStage::deserialize];
+    BOOST_CHECK_GE(statistics.m_stageSeconds[(size_t)ReaderStage::pack], 0.015);
+    BOOST_CHECK_LE(statistics.m_stageSeconds[(size_t)ReaderStage::pack] + nestedSeconds, packSeconds + 1e-6);
+    BOOST_CHECK_EQUAL(statistics.m_stageSeconds[(size_t)ReaderStage::transform], 0.0);
+    BOOST_CHECK_EQUAL(statistics.m_minibatches, 1u);
+    BOOST_CHECK_EQUAL(statistics.m_samples, 10u);
+    BOOST_CHECK_EQUAL(statistics.m_bytes, 40u);
+    BOOST_CHECK_CLOSE(statistics.m_waitSeconds, 0.75, 1e-9);
+    vector<size_t> expectedOccupancy = { 1, 0, 1 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(statistics.m_prefetchOccupancy.begin(), statistics.m_prefetchOccupancy.end(), expectedOccupancy.begin(), expectedOccupancy.end());
+
+    // The statistics start over after they have been taken.
+    statistics = collector.GetAndReset();
+    BOOST_CHECK_EQUAL(statistics.m_minibatches, 0u);
+    BOOST_CHECK(statistics.m_prefetchOccupancy.empty());
+}
+
+BOOST_AUTO_TEST_CASE(ChunkCacheMemoryBudget)
+{
+    auto deserializer = make_shared<SequentialDeserializer>(0, 1000, 20000, 100);
+    const auto& chunks = deserializer->Chunks();
+    auto chunkSize = [&](size_t i) { return chunks[i]->SizeInSamples() * sizeof(float); };
+
+    // All but the last chunk have 1001 to 1100 samples, so the budget takes exactly three of them.
+    size_t maxChunkSize = 0;
+    for (size_t i = 0; i < chunks.size(); ++i)
+        maxChunkSize = max(maxChunkSize, chunkSize(i));
+    size_t budget = 3 * maxChunkSize;
+
+    ChunkCache cache(deserializer, budget);
+    cache.GetChunk(0);
+    cache.GetChunk(1);
+    cache.GetChunk(2);
+    BOOST_CHECK_EQUAL(cache.GetStatistics().m_numMisses, 3);
+    BOOST_CHECK_EQUAL(cache.GetStatistics().m_numEvictions, 0);
+    BOOST_CHECK_EQUAL(cache.GetStatistics().m_sizeInBytes, chunkSize(0) + chunkSize(1) + chunkSize(2));
+
+    // 0 becomes the most recently used chunk, so 1 is evicted for 3.
+    cache.GetChunk(0);
+    BOOST_CHECK_EQUAL(cache.GetStatistics().m_numHits, 1);
+    cache.GetChunk(3);
+    BOOST_CHECK_EQUAL(cache.GetStatistics().m_numEvictions, 1);
+    BOOST_CHECK_EQUAL(cache.GetStatistics().m_evictedBytes, chunkSize(1));
+    cache.GetChunk(0);
+    cache.GetChunk(2);
+    BOOST_CHECK_EQUAL(cache.GetStatistics().m_numHits, 3);
+    cache.GetChunk(1);
+    BOOST_CHECK_EQUAL(cache.GetStatistics().m_numMisses, 5);
+    BOOST_CHECK_EQUAL(cache.GetStatistics().m_sizeInBytes, chunkSize(0) + chunkSize(1) + chunkSize(2));
+
+    // Chunks still in use are not evicted, even if that exceeds the budget.
+    {
+        vector<ChunkPtr> inUse;
+        for (ChunkIdType i = 4; i < 9; ++i)
+            inUse.push_back(cache.GetChunk(i));
+        size_t inUseSize = 0;
+        for (size_t i = 4; i < 9; ++i)
+            inUseSize += chunkSize(i);
+        BOOST_CHECK_EQUAL(cache.GetStatistics().m_sizeInBytes, inUseSize);
+    }
+    cache.GetChunk(9);
+    BOOST_CHECK_LE(cache.GetStatistics().m_sizeInBytes, budget);
+    BOOST_CHECK_EQUAL(cache.GetStatistics().m_numHits + cache.GetStatistics().m_numMisses, 14);
+
+    // Reading through a cache that is smaller than the randomization window gives the same data.
+    size_t sweepNumberOfSamples = 20000;
+    size_t randomizationWindow = 3000;
+    auto randomizer = make_shared<BlockRandomizer>(0, randomizationWindow, deserializer, true, BlockRandomizer::DecimationMode::chunk, false);
+    auto cachedRandomizer = make_shared<BlockRandomizer>(0, randomizationWindow, make_shared<ChunkCache>(deserializer, 2 * maxChunkSize), true, BlockRandomizer::DecimationMode::chunk, false);
+    for (size_t sweep = 0; sweep < 2; ++sweep)
+    {
+        auto expected = ReadFullSweep(randomizer, sweep, sweepNumberOfSamples);
+        auto actual = ReadFullSweep(cachedRandomizer, sweep, sweepNumberOfSamples);
+        BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ChunkCacheSharedByReaders)
+{
+    auto deserializer = make_shared<SequentialDeserializer>(0, 1000, 10000, 100);
+    auto otherDeserializer = make_shared<SequentialDeserializer>(0, 1000, 10000, 100);
+    size_t numChunks = deserializer->Chunks().size();
+
+    // The readers that give the same name get the cache of the first one, and read the chunks of its deserializer.
+    auto cache = ChunkCache::GetShared("ChunkCacheSharedByReaders", deserializer);
+    BOOST_CHECK(ChunkCache::GetShared("ChunkCacheSharedByReaders", otherDeserializer) == cache);
+    BOOST_CHECK(ChunkCache::GetShared("ChunkCacheSharedByOtherReaders", otherDeserializer) != cache);
+
+    // Readers on threads of their own read the same data as without the cache, and each chunk is loaded once.
+    size_t sweepNumberOfSamples = 10000;
+    size_t randomizationWindow = 3000;
+    auto randomizer = make_shared<BlockRandomizer>(0, randomizationWindow, deserializer, true, BlockRandomizer::DecimationMode::chunk, false);
+    auto expected = ReadFullSweep(randomizer, 0, sweepNumberOfSamples);
+
+    vector<vector<float>> actual(4);
+    vector<exception_ptr> errors(actual.size());
+    vector<thread> threads;
+    for (size_t i = 0; i < actual.size(); ++i)
+    {
+        threads.push_back(thread([&, i]()
+        {
+            try
+            {
+                auto sharedCache = ChunkCache::GetShared("ChunkCacheSharedByReaders", otherDeserializer);
+                auto cachedRandomizer = make_shared<BlockRandomizer>(0, randomizationWindow, sharedCache, true, BlockRandomizer::DecimationMode::chunk, false);
+                actual[i] = ReadFullSweep(cachedRandomizer, 0, sweepNumberOfSamples);
+            }
+            catch (...)
+            {
+                errors[i] = current_exception();
+            }
+        }));
+    }
+    for (auto& t : threads)
+        t.join();
+
+    for (size_t i = 0; i < actual.size(); ++i)
+    {
+        BOOST_REQUIRE(!errors[i]);
+        BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual[i].begin(), actual[i].end());
+    }
+    BOOST_CHECK_EQUAL(cache->GetStatistics().m_numMisses, numChunks);
+    BOOST_CHECK_EQUAL(cache->GetStatistics().m_numEvictions, 0);
+}
+
+BOOST_AUTO_TEST_CASE(SharedChunkStoreSharesChunks)
+{
+    auto deserializer = make_shared<SequentialDeserializer>(0, 1000, 10000, 100);
+    const auto& chunks = deserializer->Chunks();
+    auto readChunk = [&](const ChunkPtr& chunk, ChunkIdType chunkId)
+    {
+        vector<float> values;
+        for (size_t i = 0; i < chunks[chunkId]->SizeInSequences(); ++i)
+        {
+            vector<SequenceDataPtr> data;
+            chunk->GetSequence(i, data);
+            BOOST_REQUIRE_EQUAL(data.size(), 1);
+            BOOST_REQUIRE_EQUAL(data[0]->m_sampleLayout->GetNumElements(), 1);
+            const float* p = (const float*)data[0]->GetDataBuffer();
+            values.insert(values.end(), p, p + data[0]->m_numberOfSamples);
+        }
+        return values;
+    };
+    auto expectedChunk = [&](ChunkIdType chunkId)
+    {
+        vector<float> values;
+        for (const auto& sequence : chunks[chunkId]->m_data)
+            values.insert(values.end(), sequence.begin(), sequence.end());
+        return values;
+    };
+
+    // Two stores of the same name stand for the readers of two processes.
+    const string name = "test-" + to_string(chrono::steady_clock::now().time_since_epoch().count());
+    SharedChunkStore first(deserializer, name);
+    SharedChunkStore second(deserializer, name);
+
+    auto loaded = first.GetChunk(0);
+    auto attached = second.GetChunk(0);
+    BOOST_CHECK_EQUAL(first.GetStatistics().m_numLoaded, 1);
+    BOOST_CHECK_EQUAL(second.GetStatistics().m_numAttached, 1);
+    BOOST_CHECK_EQUAL(second.GetStatistics().m_numLoaded, 0);
+    auto expected = expectedChunk(0);
+    auto actual = readChunk(attached, 0);
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+    actual = readChunk(loaded, 0);
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+
+    // Once the loading store releases the chunk, the others keep their mapping but load the chunk again.
+    loaded.reset();
+    actual = readChunk(attached, 0);
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+    attached.reset();
+    second.GetChunk(0);
+    BOOST_CHECK_EQUAL(second.GetStatistics().m_numLoaded, 1);
+    BOOST_CHECK_EQUAL(first.GetStatistics().m_numFailed + second.GetStatistics().m_numFailed, 0);
+
+#ifndef _WIN32
+    // A segment of another process that does not hold its owner lock (any more) is loaded again.
+    {
+        unique_ptr<SharedMemorySegment> leftBehind;
+        WriteChunkImage(*deserializer, 1, GetCurrentProcessId() + 1, [&](size_t size)
+        {
+            leftBehind = SharedMemorySegment::Create("cntk-chunks-" + name + "-1", size);
+            return leftBehind ? leftBehind->Data() : nullptr;
+        });
+        BOOST_REQUIRE(leftBehind);
+        auto reloaded = first.GetChunk(1);
+        BOOST_CHECK_EQUAL(first.GetStatistics().m_numLoaded, 2);
+        BOOST_CHECK_EQUAL(first.GetStatistics().m_numAttached, 0);
+        expected = expectedChunk(1);
+        actual = readChunk(reloaded, 1);
+        BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+    }
+#endif
+
+    // Reading through the stores gives the same data.
+    size_t sweepNumberOfSamples = 10000;
+    auto randomizer = make_shared<BlockRandomizer>(0, 3000, deserializer, true, BlockRandomizer::DecimationMode::chunk, false);
+    auto sharedRandomizer = make_shared<BlockRandomizer>(0, 3000, make_shared<SharedChunkStore>(deserializer, name), true, BlockRandomizer::DecimationMode::chunk, false);
+    auto expectedSweep = ReadFullSweep(randomizer, 0, sweepNumberOfSamples);
+    auto actualSweep = ReadFullSweep(sharedRandomizer, 0, sweepNumberOfSamples);
+    BOOST_CHECK_EQUAL_COLLECTIONS(expectedSweep.begin(), expectedSweep.end(), actualSweep.begin(), actualSweep.end());
+}
+
+BOOST_AUTO_TEST_CASE(DiskChunkCacheReadsChunksFromFiles)
+{
+    auto deserializer = make_shared<SequentialDeserializer>(0, 1000, 10000, 100);
+    const size_t numberOfChunks = deserializer->Chunks().size();
+    const wstring directory = L"DiskChunkCache-" + to_wstring(chrono::steady_clock::now().time_since_epoch().count());
+    const size_t sweepNumberOfSamples = 10000;
+    auto randomizer = make_shared<BlockRandomizer>(0, 3000, deserializer, true, BlockRandomizer::DecimationMode::chunk, false);
+    auto expectedSweep = ReadFullSweep(randomizer, 0, sweepNumberOfSamples);
+
+    // The first cache writes the files, which a second one (e.g. of a later run) reads.
+    for (int run = 0; run < 2; ++run)
+    {
+        auto cache = make_shared<DiskChunkCache>(deserializer, directory, "test");
+        auto cachedRandomizer = make_shared<BlockRandomizer>(0, 3000, cache, true, BlockRandomizer::DecimationMode::chunk, false);
+        auto actualSweep = ReadFullSweep(cachedRandomizer, 0, sweepNumberOfSamples);
+        BOOST_CHECK_EQUAL_COLLECTIONS(expectedSweep.begin(), expectedSweep.end(), actualSweep.begin(), actualSweep.end());
+        BOOST_CHECK_EQUAL(cache->GetStatistics().m_numWritten, run == 0 ? numberOfChunks : 0);
+        BOOST_CHECK_EQUAL(cache->GetStatistics().m_numHits, run == 0 ? 0 : numberOfChunks);
+        BOOST_CHECK_EQUAL(cache->GetStatistics().m_numFailed, 0);
+    }
+
+    // Over the limit, the least recently used files that are not in use go.
+    {
+        DiskChunkCache cache(deserializer, directory, "test", 1);
+        auto inUse = cache.GetChunk(0);
+        for (ChunkIdType chunkId = 1; chunkId < numberOfChunks; ++chunkId)
+            cache.GetChunk(chunkId);
+        BOOST_CHECK_EQUAL(cache.GetStatistics().m_numEvictions, numberOfChunks - 2);
+        BOOST_CHECK(fexists(directory + L"/test-0.chunk"));
+        BOOST_CHECK(!fexists(directory + L"/test-1.chunk"));
+        BOOST_CHECK(fexists(directory + L"/test-" + to_wstring(numberOfChunks - 1) + L".chunk"));
+    }
+
+    for (ChunkIdType chunkId = 0; chunkId < numberOfChunks; ++chunkId)
+        _wunlink((directory + L"/test-" + to_wstring(chunkId) + L".chunk").c_str());
+}
+
+BOOST_AUTO_TEST_CASE(CompactChunkStoreKeepsValuesWithinTheirPrecision)
+{
+    auto deserializer = make_shared<SequentialDeserializer>(0, 1000, 10000, 100);
+    for (auto encoding : { CompactChunkStore::Encoding::half, CompactChunkStore::Encoding::byte })
+    {
+        CompactChunkStore store(deserializer, encoding);
+        for (ChunkIdType chunkId = 0; chunkId < deserializer->Chunks().size(); ++chunkId)
+        {
+            auto compact = store.GetChunk(chunkId);
+            auto original = deserializer->GetChunk(chunkId);
+            vector<SequenceDescription> sequences;
+            deserializer->GetSequencesForChunk(chunkId, sequences);
+            for (const auto& sequence : sequences)
+            {
+                vector<SequenceDataPtr> actual, expected;
+                compact->GetSequence(sequence.m_id, actual);
+                original->GetSequence(sequence.m_id, expected);
+                BOOST_REQUIRE_EQUAL(actual.size(), 1);
+                BOOST_REQUIRE_EQUAL(actual[0]->m_numberOfSamples, expected[0]->m_numberOfSamples);
+                BOOST_CHECK(actual[0]->m_elementType == ElementType::tfloat);
+
+                const float* a = (const float*)actual[0]->GetDataBuffer();
+                const float* e = (const float*)expected[0]->GetDataBuffer();
+                const size_t n = expected[0]->m_numberOfSamples;
+                const float range = *max_element(e, e + n) - *min_element(e, e + n);
+                for (size_t i = 0; i < n; ++i)
+                {
+                    // (byte: plus the rounding of minimum + code * step in float)
+                    float tolerance = encoding == CompactChunkStore::Encoding::half ? fabs(e[i]) / 2048 : range / 510 * 1.001f + fabs(e[i]) * 4 * numeric_limits<float>::epsilon();
+                    BOOST_CHECK_SMALL(a[i] - e[i], tolerance + 1e-6f);
+                }
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(DefaultCorpusDescriptor)
 {
     const int seed = 13;
@@ -605,6 +1371,47 @@ BOOST_AUTO_TEST_CASE(CorpusDescriptorFromFile)
     remove("test.tmp");
 }
 
+BOOST_AUTO_TEST_CASE(StringToIdMapInternsAndMapsFromFile)
+{
+    const size_t numberOfKeys = 10000;
+    StringToIdMap registry;
+    for (size_t i = 0; i < numberOfKeys; ++i)
+        BOOST_REQUIRE_EQUAL(registry["key" + to_string(i)], i);
+    BOOST_CHECK_EQUAL(registry[""], numberOfKeys);
+    BOOST_CHECK_EQUAL(registry["key17"], 17);
+    BOOST_CHECK_EQUAL(registry.Size(), numberOfKeys + 1);
+    BOOST_CHECK(!registry.Contains("key" + to_string(numberOfKeys)));
+    BOOST_CHECK_EQUAL(registry[(size_t)1234], "key1234");
+
+    registry.Save(L"StringToIdMap.tmp");
+    {
+        StringToIdMap mapped;
+        BOOST_REQUIRE(mapped.TryLoad(L"StringToIdMap.tmp"));
+        BOOST_CHECK_EQUAL(mapped.Size(), numberOfKeys + 1);
+        size_t id;
+        for (size_t i = 0; i < numberOfKeys; ++i)
+        {
+            BOOST_REQUIRE(mapped.TryGet("key" + to_string(i), id));
+            BOOST_REQUIRE_EQUAL(id, i);
+        }
+        BOOST_CHECK_EQUAL(mapped[(size_t)numberOfKeys], "");
+
+        // new keys go after those of the file
+        BOOST_CHECK_EQUAL(mapped["new"], numberOfKeys + 1);
+        BOOST_CHECK_EQUAL(mapped["key5"], 5);
+        BOOST_CHECK_EQUAL(mapped[(size_t)numberOfKeys + 1], "new");
+        BOOST_CHECK_THROW(mapped.TryLoad(L"StringToIdMap.tmp"), std::exception);
+
+        // a file of the other kind of strings is not taken
+        WStringToIdMap wide;
+        BOOST_CHECK(!wide.TryLoad(L"StringToIdMap.tmp"));
+    }
+    remove("StringToIdMap.tmp");
+
+    StringToIdMap missing;
+    BOOST_CHECK(!missing.TryLoad(L"StringToIdMap.missing"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } } } }
@@ -31,7 +31,7 @@ namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
     class SequentialDeserializer : public IDataDeserializer
     {
     public:
-        struct SequentialChunk : Chunk
+        struct SequentialChunk : Chunk, std::enable_shared_from_this<SequentialChunk>
         {
             std::vector<std::vector<float>> m_data;
             size_t m_sizeInSamples;
@@ -73,6 +73,7 @@ namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
                 s->m_data = (void*)&data[0];
                 s->m_numberOfSamples = (uint32_t)data.size();
                 s->m_sampleLayout = m_sampleLayout;
+                s->m_chunk = shared_from_this();
                 result.push_back(s);
             }
         };
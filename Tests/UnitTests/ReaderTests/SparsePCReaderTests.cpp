@@ -0,0 +1,140 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "SparsePCDeserializer.h"
+
+using namespace Microsoft::MSR::CNTK;
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(SparsePCReaderTests)
+
+template <class T>
+static void Append(vector<char>& buffer, const T& value)
+{
+    buffer.insert(buffer.end(), (const char*)&value, (const char*)&value + sizeof(value));
+}
+
+static const int32_t c_verificationCode = 0x1234;
+
+// Record r has the query value r at row r, the document values -r at rows 0 and r + 1, and the label r,
+// the layout the SparsePCReader reads.
+static void WriteSparsePCFile(const wstring& path, int32_t numberOfRecords)
+{
+    vector<char> file;
+    for (int32_t r = 0; r < numberOfRecords; ++r)
+    {
+        Append(file, (int32_t)1);
+        Append(file, (float)r);
+        Append(file, r);
+        Append(file, (int32_t)2);
+        Append(file, -(float)r);
+        Append(file, -(float)r);
+        Append(file, (int32_t)0);
+        Append(file, r + 1);
+        Append(file, (float)r);
+        Append(file, c_verificationCode);
+    }
+
+    ofstream stream(msra::strfun::utf8(path), ios::binary);
+    stream.write(file.data(), file.size());
+}
+
+static string SparsePCConfig(const wstring& path, size_t microbatchSize)
+{
+    // the default order of the streams is query, doc
+    return "file=" + msra::strfun::utf8(path) + "\nmicrobatchSize=" + to_string(microbatchSize) +
+           "\nverificationCode=" + to_string(c_verificationCode) + "\nchunkSizeInBytes=100\ncacheIndex=true\n" +
+           "input=[\nquery=[dim=10]\ndoc=[dim=10]\n]\n";
+}
+
+BOOST_AUTO_TEST_CASE(SparsePCDeserializerReadsRecords)
+{
+    const wstring path = L"SparsePCDeserializerReadsRecords.bin";
+    WriteSparsePCFile(path, 5);
+
+    // the second time from the index cache
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        ConfigParameters config;
+        config.Parse(SparsePCConfig(path, 1));
+        SparsePCDeserializer deserializer(make_shared<CorpusDescriptor>(), config, true);
+
+        auto streams = deserializer.GetStreamDescriptions();
+        BOOST_REQUIRE_EQUAL(streams.size(), 3);
+        BOOST_CHECK(streams[0]->m_name == L"query" && streams[1]->m_name == L"doc" && streams[2]->m_name == L"labels");
+        BOOST_CHECK(streams[2]->m_storageType == StorageType::dense);
+
+        // records of 40 bytes
+        auto chunks = deserializer.GetChunkDescriptions();
+        BOOST_REQUIRE_EQUAL(chunks.size(), 2);
+        BOOST_CHECK_EQUAL(chunks[0]->m_numberOfSequences, 3);
+        BOOST_CHECK_EQUAL(chunks[1]->m_numberOfSequences, 2);
+
+        vector<SequenceDataPtr> data;
+        deserializer.GetChunk(1)->GetSequence(4, data);
+        BOOST_REQUIRE_EQUAL(data.size(), 3);
+        auto query = static_pointer_cast<SparseSequenceData>(data[0]);
+        auto doc = static_pointer_cast<SparseSequenceData>(data[1]);
+        BOOST_REQUIRE_EQUAL(query->m_totalNnzCount, 1);
+        BOOST_CHECK_EQUAL(query->m_indices[0], 4);
+        BOOST_CHECK_EQUAL(((const float*)query->GetDataBuffer())[0], 4.0f);
+        BOOST_REQUIRE_EQUAL(doc->m_totalNnzCount, 2);
+        BOOST_CHECK_EQUAL(doc->m_indices[1], 5);
+        BOOST_CHECK_EQUAL(((const float*)doc->GetDataBuffer())[1], -4.0f);
+        BOOST_CHECK_EQUAL(((const float*)data[2]->GetDataBuffer())[0], 4.0f);
+    }
+    _wunlink(path.c_str());
+    _wunlink((path + L".index").c_str());
+}
+
+BOOST_AUTO_TEST_CASE(SparsePCDeserializerGroupsMicrobatches)
+{
+    const wstring path = L"SparsePCDeserializerGroupsMicrobatches.bin";
+    WriteSparsePCFile(path, 5);
+
+    {
+        ConfigParameters config;
+        config.Parse(SparsePCConfig(path, 2) + "featureOrder=query:doc\n");
+        SparsePCDeserializer deserializer(make_shared<CorpusDescriptor>(), config, true);
+
+        // the partial microbatch at the end is dropped
+        vector<SequenceDescription> descriptions;
+        for (const auto& chunk : deserializer.GetChunkDescriptions())
+            deserializer.GetSequencesForChunk(chunk->m_id, descriptions);
+        BOOST_REQUIRE_EQUAL(descriptions.size(), 2);
+        BOOST_CHECK_EQUAL(descriptions[1].m_numberOfSamples, 2);
+
+        vector<SequenceDataPtr> data;
+        deserializer.GetChunk(descriptions[1].m_chunkId)->GetSequence(1, data);
+        auto doc = static_pointer_cast<SparseSequenceData>(data[1]);
+        BOOST_REQUIRE_EQUAL(doc->m_nnzCounts.size(), 2);
+        BOOST_REQUIRE_EQUAL(doc->m_totalNnzCount, 4);
+        BOOST_CHECK_EQUAL(doc->m_indices[3], 4); // record 3
+        BOOST_CHECK_EQUAL(((const float*)doc->GetDataBuffer())[2], -3.0f);
+        const float* labels = (const float*)data[2]->GetDataBuffer();
+        BOOST_CHECK(labels[0] == 2.0f && labels[1] == 3.0f);
+    }
+    _wunlink(path.c_str());
+    _wunlink((path + L".index").c_str());
+}
+
+BOOST_AUTO_TEST_CASE(SparsePCDeserializerChecksVerificationCodes)
+{
+    const wstring path = L"SparsePCDeserializerChecksVerificationCodes.bin";
+    WriteSparsePCFile(path, 2);
+
+    ConfigParameters config;
+    config.Parse("file=" + msra::strfun::utf8(path) + "\nverificationCode=99\ninput=[\nquery=[dim=10]\ndoc=[dim=10]\n]\n");
+    BOOST_CHECK_THROW(SparsePCDeserializer(make_shared<CorpusDescriptor>(), config, true), std::exception);
+
+    _wunlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
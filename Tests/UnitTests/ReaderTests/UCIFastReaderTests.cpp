@@ -0,0 +1,114 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "UCIDeserializer.h"
+
+using namespace Microsoft::MSR::CNTK;
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(UCIFastReaderTests)
+
+static void WriteTextFile(const wstring& path, const string& text)
+{
+    ofstream stream(msra::strfun::utf8(path), ios::binary);
+    stream.write(text.data(), text.size());
+}
+
+BOOST_AUTO_TEST_CASE(UCIDeserializerReadsLines)
+{
+    const wstring path = L"UCIDeserializerReadsLines.txt";
+    const wstring mappingPath = L"UCIDeserializerReadsLines.labels.txt";
+    // line l has the label 'c<l mod 3>' and the features l, -l / 4 and l * 1e3, in several notations
+    WriteTextFile(path, "c0 0 -0 0e3\n"
+                        "c1 1.0 -0.25 1000\r\n"
+                        "\n"
+                        "c2 +2 -.5 2E3\n"
+                        "c0 3 -0.75 3000.\n"
+                        "c1 4 -1 4.0e+3");
+    WriteTextFile(mappingPath, "c0\nc1\nc2\n");
+
+    {
+        ConfigParameters config;
+        config.Parse("file=" + msra::strfun::utf8(path) + "\nchunkSizeInBytes=40\n" +
+                     "input=[\nfeatures=[start=1\ndim=3]\nlabels=[start=0\ndim=1\nlabelType=category\nlabelMappingFile=" + msra::strfun::utf8(mappingPath) + "]\n]\n");
+        UCIDeserializer deserializer(make_shared<CorpusDescriptor>(), config, true);
+
+        auto streams = deserializer.GetStreamDescriptions();
+        BOOST_REQUIRE_EQUAL(streams.size(), 2);
+        BOOST_CHECK(streams[0]->m_name == L"features" && streams[1]->m_name == L"labels");
+        BOOST_CHECK_EQUAL(streams[0]->m_sampleLayout->GetNumElements(), 3);
+        BOOST_CHECK_EQUAL(streams[1]->m_sampleLayout->GetNumElements(), 3);
+
+        // the empty line is skipped
+        auto chunks = deserializer.GetChunkDescriptions();
+        BOOST_REQUIRE_EQUAL(chunks.size(), 2);
+        BOOST_CHECK_EQUAL(chunks[0]->m_numberOfSamples, 3);
+        BOOST_CHECK_EQUAL(chunks[1]->m_numberOfSamples, 2);
+
+        for (ChunkIdType chunkId = 0; chunkId < chunks.size(); ++chunkId)
+        {
+            vector<SequenceDescription> descriptions;
+            deserializer.GetSequencesForChunk(chunkId, descriptions);
+            BOOST_REQUIRE_EQUAL(descriptions.size(), chunks[chunkId]->m_numberOfSequences);
+
+            auto chunk = deserializer.GetChunk(chunkId);
+            for (const auto& description : descriptions)
+            {
+                vector<SequenceDataPtr> data;
+                chunk->GetSequence(description.m_id, data);
+                BOOST_REQUIRE_EQUAL(data.size(), 2);
+
+                float l = (float)description.m_id;
+                const float* features = (const float*)data[0]->GetDataBuffer();
+                BOOST_CHECK_EQUAL(features[0], l);
+                BOOST_CHECK_EQUAL(features[1], -l / 4);
+                BOOST_CHECK_EQUAL(features[2], l * 1000);
+
+                const float* labels = (const float*)data[1]->GetDataBuffer();
+                for (size_t i = 0; i < 3; ++i)
+                    BOOST_CHECK_EQUAL(labels[i], i == description.m_id % 3 ? 1.0f : 0.0f);
+
+                SequenceDescription secondary;
+                BOOST_REQUIRE(deserializer.GetSequenceDescription(description, secondary));
+                BOOST_CHECK_EQUAL(secondary.m_chunkId, chunkId);
+            }
+        }
+    }
+    _wunlink(path.c_str());
+    _wunlink(mappingPath.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(UCIDeserializerReadsCustomDelimiters)
+{
+    const wstring path = L"UCIDeserializerReadsCustomDelimiters.txt";
+    WriteTextFile(path, "1,5|2,5|0\n3,125|1e-2|2\n");
+
+    {
+        ConfigParameters config;
+        config.Parse("file=" + msra::strfun::utf8(path) + "\nprecision=double\ncustomDelimiter=|\ncustomDecimalPoint=\",\"\n" +
+                     "input=[\nx=[start=0\ndim=2]\ny=[start=2\ndim=1\nlabelType=category\nlabelDim=4]\n]\n");
+        UCIDeserializer deserializer(make_shared<CorpusDescriptor>(), config, true);
+
+        auto chunks = deserializer.GetChunkDescriptions();
+        BOOST_REQUIRE_EQUAL(chunks.size(), 1);
+        BOOST_REQUIRE_EQUAL(chunks[0]->m_numberOfSamples, 2);
+
+        vector<SequenceDataPtr> data;
+        deserializer.GetChunk(0)->GetSequence(1, data);
+        const double* x = (const double*)data[0]->GetDataBuffer();
+        BOOST_CHECK_EQUAL(x[0], 3.125);
+        BOOST_CHECK_EQUAL(x[1], 0.01);
+        const double* y = (const double*)data[1]->GetDataBuffer();
+        BOOST_CHECK(y[0] == 0 && y[1] == 0 && y[2] == 1 && y[3] == 0);
+    }
+    _wunlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}}}}
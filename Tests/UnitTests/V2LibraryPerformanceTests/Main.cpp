@@ -0,0 +1,127 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Main.cpp -- end-to-end training throughput of reference workloads on synthetic data:
+//     V2LibraryPerformanceTests [-workload resnet|lstm|seq2seq|dssm] [-device cpu|gpu] [-gpu <id>]
+//                               [-minibatchSize <n>] [-warmup <n>] [-minibatches <n>] [-distributed]
+// All workloads are run unless one is selected. With -distributed, run under mpiexec with one worker per GPU: each
+// worker trains on the GPU of its rank, and the throughput is that of all workers together.
+//
+#include "CNTKLibrary.h"
+#include "TrainingBenchmark.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace CNTK;
+
+struct WorkloadFactory
+{
+    const char* name;
+    std::function<Workload(const DeviceDescriptor&, size_t)> create;
+    size_t defaultMinibatchSize;
+    const char* unit; // what a sample is
+};
+
+static void Usage()
+{
+    fprintf(stderr, "Usage: V2LibraryPerformanceTests [-workload resnet|lstm|seq2seq|dssm] [-device cpu|gpu] [-gpu <id>] [-minibatchSize <n>] [-warmup <n>] [-minibatches <n>] [-distributed]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    const std::vector<WorkloadFactory> factories = {
+        { "resnet", CreateResNetWorkload, 128, "images" },
+        { "lstm", CreateLSTMAcousticModelWorkload, 32, "frames" },
+        { "seq2seq", CreateSequenceToSequenceWorkload, 64, "words" },
+        { "dssm", CreateDSSMWorkload, 1024, "queries" },
+    };
+
+    std::string workloadName, deviceKind = "gpu";
+    int gpuId = 0;
+    size_t minibatchSize = 0, numWarmupMinibatches = 10, numMinibatches = 50;
+    bool distributed = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "-workload" && hasValue)
+            workloadName = argv[++i];
+        else if (arg == "-device" && hasValue)
+            deviceKind = argv[++i];
+        else if (arg == "-gpu" && hasValue)
+            gpuId = atoi(argv[++i]);
+        else if (arg == "-minibatchSize" && hasValue)
+            minibatchSize = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-warmup" && hasValue)
+            numWarmupMinibatches = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-minibatches" && hasValue)
+            numMinibatches = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "-distributed")
+            distributed = true;
+        else
+        {
+            Usage();
+            return -1;
+        }
+    }
+    if (deviceKind != "cpu" && deviceKind != "gpu")
+    {
+        Usage();
+        return -1;
+    }
+
+    DistributedTrainerPtr distributedTrainer;
+    if (distributed)
+    {
+        distributedTrainer = CreateDataParallelDistributedTrainer();
+        gpuId = (int) distributedTrainer->WorkerRank();
+    }
+    auto device = deviceKind == "cpu" ? DeviceDescriptor::CPUDevice() : DeviceDescriptor::GPUDevice(gpuId);
+    bool isMainWorker = !distributedTrainer || distributedTrainer->WorkerRank() == 0;
+    if (isMainWorker)
+    {
+        fprintf(stderr, "Training on %s%s, %d warm-up and %d timed minibatches per workload.\n",
+                deviceKind == "cpu" ? "the CPU" : "GPU", deviceKind == "cpu" ? "" : (" " + std::to_string(gpuId)).c_str(),
+                (int) numWarmupMinibatches, (int) numMinibatches);
+        if (distributedTrainer)
+            fprintf(stderr, "%d workers, one device each.\n", (int) distributedTrainer->NumberOfWorkers());
+    }
+
+    int numFailures = 0;
+    for (const auto& factory : factories)
+    {
+        if (!workloadName.empty() && workloadName != factory.name)
+            continue;
+        try
+        {
+            auto workload = factory.create(device, minibatchSize > 0 ? minibatchSize : factory.defaultMinibatchSize);
+            TrainingBenchmark benchmark(workload, device, distributedTrainer);
+            auto result = benchmark.Run(numWarmupMinibatches, numMinibatches);
+            if (!isMainWorker)
+                continue;
+
+            const auto& step = result.averageStep;
+            fprintf(stderr, "\n%ls:\n", result.name.c_str());
+            fprintf(stderr, "    %.1f %s/s (%d per minibatch), loss %.4f per sample\n",
+                    result.numSamples / result.seconds, factory.unit, (int) (result.numSamples / std::max<size_t>(result.numMinibatches, 1)), result.lastLossPerSample);
+            fprintf(stderr, "    step %.2f ms: data %.2f, forward %.2f, backward %.2f, communication %.2f, update %.2f\n",
+                    step.Total(), step.data, step.forward, step.backward, step.communication, step.update);
+            fprintf(stderr, "    peak memory: %.1f MB host", result.peakHostBytes / (1024.0 * 1024.0));
+            if (device.Type() == DeviceKind::GPU)
+                fprintf(stderr, ", %.1f MB in use on the GPU", result.peakDeviceBytes / (1024.0 * 1024.0));
+            fprintf(stderr, "\n");
+        }
+        catch (const std::exception& e)
+        {
+            fprintf(stderr, "\n%s: failed: %s\n", factory.name, e.what());
+            numFailures++;
+        }
+    }
+    fflush(stderr);
+    return numFailures;
+}
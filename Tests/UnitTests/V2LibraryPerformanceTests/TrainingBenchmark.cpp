@@ -0,0 +1,149 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "CNTKLibrary.h"
+#include "TrainingBenchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace CNTK;
+
+size_t GetPeakHostMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return (size_t) usage.ru_maxrss * 1024; // (kilobytes on Linux)
+#endif
+}
+
+static double GetScalar(const ValuePtr& value)
+{
+    NDArrayView cpuView(DataType::Float, value->Shape(), DeviceDescriptor::CPUDevice());
+    cpuView.CopyFrom(*value->Data());
+    return cpuView.DataBuffer<float>()[0];
+}
+
+TrainingBenchmark::TrainingBenchmark(const Workload& workload, const DeviceDescriptor& device, const DistributedTrainerPtr& distributedTrainer)
+    : m_workload(workload), m_device(device), m_distributedTrainer(distributedTrainer), m_lastAggregateLoss(0), m_lastNumSamples(0), m_peakDeviceBytes(0)
+{
+    m_aggregatedLoss = ReduceSum(workload.trainingLoss);
+    m_parameters = workload.trainingLoss->Parameters();
+
+    double learningRatePerSample = 0.0001;
+    double momentumPerSample = 0.999;
+    m_learner = MomentumSGDLearner(m_parameters, learningRatePerSample, momentumPerSample);
+
+    for (const auto& parameter : m_parameters)
+        m_parameterGradients[parameter] = nullptr;
+}
+
+void TrainingBenchmark::SamplePeakMemory()
+{
+    m_peakDeviceBytes = std::max(m_peakDeviceBytes, Internal::GetDeviceMemoryInUse(m_device));
+}
+
+void TrainingBenchmark::Step(const SyntheticMinibatch& minibatch, StepTimes& times, size_t& numSamples)
+{
+    auto lap = [this](std::chrono::high_resolution_clock::time_point& start)
+    {
+        Internal::SynchronizeDevice(m_device);
+        auto now = std::chrono::high_resolution_clock::now();
+        double milliseconds = std::chrono::duration<double, std::milli>(now - start).count();
+        start = now;
+        return milliseconds;
+    };
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::unordered_map<Variable, ValuePtr> arguments;
+    for (const auto& argument : minibatch.arguments)
+    {
+        auto mask = argument.second->Mask();
+        arguments[argument.first] = MakeSharedObject<Value>(argument.second->Data()->DeepClone(m_device, /*readOnly=*/true), mask ? mask->DeepClone(m_device) : nullptr);
+    }
+    times.data += lap(start);
+
+    std::unordered_map<Variable, ValuePtr> outputs = { { m_aggregatedLoss, nullptr } };
+    auto backPropState = m_aggregatedLoss->Forward(arguments, outputs, m_device, { m_aggregatedLoss });
+    times.forward += lap(start);
+    SamplePeakMemory();
+
+    auto rootGradientValue = MakeSharedObject<Value>(MakeSharedObject<NDArrayView>(DataType::Float, outputs[m_aggregatedLoss]->Shape(), m_device), outputs[m_aggregatedLoss]->Mask());
+    rootGradientValue->Data()->SetValue(1.0f);
+    m_aggregatedLoss->Backward(backPropState, { { m_aggregatedLoss, rootGradientValue } }, m_parameterGradients);
+    times.backward += lap(start);
+    SamplePeakMemory();
+
+    numSamples = minibatch.numSamples;
+    m_lastAggregateLoss = GetScalar(outputs[m_aggregatedLoss]);
+    if (m_distributedTrainer)
+    {
+        std::vector<std::pair<Parameter, NDArrayViewPtr>> gradientValues;
+        for (const auto& parameter : m_parameters)
+            gradientValues.push_back({ parameter, m_parameterGradients[parameter]->Data() });
+        double aggregateEvalCriterion = 0;
+        m_distributedTrainer->PreParameterUpdateCallback(gradientValues, numSamples, m_lastAggregateLoss, aggregateEvalCriterion);
+        times.communication += lap(start);
+    }
+    m_lastNumSamples = numSamples;
+
+    std::unordered_map<Parameter, NDArrayViewPtr> learnerGradients;
+    for (const auto& parameter : m_parameters)
+        learnerGradients[parameter] = m_parameterGradients[parameter]->Data();
+    m_learner->Update(learnerGradients, numSamples);
+    times.update += lap(start);
+    SamplePeakMemory();
+}
+
+TrainingBenchmarkResult TrainingBenchmark::Run(size_t numWarmupMinibatches, size_t numMinibatches)
+{
+    if (m_workload.minibatches.empty())
+        throw std::invalid_argument("TrainingBenchmark: The workload has no minibatches.");
+
+    size_t next = 0;
+    StepTimes warmupTimes;
+    size_t numSamples;
+    for (size_t i = 0; i < numWarmupMinibatches; i++)
+        Step(m_workload.minibatches[next++ % m_workload.minibatches.size()], warmupTimes, numSamples);
+
+    TrainingBenchmarkResult result;
+    result.name = m_workload.name;
+    result.numMinibatches = numMinibatches;
+    result.numSamples = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    StepTimes& times = result.averageStep;
+    for (size_t i = 0; i < numMinibatches; i++)
+    {
+        Step(m_workload.minibatches[next++ % m_workload.minibatches.size()], times, numSamples);
+        result.numSamples += numSamples;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    if (numMinibatches > 0)
+    {
+        times.data /= numMinibatches;
+        times.forward /= numMinibatches;
+        times.backward /= numMinibatches;
+        times.communication /= numMinibatches;
+        times.update /= numMinibatches;
+    }
+    result.peakHostBytes = GetPeakHostMemory();
+    result.peakDeviceBytes = m_peakDeviceBytes;
+    result.lastLossPerSample = m_lastNumSamples > 0 ? m_lastAggregateLoss / m_lastNumSamples : 0;
+    return result;
+}
@@ -0,0 +1,90 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// TrainingBenchmark.h -- end-to-end training throughput of reference workloads on synthetic data
+//
+#pragma once
+
+#include "CNTKLibrary.h"
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A minibatch of a workload, with the Values on the CPU: the benchmark copies them to the device in each step.
+struct SyntheticMinibatch
+{
+    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> arguments;
+    size_t numSamples; // of the training criterion
+};
+
+// A model with its training criterion (per sample) and a few minibatches of random data of the right shapes and
+// sparsity, which the steps cycle through.
+struct Workload
+{
+    std::wstring name;
+    CNTK::FunctionPtr trainingLoss;
+    std::vector<SyntheticMinibatch> minibatches;
+};
+
+Workload CreateResNetWorkload(const CNTK::DeviceDescriptor& device, size_t minibatchSize);
+Workload CreateLSTMAcousticModelWorkload(const CNTK::DeviceDescriptor& device, size_t minibatchSize);
+Workload CreateSequenceToSequenceWorkload(const CNTK::DeviceDescriptor& device, size_t minibatchSize);
+Workload CreateDSSMWorkload(const CNTK::DeviceDescriptor& device, size_t minibatchSize);
+
+// Per step, in milliseconds.
+struct StepTimes
+{
+    StepTimes() : data(0), forward(0), backward(0), communication(0), update(0) {}
+
+    double Total() const { return data + forward + backward + communication + update; }
+
+    double data;          // copy of the minibatch to the device
+    double forward;
+    double backward;
+    double communication; // aggregation of the gradients across the workers
+    double update;        // of the parameters by the learner
+};
+
+struct TrainingBenchmarkResult
+{
+    std::wstring name;
+    size_t numMinibatches;
+    size_t numSamples;        // of all workers
+    double seconds;           // wall clock time of the timed minibatches
+    StepTimes averageStep;
+    size_t peakHostBytes;     // of this process
+    size_t peakDeviceBytes;   // in use on the GPU, by all processes
+    double lastLossPerSample; // to tell that the training does something
+};
+
+// Trains a workload the way Trainer::TrainMinibatch() does (forward, backward, aggregation, update), but one phase
+// at a time, synchronizing the device after each, so that the time of a step can be broken down. The synchronizations
+// cost a little throughput compared to a Trainer, which overlaps the phases of a step with those of the next one.
+// With a 'distributedTrainer', the gradients are aggregated across the workers of an MPI job as a Trainer would.
+class TrainingBenchmark
+{
+public:
+    TrainingBenchmark(const Workload& workload, const CNTK::DeviceDescriptor& device, const CNTK::DistributedTrainerPtr& distributedTrainer);
+
+    // Runs 'numWarmupMinibatches' untimed, then times 'numMinibatches'.
+    TrainingBenchmarkResult Run(size_t numWarmupMinibatches, size_t numMinibatches);
+
+private:
+    void Step(const SyntheticMinibatch& minibatch, StepTimes& times, size_t& numSamples);
+    void SamplePeakMemory();
+
+    const Workload& m_workload;
+    CNTK::DeviceDescriptor m_device;
+    CNTK::DistributedTrainerPtr m_distributedTrainer;
+    CNTK::FunctionPtr m_aggregatedLoss;
+    CNTK::LearnerPtr m_learner;
+    std::vector<CNTK::Parameter> m_parameters;
+    std::unordered_map<CNTK::Variable, CNTK::ValuePtr> m_parameterGradients; // kept across steps
+    double m_lastAggregateLoss;
+    size_t m_lastNumSamples;
+    size_t m_peakDeviceBytes;
+};
+
+size_t GetPeakHostMemory();
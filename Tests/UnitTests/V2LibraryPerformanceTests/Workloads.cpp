@@ -0,0 +1,232 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Workloads.cpp -- the reference models of the training benchmark, after the V2LibraryTests that train them on real data
+//
+#include "CNTKLibrary.h"
+#include "TrainingBenchmark.h"
+#include "../V2LibraryTests/Common.h"
+#include "../V2LibraryTests/Image.h"
+#include <random>
+
+using namespace CNTK;
+
+// minibatches of random data per workload, which the steps cycle through
+static const size_t s_numSyntheticMinibatches = 4;
+
+// ResNet-20 on CIFAR-10 sized images, as CifarResNet.cpp but with the projection shortcuts of option B.
+// 'minibatchSize' is the number of images.
+Workload CreateResNetWorkload(const DeviceDescriptor& device, size_t minibatchSize)
+{
+    const size_t numOutputClasses = 10;
+    auto images = InputVariable({ 32, 32, 3 }, DataType::Float, L"images");
+    auto labels = InputVariable({ numOutputClasses }, DataType::Float, L"labels");
+
+    const double convWScale = 7.07, conv1WScale = 0.26, convBValue = 0, fc1WScale = 0.4, scValue = 1;
+    const size_t bnTimeConst = 4096, kernelWidth = 3, kernelHeight = 3;
+
+    FunctionPtr r = ConvBNReLULayer(images, 16, kernelWidth, kernelHeight, 1, 1, conv1WScale, convBValue, scValue, bnTimeConst, device);
+    for (size_t cMap : { 16, 32, 64 })
+    {
+        if (cMap > 16)
+            r = ResNetNode2BInc(r, cMap, kernelWidth, kernelHeight, convWScale, convBValue, scValue, bnTimeConst, device);
+        else
+            r = ResNetNode2A(r, cMap, kernelWidth, kernelHeight, convWScale, convBValue, scValue, bnTimeConst, device);
+        r = ResNetNode2A(r, cMap, kernelWidth, kernelHeight, convWScale, convBValue, scValue, bnTimeConst, device);
+        r = ResNetNode2A(r, cMap, kernelWidth, kernelHeight, convWScale, convBValue, scValue, bnTimeConst, device);
+    }
+
+    // global average pooling and the output layer
+    auto pool = Pooling(r, PoolingType::Average, { 8, 8, 1 }, { 1, 1, 1 });
+    auto outTimesParams = Parameter({ numOutputClasses, 1, 1, 64 }, DataType::Float, GlorotUniformInitializer(1, 0, fc1WScale), device);
+    auto outBiasParams = Parameter({ numOutputClasses }, 0.0f, device);
+    auto z = Plus(Times(outTimesParams, pool), outBiasParams, L"classifierOutput");
+
+    Workload workload;
+    workload.name = L"ResNet-20, CIFAR-10 images";
+    workload.trainingLoss = CrossEntropyWithSoftmax(z, labels, L"lossFunction");
+    std::vector<size_t> sampleLengths(minibatchSize, 1);
+    for (size_t i = 0; i < s_numSyntheticMinibatches; i++)
+    {
+        SyntheticMinibatch minibatch;
+        minibatch.arguments[images] = GenerateSequences<float>(sampleLengths, images.Shape(), DeviceDescriptor::CPUDevice(), /*oneHot=*/false);
+        minibatch.arguments[labels] = GenerateSequences<float>(sampleLengths, labels.Shape(), DeviceDescriptor::CPUDevice(), /*oneHot=*/true);
+        minibatch.numSamples = minibatchSize;
+        workload.minibatches.push_back(std::move(minibatch));
+    }
+    return workload;
+}
+
+// The three-layer LSTMP acoustic model of TruncatedLSTMAcousticModel.cpp on chunks of 20 frames, as truncated BPTT
+// reads them. 'minibatchSize' is the number of parallel chunks.
+Workload CreateLSTMAcousticModelWorkload(const DeviceDescriptor& device, size_t minibatchSize)
+{
+    const size_t featureDim = 33, numOutputClasses = 132, LSTMDim = 256, cellDim = 1024, numLSTMs = 3, truncationLength = 20;
+    auto features = InputVariable({ featureDim }, DataType::Float, L"features");
+    auto labels = InputVariable({ numOutputClasses }, DataType::Float, L"labels");
+
+    auto pastValueRecurrenceHook = [](const Variable& x) { return PastValue(x); };
+    FunctionPtr r = features;
+    for (size_t i = 0; i < numLSTMs; ++i)
+        r = LSTMPComponentWithSelfStabilization<float>(r, { LSTMDim }, { cellDim }, pastValueRecurrenceHook, pastValueRecurrenceHook, device).first;
+    auto z = FullyConnectedLinearLayer(r, numOutputClasses, device, L"classifierOutput");
+
+    Workload workload;
+    workload.name = L"LSTM acoustic model, 3x1024 cells";
+    workload.trainingLoss = CrossEntropyWithSoftmax(z, labels, L"lossFunction");
+    std::vector<size_t> sequenceLengths(minibatchSize, truncationLength);
+    for (size_t i = 0; i < s_numSyntheticMinibatches; i++)
+    {
+        SyntheticMinibatch minibatch;
+        minibatch.arguments[features] = GenerateSequences<float>(sequenceLengths, features.Shape(), DeviceDescriptor::CPUDevice(), /*oneHot=*/false);
+        minibatch.arguments[labels] = GenerateSequences<float>(sequenceLengths, labels.Shape(), DeviceDescriptor::CPUDevice(), /*oneHot=*/true);
+        minibatch.numSamples = minibatchSize * truncationLength;
+        workload.minibatches.push_back(std::move(minibatch));
+    }
+    return workload;
+}
+
+// The encoder-decoder of Seq2Seq.cpp with sparse inputs (without the beam search reordering hook), on sentences of up
+// to 30 words. 'minibatchSize' is the number of sentence pairs.
+Workload CreateSequenceToSequenceWorkload(const DeviceDescriptor& device, size_t minibatchSize)
+{
+    const size_t inputVocabDim = 10000, labelVocabDim = 10000, hiddenDim = 512, numLayers = 2, embeddingDim = 300, maxSentenceLength = 30;
+
+    std::vector<Axis> inputDynamicAxes = { Axis(L"inputAxis"), Axis::DefaultBatchAxis() };
+    auto rawInput = InputVariable({ inputVocabDim }, /*isSparse=*/true, DataType::Float, L"rawInput", inputDynamicAxes);
+    std::vector<Axis> labelDynamicAxes = { Axis(L"labelAxis"), Axis::DefaultBatchAxis() };
+    auto rawLabels = InputVariable({ labelVocabDim }, /*isSparse=*/true, DataType::Float, L"rawLabels", labelDynamicAxes);
+
+    // drop the sentence start token from the labels, for training the decoder
+    auto labelSequence = Slice(rawLabels, labelDynamicAxes[0], 1, 0);
+    auto labelSentenceStart = Sequence::First(rawLabels);
+    auto isFirstLabel = Sequence::IsFirst(labelSequence);
+
+    auto inputEmbeddingWeights = Parameter({ embeddingDim, inputVocabDim }, DataType::Float, GlorotUniformInitializer(), device);
+    auto labelEmbeddingWeights = Parameter({ embeddingDim, labelVocabDim }, DataType::Float, GlorotUniformInitializer(), device);
+    auto inputEmbedding = Times(inputEmbeddingWeights, rawInput);
+    auto labelEmbedding = Times(labelEmbeddingWeights, labelSequence);
+    auto labelSentenceStartEmbeddedScattered = Sequence::Scatter(Times(labelEmbeddingWeights, labelSentenceStart), isFirstLabel);
+
+    // encoder
+    auto encoderOutputH = Stabilize<float>(inputEmbedding, device);
+    FunctionPtr encoderOutputC;
+    auto futureValueRecurrenceHook = [](const Variable& x) { return FutureValue(x); };
+    for (size_t i = 0; i < numLayers; ++i)
+        std::tie(encoderOutputH, encoderOutputC) = LSTMPComponentWithSelfStabilization<float>(encoderOutputH, { hiddenDim }, { hiddenDim }, futureValueRecurrenceHook, futureValueRecurrenceHook, device);
+    auto thoughtVectorBroadcastH = Sequence::BroadcastAs(Sequence::First(encoderOutputH), labelEmbedding);
+    auto thoughtVectorBroadcastC = Sequence::BroadcastAs(Sequence::First(encoderOutputC), labelEmbedding);
+
+    // decoder, started by the thought vector in all layers but the first
+    auto decoderInput = ElementSelect(isFirstLabel, labelSentenceStartEmbeddedScattered, PastValue(labelEmbedding));
+    auto decoderOutputH = Stabilize<float>(decoderInput, device);
+    FunctionPtr decoderOutputC;
+    auto isFirst = Sequence::IsFirst(labelEmbedding);
+    for (size_t i = 0; i < numLayers; ++i)
+    {
+        std::function<FunctionPtr(const Variable&)> recurrenceHookH = [](const Variable& operand) { return PastValue(operand); };
+        std::function<FunctionPtr(const Variable&)> recurrenceHookC = recurrenceHookH;
+        if (i > 0)
+        {
+            recurrenceHookH = [isFirst, thoughtVectorBroadcastH](const Variable& operand) { return ElementSelect(isFirst, thoughtVectorBroadcastH, PastValue(operand)); };
+            recurrenceHookC = [isFirst, thoughtVectorBroadcastC](const Variable& operand) { return ElementSelect(isFirst, thoughtVectorBroadcastC, PastValue(operand)); };
+        }
+        std::tie(decoderOutputH, decoderOutputC) = LSTMPComponentWithSelfStabilization<float>(decoderOutputH, { hiddenDim }, { hiddenDim }, recurrenceHookH, recurrenceHookC, device);
+    }
+
+    auto outputLayerProjWeights = Parameter({ labelVocabDim, hiddenDim }, DataType::Float, GlorotUniformInitializer(), device);
+    auto biasWeights = Parameter({ labelVocabDim }, 0.0f, device);
+    auto z = Plus(Times(outputLayerProjWeights, Stabilize<float>(decoderOutputH, device)), biasWeights, L"classifierOutput");
+
+    Workload workload;
+    workload.name = L"Sequence-to-sequence, 2x512 LSTMs, 10k words";
+    workload.trainingLoss = CrossEntropyWithSoftmax(z, labelSequence, L"lossFunction");
+    for (size_t i = 0; i < s_numSyntheticMinibatches; i++)
+    {
+        SyntheticMinibatch minibatch;
+        auto inputLengths = GenerateSequenceLengths(minibatchSize, maxSentenceLength);
+        auto labelLengths = GenerateSequenceLengths(minibatchSize, maxSentenceLength);
+        minibatch.numSamples = 0;
+        for (auto& length : labelLengths)
+        {
+            length++; // the sentence start token
+            minibatch.numSamples += length - 1;
+        }
+        minibatch.arguments[rawInput] = GenerateSequences<float>(inputLengths, rawInput.Shape(), DeviceDescriptor::CPUDevice(), /*oneHot=*/true);
+        minibatch.arguments[rawLabels] = GenerateSequences<float>(labelLengths, rawLabels.Shape(), DeviceDescriptor::CPUDevice(), /*oneHot=*/true);
+        workload.minibatches.push_back(std::move(minibatch));
+    }
+    return workload;
+}
+
+// A DSSM: a query and documents as sparse bags of letter trigrams, each passed through a tower of two tanh layers
+// (one tower for queries, one for documents), ranked by the cosine similarity of their outputs; the first document is
+// the clicked one, the others are negative samples. 'minibatchSize' is the number of queries.
+Workload CreateDSSMWorkload(const DeviceDescriptor& device, size_t minibatchSize)
+{
+    const size_t vocabularyDim = 50000, numNonZerosPerSample = 30, hiddenDim = 300, outputDim = 128, numNegativeSamples = 4;
+    const size_t numDocuments = 1 + numNegativeSamples;
+
+    auto createTower = [&device, vocabularyDim, hiddenDim, outputDim]()
+    {
+        auto w1 = Parameter({ hiddenDim, vocabularyDim }, DataType::Float, GlorotUniformInitializer(), device);
+        auto b1 = Parameter({ hiddenDim }, 0.0f, device);
+        auto w2 = Parameter({ outputDim, hiddenDim }, DataType::Float, GlorotUniformInitializer(), device);
+        auto b2 = Parameter({ outputDim }, 0.0f, device);
+        return [w1, b1, w2, b2](const Variable& x) { return Tanh(Plus(Times(w2, Tanh(Plus(Times(w1, x), b1))), b2)); };
+    };
+    auto queryTower = createTower();
+    auto documentTower = createTower();
+
+    auto query = InputVariable({ vocabularyDim }, /*isSparse=*/true, DataType::Float, L"query");
+    auto labels = InputVariable({ numDocuments }, DataType::Float, L"labels");
+    auto q = queryTower(query);
+    auto dot = [](const Variable& a, const Variable& b) { return ReduceSum(ElementTimes(a, b), Axis(0)); };
+    auto queryNorm = Sqrt(dot(q, q));
+
+    std::vector<Variable> documents, similarities;
+    for (size_t i = 0; i < numDocuments; i++)
+    {
+        documents.push_back(InputVariable({ vocabularyDim }, /*isSparse=*/true, DataType::Float, L"document" + std::to_wstring(i)));
+        auto d = documentTower(documents.back());
+        similarities.push_back(ElementDivide(dot(q, d), ElementTimes(queryNorm, Sqrt(dot(d, d)))));
+    }
+    auto gamma = Constant::Scalar(10.0f, device); // smoothing factor of the softmax over the documents
+    auto z = ElementTimes(gamma, Splice(similarities, Axis(0)), L"classifierOutput");
+
+    Workload workload;
+    workload.name = L"DSSM, 50k sparse trigrams, 4 negative samples";
+    workload.trainingLoss = CrossEntropyWithSoftmax(z, labels, L"lossFunction");
+
+    std::mt19937 generator(1);
+    std::uniform_int_distribution<int> trigram(0, (int) vocabularyDim - 1);
+    auto generateBags = [&]()
+    {
+        std::vector<SparseIndexType> columnStarts(1, 0), rowIndices;
+        for (size_t j = 0; j < minibatchSize; j++)
+        {
+            std::vector<SparseIndexType> bag;
+            for (size_t k = 0; k < numNonZerosPerSample; k++)
+                bag.push_back(trigram(generator));
+            std::sort(bag.begin(), bag.end());
+            bag.erase(std::unique(bag.begin(), bag.end()), bag.end());
+            rowIndices.insert(rowIndices.end(), bag.begin(), bag.end());
+            columnStarts.push_back((SparseIndexType) rowIndices.size());
+        }
+        std::vector<float> values(rowIndices.size(), 1.0f);
+        auto data = MakeSharedObject<NDArrayView>(NDShape({ vocabularyDim, 1, minibatchSize }), columnStarts.data(), rowIndices.data(), values.data(), values.size(), DeviceDescriptor::CPUDevice(), /*readOnly=*/true);
+        return MakeSharedObject<Value>(data);
+    };
+    for (size_t i = 0; i < s_numSyntheticMinibatches; i++)
+    {
+        SyntheticMinibatch minibatch;
+        minibatch.arguments[query] = generateBags();
+        for (const auto& document : documents)
+            minibatch.arguments[document] = generateBags();
+        minibatch.arguments[labels] = Value::Create<float>(numDocuments, std::vector<std::vector<size_t>>(minibatchSize, std::vector<size_t>(1, 0)), DeviceDescriptor::CPUDevice(), /*readOnly=*/true);
+        minibatch.numSamples = minibatchSize;
+        workload.minibatches.push_back(std::move(minibatch));
+    }
+    return workload;
+}
@@ -440,6 +440,57 @@ void TestTranspose(size_t numAxes, size_t axis1, size_t axis2, const DeviceDescr
     FloatingPointVectorCompare(outputData, expectedOutputValues, "TestTimesAndPlus: Forward prop results do not match expected results");
 }
 
+// Repeated Forward calls only recompute what depends on changed inputs or parameters; the results must be as if all was recomputed
+void TestRepeatedForward(const DeviceDescriptor& device)
+{
+    srand(1);
+
+    const size_t inputDim = 5, outputDim = 3;
+    auto inputVar = InputVariable({ inputDim }, DataType::Float, L"features");
+    auto timesParam = Parameter({ outputDim, inputDim }, 0.5f, device, L"W");
+    auto plusParam = Parameter({ outputDim }, -1.0f, device, L"b");
+    auto outputFunc = Plus(ReLU(Times(timesParam, inputVar)), plusParam);
+
+    std::vector<float> inputData(inputDim);
+    for (size_t i = 0; i < inputData.size(); ++i)
+        inputData[i] = ((float)rand()) / RAND_MAX - 0.25f;
+
+    // The Value owns its storage (Values over caller buffers are always fed in again)
+    NDShape inputValueShape = inputVar.Shape().AppendShape({ 1, 1 });
+    auto inputDataView = MakeSharedObject<NDArrayView>(inputValueShape, inputData, true)->DeepClone(device, false);
+    ValuePtr inputValue = MakeSharedObject<Value>(inputDataView);
+
+    auto verifyOutput = [&](float timesParamValue, float plusParamValue, const char* message)
+    {
+        float sum = 0;
+        for (auto value : inputData)
+            sum += value;
+
+        std::vector<float> outputData(outputDim);
+        ValuePtr outputValue = MakeSharedObject<Value>(MakeSharedObject<NDArrayView>(outputFunc->Output().Shape().AppendShape({ 1, 1 }), outputData, false));
+        std::unordered_map<Variable, ValuePtr> outputs = { { outputFunc->Output(), outputValue } };
+        outputFunc->Forward({ { inputVar, inputValue } }, outputs, device);
+
+        std::vector<float> expectedOutputData(outputDim, std::max(timesParamValue * sum, 0.0f) + plusParamValue);
+        FloatingPointVectorCompare(outputData, expectedOutputData, message);
+    };
+
+    verifyOutput(0.5f, -1.0f, "TestRepeatedForward: Forward prop results do not match expected results");
+    verifyOutput(0.5f, -1.0f, "TestRepeatedForward: Forward prop results with unchanged inputs do not match expected results");
+
+    // Only the Plus changes, but the values of the Times and ReLU may have been released after the previous Forward
+    plusParam.Value()->SetValue(2.0f);
+    verifyOutput(0.5f, 2.0f, "TestRepeatedForward: Forward prop results after a change of the bias do not match expected results");
+
+    timesParam.Value()->SetValue(-0.25f);
+    verifyOutput(-0.25f, 2.0f, "TestRepeatedForward: Forward prop results after a change of the weights do not match expected results");
+
+    for (auto& value : inputData)
+        value = -value;
+    inputDataView->CopyFrom(*MakeSharedObject<NDArrayView>(inputValueShape, inputData, true));
+    verifyOutput(-0.25f, 2.0f, "TestRepeatedForward: Forward prop results after a change of the input do not match expected results");
+}
+
 void FunctionTests()
 {
     TestSlice(2, DeviceDescriptor::CPUDevice());
@@ -458,4 +509,9 @@ void FunctionTests()
 #ifndef CPUONLY
     TestTranspose(3, 1, 2, DeviceDescriptor::GPUDevice(0));
 #endif
+
+    TestRepeatedForward(DeviceDescriptor::CPUDevice());
+#ifndef CPUONLY
+    TestRepeatedForward(DeviceDescriptor::GPUDevice(0));
+#endif
 }
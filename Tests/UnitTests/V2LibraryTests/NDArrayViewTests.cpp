@@ -186,6 +186,155 @@ void TestSparseCSCArrayView(size_t numAxes, const DeviceDescriptor& device)
         throw std::runtime_error("The contents of the dense vector that the sparse NDArrayView is copied into do not match the expected values");
 }
 
+template <typename ElementType>
+void TestValueFromBuffer(const DeviceDescriptor& device)
+{
+    const NDShape sampleShape = { 3, 2 };
+    const std::vector<size_t> sequenceLengths = { 4, 1, 3 };
+    const size_t maxSequenceLength = 4;
+    std::vector<ElementType> buffer(sampleShape.TotalSize() * maxSequenceLength * sequenceLengths.size());
+    for (size_t i = 0; i < buffer.size(); ++i)
+        buffer[i] = (ElementType)i;
+
+    auto value = Value::Create(sampleShape, sequenceLengths, buffer.data(), device, true);
+    if (value->Shape() != sampleShape.AppendShape({ maxSequenceLength, sequenceLengths.size() }))
+        throw std::runtime_error("The shape of the Value created from a buffer does not match the expected shape");
+
+    if ((device == DeviceDescriptor::CPUDevice()) && (value->Data()->template DataBuffer<ElementType>() != buffer.data()))
+        throw std::runtime_error("The Value created from a CPU buffer does not refer to that buffer");
+
+    std::vector<ElementType> copiedData(buffer.size());
+    NDArrayView cpuView(value->Shape(), copiedData.data(), copiedData.size(), DeviceDescriptor::CPUDevice());
+    cpuView.CopyFrom(*value->Data());
+    if (copiedData != buffer)
+        throw std::runtime_error("The data of the Value created from a buffer does not match the buffer");
+
+    // sequences of different lengths need a mask
+    auto mask = value->Mask();
+    if (!mask || (mask->Shape() != NDShape({ maxSequenceLength, sequenceLengths.size() })))
+        throw std::runtime_error("The Value created from a buffer with sequences of different lengths has no or a wrong mask");
+
+    auto cpuMask = mask->DeepClone(DeviceDescriptor::CPUDevice());
+    for (size_t i = 0; i < sequenceLengths.size(); ++i)
+    {
+        for (size_t j = 0; j < maxSequenceLength; ++j)
+        {
+            bool isValid = cpuMask->DataBuffer()[(i * maxSequenceLength) + j] != MaskKind::Invalid;
+            if (isValid != (j < sequenceLengths[i]))
+                throw std::runtime_error("The mask of the Value created from a buffer does not match the sequence lengths");
+        }
+    }
+}
+
+template <typename ElementType>
+void TestOneHotValueFromIndices(const DeviceDescriptor& device)
+{
+    const size_t vocabularySize = 11;
+    const std::vector<SparseIndexType> oneHotIndices = { 3, 0, 10, 7, 7, 1 };
+    const std::vector<size_t> sequenceOffsets = { 0, 3, 3, 4, 6 }; // (the second sequence is empty)
+    const size_t maxSequenceLength = 3;
+
+    auto value = Value::Create<ElementType>(vocabularySize, oneHotIndices, sequenceOffsets, device, true);
+    if (value->Shape() != NDShape({ vocabularySize, maxSequenceLength, sequenceOffsets.size() - 1 }))
+        throw std::runtime_error("The shape of the one hot Value created from indices does not match the expected shape");
+
+    std::vector<ElementType> denseData(value->Shape().TotalSize());
+    NDArrayView denseCPUTensor(value->Shape(), denseData.data(), denseData.size(), DeviceDescriptor::CPUDevice());
+    denseCPUTensor.CopyFrom(*value->Data());
+
+    std::vector<ElementType> expectedData(denseData.size(), 0);
+    for (size_t i = 0; i + 1 < sequenceOffsets.size(); ++i)
+        for (size_t j = 0; j < sequenceOffsets[i + 1] - sequenceOffsets[i]; ++j)
+            expectedData[(((i * maxSequenceLength) + j) * vocabularySize) + oneHotIndices[sequenceOffsets[i] + j]] = 1;
+
+    if (denseData != expectedData)
+        throw std::runtime_error("The data of the one hot Value created from indices does not match the expected values");
+
+    if (!value->Mask() || (value->Mask()->MaskedCount() != 6))
+        throw std::runtime_error("The mask of the one hot Value created from indices does not match the sequence lengths");
+}
+
+template <typename ElementType>
+void TestNDArrayViewViews(const DeviceDescriptor& device)
+{
+    const NDShape viewShape = { 4, 3, 2 };
+    std::vector<ElementType> data(viewShape.TotalSize());
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (ElementType)i;
+
+    auto view = MakeSharedObject<NDArrayView>(viewShape, data.data(), data.size(), DeviceDescriptor::CPUDevice())->DeepClone(device);
+    auto element = [&data, &viewShape](size_t i, size_t j, size_t k) { return data[(((k * viewShape[1]) + j) * viewShape[0]) + i]; };
+
+    // a slice that is not contiguous in memory
+    auto sliceView = view->SliceView({ 1, 1, 0 }, { 2, 2, 2 });
+    if (sliceView->IsContiguous() || (sliceView->Shape() != NDShape({ 2, 2, 2 })))
+        throw std::runtime_error("The slice view has an unexpected shape or is contiguous");
+
+    auto slice = sliceView->DeepClone(DeviceDescriptor::CPUDevice());
+    const ElementType* sliceData = slice->template DataBuffer<ElementType>();
+    for (size_t k = 0; k < 2; ++k)
+        for (size_t j = 0; j < 2; ++j)
+            for (size_t i = 0; i < 2; ++i)
+                if (sliceData[(((k * 2) + j) * 2) + i] != element(1 + i, 1 + j, k))
+                    throw std::runtime_error("The data of the slice view does not match the sliced elements");
+
+    // writes through a slice change the sliced view
+    sliceView->SetValue((ElementType)-1);
+    auto cpuView = view->DeepClone(DeviceDescriptor::CPUDevice());
+    const ElementType* cpuData = cpuView->template DataBuffer<ElementType>();
+    for (size_t k = 0; k < 2; ++k)
+        for (size_t j = 0; j < 3; ++j)
+            for (size_t i = 0; i < 4; ++i)
+            {
+                bool isSliced = (i >= 1) && (i < 3) && (j >= 1);
+                if (cpuData[(((k * 3) + j) * 4) + i] != (isSliced ? (ElementType)-1 : element(i, j, k)))
+                    throw std::runtime_error("Setting the value of a slice view did not change exactly the sliced elements");
+            }
+    sliceView->CopyFrom(*slice);
+
+    auto transposed = view->TransposeAxesView(0, 2)->DeepClone(DeviceDescriptor::CPUDevice());
+    if (transposed->Shape() != NDShape({ 2, 3, 4 }))
+        throw std::runtime_error("The transposed view has an unexpected shape");
+    const ElementType* transposedData = transposed->template DataBuffer<ElementType>();
+    for (size_t i = 0; i < 4; ++i)
+        for (size_t j = 0; j < 3; ++j)
+            for (size_t k = 0; k < 2; ++k)
+                if (transposedData[(((i * 3) + j) * 2) + k] != element(i, j, k))
+                    throw std::runtime_error("The data of the transposed view does not match the transposed elements");
+
+    auto rowView = view->SliceView({ 0, 1, 1 }, { 4, 1, 1 });
+    auto broadcastView = rowView->BroadcastView({ 4, 3, 2 });
+    if (!broadcastView->IsReadOnly())
+        throw std::runtime_error("A broadcast view must be read-only");
+    auto broadcast = broadcastView->DeepClone(DeviceDescriptor::CPUDevice());
+    const ElementType* broadcastData = broadcast->template DataBuffer<ElementType>();
+    for (size_t n = 0; n < 6; ++n)
+        for (size_t i = 0; i < 4; ++i)
+            if (broadcastData[(n * 4) + i] != element(i, 1, 1))
+                throw std::runtime_error("The data of the broadcast view does not match the broadcast elements");
+
+    // a reshaped view shares the storage
+    auto reshaped = view->AsShape({ 12, 2 });
+    reshaped->SliceView({ 0, 1 }, { 12, 1 })->SetValue((ElementType)2);
+    cpuView = view->DeepClone(DeviceDescriptor::CPUDevice());
+    cpuData = cpuView->template DataBuffer<ElementType>();
+    for (size_t i = 0; i < data.size(); ++i)
+        if (cpuData[i] != ((i < 12) ? data[i] : (ElementType)2))
+            throw std::runtime_error("Setting the value of a reshaped view did not change the original view");
+
+    bool reshapeFailed = false;
+    try
+    {
+        sliceView->AsShape({ 8 });
+    }
+    catch (const std::invalid_argument&)
+    {
+        reshapeFailed = true;
+    }
+    if (!reshapeFailed)
+        throw std::runtime_error("Reshaping a view that is not contiguous in memory was not rejected");
+}
+
 void NDArrayViewTests()
 {
     TestNDArrayView<float>(2, DeviceDescriptor::CPUDevice());
@@ -197,4 +346,13 @@ void NDArrayViewTests()
     TestSparseCSCArrayView<double>(4, DeviceDescriptor::GPUDevice(0));
 #endif
     TestSparseCSCArrayView<float>(2, DeviceDescriptor::CPUDevice());
+
+    TestValueFromBuffer<float>(DeviceDescriptor::CPUDevice());
+    TestOneHotValueFromIndices<float>(DeviceDescriptor::CPUDevice());
+    TestNDArrayViewViews<float>(DeviceDescriptor::CPUDevice());
+#ifndef CPUONLY
+    TestNDArrayViewViews<double>(DeviceDescriptor::GPUDevice(0));
+    TestValueFromBuffer<double>(DeviceDescriptor::GPUDevice(0));
+    TestOneHotValueFromIndices<float>(DeviceDescriptor::GPUDevice(0));
+#endif
 }
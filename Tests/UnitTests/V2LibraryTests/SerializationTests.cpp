@@ -4,6 +4,7 @@
 //
 #include "CNTKLibrary.h"
 #include "Common.h"
+#include <chrono>
 #include <string>
 #include <random>
 #include <vector>
@@ -156,6 +157,60 @@ void TestDictionarySerialization(size_t dictSize)
         throw std::runtime_error("TestDictionarySerialization: original and deserialized dictionaries are not identical.");
 }
 
+// Large NDArrayViews (the parameters and learner state of big models) must be (de)serialized at about the speed of
+// writing and reading their bytes to a file, not element by element.
+void TestLargeNDArrayViewSerializationPerformance(size_t numElements)
+{
+    auto seconds = [](const std::function<void()>& f)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        f();
+        return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    auto view = NDArrayView::RandomUniform<float>(NDShape({ numElements }), -1.0, 1.0, 1, DeviceDescriptor::CPUDevice());
+    Dictionary originalDict;
+    originalDict[L"value"] = *view;
+
+    // the same bytes, written and read in one piece
+    std::vector<float> buffer(view->DataBuffer<float>(), view->DataBuffer<float>() + numElements);
+    double rawSeconds = seconds([&]()
+    {
+        fstream stream;
+        OpenStream(stream, tempFilePath, false);
+        stream.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(float));
+        stream.flush();
+    });
+    rawSeconds += seconds([&]()
+    {
+        fstream stream;
+        OpenStream(stream, tempFilePath, true);
+        stream.read(reinterpret_cast<char*>(buffer.data()), buffer.size() * sizeof(float));
+    });
+
+    Dictionary deserializedDict;
+    double dictionarySeconds = seconds([&]()
+    {
+        fstream stream;
+        OpenStream(stream, tempFilePath, false);
+        stream << originalDict;
+        stream.flush();
+    });
+    dictionarySeconds += seconds([&]()
+    {
+        fstream stream;
+        OpenStream(stream, tempFilePath, true);
+        stream >> deserializedDict;
+    });
+
+    if (originalDict != deserializedDict)
+        throw std::runtime_error("TestLargeNDArrayViewSerializationPerformance: original and deserialized dictionaries are not identical.");
+    // (generous, the point is to catch a per-element path; the constant covers the noise of small files)
+    if (dictionarySeconds > 4 * rawSeconds + 0.5)
+        throw std::runtime_error("TestLargeNDArrayViewSerializationPerformance: serializing and deserializing " + to_string(numElements) + " elements took " +
+                                 to_string(dictionarySeconds) + " s, vs. " + to_string(rawSeconds) + " s for their bytes.");
+}
+
 template <typename ElementType>
 void TestLearnerSerialization(int numParameters, const DeviceDescriptor& device) 
 {
@@ -218,6 +273,8 @@ void SerializationTests()
     TestDictionarySerialization(8);
     TestDictionarySerialization(16);
 
+    TestLargeNDArrayViewSerializationPerformance(16 * 1024 * 1024);
+
     TestLearnerSerialization<float>(5, DeviceDescriptor::CPUDevice());
     TestLearnerSerialization<double>(10, DeviceDescriptor::CPUDevice());
 
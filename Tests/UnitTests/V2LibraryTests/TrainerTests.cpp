@@ -4,6 +4,7 @@
 //
 #include "CNTKLibrary.h"
 #include <functional>
+#include <thread>
 #include "Common.h"
 
 using namespace CNTK;
@@ -123,6 +124,116 @@ void TrainMNISTClassifier(const DeviceDescriptor& device)
         trainer.TrainMinibatch({ { input, minibatchData[featureStreamInfo].m_data }, { labels, minibatchData[labelStreamInfo].m_data } }, device);
         PrintTrainingProgress(trainer, i, outputFrequencyInMinibatches);
     }
+
+    // The minibatches were prefetched onto the GPU
+    auto readerStatistics = minibatchSource->GetAndResetStatistics();
+    if (readerStatistics.m_numMinibatches != numMinibatchesToTrain)
+        throw std::runtime_error("TrainMNISTClassifier: Unexpected number of minibatches in the MinibatchSource statistics");
+    printf("Waited %.3gs for the minibatches (%d of %d prefetched in time)\n", readerStatistics.m_waitSeconds, (int)readerStatistics.m_numReadyMinibatches, (int)readerStatistics.m_numMinibatches);
+}
+
+void TrainWithSeparateLearners(const DeviceDescriptor& device)
+{
+    const size_t inputDim = 2;
+    const size_t numOutputClasses = 2;
+    const size_t minibatchSize = 25;
+    const size_t numMinibatchesToTrain = 200;
+
+    auto minibatchSource = TextFormatMinibatchSource(L"SimpleDataTrain_cntk_text.txt", { { L"features", inputDim }, { L"labels", numOutputClasses } });
+    auto featureStreamInfo = minibatchSource->StreamInfo(L"features");
+    auto labelStreamInfo = minibatchSource->StreamInfo(L"labels");
+
+    auto input = InputVariable({ inputDim }, DataType::Float, L"features");
+    auto timesParam = Parameter(NDArrayView::RandomUniform<float>({ numOutputClasses, inputDim }, -0.05, 0.05, 1, device));
+    auto biasParam = Parameter(NDArrayView::RandomUniform<float>({ numOutputClasses }, -0.05, 0.05, 1, device));
+    auto classifierOutput = Plus(biasParam, Times(timesParam, input), L"classifierOutput");
+
+    auto labels = InputVariable({ numOutputClasses }, DataType::Float, L"labels");
+    auto trainingLoss = CNTK::CrossEntropyWithSoftmax(classifierOutput, labels, L"lossFunction");
+
+    // with several learners, each one updates its parameters on a stream of its own
+    Trainer trainer(classifierOutput, trainingLoss, { SGDLearner({ timesParam }, 0.02), MomentumSGDLearner({ biasParam }, 0.01, 0.9) });
+    double firstLoss = 0, lastLoss = 0;
+    for (size_t i = 0; i < numMinibatchesToTrain; ++i)
+    {
+        auto minibatchData = minibatchSource->GetNextMinibatch(minibatchSize, device);
+        trainer.TrainMinibatch({ { input, minibatchData[featureStreamInfo].m_data }, { labels, minibatchData[labelStreamInfo].m_data } }, device);
+        if (i == 0)
+            firstLoss = trainer.PreviousMinibatchLossAverage();
+        lastLoss = trainer.PreviousMinibatchLossAverage();
+    }
+
+    if (!(lastLoss < firstLoss))
+        throw std::runtime_error("TrainWithSeparateLearners: The training loss did not decrease");
+}
+
+void TrainConcurrentTrainers(const DeviceDescriptor& device)
+{
+    const size_t inputDim = 2;
+    const size_t numOutputClasses = 2;
+    const size_t minibatchSize = 25;
+    const size_t numMinibatchesToTrain = 200;
+    const size_t numTrainers = 3;
+
+    // The same model and data for each trainer, each on a thread and stream of its own, with the chunks shared by their minibatch sources
+    std::vector<double> firstLosses(numTrainers), lastLosses(numTrainers);
+    auto train = [&](size_t trainerIndex)
+    {
+        auto minibatchSource = TextFormatMinibatchSource(L"SimpleDataTrain_cntk_text.txt", { { L"features", inputDim }, { L"labels", numOutputClasses } }, SIZE_MAX, L"TrainConcurrentTrainers");
+        auto featureStreamInfo = minibatchSource->StreamInfo(L"features");
+        auto labelStreamInfo = minibatchSource->StreamInfo(L"labels");
+
+        auto input = InputVariable({ inputDim }, DataType::Float, L"features");
+        auto timesParam = Parameter(NDArrayView::RandomUniform<float>({ numOutputClasses, inputDim }, -0.05, 0.05, 1, device));
+        auto biasParam = Parameter(NDArrayView::RandomUniform<float>({ numOutputClasses }, -0.05, 0.05, 1, device));
+        auto classifierOutput = Plus(biasParam, Times(timesParam, input), L"classifierOutput");
+
+        auto labels = InputVariable({ numOutputClasses }, DataType::Float, L"labels");
+        auto trainingLoss = CNTK::CrossEntropyWithSoftmax(classifierOutput, labels, L"lossFunction");
+
+        Trainer trainer(classifierOutput, trainingLoss, { SGDLearner(classifierOutput->Parameters(), 0.02) });
+        trainer.SetOwnComputeStream(true);
+        for (size_t i = 0; i < numMinibatchesToTrain; ++i)
+        {
+            auto minibatchData = minibatchSource->GetNextMinibatch(minibatchSize, device);
+            trainer.TrainMinibatch({ { input, minibatchData[featureStreamInfo].m_data }, { labels, minibatchData[labelStreamInfo].m_data } }, device);
+            if (i == 0)
+                firstLosses[trainerIndex] = trainer.PreviousMinibatchLossAverage();
+            lastLosses[trainerIndex] = trainer.PreviousMinibatchLossAverage();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<std::exception_ptr> errors(numTrainers);
+    for (size_t i = 0; i < numTrainers; ++i)
+    {
+        threads.push_back(std::thread([&, i]()
+        {
+            try
+            {
+                train(i);
+            }
+            catch (...)
+            {
+                errors[i] = std::current_exception();
+            }
+        }));
+    }
+    for (auto& thread : threads)
+        thread.join();
+    for (const auto& error : errors)
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    for (size_t i = 0; i < numTrainers; ++i)
+    {
+        if (!(lastLosses[i] < firstLosses[i]))
+            throw std::runtime_error("TrainConcurrentTrainers: The training loss did not decrease");
+        if (std::abs(lastLosses[i] - lastLosses[0]) > 1e-5 * std::abs(lastLosses[0]))
+            throw std::runtime_error("TrainConcurrentTrainers: The trainers of the same model and data trained differently");
+    }
 }
 
 void TrainerTests()
@@ -130,5 +241,7 @@ void TrainerTests()
     TrainSimpleFeedForwardClassifer(DeviceDescriptor::CPUDevice());
 #ifndef CPUONLY
     TrainMNISTClassifier(DeviceDescriptor::GPUDevice(0));
+    TrainWithSeparateLearners(DeviceDescriptor::GPUDevice(0));
+    TrainConcurrentTrainers(DeviceDescriptor::GPUDevice(0));
 #endif
 }